@@ -10,8 +10,13 @@
 #pragma once
 
 #include <time.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <common/fb303/if/gen-cpp2/FacebookService.h>
+#include "common/stats/ServiceData.h"
 
 namespace folly {
 class EventBaseManager;
@@ -32,6 +37,35 @@ public:
     // crude implementation because QsfpCache depends on it
     return (uint64_t) startTime;
   }
+
+  void getCounters(std::map<std::string, int64_t>& counters) override {
+    stats::ServiceData::get()->getCounters(counters);
+  }
+
+  int64_t getCounter(std::unique_ptr<std::string> key) override {
+    // Exported stats and dynamic counters only exist in getCounters().
+    auto counters = stats::ServiceData::get()->getCounters();
+    auto it = counters.find(*key);
+    return it == counters.end() ? 0 : it->second;
+  }
+
+  void getRegexCounters(
+      std::map<std::string, int64_t>& counters,
+      std::unique_ptr<std::string> regex) override {
+    counters = stats::ServiceData::get()->getRegexCounters(*regex);
+  }
+
+  void getSelectedCounters(
+      std::map<std::string, int64_t>& counters,
+      std::unique_ptr<std::vector<std::string>> keys) override {
+    auto all = stats::ServiceData::get()->getCounters();
+    for (const auto& key : *keys) {
+      auto it = all.find(key);
+      if (it != all.end()) {
+        counters.emplace(key, it->second);
+      }
+    }
+  }
 };
 
 }}
@@ -45,6 +45,22 @@ service FacebookService {
    */
   map<string, i64> getCounters(),
 
+  /**
+   * Gets the value of a single counter
+   */
+  i64 getCounter(1: string key),
+
+  /**
+   * Gets the counters whose names match a regular expression
+   */
+  map<string, i64> getRegexCounters(1: string regex),
+
+  /**
+   * Gets the values of the given counters.  Counters that do not exist
+   * are omitted.
+   */
+  map<string, i64> getSelectedCounters(1: list<string> keys),
+
   /**
    * Suggest a shutdown to the server
    */
@@ -2,20 +2,44 @@
 #pragma once
 
 #include <folly/Range.h>
+#include <folly/Synchronized.h>
+#include <cstdint>
 #include <functional>
+#include <map>
+#include <string>
 
 namespace facebook {
 namespace stats {
 
+/**
+ * Counters whose values are computed by a callback each time the counters
+ * are read, rather than being set as they change.
+ */
 class DynamicCounters {
  public:
-  using Callback = std::function<void()>;
+  using Callback = std::function<int64_t()>;
 
-  void registerCallback(folly::StringPiece /* name */,
-                        const Callback & /* callback */) {
+  void registerCallback(folly::StringPiece name, const Callback& callback) {
+    (*callbacks_.wlock())[name.str()] = callback;
   }
-  void unregisterCallback(folly::StringPiece /* name */) {
+  void unregisterCallback(folly::StringPiece name) {
+    callbacks_.wlock()->erase(name.str());
   }
+
+  /**
+   * Call every callback and store its value in `values`.  The callbacks are
+   * called without holding the lock, so they may register or unregister
+   * callbacks themselves.
+   */
+  void getValues(std::map<std::string, int64_t>& values) const {
+    auto callbacks = *callbacks_.rlock();
+    for (const auto& entry : callbacks) {
+      values[entry.first] = entry.second();
+    }
+  }
+
+ private:
+  folly::Synchronized<std::map<std::string, Callback>> callbacks_;
 };
 
 }
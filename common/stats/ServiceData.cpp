@@ -9,15 +9,304 @@
  */
 #include "common/stats/ServiceData.h"
 
-static facebook::stats::ServiceData payload;
+#include <folly/Conv.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <regex>
 
 namespace facebook {
 namespace stats {
 
+namespace {
+using StatsClock = folly::LegacyStatsClock<std::chrono::seconds>;
+
+constexpr size_t kNumBuckets = 60;
+const std::chrono::seconds kLevelDurations[] = {
+    std::chrono::seconds{60},
+    std::chrono::seconds{600},
+    std::chrono::seconds{3600},
+    // A duration of 0 keeps the all-time values.
+    std::chrono::seconds{0},
+};
+constexpr size_t kNumLevels =
+    sizeof(kLevelDurations) / sizeof(kLevelDurations[0]);
+
+StatsClock::time_point now() {
+  // LegacyStatsClock does not implement now(), so callers must supply the
+  // time.  steady_clock keeps the windows correct across clock changes.
+  return StatsClock::time_point{
+      std::chrono::duration_cast<StatsClock::duration>(
+          std::chrono::steady_clock::now().time_since_epoch())};
+}
+
+folly::MultiLevelTimeSeries<int64_t> makeTimeseries() {
+  return folly::MultiLevelTimeSeries<int64_t>{
+      kNumBuckets,
+      {kLevelDurations[0],
+       kLevelDurations[1],
+       kLevelDurations[2],
+       kLevelDurations[3]}};
+}
+
+folly::StringPiece exportTypeName(ExportType exportType) {
+  switch (exportType) {
+    case SUM:
+      return "sum";
+    case COUNT:
+      return "count";
+    case AVG:
+      return "avg";
+    case RATE:
+      return "rate";
+    case PERCENT:
+      return "pct";
+  }
+  return "unknown";
+}
+
+/**
+ * Returns the name for a percentile: "p50" for 50, "p999" for 99.9.
+ */
+std::string percentileName(double percentile) {
+  auto name = folly::to<std::string>("p", percentile);
+  name.erase(std::remove(name.begin(), name.end(), '.'), name.end());
+  return name;
+}
+
+/**
+ * Returns the suffix for a level: ".60" for the 60 second window, and
+ * nothing for all time.
+ */
+std::string levelSuffix(size_t level) {
+  auto seconds = kLevelDurations[level].count();
+  return seconds == 0 ? std::string{} : folly::to<std::string>(".", seconds);
+}
+
+/**
+ * Export the value of `series` (a MultiLevelTimeSeries or a
+ * TimeseriesHistogram) of the given type at `level`.
+ */
+template <typename Series>
+int64_t exportValue(const Series& series, ExportType exportType, size_t level) {
+  switch (exportType) {
+    case SUM:
+      return series.sum(level);
+    case COUNT:
+      return series.count(level);
+    case AVG:
+    case PERCENT:
+      return series.template avg<int64_t>(level);
+    case RATE:
+      return series.template rate<int64_t>(level);
+  }
+  return 0;
+}
+} // namespace
+
+ServiceData::Stat::Stat() : timeseries{makeTimeseries()} {}
+
+ServiceData::Histogram::Histogram(
+    size_t bucketWidth,
+    int64_t minValue,
+    int64_t maxValue)
+    : histogram{bucketWidth, minValue, maxValue, makeTimeseries()} {}
+
 ServiceData* ServiceData::get() {
-  return &payload;
+  // Leaked, so that thread-local stats aggregated while threads exit at
+  // shutdown still find it.
+  static ServiceData* serviceData = new ServiceData();
+  return serviceData;
+}
+
+std::map<std::string, int64_t> ServiceData::getCounters() const {
+  std::map<std::string, int64_t> counters;
+  getCounters(counters);
+  return counters;
+}
+
+void ServiceData::getCounters(std::map<std::string, int64_t>& counters) const {
+  // The callbacks may be slow, so call them before taking the lock.
+  counters_.getValues(counters);
+
+  auto currentTime = now();
+  auto state = state_.wlock();
+  for (const auto& entry : state->counters) {
+    counters[entry.first] = entry.second;
+  }
+  for (auto& entry : state->stats) {
+    auto& stat = *entry.second;
+    stat.timeseries.update(currentTime);
+    for (size_t level = 0; level < kNumLevels; ++level) {
+      for (auto exportType : stat.exports) {
+        counters[folly::to<std::string>(
+            entry.first,
+            ".",
+            exportTypeName(exportType),
+            levelSuffix(level))] =
+            exportValue(stat.timeseries, exportType, level);
+      }
+    }
+  }
+  for (auto& entry : state->histograms) {
+    auto& histogram = *entry.second;
+    histogram.histogram.update(currentTime);
+    for (size_t level = 0; level < kNumLevels; ++level) {
+      for (auto exportType : histogram.exports) {
+        counters[folly::to<std::string>(
+            entry.first,
+            ".",
+            exportTypeName(exportType),
+            levelSuffix(level))] =
+            exportValue(histogram.histogram, exportType, level);
+      }
+      for (auto percentile : histogram.percentiles) {
+        counters[folly::to<std::string>(
+            entry.first,
+            ".",
+            percentileName(percentile),
+            levelSuffix(level))] =
+            histogram.histogram.getPercentileEstimate(percentile, level);
+      }
+    }
+  }
+}
+
+std::map<std::string, int64_t> ServiceData::getRegexCounters(
+    folly::StringPiece regex) const {
+  std::regex pattern{regex.begin(), regex.end()};
+  auto counters = getCounters();
+  for (auto it = counters.begin(); it != counters.end();) {
+    if (std::regex_match(it->first, pattern)) {
+      ++it;
+    } else {
+      it = counters.erase(it);
+    }
+  }
+  return counters;
+}
+
+int64_t ServiceData::getCounter(folly::StringPiece key) const {
+  auto state = state_.rlock();
+  auto it = state->counters.find(key.str());
+  return it == state->counters.end() ? 0 : it->second;
+}
+
+int64_t ServiceData::clearCounter(folly::StringPiece key) {
+  auto state = state_.wlock();
+  auto it = state->counters.find(key.str());
+  if (it == state->counters.end()) {
+    return 0;
+  }
+  auto value = it->second;
+  state->counters.erase(it);
+  return value;
+}
+
+void ServiceData::setCounter(folly::StringPiece key, int64_t value) {
+  state_.wlock()->counters[key.str()] = value;
+}
+
+int64_t ServiceData::incrementCounter(folly::StringPiece key, int64_t amount) {
+  auto state = state_.wlock();
+  return state->counters[key.str()] += amount;
+}
+
+ServiceData::Stat& ServiceData::getStatLocked(
+    State& state,
+    folly::StringPiece key) {
+  auto& stat = state.stats[key.str()];
+  if (!stat) {
+    stat = std::make_unique<Stat>();
+  }
+  return *stat;
+}
+
+void ServiceData::addStatExportType(
+    folly::StringPiece key,
+    ExportType exportType) {
+  auto state = state_.wlock();
+  getStatLocked(*state, key).exports.insert(exportType);
+}
+
+void ServiceData::addStatValue(
+    folly::StringPiece key,
+    int64_t value,
+    stats::ExportType exportType) {
+  auto state = state_.wlock();
+  auto& stat = getStatLocked(*state, key);
+  stat.exports.insert(exportType);
+  stat.timeseries.addValue(now(), value);
+}
+
+void ServiceData::addStatValueAggregated(
+    folly::StringPiece key,
+    int64_t sum,
+    uint64_t numSamples) {
+  auto state = state_.wlock();
+  getStatLocked(*state, key)
+      .timeseries.addValueAggregated(now(), sum, numSamples);
+}
+
+void ServiceData::addHistogram(
+    folly::StringPiece key,
+    size_t bucketWidth,
+    int64_t minValue,
+    int64_t maxValue) {
+  auto state = state_.wlock();
+  auto& histogram = state->histograms[key.str()];
+  if (!histogram) {
+    histogram = std::make_unique<Histogram>(bucketWidth, minValue, maxValue);
+  }
+}
+
+void ServiceData::exportHistogram(folly::StringPiece key, double percentile) {
+  auto state = state_.wlock();
+  auto it = state->histograms.find(key.str());
+  CHECK(it != state->histograms.end()) << "no histogram named " << key;
+  auto& percentiles = it->second->percentiles;
+  if (std::find(percentiles.begin(), percentiles.end(), percentile) ==
+      percentiles.end()) {
+    percentiles.push_back(percentile);
+  }
+}
+
+void ServiceData::exportHistogram(
+    folly::StringPiece key,
+    ExportType exportType) {
+  auto state = state_.wlock();
+  auto it = state->histograms.find(key.str());
+  CHECK(it != state->histograms.end()) << "no histogram named " << key;
+  it->second->exports.insert(exportType);
+}
+
+void ServiceData::addHistogramValue(folly::StringPiece key, int64_t value) {
+  auto state = state_.wlock();
+  auto it = state->histograms.find(key.str());
+  if (it != state->histograms.end()) {
+    it->second->histogram.addValue(now(), value);
+  }
+}
+
+void ServiceData::addHistogramValues(
+    folly::StringPiece key,
+    const folly::Histogram<int64_t>& values) {
+  auto state = state_.wlock();
+  auto it = state->histograms.find(key.str());
+  if (it == state->histograms.end()) {
+    return;
+  }
+  auto& histogram = it->second->histogram;
+  if (histogram.getBucketSize() != values.getBucketSize() ||
+      histogram.getMin() != values.getMin() ||
+      histogram.getMax() != values.getMax()) {
+    LOG(ERROR) << "histogram " << key
+               << " was recorded with a different bucket configuration";
+    return;
+  }
+  histogram.addValues(now(), values);
 }
 } // namespace stats
 
-facebook::stats::ServiceData* fbData = &payload;
+facebook::stats::ServiceData* fbData = facebook::stats::ServiceData::get();
 } // namespace facebook
@@ -13,10 +13,31 @@
 #include "common/stats/ExportedStatMap.h"
 #include "common/stats/DynamicCounters.h"
 #include <folly/Range.h>
+#include <folly/Synchronized.h>
+#include <folly/stats/Histogram.h>
+#include <folly/stats/MultiLevelTimeSeries.h>
+#include <folly/stats/TimeseriesHistogram.h>
 #include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace facebook { namespace stats {
 
+/**
+ * The process-wide registry of counters, timeseries stats and histograms.
+ *
+ * Timeseries stats and histograms are kept over 60 second, 10 minute and
+ * one hour windows, and for all time.  getCounters() exports them in the
+ * fb303 naming scheme: "<key>.<type>.<window seconds>" for each export type
+ * that was added, such as "fuse.read_bytes.sum.60", and
+ * "<key>.p<percentile>.<window seconds>" for histogram percentiles, such as
+ * "fuse.lookup_us.p99.600".  The all-time values omit the window suffix.
+ *
+ * ThreadLocalStatsT buffers updates in each thread and adds them here when
+ * it is aggregated.  All methods are thread-safe.
+ */
 class ServiceData {
  public:
   static ServiceData* get();
@@ -29,24 +50,102 @@ class ServiceData {
     static ExportedHistogramMap it;
     return &it;
   }
-  std::map<std::string, int64_t> getCounters() const {
-    return std::map<std::string, int64_t>{};
-  }
-  void getCounters(std::map<std::string, int64_t>&) const {}
-  long getCounter(folly::StringPiece) const { return 0; };
-  long clearCounter(folly::StringPiece) { return 0; };
+
+  /**
+   * Return every counter, the values of the dynamic counters, and the
+   * exported values of the timeseries stats and histograms.
+   */
+  std::map<std::string, int64_t> getCounters() const;
+  void getCounters(std::map<std::string, int64_t>& counters) const;
+
+  /**
+   * Return the counters whose names match the given ECMAScript regular
+   * expression.  Throws std::regex_error if it is malformed.
+   */
+  std::map<std::string, int64_t> getRegexCounters(
+      folly::StringPiece regex) const;
+
+  /**
+   * Return the value of a counter set with setCounter() or
+   * incrementCounter(), or 0 if there is none.
+   */
+  int64_t getCounter(folly::StringPiece key) const;
+  int64_t clearCounter(folly::StringPiece key);
   void setUseOptionsAsFlags(bool) {}
-  void setCounter(folly::StringPiece, uint32_t) {}
+  void setCounter(folly::StringPiece key, int64_t value);
+  int64_t incrementCounter(folly::StringPiece key, int64_t amount = 1);
   DynamicCounters *getDynamicCounters() {
     return &counters_;
   }
+
+  /**
+   * Export the timeseries stat `key` with the given type, creating the stat
+   * if it does not exist yet.
+   */
+  void addStatExportType(folly::StringPiece key, ExportType exportType);
   void addStatValue(
       folly::StringPiece key,
       int64_t value,
-      stats::ExportType exportType) {}
+      stats::ExportType exportType);
+  void addStatValueAggregated(
+      folly::StringPiece key,
+      int64_t sum,
+      uint64_t numSamples);
+
+  /**
+   * Create a histogram.  Does nothing if one with this key already exists.
+   * Values outside [minValue, maxValue) are counted in the histogram's
+   * underflow and overflow buckets.
+   */
+  void addHistogram(
+      folly::StringPiece key,
+      size_t bucketWidth,
+      int64_t minValue,
+      int64_t maxValue);
+  /**
+   * Export the given percentile of a histogram, or its sum, count, average
+   * or rate.  Percentiles are named without their decimal point, so 99.9
+   * is exported as "p999".
+   */
+  void exportHistogram(folly::StringPiece key, double percentile);
+  void exportHistogram(folly::StringPiece key, ExportType exportType);
+  void addHistogramValue(folly::StringPiece key, int64_t value);
+  /**
+   * Add a batch of values recorded in a histogram with the same bucket
+   * configuration as the one that addHistogram() created for this key.
+   */
+  void addHistogramValues(
+      folly::StringPiece key,
+      const folly::Histogram<int64_t>& values);
 
  private:
+  struct Stat {
+    Stat();
+
+    folly::MultiLevelTimeSeries<int64_t> timeseries;
+    std::set<ExportType> exports;
+  };
+
+  struct Histogram {
+    Histogram(size_t bucketWidth, int64_t minValue, int64_t maxValue);
+
+    folly::TimeseriesHistogram<int64_t> histogram;
+    std::set<ExportType> exports;
+    std::vector<double> percentiles;
+  };
+
+  struct State {
+    std::map<std::string, int64_t> counters;
+    std::map<std::string, std::unique_ptr<Stat>> stats;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+  };
+
+  Stat& getStatLocked(State& state, folly::StringPiece key);
+
   DynamicCounters counters_;
+  // Reading a timeseries first expires its old data, so even getCounters()
+  // needs the write lock.
+  mutable folly::Synchronized<State> state_;
 };
 
 }
@@ -1,53 +1,213 @@
 // Copyright 2004-present Facebook. All Rights Reserved.
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <folly/Range.h>
+#include <folly/SpinLock.h>
 #include <folly/Synchronized.h>
-#include <folly/stats/TimeseriesHistogram.h>
+#include <folly/stats/Histogram.h>
 
 #include "common/stats/ExportType.h"
+#include "common/stats/ServiceData.h"
 
 namespace facebook { namespace stats {
 
 class TLStatsThreadSafe {};
 
+/**
+ * A set of stats that are cheap to update from one thread, and whose values
+ * aggregate() adds into the process-wide ServiceData, where getCounters()
+ * exports them.
+ *
+ * Each stat keeps only what has been recorded since the last aggregate().
+ * Updates may race with aggregate() running on another thread (the
+ * flushStatsNow() thread, in edenfs), so they are synchronized, but they
+ * never contend with other threads' updates.  Values not yet aggregated
+ * when the container is destroyed are aggregated then.
+ */
 template <class LockTraits>
 class ThreadLocalStatsT {
+ private:
+  /**
+   * The state of one stat.  Stats are returned by value from helper
+   * functions, so the container refers to this shared state rather than to
+   * the stat objects themselves.
+   */
+  class StatState {
+   public:
+    explicit StatState(folly::StringPiece name) : name_{name.str()} {}
+    virtual ~StatState() = default;
+    virtual void aggregate() = 0;
+
+   protected:
+    const std::string name_;
+  };
+
  public:
-  // TODO: This stub implementation just uses folly::Synchronized, and is not
-  // actually thread-local for now.
+  ThreadLocalStatsT() = default;
+  ThreadLocalStatsT(const ThreadLocalStatsT&) = delete;
+  ThreadLocalStatsT& operator=(const ThreadLocalStatsT&) = delete;
+
+  ~ThreadLocalStatsT() {
+    aggregate();
+  }
+
   class TLHistogram {
    public:
-     template <typename... ExportArgs>
-     TLHistogram(ThreadLocalStatsT *container, folly::StringPiece name,
-                 size_t bucketWidth, int64_t minValue, int64_t maxValue,
-                 ExportArgs... exports)
-         : histogram_(
-               folly::in_place, bucketWidth, minValue, maxValue,
-               folly::MultiLevelTimeSeries<int64_t>{
-                   /* num buckets */ 60,
-                   {
-                       std::chrono::seconds{60}, std::chrono::seconds{600},
-                       std::chrono::seconds{3600}, std::chrono::seconds{0},
-                   }}) {
-       // We don't handle setting up exports for now.
+    template <typename... ExportArgs>
+    TLHistogram(
+        ThreadLocalStatsT* container,
+        folly::StringPiece name,
+        size_t bucketWidth,
+        int64_t minValue,
+        int64_t maxValue,
+        ExportArgs... exports)
+        : state_{std::make_shared<State>(
+              name, bucketWidth, minValue, maxValue)} {
+      auto* serviceData = ServiceData::get();
+      serviceData->addHistogram(name, bucketWidth, minValue, maxValue);
+      using Expander = int[];
+      (void)Expander{0, (serviceData->exportHistogram(name, exports), 0)...};
+      container->registerStat(state_);
     }
 
     void addValue(int64_t value) {
-      // The default TimeseriesHistogram clock does not implement now;
-      // set the time using steady_clock here.
-      auto now = std::chrono::duration_cast<
-          folly::TimeseriesHistogram<int64_t>::Duration>(
-          std::chrono::steady_clock::now().time_since_epoch());
-      histogram_->addValue(now, value);
+      std::lock_guard<folly::SpinLock> guard(state_->lock);
+      state_->histogram.addValue(value);
+    }
+
+    void addRepeatedValue(int64_t value, int64_t nsamples) {
+      std::lock_guard<folly::SpinLock> guard(state_->lock);
+      state_->histogram.addRepeatedValue(value, nsamples);
     }
 
-  private:
-    folly::Synchronized<folly::TimeseriesHistogram<int64_t>> histogram_;
+   private:
+    struct State : StatState {
+      State(
+          folly::StringPiece name,
+          size_t bucketWidth,
+          int64_t minValue,
+          int64_t maxValue)
+          : StatState{name},
+            bucketWidth{bucketWidth},
+            minValue{minValue},
+            maxValue{maxValue},
+            histogram{bucketWidth, minValue, maxValue} {}
+
+      void aggregate() override {
+        // Swap in empty buckets rather than reading them under the lock, so
+        // that the owning thread is held up as briefly as possible.
+        folly::Histogram<int64_t> values{bucketWidth, minValue, maxValue};
+        {
+          std::lock_guard<folly::SpinLock> guard(lock);
+          std::swap(values, histogram);
+        }
+        ServiceData::get()->addHistogramValues(this->name_, values);
+      }
+
+      const size_t bucketWidth;
+      const int64_t minValue;
+      const int64_t maxValue;
+      folly::SpinLock lock;
+      folly::Histogram<int64_t> histogram;
+    };
+
+    std::shared_ptr<State> state_;
   };
 
-  void aggregate() {}
+  class TLTimeseries {
+   public:
+    template <typename... ExportArgs>
+    TLTimeseries(
+        ThreadLocalStatsT* container,
+        folly::StringPiece name,
+        ExportArgs... exports)
+        : state_{std::make_shared<State>(name)} {
+      auto* serviceData = ServiceData::get();
+      using Expander = int[];
+      (void)Expander{0, (serviceData->addStatExportType(name, exports), 0)...};
+      container->registerStat(state_);
+    }
+
+    void addValue(int64_t value) {
+      // The sum and count are read separately by aggregate(), so a value
+      // added concurrently may briefly be counted in one and not the other.
+      state_->sum.fetch_add(value, std::memory_order_relaxed);
+      state_->count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+   private:
+    struct State : StatState {
+      using StatState::StatState;
+
+      void aggregate() override {
+        auto samples = count.exchange(0, std::memory_order_relaxed);
+        auto total = sum.exchange(0, std::memory_order_relaxed);
+        if (samples != 0) {
+          ServiceData::get()->addStatValueAggregated(
+              this->name_, total, samples);
+        }
+      }
+
+      std::atomic<int64_t> sum{0};
+      std::atomic<uint64_t> count{0};
+    };
+
+    std::shared_ptr<State> state_;
+  };
+
+  class TLCounter {
+   public:
+    TLCounter(ThreadLocalStatsT* container, folly::StringPiece name)
+        : state_{std::make_shared<State>(name)} {
+      container->registerStat(state_);
+    }
+
+    void incrementValue(int64_t amount = 1) {
+      state_->delta.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+   private:
+    struct State : StatState {
+      using StatState::StatState;
+
+      void aggregate() override {
+        auto amount = delta.exchange(0, std::memory_order_relaxed);
+        if (amount != 0) {
+          ServiceData::get()->incrementCounter(this->name_, amount);
+        }
+      }
+
+      std::atomic<int64_t> delta{0};
+    };
+
+    std::shared_ptr<State> state_;
+  };
+
+  /**
+   * Add everything recorded since the last call into ServiceData.
+   * This may be called from any thread.
+   */
+  void aggregate() {
+    // Stats may be registered lazily while this runs, so iterate over a
+    // copy rather than holding the lock while updating ServiceData.
+    auto stats = *stats_.rlock();
+    for (const auto& stat : stats) {
+      stat->aggregate();
+    }
+  }
+
+ private:
+  void registerStat(std::shared_ptr<StatState> stat) {
+    stats_.wlock()->push_back(std::move(stat));
+  }
+
+  folly::Synchronized<std::vector<std::shared_ptr<StatState>>> stats_;
 };
 
 } // stats
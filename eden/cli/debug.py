@@ -41,6 +41,9 @@ from facebook.eden.ttypes import (
     JournalPosition,
     NoValueForKeyError,
     TimeSpec,
+    TraceEventInfo,
+    TraceEventPhase,
+    TracedOperation,
     TreeInodeDebugInfo,
 )
 
@@ -422,6 +425,71 @@ class FuseCallsCmd(Subcmd):
         return 0
 
 
+@debug_cmd("trace", "Show the most recent events from edenfs' trace buffers")
+class TraceCmd(Subcmd):
+    def setup_parser(self, parser: argparse.ArgumentParser) -> None:
+        parser.add_argument(
+            "--chrome",
+            action="store_true",
+            help="Print the events in the Chrome trace event format, which can "
+            "be loaded into chrome://tracing",
+        )
+        parser.add_argument(
+            "--request", type=int, help="Only show events from this request ID"
+        )
+
+    def run(self, args: argparse.Namespace) -> int:
+        instance = cmd_util.get_eden_instance(args)
+        with instance.get_thrift_client() as client:
+            events = client.debugGetRecentTraceEvents()
+        if args.request is not None:
+            events = [e for e in events if e.requestId == args.request]
+
+        if args.chrome:
+            json.dump(_chrome_trace(events), sys.stdout)
+            sys.stdout.write("\n")
+            return 0
+
+        start = events[0].timestamp if events else 0
+        for event in events:
+            print(
+                "{:12.3f}ms request {:<8} thread {:<8} {:6} {} {}".format(
+                    (event.timestamp - start) / 1000000,
+                    event.requestId,
+                    event.threadId,
+                    TraceEventPhase._VALUES_TO_NAMES[event.phase],
+                    TracedOperation._VALUES_TO_NAMES[event.operation],
+                    event.argument,
+                )
+            )
+        return 0
+
+
+def _chrome_trace(events: List[TraceEventInfo]) -> Dict[str, Any]:
+    # The begin and end of an operation may be recorded by different threads,
+    # so the events are reported as asynchronous events of their request.
+    phases = {
+        TraceEventPhase.BEGIN: "b",
+        TraceEventPhase.END: "e",
+        TraceEventPhase.INSTANT: "n",
+    }
+    trace_events = []
+    for event in events:
+        trace_events.append(
+            {
+                "name": TracedOperation._VALUES_TO_NAMES[event.operation],
+                "cat": "edenfs",
+                "ph": phases[event.phase],
+                "ts": event.timestamp / 1000,
+                "pid": 0,
+                "tid": event.threadId,
+                "id": event.requestId,
+                "args": {"argument": event.argument},
+            }
+        )
+    return {"traceEvents": trace_events, "displayTimeUnit": "ns"}
+
+
 def _print_inode_info(inode_info: TreeInodeDebugInfo, out: IO[bytes]) -> None:
     out.write(inode_info.path + b"\n")
     out.write(b"  Inode number:  %d\n" % inode_info.inodeNumber)
@@ -599,6 +667,79 @@ class OverlayCmd(Subcmd):
             )
 
 
+@debug_cmd("check_overlay", "Check a mount's overlay for consistency")
+class CheckOverlayCmd(Subcmd):
+    def setup_parser(self, parser: argparse.ArgumentParser) -> None:
+        parser.add_argument(
+            "--repair",
+            action="store_true",
+            default=False,
+            help="Remove orphaned overlay data and stray inode metadata",
+        )
+        parser.add_argument("path", nargs="?", help="The path to the eden mount point.")
+
+    def run(self, args: argparse.Namespace) -> int:
+        path = args.path or os.getcwd()
+        instance, checkout, _rel_path = cmd_util.require_checkout(args, path)
+
+        with instance.get_thrift_client() as client:
+            result = client.debugCheckOverlay(bytes(checkout.path), args.repair)
+
+        print(
+            f"Scanned {result.directoriesScanned} directories and "
+            f"{result.filesScanned} files"
+        )
+        counts = [
+            ("orphans", result.orphans),
+            ("invalid records", result.badRecords),
+            ("type mismatches", result.typeMismatches),
+            ("missing data", result.missingData),
+            ("unallocated metadata records", result.unallocatedMetadata),
+        ]
+        for name, count in counts:
+            print(f"{name}: {count}")
+        print(f"unreferenced metadata records: {result.unreferencedMetadata}")
+        if args.repair:
+            print(
+                f"Removed {result.orphansRemoved} orphans and "
+                f"{result.metadataRemoved} metadata records"
+            )
+        for problem in result.problems:
+            print(f"  inode {problem.inodeNumber}: {problem.description}")
+
+        num_problems = sum(count for _, count in counts)
+        return 1 if num_problems and not args.repair else 0
+
+
+@debug_cmd(
+    "export_tree_snapshot",
+    "Write the trees of a commit to a file that edenfs can serve them from",
+)
+class ExportTreeSnapshotCmd(Subcmd):
+    def setup_parser(self, parser: argparse.ArgumentParser) -> None:
+        parser.add_argument(
+            "--commit",
+            help="The commit to export.  Defaults to the mount's current parent.",
+        )
+        parser.add_argument("output", help="The path of the snapshot to write.")
+        parser.add_argument("path", nargs="?", help="The path to the eden mount point.")
+
+    def run(self, args: argparse.Namespace) -> int:
+        path = args.path or os.getcwd()
+        instance, checkout, _rel_path = cmd_util.require_checkout(args, path)
+        commit = parse_object_id(args.commit) if args.commit else b""
+        output = os.path.abspath(args.output)
+
+        with instance.get_thrift_client() as client:
+            num_trees = client.debugExportTreeSnapshot(
+                bytes(checkout.path), commit, os.fsencode(output)
+            )
+
+        print(f"Wrote {num_trees} trees to {output}")
+        print(f"Start edenfs with --tree_snapshot={output} to use it.")
+        return 0
+
+
 @debug_cmd("getpath", "Get the eden path that corresponds to an inode number")
 class GetPathCmd(Subcmd):
     def setup_parser(self, parser: argparse.ArgumentParser) -> None:
@@ -327,7 +327,9 @@ class FilesystemChecker:
         children: List[ChildInfo] = []
         if dir_data is not None:
             try:
-                parsed_data = self.overlay.parse_dir_inode_data(dir_data)
+                parsed_data = self.overlay.parse_dir_inode_data(
+                    dir_data, header.version
+                )
                 dir_entries = parsed_data.entries
             except Exception as ex:
                 type = InodeType.DIR_ERROR
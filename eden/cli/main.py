@@ -41,7 +41,7 @@ from . import (
     util,
     version as version_mod,
 )
-from .cmd_util import find_checkout, get_eden_instance
+from .cmd_util import find_checkout, get_eden_instance, require_checkout
 from .config import EdenInstance
 from .subcmd import Subcmd
 from .util import ShutdownError, print_stderr
@@ -667,6 +667,81 @@ class PrefetchCmd(Subcmd):
         return 0
 
 
+prefetch_profile_cmd = subcmd_mod.Decorator()
+
+
+def _add_checkout_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--checkout",
+        help="The path to an Eden checkout (default: the current directory)",
+    )
+
+
+@prefetch_profile_cmd("record", "Start recording the files opened in a checkout")
+class PrefetchProfileRecordCmd(Subcmd):
+    def setup_parser(self, parser: argparse.ArgumentParser) -> None:
+        _add_checkout_argument(parser)
+        parser.add_argument("tag", help="A name for this recording")
+
+    def run(self, args: argparse.Namespace) -> int:
+        instance, checkout, _rel_path = require_checkout(args, args.checkout)
+        with instance.get_thrift_client() as client:
+            client.startRecordingAccessProfile(bytes(checkout.path), args.tag)
+        return 0
+
+
+@prefetch_profile_cmd(
+    "finish", "Stop a recording and save the files it recorded to a profile"
+)
+class PrefetchProfileFinishCmd(Subcmd):
+    def setup_parser(self, parser: argparse.ArgumentParser) -> None:
+        _add_checkout_argument(parser)
+        parser.add_argument("tag", help="The name given to the recording")
+        parser.add_argument("output", help="The file to save the profile to")
+
+    def run(self, args: argparse.Namespace) -> int:
+        instance, checkout, _rel_path = require_checkout(args, args.checkout)
+        with instance.get_thrift_client() as client:
+            profile = client.stopRecordingAccessProfile(
+                bytes(checkout.path), args.tag
+            )
+        with open(args.output, "wb") as f:
+            f.write(profile)
+        return 0
+
+
+@prefetch_profile_cmd(
+    "replay", "Fetch the files listed in a profile for the current commit"
+)
+class PrefetchProfileReplayCmd(Subcmd):
+    def setup_parser(self, parser: argparse.ArgumentParser) -> None:
+        _add_checkout_argument(parser)
+        parser.add_argument("profile", help="A file saved by 'finish'")
+
+    def run(self, args: argparse.Namespace) -> int:
+        instance, checkout, _rel_path = require_checkout(args, args.checkout)
+        with open(args.profile, "rb") as f:
+            profile = f.read()
+        with instance.get_thrift_client() as client:
+            num_files = client.prefetchAccessProfile(bytes(checkout.path), profile)
+        print(f"Fetched {num_files} files")
+        return 0
+
+
+@subcmd(
+    "prefetch-profile",
+    "Record the files that a build opens, and fetch them before later builds",
+)
+class PrefetchProfileCmd(Subcmd):
+    def setup_parser(self, parser: argparse.ArgumentParser) -> None:
+        self.parser = parser
+        self.add_subcommands(parser, prefetch_profile_cmd.commands)
+
+    def run(self, args: argparse.Namespace) -> int:
+        self.parser.print_help()
+        return 0
+
+
 #
 # Most users should not need the "unmount" command in most circumstances.
 # Maybe we should deprecate or remove it in the future.
@@ -18,7 +18,7 @@ import struct
 from pathlib import Path
 from typing import BinaryIO, Iterator, Optional, Tuple
 
-from facebook.eden.overlay.ttypes import OverlayDir
+from facebook.eden.overlay.ttypes import OverlayDir, OverlayEntry
 
 
 class InvalidOverlayFile(Exception):
@@ -40,6 +40,8 @@ class InodeLookupError(Exception):
 class OverlayHeader:
     LENGTH = 64
     VERSION_1 = 1
+    # Directories in the compact encoding described in CompactOverlayDir.h
+    VERSION_2 = 2
 
     TYPE_DIR = b"OVDR"
     TYPE_FILE = b"OVFL"
@@ -72,7 +74,8 @@ class OverlayHeader:
             raise InvalidOverlayFile(
                 "overlay file is too short to contain a header: length={len(data)}"
             )
-        if version != cls.VERSION_1:
+        is_compact_dir = header_id == cls.TYPE_DIR and version == cls.VERSION_2
+        if version != cls.VERSION_1 and not is_compact_dir:
             raise InvalidOverlayFile(f"unsupported overlay file version {version}")
 
         return OverlayHeader(
@@ -212,9 +215,14 @@ class Overlay:
             header = self.check_header(f, inode_number, OverlayHeader.TYPE_DIR)
             data = f.read()
 
-        return (header, self.parse_dir_inode_data(data))
+        return (header, self.parse_dir_inode_data(data, header.version))
+
+    def parse_dir_inode_data(
+        self, data: bytes, version: int = OverlayHeader.VERSION_1
+    ) -> OverlayDir:
+        if version == OverlayHeader.VERSION_2:
+            return self._parse_compact_dir_data(data)
 
-    def parse_dir_inode_data(self, data: bytes) -> OverlayDir:
         from thrift.util import Serializer
         from thrift.protocol import TCompactProtocol
 
@@ -223,6 +231,38 @@ class Overlay:
         Serializer.deserialize(protocol_factory, data, tree_data)
         return tree_data
 
+    def _parse_compact_dir_data(self, data: bytes) -> OverlayDir:
+        hash_size = 20
+        count, name_table_size = struct.unpack_from("<II", data, 0)
+        offset = 8
+        inode_numbers = struct.unpack_from(f"<{count}Q", data, offset)
+        offset += 8 * count
+        modes = struct.unpack_from(f"<{count}I", data, offset)
+        offset += 4 * count
+        name_ends = struct.unpack_from(f"<{count}I", data, offset)
+        offset += 4 * count
+        bitmap = data[offset : offset + (count + 7) // 8]
+        offset += (count + 7) // 8
+        has_hash = [bool((bitmap[i // 8] >> (i % 8)) & 1) for i in range(count)]
+        names_offset = offset + hash_size * sum(has_hash)
+        if names_offset + name_table_size != len(data):
+            raise InvalidOverlayFile("malformed compact overlay directory")
+
+        entries = {}
+        name_start = 0
+        for i in range(count):
+            name_end = name_ends[i]
+            if name_end <= name_start or name_end > name_table_size:
+                raise InvalidOverlayFile("malformed compact overlay directory")
+            name = data[names_offset + name_start : names_offset + name_end]
+            name_start = name_end
+            entry = OverlayEntry(mode=modes[i], inodeNumber=inode_numbers[i])
+            if has_hash[i]:
+                entry.hash = data[offset : offset + hash_size]
+                offset += hash_size
+            entries[name.decode("utf-8", errors="surrogateescape")] = entry
+        return OverlayDir(entries=entries)
+
     def open_file_inode(self, inode_number: int) -> BinaryIO:
         return self.open_file_inode_tuple(inode_number)[1]
 
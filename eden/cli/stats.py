@@ -62,6 +62,15 @@ def do_stats_general(
                     stats_print.format_size(vm_rss_bytes),
                 )
             )
+        local_store_bytes = diag_info.localStoreMemoryBytes
+        if local_store_bytes is not None:
+            out.write(
+                format_str.format(
+                    "local store memory",
+                    ":",
+                    stats_print.format_size(local_store_bytes),
+                )
+            )
         out.write(
             format_str.format(
                 "inodes unloaded by periodic job",
@@ -88,6 +97,14 @@ def do_stats_general(
                 """
                 )
             )
+            memory = [
+                ("Inode memory", info.inodeMemoryBytes),
+                ("Open file blob memory", info.blobMemoryBytes),
+                ("Journal memory", info.journalMemoryBytes),
+            ]
+            for name, size in memory:
+                if size is not None:
+                    out.write(f"    {name}: {stats_print.format_size(size)}\n")
 
 
 @stats_cmd("memory", "Show memory statistics for Eden")
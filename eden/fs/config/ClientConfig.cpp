@@ -32,11 +32,16 @@ constexpr folly::StringPiece kBindMountsSection{"bind-mounts"};
 constexpr folly::StringPiece kRepoSection{"repository"};
 constexpr folly::StringPiece kRepoSourceKey{"path"};
 constexpr folly::StringPiece kRepoTypeKey{"type"};
+constexpr folly::StringPiece kScopeSection{"scope"};
+constexpr folly::StringPiece kScopeIncludeKey{"include"};
 
 // Files of interest in the client directory.
 const facebook::eden::RelativePathPiece kSnapshotFile{"SNAPSHOT"};
 const facebook::eden::RelativePathPiece kBindMountsDir{"bind-mounts"};
 const facebook::eden::RelativePathPiece kOverlayDir{"local"};
+// The widened scope, one included directory per line.  When present it
+// replaces the [scope] section of the config file.
+const facebook::eden::RelativePathPiece kScopeFile{"scope"};
 
 // File holding mapping of client directories.
 const facebook::eden::RelativePathPiece kClientDirectoryMap{"config.json"};
@@ -146,6 +151,17 @@ void ClientConfig::setParentCommits(Hash parent1, folly::Optional<Hash> parent2)
   return setParentCommits(ParentCommits{parent1, parent2});
 }
 
+void ClientConfig::setScopeIncludes(
+    const std::vector<RelativePath>& includes) const {
+  string contents;
+  for (const auto& include : includes) {
+    contents.append(include.stringPiece().str());
+    contents.push_back('\n');
+  }
+  auto scopePath = clientDirectory_ + kScopeFile;
+  folly::writeFileAtomic(scopePath.stringPiece(), contents);
+}
+
 const AbsolutePath& ClientConfig::getClientDirectory() const {
   return clientDirectory_;
 }
@@ -186,6 +202,23 @@ std::unique_ptr<ClientConfig> ClientConfig::loadFromClientDirectory(
     }
   }
 
+  // Load the scope, preferring one saved by setScopeIncludes().
+  string savedScope;
+  if (folly::readFile((clientDirectory + kScopeFile).c_str(), savedScope)) {
+    std::vector<StringPiece> lines;
+    folly::split('\n', savedScope, lines, /* ignoreEmpty */ true);
+    for (auto line : lines) {
+      config->scopeIncludes_.emplace_back(line);
+    }
+  } else if (auto scope = configRoot->get_table(kScopeSection.str())) {
+    auto includes = scope->get_array_of<std::string>(kScopeIncludeKey.str());
+    if (includes) {
+      for (const auto& include : *includes) {
+        config->scopeIncludes_.emplace_back(include);
+      }
+    }
+  }
+
   return config;
 }
 
@@ -107,6 +107,23 @@ class ClientConfig {
     return repoSource_;
   }
 
+  /**
+   * Get the directories that the checkout is scoped to, or an empty list if
+   * the whole checkout is visible.
+   *
+   * These come from the "include" list in the [scope] section of the config
+   * file, unless the scope has since been widened with setScopeIncludes().
+   */
+  const std::vector<RelativePath>& getScopeIncludes() const {
+    return scopeIncludes_;
+  }
+
+  /**
+   * Save a widened scope, so that it is still in effect the next time the
+   * checkout is mounted.  An empty list saves an unrestricted scope.
+   */
+  void setScopeIncludes(const std::vector<RelativePath>& includes) const;
+
   /** Path to the file where the current commit ID is stored */
   AbsolutePath getSnapshotPath() const;
 
@@ -124,6 +141,7 @@ class ClientConfig {
   std::vector<BindMount> bindMounts_;
   std::string repoType_;
   std::string repoSource_;
+  std::vector<RelativePath> scopeIncludes_;
 };
 } // namespace eden
 } // namespace facebook
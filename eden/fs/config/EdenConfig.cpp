@@ -9,6 +9,7 @@
  */
 #include "EdenConfig.h"
 #include <cpptoml.h>
+#include <folly/Conv.h>
 #include <folly/File.h>
 #include <folly/FileUtil.h>
 #include <folly/Range.h>
@@ -201,6 +202,102 @@ bool EdenConfig::getUseMononoke() const {
   return useMononoke_.getValue();
 }
 
+uint64_t EdenConfig::getTreeCacheSize() const {
+  return treeCacheSize_.getValue();
+}
+
+uint64_t EdenConfig::getBlobCacheSize() const {
+  return blobCacheSize_.getValue();
+}
+
+const std::string& EdenConfig::getBlobCacheCompression() const {
+  return blobCacheCompression_.getValue();
+}
+
+uint64_t EdenConfig::getBlobCacheCompressMinSize() const {
+  return blobCacheCompressMinSize_.getValue();
+}
+
+uint64_t EdenConfig::getBlobCacheCompressMaxSize() const {
+  return blobCacheCompressMaxSize_.getValue();
+}
+
+std::chrono::milliseconds EdenConfig::getNegativeCacheTTL() const {
+  return std::chrono::milliseconds(negativeCacheTTLMs_.getValue());
+}
+
+std::chrono::milliseconds EdenConfig::getLocalStoreGCInterval() const {
+  return std::chrono::milliseconds(localStoreGCIntervalMs_.getValue());
+}
+
+uint64_t EdenConfig::getLocalStoreBlobSizeLimit() const {
+  return localStoreBlobSizeLimit_.getValue();
+}
+
+uint64_t EdenConfig::getLocalStoreTreeSizeLimit() const {
+  return localStoreTreeSizeLimit_.getValue();
+}
+
+uint64_t EdenConfig::getMemoryLocalStoreSizeLimit() const {
+  return memoryLocalStoreSizeLimit_.getValue();
+}
+
+uint64_t EdenConfig::getRocksDbBlockCacheSize() const {
+  return rocksDbBlockCacheSize_.getValue();
+}
+
+uint64_t EdenConfig::getRocksDbBlobBlockCacheSize() const {
+  return rocksDbBlobBlockCacheSize_.getValue();
+}
+
+uint64_t EdenConfig::getRocksDbBlobBlockSize() const {
+  return rocksDbBlobBlockSize_.getValue();
+}
+
+uint64_t EdenConfig::getRocksDbTreeBlockSize() const {
+  return rocksDbTreeBlockSize_.getValue();
+}
+
+uint64_t EdenConfig::getRocksDbMetadataBlockSize() const {
+  return rocksDbMetadataBlockSize_.getValue();
+}
+
+uint64_t EdenConfig::getRocksDbBlobWriteBufferSize() const {
+  return rocksDbBlobWriteBufferSize_.getValue();
+}
+
+uint64_t EdenConfig::getRocksDbTreeWriteBufferSize() const {
+  return rocksDbTreeWriteBufferSize_.getValue();
+}
+
+uint64_t EdenConfig::getRocksDbMetadataWriteBufferSize() const {
+  return rocksDbMetadataWriteBufferSize_.getValue();
+}
+
+const std::string& EdenConfig::getRocksDbBlobCompression() const {
+  return rocksDbBlobCompression_.getValue();
+}
+
+const std::string& EdenConfig::getRocksDbTreeCompression() const {
+  return rocksDbTreeCompression_.getValue();
+}
+
+const std::string& EdenConfig::getRocksDbMetadataCompression() const {
+  return rocksDbMetadataCompression_.getValue();
+}
+
+uint64_t EdenConfig::getRocksDbBlobCompressionDictSize() const {
+  return rocksDbBlobCompressionDictSize_.getValue();
+}
+
+bool EdenConfig::getRocksDbAsyncWriteBatches() const {
+  return rocksDbAsyncWriteBatches_.getValue();
+}
+
+bool EdenConfig::getRocksDbDisableEphemeralWAL() const {
+  return rocksDbDisableEphemeralWAL_.getValue();
+}
+
 void EdenConfig::setUserConfigPath(AbsolutePath userConfigPath) {
   userConfigPath_ = userConfigPath;
 }
@@ -237,6 +334,24 @@ void EdenConfig::setUseMononoke(bool useMononoke, ConfigSource configSource) {
   return useMononoke_.setValue(useMononoke, configSource);
 }
 
+void EdenConfig::setTreeCacheSize(
+    uint64_t treeCacheSize,
+    ConfigSource configSource) {
+  return treeCacheSize_.setValue(treeCacheSize, configSource);
+}
+
+void EdenConfig::setBlobCacheSize(
+    uint64_t blobCacheSize,
+    ConfigSource configSource) {
+  return blobCacheSize_.setValue(blobCacheSize, configSource);
+}
+
+void EdenConfig::setNegativeCacheTTL(
+    std::chrono::milliseconds negativeCacheTTL,
+    ConfigSource configSource) {
+  return negativeCacheTTLMs_.setValue(negativeCacheTTL.count(), configSource);
+}
+
 bool hasConfigFileChanged(
     AbsolutePath configFileName,
     const struct stat* oldStat) {
@@ -462,5 +577,23 @@ folly::Expected<bool, std::string> FieldConverter<bool>::operator()(
       "Unexpected value: '", value, "'. Expected \"true\" or \"false\""));
 }
 
+folly::Expected<uint64_t, std::string> FieldConverter<uint64_t>::operator()(
+    folly::StringPiece value,
+    const std::map<std::string, std::string>& /* unused */) const {
+  auto result = folly::tryTo<uint64_t>(value);
+  if (result.hasError()) {
+    return folly::makeUnexpected<string>(folly::to<std::string>(
+        "Unexpected value: '", value, "'. Expected a non-negative integer"));
+  }
+  return result.value();
+}
+
+folly::Expected<std::string, std::string> FieldConverter<std::string>::
+operator()(
+    folly::StringPiece value,
+    const std::map<std::string, std::string>& /* unused */) const {
+  return value.str();
+}
+
 } // namespace eden
 } // namespace facebook
@@ -15,6 +15,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <bitset>
+#include <chrono>
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/model/ParentCommits.h"
 #include "eden/fs/utils/PathFuncs.h"
@@ -164,6 +165,33 @@ class FieldConverter<bool> {
       const std::map<std::string, std::string>& convData) const;
 };
 
+template <>
+class FieldConverter<uint64_t> {
+ public:
+  /**
+   * Convert the passed string piece to an unsigned 64-bit integer.
+   * @param convData is a map of conversion data that can be used by conversions
+   * method (for example $HOME value.)
+   * @return the converted value or an error message.
+   */
+  folly::Expected<uint64_t, std::string> operator()(
+      folly::StringPiece value,
+      const std::map<std::string, std::string>& convData) const;
+};
+
+template <>
+class FieldConverter<std::string> {
+ public:
+  /**
+   * Convert the passed string piece to a std::string. No interpretation of
+   * the value is performed.
+   * @return the converted string.
+   */
+  folly::Expected<std::string, std::string> operator()(
+      folly::StringPiece value,
+      const std::map<std::string, std::string>& convData) const;
+};
+
 /**
  * A Configuration setting is a piece of application configuration that can be
  * constructed by parsing a string. It retains values for various ConfigSources:
@@ -363,6 +391,97 @@ class EdenConfig : public ConfigSettingManager {
   /** Get the use mononoke flag. Default false */
   bool getUseMononoke() const;
 
+  /**
+   * Get the maximum number of bytes of deserialized Tree objects that the
+   * ObjectStore keeps in memory.
+   */
+  uint64_t getTreeCacheSize() const;
+
+  /**
+   * Get the maximum number of bytes of Blob objects that the ObjectStore keeps
+   * in memory.
+   */
+  uint64_t getBlobCacheSize() const;
+
+  /**
+   * Get how the blob cache compresses the blobs it holds: one of "none",
+   * "lz4" or "zstd".  Only blobs whose size lies between the minimum and
+   * maximum compressed sizes are compressed.  Default "none".
+   */
+  const std::string& getBlobCacheCompression() const;
+  uint64_t getBlobCacheCompressMinSize() const;
+  uint64_t getBlobCacheCompressMaxSize() const;
+
+  /**
+   * Get how long the ObjectStore remembers that an object was not found.
+   * Default 10 seconds; 0 disables negative caching.
+   */
+  std::chrono::milliseconds getNegativeCacheTTL() const;
+
+  /**
+   * Get how often the local store is garbage collected.
+   * Default 1 hour; 0 disables garbage collection.
+   */
+  std::chrono::milliseconds getLocalStoreGCInterval() const;
+
+  /**
+   * Get the approximate on-disk size, in bytes, that garbage collection keeps
+   * the locally cached blobs under.  0 means unlimited.
+   */
+  uint64_t getLocalStoreBlobSizeLimit() const;
+
+  /**
+   * Get the approximate on-disk size, in bytes, that garbage collection keeps
+   * the locally cached trees under.  0 means unlimited, which is the default
+   * since trees imported from flat manifests cannot be fetched again.
+   */
+  uint64_t getLocalStoreTreeSizeLimit() const;
+
+  /**
+   * Get the size limit, in bytes, for the re-fetchable contents of the
+   * in-memory local store.  0 means unlimited.
+   */
+  uint64_t getMemoryLocalStoreSizeLimit() const;
+
+  /**
+   * RocksDB column family tuning.
+   *
+   * The column families are grouped into three profiles: "blob" for the
+   * BlobFamily, "tree" for the TreeFamily, and "metadata" for the remaining
+   * small, fixed-size records (blob metadata, hg proxy hashes and commit to
+   * tree mappings).  Block sizes and write buffer sizes are in bytes.
+   * Compression is one of "none", "snappy", "lz4" or "zstd".
+   */
+  uint64_t getRocksDbBlockCacheSize() const;
+  uint64_t getRocksDbBlobBlockCacheSize() const;
+  uint64_t getRocksDbBlobBlockSize() const;
+  uint64_t getRocksDbTreeBlockSize() const;
+  uint64_t getRocksDbMetadataBlockSize() const;
+  uint64_t getRocksDbBlobWriteBufferSize() const;
+  uint64_t getRocksDbTreeWriteBufferSize() const;
+  uint64_t getRocksDbMetadataWriteBufferSize() const;
+  const std::string& getRocksDbBlobCompression() const;
+  const std::string& getRocksDbTreeCompression() const;
+  const std::string& getRocksDbMetadataCompression() const;
+
+  /**
+   * Get the maximum size of the compression dictionary trained for the blob
+   * column family.  0 disables dictionary compression.
+   */
+  uint64_t getRocksDbBlobCompressionDictSize() const;
+
+  /**
+   * Get whether RocksDB write batches are written on a dedicated writer
+   * thread rather than by the thread that fills them.  Default true.
+   */
+  bool getRocksDbAsyncWriteBatches() const;
+
+  /**
+   * Get whether RocksDB writes that only contain re-fetchable data skip the
+   * write-ahead log.  Default true.
+   */
+  bool getRocksDbDisableEphemeralWAL() const;
+
   void setUserConfigPath(AbsolutePath userConfigPath);
 
   void setSystemConfigDir(AbsolutePath systemConfigDir);
@@ -400,6 +519,20 @@ class EdenConfig : public ConfigSettingManager {
    */
   void setUseMononoke(bool useMononoke, ConfigSource configSource);
 
+  /** Set the in-memory tree cache size for the provided source.
+   */
+  void setTreeCacheSize(uint64_t treeCacheSize, ConfigSource configSource);
+
+  /** Set the in-memory blob cache size for the provided source.
+   */
+  void setBlobCacheSize(uint64_t blobCacheSize, ConfigSource configSource);
+
+  /** Set the negative cache TTL (in milliseconds) for the provided source.
+   */
+  void setNegativeCacheTTL(
+      std::chrono::milliseconds negativeCacheTTL,
+      ConfigSource configSource);
+
   /**
    *  Register the configuration setting. The fullKey is used to parse values
    *  from the toml file. It is of the form: "core:userConfigPath"
@@ -456,6 +589,95 @@ class EdenConfig : public ConfigSettingManager {
                                                  this};
   ConfigSetting<bool> useMononoke_{"mononoke:use-mononoke", false, this};
 
+  ConfigSetting<uint64_t> treeCacheSize_{"store:tree-cache-size",
+                                         64 * 1024 * 1024,
+                                         this};
+  ConfigSetting<uint64_t> blobCacheSize_{"store:blob-cache-size",
+                                         40 * 1024 * 1024,
+                                         this};
+  ConfigSetting<std::string> blobCacheCompression_{
+      "store:blob-cache-compression",
+      "none",
+      this};
+  ConfigSetting<uint64_t> blobCacheCompressMinSize_{
+      "store:blob-cache-compress-min-size",
+      256,
+      this};
+  ConfigSetting<uint64_t> blobCacheCompressMaxSize_{
+      "store:blob-cache-compress-max-size",
+      256 * 1024,
+      this};
+  ConfigSetting<uint64_t> negativeCacheTTLMs_{"store:negative-cache-ttl-ms",
+                                              10000,
+                                              this};
+  ConfigSetting<uint64_t> localStoreGCIntervalMs_{"store:gc-interval-ms",
+                                                  60 * 60 * 1000,
+                                                  this};
+  ConfigSetting<uint64_t> localStoreBlobSizeLimit_{
+      "store:blob-size-limit",
+      uint64_t{20} * 1024 * 1024 * 1024,
+      this};
+  ConfigSetting<uint64_t> localStoreTreeSizeLimit_{"store:tree-size-limit",
+                                                   0,
+                                                   this};
+  ConfigSetting<uint64_t> memoryLocalStoreSizeLimit_{
+      "store:memory-store-size-limit",
+      0,
+      this};
+
+  ConfigSetting<uint64_t> rocksDbBlockCacheSize_{"rocksdb:block-cache-size",
+                                                 64 * 1024 * 1024,
+                                                 this};
+  ConfigSetting<uint64_t> rocksDbBlobBlockCacheSize_{
+      "rocksdb:blob-block-cache-size",
+      8 * 1024 * 1024,
+      this};
+  ConfigSetting<uint64_t> rocksDbBlobBlockSize_{"rocksdb:blob-block-size",
+                                                64 * 1024,
+                                                this};
+  ConfigSetting<uint64_t> rocksDbTreeBlockSize_{"rocksdb:tree-block-size",
+                                                16 * 1024,
+                                                this};
+  ConfigSetting<uint64_t> rocksDbMetadataBlockSize_{
+      "rocksdb:metadata-block-size",
+      4 * 1024,
+      this};
+  ConfigSetting<uint64_t> rocksDbBlobWriteBufferSize_{
+      "rocksdb:blob-write-buffer-size",
+      64 * 1024 * 1024,
+      this};
+  ConfigSetting<uint64_t> rocksDbTreeWriteBufferSize_{
+      "rocksdb:tree-write-buffer-size",
+      32 * 1024 * 1024,
+      this};
+  ConfigSetting<uint64_t> rocksDbMetadataWriteBufferSize_{
+      "rocksdb:metadata-write-buffer-size",
+      16 * 1024 * 1024,
+      this};
+  ConfigSetting<std::string> rocksDbBlobCompression_{
+      "rocksdb:blob-compression",
+      "zstd",
+      this};
+  ConfigSetting<std::string> rocksDbTreeCompression_{
+      "rocksdb:tree-compression",
+      "lz4",
+      this};
+  ConfigSetting<std::string> rocksDbMetadataCompression_{
+      "rocksdb:metadata-compression",
+      "none",
+      this};
+  ConfigSetting<uint64_t> rocksDbBlobCompressionDictSize_{
+      "rocksdb:blob-compression-dict-size",
+      16 * 1024,
+      this};
+  ConfigSetting<bool> rocksDbAsyncWriteBatches_{"rocksdb:async-write-batches",
+                                               true,
+                                               this};
+  ConfigSetting<bool> rocksDbDisableEphemeralWAL_{
+      "rocksdb:disable-ephemeral-wal",
+      true,
+      this};
+
   struct stat systemConfigFileStat_ = {};
   struct stat userConfigFileStat_ = {};
 };
@@ -34,12 +34,20 @@ folly::Optional<folly::Expected<folly::File, int>>
 FileChangeMonitor::checkIfUpdated(bool noThrottle) {
   folly::Optional<folly::Expected<folly::File, int>> rslt;
 
-  if (!noThrottle && throttle()) {
-    return rslt;
+  if (!noThrottle) {
+    if (changeTracker_ && !changeTracker_->mayHaveChanged()) {
+      return rslt;
+    }
+    if (throttle()) {
+      return rslt;
+    }
   }
 
   // Update lastCheck - we use it for throttling
   lastCheck_ = std::chrono::steady_clock::now();
+  if (changeTracker_) {
+    changeTracker_->markChecked();
+  }
 
   // If there was an open error last time around, we can by-pass stat because
   // the most likely scenario is for open to continue failing.
@@ -10,10 +10,12 @@
 #pragma once
 
 #include <folly/File.h>
+#include <folly/Optional.h>
 #include <sys/stat.h>
 #include <chrono>
 #include <functional>
 
+#include "eden/fs/utils/InotifyWatcher.h"
 #include "eden/fs/utils/PathFuncs.h"
 
 namespace facebook {
@@ -29,6 +31,11 @@ namespace eden {
  *
  * FileChangeMonitor performs checks on demand. The throttleDuration setting
  * can further limit resource usage (to a maximum of 1 check/throttleDuration).
+ * With useInotify, checks are skipped altogether until inotify reports that
+ * something has happened to the file.  This is best for files that are
+ * checked often but rarely change.  Changes are seen shortly after they are
+ * made rather than immediately, since inotify events are delivered
+ * asynchronously.  If the file can't be watched, it is polled as usual.
  *
  * FileChangeMonitor is not thread safe - users are responsible for locking as
  * necessary.
@@ -38,11 +45,15 @@ class FileChangeMonitor {
   /**
    * Construct a FileChangeMonitor for the provided filePath.
    * @param throttleDuration specifies minimum time between file stats.
+   * @param useInotify only stat the file after inotify reports a change.
    */
   FileChangeMonitor(
       AbsolutePathPiece filePath,
-      std::chrono::milliseconds throttleDuration)
-      : filePath_{filePath}, throttleDuration_{throttleDuration} {
+      std::chrono::milliseconds throttleDuration,
+      bool useInotify = false)
+      : filePath_{filePath},
+        throttleDuration_{throttleDuration},
+        useInotify_{useInotify} {
     resetToForceChange();
   }
 
@@ -121,6 +132,9 @@ class FileChangeMonitor {
    * if the monitored file's path has changed.
    */
   void resetToForceChange() {
+    if (useInotify_) {
+      changeTracker_.emplace(filePath_);
+    }
     // Set values for stat to force changedSinceUpdate() to return TRUE.
     // We use a novel setting to force change to be detected
     memset(&fileStat_, 0, sizeof(struct stat));
@@ -139,6 +153,8 @@ class FileChangeMonitor {
   int openErrno_{0};
   std::chrono::milliseconds throttleDuration_;
   std::chrono::steady_clock::time_point lastCheck_;
+  bool useInotify_{false};
+  folly::Optional<InotifyChangeTracker> changeTracker_;
 };
 } // namespace eden
 } // namespace facebook
@@ -108,6 +108,38 @@ TEST_F(ClientConfigTest, testLoadFromClientDirectoryWithNoBindMounts) {
   EXPECT_EQ(expectedBindMounts, config->getBindMounts());
 }
 
+TEST_F(ClientConfigTest, testScopeIncludes) {
+  auto config = ClientConfig::loadFromClientDirectory(
+      AbsolutePath{mountPoint_.string()}, AbsolutePath{clientDir_.string()});
+  EXPECT_TRUE(config->getScopeIncludes().empty());
+
+  auto data =
+      "[repository]\n"
+      "path = \"/data/users/carenthomas/fbsource\"\n"
+      "type = \"git\"\n"
+      "[scope]\n"
+      "include = [\"src/lib\", \"docs\"]\n";
+  folly::writeFile(folly::StringPiece{data}, configDotToml_.c_str());
+  config = ClientConfig::loadFromClientDirectory(
+      AbsolutePath{mountPoint_.string()}, AbsolutePath{clientDir_.string()});
+  std::vector<RelativePath> expected;
+  expected.emplace_back("src/lib");
+  expected.emplace_back("docs");
+  EXPECT_EQ(expected, config->getScopeIncludes());
+
+  // A widened scope replaces the one in the config file.
+  expected.emplace_back("tools");
+  config->setScopeIncludes(expected);
+  config = ClientConfig::loadFromClientDirectory(
+      AbsolutePath{mountPoint_.string()}, AbsolutePath{clientDir_.string()});
+  EXPECT_EQ(expected, config->getScopeIncludes());
+
+  config->setScopeIncludes({});
+  config = ClientConfig::loadFromClientDirectory(
+      AbsolutePath{mountPoint_.string()}, AbsolutePath{clientDir_.string()});
+  EXPECT_TRUE(config->getScopeIncludes().empty());
+}
+
 TEST_F(ClientConfigTest, testMultipleParents) {
   auto config = ClientConfig::loadFromClientDirectory(
       AbsolutePath{mountPoint_.string()}, AbsolutePath{clientDir_.string()});
@@ -12,6 +12,7 @@
 #include <folly/experimental/TestUtil.h>
 #include <folly/test/TestUtils.h>
 #include <gtest/gtest.h>
+#include <thread>
 
 #include "eden/fs/config/FileChangeMonitor.h"
 #include "eden/fs/utils/PathFuncs.h"
@@ -428,3 +429,32 @@ TEST_F(FileChangeMonitorTest, openFailFixTest) {
   EXPECT_EQ(fcp.getCallbackCount(), 2);
   EXPECT_EQ(fcp.getFileContents(), dataOne_);
 }
+
+TEST_F(FileChangeMonitorTest, inotifySkipsChecksUntilFileChanges) {
+  MockFileChangeProcessor fcp;
+  auto path = AbsolutePath{(rootTestDir_->path() / "InotifyTest.txt").string()};
+  folly::writeFileAtomic(path.value(), dataOne_);
+
+  auto fcm = std::make_shared<FileChangeMonitor>(path, 0s, true);
+
+  // The first check always reports the file.
+  EXPECT_TRUE(fcm->invokeIfUpdated(std::ref(fcp)));
+  EXPECT_EQ(fcp.getCallbackCount(), 1);
+  EXPECT_EQ(fcp.getFileContents(), dataOne_);
+
+  // Unchanged, so not even stat()ed.
+  EXPECT_FALSE(fcm->invokeIfUpdated(std::ref(fcp)));
+
+  folly::writeFileAtomic(path.value(), dataTwo_);
+
+  // inotify events arrive asynchronously, so allow some time for it.
+  const auto deadline = std::chrono::steady_clock::now() + 5s;
+  while (!fcm->invokeIfUpdated(std::ref(fcp)) &&
+         std::chrono::steady_clock::now() < deadline) {
+    /* sleep override */ std::this_thread::sleep_for(1ms);
+  }
+  EXPECT_EQ(fcp.getCallbackCount(), 2);
+  EXPECT_EQ(fcp.getFileContents(), dataTwo_);
+
+  EXPECT_FALSE(fcm->invokeIfUpdated(std::ref(fcp)));
+}
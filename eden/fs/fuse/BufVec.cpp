@@ -9,20 +9,48 @@
  */
 #include "eden/fs/fuse/BufVec.h"
 
+#include <folly/Exception.h>
+#include <unistd.h>
+
 namespace facebook {
 namespace eden {
 
 BufVec::Buf::Buf(std::unique_ptr<folly::IOBuf> buf) : buf(std::move(buf)) {}
 
+BufVec::Buf::Buf(folly::File file, off_t pos, size_t size)
+    : file(std::move(file)), fd_size(size), fd_pos(pos) {}
+
+void BufVec::Buf::ensureLoaded() {
+  if (buf) {
+    return;
+  }
+  buf = folly::IOBuf::createCombined(fd_size);
+  auto res = ::pread(file.fd(), buf->writableBuffer(), fd_size, fd_pos);
+  folly::checkUnixError(res);
+  buf->append(res);
+}
+
 BufVec::BufVec(std::unique_ptr<folly::IOBuf> buf) {
   items_.emplace_back(std::make_shared<Buf>(std::move(buf)));
 }
 
+BufVec::BufVec(folly::File file, off_t offset, size_t length) {
+  items_.emplace_back(std::make_shared<Buf>(std::move(file), offset, length));
+}
+
+folly::Optional<BufVec::FileRange> BufVec::getFileRange() const {
+  if (items_.size() != 1 || items_[0]->buf) {
+    return folly::none;
+  }
+  const auto& b = items_[0];
+  return FileRange{b->file.fd(), b->fd_pos, b->fd_size};
+}
+
 folly::fbvector<struct iovec> BufVec::getIov() const {
   folly::fbvector<struct iovec> vec;
 
   for (const auto& b : items_) {
-    DCHECK(b->fd == -1) << "we don't support splicing yet";
+    b->ensureLoaded();
     b->buf->appendToIov(&vec);
   }
 
@@ -32,7 +60,7 @@ folly::fbvector<struct iovec> BufVec::getIov() const {
 size_t BufVec::size() const {
   size_t total = 0;
   for (const auto& b : items_) {
-    total += b->buf->computeChainDataLength();
+    total += b->buf ? b->buf->computeChainDataLength() : b->fd_size;
   }
   return total;
 }
@@ -41,7 +69,7 @@ std::string BufVec::copyData() const {
   std::string rv;
   rv.reserve(size());
   for (const auto& b : items_) {
-    DCHECK(b->fd == -1) << "we don't support splicing yet";
+    b->ensureLoaded();
     const auto* buf = b->buf.get();
     do {
       rv.append(reinterpret_cast<const char*>(buf->data()), buf->length());
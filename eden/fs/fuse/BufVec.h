@@ -9,6 +9,8 @@
  */
 #pragma once
 #include <folly/FBVector.h>
+#include <folly/File.h>
+#include <folly/Optional.h>
 #include <folly/io/IOBuf.h>
 
 namespace facebook {
@@ -17,14 +19,14 @@ namespace eden {
 /**
  * Represents data that may come from a buffer or a file descriptor.
  *
- * While we don't currently have a fuse client lib that supports this,
- * we want to make sure we're ready to use it, so this looks like
- * a dumb wrapper around IOBuf at the moment.
+ * Data in a file is only read into memory if it is asked for with getIov()
+ * or copyData().  FuseChannel can instead move it straight from the file to
+ * the FUSE device with splice(2); see getFileRange().
  */
 class BufVec {
   struct Buf {
     std::unique_ptr<folly::IOBuf> buf;
-    int fd{-1};
+    folly::File file;
     size_t fd_size{0};
     off_t fd_pos{-1};
 
@@ -34,10 +36,26 @@ class BufVec {
     Buf& operator=(Buf&&) = default;
 
     explicit Buf(std::unique_ptr<folly::IOBuf> buf);
+    Buf(folly::File file, off_t pos, size_t size);
+
+    /**
+     * Read the file range into buf, if this refers to a file and it has not
+     * been read yet.
+     */
+    void ensureLoaded();
   };
   folly::fbvector<std::shared_ptr<Buf>> items_;
 
  public:
+  /**
+   * A range of bytes in a file.
+   */
+  struct FileRange {
+    int fd;
+    off_t offset;
+    size_t length;
+  };
+
   BufVec(const BufVec&) = delete;
   BufVec& operator=(const BufVec&) = delete;
   BufVec(BufVec&&) = default;
@@ -45,15 +63,34 @@ class BufVec {
 
   explicit BufVec(std::unique_ptr<folly::IOBuf> buf);
 
+  /**
+   * Refer to up to length bytes of file starting at offset.  The BufVec takes
+   * ownership of the file descriptor.
+   */
+  BufVec(folly::File file, off_t offset, size_t length);
+
+  /**
+   * If this BufVec holds a single file range whose data has not been read
+   * into memory, return it.
+   *
+   * The file descriptor remains owned by the BufVec.
+   */
+  folly::Optional<FileRange> getFileRange() const;
+
   /**
    * Return an iovector suitable for e.g. writev()
    *   auto iov = buf->getIov();
    *   auto xfer = writev(fd, iov.data(), iov.size());
+   *
+   * This reads any file ranges into memory first.
    */
   folly::fbvector<struct iovec> getIov() const;
 
   /**
    * Returns the total number of bytes in the BufVec.
+   *
+   * For a file range that has not been read yet this is the length that was
+   * requested, which may be more than the file holds.
    */
   size_t size() const;
 
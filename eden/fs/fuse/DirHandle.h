@@ -25,6 +25,15 @@ class DirHandle : public FileHandleBase {
    */
   virtual folly::Future<DirList> readdir(DirList&& list, off_t off) = 0;
 
+  /**
+   * Read directory, including the attributes of the entries
+   *
+   * Send a DirList filled using DirList::addPlus().  Every entry returned
+   * with a non-zero nodeid counts as a lookup() of that entry.
+   * Send an empty DirList on end of stream.
+   */
+  virtual folly::Future<DirList> readdirplus(DirList&& list, off_t off) = 0;
+
   /**
    * Synchronize directory contents
    *
@@ -47,6 +47,40 @@ bool DirList::add(StringPiece name, const struct stat& st, off_t off) {
   return add(name, st.st_ino, mode_to_dtype(st.st_mode), off);
 }
 
+bool DirList::addPlus(
+    StringPiece name,
+    const fuse_entry_out& entry,
+    off_t off) {
+  const size_t avail = end_ - cur_;
+  const auto entLength = FUSE_NAME_OFFSET_DIRENTPLUS + name.size();
+  const auto fullSize = FUSE_DIRENT_ALIGN(entLength);
+  if (fullSize > avail) {
+    return false;
+  }
+
+  fuse_direntplus* const direntplus = reinterpret_cast<fuse_direntplus*>(cur_);
+  direntplus->entry_out = entry;
+  auto& dirent = direntplus->dirent;
+  dirent.ino = entry.attr.ino;
+  dirent.off = off;
+  dirent.namelen = name.size();
+  dirent.type = static_cast<decltype(dirent.type)>(
+      mode_to_dtype(entry.attr.mode));
+  memcpy(dirent.name, name.data(), name.size());
+  if (fullSize > entLength) {
+    // 0 out any padding
+    memset(cur_ + entLength, 0, fullSize - entLength);
+  }
+
+  cur_ += fullSize;
+  DCHECK_LE(cur_, end_);
+  return true;
+}
+
+size_t DirList::getMaxPlusEntries() const {
+  return (end_ - cur_) / FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET_DIRENTPLUS + 1);
+}
+
 StringPiece DirList::getBuf() const {
   return StringPiece(buf_.get(), cur_ - buf_.get());
 }
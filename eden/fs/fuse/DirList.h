@@ -13,6 +13,8 @@
 #include <memory>
 #include "eden/fs/utils/DirType.h"
 
+struct fuse_entry_out;
+
 namespace facebook {
 namespace eden {
 
@@ -44,6 +46,31 @@ class DirList {
    */
   bool add(folly::StringPiece name, const struct stat& st, off_t off);
 
+  /**
+   * Add a new fuse_direntplus record to the list, for replying to
+   * FUSE_READDIRPLUS.
+   *
+   * If entry.nodeid is non-zero the kernel treats the record like the reply
+   * to a lookup() call, and increments its reference count on the inode.  The
+   * caller is responsible for accounting for that reference.  If
+   * entry.nodeid is 0 the kernel only uses the name and type, and looks up
+   * the entry separately when it needs to.  entry.attr.ino and
+   * entry.attr.mode must be filled out either way.
+   *
+   * Returns true on success or false if the list is full.
+   */
+  bool addPlus(
+      folly::StringPiece name,
+      const fuse_entry_out& entry,
+      off_t off);
+
+  /**
+   * Return an upper bound on the number of addPlus() records that still fit
+   * in the list.  This lets callers avoid computing attributes for entries
+   * that cannot be returned by this call.
+   */
+  size_t getMaxPlusEntries() const;
+
   folly::StringPiece getBuf() const;
 };
 
@@ -54,9 +54,31 @@ fuse_attr_out Dispatcher::Attr::asFuseAttr() const {
   return result;
 }
 
+fuse_entry_out computeEntryParam(
+    InodeNumber number,
+    const Dispatcher::Attr& attr) {
+  fuse_entry_out entry;
+  entry.nodeid = number.get();
+  entry.generation = 1;
+  auto fuse_attr = attr.asFuseAttr();
+  entry.attr = fuse_attr.attr;
+  entry.attr_valid = fuse_attr.attr_valid;
+  entry.attr_valid_nsec = fuse_attr.attr_valid_nsec;
+  entry.entry_valid = fuse_attr.attr_valid;
+  entry.entry_valid_nsec = fuse_attr.attr_valid_nsec;
+  return entry;
+}
+
 Dispatcher::~Dispatcher() {}
 
-Dispatcher::Dispatcher(ThreadLocalEdenStats* stats) : stats_(stats) {}
+Dispatcher::Dispatcher(
+    ThreadLocalEdenStats* stats,
+    ThreadLocalEdenStats* mountStats)
+    : stats_(stats),
+      mountStats_(mountStats),
+      lastRequestTime_(
+          std::chrono::steady_clock::now().time_since_epoch().count()),
+      processAccessLog_(std::make_shared<ProcessAccessLog>()) {}
 
 FileHandleMap& Dispatcher::getFileHandles() {
   return fileHandles_;
@@ -87,6 +109,12 @@ folly::Future<fuse_entry_out> Dispatcher::lookup(
 
 void Dispatcher::forget(InodeNumber /*ino*/, unsigned long /*nlookup*/) {}
 
+void Dispatcher::batchForget(folly::Range<const InodeForget*> forgets) {
+  for (const auto& forget : forgets) {
+    this->forget(forget.first, forget.second);
+  }
+}
+
 folly::Future<Dispatcher::Attr> Dispatcher::getattr(InodeNumber /*ino*/) {
   throwSystemErrorExplicit(ENOENT);
 }
@@ -238,5 +266,63 @@ ThreadLocalEdenStats* Dispatcher::getStats() const {
   return stats_;
 }
 
+ThreadLocalEdenStats* Dispatcher::getMountStats() const {
+  return mountStats_;
+}
+
+namespace {
+bool mayModify(uint32_t opcode) {
+  switch (opcode) {
+    case FUSE_SETATTR:
+    case FUSE_SYMLINK:
+    case FUSE_MKNOD:
+    case FUSE_MKDIR:
+    case FUSE_UNLINK:
+    case FUSE_RMDIR:
+    case FUSE_RENAME:
+    case FUSE_RENAME2:
+    case FUSE_LINK:
+    case FUSE_WRITE:
+    case FUSE_CREATE:
+    case FUSE_FALLOCATE:
+    case FUSE_SETXATTR:
+    case FUSE_REMOVEXATTR:
+      return true;
+    default:
+      return false;
+  }
+}
+} // namespace
+
+void Dispatcher::recordRequest(const fuse_in_header& header) {
+  lastRequestTime_.store(
+      std::chrono::steady_clock::now().time_since_epoch().count(),
+      std::memory_order_relaxed);
+  if (mayModify(header.opcode)) {
+    bumpModificationGeneration();
+  }
+
+  // The kernel sends some requests, such as FUSE_FORGET, on its own behalf.
+  if (header.pid > 0) {
+    processAccessLog_->recordFuseRequest(header.pid);
+    ProcessAccessLog::setCurrent(processAccessLog_, header.pid);
+  }
+}
+
+void Dispatcher::recordRequestFinished(const fuse_in_header& header) {
+  // Bump the generation again, so that reads arriving after the
+  // modification was answered do not join reads that started before it.
+  if (mayModify(header.opcode)) {
+    bumpModificationGeneration();
+  }
+}
+
+std::chrono::steady_clock::time_point Dispatcher::getLastRequestTime()
+    const {
+  return std::chrono::steady_clock::time_point{
+      std::chrono::steady_clock::duration{
+          lastRequestTime_.load(std::memory_order_relaxed)}};
+}
+
 } // namespace eden
 } // namespace facebook
@@ -12,9 +12,13 @@
 #include <folly/Portability.h>
 #include <folly/Range.h>
 #include <sys/statvfs.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include "eden/fs/fuse/FileHandleMap.h"
 #include "eden/fs/fuse/FuseTypes.h"
 #include "eden/fs/utils/PathFuncs.h"
+#include "eden/fs/utils/ProcessAccessLog.h"
 
 namespace folly {
 template <class T, class Tag, class AccessMode>
@@ -41,16 +45,80 @@ class DirHandle;
 class MountPoint;
 using ThreadLocalEdenStats = folly::ThreadLocal<EdenStats, EdenStatsTag, void>;
 
+/**
+ * An inode number and the number of lookups on it to forget.
+ */
+using InodeForget = std::pair<InodeNumber, uint32_t>;
+
 class Dispatcher {
   fuse_init_out connInfo_;
   ThreadLocalEdenStats* stats_{nullptr};
+  ThreadLocalEdenStats* mountStats_{nullptr};
   FileHandleMap fileHandles_;
+  // When the last request arrived, in steady_clock ticks.
+  std::atomic<std::chrono::steady_clock::rep> lastRequestTime_;
+  // Bumped as each request that may modify the mount starts and finishes.
+  std::atomic<uint64_t> modificationGeneration_{0};
+  // Shared with the RequestContexts of the requests it attributes fetches
+  // to, which may outlive this Dispatcher.
+  std::shared_ptr<ProcessAccessLog> processAccessLog_;
 
  public:
   virtual ~Dispatcher();
 
-  explicit Dispatcher(ThreadLocalEdenStats* stats);
+  /**
+   * stats holds the process-wide request stats.  If mountStats is non-null,
+   * requests are also recorded there, for the stats of this mount alone.
+   */
+  explicit Dispatcher(
+      ThreadLocalEdenStats* stats,
+      ThreadLocalEdenStats* mountStats = nullptr);
   ThreadLocalEdenStats* getStats() const;
+  ThreadLocalEdenStats* getMountStats() const;
+
+  /**
+   * Note that a request from the kernel has arrived.  FuseChannel calls
+   * this as it starts each request, in the request's RequestContext, so
+   * that the backing store fetches it causes are attributed to the process
+   * that made it.
+   */
+  void recordRequest(const fuse_in_header& header);
+
+  /**
+   * Note that a request has been answered.  FuseChannel calls this after
+   * sending the reply to each request.
+   */
+  void recordRequestFinished(const fuse_in_header& header);
+
+  /**
+   * Return a number that changes whenever a request that may modify the
+   * mount starts or finishes.  Two reads that see the same generation
+   * overlapped exactly the same modifications, so they may share a result.
+   */
+  uint64_t getModificationGeneration() const {
+    return modificationGeneration_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Change the modification generation for a change to the mount that does
+   * not come through FUSE, such as a checkout.
+   */
+  void bumpModificationGeneration() {
+    modificationGeneration_.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  /**
+   * Return the FUSE requests and fetches of the processes using this mount.
+   */
+  const ProcessAccessLog& getProcessAccessLog() const {
+    return *processAccessLog_;
+  }
+
+  /**
+   * Return when the last request arrived, or when this Dispatcher was
+   * created if none has.
+   */
+  std::chrono::steady_clock::time_point getLastRequestTime() const;
 
   const fuse_init_out& getConnInfo() const;
   FileHandleMap& getFileHandles();
@@ -103,6 +171,15 @@ class Dispatcher {
    */
   virtual void forget(InodeNumber ino, unsigned long nlookup);
 
+  /**
+   * Forget about several inodes at once.
+   *
+   * This is used for FUSE_BATCH_FORGET, which the kernel sends with up to
+   * thousands of entries when it shrinks its dentry cache.  The default
+   * implementation calls forget() for each entry.
+   */
+  virtual void batchForget(folly::Range<const InodeForget*> forgets);
+
   /**
    * The stat information and the cache TTL for the kernel
    *
@@ -349,5 +426,13 @@ class Dispatcher {
   bmap(InodeNumber ino, size_t blocksize, uint64_t idx);
 };
 
+/**
+ * Compute the fuse_entry_out to return to the kernel for an inode that is
+ * being handed out by lookup(), create(), readdirplus() and friends.
+ */
+fuse_entry_out computeEntryParam(
+    InodeNumber number,
+    const Dispatcher::Attr& attr);
+
 } // namespace eden
 } // namespace facebook
@@ -9,9 +9,14 @@
  */
 #include "eden/fs/fuse/EdenStats.h"
 
+#include <folly/Conv.h>
 #include <folly/container/Array.h>
+#include <algorithm>
+#include <cctype>
 #include <chrono>
 
+#include "eden/fs/fuse/FuseTypes.h"
+
 using namespace folly;
 using namespace std::chrono;
 
@@ -24,18 +29,50 @@ constexpr std::chrono::microseconds kBucketSize{1000};
 namespace facebook {
 namespace eden {
 
-EdenStats::EdenStats() {}
+EdenStats::EdenStats(StringPiece prefix) : prefix_{prefix.str()} {}
 
 EdenStats::Histogram EdenStats::createHistogram(const std::string& name) {
+  return createHistogram(
+      name, kBucketSize.count(), kMinValue.count(), kMaxValue.count());
+}
+
+EdenStats::Histogram EdenStats::createHistogram(
+    const std::string& name,
+    int64_t bucketSize,
+    int64_t minValue,
+    int64_t maxValue) {
   return Histogram{this,
-                   name,
-                   kBucketSize.count(),
-                   kMinValue.count(),
-                   kMaxValue.count(),
+                   folly::to<std::string>(prefix_, ".", name),
+                   static_cast<size_t>(bucketSize),
+                   minValue,
+                   maxValue,
                    facebook::stats::COUNT,
                    50,
                    90,
-                   99};
+                   99,
+                   99.9};
+}
+
+EdenStats::Timeseries EdenStats::createTimeseries(StringPiece name) {
+  return Timeseries{this,
+                    folly::to<std::string>(prefix_, ".", name),
+                    facebook::stats::SUM,
+                    facebook::stats::RATE};
+}
+
+EdenStats::Counter& EdenStats::getInflightCounter(uint32_t opcode) {
+  auto& counter = inflightCounters_[opcode];
+  if (!counter) {
+    // Turn "FUSE_LOOKUP" into "lookup", matching the histogram names.
+    auto opName = fuseOpcodeName(opcode);
+    opName.removePrefix("FUSE_");
+    auto lowerName = opName.str();
+    std::transform(
+        lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+    counter = std::make_unique<Counter>(
+        this, folly::to<std::string>(prefix_, ".", lowerName, "_inflight"));
+  }
+  return *counter;
 }
 
 void EdenStats::recordLatency(
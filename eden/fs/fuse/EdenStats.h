@@ -9,6 +9,10 @@
  */
 #pragma once
 
+#include <folly/Range.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include "common/stats/ThreadLocalStats.h"
 
 namespace folly {
@@ -33,56 +37,131 @@ using ThreadLocalEdenStats = folly::ThreadLocal<EdenStats, EdenStatsTag, void>;
  * Each EdenStats object should only be used from a single thread.
  * The ThreadLocalEdenStats object should be used to maintain one EdenStats
  * object for each thread that needs to access/update the stats.
+ *
+ * ServerState holds the process-wide stats, whose names all start with
+ * "fuse.".  Each EdenMount also has its own set, named with the prefix from
+ * EdenMount::getCounterName(CounterName::FUSE), so that a slow mount can be
+ * told apart from the others.
  */
 class EdenStats : public facebook::stats::ThreadLocalStatsT<
                       facebook::stats::TLStatsThreadSafe> {
+ private:
+  // This must be declared before the stats below, since they are named
+  // using it.
+  const std::string prefix_;
+
  public:
   using Histogram = TLHistogram;
+  using Timeseries = TLTimeseries;
+  using Counter = TLCounter;
 
-  explicit EdenStats();
+  explicit EdenStats(folly::StringPiece prefix = "fuse");
 
   // We track latency in units of microseconds, hence the _us suffix
   // in the histogram names below.
 
-  Histogram lookup{createHistogram("fuse.lookup_us")};
-  Histogram forget{createHistogram("fuse.forget_us")};
-  Histogram getattr{createHistogram("fuse.getattr_us")};
-  Histogram setattr{createHistogram("fuse.setattr_us")};
-  Histogram readlink{createHistogram("fuse.readlink_us")};
-  Histogram mknod{createHistogram("fuse.mknod_us")};
-  Histogram mkdir{createHistogram("fuse.mkdir_us")};
-  Histogram unlink{createHistogram("fuse.unlink_us")};
-  Histogram rmdir{createHistogram("fuse.rmdir_us")};
-  Histogram symlink{createHistogram("fuse.symlink_us")};
-  Histogram rename{createHistogram("fuse.rename_us")};
-  Histogram link{createHistogram("fuse.link_us")};
-  Histogram open{createHistogram("fuse.open_us")};
-  Histogram read{createHistogram("fuse.read_us")};
-  Histogram write{createHistogram("fuse.write_us")};
-  Histogram flush{createHistogram("fuse.flush_us")};
-  Histogram release{createHistogram("fuse.release_us")};
-  Histogram fsync{createHistogram("fuse.fsync_us")};
-  Histogram opendir{createHistogram("fuse.opendir_us")};
-  Histogram readdir{createHistogram("fuse.readdir_us")};
-  Histogram releasedir{createHistogram("fuse.releasedir_us")};
-  Histogram fsyncdir{createHistogram("fuse.fsyncdir_us")};
-  Histogram statfs{createHistogram("fuse.statfs_us")};
-  Histogram setxattr{createHistogram("fuse.setxattr_us")};
-  Histogram getxattr{createHistogram("fuse.getxattr_us")};
-  Histogram listxattr{createHistogram("fuse.listxattr_us")};
-  Histogram removexattr{createHistogram("fuse.removexattr_us")};
-  Histogram access{createHistogram("fuse.access_us")};
-  Histogram create{createHistogram("fuse.create_us")};
-  Histogram bmap{createHistogram("fuse.bmap_us")};
-  Histogram ioctl{createHistogram("fuse.ioctl_us")};
-  Histogram poll{createHistogram("fuse.poll_us")};
-  Histogram forgetmulti{createHistogram("fuse.forgetmulti_us")};
+  Histogram lookup{createHistogram("lookup_us")};
+  Histogram forget{createHistogram("forget_us")};
+  Histogram getattr{createHistogram("getattr_us")};
+  Histogram setattr{createHistogram("setattr_us")};
+  Histogram readlink{createHistogram("readlink_us")};
+  Histogram mknod{createHistogram("mknod_us")};
+  Histogram mkdir{createHistogram("mkdir_us")};
+  Histogram unlink{createHistogram("unlink_us")};
+  Histogram rmdir{createHistogram("rmdir_us")};
+  Histogram symlink{createHistogram("symlink_us")};
+  Histogram rename{createHistogram("rename_us")};
+  Histogram link{createHistogram("link_us")};
+  Histogram open{createHistogram("open_us")};
+  Histogram read{createHistogram("read_us")};
+  Histogram write{createHistogram("write_us")};
+  Histogram flush{createHistogram("flush_us")};
+  Histogram release{createHistogram("release_us")};
+  Histogram fsync{createHistogram("fsync_us")};
+  Histogram opendir{createHistogram("opendir_us")};
+  Histogram readdir{createHistogram("readdir_us")};
+  Histogram readdirplus{createHistogram("readdirplus_us")};
+  Histogram releasedir{createHistogram("releasedir_us")};
+  Histogram fsyncdir{createHistogram("fsyncdir_us")};
+  Histogram statfs{createHistogram("statfs_us")};
+  Histogram setxattr{createHistogram("setxattr_us")};
+  Histogram getxattr{createHistogram("getxattr_us")};
+  Histogram listxattr{createHistogram("listxattr_us")};
+  Histogram removexattr{createHistogram("removexattr_us")};
+  Histogram access{createHistogram("access_us")};
+  Histogram create{createHistogram("create_us")};
+  Histogram bmap{createHistogram("bmap_us")};
+  Histogram ioctl{createHistogram("ioctl_us")};
+  Histogram poll{createHistogram("poll_us")};
+  Histogram forgetmulti{createHistogram("forgetmulti_us")};
+
+  // The stages of the requests sampled by --fuse_stage_timing_sample_rate:
+  // waiting to be handled, the handler's synchronous work, waiting for
+  // inodes to load, and writing the reply to the FUSE device.
+  Histogram requestQueueWait{createHistogram("request_queue_wait_us")};
+  Histogram requestDispatch{createHistogram("request_dispatch_us")};
+  Histogram requestInodeLoad{createHistogram("request_inode_load_us")};
+  Histogram requestReplyWrite{createHistogram("request_reply_write_us")};
+
+  // The number of bytes copied into new buffers to build each FUSE_READ
+  // reply.  Reads that share the buffers of an already loaded blob record 0.
+  Histogram readBytesCopied{createHistogram(
+      "read_bytes_copied",
+      kReadBytesBucketSize,
+      0,
+      kReadBytesMaxValue)};
+
+  // The number of bytes returned by FUSE_READ and accepted by FUSE_WRITE.
+  Timeseries readBytes{createTimeseries("read_bytes")};
+  Timeseries writeBytes{createTimeseries("write_bytes")};
+
+  // Writes merged into a file's write buffer by --write_buffer_size, and
+  // the writes of those buffers to the overlay.
+  Timeseries bufferedWrites{createTimeseries("buffered_writes")};
+  Timeseries writeBufferFlushes{createTimeseries("write_buffer_flushes")};
+
+  // Children loaded by TreeInode::bulkLoadChildren(), and how many of them
+  // were then looked up.  The ratio tells whether
+  // --bulk_load_children_max_entries is worth its memory.
+  Timeseries bulkLoadedChildren{createTimeseries("bulk_loaded_children")};
+  Timeseries bulkLoadHits{createTimeseries("bulk_load_hits")};
+
+  // FUSE_LOOKUP and FUSE_GETATTR requests that shared the result of an
+  // identical request already in progress, rather than computing their own.
+  Timeseries coalescedLookups{createTimeseries("coalesced_lookups")};
+  Timeseries coalescedGetattrs{createTimeseries("coalesced_getattrs")};
+
+  // Blobs prefetched by TreeInode::prefetchSiblingBlobs() when a directory's
+  // files are loaded in order, and how many of them were then loaded.
+  Timeseries siblingBlobsPrefetched{
+      createTimeseries("sibling_blobs_prefetched")};
+  Timeseries siblingBlobPrefetchHits{
+      createTimeseries("sibling_blob_prefetch_hits")};
+
+  // Directory entry invalidations sent to the kernel for changes made outside
+  // of FUSE requests, such as by checkout, and the ones skipped because the
+  // kernel could not have cached the entry.
+  Timeseries entryInvalidationsSent{
+      createTimeseries("entry_invalidations_sent")};
+  Timeseries entryInvalidationsSkipped{
+      createTimeseries("entry_invalidations_skipped")};
+
+  /**
+   * Returns the number of requests with the given opcode that are currently
+   * in progress, e.g. "fuse.lookup_inflight".
+   *
+   * Requests may finish on a different thread from the one that started
+   * them, so each thread's counter only holds its own increments and
+   * decrements.  They add up to the number in flight once aggregated.
+   */
+  Counter& getInflightCounter(uint32_t opcode);
 
   // Since we can potentially finish a request in a different
   // thread from the one used to initiate it, we use HistogramPtr
   // as a helper for referencing the pointer-to-member that we
   // want to update at the end of the request.
   using HistogramPtr = Histogram EdenStats::*;
+  using TimeseriesPtr = Timeseries EdenStats::*;
 
   /** Record a the latency for an operation.
    * item is the pointer-to-member for one of the histograms defined
@@ -97,7 +176,18 @@ class EdenStats : public facebook::stats::ThreadLocalStatsT<
       std::chrono::seconds now);
 
  private:
+  static constexpr int64_t kReadBytesBucketSize = 16 * 1024;
+  static constexpr int64_t kReadBytesMaxValue = 1024 * 1024;
+
   Histogram createHistogram(const std::string& name);
+  Histogram createHistogram(
+      const std::string& name,
+      int64_t bucketSize,
+      int64_t minValue,
+      int64_t maxValue);
+  Timeseries createTimeseries(folly::StringPiece name);
+
+  std::unordered_map<uint32_t, std::unique_ptr<Counter>> inflightCounters_;
 };
 
 } // namespace eden
@@ -12,6 +12,7 @@
 #include <folly/Exception.h>
 #include <folly/FileUtil.h>
 #include <folly/Random.h>
+#include <folly/hash/Hash.h>
 #include <folly/logging/xlog.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
@@ -24,9 +25,19 @@ using apache::thrift::CompactSerializer;
 namespace facebook {
 namespace eden {
 
+constexpr size_t FileHandleMap::kNumShards;
+
+FileHandleMap::Shard& FileHandleMap::getShard(uint64_t fh) {
+  // Handle numbers are usually object addresses, whose low bits are always
+  // zero, so mix them before picking a shard.
+  static_assert(
+      (kNumShards & (kNumShards - 1)) == 0, "kNumShards must be a power of 2");
+  return shards_[folly::hash::twang_mix64(fh) & (kNumShards - 1)];
+}
+
 std::shared_ptr<FileHandleBase> FileHandleMap::getGenericFileHandle(
     uint64_t fh) {
-  const auto handles = handles_.rlock();
+  const auto handles = getShard(fh).rlock();
   const auto iter = handles->find(fh);
   if (iter == handles->end()) {
     folly::throwSystemErrorExplicit(
@@ -58,7 +69,7 @@ std::shared_ptr<DirHandle> FileHandleMap::getDirHandle(uint64_t fh) {
 void FileHandleMap::recordHandle(
     std::shared_ptr<FileHandleBase> fh,
     uint64_t number) {
-  const auto handles = handles_.wlock();
+  const auto handles = getShard(number).wlock();
 
   if (handles->find(number) != handles->end()) {
     folly::throwSystemErrorExplicit(
@@ -69,8 +80,6 @@ void FileHandleMap::recordHandle(
 }
 
 uint64_t FileHandleMap::recordHandle(std::shared_ptr<FileHandleBase> fh) {
-  auto handles = handles_.wlock();
-
   // Our assignment strategy is just to take the address of the instance
   // and return that as a 64-bit number.  This avoids needing to use
   // any other mechanism for assigning or tracking numbers and keeps the
@@ -89,6 +98,7 @@ uint64_t FileHandleMap::recordHandle(std::shared_ptr<FileHandleBase> fh) {
 
   auto number = reinterpret_cast<uint64_t>(fh.get());
   for (auto attempts = 0; attempts < 100; ++attempts) {
+    auto handles = getShard(number).wlock();
     auto& entry = (*handles)[number];
 
     if (LIKELY(!entry)) {
@@ -111,7 +121,7 @@ uint64_t FileHandleMap::recordHandle(std::shared_ptr<FileHandleBase> fh) {
 
 std::shared_ptr<FileHandleBase> FileHandleMap::forgetGenericHandle(
     uint64_t fh) {
-  const auto handles = handles_.wlock();
+  const auto handles = getShard(fh).wlock();
 
   const auto iter = handles->find(fh);
   if (iter == handles->end()) {
@@ -125,21 +135,23 @@ std::shared_ptr<FileHandleBase> FileHandleMap::forgetGenericHandle(
 SerializedFileHandleMap FileHandleMap::serializeMap() {
   SerializedFileHandleMap result;
 
-  const auto handles = handles_.wlock();
-  for (const auto& it : *handles) {
-    FileHandleMapEntry entry;
+  for (auto& shard : shards_) {
+    const auto handles = shard.wlock();
+    for (const auto& it : *handles) {
+      FileHandleMapEntry entry;
 
-    entry.handleId = (int64_t)it.first;
-    entry.isDir = std::dynamic_pointer_cast<DirHandle>(it.second) != nullptr;
-    entry.inodeNumber = it.second->getInodeNumber().get();
+      entry.handleId = (int64_t)it.first;
+      entry.isDir = std::dynamic_pointer_cast<DirHandle>(it.second) != nullptr;
+      entry.inodeNumber = it.second->getInodeNumber().get();
 
-    result.entries.push_back(std::move(entry));
-  }
+      result.entries.push_back(std::move(entry));
+    }
 
-  // Release all of the file handle instances that we've been maintaining;
-  // this unblocks tearing down the InodeMap that will happen shortly
-  // during graceful restart.
-  handles->clear();
+    // Release all of the file handle instances that we've been maintaining;
+    // this unblocks tearing down the InodeMap that will happen shortly
+    // during graceful restart.
+    handles->clear();
+  }
   return result;
 }
 
@@ -9,8 +9,12 @@
  */
 #pragma once
 #include <folly/Range.h>
+#include <folly/SharedMutex.h>
 #include <folly/Synchronized.h>
+#include <array>
+#include <memory>
 #include <unordered_map>
+#include "eden/fs/utils/LockProfiler.h"
 
 namespace facebook {
 namespace eden {
@@ -31,6 +35,13 @@ class SerializedFileHandleMap;
  * During a hot upgrade we intend to use this mapping to pass information
  * on to the replacement child process, although that functionality has
  * not yet been written.
+ *
+ * Every READ, WRITE, FLUSH and RELEASE looks up a handle, so the map is
+ * split into shards with their own locks.  Requests for different handles
+ * rarely contend, and lookups only need a shared lock on their shard.
+ * Handle numbers are chosen freely when opening a file but must be
+ * preserved across a graceful restart, which is why they are not simply
+ * indexes into a table.
  */
 class FileHandleMap {
  public:
@@ -77,9 +88,21 @@ class FileHandleMap {
   SerializedFileHandleMap serializeMap();
 
  private:
-  folly::Synchronized<
-      std::unordered_map<uint64_t, std::shared_ptr<FileHandleBase>>>
-      handles_;
+  struct ShardLockName {
+    static folly::StringPiece name() {
+      return "file_handle_map";
+    }
+  };
+  using Shard = folly::Synchronized<
+      std::unordered_map<uint64_t, std::shared_ptr<FileHandleBase>>,
+      ProfiledSharedMutex<ShardLockName>>;
+
+  // A power of two, so that picking a shard is a mask.
+  static constexpr size_t kNumShards = 64;
+
+  Shard& getShard(uint64_t fh);
+
+  std::array<Shard, kNumShards> shards_;
 };
 
 } // namespace eden
@@ -9,25 +9,91 @@
  */
 #include "eden/fs/fuse/FuseChannel.h"
 
+#include <algorithm>
 #include <boost/cast.hpp>
+#include <fcntl.h>
+#include <folly/FileUtil.h>
+#include <folly/ScopeGuard.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
 #include <folly/futures/helpers.h>
 #include <folly/io/async/Request.h>
 #include <folly/logging/xlog.h>
 #include <folly/system/ThreadName.h>
+#include <gflags/gflags.h>
 #include <signal.h>
+#include <sys/ioctl.h>
 #include <type_traits>
+#include <unordered_set>
+#include "eden/fs/fuse/BufVec.h"
 #include "eden/fs/fuse/DirHandle.h"
 #include "eden/fs/fuse/DirList.h"
 #include "eden/fs/fuse/Dispatcher.h"
 #include "eden/fs/fuse/FileHandle.h"
+#include "eden/fs/fuse/FuseTrace.h"
 #include "eden/fs/fuse/RequestData.h"
 #include "eden/fs/utils/Bug.h"
+#include "eden/fs/utils/CycleClock.h"
 #include "eden/fs/utils/Synchronized.h"
 #include "eden/fs/utils/SystemError.h"
 
 using namespace folly;
 using std::string;
 
+DEFINE_bool(
+    fuse_splice_reads,
+    false,
+    "Reply to reads of materialized files by splicing their data from the "
+    "overlay to the FUSE device, if the kernel supports it.");
+DEFINE_bool(
+    fuse_readdirplus,
+    true,
+    "Let the kernel use READDIRPLUS to fetch directory entries together with "
+    "their attributes, when it decides that is worthwhile.");
+DEFINE_bool(
+    fuse_writeback_cache,
+    false,
+    "Let the kernel cache writes and send them to us in large batches, "
+    "rather than sending each write() call synchronously.");
+DEFINE_uint64(
+    fuse_max_worker_threads,
+    64,
+    "The number of FUSE worker threads each mount may grow to when all of its "
+    "threads are busy.  Extra threads exit again once the load drops.");
+DEFINE_uint64(
+    fuse_max_blocking_workers,
+    8,
+    "The number of FUSE worker threads per mount that may be busy with "
+    "requests that can block on the object store, such as lookup and read.  "
+    "Further such requests are handed to a shared thread pool, so that the "
+    "workers stay available for other requests.  0 means no limit.");
+DEFINE_uint64(
+    fuse_invalidation_threads,
+    4,
+    "The number of threads used to send large batches of kernel cache "
+    "invalidations, e.g. during checkout.");
+DEFINE_bool(
+    fuse_parallel_dirops,
+    true,
+    "Let the kernel send lookup and readdir requests for the same directory "
+    "concurrently, rather than one at a time.");
+DEFINE_bool(
+    fuse_clone_device,
+    true,
+    "Give each FUSE worker thread its own clone of the FUSE device, so that "
+    "the kernel queues requests for each thread separately.");
+DEFINE_uint64(
+    fuse_max_write,
+    128 * 1024,
+    "The largest write request the kernel may send us, in bytes.  Kernels "
+    "without FUSE_MAX_PAGES limit this to 128KB.");
+DEFINE_string(
+    fuse_thread_affinity,
+    "",
+    "The CPUs the FUSE worker threads may run on: a CPU list like "
+    "\"0-7,16-23\", or \"node:\" followed by a list of NUMA nodes.  Empty "
+    "lets them run anywhere");
+
 namespace facebook {
 namespace eden {
 
@@ -36,103 +102,26 @@ namespace {
 // This is the minimum size used by libfuse so we use it too!
 constexpr size_t MIN_BUFSIZE = 0x21000;
 
-StringPiece fuseOpcodeName(FuseOpcode opcode) {
-  switch (opcode) {
-    case FUSE_LOOKUP:
-      return "FUSE_LOOKUP";
-    case FUSE_FORGET:
-      return "FUSE_FORGET";
-    case FUSE_GETATTR:
-      return "FUSE_GETATTR";
-    case FUSE_SETATTR:
-      return "FUSE_SETATTR";
-    case FUSE_READLINK:
-      return "FUSE_READLINK";
-    case FUSE_SYMLINK:
-      return "FUSE_SYMLINK";
-    case FUSE_MKNOD:
-      return "FUSE_MKNOD";
-    case FUSE_MKDIR:
-      return "FUSE_MKDIR";
-    case FUSE_UNLINK:
-      return "FUSE_UNLINK";
-    case FUSE_RMDIR:
-      return "FUSE_RMDIR";
-    case FUSE_RENAME:
-      return "FUSE_RENAME";
-    case FUSE_LINK:
-      return "FUSE_LINK";
-    case FUSE_OPEN:
-      return "FUSE_OPEN";
-    case FUSE_READ:
-      return "FUSE_READ";
-    case FUSE_WRITE:
-      return "FUSE_WRITE";
-    case FUSE_STATFS:
-      return "FUSE_STATFS";
-    case FUSE_RELEASE:
-      return "FUSE_RELEASE";
-    case FUSE_FSYNC:
-      return "FUSE_FSYNC";
-    case FUSE_SETXATTR:
-      return "FUSE_SETXATTR";
-    case FUSE_GETXATTR:
-      return "FUSE_GETXATTR";
-    case FUSE_LISTXATTR:
-      return "FUSE_LISTXATTR";
-    case FUSE_REMOVEXATTR:
-      return "FUSE_REMOVEXATTR";
-    case FUSE_FLUSH:
-      return "FUSE_FLUSH";
-    case FUSE_INIT:
-      return "FUSE_INIT";
-    case FUSE_OPENDIR:
-      return "FUSE_OPENDIR";
-    case FUSE_READDIR:
-      return "FUSE_READDIR";
-    case FUSE_RELEASEDIR:
-      return "FUSE_RELEASEDIR";
-    case FUSE_FSYNCDIR:
-      return "FUSE_FSYNCDIR";
-    case FUSE_GETLK:
-      return "FUSE_GETLK";
-    case FUSE_SETLK:
-      return "FUSE_SETLK";
-    case FUSE_SETLKW:
-      return "FUSE_SETLKW";
-    case FUSE_ACCESS:
-      return "FUSE_ACCESS";
-    case FUSE_CREATE:
-      return "FUSE_CREATE";
-    case FUSE_INTERRUPT:
-      return "FUSE_INTERRUPT";
-    case FUSE_BMAP:
-      return "FUSE_BMAP";
-    case FUSE_DESTROY:
-      return "FUSE_DESTROY";
-    case FUSE_IOCTL:
-      return "FUSE_IOCTL";
-    case FUSE_POLL:
-      return "FUSE_POLL";
-    case FUSE_NOTIFY_REPLY:
-      return "FUSE_NOTIFY_REPLY";
-    case FUSE_BATCH_FORGET:
-      return "FUSE_BATCH_FORGET";
-    case FUSE_FALLOCATE:
-      return "FUSE_FALLOCATE";
-    case FUSE_READDIRPLUS:
-      return "FUSE_READDIRPLUS";
-    case FUSE_RENAME2:
-      return "FUSE_RENAME2";
-    case FUSE_LSEEK:
-      return "FUSE_LSEEK";
-
-    case CUSE_INIT:
-      return "CUSE_INIT";
-  }
-  return "<unknown>";
+/**
+ * The thread pool running requests that may block, once a mount has
+ * --fuse_max_blocking_workers worker threads busy with them.
+ *
+ * This is shared by all mounts and intentionally never destroyed: the last
+ * request on a FuseChannel may run here and destroy the FuseChannel, so the
+ * pool cannot be owned by it.
+ */
+folly::CPUThreadPoolExecutor* getBlockingRequestExecutor() {
+  static auto* executor = new folly::CPUThreadPoolExecutor(
+      std::max<size_t>(FLAGS_fuse_max_blocking_workers, 1),
+      std::make_shared<folly::NamedThreadFactory>("FuseBlocking"));
+  return executor;
 }
 
+// Only spread a batch of invalidations across several threads if each thread
+// gets at least this many.  Each invalidation is a single write() to the FUSE
+// device, so smaller batches are not worth the hand-off.
+constexpr size_t kMinInvalidationsPerThread = 256;
+
 using Handler = folly::Future<folly::Unit> (
     FuseChannel::*)(const fuse_in_header* header, const uint8_t* arg);
 
@@ -166,16 +155,24 @@ void installSignalHandler() {
 struct FuseChannel::HandlerEntry {
   Handler handler;
   EdenStats::HistogramPtr histogram;
+  // Whether the handler may block its worker thread for a long time, e.g.
+  // reading from the LocalStore or waiting on a backing store import.
+  bool mayBlock{false};
 };
 
+namespace {
+constexpr bool kMayBlock = true;
+} // namespace
+
 const FuseChannel::HandlerMap FuseChannel::handlerMap_ = {
-    {FUSE_READ, {&FuseChannel::fuseRead, &EdenStats::read}},
+    {FUSE_READ, {&FuseChannel::fuseRead, &EdenStats::read, kMayBlock}},
     {FUSE_WRITE, {&FuseChannel::fuseWrite, &EdenStats::write}},
-    {FUSE_LOOKUP, {&FuseChannel::fuseLookup, &EdenStats::lookup}},
+    {FUSE_LOOKUP, {&FuseChannel::fuseLookup, &EdenStats::lookup, kMayBlock}},
     {FUSE_FORGET, {&FuseChannel::fuseForget, &EdenStats::forget}},
     {FUSE_GETATTR, {&FuseChannel::fuseGetAttr, &EdenStats::getattr}},
     {FUSE_SETATTR, {&FuseChannel::fuseSetAttr, &EdenStats::setattr}},
-    {FUSE_READLINK, {&FuseChannel::fuseReadLink, &EdenStats::readlink}},
+    {FUSE_READLINK,
+     {&FuseChannel::fuseReadLink, &EdenStats::readlink, kMayBlock}},
     {FUSE_SYMLINK, {&FuseChannel::fuseSymlink, &EdenStats::symlink}},
     {FUSE_MKNOD, {&FuseChannel::fuseMknod, &EdenStats::mknod}},
     {FUSE_MKDIR, {&FuseChannel::fuseMkdir, &EdenStats::mkdir}},
@@ -188,13 +185,16 @@ const FuseChannel::HandlerMap FuseChannel::handlerMap_ = {
     {FUSE_RELEASE, {&FuseChannel::fuseRelease, &EdenStats::release}},
     {FUSE_FSYNC, {&FuseChannel::fuseFsync, &EdenStats::fsync}},
     {FUSE_SETXATTR, {&FuseChannel::fuseSetXAttr, &EdenStats::setxattr}},
-    {FUSE_GETXATTR, {&FuseChannel::fuseGetXAttr, &EdenStats::getxattr}},
+    {FUSE_GETXATTR,
+     {&FuseChannel::fuseGetXAttr, &EdenStats::getxattr, kMayBlock}},
     {FUSE_LISTXATTR, {&FuseChannel::fuseListXAttr, &EdenStats::listxattr}},
     {FUSE_REMOVEXATTR,
      {&FuseChannel::fuseRemoveXAttr, &EdenStats::removexattr}},
     {FUSE_FLUSH, {&FuseChannel::fuseFlush, &EdenStats::flush}},
     {FUSE_OPENDIR, {&FuseChannel::fuseOpenDir, &EdenStats::opendir}},
     {FUSE_READDIR, {&FuseChannel::fuseReadDir, &EdenStats::readdir}},
+    {FUSE_READDIRPLUS,
+     {&FuseChannel::fuseReadDirPlus, &EdenStats::readdirplus, kMayBlock}},
     {FUSE_RELEASEDIR, {&FuseChannel::fuseReleaseDir, &EdenStats::releasedir}},
     {FUSE_FSYNCDIR, {&FuseChannel::fuseFsyncDir, &EdenStats::fsyncdir}},
     {FUSE_ACCESS, {&FuseChannel::fuseAccess, &EdenStats::access}},
@@ -271,6 +271,27 @@ static const std::unordered_map<int32_t, const char*> capsLabels = {
 FuseChannel::DataRange::DataRange(int64_t off, int64_t len)
     : offset(off), length(len) {}
 
+void FuseChannel::DataRange::merge(const DataRange& other) {
+  // A negative offset only invalidates the attributes, which invalidating
+  // any data range also does.
+  if (other.offset < 0) {
+    return;
+  }
+  if (offset < 0) {
+    *this = other;
+    return;
+  }
+
+  // A non-positive length extends to the end of the file.
+  constexpr auto kToEnd = std::numeric_limits<int64_t>::max();
+  auto rangeEnd = [](const DataRange& range) {
+    return range.length > 0 ? range.offset + range.length : kToEnd;
+  };
+  const auto end = std::max(rangeEnd(*this), rangeEnd(other));
+  offset = std::min(offset, other.offset);
+  length = end == kToEnd ? 0 : end - offset;
+}
+
 FuseChannel::InvalidationEntry::InvalidationEntry(
     InodeNumber num,
     PathComponentPiece n)
@@ -350,12 +371,15 @@ std::ostream& operator<<(
             << ")";
 }
 
-void FuseChannel::replyError(const fuse_in_header& request, int errorCode) {
+void FuseChannel::replyError(
+    int fuseDevice,
+    const fuse_in_header& request,
+    int errorCode) {
   fuse_out_header err;
   err.len = sizeof(err);
   err.error = -errorCode;
   err.unique = request.unique;
-  auto res = write(fuseDevice_.fd(), &err, sizeof(err));
+  auto res = write(fuseDevice, &err, sizeof(err));
   if (res != sizeof(err)) {
     if (res < 0) {
       throwSystemError("replyError: error writing to fuse device");
@@ -366,6 +390,7 @@ void FuseChannel::replyError(const fuse_in_header& request, int errorCode) {
 }
 
 void FuseChannel::sendReply(
+    int fuseDevice,
     const fuse_in_header& request,
     folly::fbvector<iovec>&& vec) const {
   fuse_out_header out;
@@ -374,10 +399,11 @@ void FuseChannel::sendReply(
 
   vec.insert(vec.begin(), make_iovec(out));
 
-  sendRawReply(vec.data(), vec.size());
+  sendRawReply(fuseDevice, vec.data(), vec.size());
 }
 
 void FuseChannel::sendReply(
+    int fuseDevice,
     const fuse_in_header& request,
     folly::ByteRange bytes) const {
   fuse_out_header out;
@@ -390,10 +416,13 @@ void FuseChannel::sendReply(
   iov[1].iov_base = const_cast<uint8_t*>(bytes.data());
   iov[1].iov_len = bytes.size();
 
-  sendRawReply(iov.data(), iov.size());
+  sendRawReply(fuseDevice, iov.data(), iov.size());
 }
 
-void FuseChannel::sendRawReply(const iovec iov[], size_t count) const {
+void FuseChannel::sendRawReply(
+    int fuseDevice,
+    const iovec iov[],
+    size_t count) const {
   // Ensure that the length is set correctly
   DCHECK_EQ(iov[0].iov_len, sizeof(fuse_out_header));
   const auto header = reinterpret_cast<fuse_out_header*>(iov[0].iov_base);
@@ -402,7 +431,7 @@ void FuseChannel::sendRawReply(const iovec iov[], size_t count) const {
     header->len += iov[i].iov_len;
   }
 
-  const auto res = writev(fuseDevice_.fd(), iov, count);
+  const auto res = writev(fuseDevice, iov, count);
   const int err = errno;
   XLOG(DBG7) << "sendRawReply: unique=" << header->unique
              << " header->len=" << header->len << " wrote=" << res;
@@ -420,18 +449,150 @@ void FuseChannel::sendRawReply(const iovec iov[], size_t count) const {
   }
 }
 
+void FuseChannel::sendReply(
+    int fuseDevice,
+    const fuse_in_header& request,
+    const BufVec& buf) const {
+  auto range = buf.getFileRange();
+  if (range && canSpliceReplies() &&
+      trySpliceReply(
+          fuseDevice, request, range->fd, range->offset, range->length)) {
+    return;
+  }
+  sendReply(fuseDevice, request, buf.getIov());
+}
+
+bool FuseChannel::canSpliceReplies() const {
+  return connInfo_.hasValue() && (connInfo_->flags & FUSE_SPLICE_WRITE);
+}
+
+bool FuseChannel::isWritebackCacheEnabled() const {
+  return connInfo_.hasValue() && (connInfo_->flags & FUSE_WRITEBACK_CACHE);
+}
+
+FuseChannel::SplicePipe* FuseChannel::getSplicePipe() const {
+  auto splicePipe = splicePipes_.get();
+  if (splicePipe->readEnd) {
+    return splicePipe;
+  }
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+    XLOG(WARN) << "unable to create a pipe for splicing FUSE replies: "
+               << folly::errnoStr(errno);
+    return nullptr;
+  }
+  folly::File readEnd{fds[0], /*ownsFd=*/true};
+  folly::File writeEnd{fds[1], /*ownsFd=*/true};
+
+  // The whole reply is moved into the pipe before any of it is moved out, so
+  // the pipe has to be able to hold the largest reply we send.
+  if (fcntl(writeEnd.fd(), F_SETPIPE_SZ, bufferSize_) < 0) {
+    XLOG(WARN) << "unable to grow the pipe for splicing FUSE replies to "
+               << bufferSize_ << " bytes: " << folly::errnoStr(errno);
+    return nullptr;
+  }
+
+  splicePipe->readEnd = std::move(readEnd);
+  splicePipe->writeEnd = std::move(writeEnd);
+  return splicePipe;
+}
+
+bool FuseChannel::trySpliceReply(
+    int fuseDevice,
+    const fuse_in_header& request,
+    int fd,
+    off_t offset,
+    size_t length) const {
+  if (sizeof(fuse_out_header) + length > bufferSize_) {
+    return false;
+  }
+  auto splicePipe = getSplicePipe();
+  if (!splicePipe) {
+    return false;
+  }
+
+  fuse_out_header out;
+  out.unique = request.unique;
+  out.error = 0;
+  out.len = sizeof(out) + length;
+  auto res = folly::writeNoInt(splicePipe->writeEnd.fd(), &out, sizeof(out));
+  if (res != sizeof(out)) {
+    *splicePipe = SplicePipe{};
+    return false;
+  }
+
+  loff_t fileOffset = offset;
+  size_t remaining = length;
+  while (remaining > 0) {
+    auto moved = splice(
+        fd,
+        &fileOffset,
+        splicePipe->writeEnd.fd(),
+        nullptr,
+        remaining,
+        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (moved <= 0) {
+      // The file ended early, probably because it was truncated after the
+      // read was started.  Throw away whatever made it into the pipe.
+      XLOG(DBG4) << "unable to splice " << length << " bytes @" << offset
+                 << " for FUSE reply: "
+                 << (moved < 0 ? folly::errnoStr(errno) : "end of file");
+      *splicePipe = SplicePipe{};
+      return false;
+    }
+    remaining -= moved;
+  }
+
+  res = splice(
+      splicePipe->readEnd.fd(),
+      nullptr,
+      fuseDevice,
+      nullptr,
+      out.len,
+      SPLICE_F_MOVE);
+  const int err = errno;
+  XLOG(DBG7) << "trySpliceReply: unique=" << out.unique << " len=" << out.len
+             << " wrote=" << res;
+
+  if (res != static_cast<ssize_t>(out.len)) {
+    // Don't leave part of this reply in the pipe to be sent with the next.
+    *splicePipe = SplicePipe{};
+    if (res >= 0) {
+      throw std::runtime_error("unexpected short splice to FUSE device");
+    }
+    if (err == ENOENT) {
+      // Interrupted by a signal.  We don't need to log this,
+      // but will propagate it back to our caller.
+    } else if (!isFuseDeviceValid(state_.rlock()->stopReason)) {
+      XLOG(INFO) << "error splicing to fuse device: session closed";
+    } else {
+      XLOG(WARNING) << "error splicing to fuse device: "
+                    << folly::errnoStr(err);
+    }
+    throwSystemErrorExplicit(err, "error splicing to fuse device");
+  }
+  return true;
+}
+
 FuseChannel::FuseChannel(
     folly::File&& fuseDevice,
     AbsolutePathPiece mountPath,
     size_t numThreads,
     Dispatcher* const dispatcher)
-    : bufferSize_(std::max(size_t(getpagesize()) + 0x1000, MIN_BUFSIZE)),
-      numThreads_(numThreads),
+    : numThreads_(numThreads),
+      threadAffinity_(CpuAffinity::parse(FLAGS_fuse_thread_affinity)),
       dispatcher_(dispatcher),
       mountPath_(mountPath),
+      bufferSize_(std::max(
+          {size_t(getpagesize()) + 0x1000,
+           MIN_BUFSIZE,
+           size_t(FLAGS_fuse_max_write) + 0x1000})),
       fuseDevice_(std::move(fuseDevice)) {
   CHECK_GE(numThreads_, 1);
   installSignalHandler();
+  // Measure the request timer now rather than during the first request.
+  CycleClock::getCalibration();
 }
 
 FuseChannel::~FuseChannel() {}
@@ -451,6 +612,9 @@ Future<FuseChannel::StopFuture> FuseChannel::initialize() {
 FuseChannel::StopFuture FuseChannel::initializeFromTakeover(
     fuse_init_out connInfo) {
   connInfo_ = connInfo;
+  // The kernel will keep using the max_write negotiated by the previous
+  // process, regardless of our own setting.
+  bufferSize_ = std::max(bufferSize_, size_t(connInfo_->max_write) + 0x1000);
   XLOG(INFO) << "Takeover using max_write=" << connInfo_->max_write
              << ", max_readahead=" << connInfo_->max_readahead
              << ", want=" << flagsToLabel(capsLabels, connInfo_->flags);
@@ -478,6 +642,11 @@ void FuseChannel::startWorkerThreads() {
       state->workerThreads.emplace_back([this] { fuseWorkerThread(); });
     }
 
+    if (FLAGS_fuse_invalidation_threads > 1) {
+      invalidationExecutor_ = std::make_unique<folly::CPUThreadPoolExecutor>(
+          FLAGS_fuse_invalidation_threads,
+          std::make_shared<folly::NamedThreadFactory>("FuseInvalidate"));
+    }
     invalidationThread_ = std::thread([this] { invalidationThread(); });
   } catch (const std::exception& ex) {
     XLOG(ERR) << "Error starting FUSE worker threads: " << exceptionStr(ex);
@@ -615,7 +784,7 @@ void FuseChannel::sendInvalidateInode(
   iov[1].iov_len = sizeof(notify);
 
   try {
-    sendRawReply(iov.data(), iov.size());
+    sendRawReply(fuseDevice_.fd(), iov.data(), iov.size());
     XLOG(DBG7) << "invalidateInode ino=" << ino << " off=" << off
                << " len=" << len << " OK!";
   } catch (const std::system_error& exc) {
@@ -668,7 +837,7 @@ void FuseChannel::sendInvalidateEntry(
   iov[3].iov_len = 1;
 
   try {
-    sendRawReply(iov.data(), iov.size());
+    sendRawReply(fuseDevice_.fd(), iov.data(), iov.size());
   } catch (const std::system_error& exc) {
     // Ignore ENOENT.  This can happen for inode numbers that we allocated on
     // our own and haven't actually told the kernel about yet.
@@ -683,6 +852,19 @@ void FuseChannel::sendInvalidateEntry(
   }
 }
 
+void FuseChannel::startTraceRecording(
+    std::shared_ptr<FuseTraceWriter> writer) {
+  *traceWriter_.wlock() = std::move(writer);
+  isRecordingTrace_.store(true, std::memory_order_release);
+}
+
+std::shared_ptr<FuseTraceWriter> FuseChannel::stopTraceRecording() {
+  isRecordingTrace_.store(false, std::memory_order_release);
+  std::shared_ptr<FuseTraceWriter> writer;
+  traceWriter_.wlock()->swap(writer);
+  return writer;
+}
+
 std::vector<fuse_in_header> FuseChannel::getOutstandingRequests() {
   auto state = state_.wlock();
   const auto& requests = state->requests;
@@ -759,6 +941,7 @@ void FuseChannel::initWorkerThread() noexcept {
   try {
     setThreadSigmask();
     setThreadName(to<std::string>("fuse", mountPath_.basename()));
+    threadAffinity_.applyToCurrentThread();
 
     // Read the INIT packet
     readInitPacket();
@@ -784,9 +967,11 @@ void FuseChannel::initWorkerThread() noexcept {
 void FuseChannel::fuseWorkerThread() noexcept {
   setThreadName(to<std::string>("fuse", mountPath_.basename()));
   setThreadSigmask();
+  threadAffinity_.applyToCurrentThread();
 
+  bool retired = false;
   try {
-    processSession();
+    retired = processSession();
   } catch (const std::exception& ex) {
     XLOG(ERR) << "unexpected error in FUSE worker thread: " << exceptionStr(ex);
     // Request that all other FUSE threads exit.
@@ -800,6 +985,11 @@ void FuseChannel::fuseWorkerThread() noexcept {
   {
     auto state = state_.wlock();
     ++state->stoppedThreads;
+    if (retired) {
+      // The thread that next grows the pool will join us.
+      --state->retiringThreads;
+      state->retiredThreadIds.push_back(std::this_thread::get_id());
+    }
     DCHECK(!state->destroyPending) << "destroyPending cannot be set while "
                                       "worker threads are still running";
 
@@ -807,12 +997,88 @@ void FuseChannel::fuseWorkerThread() noexcept {
     // outstanding then invoke sessionComplete().  If we are the last thread
     // but there are still outstanding requests we will invoke
     // sessionComplete() when finishRequest() is called for the last request.
-    if (state->stoppedThreads == numThreads_ && state->requests.empty()) {
+    if (allWorkerThreadsStopped(*state) && state->requests.empty()) {
       sessionComplete(std::move(state));
     }
   }
 }
 
+bool FuseChannel::allWorkerThreadsStopped(const State& state) const {
+  // If initialization failed we may not have started all of the threads, in
+  // which case we do not want to report the session as complete.
+  return state.workerThreads.size() >= numThreads_ &&
+      state.stoppedThreads == state.workerThreads.size();
+}
+
+void FuseChannel::maybeAddWorkerThread() {
+  auto state = state_.wlock();
+  if (state->stopReason != StopReason::RUNNING ||
+      idleWorkers_.load(std::memory_order_acquire) > 0) {
+    return;
+  }
+
+  // Join any threads that have exited since we last grew the pool.
+  for (const auto& id : state->retiredThreadIds) {
+    auto it = std::find_if(
+        state->workerThreads.begin(),
+        state->workerThreads.end(),
+        [&](const std::thread& thread) { return thread.get_id() == id; });
+    DCHECK(it != state->workerThreads.end());
+    if (it != state->workerThreads.end()) {
+      it->join();
+      state->workerThreads.erase(it);
+      --state->stoppedThreads;
+    }
+  }
+  state->retiredThreadIds.clear();
+
+  const auto maxThreads =
+      std::max<size_t>(numThreads_, FLAGS_fuse_max_worker_threads);
+  if (state->workerThreads.size() - state->stoppedThreads >= maxThreads) {
+    return;
+  }
+  try {
+    state->workerThreads.emplace_back([this] { fuseWorkerThread(); });
+  } catch (const std::exception& ex) {
+    XLOG(WARN) << "failed to start an additional FUSE worker thread: "
+               << exceptionStr(ex);
+    return;
+  }
+  XLOG(DBG3) << "all FUSE worker threads for " << mountPath_
+             << " are busy; started worker thread "
+             << state->workerThreads.size() - state->stoppedThreads;
+}
+
+bool FuseChannel::tryAcquireBlockingWorker() {
+  const auto limit = FLAGS_fuse_max_blocking_workers;
+  auto current = blockingWorkers_.load(std::memory_order_acquire);
+  do {
+    if (limit != 0 && current >= limit) {
+      return false;
+    }
+  } while (!blockingWorkers_.compare_exchange_weak(
+      current, current + 1, std::memory_order_acq_rel));
+  return true;
+}
+
+bool FuseChannel::tryRetireWorkerThread() {
+  // Only retire a thread once there are enough idle threads to handle a
+  // burst of requests as large as our normal pool.
+  if (idleWorkers_.load(std::memory_order_acquire) < numThreads_) {
+    return false;
+  }
+  auto state = state_.wlock();
+  const auto running = state->workerThreads.size() - state->stoppedThreads -
+      state->retiringThreads;
+  if (state->stopReason != StopReason::RUNNING || running <= numThreads_) {
+    return false;
+  }
+  ++state->retiringThreads;
+  XLOG(DBG3) << "retiring idle FUSE worker thread for " << mountPath_;
+  return true;
+}
+
+
 void FuseChannel::invalidationThread() noexcept {
   // We send all FUSE_NOTIFY_INVAL_ENTRY and FUSE_NOTIFY_INVAL_INODE requests
   // in a dedicated thread.  These requests will block in the kernel until it
@@ -830,6 +1096,9 @@ void FuseChannel::invalidationThread() noexcept {
   // currently owns the rename lock, and will generate invalidation requests.
   // We need to make sure the checkout operation does not block waiting on the
   // invalidation requests to complete, since otherwise this would deadlock.
+  //
+  // The same applies to the invalidationExecutor_ threads, which only ever
+  // run sendInvalidation() on behalf of this thread.
   while (true) {
     // Wait for entries to process
     std::vector<InvalidationEntry> entries;
@@ -844,12 +1113,92 @@ void FuseChannel::invalidationThread() noexcept {
       lockedQueue->queue.swap(entries);
     }
 
-    // Process all of the entries we found
+    // Process all of the entries we found.  A checkout can queue many
+    // invalidations for the same inodes, so coalesce them first.
+    auto flushPromises = coalesceInvalidations(entries);
+    sendInvalidations(entries);
+    entries.clear();
+
+    // Every entry queued before these flushes has now been sent.
+    for (auto& promise : flushPromises) {
+      promise.setValue();
+    }
+  }
+}
+
+std::vector<Promise<Unit>> FuseChannel::coalesceInvalidations(
+    std::vector<InvalidationEntry>& entries) {
+  std::vector<Promise<Unit>> flushPromises;
+  std::vector<bool> keep(entries.size(), false);
+  // The index of the first INODE entry for each inode number.
+  std::unordered_map<InodeNumber, size_t> inodeEntries;
+  // The names whose DIR_ENTRY we are keeping, pointing into `entries`.
+  std::unordered_map<InodeNumber, std::unordered_set<PathComponentPiece>>
+      dirEntries;
+
+  for (size_t idx = 0; idx < entries.size(); ++idx) {
+    auto& entry = entries[idx];
+    switch (entry.type) {
+      case InvalidationType::INODE: {
+        auto ret = inodeEntries.emplace(entry.inode, idx);
+        if (ret.second) {
+          keep[idx] = true;
+        } else {
+          entries[ret.first->second].range.merge(entry.range);
+        }
+        break;
+      }
+      case InvalidationType::DIR_ENTRY:
+        keep[idx] = dirEntries[entry.inode].insert(entry.name).second;
+        break;
+      case InvalidationType::FLUSH:
+        flushPromises.push_back(std::move(entry.promise));
+        break;
+    }
+  }
+
+  std::vector<InvalidationEntry> coalesced;
+  coalesced.reserve(entries.size());
+  for (size_t idx = 0; idx < entries.size(); ++idx) {
+    if (keep[idx]) {
+      coalesced.push_back(std::move(entries[idx]));
+    }
+  }
+  XLOG_IF(DBG4, coalesced.size() != entries.size())
+      << "coalesced " << entries.size() << " invalidation requests into "
+      << coalesced.size();
+  entries.swap(coalesced);
+  return flushPromises;
+}
+
+void FuseChannel::sendInvalidations(std::vector<InvalidationEntry>& entries) {
+  size_t numChunks = 1;
+  if (invalidationExecutor_) {
+    numChunks = std::min<size_t>(
+        FLAGS_fuse_invalidation_threads,
+        entries.size() / kMinInvalidationsPerThread);
+  }
+  if (numChunks <= 1) {
     for (auto& entry : entries) {
       sendInvalidation(entry);
     }
-    entries.clear();
+    return;
+  }
+
+  // Entries for different inodes and names are independent of each other, so
+  // they can be sent in any order.  sendInvalidation() never throws.
+  const size_t chunkSize = (entries.size() + numChunks - 1) / numChunks;
+  std::vector<Future<Unit>> futures;
+  for (size_t start = 0; start < entries.size(); start += chunkSize) {
+    const size_t end = std::min(start + chunkSize, entries.size());
+    futures.push_back(
+        via(invalidationExecutor_.get(), [this, &entries, start, end] {
+          for (size_t idx = start; idx < end; ++idx) {
+            sendInvalidation(entries[idx]);
+          }
+        }));
   }
+  collectAllSemiFuture(futures).wait();
 }
 
 void FuseChannel::stopInvalidationThread() {
@@ -862,6 +1211,7 @@ void FuseChannel::stopInvalidationThread() {
   invalidationQueue_.lock()->stop = true;
   invalidationCV_.notify_one();
   invalidationThread_.join();
+  invalidationExecutor_.reset();
 }
 
 void FuseChannel::readInitPacket() {
@@ -932,7 +1282,7 @@ void FuseChannel::readInitPacket() {
   }
 
   if (init.header.opcode != FUSE_INIT) {
-    replyError(init.header, EPROTO);
+    replyError(fuseDevice_.fd(), init.header, EPROTO);
     throw std::runtime_error(folly::to<std::string>(
         "expected to receive FUSE_INIT for \"",
         mountPath_,
@@ -946,23 +1296,50 @@ void FuseChannel::readInitPacket() {
   fuse_init_out connInfo = {};
   connInfo.major = init.init.major;
   connInfo.minor = init.init.minor;
-  connInfo.max_write = bufferSize_ - 4096;
+  connInfo.max_write = std::min<size_t>(
+      std::max<size_t>(FLAGS_fuse_max_write, 4096), bufferSize_ - 4096);
 
   connInfo.max_readahead = init.init.max_readahead;
 
   const auto& capable = init.init.flags;
   auto& want = connInfo.flags;
 
-  // TODO: follow up and look at the new flags; particularly
-  // FUSE_PARALLEL_DIROPS, FUSE_DO_READDIRPLUS,
-  // FUSE_READDIRPLUS_AUTO. FUSE_SPLICE_XXX are interesting too,
-  // but may not directly benefit eden today.
+  // We do not use FUSE_SPLICE_READ yet.
   //
   // It would be great to enable FUSE_ATOMIC_O_TRUNC but it
   // seems to trigger a kernel/FUSE bug.  See
   // test_mmap_is_null_terminated_after_truncate_and_write_to_overlay
   // in mmap_test.py. FUSE_ATOMIC_O_TRUNC |
+  //
+  // Newer kernels also offer FUSE_PASSTHROUGH, which would let the kernel do
+  // I/O on materialized files directly against their overlay file.  We
+  // cannot use it yet: the kernel uses file offsets unchanged, but overlay
+  // files start with a header, and writes have to go through FileInode so
+  // that the journal and the cached SHA-1 stay correct.
   want = capable & (FUSE_BIG_WRITES | FUSE_ASYNC_READ);
+  if (FLAGS_fuse_splice_reads) {
+    // We splice replies to the kernel, but not requests from it.
+    want |= capable & (FUSE_SPLICE_WRITE | FUSE_SPLICE_MOVE);
+  }
+  if (FLAGS_fuse_readdirplus) {
+    // With READDIRPLUS_AUTO the kernel only sends READDIRPLUS for a directory
+    // after something has looked up one of its entries, e.g. `ls -l`, and
+    // sends plain READDIR for callers that only want the names.
+    want |= capable & (FUSE_DO_READDIRPLUS | FUSE_READDIRPLUS_AUTO);
+  }
+  if (FLAGS_fuse_writeback_cache) {
+    want |= capable & FUSE_WRITEBACK_CACHE;
+  }
+  if (FLAGS_fuse_parallel_dirops) {
+    // Without this the kernel holds a directory's lock exclusively for each
+    // lookup and readdir in it.  Our lookups and readdirs only take the
+    // TreeInode's contents lock, and concurrent lookups of the same name
+    // share one load through the InodeMap, so they are safe to run in
+    // parallel.  Each successful lookup reply still bumps the FUSE refcount,
+    // matching the kernel's count.  Operations that change the directory
+    // still hold the lock exclusively.
+    want |= capable & FUSE_PARALLEL_DIROPS;
+  }
 
   XLOG(INFO) << "Speaking fuse protocol kernel=" << init.init.major << "."
              << init.init.minor << " local=" << FUSE_KERNEL_VERSION << "."
@@ -973,7 +1350,7 @@ void FuseChannel::readInitPacket() {
              << ", want=" << flagsToLabel(capsLabels, want);
 
   if (init.init.major != FUSE_KERNEL_VERSION) {
-    replyError(init.header, EPROTO);
+    replyError(fuseDevice_.fd(), init.header, EPROTO);
     throw std::runtime_error(folly::to<std::string>(
         "Unsupported FUSE kernel version ",
         init.init.major,
@@ -993,20 +1370,62 @@ void FuseChannel::readInitPacket() {
   // initPromise_, so that the kernel will put the mount point in use and will
   // not block further filesystem access on us while running the Dispatcher
   // callback code.
-  sendReply(init.header, connInfo);
+  sendReply(fuseDevice_.fd(), init.header, connInfo);
   dispatcher_->initConnection(connInfo);
 }
 
-void FuseChannel::processSession() {
+std::shared_ptr<folly::File> FuseChannel::cloneFuseDevice() {
+  // Without a clone, share fuseDevice_, which outlives all of the requests.
+  auto shared = std::shared_ptr<folly::File>(
+      std::shared_ptr<folly::File>{}, &fuseDevice_);
+#ifdef FUSE_DEV_IOC_CLONE
+  if (!FLAGS_fuse_clone_device) {
+    return shared;
+  }
+  const int cloneFd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+  if (cloneFd < 0) {
+    XLOG(DBG2) << "unable to open /dev/fuse to clone the FUSE device for "
+               << mountPath_ << ": " << folly::errnoStr(errno);
+    return shared;
+  }
+  auto clone = std::make_shared<folly::File>(cloneFd, /*ownsFd=*/true);
+  uint32_t sourceFd = fuseDevice_.fd();
+  if (ioctl(clone->fd(), FUSE_DEV_IOC_CLONE, &sourceFd) != 0) {
+    // This is expected on kernels older than 4.2, and when fuseDevice_ is
+    // not a real FUSE device, as in our tests.
+    XLOG(DBG2) << "unable to clone the FUSE device for " << mountPath_
+               << ": " << folly::errnoStr(errno);
+    return shared;
+  }
+  return clone;
+#else
+  return shared;
+#endif
+}
+
+bool FuseChannel::processSession() {
   std::vector<char> buf(bufferSize_);
+  auto fuseDevice = cloneFuseDevice();
+  const int fuseDeviceFd = fuseDevice->fd();
   // Save this for the sanity check later in the loop to avoid
   // additional syscalls on each loop iteration.
   auto myPid = getpid();
 
   while (!stop_.load(std::memory_order_relaxed)) {
+    if (tryRetireWorkerThread()) {
+      return true;
+    }
+
     // TODO: FUSE_SPLICE_READ allows using splice(2) here if we enable it.
     // We can look at turning this on once the main plumbing is complete.
-    auto res = read(fuseDevice_.fd(), buf.data(), buf.size());
+    idleWorkers_.fetch_add(1, std::memory_order_acq_rel);
+    auto res = read(fuseDeviceFd, buf.data(), buf.size());
+    if (idleWorkers_.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+        res > 0) {
+      // We were the last idle worker, so nobody is waiting for the next
+      // request.  Start another thread in case this one blocks.
+      maybeAddWorkerThread();
+    }
     if (res < 0) {
       int error = errno;
       if (stop_.load(std::memory_order_relaxed)) {
@@ -1049,7 +1468,7 @@ void FuseChannel::processSession() {
                   << arg_size;
         requestSessionExit(StopReason::FUSE_TRUNCATED_REQUEST);
       }
-      return;
+      return false;
     }
 
     const auto* header = reinterpret_cast<fuse_in_header*>(buf.data());
@@ -1072,13 +1491,13 @@ void FuseChannel::processSession() {
       XLOG(DFATAL) << "Received FUSE request from our own pid: opcode="
                    << header->opcode << " nodeid=" << header->nodeid
                    << " pid=" << header->pid;
-      replyError(*header, EIO);
+      replyError(fuseDeviceFd, *header, EIO);
       continue;
     }
 
     switch (header->opcode) {
       case FUSE_INIT:
-        replyError(*header, EPROTO);
+        replyError(fuseDeviceFd, *header, EPROTO);
         throw std::runtime_error(
             "received FUSE_INIT after we have been initialized!?");
 
@@ -1087,7 +1506,7 @@ void FuseChannel::processSession() {
       case FUSE_SETLKW:
         // Deliberately not handling locking; this causes
         // the kernel to do it for us
-        replyError(*header, ENOSYS);
+        replyError(fuseDeviceFd, *header, ENOSYS);
         break;
 
       case FUSE_INTERRUPT: {
@@ -1135,7 +1554,7 @@ void FuseChannel::processSession() {
       case FUSE_IOCTL:
         // Rather than the default ENOSYS, we need to return ENOTTY
         // to indicate that the requested ioctl is not supported
-        replyError(*header, ENOTTY);
+        replyError(fuseDeviceFd, *header, ENOTTY);
         break;
 
       default: {
@@ -1147,7 +1566,8 @@ void FuseChannel::processSession() {
           // request.
           RequestContextScopeGuard requestContextGuard;
 
-          auto& request = RequestData::create(this, *header, dispatcher_);
+          auto& request =
+              RequestData::create(this, *header, dispatcher_, fuseDevice);
           {
             // Save a weak reference to this new request context.
             // We'll need this to process FUSE_INTERRUPT requests.
@@ -1168,11 +1588,51 @@ void FuseChannel::processSession() {
           // These methods are internally synchronised to make this safe
           // so we don't need to reacquire state_ lock after calling the
           // handler.
-          request.setRequestFuture(
-              request.startRequest(dispatcher_->getStats(), entry.histogram)
-                  .thenValue([=, &request](auto&&) {
+          dispatcher_->recordRequest(*header);
+          if (UNLIKELY(isRecordingTrace_.load(std::memory_order_acquire))) {
+            if (auto writer = *traceWriter_.rlock()) {
+              writer->recordRequest(
+                  *header,
+                  folly::ByteRange{arg, header->len - sizeof(fuse_in_header)});
+            }
+          }
+          auto started = request.startRequest(
+              dispatcher_->getStats(),
+              dispatcher_->getMountStats(),
+              entry.histogram);
+          if (!entry.mayBlock) {
+            request.setRequestFuture(
+                std::move(started).thenValue([=, &request](auto&&) {
+                  return request.runHandler([&] {
                     return (this->*entry.handler)(&request.getReq(), arg);
-                  }));
+                  });
+                }));
+          } else if (tryAcquireBlockingWorker()) {
+            SCOPE_EXIT {
+              blockingWorkers_.fetch_sub(1, std::memory_order_acq_rel);
+            };
+            request.setRequestFuture(
+                std::move(started).thenValue([=, &request](auto&&) {
+                  return request.runHandler([&] {
+                    return (this->*entry.handler)(&request.getReq(), arg);
+                  });
+                }));
+          } else {
+            // Too many workers are already tied up with requests that may
+            // block.  Run this one on the shared pool instead, with a copy of
+            // the arguments since buf is reused for the next request.
+            auto argCopy = std::make_shared<std::vector<uint8_t>>(
+                arg, arg + (header->len - sizeof(fuse_in_header)));
+            request.setRequestFuture(
+                std::move(started)
+                    .via(getBlockingRequestExecutor())
+                    .thenValue([=, &request](auto&&) {
+                      return request.runHandler([&] {
+                        return (this->*entry.handler)(
+                            &request.getReq(), argCopy->data());
+                      });
+                    }));
+          }
           break;
         }
 
@@ -1193,19 +1653,22 @@ void FuseChannel::processSession() {
             });
 
         try {
-          replyError(*header, ENOSYS);
+          replyError(fuseDeviceFd, *header, ENOSYS);
         } catch (const std::system_error& exc) {
           XLOG(ERR) << "Failed to write error response to fuse: " << exc.what();
           requestSessionExit(StopReason::FUSE_WRITE_ERROR);
-          return;
+          return false;
         }
         break;
       }
     }
   }
+  return false;
 }
 
 void FuseChannel::finishRequest(const fuse_in_header& header) {
+  dispatcher_->recordRequestFinished(header);
+
   // Remove the current request from the map.
   auto state = state_.wlock();
   const bool erased = state->requests.erase(header.unique) > 0;
@@ -1213,7 +1676,7 @@ void FuseChannel::finishRequest(const fuse_in_header& header) {
 
   // We may be complete; check to see if all requests are
   // done and whether there are any threads remaining.
-  if (state->requests.empty() && state->stoppedThreads == numThreads_) {
+  if (state->requests.empty() && allWorkerThreadsStopped(*state)) {
     sessionComplete(std::move(state));
   }
 }
@@ -1258,7 +1721,9 @@ folly::Future<folly::Unit> FuseChannel::fuseRead(
   auto fh = dispatcher_->getFileHandle(read->fh);
   XLOG(DBG7) << "reading " << read->size << "@" << read->offset;
   return fh->read(read->size, read->offset).thenValue([](BufVec&& buf) {
-    RequestData::get().sendReply(buf.getIov());
+    auto& request = RequestData::get();
+    request.recordBytes(&EdenStats::readBytes, buf.size());
+    request.sendReply(buf);
   });
 }
 
@@ -1278,7 +1743,9 @@ folly::Future<folly::Unit> FuseChannel::fuseWrite(
       .then([](size_t wrote) {
         fuse_write_out out = {};
         out.size = wrote;
-        RequestData::get().sendReply(out);
+        auto& request = RequestData::get();
+        request.recordBytes(&EdenStats::writeBytes, wrote);
+        request.sendReply(out);
       });
 }
 
@@ -1290,9 +1757,16 @@ folly::Future<folly::Unit> FuseChannel::fuseLookup(
 
   XLOG(DBG7) << "FUSE_LOOKUP";
 
-  return dispatcher_->lookup(parent, name).thenValue([](fuse_entry_out param) {
-    RequestData::get().sendReply(param);
-  });
+  return dispatcher_->lookup(parent, name)
+      .thenValue([this](fuse_entry_out param) {
+        auto& request = RequestData::get();
+        if (UNLIKELY(isRecordingTrace_.load(std::memory_order_acquire))) {
+          if (auto writer = *traceWriter_.rlock()) {
+            writer->recordLookupEntry(request.getReq().unique, param);
+          }
+        }
+        request.sendReply(param);
+      });
 }
 
 folly::Future<folly::Unit> FuseChannel::fuseForget(
@@ -1673,6 +2147,19 @@ folly::Future<folly::Unit> FuseChannel::fuseReadDir(
       });
 }
 
+folly::Future<folly::Unit> FuseChannel::fuseReadDirPlus(
+    const fuse_in_header* /*header*/,
+    const uint8_t* arg) {
+  auto read = reinterpret_cast<const fuse_read_in*>(arg);
+  XLOG(DBG7) << "FUSE_READDIRPLUS";
+  const auto dh = dispatcher_->getDirHandle(read->fh);
+  return dh->readdirplus(DirList(read->size), read->offset)
+      .thenValue([](DirList&& list) {
+        const auto buf = list.getBuf();
+        RequestData::get().sendReply(StringPiece(buf));
+      });
+}
+
 folly::Future<folly::Unit> FuseChannel::fuseReleaseDir(
     const fuse_in_header* /*header*/,
     const uint8_t* arg) {
@@ -1767,12 +2254,14 @@ folly::Future<folly::Unit> FuseChannel::fuseBatchForget(
   const auto forgets = reinterpret_cast<const fuse_batch_forget_in*>(arg);
   auto item = reinterpret_cast<const fuse_forget_one*>(forgets + 1);
   const auto end = item + forgets->count;
-  XLOG(DBG7) << "FUSE_BATCH_FORGET";
+  XLOG(DBG7) << "FUSE_BATCH_FORGET count=" << forgets->count;
 
-  while (item != end) {
-    dispatcher_->forget(InodeNumber{item->nodeid}, item->nlookup);
-    ++item;
+  std::vector<InodeForget> batch;
+  batch.reserve(forgets->count);
+  for (; item != end; ++item) {
+    batch.emplace_back(InodeNumber{item->nodeid}, item->nlookup);
   }
+  dispatcher_->batchForget(folly::range(batch));
   return Unit{};
 }
 
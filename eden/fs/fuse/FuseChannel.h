@@ -10,10 +10,12 @@
 #pragma once
 #include <folly/File.h>
 #include <folly/Synchronized.h>
+#include <folly/ThreadLocal.h>
 #include <folly/futures/Future.h>
 #include <folly/futures/Promise.h>
 #include <stdlib.h>
 #include <sys/uio.h>
+#include <atomic>
 #include <condition_variable>
 #include <iosfwd>
 #include <memory>
@@ -24,8 +26,10 @@
 
 #include "eden/fs/fuse/FuseTypes.h"
 #include "eden/fs/utils/PathFuncs.h"
+#include "eden/fs/utils/ThreadAffinity.h"
 
 namespace folly {
+class CPUThreadPoolExecutor;
 class RequestContext;
 struct Unit;
 } // namespace folly
@@ -33,7 +37,9 @@ struct Unit;
 namespace facebook {
 namespace eden {
 
+class BufVec;
 class Dispatcher;
+class FuseTraceWriter;
 
 class FuseChannel {
  public:
@@ -209,10 +215,15 @@ class FuseChannel {
    * status (no additional payload).
    * `err` may be 0 (indicating success) or a positive errno value.
    *
+   * The reply methods take the FUSE device that the request was read from,
+   * since the kernel only accepts the reply to a request on that device.
+   * Each worker thread may read from its own clone of the device; see
+   * cloneFuseDevice().
+   *
    * throws system_error if the write fails.  Writes can fail if the
    * data we send to the kernel is invalid.
    */
-  void replyError(const fuse_in_header& request, int err);
+  void replyError(int fuseDevice, const fuse_in_header& request, int err);
 
   /**
    * Sends a raw data packet to the kernel.
@@ -225,7 +236,7 @@ class FuseChannel {
    * throws system_error if the write fails.  Writes can fail if the
    * data we send to the kernel is invalid.
    */
-  void sendRawReply(const iovec iov[], size_t count) const;
+  void sendRawReply(int fuseDevice, const iovec iov[], size_t count) const;
 
   /**
    * Sends a range of contiguous bytes as a reply to the kernel.
@@ -236,7 +247,10 @@ class FuseChannel {
    * throws system_error if the write fails.  Writes can fail if the
    * data we send to the kernel is invalid.
    */
-  void sendReply(const fuse_in_header& request, folly::ByteRange bytes) const;
+  void sendReply(
+      int fuseDevice,
+      const fuse_in_header& request,
+      folly::ByteRange bytes) const;
 
   /**
    * Sends a reply to a kernel request, consisting of multiple parts.
@@ -247,8 +261,46 @@ class FuseChannel {
    * throws system_error if the write fails.  Writes can fail if the
    * data we send to the kernel is invalid.
    */
-  void sendReply(const fuse_in_header& request, folly::fbvector<iovec>&& vec)
-      const;
+  void sendReply(
+      int fuseDevice,
+      const fuse_in_header& request,
+      folly::fbvector<iovec>&& vec) const;
+
+  /**
+   * Sends the contents of a BufVec as the reply to a kernel request.
+   *
+   * If the BufVec refers to a range of a file and canSpliceReplies() is
+   * true, the data is moved from the file to the FUSE device with splice(2)
+   * rather than being read into memory first.
+   *
+   * throws system_error if the write fails.  Writes can fail if the
+   * data we send to the kernel is invalid.
+   */
+  void sendReply(
+      int fuseDevice,
+      const fuse_in_header& request,
+      const BufVec& buf) const;
+
+  /**
+   * Returns true if sendReply() will splice file-backed BufVecs to the FUSE
+   * device.  This requires --fuse_splice_reads, and a kernel that reported
+   * FUSE_SPLICE_WRITE support during the FUSE_INIT handshake.
+   *
+   * This is only meaningful once initialization has completed.
+   */
+  bool canSpliceReplies() const;
+
+  /**
+   * Returns true if the kernel caches writes and sends them to us later
+   * (FUSE_WRITEBACK_CACHE).
+   *
+   * In this mode the kernel is authoritative for the size and timestamps of
+   * files it has cached data for: it sends the mtime and ctime with setattr()
+   * when it flushes, so writes should not update them.
+   *
+   * This is only meaningful once initialization has completed.
+   */
+  bool isWritebackCacheEnabled() const;
 
   /**
    * Sends a reply to the kernel.
@@ -259,8 +311,12 @@ class FuseChannel {
    * data we send to the kernel is invalid.
    */
   template <typename T>
-  void sendReply(const fuse_in_header& request, const T& payload) const {
+  void sendReply(
+      int fuseDevice,
+      const fuse_in_header& request,
+      const T& payload) const {
     sendReply(
+        fuseDevice,
         request,
         folly::ByteRange{reinterpret_cast<const uint8_t*>(&payload),
                          sizeof(T)});
@@ -279,6 +335,18 @@ class FuseChannel {
    */
   std::vector<fuse_in_header> getOutstandingRequests();
 
+  /**
+   * Record the requests this channel receives into writer, replacing any
+   * recording already in progress.
+   */
+  void startTraceRecording(std::shared_ptr<FuseTraceWriter> writer);
+
+  /**
+   * Stop recording requests, and return the writer that was recording them,
+   * or null if none was.
+   */
+  std::shared_ptr<FuseTraceWriter> stopTraceRecording();
+
  private:
   struct HandlerEntry;
   using HandlerMap = std::unordered_map<uint32_t, HandlerEntry>;
@@ -304,6 +372,19 @@ class FuseChannel {
      */
     size_t stoppedThreads{0};
 
+    /**
+     * Worker threads beyond numThreads_ are started when all of the existing
+     * ones are busy, and exit again once enough threads are idle.
+     *
+     * retiringThreads counts threads that have decided to exit but have not
+     * yet done so.  retiredThreadIds lists threads that have exited and
+     * still need to be joined and removed from workerThreads; this is done
+     * the next time the pool grows.  Retired threads are included in
+     * stoppedThreads until then.
+     */
+    size_t retiringThreads{0};
+    std::vector<std::thread::id> retiredThreadIds;
+
     /**
      * If destroyPending is true, the FuseChannel object should be
      * automatically destroyed when the last outstanding request finishes.
@@ -321,6 +402,12 @@ class FuseChannel {
   struct DataRange {
     DataRange(int64_t offset, int64_t length);
 
+    /**
+     * Extend this range so that invalidating it also invalidates everything
+     * that invalidating `other` would.
+     */
+    void merge(const DataRange& other);
+
     int64_t offset;
     int64_t length;
   };
@@ -439,6 +526,9 @@ class FuseChannel {
   folly::Future<folly::Unit> fuseReadDir(
       const fuse_in_header* header,
       const uint8_t* arg);
+  folly::Future<folly::Unit> fuseReadDirPlus(
+      const fuse_in_header* header,
+      const uint8_t* arg);
   folly::Future<folly::Unit> fuseReleaseDir(
       const fuse_in_header* header,
       const uint8_t* arg);
@@ -464,6 +554,23 @@ class FuseChannel {
   void invalidationThread() noexcept;
   void stopInvalidationThread();
   void sendInvalidation(InvalidationEntry& entry);
+
+  /**
+   * Coalesce a batch of entries taken from the invalidation queue.
+   *
+   * Duplicate directory entry invalidations are dropped, and invalidations of
+   * the same inode are merged into one covering all of the requested ranges.
+   * FLUSH entries are removed from the batch and their promises returned;
+   * they can be fulfilled once the remaining entries have been sent.
+   */
+  static std::vector<folly::Promise<folly::Unit>> coalesceInvalidations(
+      std::vector<InvalidationEntry>& entries);
+
+  /**
+   * Send a coalesced batch of invalidations, spreading large batches across
+   * the invalidation executor.  Returns once all of them have been sent.
+   */
+  void sendInvalidations(std::vector<InvalidationEntry>& entries);
   void sendInvalidateInode(InodeNumber ino, int64_t off, int64_t len);
   void sendInvalidateEntry(InodeNumber parent, PathComponentPiece name);
   void readInitPacket();
@@ -495,8 +602,50 @@ class FuseChannel {
    * This function blocks until the fuse session is stopped.
    * The intent is that this is called from each of the
    * fuse worker threads provided by the MountPoint.
+   *
+   * Returns true if the thread should exit because the pool has more idle
+   * threads than it needs, and false if the session is being torn down.
+   */
+  bool processSession();
+
+  /**
+   * Returns the device that the calling worker thread should read requests
+   * from: its own clone of fuseDevice_ if --fuse_clone_device is set and the
+   * kernel supports FUSE_DEV_IOC_CLONE, or fuseDevice_ itself otherwise.
+   *
+   * With a clone of its own, each thread waits on its own queue in the
+   * kernel rather than all of them contending for the one queue of
+   * fuseDevice_.  The kernel only accepts replies to the requests read from
+   * a clone on that clone, and fails any requests that are still
+   * outstanding when it is closed, so each request keeps a reference to the
+   * device it was read from.
    */
-  void processSession();
+  std::shared_ptr<folly::File> cloneFuseDevice();
+
+  /**
+   * Start another worker thread if none are idle and we are below
+   * --fuse_max_worker_threads.  Also joins threads that have retired.
+   */
+  void maybeAddWorkerThread();
+
+  /**
+   * Returns true if the calling worker thread should exit, because we have
+   * more threads than numThreads_ and more than enough of them are idle.
+   */
+  bool tryRetireWorkerThread();
+
+  /**
+   * Reserve one of the --fuse_max_blocking_workers slots for a request that
+   * may block.  The caller must decrement blockingWorkers_ afterwards.
+   * Returns false if all of the slots are in use.
+   */
+  bool tryAcquireBlockingWorker();
+
+  /**
+   * Returns true once every worker thread has stopped, including the case
+   * where threads were stopped before all numThreads_ had been started.
+   */
+  bool allWorkerThreadsStopped(const State& state) const;
 
   /**
    * Requests that the worker threads terminate their processing loop.
@@ -506,11 +655,42 @@ class FuseChannel {
       const folly::Synchronized<State>::LockedPtr& state,
       StopReason reason);
 
+  /**
+   * A pipe used to splice reply data from a file to the FUSE device.  Each
+   * thread that sends replies has its own, created the first time it is
+   * needed.
+   */
+  struct SplicePipe {
+    folly::File readEnd;
+    folly::File writeEnd;
+  };
+
+  /**
+   * Returns the calling thread's SplicePipe, or nullptr if it could not be
+   * created.
+   */
+  SplicePipe* getSplicePipe() const;
+
+  /**
+   * Try to send the given file range as the reply to request with splice(2).
+   *
+   * Returns false without sending anything if the data could not be moved
+   * into the pipe, for instance because the file is shorter than expected,
+   * in which case the caller should send the reply some other way.
+   */
+  bool trySpliceReply(
+      int fuseDevice,
+      const fuse_in_header& request,
+      int fd,
+      off_t offset,
+      size_t length) const;
+
   /*
    * Constant state that does not change for the lifetime of the FuseChannel
    */
-  const size_t bufferSize_{0};
   const size_t numThreads_;
+  // The CPUs the worker threads run on, from --fuse_thread_affinity.
+  const CpuAffinity threadAffinity_;
   Dispatcher* const dispatcher_{nullptr};
   const AbsolutePath mountPath_;
 
@@ -520,6 +700,24 @@ class FuseChannel {
    */
   folly::Optional<fuse_init_out> connInfo_;
 
+  /*
+   * The size of the buffer each worker thread reads requests into.  This
+   * must be large enough for a write of connInfo_->max_write bytes, so it
+   * may grow when taking over a mount from a process that negotiated a
+   * larger max_write, but is constant once the worker threads start.
+   */
+  size_t bufferSize_{0};
+
+  mutable folly::ThreadLocal<SplicePipe> splicePipes_;
+
+  /*
+   * The number of worker threads waiting in read() for the next request,
+   * and the number running the synchronous part of a handler that may
+   * block.
+   */
+  std::atomic<size_t> idleWorkers_{0};
+  std::atomic<size_t> blockingWorkers_{0};
+
   /*
    * fuseDevice_ is constant while the worker threads are running.
    *
@@ -550,11 +748,19 @@ class FuseChannel {
   // To prevent logging unsupported opcodes twice.
   folly::Synchronized<std::unordered_set<FuseOpcode>> unhandledOpcodes_;
 
+  // The trace being recorded, if any.  isRecordingTrace_ lets requests skip
+  // the lock when nothing is being recorded.
+  std::atomic<bool> isRecordingTrace_{false};
+  folly::Synchronized<std::shared_ptr<FuseTraceWriter>> traceWriter_;
+
   // State for sending inode invalidation requests to the kernel
   // These are processed in their own dedicated thread.
   folly::Synchronized<InvalidationQueue, std::mutex> invalidationQueue_;
   std::condition_variable invalidationCV_;
   std::thread invalidationThread_;
+  // Helper threads for sending large batches of invalidations.  This is null
+  // if --fuse_invalidation_threads is 1.
+  std::unique_ptr<folly::CPUThreadPoolExecutor> invalidationExecutor_;
 
   static const HandlerMap handlerMap_;
 };
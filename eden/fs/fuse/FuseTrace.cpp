@@ -0,0 +1,220 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/fuse/FuseTrace.h"
+
+#include <folly/Conv.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <folly/logging/xlog.h>
+#include <cstring>
+#include <stdexcept>
+
+using std::string;
+using namespace std::chrono;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+struct FuseTraceHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t recordSize;
+};
+
+static_assert(sizeof(FuseTraceHeader) == 16, "trace header size changed");
+static_assert(sizeof(FuseTraceRecord) == 56, "trace record size changed");
+
+constexpr size_t kFlushRecords = 1024;
+
+/**
+ * Returns the offset in arg of the first name of a request, or -1 if it has
+ * none.
+ */
+ssize_t getNameOffset(uint32_t opcode) {
+  switch (opcode) {
+    case FUSE_LOOKUP:
+    case FUSE_UNLINK:
+    case FUSE_RMDIR:
+    case FUSE_SYMLINK:
+      return 0;
+    case FUSE_MKDIR:
+      return sizeof(fuse_mkdir_in);
+    case FUSE_MKNOD:
+      return sizeof(fuse_mknod_in);
+    case FUSE_CREATE:
+      return sizeof(fuse_create_in);
+    case FUSE_RENAME:
+      return sizeof(fuse_rename_in);
+    case FUSE_LINK:
+      return sizeof(fuse_link_in);
+    case FUSE_GETXATTR:
+      return sizeof(fuse_getxattr_in);
+    default:
+      return -1;
+  }
+}
+
+template <typename T>
+const T* getArg(folly::ByteRange arg) {
+  return arg.size() >= sizeof(T) ? reinterpret_cast<const T*>(arg.data())
+                                 : nullptr;
+}
+} // namespace
+
+FuseTraceWriter::FuseTraceWriter(folly::File file, bool recordPids)
+    : start_{steady_clock::now()},
+      recordPids_{recordPids},
+      state_{folly::in_place, std::move(file)} {
+  FuseTraceHeader header = {};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.recordSize = sizeof(FuseTraceRecord);
+  auto state = state_.lock();
+  folly::checkUnixError(
+      folly::writeFull(state->file.fd(), &header, sizeof(header)),
+      "failed to write FUSE trace header");
+}
+
+FuseTraceWriter::~FuseTraceWriter() {
+  finish();
+}
+
+uint64_t FuseTraceWriter::now() const {
+  return duration_cast<nanoseconds>(steady_clock::now() - start_).count();
+}
+
+void FuseTraceWriter::recordRequest(
+    const fuse_in_header& header,
+    folly::ByteRange arg) {
+  FuseTraceRecord record = {};
+  record.kind = FuseTraceRecord::REQUEST;
+  record.opcode = header.opcode;
+  record.timeNs = now();
+  record.unique = header.unique;
+  record.nodeid = header.nodeid;
+  record.pid = recordPids_ ? header.pid : 0;
+
+  switch (header.opcode) {
+    case FUSE_READ:
+    case FUSE_READDIR:
+    case FUSE_READDIRPLUS:
+      if (const auto* read = getArg<fuse_read_in>(arg)) {
+        record.offset = read->offset;
+        record.size = read->size;
+      }
+      break;
+    case FUSE_WRITE:
+      if (const auto* write = getArg<fuse_write_in>(arg)) {
+        record.offset = write->offset;
+        record.size = write->size;
+      }
+      break;
+  }
+
+  folly::StringPiece name;
+  auto nameOffset = getNameOffset(header.opcode);
+  if (nameOffset >= 0 && static_cast<size_t>(nameOffset) < arg.size()) {
+    const auto* start = reinterpret_cast<const char*>(arg.data()) + nameOffset;
+    name = folly::StringPiece{
+        start, strnlen(start, arg.size() - static_cast<size_t>(nameOffset))};
+  }
+  append(record, name);
+}
+
+void FuseTraceWriter::recordLookupEntry(
+    uint64_t unique,
+    const fuse_entry_out& entry) {
+  FuseTraceRecord record = {};
+  record.kind = FuseTraceRecord::LOOKUP_ENTRY;
+  record.opcode = FUSE_LOOKUP;
+  record.timeNs = now();
+  record.unique = unique;
+  record.nodeid = entry.nodeid;
+  record.offset = entry.attr.size;
+  record.mode = entry.attr.mode;
+  append(record, folly::StringPiece{});
+}
+
+void FuseTraceWriter::append(
+    FuseTraceRecord record,
+    folly::StringPiece name) {
+  auto state = state_.lock();
+  if (state->closed) {
+    return;
+  }
+  if (!name.empty()) {
+    auto ret = state->nameIds.emplace(
+        name.str(), static_cast<uint32_t>(state->nameIds.size() + 1));
+    record.nameId = ret.first->second;
+  }
+  state->buffer.push_back(record);
+  if (state->buffer.size() >= kFlushRecords) {
+    flush(*state);
+  }
+}
+
+void FuseTraceWriter::flush(State& state) {
+  if (state.buffer.empty()) {
+    return;
+  }
+  auto bytes = state.buffer.size() * sizeof(FuseTraceRecord);
+  auto written = folly::writeFull(state.file.fd(), state.buffer.data(), bytes);
+  if (written != static_cast<ssize_t>(bytes)) {
+    XLOG(ERR) << "failed to write FUSE trace, dropping the rest of it: "
+              << folly::errnoStr(errno);
+    state.closed = true;
+  } else {
+    state.recordsWritten += state.buffer.size();
+  }
+  state.buffer.clear();
+}
+
+size_t FuseTraceWriter::finish() {
+  auto state = state_.lock();
+  if (!state->closed) {
+    flush(*state);
+    state->closed = true;
+  }
+  return state->recordsWritten;
+}
+
+std::vector<FuseTraceRecord> readFuseTrace(folly::StringPiece path) {
+  string contents;
+  if (!folly::readFile(path.str().c_str(), contents)) {
+    folly::throwSystemError("failed to read FUSE trace ", path);
+  }
+  FuseTraceHeader header;
+  if (contents.size() < sizeof(header)) {
+    throw std::invalid_argument(
+        folly::to<string>(path, " is too short to be a FUSE trace"));
+  }
+  memcpy(&header, contents.data(), sizeof(header));
+  if (header.magic != FuseTraceWriter::kMagic ||
+      header.version != FuseTraceWriter::kVersion ||
+      header.recordSize != sizeof(FuseTraceRecord)) {
+    throw std::invalid_argument(folly::to<string>(
+        path, " is not a version ", FuseTraceWriter::kVersion, " FUSE trace"));
+  }
+
+  // A trace that was being written when edenfs died may end in a partial
+  // record, which is dropped.
+  auto count = (contents.size() - sizeof(header)) / sizeof(FuseTraceRecord);
+  std::vector<FuseTraceRecord> records(count);
+  memcpy(
+      records.data(),
+      contents.data() + sizeof(header),
+      count * sizeof(FuseTraceRecord));
+  return records;
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/File.h>
+#include <folly/Range.h>
+#include <folly/Synchronized.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "eden/fs/fuse/FuseTypes.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * One record of a FUSE trace: either a request the mount received, or the
+ * entry that a FUSE_LOOKUP replied with, which lets a replay rebuild the
+ * part of the tree that the trace used.
+ *
+ * Names are anonymized: each distinct name in a trace is replaced by a
+ * number, in the order the names were first seen.  File contents and
+ * attribute values other than the mode and size are never recorded.
+ *
+ * Records are written in the host's byte order.
+ */
+struct FuseTraceRecord {
+  enum Kind : uint8_t {
+    REQUEST = 1,
+    LOOKUP_ENTRY = 2,
+  };
+
+  Kind kind;
+  uint8_t unused[3];
+  uint32_t opcode;
+  /** Nanoseconds from the start of the recording. */
+  uint64_t timeNs;
+  /** Matches a LOOKUP_ENTRY to the request it answers. */
+  uint64_t unique;
+  /** The request's inode, or the inode that was looked up. */
+  uint64_t nodeid;
+  /** The offset of reads, writes and readdirs, or the entry's file size. */
+  uint64_t offset;
+  /** The size of reads, writes and readdirs. */
+  uint32_t size;
+  /** The request's first name, or 0 if it has none. */
+  uint32_t nameId;
+  /** The requesting process, or 0 if pids were not recorded. */
+  uint32_t pid;
+  /** The entry's mode. */
+  uint32_t mode;
+};
+
+/**
+ * FuseTraceWriter records the requests a FuseChannel receives into a file,
+ * for replaying them later with eden/fs/inodes/test/FuseTraceReplay.cpp.
+ *
+ * Records are buffered and written in batches.  If a write fails the error
+ * is logged and the rest of the trace is dropped.
+ *
+ * FuseTraceWriter is thread-safe.
+ */
+class FuseTraceWriter {
+ public:
+  static constexpr uint64_t kMagic = 0x4543415254534645; // "EFSTRACE"
+  static constexpr uint32_t kVersion = 1;
+
+  FuseTraceWriter(folly::File file, bool recordPids);
+  ~FuseTraceWriter();
+
+  FuseTraceWriter(const FuseTraceWriter&) = delete;
+  FuseTraceWriter& operator=(const FuseTraceWriter&) = delete;
+
+  /**
+   * Record a request.  arg is the data following the fuse_in_header.
+   */
+  void recordRequest(const fuse_in_header& header, folly::ByteRange arg);
+
+  /**
+   * Record the reply to the FUSE_LOOKUP with the given unique ID.
+   */
+  void recordLookupEntry(uint64_t unique, const fuse_entry_out& entry);
+
+  /**
+   * Write any buffered records, and return the number of records written.
+   * Later records are dropped.
+   */
+  size_t finish();
+
+ private:
+  struct State {
+    explicit State(folly::File f) : file{std::move(f)} {}
+
+    folly::File file;
+    std::vector<FuseTraceRecord> buffer;
+    std::unordered_map<std::string, uint32_t> nameIds;
+    size_t recordsWritten{0};
+    bool closed{false};
+  };
+
+  void append(FuseTraceRecord record, folly::StringPiece name);
+  void flush(State& state);
+  uint64_t now() const;
+
+  const std::chrono::steady_clock::time_point start_;
+  const bool recordPids_;
+  folly::Synchronized<State, std::mutex> state_;
+};
+
+/**
+ * Read all of the records of a trace written by FuseTraceWriter.  Throws if
+ * the file cannot be read or is not a valid trace.
+ */
+std::vector<FuseTraceRecord> readFuseTrace(folly::StringPiece path);
+
+} // namespace eden
+} // namespace facebook
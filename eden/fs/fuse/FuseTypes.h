@@ -10,6 +10,7 @@
 #pragma once
 #include <folly/File.h>
 #include <folly/Format.h>
+#include <folly/Range.h>
 #include <functional>
 #include <iosfwd>
 #include <utility>
@@ -117,6 +118,11 @@ void toAppend(InodeNumber ino, folly::fbstring* result);
 
 using FuseOpcode = decltype(std::declval<fuse_in_header>().opcode);
 
+/**
+ * Returns the name of a FUSE opcode, e.g. "FUSE_LOOKUP", or "<unknown>".
+ */
+folly::StringPiece fuseOpcodeName(FuseOpcode opcode);
+
 /** Encapsulates the fuse device & connection information for a mount point.
  * This is the data that is required to be passed to a new process when
  * performing a graceful restart in order to re-establish the FuseChannel.
@@ -10,9 +10,19 @@
 #include "eden/fs/fuse/RequestData.h"
 
 #include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
+#include <initializer_list>
 
 #include "eden/fs/fuse/Dispatcher.h"
 #include "eden/fs/utils/SystemError.h"
+#include "eden/fs/utils/TraceBuffer.h"
+
+DEFINE_uint64(
+    fuse_stage_timing_sample_rate,
+    100,
+    "Time the stages of one in this many FUSE requests on each thread: the "
+    "wait to be handled, the handler itself, inode loads and the reply.  0 "
+    "turns this off.");
 
 using namespace folly;
 using namespace std::chrono;
@@ -20,13 +30,44 @@ using namespace std::chrono;
 namespace facebook {
 namespace eden {
 
+namespace {
+// Indexed by RequestData::Stage.
+constexpr EdenStats::HistogramPtr kStageHistograms[] = {
+    &EdenStats::requestQueueWait,
+    &EdenStats::requestDispatch,
+    &EdenStats::requestInodeLoad,
+    &EdenStats::requestReplyWrite,
+};
+static_assert(
+    sizeof(kStageHistograms) / sizeof(kStageHistograms[0]) ==
+        static_cast<size_t>(RequestData::Stage::NUM_STAGES),
+    "every stage needs a histogram");
+
+bool shouldTimeStages() {
+  const auto sampleRate = FLAGS_fuse_stage_timing_sample_rate;
+  if (sampleRate == 0) {
+    return false;
+  }
+  static thread_local uint64_t requests = 0;
+  if (++requests < sampleRate) {
+    return false;
+  }
+  requests = 0;
+  return true;
+}
+} // namespace
+
 const std::string RequestData::kKey("fuse");
 
 RequestData::RequestData(
     FuseChannel* channel,
     const fuse_in_header& fuseHeader,
-    Dispatcher* dispatcher)
-    : channel_(channel), fuseHeader_(fuseHeader), dispatcher_(dispatcher) {}
+    Dispatcher* dispatcher,
+    std::shared_ptr<folly::File> fuseDevice)
+    : channel_(channel),
+      fuseHeader_(fuseHeader),
+      fuseDevice_(std::move(fuseDevice)),
+      dispatcher_(dispatcher) {}
 
 RequestData::~RequestData() {
   channel_->finishRequest(fuseHeader_);
@@ -39,6 +80,7 @@ void RequestData::interrupt() {
   // Otherwise, the thread launching the request will be responsible for
   // interrupting it after it finishes launching the operation inside
   // setRequestFuture().
+  cancellation_.cancel();
   auto oldValue = interruptFlag_.fetch_or(
       kInterruptRequestedFlag, std::memory_order_acq_rel);
   if (oldValue == kInterrupterInitialisedFlag) {
@@ -62,30 +104,86 @@ RequestData& RequestData::get() {
 RequestData& RequestData::create(
     FuseChannel* channel,
     const fuse_in_header& fuseHeader,
-    Dispatcher* dispatcher) {
+    Dispatcher* dispatcher,
+    std::shared_ptr<folly::File> fuseDevice) {
   folly::RequestContext::get()->setContextData(
       RequestData::kKey,
-      std::make_unique<RequestData>(channel, fuseHeader, dispatcher));
-  return get();
+      std::make_unique<RequestData>(
+          channel, fuseHeader, dispatcher, std::move(fuseDevice)));
+  auto& data = get();
+  CancellationToken::setCurrent(data.cancellation_.getToken());
+  return data;
 }
 
 Future<folly::Unit> RequestData::startRequest(
     ThreadLocalEdenStats* stats,
+    ThreadLocalEdenStats* mountStats,
     EdenStats::HistogramPtr histogram) {
-  startTime_ = steady_clock::now();
+  startTicks_ = CycleClock::now();
+  timingStages_ = shouldTimeStages();
   DCHECK(latencyHistogram_ == nullptr);
   latencyHistogram_ = histogram;
   stats_ = stats;
+  mountStats_ = mountStats;
+  opcode_ = fuseHeader_.opcode;
+  traceRequestId_ = TraceBuffer::startRequest();
+  TraceBuffer::record(
+      TraceEventKind::FUSE_REQUEST,
+      TracePhase::BEGIN,
+      traceRequestId_,
+      opcode_);
+  stats_->get()->getInflightCounter(opcode_).incrementValue(1);
+  if (mountStats_) {
+    mountStats_->get()->getInflightCounter(opcode_).incrementValue(1);
+  }
   return folly::unit;
 }
 
 void RequestData::finishRequest() {
-  const auto now = steady_clock::now();
-  const auto now_since_epoch = duration_cast<seconds>(now.time_since_epoch());
-  const auto diff = duration_cast<microseconds>(now - startTime_);
-  stats_->get()->recordLatency(latencyHistogram_, diff, now_since_epoch);
+  const auto now_since_epoch = duration_cast<seconds>(
+      CycleClock::coarseSteadyNow().time_since_epoch());
+  const auto diff = duration_cast<microseconds>(
+      CycleClock::elapsed(startTicks_, CycleClock::now()));
+  for (auto* stats : {stats_, mountStats_}) {
+    if (stats) {
+      auto* threadStats = stats->get();
+      threadStats->recordLatency(latencyHistogram_, diff, now_since_epoch);
+      threadStats->getInflightCounter(opcode_).incrementValue(-1);
+      if (timingStages_) {
+        for (size_t stage = 0; stage < kNumStages; ++stage) {
+          threadStats->recordLatency(
+              kStageHistograms[stage],
+              duration_cast<microseconds>(nanoseconds{
+                  stageNanos_[stage].load(std::memory_order_relaxed)}),
+              now_since_epoch);
+        }
+      }
+    }
+  }
+  TraceBuffer::record(
+      TraceEventKind::FUSE_REQUEST,
+      TracePhase::END,
+      traceRequestId_,
+      opcode_);
   latencyHistogram_ = nullptr;
   stats_ = nullptr;
+  mountStats_ = nullptr;
+}
+
+void RequestData::addStageTime(
+    Stage stage,
+    CycleClock::Ticks start,
+    CycleClock::Ticks end) {
+  stageNanos_[static_cast<size_t>(stage)].fetch_add(
+      CycleClock::elapsed(start, end).count(), std::memory_order_relaxed);
+}
+
+void RequestData::recordBytes(EdenStats::TimeseriesPtr item, int64_t bytes) {
+  for (auto* stats : {stats_, mountStats_}) {
+    if (stats) {
+      (stats->get()->*item).addValue(bytes);
+    }
+  }
 }
 
 fuse_in_header RequestData::stealReq() {
@@ -115,7 +213,8 @@ Dispatcher* RequestData::getDispatcher() const {
 }
 
 void RequestData::replyError(int err) {
-  channel_->replyError(stealReq(), err);
+  auto timer = timeStage(Stage::REPLY_WRITE);
+  channel_->replyError(fuseDevice_->fd(), stealReq(), err);
 }
 
 void RequestData::replyNone() {
@@ -10,11 +10,14 @@
 #pragma once
 #include <folly/futures/Future.h>
 #include <folly/io/async/Request.h>
+#include <array>
 #include <atomic>
 #include <utility>
 #include "eden/fs/fuse/EdenStats.h"
 #include "eden/fs/fuse/FuseChannel.h"
 #include "eden/fs/fuse/FuseTypes.h"
+#include "eden/fs/utils/Cancellation.h"
+#include "eden/fs/utils/CycleClock.h"
 
 namespace facebook {
 namespace eden {
@@ -24,15 +27,61 @@ class Dispatcher;
 class RequestData : public folly::RequestData {
   FuseChannel* channel_;
   fuse_in_header fuseHeader_;
+  // The FUSE device the request was read from, which replies must be sent
+  // to.  Holding it keeps a worker thread's clone of the device open until
+  // its last request has been answered.
+  std::shared_ptr<folly::File> fuseDevice_;
   // Needed to track stats
-  std::chrono::time_point<std::chrono::steady_clock> startTime_;
+  CycleClock::Ticks startTicks_{0};
   EdenStats::HistogramPtr latencyHistogram_{nullptr};
   ThreadLocalEdenStats* stats_{nullptr};
+  ThreadLocalEdenStats* mountStats_{nullptr};
+  FuseOpcode opcode_{0};
+  uint64_t traceRequestId_{0};
   Dispatcher* dispatcher_{nullptr};
 
   fuse_in_header stealReq();
 
  public:
+  /**
+   * The stages of a request that are timed for one in every
+   * --fuse_stage_timing_sample_rate requests.
+   */
+  enum class Stage : uint8_t {
+    QUEUE_WAIT,
+    DISPATCH,
+    INODE_LOAD,
+    REPLY_WRITE,
+    NUM_STAGES,
+  };
+
+  /**
+   * Adds the time from its construction to its destruction to one stage of
+   * a request, or does nothing if the request's stages are not being timed.
+   */
+  class StageTimer {
+   public:
+    StageTimer(RequestData* request, Stage stage)
+        : request_{request},
+          stage_{stage},
+          start_{request ? CycleClock::now() : 0} {}
+    StageTimer(StageTimer&& other) noexcept
+        : request_{other.request_}, stage_{other.stage_}, start_{other.start_} {
+      other.request_ = nullptr;
+    }
+    StageTimer& operator=(StageTimer&&) = delete;
+    ~StageTimer() {
+      if (request_) {
+        request_->addStageTime(stage_, start_, CycleClock::now());
+      }
+    }
+
+   private:
+    RequestData* request_;
+    Stage stage_;
+    CycleClock::Ticks start_;
+  };
+
   static const std::string kKey;
   RequestData(const RequestData&) = delete;
   RequestData& operator=(const RequestData&) = delete;
@@ -41,13 +90,15 @@ class RequestData : public folly::RequestData {
   explicit RequestData(
       FuseChannel* channel,
       const fuse_in_header& fuseHeader,
-      Dispatcher* dispatcher);
+      Dispatcher* dispatcher,
+      std::shared_ptr<folly::File> fuseDevice);
   ~RequestData();
   static RequestData& get();
   static RequestData& create(
       FuseChannel* channel,
       const fuse_in_header& fuseHeader,
-      Dispatcher* dispatcher);
+      Dispatcher* dispatcher,
+      std::shared_ptr<folly::File> fuseDevice);
 
   bool hasCallback() override {
     return false;
@@ -57,11 +108,63 @@ class RequestData : public folly::RequestData {
   // a FUSE request, false otherwise.
   static bool isFuseRequest();
 
+  /**
+   * Start timing the request.  Its latency and in-flight count are recorded
+   * in stats, and also in mountStats if that is non-null.
+   */
   folly::Future<folly::Unit> startRequest(
       ThreadLocalEdenStats* stats,
+      ThreadLocalEdenStats* mountStats,
       EdenStats::HistogramPtr histogram);
   void finishRequest();
 
+  StageTimer timeStage(Stage stage) {
+    return StageTimer{timingStages_ ? this : nullptr, stage};
+  }
+
+  /**
+   * Call the request's handler, timing the wait since startRequest() and
+   * the handler's synchronous work.
+   */
+  template <typename Fn>
+  folly::Future<folly::Unit> runHandler(Fn&& handler) {
+    if (LIKELY(!timingStages_)) {
+      return handler();
+    }
+    auto timer = timeStage(Stage::DISPATCH);
+    addStageTime(Stage::QUEUE_WAIT, startTicks_, CycleClock::now());
+    return handler();
+  }
+
+  /**
+   * If the current request's stages are being timed, add the time from
+   * start, read before starting to load an inode, until future completes to
+   * its INODE_LOAD stage.  Loads may overlap, so the stage is the sum of
+   * their times.
+   */
+  template <typename T>
+  static folly::Future<T> timeInodeLoad(
+      folly::Future<T>&& future,
+      CycleClock::Ticks start) {
+    if (!isFuseRequest()) {
+      return std::move(future);
+    }
+    auto& request = get();
+    if (LIKELY(!request.timingStages_)) {
+      return std::move(future);
+    }
+    // The callback holds the request's context, which owns the request.
+    return std::move(future).ensure([&request, start] {
+      request.addStageTime(Stage::INODE_LOAD, start, CycleClock::now());
+    });
+  }
+
+  /**
+   * Add the number of bytes transferred by this request to the given
+   * timeseries of the same stats as startRequest().
+   */
+  void recordBytes(EdenStats::TimeseriesPtr item, int64_t bytes);
+
   // Returns the associated dispatcher instance
   Dispatcher* getDispatcher() const;
 
@@ -113,19 +216,28 @@ class RequestData : public folly::RequestData {
 
   template <typename T>
   void sendReply(const T& payload) {
-    channel_->sendReply(stealReq(), payload);
+    auto timer = timeStage(Stage::REPLY_WRITE);
+    channel_->sendReply(fuseDevice_->fd(), stealReq(), payload);
   }
 
   void sendReply(folly::ByteRange bytes) {
-    channel_->sendReply(stealReq(), bytes);
+    auto timer = timeStage(Stage::REPLY_WRITE);
+    channel_->sendReply(fuseDevice_->fd(), stealReq(), bytes);
   }
 
   void sendReply(folly::fbvector<iovec>&& vec) {
-    channel_->sendReply(stealReq(), std::move(vec));
+    auto timer = timeStage(Stage::REPLY_WRITE);
+    channel_->sendReply(fuseDevice_->fd(), stealReq(), std::move(vec));
   }
 
   void sendReply(folly::StringPiece piece) {
-    channel_->sendReply(stealReq(), folly::ByteRange(piece));
+    auto timer = timeStage(Stage::REPLY_WRITE);
+    channel_->sendReply(fuseDevice_->fd(), stealReq(), folly::ByteRange(piece));
+  }
+
+  void sendReply(const BufVec& buf) {
+    auto timer = timeStage(Stage::REPLY_WRITE);
+    channel_->sendReply(fuseDevice_->fd(), stealReq(), buf);
   }
 
   // Reply with a negative errno value or 0 for success
@@ -136,10 +248,26 @@ class RequestData : public folly::RequestData {
 
   // Notify this request about EINTR.  This causes the future to be
   // cancel()'d and may result in it stopping what it was doing
-  // before it is complete.
+  // before it is complete.  It also cancels the request's
+  // CancellationToken, so that queued imports that only this request is
+  // waiting for are dropped.
   void interrupt();
 
  private:
+  static constexpr size_t kNumStages = static_cast<size_t>(Stage::NUM_STAGES);
+
+  void addStageTime(
+      Stage stage,
+      CycleClock::Ticks start,
+      CycleClock::Ticks end);
+
+  CancellationSource cancellation_;
+
+  bool timingStages_{false};
+  // Stages may be timed on several threads at once, e.g. by concurrent
+  // inode loads.
+  std::array<std::atomic<uint64_t>, kNumStages> stageNanos_{};
+
   folly::Future<folly::Unit> interrupter_;
 
   // This atomic variable is a set of two flags is used to decide the race
@@ -8,16 +8,34 @@
  *
  */
 #include <boost/filesystem.hpp>
+#include <folly/Conv.h>
 #include <folly/Exception.h>
+#include <folly/String.h>
 #include <folly/init/Init.h>
+#include <folly/io/IOBuf.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/io/async/EventBaseThread.h>
 #include <folly/logging/Init.h>
+#include <folly/logging/LogCategory.h>
+#include <folly/logging/LoggerDB.h>
 #include <folly/logging/xlog.h>
+#include <folly/stop_watch.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sysexits.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include "eden/fs/fuse/BufVec.h"
+#include "eden/fs/fuse/DirHandle.h"
+#include "eden/fs/fuse/DirList.h"
 #include "eden/fs/fuse/Dispatcher.h"
 #include "eden/fs/fuse/EdenStats.h"
+#include "eden/fs/fuse/FileHandle.h"
 #include "eden/fs/fuse/FuseChannel.h"
 #include "eden/fs/fuse/privhelper/PrivHelper.h"
 #include "eden/fs/fuse/privhelper/UserInfo.h"
@@ -27,36 +45,349 @@ using namespace facebook::eden;
 using namespace std::chrono_literals;
 using folly::exceptionStr;
 using folly::makeFuture;
+using folly::StringPiece;
 using std::string;
+using std::vector;
 
 DEFINE_int32(numFuseThreads, 4, "The number of FUSE worker threads");
+DEFINE_int32(dirs, 16, "Number of directories in the root of the mount");
+DEFINE_int32(files_per_dir, 64, "Number of files in each directory");
+DEFINE_int32(file_size, 4096, "Size of each file");
+DEFINE_int32(
+    dispatcher_latency_us,
+    0,
+    "Time the dispatcher spends on each request, on the FUSE worker thread, "
+    "to stand in for the cost of the inode layer");
+DEFINE_int32(
+    load_threads,
+    0,
+    "If non-zero, send requests to the mount from this many threads, report "
+    "the cost of each kind of request, and unmount.  Otherwise serve the "
+    "mount until it is unmounted.");
+DEFINE_int32(load_seconds, 5, "How long to run each load workload");
+DEFINE_string(
+    fuse_thread_counts,
+    "",
+    "Comma-separated numbers of FUSE worker threads to measure in load mode, "
+    "remounting for each.  Defaults to --numFuseThreads.");
 
 FOLLY_INIT_LOGGING_CONFIG("eden=DBG2,eden.fs.fuse=DBG7");
 
 namespace {
-class TestDispatcher : public Dispatcher {
+
+/**
+ * The requests that the dispatcher answers.  The FUSE channel handles
+ * RELEASE and RELEASEDIR itself.
+ */
+enum class Op {
+  LOOKUP,
+  GETATTR,
+  OPEN,
+  READ,
+  FLUSH,
+  OPENDIR,
+  READDIR,
+};
+constexpr size_t kNumOps = static_cast<size_t>(Op::READDIR) + 1;
+constexpr StringPiece kOpNames[kNumOps] =
+    {"LOOKUP", "GETATTR", "OPEN", "READ", "FLUSH", "OPENDIR", "READDIR"};
+
+struct OpCounts {
+  uint64_t count[kNumOps] = {};
+  uint64_t nanos[kNumOps] = {};
+};
+
+/**
+ * Counts the requests of each kind and the time the dispatcher spent on
+ * them, so that it can be subtracted from the time the client saw.
+ */
+class DispatcherStats {
  public:
-  TestDispatcher(ThreadLocalEdenStats* stats, const UserInfo& identity)
-      : Dispatcher(stats), identity_(identity) {}
+  class Timer {
+   public:
+    Timer(DispatcherStats& stats, Op op) : stats_(stats), op_(op) {
+      if (FLAGS_dispatcher_latency_us > 0) {
+        /* sleep override */ std::this_thread::sleep_for(
+            std::chrono::microseconds{FLAGS_dispatcher_latency_us});
+      }
+    }
+    ~Timer() {
+      auto index = static_cast<size_t>(op_);
+      stats_.count_[index] += 1;
+      stats_.nanos_[index] +=
+          std::chrono::nanoseconds{timer_.elapsed()}.count();
+    }
 
-  folly::Future<Attr> getattr(InodeNumber ino) override {
-    if (ino == kRootNodeId) {
-      struct stat st = {};
-      st.st_ino = ino.get();
+   private:
+    DispatcherStats& stats_;
+    Op op_;
+    folly::stop_watch<> timer_;
+  };
+
+  OpCounts get() const {
+    OpCounts counts;
+    for (size_t n = 0; n < kNumOps; ++n) {
+      counts.count[n] = count_[n].load();
+      counts.nanos[n] = nanos_[n].load();
+    }
+    return counts;
+  }
+
+ private:
+  std::atomic<uint64_t> count_[kNumOps] = {};
+  std::atomic<uint64_t> nanos_[kNumOps] = {};
+};
+
+/**
+ * The in-memory tree: --dirs directories in the root, each holding
+ * --files_per_dir files.  Inode numbers are computed from the position of
+ * each entry, so the tree takes no memory.
+ */
+class FakeTree {
+ public:
+  explicit FakeTree(const UserInfo& identity) : identity_(identity) {}
+
+  InodeNumber dirInode(uint64_t dir) const {
+    return InodeNumber{kRootNodeId.get() + 1 + dir};
+  }
+  InodeNumber fileInode(uint64_t dir, uint64_t file) const {
+    return InodeNumber{kRootNodeId.get() + 1 + FLAGS_dirs +
+                       dir * FLAGS_files_per_dir + file};
+  }
+
+  bool isRoot(InodeNumber ino) const {
+    return ino == kRootNodeId;
+  }
+  bool isDir(InodeNumber ino) const {
+    return ino.get() > kRootNodeId.get() &&
+        ino.get() <= kRootNodeId.get() + FLAGS_dirs;
+  }
+  bool isFile(InodeNumber ino) const {
+    return ino.get() > kRootNodeId.get() + FLAGS_dirs &&
+        ino.get() <= kRootNodeId.get() + FLAGS_dirs +
+            uint64_t(FLAGS_dirs) * FLAGS_files_per_dir;
+  }
+
+  /**
+   * The number of entries in a directory, and the name and inode of each.
+   */
+  size_t getEntryCount(InodeNumber dir) const {
+    return isRoot(dir) ? FLAGS_dirs : FLAGS_files_per_dir;
+  }
+  string getEntryName(InodeNumber dir, size_t index) const {
+    return folly::to<string>(isRoot(dir) ? "dir" : "file", index);
+  }
+  InodeNumber getEntryInode(InodeNumber dir, size_t index) const {
+    if (isRoot(dir)) {
+      return dirInode(index);
+    }
+    return fileInode(dir.get() - dirInode(0).get(), index);
+  }
+
+  folly::Optional<InodeNumber> find(InodeNumber dir, StringPiece name) const {
+    auto prefix = isRoot(dir) ? StringPiece{"dir"} : StringPiece{"file"};
+    if (!(isRoot(dir) || isDir(dir)) || !name.startsWith(prefix)) {
+      return folly::none;
+    }
+    auto index = folly::tryTo<size_t>(name.subpiece(prefix.size()));
+    if (!index.hasValue() || *index >= getEntryCount(dir) ||
+        getEntryName(dir, *index) != name) {
+      return folly::none;
+    }
+    return getEntryInode(dir, *index);
+  }
+
+  struct stat getStat(InodeNumber ino) const {
+    struct stat st = {};
+    st.st_ino = ino.get();
+    st.st_uid = identity_.getUid();
+    st.st_gid = identity_.getGid();
+    st.st_blksize = 512;
+    if (isFile(ino)) {
+      st.st_mode = S_IFREG | 0644;
+      st.st_nlink = 1;
+      st.st_size = FLAGS_file_size;
+      st.st_blocks = (FLAGS_file_size + 511) / 512;
+    } else if (isRoot(ino) || isDir(ino)) {
       st.st_mode = S_IFDIR | 0755;
       st.st_nlink = 2;
-      st.st_uid = identity_.getUid();
-      st.st_gid = identity_.getGid();
-      st.st_blksize = 512;
       st.st_blocks = 1;
-      return folly::makeFuture(Attr(st, /* timeout */ 0));
+    } else {
+      folly::throwSystemErrorExplicit(ENOENT);
     }
-    folly::throwSystemErrorExplicit(ENOENT);
+    return st;
   }
 
+ private:
   UserInfo identity_;
 };
 
+/**
+ * Nothing is cached by the kernel, so that each client request reaches the
+ * dispatcher.
+ */
+Dispatcher::Attr makeAttr(const FakeTree& tree, InodeNumber ino) {
+  return Dispatcher::Attr{tree.getStat(ino), /* timeout */ 0};
+}
+
+class TestFileHandle : public FileHandle {
+ public:
+  TestFileHandle(
+      const FakeTree& tree,
+      DispatcherStats& stats,
+      InodeNumber ino,
+      StringPiece contents)
+      : tree_(tree), stats_(stats), ino_(ino), contents_(contents) {}
+
+  InodeNumber getInodeNumber() override {
+    return ino_;
+  }
+  folly::Future<Dispatcher::Attr> getattr() override {
+    DispatcherStats::Timer timer{stats_, Op::GETATTR};
+    return makeAttr(tree_, ino_);
+  }
+  folly::Future<Dispatcher::Attr> setattr(const fuse_setattr_in&) override {
+    folly::throwSystemErrorExplicit(EROFS);
+  }
+  bool usesDirectIO() const override {
+    // Send every read to the dispatcher rather than the page cache.
+    return true;
+  }
+  folly::Future<BufVec> read(size_t size, off_t off) override {
+    DispatcherStats::Timer timer{stats_, Op::READ};
+    auto data = contents_.subpiece(
+        std::min<size_t>(off, contents_.size()), size);
+    return BufVec{folly::IOBuf::wrapBuffer(data.data(), data.size())};
+  }
+  folly::Future<size_t> write(BufVec&&, off_t) override {
+    folly::throwSystemErrorExplicit(EROFS);
+  }
+  folly::Future<size_t> write(StringPiece, off_t) override {
+    folly::throwSystemErrorExplicit(EROFS);
+  }
+  folly::Future<folly::Unit> flush(uint64_t) override {
+    DispatcherStats::Timer timer{stats_, Op::FLUSH};
+    return folly::unit;
+  }
+  folly::Future<folly::Unit> fsync(bool) override {
+    return folly::unit;
+  }
+
+ private:
+  const FakeTree& tree_;
+  DispatcherStats& stats_;
+  InodeNumber ino_;
+  StringPiece contents_;
+};
+
+class TestDirHandle : public DirHandle {
+ public:
+  TestDirHandle(const FakeTree& tree, DispatcherStats& stats, InodeNumber ino)
+      : tree_(tree), stats_(stats), ino_(ino) {}
+
+  InodeNumber getInodeNumber() override {
+    return ino_;
+  }
+  folly::Future<Dispatcher::Attr> getattr() override {
+    DispatcherStats::Timer timer{stats_, Op::GETATTR};
+    return makeAttr(tree_, ino_);
+  }
+  folly::Future<Dispatcher::Attr> setattr(const fuse_setattr_in&) override {
+    folly::throwSystemErrorExplicit(EROFS);
+  }
+  folly::Future<DirList> readdir(DirList&& list, off_t off) override {
+    DispatcherStats::Timer timer{stats_, Op::READDIR};
+    for (size_t index = off; index < tree_.getEntryCount(ino_); ++index) {
+      auto st = tree_.getStat(tree_.getEntryInode(ino_, index));
+      if (!list.add(tree_.getEntryName(ino_, index), st, index + 1)) {
+        break;
+      }
+    }
+    return std::move(list);
+  }
+  folly::Future<DirList> readdirplus(DirList&& list, off_t off) override {
+    DispatcherStats::Timer timer{stats_, Op::READDIR};
+    for (size_t index = off; index < tree_.getEntryCount(ino_); ++index) {
+      // A nodeid of 0 leaves the lookup count alone.
+      fuse_entry_out entry = {};
+      auto st = tree_.getStat(tree_.getEntryInode(ino_, index));
+      entry.attr.ino = st.st_ino;
+      entry.attr.mode = st.st_mode;
+      if (!list.addPlus(tree_.getEntryName(ino_, index), entry, index + 1)) {
+        break;
+      }
+    }
+    return std::move(list);
+  }
+  folly::Future<folly::Unit> fsyncdir(bool) override {
+    return folly::unit;
+  }
+
+ private:
+  const FakeTree& tree_;
+  DispatcherStats& stats_;
+  InodeNumber ino_;
+};
+
+class TestDispatcher : public Dispatcher {
+ public:
+  TestDispatcher(ThreadLocalEdenStats* stats, const UserInfo& identity)
+      : Dispatcher(stats),
+        tree_(identity),
+        contents_(FLAGS_file_size, 'x') {}
+
+  folly::Future<fuse_entry_out> lookup(
+      InodeNumber parent,
+      PathComponentPiece name) override {
+    Timer timer{stats_, Op::LOOKUP};
+    auto ino = tree_.find(parent, name.stringPiece());
+    if (!ino) {
+      folly::throwSystemErrorExplicit(ENOENT);
+    }
+    fuse_entry_out entry = {};
+    entry.nodeid = ino->get();
+    entry.generation = 1;
+    entry.attr = makeAttr(tree_, *ino).asFuseAttr().attr;
+    return entry;
+  }
+
+  folly::Future<Attr> getattr(InodeNumber ino) override {
+    Timer timer{stats_, Op::GETATTR};
+    return makeAttr(tree_, ino);
+  }
+
+  folly::Future<std::shared_ptr<FileHandle>> open(InodeNumber ino, int)
+      override {
+    Timer timer{stats_, Op::OPEN};
+    if (!tree_.isFile(ino)) {
+      folly::throwSystemErrorExplicit(EISDIR);
+    }
+    return std::shared_ptr<FileHandle>{std::make_shared<TestFileHandle>(
+        tree_, stats_, ino, StringPiece{contents_})};
+  }
+
+  folly::Future<std::shared_ptr<DirHandle>> opendir(InodeNumber ino, int)
+      override {
+    Timer timer{stats_, Op::OPENDIR};
+    if (!tree_.isRoot(ino) && !tree_.isDir(ino)) {
+      folly::throwSystemErrorExplicit(ENOTDIR);
+    }
+    return std::shared_ptr<DirHandle>{
+        std::make_shared<TestDirHandle>(tree_, stats_, ino)};
+  }
+
+  const DispatcherStats& getDispatcherStats() const {
+    return stats_;
+  }
+
+ private:
+  using Timer = DispatcherStats::Timer;
+
+  FakeTree tree_;
+  string contents_;
+  DispatcherStats stats_;
+};
+
 void ensureEmptyDirectory(AbsolutePathPiece path) {
   boost::filesystem::path boostPath(
       path.stringPiece().begin(), path.stringPiece().end());
@@ -70,6 +401,177 @@ void ensureEmptyDirectory(AbsolutePathPiece path) {
     }
   }
 }
+
+/**
+ * The descriptors and buffer each load thread sends its requests with.
+ */
+struct LoadClient {
+  LoadClient(AbsolutePathPiece mountPath, size_t index) : rng(index) {
+    for (int dir = 0; dir < FLAGS_dirs; ++dir) {
+      auto path = folly::to<string>(mountPath, "/dir", dir);
+      dirFds.push_back(folly::checkUnixError(
+          open(path.c_str(), O_RDONLY | O_DIRECTORY), "open ", path));
+      auto file = folly::to<string>(path, "/file", rng() % FLAGS_files_per_dir);
+      fileFds.push_back(folly::checkUnixError(
+          open(file.c_str(), O_RDONLY), "open ", file));
+    }
+    buffer.resize(std::max(FLAGS_file_size, 64 * 1024));
+  }
+
+  ~LoadClient() {
+    for (auto fd : dirFds) {
+      close(fd);
+    }
+    for (auto fd : fileFds) {
+      close(fd);
+    }
+  }
+
+  int pickDir() {
+    return dirFds[rng() % dirFds.size()];
+  }
+  int pickFile() {
+    return fileFds[rng() % fileFds.size()];
+  }
+  string pickName() {
+    return folly::to<string>("file", rng() % FLAGS_files_per_dir);
+  }
+
+  std::mt19937_64 rng;
+  vector<int> dirFds;
+  vector<int> fileFds;
+  vector<char> buffer;
+};
+
+/**
+ * A system call whose cost is measured, chosen so that it sends the
+ * dispatcher few kinds of request.
+ */
+struct Workload {
+  StringPiece name;
+  void (*run)(LoadClient& client);
+};
+
+const Workload kWorkloads[] = {
+    {"fstat",
+     [](LoadClient& client) {
+       struct stat st;
+       folly::checkUnixError(fstat(client.pickFile(), &st), "fstat");
+     }},
+    {"fstatat",
+     [](LoadClient& client) {
+       struct stat st;
+       folly::checkUnixError(
+           fstatat(client.pickDir(), client.pickName().c_str(), &st, 0),
+           "fstatat");
+     }},
+    {"pread",
+     [](LoadClient& client) {
+       folly::checkUnixError(
+           pread(client.pickFile(), client.buffer.data(), FLAGS_file_size, 0),
+           "pread");
+     }},
+    {"getdents",
+     [](LoadClient& client) {
+       auto fd = client.pickDir();
+       folly::checkUnixError(lseek(fd, 0, SEEK_SET), "lseek");
+       folly::checkUnixError(
+           syscall(
+               SYS_getdents64, fd, client.buffer.data(), client.buffer.size()),
+           "getdents64");
+     }},
+    {"open",
+     [](LoadClient& client) {
+       auto fd = folly::checkUnixError(
+           openat(client.pickDir(), client.pickName().c_str(), O_RDONLY),
+           "openat");
+       close(fd);
+     }},
+};
+
+/**
+ * Run each workload against the mount, and report how long the system
+ * calls took, how many requests of each kind they caused, and how much of
+ * their time was spent outside the dispatcher: in the kernel and in
+ * FuseChannel receiving, dispatching and replying to the requests.
+ */
+void runLoad(AbsolutePathPiece mountPath, const TestDispatcher& dispatcher) {
+  vector<std::unique_ptr<LoadClient>> clients;
+  for (int n = 0; n < FLAGS_load_threads; ++n) {
+    clients.push_back(std::make_unique<LoadClient>(mountPath, n));
+  }
+
+  for (const auto& workload : kWorkloads) {
+    auto before = dispatcher.getDispatcherStats().get();
+    vector<vector<uint64_t>> latencies(clients.size());
+    auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::seconds{FLAGS_load_seconds};
+    vector<std::thread> threads;
+    for (size_t n = 0; n < clients.size(); ++n) {
+      threads.emplace_back([&, n] {
+        while (std::chrono::steady_clock::now() < deadline) {
+          folly::stop_watch<std::chrono::nanoseconds> timer;
+          workload.run(*clients[n]);
+          latencies[n].push_back(timer.elapsed().count());
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    auto after = dispatcher.getDispatcherStats().get();
+
+    vector<uint64_t> all;
+    for (const auto& clientLatencies : latencies) {
+      all.insert(all.end(), clientLatencies.begin(), clientLatencies.end());
+    }
+    if (all.empty()) {
+      continue;
+    }
+    std::sort(all.begin(), all.end());
+    uint64_t totalNanos = 0;
+    for (auto nanos : all) {
+      totalNanos += nanos;
+    }
+    uint64_t requests = 0;
+    uint64_t dispatcherNanos = 0;
+    string opcodes;
+    for (size_t op = 0; op < kNumOps; ++op) {
+      auto count = after.count[op] - before.count[op];
+      if (count == 0) {
+        continue;
+      }
+      requests += count;
+      dispatcherNanos += after.nanos[op] - before.nanos[op];
+      opcodes += folly::sformat(
+          " {}={:.2f}", kOpNames[op], double(count) / all.size());
+    }
+
+    // The time each request cost beyond the dispatcher's share of it.
+    auto overheadNanos = requests
+        ? double(totalNanos - std::min(dispatcherNanos, totalNanos)) / requests
+        : 0.0;
+    printf(
+        "  %-8s %9.0f calls/s  p50 %7.1f us  p99 %7.1f us  "
+        "overhead %6.1f us/request  requests/call:%s\n",
+        workload.name.str().c_str(),
+        all.size() / double(FLAGS_load_seconds),
+        all[all.size() / 2] / 1000.0,
+        all[(all.size() - 1) * 99 / 100] / 1000.0,
+        overheadNanos / 1000.0,
+        opcodes.c_str());
+  }
+}
+
+vector<int> getFuseThreadCounts() {
+  if (FLAGS_fuse_thread_counts.empty()) {
+    return {FLAGS_numFuseThreads};
+  }
+  vector<int> counts;
+  folly::splitTo<int>(
+      ',', FLAGS_fuse_thread_counts, std::back_inserter(counts), true);
+  return counts;
+}
 } // namespace
 
 int main(int argc, char** argv) {
@@ -112,21 +614,42 @@ int main(int argc, char** argv) {
   folly::EventBaseThread evbt;
   evbt.getEventBase()->runInEventBaseThreadAndWait(
       [&] { privHelper->attachEventBase(evbt.getEventBase()); });
-  auto fuseDevice = privHelper->fuseMount(mountPath.value()).get(100ms);
 
   ThreadLocalEdenStats stats;
   TestDispatcher dispatcher(&stats, identity);
 
-  std::unique_ptr<FuseChannel, FuseChannelDeleter> channel(new FuseChannel(
-      std::move(fuseDevice), mountPath, FLAGS_numFuseThreads, &dispatcher));
+  if (FLAGS_load_threads == 0) {
+    auto fuseDevice = privHelper->fuseMount(mountPath.value()).get(100ms);
+    std::unique_ptr<FuseChannel, FuseChannelDeleter> channel(new FuseChannel(
+        std::move(fuseDevice), mountPath, FLAGS_numFuseThreads, &dispatcher));
 
-  XLOG(INFO) << "Starting FUSE...";
-  auto completionFuture = channel->initialize().get();
-  XLOG(INFO) << "FUSE started";
+    XLOG(INFO) << "Starting FUSE...";
+    auto completionFuture = channel->initialize().get();
+    XLOG(INFO) << "FUSE started";
 
-  auto stopData = std::move(completionFuture).get();
-  XLOG(INFO) << "FUSE channel done; stop_reason="
-             << static_cast<int>(stopData.reason);
+    auto stopData = std::move(completionFuture).get();
+    XLOG(INFO) << "FUSE channel done; stop_reason="
+               << static_cast<int>(stopData.reason);
+    return EX_OK;
+  }
+
+  // Logging each request would cost more than handling it.
+  folly::LoggerDB::get().getCategory("eden.fs.fuse")->setLevel(
+      folly::LogLevel::INFO);
+  for (auto numThreads : getFuseThreadCounts()) {
+    auto fuseDevice = privHelper->fuseMount(mountPath.value()).get(100ms);
+    std::unique_ptr<FuseChannel, FuseChannelDeleter> channel(new FuseChannel(
+        std::move(fuseDevice), mountPath, numThreads, &dispatcher));
+    auto completionFuture = channel->initialize().get();
 
+    printf(
+        "%d FUSE threads, %d client threads:\n",
+        numThreads,
+        FLAGS_load_threads);
+    runLoad(mountPath, dispatcher);
+
+    privHelper->fuseUnmount(mountPath.value()).get(10s);
+    std::move(completionFuture).get(10s);
+  }
   return EX_OK;
 }
@@ -17,6 +17,8 @@
 #include <folly/FileUtil.h>
 #include <folly/Format.h>
 #include <folly/String.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
 #include <folly/init/Init.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
@@ -46,9 +48,23 @@ using std::string;
 namespace facebook {
 namespace eden {
 
+namespace {
+// Enough to overlap the mounts that edenfs restores in parallel at startup.
+constexpr size_t kNumWorkerThreads = 4;
+} // namespace
+
 PrivHelperServer::PrivHelperServer() {}
 
-PrivHelperServer::~PrivHelperServer() {}
+PrivHelperServer::~PrivHelperServer() {
+  // Destroying the EventBase runs any responses still queued for sending,
+  // which check conn_, so tear things down in this order rather than in
+  // member order.
+  if (workers_) {
+    workers_->join();
+  }
+  conn_.reset();
+  eventBase_.reset();
+}
 
 void PrivHelperServer::init(folly::File&& socket, uid_t uid, gid_t gid) {
   // Call folly::init()
@@ -79,6 +95,9 @@ void PrivHelperServer::initPartial(folly::File&& socket, uid_t uid, gid_t gid) {
   // NotificationQueue code checks to ensure that it isn't used across a fork.
   eventBase_ = std::make_unique<folly::EventBase>();
   conn_ = UnixSocket::makeUnique(eventBase_.get(), std::move(socket));
+  workers_ = std::make_unique<folly::CPUThreadPoolExecutor>(
+      kNumWorkerThreads,
+      std::make_shared<folly::NamedThreadFactory>("PrivHelper"));
   uid_ = uid;
   gid_ = gid;
 
@@ -179,9 +198,10 @@ UnixSocket::Message PrivHelperServer::processTakeoverStartupMsg(
   XLOG(DBG3) << "takeover startup for \"" << mountPath << "\"; "
              << bindMounts.size() << " bind mounts";
 
-  mountPoints_.insert(mountPath);
+  auto mountPoints = mountPoints_.wlock();
+  mountPoints->fuseMounts.insert(mountPath);
   for (auto& bindMount : bindMounts) {
-    bindMountPoints_.insert({mountPath, bindMount});
+    mountPoints->bindMounts.insert({mountPath, bindMount});
   }
   return makeResponse();
 }
@@ -192,7 +212,7 @@ UnixSocket::Message PrivHelperServer::processMountMsg(Cursor& cursor) {
   XLOG(DBG3) << "mount \"" << mountPath << "\"";
 
   auto fuseDev = fuseMount(mountPath.c_str());
-  mountPoints_.insert(mountPath);
+  mountPoints_.wlock()->fuseMounts.insert(mountPath);
 
   return makeResponse(std::move(fuseDev));
 }
@@ -202,20 +222,28 @@ UnixSocket::Message PrivHelperServer::processUnmountMsg(Cursor& cursor) {
   PrivHelperConn::parseUnmountRequest(cursor, mountPath);
   XLOG(DBG3) << "unmount \"" << mountPath << "\"";
 
-  const auto it = mountPoints_.find(mountPath);
-  if (it == mountPoints_.end()) {
-    throw std::domain_error(
-        folly::to<string>("No FUSE mount found for ", mountPath));
+  // Other threads only change the entries for other mount points, so these
+  // can't change while we unmount them without holding the lock.
+  std::vector<string> bindMounts;
+  {
+    auto mountPoints = mountPoints_.rlock();
+    if (mountPoints->fuseMounts.count(mountPath) == 0) {
+      throw std::domain_error(
+          folly::to<string>("No FUSE mount found for ", mountPath));
+    }
+    const auto range = mountPoints->bindMounts.equal_range(mountPath);
+    for (auto bindIter = range.first; bindIter != range.second; ++bindIter) {
+      bindMounts.push_back(bindIter->second);
+    }
   }
 
-  const auto range = bindMountPoints_.equal_range(mountPath);
-  for (auto bindIter = range.first; bindIter != range.second; ++bindIter) {
-    bindUnmount(bindIter->second.c_str());
+  for (const auto& bindMount : bindMounts) {
+    bindUnmount(bindMount.c_str());
   }
-  bindMountPoints_.erase(range.first, range.second);
+  mountPoints_.wlock()->bindMounts.erase(mountPath);
 
   fuseUnmount(mountPath.c_str());
-  mountPoints_.erase(mountPath);
+  mountPoints_.wlock()->fuseMounts.erase(mountPath);
   return makeResponse();
 }
 
@@ -225,16 +253,14 @@ UnixSocket::Message PrivHelperServer::processTakeoverShutdownMsg(
   PrivHelperConn::parseTakeoverShutdownRequest(cursor, mountPath);
   XLOG(DBG3) << "takeover shutdown \"" << mountPath << "\"";
 
-  const auto it = mountPoints_.find(mountPath);
-  if (it == mountPoints_.end()) {
+  auto mountPoints = mountPoints_.wlock();
+  if (mountPoints->fuseMounts.count(mountPath) == 0) {
     throw std::domain_error(
         folly::to<string>("No FUSE mount found for ", mountPath));
   }
 
-  const auto range = bindMountPoints_.equal_range(mountPath);
-  bindMountPoints_.erase(range.first, range.second);
-
-  mountPoints_.erase(mountPath);
+  mountPoints->bindMounts.erase(mountPath);
+  mountPoints->fuseMounts.erase(mountPath);
   return makeResponse();
 }
 
@@ -247,10 +273,13 @@ UnixSocket::Message PrivHelperServer::processBindMountMsg(Cursor& cursor) {
   // Figure out which FUSE mount the mountPath belongs to.
   // (Alternatively, we could just make this part of the Message.)
   string key;
-  for (const auto& mountPoint : mountPoints_) {
-    if (boost::starts_with(mountPath, mountPoint + "/")) {
-      key = mountPoint;
-      break;
+  {
+    auto mountPoints = mountPoints_.rlock();
+    for (const auto& mountPoint : mountPoints->fuseMounts) {
+      if (boost::starts_with(mountPath, mountPoint + "/")) {
+        key = mountPoint;
+        break;
+      }
     }
   }
   if (key.empty()) {
@@ -259,7 +288,7 @@ UnixSocket::Message PrivHelperServer::processBindMountMsg(Cursor& cursor) {
   }
 
   bindMount(clientPath.c_str(), mountPath.c_str());
-  bindMountPoints_.insert({key, mountPath});
+  mountPoints_.wlock()->bindMounts.insert({key, mountPath});
   return makeResponse();
 }
 
@@ -356,19 +385,121 @@ void PrivHelperServer::run() {
   // too.
   XLOG(DBG5) << "privhelper process exiting";
 
+  // Let the requests that were already started finish, so that we know about
+  // every mount point they created.  Nobody is left to reply to.
+  workers_->join();
+  conn_.reset();
+
   // Unmount all active mount points
   cleanupMountPoints();
 }
 
 void PrivHelperServer::messageReceived(UnixSocket::Message&& message) noexcept {
   try {
-    processAndSendResponse(std::move(message));
+    auto mountPoint = getRequestMountPoint(message);
+    if (mountPoint.empty()) {
+      processAndSendResponse(std::move(message));
+      return;
+    }
+    runForMountPoint(
+        mountPoint, [this, message = std::move(message)]() mutable {
+          try {
+            processAndSendResponse(std::move(message));
+          } catch (const std::exception& ex) {
+            XLOG(ERR) << "error processing privhelper request: "
+                      << folly::exceptionStr(ex);
+          }
+        });
   } catch (const std::exception& ex) {
     XLOG(ERR) << "error processing privhelper request: "
               << folly::exceptionStr(ex);
   }
 }
 
+std::string PrivHelperServer::getRequestMountPoint(
+    const UnixSocket::Message& message) {
+  string mountPath;
+  try {
+    Cursor cursor{&message.data};
+    cursor.skip(sizeof(uint32_t)); // the transaction ID
+    const auto msgType =
+        static_cast<PrivHelperConn::MsgType>(cursor.readBE<uint32_t>());
+    switch (msgType) {
+      case PrivHelperConn::REQ_MOUNT_FUSE:
+        PrivHelperConn::parseMountRequest(cursor, mountPath);
+        return mountPath;
+      case PrivHelperConn::REQ_UNMOUNT_FUSE:
+        PrivHelperConn::parseUnmountRequest(cursor, mountPath);
+        return mountPath;
+      case PrivHelperConn::REQ_TAKEOVER_SHUTDOWN:
+        PrivHelperConn::parseTakeoverShutdownRequest(cursor, mountPath);
+        return mountPath;
+      case PrivHelperConn::REQ_TAKEOVER_STARTUP: {
+        std::vector<string> bindMounts;
+        PrivHelperConn::parseTakeoverStartupRequest(
+            cursor, mountPath, bindMounts);
+        return mountPath;
+      }
+      case PrivHelperConn::REQ_MOUNT_BIND: {
+        // Order this after the FUSE mount it lives in, even if that has not
+        // finished mounting yet.  If there isn't one, processBindMountMsg()
+        // reports the error.
+        string clientPath;
+        PrivHelperConn::parseBindMountRequest(cursor, clientPath, mountPath);
+        auto pendingOps = pendingOps_.rlock();
+        for (const auto& entry : *pendingOps) {
+          if (boost::starts_with(mountPath, entry.first + "/")) {
+            return entry.first;
+          }
+        }
+        return mountPath;
+      }
+      case PrivHelperConn::REQ_SET_LOG_FILE:
+      case PrivHelperConn::MSG_TYPE_NONE:
+      case PrivHelperConn::RESP_ERROR:
+        break;
+    }
+  } catch (const std::exception&) {
+    // Let processAndSendResponse() report the malformed request.
+  }
+  return string{};
+}
+
+void PrivHelperServer::runForMountPoint(
+    const std::string& mountPoint,
+    folly::Func op) {
+  {
+    auto pendingOps = pendingOps_.wlock();
+    auto& pending = (*pendingOps)[mountPoint];
+    pending.ops.push_back(std::move(op));
+    if (pending.running) {
+      return;
+    }
+    pending.running = true;
+  }
+  workers_->add([this, mountPoint] { runPendingOps(mountPoint); });
+}
+
+void PrivHelperServer::runPendingOps(const std::string& mountPoint) {
+  // Run the queued operations from this one task, rather than adding a task
+  // for each of them, so that run() only has to join the workers to wait for
+  // all of them.
+  while (true) {
+    folly::Func op;
+    {
+      auto pendingOps = pendingOps_.wlock();
+      auto& pending = pendingOps->at(mountPoint);
+      if (pending.ops.empty()) {
+        pending.running = false;
+        return;
+      }
+      op = std::move(pending.ops.front());
+      pending.ops.pop_front();
+    }
+    op();
+  }
+}
+
 void PrivHelperServer::processAndSendResponse(UnixSocket::Message&& message) {
   Cursor cursor{&message.data};
   const auto xid = cursor.readBE<uint32_t>();
@@ -410,7 +541,19 @@ void PrivHelperServer::processAndSendResponse(UnixSocket::Message&& message) {
   respCursor.writeBE<uint32_t>(xid);
   respCursor.writeBE<uint32_t>(responseType);
 
-  conn_->send(std::move(response));
+  sendResponse(std::move(response));
+}
+
+void PrivHelperServer::sendResponse(UnixSocket::Message&& response) {
+  // Responses may be ready on any worker thread, but the socket may only be
+  // used from the EventBase thread.
+  eventBase_->runInEventBaseThread(
+      [this, response = std::move(response)]() mutable {
+        if (!conn_) {
+          return;
+        }
+        conn_->send(std::move(response));
+      });
 }
 
 UnixSocket::Message PrivHelperServer::makeResponse() {
@@ -474,15 +617,16 @@ void PrivHelperServer::receiveError(
 }
 
 void PrivHelperServer::cleanupMountPoints() {
+  auto mountPoints = mountPoints_.wlock();
   size_t numBindMountsRemoved = 0;
-  for (const auto& mountPoint : mountPoints_) {
+  for (const auto& mountPoint : mountPoints->fuseMounts) {
     // Clean up the bind mounts for a FUSE mount before the FUSE mount itself.
     //
     // Note that these unmounts might fail if the main eden process has already
     // exited: these are inside an eden mount, and so accessing the parent
     // directory will fail with ENOTCONN the eden has already closed the fuse
     // connection.
-    const auto range = bindMountPoints_.equal_range(mountPoint);
+    const auto range = mountPoints->bindMounts.equal_range(mountPoint);
     for (auto it = range.first; it != range.second; ++it) {
       try {
         bindUnmount(it->second.c_str());
@@ -501,11 +645,12 @@ void PrivHelperServer::cleanupMountPoints() {
     }
   }
 
-  XLOG_IF(ERR, bindMountPoints_.size() != numBindMountsRemoved)
+  XLOG_IF(ERR, mountPoints->bindMounts.size() != numBindMountsRemoved)
       << "Not all bind mounts were removed during cleanup: had "
-      << bindMountPoints_.size() << ", removed " << numBindMountsRemoved;
-  bindMountPoints_.clear();
-  mountPoints_.clear();
+      << mountPoints->bindMounts.size() << ", removed "
+      << numBindMountsRemoved;
+  mountPoints->bindMounts.clear();
+  mountPoints->fuseMounts.clear();
 }
 
 } // namespace eden
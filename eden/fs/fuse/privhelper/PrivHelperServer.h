@@ -9,8 +9,12 @@
  */
 #pragma once
 
+#include <folly/Function.h>
+#include <folly/Synchronized.h>
 #include <sys/types.h>
+#include <deque>
 #include <limits>
+#include <memory>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -18,6 +22,7 @@
 #include "eden/fs/utils/UnixSocket.h"
 
 namespace folly {
+class CPUThreadPoolExecutor;
 class EventBase;
 class File;
 namespace io {
@@ -38,6 +43,12 @@ namespace eden {
  *
  * The uid and gid parameters specify the user and group ID of the unprivileged
  * process that will be making requests to us.
+ *
+ * Requests for different mount points are processed concurrently on a small
+ * pool of worker threads, so that a slow mount or unmount does not hold up
+ * the others.  Requests for the same mount point, including those for the
+ * bind mounts inside it, are still processed one at a time in the order they
+ * were received.
  */
 class PrivHelperServer : private UnixSocket::ReceiveCallback {
  public:
@@ -73,7 +84,25 @@ class PrivHelperServer : private UnixSocket::ReceiveCallback {
   void socketClosed() noexcept override;
   void receiveError(const folly::exception_wrapper& ew) noexcept override;
 
+  /**
+   * Return the FUSE mount point that a request operates on, or an empty
+   * string if it can be processed immediately on the EventBase thread.
+   *
+   * This must only be called from the EventBase thread.
+   */
+  std::string getRequestMountPoint(const UnixSocket::Message& message);
+
+  /**
+   * Run op on a worker thread once every earlier operation for mountPoint
+   * has finished.
+   *
+   * This must only be called from the EventBase thread.
+   */
+  void runForMountPoint(const std::string& mountPoint, folly::Func op);
+  void runPendingOps(const std::string& mountPoint);
+
   void processAndSendResponse(UnixSocket::Message&& message);
+  void sendResponse(UnixSocket::Message&& response);
   UnixSocket::Message processMessage(
       PrivHelperConn::MsgType msgType,
       folly::io::Cursor& cursor,
@@ -98,15 +127,28 @@ class PrivHelperServer : private UnixSocket::ReceiveCallback {
   virtual void bindUnmount(const char* mountPath);
   virtual void setLogFile(folly::File&& logFile);
 
+  struct MountPoints {
+    std::set<std::string> fuseMounts;
+    std::unordered_multimap<std::string, std::string> bindMounts;
+  };
+  struct PendingOps {
+    std::deque<folly::Func> ops;
+    bool running{false};
+  };
+
   std::unique_ptr<folly::EventBase> eventBase_;
   UnixSocket::UniquePtr conn_;
+  std::unique_ptr<folly::CPUThreadPoolExecutor> workers_;
   uid_t uid_{std::numeric_limits<uid_t>::max()};
   gid_t gid_{std::numeric_limits<gid_t>::max()};
 
-  // The privhelper server only has a single thread,
-  // so we don't need to lock the following state
-  std::set<std::string> mountPoints_;
-  std::unordered_multimap<std::string, std::string> bindMountPoints_;
+  // Updated by the worker threads as mounts and unmounts complete.
+  folly::Synchronized<MountPoints> mountPoints_;
+
+  // The operations waiting to run for each mount point that has been
+  // requested.  Entries are kept once their queue is empty, so that bind
+  // mount requests can be matched with a FUSE mount that is still pending.
+  folly::Synchronized<std::unordered_map<std::string, PendingOps>> pendingOps_;
 };
 
 } // namespace eden
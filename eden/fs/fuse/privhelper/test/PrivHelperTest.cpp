@@ -274,6 +274,60 @@ TEST_F(PrivHelperTest, multiplePendingFuseMounts) {
   EXPECT_THAT(server_.getUnusedFuseUnmountResults(), UnorderedElementsAre());
 }
 
+TEST_F(PrivHelperTest, slowMountDoesNotBlockOtherMounts) {
+  TemporaryFile tempFile;
+  auto slowPromise = server_.setFuseMountResult("/mnt/slow");
+  server_.setFuseMountResult("/mnt/fast").setValue(File(tempFile.fd(), false));
+  server_.setBindMountResult("/mnt/fast/buck-out").setValue();
+  server_.setFuseUnmountResult("/mnt/slow").setValue();
+  server_.setFuseUnmountResult("/mnt/fast").setValue();
+  server_.setBindUnmountResult("/mnt/fast/buck-out").setValue();
+
+  auto slowResult = client_->fuseMount("/mnt/slow");
+  auto fastResult = client_->fuseMount("/mnt/fast");
+
+  // The second mount and its bind mount complete while the first mount is
+  // still waiting.
+  std::move(fastResult).get(1s);
+  client_->bindMount("/bind/mount/source", "/mnt/fast/buck-out").get(1s);
+  EXPECT_FALSE(slowResult.isReady());
+
+  slowPromise.setValue(File(tempFile.fd(), false));
+  std::move(slowResult).get(1s);
+
+  cleanup();
+  EXPECT_THAT(server_.getUnusedFuseUnmountResults(), UnorderedElementsAre());
+  EXPECT_THAT(server_.getUnusedBindUnmountResults(), UnorderedElementsAre());
+}
+
+TEST_F(PrivHelperTest, requestsForOneMountRunInOrder) {
+  TemporaryFile tempFile;
+  auto mountPromise = server_.setFuseMountResult("/mnt/abc");
+  server_.setBindMountResult("/mnt/abc/buck-out").setValue();
+  server_.setBindUnmountResult("/mnt/abc/buck-out").setValue();
+  server_.setFuseUnmountResult("/mnt/abc").setValue();
+
+  // The bind mount and the unmount are sent before the FUSE mount has
+  // completed, and must wait for it rather than fail.
+  auto mountResult = client_->fuseMount("/mnt/abc");
+  auto bindResult =
+      client_->bindMount("/bind/mount/source", "/mnt/abc/buck-out");
+  auto unmountResult = client_->fuseUnmount("/mnt/abc");
+  /* sleep override */ std::this_thread::sleep_for(20ms);
+  EXPECT_FALSE(mountResult.isReady());
+  EXPECT_FALSE(bindResult.isReady());
+  EXPECT_FALSE(unmountResult.isReady());
+
+  mountPromise.setValue(File(tempFile.fd(), false));
+  std::move(mountResult).get(1s);
+  std::move(bindResult).get(1s);
+  std::move(unmountResult).get(1s);
+
+  cleanup();
+  EXPECT_THAT(server_.getUnusedFuseUnmountResults(), UnorderedElementsAre());
+  EXPECT_THAT(server_.getUnusedBindUnmountResults(), UnorderedElementsAre());
+}
+
 TEST_F(PrivHelperTest, bindMounts) {
   TemporaryFile tempFile;
 
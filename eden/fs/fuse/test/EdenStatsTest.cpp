@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/fuse/EdenStats.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include "common/stats/ServiceData.h"
+#include "eden/fs/fuse/FuseTypes.h"
+
+using namespace facebook::eden;
+using facebook::stats::ServiceData;
+
+namespace {
+int64_t getCounter(const std::string& name) {
+  auto counters = ServiceData::get()->getCounters();
+  auto it = counters.find(name);
+  EXPECT_NE(counters.end(), it) << "no counter named " << name;
+  return it == counters.end() ? -1 : it->second;
+}
+} // namespace
+
+TEST(EdenStats, histogramsAreExportedOnceAggregated) {
+  EdenStats stats{"histogram_test"};
+  for (int64_t n = 0; n < 100; ++n) {
+    stats.lookup.addValue(n * 100);
+  }
+  EXPECT_EQ(0, ServiceData::get()->getCounters().count(
+                   "histogram_test.lookup_us.count.60"));
+
+  stats.aggregate();
+  EXPECT_EQ(100, getCounter("histogram_test.lookup_us.count.60"));
+  EXPECT_EQ(100, getCounter("histogram_test.lookup_us.count"));
+  // Percentiles are estimated within the 1ms buckets.
+  EXPECT_NEAR(5000, getCounter("histogram_test.lookup_us.p50.60"), 1000);
+  EXPECT_NEAR(9000, getCounter("histogram_test.lookup_us.p90.600"), 1000);
+  EXPECT_NEAR(9900, getCounter("histogram_test.lookup_us.p99.3600"), 1000);
+  EXPECT_NEAR(9990, getCounter("histogram_test.lookup_us.p999"), 1000);
+
+  // Aggregating again adds only what was recorded since.
+  stats.lookup.addValue(100);
+  stats.aggregate();
+  EXPECT_EQ(101, getCounter("histogram_test.lookup_us.count.60"));
+}
+
+TEST(EdenStats, statsFromSeveralThreadsAreCombined) {
+  auto record = [] {
+    EdenStats stats{"thread_test"};
+    stats.readBytes.addValue(4096);
+    stats.getInflightCounter(FUSE_READ).incrementValue(1);
+    // The stats are aggregated when they are destroyed.
+  };
+  std::thread first{record};
+  std::thread second{record};
+  first.join();
+  second.join();
+
+  EXPECT_EQ(8192, getCounter("thread_test.read_bytes.sum.60"));
+  EXPECT_EQ(2, getCounter("thread_test.read_inflight"));
+}
+
+TEST(EdenStats, regexCountersSelectByName) {
+  ServiceData::get()->setCounter("regex_test.one", 1);
+  ServiceData::get()->setCounter("regex_test.two", 2);
+  auto counters = ServiceData::get()->getRegexCounters("regex_test\\.t.*");
+  ASSERT_EQ(1, counters.size());
+  EXPECT_EQ(2, counters["regex_test.two"]);
+}
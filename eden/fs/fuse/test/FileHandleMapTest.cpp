@@ -37,6 +37,10 @@ class FakeDirHandle : public DirHandle {
   folly::Future<DirList> readdir(DirList&& /*list*/, off_t /*off*/) override {
     throw std::runtime_error("fake!");
   }
+  folly::Future<DirList> readdirplus(DirList&& /*list*/, off_t /*off*/)
+      override {
+    throw std::runtime_error("fake!");
+  }
 
   folly::Future<folly::Unit> fsyncdir(bool /*datasync*/) override {
     throw std::runtime_error("fake!");
@@ -129,3 +133,24 @@ TEST(FileHandleMap, Serialization) {
 
   EXPECT_EQ(expected, newSerialized.entries);
 }
+
+TEST(FileHandleMap, ManyHandles) {
+  FileHandleMap fmap;
+
+  std::vector<std::shared_ptr<FakeFileHandle>> fileHandles;
+  std::vector<uint64_t> numbers;
+  for (uint64_t ino = 1; ino <= 1000; ++ino) {
+    fileHandles.push_back(std::make_shared<FakeFileHandle>(InodeNumber{ino}));
+    numbers.push_back(fmap.recordHandle(fileHandles.back()));
+  }
+
+  for (size_t n = 0; n < numbers.size(); ++n) {
+    EXPECT_EQ(fileHandles[n], fmap.getFileHandle(numbers[n]));
+  }
+  EXPECT_EQ(fileHandles[10], fmap.forgetGenericHandle(numbers[10]));
+  EXPECT_THROW(fmap.getFileHandle(numbers[10]), std::system_error);
+  EXPECT_THROW(fmap.getDirHandle(numbers[11]), std::system_error);
+
+  EXPECT_EQ(999, fmap.serializeMap().entries.size());
+  EXPECT_EQ(0, fmap.serializeMap().entries.size());
+}
@@ -12,6 +12,7 @@
 #include <folly/Random.h>
 #include <folly/logging/xlog.h>
 #include <folly/test/TestUtils.h>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include <unordered_map>
 #include "eden/fs/fuse/Dispatcher.h"
@@ -30,6 +31,8 @@ using folly::Unit;
 using std::make_unique;
 using std::unique_ptr;
 
+DECLARE_bool(fuse_parallel_dirops);
+
 namespace {
 
 // Most of the tests wait on Futures to complete.
@@ -178,6 +181,37 @@ TEST_F(FuseChannelTest, testTakeoverStop) {
   EXPECT_EQ(flags, stopData.fuseSettings.flags);
 }
 
+TEST_F(FuseChannelTest, testParallelDiropsIsNegotiated) {
+  constexpr uint32_t capable = FUSE_ASYNC_READ | FUSE_PARALLEL_DIROPS;
+  auto channel = createChannel();
+  auto completeFuture = performInit(
+      channel.get(),
+      FUSE_KERNEL_VERSION,
+      FUSE_KERNEL_MINOR_VERSION,
+      0,
+      capable);
+
+  channel->takeoverStop();
+  auto stopData = std::move(completeFuture).get(kTimeout);
+  EXPECT_EQ(capable, stopData.fuseSettings.flags);
+}
+
+TEST_F(FuseChannelTest, testParallelDiropsCanBeDisabled) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_fuse_parallel_dirops = false;
+  auto channel = createChannel();
+  auto completeFuture = performInit(
+      channel.get(),
+      FUSE_KERNEL_VERSION,
+      FUSE_KERNEL_MINOR_VERSION,
+      0,
+      FUSE_ASYNC_READ | FUSE_PARALLEL_DIROPS);
+
+  channel->takeoverStop();
+  auto stopData = std::move(completeFuture).get(kTimeout);
+  EXPECT_EQ(FUSE_ASYNC_READ, stopData.fuseSettings.flags);
+}
+
 TEST_F(FuseChannelTest, testInitUnmountRace) {
   auto channel = createChannel();
   auto completeFuture = performInit(channel.get());
@@ -0,0 +1,130 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/fuse/FuseTrace.h"
+
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <string>
+
+using namespace facebook::eden;
+using folly::ByteRange;
+using std::string;
+
+namespace {
+fuse_in_header makeHeader(uint32_t opcode, uint64_t unique, uint64_t nodeid) {
+  fuse_in_header header = {};
+  header.opcode = opcode;
+  header.unique = unique;
+  header.nodeid = nodeid;
+  header.pid = 1234;
+  return header;
+}
+
+ByteRange bytes(const string& arg) {
+  return ByteRange{folly::StringPiece{arg}};
+}
+
+class FuseTraceTest : public ::testing::Test {
+ protected:
+  folly::File openTrace() {
+    return folly::File{path_, O_WRONLY | O_CREAT | O_TRUNC, 0600};
+  }
+
+  folly::test::TemporaryDirectory tmpDir_;
+  string path_{(tmpDir_.path() / "trace").string()};
+};
+} // namespace
+
+TEST_F(FuseTraceTest, recordsRoundTripWithAnonymizedNames) {
+  {
+    FuseTraceWriter writer{openTrace(), false};
+    writer.recordRequest(
+        makeHeader(FUSE_LOOKUP, 10, FUSE_ROOT_ID), bytes(string("src\0", 4)));
+    fuse_entry_out entry = {};
+    entry.nodeid = 5;
+    entry.attr.size = 100;
+    entry.attr.mode = S_IFREG | 0644;
+    writer.recordLookupEntry(10, entry);
+
+    fuse_read_in read = {};
+    read.offset = 4096;
+    read.size = 8192;
+    writer.recordRequest(
+        makeHeader(FUSE_READ, 11, 5),
+        ByteRange{reinterpret_cast<const uint8_t*>(&read), sizeof(read)});
+    writer.recordRequest(
+        makeHeader(FUSE_LOOKUP, 12, 5), bytes(string("lib\0", 4)));
+    writer.recordRequest(
+        makeHeader(FUSE_LOOKUP, 13, 5), bytes(string("src\0", 4)));
+    EXPECT_EQ(5, writer.finish());
+  }
+
+  auto records = readFuseTrace(path_);
+  ASSERT_EQ(5, records.size());
+  EXPECT_EQ(FuseTraceRecord::REQUEST, records[0].kind);
+  EXPECT_EQ(FUSE_LOOKUP, records[0].opcode);
+  EXPECT_EQ(1, records[0].nameId);
+  EXPECT_EQ(0, records[0].pid);
+
+  EXPECT_EQ(FuseTraceRecord::LOOKUP_ENTRY, records[1].kind);
+  EXPECT_EQ(10, records[1].unique);
+  EXPECT_EQ(5, records[1].nodeid);
+  EXPECT_EQ(100, records[1].offset);
+  EXPECT_EQ(S_IFREG | 0644, records[1].mode);
+
+  EXPECT_EQ(FUSE_READ, records[2].opcode);
+  EXPECT_EQ(4096, records[2].offset);
+  EXPECT_EQ(8192, records[2].size);
+
+  EXPECT_EQ(2, records[3].nameId);
+  EXPECT_EQ(1, records[4].nameId);
+  EXPECT_LE(records[0].timeNs, records[4].timeNs);
+
+  string contents;
+  ASSERT_TRUE(folly::readFile(path_.c_str(), contents));
+  EXPECT_EQ(string::npos, contents.find("src"));
+}
+
+TEST_F(FuseTraceTest, pidsAreOnlyRecordedWhenRequested) {
+  {
+    FuseTraceWriter writer{openTrace(), true};
+    writer.recordRequest(makeHeader(FUSE_GETATTR, 1, 5), ByteRange{});
+  }
+  auto records = readFuseTrace(path_);
+  ASSERT_EQ(1, records.size());
+  EXPECT_EQ(1234, records[0].pid);
+}
+
+TEST_F(FuseTraceTest, recordsAfterFinishAreDropped) {
+  FuseTraceWriter writer{openTrace(), false};
+  writer.recordRequest(makeHeader(FUSE_GETATTR, 1, 5), ByteRange{});
+  EXPECT_EQ(1, writer.finish());
+  writer.recordRequest(makeHeader(FUSE_GETATTR, 2, 5), ByteRange{});
+  EXPECT_EQ(1, writer.finish());
+  EXPECT_EQ(1, readFuseTrace(path_).size());
+}
+
+TEST_F(FuseTraceTest, truncatedTracesLoseOnlyTheirPartialRecord) {
+  {
+    FuseTraceWriter writer{openTrace(), false};
+    writer.recordRequest(makeHeader(FUSE_GETATTR, 1, 5), ByteRange{});
+    writer.recordRequest(makeHeader(FUSE_GETATTR, 2, 5), ByteRange{});
+  }
+  string contents;
+  ASSERT_TRUE(folly::readFile(path_.c_str(), contents));
+  ASSERT_TRUE(folly::writeFile(
+      contents.substr(0, contents.size() - 1), path_.c_str()));
+  EXPECT_EQ(1, readFuseTrace(path_).size());
+
+  ASSERT_TRUE(folly::writeFile(string("not a trace"), path_.c_str()));
+  EXPECT_THROW(readFuseTrace(path_), std::invalid_argument);
+}
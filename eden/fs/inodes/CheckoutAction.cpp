@@ -10,6 +10,7 @@
 #include "eden/fs/inodes/CheckoutAction.h"
 
 #include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
 
 #include "eden/fs/inodes/CheckoutContext.h"
 #include "eden/fs/inodes/FileInode.h"
@@ -28,6 +29,13 @@ using folly::Unit;
 using std::make_shared;
 using std::vector;
 
+DEFINE_int32(
+    checkout_tree_prefetch_depth,
+    3,
+    "When checkout walks into a directory, ask the backing store to fetch "
+    "this many levels of subdirectories below it as well, for stores that "
+    "can fetch them together.  0 disables this.");
+
 namespace facebook {
 namespace eden {
 
@@ -122,11 +130,15 @@ Future<Unit> CheckoutAction::run(
   // until this LoadingRefcount is destroyed.
   LoadingRefcount refcount{this};
 
+  // Checkout loads many objects at once, so let filesystem reads from other
+  // processes go ahead of them.
+  constexpr auto kPriority = ImportPriority::Background;
+
   try {
     // Load the Blob or Tree for the old TreeEntry.
     if (oldScmEntry_.hasValue()) {
       if (oldScmEntry_.value().isTree()) {
-        store->getTree(oldScmEntry_.value().getHash())
+        store->getTree(oldScmEntry_.value().getHash(), kPriority)
             .then([rc = LoadingRefcount(this)](
                       std::shared_ptr<const Tree> oldTree) {
               rc->setOldTree(std::move(oldTree));
@@ -135,7 +147,7 @@ Future<Unit> CheckoutAction::run(
               rc->error("error getting old tree", ew);
             });
       } else {
-        store->getBlob(oldScmEntry_.value().getHash())
+        store->getBlob(oldScmEntry_.value().getHash(), kPriority)
             .then([rc = LoadingRefcount(this)](
                       std::shared_ptr<const Blob> oldBlob) {
               rc->setOldBlob(std::move(oldBlob));
@@ -150,7 +162,22 @@ Future<Unit> CheckoutAction::run(
     if (newScmEntry_.hasValue()) {
       const auto& newEntry = newScmEntry_.value();
       if (newEntry.isTree()) {
-        store->getTree(newEntry.getHash())
+        // We are about to recurse into this tree, so fetch the levels below
+        // it now, rather than one tree at a time as we reach them.  This is
+        // only a hint, so errors are ignored; the getTree() calls that need
+        // the data will report them.
+        if (FLAGS_checkout_tree_prefetch_depth > 0) {
+          store
+              ->prefetchTree(
+                  newEntry.getHash(),
+                  static_cast<size_t>(FLAGS_checkout_tree_prefetch_depth))
+              .onError(
+                  [hash = newEntry.getHash()](const exception_wrapper& ew) {
+                    XLOG(DBG3) << "error prefetching tree " << hash << ": "
+                               << ew.what();
+                  });
+        }
+        store->getTree(newEntry.getHash(), kPriority)
             .then([rc = LoadingRefcount(this)](
                       std::shared_ptr<const Tree> newTree) {
               rc->setNewTree(std::move(newTree));
@@ -159,7 +186,7 @@ Future<Unit> CheckoutAction::run(
               rc->error("error getting new tree", ew);
             });
       } else {
-        store->getBlob(newEntry.getHash())
+        store->getBlob(newEntry.getHash(), kPriority)
             .then([rc = LoadingRefcount(this)](
                       std::shared_ptr<const Blob> newBlob) {
               rc->setNewBlob(std::move(newBlob));
@@ -10,7 +10,9 @@
 #include "eden/fs/inodes/CheckoutContext.h"
 
 #include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
 
+#include "eden/fs/inodes/CheckoutTreePrefetcher.h"
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/InodePtr.h"
 #include "eden/fs/inodes/TreeInode.h"
@@ -19,6 +21,13 @@ using folly::Future;
 using folly::Unit;
 using std::vector;
 
+DEFINE_int32(
+    checkout_max_tree_prefetches,
+    32,
+    "The maximum number of pairs of source control trees that checkout "
+    "fetches ahead of the directories it is currently processing.  "
+    "0 disables this.");
+
 namespace facebook {
 namespace eden {
 
@@ -30,13 +39,50 @@ CheckoutContext::CheckoutContext(
       mount_{mount},
       parentsLock_(std::move(parentsLock)) {}
 
-CheckoutContext::~CheckoutContext() {}
+CheckoutContext::~CheckoutContext() {
+  if (prefetcher_) {
+    prefetcher_->stop();
+  }
+}
 
 void CheckoutContext::start(RenameLock&& renameLock) {
   renameLock_ = std::move(renameLock);
 }
 
+void CheckoutContext::startTreePrefetch(
+    const Tree* fromTree,
+    const Tree* toTree) {
+  if (FLAGS_checkout_max_tree_prefetches <= 0) {
+    return;
+  }
+  CHECK(!prefetcher_);
+  prefetcher_ = std::make_shared<CheckoutTreePrefetcher>(
+      mount_->getObjectStore(),
+      static_cast<size_t>(FLAGS_checkout_max_tree_prefetches));
+  prefetcher_->start(fromTree, toTree);
+}
+
+CheckoutContext::Progress CheckoutContext::getProgress() const {
+  Progress progress;
+  progress.treesCheckedOut = treesCheckedOut_.load(std::memory_order_relaxed);
+  progress.actionsStarted = actionsStarted_.load(std::memory_order_relaxed);
+  if (prefetcher_) {
+    progress.treesPrefetched = prefetcher_->getTreesFetched();
+  }
+  return progress;
+}
+
 Future<vector<CheckoutConflict>> CheckoutContext::finish(Hash newSnapshot) {
+  // Anything the prefetcher has not fetched yet is no longer needed.
+  if (prefetcher_) {
+    prefetcher_->stop();
+  }
+  auto progress = getProgress();
+  XLOG(DBG2) << "checkout of " << mount_->getPath() << " processed "
+             << progress.treesCheckedOut << " directories with "
+             << progress.actionsStarted << " changed entries; prefetched "
+             << progress.treesPrefetched << " trees";
+
   // Only update the parents if it is not a dry run.
   if (!isDryRun()) {
     // Update the in-memory snapshot ID
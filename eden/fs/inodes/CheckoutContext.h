@@ -10,6 +10,8 @@
 #pragma once
 
 #include <folly/Synchronized.h>
+#include <atomic>
+#include <memory>
 #include <vector>
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/InodePtrFwd.h"
@@ -27,6 +29,7 @@ namespace facebook {
 namespace eden {
 
 class CheckoutConflict;
+class CheckoutTreePrefetcher;
 class TreeInode;
 class Tree;
 
@@ -66,11 +69,31 @@ class CheckoutContext {
     return checkoutMode_ == CheckoutMode::FORCE;
   }
 
+  /**
+   * Counts of the work done so far by a checkout operation.
+   */
+  struct Progress {
+    /** The number of directories TreeInode::checkout() has processed. */
+    uint64_t treesCheckedOut{0};
+    /** The number of CheckoutActions started for changed entries. */
+    uint64_t actionsStarted{0};
+    /** The number of Trees fetched ahead of the checkout reaching them. */
+    uint64_t treesPrefetched{0};
+  };
+
   /**
    * Start the checkout operation.
    */
   void start(RenameLock&& renameLock);
 
+  /**
+   * Start fetching the Trees for subdirectories that differ between fromTree
+   * and toTree, ahead of the checkout reaching them.
+   *
+   * This does nothing if --checkout_max_tree_prefetches is 0.
+   */
+  void startTreePrefetch(const Tree* fromTree, const Tree* toTree);
+
   /**
    * Complete the checkout operation
    *
@@ -99,6 +122,17 @@ class CheckoutContext {
     return renameLock_;
   }
 
+  /**
+   * Record that TreeInode::checkout() processed a directory, starting
+   * numActions CheckoutActions for it.
+   */
+  void recordTreeCheckedOut(size_t numActions) {
+    treesCheckedOut_.fetch_add(1, std::memory_order_relaxed);
+    actionsStarted_.fetch_add(numActions, std::memory_order_relaxed);
+  }
+
+  Progress getProgress() const;
+
  private:
   CheckoutMode checkoutMode_;
   EdenMount* const mount_;
@@ -109,6 +143,10 @@ class CheckoutContext {
   // if some data load operations complete asynchronously on other threads.
   // Therefore access to the conflicts list must be synchronized.
   folly::Synchronized<std::vector<CheckoutConflict>> conflicts_;
+
+  std::shared_ptr<CheckoutTreePrefetcher> prefetcher_;
+  std::atomic<uint64_t> treesCheckedOut_{0};
+  std::atomic<uint64_t> actionsStarted_{0};
 };
 } // namespace eden
 } // namespace facebook
@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/CheckoutTreePrefetcher.h"
+
+#include <folly/futures/Future.h>
+#include <folly/logging/xlog.h>
+
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/ObjectStore.h"
+
+using folly::exception_wrapper;
+using std::shared_ptr;
+
+namespace facebook {
+namespace eden {
+
+CheckoutTreePrefetcher::CheckoutTreePrefetcher(
+    ObjectStore* store,
+    size_t maxInFlight)
+    : store_{store}, maxInFlight_{maxInFlight} {}
+
+void CheckoutTreePrefetcher::start(const Tree* fromTree, const Tree* toTree) {
+  queueDifferingChildren(*state_.wlock(), fromTree, toTree);
+  drain();
+}
+
+void CheckoutTreePrefetcher::stop() {
+  auto state = state_.wlock();
+  state->stopped = true;
+  state->queue.clear();
+}
+
+void CheckoutTreePrefetcher::queueDifferingChildren(
+    State& state,
+    const Tree* fromTree,
+    const Tree* toTree) {
+  if (state.stopped || !fromTree || !toTree) {
+    return;
+  }
+
+  // Both entry lists are sorted by name, so walk them together.
+  const auto& fromEntries = fromTree->getTreeEntries();
+  const auto& toEntries = toTree->getTreeEntries();
+  size_t fromIdx = 0;
+  size_t toIdx = 0;
+  while (fromIdx < fromEntries.size() && toIdx < toEntries.size()) {
+    const auto& fromEntry = fromEntries[fromIdx];
+    const auto& toEntry = toEntries[toIdx];
+    if (fromEntry.getName() < toEntry.getName()) {
+      ++fromIdx;
+    } else if (toEntry.getName() < fromEntry.getName()) {
+      ++toIdx;
+    } else {
+      // Added and removed directories don't need their contents compared,
+      // so we only look inside directories present on both sides.
+      if (fromEntry.isTree() && toEntry.isTree() &&
+          fromEntry.getHash() != toEntry.getHash()) {
+        state.queue.push_back(TreePair{fromEntry.getHash(), toEntry.getHash()});
+      }
+      ++fromIdx;
+      ++toIdx;
+    }
+  }
+}
+
+void CheckoutTreePrefetcher::drain() {
+  {
+    auto state = state_.wlock();
+    if (state->draining) {
+      return;
+    }
+    state->draining = true;
+  }
+
+  while (true) {
+    TreePair pair;
+    {
+      auto state = state_.wlock();
+      if (state->stopped || state->queue.empty() ||
+          state->inFlight >= maxInFlight_) {
+        state->draining = false;
+        return;
+      }
+      pair = std::move(state->queue.front());
+      state->queue.pop_front();
+      ++state->inFlight;
+    }
+    fetch(std::move(pair));
+  }
+}
+
+void CheckoutTreePrefetcher::fetch(TreePair pair) {
+  constexpr auto kPriority = ImportPriority::Background;
+  auto fromFuture = store_->getTree(pair.fromHash, kPriority);
+  auto toFuture = store_->getTree(pair.toHash, kPriority);
+  folly::collect(fromFuture, toFuture)
+      .thenValue([self = shared_from_this()](
+                     std::tuple<shared_ptr<const Tree>, shared_ptr<const Tree>>
+                         trees) {
+        self->treesFetched_.fetch_add(2, std::memory_order_relaxed);
+        {
+          auto state = self->state_.wlock();
+          --state->inFlight;
+          queueDifferingChildren(
+              *state, std::get<0>(trees).get(), std::get<1>(trees).get());
+        }
+        self->drain();
+      })
+      .onError([self = shared_from_this(),
+                hash = pair.toHash](const exception_wrapper& ew) {
+        XLOG(DBG3) << "error prefetching tree " << hash
+                   << " for checkout: " << ew.what();
+        --self->state_.wlock()->inFlight;
+        self->drain();
+      });
+}
+} // namespace eden
+} // namespace facebook
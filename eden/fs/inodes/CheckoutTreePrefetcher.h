@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include "eden/fs/model/Hash.h"
+
+namespace facebook {
+namespace eden {
+
+class ObjectStore;
+class Tree;
+
+/**
+ * CheckoutTreePrefetcher walks ahead of a checkout operation, fetching the
+ * source control Trees that the checkout will need to compare.
+ *
+ * TreeInode::checkout() only learns which subdirectories differ once it has
+ * the Trees for the current directory, so without this every level of the
+ * checkout waits for its own round trip to the ObjectStore.  Starting from
+ * the two root Trees, the prefetcher fetches both versions of every
+ * subdirectory whose hash differs between them, and then does the same for
+ * their children.  The fetched Trees stay in the ObjectStore's caches, where
+ * the checkout's own getTree() calls find them.
+ *
+ * At most maxInFlight pairs of Trees are fetched at once; the rest wait in a
+ * queue.  Errors are ignored, since the checkout will fetch the same Trees
+ * itself and report them.
+ *
+ * CheckoutTreePrefetcher must be managed by a std::shared_ptr, since pending
+ * fetches hold a reference to it.
+ */
+class CheckoutTreePrefetcher
+    : public std::enable_shared_from_this<CheckoutTreePrefetcher> {
+ public:
+  CheckoutTreePrefetcher(ObjectStore* store, size_t maxInFlight);
+
+  /**
+   * Start prefetching the subdirectories that differ between two Trees.
+   * Either Tree may be null.
+   */
+  void start(const Tree* fromTree, const Tree* toTree);
+
+  /**
+   * Stop starting new fetches.  Fetches that are already in flight still
+   * complete, but do not queue any more work.
+   */
+  void stop();
+
+  /**
+   * Returns the number of Trees fetched so far.
+   */
+  uint64_t getTreesFetched() const {
+    return treesFetched_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct TreePair {
+    Hash fromHash;
+    Hash toHash;
+  };
+
+  struct State {
+    std::deque<TreePair> queue;
+    size_t inFlight{0};
+    bool draining{false};
+    bool stopped{false};
+  };
+
+  /**
+   * Queue a TreePair for every subdirectory present as a directory in both
+   * Trees whose hashes differ.  The state lock must be held.
+   */
+  static void queueDifferingChildren(
+      State& state,
+      const Tree* fromTree,
+      const Tree* toTree);
+
+  /**
+   * Start fetching queued TreePairs until maxInFlight_ are in flight.
+   *
+   * Fetches that complete immediately call back into drain(), so only one
+   * thread at a time runs the loop; the others leave their work for it.
+   */
+  void drain();
+  void fetch(TreePair pair);
+
+  ObjectStore* const store_;
+  const size_t maxInFlight_;
+  folly::Synchronized<State> state_;
+  std::atomic<uint64_t> treesFetched_{0};
+};
+} // namespace eden
+} // namespace facebook
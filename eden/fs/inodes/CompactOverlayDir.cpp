@@ -0,0 +1,188 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/CompactOverlayDir.h"
+
+#include <folly/Bits.h>
+#include <folly/Exception.h>
+#include <folly/Optional.h>
+
+namespace facebook {
+namespace eden {
+
+using folly::ByteRange;
+using folly::StringPiece;
+
+namespace {
+
+constexpr size_t kPreambleSize = 2 * sizeof(uint32_t);
+
+template <typename T>
+void append(std::string& out, T value) {
+  value = folly::Endian::little(value);
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T load(const char* data, size_t index) {
+  return folly::Endian::little(
+      folly::loadUnaligned<T>(data + index * sizeof(T)));
+}
+
+[[noreturn]] void throwMalformed(StringPiece reason) {
+  folly::throwSystemErrorExplicit(
+      EIO, "malformed compact overlay directory: ", reason);
+}
+
+/**
+ * Validate a compact record and call fn(name, inodeNumber, mode, hash) for
+ * each entry in order.  hash is null for materialized entries.
+ */
+template <typename Fn>
+void forEachEntry(StringPiece data, Fn&& fn) {
+  if (data.size() < kPreambleSize) {
+    throwMalformed("too short");
+  }
+  const size_t count = load<uint32_t>(data.data(), 0);
+  const size_t nameTableSize = load<uint32_t>(data.data(), 1);
+
+  const char* inodes = data.data() + kPreambleSize;
+  const char* modes = inodes + count * sizeof(uint64_t);
+  const char* nameEnds = modes + count * sizeof(uint32_t);
+  const char* bitmap = nameEnds + count * sizeof(uint32_t);
+  const char* hashes = bitmap + (count + 7) / 8;
+  // Check the fixed-width arrays fit before reading the bitmap.
+  if (static_cast<size_t>(hashes - data.data()) > data.size()) {
+    throwMalformed("entry arrays truncated");
+  }
+
+  size_t numHashes = 0;
+  for (size_t i = 0; i < count; ++i) {
+    numHashes += (bitmap[i / 8] >> (i % 8)) & 1;
+  }
+  const char* names = hashes + numHashes * Hash::RAW_SIZE;
+  if (static_cast<size_t>(names - data.data()) + nameTableSize !=
+      data.size()) {
+    throwMalformed("size mismatch");
+  }
+
+  size_t nameStart = 0;
+  size_t hashIndex = 0;
+  for (size_t i = 0; i < count; ++i) {
+    size_t nameEnd = load<uint32_t>(nameEnds, i);
+    if (nameEnd <= nameStart || nameEnd > nameTableSize) {
+      throwMalformed("bad name offset");
+    }
+    StringPiece name{names + nameStart, names + nameEnd};
+    nameStart = nameEnd;
+
+    folly::Optional<Hash> hash;
+    if ((bitmap[i / 8] >> (i % 8)) & 1) {
+      auto hashData =
+          reinterpret_cast<const uint8_t*>(hashes) + hashIndex * Hash::RAW_SIZE;
+      hash = Hash{ByteRange{hashData, Hash::RAW_SIZE}};
+      ++hashIndex;
+    }
+
+    fn(name,
+       InodeNumber{load<uint64_t>(inodes, i)},
+       static_cast<mode_t>(load<uint32_t>(modes, i)),
+       hash.get_pointer());
+  }
+}
+
+} // namespace
+
+std::string serializeCompactOverlayDir(const DirContents& dir) {
+  size_t nameTableSize = 0;
+  size_t numHashes = 0;
+  for (const auto& entry : dir) {
+    nameTableSize += entry.first.stringPiece().size();
+    numHashes += !entry.second.isMaterialized();
+  }
+  const size_t count = dir.size();
+
+  std::string out;
+  out.reserve(
+      kPreambleSize + count * (sizeof(uint64_t) + 2 * sizeof(uint32_t)) +
+      (count + 7) / 8 + numHashes * Hash::RAW_SIZE + nameTableSize);
+
+  append<uint32_t>(out, count);
+  append<uint32_t>(out, nameTableSize);
+  for (const auto& entry : dir) {
+    append<uint64_t>(out, entry.second.getInodeNumber().get());
+  }
+  for (const auto& entry : dir) {
+    append<uint32_t>(out, entry.second.getModeUnsafe());
+  }
+  uint32_t nameEnd = 0;
+  for (const auto& entry : dir) {
+    nameEnd += entry.first.stringPiece().size();
+    append<uint32_t>(out, nameEnd);
+  }
+
+  std::string bitmap((count + 7) / 8, '\0');
+  size_t index = 0;
+  for (const auto& entry : dir) {
+    if (!entry.second.isMaterialized()) {
+      bitmap[index / 8] |= 1 << (index % 8);
+    }
+    ++index;
+  }
+  out.append(bitmap);
+
+  for (const auto& entry : dir) {
+    if (!entry.second.isMaterialized()) {
+      auto bytes = entry.second.getHash().getBytes();
+      out.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+  }
+  // DirContents is sorted by name, so the name table is too.
+  for (const auto& entry : dir) {
+    auto name = entry.first.stringPiece();
+    out.append(name.data(), name.size());
+  }
+  return out;
+}
+
+DirContents deserializeCompactOverlayDir(StringPiece data) {
+  DirContents result;
+  if (data.size() >= kPreambleSize) {
+    result.reserve(load<uint32_t>(data.data(), 0));
+  }
+  forEachEntry(
+      data,
+      [&](StringPiece name, InodeNumber ino, mode_t mode, const Hash* hash) {
+        if (hash) {
+          result.emplace(PathComponentPiece{name}, mode, ino, *hash);
+        } else {
+          result.emplace(PathComponentPiece{name}, mode, ino);
+        }
+      });
+  return result;
+}
+
+overlay::OverlayDir compactOverlayDirToThrift(StringPiece data) {
+  overlay::OverlayDir result;
+  forEachEntry(
+      data,
+      [&](StringPiece name, InodeNumber ino, mode_t mode, const Hash* hash) {
+        overlay::OverlayEntry entry;
+        entry.mode = mode;
+        entry.inodeNumber = ino.get();
+        if (hash) {
+          entry.set_hash(StringPiece{hash->getBytes()}.str());
+        }
+        result.entries.emplace(name.str(), std::move(entry));
+      });
+  return result;
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <folly/Range.h>
+#include <string>
+#include "eden/fs/inodes/DirEntry.h"
+#include "eden/fs/inodes/gen-cpp2/overlay_types.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * The compact encoding of an overlay directory record, used for records whose
+ * header has version Overlay::kDirHeaderVersion.  The older records are a
+ * thrift-serialized overlay::OverlayDir.
+ *
+ * Decoding does not need to build a map of thrift structs first, and the
+ * fixed-width arrays are 8-byte aligned when the record is, so the encoding
+ * can be read in place from an mmapped record.
+ *
+ * All integers are little-endian:
+ *
+ *   uint32 entryCount
+ *   uint32 nameTableSize
+ *   uint64 inodeNumbers[entryCount]
+ *   uint32 modes[entryCount]
+ *   uint32 nameEnds[entryCount]       end offset of each name in the table
+ *   uint8  hashBitmap[(entryCount + 7) / 8]   bit set if the entry has a hash
+ *   uint8  hashes[numHashes][Hash::RAW_SIZE]  in entry order
+ *   char   nameTable[nameTableSize]   the names, sorted, without separators
+ *
+ * Entries without a hash are materialized.
+ */
+std::string serializeCompactOverlayDir(const DirContents& dir);
+
+/**
+ * Decode a compact record (without the Overlay header).  Throws if data is
+ * malformed.
+ */
+DirContents deserializeCompactOverlayDir(folly::StringPiece data);
+
+/**
+ * Decode a compact record into the older thrift representation, for code
+ * that handles both formats.
+ */
+overlay::OverlayDir compactOverlayDirToThrift(folly::StringPiece data);
+
+} // namespace eden
+} // namespace facebook
@@ -80,8 +80,10 @@ class UntrackedDiffEntry : public DeferredDiffEntry {
       });
     }
 
-    auto treeInode = inode_.asTreePtrOrNull();
-    if (!treeInode.get()) {
+    // inode_ holds the TreeInode until this entry is destroyed, after its
+    // diff completes, so diff() can borrow it.
+    auto* treeInode = inode_.asTreeOrNull();
+    if (!treeInode) {
       auto bug = EDEN_BUG()
           << "UntrackedDiffEntry should only used with tree inodes";
       return makeFuture<Unit>(bug.toException());
@@ -122,6 +124,9 @@ folly::Future<folly::Unit> diffRemovedTree(
     RelativePath currentPath,
     const TreeEntry& entry) {
   DCHECK(entry.isTree());
+  if (context->isCancelled()) {
+    return makeFuture();
+  }
   return context->store->getTree(entry.getHash())
       .then([context, currentPath = RelativePath{std::move(currentPath)}](
                 shared_ptr<const Tree>&& tree) {
@@ -135,13 +140,16 @@ folly::Future<folly::Unit> diffRemovedTree(
     const Tree* tree) {
   vector<Future<Unit>> subFutures;
   for (const auto& entry : tree->getTreeEntries()) {
+    auto entryPath = currentPath + entry.getName();
+    if (!context->shouldDiff(entryPath)) {
+      continue;
+    }
     if (entry.isTree()) {
-      auto f = diffRemovedTree(context, currentPath + entry.getName(), entry);
+      auto f = diffRemovedTree(context, std::move(entryPath), entry);
       subFutures.emplace_back(std::move(f));
     } else {
-      XLOG(DBG5) << "diff: file in removed directory: "
-                 << currentPath + entry.getName();
-      context->callback->removedFile(currentPath + entry.getName(), entry);
+      XLOG(DBG5) << "diff: file in removed directory: " << entryPath;
+      context->callback->removedFile(entryPath, entry);
     }
   }
 
@@ -239,7 +247,8 @@ class ModifiedDiffEntry : public DeferredDiffEntry {
 
  private:
   folly::Future<folly::Unit> runForScmTree() {
-    auto treeInode = inode_.asTreePtrOrNull();
+    // As in UntrackedDiffEntry, inode_ outlives the diff of its TreeInode.
+    auto* treeInode = inode_.asTreeOrNull();
     if (!treeInode) {
       // This is a Tree in the source control state, but a file or symlink
       // in the current filesystem state.
@@ -269,15 +278,14 @@ class ModifiedDiffEntry : public DeferredDiffEntry {
 
     // Possibly modified directory.  Load the Tree in question.
     return context_->store->getTree(scmEntry_.getHash())
-        .then([this, treeInode = std::move(treeInode)](
-                  shared_ptr<const Tree>&& tree) {
+        .then([this, treeInode](shared_ptr<const Tree>&& tree) {
           return treeInode->diff(
               context_, getPath(), std::move(tree), ignore_, isIgnored_);
         });
   }
 
   folly::Future<folly::Unit> runForScmBlob() {
-    auto fileInode = inode_.asFilePtrOrNull();
+    auto* fileInode = inode_.asFileOrNull();
     if (!fileInode) {
       // This is a file in the source control state, but a directory
       // in the current filesystem state.
@@ -285,7 +293,7 @@ class ModifiedDiffEntry : public DeferredDiffEntry {
       // tree as untracked/ignored.
       XLOG(DBG5) << "removed file: " << getPath();
       context_->callback->removedFile(getPath(), scmEntry_);
-      auto treeInode = inode_.asTreePtr();
+      auto* treeInode = inode_.asTree();
       if (isIgnored_ && !context_->listIgnored) {
         return makeFuture();
       }
@@ -9,6 +9,7 @@
  */
 
 #include "eden/fs/inodes/DiffContext.h"
+#include "eden/fs/inodes/InodeDiffCallback.h"
 #include "eden/fs/inodes/TopLevelIgnores.h"
 #include "eden/fs/model/git/GitIgnoreStack.h"
 
@@ -31,5 +32,13 @@ const GitIgnoreStack* DiffContext::getToplevelIgnore() const {
   return topLevelIgnores_->getStack();
 }
 
+bool DiffContext::isCancelled() const {
+  return callback->isCancelled();
+}
+
+bool DiffContext::shouldDiff(RelativePathPiece path) const {
+  return callback->shouldDiff(path);
+}
+
 } // namespace eden
 } // namespace facebook
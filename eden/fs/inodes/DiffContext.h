@@ -52,6 +52,17 @@ class DiffContext {
 
   const GitIgnoreStack* getToplevelIgnore() const;
 
+  /**
+   * Whether the diff should stop early.  See InodeDiffCallback::isCancelled().
+   */
+  bool isCancelled() const;
+
+  /**
+   * Whether the diff should look at the entry at path.  See
+   * InodeDiffCallback::shouldDiff().
+   */
+  bool shouldDiff(RelativePathPiece path) const;
+
  private:
   std::unique_ptr<TopLevelIgnores> topLevelIgnores_;
 };
@@ -12,6 +12,7 @@
 #include <folly/Synchronized.h>
 #include <folly/futures/Future.h>
 #include <folly/logging/xlog.h>
+#include <atomic>
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/InodeDiffCallback.h"
 #include "eden/fs/model/Tree.h"
@@ -22,26 +23,45 @@
 namespace facebook {
 namespace eden {
 namespace {
+/**
+ * Collects the results of a diff into a ScmStatus.
+ *
+ * Results outside of the filter are dropped, and the directories that
+ * cannot hold any are skipped.  Once limit results have been collected the
+ * diff is cancelled, and the status is marked as truncated.
+ */
 class ThriftStatusCallback : public InodeDiffCallback {
  public:
+  ThriftStatusCallback() = default;
+  ThriftStatusCallback(PathPrefixFilter filter, size_t limit)
+      : filter_(std::move(filter)), limit_(limit) {}
+
   void ignoredFile(RelativePathPiece path) override {
-    data_.wlock()->emplace(path.stringPiece().str(), ScmFileStatus::IGNORED);
+    addEntry(path, ScmFileStatus::IGNORED);
   }
 
   void untrackedFile(RelativePathPiece path) override {
-    data_.wlock()->emplace(path.stringPiece().str(), ScmFileStatus::ADDED);
+    addEntry(path, ScmFileStatus::ADDED);
   }
 
   void removedFile(
       RelativePathPiece path,
       const TreeEntry& /* sourceControlEntry */) override {
-    data_.wlock()->emplace(path.stringPiece().str(), ScmFileStatus::REMOVED);
+    addEntry(path, ScmFileStatus::REMOVED);
   }
 
   void modifiedFile(
       RelativePathPiece path,
       const TreeEntry& /* sourceControlEntry */) override {
-    data_.wlock()->emplace(path.stringPiece().str(), ScmFileStatus::MODIFIED);
+    addEntry(path, ScmFileStatus::MODIFIED);
+  }
+
+  bool isCancelled() const override {
+    return limitReached_.load(std::memory_order_relaxed);
+  }
+
+  bool shouldDiff(RelativePathPiece path) const override {
+    return filter_.mayMatchUnder(path);
   }
 
   void diffError(RelativePathPiece path, const folly::exception_wrapper& ew)
@@ -66,11 +86,27 @@ class ThriftStatusCallback : public InodeDiffCallback {
       auto data = data_.wlock();
       status.entries.swap(*data);
     }
+    status.truncated = limitReached_.load(std::memory_order_relaxed);
 
     return status;
   }
 
  private:
+  void addEntry(RelativePathPiece path, ScmFileStatus status) {
+    if (!filter_.matches(path)) {
+      return;
+    }
+    auto data = data_.wlock();
+    if (limit_ != 0 && data->size() >= limit_) {
+      limitReached_.store(true, std::memory_order_relaxed);
+      return;
+    }
+    data->emplace(path.stringPiece().str(), status);
+  }
+
+  const PathPrefixFilter filter_;
+  const size_t limit_{0};
+  std::atomic<bool> limitReached_{false};
   folly::Synchronized<std::map<std::string, ScmFileStatus>> data_;
 };
 } // unnamed namespace
@@ -110,5 +146,20 @@ diffMountForStatus(const EdenMount* mount, Hash commitHash, bool listIgnored) {
       });
 }
 
+folly::Future<std::unique_ptr<ScmStatus>> diffMountForStatus(
+    const EdenMount* mount,
+    Hash commitHash,
+    bool listIgnored,
+    PathPrefixFilter filter,
+    size_t limit) {
+  auto callback =
+      std::make_unique<ThriftStatusCallback>(std::move(filter), limit);
+  auto callbackPtr = callback.get();
+  return mount->diff(callbackPtr, commitHash, listIgnored)
+      .then([callback = std::move(callback)]() {
+        return std::make_unique<ScmStatus>(callback->extractStatus());
+      });
+}
+
 } // namespace eden
 } // namespace facebook
@@ -11,6 +11,7 @@
 #include <iosfwd>
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/service/gen-cpp2/EdenService.h"
+#include "eden/fs/utils/PathPrefixFilter.h"
 
 namespace folly {
 template <typename T>
@@ -33,5 +34,21 @@ std::ostream& operator<<(std::ostream& os, const ScmStatus& status);
 folly::Future<std::unique_ptr<ScmStatus>>
 diffMountForStatus(const EdenMount* mount, Hash commitHash, bool listIgnored);
 
+/**
+ * Compute the status of the working directory against a commit, restricted
+ * to the paths that match filter.  Directories that cannot contain a
+ * matching path are not loaded.
+ *
+ * If limit is non-zero the diff stops once it has found that many
+ * differences, and sets the truncated field of the result.  The differences
+ * returned are then not necessarily the first ones in path order.
+ */
+folly::Future<std::unique_ptr<ScmStatus>> diffMountForStatus(
+    const EdenMount* mount,
+    Hash commitHash,
+    bool listIgnored,
+    PathPrefixFilter filter,
+    size_t limit);
+
 } // namespace eden
 } // namespace facebook
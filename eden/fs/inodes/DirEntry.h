@@ -43,9 +43,11 @@ class DirEntry {
       : initialMode_{m},
         hasHash_{true},
         hasInodePointer_{false},
+        loadedInBulk_{false},
+        blobPrefetched_{false},
         hash_{hash},
         inodeNumber_{number} {
-    CHECK_EQ(m, m & 0x3fffffff);
+    CHECK_EQ(m, m & 0x0fffffff);
     DCHECK(number.hasValue());
   }
 
@@ -56,8 +58,10 @@ class DirEntry {
       : initialMode_{m},
         hasHash_{false},
         hasInodePointer_{false},
+        loadedInBulk_{false},
+        blobPrefetched_{false},
         inodeNumber_{number} {
-    CHECK_EQ(m, m & 0x3fffffff);
+    CHECK_EQ(m, m & 0x0fffffff);
     DCHECK(number.hasValue());
   }
 
@@ -149,7 +153,8 @@ class DirEntry {
 
   InodePtr getInodePtr() const {
     // It's safe to call newPtrLocked because calling getInode() implies the
-    // TreeInode's contents_ lock is held.
+    // TreeInode's contents_ lock is held.  Holding it in shared mode is
+    // enough, since inodes are only unloaded with it held exclusively.
     return hasInodePointer_ ? InodePtr::newPtrLocked(inode_) : InodePtr{};
   }
 
@@ -179,17 +184,41 @@ class DirEntry {
    */
   FOLLY_NODISCARD InodeBase* clearInode();
 
+  /**
+   * Whether this entry's inode was loaded by TreeInode's bulk child loading
+   * and has not been looked up since.  Only used to measure how often bulk
+   * loading pays off.
+   */
+  bool isLoadedInBulk() const {
+    return loadedInBulk_;
+  }
+  void setLoadedInBulk(bool loadedInBulk) {
+    loadedInBulk_ = loadedInBulk;
+  }
+
+  /**
+   * Whether this entry's blob was prefetched by
+   * TreeInode::prefetchSiblingBlobs() and has not been loaded since.  Only
+   * used to measure how often the prefetch pays off.
+   */
+  bool isBlobPrefetched() const {
+    return blobPrefetched_;
+  }
+  void setBlobPrefetched(bool blobPrefetched) {
+    blobPrefetched_ = blobPrefetched;
+  }
+
  private:
   /**
-   * The initial entry type for this entry. Two bits are borrowed from the top
-   * so the entire struct fits in four words.
+   * The initial entry type for this entry. Four bits are borrowed from the
+   * top so the entire struct fits in four words.
    *
    * TODO: This field is not updated when an inode's mode bits are changed.
    * For now, it's used primarily to migrate data without loss from the old
    * Overlay Dir storage. After the InodeMetadataTable is in use for a while,
    * this should be replaced with dtype_t and the bitfields can go away.
    */
-  mode_t initialMode_ : 30;
+  mode_t initialMode_ : 28;
 
   /**
    * Whether the hash_ field matches the contents from source control. If
@@ -202,6 +231,16 @@ class DirEntry {
    */
   bool hasInodePointer_ : 1;
 
+  /**
+   * See isLoadedInBulk().
+   */
+  bool loadedInBulk_ : 1;
+
+  /**
+   * See isBlobPrefetched().
+   */
+  bool blobPrefetched_ : 1;
+
   /**
    * If the entry is not materialized, this contains the hash
    * identifying the source control Tree (if this is a directory) or Blob
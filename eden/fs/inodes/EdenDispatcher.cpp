@@ -10,6 +10,7 @@
 #include "EdenDispatcher.h"
 
 #include <folly/Format.h>
+#include <folly/hash/Hash.h>
 #include <folly/executors/CPUThreadPoolExecutor.h>
 #include <folly/executors/GlobalExecutor.h>
 #include <folly/logging/xlog.h>
@@ -18,6 +19,7 @@
 #include <shared_mutex>
 
 #include "eden/fs/fuse/DirHandle.h"
+#include "eden/fs/fuse/EdenStats.h"
 #include "eden/fs/fuse/FileHandle.h"
 #include "eden/fs/fuse/RequestData.h"
 #include "eden/fs/inodes/EdenFileHandle.h"
@@ -39,45 +41,110 @@ DEFINE_int32(
     inode_reserve,
     1000000,
     "pre-size inode hash table for this many entries");
+DEFINE_int32(
+    negative_lookup_ttl_seconds,
+    -1,
+    "How long the kernel may cache a failed lookup in a directory that is "
+    "unchanged from source control.  -1 caches it until eden invalidates it, "
+    "0 disables caching.");
+DEFINE_int32(
+    materialized_negative_lookup_ttl_seconds,
+    -1,
+    "How long the kernel may cache a failed lookup in a directory that has "
+    "been modified locally.  -1 caches it until eden invalidates it, 0 "
+    "disables caching.");
+DEFINE_bool(
+    lookup_unloaded_directories,
+    true,
+    "Answer lookups of directories that are unchanged from source control "
+    "from their parent's entry, and only fetch their contents once something "
+    "reads them or looks up their children.");
 
 namespace facebook {
 namespace eden {
 
 EdenDispatcher::EdenDispatcher(EdenMount* mount)
-    : Dispatcher(mount->getStats()),
+    : Dispatcher(mount->getStats(), mount->getMountStats()),
       mount_(mount),
       inodeMap_(mount_->getInodeMap()) {}
 
 namespace {
 
-/** Compute a fuse_entry_out */
-fuse_entry_out computeEntryParam(
-    InodeNumber number,
-    const Dispatcher::Attr& attr) {
-  fuse_entry_out entry;
-  entry.nodeid = number.get();
-  entry.generation = 1;
-  auto fuse_attr = attr.asFuseAttr();
-  entry.attr = fuse_attr.attr;
-  entry.attr_valid = fuse_attr.attr_valid;
-  entry.attr_valid_nsec = fuse_attr.attr_valid_nsec;
-  entry.entry_valid = fuse_attr.attr_valid;
-  entry.entry_valid_nsec = fuse_attr.attr_valid_nsec;
-  return entry;
-}
-
 Dispatcher::Attr attrForInodeWithCorruptOverlay() noexcept {
   struct stat st;
   std::memset(&st, 0, sizeof(st));
   st.st_mode = S_IFREG;
   return Dispatcher::Attr{st};
 }
+
+/**
+ * Returns the reply that lets the kernel cache a failed lookup in tree: an
+ * entry with inode number 0 that is valid for the configured time.  Returns
+ * none if the result should not be cached.
+ *
+ * Caching forever is safe because names only appear in a directory through
+ * FUSE, which the kernel sees, or through TreeInode functions that
+ * invalidate the kernel's entry for the name, such as checkout.
+ */
+folly::Optional<fuse_entry_out> negativeEntryParam(TreeInode& tree) {
+  // Names outside the mount's scope may appear once the scope is widened.
+  if (tree.getMount()->isOutsideScope(tree)) {
+    return folly::none;
+  }
+  auto ttl = tree.getContents().rlock()->isMaterialized()
+      ? FLAGS_materialized_negative_lookup_ttl_seconds
+      : FLAGS_negative_lookup_ttl_seconds;
+  if (ttl == 0) {
+    return folly::none;
+  }
+
+  fuse_entry_out entry = {};
+  if (ttl < 0) {
+    entry.attr_valid = std::numeric_limits<decltype(entry.attr_valid)>::max();
+    entry.entry_valid =
+        std::numeric_limits<decltype(entry.entry_valid)>::max();
+  } else {
+    entry.attr_valid = ttl;
+    entry.entry_valid = ttl;
+  }
+  return entry;
+}
+
+/**
+ * Directories outside the mount's scope appear empty, so they cannot have
+ * children looked up or created in them.
+ */
+void checkInScope(const TreeInode& parent, int errnum) {
+  if (parent.getMount()->isOutsideScope(parent)) {
+    folly::throwSystemErrorExplicit(
+        errnum, parent.getLogPath(), " is outside the mount's scope");
+  }
+}
 } // namespace
 
+size_t EdenDispatcher::LookupKeyHasher::operator()(
+    const LookupKey& key) const {
+  return folly::hash::hash_combine(key.parent, key.name, key.generation);
+}
+
+size_t EdenDispatcher::GetattrKeyHasher::operator()(
+    const GetattrKey& key) const {
+  return folly::hash::hash_combine(key.ino, key.generation);
+}
+
 folly::Future<Dispatcher::Attr> EdenDispatcher::getattr(InodeNumber ino) {
   FB_LOGF(mount_->getStraceLogger(), DBG7, "getattr({})", ino);
-  return inodeMap_->lookupInode(ino).thenValue(
-      [](const InodePtr& inode) { return inode->getattr(); });
+  bool started = false;
+  auto future = pendingGetattrs_.load(
+      GetattrKey{ino, getModificationGeneration()}, [&] {
+        started = true;
+        return inodeMap_->lookupInode(ino).thenValue(
+            [](const InodePtr& inode) { return inode->getattr(); });
+      });
+  if (!started) {
+    getStats()->get()->coalescedGetattrs.addValue(1);
+  }
+  return future;
 }
 
 folly::Future<std::shared_ptr<DirHandle>> EdenDispatcher::opendir(
@@ -85,61 +152,104 @@ folly::Future<std::shared_ptr<DirHandle>> EdenDispatcher::opendir(
     int flags) {
   FB_LOGF(
       mount_->getStraceLogger(), DBG7, "opendir({}, flags={:x})", ino, flags);
-  return inodeMap_->lookupTreeInode(ino).then(
+  auto inodeFuture = inodeMap_->lookupTreeInode(ino);
+  hotInodes_.record(ino, inodeFuture.isReady());
+  return std::move(inodeFuture).then(
       [](const TreeInodePtr& inode) { return inode->opendir(); });
 }
 
+folly::Future<EdenDispatcher::LookupResult> EdenDispatcher::lookupChild(
+    InodeNumber parent,
+    PathComponent name) {
+  return inodeMap_->lookupTreeInode(parent).then(
+      [name = std::move(name)](const TreeInodePtr& tree) {
+        checkInScope(*tree, ENOENT);
+        // Stat-only walks look up every directory without reading most of
+        // them, so do not fetch a directory's Tree just to return its inode
+        // number.
+        if (FLAGS_lookup_unloaded_directories) {
+          if (auto attr = tree->getUnloadedChildAttr(name)) {
+            return makeFuture(LookupResult{InodePtr{}, attr.value(), tree});
+          }
+        }
+        return tree->getOrLoadChild(name).then(&lookupResultForInode);
+      });
+}
+
+folly::Future<EdenDispatcher::LookupResult>
+EdenDispatcher::lookupResultForInode(const InodePtr& inode) {
+  return folly::makeFutureWith([&]() { return inode->getattr(); })
+      .then([inode](folly::Try<Dispatcher::Attr> maybeAttr) {
+        if (maybeAttr.hasValue()) {
+          // Preserve inode's life for the duration of the prefetch.
+          inode->prefetch().ensure([inode] {});
+          return LookupResult{inode, maybeAttr.value()};
+        } else {
+          // The most common case for getattr() failing is if this file is
+          // materialized but the data for it in the overlay is missing
+          // or corrupt.  This can happen after a hard reboot where the
+          // overlay data was not synced to disk first.
+          //
+          // We intentionally want to return a result here rather than
+          // failing; otherwise we can't return the inode number to the
+          // kernel at all.  This blocks other operations on the file,
+          // like FUSE_UNLINK.  By successfully returning from the
+          // lookup we allow clients to remove this corrupt file with an
+          // unlink operation.  (Even though FUSE_UNLINK does not require
+          // the child inode number, the kernel does not appear to send a
+          // FUSE_UNLINK request to us if it could not get the child inode
+          // number first.)
+          XLOG(WARN) << "error getting attributes for inode "
+                     << inode->getNodeId() << " (" << inode->getLogPath()
+                     << "): " << maybeAttr.exception().what();
+          return LookupResult{inode, attrForInodeWithCorruptOverlay()};
+        }
+      });
+}
+
 folly::Future<fuse_entry_out> EdenDispatcher::lookup(
     InodeNumber parent,
     PathComponentPiece namepiece) {
   FB_LOGF(mount_->getStraceLogger(), DBG7, "lookup({}, {})", parent, namepiece);
-  return inodeMap_->lookupTreeInode(parent)
-      .then([name = PathComponent(namepiece)](const TreeInodePtr& tree) {
-        return tree->getOrLoadChild(name);
-      })
-      .then([](const InodePtr& inode) {
-        return folly::makeFutureWith([&]() { return inode->getattr(); })
-            .then([inode](folly::Try<Dispatcher::Attr> maybeAttr) {
-              if (maybeAttr.hasValue()) {
-                // Preserve inode's life for the duration of the prefetch.
-                inode->prefetch().ensure([inode] {});
-                inode->incFuseRefcount();
-                return computeEntryParam(inode->getNodeId(), maybeAttr.value());
-              } else {
-                // The most common case for getattr() failing is if this file is
-                // materialized but the data for it in the overlay is missing
-                // or corrupt.  This can happen after a hard reboot where the
-                // overlay data was not synced to disk first.
-                //
-                // We intentionally want to return a result here rather than
-                // failing; otherwise we can't return the inode number to the
-                // kernel at all.  This blocks other operations on the file,
-                // like FUSE_UNLINK.  By successfully returning from the
-                // lookup we allow clients to remove this corrupt file with an
-                // unlink operation.  (Even though FUSE_UNLINK does not require
-                // the child inode number, the kernel does not appear to send a
-                // FUSE_UNLINK request to us if it could not get the child inode
-                // number first.)
-                XLOG(WARN) << "error getting attributes for inode "
-                           << inode->getNodeId() << " (" << inode->getLogPath()
-                           << "): " << maybeAttr.exception().what();
-                inode->incFuseRefcount();
-                return computeEntryParam(
-                    inode->getNodeId(), attrForInodeWithCorruptOverlay());
-              }
-            });
+  PathComponent name{namepiece};
+  bool started = false;
+  auto future = pendingLookups_.load(
+      LookupKey{parent, name, getModificationGeneration()}, [&] {
+        started = true;
+        return lookupChild(parent, name);
+      });
+  if (!started) {
+    getStats()->get()->coalescedLookups.addValue(1);
+  }
+  return std::move(future)
+      .thenValue([name = std::move(name)](const LookupResult& result) {
+        if (!result.inode) {
+          // The child was answered without being loaded.  Record the
+          // kernel's reference in the parent's entry for it.
+          InodeNumber number{result.attr.st.st_ino};
+          if (!result.parent->incChildFuseRefcount(name, number)) {
+            folly::throwSystemErrorExplicit(
+                ESTALE,
+                result.parent->getLogPath(),
+                "/",
+                name,
+                " changed during lookup");
+          }
+          return computeEntryParam(number, result.attr);
+        }
+        result.inode->incFuseRefcount();
+        return computeEntryParam(result.inode->getNodeId(), result.attr);
       })
-      .onError([](const std::system_error& err) {
-        // Translate ENOENT into a successful response with an
-        // inode number of 0 and a large entry_valid time, to let the kernel
-        // cache this negative lookup result.
+      .onError([this, parent](const std::system_error& err) {
+        // Translate ENOENT into a successful response with an inode number of
+        // 0, to let the kernel cache this negative lookup result.  The
+        // parent is still loaded if this came from looking up the child.
         if (isEnoent(err)) {
-          fuse_entry_out entry = {};
-          entry.attr_valid =
-              std::numeric_limits<decltype(entry.attr_valid)>::max();
-          entry.entry_valid =
-              std::numeric_limits<decltype(entry.entry_valid)>::max();
-          return entry;
+          if (auto tree = inodeMap_->lookupLoadedTree(parent)) {
+            if (auto entry = negativeEntryParam(*tree)) {
+              return *entry;
+            }
+          }
         }
         throw err;
       });
@@ -158,12 +268,26 @@ void EdenDispatcher::forget(InodeNumber ino, unsigned long nlookup) {
   inodeMap_->decFuseRefcount(ino, nlookup);
 }
 
+void EdenDispatcher::batchForget(folly::Range<const InodeForget*> forgets) {
+  FB_LOGF(
+      mount_->getStraceLogger(),
+      DBG7,
+      "batchForget({} inodes)",
+      forgets.size());
+  inodeMap_->decFuseRefcounts(forgets);
+}
+
 folly::Future<std::shared_ptr<FileHandle>> EdenDispatcher::open(
     InodeNumber ino,
     int flags) {
   FB_LOGF(mount_->getStraceLogger(), DBG7, "open({}, flags={:x})", ino, flags);
-  return inodeMap_->lookupFileInode(ino).then(
-      [flags](const FileInodePtr& inode) { return inode->open(flags); });
+  auto inodeFuture = inodeMap_->lookupFileInode(ino);
+  hotInodes_.record(ino, inodeFuture.isReady());
+  return std::move(inodeFuture).then(
+      [this, flags](const FileInodePtr& inode) {
+        mount_->recordFileAccess(*inode);
+        return inode->open(flags);
+      });
 }
 
 folly::Future<Dispatcher::Create> EdenDispatcher::create(
@@ -182,6 +306,7 @@ folly::Future<Dispatcher::Create> EdenDispatcher::create(
   return inodeMap_->lookupTreeInode(parent)
       .then([childName = PathComponent{name}, mode, flags](
                 const TreeInodePtr& parentInode) {
+        checkInScope(*parentInode, EPERM);
         return parentInode->create(childName, mode, flags);
       })
       .then([=](TreeInode::CreateResult created) {
@@ -215,6 +340,7 @@ folly::Future<fuse_entry_out> EdenDispatcher::mknod(
       rdev);
   return inodeMap_->lookupTreeInode(parent).then(
       [childName = PathComponent{name}, mode, rdev](const TreeInodePtr& inode) {
+        checkInScope(*inode, EPERM);
         auto child = inode->mknod(childName, mode, rdev);
         return child->getattr().then([child](Dispatcher::Attr attr) {
           child->incFuseRefcount();
@@ -236,6 +362,7 @@ folly::Future<fuse_entry_out> EdenDispatcher::mkdir(
       mode);
   return inodeMap_->lookupTreeInode(parent).then(
       [childName = PathComponent{name}, mode](const TreeInodePtr& inode) {
+        checkInScope(*inode, EPERM);
         auto child = inode->mkdir(childName, mode);
         return child->getattr().then([child](Dispatcher::Attr attr) {
           child->incFuseRefcount();
@@ -273,6 +400,7 @@ folly::Future<fuse_entry_out> EdenDispatcher::symlink(
   return inodeMap_->lookupTreeInode(parent).then(
       [linkContents = link.str(),
        childName = PathComponent{name}](const TreeInodePtr& inode) {
+        checkInScope(*inode, EPERM);
         auto symlinkInode = inode->symlink(childName, linkContents);
         symlinkInode->incFuseRefcount();
         return symlinkInode->getattr().then([symlinkInode](Attr&& attr) {
@@ -305,6 +433,7 @@ folly::Future<folly::Unit> EdenDispatcher::rename(
                 const TreeInodePtr& parent) mutable {
         return std::move(npFuture).then(
             [parent, name, newName](const TreeInodePtr& newParent) {
+              checkInScope(*newParent, EPERM);
               return parent->rename(name, newParent, newName);
             });
       });
@@ -10,6 +10,9 @@
 #pragma once
 #include "eden/fs/fuse/Dispatcher.h"
 #include "eden/fs/inodes/InodePtr.h"
+#include "eden/fs/utils/HotKeyTracker.h"
+#include "eden/fs/utils/PathFuncs.h"
+#include "eden/fs/utils/PendingLoadMap.h"
 
 namespace facebook {
 namespace eden {
@@ -41,6 +44,7 @@ class EdenDispatcher : public Dispatcher {
       PathComponentPiece name) override;
 
   void forget(InodeNumber ino, unsigned long nlookup) override;
+  void batchForget(folly::Range<const InodeForget*> forgets) override;
   folly::Future<std::shared_ptr<FileHandle>> open(InodeNumber ino, int flags)
       override;
   folly::Future<std::string> readlink(InodeNumber ino) override;
@@ -79,7 +83,67 @@ class EdenDispatcher : public Dispatcher {
       override;
   folly::Future<std::vector<std::string>> listxattr(InodeNumber ino) override;
 
+  using HotInodeTracker = HotKeyTracker<InodeNumber>;
+
+  /**
+   * Get the most frequently opened files and directories.  An open is a hit
+   * if the inode was already loaded.  Inode numbers are tracked rather than
+   * paths, so that no path has to be built while serving the request; use
+   * InodeMap::getPathForInode() to name them.
+   */
+  HotInodeTracker& getHotInodes() {
+    return hotInodes_;
+  }
+
  private:
+  /**
+   * Identifies a lookup or getattr that may share its result with identical
+   * requests in progress.  The modification generation keeps requests that
+   * arrived on either side of a change to the mount apart.
+   */
+  struct LookupKey {
+    InodeNumber parent;
+    PathComponent name;
+    uint64_t generation;
+
+    bool operator==(const LookupKey& other) const {
+      return parent == other.parent && generation == other.generation &&
+          name == other.name;
+    }
+  };
+  struct LookupKeyHasher {
+    size_t operator()(const LookupKey& key) const;
+  };
+  struct GetattrKey {
+    InodeNumber ino;
+    uint64_t generation;
+
+    bool operator==(const GetattrKey& other) const {
+      return ino == other.ino && generation == other.generation;
+    }
+  };
+  struct GetattrKeyHasher {
+    size_t operator()(const GetattrKey& key) const;
+  };
+
+  /**
+   * The part of a lookup that identical requests can share.  Each request
+   * still takes its own FUSE reference on the inode.
+   */
+  struct LookupResult {
+    // Null if the child was answered from its entry in parent, without
+    // loading it.
+    InodePtr inode;
+    Attr attr;
+    TreeInodePtr parent;
+  };
+
+  folly::Future<LookupResult> lookupChild(
+      InodeNumber parent,
+      PathComponent name);
+  static folly::Future<LookupResult> lookupResultForInode(
+      const InodePtr& inode);
+
   // The EdenMount that owns this EdenDispatcher.
   EdenMount* const mount_;
   // The EdenMount's InodeMap.
@@ -87,6 +151,9 @@ class EdenDispatcher : public Dispatcher {
   // every FUSE request, and having it locally avoids  having to dereference
   // mount_ first.
   InodeMap* const inodeMap_;
+  HotInodeTracker hotInodes_;
+  PendingLoadMap<LookupKey, LookupResult, LookupKeyHasher> pendingLookups_;
+  PendingLoadMap<GetattrKey, Attr, GetattrKeyHasher> pendingGetattrs_;
 };
 } // namespace eden
 } // namespace facebook
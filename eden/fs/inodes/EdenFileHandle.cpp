@@ -90,6 +90,10 @@ folly::Future<size_t> EdenFileHandle::write(folly::StringPiece str, off_t off) {
       inode_->getNodeId(),
       off,
       str.size());
+  // Buffered writes are recorded in the journal when they are flushed.
+  if (auto size = inode_->tryBufferWrite(str, off)) {
+    return size.value();
+  }
   return inode_->write(str, off).then([inode = inode_](size_t size) {
     auto myname = inode->getPath();
     if (myname.hasValue()) {
@@ -116,8 +120,7 @@ folly::Future<folly::Unit> EdenFileHandle::fsync(bool datasync) {
       DBG7,
       "fsync({})",
       inode_->getNodeId());
-  inode_->fsync(datasync);
-  return folly::unit;
+  return inode_->fsync(datasync);
 }
 } // namespace eden
 } // namespace facebook
@@ -12,6 +12,7 @@
 #include <folly/ExceptionWrapper.h>
 #include <folly/FBString.h>
 #include <folly/File.h>
+#include <folly/FileUtil.h>
 #ifndef EDEN_WIN
 #include <folly/Subprocess.h>
 #endif
@@ -20,7 +21,10 @@
 #include <folly/io/async/EventBase.h>
 #include <folly/logging/Logger.h>
 #include <folly/logging/xlog.h>
+#include <folly/stop_watch.h>
 #include <folly/system/ThreadName.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+#include <deque>
 
 #include "eden/fs/config/ClientConfig.h"
 #include "eden/fs/fuse/DirHandle.h"
@@ -35,17 +39,22 @@
 #include "eden/fs/inodes/InodeMap.h"
 #include "eden/fs/inodes/InodeTable.h"
 #include "eden/fs/inodes/Overlay.h"
+#include "eden/fs/inodes/ScmStatusCache.h"
 #include "eden/fs/inodes/ServerState.h"
 #include "eden/fs/inodes/TopLevelIgnores.h"
 #include "eden/fs/inodes/TreeInode.h"
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/model/Tree.h"
 #include "eden/fs/model/git/GitIgnoreStack.h"
+#include "eden/fs/service/ThriftUtil.h"
+#include "eden/fs/store/CommitDiffCache.h"
 #include "eden/fs/store/ObjectStore.h"
+#include "eden/fs/store/PathIndex.h"
 #include "eden/fs/utils/Bug.h"
 #include "eden/fs/utils/Clock.h"
 #include "eden/fs/utils/UnboundedQueueExecutor.h"
 
+using apache::thrift::CompactSerializer;
 using folly::Future;
 using folly::makeFuture;
 using folly::setThreadName;
@@ -60,6 +69,37 @@ using std::vector;
 using std::chrono::system_clock;
 
 DEFINE_int32(fuseNumThreads, 16, "how many fuse dispatcher threads to spawn");
+DEFINE_uint64(
+    fuse_attr_timeout,
+    std::numeric_limits<uint64_t>::max(),
+    "How long, in seconds, the kernel may cache the attributes and directory "
+    "entries of inodes that match source control.  These only change on "
+    "checkout, which invalidates them in the kernel.");
+DEFINE_uint64(
+    fuse_materialized_attr_timeout,
+    std::numeric_limits<uint64_t>::max(),
+    "How long, in seconds, the kernel may cache the attributes and directory "
+    "entries of inodes that have been modified locally.");
+DEFINE_uint64(
+    path_inode_cache_size,
+    10000,
+    "How many recently resolved paths each mount remembers the inode number "
+    "of, for thrift calls that take paths.  0 disables the cache.");
+DEFINE_uint64(
+    takeover_warm_max_directories,
+    100000,
+    "How many loaded directories a graceful restart hands to the new process "
+    "to load again in the background.  0 disables cache warming.");
+DEFINE_uint64(
+    takeover_warm_max_blobs,
+    10000,
+    "How many blobs of loaded files a graceful restart hands to the new "
+    "process to fetch again in the background.");
+DEFINE_uint64(
+    access_profile_max_paths,
+    1000000,
+    "The most paths that a single access profile recording keeps.  Files "
+    "opened after a recording is full are not recorded.");
 
 namespace facebook {
 namespace eden {
@@ -107,14 +147,15 @@ class EdenMount::JournalDiffCallback : public InodeDiffCallback {
     auto diffContext = mount->createDiffContext(this, /* listIgnored */ false);
     auto rawContext = diffContext.get();
 
-    return rootInode
-        ->diff(
-            rawContext,
-            RelativePathPiece{},
-            std::move(rootTree),
-            rawContext->getToplevelIgnore(),
-            false)
-        .ensure([diffContext = std::move(diffContext)]() {});
+    auto future = rootInode->diff(
+        rawContext,
+        RelativePathPiece{},
+        std::move(rootTree),
+        rawContext->getToplevelIgnore(),
+        false);
+    return std::move(future).ensure(
+        [diffContext = std::move(diffContext),
+         rootInode = std::move(rootInode)]() {});
   }
 
   /** moves the JournalDelta information out of this diff callback instance,
@@ -138,12 +179,16 @@ class EdenMount::JournalDiffCallback : public InodeDiffCallback {
 
 constexpr int EdenMount::kMaxSymlinkChainDepth;
 static constexpr folly::StringPiece kEdenStracePrefix = "eden.strace.";
+// The journal saved in the client directory by a clean shutdown.
+static constexpr folly::StringPiece kSavedJournalFile{"journal"};
+// How many directories or blobs warmCaches() requests at a time.
+static constexpr size_t kWarmBatchSize = 64;
 
 // We compute this when the process is initialized, but stash a copy
-// in each EdenMount.  We may in the future manage to propagate enough
-// state across upgrades or restarts that we can preserve this, but
-// as implemented today, a process restart will invalidate any cached
-// mountGeneration that a client may be holding on to.
+// in each EdenMount.  A mount that restores its journal after a graceful
+// restart or a clean shutdown keeps the generation it had before; otherwise a
+// process restart will invalidate any cached mountGeneration that a client
+// may be holding on to.
 // We take the bottom 16-bits of the pid and 32-bits of the current
 // time and shift them up, leaving 16 bits for a mount point generation
 // number.
@@ -158,36 +203,64 @@ static std::atomic<uint16_t> mountGeneration{0};
 std::shared_ptr<EdenMount> EdenMount::create(
     std::unique_ptr<ClientConfig> config,
     std::unique_ptr<ObjectStore> objectStore,
-    std::shared_ptr<ServerState> serverState) {
-  return std::shared_ptr<EdenMount>{
-      new EdenMount{
-          std::move(config), std::move(objectStore), std::move(serverState)},
-      EdenMountDeleter{}};
+    std::shared_ptr<ServerState> serverState,
+    std::unique_ptr<Overlay> overlay) {
+  return std::shared_ptr<EdenMount>{new EdenMount{std::move(config),
+                                                  std::move(objectStore),
+                                                  std::move(serverState),
+                                                  std::move(overlay)},
+                                    EdenMountDeleter{}};
 }
 
 EdenMount::EdenMount(
     std::unique_ptr<ClientConfig> config,
     std::unique_ptr<ObjectStore> objectStore,
-    std::shared_ptr<ServerState> serverState)
+    std::shared_ptr<ServerState> serverState,
+    std::unique_ptr<Overlay> overlay)
     : config_(std::move(config)),
       serverState_(std::move(serverState)),
+      mountStats_{std::make_unique<ThreadLocalEdenStats>(
+          [prefix = getCounterName(CounterName::FUSE)] {
+            return new EdenStats(prefix);
+          })},
       inodeMap_{new InodeMap(this)},
       dispatcher_{new EdenDispatcher(this)},
       objectStore_(std::move(objectStore)),
-      overlay_(std::make_unique<Overlay>(config_->getOverlayPath())),
+      overlay_(
+          overlay ? std::move(overlay)
+                  : std::make_unique<Overlay>(config_->getOverlayPath())),
+      pathInodeCache_{folly::in_place,
+                      std::max<uint64_t>(FLAGS_path_inode_cache_size, 1)},
       bindMounts_(config_->getBindMounts()),
+      scmStatusCache_{std::make_unique<ScmStatusCache>(this)},
+      commitDiffCache_{std::make_unique<CommitDiffCache>(objectStore_.get())},
       mountGeneration_(globalProcessGeneration | ++mountGeneration),
       straceLogger_{kEdenStracePrefix.str() + config_->getMountPath().value()},
+      lastThriftActivity_{
+          std::chrono::steady_clock::now().time_since_epoch().count()},
       lastCheckoutTime_{serverState_->getClock()->getRealtime()},
+      scope_{folly::in_place, config_->getScopeIncludes()},
+      scopeRestricted_{scope_.rlock()->isRestricted()},
       uid_(getuid()),
       gid_(getgid()),
       clock_(serverState_->getClock()) {}
 
 folly::Future<folly::Unit> EdenMount::initialize(
-    const folly::Optional<SerializedInodeMap>& takeover) {
+    const folly::Optional<SerializedInodeMap>& takeover,
+    const folly::Optional<SerializedJournal>& takeoverJournal) {
   auto parents = std::make_shared<ParentCommits>(config_->getParentCommits());
   parentInfo_.wlock()->parents.setParents(*parents);
 
+  // Always remove a saved journal, even after a takeover, so that it cannot
+  // be picked up by a later restart that it does not describe.
+  auto savedJournal = loadSavedJournal();
+  bool restoredJournal = false;
+  if (takeoverJournal) {
+    restoredJournal = restoreJournal(*takeoverJournal, parents->parent1());
+  } else if (savedJournal && !takeover) {
+    restoredJournal = restoreJournal(*savedJournal, parents->parent1());
+  }
+
   // Do this before the root TreeInode is allocated in case it needs to allocate
   // any inode numbers.
   if (!takeover) {
@@ -206,7 +279,7 @@ folly::Future<folly::Unit> EdenMount::initialize(
   CHECK(overlay_->hasInitializedNextInodeNumber());
 
   return createRootInode(*parents).then(
-      [this, parents, takeover](TreeInodePtr initTreeNode) {
+      [this, parents, takeover, restoredJournal](TreeInodePtr initTreeNode) {
         if (takeover) {
           inodeMap_->initializeFromTakeover(std::move(initTreeNode), *takeover);
         } else {
@@ -215,11 +288,19 @@ folly::Future<folly::Unit> EdenMount::initialize(
 
         // Record the transition from no snapshot to the current snapshot in
         // the journal.  This also sets things up so that we can carry the
-        // snapshot id forward through subsequent journal entries.
-        auto delta = std::make_unique<JournalDelta>();
-        delta->toHash = parents->parent1();
-        journal_.addDelta(std::move(delta));
+        // snapshot id forward through subsequent journal entries.  A restored
+        // journal already ends on the current snapshot.
+        if (!restoredJournal) {
+          auto delta = std::make_unique<JournalDelta>();
+          delta->toHash = parents->parent1();
+          journal_.addDelta(std::move(delta));
+        }
         return setupDotEden(getRootInode());
+      })
+      .thenValue([this](folly::Unit) {
+        // If the next inode number came from the inode checkpoint, confirm
+        // it against the overlay without holding up the mount.
+        overlay_->verifyNextInodeNumberInBackground();
       });
 }
 
@@ -337,7 +418,11 @@ void EdenMount::destroy() {
               << " in unexpected state " << static_cast<uint32_t>(oldState);
 }
 
-Future<std::tuple<SerializedFileHandleMap, SerializedInodeMap>>
+Future<std::tuple<
+    SerializedFileHandleMap,
+    SerializedInodeMap,
+    SerializedJournal,
+    SerializedWarmState>>
 EdenMount::shutdown(bool doTakeover, bool allowFuseNotStarted) {
   // shutdown() should only be called on mounts that have not yet reached
   // SHUTTING_DOWN or later states.  Confirm this is the case, and move to
@@ -353,7 +438,11 @@ EdenMount::shutdown(bool doTakeover, bool allowFuseNotStarted) {
   return shutdownImpl(doTakeover);
 }
 
-Future<std::tuple<SerializedFileHandleMap, SerializedInodeMap>>
+Future<std::tuple<
+    SerializedFileHandleMap,
+    SerializedInodeMap,
+    SerializedJournal,
+    SerializedWarmState>>
 EdenMount::shutdownImpl(bool doTakeover) {
   journal_.cancelAllSubscribers();
   XLOG(DBG1) << "beginning shutdown for EdenMount " << getPath();
@@ -364,24 +453,480 @@ EdenMount::shutdownImpl(bool doTakeover) {
   auto fileHandleMap = doTakeover
       ? getDispatcher()->getFileHandles().serializeMap()
       : SerializedFileHandleMap{};
+  // This has to be recorded before the InodeMap unloads everything.
+  SerializedWarmState warmState;
+  if (doTakeover) {
+    auto prepared = preparedWarmState_.wlock();
+    warmState = prepared->hasValue() ? std::move(prepared->value())
+                                     : collectWarmState();
+  }
 
   return inodeMap_->shutdown(doTakeover)
-      .then([this, fileHandleMap = std::move(fileHandleMap)](
-                SerializedInodeMap inodeMap) {
+      .then([this,
+             doTakeover,
+             fileHandleMap = std::move(fileHandleMap),
+             warmState = std::move(warmState)](
+                SerializedInodeMap inodeMap) mutable {
         XLOG(DBG1) << "shutdown complete for EdenMount " << getPath();
+        // All inodes are gone, so nothing can add to the journal any more.
+        SerializedJournal journal;
+        if (doTakeover) {
+          journal = serializeJournal();
+        } else {
+          saveJournal();
+        }
+
         // Close the Overlay object to make sure we have released its lock.
         // This is important during graceful restart to ensure that we have
         // released the lock before the new edenfs process begins to take over
         // the mount point.
         overlay_->close();
         state_.store(State::SHUT_DOWN);
-        return std::make_tuple(fileHandleMap, inodeMap);
+        return std::make_tuple(
+            fileHandleMap,
+            inodeMap,
+            std::move(journal),
+            std::move(warmState));
+      });
+}
+
+Future<Unit> EdenMount::prepareForTakeover() {
+  folly::stop_watch<std::chrono::milliseconds> timer;
+  *preparedWarmState_.wlock() = collectWarmState();
+
+  // Everything is old enough to unload.
+  auto cutoff =
+      folly::to<timespec>(system_clock::now() + std::chrono::hours(1));
+  auto unloaded = getRootInode()->unloadChildrenLastAccessedBefore(cutoff);
+  XLOG(DBG1) << "unloaded " << unloaded << " inodes from " << getPath()
+             << " in " << timer.elapsed().count() << "ms before takeover";
+
+  return overlay_->flushPendingAsync();
+}
+
+void EdenMount::recordActivity() {
+  lastThriftActivity_.store(
+      std::chrono::steady_clock::now().time_since_epoch().count(),
+      std::memory_order_relaxed);
+}
+
+std::chrono::steady_clock::time_point EdenMount::getLastActivityTime() const {
+  std::chrono::steady_clock::time_point thriftTime{
+      std::chrono::steady_clock::duration{
+          lastThriftActivity_.load(std::memory_order_relaxed)}};
+  return std::max(thriftTime, dispatcher_->getLastRequestTime());
+}
+
+bool EdenMount::isHibernating() const {
+  auto hibernatedAt = hibernatedAt_.load(std::memory_order_relaxed);
+  return hibernatedAt != 0 &&
+      getLastActivityTime().time_since_epoch().count() <= hibernatedAt;
+}
+
+Future<size_t> EdenMount::hibernate(size_t journalMemoryLimit) {
+  if (state_.load(std::memory_order_acquire) >= State::SHUTTING_DOWN) {
+    return makeFuture<size_t>(0);
+  }
+  folly::stop_watch<std::chrono::milliseconds> timer;
+  hibernatedAt_.store(
+      std::chrono::steady_clock::now().time_since_epoch().count(),
+      std::memory_order_relaxed);
+
+  // Everything is old enough to unload, and open files drop their blobs.
+  auto cutoff =
+      folly::to<timespec>(system_clock::now() + std::chrono::hours(1));
+  size_t unloaded = getRootInode()->unloadChildrenLastAccessedBefore(cutoff);
+  auto blobBytes = inodeMap_->releaseIdleBlobs(
+      std::chrono::steady_clock::now() + std::chrono::hours(1));
+
+  pathInodeCache_.lock()->clear();
+  scmStatusCache_->clear();
+  commitDiffCache_->clear();
+  journal_.shrinkTo(journalMemoryLimit);
+  if (auto* table = getInodeMetadataTable()) {
+    table->releaseMemory();
+  }
+
+  XLOG(DBG1) << "hibernated " << getPath() << ": unloaded " << unloaded
+             << " inodes and " << blobBytes << " bytes of blobs in "
+             << timer.elapsed().count() << "ms";
+  return overlay_->flushPendingAsync().thenValue(
+      [unloaded](auto&&) { return unloaded; });
+}
+
+SerializedWarmState EdenMount::collectWarmState() const {
+  SerializedWarmState warmState;
+  const auto maxDirectories = FLAGS_takeover_warm_max_directories;
+  const auto maxBlobs = FLAGS_takeover_warm_max_blobs;
+  if (maxDirectories == 0) {
+    return warmState;
+  }
+
+  // Walk breadth first, so that if there are too many directories to send
+  // we keep the ones closest to the root.
+  std::deque<std::pair<TreeInodePtr, RelativePath>> pending;
+  pending.emplace_back(getRootInode(), RelativePath{});
+  while (!pending.empty() &&
+         warmState.loadedDirectories.size() < maxDirectories) {
+    auto tree = std::move(pending.front().first);
+    auto path = std::move(pending.front().second);
+    pending.pop_front();
+    if (!path.empty()) {
+      warmState.loadedDirectories.push_back(path.stringPiece().str());
+    }
+
+    auto contents = tree->getContents().rlock();
+    for (const auto& entry : contents->entries) {
+      if (!entry.second.getInode()) {
+        continue;
+      }
+      if (auto child = entry.second.asTreePtrOrNull()) {
+        pending.emplace_back(std::move(child), path + entry.first);
+      } else if (
+          !entry.second.isMaterialized() &&
+          warmState.blobHashes.size() < maxBlobs) {
+        warmState.blobHashes.push_back(thriftHash(entry.second.getHash()));
+      }
+    }
+  }
+  return warmState;
+}
+
+namespace {
+/**
+ * Call fn on each of items, kWarmBatchSize at a time, until they have all
+ * been processed or shouldStop() returns true.  Errors are ignored.
+ */
+template <typename Item, typename Fn, typename StopFn>
+Future<Unit> warmInBatches(
+    std::shared_ptr<std::vector<Item>> items,
+    size_t start,
+    folly::Executor* executor,
+    Fn fn,
+    StopFn shouldStop) {
+  if (start >= items->size() || shouldStop()) {
+    return folly::makeFuture();
+  }
+  auto end = std::min(start + kWarmBatchSize, items->size());
+  std::vector<Future<Unit>> batch;
+  for (auto n = start; n < end; ++n) {
+    batch.push_back(folly::makeFutureWith([&] { return fn((*items)[n]); }));
+  }
+  return folly::collectAll(batch).via(executor).then(
+      [items = std::move(items), end, executor, fn, shouldStop](
+          std::vector<folly::Try<Unit>>&&) mutable {
+        return warmInBatches(
+            std::move(items), end, executor, std::move(fn), shouldStop);
+      });
+}
+} // namespace
+
+Future<Unit> EdenMount::warmCaches(SerializedWarmState warmState) {
+  auto* executor = getBackgroundThreadPool().get();
+  auto shouldStop = [this] {
+    return state_.load(std::memory_order_acquire) >= State::SHUTTING_DOWN;
+  };
+  auto directories = std::make_shared<std::vector<std::string>>(
+      std::move(warmState.loadedDirectories));
+  auto blobs = std::make_shared<std::vector<std::string>>(
+      std::move(warmState.blobHashes));
+  XLOG(DBG2) << "warming " << getPath() << " with " << directories->size()
+             << " directories and " << blobs->size() << " blobs";
+
+  folly::stop_watch<> timer;
+  // Directories are loaded first, since FUSE requests need their inodes
+  // while blobs are only needed once a file is read.
+  return folly::via(executor)
+      .then([this, directories, executor, shouldStop] {
+        return warmInBatches(
+            directories,
+            0,
+            executor,
+            [this](const std::string& path) {
+              return getInode(RelativePathPiece{path}).unit();
+            },
+            shouldStop);
+      })
+      .then([this, blobs, executor, shouldStop] {
+        return warmInBatches(
+            blobs,
+            0,
+            executor,
+            [this](const std::string& hash) {
+              return getObjectStore()
+                  ->getBlob(hashFromThrift(hash), ImportPriority::Background)
+                  .unit();
+            },
+            shouldStop);
+      })
+      .then([this, timer] {
+        XLOG(DBG1) << "finished warming caches for " << getPath() << " in "
+                   << std::chrono::duration_cast<std::chrono::milliseconds>(
+                          timer.elapsed())
+                          .count()
+                   << "ms";
       });
 }
+
+bool EdenMount::startRecordingAccessProfile(StringPiece tag) {
+  auto profiles = accessProfiles_.wlock();
+  if (!profiles->emplace(tag.str(), AccessProfile{}).second) {
+    return false;
+  }
+  recordingAccessProfiles_.store(true, std::memory_order_release);
+  XLOG(DBG2) << "started recording access profile \"" << tag << "\" for "
+             << getPath();
+  return true;
+}
+
+folly::Optional<AccessProfile> EdenMount::stopRecordingAccessProfile(
+    StringPiece tag) {
+  auto profiles = accessProfiles_.wlock();
+  auto iter = profiles->find(tag.str());
+  if (iter == profiles->end()) {
+    return folly::none;
+  }
+  auto profile = std::move(iter->second);
+  profiles->erase(iter);
+  recordingAccessProfiles_.store(
+      !profiles->empty(), std::memory_order_release);
+  XLOG(DBG2) << "recorded " << profile.size() << " paths in access profile \""
+             << tag << "\" for " << getPath();
+  return std::move(profile);
+}
+
+void EdenMount::recordFileAccess(const InodeBase& inode) {
+  if (!recordingAccessProfiles_.load(std::memory_order_acquire)) {
+    return;
+  }
+  // getPath() returns none for unlinked files, which a later build could not
+  // open by name anyway.
+  auto path = inode.getPath();
+  if (!path) {
+    return;
+  }
+  auto profiles = accessProfiles_.wlock();
+  for (auto& entry : *profiles) {
+    auto& profile = entry.second;
+    if (profile.size() < FLAGS_access_profile_max_paths) {
+      profile.add(path.value());
+    }
+  }
+}
+
+bool EdenMount::isOutsideScope(const TreeInode& dir) const {
+  if (!scopeRestricted_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  // Unlinked directories are empty anyway.
+  auto path = dir.getPath();
+  return path && isOutsideScope(path.value());
+}
+
+bool EdenMount::isOutsideScope(RelativePathPiece dir) const {
+  if (!scopeRestricted_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  return scope_.rlock()->isOutside(dir);
+}
+
+std::vector<RelativePath> EdenMount::getScopeIncludes() const {
+  return scope_.rlock()->getIncludes();
+}
+
+void EdenMount::widenScope(const std::vector<RelativePath>& paths) {
+  auto scope = scope_.wlock();
+  auto widened = *scope;
+  if (!widened.widen(paths)) {
+    return;
+  }
+  // Save the scope before it takes effect, so that a failure leaves the
+  // mount and its config in agreement.  Nothing needs to be invalidated in
+  // the kernel: lookups outside the scope are never cached as negative, and
+  // directory listings are not cached.
+  config_->setScopeIncludes(widened.getIncludes());
+  *scope = std::move(widened);
+  scopeRestricted_.store(scope->isRestricted(), std::memory_order_release);
+  XLOG(DBG2) << "widened the scope of " << getPath() << " to "
+             << scope->getIncludes().size() << " directories";
+}
+
+Future<size_t> EdenMount::prefetchAccessProfile(
+    std::shared_ptr<const AccessProfile> profile) {
+  return getRootTreeFuture().thenValue(
+      [this, profile = std::move(profile)](std::shared_ptr<const Tree> root) {
+        return ::facebook::eden::prefetchAccessProfile(
+            getObjectStore(),
+            std::move(root),
+            profile,
+            getBackgroundThreadPool().get());
+      });
+}
+
+Future<std::shared_ptr<const PathIndex>> EdenMount::getPathIndex(
+    const Hash& commitHash) {
+  return objectStore_->getTreeForCommit(commitHash)
+      .thenValue([this](std::shared_ptr<const Tree> root) {
+        {
+          auto index = pathIndex_.rlock();
+          if (*index && (*index)->getRootTreeID() == root->getHash()) {
+            return makeFuture(*index);
+          }
+        }
+        return PathIndex::getOrBuild(objectStore_.get(), root->getHash())
+            .thenValue([this](std::shared_ptr<const PathIndex> index) {
+              *pathIndex_.wlock() = index;
+              return index;
+            });
+      });
+}
+
+Future<OverlayChecker::Result> EdenMount::checkOverlay(bool repair) {
+  OverlayChecker::Options options;
+  options.repair = repair;
+  options.isInodeInUse = [inodeMap = getInodeMap()](InodeNumber ino) {
+    return inodeMap->isInodeRemembered(ino) ||
+        inodeMap->lookupLoadedInode(ino) != nullptr;
+  };
+  return overlay_->checkInBackground(std::move(options));
+}
+
+SerializedJournal EdenMount::serializeJournal() const {
+  std::vector<SerializedJournalDelta> deltas;
+  journal_.forEachDelta(
+      1,
+      std::numeric_limits<JournalDelta::SequenceNumber>::max(),
+      [&deltas](const JournalDelta& delta) {
+        SerializedJournalDelta serialized;
+        serialized.fromSequence = delta.fromSequence;
+        serialized.toSequence = delta.toSequence;
+        serialized.fromHash = thriftHash(delta.fromHash);
+        serialized.toHash = thriftHash(delta.toHash);
+        delta.forEachChangedPath(
+            [&serialized](RelativePathPiece path, const PathChangeInfo& info) {
+              SerializedPathChange change;
+              change.path = path.stringPiece().str();
+              change.existedBefore = info.existedBefore;
+              change.existedAfter = info.existedAfter;
+              serialized.changedPaths.push_back(std::move(change));
+            });
+        delta.forEachUncleanPath([&serialized](RelativePathPiece path) {
+          serialized.uncleanPaths.push_back(path.stringPiece().str());
+        });
+        deltas.push_back(std::move(serialized));
+        return true;
+      });
+  std::reverse(deltas.begin(), deltas.end());
+
+  SerializedJournal journal;
+  journal.mountGeneration = mountGeneration_;
+  journal.deltas = std::move(deltas);
+  return journal;
+}
+
+bool EdenMount::restoreJournal(
+    const SerializedJournal& journal,
+    const Hash& parent) {
+  if (journal.deltas.empty()) {
+    return false;
+  }
+
+  std::vector<std::unique_ptr<JournalDelta>> deltas;
+  deltas.reserve(journal.deltas.size());
+  JournalDelta::SequenceNumber lastSequence = 0;
+  try {
+    for (const auto& serialized : journal.deltas) {
+      auto delta = std::make_unique<JournalDelta>();
+      delta->fromSequence = serialized.fromSequence;
+      delta->toSequence = serialized.toSequence;
+      if (delta->fromSequence <= lastSequence ||
+          delta->toSequence < delta->fromSequence) {
+        throw std::domain_error("sequence numbers are out of order");
+      }
+      lastSequence = delta->toSequence;
+      delta->fromHash = hashFromThrift(serialized.fromHash);
+      delta->toHash = hashFromThrift(serialized.toHash);
+      for (const auto& change : serialized.changedPaths) {
+        delta->changedFilesInOverlay.emplace(
+            RelativePath{change.path},
+            PathChangeInfo{change.existedBefore, change.existedAfter});
+      }
+      for (const auto& path : serialized.uncleanPaths) {
+        delta->uncleanPaths.emplace(path);
+      }
+      deltas.push_back(std::move(delta));
+    }
+  } catch (const std::exception& e) {
+    XLOG(WARN) << "Not restoring the journal for " << getPath() << ": "
+               << e.what();
+    return false;
+  }
+  if (deltas.back()->toHash != parent) {
+    XLOG(WARN) << "Not restoring the journal for " << getPath()
+               << ": it does not end at the current commit " << parent;
+    return false;
+  }
+
+  journal_.restore(std::move(deltas));
+  mountGeneration_ = journal.mountGeneration;
+  XLOG(DBG1) << "restored " << journal.deltas.size() << " journal deltas for "
+             << getPath() << " through sequence " << lastSequence;
+  return true;
+}
+
+void EdenMount::saveJournal() const {
+  auto path =
+      config_->getClientDirectory() + PathComponentPiece{kSavedJournalFile};
+  try {
+    folly::writeFileAtomic(
+        path.stringPiece(),
+        CompactSerializer::serialize<std::string>(serializeJournal()));
+  } catch (const std::exception& e) {
+    XLOG(ERR) << "Failed to save the journal for " << getPath() << ": "
+              << e.what();
+  }
+}
+
+folly::Optional<SerializedJournal> EdenMount::loadSavedJournal() const {
+  auto path =
+      config_->getClientDirectory() + PathComponentPiece{kSavedJournalFile};
+  std::string data;
+  if (!folly::readFile(path.c_str(), data)) {
+    if (errno != ENOENT) {
+      XLOG(WARN) << "Failed to read the saved journal for " << getPath()
+                 << ": " << folly::errnoStr(errno);
+    }
+    return folly::none;
+  }
+  if (unlink(path.c_str()) != 0) {
+    // If it stays around, a later restart could restore it even though it
+    // is missing the changes made in the meantime.
+    XLOG(ERR) << "Failed to remove the saved journal for " << getPath()
+              << ": " << folly::errnoStr(errno);
+    return folly::none;
+  }
+
+  try {
+    return CompactSerializer::deserialize<SerializedJournal>(data);
+  } catch (const std::exception& e) {
+    XLOG(WARN) << "Ignoring the saved journal for " << getPath() << ": "
+               << e.what();
+    return folly::none;
+  }
+}
 const shared_ptr<UnboundedQueueExecutor>& EdenMount::getThreadPool() const {
   return serverState_->getThreadPool();
 }
 
+const shared_ptr<UnboundedQueueExecutor>& EdenMount::getBackgroundThreadPool()
+    const {
+  return serverState_->getBackgroundThreadPool();
+}
+
+const shared_ptr<UnboundedQueueExecutor>& EdenMount::getOverlayIoPool() const {
+  return serverState_->getOverlayIoPool();
+}
+
 InodeMetadataTable* EdenMount::getInodeMetadataTable() const {
   return overlay_->getInodeMetadataTable();
 }
@@ -398,6 +943,10 @@ ThreadLocalEdenStats* EdenMount::getStats() const {
   return &serverState_->getStats();
 }
 
+ThreadLocalEdenStats* EdenMount::getMountStats() const {
+  return mountStats_.get();
+}
+
 const vector<BindMount>& EdenMount::getBindMounts() const {
   return bindMounts_;
 }
@@ -423,7 +972,46 @@ std::shared_ptr<const Tree> EdenMount::getRootTree() const {
 }
 
 Future<InodePtr> EdenMount::getInode(RelativePathPiece path) const {
-  return inodeMap_->getRootInode()->getChildRecursive(path);
+  if (FLAGS_path_inode_cache_size == 0 || path.empty()) {
+    return inodeMap_->getRootInode()->getChildRecursive(path);
+  }
+
+  // Read the generation before the walk, so that a rename or unlink that
+  // races with it invalidates the result.
+  auto generation = pathInodeCacheGeneration_.load(std::memory_order_acquire);
+  folly::Optional<InodeNumber> cachedNumber;
+  {
+    auto cache = pathInodeCache_.lock();
+    auto iter = cache->find(path.copy());
+    if (iter != cache->end() && iter->second.generation == generation) {
+      cachedNumber = iter->second.inodeNumber;
+    }
+  }
+  if (cachedNumber) {
+    // Only use inodes that are still loaded; anything else takes the walk,
+    // which loads them.
+    auto inode = inodeMap_->lookupLoadedInode(*cachedNumber);
+    if (inode && !inode->isUnlinked()) {
+      return makeFuture<InodePtr>(std::move(inode));
+    }
+  }
+
+  return inodeMap_->getRootInode()->getChildRecursive(path).thenValue(
+      [this, path = path.copy(), generation](InodePtr inode) {
+        auto cache = pathInodeCache_.lock();
+        cache->set(path, PathInodeCacheEntry{inode->getNodeId(), generation});
+        return inode;
+      });
+}
+
+void EdenMount::invalidatePathInodeCache(const RenameLock& renameLock) {
+  DCHECK(renameLock.isHeld(this));
+  pathInodeCacheGeneration_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void EdenMount::invalidatePathInodeCache(const SharedRenameLock& renameLock) {
+  DCHECK(renameLock.isHeld(this));
+  pathInodeCacheGeneration_.fetch_add(1, std::memory_order_acq_rel);
 }
 
 InodePtr EdenMount::getInodeBlocking(RelativePathPiece path) const {
@@ -467,10 +1055,10 @@ folly::Future<InodePtr> EdenMount::resolveSymlinkImpl(
     return makeFuture<InodePtr>(bug.toException());
   }
 
-  return fileInode->readAll().then([this,
-                                    pInode,
-                                    path = std::move(path),
-                                    depth](std::string&& pointsTo) mutable {
+  return fileInode->readlink().then([this,
+                                     pInode,
+                                     path = std::move(path),
+                                     depth](std::string&& pointsTo) mutable {
     // normalized path to symlink target
     auto joinedExpected = joinAndNormalize(path.dirname(), pointsTo);
     if (joinedExpected.hasError()) {
@@ -510,6 +1098,10 @@ folly::Future<std::vector<CheckoutConflict>> EdenMount::checkout(
   // checkout
   *lastCheckoutTime_.wlock() = clock_->getRealtime();
 
+  // Stop FUSE reads that start during the checkout from sharing the results
+  // of reads that started before it, and again once it is done.
+  dispatcher_->bumpModificationGeneration();
+
   auto fromTreeFuture = objectStore_->getTreeForCommit(oldParents.parent1());
   auto toTreeFuture = objectStore_->getTreeForCommit(snapshotHash);
 
@@ -541,8 +1133,13 @@ folly::Future<std::vector<CheckoutConflict>> EdenMount::checkout(
         return std::move(journalDiffFuture)
             .then([this, ctx, fromTree, toTree]() {
               ctx->start(this->acquireRenameLock());
-              return this->getRootInode()->checkout(
-                  ctx.get(), fromTree, toTree);
+              ctx->startTreePrefetch(fromTree.get(), toTree.get());
+              // checkout() borrows the root inode, so hold it until the
+              // whole tree has been checked out.
+              auto rootInode = this->getRootInode();
+              auto future = rootInode->checkout(ctx.get(), fromTree, toTree);
+              return std::move(future).ensure(
+                  [rootInode = std::move(rootInode)] {});
             });
       })
       .then([ctx, snapshotHash] {
@@ -582,7 +1179,8 @@ folly::Future<std::vector<CheckoutConflict>> EdenMount::checkout(
         journal_.addDelta(std::move(journalDelta));
 
         return conflicts;
-      });
+      })
+      .ensure([this] { dispatcher_->bumpModificationGeneration(); });
 }
 
 std::unique_ptr<DiffContext> EdenMount::createDiffContext(
@@ -596,17 +1194,19 @@ std::unique_ptr<DiffContext> EdenMount::createDiffContext(
 }
 
 Future<Unit> EdenMount::diff(const DiffContext* ctxPtr, Hash commitHash) const {
+  // diff() borrows the root inode, so hold it until the diff completes.
   auto rootInode = getRootInode();
+  auto* rawRootInode = rootInode.get();
   return objectStore_->getTreeForCommit(commitHash)
-      .then([ctxPtr, rootInode = std::move(rootInode)](
-                std::shared_ptr<const Tree>&& rootTree) {
-        return rootInode->diff(
+      .then([ctxPtr, rawRootInode](std::shared_ptr<const Tree>&& rootTree) {
+        return rawRootInode->diff(
             ctxPtr,
             RelativePathPiece{},
             std::move(rootTree),
             ctxPtr->getToplevelIgnore(),
             false);
-      });
+      })
+      .ensure([rootInode = std::move(rootInode)] {});
 }
 
 Future<Unit> EdenMount::diff(
@@ -664,13 +1264,49 @@ SharedRenameLock EdenMount::acquireSharedRenameLock() {
   return SharedRenameLock{this};
 }
 
+std::unique_lock<std::mutex> EdenMount::acquireDirectoryRenameLock(
+    const SharedRenameLock& renameLock,
+    InodeNumber directory) {
+  DCHECK(renameLock.isHeld(this));
+  auto stripe = directory.get() % kNumDirectoryRenameStripes;
+  return std::unique_lock<std::mutex>{directoryRenameMutexes_[stripe]};
+}
+
 std::string EdenMount::getCounterName(CounterName name) {
-  const auto prefix = getPath().stringPiece().str();
+  return getCounterName(getPath(), name);
+}
+
+std::string EdenMount::getCounterName(
+    AbsolutePathPiece mountPath,
+    CounterName name) {
+  const auto prefix = mountPath.stringPiece().str();
   switch (name) {
     case CounterName::LOADED:
       return prefix + ".loaded";
     case CounterName::UNLOADED:
       return prefix + ".unloaded";
+    case CounterName::FUSE:
+      return prefix + ".fuse";
+    case CounterName::OVERLAY_GC_QUEUED:
+      return prefix + ".overlay_gc.queued";
+    case CounterName::OVERLAY_GC_REMOVED:
+      return prefix + ".overlay_gc.removed";
+    case CounterName::JOURNAL_MEMORY:
+      return prefix + ".journal.memory";
+    case CounterName::JOURNAL_ENTRIES:
+      return prefix + ".journal.entries";
+    case CounterName::INODE_MEMORY:
+      return prefix + ".inodes.memory";
+    case CounterName::BLOB_MEMORY:
+      return prefix + ".blobs.memory";
+    case CounterName::INODE_TABLE_RECORDS:
+      return prefix + ".inode_table.records";
+    case CounterName::INODE_TABLE_FRAGMENTATION:
+      return prefix + ".inode_table.fragmentation_pct";
+    case CounterName::INODE_TABLE_COMPACTED:
+      return prefix + ".inode_table.compacted";
+    case CounterName::OBJECT_STORE:
+      return prefix + ".object_store";
   }
   EDEN_BUG() << "unknown counter name " << static_cast<int>(name);
   folly::assume_unreachable();
@@ -773,6 +1409,11 @@ struct stat EdenMount::initStatData() const {
   return st;
 }
 
+uint64_t EdenMount::getAttrTimeout(bool isMaterialized) const {
+  return isMaterialized ? FLAGS_fuse_materialized_attr_timeout
+                        : FLAGS_fuse_attr_timeout;
+}
+
 InodeMetadata EdenMount::getInitialInodeMetadata(mode_t mode) const {
   return InodeMetadata{
       mode, uid_, gid_, InodeTimestamps{getLastCheckoutTime()}};
@@ -13,20 +13,27 @@
 #include <folly/SharedMutex.h>
 #include <folly/Synchronized.h>
 #include <folly/ThreadLocal.h>
+#include <folly/container/EvictingCacheMap.h>
 #include <folly/futures/Future.h>
 #include <folly/futures/Promise.h>
 #include <folly/logging/Logger.h>
+#include <array>
 #include <chrono>
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <string>
+#include <unordered_map>
 #include "eden/fs/fuse/EdenStats.h"
 #include "eden/fs/fuse/FuseChannel.h"
 #include "eden/fs/fuse/gen-cpp2/handlemap_types.h"
 #include "eden/fs/inodes/InodePtrFwd.h"
+#include "eden/fs/inodes/MountScope.h"
+#include "eden/fs/inodes/OverlayChecker.h"
 #include "eden/fs/journal/Journal.h"
 #include "eden/fs/model/ParentCommits.h"
 #include "eden/fs/service/gen-cpp2/eden_types.h"
+#include "eden/fs/store/AccessProfile.h"
 #include "eden/fs/takeover/TakeoverData.h"
 #include "eden/fs/utils/PathFuncs.h"
 
@@ -45,6 +52,7 @@ class BindMount;
 class CheckoutConflict;
 class ClientConfig;
 class Clock;
+class CommitDiffCache;
 class DiffContext;
 class EdenDispatcher;
 class FuseChannel;
@@ -52,11 +60,14 @@ class InodeDiffCallback;
 class InodeMap;
 class MountPoint;
 struct InodeMetadata;
-template <typename T>
+struct PackedInodeMetadata;
+template <typename Record, typename Stored>
 class InodeTable;
-using InodeMetadataTable = InodeTable<InodeMetadata>;
+using InodeMetadataTable = InodeTable<InodeMetadata, PackedInodeMetadata>;
 class ObjectStore;
 class Overlay;
+class PathIndex;
+class ScmStatusCache;
 class ServerState;
 class Tree;
 class UnboundedQueueExecutor;
@@ -75,7 +86,55 @@ enum class CounterName {
   /**
    * Represents count of unloaded inodes in the current mount.
    */
-  UNLOADED
+  UNLOADED,
+  /**
+   * The prefix of the FUSE request stats for the current mount.
+   */
+  FUSE,
+  /**
+   * Represents the number of directories waiting to be removed from the
+   * overlay by its GC threads.
+   */
+  OVERLAY_GC_QUEUED,
+  /**
+   * Represents the total number of inodes whose overlay data the GC threads
+   * have removed.  Its rate is the GC throughput.
+   */
+  OVERLAY_GC_REMOVED,
+  /**
+   * Represents the estimated number of bytes used by the journal.
+   */
+  JOURNAL_MEMORY,
+  /**
+   * Represents the number of deltas held by the journal.
+   */
+  JOURNAL_ENTRIES,
+  /**
+   * Represents the estimated number of bytes used by the mount's loaded and
+   * unloaded inodes.
+   */
+  INODE_MEMORY,
+  /**
+   * Represents the number of bytes of blob data held by open files.
+   */
+  BLOB_MEMORY,
+  /**
+   * Represents the number of records in the inode metadata table.
+   */
+  INODE_TABLE_RECORDS,
+  /**
+   * Represents the percentage of the inode metadata table's allocated slots
+   * that are unused.
+   */
+  INODE_TABLE_FRAGMENTATION,
+  /**
+   * Represents the number of inode metadata records removed by compaction.
+   */
+  INODE_TABLE_COMPACTED,
+  /**
+   * The prefix of the stats for the mount's fetches from its BackingStore.
+   */
+  OBJECT_STORE
 };
 
 /**
@@ -97,19 +156,30 @@ class EdenMount {
    * instance.  This is not done implicitly because the graceful
    * restart code needs to take the opportunity to update the InodeMap
    * prior to the logic in initialize() running.
+   *
+   * The checkout's overlay is opened here unless the caller has already
+   * opened it, as EdenServer does at startup while the local store opens.
    */
   static std::shared_ptr<EdenMount> create(
       std::unique_ptr<ClientConfig> config,
       std::unique_ptr<ObjectStore> objectStore,
-      std::shared_ptr<ServerState> serverState);
+      std::shared_ptr<ServerState> serverState,
+      std::unique_ptr<Overlay> overlay = nullptr);
 
   /**
    * Asynchronous EdenMount initialization - post instantiation.
    *
    * If takeover data is specified, it is used to initialize the inode map.
+   *
+   * The journal is restored from takeoverJournal if it is given, and
+   * otherwise from the copy saved by a clean shutdown, if any.  Clients
+   * holding journal positions can then keep using them.  If there is no
+   * usable journal, the mount starts a new one with a new mount generation.
    */
   FOLLY_NODISCARD folly::Future<folly::Unit> initialize(
-      const folly::Optional<SerializedInodeMap>& takeover = folly::none);
+      const folly::Optional<SerializedInodeMap>& takeover = folly::none,
+      const folly::Optional<SerializedJournal>& takeoverJournal =
+          folly::none);
 
   /**
    * Destroy the EdenMount.
@@ -138,14 +208,152 @@ class EdenMount {
    *
    * If doTakeover is true, this function will return populated
    * SerializedFileHandleMap and SerializedInodeMap instances generated by
-   * calling FileHandleMap::serializeMap() and InodeMap::shutdown.
+   * calling FileHandleMap::serializeMap() and InodeMap::shutdown, the
+   * journal, and the directories and blobs that were loaded, for
+   * warmCaches() in the new process.
    *
    * If doTakeover is false, this function will return default-constructed
-   * SerializedFileHandleMap and SerializedInodeMap instances.
+   * instances, and saves the journal in the client directory instead.
    */
-  folly::Future<std::tuple<SerializedFileHandleMap, SerializedInodeMap>>
+  folly::Future<std::tuple<
+      SerializedFileHandleMap,
+      SerializedInodeMap,
+      SerializedJournal,
+      SerializedWarmState>>
   shutdown(bool doTakeover, bool allowFuseNotStarted = false);
 
+  /**
+   * Get ready to hand this mount over to a new process, while FUSE requests
+   * are still being served, so that less is left to do once they stop.
+   *
+   * This records what is loaded for the new process to warm its caches
+   * with, then unloads every unreferenced inode, so that InodeMap::shutdown()
+   * has little left to walk, and writes out any buffered overlay data.
+   * The returned future completes once the overlay writes are done.
+   */
+  FOLLY_NODISCARD folly::Future<folly::Unit> prepareForTakeover();
+
+  /**
+   * Note that a thrift call is working on this mount, so that it does not
+   * count as idle.  FUSE requests are recorded by the dispatcher.
+   */
+  void recordActivity();
+
+  /**
+   * Return when the last FUSE request or thrift call for this mount
+   * arrived, or when the mount was created if none has.
+   */
+  std::chrono::steady_clock::time_point getLastActivityTime() const;
+
+  /**
+   * Returns true if hibernate() has run since the last activity.
+   */
+  bool isHibernating() const;
+
+  /**
+   * Give back as much memory as possible while the mount is idle.
+   *
+   * This unloads every unreferenced inode, drops the per-mount caches,
+   * shrinks the journal to journalMemoryLimit bytes, and lets the kernel
+   * reclaim the resident pages of the inode metadata table.  Nothing needs
+   * to be done to wake the mount: the next access loads what it needs
+   * again.  The returned future yields the number of inodes unloaded, once
+   * buffered overlay data has been written out.
+   */
+  FOLLY_NODISCARD folly::Future<size_t> hibernate(size_t journalMemoryLimit);
+
+  /**
+   * Load the directories and fetch the blobs that the previous process
+   * had loaded when it handed this mount over, so that the first accesses
+   * after a graceful restart do not all have to go to the backing store.
+   *
+   * This runs on the background thread pool, a batch at a time, and stops
+   * early if the mount starts shutting down.  Paths that no longer exist
+   * and objects that cannot be fetched are skipped.  The caller must keep
+   * the EdenMount alive until the returned future completes.
+   */
+  FOLLY_NODISCARD folly::Future<folly::Unit> warmCaches(
+      SerializedWarmState warmState);
+
+  /**
+   * Start recording the paths of the files opened in this mount, under a tag
+   * chosen by the caller.  Several recordings with different tags may be in
+   * progress at once, and each records every file opened while it runs.
+   *
+   * Returns false if a recording with this tag is already in progress.
+   */
+  bool startRecordingAccessProfile(folly::StringPiece tag);
+
+  /**
+   * Finish the recording with this tag and return the paths it recorded,
+   * or folly::none if no recording with this tag is in progress.
+   */
+  folly::Optional<AccessProfile> stopRecordingAccessProfile(
+      folly::StringPiece tag);
+
+  /**
+   * Add the path of a file that was opened to the recordings in progress.
+   * This is cheap when nothing is being recorded.
+   */
+  void recordFileAccess(const InodeBase& inode);
+
+  /**
+   * Returns true if the mount is scoped to some of its directories, and the
+   * given directory is outside the scope.  The contents of such directories
+   * appear empty, and are skipped by diffs, globs and prefetches.
+   *
+   * This is cheap when the mount is not scoped.
+   */
+  bool isOutsideScope(const TreeInode& dir) const;
+  bool isOutsideScope(RelativePathPiece dir) const;
+
+  /**
+   * Return the directories the mount is scoped to, or an empty list if the
+   * whole checkout is visible.
+   */
+  std::vector<RelativePath> getScopeIncludes() const;
+
+  /**
+   * Add the given directories to the scope, and save the widened scope so
+   * that it also applies to later mounts of this checkout.  Widening the
+   * scope to the root of the mount makes the whole checkout visible.
+   *
+   * The scope cannot be narrowed while the checkout is mounted, since the
+   * kernel and its users may already refer to the inodes it would hide.
+   */
+  void widenScope(const std::vector<RelativePath>& paths);
+
+  /**
+   * Fetch the trees and blobs of the files in an access profile that exist
+   * in the commit that is currently checked out, so that a build that opens
+   * them does not have to wait on the backing store for each one.
+   *
+   * Returns the number of files whose blobs were fetched.  The caller must
+   * keep the EdenMount alive until the returned future completes.
+   */
+  folly::Future<size_t> prefetchAccessProfile(
+      std::shared_ptr<const AccessProfile> profile);
+
+  /**
+   * Get the PathIndex of the given commit's root tree, loading or building
+   * it if it is not the one this mount used last.
+   *
+   * The index only describes the commit; callers combine it with the
+   * working copy's status.  The caller must keep the EdenMount alive until
+   * the returned future completes.
+   */
+  folly::Future<std::shared_ptr<const PathIndex>> getPathIndex(
+      const Hash& commitHash);
+
+  /**
+   * Check this mount's overlay for consistency in the background, and remove
+   * the orphaned data it finds if repair is set.
+   *
+   * Inodes that are loaded, or that the kernel may still refer to, are never
+   * reported as orphans or removed.
+   */
+  folly::Future<OverlayChecker::Result> checkOverlay(bool repair);
+
   /**
    * Get the FUSE channel for this mount point.
    *
@@ -211,6 +419,28 @@ class EdenMount {
     return journal_;
   }
 
+  /**
+   * Return the cache of the most recent getScmStatus() result.
+   */
+  ScmStatusCache* getScmStatusCache() const {
+    return scmStatusCache_.get();
+  }
+
+  /**
+   * Return the cache of diffs between the commits that this mount's Journal
+   * records checkouts between.
+   */
+  CommitDiffCache* getCommitDiffCache() const {
+    return commitDiffCache_.get();
+  }
+
+  /**
+   * Return the server state shared by all mount points.
+   */
+  const std::shared_ptr<ServerState>& getServerState() const {
+    return serverState_;
+  }
+
   uint64_t getMountGeneration() const {
     return mountGeneration_;
   }
@@ -224,6 +454,19 @@ class EdenMount {
    */
   const std::shared_ptr<UnboundedQueueExecutor>& getThreadPool() const;
 
+  /**
+   * Returns the server's thread pool for bulk background work.
+   * See ServerState::getBackgroundThreadPool().
+   */
+  const std::shared_ptr<UnboundedQueueExecutor>& getBackgroundThreadPool()
+      const;
+
+  /**
+   * Returns the server's thread pool for overlay file I/O, or null.
+   * See ServerState::getOverlayIoPool().
+   */
+  const std::shared_ptr<UnboundedQueueExecutor>& getOverlayIoPool() const;
+
   /**
    * Returns the Clock with which this mount was configured.
    */
@@ -268,6 +511,16 @@ class EdenMount {
    */
   InodePtr getInodeBlocking(RelativePathPiece path) const;
 
+  /**
+   * Forget the paths cached by getInode().
+   *
+   * This must be called, with the rename lock held, whenever a loaded inode
+   * is unlinked or moved, or the inode number for a name changes.  InodeBase
+   * does this from markUnlinked() and updateLocation().
+   */
+  void invalidatePathInodeCache(const RenameLock& renameLock);
+  void invalidatePathInodeCache(const SharedRenameLock& renameLock);
+
   /**
    * Syntactic sugar for getInode().get().asTreePtr()
    *
@@ -364,12 +617,32 @@ class EdenMount {
   SharedRenameLock acquireSharedRenameLock();
 
   /**
-   * Returns a pointer to a stats instance associated with this mountpoint.
-   * Today this is the global stats instance, but in the future it will be
-   * a mount point specific instance.
+   * Acquire the lock for renames within a single directory.
+   *
+   * Renames that move a file within one directory cannot change the path of
+   * any other inode, so they only hold the rename lock in shared mode, plus
+   * this lock for the directory they modify.  It orders renames within the
+   * same directory, including their journal entries, while renames in other
+   * directories proceed in parallel.  Operations holding the rename lock in
+   * exclusive mode (such as checkout) do not need it.
+   *
+   * Only one directory rename lock may be held at a time.
+   */
+  std::unique_lock<std::mutex> acquireDirectoryRenameLock(
+      const SharedRenameLock& renameLock,
+      InodeNumber directory);
+
+  /**
+   * Returns a pointer to the process-wide stats instance.
    */
   ThreadLocalEdenStats* getStats() const;
 
+  /**
+   * Returns a pointer to the stats for this mount point alone, named with
+   * the getCounterName(CounterName::FUSE) prefix.
+   */
+  ThreadLocalEdenStats* getMountStats() const;
+
   folly::Logger& getStraceLogger() {
     return straceLogger_;
   }
@@ -391,6 +664,14 @@ class EdenMount {
    */
   std::string getCounterName(CounterName name);
 
+  /**
+   * Returns the name of the counter for the mount at mountPath.  This can
+   * be used to name stats that are created before the EdenMount itself.
+   */
+  static std::string getCounterName(
+      AbsolutePathPiece mountPath,
+      CounterName name);
+
   struct ParentInfo {
     ParentCommits parents;
   };
@@ -436,6 +717,16 @@ class EdenMount {
    */
   struct stat initStatData() const;
 
+  /**
+   * Return how long, in seconds, the kernel may cache the attributes and
+   * directory entry of an inode.
+   *
+   * Inodes that are not materialized can only change on checkout, which
+   * explicitly invalidates the kernel's caches, so they can be cached for
+   * longer than inodes that are being modified locally.
+   */
+  uint64_t getAttrTimeout(bool isMaterialized) const;
+
   /**
    * Given a mode_t, return an initial InodeMetadata.  All timestamps are set
    * to the last checkout time and uid and gid are set to the creator of the
@@ -529,7 +820,8 @@ class EdenMount {
   EdenMount(
       std::unique_ptr<ClientConfig> config,
       std::unique_ptr<ObjectStore> objectStore,
-      std::shared_ptr<ServerState> serverState);
+      std::shared_ptr<ServerState> serverState,
+      std::unique_ptr<Overlay> overlay);
 
   // Forbidden copy constructor and assignment operator
   EdenMount(EdenMount const&) = delete;
@@ -538,9 +830,36 @@ class EdenMount {
   folly::Future<TreeInodePtr> createRootInode(
       const ParentCommits& parentCommits);
   FOLLY_NODISCARD folly::Future<folly::Unit> setupDotEden(TreeInodePtr root);
-  folly::Future<std::tuple<SerializedFileHandleMap, SerializedInodeMap>>
+  folly::Future<std::tuple<
+      SerializedFileHandleMap,
+      SerializedInodeMap,
+      SerializedJournal,
+      SerializedWarmState>>
   shutdownImpl(bool doTakeover);
 
+  /**
+   * Record the loaded directories, closest to the root first, and the blobs
+   * of the loaded files that match source control, up to the limits set by
+   * --takeover_warm_max_directories and --takeover_warm_max_blobs.
+   */
+  SerializedWarmState collectWarmState() const;
+
+  /**
+   * Restore journal_ and mountGeneration_ from a journal saved by an earlier
+   * instance of this mount.  Returns false, leaving the journal empty, if it
+   * does not lead up to the current parent commit.
+   */
+  bool restoreJournal(const SerializedJournal& journal, const Hash& parent);
+  SerializedJournal serializeJournal() const;
+
+  /**
+   * Save the journal for the next instance of this mount, or load and remove
+   * the saved copy.  The copy is removed as soon as it is loaded, since any
+   * change made after that would be missing from it.
+   */
+  void saveJournal() const;
+  folly::Optional<SerializedJournal> loadSavedJournal() const;
+
   std::unique_ptr<DiffContext> createDiffContext(
       InodeDiffCallback* callback,
       bool listIgnored) const;
@@ -587,6 +906,11 @@ class EdenMount {
    */
   std::shared_ptr<ServerState> serverState_;
 
+  /**
+   * This must be declared before dispatcher_, which records requests here.
+   */
+  std::unique_ptr<ThreadLocalEdenStats> mountStats_;
+
   std::unique_ptr<InodeMap> inodeMap_;
   std::unique_ptr<EdenDispatcher> dispatcher_;
   std::unique_ptr<ObjectStore> objectStore_;
@@ -598,10 +922,46 @@ class EdenMount {
    *
    * This includes rename() operations as well as unlink() and rmdir().
    * Any operation that modifies an existing InodeBase's location_ data must
-   * hold the rename lock.
+   * hold the rename lock.  Most hold it in exclusive mode; renames of files
+   * within a single directory hold it in shared mode together with one of
+   * directoryRenameMutexes_.
    */
   folly::SharedMutex renameMutex_;
 
+  /**
+   * Locks returned by acquireDirectoryRenameLock(), striped by directory
+   * inode number.  Two directories may share a stripe; this only costs
+   * parallelism, since no thread ever holds more than one stripe.
+   */
+  static constexpr size_t kNumDirectoryRenameStripes = 64;
+  std::array<std::mutex, kNumDirectoryRenameStripes> directoryRenameMutexes_;
+
+  struct PathInodeCacheEntry {
+    InodeNumber inodeNumber;
+    /// The pathInodeCacheGeneration_ when the lookup started.
+    uint64_t generation;
+  };
+
+  /**
+   * Recently resolved paths for getInode(), so that repeated thrift calls on
+   * deep paths do not walk from the root every time.
+   *
+   * An entry is only valid while pathInodeCacheGeneration_ still matches
+   * the one recorded in it, which invalidatePathInodeCache() bumps.
+   */
+  mutable folly::Synchronized<
+      folly::EvictingCacheMap<RelativePath, PathInodeCacheEntry>,
+      std::mutex>
+      pathInodeCache_;
+  std::atomic<uint64_t> pathInodeCacheGeneration_{0};
+
+  /**
+   * When the last thrift call for this mount arrived, and when hibernate()
+   * last ran, in steady_clock ticks.  The dispatcher tracks FUSE requests.
+   */
+  std::atomic<std::chrono::steady_clock::rep> lastThriftActivity_;
+  std::atomic<std::chrono::steady_clock::rep> hibernatedAt_{0};
+
   /**
    * The IDs of the parent commit(s) of the working directory.
    *
@@ -619,11 +979,24 @@ class EdenMount {
 
   Journal journal_;
 
+  /**
+   * This refers to journal_, so it must be declared after it.
+   */
+  std::unique_ptr<ScmStatusCache> scmStatusCache_;
+
+  /**
+   * This refers to objectStore_, so it must be declared after it.
+   */
+  std::unique_ptr<CommitDiffCache> commitDiffCache_;
+
   /**
    * A number to uniquely identify this particular incarnation of this mount.
    * We use bits from the process id and the time at which we were mounted.
+   *
+   * initialize() replaces this with the generation of the journal it
+   * restores, if any, before the mount is visible to clients.
    */
-  const uint64_t mountGeneration_;
+  uint64_t mountGeneration_;
 
   /**
    * The path to the unix socket that can be used to address us via thrift
@@ -659,6 +1032,35 @@ class EdenMount {
    */
   std::atomic<State> state_{State::UNINITIALIZED};
 
+  /**
+   * The warm state recorded by prepareForTakeover(), which shutdown() sends
+   * instead of collecting it again once most inodes have been unloaded.
+   */
+  folly::Synchronized<folly::Optional<SerializedWarmState>>
+      preparedWarmState_;
+
+  /**
+   * The access profiles being recorded, by tag.  recordingAccessProfiles_ is
+   * true while there are any, so that opens need not take the lock when
+   * nothing is being recorded.
+   */
+  folly::Synchronized<std::unordered_map<std::string, AccessProfile>>
+      accessProfiles_;
+
+  /**
+   * The PathIndex most recently returned by getPathIndex(), which is
+   * usually that of the commit that is checked out.
+   */
+  folly::Synchronized<std::shared_ptr<const PathIndex>> pathIndex_;
+  std::atomic<bool> recordingAccessProfiles_{false};
+
+  /**
+   * The directories this mount is scoped to.  scopeRestricted_ is set while
+   * the scope hides anything, so that unscoped mounts can skip the lock.
+   */
+  folly::Synchronized<MountScope> scope_;
+  std::atomic<bool> scopeRestricted_;
+
   /**
    * uid and gid that we'll set as the owners in the stat information
    * returned via initStatData().
@@ -702,6 +1104,7 @@ class RenameLock : public std::unique_lock<folly::SharedMutex> {
  */
 class SharedRenameLock : public std::shared_lock<folly::SharedMutex> {
  public:
+  SharedRenameLock() {}
   explicit SharedRenameLock(EdenMount* mount)
       : std::shared_lock<folly::SharedMutex>{mount->renameMutex_} {}
 
@@ -9,15 +9,21 @@
  */
 #include "eden/fs/inodes/FileInode.h"
 
+#include <folly/Conv.h>
 #include <folly/FileUtil.h>
+#include <folly/ThreadLocal.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
 #include <openssl/sha.h>
+#include "eden/fs/fuse/EdenStats.h"
+#include "eden/fs/fuse/FuseChannel.h"
 #include "eden/fs/inodes/EdenFileHandle.h"
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/InodeError.h"
+#include "eden/fs/inodes/InodeMap.h"
 #include "eden/fs/inodes/InodeTable.h"
 #include "eden/fs/inodes/Overlay.h"
 #include "eden/fs/inodes/TreeInode.h"
@@ -42,9 +48,55 @@ using std::shared_ptr;
 using std::string;
 using std::vector;
 
+DEFINE_uint64(
+    min_streaming_read_blob_size,
+    16 * 1024 * 1024,
+    "Files whose source control blob is at least this many bytes are read "
+    "from the object store in chunks, without loading the whole blob into "
+    "memory.  0 disables this.");
+DEFINE_uint64(
+    max_inline_sha1_size,
+    1024 * 1024,
+    "When comparing a materialized file with source control, files larger "
+    "than this many bytes whose SHA-1 is not cached are hashed on the "
+    "background thread pool rather than on the calling thread.");
+DEFINE_uint64(
+    write_buffer_size,
+    0,
+    "If non-zero, adjacent writes smaller than this many bytes to an open "
+    "file are merged in memory and written to the overlay together, once "
+    "this many bytes are buffered or the file is read, synced or closed.  "
+    "Has no effect when the kernel writeback cache is enabled.  0 disables "
+    "this.");
+
 namespace facebook {
 namespace eden {
 
+namespace {
+// The overlay file attribute recording the size and mtime that the file had
+// when the SHA-1 in kXattrSha1 was computed.
+constexpr StringPiece kXattrSha1Stat{"user.sha1stat"};
+
+std::string sha1StatRecord(const struct stat& st) {
+  return folly::to<std::string>(
+      st.st_size, ":", st.st_mtim.tv_sec, ".", st.st_mtim.tv_nsec);
+}
+
+/**
+ * Run fn on the mount's overlay I/O pool, so that the FUSE worker calling
+ * us does not wait on the overlay's disk.  fn runs right away if there is no
+ * such pool.
+ */
+template <typename Fn>
+auto runOnOverlayIoPool(EdenMount* mount, Fn&& fn) {
+  auto* pool = mount->getOverlayIoPool().get();
+  if (!pool) {
+    return folly::makeFutureWith(std::forward<Fn>(fn));
+  }
+  return folly::via(pool, std::forward<Fn>(fn));
+}
+} // namespace
+
 /*********************************************************************
  * FileInode::LockedState
  ********************************************************************/
@@ -224,9 +276,12 @@ void FileInode::LockedState::setMaterialized(folly::File&& file) {
 
   ptr_->file = std::move(file);
   ptr_->hash.reset();
-  ptr_->blob.reset();
+  ptr_->resetBlob();
   ptr_->tag = State::MATERIALIZED_IN_OVERLAY;
   ptr_->sha1Valid = false;
+  ptr_->sha1Context.reset();
+  ptr_->sha1ContextLength = 0;
+  ptr_->sha1RecordMayExist = false;
 }
 
 /*********************************************************************
@@ -251,8 +306,7 @@ typename folly::futures::detail::callableResult<FileInode::LockedState, Fn>::
           [&] { return std::forward<Fn>(fn)(std::move(state)); });
     case State::BLOB_LOADING:
       // If we're already loading, latch on to the in-progress load
-      future = state->blobLoadingPromise->getFuture();
-      state.unlock();
+      future = joinLoadingData(std::move(state));
       break;
     case State::NOT_LOADED:
       future = startLoadingData(std::move(state));
@@ -261,13 +315,13 @@ typename folly::futures::detail::callableResult<FileInode::LockedState, Fn>::
 
   return std::move(future).then([self = inodePtrFromThis(),
                                  fn = std::forward<Fn>(fn)](
-                                    FileHandlePtr /* handle */) mutable {
+                                    FileHandlePtr handle) mutable {
     // Simply call runWhileDataLoaded() again when we we finish loading the blob
     // data.  The state should be BLOB_LOADED or MATERIALIZED_IN_OVERLAY this
-    // time around.
+    // time around, unless we joined a load that was dropped.
     auto stateLock = LockedState{self};
     DCHECK(
-        stateLock->tag == State::BLOB_LOADED ||
+        !handle || stateLock->tag == State::BLOB_LOADED ||
         stateLock->tag == State::MATERIALIZED_IN_OVERLAY)
         << "unexpected FileInode state after loading: " << stateLock->tag;
     return self->runWhileDataLoaded(std::move(stateLock), std::forward<Fn>(fn));
@@ -310,8 +364,7 @@ typename folly::futures::detail::callableResult<FileInode::LockedState, Fn>::
           [&] { return std::forward<Fn>(fn)(LockedState{std::move(state)}); });
     case State::BLOB_LOADING:
       // If we're already loading, latch on to the in-progress load
-      future = state->blobLoadingPromise->getFuture();
-      state.unlock();
+      future = joinLoadingData(std::move(state));
       break;
     case State::NOT_LOADED:
       future = startLoadingData(std::move(state));
@@ -320,13 +373,13 @@ typename folly::futures::detail::callableResult<FileInode::LockedState, Fn>::
 
   return std::move(future).then([self = inodePtrFromThis(),
                                  fn = std::forward<Fn>(fn)](
-                                    FileHandlePtr /* handle */) mutable {
+                                    FileHandlePtr handle) mutable {
     // Simply call runWhileDataLoaded() again when we we finish loading the blob
     // data.  The state should be BLOB_LOADED or MATERIALIZED_IN_OVERLAY this
-    // time around.
+    // time around, unless we joined a load that was dropped.
     auto stateLock = LockedState{self};
     DCHECK(
-        stateLock->tag == State::BLOB_LOADED ||
+        !handle || stateLock->tag == State::BLOB_LOADED ||
         stateLock->tag == State::MATERIALIZED_IN_OVERLAY)
         << "unexpected FileInode state after loading: " << stateLock->tag;
     return self->runWhileMaterialized(
@@ -384,6 +437,7 @@ FileInode::truncateAndRun(LockedState state, Fn&& fn) {
         // Now that materializeAndTruncate() has succeeded, extract the
         // blobLoadingPromise so we can fulfill it as we exit.
         loadingPromise = std::move(innerState->blobLoadingPromise);
+        innerState->blobLoadingWaiters = CancellationJoin{};
         // Also call materializeInParent() as we exit, before fulfilling the
         // blobLoadingPromise.
         SCOPE_EXIT {
@@ -413,13 +467,17 @@ FileInode::truncateAndRun(LockedState state, Fn&& fn) {
  * FileInode::State methods
  ********************************************************************/
 
-FileInodeState::FileInodeState(const folly::Optional<Hash>& h) : hash(h) {
+FileInodeState::FileInodeState(
+    const folly::Optional<Hash>& h,
+    std::atomic<uint64_t>* blobBytes)
+    : hash(h), loadedBlobBytes(blobBytes) {
   tag = hash ? NOT_LOADED : MATERIALIZED_IN_OVERLAY;
 
   checkInvariants();
 }
 
-FileInodeState::FileInodeState() : tag(MATERIALIZED_IN_OVERLAY) {
+FileInodeState::FileInodeState(std::atomic<uint64_t>* blobBytes)
+    : tag(MATERIALIZED_IN_OVERLAY), loadedBlobBytes(blobBytes) {
   checkInvariants();
 }
 
@@ -427,7 +485,26 @@ FileInodeState::FileInodeState() : tag(MATERIALIZED_IN_OVERLAY) {
  * Define FileInodeState destructor explicitly to avoid including
  * some header files in FileInode.h
  */
-FileInodeState::~FileInodeState() = default;
+FileInodeState::~FileInodeState() {
+  resetBlob();
+}
+
+void FileInodeState::setBlob(std::shared_ptr<const Blob> newBlob) {
+  resetBlob();
+  if (newBlob && loadedBlobBytes) {
+    loadedBlobBytes->fetch_add(
+        newBlob->getSizeBytes(), std::memory_order_relaxed);
+  }
+  blob = std::move(newBlob);
+  markBlobUsed();
+}
+
+void FileInodeState::resetBlob() {
+  if (blob && loadedBlobBytes) {
+    loadedBlobBytes->fetch_sub(blob->getSizeBytes(), std::memory_order_relaxed);
+  }
+  blob.reset();
+}
 
 void FileInodeState::checkInvariants() {
   switch (tag) {
@@ -466,6 +543,9 @@ void FileInodeState::checkInvariants() {
         // that it's not open if openCount is zero.
         CHECK(!file);
       }
+      if (!writeBuffer.empty()) {
+        CHECK(file);
+      }
       return;
   }
 
@@ -482,10 +562,11 @@ void FileInodeState::decOpenCount() {
   if (openCount == 0) {
     switch (tag) {
       case BLOB_LOADED:
-        blob.reset();
+        resetBlob();
         tag = NOT_LOADED;
         break;
       case MATERIALIZED_IN_OVERLAY:
+        DCHECK(writeBuffer.empty());
         // TODO: Before closing the file handle, it might make sense to write
         // in-memory timestamps into the overlay, even if the inode remains in
         // memory. This would ensure timestamps persist even if the edenfs
@@ -535,7 +616,10 @@ FileInode::FileInode(
           std::move(initialTimestampsFn),
           std::move(parentInode),
           name),
-      state_(folly::in_place, hash) {}
+      state_(
+          folly::in_place,
+          hash,
+          getMount()->getInodeMap()->getLoadedBlobBytesCounter()) {}
 
 // The FileInode is in MATERIALIZED_IN_OVERLAY state.
 FileInode::FileInode(
@@ -545,15 +629,20 @@ FileInode::FileInode(
     mode_t initialMode,
     InodeTimestamps initialTimestamps)
     : Base(ino, initialMode, initialTimestamps, std::move(parentInode), name),
-      state_(folly::in_place) {}
+      state_(
+          folly::in_place,
+          getMount()->getInodeMap()->getLoadedBlobBytesCounter()) {}
 
 folly::Future<Dispatcher::Attr> FileInode::getattr() {
   // Future optimization opportunity: right now, if we have not already
   // materialized the data from the entry, we have to materialize it
   // from the store.  If we augmented our metadata we could avoid this,
   // and this would speed up operations like `ls`.
-  return stat().thenValue(
-      [](const struct stat& st) { return Dispatcher::Attr{st}; });
+  return stat().thenValue([self = inodePtrFromThis()](const struct stat& st) {
+    auto isMaterialized = self->state_.rlock()->isMaterialized();
+    return Dispatcher::Attr{
+        st, self->getMount()->getAttrTimeout(isMaterialized)};
+  });
 }
 
 folly::Future<Dispatcher::Attr> FileInode::setattr(
@@ -567,14 +656,18 @@ folly::Future<Dispatcher::Attr> FileInode::setattr(
   }
 
   auto setAttrs = [self = inodePtrFromThis(), attr](LockedState&& state) {
-    auto result = Dispatcher::Attr{self->getMount()->initStatData()};
+    // setattr() always materializes the file.
+    auto result = Dispatcher::Attr{self->getMount()->initStatData(),
+                                   self->getMount()->getAttrTimeout(true)};
 
     DCHECK_EQ(State::MATERIALIZED_IN_OVERLAY, state->tag)
         << "Must have a file in the overlay at this point";
     DCHECK(state->isFileOpen());
+    self->flushWriteBufferLocked(state);
 
     // Set the size of the file when FATTR_SIZE is set
     if (attr.valid & FATTR_SIZE) {
+      invalidateSha1(state, /*resetContext=*/true);
       checkUnixError(
           ftruncate(state->file.fd(), attr.size + Overlay::kHeaderLength));
     }
@@ -620,12 +713,31 @@ folly::Future<std::string> FileInode::readlink() {
     throw InodeError(EINVAL, inodePtrFromThis(), "not a symlink");
   }
 
-  // The symlink contents are simply the file contents!
-  return readAll();
+  // The symlink contents are simply the file contents!  Unless the symlink
+  // was created locally, read them through the ObjectStore's cache of
+  // symlink targets rather than loading the blob into this inode.
+  auto hash = getBlobHash();
+  if (!hash) {
+    return readAll();
+  }
+  return getObjectStore()->getSymlinkTarget(hash.value()).thenValue(
+      [self = inodePtrFromThis()](std::string target) {
+        self->updateAtimeLocked(*LockedState{self});
+        return target;
+      });
 }
 
 void FileInode::fileHandleDidClose() {
   auto state = LockedState{this};
+  try {
+    flushWriteBufferLocked(state);
+  } catch (const std::exception& ex) {
+    // The kernel sends FUSE_FLUSH before releasing a handle, so a failure
+    // here has normally been reported already.
+    XLOG(ERR) << "error writing buffered writes to " << getLogPath() << ": "
+              << folly::exceptionStr(ex);
+    state->writeBuffer.clear();
+  }
   state->decOpenCount();
 }
 
@@ -660,9 +772,12 @@ folly::Future<bool> FileInode::isSameAs(
     return result.value();
   }
 
-  auto blobSha1 = Hash::sha1(&blob.getContents());
-  return getSha1().thenValue(
-      [blobSha1](const Hash& sha1) { return sha1 == blobSha1; });
+  // The blob's metadata was stored in the LocalStore when it was loaded, so
+  // this avoids hashing its contents again.
+  return getObjectStore()->getBlobMetadata(blob.getHash()).thenValue(
+      [self = inodePtrFromThis()](const BlobMetadata& metadata) {
+        return self->isSameAsSlow(metadata);
+      });
 }
 
 folly::Future<bool> FileInode::isSameAs(
@@ -673,11 +788,59 @@ folly::Future<bool> FileInode::isSameAs(
     return makeFuture(result.value());
   }
 
-  auto f1 = getSha1();
-  auto f2 = getMount()->getObjectStore()->getBlobMetadata(blobID);
-  return folly::collect(f1, f2).thenValue(
-      [](std::tuple<Hash, BlobMetadata>&& result) {
-        return std::get<0>(result) == std::get<1>(result).sha1;
+  return getObjectStore()->getBlobMetadata(blobID).thenValue(
+      [self = inodePtrFromThis()](const BlobMetadata& metadata) {
+        return self->isSameAsSlow(metadata);
+      });
+}
+
+folly::Future<bool> FileInode::isSameAsSlow(const BlobMetadata& blobMetadata) {
+  {
+    auto state = LockedState{this};
+    if (state->tag == State::MATERIALIZED_IN_OVERLAY) {
+      state.ensureFileOpen(this);
+      flushWriteBufferLocked(state);
+
+      // Files of different sizes cannot have the same contents, and the size
+      // is much cheaper to check than the SHA-1.
+      struct stat overlayStat;
+      checkUnixError(fstat(state->file.fd(), &overlayStat));
+      const auto size =
+          static_cast<uint64_t>(overlayStat.st_size) - Overlay::kHeaderLength;
+      if (size != blobMetadata.size) {
+        return false;
+      }
+
+      if (state->sha1Valid || loadStoredSha1(state)) {
+        auto shaStr = fgetxattr(state->file.fd(), kXattrSha1);
+        if (!shaStr.empty()) {
+          return Hash(shaStr) == blobMetadata.sha1;
+        }
+      }
+
+      if (size <= FLAGS_max_inline_sha1_size) {
+        return recomputeAndStoreSha1(state) == blobMetadata.sha1;
+      }
+
+      // Reading a large file would hold up the calling thread, which may be
+      // running other FUSE requests.  The background pool has a fixed number
+      // of threads, each hashing through a small buffer, so a checkout over
+      // many rewritten files reads a bounded number of them at once.
+      return folly::via(getMount()->getBackgroundThreadPool().get())
+          .thenValue([self = inodePtrFromThis()](auto&&) {
+            return self->getSha1();
+          })
+          .thenValue([blobSha1 = blobMetadata.sha1](const Hash& sha1) {
+            return sha1 == blobSha1;
+          });
+    }
+  }
+
+  // The file is not materialized, so its SHA-1 comes from the metadata of
+  // its own blob.
+  return getSha1().thenValue(
+      [blobSha1 = blobMetadata.sha1](const Hash& sha1) {
+        return sha1 == blobSha1;
       });
 }
 
@@ -719,6 +882,32 @@ folly::Future<std::shared_ptr<FileHandle>> FileInode::open(int flags) {
       // necessary.  We don't actually need to run anything, so we pass in a
       // no-op lambda.
       (void)truncateAndRun(std::move(state), [](LockedState&&) { return 0; });
+    } else if (
+        state->tag == State::NOT_LOADED &&
+        FLAGS_min_streaming_read_blob_size != 0) {
+      // Check the blob's size before loading or materializing it.  Large
+      // files are read in chunks and are only materialized once they are
+      // actually written to, so that opening a multi-GB file for a small
+      // edit, or opening it read-write only to read from it, does not first
+      // load and copy all of it.
+      auto blobID = state->hash.value();
+      bool materialize = flags & (O_RDWR | O_WRONLY | O_CREAT);
+      state.unlock();
+      (void)getObjectStore()->getBlobMetadata(blobID).thenValue(
+          [self = inodePtrFromThis(), materialize](
+              const BlobMetadata& metadata) {
+            if (metadata.size >= FLAGS_min_streaming_read_blob_size) {
+              return;
+            }
+            auto lockedState = LockedState{self};
+            if (materialize) {
+              (void)self->runWhileMaterialized(
+                  std::move(lockedState), [](LockedState&&) { return 0; });
+            } else {
+              (void)self->runWhileDataLoaded(
+                  std::move(lockedState), [](LockedState&&) { return 0; });
+            }
+          });
     } else if (flags & (O_RDWR | O_WRONLY | O_CREAT)) {
       // Call runWhileMaterialized() to begin materializing the data into the
       // overlay, since the caller will likely want to use it soon since they
@@ -741,6 +930,12 @@ folly::Future<std::shared_ptr<FileHandle>> FileInode::open(int flags) {
     }
   }
 
+  if (flags & O_TRUNC) {
+    // Truncating the file changes it even if nothing is ever written through
+    // the new handle.
+    updateJournal();
+  }
+
   return fileHandle;
 }
 
@@ -785,7 +980,8 @@ Future<Hash> FileInode::getSha1() {
               [](const BlobMetadata& metadata) { return metadata.sha1; });
     case State::MATERIALIZED_IN_OVERLAY:
       state.ensureFileOpen(this);
-      if (state->sha1Valid) {
+      flushWriteBufferLocked(state);
+      if (state->sha1Valid || loadStoredSha1(state)) {
         auto shaStr = fgetxattr(state->file.fd(), kXattrSha1);
         if (!shaStr.empty()) {
           return Hash(shaStr);
@@ -805,6 +1001,8 @@ folly::Future<struct stat> FileInode::stat() {
         st.st_ino = self->getNodeId().get();
 
         if (state->tag == State::MATERIALIZED_IN_OVERLAY) {
+          self->flushWriteBufferLocked(state);
+
           // We are calling fstat only to get the size of the file.
           struct stat overlayStat;
           checkUnixError(fstat(state->file.fd(), &overlayStat));
@@ -850,36 +1048,45 @@ void FileInode::updateBlockCount(struct stat& st) {
 void FileInode::flush(uint64_t /* lock_owner */) {
   // This is called by FUSE when a file handle is closed.
   // https://github.com/libfuse/libfuse/wiki/FAQ#which-method-is-called-on-the-close-system-call
-  // We have no write buffers, so there is nothing for us to flush,
-  // but let's take this opportunity to update the sha1 attribute.
+  // Write out any buffered writes, so that close() reports their errors,
+  // and let's take this opportunity to update the sha1 attribute.  (In
+  // writeback cache mode the kernel sends us its cached writes for this
+  // file before the flush, so the overlay and journal are up to date here.)
   auto state = LockedState{this};
+  flushWriteBufferLocked(state);
   if (state->isFileOpen() && !state->sha1Valid) {
     recomputeAndStoreSha1(state);
   }
 }
 
-void FileInode::fsync(bool datasync) {
-  auto state = LockedState{this};
-  if (!state->isFileOpen()) {
-    // If we don't have an overlay file then we have nothing to sync.
-    return;
-  }
-
-  auto res =
-#ifndef __APPLE__
-      datasync ? ::fdatasync(state->file.fd()) :
-#endif
-               ::fsync(state->file.fd());
-  checkUnixError(res);
+Future<Unit> FileInode::fsync(bool datasync) {
+  return runOnOverlayIoPool(
+      getMount(), [self = inodePtrFromThis(), datasync]() -> Future<Unit> {
+        folly::File file;
+        {
+          auto state = LockedState{self};
+          if (!state->isFileOpen()) {
+            // If we don't have an overlay file then we have nothing to sync.
+            return folly::unit;
+          }
+          self->flushWriteBufferLocked(state);
+
+          // let's take this opportunity to update the sha1 attribute.
+          // TODO: A program that issues a series of write() and fsync()
+          // syscalls (for example, when logging to a file), would exhibit
+          // quadratic behavior here.  This should either not recompute SHA-1
+          // here or instead remember if the prior SHA-1 was actually used.
+          if (!state->sha1Valid) {
+            self->recomputeAndStoreSha1(state);
+          }
 
-  // let's take this opportunity to update the sha1 attribute.
-  // TODO: A program that issues a series of write() and fsync() syscalls (for
-  // example, when logging to a file), would exhibit quadratic behavior here.
-  // This should either not recompute SHA-1 here or instead remember if the
-  // prior SHA-1 was actually used.
-  if (!state->sha1Valid) {
-    recomputeAndStoreSha1(state);
-  }
+          // Sync our own descriptor, so that the file may be closed and
+          // written again while the sync waits for its group.
+          file = state->file.dup();
+        }
+        return self->getMount()->getOverlay()->syncFile(
+            std::move(file), datasync);
+      });
 }
 
 Future<string> FileInode::readAll() {
@@ -889,6 +1096,8 @@ Future<string> FileInode::readAll() {
         std::string result;
         switch (state->tag) {
           case State::MATERIALIZED_IN_OVERLAY: {
+            self->flushWriteBufferLocked(state);
+
             // Note that this code requires a write lock on state_ because the
             // lseek() call modifies the file offset of the file descriptor.
             auto rc = lseek(state->file.fd(), Overlay::kHeaderLength, SEEK_SET);
@@ -915,45 +1124,148 @@ Future<string> FileInode::readAll() {
       });
 }
 
+namespace {
+// Reads of materialized files at least this large are spliced from the
+// overlay to the FUSE device when the FuseChannel supports it.  Below this
+// the extra syscalls cost more than copying the data.
+constexpr size_t kMinSpliceReadSize = 32 * 1024;
+
+void recordReadBytesCopied(EdenMount* mount, size_t bytes) {
+  mount->getStats()->get()->readBytesCopied.addValue(bytes);
+}
+} // namespace
+
 Future<BufVec> FileInode::read(size_t size, off_t off) {
+  // MATERIALIZED_IN_OVERLAY is a final state, so once we see it here it
+  // cannot change before the read runs on the overlay I/O pool.
+  if (state_.rlock()->isMaterialized() && getMount()->getOverlayIoPool()) {
+    return runOnOverlayIoPool(
+        getMount(), [self = inodePtrFromThis(), size, off] {
+          if (auto result = self->tryReadShared(size, off)) {
+            return folly::makeFuture(std::move(result).value());
+          }
+          return self->readLoadedData(LockedState{self}, size, off);
+        });
+  }
+  if (auto result = tryReadShared(size, off)) {
+    return folly::makeFuture(std::move(result).value());
+  }
+
+  auto state = LockedState{this};
+  if (state->tag != State::NOT_LOADED ||
+      FLAGS_min_streaming_read_blob_size == 0) {
+    return readLoadedData(std::move(state), size, off);
+  }
+
+  // Check the blob's size before deciding whether to load it.  The metadata
+  // is usually already in the LocalStore, since the kernel looks up the
+  // file's attributes before reading from it.
+  auto blobID = state->hash.value();
+  state.unlock();
+  return getObjectStore()->getBlobMetadata(blobID).thenValue(
+      [self = inodePtrFromThis(), blobID, size, off](
+          const BlobMetadata& metadata) {
+        if (metadata.size < FLAGS_min_streaming_read_blob_size) {
+          return self->readLoadedData(LockedState{self}, size, off);
+        }
+
+        // Serve the read from the blob's chunks and leave the inode
+        // NOT_LOADED, so that reading a very large file never holds all of
+        // it in memory.
+        return self->getObjectStore()
+            ->getBlobRange(
+                blobID, metadata.size, off, size, ImportPriority::Interactive)
+            .thenValue([self](std::unique_ptr<folly::IOBuf> buf) {
+              auto lockedState = LockedState{self};
+              self->updateAtimeLocked(*lockedState);
+              return BufVec{std::move(buf)};
+            });
+      });
+}
+
+Future<BufVec>
+FileInode::readLoadedData(LockedState state, size_t size, off_t off) {
   return runWhileDataLoaded(
-      LockedState{this},
+      std::move(state),
       [size, off, self = inodePtrFromThis()](LockedState&& state) {
         SCOPE_SUCCESS {
           self->updateAtimeLocked(*state);
         };
+        self->flushWriteBufferLocked(state);
+        return self->readLocked(*state, size, off);
+      });
+}
 
-        if (state->tag == State::MATERIALIZED_IN_OVERLAY) {
-          auto buf = folly::IOBuf::createCombined(size);
-          auto res = ::pread(
-              state->file.fd(),
-              buf->writableBuffer(),
-              size,
-              off + Overlay::kHeaderLength);
-
-          checkUnixError(res);
-          buf->append(res);
-          return BufVec{std::move(buf)};
-        } else {
-          // runWhileDataLoaded() ensures that the state is either
-          // MATERIALIZED_IN_OVERLAY or BLOB_LOADED
-          DCHECK_EQ(state->tag, State::BLOB_LOADED);
-          auto buf = state->blob->getContents();
-          folly::io::Cursor cursor(&buf);
+folly::Optional<BufVec> FileInode::tryReadShared(size_t size, off_t off) {
+  auto state = state_.rlock();
+  if (state->tag != State::BLOB_LOADED &&
+      !(state->isMaterialized() && state->isFileOpen())) {
+    return folly::none;
+  }
+  // Buffered writes can only be flushed holding the lock exclusively.
+  if (!state->writeBuffer.empty()) {
+    return folly::none;
+  }
+  auto result = readLocked(*state, size, off);
+  updateAtimeLocked(*state);
+  return std::move(result);
+}
 
-          if (!cursor.canAdvance(off)) {
-            // Seek beyond EOF.  Return an empty result.
-            return BufVec{folly::IOBuf::wrapBuffer("", 0)};
-          }
+BufVec FileInode::readLocked(const State& state, size_t size, off_t off) {
+  if (state.tag == State::MATERIALIZED_IN_OVERLAY) {
+    // pread() does not move the file offset, so concurrent readers can share
+    // the descriptor.
+    auto channel = getMount()->getFuseChannel();
+    if (size >= kMinSpliceReadSize && channel && channel->canSpliceReplies()) {
+      // Hand the FuseChannel its own descriptor for the overlay file,
+      // since the reply is sent after we release the state lock.
+      recordReadBytesCopied(getMount(), 0);
+      return BufVec{state.file.dup(), off + Overlay::kHeaderLength, size};
+    }
 
-          cursor.skip(off);
+    auto buf = folly::IOBuf::createCombined(size);
+    auto res = ::pread(
+        state.file.fd(),
+        buf->writableBuffer(),
+        size,
+        off + Overlay::kHeaderLength);
+
+    checkUnixError(res);
+    buf->append(res);
+    recordReadBytesCopied(getMount(), res);
+    return BufVec{std::move(buf)};
+  }
 
-          std::unique_ptr<folly::IOBuf> result;
-          cursor.cloneAtMost(result, size);
+  // Callers ensure that the state is either MATERIALIZED_IN_OVERLAY or
+  // BLOB_LOADED
+  DCHECK_EQ(state.tag, State::BLOB_LOADED);
+  state.markBlobUsed();
+  const auto& contents = state.blob->getContents();
+  folly::io::Cursor cursor(&contents);
 
-          return BufVec{std::move(result)};
-        }
-      });
+  if (!cursor.canAdvance(off)) {
+    // Seek beyond EOF.  Return an empty result.
+    return BufVec{folly::IOBuf::wrapBuffer("", 0)};
+  }
+
+  cursor.skip(off);
+
+  // Hand out IOBufs that share the blob's buffers, so the reply is
+  // written to the FUSE device straight from them.  Buffers that are
+  // not reference counted could be freed along with the blob before
+  // the reply is sent, so those have to be copied.
+  std::unique_ptr<folly::IOBuf> result;
+  if (contents.isManaged()) {
+    cursor.cloneAtMost(result, size);
+    recordReadBytesCopied(getMount(), 0);
+  } else {
+    result = folly::IOBuf::create(std::min(size, cursor.totalLength()));
+    auto copied = cursor.pullAtMost(result->writableData(), size);
+    result->append(copied);
+    recordReadBytesCopied(getMount(), copied);
+  }
+
+  return BufVec{std::move(result)};
 }
 
 size_t FileInode::writeImpl(
@@ -964,27 +1276,146 @@ size_t FileInode::writeImpl(
   DCHECK_EQ(state->tag, State::MATERIALIZED_IN_OVERLAY);
   DCHECK(state->isFileOpen());
 
-  state->sha1Valid = false;
+  // Keep the buffered writes ordered before this one.
+  flushWriteBufferLocked(state);
+  return writeToOverlay(state, iov, numIovecs, off, getNow());
+}
+
+size_t FileInode::writeToOverlay(
+    LockedState& state,
+    const struct iovec* iov,
+    size_t numIovecs,
+    off_t off,
+    const timespec& mtime) {
+
+  // A write at or past the end of the hashed prefix leaves the prefix
+  // unchanged, and one right at its end can extend it.
+  auto sha1Prefix = state->sha1ContextLength;
+  invalidateSha1(state, /*resetContext=*/uint64_t(off) < sha1Prefix);
   auto xfer =
       ::pwritev(state->file.fd(), iov, numIovecs, off + Overlay::kHeaderLength);
   checkUnixError(xfer);
 
-  updateMtimeAndCtimeLocked(*state, getNow());
+  if (state->sha1Context && uint64_t(off) == sha1Prefix) {
+    size_t remaining = xfer;
+    for (size_t n = 0; n < numIovecs && remaining > 0; ++n) {
+      auto len = std::min(remaining, iov[n].iov_len);
+      SHA1_Update(state->sha1Context.get(), iov[n].iov_base, len);
+      remaining -= len;
+    }
+    state->sha1ContextLength += xfer;
+  }
+
+  // In writeback cache mode the kernel tracks the mtime and ctime of writes
+  // itself and sends them with setattr() when it flushes.  Writes may reach
+  // us long after they were made, so updating the timestamps here would
+  // clobber the values the kernel reports, including ones set with utimes().
+  auto channel = getMount()->getFuseChannel();
+  if (!channel || !channel->isWritebackCacheEnabled()) {
+    updateMtimeAndCtimeLocked(*state, mtime);
+  }
 
   return xfer;
 }
 
+folly::Optional<size_t> FileInode::tryBufferWrite(
+    folly::StringPiece data,
+    off_t off) {
+  const auto limit = FLAGS_write_buffer_size;
+  if (data.size() >= limit) {
+    return folly::none;
+  }
+  // The kernel writeback cache already merges small writes.
+  auto channel = getMount()->getFuseChannel();
+  if (channel && channel->isWritebackCacheEnabled()) {
+    return folly::none;
+  }
+
+  // Writes to files that are not materialized yet, or whose overlay file is
+  // not open, take the usual path.  An open overlay file means a handle is
+  // open, whose release flushes the buffer before the file is closed.
+  auto state = LockedState{this};
+  if (!state->isMaterialized() || !state->isFileOpen()) {
+    return folly::none;
+  }
+
+  auto& buffer = state->writeBuffer;
+  if (!buffer.empty() &&
+      (off < state->writeBufferOffset ||
+       off > state->writeBufferOffset + static_cast<off_t>(buffer.size()))) {
+    flushWriteBufferLocked(state);
+  }
+  if (buffer.empty()) {
+    state->writeBufferOffset = off;
+    getMount()->getInodeMap()->recordBufferedWrites(getNodeId());
+  }
+
+  auto start = static_cast<size_t>(off - state->writeBufferOffset);
+  if (start + data.size() > buffer.size()) {
+    buffer.resize(start + data.size());
+  }
+  memcpy(&buffer[start], data.data(), data.size());
+  state->writeBufferMtime = getNow();
+  getMount()->getStats()->get()->bufferedWrites.addValue(1);
+
+  if (buffer.size() >= limit) {
+    flushWriteBufferLocked(state);
+  }
+  return data.size();
+}
+
+void FileInode::flushWriteBuffer() {
+  auto state = LockedState{this};
+  flushWriteBufferLocked(state);
+}
+
+void FileInode::flushWriteBufferLocked(LockedState& state) {
+  if (state->writeBuffer.empty()) {
+    return;
+  }
+  DCHECK(state->isFileOpen());
+
+  // Writing the same bytes again is harmless, so a retry after a partial
+  // failure may simply start over.
+  const auto& buffer = state->writeBuffer;
+  size_t written = 0;
+  while (written < buffer.size()) {
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(buffer.data() + written);
+    iov.iov_len = buffer.size() - written;
+    written += writeToOverlay(
+        state,
+        &iov,
+        1,
+        state->writeBufferOffset + written,
+        state->writeBufferMtime);
+  }
+  state->writeBuffer = std::string{};
+  updateJournal();
+  getMount()->getStats()->get()->writeBufferFlushes.addValue(1);
+}
+
 folly::Future<size_t> FileInode::write(BufVec&& buf, off_t off) {
-  return runWhileMaterialized(
-      LockedState{this},
-      [buf = std::move(buf), off, self = inodePtrFromThis()](
-          LockedState&& state) {
-        auto vec = buf.getIov();
-        return self->writeImpl(state, vec.data(), vec.size(), off);
+  return runOnOverlayIoPool(
+      getMount(),
+      [buf = std::move(buf), off, self = inodePtrFromThis()]() mutable {
+        return self->runWhileMaterialized(
+            LockedState{self},
+            [buf = std::move(buf), off, self](LockedState&& state) {
+              auto vec = buf.getIov();
+              return self->writeImpl(state, vec.data(), vec.size(), off);
+            });
       });
 }
 
 folly::Future<size_t> FileInode::write(folly::StringPiece data, off_t off) {
+  if (getMount()->getOverlayIoPool()) {
+    // The data is only valid until we return, so it must be copied before
+    // the write moves to another thread.
+    return write(
+        BufVec{folly::IOBuf::copyBuffer(data.data(), data.size())}, off);
+  }
+
   auto state = LockedState{this};
 
   // If we are currently materialized we don't need to copy the input data.
@@ -1006,23 +1437,51 @@ folly::Future<size_t> FileInode::write(folly::StringPiece data, off_t off) {
       });
 }
 
+uint64_t FileInode::releaseBlobIfIdle(
+    std::chrono::steady_clock::time_point cutoff) {
+  auto state = LockedState{this};
+  if (state->tag != State::BLOB_LOADED ||
+      state->blobLastUsed.load(std::memory_order_relaxed) >=
+          cutoff.time_since_epoch().count()) {
+    return 0;
+  }
+  auto bytes = state->blob->getSizeBytes();
+  state->resetBlob();
+  state->tag = State::NOT_LOADED;
+  return bytes;
+}
+
 Future<FileInode::FileHandlePtr> FileInode::startLoadingData(
     LockedState state) {
   DCHECK_EQ(state->tag, State::NOT_LOADED);
 
   // Start the blob load first in case this throws an exception.
   // Ideally the state transition is no-except in tandem with the
-  // Future's .then call.
-  auto blobFuture = getObjectStore()->getBlob(state->hash.value());
+  // Future's .then call.  The load is only cancelled once every request that
+  // joins it has been.
+  CancellationJoin waiters{CancellationToken::current()};
+  auto blobFuture = [&] {
+    CancellationScope scope{waiters.getToken()};
+    return getObjectStore()->getBlob(
+        state->hash.value(), ImportPriority::Interactive);
+  }();
 
   // Everything from here through blobFuture.then should be noexcept.
   state->blobLoadingPromise.emplace();
+  state->blobLoadingWaiters = std::move(waiters);
   auto resultFuture = state->blobLoadingPromise->getFuture();
   state->tag = State::BLOB_LOADING;
 
   // Unlock state_ while we wait on the blob data to load
   state.unlock();
 
+  // Let our parent prefetch the files after this one if they are being read
+  // in order.  Renames racing with this only make the hint less accurate.
+  auto location = getLocationInfoRacy();
+  if (location.parent && !location.unlinked) {
+    location.parent->prefetchSiblingBlobs(location.name);
+  }
+
   auto self = inodePtrFromThis(); // separate line for formatting
   std::move(blobFuture)
       .then([self](folly::Try<std::shared_ptr<const Blob>> tryBlob) mutable {
@@ -1038,11 +1497,12 @@ Future<FileInode::FileHandlePtr> FileInode::startLoadingData(
           case State::BLOB_LOADING: {
             auto promise = std::move(*state->blobLoadingPromise);
             state->blobLoadingPromise.clear();
+            state->blobLoadingWaiters = CancellationJoin{};
 
             if (tryBlob.hasValue()) {
               // Transition to 'loaded' state.
               state.incOpenCount();
-              state->blob = std::move(tryBlob.value());
+              state->setBlob(std::move(tryBlob.value()));
               state->tag = State::BLOB_LOADED;
               promise.setValue(state.unlockAndCreateHandle(std::move(self)));
             } else {
@@ -1079,6 +1539,21 @@ Future<FileInode::FileHandlePtr> FileInode::startLoadingData(
   return resultFuture;
 }
 
+Future<FileInode::FileHandlePtr> FileInode::joinLoadingData(
+    LockedState state) {
+  DCHECK_EQ(state->tag, State::BLOB_LOADING);
+  auto future = state->blobLoadingPromise->getFuture();
+  if (state->blobLoadingWaiters.add(CancellationToken::current())) {
+    return future;
+  }
+
+  // Every request waiting on the load was cancelled, so the blob may never
+  // arrive.  Wait for the load to finish either way, and let the caller
+  // start a new one if it failed.
+  return std::move(future).then(
+      [](folly::Try<FileHandlePtr>&&) { return FileHandlePtr{}; });
+}
+
 void FileInode::materializeNow(LockedState& state) {
   // This function should only be called from the BLOB_LOADED state
   DCHECK_EQ(state->tag, State::BLOB_LOADED);
@@ -1125,7 +1600,10 @@ void FileInode::truncateInOverlay(LockedState& state) {
   CHECK(!state->blob);
 
   state.ensureFileOpen(this);
+  invalidateSha1(state, /*resetContext=*/true);
   checkUnixError(ftruncate(state->file.fd(), 0 + Overlay::kHeaderLength));
+  // The buffered writes would have been truncated away too.
+  state->writeBuffer.clear();
 }
 
 ObjectStore* FileInode::getObjectStore() const {
@@ -1136,10 +1614,16 @@ Hash FileInode::recomputeAndStoreSha1(const LockedState& state) {
   DCHECK_EQ(state->tag, State::MATERIALIZED_IN_OVERLAY);
   DCHECK(state->isFileOpen());
 
+  // Resume from the hashed prefix, if we have one.
   uint8_t buf[8192];
   off_t off = Overlay::kHeaderLength;
   SHA_CTX ctx;
-  SHA1_Init(&ctx);
+  if (state->sha1Context) {
+    ctx = *state->sha1Context;
+    off += state->sha1ContextLength;
+  } else {
+    SHA1_Init(&ctx);
+  }
 
   while (true) {
     // Using pread here so that we don't move the file position;
@@ -1158,6 +1642,14 @@ Hash FileInode::recomputeAndStoreSha1(const LockedState& state) {
     off += len;
   }
 
+  // Keep the state for the whole file so that later appends only need to
+  // hash the new data.
+  if (!state->sha1Context) {
+    state->sha1Context = std::make_unique<SHA_CTX>();
+  }
+  *state->sha1Context = ctx;
+  state->sha1ContextLength = off - Overlay::kHeaderLength;
+
   uint8_t digest[SHA_DIGEST_LENGTH];
   SHA1_Final(digest, &ctx);
   auto sha1 = Hash(folly::ByteRange(digest, sizeof(digest)));
@@ -1172,6 +1664,13 @@ void FileInode::storeSha1(const LockedState& state, Hash sha1) {
   try {
     fsetxattr(state->file.fd(), kXattrSha1, sha1.toString());
     state->sha1Valid = true;
+
+    // Record what the file looked like when we hashed it, so that the SHA-1
+    // can be trusted after this inode is unloaded or edenfs restarts.
+    state->sha1RecordMayExist = true;
+    struct stat st;
+    checkUnixError(fstat(state->file.fd(), &st));
+    fsetxattr(state->file.fd(), kXattrSha1Stat, sha1StatRecord(st));
   } catch (const std::exception& ex) {
     // If something goes wrong storing the attribute just log a warning
     // and leave sha1Valid as false.  We'll have to recompute the value
@@ -1181,9 +1680,57 @@ void FileInode::storeSha1(const LockedState& state, Hash sha1) {
   }
 }
 
+void FileInode::invalidateSha1(const LockedState& state, bool resetContext) {
+  DCHECK_EQ(state->tag, State::MATERIALIZED_IN_OVERLAY);
+  DCHECK(state->isFileOpen());
+
+  if (resetContext) {
+    state->sha1Context.reset();
+    state->sha1ContextLength = 0;
+  }
+  state->sha1Valid = false;
+  if (!state->sha1RecordMayExist) {
+    return;
+  }
+
+  state->sha1RecordMayExist = false;
+  try {
+    // The mtime may not change if the file is modified soon after hashing
+    // it, so remove the record rather than relying on it going stale.
+    fremovexattr(state->file.fd(), kXattrSha1Stat);
+  } catch (const std::system_error& ex) {
+    if (ex.code().value() != kENOATTR) {
+      XLOG(WARNING) << "error clearing SHA1 attribute in the overlay: "
+                    << folly::exceptionStr(ex);
+    }
+  }
+}
+
+bool FileInode::loadStoredSha1(const LockedState& state) {
+  DCHECK_EQ(state->tag, State::MATERIALIZED_IN_OVERLAY);
+  DCHECK(state->isFileOpen());
+
+  try {
+    struct stat st;
+    checkUnixError(fstat(state->file.fd(), &st));
+    if (fgetxattr(state->file.fd(), kXattrSha1Stat) != sha1StatRecord(st)) {
+      return false;
+    }
+  } catch (const std::system_error& ex) {
+    if (ex.code().value() != kENOATTR) {
+      XLOG(WARNING) << "error reading SHA1 attribute in the overlay: "
+                    << folly::exceptionStr(ex);
+    }
+    return false;
+  }
+
+  state->sha1Valid = true;
+  return true;
+}
+
 folly::Future<folly::Unit> FileInode::prefetch() {
   // Careful to only hold the lock while fetching a copy of the hash.
-  return folly::via(getMount()->getThreadPool().get())
+  return folly::via(getMount()->getBackgroundThreadPool().get())
       .thenValue([this](auto&&) {
         if (auto hash = state_.rlock()->hash) {
           getObjectStore()->getBlobMetadata(*hash);
@@ -13,9 +13,12 @@
 #include <folly/Synchronized.h>
 #include <folly/futures/Future.h>
 #include <folly/futures/SharedPromise.h>
+#include <openssl/sha.h>
+#include <atomic>
 #include <chrono>
 #include "eden/fs/inodes/InodeBase.h"
 #include "eden/fs/model/Tree.h"
+#include "eden/fs/utils/Cancellation.h"
 
 namespace folly {
 class File;
@@ -25,6 +28,7 @@ namespace facebook {
 namespace eden {
 
 class Blob;
+class BlobMetadata;
 class BufVec;
 class EdenFileHandle;
 class Hash;
@@ -60,8 +64,14 @@ struct FileInodeState {
     MATERIALIZED_IN_OVERLAY,
   };
 
-  explicit FileInodeState(const folly::Optional<Hash>& hash);
-  explicit FileInodeState();
+  /**
+   * loadedBlobBytes is the mount's count of blob bytes held in memory, which
+   * this state adds its blob's size to while it holds one.  It may be null.
+   */
+  FileInodeState(
+      const folly::Optional<Hash>& hash,
+      std::atomic<uint64_t>* loadedBlobBytes);
+  explicit FileInodeState(std::atomic<uint64_t>* loadedBlobBytes);
   ~FileInodeState();
 
   /**
@@ -95,6 +105,21 @@ struct FileInodeState {
    */
   void incOpenCount();
 
+  /**
+   * Set or clear blob, keeping loadedBlobBytes up to date.
+   */
+  void setBlob(std::shared_ptr<const Blob> newBlob);
+  void resetBlob();
+
+  /**
+   * Record that the blob was just read.
+   */
+  void markBlobUsed() const {
+    blobLastUsed.store(
+        std::chrono::steady_clock::now().time_since_epoch().count(),
+        std::memory_order_relaxed);
+  }
+
   Tag tag;
 
   /**
@@ -107,17 +132,47 @@ struct FileInodeState {
    * Set if 'loading'.
    */
   folly::Optional<folly::SharedPromise<FileHandlePtr>> blobLoadingPromise;
+  /**
+   * The requests waiting on blobLoadingPromise, if 'loading'.  The blob load
+   * is only dropped once all of them have been cancelled.
+   */
+  CancellationJoin blobLoadingWaiters;
 
   /**
    * Set if 'loaded', references immutable data from the backing store.
    */
   std::shared_ptr<const Blob> blob;
 
+  /**
+   * When blob was last read, as a steady_clock tick count, so that the
+   * blobs of files that are open but idle can be released.  This is atomic
+   * because reads may only hold a read lock on the state.
+   */
+  mutable std::atomic<std::chrono::steady_clock::rep> blobLastUsed{0};
+
   /**
    * If backed by an overlay file, whether the sha1 xattr is valid
    */
   bool sha1Valid{false};
 
+  /**
+   * If backed by an overlay file, the SHA-1 state after hashing the first
+   * sha1ContextLength bytes of its contents.
+   *
+   * Writes past that prefix leave it valid, so a file that is only ever
+   * appended to, like a log, can have its SHA-1 computed by hashing just the
+   * newly appended data.
+   */
+  std::unique_ptr<SHA_CTX> sha1Context;
+  uint64_t sha1ContextLength{0};
+
+  /**
+   * Whether the overlay file may have a record validating its stored SHA-1.
+   * This must be assumed for overlay files that were not created by this
+   * FileInode, since an earlier one may have hashed the file.
+   */
+  bool sha1RecordMayExist{true};
+
   /**
    * Set if 'materialized', holds the open file descriptor backed by an
    * overlay file.
@@ -128,6 +183,18 @@ struct FileInodeState {
    * Number of open file handles referencing us.
    */
   size_t openCount{0};
+
+  /**
+   * Small writes that have been accepted but not yet written to the overlay
+   * file, if --write_buffer_size is set.  writeBuffer holds the contents of
+   * the file from writeBufferOffset on, and writeBufferMtime is when the
+   * last write merged into it was made.  Only set while the file is open.
+   */
+  std::string writeBuffer;
+  off_t writeBufferOffset{0};
+  timespec writeBufferMtime{};
+
+  std::atomic<uint64_t>* const loadedBlobBytes{nullptr};
 };
 
 class FileInode final : public InodeBaseMetadata<FileInodeState> {
@@ -180,6 +247,11 @@ class FileInode final : public InodeBaseMetadata<FileInodeState> {
   folly::Future<Dispatcher::Attr> getattr() override;
   folly::Future<Dispatcher::Attr> setattr(const fuse_setattr_in& attr) override;
 
+  /**
+   * Update the st_blocks field in a stat structure based on the st_size value.
+   */
+  static void updateBlockCount(struct stat& st);
+
   /// Throws InodeError EINVAL if inode is not a symbolic node.
   folly::Future<std::string> readlink();
 
@@ -245,6 +317,21 @@ class FileInode final : public InodeBaseMetadata<FileInodeState> {
 
   folly::Future<size_t> write(folly::StringPiece data, off_t off);
 
+  /**
+   * Drop the blob held for this file if it has not been read since cutoff.
+   * Open files keep their blob loaded, so this bounds the memory held by
+   * files that are open but idle.  The next read loads the blob again,
+   * normally from the LocalStore.
+   *
+   * Returns the number of bytes released.
+   */
+  uint64_t releaseBlobIfIdle(std::chrono::steady_clock::time_point cutoff);
+
+  /**
+   * Write the writes buffered by tryBufferWrite() to the overlay file.
+   */
+  void flushWriteBuffer();
+
  private:
   using State = FileInodeState;
   class LockedState;
@@ -301,6 +388,41 @@ class FileInode final : public InodeBaseMetadata<FileInodeState> {
   FOLLY_NODISCARD folly::Future<FileHandlePtr> startLoadingData(
       LockedState state);
 
+  /**
+   * Wait for the load that is already in progress.
+   *
+   * state->tag must be BLOB_LOADING when this is called.  The returned
+   * handle is null if the load may have been dropped because every other
+   * request waiting on it was cancelled, in which case the caller should
+   * look at the state again once the Future completes.
+   */
+  FOLLY_NODISCARD folly::Future<FileHandlePtr> joinLoadingData(
+      LockedState state);
+
+  /**
+   * Implement read() by loading the blob into memory if the file is not
+   * materialized.
+   */
+  folly::Future<BufVec>
+  readLoadedData(LockedState state, size_t size, off_t off);
+
+  /**
+   * Serve a read holding the state lock only in shared mode, so that threads
+   * reading one file at the same time do not serialize on it.
+   *
+   * This is only possible when the data is already available: the blob is
+   * loaded, or the file is materialized and its overlay file is open.
+   * Otherwise this returns folly::none and the caller should fall back to
+   * readLoadedData().
+   */
+  folly::Optional<BufVec> tryReadShared(size_t size, off_t off);
+
+  /**
+   * Read from a BLOB_LOADED state, or from a MATERIALIZED_IN_OVERLAY state
+   * whose overlay file is open.  The state lock may be held in either mode.
+   */
+  BufVec readLocked(const State& state, size_t size, off_t off);
+
   /**
    * Materialize the file as an empty file in the overlay.
    *
@@ -377,6 +499,14 @@ class FileInode final : public InodeBaseMetadata<FileInodeState> {
       const Hash& blobID,
       TreeEntryType entryType);
 
+  /**
+   * Helper function for isSameAs().
+   *
+   * Compare the file's contents against a blob's size and SHA-1, for when
+   * isSameAsFast() could not decide.
+   */
+  folly::Future<bool> isSameAsSlow(const BlobMetadata& blobMetadata);
+
   /**
    * Recompute the SHA1 content hash of the open file.
    *
@@ -393,6 +523,24 @@ class FileInode final : public InodeBaseMetadata<FileInodeState> {
    */
   static void storeSha1(const LockedState& state, Hash sha1);
 
+  /**
+   * Mark the SHA-1 of an overlay file as out of date, before its contents
+   * are changed.
+   *
+   * If resetContext is true the resumable SHA-1 state is discarded too; it
+   * may be kept only when the change does not touch the hashed prefix.
+   */
+  static void invalidateSha1(const LockedState& state, bool resetContext);
+
+  /**
+   * Validate a SHA-1 stored on the overlay file by an earlier FileInode for
+   * this inode number, possibly in an earlier run of edenfs.
+   *
+   * The SHA-1 is trusted if the overlay file still has the size and mtime
+   * recorded alongside it.  Returns true and sets state->sha1Valid if so.
+   */
+  static bool loadStoredSha1(const LockedState& state);
+
   /**
    * Get the ObjectStore used by this FileInode to load non-materialized data.
    */
@@ -420,15 +568,35 @@ class FileInode final : public InodeBaseMetadata<FileInodeState> {
       const struct iovec* iov,
       size_t numIovecs,
       off_t off);
+  size_t writeToOverlay(
+      LockedState& state,
+      const struct iovec* iov,
+      size_t numIovecs,
+      off_t off,
+      const timespec& mtime);
 
-  folly::Future<struct stat> stat();
-  void flush(uint64_t lock_owner);
-  void fsync(bool datasync);
+  /**
+   * Merge a small write to an open, materialized file into its write buffer
+   * rather than writing it to the overlay now.  Returns the number of bytes
+   * written, or folly::none if the write should go through write() instead.
+   *
+   * The buffer is written to the overlay, and recorded in the journal, once
+   * it reaches --write_buffer_size bytes, when a write does not touch or
+   * extend the buffered range, and before anything reads, stats, truncates,
+   * hashes, syncs or closes the file.  InodeMap::flushWriteBuffers() also
+   * flushes it periodically.
+   */
+  folly::Optional<size_t> tryBufferWrite(folly::StringPiece data, off_t off);
 
   /**
-   * Update the st_blocks field in a stat structure based on the st_size value.
+   * Write the buffered writes, if any, to the overlay file.  The buffer is
+   * kept if this throws.
    */
-  static void updateBlockCount(struct stat& st);
+  void flushWriteBufferLocked(LockedState& state);
+
+  folly::Future<struct stat> stat();
+  void flush(uint64_t lock_owner);
+  FOLLY_NODISCARD folly::Future<folly::Unit> fsync(bool datasync);
 
   folly::Synchronized<State> state_;
 
@@ -8,6 +8,8 @@
  *
  */
 #include "GlobNode.h"
+#include <unordered_map>
+#include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/TreeInode.h"
 
 using folly::Future;
@@ -23,6 +25,39 @@ namespace eden {
 
 namespace {
 
+/**
+ * Continue on the executor, if there is one, so that sibling subdirectories
+ * are evaluated in parallel rather than inline in whichever thread happened
+ * to complete their load.
+ */
+template <typename T>
+Future<T> maybeVia(Future<T>&& future, folly::Executor* executor) {
+  if (executor) {
+    return std::move(future).via(executor);
+  }
+  return std::move(future);
+}
+
+/**
+ * Append the results of the child evaluations to the results for the
+ * current directory.
+ */
+Future<vector<RelativePath>> collectResults(
+    vector<Future<vector<RelativePath>>>&& futures,
+    vector<RelativePath>&& results = {}) {
+  return folly::collect(futures).then(
+      [shadowResults = std::move(results)](
+          vector<vector<RelativePath>>&& matchVector) mutable {
+        for (auto& matches : matchVector) {
+          shadowResults.insert(
+              shadowResults.end(),
+              std::make_move_iterator(matches.begin()),
+              std::make_move_iterator(matches.end()));
+        }
+        return shadowResults;
+      });
+}
+
 // Policy objects to help avoid duplicating the core globbing logic.
 // We can walk over two different kinds of trees; either TreeInodes
 // or raw Trees from the storage layer.  While they have similar
@@ -34,11 +69,26 @@ namespace {
  * are iterated.
  * We only need to prefetch children of TreeInodes that are
  * not materialized.
+ *
+ * The roots are only used until evaluateImpl() returns, while the caller's
+ * TreeInodePtr is still alive, so they borrow the inode rather than copying
+ * the pointer and touching its refcount for every directory globbed.
  */
 struct TreeInodePtrRoot {
-  TreeInodePtr root;
+  TreeInode* root;
+
+  explicit TreeInodePtrRoot(const TreeInodePtr& root) : root(root.get()) {}
+
+  /** Return the mount being globbed */
+  const EdenMount* getMount() const {
+    return root->getMount();
+  }
 
-  explicit TreeInodePtrRoot(TreeInodePtr root) : root(root) {}
+  /** Returns true if the contents of the directory at this path are hidden
+   * by the mount's scope */
+  bool isOutsideScope(RelativePathPiece path) const {
+    return root->getMount()->isOutsideScope(path);
+  }
 
   /** Return an object that holds a lock over the children */
   auto lockContents() {
@@ -122,11 +172,26 @@ struct TreeInodePtrRoot {
 /** TreeRoot wraps a Tree for globbing.
  * The entries do not need to be locked, but to satisfy the interface
  * we return the entries when lockContents() is called.
+ * Like TreeInodePtrRoot, it borrows the Tree from its caller.
  */
 struct TreeRoot {
-  std::shared_ptr<const Tree> tree;
+  const Tree* tree;
+  // The mount whose unmaterialized directories are being globbed, or null
+  // when globbing a commit.
+  const EdenMount* mount;
+
+  explicit TreeRoot(
+      const std::shared_ptr<const Tree>& tree,
+      const EdenMount* mount = nullptr)
+      : tree(tree.get()), mount(mount) {}
+
+  const EdenMount* getMount() const {
+    return mount;
+  }
 
-  explicit TreeRoot(const std::shared_ptr<const Tree>& tree) : tree(tree) {}
+  bool isOutsideScope(RelativePathPiece path) const {
+    return mount && mount->isOutsideScope(path);
+  }
 
   /** We don't need to lock the contents, so we just return a reference
    * to the entries */
@@ -269,137 +334,201 @@ Future<vector<RelativePath>> GlobNode::evaluateImpl(
     const ObjectStore* store,
     RelativePathPiece rootPath,
     ROOT&& root,
-    GlobNode::PrefetchList fileBlobsToPrefetch) {
+    const vector<GlobNode*>& nodes,
+    GlobNode::PrefetchList fileBlobsToPrefetch,
+    folly::Executor* executor,
+    const std::shared_ptr<const ResultCallback>& onResults) {
   vector<RelativePath> results;
-  vector<std::pair<PathComponentPiece, GlobNode*>> recurse;
+  if (root.isOutsideScope(rootPath)) {
+    return results;
+  }
+  vector<Hash> blobsToPrefetch;
   vector<Future<vector<RelativePath>>> futures;
-  futures.emplace_back(evaluateRecursiveComponentImpl(
-      store, rootPath, root, fileBlobsToPrefetch));
+  for (auto* node : nodes) {
+    if (!node->recursiveChildren_.empty()) {
+      futures.emplace_back(node->evaluateRecursiveComponentImpl(
+          store, rootPath, root, fileBlobsToPrefetch, executor, onResults));
+    }
+  }
+
+  // The subdirectories we need to descend into, along with the GlobNodes to
+  // evaluate against each of them.  A subdirectory matched by several
+  // patterns is only loaded and walked once.
+  struct Subdir {
+    PathComponent name;
+    bool loadInode;
+    Hash hash;
+    vector<GlobNode*> nodes;
+  };
+  vector<Subdir> subdirs;
 
   {
     auto contents = root.lockContents();
-    for (auto& node : children_) {
-      if (!node->hasSpecials_) {
+    std::unordered_map<PathComponentPiece, size_t> subdirIndexes;
+    auto addMatch = [&](GlobNode* node,
+                        const auto& entry,
+                        PathComponentPiece name) {
+      if (node->isLeaf_) {
+        results.emplace_back(rootPath + name);
+        if (fileBlobsToPrefetch && root.entryShouldPrefetch(entry)) {
+          blobsToPrefetch.emplace_back(root.entryHash(entry));
+        }
+      }
+      // If this node has children of its own and this is a dir, we need to
+      // recurse.
+      if ((node->children_.empty() && node->recursiveChildren_.empty()) ||
+          !root.entryIsTree(entry)) {
+        return;
+      }
+      auto ret = subdirIndexes.emplace(name, subdirs.size());
+      if (ret.second) {
+        // Materialized directories have no hash; they are loaded as inodes.
+        auto loadInode = root.entryShouldLoadChildTree(entry);
+        subdirs.push_back(Subdir{PathComponent{name},
+                                 loadInode,
+                                 loadInode ? Hash{} : root.entryHash(entry),
+                                 {}});
+      }
+      subdirs[ret.first->second].nodes.push_back(node);
+    };
+
+    vector<GlobNode*> specialChildren;
+    for (auto* parent : nodes) {
+      for (auto& node : parent->children_) {
+        if (node->hasSpecials_) {
+          specialChildren.push_back(node.get());
+          continue;
+        }
         // We can try a lookup for the exact name
         auto name = PathComponentPiece(node->pattern_);
         auto entry = root.lookupEntry(contents, name);
         if (entry) {
-          // Matched!
-          if (node->isLeaf_) {
-            results.emplace_back((rootPath + name));
-            if (fileBlobsToPrefetch && root.entryShouldPrefetch(entry)) {
-              fileBlobsToPrefetch->wlock()->emplace_back(root.entryHash(entry));
-            }
-            continue;
-          }
-
-          // Not the leaf of a pattern; if this is a dir, we need to recurse
-          if (root.entryIsTree(entry)) {
-            if (root.entryShouldLoadChildTree(entry)) {
-              recurse.emplace_back(std::make_pair(name, node.get()));
-            } else {
-              auto candidateName = rootPath + name;
-              futures.emplace_back(
-                  store->getTree(root.entryHash(entry))
-                      .then([candidateName,
-                             store,
-                             innerNode = node.get(),
-                             fileBlobsToPrefetch](
-                                std::shared_ptr<const Tree> dir) {
-                        return innerNode->evaluateImpl(
-                            store,
-                            candidateName,
-                            TreeRoot(dir),
-                            fileBlobsToPrefetch);
-                      }));
-            }
-          }
+          addMatch(node.get(), entry, name);
         }
-      } else {
-        // We need to match it out of the entries in this inode
-        for (auto& entry : root.iterate(contents)) {
-          auto name = root.entryName(entry);
+      }
+    }
+
+    // Match the remaining patterns against the entries in this directory.
+    // We make a single pass over the entries for all of them.
+    if (!specialChildren.empty()) {
+      for (auto& entry : root.iterate(contents)) {
+        auto name = root.entryName(entry);
+        for (auto* node : specialChildren) {
           if (node->alwaysMatch_ || node->matcher_.match(name.stringPiece())) {
-            if (node->isLeaf_) {
-              results.emplace_back((rootPath + name));
-              if (fileBlobsToPrefetch && root.entryShouldPrefetch(entry)) {
-                fileBlobsToPrefetch->wlock()->emplace_back(
-                    root.entryHash(entry));
-              }
-              continue;
-            }
-            // Not the leaf of a pattern; if this is a dir, we need to
-            // recurse
-            if (root.entryIsTree(entry)) {
-              if (root.entryShouldLoadChildTree(entry)) {
-                recurse.emplace_back(std::make_pair(name, node.get()));
-              } else {
-                auto candidateName = rootPath + name;
-                futures.emplace_back(
-                    store->getTree(root.entryHash(entry))
-                        .then([candidateName,
-                               store,
-                               innerNode = node.get(),
-                               fileBlobsToPrefetch](
-                                  std::shared_ptr<const Tree> dir) {
-                          return innerNode->evaluateImpl(
-                              store,
-                              candidateName,
-                              TreeRoot(dir),
-                              fileBlobsToPrefetch);
-                        }));
-              }
-            }
+            addMatch(node, entry, name);
           }
         }
       }
     }
   }
 
-  // Recursively load child inodes and evaluate matches
+  // Record the blobs to prefetch with a single lock acquisition per
+  // directory.
+  if (!blobsToPrefetch.empty()) {
+    auto list = fileBlobsToPrefetch->wlock();
+    list->insert(list->end(), blobsToPrefetch.begin(), blobsToPrefetch.end());
+  }
 
-  for (auto& item : recurse) {
-    auto candidateName = rootPath + item.first;
-    futures.emplace_back(root.getOrLoadChildTree(item.first)
-                             .then([store,
-                                    candidateName,
-                                    node = item.second,
-                                    fileBlobsToPrefetch](TreeInodePtr dir) {
-                               return node->evaluateImpl(
-                                   store,
-                                   candidateName,
-                                   TreeInodePtrRoot(dir),
-                                   fileBlobsToPrefetch);
-                             }));
+  if (onResults) {
+    if (!(*onResults)(std::move(results))) {
+      return collectResults(std::move(futures));
+    }
+    results.clear();
+  }
+
+  // Recursively load child trees and inodes and evaluate matches
+  for (auto& subdir : subdirs) {
+    auto candidateName = rootPath + subdir.name;
+    if (subdir.loadInode) {
+      futures.emplace_back(
+          maybeVia(root.getOrLoadChildTree(subdir.name), executor)
+              .then([store,
+                     candidateName,
+                     nodes = std::move(subdir.nodes),
+                     fileBlobsToPrefetch,
+                     executor,
+                     onResults](TreeInodePtr dir) {
+                return evaluateImpl(
+                    store,
+                    candidateName,
+                    TreeInodePtrRoot(dir),
+                    nodes,
+                    fileBlobsToPrefetch,
+                    executor,
+                    onResults);
+              }));
+    } else {
+      futures.emplace_back(
+          maybeVia(store->getTree(subdir.hash), executor)
+              .then([store,
+                     mount = root.getMount(),
+                     candidateName,
+                     nodes = std::move(subdir.nodes),
+                     fileBlobsToPrefetch,
+                     executor,
+                     onResults](std::shared_ptr<const Tree> dir) {
+                return evaluateImpl(
+                    store,
+                    candidateName,
+                    TreeRoot(dir, mount),
+                    nodes,
+                    fileBlobsToPrefetch,
+                    executor,
+                    onResults);
+              }));
+    }
   }
-  return folly::collect(futures).then(
-      [shadowResults = std::move(results)](
-          vector<vector<RelativePath>>&& matchVector) mutable {
-        for (auto& matches : matchVector) {
-          shadowResults.insert(
-              shadowResults.end(),
-              std::make_move_iterator(matches.begin()),
-              std::make_move_iterator(matches.end()));
-        }
-        return shadowResults;
-      });
+  return collectResults(std::move(futures), std::move(results));
 }
 
 Future<vector<RelativePath>> GlobNode::evaluate(
     const ObjectStore* store,
     RelativePathPiece rootPath,
-    TreeInodePtr root,
-    GlobNode::PrefetchList fileBlobsToPrefetch) {
+    const TreeInodePtr& root,
+    GlobNode::PrefetchList fileBlobsToPrefetch,
+    folly::Executor* executor) {
   return evaluateImpl(
-      store, rootPath, TreeInodePtrRoot(root), fileBlobsToPrefetch);
+      store,
+      rootPath,
+      TreeInodePtrRoot(root),
+      {this},
+      fileBlobsToPrefetch,
+      executor,
+      nullptr);
 }
 
 folly::Future<vector<RelativePath>> GlobNode::evaluate(
     const ObjectStore* store,
     RelativePathPiece rootPath,
     const std::shared_ptr<const Tree>& tree,
-    GlobNode::PrefetchList fileBlobsToPrefetch) {
-  return evaluateImpl(store, rootPath, TreeRoot(tree), fileBlobsToPrefetch);
+    GlobNode::PrefetchList fileBlobsToPrefetch,
+    folly::Executor* executor) {
+  return evaluateImpl(
+      store,
+      rootPath,
+      TreeRoot(tree),
+      {this},
+      fileBlobsToPrefetch,
+      executor,
+      nullptr);
+}
+
+Future<folly::Unit> GlobNode::evaluateStreaming(
+    const ObjectStore* store,
+    RelativePathPiece rootPath,
+    const TreeInodePtr& root,
+    GlobNode::PrefetchList fileBlobsToPrefetch,
+    folly::Executor* executor,
+    ResultCallback onResults) {
+  return evaluateImpl(
+             store,
+             rootPath,
+             TreeInodePtrRoot(root),
+             {this},
+             fileBlobsToPrefetch,
+             executor,
+             std::make_shared<const ResultCallback>(std::move(onResults)))
+      .then([](vector<RelativePath>&& /* results */) {});
 }
 
 StringPiece GlobNode::tokenize(StringPiece& pattern, bool* hasSpecials) {
@@ -445,13 +574,17 @@ Future<vector<RelativePath>> GlobNode::evaluateRecursiveComponentImpl(
     const ObjectStore* store,
     RelativePathPiece rootPath,
     ROOT&& root,
-    GlobNode::PrefetchList fileBlobsToPrefetch) {
+    GlobNode::PrefetchList fileBlobsToPrefetch,
+    folly::Executor* executor,
+    const std::shared_ptr<const ResultCallback>& onResults) {
   vector<RelativePath> results;
-  if (recursiveChildren_.empty()) {
+  if (recursiveChildren_.empty() || root.isOutsideScope(rootPath)) {
     return results;
   }
 
+  vector<Hash> blobsToPrefetch;
   vector<RelativePath> subDirNames;
+  vector<std::pair<RelativePath, Hash>> subTrees;
   vector<Future<vector<RelativePath>>> futures;
   {
     auto contents = root.lockContents();
@@ -463,7 +596,7 @@ Future<vector<RelativePath>> GlobNode::evaluateRecursiveComponentImpl(
             node->matcher_.match(candidateName.stringPiece())) {
           results.emplace_back(candidateName);
           if (fileBlobsToPrefetch && root.entryShouldPrefetch(entry)) {
-            fileBlobsToPrefetch->wlock()->emplace_back(root.entryHash(entry));
+            blobsToPrefetch.emplace_back(root.entryHash(entry));
           }
           // No sense running multiple matches for this same file.
           break;
@@ -476,46 +609,64 @@ Future<vector<RelativePath>> GlobNode::evaluateRecursiveComponentImpl(
         if (root.entryShouldLoadChildTree(entry)) {
           subDirNames.emplace_back(candidateName);
         } else {
-          futures.emplace_back(
-              store->getTree(root.entryHash(entry))
-                  .then([candidateName, store, this, fileBlobsToPrefetch](
-                            const std::shared_ptr<const Tree>& tree) {
-                    return evaluateRecursiveComponentImpl(
-                        store,
-                        candidateName,
-                        TreeRoot(tree),
-                        fileBlobsToPrefetch);
-                  }));
+          subTrees.emplace_back(candidateName, root.entryHash(entry));
         }
       }
     }
   }
 
-  // Recursively load child inodes and evaluate matches
+  if (!blobsToPrefetch.empty()) {
+    auto list = fileBlobsToPrefetch->wlock();
+    list->insert(list->end(), blobsToPrefetch.begin(), blobsToPrefetch.end());
+  }
+
+  if (onResults) {
+    if (!(*onResults)(std::move(results))) {
+      return vector<RelativePath>{};
+    }
+    results.clear();
+  }
+
+  // Recursively load child trees and inodes and evaluate matches
+  for (auto& subTree : subTrees) {
+    futures.emplace_back(
+        maybeVia(store->getTree(subTree.second), executor)
+            .then([candidateName = std::move(subTree.first),
+                   store,
+                   mount = root.getMount(),
+                   this,
+                   fileBlobsToPrefetch,
+                   executor,
+                   onResults](const std::shared_ptr<const Tree>& tree) {
+              return evaluateRecursiveComponentImpl(
+                  store,
+                  candidateName,
+                  TreeRoot(tree, mount),
+                  fileBlobsToPrefetch,
+                  executor,
+                  onResults);
+            }));
+  }
   for (auto& candidateName : subDirNames) {
     futures.emplace_back(
-        root.getOrLoadChildTree(candidateName.basename())
-            .then([candidateName, store, this, fileBlobsToPrefetch](
-                      TreeInodePtr dir) {
+        maybeVia(root.getOrLoadChildTree(candidateName.basename()), executor)
+            .then([candidateName,
+                   store,
+                   this,
+                   fileBlobsToPrefetch,
+                   executor,
+                   onResults](TreeInodePtr dir) {
               return evaluateRecursiveComponentImpl(
                   store,
                   candidateName,
                   TreeInodePtrRoot(dir),
-                  fileBlobsToPrefetch);
+                  fileBlobsToPrefetch,
+                  executor,
+                  onResults);
             }));
   }
 
-  return folly::collect(futures).then(
-      [shadowResults = std::move(results)](
-          vector<vector<RelativePath>>&& matchVector) mutable {
-        for (auto& matches : matchVector) {
-          shadowResults.insert(
-              shadowResults.end(),
-              std::make_move_iterator(matches.begin()),
-              std::make_move_iterator(matches.end()));
-        }
-        return shadowResults;
-      });
+  return collectResults(std::move(futures), std::move(results));
 }
 
 } // namespace eden
@@ -9,6 +9,7 @@
  */
 #pragma once
 #include <folly/futures/Future.h>
+#include <functional>
 #include "eden/fs/inodes/InodePtrFwd.h"
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/model/Tree.h"
@@ -36,6 +37,10 @@ class GlobNode {
 
   using PrefetchList = std::shared_ptr<folly::Synchronized<std::vector<Hash>>>;
 
+  // Receives the matches found in one directory.  Returns false to stop the
+  // evaluation from descending any further.
+  using ResultCallback = std::function<bool(std::vector<RelativePath>&&)>;
+
   GlobNode(folly::StringPiece pattern, bool includeDotfiles, bool hasSpecials);
 
   // Compile and add a new glob pattern to the tree.
@@ -52,18 +57,36 @@ class GlobNode {
   // prefetched via the ObjectStore layer.  This will not change the
   // materialization or overlay state for children that already have
   // inodes assigned.
+  // If executor is non-null, the evaluation of each subdirectory continues
+  // on it once that subdirectory has been loaded, so that sibling
+  // subdirectories are evaluated in parallel.
   folly::Future<std::vector<RelativePath>> evaluate(
       const ObjectStore* store,
       RelativePathPiece rootPath,
-      TreeInodePtr root,
-      PrefetchList fileBlobsToPrefetch);
+      const TreeInodePtr& root,
+      PrefetchList fileBlobsToPrefetch,
+      folly::Executor* executor = nullptr);
 
   // This is the Tree version of the method above
   folly::Future<std::vector<RelativePath>> evaluate(
       const ObjectStore* store,
       RelativePathPiece rootPath,
       const std::shared_ptr<const Tree>& tree,
-      PrefetchList fileBlobsToPrefetch);
+      PrefetchList fileBlobsToPrefetch,
+      folly::Executor* executor = nullptr);
+
+  // Like evaluate(), but rather than accumulating the matches into a single
+  // vector, this passes the matches to onResults as each directory is
+  // evaluated.  onResults may be called concurrently from several threads
+  // when an executor is given.  It is also called, with no matches, for
+  // directories that contain none, so that it can cancel the evaluation.
+  folly::Future<folly::Unit> evaluateStreaming(
+      const ObjectStore* store,
+      RelativePathPiece rootPath,
+      const TreeInodePtr& root,
+      PrefetchList fileBlobsToPrefetch,
+      folly::Executor* executor,
+      ResultCallback onResults);
 
  private:
   // Returns the next glob node token.
@@ -94,14 +117,23 @@ class GlobNode {
       const ObjectStore* store,
       RelativePathPiece rootPath,
       ROOT&& root,
-      PrefetchList fileBlobsToPrefetch);
+      PrefetchList fileBlobsToPrefetch,
+      folly::Executor* executor,
+      const std::shared_ptr<const ResultCallback>& onResults);
 
+  // Evaluates the non-recursive children of all of the given nodes against
+  // root.  Several patterns can lead to the same directory, e.g. "foo/*.c"
+  // and "foo/*.h"; evaluating them together means that each directory is
+  // only loaded and walked once no matter how many patterns reach it.
   template <typename ROOT>
-  folly::Future<std::vector<RelativePath>> evaluateImpl(
+  static folly::Future<std::vector<RelativePath>> evaluateImpl(
       const ObjectStore* store,
       RelativePathPiece rootPath,
       ROOT&& root,
-      PrefetchList fileBlobsToPrefetch);
+      const std::vector<GlobNode*>& nodes,
+      PrefetchList fileBlobsToPrefetch,
+      folly::Executor* executor,
+      const std::shared_ptr<const ResultCallback>& onResults);
 
   // The pattern fragment for this node
   std::string pattern_;
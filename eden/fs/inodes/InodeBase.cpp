@@ -244,8 +244,24 @@ std::unique_ptr<InodeBase> InodeBase::markUnlinked(
     TreeInode* parent,
     PathComponentPiece name,
     const RenameLock& renameLock) {
-  XLOG(DBG5) << "inode " << this << " unlinked: " << getLogPath();
   DCHECK(renameLock.isHeld(mount_));
+  mount_->invalidatePathInodeCache(renameLock);
+  return markUnlinkedImpl(parent, name);
+}
+
+std::unique_ptr<InodeBase> InodeBase::markUnlinked(
+    TreeInode* parent,
+    PathComponentPiece name,
+    const SharedRenameLock& renameLock) {
+  DCHECK(renameLock.isHeld(mount_));
+  mount_->invalidatePathInodeCache(renameLock);
+  return markUnlinkedImpl(parent, name);
+}
+
+std::unique_ptr<InodeBase> InodeBase::markUnlinkedImpl(
+    TreeInode* parent,
+    PathComponentPiece name) {
+  XLOG(DBG5) << "inode " << this << " unlinked: " << getLogPath();
 
   {
     auto loc = location_.wlock();
@@ -257,7 +273,7 @@ std::unique_ptr<InodeBase> InodeBase::markUnlinked(
   // Grab the inode map lock, and check if we should unload
   // ourself immediately.
   auto* inodeMap = getMount()->getInodeMap();
-  auto inodeMapLock = inodeMap->lockForUnload();
+  auto inodeMapLock = inodeMap->lockForUnload(getNodeId());
   if (isPtrAcquireCountZero() && getFuseRefcount() == 0) {
     inodeMap->unloadInode(this, parent, name, true, inodeMapLock);
     // We have to delete ourself now.
@@ -285,9 +301,26 @@ void InodeBase::updateLocation(
     TreeInodePtr newParent,
     PathComponentPiece newName,
     const RenameLock& renameLock) {
+  DCHECK(renameLock.isHeld(mount_));
+  updateLocationImpl(std::move(newParent), newName);
+  mount_->invalidatePathInodeCache(renameLock);
+}
+
+void InodeBase::updateLocation(
+    TreeInodePtr newParent,
+    PathComponentPiece newName,
+    const SharedRenameLock& renameLock) {
+  DCHECK(renameLock.isHeld(mount_));
+  DCHECK_EQ(newParent.get(), location_.rlock()->parent.get());
+  updateLocationImpl(std::move(newParent), newName);
+  mount_->invalidatePathInodeCache(renameLock);
+}
+
+void InodeBase::updateLocationImpl(
+    TreeInodePtr newParent,
+    PathComponentPiece newName) {
   XLOG(DBG5) << "inode " << this << " renamed: " << getLogPath() << " --> "
              << newParent->getLogPath() << " / \"" << newName << "\"";
-  DCHECK(renameLock.isHeld(mount_));
   DCHECK_EQ(mount_, newParent->mount_);
 
   auto loc = location_.wlock();
@@ -314,7 +347,7 @@ void InodeBase::onPtrRefZero() const {
 }
 
 ParentInodeInfo InodeBase::getParentInfo() const {
-  using ParentContentsPtr = folly::Synchronized<TreeInodeState>::LockedPtr;
+  using ParentContentsPtr = SynchronizedTreeInodeState::LockedPtr;
 
   // Grab our parent's contents_ lock.
   //
@@ -203,6 +203,16 @@ class InodeBase {
       PathComponentPiece name,
       const RenameLock& renameLock);
 
+  /**
+   * A variant of markUnlinked() for renames within a single directory, which
+   * only hold the rename lock in shared mode.  The caller must also hold the
+   * parent's directory rename lock (see EdenMount::acquireDirectoryRenameLock).
+   */
+  std::unique_ptr<InodeBase> markUnlinked(
+      TreeInode* parent,
+      PathComponentPiece name,
+      const SharedRenameLock& renameLock);
+
   /**
    * This method should only be called by TreeInode::loadUnlinkedChildInode().
    * Its purpose is to set the unlinked flag to true for inodes that have
@@ -221,6 +231,15 @@ class InodeBase {
       PathComponentPiece newName,
       const RenameLock& renameLock);
 
+  /**
+   * A variant of updateLocation() for renames within a single directory, where
+   * newParent must be the current parent.
+   */
+  void updateLocation(
+      TreeInodePtr newParent,
+      PathComponentPiece newName,
+      const SharedRenameLock& renameLock);
+
   /**
    * Check to see if the ptrAcquire reference count is zero.
    *
@@ -286,6 +305,20 @@ class InodeBase {
     return numFuseReferences_.load(std::memory_order_acquire);
   }
 
+  /**
+   * Returns true if the kernel holds a reference to this inode, and so may
+   * have cached a directory entry for it, or entries of its children.
+   *
+   * Like debugGetFuseRefcount() this can change as soon as it returns.  It
+   * may still be used to skip cache invalidations: the count is incremented
+   * before a FUSE reply hands the inode to the kernel, so an inode with no
+   * references can only become known to the kernel through a later lookup,
+   * which sees the updated state.
+   */
+  bool isReferencedByKernel() const {
+    return numFuseReferences_.load(std::memory_order_acquire) > 0;
+  }
+
   /**
    * Set the FUSE reference count.
    *
@@ -358,6 +391,16 @@ class InodeBase {
     return *loc;
   }
 
+  /**
+   * Returns this inode's location at this exact point in time.  As with
+   * getParentRacy(), it may change as soon as this returns unless the rename
+   * lock is held, so it must only be used for hints.
+   */
+  LocationInfo getLocationInfoRacy() const {
+    auto loc = location_.rlock();
+    return *loc;
+  }
+
   /**
    * Acquire this inode's contents lock and return its metadata.
    */
@@ -399,6 +442,13 @@ class InodeBase {
   bool getPathHelper(std::vector<PathComponent>& names, bool stopOnUnlinked)
       const;
 
+  // The implementations of markUnlinked() and updateLocation(), once the
+  // caller's rename lock has been checked.
+  std::unique_ptr<InodeBase> markUnlinkedImpl(
+      TreeInode* parent,
+      PathComponentPiece name);
+  void updateLocationImpl(TreeInodePtr newParent, PathComponentPiece newName);
+
   // incrementPtrRef() is called by InodePtr whenever an InodePtr is copied.
   void incrementPtrRef() const {
     auto prevValue = ptrRefcount_.fetch_add(1, std::memory_order_acq_rel);
@@ -581,12 +631,12 @@ class InodeBaseMetadata : public InodeBase {
 
   /**
    * Helper function to set the atime of this inode. The inode's state lock must
-   * be held.
+   * be held, in either shared or exclusive mode.
    *
    * Note that FUSE doesn't claim to fully implement atime.
    * https://sourceforge.net/p/fuse/mailman/message/34448996/
    */
-  void updateAtimeLocked(InodeState&) {
+  void updateAtimeLocked(const InodeState&) {
     return InodeBase::updateAtime();
   }
 
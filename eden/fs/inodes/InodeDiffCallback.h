@@ -44,6 +44,28 @@ class InodeDiffCallback {
   virtual void diffError(
       RelativePathPiece path,
       const folly::exception_wrapper& ew) = 0;
+
+  /**
+   * Returns true if the caller no longer wants the results of this diff.
+   *
+   * The diff checks this before descending into each directory, and stops
+   * early (reporting only some of the differences) once it returns true.
+   */
+  virtual bool isCancelled() const {
+    return false;
+  }
+
+  /**
+   * Returns false to skip the entry at path without reporting it, and
+   * without loading or reporting anything under it if it is a directory.
+   *
+   * This only prunes the diff: it may still report some paths for which
+   * this returns false, so callbacks that filter must also check the paths
+   * they are given.
+   */
+  virtual bool shouldDiff(RelativePathPiece /* path */) const {
+    return true;
+  }
 };
 } // namespace eden
 } // namespace facebook
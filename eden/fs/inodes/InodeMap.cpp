@@ -13,14 +13,20 @@
 #include <folly/Exception.h>
 #include <folly/Likely.h>
 #include <folly/logging/xlog.h>
+#include <algorithm>
 
+#include "eden/fs/fuse/RequestData.h"
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/FileInode.h"
 #include "eden/fs/inodes/Overlay.h"
 #include "eden/fs/inodes/ParentInodeInfo.h"
 #include "eden/fs/inodes/TreeInode.h"
 #include "eden/fs/service/ThriftUtil.h"
+#include "eden/fs/takeover/UnloadedInodeTable.h"
 #include "eden/fs/utils/Bug.h"
+#include "eden/fs/utils/CycleClock.h"
+#include "eden/fs/utils/TraceBuffer.h"
+#include "eden/fs/utils/UnboundedQueueExecutor.h"
 
 using folly::Future;
 using folly::Optional;
@@ -107,8 +113,10 @@ InodeMap::~InodeMap() {
   // destroy the EdenMount.
 }
 
+constexpr size_t InodeMap::kNumShards;
+
 void InodeMap::initialize(TreeInodePtr root) {
-  auto data = data_.wlock();
+  auto data = getShard(kRootNodeId).wlock();
   CHECK(!root_);
   root_ = std::move(root);
   auto ret = data->loadedInodes_.emplace(kRootNodeId, root_.get());
@@ -118,39 +126,34 @@ void InodeMap::initialize(TreeInodePtr root) {
 void InodeMap::initializeFromTakeover(
     TreeInodePtr root,
     const SerializedInodeMap& takeover) {
-  auto data = data_.wlock();
-
-  CHECK_EQ(data->loadedInodes_.size(), 0)
+  CHECK_EQ(getLoadedInodeCount(), 0)
       << "cannot load InodeMap data over a populated instance";
-  CHECK_EQ(data->unloadedInodes_.size(), 0)
+  CHECK_EQ(getUnloadedInodeCount(), 0)
       << "cannot load InodeMap data over a populated instance";
 
   CHECK(!root_);
   root_ = std::move(root);
-  auto ret = data->loadedInodes_.emplace(kRootNodeId, root_.get());
+  auto ret = getShard(kRootNodeId).wlock()->loadedInodes_.emplace(
+      kRootNodeId, root_.get());
   CHECK(ret.second);
-  for (const auto& entry : takeover.unloadedInodes) {
-    if (entry.numFuseReferences < 0) {
-      auto message = folly::to<std::string>(
-          "inode number ",
-          entry.inodeNumber,
-          " has a negative numFuseReferences number");
-      XLOG(ERR) << message;
-      throw std::runtime_error(message);
-    }
 
-    auto unloadedEntry = UnloadedInode(
-        InodeNumber::fromThrift(entry.inodeNumber),
-        InodeNumber::fromThrift(entry.parentInode),
-        PathComponentPiece{entry.name},
-        entry.isUnlinked,
-        entry.mode,
-        entry.hash.empty() ? Optional<Hash>{folly::none}
-                           : Optional<Hash>{hashFromThrift(entry.hash)},
-        entry.numFuseReferences);
-
-    auto result = data->unloadedInodes_.emplace(
-        InodeNumber::fromThrift(entry.inodeNumber), std::move(unloadedEntry));
+  if (!takeover.unloadedInodeTablePath.empty()) {
+    // The previous process sorted the table, so there is nothing to check
+    // until each record is used.
+    takeoverInodes_ = UnloadedInodeTable::open(
+        AbsolutePathPiece{takeover.unloadedInodeTablePath});
+    auto count = takeoverInodes_->size();
+    takeoverInodeMoved_ = std::make_unique<bool[]>(count);
+    takeoverInodesRemaining_.store(count, std::memory_order_release);
+    XLOG(DBG2) << "InodeMap initialized mount " << mount_->getPath()
+               << " from takeover, " << count
+               << " inodes mapped from " << takeover.unloadedInodeTablePath;
+  }
+
+  for (const auto& entry : takeover.unloadedInodes) {
+    auto number = InodeNumber::fromThrift(entry.inodeNumber);
+    auto result = getShard(number).wlock()->unloadedInodes_.emplace(
+        number, deserializeUnloadedInode(entry));
     if (!result.second) {
       auto message = folly::to<std::string>(
           "failed to emplace inode number ",
@@ -162,17 +165,116 @@ void InodeMap::initializeFromTakeover(
   }
 
   XLOG(DBG2) << "InodeMap initialized mount " << mount_->getPath()
-             << " from takeover, " << data->unloadedInodes_.size()
+             << " from takeover, " << takeover.unloadedInodes.size()
              << " inodes registered";
 }
 
+InodeMap::UnloadedInode InodeMap::deserializeUnloadedInode(
+    const SerializedInodeMapEntry& entry) {
+  if (entry.numFuseReferences < 0) {
+    auto message = folly::to<std::string>(
+        "inode number ",
+        entry.inodeNumber,
+        " has a negative numFuseReferences number");
+    XLOG(ERR) << message;
+    throw std::runtime_error(message);
+  }
+
+  return UnloadedInode(
+      InodeNumber::fromThrift(entry.inodeNumber),
+      InodeNumber::fromThrift(entry.parentInode),
+      PathComponentPiece{entry.name},
+      entry.isUnlinked,
+      entry.mode,
+      entry.hash.empty() ? Optional<Hash>{folly::none}
+                         : Optional<Hash>{hashFromThrift(entry.hash)},
+      entry.numFuseReferences);
+}
+
+Optional<size_t> InodeMap::findTakeoverInode(InodeNumber number) const {
+  if (!takeoverInodes_ ||
+      takeoverInodesRemaining_.load(std::memory_order_acquire) == 0) {
+    return folly::none;
+  }
+  auto index = takeoverInodes_->find(number.get());
+  if (!index || takeoverInodeMoved_[*index]) {
+    return folly::none;
+  }
+  return index;
+}
+
+InodeMap::UnloadedInode* InodeMap::findUnloadedInode(
+    Shard& shard,
+    InodeNumber number) {
+  auto iter = shard.unloadedInodes_.find(number);
+  if (iter != shard.unloadedInodes_.end()) {
+    return &iter->second;
+  }
+
+  auto index = findTakeoverInode(number);
+  if (!index) {
+    return nullptr;
+  }
+  auto ret = shard.unloadedInodes_.emplace(
+      number, deserializeUnloadedInode(takeoverInodes_->getEntry(*index)));
+  DCHECK(ret.second);
+  takeoverInodeMoved_[*index] = true;
+  takeoverInodesRemaining_.fetch_sub(1, std::memory_order_acq_rel);
+  XLOG(DBG5) << "moved inode " << number << " from the takeover table";
+  return &ret.first->second;
+}
+
+const InodeMap::UnloadedInode* InodeMap::findUnloadedInode(
+    const Shard& shard,
+    InodeNumber number,
+    Optional<UnloadedInode>& storage) const {
+  auto iter = shard.unloadedInodes_.find(number);
+  if (iter != shard.unloadedInodes_.end()) {
+    return &iter->second;
+  }
+
+  auto index = findTakeoverInode(number);
+  if (!index) {
+    return nullptr;
+  }
+  storage.emplace(deserializeUnloadedInode(takeoverInodes_->getEntry(*index)));
+  return storage.get_pointer();
+}
+
+bool InodeMap::isUnloadedInodeKnown(const Shard& shard, InodeNumber number)
+    const {
+  return shard.unloadedInodes_.count(number) > 0 ||
+      findTakeoverInode(number).hasValue();
+}
+
 Future<InodePtr> InodeMap::lookupInode(InodeNumber number) {
+  auto& shard = getShard(number);
+
+  // Most lookups are for inodes that are already loaded, so check for that
+  // with only a shared lock on the shard first.
+  {
+    auto data = shard.rlock();
+    auto loadedIter = data->loadedInodes_.find(number);
+    if (loadedIter != data->loadedInodes_.end()) {
+      auto result = loadedIter->second.getPtr();
+      data.unlock();
+      return folly::makeFuture<InodePtr>(std::move(result));
+    }
+  }
+
+  auto loadStart = CycleClock::now();
+  return RequestData::timeInodeLoad(loadInode(number), loadStart);
+}
+
+Future<InodePtr> InodeMap::loadInode(InodeNumber number) {
+  auto& shard = getShard(number);
+
   // Lock the data.
   // We hold it while doing most of our work below, but explicitly unlock it
   // before triggering inode loading or before fulfilling any Promises.
-  auto data = data_.wlock();
+  auto data = shard.wlock();
 
-  // Check to see if this Inode is already loaded
+  // Check again, in case the inode finished loading after we checked above.
   auto loadedIter = data->loadedInodes_.find(number);
   if (loadedIter != data->loadedInodes_.end()) {
     // Make a copy of the InodePtr with the lock held, then release the lock
@@ -186,8 +288,8 @@ Future<InodePtr> InodeMap::lookupInode(InodeNumber number) {
   }
 
   // Look up the data in the unloadedInodes_ map.
-  auto unloadedIter = data->unloadedInodes_.find(number);
-  if (UNLIKELY(unloadedIter == data->unloadedInodes_.end())) {
+  auto* unloadedData = findUnloadedInode(*data, number);
+  if (UNLIKELY(!unloadedData)) {
     // This generally shouldn't happen.  If a InodeNumber has been allocated we
     // should always know about it.  It's a bug if our caller calls us with an
     // invalid InodeNumber number.
@@ -197,7 +299,6 @@ Future<InodePtr> InodeMap::lookupInode(InodeNumber number) {
   }
 
   // Check to see if anyone else has already started loading this inode.
-  auto* unloadedData = &unloadedIter->second;
   bool alreadyLoading = !unloadedData->promises.empty();
 
   // Add a new entry to the promises list.
@@ -221,25 +322,32 @@ Future<InodePtr> InodeMap::lookupInode(InodeNumber number) {
   // (It might have been simpler to recursively call lookupInode() to get the
   // parent, but that would require releasing and re-acquiring the lock more
   // than necessary.)
+  //
+  // The parent is usually in a different shard, so we copy what we need from
+  // the child's entry and release its shard before locking the parent's.
+  // Nobody else will start loading the child in the meantime, since we have
+  // already added the first promise for it.
   auto childInodeNumber = number;
   while (true) {
+    const auto parentNumber = unloadedData->parent;
+    PathComponent childName = unloadedData->name;
+    const bool isUnlinked = unloadedData->isUnlinked;
+    const auto optionalHash = unloadedData->hash;
+    const auto mode = unloadedData->mode;
+    data.unlock();
+    data = getShard(parentNumber).wlock();
+
     // Check to see if this parent is loaded
-    loadedIter = data->loadedInodes_.find(unloadedData->parent);
+    loadedIter = data->loadedInodes_.find(parentNumber);
     if (loadedIter != data->loadedInodes_.end()) {
       // We found a loaded parent.
-      // Grab copies of the arguments we need for startChildLookup(),
-      // with the lock still held.
       InodePtr firstLoadedParent = loadedIter->second.getPtr();
-      PathComponent requiredChildName = unloadedData->name;
-      bool isUnlinked = unloadedData->isUnlinked;
-      auto optionalHash = unloadedData->hash;
-      auto mode = unloadedData->mode;
       // Unlock the data before starting the child lookup
       data.unlock();
       // Trigger the lookup, then return to our caller.
       startChildLookup(
           firstLoadedParent,
-          requiredChildName,
+          childName,
           isUnlinked,
           childInodeNumber,
           optionalHash,
@@ -248,19 +356,18 @@ Future<InodePtr> InodeMap::lookupInode(InodeNumber number) {
     }
 
     // Look up the parent in unloadedInodes_
-    unloadedIter = data->unloadedInodes_.find(unloadedData->parent);
-    if (UNLIKELY(unloadedIter == data->unloadedInodes_.end())) {
+    auto* parentData = findUnloadedInode(*data, parentNumber);
+    if (UNLIKELY(!parentData)) {
       // This shouldn't happen.  We must know about the parent inode number if
       // we knew about the child.
-      auto bug = EDEN_BUG() << "unknown parent inode " << unloadedData->parent
-                            << " (of " << unloadedData->name << ")";
+      auto bug = EDEN_BUG() << "unknown parent inode " << parentNumber
+                            << " (of " << childName << ")";
       // Unlock our data before calling inodeLoadFailed()
       data.unlock();
       inodeLoadFailed(childInodeNumber, bug.toException());
       return result;
     }
 
-    auto* parentData = &unloadedIter->second;
     alreadyLoading = !parentData->promises.empty();
 
     // Add a new entry to the promises list.
@@ -269,11 +376,11 @@ Future<InodePtr> InodeMap::lookupInode(InodeNumber number) {
     parentData->promises.emplace_back();
     setupParentLookupPromise(
         parentData->promises.back(),
-        unloadedData->name,
-        unloadedData->isUnlinked,
+        childName,
+        isUnlinked,
         childInodeNumber,
-        unloadedData->hash,
-        unloadedData->mode);
+        optionalHash,
+        mode);
 
     if (alreadyLoading) {
       // This parent is already being loaded.
@@ -282,7 +389,7 @@ Future<InodePtr> InodeMap::lookupInode(InodeNumber number) {
     }
 
     // Continue around the loop to look up our parent's parent
-    childInodeNumber = unloadedData->parent;
+    childInodeNumber = parentNumber;
     unloadedData = parentData;
   }
 }
@@ -346,10 +453,12 @@ InodeMap::PromiseVector InodeMap::inodeLoadComplete(InodeBase* inode) {
   auto number = inode->getNodeId();
   XLOG(DBG5) << "successfully loaded inode " << number << ": "
              << inode->getLogPath();
+  TraceBuffer::record(
+      TraceEventKind::INODE_LOAD, TracePhase::END, number.get());
 
   PromiseVector promises;
   try {
-    auto data = data_.wlock();
+    auto data = getShard(number).wlock();
     auto it = data->unloadedInodes_.find(number);
     CHECK(it != data->unloadedInodes_.end())
         << "failed to find unloaded inode data when finishing load of inode "
@@ -378,6 +487,8 @@ void InodeMap::inodeLoadFailed(
     const folly::exception_wrapper& ex) {
   XLOG(ERR) << "failed to load inode " << number << ": "
             << folly::exceptionStr(ex);
+  TraceBuffer::record(
+      TraceEventKind::INODE_LOAD, TracePhase::END, number.get());
   auto promises = extractPendingPromises(number);
   for (auto& promise : promises) {
     promise.setException(ex);
@@ -387,7 +498,7 @@ void InodeMap::inodeLoadFailed(
 InodeMap::PromiseVector InodeMap::extractPendingPromises(InodeNumber number) {
   PromiseVector promises;
   {
-    auto data = data_.wlock();
+    auto data = getShard(number).wlock();
     auto it = data->unloadedInodes_.find(number);
     CHECK(it != data->unloadedInodes_.end())
         << "failed to find unloaded inode data when finishing load of inode "
@@ -408,7 +519,7 @@ Future<FileInodePtr> InodeMap::lookupFileInode(InodeNumber number) {
 }
 
 InodePtr InodeMap::lookupLoadedInode(InodeNumber number) {
-  auto data = data_.rlock();
+  auto data = getShard(number).rlock();
   auto it = data->loadedInodes_.find(number);
   if (it == data->loadedInodes_.end()) {
     return nullptr;
@@ -433,9 +544,10 @@ FileInodePtr InodeMap::lookupLoadedFile(InodeNumber number) {
 }
 
 UnloadedInodeData InodeMap::lookupUnloadedInode(InodeNumber number) {
-  auto data = data_.rlock();
-  auto it = data->unloadedInodes_.find(number);
-  if (it == data->unloadedInodes_.end()) {
+  auto data = getShard(number).rlock();
+  Optional<UnloadedInode> storage;
+  auto* unloaded = findUnloadedInode(*data, number, storage);
+  if (!unloaded) {
     // This generally shouldn't happen.  If a InodeNumber has been allocated we
     // should always know about it.  It's a bug if our caller calls us with an
     // invalid InodeNumber number.
@@ -443,49 +555,57 @@ UnloadedInodeData InodeMap::lookupUnloadedInode(InodeNumber number) {
     throwSystemErrorExplicit(EINVAL, "unknown inode number ", number);
   }
 
-  return UnloadedInodeData(it->second.parent, it->second.name);
+  return UnloadedInodeData(unloaded->parent, unloaded->name);
 }
 
 folly::Optional<RelativePath> InodeMap::getPathForInode(
     InodeNumber inodeNumber) {
-  auto data = data_.rlock();
-  return getPathForInodeHelper(inodeNumber, data);
-}
+  // Collect the names of the unloaded inodes from the bottom up, locking one
+  // shard at a time, until we reach the root or a loaded inode.
+  std::vector<PathComponent> names;
+  folly::Optional<RelativePath> loadedPath;
+  auto number = inodeNumber;
+  while (number != kRootNodeId) {
+    auto data = getShard(number).rlock();
+    auto loadedIt = data->loadedInodes_.find(number);
+    if (loadedIt != data->loadedInodes_.cend()) {
+      // If the inode is loaded, use its RelativePath
+      loadedPath = loadedIt->second->getPath();
+      if (!loadedPath) {
+        if (names.empty()) {
+          return folly::none;
+        }
+        EDEN_BUG() << "unlinked parent inode " << number
+                   << "appears to contain non-unlinked child " << inodeNumber;
+      }
+      break;
+    }
 
-folly::Optional<RelativePath> InodeMap::getPathForInodeHelper(
-    InodeNumber inodeNumber,
-    const folly::Synchronized<Members>::ConstLockedPtr& data) {
-  auto loadedIt = data->loadedInodes_.find(inodeNumber);
-  if (loadedIt != data->loadedInodes_.cend()) {
-    // If the inode is loaded, return its RelativePath
-    return loadedIt->second->getPath();
-  } else {
-    auto unloadedIt = data->unloadedInodes_.find(inodeNumber);
-    if (unloadedIt != data->unloadedInodes_.cend()) {
-      if (unloadedIt->second.isUnlinked) {
+    Optional<UnloadedInode> storage;
+    auto* unloaded = findUnloadedInode(*data, number, storage);
+    if (!unloaded) {
+      throwSystemErrorExplicit(EINVAL, "unknown inode number ", number);
+    }
+    if (unloaded->isUnlinked) {
+      if (names.empty()) {
         return folly::none;
       }
-      // If the inode is not loaded, return its parent's path as long as it's
-      // parent isn't the root
-      auto parent = unloadedIt->second.parent;
-      if (parent == kRootNodeId) {
-        // The parent is the Eden mount root, just return its name (base case)
-        return RelativePath(unloadedIt->second.name);
-      }
-      auto dir = getPathForInodeHelper(parent, data);
-      if (!dir) {
-        EDEN_BUG() << "unlinked parent inode " << parent
-                   << "appears to contain non-unlinked child " << inodeNumber;
-      }
-      return *dir + unloadedIt->second.name;
-    } else {
-      throwSystemErrorExplicit(EINVAL, "unknown inode number ", inodeNumber);
+      EDEN_BUG() << "unlinked parent inode " << number
+                 << "appears to contain non-unlinked child " << inodeNumber;
     }
+    names.push_back(unloaded->name);
+    number = unloaded->parent;
   }
+
+  auto path = loadedPath ? std::move(loadedPath).value() : RelativePath{};
+  for (auto it = names.rbegin(); it != names.rend(); ++it) {
+    path = path + *it;
+  }
+  return path;
 }
 
 void InodeMap::decFuseRefcount(InodeNumber number, uint32_t count) {
-  auto data = data_.wlock();
+  auto data = getShard(number).wlock();
 
   // First check in the loaded inode map
   auto loadedIter = data->loadedInodes_.find(number);
@@ -505,45 +625,96 @@ void InodeMap::decFuseRefcount(InodeNumber number, uint32_t count) {
   }
 
   // If it wasn't loaded, it should be in the unloaded map
-  auto unloadedIter = data->unloadedInodes_.find(number);
-  if (UNLIKELY(unloadedIter == data->unloadedInodes_.end())) {
+  decUnloadedFuseRefcount(*data, number, count);
+}
+
+void InodeMap::decFuseRefcounts(folly::Range<const InodeForget*> decrements) {
+  // Visit the batch one shard at a time, so that each shard lock is
+  // acquired once no matter how many of its inodes the batch names.
+  std::vector<const InodeForget*> byShard;
+  byShard.reserve(decrements.size());
+  for (const auto& decrement : decrements) {
+    byShard.push_back(&decrement);
+  }
+  std::stable_sort(
+      byShard.begin(),
+      byShard.end(),
+      [](const InodeForget* a, const InodeForget* b) {
+        return getShardIndex(a->first) < getShardIndex(b->first);
+      });
+
+  std::vector<std::pair<InodePtr, uint32_t>> loaded;
+  auto iter = byShard.begin();
+  while (iter != byShard.end()) {
+    auto shardIndex = getShardIndex((*iter)->first);
+    auto data = shards_[shardIndex].wlock();
+    for (; iter != byShard.end() && getShardIndex((*iter)->first) == shardIndex;
+         ++iter) {
+      auto number = (*iter)->first;
+      auto count = (*iter)->second;
+      auto loadedIter = data->loadedInodes_.find(number);
+      if (loadedIter != data->loadedInodes_.end()) {
+        // As in decFuseRefcount(), hold a pointer reference across the
+        // decrement so that onInodeUnreferenced() is processed afterwards.
+        loaded.emplace_back(loadedIter->second.getPtr(), count);
+      } else {
+        decUnloadedFuseRefcount(*data, number, count);
+      }
+    }
+  }
+
+  if (loaded.empty()) {
+    return;
+  }
+  for (const auto& entry : loaded) {
+    entry.first->decFuseRefcount(entry.second);
+  }
+  // Releasing these pointers may unload the inodes, which locks their parents
+  // and the InodeMap again.  Leave that to the background pool so that a
+  // forget storm does not hold up the FUSE threads serving lookups.
+  mount_->getBackgroundThreadPool()->add(
+      [inodes = std::move(loaded)]() mutable { inodes.clear(); });
+}
+
+void InodeMap::decUnloadedFuseRefcount(
+    Shard& shard,
+    InodeNumber number,
+    uint32_t count) {
+  auto* unloadedData = findUnloadedInode(shard, number);
+  if (UNLIKELY(!unloadedData)) {
     EDEN_BUG() << "InodeMap::decFuseRefcount() called on unknown inode number "
                << number;
   }
 
   // Decrement the reference count in the unloaded entry
-  auto& unloadedEntry = unloadedIter->second;
+  auto& unloadedEntry = *unloadedData;
   CHECK_GE(unloadedEntry.numFuseReferences, count);
   unloadedEntry.numFuseReferences -= count;
   if (unloadedEntry.numFuseReferences <= 0) {
     // We can completely forget about this unloaded inode now.
     XLOG(DBG5) << "forgetting unloaded inode " << number << ": "
                << unloadedEntry.parent << ":" << unloadedEntry.name;
-    data->unloadedInodes_.erase(unloadedIter);
+    shard.unloadedInodes_.erase(number);
   }
 }
 
 void InodeMap::setUnmounted() {
-  auto data = data_.wlock();
-  DCHECK(!data->isUnmounted_);
-  data->isUnmounted_ = true;
+  auto wasUnmounted = isUnmounted_.exchange(true, std::memory_order_acq_rel);
+  DCHECK(!wasUnmounted);
 }
 
 Future<SerializedInodeMap> InodeMap::shutdown(bool doTakeover) {
   // Record that we are in the process of shutting down.
-  auto future = Future<folly::Unit>::makeEmpty();
-  {
-    auto data = data_.wlock();
-    CHECK(!data->shutdownPromise.hasValue())
-        << "shutdown() invoked more than once on InodeMap for "
-        << mount_->getPath();
-    data->shutdownPromise.assign(Promise<Unit>{});
-    future = data->shutdownPromise->getFuture();
+  auto wasShuttingDown =
+      isShuttingDown_.exchange(true, std::memory_order_acq_rel);
+  CHECK(!wasShuttingDown)
+      << "shutdown() invoked more than once on InodeMap for "
+      << mount_->getPath();
+  auto future = shutdownPromise_.getFuture();
 
-    XLOG(DBG3) << "starting InodeMap::shutdown: loadedCount="
-               << data->loadedInodes_.size()
-               << " unloadedCount=" << data->unloadedInodes_.size();
-  }
+  XLOG(DBG3) << "starting InodeMap::shutdown: loadedCount="
+             << getLoadedInodeCount()
+             << " unloadedCount=" << getUnloadedInodeCount();
 
   // Walk from the root of the tree down, finding all unreferenced inodes,
   // and immediately destroy them.
@@ -572,19 +743,20 @@ Future<SerializedInodeMap> InodeMap::shutdown(bool doTakeover) {
     // to them, then let the normal pointer release process be responsible for
     // unloading them.
     std::vector<InodePtr> inodesToUnload;
-    auto data = data_.wlock();
-    for (const auto& entry : data->loadedInodes_) {
-      if (!entry.second->isPtrAcquireCountZero()) {
-        continue;
-      }
-      if (!entry.second->isUnlinked()) {
-        continue;
+    for (auto& shard : shards_) {
+      auto data = shard.wlock();
+      for (const auto& entry : data->loadedInodes_) {
+        if (!entry.second->isPtrAcquireCountZero()) {
+          continue;
+        }
+        if (!entry.second->isUnlinked()) {
+          continue;
+        }
+        inodesToUnload.push_back(entry.second.getPtr());
       }
-      inodesToUnload.push_back(entry.second.getPtr());
     }
-    // Release the lock, then release all of our InodePtrs to unload
-    // the inodes.
-    data.unlock();
+    // Release all of our InodePtrs to unload the inodes, without holding any
+    // shard locks.
     inodesToUnload.clear();
   }
 
@@ -600,45 +772,58 @@ Future<SerializedInodeMap> InodeMap::shutdown(bool doTakeover) {
     if (!doTakeover) {
       return SerializedInodeMap{};
     }
-    auto data = data_.wlock();
+    const auto loadedCount = getLoadedInodeCount();
+    const auto unloadedCount = getUnloadedInodeCount();
     XLOG(DBG3)
         << "InodeMap::shutdown after releasing inodesToClear: loadedCount="
-        << data->loadedInodes_.size()
-        << " unloadedCount=" << data->unloadedInodes_.size();
+        << loadedCount << " unloadedCount=" << unloadedCount;
 
-    if (data->loadedInodes_.size() != 1) {
-      EDEN_BUG() << "After InodeMap::shutdown() finished, "
-                 << data->loadedInodes_.size()
+    if (loadedCount != 1) {
+      EDEN_BUG() << "After InodeMap::shutdown() finished, " << loadedCount
                  << " inodes still loaded; they must all (except the root) "
                  << "have been unloaded for this to succeed!";
     }
 
     SerializedInodeMap result;
-    result.unloadedInodes.reserve(data->unloadedInodes_.size());
-    for (const auto& it : data->unloadedInodes_) {
-      const auto& entry = it.second;
-      SerializedInodeMapEntry serializedEntry;
-
-      XLOG(DBG5) << "  serializing unloaded inode " << entry.number.get()
-                 << " parent=" << entry.parent.get() << " name=" << entry.name;
-
-      serializedEntry.inodeNumber = entry.number.get();
-      serializedEntry.parentInode = entry.parent.get();
-      serializedEntry.name = entry.name.stringPiece().str();
-      serializedEntry.isUnlinked = entry.isUnlinked;
-      serializedEntry.numFuseReferences = entry.numFuseReferences;
-      serializedEntry.hash = thriftHash(entry.hash);
-      serializedEntry.mode = entry.mode;
-
-      result.unloadedInodes.emplace_back(std::move(serializedEntry));
+    result.unloadedInodes.reserve(unloadedCount);
+    for (auto& shard : shards_) {
+      auto data = shard.rlock();
+      for (const auto& it : data->unloadedInodes_) {
+        const auto& entry = it.second;
+        SerializedInodeMapEntry serializedEntry;
+
+        XLOG(DBG5) << "  serializing unloaded inode " << entry.number.get()
+                   << " parent=" << entry.parent.get()
+                   << " name=" << entry.name;
+
+        serializedEntry.inodeNumber = entry.number.get();
+        serializedEntry.parentInode = entry.parent.get();
+        serializedEntry.name = entry.name.stringPiece().str();
+        serializedEntry.isUnlinked = entry.isUnlinked;
+        serializedEntry.numFuseReferences = entry.numFuseReferences;
+        serializedEntry.hash = thriftHash(entry.hash);
+        serializedEntry.mode = entry.mode;
+
+        result.unloadedInodes.emplace_back(std::move(serializedEntry));
+      }
+    }
+
+    // Nothing else can touch the map now, so pass on any records from our
+    // own takeover that were never used without taking the shard locks.
+    if (takeoverInodes_) {
+      for (size_t index = 0; index < takeoverInodes_->size(); ++index) {
+        if (!takeoverInodeMoved_[index]) {
+          result.unloadedInodes.emplace_back(
+              takeoverInodes_->getEntry(index));
+        }
+      }
     }
 
     return result;
   });
 }
 
-void InodeMap::shutdownComplete(
-    folly::Synchronized<Members>::LockedPtr&& data) {
+void InodeMap::shutdownComplete(ShardLock&& rootShard) {
   // We manually dropped our reference count to the root inode in
   // beginShutdown().  Destroy it now, and call resetNoDecRef() on our pointer
   // to make sure it doesn't try to decrement the reference count again when
@@ -646,16 +831,15 @@ void InodeMap::shutdownComplete(
   delete root_.get();
   root_.resetNoDecRef();
 
-  // Unlock data_ before fulfilling the shutdown promise, just in case the
-  // promise invokes a callback that calls some of our other methods that
-  // may need to acquire this lock.
-  auto* shutdownPromise = &data->shutdownPromise.value();
-  data.unlock();
-  shutdownPromise->setValue();
+  // Unlock the root's shard before fulfilling the shutdown promise, just in
+  // case the promise invokes a callback that calls some of our other methods
+  // that may need to acquire this lock.
+  rootShard.unlock();
+  shutdownPromise_.setValue();
 }
 
 bool InodeMap::isInodeRemembered(InodeNumber ino) const {
-  return data_.rlock()->unloadedInodes_.count(ino) > 0;
+  return isUnloadedInodeKnown(*getShard(ino).rlock(), ino);
 }
 
 void InodeMap::onInodeUnreferenced(
@@ -664,7 +848,7 @@ void InodeMap::onInodeUnreferenced(
   XLOG(DBG5) << "inode " << inode->getNodeId()
              << " unreferenced: " << inode->getLogPath();
   // Acquire our lock.
-  auto data = data_.wlock();
+  auto data = getShard(inode->getNodeId()).wlock();
 
   // Decrement the Inode's acquire count
   auto acquireCount = inode->decPtrAcquireCount();
@@ -676,7 +860,7 @@ void InodeMap::onInodeUnreferenced(
 
   // Decide if we should unload the inode now, or wait until later.
   bool unloadNow = false;
-  bool shuttingDown = data->shutdownPromise.hasValue();
+  bool shuttingDown = isShuttingDown_.load(std::memory_order_acquire);
   DCHECK(shuttingDown || inode != root_.get());
   if (shuttingDown) {
     // Check to see if this was the root inode that got unloaded.
@@ -700,13 +884,15 @@ void InodeMap::onInodeUnreferenced(
     //   For now we choose to always keep it loaded.
   }
 
+  InodeMapLock lock;
+  lock.shards_[getShardIndex(inode->getNodeId())] = std::move(data);
   if (unloadNow) {
     unloadInode(
         inode,
         parentInfo.getParent().get(),
         parentInfo.getName(),
         parentInfo.isUnlinked(),
-        data);
+        lock);
     if (!parentInfo.isUnlinked()) {
       const auto& parentContents = parentInfo.getParentContents();
       auto it = parentContents->entries.find(parentInfo.getName());
@@ -720,7 +906,7 @@ void InodeMap::onInodeUnreferenced(
   // Deleting it may cause its parent TreeInode to become unreferenced, causing
   // another recursive call to onInodeUnreferenced(), which will need to
   // reacquire the lock.
-  data.unlock();
+  lock.unlock();
   parentInfo.reset();
   if (unloadNow) {
     delete inode;
@@ -728,7 +914,42 @@ void InodeMap::onInodeUnreferenced(
 }
 
 InodeMapLock InodeMap::lockForUnload() {
-  return InodeMapLock{data_.wlock()};
+  InodeMapLock lock;
+  // Acquire the shards in index order, as required by our lock hierarchy.
+  for (size_t idx = 0; idx < kNumShards; ++idx) {
+    lock.shards_[idx] = shards_[idx].wlock();
+  }
+  return lock;
+}
+
+InodeMapLock InodeMap::lockForUnload(InodeNumber number) {
+  InodeMapLock lock;
+  lock.shards_[getShardIndex(number)] = getShard(number).wlock();
+  return lock;
+}
+
+bool InodeMap::isRememberedForUnload(
+    InodeNumber number,
+    const InodeMapLock& lock) {
+  const auto idx = getShardIndex(number);
+  if (lock.shards_[idx]) {
+    return isUnloadedInodeKnown(*lock.shards_[idx], number);
+  }
+
+  // We may block on shards after the last one we hold, but only try to lock
+  // earlier ones, since another thread may hold them while waiting for ours.
+  bool mayBlock = true;
+  for (size_t held = idx + 1; held < kNumShards; ++held) {
+    if (lock.shards_[held]) {
+      mayBlock = false;
+      break;
+    }
+  }
+  auto data = mayBlock ? shards_[idx].rlock() : shards_[idx].rlock(0s);
+  if (!data) {
+    return true;
+  }
+  return isUnloadedInodeKnown(*data, number);
 }
 
 void InodeMap::unloadInode(
@@ -737,7 +958,13 @@ void InodeMap::unloadInode(
     PathComponentPiece name,
     bool isUnlinked,
     const InodeMapLock& lock) {
-  return unloadInode(inode, parent, name, isUnlinked, lock.data_);
+  auto& shard = lock.shards_[getShardIndex(inode->getNodeId())];
+  CHECK(shard) << "unloadInode() called without holding the shard lock for "
+               << inode->getLogPath();
+  return unloadInode(
+      inode, parent, name, isUnlinked, *shard, [&](InodeNumber number) {
+        return isRememberedForUnload(number, lock);
+      });
 }
 
 void InodeMap::unloadInode(
@@ -745,21 +972,22 @@ void InodeMap::unloadInode(
     TreeInode* parent,
     PathComponentPiece name,
     bool isUnlinked,
-    const folly::Synchronized<Members>::LockedPtr& data) {
+    Shard& shard,
+    folly::FunctionRef<bool(InodeNumber)> isRemembered) {
   // Call updateOverlayForUnload() to update the overlay and compute
   // if we need to remember an UnloadedInode entry.
   auto unloadedEntry =
-      updateOverlayForUnload(inode, parent, name, isUnlinked, data);
+      updateOverlayForUnload(inode, parent, name, isUnlinked, isRemembered);
   if (unloadedEntry) {
     // Insert the unloaded entry
     XLOG(DBG7) << "inserting unloaded map entry for inode "
                << inode->getNodeId();
-    auto ret = data->unloadedInodes_.emplace(
+    auto ret = shard.unloadedInodes_.emplace(
         inode->getNodeId(), std::move(unloadedEntry.value()));
     CHECK(ret.second);
   }
 
-  auto numErased = data->loadedInodes_.erase(inode->getNodeId());
+  auto numErased = shard.loadedInodes_.erase(inode->getNodeId());
   CHECK_EQ(numErased, 1) << "inconsistent loaded inodes data: "
                          << inode->getLogPath();
 }
@@ -769,9 +997,10 @@ Optional<InodeMap::UnloadedInode> InodeMap::updateOverlayForUnload(
     TreeInode* parent,
     PathComponentPiece name,
     bool isUnlinked,
-    const folly::Synchronized<Members>::LockedPtr& data) {
+    folly::FunctionRef<bool(InodeNumber)> isRemembered) {
   auto fuseCount = inode->getFuseRefcount();
-  if (isUnlinked && (data->isUnmounted_ || fuseCount == 0)) {
+  const bool isUnmounted = isUnmounted_.load(std::memory_order_acquire);
+  if (isUnlinked && (isUnmounted || fuseCount == 0)) {
     try {
       mount_->getOverlay()->removeOverlayData(inode->getNodeId());
     } catch (const std::exception& ex) {
@@ -788,13 +1017,28 @@ Optional<InodeMap::UnloadedInode> InodeMap::updateOverlayForUnload(
                 << inode->getNodeId() << " (" << inode->getLogPath()
                 << "): " << folly::exceptionStr(ex);
     }
+  } else if (!isUnlinked) {
+    // Nothing can have the overlay file of an inode being unloaded open, so
+    // this is when small materialized files are packed.  getBlobHash() is
+    // reliable here for the same reason.
+    auto* asFile = dynamic_cast<FileInode*>(inode);
+    if (asFile && !asFile->getBlobHash()) {
+      try {
+        mount_->getOverlay()->packSmallFile(inode->getNodeId());
+      } catch (const std::exception& ex) {
+        // The file stays in its own overlay file.
+        XLOG(WARN) << "error packing overlay file while unloading inode "
+                   << inode->getNodeId() << " (" << inode->getLogPath()
+                   << "): " << folly::exceptionStr(ex);
+      }
+    }
   }
 
   // If the mount point has been unmounted, ignore any outstanding FUSE
   // refcounts on inodes that still existed before it was unmounted.
   // Everything is unreferenced by FUSE after an unmount operation, and we no
   // longer need to remember anything in the unloadedInodes_ map.
-  if (data->isUnmounted_) {
+  if (isUnmounted) {
     XLOG(DBG5) << "forgetting unreferenced inode " << inode->getNodeId()
                << " after unmount: " << inode->getLogPath();
     return folly::none;
@@ -810,7 +1054,7 @@ Optional<InodeMap::UnloadedInode> InodeMap::updateOverlayForUnload(
 
   auto* asTree = dynamic_cast<TreeInode*>(inode);
   if (asTree) {
-    // Normally, acquiring the tree's contents lock while the InodeMap members
+    // Normally, acquiring the tree's contents lock while an InodeMap shard
     // lock is held violates our lock hierarchy.  However, since this TreeInode
     // is being unloaded, nobody else can reference it right now, so the lock is
     // guaranteed not held.  Another option is to acquire the TreeInode's lock
@@ -841,7 +1085,7 @@ Optional<InodeMap::UnloadedInode> InodeMap::updateOverlayForUnload(
     for (const auto& pair : treeContentsLock->entries) {
       const auto& childName = pair.first;
       const auto& entry = pair.second;
-      if (data->unloadedInodes_.count(entry.getInodeNumber())) {
+      if (isRemembered(entry.getInodeNumber())) {
         XLOG(DBG5) << "remembering inode " << asTree->getNodeId() << " ("
                    << asTree->getLogPath() << ") because its child "
                    << childName << " was remembered";
@@ -876,10 +1120,9 @@ bool InodeMap::shouldLoadChild(
     PathComponentPiece name,
     InodeNumber childInode,
     folly::Promise<InodePtr> promise) {
-  auto data = data_.wlock();
-  auto iter = data->unloadedInodes_.find(childInode);
-  UnloadedInode* unloadedData{nullptr};
-  if (iter == data->unloadedInodes_.end()) {
+  auto data = getShard(childInode).wlock();
+  auto* unloadedData = findUnloadedInode(*data, childInode);
+  if (!unloadedData) {
     InodeNumber parentNumber = parent->getNodeId();
     auto newUnloadedData = UnloadedInode(childInode, parentNumber, name);
     auto ret =
@@ -887,7 +1130,6 @@ bool InodeMap::shouldLoadChild(
     DCHECK(ret.second);
     unloadedData = &ret.first->second;
   } else {
-    unloadedData = &iter->second;
     DCHECK_EQ(unloadedData->number, childInode);
   }
 
@@ -902,24 +1144,141 @@ bool InodeMap::shouldLoadChild(
   return isFirstPromise;
 }
 
+void InodeMap::incUnloadedChildFuseRefcount(
+    const TreeInode* parent,
+    PathComponentPiece name,
+    InodeNumber childInode,
+    mode_t mode,
+    folly::Optional<Hash> hash,
+    uint32_t count) {
+  auto data = getShard(childInode).wlock();
+  DCHECK_EQ(0, data->loadedInodes_.count(childInode))
+      << "incUnloadedChildFuseRefcount() called on loaded inode "
+      << childInode;
+
+  auto* unloadedData = findUnloadedInode(*data, childInode);
+  if (unloadedData) {
+    unloadedData->numFuseReferences += count;
+    return;
+  }
+
+  XLOG(DBG5) << "remembering unloaded inode " << childInode << ": "
+             << parent->getNodeId() << ":" << name;
+  auto ret = data->unloadedInodes_.emplace(
+      childInode,
+      UnloadedInode(
+          childInode,
+          parent->getNodeId(),
+          name,
+          false,
+          mode,
+          hash,
+          count));
+  DCHECK(ret.second);
+}
+
 void InodeMap::inodeCreated(const InodePtr& inode) {
   XLOG(DBG4) << "created new inode " << inode->getNodeId() << ": "
              << inode->getLogPath();
-  auto data = data_.wlock();
+  auto data = getShard(inode->getNodeId()).wlock();
   data->loadedInodes_.emplace(inode->getNodeId(), inode.get());
 }
 
 InodeMap::LoadedInodeCounts InodeMap::getLoadedInodeCounts() const {
   LoadedInodeCounts counts;
-  auto data = data_.rlock();
-  for (const auto& entry : data->loadedInodes_) {
-    if (entry.second->getType() == dtype_t::Dir) {
-      ++counts.treeCount;
-    } else {
-      ++counts.fileCount;
+  for (const auto& shard : shards_) {
+    auto data = shard.rlock();
+    for (const auto& entry : data->loadedInodes_) {
+      if (entry.second->getType() == dtype_t::Dir) {
+        ++counts.treeCount;
+      } else {
+        ++counts.fileCount;
+      }
     }
   }
   return counts;
 }
+
+uint64_t InodeMap::releaseIdleBlobs(
+    std::chrono::steady_clock::time_point cutoff) {
+  if (getLoadedBlobBytes() == 0) {
+    return 0;
+  }
+
+  // Take references to the files while holding the shard locks, but only
+  // lock each file once they have been released.
+  std::vector<FileInodePtr> files;
+  for (const auto& shard : shards_) {
+    auto data = shard.rlock();
+    for (const auto& entry : data->loadedInodes_) {
+      if (entry.second->getType() != dtype_t::Dir) {
+        files.push_back(entry.second.getPtr().asFilePtr());
+      }
+    }
+  }
+
+  uint64_t released = 0;
+  for (const auto& file : files) {
+    released += file->releaseBlobIfIdle(cutoff);
+  }
+  return released;
+}
+
+void InodeMap::recordBufferedWrites(InodeNumber number) {
+  filesWithBufferedWrites_.wlock()->insert(number);
+}
+
+void InodeMap::flushWriteBuffers() {
+  std::unordered_set<InodeNumber> numbers;
+  filesWithBufferedWrites_.wlock()->swap(numbers);
+
+  for (auto number : numbers) {
+    try {
+      if (auto file = lookupLoadedFile(number)) {
+        file->flushWriteBuffer();
+      }
+    } catch (const std::exception& ex) {
+      // Try again next time.
+      XLOG(ERR) << "error writing buffered writes for inode " << number
+                << ": " << folly::exceptionStr(ex);
+      recordBufferedWrites(number);
+    }
+  }
+}
+
+size_t InodeMap::getApproximateMemoryUsage() const {
+  // Each hash table entry also costs a node pointer and a bucket pointer.
+  constexpr size_t kEntryOverhead = 2 * sizeof(void*);
+  size_t total = 0;
+  for (const auto& shard : shards_) {
+    auto data = shard.rlock();
+    for (const auto& entry : data->loadedInodes_) {
+      total += sizeof(entry) + kEntryOverhead +
+          (entry.second->getType() == dtype_t::Dir ? sizeof(TreeInode)
+                                                   : sizeof(FileInode));
+    }
+    for (const auto& entry : data->unloadedInodes_) {
+      total += sizeof(entry) + kEntryOverhead +
+          entry.second.name.stringPiece().size();
+    }
+  }
+  return total;
+}
+
+size_t InodeMap::getLoadedInodeCount() const {
+  size_t count = 0;
+  for (const auto& shard : shards_) {
+    count += shard.rlock()->loadedInodes_.size();
+  }
+  return count;
+}
+
+size_t InodeMap::getUnloadedInodeCount() const {
+  size_t count = 0;
+  for (const auto& shard : shards_) {
+    count += shard.rlock()->unloadedInodes_.size();
+  }
+  return count + takeoverInodesRemaining_.load(std::memory_order_acquire);
+}
 } // namespace eden
 } // namespace facebook
@@ -9,16 +9,23 @@
  */
 #pragma once
 
+#include <folly/Function.h>
 #include <folly/Synchronized.h>
 #include <folly/futures/Future.h>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <list>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "eden/fs/fuse/FuseChannel.h"
 #include "eden/fs/inodes/InodePtr.h"
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/takeover/gen-cpp2/takeover_types.h"
+#include "eden/fs/utils/LockProfiler.h"
 #include "eden/fs/utils/PathFuncs.h"
 
 namespace folly {
@@ -33,6 +40,7 @@ class FileInode;
 class InodeBase;
 class TreeInode;
 class ParentInodeInfo;
+class UnloadedInodeTable;
 
 struct UnloadedInodeData {
   UnloadedInodeData(InodeNumber p, PathComponentPiece n) : parent(p), name(n) {}
@@ -89,6 +97,12 @@ class InodeMapLock;
  *   inode number is inserted directly into loadedInodes_, without ever being
  *   in unloadedInodes_.
  *
+ *   The exceptions are children whose attributes are known from their
+ *   parent's entry: files listed by readdirplus(), and directories that are
+ *   unchanged from source control when --lookup_unloaded_directories is set.
+ *   Their inode numbers are returned without loading them, and are recorded
+ *   in unloadedInodes_ until something needs the Inode object.
+ *
  *   The unloadedInodes_ map is primarily for inodes that were loaded and have
  *   since been unloaded due to inactivity.
  *
@@ -97,6 +111,12 @@ class InodeMapLock;
  *
  *   We currently always allocate a InodeNumber value for any new Inode object
  *   even if it is not needed yet by the FUSE APIs.
+ *
+ * Both maps are split into shards by InodeNumber, each with its own lock, so
+ * that FUSE requests for different inodes rarely contend.  Operations on a
+ * single inode only lock its shard.  Walking up through unloaded parents
+ * locks one shard at a time, and lockForUnload() locks every shard, in
+ * index order, for the rare operations that unload many inodes at once.
  */
 class InodeMap {
  public:
@@ -127,6 +147,11 @@ class InodeMap {
    * Initialize the InodeMap from data handed over from a process being taken
    * over.
    *
+   * If the unloaded inodes were handed over in an UnloadedInodeTable file,
+   * this only maps it.  Each inode is moved from the table into
+   * unloadedInodes_ the first time it is used, so that mounts remembering
+   * millions of inodes can start serving straight away.
+   *
    * This method has the same constraints and concerns as initialize().
    */
   void initializeFromTakeover(
@@ -238,6 +263,17 @@ class InodeMap {
    */
   void decFuseRefcount(InodeNumber number, uint32_t count = 1);
 
+  /**
+   * Decrement the FUSE reference counts of a batch of inode numbers.
+   *
+   * This behaves like calling decFuseRefcount() for each entry, but locks
+   * each shard at most once for the whole batch.  Dropping the last
+   * reference to a loaded inode can unload it, which needs its parent's
+   * contents lock, so that work is handed to the background thread pool
+   * rather than done on the calling FUSE thread.
+   */
+  void decFuseRefcounts(folly::Range<const InodeForget*> decrements);
+
   /**
    * Indicate that the mount point has been unmounted.
    *
@@ -288,10 +324,19 @@ class InodeMap {
    * unloading.  It should only be called *after* acquring the TreeInode
    * contents lock.
    *
+   * This locks every shard.  Use lockForUnload(InodeNumber) when only a
+   * single inode will be unloaded.
+   *
    * This is an internal API that should not be used by most callers.
    */
   InodeMapLock lockForUnload();
 
+  /**
+   * Acquire the lock for the shard holding a single inode, for unloading that
+   * inode alone.
+   */
+  InodeMapLock lockForUnload(InodeNumber number);
+
   /**
    * unloadedInode() should be called to unload an unreferenced inode.
    *
@@ -374,6 +419,26 @@ class InodeMap {
       InodeNumber number,
       const folly::exception_wrapper& exception);
 
+  /**
+   * incUnloadedChildFuseRefcount() should only be called while holding the
+   * parent TreeInode's contents lock.
+   *
+   * Record that an inode number for a child that is not loaded has been
+   * returned to FUSE, e.g. by readdirplus(), without loading the child.  This
+   * increments the FUSE refcount in the child's unloaded entry, creating the
+   * entry if necessary, so that the child can later be loaded by inode
+   * number and its refcount will be transferred to the Inode object.
+   *
+   * The caller must have checked that the child is not loaded.
+   */
+  void incUnloadedChildFuseRefcount(
+      const TreeInode* parent,
+      PathComponentPiece name,
+      InodeNumber childInode,
+      mode_t mode,
+      folly::Optional<Hash> hash,
+      uint32_t count = 1);
+
   void inodeCreated(const InodePtr& inode);
 
   struct LoadedInodeCounts {
@@ -387,13 +452,59 @@ class InodeMap {
    */
   LoadedInodeCounts getLoadedInodeCounts() const;
 
-  size_t getLoadedInodeCount() const {
-    return data_.rlock()->loadedInodes_.size();
+  size_t getLoadedInodeCount() const;
+  size_t getUnloadedInodeCount() const;
+
+  /**
+   * Returns an estimate of the memory used by the loaded and unloaded inodes
+   * in this map, in bytes.
+   *
+   * This counts the inode objects and their map entries, but not the
+   * contents of loaded directories or the blobs held by open files.
+   */
+  size_t getApproximateMemoryUsage() const;
+
+  /**
+   * Returns the number of bytes of source control data held in memory by
+   * open files in this mount.
+   *
+   * The same blobs may also be held by the ObjectStore's blob cache, so
+   * this can overlap with that cache's size.
+   */
+  uint64_t getLoadedBlobBytes() const {
+    return loadedBlobBytes_.load(std::memory_order_relaxed);
   }
-  size_t getUnloadedInodeCount() const {
-    return data_.rlock()->unloadedInodes_.size();
+
+  /**
+   * The counter behind getLoadedBlobBytes(), which FileInodes update as they
+   * load and release blobs.
+   */
+  std::atomic<uint64_t>* getLoadedBlobBytesCounter() {
+    return &loadedBlobBytes_;
   }
 
+  /**
+   * Release the blobs held by loaded files that have not been read since
+   * cutoff.  See FileInode::releaseBlobIfIdle().
+   *
+   * Returns the number of bytes released.
+   */
+  uint64_t releaseIdleBlobs(std::chrono::steady_clock::time_point cutoff);
+
+  /**
+   * Note that a file has started buffering writes, so that
+   * flushWriteBuffers() writes them to the overlay.  See
+   * FileInode::tryBufferWrite().
+   */
+  void recordBufferedWrites(InodeNumber number);
+
+  /**
+   * Write the buffered writes of every file that recorded some to the
+   * overlay.  EdenServer calls this periodically, to bound how long writes
+   * stay in memory.
+   */
+  void flushWriteBuffers();
+
  private:
   friend class InodeMapLock;
 
@@ -459,7 +570,7 @@ class InodeMap {
      *
      * (We could use folly::SharedPromise here instead, but it has extra
      * overhead that we don't really need.  It performs its own locking, but we
-     * are already protected by the data_ lock.)
+     * are already protected by the shard lock.)
      */
     PromiseVector promises;
     /**
@@ -484,7 +595,7 @@ class InodeMap {
 
     InodePtr getPtr() const {
       // Calling InodePtr::newPtrLocked is safe because interacting with
-      // LoadedInode implies the data_ lock is held.
+      // LoadedInode implies the shard lock is held.
       return InodePtr::newPtrLocked(inode_);
     }
 
@@ -503,7 +614,10 @@ class InodeMap {
     InodeBase* inode_{nullptr};
   };
 
-  struct Members {
+  /**
+   * The inodes whose numbers map to one shard.
+   */
+  struct Shard {
     /**
      * The map of loaded inodes
      *
@@ -518,33 +632,77 @@ class InodeMap {
      * The map of currently unloaded inodes
      */
     std::unordered_map<InodeNumber, UnloadedInode> unloadedInodes_;
+  };
+  struct ShardLockName {
+    static folly::StringPiece name() {
+      return "inode_map";
+    }
+  };
+  using SynchronizedShard =
+      folly::Synchronized<Shard, ProfiledSharedMutex<ShardLockName>>;
+  using ShardLock = SynchronizedShard::LockedPtr;
 
-    /**
-     * Indicates if the FUSE mount point has been unmounted.
-     *
-     * If this is true then the FUSE refcount on all inodes should be treated
-     * as 0, and we can forget all inodes while shutting down.
-     */
-    bool isUnmounted_{false};
+  // A power of two, so that picking a shard is a mask.  Inode numbers are
+  // allocated sequentially, so the low bits spread them evenly.
+  static constexpr size_t kNumShards = 64;
 
-    /**
-     * A promise to fulfill once shutdown() completes.
-     *
-     * This is only initialized when shutdown() is called, and will be
-     * folly::none until we are shutting down.
-     *
-     * In the future we could update this to just use an empty promise to
-     * indicate that we are not shutting down yet.  However, currently
-     * folly::Promise does not have a simple API to check if it is empty or not,
-     * so we have to wrap it in a folly::Optional.
-     */
-    folly::Optional<folly::Promise<folly::Unit>> shutdownPromise;
-  };
+  static size_t getShardIndex(InodeNumber number) {
+    return number.get() & (kNumShards - 1);
+  }
+  SynchronizedShard& getShard(InodeNumber number) {
+    return shards_[getShardIndex(number)];
+  }
+  const SynchronizedShard& getShard(InodeNumber number) const {
+    return shards_[getShardIndex(number)];
+  }
 
   InodeMap(InodeMap const&) = delete;
   InodeMap& operator=(InodeMap const&) = delete;
 
-  void shutdownComplete(folly::Synchronized<Members>::LockedPtr&& data);
+  void shutdownComplete(ShardLock&& rootShard);
+
+  /**
+   * Convert an unloaded inode handed over by takeover.  Throws if the entry
+   * is invalid.
+   */
+  static UnloadedInode deserializeUnloadedInode(
+      const SerializedInodeMapEntry& entry);
+
+  /**
+   * Return the index of the record for number in takeoverInodes_, if there
+   * is one that has not been moved into unloadedInodes_ yet.  The caller must
+   * hold the shard lock for number.
+   */
+  folly::Optional<size_t> findTakeoverInode(InodeNumber number) const;
+
+  /**
+   * Find number in shard.unloadedInodes_, first moving its record there from
+   * takeoverInodes_ if it is still in the table.  Returns nullptr if it is in
+   * neither.  The caller must hold the shard's write lock.
+   */
+  UnloadedInode* findUnloadedInode(Shard& shard, InodeNumber number);
+
+  /**
+   * Like findUnloadedInode(), but only needs the shard's read lock, so
+   * records still in takeoverInodes_ are decoded into storage rather than
+   * moved.
+   */
+  const UnloadedInode* findUnloadedInode(
+      const Shard& shard,
+      InodeNumber number,
+      folly::Optional<UnloadedInode>& storage) const;
+
+  /**
+   * Returns true if number is in shard.unloadedInodes_ or still in
+   * takeoverInodes_.
+   */
+  bool isUnloadedInodeKnown(const Shard& shard, InodeNumber number) const;
+
+  /**
+   * The part of lookupInode() for inodes that were not loaded when it
+   * checked, timed as part of the FUSE request that needed them.
+   */
+  folly::Future<InodePtr> loadInode(InodeNumber number);
 
   void setupParentLookupPromise(
       folly::Promise<InodePtr>& promise,
@@ -565,14 +723,29 @@ class InodeMap {
    * Extract the list of promises waiting on the specified inode number to be
    * loaded.
    *
-   * This method acquires the data_ lock internally.
+   * This method acquires the shard lock internally.
    * It should never be called while already holding the lock.
    */
   PromiseVector extractPendingPromises(InodeNumber number);
 
-  folly::Optional<RelativePath> getPathForInodeHelper(
-      InodeNumber inodeNumber,
-      const folly::Synchronized<Members>::ConstLockedPtr& data);
+  /**
+   * Decrement the FUSE reference count of an inode in shard.unloadedInodes_,
+   * forgetting it entirely once the count reaches zero.
+   */
+  void decUnloadedFuseRefcount(
+      Shard& shard,
+      InodeNumber number,
+      uint32_t count);
+
+  /**
+   * Returns true if the given inode number is in unloadedInodes_, using the
+   * shard locks already held in lock where possible.
+   *
+   * Other shards are only locked without blocking if that could violate the
+   * shard lock order.  If such a shard is busy this conservatively returns
+   * true, which at worst makes us remember a parent inode we did not need to.
+   */
+  bool isRememberedForUnload(InodeNumber number, const InodeMapLock& lock);
 
   /**
    * Unload an inode
@@ -582,13 +755,16 @@ class InodeMap {
    *
    * The caller is responsible for actually deleting the Inode object after
    * releasing the InodeMap lock.
+   *
+   * isRemembered reports whether another inode number is in unloadedInodes_.
    */
   void unloadInode(
       InodeBase* inode,
       TreeInode* parent,
       PathComponentPiece name,
       bool isUnlinked,
-      const folly::Synchronized<Members>::LockedPtr& lock);
+      Shard& shard,
+      folly::FunctionRef<bool(InodeNumber)> isRemembered);
 
   /**
    * Update the overlay data for an inode before unloading it.
@@ -602,7 +778,7 @@ class InodeMap {
       TreeInode* parent,
       PathComponentPiece name,
       bool isUnlinked,
-      const folly::Synchronized<Members>::LockedPtr& lock);
+      folly::FunctionRef<bool(InodeNumber)> isRemembered);
 
   /**
    * The EdenMount that owns this InodeMap.
@@ -618,16 +794,54 @@ class InodeMap {
   TreeInodePtr root_;
 
   /**
-   * The locked data.
+   * The locked data, split into shards by inode number.
    *
-   * Note: be very careful to hold this lock only when necessary.  No other
-   * locks should be acquired when holding this lock.  In particular this means
+   * Note: be very careful to hold these locks only when necessary.  No other
+   * locks should be acquired when holding one.  In particular this means
    * that we should never access any InodeBase objects while holding the lock,
    * since we should not hold our lock while an InodeBase acquires its own
    * internal lock.  (This makes it safe for InodeBase to perform operations on
    * the InodeMap while holding their own lock.)
+   *
+   * Code that holds more than one shard lock at a time must acquire them in
+   * increasing index order.
+   */
+  std::array<SynchronizedShard, kNumShards> shards_;
+
+  /**
+   * Indicates if the FUSE mount point has been unmounted.
+   *
+   * If this is true then the FUSE refcount on all inodes should be treated
+   * as 0, and we can forget all inodes while shutting down.
+   */
+  std::atomic<bool> isUnmounted_{false};
+
+  /**
+   * Set by shutdown(), after which shutdownPromise_ is fulfilled once the
+   * root inode is unreferenced.
    */
-  folly::Synchronized<Members> data_;
+  std::atomic<bool> isShuttingDown_{false};
+  folly::Promise<folly::Unit> shutdownPromise_;
+
+  std::atomic<uint64_t> loadedBlobBytes_{0};
+
+  /**
+   * The files that may have buffered writes.  Inode numbers rather than
+   * pointers are kept, so that these files can still be unloaded.
+   */
+  folly::Synchronized<std::unordered_set<InodeNumber>> filesWithBufferedWrites_;
+
+  /**
+   * The unloaded inodes handed over by takeover that have not been used
+   * yet, or null.  This never changes after initializeFromTakeover().
+   *
+   * takeoverInodeMoved_ marks the records that have been moved into
+   * unloadedInodes_, after which the table no longer speaks for them.  Each
+   * flag is only accessed with the shard lock for its inode number held.
+   */
+  std::unique_ptr<UnloadedInodeTable> takeoverInodes_;
+  std::unique_ptr<bool[]> takeoverInodeMoved_;
+  std::atomic<size_t> takeoverInodesRemaining_{0};
 };
 
 /**
@@ -639,17 +853,21 @@ class InodeMap {
  */
 class InodeMapLock {
  public:
-  explicit InodeMapLock(
-      folly::Synchronized<InodeMap::Members>::LockedPtr&& data)
-      : data_(std::move(data)) {}
-
   void unlock() {
-    data_.unlock();
+    for (auto& shard : shards_) {
+      if (shard) {
+        shard.unlock();
+      }
+    }
   }
 
  private:
   friend class InodeMap;
-  folly::Synchronized<InodeMap::Members>::LockedPtr data_;
+
+  InodeMapLock() : shards_(InodeMap::kNumShards) {}
+
+  // Indexed by shard; only the shards this lock holds are non-null.
+  std::vector<InodeMap::ShardLock> shards_;
 };
 } // namespace eden
 } // namespace facebook
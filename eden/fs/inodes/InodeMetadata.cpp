@@ -8,11 +8,29 @@
  *
  */
 #include "eden/fs/inodes/InodeMetadata.h"
+#include <unistd.h>
 #include "eden/fs/fuse/FuseTypes.h"
 
 namespace facebook {
 namespace eden {
 
+namespace {
+/**
+ * The owner of every mount of this edenfs process.  edenfs drops its
+ * privileges before it opens any mounts, so this is the mount owner's.
+ */
+uid_t getOwnerUid() {
+  static const uid_t uid = getuid();
+  return uid;
+}
+gid_t getOwnerGid() {
+  static const gid_t gid = getgid();
+  return gid;
+}
+
+constexpr uint32_t kShortIdMax = 0xffff;
+} // namespace
+
 void InodeMetadata::updateFromAttr(
     const Clock& clock,
     const fuse_setattr_in& attr) {
@@ -39,5 +57,61 @@ void InodeMetadata::applyToStat(struct stat& st) const {
   timestamps.applyToStat(st);
 }
 
+PackedInodeMetadata::PackedInodeMetadata(
+    const InodeMetadata& metadata) noexcept
+    : mode{static_cast<uint16_t>(metadata.mode)},
+      atime{metadata.timestamps.atime.asRawRepresentation()},
+      mtime{metadata.timestamps.mtime.asRawRepresentation()},
+      ctime{metadata.timestamps.ctime.asRawRepresentation()} {
+  bool customUid = metadata.uid != getOwnerUid();
+  bool customGid = metadata.gid != getOwnerGid();
+  if (customUid && customGid) {
+    flags = CUSTOM_UID | CUSTOM_GID;
+    if (metadata.uid == metadata.gid) {
+      flags |= SAME_IDS;
+      id = metadata.uid;
+    } else if (metadata.uid <= kShortIdMax && metadata.gid <= kShortIdMax) {
+      flags |= SHORT_IDS;
+      id = metadata.uid | (metadata.gid << 16);
+    } else {
+      flags |= GID_IN_ATIME;
+      id = metadata.uid;
+      atime = metadata.gid;
+    }
+  } else if (customUid) {
+    flags = CUSTOM_UID;
+    id = metadata.uid;
+  } else if (customGid) {
+    flags = CUSTOM_GID;
+    id = metadata.gid;
+  }
+}
+
+InodeMetadata PackedInodeMetadata::unpack() const noexcept {
+  InodeMetadata metadata;
+  metadata.mode = mode;
+  metadata.uid = getOwnerUid();
+  metadata.gid = getOwnerGid();
+  metadata.timestamps.atime = EdenTimestamp{atime};
+  metadata.timestamps.mtime = EdenTimestamp{mtime};
+  metadata.timestamps.ctime = EdenTimestamp{ctime};
+  if (flags & SAME_IDS) {
+    metadata.uid = id;
+    metadata.gid = id;
+  } else if (flags & SHORT_IDS) {
+    metadata.uid = id & kShortIdMax;
+    metadata.gid = id >> 16;
+  } else if (flags & GID_IN_ATIME) {
+    metadata.uid = id;
+    metadata.gid = static_cast<gid_t>(atime);
+    metadata.timestamps.atime = metadata.timestamps.mtime;
+  } else if (flags & CUSTOM_UID) {
+    metadata.uid = id;
+  } else if (flags & CUSTOM_GID) {
+    metadata.gid = id;
+  }
+  return metadata;
+}
+
 } // namespace eden
 } // namespace facebook
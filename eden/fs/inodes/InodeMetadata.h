@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <stdint.h>
 #include <sys/stat.h>
 #include "eden/fs/inodes/InodeTimestamps.h"
 
@@ -21,11 +22,9 @@ namespace eden {
 /**
  * Fixed-size structure of per-inode bits that should be persisted across runs.
  *
- * Warning: This data structure is serialized directly to disk via InodeTable.
- * Do not change the order, sizes, or meanings of the fields. Instead, rename
- * this struct, create a new InodeMetadata struct with the next VERSION value,
- * add an explicit constructor from the old version, and add the old version to
- * the InodeMetadataTable typedef in InodeTable.h.
+ * Warning: InodeMetadataTable files written before PackedInodeMetadata
+ * existed hold this structure directly, and are migrated from it when they
+ * are opened.  Do not change the order, sizes, or meanings of the fields.
  */
 struct InodeMetadata {
   enum { VERSION = 0 };
@@ -53,5 +52,52 @@ struct InodeMetadata {
   // dev_t rdev;
   // creation time
 };
+
+/**
+ * InodeMetadata as the InodeMetadataTable stores it: packed into 32 bytes, so
+ * that each of the table's entries takes 40 bytes rather than 48.
+ *
+ * Only the 16 bits of the mode that are defined are kept.  The uid and gid
+ * are omitted when they are those of the user running edenfs, who owns its
+ * mounts, which is nearly always.  Otherwise id holds whichever of them
+ * differs.  If both differ, they share id when they are equal or both fit
+ * in 16 bits, and otherwise the gid takes the place of atime, whose value is
+ * then read back as mtime.
+ *
+ * Warning: This data structure is serialized directly to disk via InodeTable.
+ * Do not change the order, sizes, or meanings of the fields. Instead, create
+ * a new record struct with the next VERSION value, add an explicit
+ * constructor from the old version, and pass the old version to
+ * InodeMetadataTable::open() in Overlay.cpp.
+ */
+struct PackedInodeMetadata {
+  enum { VERSION = 1 };
+
+  enum Flags : uint16_t {
+    /// The uid is not the owner's.
+    CUSTOM_UID = 1,
+    /// The gid is not the owner's.
+    CUSTOM_GID = 2,
+    /// id holds both the uid and gid, which are equal.
+    SAME_IDS = 4,
+    /// id holds the uid in its low 16 bits and the gid in its high 16 bits.
+    SHORT_IDS = 8,
+    /// id holds the uid, and atime holds the gid.
+    GID_IN_ATIME = 16,
+  };
+
+  PackedInodeMetadata() = default;
+
+  explicit PackedInodeMetadata(const InodeMetadata& metadata) noexcept;
+
+  InodeMetadata unpack() const noexcept;
+
+  uint16_t mode{0};
+  uint16_t flags{0};
+  uint32_t id{0};
+  uint64_t atime{0};
+  uint64_t mtime{0};
+  uint64_t ctime{0};
+};
 } // namespace eden
 } // namespace facebook
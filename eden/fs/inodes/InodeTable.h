@@ -9,6 +9,16 @@
  */
 #pragma once
 
+#include <folly/ScopeGuard.h>
+#include <folly/Synchronized.h>
+#include <folly/concurrency/ConcurrentHashMap.h>
+#include <folly/portability/Asm.h>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
 #include "eden/fs/fuse/FuseTypes.h"
 #include "eden/fs/inodes/InodeMetadata.h"
 #include "eden/fs/utils/Bug.h"
@@ -41,6 +51,44 @@ struct InodeTableEntry {
   // corrupted entries?
   Record record;
 };
+
+/**
+ * Converts between the records that InodeTable's callers see and the ones
+ * it stores.  Stored must be explicitly constructible from Record, and
+ * provide Record unpack() const.
+ */
+template <typename Record, typename Stored>
+struct InodeTableCodec {
+  static Stored encode(const Record& record) {
+    return Stored{record};
+  }
+  static Record decode(const Stored& stored) {
+    return stored.unpack();
+  }
+  /// Calls fn(record) and stores the record it modified.
+  template <typename Fn>
+  static auto modify(Stored& stored, Fn&& fn) {
+    auto record = decode(stored);
+    SCOPE_EXIT {
+      stored = encode(record);
+    };
+    return fn(record);
+  }
+};
+
+template <typename Record>
+struct InodeTableCodec<Record, Record> {
+  static const Record& encode(const Record& record) {
+    return record;
+  }
+  static const Record& decode(const Record& stored) {
+    return stored;
+  }
+  template <typename Fn>
+  static auto modify(Record& stored, Fn&& fn) {
+    return fn(stored);
+  }
+};
 } // namespace detail
 
 /**
@@ -58,27 +106,47 @@ struct InodeTableEntry {
  * is killed.
  *
  * The storage remains dense - rather than using a free list, upon removal of an
- * entry, the last entry is moved to the removed entry's index.
+ * entry, the last entry is moved to the removed entry's index, so freed slots
+ * are reused by the next insertion.  The file never shrinks, but once more
+ * than maxFragmentation of its allocated slots are unused, the space past the
+ * last record is given back (see MappedDiskVector::releaseUnusedCapacity()).
+ *
+ * Records whose inodes can no longer be referred to, such as the children of
+ * source control directories that were unloaded and forgotten, are not freed
+ * by anyone.  compact() removes them given a way to tell which are live.
  *
  * The locking strategy is as follows:
  *
- * The index from inode number to record index is wrapped in a SharedMutex.
- * Most accesses will only take a reader lock unless a new entry is added or
- * an inode number is removed.
+ * Reads take no locks.  getattr() reads a record for every stat() call, so
+ * readers must not share a lock with each other.  Instead:
+ *
+ * - The index from inode number to record index is a ConcurrentHashMap,
+ *   which can be searched while it is modified.
+ * - Adding, removing or moving records happens with the state_ write lock
+ *   held and bumps structureVersion_, a sequence number that is odd while
+ *   such a change is in progress.
+ * - Modifying a record in place happens with the state_ read lock held and
+ *   with the record's stripe sequence number held odd.  Stripes are shared
+ *   by inode numbers with the same remainder, so writers to different
+ *   inodes in a stripe take turns.
+ * - A reader copies the record and retries if either sequence number was
+ *   odd or changed while it was copying.  After a few failed attempts it
+ *   falls back to locking.
+ * - The file's mapping never moves out from under a reader: it grows in
+ *   place into reserved address space, and if it outgrows that, the old
+ *   mapping is kept until the table is destroyed.
  *
  * The contents of each record itself is protected by the FileInode and
- * TreeInode's locks.
+ * TreeInode's locks, which serialize modifications of the same record.
  *
- * (Someday it might be worthwhile to investigate whether a freelist is
- * beneficial. If records have stable locations within the file and the file
- * is mapped in chunks, allocated records will have stable pointers, avoiding
- * the need for metadata reads and writes to acquire a lock on the index data
- * structure, at the cost of a guaranteed-dense map.)
+ * Records may be stored in a more compact form than callers use: if Stored
+ * differs from Record, each record is converted on every read and write.
  */
-template <typename Record>
+template <typename Record, typename Stored = Record>
 class InodeTable {
  public:
-  using Entry = detail::InodeTableEntry<Record>;
+  using Entry = detail::InodeTableEntry<Stored>;
+  using Codec = detail::InodeTableCodec<Record, Stored>;
 
   InodeTable() = delete;
   InodeTable(const InodeTable&) = delete;
@@ -87,14 +155,48 @@ class InodeTable {
   InodeTable& operator=(const InodeTable&) = delete;
   InodeTable& operator=(InodeTable&&) = delete;
 
+  struct Stats {
+    /** The number of records in the table. */
+    size_t records{0};
+    /** The number of records the table's allocated disk space can hold. */
+    size_t capacity{0};
+    /** The number of records removed by compact() since the table opened. */
+    uint64_t recordsCompacted{0};
+    /** The bytes of unused capacity given back since the table opened. */
+    uint64_t bytesReleased{0};
+
+    /** The fraction of the allocated slots that are unused. */
+    double getFragmentation() const {
+      return capacity == 0 ? 0.0
+                           : 1.0 - static_cast<double>(records) / capacity;
+    }
+  };
+
   /**
    * Create or open an InodeTable at the specified path.
+   *
+   * If flushInterval is nonzero, writeback of the table to disk is started
+   * after every flushInterval record updates rather than left entirely to
+   * the kernel.
+   *
+   * If maxFragmentation is nonzero, unused capacity is given back whenever
+   * removing records leaves more than that fraction of it unused.
    */
   template <typename... OldRecords>
-  static std::unique_ptr<InodeTable> open(folly::StringPiece path) {
-    return std::unique_ptr<InodeTable>{
-        new InodeTable{MappedDiskVector<Entry>::template open<
-            detail::InodeTableEntry<OldRecords>...>(path, true)}};
+  static std::unique_ptr<InodeTable> open(
+      folly::StringPiece path,
+      MappedDiskVectorOptions options = {},
+      size_t flushInterval = 0,
+      double maxFragmentation = 0) {
+    // Every record is read into the index on open.
+    options.populate = true;
+    // Lock-free readers may hold on to the old mapping across growth.
+    options.keepOldMappings = true;
+    return std::unique_ptr<InodeTable>{new InodeTable{
+        MappedDiskVector<Entry>::template open<
+            detail::InodeTableEntry<OldRecords>...>(path, options),
+        flushInterval,
+        maxFragmentation}};
   }
 
   /**
@@ -102,6 +204,9 @@ class InodeTable {
    * whether it was set to the default or not.
    */
   Record setDefault(InodeNumber ino, const Record& record) {
+    if (auto existing = getOptional(ino)) {
+      return *existing;
+    }
     return modifyOrInsert<Record>(
         ino,
         [&](auto& existing) { return existing; },
@@ -122,6 +227,11 @@ class InodeTable {
    */
   template <typename PopFn>
   void populateIfNotSet(InodeNumber ino, PopFn&& populate) {
+    // Records are only removed when their inode is forgotten, so if there is
+    // an entry now there is nothing to do.
+    if (indices_.find(ino) != indices_.cend()) {
+      return;
+    }
     modifyOrInsert<void>(ino, [&](auto&) {}, populate, [&](auto&) {});
   }
 
@@ -152,17 +262,57 @@ class InodeTable {
   /**
    * If the table has an entry for this inode, returns it.  Otherwise, returns
    * folly::none.
+   *
+   * This does not take any locks unless it keeps racing with writers.
    */
   folly::Optional<Record> getOptional(InodeNumber ino) {
+    auto& stripe = stripeFor(ino);
+    for (size_t attempt = 0; attempt < kMaxOptimisticReads; ++attempt) {
+      auto structure = structureVersion_.load(std::memory_order_acquire);
+      auto sequence = stripe.sequence.load(std::memory_order_acquire);
+      if ((structure | sequence) & 1) {
+        folly::asm_volatile_pause();
+        continue;
+      }
+
+      auto iter = indices_.find(ino);
+      folly::Optional<size_t> index;
+      if (iter != indices_.cend()) {
+        index = iter->second;
+      }
+
+      // Copy the entry out byte by byte, since a writer may be changing it.
+      typename std::aligned_storage<sizeof(Entry), alignof(Entry)>::type copy;
+      if (index) {
+        auto* records = records_.load(std::memory_order_acquire);
+        memcpy(&copy, records + *index, sizeof(Entry));
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (structure != structureVersion_.load(std::memory_order_relaxed) ||
+          sequence != stripe.sequence.load(std::memory_order_relaxed)) {
+        continue;
+      }
+      if (!index) {
+        return folly::none;
+      }
+      const auto& entry = *reinterpret_cast<const Entry*>(&copy);
+      if (entry.inode == ino) {
+        return Record{Codec::decode(entry.record)};
+      }
+    }
+
+    // Too much contention.  Serialize with the writers instead.
     return state_.withRLock([&](const auto& state) -> folly::Optional<Record> {
-      auto iter = state.indices.find(ino);
-      if (iter == state.indices.end()) {
+      auto iter = indices_.find(ino);
+      if (iter == indices_.cend()) {
         return folly::none;
-      } else {
-        auto index = iter->second;
-        CHECK_LT(index, state.storage.size());
-        return state.storage[index].record;
       }
+      auto index = iter->second;
+      CHECK_LT(index, state.storage.size());
+      return writeRecord(ino, [&]() -> Record {
+        return Codec::decode(state.storage[index].record);
+      });
     });
   }
 
@@ -176,54 +326,251 @@ class InodeTable {
   template <typename ModFn>
   Record modifyOrThrow(InodeNumber ino, ModFn&& fn) {
     return state_.withRLock([&](auto& state) {
-      auto iter = state.indices.find(ino);
-      if (iter == state.indices.end()) {
+      auto iter = indices_.find(ino);
+      if (iter == indices_.cend()) {
         throw std::out_of_range(
             folly::to<std::string>("no entry in InodeTable for inode ", ino));
       }
       auto index = iter->second;
       CHECK_LT(index, state.storage.size());
-      fn(state.storage[index].record);
-      // TODO: maybe trigger a background msync
-      return state.storage[index].record;
+      auto result = writeRecord(ino, [&]() -> Record {
+        auto& stored = state.storage[index].record;
+        Codec::modify(stored, fn);
+        return Codec::decode(stored);
+      });
+      noteUpdate(state);
+      return result;
     });
   }
 
-  // TODO: replace with freeInodes - it's much more efficient to free a bunch
-  // at once.
   void freeInode(InodeNumber ino) {
     state_.withWLock([&](auto& state) {
-      auto& storage = state.storage;
-      auto& indices = state.indices;
-
-      auto iter = indices.find(ino);
-      if (iter == indices.end()) {
-        // While transitioning metadata from the overlay to the
-        // InodeMetadataTable, it is common for there to be no metadata for an
-        // inode whose number is known. The Overlay calls freeInode()
-        // unconditionally, so simply do nothing.
-        return;
+      auto version = beginStructureChange();
+      SCOPE_EXIT {
+        endStructureChange(version);
+      };
+      freeInodeLocked(state, ino);
+    });
+    maybeReleaseCapacity();
+  }
+
+  /**
+   * Remove the records for all of the given inodes while taking the lock
+   * once.  Inodes without a record are skipped.
+   */
+  void freeInodes(const std::vector<InodeNumber>& inodes) {
+    if (inodes.empty()) {
+      return;
+    }
+    state_.withWLock([&](auto& state) {
+      auto version = beginStructureChange();
+      SCOPE_EXIT {
+        endStructureChange(version);
+      };
+      for (auto ino : inodes) {
+        freeInodeLocked(state, ino);
       }
+    });
+    maybeReleaseCapacity();
+  }
 
-      size_t indexToDelete = iter->second;
-      indices.erase(iter);
+  /**
+   * Remove every record for which isLive(inodeNumber) returns false, moving
+   * the remaining records down to fill the gaps in their existing order, and
+   * rebuild the index.  Duplicate records left by an earlier crash are
+   * dropped too.  Then give back the unused capacity.
+   *
+   * isLive is called with the table's write lock held, so it must not call
+   * back into the InodeTable.  Readers are not blocked while it runs, but
+   * writers are.
+   *
+   * Returns the number of records removed.
+   */
+  template <typename LiveFn>
+  size_t compact(LiveFn&& isLive) {
+    return state_.withWLock([&](auto& state) {
+      auto& storage = state.storage;
+      size_t kept = 0;
+      {
+        auto version = beginStructureChange();
+        SCOPE_EXIT {
+          endStructureChange(version);
+        };
+        for (size_t index = 0; index < storage.size(); ++index) {
+          auto ino = storage[index].inode;
+          auto iter = indices_.find(ino);
+          bool indexed = iter != indices_.cend() && iter->second == index;
+          if (!indexed) {
+            // A duplicate; the indexed record is kept or removed on its own.
+            continue;
+          }
+          if (!isLive(ino)) {
+            indices_.erase(ino);
+            continue;
+          }
+          if (kept != index) {
+            storage[kept] = storage[index];
+            indices_.insert_or_assign(ino, kept);
+          }
+          ++kept;
+        }
+      }
+      auto removed = storage.size() - kept;
+      storage.truncate(kept);
+      state.recordsCompacted += removed;
+      state.bytesReleased += storage.releaseUnusedCapacity();
+      return removed;
+    });
+  }
 
-      DCHECK_GT(storage.size(), 0);
-      size_t lastIndex = storage.size() - 1;
+  Stats getStats() const {
+    return state_.withRLock([](const auto& state) {
+      Stats stats;
+      stats.records = state.storage.size();
+      stats.capacity = state.storage.backedCapacity();
+      stats.recordsCompacted = state.recordsCompacted;
+      stats.bytesReleased = state.bytesReleased;
+      return stats;
+    });
+  }
 
-      if (lastIndex != indexToDelete) {
-        auto lastInode = storage[lastIndex].inode;
-        storage[indexToDelete] = storage[lastIndex];
-        indices[lastInode] = indexToDelete;
+  /**
+   * Return the inode numbers of all of the records in the table.
+   */
+  std::vector<InodeNumber> getAllInodes() {
+    return state_.withRLock([](const auto& state) {
+      std::vector<InodeNumber> inodes;
+      inodes.reserve(state.storage.size());
+      for (size_t i = 0; i < state.storage.size(); ++i) {
+        inodes.push_back(state.storage[i].inode);
       }
-
-      storage.pop_back();
+      return inodes;
     });
   }
 
+  /**
+   * Write the modified records to disk and wait for the writes to complete.
+   */
+  void sync() {
+    state_.withRLock([](const auto& state) { state.storage.sync(); });
+  }
+
+  /**
+   * Let the kernel reclaim the memory holding the records.  They are read
+   * back from the file as they are used.  See
+   * MappedDiskVector::releaseMemory().
+   */
+  void releaseMemory() {
+    state_.withRLock([](const auto& state) { state.storage.releaseMemory(); });
+  }
+
  private:
-  explicit InodeTable(MappedDiskVector<Entry>&& storage)
-      : state_{folly::in_place, std::move(storage)} {}
+  struct State;
+
+  /**
+   * Remove the record for ino, if it has one.  Must be called with the
+   * state_ write lock held, inside a structure change.
+   */
+  void freeInodeLocked(State& state, InodeNumber ino) {
+    auto& storage = state.storage;
+
+    auto iter = indices_.find(ino);
+    if (iter == indices_.cend()) {
+      // While transitioning metadata from the overlay to the
+      // InodeMetadataTable, it is common for there to be no metadata for an
+      // inode whose number is known. The Overlay calls freeInode()
+      // unconditionally, so simply do nothing.
+      return;
+    }
+
+    size_t indexToDelete = iter->second;
+    indices_.erase(ino);
+
+    DCHECK_GT(storage.size(), 0);
+    size_t lastIndex = storage.size() - 1;
+
+    if (lastIndex != indexToDelete) {
+      auto lastInode = storage[lastIndex].inode;
+      storage[indexToDelete] = storage[lastIndex];
+      indices_.insert_or_assign(lastInode, indexToDelete);
+    }
+
+    storage.pop_back();
+  }
+
+  InodeTable(
+      MappedDiskVector<Entry>&& storage,
+      size_t flushInterval,
+      double maxFragmentation)
+      : flushInterval_{flushInterval},
+        maxFragmentation_{maxFragmentation},
+        state_{folly::in_place, std::move(storage)} {
+    auto state = state_.wlock();
+    for (size_t i = 0; i < state->storage.size(); ++i) {
+      const Entry& entry = state->storage[i];
+      auto ret = indices_.insert(entry.inode, i);
+      if (!ret.second) {
+        XLOG(WARNING) << "Duplicate records for the same inode: indices "
+                      << ret.first->second << " and " << i;
+        continue;
+      }
+    }
+    records_.store(state->storage.begin(), std::memory_order_release);
+  }
+
+  /**
+   * Readers that keep racing with writers give up and take the read lock
+   * after this many attempts.
+   */
+  static constexpr size_t kMaxOptimisticReads = 8;
+
+  static constexpr size_t kRecordStripes = 64;
+
+  struct alignas(64) RecordStripe {
+    /// Odd while a record in this stripe is being modified.
+    std::atomic<uint32_t> sequence{0};
+  };
+
+  RecordStripe& stripeFor(InodeNumber ino) {
+    return stripes_[ino.get() % kRecordStripes];
+  }
+
+  /**
+   * Calls fn with the record's stripe held odd, so lock-free readers of any
+   * record in the stripe retry rather than see a partial update.
+   */
+  template <typename Fn>
+  auto writeRecord(InodeNumber ino, Fn&& fn) {
+    auto& sequence = stripeFor(ino).sequence;
+    auto value = sequence.load(std::memory_order_relaxed);
+    while ((value & 1) ||
+           !sequence.compare_exchange_weak(
+               value, value + 1, std::memory_order_relaxed)) {
+      folly::asm_volatile_pause();
+      value = sequence.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    SCOPE_EXIT {
+      sequence.store(value + 2, std::memory_order_release);
+    };
+    return fn();
+  }
+
+  /**
+   * Must be called with the write lock held before records are added,
+   * removed, or moved.  Returns the version to pass to endStructureChange().
+   */
+  uint64_t beginStructureChange() {
+    auto version = structureVersion_.load(std::memory_order_relaxed);
+    DCHECK_EQ(0, version & 1);
+    structureVersion_.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return version;
+  }
+
+  void endStructureChange(uint64_t version) {
+    structureVersion_.store(version + 2, std::memory_order_release);
+  }
 
   /**
    * Helper function that, in the common case that this inode number
@@ -254,10 +601,12 @@ class InodeTable {
     // modify immediately.
     {
       auto state = state_.rlock();
-      auto iter = state->indices.find(ino);
-      if (LIKELY(iter != state->indices.end())) {
+      auto iter = indices_.find(ino);
+      if (LIKELY(iter != indices_.cend())) {
         auto index = iter->second;
-        return modify(state->storage[index].record);
+        return writeRecord(ino, [&]() -> T {
+          return Codec::modify(state->storage[index].record, modify);
+        });
       }
     }
 
@@ -267,30 +616,33 @@ class InodeTable {
 
     auto state = state_.wlock();
     // Check again - something may have raced between the locks.
-    auto iter = state->indices.find(ino);
-    if (UNLIKELY(iter != state->indices.end())) {
+    auto iter = indices_.find(ino);
+    if (UNLIKELY(iter != indices_.cend())) {
       auto index = iter->second;
-      return modify(state->storage[index].record);
+      return writeRecord(ino, [&]() -> T {
+        return Codec::modify(state->storage[index].record, modify);
+      });
     }
 
     size_t index = state->storage.size();
-    state->storage.emplace_back(ino, record);
-    state->indices.emplace(ino, index);
-    return result(state->storage[index].record);
+    {
+      auto version = beginStructureChange();
+      SCOPE_EXIT {
+        endStructureChange(version);
+      };
+      state->storage.emplace_back(ino, Codec::encode(record));
+      // Growing may have moved the records.  Publish them before the index
+      // entry that refers to them.
+      records_.store(state->storage.begin(), std::memory_order_release);
+      indices_.insert(ino, index);
+    }
+    noteUpdate(*state);
+    Record inserted{Codec::decode(state->storage[index].record)};
+    return result(inserted);
   }
 
   struct State {
-    State(MappedDiskVector<Entry>&& mdv) : storage{std::move(mdv)} {
-      for (size_t i = 0; i < storage.size(); ++i) {
-        const Entry& entry = storage[i];
-        auto ret = indices.insert({entry.inode, i});
-        if (!ret.second) {
-          XLOG(WARNING) << "Duplicate records for the same inode: indices "
-                        << indices[entry.inode] << " and " << i;
-          continue;
-        }
-      }
-    }
+    explicit State(MappedDiskVector<Entry>&& mdv) : storage{std::move(mdv)} {}
 
     /**
      * Holds the actual records, indexed by the values in indices_. The
@@ -303,18 +655,82 @@ class InodeTable {
      */
     mutable MappedDiskVector<Entry> storage;
 
-    /// Maintains an index from inode number to index in storage_.
-    std::unordered_map<InodeNumber, size_t> indices;
+    uint64_t recordsCompacted{0};
+    uint64_t bytesReleased{0};
   };
 
+  /**
+   * Give back the unused capacity if more than maxFragmentation_ of it is
+   * unused.  Called after records are removed, without the lock held.
+   */
+  void maybeReleaseCapacity() {
+    if (maxFragmentation_ <= 0) {
+      return;
+    }
+    auto isFragmented = [&](const State& state) {
+      return state.storage.getReleasableBytes() > 0 &&
+          state.storage.size() <
+          (1.0 - maxFragmentation_) * state.storage.backedCapacity();
+    };
+    if (!state_.withRLock(isFragmented)) {
+      return;
+    }
+    state_.withWLock([&](auto& state) {
+      if (isFragmented(state)) {
+        state.bytesReleased += state.storage.releaseUnusedCapacity();
+      }
+    });
+  }
+
+  /**
+   * Called with at least the rlock held after a record is modified.  Every
+   * flushInterval_ updates, starts writing the table back to disk so that
+   * dirty pages do not pile up until the kernel decides to flush them all at
+   * once.
+   */
+  void noteUpdate(const State& state) {
+    if (flushInterval_ == 0) {
+      return;
+    }
+    auto updates =
+        1 + updatesSinceFlush_.fetch_add(1, std::memory_order_relaxed);
+    if (updates % flushInterval_ == 0) {
+      state.storage.flushAsync();
+    }
+  }
+
+  const size_t flushInterval_;
+  const double maxFragmentation_;
+  std::atomic<size_t> updatesSinceFlush_{0};
+
+  /**
+   * Maps inode numbers to indices into the storage.  Only modified with the
+   * state_ write lock held, but searched without it.
+   */
+  folly::ConcurrentHashMap<InodeNumber, size_t> indices_;
+
+  /// The start of the storage's records, for lock-free readers.
+  std::atomic<const Entry*> records_{nullptr};
+
+  /// Odd while records are being added, removed or moved.
+  std::atomic<uint64_t> structureVersion_{0};
+
+  std::array<RecordStripe, kRecordStripes> stripes_;
+
   folly::Synchronized<State> state_;
 }; // namespace eden
 
 static_assert(
     sizeof(InodeMetadata) == 40,
     "Don't change InodeMetadata without implementing a migration path");
+static_assert(
+    sizeof(PackedInodeMetadata) == 32,
+    "Don't change PackedInodeMetadata without implementing a migration path");
+static_assert(
+    sizeof(detail::InodeTableEntry<PackedInodeMetadata>) == 40,
+    "PackedInodeMetadata entries should not be padded");
 
-using InodeMetadataTable = InodeTable<InodeMetadata>;
+using InodeMetadataTable = InodeTable<InodeMetadata, PackedInodeMetadata>;
 
 } // namespace eden
 } // namespace facebook
@@ -144,8 +144,16 @@ void InodeTimestamps::setattrTimes(
 
   // we do not allow users to set ctime using setattr. ctime should be changed
   // when ever setattr is called, as this function is called in setattr, update
-  // ctime to now.
-  ctime = now;
+  // ctime to now.  The exception is the kernel itself, which sends FATTR_CTIME
+  // in writeback cache mode to flush the ctime of writes it has cached.
+  if (attr.valid & FATTR_CTIME) {
+    timespec attr_ctime;
+    attr_ctime.tv_sec = attr.ctime;
+    attr_ctime.tv_nsec = attr.ctimensec;
+    ctime = attr_ctime;
+  } else {
+    ctime = now;
+  }
 }
 
 void InodeTimestamps::applyToStat(struct stat& st) const {
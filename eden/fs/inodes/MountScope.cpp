@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/MountScope.h"
+
+#include <algorithm>
+
+namespace facebook {
+namespace eden {
+
+MountScope::MountScope(const std::vector<RelativePath>& includes) {
+  if (std::any_of(includes.begin(), includes.end(), [](const auto& path) {
+        return path.empty();
+      })) {
+    return;
+  }
+  for (const auto& path : includes) {
+    addInclude(path);
+  }
+}
+
+bool MountScope::covers(RelativePathPiece path) const {
+  return std::any_of(
+      includes_.begin(), includes_.end(), [path](const auto& include) {
+        return path == include || path.isSubDirOf(include);
+      });
+}
+
+bool MountScope::addInclude(RelativePathPiece path) {
+  if (covers(path)) {
+    return false;
+  }
+  // Drop any includes that the new one subsumes.
+  includes_.erase(
+      std::remove_if(
+          includes_.begin(),
+          includes_.end(),
+          [path](const auto& include) { return include.isSubDirOf(path); }),
+      includes_.end());
+  includes_.emplace_back(path);
+  return true;
+}
+
+bool MountScope::isOutside(RelativePathPiece dir) const {
+  if (!isRestricted() || dir.empty()) {
+    return false;
+  }
+  for (const auto& include : includes_) {
+    if (dir == include || dir.isSubDirOf(include) ||
+        dir.isParentDirOf(include)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MountScope::widen(const std::vector<RelativePath>& paths) {
+  if (!isRestricted()) {
+    return false;
+  }
+
+  bool changed = false;
+  for (const auto& path : paths) {
+    if (path.empty()) {
+      includes_.clear();
+      return true;
+    }
+    changed |= addInclude(path);
+  }
+  return changed;
+}
+
+} // namespace eden
+} // namespace facebook
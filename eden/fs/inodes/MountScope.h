@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <vector>
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * MountScope records the directories of a checkout that a user has asked to
+ * work in.
+ *
+ * A scope is a list of included directories.  The included directories and
+ * everything below them are visible, as are the directories leading to them.
+ * Any other directory is outside of the scope: it still appears in its
+ * parent's listing, but its own contents appear empty, so crawlers stop at
+ * the scope boundary instead of loading the whole repository.
+ *
+ * A scope with no includes is unrestricted.
+ */
+class MountScope {
+ public:
+  MountScope() = default;
+  explicit MountScope(const std::vector<RelativePath>& includes);
+
+  /**
+   * Returns true if this scope hides any part of the checkout.
+   */
+  bool isRestricted() const {
+    return !includes_.empty();
+  }
+
+  /**
+   * Returns true if the contents of the given directory should be hidden.
+   */
+  bool isOutside(RelativePathPiece dir) const;
+
+  /**
+   * Add the given directories to the scope.  Including the root of the
+   * checkout makes the scope unrestricted.
+   *
+   * Returns true if the scope changed.
+   */
+  bool widen(const std::vector<RelativePath>& paths);
+
+  /**
+   * Returns the included directories.  None of them is inside another.
+   */
+  const std::vector<RelativePath>& getIncludes() const {
+    return includes_;
+  }
+
+ private:
+  /**
+   * Returns true if the given path is included by the scope.
+   */
+  bool covers(RelativePathPiece path) const;
+
+  /**
+   * Add a non-root directory to the includes, returning false if it was
+   * already covered.
+   */
+  bool addInclude(RelativePathPiece path);
+
+  std::vector<RelativePath> includes_;
+};
+
+} // namespace eden
+} // namespace facebook
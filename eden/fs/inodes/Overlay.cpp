@@ -10,19 +10,93 @@
 #include "eden/fs/inodes/Overlay.h"
 
 #include <boost/filesystem.hpp>
+#include <folly/Conv.h>
 #include <folly/Exception.h>
 #include <folly/File.h>
 #include <folly/FileUtil.h>
 #include <folly/Range.h>
+#include <folly/futures/Future.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/logging/xlog.h>
+#include <folly/system/ThreadName.h>
+#include <gflags/gflags.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 #include <algorithm>
+#include <functional>
+#include <unordered_set>
+#include "eden/fs/inodes/CompactOverlayDir.h"
 #include "eden/fs/inodes/DirEntry.h"
 #include "eden/fs/inodes/InodeMap.h"
 #include "eden/fs/inodes/InodeTable.h"
+#include "eden/fs/inodes/SqliteOverlayDirStore.h"
 #include "eden/fs/utils/PathFuncs.h"
+#include "eden/fs/utils/TraceBuffer.h"
+
+DEFINE_bool(
+    overlay_dirs_in_sqlite,
+    false,
+    "Store the directory records of newly created overlays in a single "
+    "sqlite database rather than one file per directory.  Existing overlays "
+    "keep using the format they were created with.");
+
+DEFINE_uint64(
+    overlay_small_file_max_size,
+    0,
+    "Pack materialized files no larger than this many bytes into a single "
+    "sqlite database when their inodes are unloaded, rather than keeping one "
+    "overlay file per file.  Packed files are moved back into their own "
+    "overlay file when opened.  Zero stops packing new files.");
+
+DEFINE_uint64(
+    overlay_inode_reservation,
+    1 << 16,
+    "How many inode numbers the overlay reserves at a time in its inode "
+    "checkpoint, so that after an unclean shutdown it can continue past the "
+    "reserved numbers instead of scanning the whole overlay.  Zero disables "
+    "the checkpoint.");
+
+DEFINE_bool(
+    inode_table_huge_pages,
+    false,
+    "Ask for the inode metadata table to be mapped with transparent huge "
+    "pages");
+DEFINE_uint64(
+    inode_table_address_space_mb,
+    16384,
+    "Address space to reserve for the inode metadata table, in megabytes.  "
+    "The table can grow this large without being remapped.");
+DEFINE_double(
+    inode_table_max_fragmentation,
+    0.5,
+    "Give back the disk space and memory of the unused slots at the end of "
+    "the inode metadata table once more than this fraction of its slots are "
+    "unused.  Zero never gives them back.");
+DEFINE_uint64(
+    inode_table_flush_interval,
+    10000,
+    "Start writing the inode metadata table back to disk after this many "
+    "updates.  Zero leaves it to the kernel.");
+
+DEFINE_int32(
+    overlay_gc_threads,
+    4,
+    "The number of threads each overlay uses to remove the data of deleted "
+    "directory trees.");
+
+DEFINE_int32(
+    overlay_dir_write_delay_ms,
+    0,
+    "If nonzero, buffer overlay directory records for up to this long so "
+    "that repeated saves of a directory are coalesced and written in "
+    "batches.  Records buffered when edenfs crashes are lost.");
+
+DEFINE_uint64(
+    overlay_syncfs_min_files,
+    8,
+    "When at least this many overlay files are waiting to be fsynced at "
+    "once, sync the whole overlay filesystem with syncfs() rather than "
+    "each file on its own.  Zero never uses syncfs().");
 
 namespace facebook {
 namespace eden {
@@ -44,6 +118,20 @@ using std::string;
 constexpr StringPiece kInfoFile{"info"};
 constexpr StringPiece kMetadataFile{"metadata.table"};
 constexpr const char* kNextInodeNumberFile{"next-inode-number"};
+constexpr const char* kInodeCheckpointFile{"next-inode-checkpoint"};
+constexpr StringPiece kDirStoreFile{"dirs.db"};
+constexpr StringPiece kSmallFileStoreFile{"files.db"};
+
+/**
+ * The number of buffered directory writes at which the writer thread starts
+ * writing without waiting out the rest of the write delay.
+ */
+constexpr size_t kMaxPendingWrites = 10000;
+
+/**
+ * The maximum number of directories a GC thread takes from the queue at once.
+ */
+constexpr size_t kGCBatchSize = 256;
 
 /**
  * 4-byte magic identifier to put at the start of the info file.
@@ -82,13 +170,24 @@ void formatSubdirPath(MutableStringPiece subdirPath, uint64_t inode) {
 constexpr folly::StringPiece Overlay::kHeaderIdentifierDir;
 constexpr folly::StringPiece Overlay::kHeaderIdentifierFile;
 constexpr uint32_t Overlay::kHeaderVersion;
+constexpr uint32_t Overlay::kDirHeaderVersion;
 constexpr size_t Overlay::kHeaderLength;
 
-Overlay::Overlay(AbsolutePathPiece localDir) : localDir_(localDir) {
+Overlay::Overlay(AbsolutePathPiece localDir)
+    : localDir_(localDir),
+      writeDelay_(std::max(FLAGS_overlay_dir_write_delay_ms, 0)),
+      inodeReservationSize_(FLAGS_overlay_inode_reservation) {
   initOverlay();
   tryLoadNextInodeNumber();
+  tryLoadInodeCheckpoint();
 
-  gcThread_ = std::thread([this] { gcThread(); });
+  auto numGCThreads = std::max(FLAGS_overlay_gc_threads, 1);
+  for (int n = 0; n < numGCThreads; ++n) {
+    gcThreads_.emplace_back([this] { gcThread(); });
+  }
+  if (isBufferingWrites()) {
+    writerThread_ = std::thread([this] { writerThread(); });
+  }
 }
 
 Overlay::~Overlay() {
@@ -96,7 +195,10 @@ Overlay::~Overlay() {
 }
 
 void Overlay::close() {
-  CHECK_NE(std::this_thread::get_id(), gcThread_.get_id());
+  for (const auto& thread : gcThreads_) {
+    CHECK_NE(std::this_thread::get_id(), thread.get_id());
+  }
+  CHECK_NE(std::this_thread::get_id(), writerThread_.get_id());
 
   if (!infoFile_) {
     return;
@@ -104,17 +206,42 @@ void Overlay::close() {
 
   // Make sure everything is shut down in reverse of construction order.
 
+  closing_.store(true, std::memory_order_relaxed);
+  if (verifyThread_.joinable()) {
+    verifyThread_.join();
+  }
+  if (checkThread_.joinable()) {
+    checkThread_.join();
+  }
+
   gcQueue_.lock()->stop = true;
-  gcCondVar_.notify_one();
-  gcThread_.join();
+  gcCondVar_.notify_all();
+  for (auto& thread : gcThreads_) {
+    thread.join();
+  }
+  gcThreads_.clear();
+
+  // The writer thread writes out everything still buffered before exiting.
+  if (writerThread_.joinable()) {
+    writeQueue_.lock()->stop = true;
+    writeCondVar_.notify_one();
+    writerThread_.join();
+  }
 
   saveNextInodeNumber();
 
+  dirStore_.reset();
+  smallFileStore_.reset();
   inodeMetadataTable_.reset();
   dirFile_.close();
   infoFile_.close();
 }
 
+void Overlay::initNextInodeNumber(uint64_t nextInodeNumber) {
+  nextInodeNumber_.store(nextInodeNumber, std::memory_order_relaxed);
+  initialNextInodeNumber_ = nextInodeNumber;
+}
+
 bool Overlay::hasInitializedNextInodeNumber() const {
   // nextInodeNumber_ is either 0 (uninitialized) or nonzero (initialized).
   // It's only initialized on one thread, so relaxed loads are okay.
@@ -124,12 +251,15 @@ bool Overlay::hasInitializedNextInodeNumber() const {
 void Overlay::initOverlay() {
   // Read the info file.
   auto infoPath = localDir_ + PathComponentPiece{kInfoFile};
+  auto dirStorePath = localDir_ + PathComponentPiece{kDirStoreFile};
+  bool useDirStore = false;
   int fd = folly::openNoInt(infoPath.value().c_str(), O_RDONLY | O_CLOEXEC);
   if (fd >= 0) {
     // This is an existing overlay directory.
     // Read the info file and make sure we are compatible with its version.
     infoFile_ = File{fd, /* ownsFd */ true};
     readExistingOverlay(infoFile_.fd());
+    useDirStore = 0 == access(dirStorePath.c_str(), F_OK);
   } else if (errno != ENOENT) {
     folly::throwSystemError(
         "error reading eden overlay info file ", infoPath.stringPiece());
@@ -137,6 +267,7 @@ void Overlay::initOverlay() {
     // This is a brand new overlay directory.
     initNewOverlay();
     infoFile_ = File{infoPath.value().c_str(), O_RDONLY | O_CLOEXEC};
+    useDirStore = FLAGS_overlay_dirs_in_sqlite;
   }
 
   if (!infoFile_.try_lock()) {
@@ -158,8 +289,26 @@ void Overlay::initOverlay() {
 
   // Open after infoFile_'s lock is acquired because the InodeTable acquires
   // its own lock, which should be released prior to infoFile_.
-  inodeMetadataTable_ = InodeMetadataTable::open(
-      (localDir_ + PathComponentPiece{kMetadataFile}).c_str());
+  MappedDiskVectorOptions tableOptions;
+  tableOptions.hugePages = FLAGS_inode_table_huge_pages;
+  tableOptions.addressSpaceReservation =
+      FLAGS_inode_table_address_space_mb << 20;
+  inodeMetadataTable_ = InodeMetadataTable::open<InodeMetadata>(
+      (localDir_ + PathComponentPiece{kMetadataFile}).c_str(),
+      tableOptions,
+      FLAGS_inode_table_flush_interval,
+      FLAGS_inode_table_max_fragmentation);
+
+  if (useDirStore) {
+    dirStore_ = std::make_unique<SqliteOverlayDirStore>(dirStorePath);
+  }
+
+  auto smallFileStorePath = localDir_ + PathComponentPiece{kSmallFileStoreFile};
+  if (FLAGS_overlay_small_file_max_size > 0 ||
+      0 == access(smallFileStorePath.c_str(), F_OK)) {
+    smallFileStore_ =
+        std::make_unique<SqliteOverlayDirStore>(smallFileStorePath);
+  }
 }
 
 void Overlay::tryLoadNextInodeNumber() {
@@ -207,7 +356,7 @@ void Overlay::tryLoadNextInodeNumber() {
     return;
   }
 
-  nextInodeNumber_.store(nextInodeNumber, std::memory_order_relaxed);
+  initNextInodeNumber(nextInodeNumber);
 }
 
 void Overlay::saveNextInodeNumber() {
@@ -227,6 +376,81 @@ void Overlay::saveNextInodeNumber() {
           reinterpret_cast<const uint8_t*>(&nextInodeNumber + 1)));
 }
 
+void Overlay::tryLoadInodeCheckpoint() {
+  auto path = localDir_ + PathComponentPiece{kInodeCheckpointFile};
+  std::string data;
+  if (!folly::readFile(path.c_str(), data)) {
+    if (errno != ENOENT) {
+      XLOG(WARN) << "Failed to read " << kInodeCheckpointFile << ": "
+                 << folly::errnoStr(errno);
+    }
+    return;
+  }
+
+  // The checkpoint holds the generation followed by the reserved number.
+  std::array<uint64_t, 2> checkpoint;
+  if (data.size() != sizeof(checkpoint)) {
+    XLOG(WARN) << "Ignoring " << kInodeCheckpointFile << " of unexpected size "
+               << data.size();
+    return;
+  }
+  memcpy(checkpoint.data(), data.data(), sizeof(checkpoint));
+  checkpointGeneration_ = checkpoint[0];
+  auto reservedInodeNumber = checkpoint[1];
+
+  if (hasInitializedNextInodeNumber()) {
+    return;
+  }
+  if (reservedInodeNumber <= kRootNodeId.get()) {
+    XLOG(WARN) << "Invalid reserved inode number " << reservedInodeNumber
+               << ". Full overlay scan required.";
+    return;
+  }
+
+  XLOG(INFO) << "Overlay " << localDir_
+             << " was not shut down cleanly; continuing from inode number "
+             << reservedInodeNumber << " reserved by checkpoint generation "
+             << checkpointGeneration_;
+  initNextInodeNumber(reservedInodeNumber);
+  recoveredFromCheckpoint_ = true;
+}
+
+void Overlay::reserveInodeNumbers(uint64_t inodeNumber) {
+  std::lock_guard<std::mutex> guard(checkpointMutex_);
+  if (inodeNumber < reservedInodeNumber_.load(std::memory_order_acquire)) {
+    // Another thread reserved it first.
+    return;
+  }
+  auto reservationSize = inodeReservationSize_.load(std::memory_order_relaxed);
+  if (reservationSize == 0) {
+    return;
+  }
+
+  auto path = localDir_ + PathComponentPiece{kInodeCheckpointFile};
+  std::array<uint64_t, 2> checkpoint{
+      {checkpointGeneration_ + 1, inodeNumber + 1 + reservationSize}};
+  try {
+    folly::writeFileAtomic(
+        path.stringPiece(),
+        ByteRange(
+            reinterpret_cast<const uint8_t*>(checkpoint.data()),
+            sizeof(checkpoint)));
+  } catch (const std::exception& e) {
+    // An out of date checkpoint would let inode numbers be reused after a
+    // crash, so remove it and fall back to scanning.
+    XLOG(ERR) << "Failed to write " << kInodeCheckpointFile
+              << ", disabling inode checkpoints: " << e.what();
+    inodeReservationSize_.store(0, std::memory_order_relaxed);
+    if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+      XLOG(ERR) << "Failed to remove " << kInodeCheckpointFile << ": "
+                << folly::errnoStr(errno);
+    }
+    return;
+  }
+  checkpointGeneration_ = checkpoint[0];
+  reservedInodeNumber_.store(checkpoint[1], std::memory_order_release);
+}
+
 void Overlay::readExistingOverlay(int infoFD) {
   // Read the info file header
   std::array<uint8_t, kInfoHeaderSize> infoHeader;
@@ -298,7 +522,7 @@ void Overlay::initNewOverlay() {
       infoPath.stringPiece(), ByteRange(infoHeader.data(), infoHeader.size()));
 
   // kRootNodeId is reserved - start at the next one. No scan is necessary.
-  nextInodeNumber_.store(kRootNodeId.get() + 1, std::memory_order_relaxed);
+  initNextInodeNumber(kRootNodeId.get() + 1);
 }
 
 void Overlay::ensureTmpDirectoryIsCreated() {
@@ -336,23 +560,46 @@ InodeNumber Overlay::allocateInodeNumber() {
   // might on ARM.
   auto previous = nextInodeNumber_++;
   DCHECK_NE(0, previous) << "allocateInodeNumber called before initialize";
+  if (UNLIKELY(
+          previous >= reservedInodeNumber_.load(std::memory_order_acquire))) {
+    reserveInodeNumbers(previous);
+  }
   return InodeNumber{previous};
 }
 
 Optional<std::pair<DirContents, InodeTimestamps>> Overlay::loadOverlayDir(
     InodeNumber inodeNumber) {
+  std::string serializedData;
+  {
+    TraceScope trace{TraceEventKind::OVERLAY_READ, inodeNumber.get()};
+    if (!readOverlayDirRecord(inodeNumber, serializedData)) {
+      return folly::none;
+    }
+  }
+
   InodeTimestamps timestamps;
-  auto dirData = deserializeOverlayDir(inodeNumber, timestamps);
-  if (!dirData.hasValue()) {
-    return folly::none;
+  StringPiece contents{serializedData};
+  auto version = parseHeader(
+      contents.subpiece(0, kHeaderLength), kHeaderIdentifierDir, timestamps);
+  contents.advance(kHeaderLength);
+
+  // Records in the compact format are decoded straight into DirContents.
+  if (version == kDirHeaderVersion) {
+    return std::pair<DirContents, InodeTimestamps>{
+        deserializeCompactOverlayDir(contents), timestamps};
   }
-  const auto& dir = dirData.value();
+
+  // Older records are a serialized overlay::OverlayDir.
+  auto dir = CompactSerializer::deserialize<overlay::OverlayDir>(contents);
 
   bool shouldMigrateToNewFormat = false;
 
   DirContents result;
+  result.reserve(dir.entries.size());
   for (auto& iter : dir.entries) {
-    const auto& name = iter.first;
+    // These names were PathComponents when saveOverlayDir() wrote them, so
+    // there is no need to check them again for every directory loaded.
+    const PathComponentPiece name{iter.first, detail::SkipPathSanityCheck()};
     const auto& value = iter.second;
 
     bool isMaterialized = !value.__isset.hash || value.hash.empty();
@@ -365,10 +612,10 @@ Optional<std::pair<DirContents, InodeTimestamps>> Overlay::loadOverlayDir(
     }
 
     if (isMaterialized) {
-      result.emplace(PathComponentPiece{name}, value.mode, ino);
+      result.emplace(name, value.mode, ino);
     } else {
       auto hash = Hash{folly::ByteRange{folly::StringPiece{value.hash}}};
-      result.emplace(PathComponentPiece{name}, value.mode, ino, hash);
+      result.emplace(name, value.mode, ino, hash);
     }
   }
 
@@ -388,43 +635,58 @@ void Overlay::saveOverlayDir(
       << "saveOverlayDir called with unallocated inode number";
 
   // TODO: T20282158 clean up access of child inode information.
-  //
-  // Translate the data to the thrift equivalents
-  overlay::OverlayDir odir;
-
+  std::vector<InodeNumber> materializedDirs;
   for (auto& entIter : dir) {
-    const auto& entName = entIter.first;
     const auto& ent = entIter.second;
 
     CHECK_LT(ent.getInodeNumber().get(), nextInodeNumber)
         << "saveOverlayDir called with entry using unallocated inode number";
 
-    overlay::OverlayEntry oent;
-    oent.mode = ent.getModeUnsafe();
-    oent.inodeNumber = ent.getInodeNumber().get();
-    bool isMaterialized = ent.isMaterialized();
-    if (!isMaterialized) {
-      auto entHash = ent.getHash();
-      auto bytes = entHash.getBytes();
-      oent.set_hash(std::string{reinterpret_cast<const char*>(bytes.data()),
-                                bytes.size()});
+    if (ent.isMaterialized() && ent.isDirectory()) {
+      materializedDirs.push_back(ent.getInodeNumber());
     }
-
-    odir.entries.emplace(
-        std::make_pair(entName.stringPiece().str(), std::move(oent)));
   }
 
-  // Ask thrift to serialize it.
-  auto serializedData = CompactSerializer::serialize<std::string>(odir);
+  auto serializedData = serializeCompactOverlayDir(dir);
 
   // Add header to the overlay directory.
-  auto header = createHeader(kHeaderIdentifierDir, kHeaderVersion, timestamps);
+  auto header =
+      createHeader(kHeaderIdentifierDir, kDirHeaderVersion, timestamps);
+
+  if (!isBufferingWrites()) {
+    writeOverlayDir(
+        inodeNumber, ByteRange{header}, ByteRange{StringPiece{serializedData}});
+    return;
+  }
+
+  PendingWrite write;
+  write.record.reserve(header.size() + serializedData.size());
+  write.record.append(
+      reinterpret_cast<const char*>(header.data()), header.size());
+  write.record.append(serializedData);
+  write.materializedDirs = std::move(materializedDirs);
+  {
+    auto queue = writeQueue_.lock();
+    queue->pending[inodeNumber] = std::move(write);
+  }
+  writeCondVar_.notify_one();
+}
+
+void Overlay::writeOverlayDir(
+    InodeNumber inodeNumber,
+    ByteRange header,
+    ByteRange contents) {
+  TraceScope trace{TraceEventKind::OVERLAY_WRITE, inodeNumber.get()};
+  if (dirStore_) {
+    dirStore_->save(inodeNumber, header, contents);
+    return;
+  }
 
   std::array<struct iovec, 2> iov;
-  iov[0].iov_base = header.data();
+  iov[0].iov_base = const_cast<uint8_t*>(header.data());
   iov[0].iov_len = header.size();
-  iov[1].iov_base = const_cast<char*>(serializedData.data());
-  iov[1].iov_len = serializedData.size();
+  iov[1].iov_base = const_cast<uint8_t*>(contents.data());
+  iov[1].iov_len = contents.size();
   (void)createOverlayFileImpl(inodeNumber, iov.data(), iov.size());
 }
 
@@ -432,6 +694,32 @@ void Overlay::removeOverlayData(InodeNumber inodeNumber) {
   // TODO: batch request during GC
   getInodeMetadataTable()->freeInode(inodeNumber);
 
+  if (isBufferingWrites()) {
+    {
+      auto queue = writeQueue_.lock();
+      auto& write = queue->pending[inodeNumber];
+      write.record.clear();
+      write.materializedDirs.clear();
+      write.removed = true;
+    }
+    writeCondVar_.notify_one();
+    return;
+  }
+
+  // An inode is either a directory or a file, so if the dir store had a
+  // record there is no file to remove.
+  if (dirStore_ && dirStore_->remove(inodeNumber)) {
+    XLOG(DBG4) << "removed overlay dir for inode " << inodeNumber;
+    return;
+  }
+  removeOverlayFile(inodeNumber);
+}
+
+void Overlay::removeOverlayFile(InodeNumber inodeNumber) {
+  if (smallFileStore_ && smallFileStore_->remove(inodeNumber)) {
+    XLOG(DBG4) << "removed packed overlay data for inode " << inodeNumber;
+    return;
+  }
   auto path = getFilePath(inodeNumber);
   int result = ::unlinkat(dirFile_.fd(), path.c_str(), 0);
   if (result == 0) {
@@ -462,15 +750,157 @@ void Overlay::recursivelyRemoveOverlayData(InodeNumber inodeNumber) {
 folly::Future<folly::Unit> Overlay::flushPendingAsync() {
   folly::Promise<folly::Unit> promise;
   auto future = promise.getFuture();
-  gcQueue_.lock()->queue.emplace_back(std::move(promise));
+  gcQueue_.lock()->flushes.push_back(std::move(promise));
   gcCondVar_.notify_one();
+  if (!isBufferingWrites()) {
+    return future;
+  }
+  // The GC buffers removals of its own, so wait for it before flushing.
+  return std::move(future).then([this] { return flushPendingWrites(); });
+}
+
+folly::Future<folly::Unit> Overlay::flushPendingWrites() {
+  folly::Promise<folly::Unit> promise;
+  auto future = promise.getFuture();
+  writeQueue_.lock()->flushes.push_back(std::move(promise));
+  writeCondVar_.notify_one();
   return future;
 }
 
+const Overlay::PendingWrite* Overlay::findPendingWrite(
+    const WriteQueue& queue,
+    InodeNumber inodeNumber) {
+  auto it = queue.pending.find(inodeNumber);
+  if (it != queue.pending.end()) {
+    return &it->second;
+  }
+  it = queue.inFlight.find(inodeNumber);
+  if (it != queue.inFlight.end()) {
+    return &it->second;
+  }
+  return nullptr;
+}
+
+void Overlay::writerThread() noexcept {
+  for (;;) {
+    std::vector<folly::Promise<folly::Unit>> flushes;
+    {
+      auto lock = writeQueue_.lock();
+      while (lock->pending.empty() && lock->flushes.empty()) {
+        if (lock->stop) {
+          return;
+        }
+        writeCondVar_.wait(lock.getUniqueLock());
+      }
+
+      // Let further saves of the same directories coalesce with these,
+      // unless someone is waiting for them or the buffer is full.
+      writeCondVar_.wait_for(lock.getUniqueLock(), writeDelay_, [&] {
+        return lock->stop || !lock->flushes.empty() ||
+            lock->pending.size() >= kMaxPendingWrites;
+      });
+
+      lock->inFlight.swap(lock->pending);
+      flushes.swap(lock->flushes);
+    }
+
+    // inFlight is only modified by this thread, so it can be read here
+    // without holding the lock.
+    writeBatch(writeQueue_.unsafeGetUnlocked().inFlight);
+    writeQueue_.lock()->inFlight.clear();
+
+    for (auto& flush : flushes) {
+      flush.setValue();
+    }
+  }
+}
+
+void Overlay::writeBatch(const PendingWrites& writes) {
+  std::vector<InodeNumber> order;
+  order.reserve(writes.size());
+  std::unordered_set<InodeNumber> visited;
+  std::function<void(InodeNumber)> visit = [&](InodeNumber inodeNumber) {
+    auto it = writes.find(inodeNumber);
+    if (it == writes.end() || !visited.insert(inodeNumber).second) {
+      return;
+    }
+    for (auto child : it->second.materializedDirs) {
+      visit(child);
+    }
+    order.push_back(inodeNumber);
+  };
+  for (const auto& entry : writes) {
+    visit(entry.first);
+  }
+
+  std::vector<InodeNumber> removals;
+  std::vector<std::pair<InodeNumber, ByteRange>> records;
+  for (auto inodeNumber : order) {
+    const auto& write = writes.at(inodeNumber);
+    if (write.removed) {
+      removals.push_back(inodeNumber);
+      continue;
+    }
+    if (dirStore_) {
+      // Committed together below.
+      records.emplace_back(inodeNumber, ByteRange{StringPiece{write.record}});
+      continue;
+    }
+    try {
+      ByteRange record{StringPiece{write.record}};
+      writeOverlayDir(
+          inodeNumber,
+          record.subpiece(0, kHeaderLength),
+          record.subpiece(kHeaderLength));
+    } catch (const std::exception& e) {
+      XLOG(ERR) << "Failed to write overlay data for inode " << inodeNumber
+                << ": " << e.what();
+    }
+  }
+
+  if (!records.empty()) {
+    try {
+      dirStore_->save(records);
+    } catch (const std::exception& e) {
+      XLOG(ERR) << "Failed to write overlay data for " << records.size()
+                << " directories: " << e.what();
+    }
+  }
+
+  if (dirStore_ && !removals.empty()) {
+    try {
+      dirStore_->remove(removals);
+    } catch (const std::exception& e) {
+      XLOG(ERR) << "Failed to remove overlay data for " << removals.size()
+                << " directories: " << e.what();
+    }
+  }
+  for (auto inodeNumber : removals) {
+    try {
+      removeOverlayFile(inodeNumber);
+    } catch (const std::exception& e) {
+      XLOG(ERR) << "Failed to remove overlay data for inode " << inodeNumber
+                << ": " << e.what();
+    }
+  }
+}
+
 bool Overlay::hasOverlayData(InodeNumber inodeNumber) {
   // TODO: It might be worth maintaining a memory-mapped set to rapidly
   // query whether the overlay has an entry for a particular inode.  As it is,
   // this function requires a syscall to see if the overlay has an entry.
+  if (isBufferingWrites()) {
+    auto queue = writeQueue_.lock();
+    if (auto write = findPendingWrite(*queue, inodeNumber)) {
+      return !write->removed;
+    }
+  }
+  if (dirStore_ && dirStore_->has(inodeNumber)) {
+    return true;
+  }
+  if (smallFileStore_ && smallFileStore_->has(inodeNumber)) {
+    return true;
+  }
   auto path = getFilePath(inodeNumber);
   struct stat st;
   if (0 == fstatat(dirFile_.fd(), path.c_str(), &st, AT_SYMLINK_NOFOLLOW)) {
@@ -487,16 +917,67 @@ InodeNumber Overlay::scanForNextInodeNumber() {
     return InodeNumber{ino - 1};
   }
 
-  // TODO: We should probably store the max inode number in the header file
-  // during graceful unmount.  When opening an overlay we can then simply read
-  // back the max inode number from this file if the overlay was shut down
-  // cleanly last time.
-  //
-  // We would only then need to do a scan if the overlay was not cleanly shut
-  // down.
-  //
-  // For now we always do a scan.
+  // Neither a clean shutdown nor the inode checkpoint told us the next inode
+  // number, so scan the overlay for it.
+  auto maxInode = findMaxInodeNumber();
+  initNextInodeNumber(maxInode.get() + 1);
+
+  return maxInode;
+}
+
+void Overlay::verifyNextInodeNumberInBackground() {
+  if (!recoveredFromCheckpoint_) {
+    return;
+  }
+  verifyThread_ = std::thread([this] {
+    folly::setThreadName("OverlayVerify");
+    auto maxInode = findMaxInodeNumber();
+    if (closing_.load(std::memory_order_relaxed)) {
+      return;
+    }
 
+    auto next = nextInodeNumber_.load(std::memory_order_acquire);
+    while (maxInode.get() >= next) {
+      // This means a checkpoint was lost or an inode number was allocated
+      // without one.  Make sure the number is not handed out again.
+      XLOG(ERR) << "Overlay " << localDir_ << " contains inode number "
+                << maxInode << " but the inode checkpoint only reserved up to "
+                << next;
+      if (nextInodeNumber_.compare_exchange_weak(
+              next, maxInode.get() + 1, std::memory_order_acq_rel)) {
+        break;
+      }
+    }
+    XLOG(DBG2) << "finished verifying the next inode number of " << localDir_;
+  });
+}
+
+folly::Future<OverlayChecker::Result> Overlay::checkInBackground(
+    OverlayChecker::Options options) {
+  std::lock_guard<std::mutex> guard(checkMutex_);
+  if (checkRunning_) {
+    return folly::makeFuture<OverlayChecker::Result>(std::runtime_error(
+        folly::to<string>("a check of overlay ", localDir_, " is running")));
+  }
+  if (checkThread_.joinable()) {
+    checkThread_.join();
+  }
+
+  checkRunning_ = true;
+  folly::Promise<OverlayChecker::Result> promise;
+  auto future = promise.getFuture();
+  checkThread_ = std::thread([this,
+                              options = std::move(options),
+                              promise = std::move(promise)]() mutable {
+    folly::setThreadName("OverlayCheck");
+    promise.setWith([&] { return OverlayChecker{this, options}.run(); });
+    std::lock_guard<std::mutex> guard(checkMutex_);
+    checkRunning_ = false;
+  });
+  return future;
+}
+
+InodeNumber Overlay::findMaxInodeNumber() {
   // Walk the root directory downwards to find all (non-unlinked) directory
   // inodes stored in the overlay.
   //
@@ -508,6 +989,9 @@ InodeNumber Overlay::scanForNextInodeNumber() {
   std::vector<InodeNumber> toProcess;
   toProcess.push_back(maxInode);
   while (!toProcess.empty()) {
+    if (closing_.load(std::memory_order_relaxed)) {
+      return maxInode;
+    }
     auto dirInodeNumber = toProcess.back();
     toProcess.pop_back();
 
@@ -547,8 +1031,11 @@ InodeNumber Overlay::scanForNextInodeNumber() {
       }
     }
   }
-
-  nextInodeNumber_.store(maxInode.get() + 1, std::memory_order_relaxed);
+  if (smallFileStore_) {
+    for (auto ino : smallFileStore_->getAllInodeNumbers()) {
+      maxInode = std::max(maxInode, ino);
+    }
+  }
 
   return maxInode;
 }
@@ -566,17 +1053,17 @@ Overlay::InodePath Overlay::getFilePath(InodeNumber inodeNumber) {
   return outPath;
 }
 
-Optional<overlay::OverlayDir> Overlay::deserializeOverlayDir(
+bool Overlay::readOverlayFile(
+    const InodePath& path,
     InodeNumber inodeNumber,
-    InodeTimestamps& timeStamps) const {
-  // Open the file.  Return folly::none if the file does not exist.
-  auto path = getFilePath(inodeNumber);
+    std::string& serializedData) const {
+  // Open the file.  Return false if the file does not exist.
   int fd = openat(dirFile_.fd(), path.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW);
   if (fd == -1) {
     int err = errno;
     if (err == ENOENT) {
       // There is no overlay here
-      return folly::none;
+      return false;
     }
     folly::throwSystemErrorExplicit(
         err,
@@ -588,18 +1075,46 @@ Optional<overlay::OverlayDir> Overlay::deserializeOverlayDir(
   folly::File file{fd, /* ownsFd */ true};
 
   // Read the file data
-  std::string serializedData;
   if (!folly::readFile(file.fd(), serializedData)) {
     int err = errno;
     if (err == ENOENT) {
       // There is no overlay here
-      return folly::none;
+      return false;
     }
     folly::throwSystemErrorExplicit(
         errno, "failed to read ", RelativePathPiece{path});
   }
+  return true;
+}
+
+bool Overlay::readOverlayDirRecord(
+    InodeNumber inodeNumber,
+    std::string& serializedData) const {
+  auto path = getFilePath(inodeNumber);
+  bool buffered = false;
+  if (isBufferingWrites()) {
+    auto queue = writeQueue_.lock();
+    if (auto write = findPendingWrite(*queue, inodeNumber)) {
+      if (write->removed) {
+        return false;
+      }
+      serializedData = write->record;
+      buffered = true;
+    }
+  }
+
+  if (buffered) {
+    // The record has not been written out yet.
+  } else if (dirStore_) {
+    auto record = dirStore_->load(inodeNumber);
+    if (!record) {
+      return false;
+    }
+    serializedData = std::move(*record);
+  } else if (!readOverlayFile(path, inodeNumber, serializedData)) {
+    return false;
+  }
 
-  // Removing header and deserializing the contents
   if (serializedData.size() < kHeaderLength) {
     // Something Wrong with the file(may be corrupted)
     folly::throwSystemErrorExplicit(
@@ -609,14 +1124,27 @@ Optional<overlay::OverlayDir> Overlay::deserializeOverlayDir(
         " is too short for header: size=",
         serializedData.size());
   }
+  return true;
+}
 
-  StringPiece header{serializedData, 0, kHeaderLength};
-  // validate header and get the timestamps
-  parseHeader(header, kHeaderIdentifierDir, timeStamps);
+Optional<overlay::OverlayDir> Overlay::deserializeOverlayDir(
+    InodeNumber inodeNumber,
+    InodeTimestamps& timeStamps) const {
+  std::string serializedData;
+  if (!readOverlayDirRecord(inodeNumber, serializedData)) {
+    return folly::none;
+  }
 
+  // Removing header and deserializing the contents
   StringPiece contents{serializedData};
+  // validate header and get the timestamps
+  auto version = parseHeader(
+      contents.subpiece(0, kHeaderLength), kHeaderIdentifierDir, timeStamps);
   contents.advance(kHeaderLength);
 
+  if (version == kDirHeaderVersion) {
+    return compactOverlayDirToThrift(contents);
+  }
   return CompactSerializer::deserialize<overlay::OverlayDir>(contents);
 }
 
@@ -677,6 +1205,13 @@ folly::File Overlay::openFileNoVerify(InodeNumber inodeNumber) {
   auto path = getFilePath(inodeNumber);
 
   int fd = openat(dirFile_.fd(), path.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW);
+  if (fd == -1 && errno == ENOENT && smallFileStore_) {
+    auto file = unpackSmallFile(inodeNumber);
+    if (file) {
+      return file;
+    }
+    errno = ENOENT;
+  }
   folly::checkUnixError(
       fd,
       "error opening overlay file for inode ",
@@ -686,6 +1221,81 @@ folly::File Overlay::openFileNoVerify(InodeNumber inodeNumber) {
   return folly::File{fd, /* ownsFd */ true};
 }
 
+bool Overlay::packSmallFile(InodeNumber inodeNumber) {
+  const auto maxSize = FLAGS_overlay_small_file_max_size;
+  if (!smallFileStore_ || maxSize == 0) {
+    return false;
+  }
+
+  auto path = getFilePath(inodeNumber);
+  int fd =
+      openat(dirFile_.fd(), path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return false;
+    }
+    folly::throwSystemError(
+        "error opening overlay file for inode ",
+        inodeNumber,
+        " in ",
+        localDir_);
+  }
+  folly::File file{fd, /* ownsFd */ true};
+
+  struct stat st;
+  folly::checkUnixError(
+      fstat(file.fd(), &st),
+      "error getting size of overlay file for inode ",
+      inodeNumber);
+  if (static_cast<uint64_t>(st.st_size) < kHeaderLength ||
+      static_cast<uint64_t>(st.st_size) - kHeaderLength > maxSize) {
+    return false;
+  }
+
+  std::string record;
+  if (!folly::readFile(file.fd(), record, st.st_size)) {
+    folly::throwSystemError(
+        "failed to read overlay file for inode ", inodeNumber);
+  }
+  // Overlays without a dir store keep directory records in overlay files
+  // too; those are never packed.
+  if (record.size() != static_cast<size_t>(st.st_size) ||
+      !StringPiece{record}.startsWith(kHeaderIdentifierFile)) {
+    return false;
+  }
+
+  // Save the record before unlinking the file, so that a crash in between
+  // leaves both.  The overlay file is preferred when both exist.
+  ByteRange bytes{StringPiece{record}};
+  smallFileStore_->save(
+      inodeNumber,
+      bytes.subpiece(0, kHeaderLength),
+      bytes.subpiece(kHeaderLength));
+  folly::checkUnixError(
+      unlinkat(dirFile_.fd(), path.c_str(), 0),
+      "error unlinking packed overlay file: ",
+      RelativePathPiece{path});
+  XLOG(DBG4) << "packed " << record.size() - kHeaderLength
+             << " bytes of overlay data for inode " << inodeNumber;
+  return true;
+}
+
+folly::File Overlay::unpackSmallFile(InodeNumber inodeNumber) {
+  auto record = smallFileStore_->load(inodeNumber);
+  if (!record) {
+    return folly::File{};
+  }
+
+  iovec iov;
+  iov.iov_base = &(*record)[0];
+  iov.iov_len = record->size();
+  auto file = createOverlayFileImpl(inodeNumber, &iov, 1);
+  // Remove the record only once the overlay file has replaced it.
+  smallFileStore_->remove(inodeNumber);
+  XLOG(DBG4) << "unpacked overlay data for inode " << inodeNumber;
+  return file;
+}
+
 namespace {
 
 constexpr auto tmpPrefix = "tmp/"_sp;
@@ -713,6 +1323,13 @@ folly::File Overlay::createOverlayFileImpl(
   CHECK_LT(inodeNumber.get(), nextInodeNumber_.load(std::memory_order_relaxed))
       << "createOverlayFile called with unallocated inode number";
 
+  if (useTmpFiles_.load(std::memory_order_relaxed)) {
+    auto file = createOverlayTmpFile(inodeNumber, iov, iovCount);
+    if (file) {
+      return file;
+    }
+  }
+
   // We do not use mkstemp() to create the temporary file, since there is no
   // mkstempat() equivalent that can create files relative to dirFile_.  We
   // simply create the file with a fixed suffix, and do not use O_EXCL.  This
@@ -720,10 +1337,6 @@ folly::File Overlay::createOverlayFileImpl(
   // to create files inside the overlay directory, so no one else can create
   // symlinks inside the overlay directory.  We also open the temporary file
   // using O_NOFOLLOW.
-  //
-  // We could potentially use O_TMPFILE followed by linkat() to commit the
-  // file.  However this may not be supported by all filesystems, and seems to
-  // provide minimal benefits for our use case.
   auto path = getFilePath(inodeNumber);
 
   auto tmpPath = getFileTmpPath(inodeNumber);
@@ -747,7 +1360,120 @@ folly::File Overlay::createOverlayFileImpl(
     }
   };
 
-  auto sizeWritten = folly::writevFull(tmpFD, iov, iovCount);
+  writeOverlayFileData(inodeNumber, tmpFD, iov, iovCount);
+
+  auto returnCode =
+      renameat(dirFile_.fd(), tmpPath.data(), dirFile_.fd(), path.c_str());
+  folly::checkUnixError(
+      returnCode,
+      "error committing overlay file for inode ",
+      inodeNumber,
+      " in ",
+      localDir_);
+  // We do not want to unlink the temporary file on exit now that we have
+  // successfully renamed it.
+  success = true;
+
+  return file;
+}
+
+folly::File Overlay::createOverlayTmpFile(
+    InodeNumber inodeNumber,
+    iovec* iov,
+    size_t iovCount) {
+#ifdef O_TMPFILE
+  auto fd = openat(dirFile_.fd(), "tmp", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    // Kernels that predate O_TMPFILE treat it as O_DIRECTORY, and fail with
+    // EISDIR.
+    if (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL) {
+      XLOG(INFO) << "the overlay in " << localDir_
+                 << " does not support O_TMPFILE: " << folly::errnoStr(errno);
+      useTmpFiles_.store(false, std::memory_order_relaxed);
+      return folly::File{};
+    }
+    folly::throwSystemError(
+        "failed to create temporary overlay file for inode ",
+        inodeNumber,
+        " in ",
+        localDir_);
+  }
+  folly::File file{fd, /* ownsFd */ true};
+
+  writeOverlayFileData(inodeNumber, fd, iov, iovCount);
+
+  // Linking an open file with AT_EMPTY_PATH requires CAP_DAC_READ_SEARCH,
+  // but linking its /proc/self/fd entry does not.
+  auto procPath = folly::to<std::string>("/proc/self/fd/", fd);
+  auto path = getFilePath(inodeNumber);
+  auto returnCode = linkat(
+      AT_FDCWD,
+      procPath.c_str(),
+      dirFile_.fd(),
+      path.c_str(),
+      AT_SYMLINK_FOLLOW);
+  if (returnCode == 0) {
+    return file;
+  }
+  auto linkErrno = errno;
+  if (linkErrno == ENOENT && access("/proc/self/fd", F_OK) != 0) {
+    XLOG(INFO) << "/proc is not available to link O_TMPFILE overlay files";
+    useTmpFiles_.store(false, std::memory_order_relaxed);
+    return folly::File{};
+  }
+  if (linkErrno != EEXIST) {
+    folly::throwSystemErrorExplicit(
+        linkErrno,
+        "error committing overlay file for inode ",
+        inodeNumber,
+        " in ",
+        localDir_);
+  }
+
+  // linkat() cannot replace the inode's existing file, so link the new one
+  // under the temporary name and rename it over the old one, which is
+  // atomic.
+  auto tmpPath = getFileTmpPath(inodeNumber);
+  unlinkat(dirFile_.fd(), tmpPath.data(), 0);
+  folly::checkUnixError(
+      linkat(
+          AT_FDCWD,
+          procPath.c_str(),
+          dirFile_.fd(),
+          tmpPath.data(),
+          AT_SYMLINK_FOLLOW),
+      "error committing overlay file for inode ",
+      inodeNumber,
+      " in ",
+      localDir_);
+  returnCode =
+      renameat(dirFile_.fd(), tmpPath.data(), dirFile_.fd(), path.c_str());
+  if (returnCode != 0) {
+    auto savedErrno = errno;
+    unlinkat(dirFile_.fd(), tmpPath.data(), 0);
+    folly::throwSystemErrorExplicit(
+        savedErrno,
+        "error committing overlay file for inode ",
+        inodeNumber,
+        " in ",
+        localDir_);
+  }
+  return file;
+#else
+  (void)inodeNumber;
+  (void)iov;
+  (void)iovCount;
+  useTmpFiles_.store(false, std::memory_order_relaxed);
+  return folly::File{};
+#endif
+}
+
+void Overlay::writeOverlayFileData(
+    InodeNumber inodeNumber,
+    int fd,
+    iovec* iov,
+    size_t iovCount) {
+  auto sizeWritten = folly::writevFull(fd, iov, iovCount);
   folly::checkUnixError(
       sizeWritten,
       "error writing to overlay file for inode ",
@@ -771,7 +1497,7 @@ folly::File Overlay::createOverlayFileImpl(
   // not be able to remount the checkout.  Therefore we always call fdatasync()
   // when writing out the root inode.
   if (inodeNumber == kRootNodeId) {
-    auto syncReturnCode = folly::fdatasyncNoInt(tmpFD);
+    auto syncReturnCode = folly::fdatasyncNoInt(fd);
     folly::checkUnixError(
         syncReturnCode,
         "error flushing data to overlay file for inode ",
@@ -779,20 +1505,94 @@ folly::File Overlay::createOverlayFileImpl(
         " in ",
         localDir_);
   }
+}
 
-  auto returnCode =
-      renameat(dirFile_.fd(), tmpPath.data(), dirFile_.fd(), path.c_str());
-  folly::checkUnixError(
-      returnCode,
-      "error committing overlay file for inode ",
-      inodeNumber,
-      " in ",
-      localDir_);
-  // We do not want to unlink the temporary file on exit now that we have
-  // successfully renamed it.
-  success = true;
+folly::Future<folly::Unit> Overlay::syncFile(
+    folly::File file,
+    bool datasync) {
+  folly::Future<folly::Unit> future = folly::Future<folly::Unit>::makeEmpty();
+  {
+    std::lock_guard<std::mutex> lock{syncMutex_};
+    pendingSyncs_.push_back(PendingSync{std::move(file), datasync, {}});
+    future = pendingSyncs_.back().promise.getFuture();
+    if (syncRunning_) {
+      // The running sync may have started before our writes, so ours is
+      // synced in the next group.
+      return future;
+    }
+    syncRunning_ = true;
+  }
 
-  return file;
+  // Keep syncing groups until no files are left waiting.
+  while (true) {
+    std::vector<PendingSync> group;
+    {
+      std::lock_guard<std::mutex> lock{syncMutex_};
+      if (pendingSyncs_.empty()) {
+        syncRunning_ = false;
+        break;
+      }
+      group.swap(pendingSyncs_);
+    }
+    syncGroup(group);
+  }
+  return future;
+}
+
+void Overlay::syncGroup(std::vector<PendingSync>& group) {
+  auto fail = [&](const folly::exception_wrapper& ew) {
+    for (auto& entry : group) {
+      if (!entry.promise.isFulfilled()) {
+        entry.promise.setException(ew);
+      }
+    }
+  };
+
+#ifdef __linux__
+  if (FLAGS_overlay_syncfs_min_files > 0 &&
+      group.size() >= FLAGS_overlay_syncfs_min_files) {
+    // syncfs() also writes out the InodeMetadataTable, which lives on the
+    // same filesystem.
+    if (syncfs(dirFile_.fd()) != 0) {
+      fail(folly::makeSystemError(
+          "error syncing the overlay filesystem in ", localDir_));
+      return;
+    }
+    for (auto& entry : group) {
+      entry.promise.setValue();
+    }
+    return;
+  }
+#endif
+
+  // A failure to sync one file is only reported to its own caller.
+  std::vector<folly::exception_wrapper> errors(group.size());
+  for (size_t n = 0; n < group.size(); ++n) {
+    auto fd = group[n].file.fd();
+    auto rc = group[n].datasync ? folly::fdatasyncNoInt(fd)
+                                : folly::fsyncNoInt(fd);
+    if (rc != 0) {
+      errors[n] = folly::makeSystemError(
+          "error syncing overlay file in ", localDir_);
+    }
+  }
+
+  try {
+    if (inodeMetadataTable_) {
+      inodeMetadataTable_->sync();
+    }
+  } catch (const std::exception& ex) {
+    fail(folly::exception_wrapper{std::current_exception(), ex});
+    return;
+  }
+
+  for (size_t n = 0; n < group.size(); ++n) {
+    if (errors[n]) {
+      group[n].promise.setException(std::move(errors[n]));
+    } else {
+      group[n].promise.setValue();
+    }
+  }
 }
 
 folly::File Overlay::createOverlayFile(
@@ -832,7 +1632,7 @@ folly::File Overlay::createOverlayFile(
   return createOverlayFileImpl(inodeNumber, iov.data(), iov.size());
 }
 
-void Overlay::parseHeader(
+uint32_t Overlay::parseHeader(
     folly::StringPiece header,
     folly::StringPiece headerId,
     InodeTimestamps& timestamps) {
@@ -851,7 +1651,9 @@ void Overlay::parseHeader(
 
   // Validate header version
   auto version = cursor.readBE<uint32_t>();
-  if (version != kHeaderVersion) {
+  bool isCompactDir =
+      headerId == kHeaderIdentifierDir && version == kDirHeaderVersion;
+  if (version != kHeaderVersion && !isCompactDir) {
     folly::throwSystemError(EIO, "Unexpected overlay version :", version);
   }
   timespec atime, ctime, mtime;
@@ -864,57 +1666,117 @@ void Overlay::parseHeader(
   timestamps.atime = atime;
   timestamps.ctime = ctime;
   timestamps.mtime = mtime;
+  return version;
 }
 
 void Overlay::gcThread() noexcept {
   for (;;) {
     std::vector<GCRequest> requests;
+    std::vector<folly::Promise<folly::Unit>> flushes;
     {
       auto lock = gcQueue_.lock();
       while (lock->queue.empty()) {
+        if (lock->activeThreads == 0 && !lock->flushes.empty()) {
+          flushes.swap(lock->flushes);
+          break;
+        }
         if (lock->stop) {
           return;
         }
         gcCondVar_.wait(lock.getUniqueLock());
-        continue;
       }
 
-      requests = std::move(lock->queue);
+      if (flushes.empty()) {
+        auto& queue = lock->queue;
+        auto begin = queue.end() - std::min(queue.size(), kGCBatchSize);
+        requests.assign(
+            std::make_move_iterator(begin),
+            std::make_move_iterator(queue.end()));
+        queue.erase(begin, queue.end());
+        ++lock->activeThreads;
+      }
     }
 
-    for (auto& request : requests) {
-      try {
-        handleGCRequest(request);
-      } catch (const std::exception& e) {
-        XLOG(ERR) << "handleGCRequest should never throw, but it did: "
-                  << e.what();
+    for (auto& flush : flushes) {
+      flush.setValue();
+    }
+    if (requests.empty()) {
+      continue;
+    }
+
+    std::vector<GCRequest> discovered;
+    try {
+      handleGCRequests(requests, discovered);
+    } catch (const std::exception& e) {
+      XLOG(ERR) << "handleGCRequests should never throw, but it did: "
+                << e.what();
+    }
+
+    bool idle;
+    {
+      auto lock = gcQueue_.lock();
+      --lock->activeThreads;
+      for (auto& request : discovered) {
+        lock->queue.push_back(std::move(request));
       }
+      idle = lock->activeThreads == 0 && lock->queue.empty();
+    }
+    // Wake the other threads to share the new work, or to complete any
+    // flushes now that the queue has drained.
+    if (!discovered.empty() || idle) {
+      gcCondVar_.notify_all();
     }
   }
 }
 
-void Overlay::handleGCRequest(GCRequest& request) {
-  if (request.flush) {
-    request.flush->setValue();
-    return;
-  }
-
-  // Should only include inode numbers for trees.
-  std::queue<InodeNumber> queue;
+size_t Overlay::getGCQueueDepth() const {
+  auto lock = gcQueue_.lock();
+  return lock->queue.size() + lock->activeThreads;
+}
 
-  // TODO: For better throughput on large tree collections, it might make
-  // sense to split this into two threads: one for traversing the tree and
-  // another that makes the actual unlink calls.
+void Overlay::handleGCRequests(
+    std::vector<GCRequest>& requests,
+    std::vector<GCRequest>& discovered) {
   auto safeRemoveOverlayData = [&](InodeNumber inodeNumber) {
     try {
       removeOverlayData(inodeNumber);
+      gcRemovedInodes_.fetch_add(1, std::memory_order_relaxed);
     } catch (const std::exception& e) {
       XLOG(ERR) << "Failed to remove overlay data for inode " << inodeNumber
                 << ": " << e.what();
     }
   };
 
-  auto processDir = [&](const overlay::OverlayDir& dir) {
+  // With a dir store, the records of the directories in this batch are
+  // removed together in one transaction.
+  std::vector<InodeNumber> removedDirs;
+  for (auto& request : requests) {
+    overlay::OverlayDir dir;
+    if (request.dir) {
+      dir = std::move(*request.dir);
+    } else {
+      auto ino = request.inodeNumber;
+      try {
+        InodeTimestamps dummy;
+        auto dirData = deserializeOverlayDir(ino, dummy);
+        if (!dirData.hasValue()) {
+          XLOG(DBG3) << "no dir data for inode " << ino;
+          continue;
+        }
+        dir = std::move(*dirData);
+      } catch (const std::exception& e) {
+        XLOG(ERR) << "While collecting, failed to load tree data for inode "
+                  << ino << ": " << e.what();
+        continue;
+      }
+
+      if (dirStore_) {
+        removedDirs.push_back(ino);
+      } else {
+        safeRemoveOverlayData(ino);
+      }
+    }
+
     for (const auto& entry : dir.entries) {
       const auto& value = entry.second;
       if (!value.inodeNumber) {
@@ -925,7 +1787,7 @@ void Overlay::handleGCRequest(GCRequest& request) {
       auto ino = InodeNumber::fromThrift(value.inodeNumber);
 
       if (S_ISDIR(value.mode)) {
-        queue.push(ino);
+        discovered.emplace_back(ino);
       } else {
         // No need to recurse, but delete any file at this inode.  Note that,
         // under normal operation, there should be nothing at this path
@@ -934,33 +1796,31 @@ void Overlay::handleGCRequest(GCRequest& request) {
         safeRemoveOverlayData(ino);
       }
     }
-  };
-
-  processDir(request.dir);
-
-  while (!queue.empty()) {
-    auto ino = queue.front();
-    queue.pop();
+  }
 
-    overlay::OverlayDir dir;
+  if (!removedDirs.empty()) {
     try {
-      InodeTimestamps dummy;
-      auto dirData = deserializeOverlayDir(ino, dummy);
-      if (!dirData.hasValue()) {
-        XLOG(DBG3) << "no dir data for inode " << ino;
-        continue;
-      } else {
-        dir = std::move(*dirData);
-      }
+      removeOverlayDirs(removedDirs);
+      gcRemovedInodes_.fetch_add(
+          removedDirs.size(), std::memory_order_relaxed);
     } catch (const std::exception& e) {
-      XLOG(ERR) << "While collecting, failed to load tree data for inode "
-                << ino << ": " << e.what();
-      continue;
+      XLOG(ERR) << "Failed to remove overlay data for " << removedDirs.size()
+                << " directories: " << e.what();
     }
+  }
+}
 
-    safeRemoveOverlayData(ino);
-    processDir(dir);
+void Overlay::removeOverlayDirs(const std::vector<InodeNumber>& inodeNumbers) {
+  if (isBufferingWrites()) {
+    // Buffered removals are batched by the writer thread.
+    for (auto inodeNumber : inodeNumbers) {
+      removeOverlayData(inodeNumber);
+    }
+    return;
   }
+
+  getInodeMetadataTable()->freeInodes(inodeNumbers);
+  dirStore_->remove(inodeNumbers);
 }
 
 Overlay::InodePath::InodePath() noexcept : path_{'\0'} {}
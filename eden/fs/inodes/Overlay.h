@@ -14,10 +14,17 @@
 #include <folly/futures/Promise.h>
 #include <gtest/gtest_prod.h>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 #include "eden/fs/fuse/FuseTypes.h"
 #include "eden/fs/inodes/InodeTimestamps.h"
+#include "eden/fs/inodes/OverlayChecker.h"
 #include "eden/fs/inodes/gen-cpp2/overlay_types.h"
 #include "eden/fs/utils/DirType.h"
 #include "eden/fs/utils/PathFuncs.h"
@@ -31,10 +38,12 @@ class OverlayDir;
 
 struct DirContents;
 class InodeMap;
+class OverlayDirStore;
 struct InodeMetadata;
-template <typename T>
+struct PackedInodeMetadata;
+template <typename Record, typename Stored>
 class InodeTable;
-using InodeMetadataTable = InodeTable<InodeMetadata>;
+using InodeMetadataTable = InodeTable<InodeMetadata, PackedInodeMetadata>;
 struct SerializedInodeMap;
 
 /** Manages the write overlay storage area.
@@ -96,6 +105,28 @@ class Overlay {
    */
   InodeNumber scanForNextInodeNumber();
 
+  /**
+   * If the next inode number was recovered from the inode checkpoint after an
+   * unclean shutdown, scan the overlay on a background thread to confirm
+   * that no inode number in it was handed out past the checkpoint.  This is
+   * a consistency check that should find nothing; it runs after the mount is
+   * serving rather than delaying it.
+   *
+   * Does nothing otherwise.
+   */
+  void verifyNextInodeNumberInBackground();
+
+  /**
+   * Check the overlay for consistency on a background thread, and repair it
+   * if options.repair is set.  See OverlayChecker.
+   *
+   * This can be called while the overlay is in use, but only one check runs
+   * at a time; the returned Future fails if another one is running.  A check
+   * still running when the overlay is closed is abandoned.
+   */
+  folly::Future<OverlayChecker::Result> checkInBackground(
+      OverlayChecker::Options options);
+
   /**
    * allocateInodeNumber() should only be called by TreeInode.
    *
@@ -110,6 +141,11 @@ class Overlay {
    * It is illegal to call allocateInodeNumber prior to
    * setNextInodeNumber or scanForNextInodeNumber.
    *
+   * Inode numbers are reserved --overlay_inode_reservation at a time in the
+   * inode checkpoint file, which lets the Overlay pick the next inode number
+   * after an unclean shutdown without scanning.  Allocating the first number
+   * of each range waits for the checkpoint to be written.
+   *
    * TODO: It would be easy to extend this function to allocate a range of
    * inode values in one atomic operation.
    */
@@ -124,6 +160,13 @@ class Overlay {
     return inodeMetadataTable_.get();
   }
 
+  /**
+   * Save the record for a directory.
+   *
+   * If --overlay_dir_write_delay_ms is set this only buffers the record;
+   * the writer thread writes it out within that delay, coalesced with any
+   * later saves of the same directory.  Loads see buffered records.
+   */
   void saveOverlayDir(
       InodeNumber inodeNumber,
       const DirContents& dir,
@@ -144,12 +187,27 @@ class Overlay {
 
   /**
    * Returns a future that completes once all previously-issued async
-   * operations, namely recursivelyRemoveOverlayData, finish.
+   * operations, namely recursivelyRemoveOverlayData and buffered directory
+   * writes, finish.
    */
   folly::Future<folly::Unit> flushPendingAsync();
 
   bool hasOverlayData(InodeNumber inodeNumber);
 
+  /**
+   * The number of directories the GC threads have yet to collect, including
+   * those currently being collected.
+   */
+  size_t getGCQueueDepth() const;
+
+  /**
+   * The number of inodes whose data the GC threads have removed since the
+   * Overlay was opened.
+   */
+  uint64_t getGCRemovedInodeCount() const {
+    return gcRemovedInodes_.load(std::memory_order_relaxed);
+  }
+
   /**
    * Helper function that opens an existing overlay file,
    * checks if the file has valid header
@@ -162,9 +220,37 @@ class Overlay {
 
   /**
    * Open an existing overlay file without verifying the header.
+   *
+   * If the file was packed into the small file store it is first unpacked
+   * back into its own overlay file, since FileInode does all of its I/O
+   * through a file descriptor.
    */
   folly::File openFileNoVerify(InodeNumber inodeNumber);
 
+  /**
+   * If the given materialized file holds no more than
+   * --overlay_small_file_max_size bytes, move it from its own overlay file
+   * into the small file store.  It is unpacked again the next time it is
+   * opened.
+   *
+   * This must only be called while nothing has the overlay file open, such
+   * as when its FileInode is unloaded.  Returns true if the file was packed.
+   */
+  bool packSmallFile(InodeNumber inodeNumber);
+
+  /**
+   * Make the contents of an open overlay file durable, along with the
+   * InodeMetadataTable.
+   *
+   * Concurrent calls are committed in groups: the caller that finds no sync
+   * running syncs every file queued so far, with one syncfs() if there are
+   * at least --overlay_syncfs_min_files of them, and one msync() of the
+   * metadata table.  Files queued meanwhile form the next group, so a burst
+   * of fsyncs costs a few disk flushes rather than one each.  The returned
+   * Future completes once the group holding this file is synced.
+   */
+  folly::Future<folly::Unit> syncFile(folly::File file, bool datasync);
+
   /**
    * Helper function that creates an overlay file for a new FileInode.
    */
@@ -188,6 +274,12 @@ class Overlay {
   static constexpr folly::StringPiece kHeaderIdentifierDir{"OVDR"};
   static constexpr folly::StringPiece kHeaderIdentifierFile{"OVFL"};
   static constexpr uint32_t kHeaderVersion = 1;
+  /**
+   * The header version for directory records in the CompactOverlayDir
+   * format.  Directories with kHeaderVersion are a serialized
+   * overlay::OverlayDir, and can still be read.
+   */
+  static constexpr uint32_t kDirHeaderVersion = 2;
   static constexpr size_t kHeaderLength = 64;
 
   /**
@@ -198,44 +290,153 @@ class Overlay {
 
  private:
   FRIEND_TEST(OverlayTest, getFilePath);
+  friend class OverlayChecker;
 
   /**
-   * A request for the background GC thread.  There are two types of requests:
-   * recursively forget data underneath an given directory, or complete a
-   * promise.  The latter is used for synchronization with the GC thread,
-   * primarily in unit tests.
+   * A request for the background GC threads: forget the data for everything
+   * underneath a directory.
+   *
+   * Requests made by recursivelyRemoveOverlayData carry the contents of the
+   * directory, whose own record has already been removed.  The GC threads
+   * queue a request with just the inode number for each child directory they
+   * find, and load and remove that directory's record themselves, so that
+   * other GC threads can work on the children in parallel.
    *
-   * If additional request types are added in the future, consider renaming to
-   * AsyncRequest.  However, recursive collection of forgotten inode numbers
-   * is the only operation that can be made async while preserving our
-   * durability goals.
+   * Recursive collection of forgotten inode numbers is the only operation
+   * that can be made async while preserving our durability goals.
    */
   struct GCRequest {
-    GCRequest() {}
     explicit GCRequest(overlay::OverlayDir&& d) : dir{std::move(d)} {}
-    explicit GCRequest(folly::Promise<folly::Unit> p) : flush{std::move(p)} {}
+    explicit GCRequest(InodeNumber ino) : inodeNumber{ino} {}
 
-    overlay::OverlayDir dir;
-    // Iff set, this is a flush request.
-    folly::Optional<folly::Promise<folly::Unit>> flush;
+    folly::Optional<overlay::OverlayDir> dir;
+    // Only used if dir is not set.
+    InodeNumber inodeNumber;
   };
 
   struct GCQueue {
     bool stop = false;
     std::vector<GCRequest> queue;
+    // The number of GC threads working on requests taken from the queue.
+    size_t activeThreads = 0;
+    // Fulfilled once the queue is empty and no GC thread is active.  This is
+    // used for synchronization with the GC threads, primarily in unit tests.
+    std::vector<folly::Promise<folly::Unit>> flushes;
+  };
+
+  /**
+   * A buffered directory record, or a buffered removal of an inode's data.
+   *
+   * Removals are buffered too when writes are buffered: removing the data
+   * right away could leave the old record of its parent on disk, still
+   * referring to it, until the parent's new record is written.
+   */
+  struct PendingWrite {
+    // The header followed by the serialized OverlayDir.  Empty if removed.
+    std::string record;
+    // Materialized children that are directories.  Any buffered records for
+    // these are written before this one, so that, as with unbuffered saves,
+    // the overlay on disk never refers to a directory it doesn't contain.
+    std::vector<InodeNumber> materializedDirs;
+    bool removed{false};
+  };
+  using PendingWrites = std::unordered_map<InodeNumber, PendingWrite>;
+
+  struct WriteQueue {
+    bool stop = false;
+    // Writes buffered since the writer thread last took a batch.
+    PendingWrites pending;
+    // The batch the writer thread is writing.  Only the writer thread
+    // modifies this, and only while holding the lock.
+    PendingWrites inFlight;
+    // Fulfilled once the writes buffered before they were added are done.
+    std::vector<folly::Promise<folly::Unit>> flushes;
   };
 
   void initOverlay();
+  /** Set nextInodeNumber_ and initialNextInodeNumber_ during initialization. */
+  void initNextInodeNumber(uint64_t nextInodeNumber);
   void tryLoadNextInodeNumber();
   void saveNextInodeNumber();
+
+  /**
+   * Read the inode checkpoint, if there is one.  If the next inode number was
+   * not saved by a clean shutdown, continue from the checkpoint's reserved
+   * number.
+   */
+  void tryLoadInodeCheckpoint();
+
+  /**
+   * Reserve the inode numbers up to and past inodeNumber in the inode
+   * checkpoint.
+   */
+  void reserveInodeNumbers(uint64_t inodeNumber);
+
+  /**
+   * Walk the overlay and return the largest inode number it refers to.
+   */
+  InodeNumber findMaxInodeNumber();
   void readExistingOverlay(int infoFD);
   void initNewOverlay();
   void ensureTmpDirectoryIsCreated();
 
+  bool isBufferingWrites() const {
+    return writeDelay_.count() > 0;
+  }
+
+  /**
+   * Look up the buffered write for an inode, if there is one.  queue must be
+   * locked.
+   */
+  static const PendingWrite* findPendingWrite(
+      const WriteQueue& queue,
+      InodeNumber inodeNumber);
+
+  /** Write a directory record out to the dir store or overlay file. */
+  void writeOverlayDir(
+      InodeNumber inodeNumber,
+      folly::ByteRange header,
+      folly::ByteRange contents);
+
+  /**
+   * Unlink the overlay file for an inode, or remove its record from the
+   * small file store, if it has either.
+   */
+  void removeOverlayFile(InodeNumber inodeNumber);
+
+  folly::Future<folly::Unit> flushPendingWrites();
+  void writerThread() noexcept;
+
+  /**
+   * Write out a batch of buffered writes: directory records first, in an
+   * order where each one follows its materialized children, then removals.
+   */
+  void writeBatch(const PendingWrites& writes);
+
+  /**
+   * Read the record for a directory, header included, from the write
+   * buffer, dir store or overlay file.
+   *
+   * Returns false if there is no record.
+   */
+  bool readOverlayDirRecord(
+      InodeNumber inodeNumber,
+      std::string& serializedData) const;
+
   folly::Optional<overlay::OverlayDir> deserializeOverlayDir(
       InodeNumber inodeNumber,
       InodeTimestamps& timeStamps) const;
 
+  /**
+   * Read the whole overlay file at path into serializedData.
+   *
+   * Returns false if there is no such file.
+   */
+  bool readOverlayFile(
+      const InodePath& path,
+      InodeNumber inodeNumber,
+      std::string& serializedData) const;
+
   /**
    * Creates header for the files stored in Overlay
    */
@@ -247,6 +448,41 @@ class Overlay {
   folly::File
   createOverlayFileImpl(InodeNumber inodeNumber, iovec* iov, size_t iovCount);
 
+  /**
+   * Create the file for createOverlayFileImpl() as an unnamed O_TMPFILE in
+   * tmp/, and link it into place once its data is written.  This saves
+   * creating a directory entry for the temporary file and renaming it when
+   * the inode has no file yet.
+   *
+   * Returns an empty File if the overlay's filesystem does not support
+   * O_TMPFILE, after which createOverlayFileImpl() stops trying it.
+   */
+  folly::File createOverlayTmpFile(
+      InodeNumber inodeNumber,
+      iovec* iov,
+      size_t iovCount);
+
+  /**
+   * Write the contents of a new overlay file, and sync them if the file is
+   * important enough.
+   */
+  void writeOverlayFileData(
+      InodeNumber inodeNumber,
+      int fd,
+      iovec* iov,
+      size_t iovCount);
+
+  struct PendingSync {
+    folly::File file;
+    bool datasync;
+    folly::Promise<folly::Unit> promise;
+  };
+
+  /**
+   * Sync one group of files for syncFile(), fulfilling each one's promise.
+   */
+  void syncGroup(std::vector<PendingSync>& group);
+
   /**
    * Get the path to the file for the given inode, relative to localDir_.
    *
@@ -256,18 +492,47 @@ class Overlay {
 
   /**
    * Parses, validates and reads Timestamps from the header.
+   *
+   * Returns the header version.
    */
-  static void parseHeader(
+  static uint32_t parseHeader(
       folly::StringPiece header,
       folly::StringPiece headerId,
       InodeTimestamps& timeStamps);
 
   void gcThread() noexcept;
-  void handleGCRequest(GCRequest& request);
+
+  /**
+   * Remove the data for the children of the requested directories, and the
+   * records of those directories that were not removed already.  Requests for
+   * the child directories are added to discovered.
+   */
+  void handleGCRequests(
+      std::vector<GCRequest>& requests,
+      std::vector<GCRequest>& discovered);
+
+  /**
+   * Remove the dir store records and metadata for the given directories in
+   * one batch, or buffer their removal if writes are buffered.  Only valid
+   * when dirStore_ is set.
+   */
+  void removeOverlayDirs(const std::vector<InodeNumber>& inodeNumbers);
+
+  /**
+   * Move a file packed by packSmallFile() back into its own overlay file and
+   * return it open.  Returns a closed File if there is no packed record.
+   */
+  folly::File unpackSmallFile(InodeNumber inodeNumber);
 
   /** path to ".eden/CLIENT/local" */
   const AbsolutePath localDir_;
 
+  /**
+   * How long directory records may be buffered before they are written.
+   * Zero means saveOverlayDir writes them immediately.
+   */
+  const std::chrono::milliseconds writeDelay_;
+
   /**
    * The next inode number to allocate.  Zero indicates that neither
    * initializeFromTakeover nor getMaxRecordedInode have been called.
@@ -276,6 +541,51 @@ class Overlay {
    */
   std::atomic<uint64_t> nextInodeNumber_{0};
 
+  /**
+   * The first inode number this Overlay could allocate, or zero if
+   * nextInodeNumber_ has not been initialized.  Every lower number was
+   * allocated by an earlier process, so it can only still be referred to from
+   * the overlay's directory records or the InodeMap.  Set once during
+   * initialization.
+   */
+  uint64_t initialNextInodeNumber_{0};
+
+  /**
+   * The inode checkpoint covers all inode numbers below this.  Zero if no
+   * checkpoint has been written since the Overlay was opened.
+   */
+  std::atomic<uint64_t> reservedInodeNumber_{0};
+
+  /**
+   * How many inode numbers each checkpoint reserves.  Zero if checkpoints
+   * are disabled, either by flag or because one could not be written.
+   */
+  std::atomic<uint64_t> inodeReservationSize_;
+
+  /** Protects writing the inode checkpoint. */
+  std::mutex checkpointMutex_;
+  /** Increases each time the inode checkpoint is written. */
+  uint64_t checkpointGeneration_{0};
+
+  /** Set if nextInodeNumber_ was recovered from the inode checkpoint. */
+  bool recoveredFromCheckpoint_{false};
+
+  /** Runs verifyNextInodeNumberInBackground()'s scan. */
+  std::thread verifyThread_;
+  /** Runs checkInBackground()'s check, if one has been started. */
+  std::thread checkThread_;
+  std::mutex checkMutex_;
+  bool checkRunning_{false};
+
+  /**
+   * The files waiting for the next group sync, and whether a thread is
+   * syncing a group now.  See syncFile().
+   */
+  std::mutex syncMutex_;
+  std::vector<PendingSync> pendingSyncs_;
+  bool syncRunning_{false};
+  std::atomic<bool> closing_{false};
+
   /**
    * An open file descriptor to the overlay info file.
    *
@@ -292,6 +602,12 @@ class Overlay {
    */
   folly::File dirFile_;
 
+  /**
+   * Cleared once creating an O_TMPFILE in the overlay fails because the
+   * filesystem or kernel does not support it.
+   */
+  std::atomic<bool> useTmpFiles_{true};
+
   /**
    * Disk-backed mapping from inode number to InodeMetadata.
    * Defined below infoFile_ because it acquires its own file lock, which should
@@ -300,12 +616,43 @@ class Overlay {
   std::unique_ptr<InodeMetadataTable> inodeMetadataTable_;
 
   /**
-   * Thread which recursively removes entries from the overlay underneath the
+   * Where directory records are kept, if not in the per-inode files.
+   *
+   * This is chosen when the overlay is created (see
+   * --overlay_dirs_in_sqlite) and is null for overlays that keep each
+   * directory in its own file.  File contents are always stored in the
+   * per-inode files.
+   */
+  std::unique_ptr<OverlayDirStore> dirStore_;
+
+  /**
+   * Where small materialized files are packed while they are not open, so
+   * that an overlay full of tiny files does not need an inode and directory
+   * entry on disk for each one.  Records are the same header and contents
+   * the file would hold on its own.
+   *
+   * Opened once --overlay_small_file_max_size is nonzero, and for as long
+   * afterwards as the database exists, so that packed files stay readable
+   * after the flag is turned off.  Null otherwise.
+   */
+  std::unique_ptr<OverlayDirStore> smallFileStore_;
+
+  /**
+   * Threads which recursively remove entries from the overlay underneath the
    * trees added to gcQueue_.
    */
-  std::thread gcThread_;
+  std::vector<std::thread> gcThreads_;
   folly::Synchronized<GCQueue, std::mutex> gcQueue_;
   std::condition_variable gcCondVar_;
+  std::atomic<uint64_t> gcRemovedInodes_{0};
+
+  /**
+   * Thread which writes out buffered directory records.  Only started if
+   * writeDelay_ is nonzero.
+   */
+  std::thread writerThread_;
+  folly::Synchronized<WriteQueue, std::mutex> writeQueue_;
+  std::condition_variable writeCondVar_;
 };
 
 class Overlay::InodePath {
@@ -0,0 +1,454 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/OverlayChecker.h"
+
+#include <boost/filesystem.hpp>
+#include <folly/Conv.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "eden/fs/inodes/InodeTable.h"
+#include "eden/fs/inodes/Overlay.h"
+#include "eden/fs/inodes/OverlayDirStore.h"
+#include "eden/fs/utils/DirType.h"
+
+DEFINE_int32(
+    overlay_check_threads,
+    8,
+    "The number of threads an overlay check uses to walk the directory "
+    "records and scan the overlay files");
+
+namespace facebook {
+namespace eden {
+
+using folly::StringPiece;
+using std::string;
+using std::vector;
+
+namespace {
+/**
+ * The number of orphans removed together, with one InodeMetadataTable update
+ * and, for directories in the dir store, one transaction.
+ */
+constexpr size_t kOrphanBatchSize = 256;
+
+constexpr size_t kNumShards = 256;
+} // namespace
+
+constexpr size_t OverlayChecker::kMaxReportedProblems;
+
+OverlayChecker::OverlayChecker(Overlay* overlay, Options options)
+    : overlay_(overlay), options_(std::move(options)) {}
+
+OverlayChecker::Result OverlayChecker::run() {
+  inodeNumberLimit_ =
+      overlay_->nextInodeNumber_.load(std::memory_order_acquire);
+  CHECK_NE(0, inodeNumberLimit_)
+      << "the overlay must be initialized before it is checked";
+
+  walkDirectories();
+  if (overlay_->dirStore_) {
+    scanDirStore();
+  }
+  if (overlay_->smallFileStore_) {
+    scanSmallFileStore();
+  }
+  scanShards();
+  crossReference();
+  checkMetadataTable();
+
+  XLOG(DBG2) << "checked overlay " << overlay_->localDir_ << ": "
+             << result_.directoriesScanned << " directories, "
+             << result_.filesScanned << " files, "
+             << result_.getProblemCount() << " problems";
+  return std::move(result_);
+}
+
+template <typename Fn>
+void OverlayChecker::parallelFor(size_t count, Fn&& fn) {
+  auto numThreads = std::min<size_t>(
+      std::max(FLAGS_overlay_check_threads, 1), std::max<size_t>(count, 1));
+  std::atomic<size_t> next{0};
+  folly::exception_wrapper error;
+  std::mutex errorMutex;
+  auto worker = [&] {
+    try {
+      for (size_t index = next++; index < count; index = next++) {
+        fn(index);
+      }
+    } catch (const std::exception& ex) {
+      // Stop the other threads too.
+      next = count;
+      std::lock_guard<std::mutex> guard(errorMutex);
+      if (!error) {
+        error = folly::exception_wrapper{std::current_exception(), ex};
+      }
+    }
+  };
+
+  vector<std::thread> threads;
+  for (size_t n = 1; n < numThreads; ++n) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    error.throw_exception();
+  }
+}
+
+void OverlayChecker::walkDirectories() {
+  // Walk one level at a time, so that each level is spread over the check
+  // threads.
+  vector<DirToWalk> level{{kRootNodeId, true}};
+  while (!level.empty()) {
+    vector<DirToWalk> nextLevel;
+    parallelFor(level.size(), [&](size_t index) {
+      checkNotClosing();
+      const auto& toWalk = level[index];
+
+      folly::Optional<overlay::OverlayDir> dir;
+      try {
+        InodeTimestamps timestamps;
+        dir = overlay_->deserializeOverlayDir(toWalk.inodeNumber, timestamps);
+      } catch (const std::exception& ex) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        unreadableDirs_.emplace_back(
+            toWalk.inodeNumber, folly::exceptionStr(ex).toStdString());
+        return;
+      }
+      if (!dir) {
+        // Directories that are not materialized usually have no record.
+        if (toWalk.materialized) {
+          std::lock_guard<std::mutex> guard(mutex_);
+          missingDirs_.push_back(toWalk.inodeNumber);
+        }
+        return;
+      }
+
+      vector<DirToWalk> subdirs;
+      vector<InodeNumber> files;
+      vector<InodeNumber> materializedFiles;
+      for (const auto& entry : dir->entries) {
+        const auto& value = entry.second;
+        if (value.inodeNumber == 0 ||
+            static_cast<uint64_t>(value.inodeNumber) >= inodeNumberLimit_) {
+          continue;
+        }
+        auto ino = InodeNumber::fromThrift(value.inodeNumber);
+        bool materialized = !value.__isset.hash || value.hash.empty();
+        if (mode_to_dtype(value.mode) == dtype_t::Dir) {
+          subdirs.push_back(DirToWalk{ino, materialized});
+        } else {
+          files.push_back(ino);
+          if (materialized) {
+            materializedFiles.push_back(ino);
+          }
+        }
+      }
+
+      std::lock_guard<std::mutex> guard(mutex_);
+      ++result_.directoriesScanned;
+      for (const auto& subdir : subdirs) {
+        // A directory referred to twice is only walked once.
+        if (referencedDirs_.insert(subdir.inodeNumber.get()).second) {
+          nextLevel.push_back(subdir);
+        }
+      }
+      for (auto ino : files) {
+        referencedFiles_.insert(ino.get());
+      }
+      materializedFiles_.insert(
+          materializedFiles_.end(),
+          materializedFiles.begin(),
+          materializedFiles.end());
+    });
+    level = std::move(nextLevel);
+  }
+}
+
+void OverlayChecker::scanDirStore() {
+  for (auto ino : overlay_->dirStore_->getAllInodeNumbers()) {
+    if (ino.get() < inodeNumberLimit_) {
+      dirData_.insert(ino.get());
+    }
+  }
+}
+
+void OverlayChecker::scanSmallFileStore() {
+  // The store only ever holds files, so their headers are not read.
+  for (auto ino : overlay_->smallFileStore_->getAllInodeNumbers()) {
+    if (ino.get() < inodeNumberLimit_) {
+      fileData_.insert(ino.get());
+      ++result_.filesScanned;
+    }
+  }
+}
+
+void OverlayChecker::scanShards() {
+  parallelFor(kNumShards, [&](size_t shard) {
+    checkNotClosing();
+    auto subdirPath = overlay_->localDir_ +
+        PathComponent{folly::sformat("{:02x}", shard)};
+
+    vector<uint64_t> files;
+    vector<uint64_t> dirs;
+    vector<std::pair<InodeNumber, string>> bad;
+    boost::system::error_code error;
+    auto boostPath = boost::filesystem::path{subdirPath.value().c_str()};
+    for (boost::filesystem::directory_iterator it(boostPath, error), end;
+         !error && it != end;
+         it.increment(error)) {
+      auto number = folly::tryTo<uint64_t>(it->path().filename().string());
+      if (!number.hasValue() || number.value() >= inodeNumberLimit_) {
+        continue;
+      }
+      InodeNumber ino{number.value()};
+      try {
+        auto type = readFileHeader(ino);
+        if (!type) {
+          continue;
+        }
+        (*type == DataType::Dir ? dirs : files).push_back(ino.get());
+      } catch (const std::exception& ex) {
+        bad.emplace_back(ino, folly::exceptionStr(ex).toStdString());
+      }
+    }
+    if (error) {
+      folly::throwSystemErrorExplicit(
+          error.value(), "error listing overlay directory ", subdirPath);
+    }
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    result_.filesScanned += files.size() + dirs.size() + bad.size();
+    fileData_.insert(files.begin(), files.end());
+    dirData_.insert(dirs.begin(), dirs.end());
+    for (auto& entry : bad) {
+      badData_.insert(entry.first.get());
+      ++result_.badRecords;
+      addProblem(entry.first, "invalid overlay file: " + entry.second);
+    }
+  });
+}
+
+folly::Optional<OverlayChecker::DataType> OverlayChecker::readFileHeader(
+    InodeNumber inodeNumber) const {
+  auto path = Overlay::getFilePath(inodeNumber);
+  int fd = openat(
+      overlay_->dirFile_.fd(), path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return folly::none;
+    }
+    folly::throwSystemError("error opening ", RelativePathPiece{path});
+  }
+  folly::File file{fd, /* ownsFd */ true};
+
+  std::array<char, Overlay::kHeaderLength> header;
+  auto bytesRead = folly::readFull(fd, header.data(), header.size());
+  folly::checkUnixError(bytesRead, "error reading ", RelativePathPiece{path});
+  if (static_cast<size_t>(bytesRead) < header.size()) {
+    folly::throwSystemErrorExplicit(
+        EIO, "the file is too short for a header: size=", bytesRead);
+  }
+
+  StringPiece headerPiece{header.data(), header.size()};
+  auto type = headerPiece.startsWith(Overlay::kHeaderIdentifierDir)
+      ? DataType::Dir
+      : DataType::File;
+  InodeTimestamps timestamps;
+  // This throws if the identifier or version is invalid.
+  Overlay::parseHeader(
+      headerPiece,
+      type == DataType::Dir ? Overlay::kHeaderIdentifierDir
+                            : Overlay::kHeaderIdentifierFile,
+      timestamps);
+  return type;
+}
+
+void OverlayChecker::crossReference() {
+  auto hasData = [this](uint64_t ino) {
+    return fileData_.count(ino) || dirData_.count(ino) || badData_.count(ino);
+  };
+
+  for (const auto& entry : unreadableDirs_) {
+    auto ino = entry.first.get();
+    if (fileData_.count(ino)) {
+      ++result_.typeMismatches;
+      addProblem(entry.first, "referred to as a directory but holds a file");
+    } else if (!badData_.count(ino)) {
+      // Overlay files with an invalid header were reported by scanShards().
+      ++result_.badRecords;
+      addProblem(entry.first, "invalid directory record: " + entry.second);
+    }
+  }
+  for (auto ino : referencedFiles_) {
+    if (dirData_.count(ino)) {
+      ++result_.typeMismatches;
+      addProblem(
+          InodeNumber{ino}, "referred to as a file but holds a directory");
+    }
+  }
+
+  // The data may have been removed since it was looked for, along with the
+  // entry that referred to it.  Only report data that is still missing.
+  auto isMissing = [this](InodeNumber ino) {
+    return !isInUse(ino) && !overlay_->hasOverlayData(ino);
+  };
+  for (auto ino : materializedFiles_) {
+    if (!hasData(ino.get()) && isMissing(ino)) {
+      ++result_.missingData;
+      addProblem(ino, "the data for a materialized file is missing");
+    }
+  }
+  for (auto ino : missingDirs_) {
+    if (fileData_.count(ino.get())) {
+      // The dir store has no record for it because it holds a file.
+      ++result_.typeMismatches;
+      addProblem(ino, "referred to as a directory but holds a file");
+    } else if (isMissing(ino)) {
+      ++result_.missingData;
+      addProblem(ino, "the record for a materialized directory is missing");
+    }
+  }
+
+  vector<InodeNumber> orphans;
+  auto findOrphans = [&](const std::unordered_set<uint64_t>& data) {
+    for (auto ino : data) {
+      if (ino != kRootNodeId.get() && !referencedFiles_.count(ino) &&
+          !referencedDirs_.count(ino) && !isInUse(InodeNumber{ino})) {
+        orphans.emplace_back(ino);
+      }
+    }
+  };
+  findOrphans(fileData_);
+  findOrphans(dirData_);
+  findOrphans(badData_);
+
+  // Report them in order, which keeps the reported sample stable.
+  std::sort(orphans.begin(), orphans.end());
+  result_.orphans = orphans.size();
+  for (auto ino : orphans) {
+    addProblem(ino, "not referred to by any directory");
+  }
+
+  if (options_.repair) {
+    removeOrphans(orphans);
+  }
+}
+
+void OverlayChecker::removeOrphans(const vector<InodeNumber>& orphans) {
+  auto numBatches = (orphans.size() + kOrphanBatchSize - 1) / kOrphanBatchSize;
+  std::atomic<uint64_t> removed{0};
+  parallelFor(numBatches, [&](size_t batchIndex) {
+    checkNotClosing();
+    auto begin = orphans.begin() + batchIndex * kOrphanBatchSize;
+    auto end = orphans.begin() +
+        std::min(orphans.size(), (batchIndex + 1) * kOrphanBatchSize);
+
+    vector<InodeNumber> files;
+    vector<InodeNumber> dirStoreDirs;
+    for (auto it = begin; it != end; ++it) {
+      // The mount may have loaded it since it was found.
+      if (isInUse(*it)) {
+        continue;
+      }
+      if (overlay_->dirStore_ && dirData_.count(it->get())) {
+        dirStoreDirs.push_back(*it);
+      } else {
+        files.push_back(*it);
+      }
+    }
+
+    for (auto ino : files) {
+      overlay_->removeOverlayFile(ino);
+    }
+    overlay_->getInodeMetadataTable()->freeInodes(files);
+    if (!dirStoreDirs.empty()) {
+      overlay_->removeOverlayDirs(dirStoreDirs);
+    }
+    removed += files.size() + dirStoreDirs.size();
+  });
+  result_.orphansRemoved = removed.load();
+}
+
+void OverlayChecker::checkMetadataTable() {
+  auto* table = overlay_->getInodeMetadataTable();
+  // Inode numbers are only allocated upwards, so a record above the next
+  // inode number was left behind by an earlier allocation and would be
+  // mistaken for the metadata of the inode that is next given that number.
+  auto next = overlay_->nextInodeNumber_.load(std::memory_order_acquire);
+  // A number allocated by an earlier process can only be referred to by a
+  // directory record or the InodeMap.  If a directory could not be read, its
+  // children are unknown, so nothing is considered unreferenced.
+  auto initial = overlay_->initialNextInodeNumber_;
+  bool findUnreferenced = initial != 0 && unreadableDirs_.empty() &&
+      missingDirs_.empty();
+  auto isUnreferenced = [&](InodeNumber ino) {
+    auto number = ino.get();
+    return findUnreferenced && number < initial && ino != kRootNodeId &&
+        !referencedFiles_.count(number) && !referencedDirs_.count(number) &&
+        !fileData_.count(number) && !dirData_.count(number) &&
+        !badData_.count(number) && !isInUse(ino);
+  };
+
+  vector<InodeNumber> unallocated;
+  std::unordered_set<uint64_t> toRemove;
+  for (auto ino : table->getAllInodes()) {
+    if (ino.get() >= next) {
+      unallocated.push_back(ino);
+      toRemove.insert(ino.get());
+    } else if (isUnreferenced(ino)) {
+      toRemove.insert(ino.get());
+    }
+  }
+  std::sort(unallocated.begin(), unallocated.end());
+  result_.unallocatedMetadata = unallocated.size();
+  result_.unreferencedMetadata = toRemove.size() - unallocated.size();
+  for (auto ino : unallocated) {
+    addProblem(ino, "metadata record for an unallocated inode number");
+  }
+
+  if (options_.repair && !toRemove.empty()) {
+    // isInUse() must not be called from compact(), which holds the table's
+    // lock, since the InodeMap updates the table with its own locks held.
+    result_.metadataRemoved = table->compact(
+        [&](InodeNumber ino) { return toRemove.count(ino.get()) == 0; });
+  }
+}
+
+bool OverlayChecker::isInUse(InodeNumber inodeNumber) const {
+  return options_.isInodeInUse && options_.isInodeInUse(inodeNumber);
+}
+
+void OverlayChecker::checkNotClosing() const {
+  if (overlay_->closing_.load(std::memory_order_relaxed)) {
+    throw std::runtime_error(folly::to<string>(
+        "overlay ", overlay_->localDir_, " was closed during the check"));
+  }
+}
+
+void OverlayChecker::addProblem(InodeNumber inodeNumber, string description) {
+  XLOG(DBG3) << "overlay " << overlay_->localDir_ << ": inode " << inodeNumber
+             << ": " << description;
+  if (result_.problems.size() < kMaxReportedProblems) {
+    result_.problems.emplace_back(inodeNumber, std::move(description));
+  }
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,176 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <folly/Optional.h>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "eden/fs/fuse/FuseTypes.h"
+
+namespace facebook {
+namespace eden {
+
+class Overlay;
+
+/**
+ * Checks an Overlay for consistency, and optionally repairs what it finds.
+ *
+ * The check has two parts, each spread over --overlay_check_threads threads:
+ *
+ * - It walks the directory records down from the root, one level at a
+ *   time, to find every inode the overlay still refers to.
+ * - It reads the header of every file in the 256 shard directories, and the
+ *   list of records in the dir store if the overlay has one.
+ *
+ * Comparing the two finds:
+ *
+ * - orphans: overlay data for inodes that no directory refers to, such as
+ *   the files left behind by a crash in the middle of removing a tree.
+ * - records with an invalid header or contents, and records whose header
+ *   says file where the parent says directory or vice versa.
+ * - materialized entries whose data is missing.
+ * - InodeMetadataTable records for inode numbers that were never allocated.
+ *
+ * It also counts the InodeMetadataTable records that nothing can refer to
+ * any more: those allocated by an earlier process that no directory record
+ * refers to and the mount is not using.  These are left behind in normal
+ * operation, for instance by source control directories that were unloaded
+ * and forgotten, so they are not counted as problems.
+ *
+ * Only orphans and stray metadata records are repaired.  Orphans are removed
+ * in batches, as the GC threads do, and the metadata table is compacted.
+ *
+ * The check can run while the overlay is in use by a live mount.  Inode
+ * numbers allocated after it starts are skipped, and options.isInodeInUse
+ * is asked before anything is reported or removed, so that the data of
+ * unlinked files that are still open, and of inodes that are being moved
+ * between directories during the walk, is left alone.
+ */
+class OverlayChecker {
+ public:
+  struct Options {
+    /** Remove orphans and stray metadata records rather than only report. */
+    bool repair{false};
+
+    /**
+     * Returns true if the mount has loaded the inode, or may still refer to
+     * it.  Unset for overlays that are not mounted.
+     */
+    std::function<bool(InodeNumber)> isInodeInUse;
+  };
+
+  struct Result {
+    uint64_t directoriesScanned{0};
+    uint64_t filesScanned{0};
+    uint64_t orphans{0};
+    uint64_t orphansRemoved{0};
+    // Overlay data with an invalid header or contents.
+    uint64_t badRecords{0};
+    uint64_t typeMismatches{0};
+    uint64_t missingData{0};
+    uint64_t unallocatedMetadata{0};
+    // Not a problem; see above.
+    uint64_t unreferencedMetadata{0};
+    uint64_t metadataRemoved{0};
+
+    /**
+     * A description of each problem found, up to kMaxReportedProblems of
+     * them.
+     */
+    std::vector<std::pair<InodeNumber, std::string>> problems;
+
+    uint64_t getProblemCount() const {
+      return orphans + badRecords + typeMismatches + missingData +
+          unallocatedMetadata;
+    }
+  };
+
+  static constexpr size_t kMaxReportedProblems = 1000;
+
+  OverlayChecker(Overlay* overlay, Options options);
+
+  /**
+   * Run the check.  Throws std::runtime_error if the overlay is closed
+   * before it finishes.
+   */
+  Result run();
+
+ private:
+  enum class DataType { File, Dir };
+
+  struct DirToWalk {
+    InodeNumber inodeNumber;
+    // Whether the parent says this directory is materialized, and so must
+    // have a record.
+    bool materialized;
+  };
+
+  void walkDirectories();
+  void scanShards();
+  void scanDirStore();
+  void scanSmallFileStore();
+  void crossReference();
+  void checkMetadataTable();
+  void removeOrphans(const std::vector<InodeNumber>& orphans);
+
+  /**
+   * Read the header of an overlay file to find whether it holds a file or a
+   * directory.  Returns folly::none if the file was removed since it was
+   * listed, and throws if the header is invalid.
+   */
+  folly::Optional<DataType> readFileHeader(InodeNumber inodeNumber) const;
+
+  bool isInUse(InodeNumber inodeNumber) const;
+  void checkNotClosing() const;
+  void addProblem(InodeNumber inodeNumber, std::string description);
+
+  /**
+   * Call fn(index) for each index below count, spread over the check
+   * threads.
+   */
+  template <typename Fn>
+  void parallelFor(size_t count, Fn&& fn);
+
+  Overlay* const overlay_;
+  const Options options_;
+
+  /**
+   * Inode numbers at or above this were allocated after the check started,
+   * and are skipped.
+   */
+  uint64_t inodeNumberLimit_{0};
+
+  // Inodes the directory records refer to.
+  std::unordered_set<uint64_t> referencedFiles_;
+  std::unordered_set<uint64_t> referencedDirs_;
+  // Materialized files that must have an overlay file.
+  std::vector<InodeNumber> materializedFiles_;
+  // Directories whose records could not be read, with the error.
+  std::vector<std::pair<InodeNumber, std::string>> unreadableDirs_;
+  // Materialized directories that had no record.
+  std::vector<InodeNumber> missingDirs_;
+  // Overlay files and dir store records found by the scans, by the type
+  // their header gives.  badData_ holds the files with an invalid header.
+  std::unordered_set<uint64_t> fileData_;
+  std::unordered_set<uint64_t> dirData_;
+  std::unordered_set<uint64_t> badData_;
+
+  // Protects the members above while the check threads are running.
+  std::mutex mutex_;
+
+  Result result_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "eden/fs/fuse/FuseTypes.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * Storage for the directory records of an Overlay.
+ *
+ * By default the Overlay keeps each directory record in its own file next to
+ * the materialized file contents.  An OverlayDirStore lets the records live
+ * somewhere else, such as a single embedded database, so that checkout does
+ * not have to create and rename one file per modified directory.
+ *
+ * Records are opaque to the store: each one is the Overlay's header followed
+ * by the serialized overlay::OverlayDir.  The Overlay also packs small files
+ * into a second store, whose records are a header followed by the file
+ * contents.
+ *
+ * Implementations must be thread-safe.
+ */
+class OverlayDirStore {
+ public:
+  virtual ~OverlayDirStore() {}
+
+  /**
+   * Return the record for the given directory, or folly::none if there is
+   * none.
+   */
+  virtual folly::Optional<std::string> load(InodeNumber inodeNumber) = 0;
+
+  /**
+   * Replace the record for the given directory with header followed by
+   * contents.
+   */
+  virtual void save(
+      InodeNumber inodeNumber,
+      folly::ByteRange header,
+      folly::ByteRange contents) = 0;
+
+  /**
+   * Replace the records for several directories.  Each record is given
+   * whole, header included.  Implementations should do this in as few
+   * transactions as they can.
+   */
+  virtual void save(
+      const std::vector<std::pair<InodeNumber, folly::ByteRange>>& records) = 0;
+
+  /**
+   * Remove the record for the given directory.
+   *
+   * Returns true if there was a record to remove.
+   */
+  virtual bool remove(InodeNumber inodeNumber) = 0;
+
+  /**
+   * Remove the records for all of the given directories.  Implementations
+   * should do this in as few transactions as they can.
+   */
+  virtual void remove(const std::vector<InodeNumber>& inodeNumbers) = 0;
+
+  virtual bool has(InodeNumber inodeNumber) = 0;
+
+  /**
+   * Return the inode numbers of every directory with a record, in no
+   * particular order.
+   */
+  virtual std::vector<InodeNumber> getAllInodeNumbers() = 0;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,299 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/ScmStatusCache.h"
+
+#include <folly/futures/Future.h>
+#include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
+#include <unordered_set>
+
+#include "eden/fs/inodes/Differ.h"
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/FileInode.h"
+#include "eden/fs/inodes/InodePtr.h"
+#include "eden/fs/inodes/ServerState.h"
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/model/TreeEntry.h"
+#include "eden/fs/store/ObjectStore.h"
+
+using folly::Future;
+using folly::makeFuture;
+using folly::Optional;
+using std::make_unique;
+using std::shared_ptr;
+using std::unique_ptr;
+using std::vector;
+
+DEFINE_uint64(
+    scm_status_cache_max_incremental_paths,
+    10000,
+    "The maximum number of changed paths for which getScmStatus() will "
+    "update its cached result rather than performing a full diff");
+
+namespace facebook {
+namespace eden {
+
+namespace {
+enum class PathStatus {
+  CLEAN,
+  MODIFIED,
+  REMOVED,
+  // The incremental update cannot tell what this path's status is.
+  UNKNOWN,
+};
+
+/**
+ * Returns true if the path is inside a directory that diff never reports
+ * on, such as .hg or .eden.
+ */
+bool isHiddenPath(RelativePathPiece path) {
+  for (auto name : path.components()) {
+    if (name.stringPiece() == ".hg" || name.stringPiece() == ".eden") {
+      return true;
+    }
+  }
+  return false;
+}
+
+Future<Optional<TreeEntry>> lookupScmEntry(
+    ObjectStore* store,
+    shared_ptr<const Tree> tree,
+    shared_ptr<const vector<PathComponent>> names,
+    size_t index) {
+  const auto* entry = tree->getEntryPtr((*names)[index]);
+  if (!entry) {
+    return makeFuture(Optional<TreeEntry>{});
+  }
+  if (index + 1 == names->size()) {
+    return makeFuture(Optional<TreeEntry>{*entry});
+  }
+  if (!entry->isTree()) {
+    return makeFuture(Optional<TreeEntry>{});
+  }
+  return store->getTree(entry->getHash())
+      .thenValue([store, names, index](shared_ptr<const Tree> child) {
+        return lookupScmEntry(store, std::move(child), names, index + 1);
+      });
+}
+
+Future<PathStatus> getPathStatus(
+    const EdenMount* mount,
+    shared_ptr<const Tree> rootTree,
+    RelativePathPiece path) {
+  auto names = std::make_shared<vector<PathComponent>>();
+  for (auto name : path.components()) {
+    names->emplace_back(name);
+  }
+  return lookupScmEntry(mount->getObjectStore(), std::move(rootTree), names, 0)
+      .thenValue(
+          [mount, path = path.copy()](
+              Optional<TreeEntry> scmEntry) -> Future<PathStatus> {
+            if (!scmEntry.hasValue() || scmEntry->isTree()) {
+              return PathStatus::UNKNOWN;
+            }
+            return mount->getInode(path).then(
+                [scmEntry = std::move(scmEntry).value()](
+                    folly::Try<InodePtr>&& inode) -> Future<PathStatus> {
+                  if (inode.hasException()) {
+                    int errnum = 0;
+                    inode.exception().with_exception(
+                        [&errnum](const std::system_error& ex) {
+                          errnum = ex.code().value();
+                        });
+                    return (errnum == ENOENT || errnum == ENOTDIR)
+                        ? PathStatus::REMOVED
+                        : PathStatus::UNKNOWN;
+                  }
+                  auto file = inode.value().asFilePtrOrNull();
+                  if (!file) {
+                    return PathStatus::UNKNOWN;
+                  }
+                  return file->isSameAs(scmEntry.getHash(), scmEntry.getType())
+                      .thenValue([](bool isSame) {
+                        return isSame ? PathStatus::CLEAN
+                                      : PathStatus::MODIFIED;
+                      });
+                });
+          })
+      .onError([](const folly::exception_wrapper&) {
+        // Let the full diff report the error.
+        return PathStatus::UNKNOWN;
+      });
+}
+} // namespace
+
+ScmStatusCache::ScmStatusCache(EdenMount* mount) : mount_{mount} {}
+
+ScmStatusCache::~ScmStatusCache() {}
+
+Future<unique_ptr<ScmStatus>> ScmStatusCache::getStatus(
+    Hash commitHash,
+    bool listIgnored) {
+  // Read the journal before anything else, so that changes made while we
+  // compute the status are picked up again by the next call.
+  auto ignoreGeneration =
+      mount_->getServerState()->getTopLevelIgnoresGeneration();
+  auto latest = mount_->getJournal().getLatest();
+  auto sequence = latest ? latest->toSequence : 0;
+
+  Optional<Entry> cached;
+  {
+    auto entry = entry_.rlock();
+    if (entry->hasValue() && (*entry)->commitHash == commitHash &&
+        (*entry)->listIgnored == listIgnored &&
+        (*entry)->ignoreGeneration == ignoreGeneration) {
+      cached = entry->value();
+    }
+  }
+  if (!cached.hasValue()) {
+    return computeFullStatus(
+        commitHash, listIgnored, ignoreGeneration, sequence);
+  }
+
+  if (cached->sequence == sequence) {
+    incrementalUpdates_.fetch_add(1, std::memory_order_relaxed);
+    return makeFuture(make_unique<ScmStatus>(std::move(cached->status)));
+  }
+
+  auto paths = getChangedPaths(cached->sequence, sequence);
+  if (!paths.hasValue()) {
+    return computeFullStatus(
+        commitHash, listIgnored, ignoreGeneration, sequence);
+  }
+  return updateStatus(
+      std::move(cached).value(), std::move(paths).value(), sequence);
+}
+
+void ScmStatusCache::clear() {
+  entry_.wlock()->clear();
+}
+
+Future<unique_ptr<ScmStatus>> ScmStatusCache::computeFullStatus(
+    Hash commitHash,
+    bool listIgnored,
+    uint64_t ignoreGeneration,
+    JournalDelta::SequenceNumber sequence) {
+  return diffMountForStatus(mount_, commitHash, listIgnored)
+      .thenValue([this, commitHash, listIgnored, ignoreGeneration, sequence](
+                     unique_ptr<ScmStatus> status) {
+        storeEntry(Entry{
+            commitHash, listIgnored, ignoreGeneration, sequence, *status});
+        return status;
+      });
+}
+
+Optional<vector<RelativePath>> ScmStatusCache::getChangedPaths(
+    JournalDelta::SequenceNumber cachedSequence,
+    JournalDelta::SequenceNumber sequence) const {
+  std::unordered_set<RelativePath> seen;
+  vector<RelativePath> paths;
+  bool usable = true;
+  auto addPath = [&](RelativePathPiece path) {
+    if (isHiddenPath(path)) {
+      return;
+    }
+    if (path.basename().stringPiece() == ".gitignore") {
+      // This may change the status of any number of untracked files.
+      usable = false;
+      return;
+    }
+    auto inserted = seen.insert(path.copy());
+    if (inserted.second) {
+      paths.push_back(*inserted.first);
+    }
+  };
+
+  folly::Optional<JournalDelta::SequenceNumber> oldestSequence;
+  mount_->getJournal().forEachDelta(
+      cachedSequence + 1, sequence, [&](const JournalDelta& delta) {
+        if (delta.fromHash != delta.toHash) {
+          // A checkout or reset; the journal does not record every path
+          // whose status this changed.
+          usable = false;
+          return false;
+        }
+        delta.forEachChangedPath(
+            [&](RelativePathPiece path, const PathChangeInfo&) {
+              addPath(path);
+            });
+        delta.forEachUncleanPath(addPath);
+        if (!usable ||
+            paths.size() > FLAGS_scm_status_cache_max_incremental_paths) {
+          usable = false;
+          return false;
+        }
+        oldestSequence = delta.fromSequence;
+        return true;
+      });
+
+  // Make sure that the journal still covers every change made after the
+  // cached status was computed.
+  if (!usable || !oldestSequence || *oldestSequence > cachedSequence + 1) {
+    return folly::none;
+  }
+  return paths;
+}
+
+Future<unique_ptr<ScmStatus>> ScmStatusCache::updateStatus(
+    Entry entry,
+    vector<RelativePath> paths,
+    JournalDelta::SequenceNumber sequence) {
+  XLOG(DBG4) << "updating cached status for " << mount_->getPath() << " with "
+             << paths.size() << " changed paths";
+  auto sharedPaths = std::make_shared<vector<RelativePath>>(std::move(paths));
+  return mount_->getObjectStore()
+      ->getTreeForCommit(entry.commitHash)
+      .thenValue([mount = mount_, sharedPaths](shared_ptr<const Tree> tree) {
+        vector<Future<PathStatus>> futures;
+        futures.reserve(sharedPaths->size());
+        for (const auto& path : *sharedPaths) {
+          futures.push_back(getPathStatus(mount, tree, path));
+        }
+        return folly::collect(futures);
+      })
+      .thenValue([this, entry = std::move(entry), sharedPaths, sequence](
+                     vector<PathStatus> results) mutable
+                 -> Future<unique_ptr<ScmStatus>> {
+        auto& entries = entry.status.entries;
+        for (size_t n = 0; n < results.size(); ++n) {
+          auto path = (*sharedPaths)[n].stringPiece().str();
+          switch (results[n]) {
+            case PathStatus::CLEAN:
+              entries.erase(path);
+              break;
+            case PathStatus::MODIFIED:
+              entries[path] = ScmFileStatus::MODIFIED;
+              break;
+            case PathStatus::REMOVED:
+              entries[path] = ScmFileStatus::REMOVED;
+              break;
+            case PathStatus::UNKNOWN:
+              return computeFullStatus(
+                  entry.commitHash,
+                  entry.listIgnored,
+                  entry.ignoreGeneration,
+                  sequence);
+          }
+        }
+
+        incrementalUpdates_.fetch_add(1, std::memory_order_relaxed);
+        entry.sequence = sequence;
+        auto status = make_unique<ScmStatus>(entry.status);
+        storeEntry(std::move(entry));
+        return makeFuture(std::move(status));
+      });
+}
+
+void ScmStatusCache::storeEntry(Entry entry) {
+  *entry_.wlock() = std::move(entry);
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/Synchronized.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "eden/fs/journal/JournalDelta.h"
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/service/gen-cpp2/eden_types.h"
+
+namespace folly {
+template <typename T>
+class Future;
+}
+
+namespace facebook {
+namespace eden {
+
+class EdenMount;
+
+/**
+ * ScmStatusCache remembers the result of the most recent status computation
+ * for a mount, so that repeated getScmStatus() calls do not each have to diff
+ * the entire working directory.
+ *
+ * The cached status is tagged with the journal sequence number that was
+ * current when it was computed.  If the journal has not moved since, the
+ * cached status is returned as-is.  If it has, only the paths recorded in the
+ * journal since then are compared against the commit again.
+ *
+ * The incremental update only understands changes to files that exist in the
+ * commit.  Anything else (untracked files, directories, .gitignore files,
+ * checkouts, or more changed paths than
+ * --scm_status_cache_max_incremental_paths) falls back to a full diff, since
+ * working out whether an untracked path is ignored requires walking its
+ * parent directories' ignore files.
+ *
+ * ScmStatusCache is thread-safe.
+ */
+class ScmStatusCache {
+ public:
+  explicit ScmStatusCache(EdenMount* mount);
+  ~ScmStatusCache();
+
+  /**
+   * Get the status of the working directory relative to the specified commit.
+   */
+  folly::Future<std::unique_ptr<ScmStatus>> getStatus(
+      Hash commitHash,
+      bool listIgnored);
+
+  /**
+   * Forget the cached status, so the next getStatus() call performs a full
+   * diff.
+   */
+  void clear();
+
+  /**
+   * Get the number of getStatus() calls that were answered without a full
+   * diff.  Primarily for testing.
+   */
+  size_t getIncrementalUpdateCount() const {
+    return incrementalUpdates_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Entry {
+    Hash commitHash;
+    bool listIgnored;
+    uint64_t ignoreGeneration;
+    JournalDelta::SequenceNumber sequence;
+    ScmStatus status;
+  };
+
+  ScmStatusCache(const ScmStatusCache&) = delete;
+  ScmStatusCache& operator=(const ScmStatusCache&) = delete;
+
+  folly::Future<std::unique_ptr<ScmStatus>> computeFullStatus(
+      Hash commitHash,
+      bool listIgnored,
+      uint64_t ignoreGeneration,
+      JournalDelta::SequenceNumber sequence);
+
+  /**
+   * Collect the paths changed since the cached entry was computed.
+   *
+   * Returns folly::none if the journal deltas cannot be used to update
+   * the entry.
+   */
+  folly::Optional<std::vector<RelativePath>> getChangedPaths(
+      JournalDelta::SequenceNumber cachedSequence,
+      JournalDelta::SequenceNumber sequence) const;
+
+  folly::Future<std::unique_ptr<ScmStatus>> updateStatus(
+      Entry entry,
+      std::vector<RelativePath> paths,
+      JournalDelta::SequenceNumber sequence);
+
+  void storeEntry(Entry entry);
+
+  EdenMount* const mount_{nullptr};
+  folly::Synchronized<folly::Optional<Entry>> entry_;
+  std::atomic<size_t> incrementalUpdates_{0};
+};
+
+} // namespace eden
+} // namespace facebook
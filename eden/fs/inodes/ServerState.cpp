@@ -10,6 +10,7 @@
 #include "eden/fs/inodes/ServerState.h"
 
 #include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
 
 #include "eden/fs/config/EdenConfig.h"
 #include "eden/fs/fuse/privhelper/PrivHelper.h"
@@ -17,6 +18,12 @@
 #include "eden/fs/utils/Clock.h"
 #include "eden/fs/utils/UnboundedQueueExecutor.h"
 
+DEFINE_bool(
+    inotify_config_files,
+    true,
+    "Use inotify to notice changes to the config and ignore files, rather "
+    "than checking them every few seconds");
+
 namespace facebook {
 namespace eden {
 
@@ -29,23 +36,45 @@ constexpr std::chrono::seconds kUserIgnoreMinPollSeconds{5};
 /** Throttle Ignore change checks, max of 1 per kSystemIgnoreMinPollSeconds */
 constexpr std::chrono::seconds kSystemIgnoreMinPollSeconds{5};
 
+/** The number of parsed .gitignore files to keep in the GitIgnoreCache */
+constexpr size_t kGitIgnoreCacheSize{10000};
+
 ServerState::ServerState(
     UserInfo userInfo,
     std::shared_ptr<PrivHelper> privHelper,
     std::shared_ptr<UnboundedQueueExecutor> threadPool,
+    std::shared_ptr<UnboundedQueueExecutor> backgroundThreadPool,
+    std::shared_ptr<UnboundedQueueExecutor> overlayIoPool,
     std::shared_ptr<Clock> clock,
     std::shared_ptr<const EdenConfig> edenConfig)
     : userInfo_{std::move(userInfo)},
       privHelper_{std::move(privHelper)},
       threadPool_{std::move(threadPool)},
+      backgroundThreadPool_{std::move(backgroundThreadPool)},
+      overlayIoPool_{std::move(overlayIoPool)},
       clock_{std::move(clock)},
-      configState_{ConfigState{edenConfig}},
+      config_{edenConfig},
+      configState_{ConfigState{edenConfig, FLAGS_inotify_config_files}},
       userIgnoreFileMonitor_{CachedParsedFileMonitor<GitIgnoreFileParser>{
           edenConfig->getUserIgnoreFile(),
-          kUserIgnoreMinPollSeconds}},
+          kUserIgnoreMinPollSeconds,
+          FLAGS_inotify_config_files}},
       systemIgnoreFileMonitor_{CachedParsedFileMonitor<GitIgnoreFileParser>{
           edenConfig->getSystemIgnoreFile(),
-          kSystemIgnoreMinPollSeconds}} {}
+          kSystemIgnoreMinPollSeconds,
+          FLAGS_inotify_config_files}},
+      gitIgnoreCache_{kGitIgnoreCacheSize} {}
+
+ServerState::ConfigState::ConfigState(
+    const std::shared_ptr<const EdenConfig>& config,
+    bool useInotify) {
+  if (useInotify) {
+    // The trackers report a possible change until the first check, which
+    // catches anything that changed after the config was loaded.
+    userConfigTracker.emplace(config->getUserConfigPath());
+    systemConfigTracker.emplace(config->getSystemConfigPath());
+  }
+}
 
 ServerState::~ServerState() {}
 
@@ -53,32 +82,63 @@ std::shared_ptr<const EdenConfig> ServerState::getEdenConfig(bool skipUpdate) {
   if (!skipUpdate) {
     return getUpdatedEdenConfig();
   }
-  return configState_.rlock()->config;
+  return std::atomic_load_explicit(&config_, std::memory_order_acquire);
+}
+
+uint64_t ServerState::getEdenConfigVersion() const {
+  return configVersion_.load(std::memory_order_acquire);
 }
 
-// TODO: Update this monitoring code to use FileChangeMonitor.
 std::shared_ptr<const EdenConfig> ServerState::getUpdatedEdenConfig() {
-  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
-  // Throttle the updates
+  // Nearly every call comes between checks, and only has to load the
+  // current snapshot.
+  const auto now = std::chrono::steady_clock::now();
+  if (now.time_since_epoch().count() <
+      nextConfigCheck_.load(std::memory_order_relaxed)) {
+    return std::atomic_load_explicit(&config_, std::memory_order_acquire);
+  }
+
   auto cfgStatePtr = configState_.wlock();
-  if ((now - cfgStatePtr->lastCheck) > kEdenConfigMinPollSeconds) {
-    // Update the throttle setting - to prevent thrashing.
-    cfgStatePtr->lastCheck = now;
-    bool userConfigChanged = cfgStatePtr->config->hasUserConfigFileChanged();
-    bool systemConfigChanged =
-        cfgStatePtr->config->hasSystemConfigFileChanged();
-    if (userConfigChanged || systemConfigChanged) {
-      auto newConfig = std::make_shared<EdenConfig>(*cfgStatePtr->config);
-      if (userConfigChanged) {
-        newConfig->loadUserConfig();
-      }
-      if (systemConfigChanged) {
-        newConfig->loadSystemConfig();
-      }
-      cfgStatePtr->config = std::move(newConfig);
+  if (now.time_since_epoch().count() <
+      nextConfigCheck_.load(std::memory_order_relaxed)) {
+    // Another thread checked while we waited for the lock.
+    return std::atomic_load_explicit(&config_, std::memory_order_acquire);
+  }
+  // Throttle the updates
+  nextConfigCheck_.store(
+      (now + kEdenConfigMinPollSeconds).time_since_epoch().count(),
+      std::memory_order_relaxed);
+
+  // Only this thread can replace config_ while we hold the lock.
+  auto config = std::atomic_load_explicit(&config_, std::memory_order_acquire);
+  auto& userTracker = cfgStatePtr->userConfigTracker;
+  auto& systemTracker = cfgStatePtr->systemConfigTracker;
+  const bool userMayHaveChanged = !userTracker || userTracker->mayHaveChanged();
+  const bool systemMayHaveChanged =
+      !systemTracker || systemTracker->mayHaveChanged();
+  if (userTracker && userMayHaveChanged) {
+    userTracker->markChecked();
+  }
+  if (systemTracker && systemMayHaveChanged) {
+    systemTracker->markChecked();
+  }
+  bool userConfigChanged =
+      userMayHaveChanged && config->hasUserConfigFileChanged();
+  bool systemConfigChanged =
+      systemMayHaveChanged && config->hasSystemConfigFileChanged();
+  if (userConfigChanged || systemConfigChanged) {
+    auto newConfig = std::make_shared<EdenConfig>(*config);
+    if (userConfigChanged) {
+      newConfig->loadUserConfig();
     }
+    if (systemConfigChanged) {
+      newConfig->loadSystemConfig();
+    }
+    config = std::move(newConfig);
+    std::atomic_store_explicit(&config_, config, std::memory_order_release);
+    configVersion_.fetch_add(1, std::memory_order_release);
   }
-  return cfgStatePtr->config;
+  return config;
 }
 
 std::unique_ptr<TopLevelIgnores> ServerState::getTopLevelIgnores() {
@@ -108,5 +168,18 @@ std::unique_ptr<TopLevelIgnores> ServerState::getTopLevelIgnores() {
       std::move(userGitIgnore), std::move(systemGitIgnore));
 }
 
+uint64_t ServerState::getTopLevelIgnoresGeneration() {
+  auto edenConfig = getEdenConfig();
+
+  // getFileContents() checks whether the files have changed, bumping the
+  // update counts if they have.
+  auto userIgnoreFileMonitor = userIgnoreFileMonitor_.wlock();
+  userIgnoreFileMonitor->getFileContents(edenConfig->getUserIgnoreFile());
+  auto systemIgnoreFileMonitor = systemIgnoreFileMonitor_.wlock();
+  systemIgnoreFileMonitor->getFileContents(edenConfig->getSystemIgnoreFile());
+  return userIgnoreFileMonitor->getUpdateCount() +
+      systemIgnoreFileMonitor->getUpdateCount();
+}
+
 } // namespace eden
 } // namespace facebook
@@ -10,13 +10,16 @@
 #pragma once
 
 #include <folly/ThreadLocal.h>
+#include <atomic>
 #include <chrono>
 #include <memory>
 
 #include "eden/fs/config/CachedParsedFileMonitor.h"
 #include "eden/fs/fuse/EdenStats.h"
 #include "eden/fs/fuse/privhelper/UserInfo.h"
+#include "eden/fs/model/git/GitIgnoreCache.h"
 #include "eden/fs/model/git/GitIgnoreFileParser.h"
+#include "eden/fs/utils/InotifyWatcher.h"
 #include "eden/fs/utils/PathFuncs.h"
 
 namespace facebook {
@@ -40,6 +43,8 @@ class ServerState {
       UserInfo userInfo,
       std::shared_ptr<PrivHelper> privHelper,
       std::shared_ptr<UnboundedQueueExecutor> threadPool,
+      std::shared_ptr<UnboundedQueueExecutor> backgroundThreadPool,
+      std::shared_ptr<UnboundedQueueExecutor> overlayIoPool,
       std::shared_ptr<Clock> clock,
       std::shared_ptr<const EdenConfig> edenConfig);
   ~ServerState();
@@ -75,15 +80,41 @@ class ServerState {
    * necessary and return an updated EdenConfig. The update checks are
    * throttleSeconds to kEdenConfigMinPollSeconds. If 'skipUpdate' is set, no
    * update check is performed and the current EdenConfig is returned.
+   *
+   * Between update checks this does not take any locks.  The returned
+   * EdenConfig is never modified, so callers on hot paths should fetch it
+   * once per request and read all the settings they need from it.
    */
   std::shared_ptr<const EdenConfig> getEdenConfig(bool skipUpdate = false);
 
+  /**
+   * Get a number that increases each time the EdenConfig is reloaded.
+   *
+   * Code that derives state from config settings, such as cache sizes, can
+   * store this along with it, and redo the work once it changes.
+   */
+  uint64_t getEdenConfigVersion() const;
+
   /**
    * Get the TopLevelIgnores. It is based on the system and user git ignore
    * files.
    */
   std::unique_ptr<TopLevelIgnores> getTopLevelIgnores();
 
+  /**
+   * Get a number that changes whenever the system or user git ignore files
+   * change, so that callers can tell whether results computed with an
+   * earlier TopLevelIgnores object are still valid.
+   */
+  uint64_t getTopLevelIgnoresGeneration();
+
+  /**
+   * Get the cache of parsed .gitignore files shared by all mount points.
+   */
+  GitIgnoreCache* getGitIgnoreCache() {
+    return &gitIgnoreCache_;
+  }
+
   /**
    * Get the UserInfo object describing the user running this edenfs process.
    */
@@ -102,12 +133,40 @@ class ServerState {
   /**
    * Get the thread pool.
    *
+   * This pool runs latency-sensitive work: the continuations of FUSE
+   * requests and of the backing store imports they wait on.  Bulk work
+   * belongs on getBackgroundThreadPool() instead, so that it cannot queue
+   * up ahead of a lookup.
+   *
    * Adding new tasks to this thread pool executor will never block.
    */
   const std::shared_ptr<UnboundedQueueExecutor>& getThreadPool() const {
     return threadPool_;
   }
 
+  /**
+   * Get the thread pool for bulk background work, such as glob evaluation
+   * and prefetching, diffs between commits, and local store garbage
+   * collection.
+   *
+   * Adding new tasks to this thread pool executor will never block.
+   */
+  const std::shared_ptr<UnboundedQueueExecutor>& getBackgroundThreadPool()
+      const {
+    return backgroundThreadPool_;
+  }
+
+  /**
+   * Get the thread pool for reads, writes and syncs of materialized files in
+   * the overlay.  While a thread here waits on the disk, the FUSE worker
+   * that received the request is free to handle others.
+   *
+   * This is null if overlay I/O should run on the calling thread instead.
+   */
+  const std::shared_ptr<UnboundedQueueExecutor>& getOverlayIoPool() const {
+    return overlayIoPool_;
+  }
+
   /**
    * Get the Clock.
    */
@@ -117,10 +176,13 @@ class ServerState {
 
  private:
   struct ConfigState {
-    explicit ConfigState(const std::shared_ptr<const EdenConfig>& config)
-        : config{config} {}
-    std::chrono::steady_clock::time_point lastCheck;
-    std::shared_ptr<const EdenConfig> config;
+    ConfigState(
+        const std::shared_ptr<const EdenConfig>& config,
+        bool useInotify);
+    // Set if the config files are watched with inotify, in which case they
+    // are only stat()ed after a change has been reported.
+    folly::Optional<InotifyChangeTracker> userConfigTracker;
+    folly::Optional<InotifyChangeTracker> systemConfigTracker;
   };
 
   /**
@@ -136,12 +198,26 @@ class ServerState {
   ThreadLocalEdenStats edenStats_;
   std::shared_ptr<PrivHelper> privHelper_;
   std::shared_ptr<UnboundedQueueExecutor> threadPool_;
+  std::shared_ptr<UnboundedQueueExecutor> backgroundThreadPool_;
+  std::shared_ptr<UnboundedQueueExecutor> overlayIoPool_;
   std::shared_ptr<Clock> clock_;
+  /**
+   * The current EdenConfig.  It is never modified once published here, so
+   * readers can use it without locking; a reload publishes a new one.
+   *
+   * This is only accessed with std::atomic_load() and std::atomic_store(),
+   * and only replaced while holding configState_'s lock.
+   */
+  std::shared_ptr<const EdenConfig> config_;
+  std::atomic<uint64_t> configVersion_{0};
+  /** When config_ is next due to be checked, in steady_clock ticks. */
+  std::atomic<std::chrono::steady_clock::rep> nextConfigCheck_{0};
   folly::Synchronized<ConfigState> configState_;
   folly::Synchronized<CachedParsedFileMonitor<GitIgnoreFileParser>>
       userIgnoreFileMonitor_;
   folly::Synchronized<CachedParsedFileMonitor<GitIgnoreFileParser>>
       systemIgnoreFileMonitor_;
+  GitIgnoreCache gitIgnoreCache_;
 };
 } // namespace eden
 } // namespace facebook
@@ -0,0 +1,197 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/SqliteOverlayDirStore.h"
+
+#include <folly/Bits.h>
+#include <folly/ScopeGuard.h>
+#include <array>
+#include <cstring>
+
+namespace facebook {
+namespace eden {
+
+using folly::ByteRange;
+using folly::StringPiece;
+
+namespace {
+// Keys are big-endian so that the rows are stored in inode number order.
+using InodeKey = std::array<uint8_t, sizeof(uint64_t)>;
+
+InodeKey makeKey(InodeNumber inodeNumber) {
+  InodeKey key;
+  auto value = folly::Endian::big(inodeNumber.get());
+  memcpy(key.data(), &value, sizeof(value));
+  return key;
+}
+} // namespace
+
+SqliteOverlayDirStore::SqliteOverlayDirStore(AbsolutePathPiece path)
+    : db_(path, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) {
+  auto db = db_.lock();
+
+  SqliteStatement(db, "PRAGMA journal_mode=WAL").step();
+  SqliteStatement(db, "PRAGMA synchronous=NORMAL").step();
+  SqliteStatement(
+      db,
+      "CREATE TABLE IF NOT EXISTS dirs(",
+      "inode BINARY NOT NULL,",
+      "value BINARY NOT NULL,",
+      "PRIMARY KEY (inode)",
+      ")")
+      .step();
+
+  loadStatement_ = std::make_unique<SqliteStatement>(
+      db, "SELECT value FROM dirs WHERE inode = ?");
+  saveStatement_ = std::make_unique<SqliteStatement>(
+      db, "INSERT OR REPLACE INTO dirs VALUES(?, ?)");
+  removeStatement_ =
+      std::make_unique<SqliteStatement>(db, "DELETE FROM dirs WHERE inode = ?");
+  hasStatement_ = std::make_unique<SqliteStatement>(
+      db, "SELECT 1 FROM dirs WHERE inode = ?");
+}
+
+SqliteOverlayDirStore::~SqliteOverlayDirStore() {
+  {
+    auto db = db_.lock();
+    loadStatement_.reset();
+    saveStatement_.reset();
+    removeStatement_.reset();
+    hasStatement_.reset();
+  }
+  db_.close();
+}
+
+folly::Optional<std::string> SqliteOverlayDirStore::load(
+    InodeNumber inodeNumber) {
+  auto key = makeKey(inodeNumber);
+  auto db = db_.lock();
+  auto& stmt = *loadStatement_;
+  SCOPE_EXIT {
+    stmt.reset();
+  };
+  stmt.bind(1, ByteRange{key});
+  if (!stmt.step()) {
+    return folly::none;
+  }
+  return stmt.columnBlob(0).str();
+}
+
+void SqliteOverlayDirStore::save(
+    InodeNumber inodeNumber,
+    ByteRange header,
+    ByteRange contents) {
+  auto key = makeKey(inodeNumber);
+  std::string value;
+  value.reserve(header.size() + contents.size());
+  value.append(reinterpret_cast<const char*>(header.data()), header.size());
+  value.append(reinterpret_cast<const char*>(contents.data()), contents.size());
+
+  auto db = db_.lock();
+  auto& stmt = *saveStatement_;
+  SCOPE_EXIT {
+    stmt.reset();
+  };
+  stmt.bind(1, ByteRange{key});
+  stmt.bind(2, StringPiece{value});
+  stmt.step();
+}
+
+void SqliteOverlayDirStore::save(
+    const std::vector<std::pair<InodeNumber, ByteRange>>& records) {
+  if (records.empty()) {
+    return;
+  }
+
+  auto db = db_.lock();
+  SqliteStatement(db, "BEGIN").step();
+  try {
+    auto& stmt = *saveStatement_;
+    for (const auto& record : records) {
+      SCOPE_EXIT {
+        stmt.reset();
+      };
+      auto key = makeKey(record.first);
+      stmt.bind(1, ByteRange{key});
+      stmt.bind(2, record.second);
+      stmt.step();
+    }
+    SqliteStatement(db, "COMMIT").step();
+  } catch (const std::exception&) {
+    SqliteStatement(db, "ROLLBACK").step();
+    throw;
+  }
+}
+
+bool SqliteOverlayDirStore::remove(InodeNumber inodeNumber) {
+  auto key = makeKey(inodeNumber);
+  auto db = db_.lock();
+  auto& stmt = *removeStatement_;
+  SCOPE_EXIT {
+    stmt.reset();
+  };
+  stmt.bind(1, ByteRange{key});
+  stmt.step();
+  return sqlite3_changes(*db) > 0;
+}
+
+void SqliteOverlayDirStore::remove(
+    const std::vector<InodeNumber>& inodeNumbers) {
+  if (inodeNumbers.empty()) {
+    return;
+  }
+
+  auto db = db_.lock();
+  SqliteStatement(db, "BEGIN").step();
+  try {
+    auto& stmt = *removeStatement_;
+    for (auto inodeNumber : inodeNumbers) {
+      SCOPE_EXIT {
+        stmt.reset();
+      };
+      auto key = makeKey(inodeNumber);
+      stmt.bind(1, ByteRange{key});
+      stmt.step();
+    }
+    SqliteStatement(db, "COMMIT").step();
+  } catch (const std::exception&) {
+    SqliteStatement(db, "ROLLBACK").step();
+    throw;
+  }
+}
+
+bool SqliteOverlayDirStore::has(InodeNumber inodeNumber) {
+  auto key = makeKey(inodeNumber);
+  auto db = db_.lock();
+  auto& stmt = *hasStatement_;
+  SCOPE_EXIT {
+    stmt.reset();
+  };
+  stmt.bind(1, ByteRange{key});
+  return stmt.step();
+}
+
+std::vector<InodeNumber> SqliteOverlayDirStore::getAllInodeNumbers() {
+  std::vector<InodeNumber> inodeNumbers;
+  auto db = db_.lock();
+  SqliteStatement stmt(db, "SELECT inode FROM dirs");
+  while (stmt.step()) {
+    auto key = stmt.columnBlob(0);
+    if (key.size() != sizeof(uint64_t)) {
+      continue;
+    }
+    uint64_t value;
+    memcpy(&value, key.data(), sizeof(value));
+    inodeNumbers.emplace_back(folly::Endian::big(value));
+  }
+  return inodeNumbers;
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,60 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <memory>
+#include "eden/fs/inodes/OverlayDirStore.h"
+#include "eden/fs/sqlite/Sqlite.h"
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * An OverlayDirStore that keeps every directory record in one sqlite
+ * database.
+ *
+ * Saving a directory is a single row update rather than creating, writing
+ * and renaming a file, and reading one back does not need to open a file.
+ * The database is used in WAL mode with synchronous=NORMAL, so a write does
+ * not wait for the disk but the database cannot be corrupted by a crash; this
+ * matches the durability docs/InodeStorage.md promises for the files.
+ *
+ * All statements are prepared once and run on a single connection.
+ */
+class SqliteOverlayDirStore : public OverlayDirStore {
+ public:
+  explicit SqliteOverlayDirStore(AbsolutePathPiece path);
+  ~SqliteOverlayDirStore() override;
+
+  folly::Optional<std::string> load(InodeNumber inodeNumber) override;
+  void save(
+      InodeNumber inodeNumber,
+      folly::ByteRange header,
+      folly::ByteRange contents) override;
+  void save(const std::vector<std::pair<InodeNumber, folly::ByteRange>>&
+                records) override;
+  bool remove(InodeNumber inodeNumber) override;
+  void remove(const std::vector<InodeNumber>& inodeNumbers) override;
+  bool has(InodeNumber inodeNumber) override;
+  std::vector<InodeNumber> getAllInodeNumbers() override;
+
+ private:
+  SqliteDatabase db_;
+
+  // Only used while holding a lock on db_, and finalized before db_ is
+  // closed.
+  std::unique_ptr<SqliteStatement> loadStatement_;
+  std::unique_ptr<SqliteStatement> saveStatement_;
+  std::unique_ptr<SqliteStatement> removeStatement_;
+  std::unique_ptr<SqliteStatement> hasStatement_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -15,6 +15,7 @@
 #include <folly/futures/Future.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
 #include <vector>
 
 #include "eden/fs/fuse/FuseChannel.h"
@@ -32,6 +33,7 @@
 #include "eden/fs/inodes/InodeMap.h"
 #include "eden/fs/inodes/InodeTable.h"
 #include "eden/fs/inodes/Overlay.h"
+#include "eden/fs/inodes/ServerState.h"
 #include "eden/fs/inodes/TreeInodeDirHandle.h"
 #include "eden/fs/journal/JournalDelta.h"
 #include "eden/fs/model/Tree.h"
@@ -39,11 +41,15 @@
 #include "eden/fs/model/git/GitIgnoreStack.h"
 #include "eden/fs/service/ThriftUtil.h"
 #include "eden/fs/service/gen-cpp2/eden_types.h"
+#include "eden/fs/store/BlobMetadata.h"
 #include "eden/fs/store/ObjectStore.h"
 #include "eden/fs/utils/Bug.h"
+#include "eden/fs/utils/Cancellation.h"
 #include "eden/fs/utils/Clock.h"
+#include "eden/fs/utils/CycleClock.h"
 #include "eden/fs/utils/PathFuncs.h"
 #include "eden/fs/utils/TimeUtil.h"
+#include "eden/fs/utils/TraceBuffer.h"
 #include "eden/fs/utils/UnboundedQueueExecutor.h"
 
 using folly::ByteRange;
@@ -57,6 +63,19 @@ using std::shared_ptr;
 using std::unique_ptr;
 using std::vector;
 
+DEFINE_int32(
+    bulk_load_children_max_entries,
+    256,
+    "The first time a child of a directory with at most this many entries is "
+    "looked up, or the directory is read, start loading all of its children.  "
+    "0 disables this.");
+
+DEFINE_int32(
+    sibling_blob_prefetch_count,
+    16,
+    "When the files of a directory are loaded in name order, prefetch the "
+    "blobs of up to this many of the files that follow.  0 disables this.");
+
 namespace facebook {
 namespace eden {
 
@@ -182,32 +201,100 @@ TreeInode::TreeInode(
 TreeInode::~TreeInode() {}
 
 folly::Future<Dispatcher::Attr> TreeInode::getattr() {
-  return getAttrLocked(contents_.rlock()->entries);
+  return getAttrLocked(*contents_.rlock());
 }
 
-Dispatcher::Attr TreeInode::getAttrLocked(const DirContents& contents) {
-  Dispatcher::Attr attr(getMount()->initStatData());
+Dispatcher::Attr TreeInode::getAttrLocked(const TreeInodeState& contents) {
+  Dispatcher::Attr attr(
+      getMount()->initStatData(),
+      getMount()->getAttrTimeout(contents.isMaterialized()));
 
   attr.st.st_ino = getNodeId().get();
-  getMetadataLocked(contents).applyToStat(attr.st);
+  getMetadataLocked(contents.entries).applyToStat(attr.st);
 
   // For directories, nlink is the number of entries including the
   // "." and ".." links.
-  attr.st.st_nlink = contents.size() + 2;
+  attr.st.st_nlink = contents.entries.size() + 2;
   return attr;
 }
 
+folly::Optional<Dispatcher::Attr> TreeInode::getUnloadedChildAttr(
+    PathComponentPiece name) {
+  auto contents = contents_.rlock();
+  auto iter = contents->entries.find(name);
+  if (iter == contents->entries.end()) {
+    return folly::none;
+  }
+  const auto& entry = iter->second;
+  if (!entry.isDirectory() || entry.isMaterialized() || entry.getInode()) {
+    return folly::none;
+  }
+
+  auto* mount = getMount();
+  auto number = entry.getInodeNumber();
+  auto st = mount->initStatData();
+  st.st_ino = number.get();
+  // The number of subdirectories is not known until the Tree is fetched.  A
+  // link count of 1 tells tools like find not to rely on it.
+  st.st_nlink = 1;
+  mount->getInodeMetadataTable()
+      ->setDefault(
+          number, mount->getInitialInodeMetadata(entry.getInitialMode()))
+      .applyToStat(st);
+  return Dispatcher::Attr{st, mount->getAttrTimeout(false)};
+}
+
+bool TreeInode::incChildFuseRefcount(
+    PathComponentPiece name,
+    InodeNumber number) {
+  // Hold the contents lock so that the child cannot finish loading or be
+  // unloaded while its reference is recorded.
+  auto contents = contents_.wlock();
+  auto iter = contents->entries.find(name);
+  if (iter == contents->entries.end() ||
+      iter->second.getInodeNumber() != number) {
+    return false;
+  }
+  const auto& entry = iter->second;
+  if (auto* child = entry.getInode()) {
+    child->incFuseRefcount();
+  } else {
+    getInodeMap()->incUnloadedChildFuseRefcount(
+        this, name, number, entry.getInitialMode(), entry.getOptionalHash());
+  }
+  return true;
+}
+
 folly::Future<InodePtr> TreeInode::getChildByName(
     PathComponentPiece namepiece) {
   return getOrLoadChild(namepiece);
 }
 
 Future<InodePtr> TreeInode::getOrLoadChild(PathComponentPiece name) {
+  // Most lookups are for children that are already loaded, often in the
+  // directories that every process walks through.  Answer those under the
+  // shared lock, so that they do not serialize on the exclusive lock.  The
+  // exclusive lock is only needed to load a child, or to clear the bulk load
+  // flag the first time a child loaded in bulk is looked up.
+  {
+    auto contents = contents_.rlock();
+    auto iter = contents->entries.find(name);
+    if (iter != contents->entries.end() && !iter->second.isLoadedInBulk()) {
+      // Parent contents locks held in shared mode still prevent the child
+      // from being unloaded, since unloading needs the exclusive lock.
+      if (auto child = iter->second.getInodePtr()) {
+        return makeFuture<InodePtr>(std::move(child));
+      }
+    }
+  }
+
   auto inodeLoadFuture = Future<unique_ptr<InodeBase>>::makeEmpty();
   auto returnFuture = Future<InodePtr>::makeEmpty();
   InodePtr childInodePtr;
   InodeMap::PromiseVector promises;
   InodeNumber childNumber;
+  std::vector<IncompleteInodeLoad> bulkLoads;
+  CycleClock::Ticks loadStart;
   {
     auto contents = contents_.wlock();
     auto iter = contents->entries.find(name);
@@ -223,6 +310,10 @@ Future<InodePtr> TreeInode::getOrLoadChild(PathComponentPiece name) {
 
     // Check to see if the entry is already loaded
     auto& entry = iter->second;
+    if (entry.isLoadedInBulk()) {
+      entry.setLoadedInBulk(false);
+      getMount()->getStats()->get()->bulkLoadHits.addValue(1);
+    }
     if (entry.getInode()) {
       return makeFuture<InodePtr>(entry.getInodePtr());
     }
@@ -230,6 +321,7 @@ Future<InodePtr> TreeInode::getOrLoadChild(PathComponentPiece name) {
     // The entry is not loaded yet.  Ask the InodeMap about the entry.
     // The InodeMap will tell us if this inode is already in the process of
     // being loaded, or if we need to start loading it now.
+    loadStart = CycleClock::now();
     folly::Promise<InodePtr> promise;
     returnFuture = promise.getFuture();
     childNumber = entry.getInodeNumber();
@@ -251,6 +343,10 @@ Future<InodePtr> TreeInode::getOrLoadChild(PathComponentPiece name) {
         inodeLoadFuture = std::move(loadFuture);
       }
     }
+
+    // This is probably the start of a crawl of this directory.  Start
+    // loading its other children while we hold the lock.
+    bulkLoadChildrenLocked(*contents, name, &bulkLoads);
   }
 
   if (inodeLoadFuture.valid()) {
@@ -260,8 +356,104 @@ Future<InodePtr> TreeInode::getOrLoadChild(PathComponentPiece name) {
       promise.setValue(childInodePtr);
     }
   }
+  for (auto& load : bulkLoads) {
+    load.finish();
+  }
 
-  return returnFuture;
+  return RequestData::timeInodeLoad(std::move(returnFuture), loadStart);
+}
+
+void TreeInode::bulkLoadChildren() {
+  std::vector<IncompleteInodeLoad> pendingLoads;
+  {
+    auto contents = contents_.wlock();
+    bulkLoadChildrenLocked(*contents, folly::none, &pendingLoads);
+  }
+  for (auto& load : pendingLoads) {
+    load.finish();
+  }
+}
+
+void TreeInode::bulkLoadChildrenLocked(
+    TreeInodeState& contents,
+    folly::Optional<PathComponentPiece> skip,
+    std::vector<IncompleteInodeLoad>* pendingLoads) {
+  if (contents.childrenBulkLoaded ||
+      FLAGS_bulk_load_children_max_entries <= 0 ||
+      contents.entries.size() >
+          static_cast<size_t>(FLAGS_bulk_load_children_max_entries)) {
+    return;
+  }
+  contents.childrenBulkLoaded = true;
+
+  uint64_t numLoaded = 0;
+  for (auto& entry : contents.entries) {
+    auto& ent = entry.second;
+    if (ent.getInode() || (skip && entry.first == skip.value())) {
+      continue;
+    }
+    // Nobody is waiting for the result; the InodeMap keeps the child loaded.
+    loadChildLocked(contents.entries, entry.first, ent, pendingLoads);
+    ent.setLoadedInBulk(true);
+    ++numLoaded;
+  }
+  if (numLoaded) {
+    XLOG(DBG5) << "bulk loading " << numLoaded << " children of "
+               << getLogPath();
+    getMount()->getStats()->get()->bulkLoadedChildren.addValue(numLoaded);
+  }
+}
+
+void TreeInode::prefetchSiblingBlobs(PathComponentPiece name) {
+  auto* stats = getMount()->getStats()->get();
+  std::vector<Hash> toPrefetch;
+  {
+    auto contents = contents_.wlock();
+    auto iter = contents->entries.find(name);
+    if (iter == contents->entries.end()) {
+      return;
+    }
+    if (iter->second.isBlobPrefetched()) {
+      iter->second.setBlobPrefetched(false);
+      stats->siblingBlobPrefetchHits.addValue(1);
+    }
+
+    const bool inOrder =
+        contents->lastBlobLoad && contents->lastBlobLoad.value() < name;
+    contents->lastBlobLoad = PathComponent{name};
+    if (!inOrder || FLAGS_sibling_blob_prefetch_count <= 0) {
+      return;
+    }
+
+    // Keep the next files prefetched.  Those prefetched by earlier loads
+    // still count against the window, so it only moves ahead by about one
+    // file per load.
+    int32_t numFiles = 0;
+    for (++iter; iter != contents->entries.end() &&
+         numFiles < FLAGS_sibling_blob_prefetch_count;
+         ++iter) {
+      auto& entry = iter->second;
+      if (entry.isDirectory() || entry.isMaterialized()) {
+        continue;
+      }
+      ++numFiles;
+      if (!entry.isBlobPrefetched()) {
+        entry.setBlobPrefetched(true);
+        toPrefetch.push_back(entry.getHash());
+      }
+    }
+  }
+
+  if (toPrefetch.empty()) {
+    return;
+  }
+  XLOG(DBG5) << "prefetching " << toPrefetch.size() << " blobs after " << name
+             << " in " << getLogPath();
+  stats->siblingBlobsPrefetched.addValue(toPrefetch.size());
+  getStore()->prefetchBlobs(toPrefetch).onError(
+      [](const folly::exception_wrapper& ew) {
+        XLOG(DBG3) << "error prefetching sibling blobs: " << ew.what();
+      });
 }
 
 Future<TreeInodePtr> TreeInode::getOrLoadChildTree(PathComponentPiece name) {
@@ -274,6 +466,55 @@ Future<TreeInodePtr> TreeInode::getOrLoadChildTree(PathComponentPiece name) {
   });
 }
 
+Future<vector<folly::Try<Hash>>> TreeInode::getChildSha1s(
+    const vector<PathComponent>& names) {
+  // Look up all of the entries with a single lock acquisition.  Loaded
+  // inodes are collected and asked for their SHA-1 after releasing the lock.
+  vector<Future<Hash>> futures;
+  vector<std::pair<size_t, InodePtr>> loadedChildren;
+  vector<size_t> unloadedChildren;
+  futures.reserve(names.size());
+  {
+    auto contents = contents_.rlock();
+    for (size_t n = 0; n < names.size(); ++n) {
+      const auto& name = names[n];
+      auto iter = contents->entries.find(name);
+      if (iter == contents->entries.end()) {
+        futures.emplace_back(
+            makeFuture<Hash>(InodeError(ENOENT, inodePtrFromThis(), name)));
+        continue;
+      }
+      const auto& entry = iter->second;
+      if (entry.isDirectory()) {
+        futures.emplace_back(
+            makeFuture<Hash>(InodeError(EISDIR, inodePtrFromThis(), name)));
+      } else if (!S_ISREG(entry.getInitialMode())) {
+        // We intentionally want to refuse to compute the SHA1 of symlinks
+        futures.emplace_back(makeFuture<Hash>(
+            InodeError(EINVAL, inodePtrFromThis(), name, "file is a symlink")));
+      } else if (entry.getInode()) {
+        futures.emplace_back(Future<Hash>::makeEmpty());
+        loadedChildren.emplace_back(n, entry.getInodePtr());
+      } else if (entry.isMaterialized()) {
+        futures.emplace_back(Future<Hash>::makeEmpty());
+        unloadedChildren.push_back(n);
+      } else {
+        futures.emplace_back(getStore()->getBlobMetadata(entry.getHash()).then(
+            [](const BlobMetadata& metadata) { return metadata.sha1; }));
+      }
+    }
+  }
+
+  for (auto& child : loadedChildren) {
+    futures[child.first] = child.second.asFilePtr()->getSha1();
+  }
+  for (auto n : unloadedChildren) {
+    futures[n] = getOrLoadChild(names[n]).then(
+        [](const InodePtr& inode) { return inode.asFilePtr()->getSha1(); });
+  }
+  return folly::collectAllSemiFuture(std::move(futures)).toUnsafeFuture();
+}
+
 namespace {
 /**
  * A helper class for performing a recursive path lookup.
@@ -523,6 +764,10 @@ Future<unique_ptr<InodeBase>> TreeInode::startLoadingInodeNoThrow(
   // It simplifies their logic to guarantee that we never throw an exception,
   // and always return a Future object.  Therefore we simply wrap
   // startLoadingInode() and convert any thrown exceptions into Future.
+  TraceBuffer::record(
+      TraceEventKind::INODE_LOAD,
+      TracePhase::BEGIN,
+      entry.getInodeNumber().get());
   try {
     return startLoadingInode(entry, name);
   } catch (const std::exception& ex) {
@@ -613,8 +858,12 @@ Future<unique_ptr<InodeBase>> TreeInode::startLoadingInode(
   }
 
   if (!entry.isMaterialized()) {
+    // InodeMap shares this load with every other lookup of the same inode,
+    // without tracking who is waiting, so it must not be dropped when the
+    // request that started it is cancelled.
+    CancellationScope uncancellable{CancellationToken{}};
     return getStore()
-        ->getTree(entry.getHash())
+        ->getTree(entry.getHash(), ImportPriority::Interactive)
         .then(
             [self = inodePtrFromThis(),
              childName = PathComponent{name},
@@ -865,8 +1114,11 @@ DirContents TreeInode::buildDirFromTree(const Tree* tree, Overlay* overlay) {
   // of atomic operations from N to 1, though if the atomic is issued with the
   // other work this loop is doing it may not matter much.
 
+  // Tree entries are sorted, so each emplace() appends to the end.  Reserve
+  // the exact size up front so large directories don't carry the vector's
+  // spare growth capacity around for as long as they stay loaded.
   DirContents dir;
-  // TODO: O(N^2)
+  dir.reserve(tree->getTreeEntries().size());
   for (const auto& treeEntry : tree->getTreeEntries()) {
     dir.emplace(
         treeEntry.getName(),
@@ -878,7 +1130,7 @@ DirContents TreeInode::buildDirFromTree(const Tree* tree, Overlay* overlay) {
 }
 
 FileInodePtr TreeInode::createImpl(
-    folly::Synchronized<TreeInodeState>::LockedPtr contents,
+    SynchronizedTreeInodeState::LockedPtr contents,
     PathComponentPiece name,
     mode_t mode,
     ByteRange fileContents,
@@ -1298,7 +1550,7 @@ int TreeInode::tryRemoveChild(
   // We have successfully removed the entry.
   // Flush the kernel cache for this entry if requested.
   if (flushKernelCache) {
-    invalidateFuseCache(name);
+    invalidateFuseCacheIfCached(name, child->isReferencedByKernel());
   }
 
   return 0;
@@ -1322,6 +1574,11 @@ int TreeInode::checkPreRemove(const FileInodePtr& /* child */) {
  * A helper class that stores all locks required to perform a rename.
  *
  * This class helps acquire the locks in the correct order.
+ *
+ * Most renames hold the mountpoint-wide rename lock in exclusive mode.
+ * Renames of a file within a single directory hold it in shared mode instead,
+ * along with that directory's rename lock, so that they can run in parallel
+ * with renames in other directories.
  */
 class TreeInode::TreeRenameLocks {
  public:
@@ -1333,6 +1590,19 @@ class TreeInode::TreeRenameLocks {
       TreeInode* destTree,
       PathComponentPiece destName);
 
+  /**
+   * Acquire the locks for a rename within the single directory tree, holding
+   * the mountpoint-wide rename lock in shared mode.
+   *
+   * The caller must check that the source is not a directory before
+   * performing the rename with these locks, and fall back to acquireLocks()
+   * otherwise.
+   */
+  void acquireDirectoryLocks(
+      SharedRenameLock&& renameLock,
+      TreeInode* tree,
+      PathComponentPiece destName);
+
   /**
    * Reset the TreeRenameLocks to the empty state, releasing all locks that it
    * holds.
@@ -1343,16 +1613,42 @@ class TreeInode::TreeRenameLocks {
 
   /**
    * Release all locks held by this TreeRenameLocks object except for the
-   * mount point RenameLock.
+   * mount point rename lock and, if held, the directory rename lock.
    */
   void releaseAllButRename() {
-    *this = TreeRenameLocks(std::move(renameLock_));
+    TreeRenameLocks remaining;
+    remaining.renameLock_ = std::move(renameLock_);
+    remaining.sharedRenameLock_ = std::move(sharedRenameLock_);
+    remaining.directoryRenameLock_ = std::move(directoryRenameLock_);
+    *this = std::move(remaining);
+  }
+
+  /**
+   * Returns true if the mount point rename lock is held in exclusive mode,
+   * and false if this is a rename within a single directory.
+   */
+  bool holdsExclusiveRenameLock() const {
+    return renameLock_.owns_lock();
+  }
+
+  bool holdsRenameLock() const {
+    return renameLock_.owns_lock() || sharedRenameLock_.owns_lock();
   }
 
   const RenameLock& renameLock() const {
+    DCHECK(holdsExclusiveRenameLock());
     return renameLock_;
   }
 
+  const SharedRenameLock& sharedRenameLock() const {
+    DCHECK(sharedRenameLock_.owns_lock());
+    return sharedRenameLock_;
+  }
+
+  bool srcIsMaterialized() const {
+    return srcContentsLock_->isMaterialized();
+  }
+
   DirContents* srcContents() {
     return srcContents_;
   }
@@ -1382,15 +1678,18 @@ class TreeInode::TreeRenameLocks {
   }
 
  private:
-  explicit TreeRenameLocks(RenameLock&& renameLock)
-      : renameLock_{std::move(renameLock)} {}
-
   void lockDestChild(PathComponentPiece destName);
 
   /**
-   * The mountpoint-wide rename lock.
+   * The mountpoint-wide rename lock.  Only one of these is held.
    */
   RenameLock renameLock_;
+  SharedRenameLock sharedRenameLock_;
+
+  /**
+   * The directory rename lock, held along with sharedRenameLock_.
+   */
+  std::unique_lock<std::mutex> directoryRenameLock_;
 
   /**
    * Locks for the contents of the source and destination directories.
@@ -1399,9 +1698,9 @@ class TreeInode::TreeRenameLocks {
    * always both set, so that destContents_ can be used regardless of wether
    * the source and destination are both the same directory or not.
    */
-  folly::Synchronized<TreeInodeState>::LockedPtr srcContentsLock_;
-  folly::Synchronized<TreeInodeState>::LockedPtr destContentsLock_;
-  folly::Synchronized<TreeInodeState>::LockedPtr destChildContentsLock_;
+  SynchronizedTreeInodeState::LockedPtr srcContentsLock_;
+  SynchronizedTreeInodeState::LockedPtr destContentsLock_;
+  SynchronizedTreeInodeState::LockedPtr destChildContentsLock_;
 
   /**
    * Pointers to the source and destination directory contents.
@@ -1437,15 +1736,36 @@ Future<Unit> TreeInode::rename(
   bool needSrc = false;
   bool needDest = false;
   {
-    auto renameLock = getMount()->acquireRenameLock();
-    materialize(&renameLock);
-    if (destParent.get() != this) {
-      destParent->materialize(&renameLock);
+    TreeRenameLocks locks;
+    if (destParent.get() == this) {
+      // Renaming a file within a single directory cannot change the path of
+      // any other inode, so try to do it without excluding every other rename
+      // in the mount.  Build systems often stage their outputs this way.
+      materialize();
+      locks.acquireDirectoryLocks(
+          getMount()->acquireSharedRenameLock(), this, destName);
+      auto srcIter = locks.srcContents()->find(name);
+      if (!locks.srcIsMaterialized() ||
+          (srcIter != locks.srcContents()->end() &&
+           srcIter->second.isDirectory())) {
+        // Either a checkout dematerialized this directory after we
+        // materialized it, or this renames a directory, which changes the
+        // path of everything inside it.  Use the exclusive lock instead.
+        locks.reset();
+      }
     }
 
-    // Acquire the locks required to do the rename
-    TreeRenameLocks locks;
-    locks.acquireLocks(std::move(renameLock), this, destParent.get(), destName);
+    if (!locks.holdsRenameLock()) {
+      auto renameLock = getMount()->acquireRenameLock();
+      materialize(&renameLock);
+      if (destParent.get() != this) {
+        destParent->materialize(&renameLock);
+      }
+
+      // Acquire the locks required to do the rename
+      locks.acquireLocks(
+          std::move(renameLock), this, destParent.get(), destName);
+    }
 
     // Look up the source entry.  The destination entry info was already
     // loaded by TreeRenameLocks::acquireLocks().
@@ -1576,6 +1896,8 @@ Future<Unit> TreeInode::doRename(
   // directory.  That will have already been caught by the earlier check that
   // ensures the destination directory is non-empty.
   if (srcEntry.isDirectory()) {
+    // Directories are only renamed with the exclusive rename lock.
+    DCHECK(locks.holdsExclusiveRenameLock());
     // Our caller has already verified that the source is also a
     // directory here.
     auto* srcTreeInode =
@@ -1593,8 +1915,13 @@ Future<Unit> TreeInode::doRename(
   auto* childInode = srcEntry.getInode();
   bool destChildExists = locks.destChildExists();
   if (destChildExists) {
-    deletedInode = locks.destChild()->markUnlinked(
-        destParent.get(), destName, locks.renameLock());
+    if (locks.holdsExclusiveRenameLock()) {
+      deletedInode = locks.destChild()->markUnlinked(
+          destParent.get(), destName, locks.renameLock());
+    } else {
+      deletedInode = locks.destChild()->markUnlinked(
+          destParent.get(), destName, locks.sharedRenameLock());
+    }
 
     // Replace the destination contents entry with the source data
     locks.destChildIter()->second = std::move(srcIter->second);
@@ -1612,7 +1939,11 @@ Future<Unit> TreeInode::doRename(
   }
 
   // Inform the child inode that it has been moved
-  childInode->updateLocation(destParent, destName, locks.renameLock());
+  if (locks.holdsExclusiveRenameLock()) {
+    childInode->updateLocation(destParent, destName, locks.renameLock());
+  } else {
+    childInode->updateLocation(destParent, destName, locks.sharedRenameLock());
+  }
 
   // Now remove the source information
   locks.srcContents()->erase(srcIter);
@@ -1633,7 +1964,8 @@ Future<Unit> TreeInode::doRename(
   }
 
   // Release the TreeInode locks before we write a journal entry.
-  // We keep holding the mount point rename lock for now though.  This ensures
+  // We keep holding the mount point rename lock (and the directory rename
+  // lock, for renames within one directory) for now though.  This ensures
   // that rename and deletion events do show up in the journal in the correct
   // order.
   locks.releaseAllButRename();
@@ -1730,6 +2062,23 @@ void TreeInode::TreeRenameLocks::acquireLocks(
   }
 }
 
+void TreeInode::TreeRenameLocks::acquireDirectoryLocks(
+    SharedRenameLock&& renameLock,
+    TreeInode* tree,
+    PathComponentPiece destName) {
+  // The directory rename lock orders us with other renames in this
+  // directory.  It must be acquired before the contents lock, and we never
+  // hold more than one, so it cannot deadlock with renames elsewhere.
+  directoryRenameLock_ = tree->getMount()->acquireDirectoryRenameLock(
+      renameLock, tree->getNodeId());
+  sharedRenameLock_ = std::move(renameLock);
+
+  srcContentsLock_ = tree->contents_.wlock();
+  srcContents_ = &srcContentsLock_->entries;
+  destContents_ = &srcContentsLock_->entries;
+  lockDestChild(destName);
+}
+
 void TreeInode::TreeRenameLocks::lockDestChild(PathComponentPiece destName) {
   // Look up the destination child entry
   destChildIter_ = destContents_->find(destName);
@@ -1756,6 +2105,20 @@ Future<Unit> TreeInode::diff(
     bool isIgnored) {
   static const PathComponentPiece kIgnoreFilename{".gitignore"};
 
+  if (context->isCancelled()) {
+    XLOG(DBG5) << "diff() on directory " << getLogPath() << " cancelled";
+    return makeFuture();
+  }
+
+  // Directories outside the mount's scope appear empty, which hides their
+  // source control contents too, so there is nothing to report for them.
+  // Only an unmaterialized directory can be skipped safely, though: one that
+  // was modified before the scope was set must still show its changes.
+  if (getMount()->isOutsideScope(currentPath) &&
+      !contents_.rlock()->isMaterialized()) {
+    return makeFuture();
+  }
+
   InodePtr inode;
   auto inodeFuture = Future<InodePtr>::makeEmpty();
   vector<IncompleteInodeLoad> pendingLoads;
@@ -1841,13 +2204,13 @@ Future<Unit> TreeInode::diff(
 
   if (!inode) {
     return std::move(inodeFuture)
-        .then([self = inodePtrFromThis(),
+        .then([this,
                context,
                currentPath = RelativePath{currentPath},
                tree = std::move(tree),
                parentIgnore,
                isIgnored](InodePtr&& loadedInode) mutable {
-          return self->loadGitIgnoreThenDiff(
+          return loadGitIgnoreThenDiff(
               std::move(loadedInode),
               context,
               currentPath,
@@ -1897,15 +2260,15 @@ Future<Unit> TreeInode::loadGitIgnoreThenDiff(
                      << folly::exceptionStr(ex);
           return InodePtr{};
         })
-        .then([self = inodePtrFromThis(),
+        .then([this,
                context,
                currentPath = currentPath.copy(),
                tree,
                parentIgnore,
                isIgnored](InodePtr pResolved) mutable {
           if (!pResolved) {
-            return self->computeDiff(
-                self->contents_.wlock(),
+            return computeDiff(
+                contents_.wlock(),
                 context,
                 currentPath,
                 std::move(tree),
@@ -1914,34 +2277,67 @@ Future<Unit> TreeInode::loadGitIgnoreThenDiff(
           }
           // Note: infinite recursion is not a concern because resolveSymlink()
           // can not return a symlink
-          return self->loadGitIgnoreThenDiff(
-              pResolved, context, currentPath, tree, parentIgnore, isIgnored);
+          return loadGitIgnoreThenDiff(
+              std::move(pResolved),
+              context,
+              currentPath,
+              std::move(tree),
+              parentIgnore,
+              isIgnored);
         });
   }
 
+  // Unmodified .gitignore files are usually identical to the ones we parsed
+  // during the previous diff, so look them up by blob hash before reading
+  // them.
+  auto* ignoreCache = getMount()->getServerState()->getGitIgnoreCache();
+  auto blobHash = fileInode->getBlobHash();
+  if (blobHash.hasValue()) {
+    auto ignore = ignoreCache->get(blobHash.value());
+    if (ignore) {
+      return computeDiff(
+          contents_.wlock(),
+          context,
+          currentPath,
+          std::move(tree),
+          make_unique<GitIgnoreStack>(parentIgnore, std::move(ignore)),
+          isIgnored);
+    }
+  }
+
   return fileInode->readAll()
       .onError([](const folly::exception_wrapper& ex) {
         XLOG(WARN) << "error reading ignore file: " << folly::exceptionStr(ex);
         return std::string{};
       })
-      .then([self = inodePtrFromThis(),
+      .then([this,
+             fileInode = std::move(gitignoreInode).asFilePtr(),
+             ignoreCache,
+             blobHash,
              context,
              currentPath = RelativePath{currentPath}, // deep copy
              tree,
              parentIgnore,
              isIgnored](std::string&& ignoreFileContents) mutable {
-        return self->computeDiff(
-            self->contents_.wlock(),
+        auto ignore = std::make_shared<GitIgnore>();
+        ignore->loadFile(ignoreFileContents);
+        // Only cache the result if the file was still unmodified once we read
+        // it, so the contents really are those of the blob.
+        if (blobHash.hasValue() && fileInode->getBlobHash() == blobHash) {
+          ignoreCache->insert(blobHash.value(), ignore);
+        }
+        return computeDiff(
+            contents_.wlock(),
             context,
             currentPath,
             std::move(tree),
-            make_unique<GitIgnoreStack>(parentIgnore, ignoreFileContents),
+            make_unique<GitIgnoreStack>(parentIgnore, std::move(ignore)),
             isIgnored);
       });
 }
 
 Future<Unit> TreeInode::computeDiff(
-    folly::Synchronized<TreeInodeState>::LockedPtr contentsLock,
+    SynchronizedTreeInodeState::LockedPtr contentsLock,
     const DiffContext* context,
     RelativePathPiece currentPath,
     shared_ptr<const Tree> tree,
@@ -1961,7 +2357,6 @@ Future<Unit> TreeInode::computeDiff(
   std::vector<PathComponent> modifiedFiles;
 
   std::vector<std::unique_ptr<DeferredDiffEntry>> deferredEntries;
-  auto self = inodePtrFromThis();
 
   // Grab the contents_ lock, and loop to find children that might be
   // different.  In this first pass we primarily build the list of children to
@@ -1982,6 +2377,9 @@ Future<Unit> TreeInode::computeDiff(
       auto fileType = inodeEntry->isDirectory() ? GitIgnore::TYPE_DIR
                                                 : GitIgnore::TYPE_FILE;
       auto entryPath = currentPath + name;
+      if (!context->shouldDiff(entryPath)) {
+        return;
+      }
       if (!isIgnored) {
         auto ignoreStatus = ignore->match(entryPath, fileType);
         if (ignoreStatus == GitIgnore::HIDDEN) {
@@ -2004,7 +2402,7 @@ Future<Unit> TreeInode::computeDiff(
                     ignore.get(),
                     entryIgnored));
           } else {
-            auto inodeFuture = self->loadChildLocked(
+            auto inodeFuture = loadChildLocked(
                 contents->entries, name, *inodeEntry, &pendingLoads);
             deferredEntries.emplace_back(
                 DeferredDiffEntry::createUntrackedEntryFromInodeFuture(
@@ -2030,14 +2428,16 @@ Future<Unit> TreeInode::computeDiff(
     };
 
     auto processRemoved = [&](const TreeEntry& scmEntry) {
+      auto entryPath = currentPath + scmEntry.getName();
+      if (!context->shouldDiff(entryPath)) {
+        return;
+      }
       if (scmEntry.isTree()) {
         deferredEntries.emplace_back(DeferredDiffEntry::createRemovedEntry(
-            context, currentPath + scmEntry.getName(), scmEntry));
+            context, entryPath, scmEntry));
       } else {
-        XLOG(DBG5) << "diff: removed file: "
-                   << currentPath + scmEntry.getName();
-        context->callback->removedFile(
-            currentPath + scmEntry.getName(), scmEntry);
+        XLOG(DBG5) << "diff: removed file: " << entryPath;
+        context->callback->removedFile(entryPath, scmEntry);
       }
     };
 
@@ -2048,6 +2448,9 @@ Future<Unit> TreeInode::computeDiff(
       // is always included since it is already tracked in source control.
       bool entryIgnored = isIgnored;
       auto entryPath = currentPath + scmEntry.getName();
+      if (!context->shouldDiff(entryPath)) {
+        return;
+      }
       if (!isIgnored && (inodeEntry->isDirectory() || scmEntry.isTree())) {
         auto ignoreStatus = ignore->match(entryPath, GitIgnore::TYPE_DIR);
         if (ignoreStatus == GitIgnore::HIDDEN) {
@@ -2064,6 +2467,25 @@ Future<Unit> TreeInode::computeDiff(
 
       if (inodeEntry->getInode()) {
         // This inode is already loaded.
+        //
+        // If it is a directory that still matches the source control Tree,
+        // skip it now rather than queueing a DeferredDiffEntry that would
+        // fetch the Tree only for our child's diff() to find the same hash.
+        // A directory that is not materialized cannot contain untracked or
+        // ignored files, so this holds even when listing ignored files.
+        //
+        // Acquiring our child's contents lock while holding ours follows the
+        // parent-before-child lock ordering.
+        auto* childTree = dynamic_cast<TreeInode*>(inodeEntry->getInode());
+        if (childTree && scmEntry.isTree()) {
+          auto childContents = childTree->contents_.rlock();
+          if (!childContents->isMaterialized() &&
+              childContents->treeHash.value() == scmEntry.getHash()) {
+            XLOG(DBG9) << "diff: unchanged loaded directory: " << entryPath;
+            return;
+          }
+        }
+
         auto childInodePtr = inodeEntry->getInodePtr();
         deferredEntries.emplace_back(DeferredDiffEntry::createModifiedEntry(
             context,
@@ -2075,7 +2497,7 @@ Future<Unit> TreeInode::computeDiff(
       } else if (inodeEntry->isMaterialized()) {
         // This inode is not loaded but is materialized.
         // We'll have to load it to confirm if it is the same or different.
-        auto inodeFuture = self->loadChildLocked(
+        auto inodeFuture = loadChildLocked(
             contents->entries, scmEntry.getName(), *inodeEntry, &pendingLoads);
         deferredEntries.emplace_back(
             DeferredDiffEntry::createModifiedEntryFromInodeFuture(
@@ -2098,7 +2520,7 @@ Future<Unit> TreeInode::computeDiff(
       } else if (inodeEntry->isDirectory()) {
         // This is a modified directory.  We have to load it then recurse
         // into it to find files with differences.
-        auto inodeFuture = self->loadChildLocked(
+        auto inodeFuture = loadChildLocked(
             contents->entries, scmEntry.getName(), *inodeEntry, &pendingLoads);
         deferredEntries.emplace_back(
             DeferredDiffEntry::createModifiedEntryFromInodeFuture(
@@ -2203,7 +2625,8 @@ Future<Unit> TreeInode::computeDiff(
   // Now process all of the deferred work.
   vector<Future<Unit>> deferredFutures;
   for (auto& entry : deferredEntries) {
-    deferredFutures.push_back(entry->run());
+    deferredFutures.push_back(
+        context->isCancelled() ? makeFuture() : entry->run());
   }
 
   // Wait on all of the deferred entries to complete.
@@ -2212,8 +2635,7 @@ Future<Unit> TreeInode::computeDiff(
   // destroyed before they complete.
   return folly::collectAllSemiFuture(deferredFutures)
       .toUnsafeFuture()
-      .then([self = std::move(self),
-             currentPath = RelativePath{std::move(currentPath)},
+      .then([currentPath = RelativePath{std::move(currentPath)},
              context,
              // Capture ignore to ensure it remains valid until all of our
              // children's diff operations complete.
@@ -2250,6 +2672,7 @@ Future<Unit> TreeInode::checkout(
 
   computeCheckoutActions(
       ctx, fromTree.get(), toTree.get(), &actions, &pendingLoads);
+  ctx->recordTreeCheckedOut(actions.size());
 
   // Wire up the callbacks for any pending inode loads we started
   for (auto& load : pendingLoads) {
@@ -2265,7 +2688,7 @@ Future<Unit> TreeInode::checkout(
   return folly::collectAllSemiFuture(actionFutures)
       .toUnsafeFuture()
       .then([ctx,
-             self = inodePtrFromThis(),
+             this,
              toTree = std::move(toTree),
              actions =
                  std::move(actions)](vector<folly::Try<Unit>> actionResults) {
@@ -2277,15 +2700,14 @@ Future<Unit> TreeInode::checkout(
             continue;
           }
           ++numErrors;
-          ctx->addError(
-              self.get(), actions[n]->getEntryName(), result.exception());
+          ctx->addError(this, actions[n]->getEntryName(), result.exception());
         }
 
         // Update our state in the overlay
-        self->saveOverlayPostCheckout(ctx, toTree.get());
+        saveOverlayPostCheckout(ctx, toTree.get());
 
-        XLOG(DBG4) << "checkout: finished update of " << self->getLogPath()
-                   << ": " << numErrors << " errors";
+        XLOG(DBG4) << "checkout: finished update of " << getLogPath() << ": "
+                   << numErrors << " errors";
       });
 }
 
@@ -2449,7 +2871,8 @@ unique_ptr<CheckoutAction> TreeInode::processCheckoutEntry(
             modeFromTreeEntryType(newScmEntry->getType()),
             getOverlay()->allocateInodeNumber(),
             newScmEntry->getHash());
-        invalidateFuseCache(newScmEntry->getName());
+        invalidateFuseCacheIfCached(
+            newScmEntry->getName(), /*childMayBeCached=*/true);
         contentsUpdated = true;
       }
     } else if (!newScmEntry) {
@@ -2471,7 +2894,8 @@ unique_ptr<CheckoutAction> TreeInode::processCheckoutEntry(
             modeFromTreeEntryType(newScmEntry->getType()),
             getOverlay()->allocateInodeNumber(),
             newScmEntry->getHash());
-        invalidateFuseCache(newScmEntry->getName());
+        invalidateFuseCacheIfCached(
+            newScmEntry->getName(), /*childMayBeCached=*/true);
         contentsUpdated = true;
       }
     }
@@ -2585,11 +3009,10 @@ unique_ptr<CheckoutAction> TreeInode::processCheckoutEntry(
   // this information up to our caller so it can mark us
   // materialized if necessary.
 
-  // We removed or replaced an entry - invalidate it.
-  auto* fuseChannel = getMount()->getFuseChannel();
-  if (fuseChannel) {
-    fuseChannel->invalidateEntry(getNodeId(), name);
-  }
+  // We removed or replaced an entry - invalidate it.  The old inode was
+  // neither loaded nor remembered, so the kernel has no reference to it, and
+  // so no entry to invalidate.
+  invalidateFuseCacheIfCached(name, /*childMayBeCached=*/false);
 
   return nullptr;
 }
@@ -2601,8 +3024,8 @@ Future<Unit> TreeInode::checkoutUpdateEntry(
     std::shared_ptr<const Tree> oldTree,
     std::shared_ptr<const Tree> newTree,
     const folly::Optional<TreeEntry>& newScmEntry) {
-  auto treeInode = inode.asTreePtrOrNull();
-  if (!treeInode) {
+  auto* rawTreeInode = inode.asTreeOrNull();
+  if (!rawTreeInode) {
     // If the target of the update is not a directory, then we know we do not
     // need to recurse into it, looking for more conflicts, so we can exit here.
     if (ctx->isDryRun()) {
@@ -2644,7 +3067,7 @@ Future<Unit> TreeInode::checkoutUpdateEntry(
     }
 
     // Tell FUSE to invalidate its cache for this entry.
-    invalidateFuseCache(name);
+    invalidateFuseCacheIfCached(name, inode->isReferencedByKernel());
 
     // We don't save our own overlay data right now:
     // we'll wait to do that until the checkout operation finishes touching all
@@ -2652,6 +3075,11 @@ Future<Unit> TreeInode::checkoutUpdateEntry(
     return makeFuture();
   }
 
+  // checkout() only borrows the child, so it is kept referenced here until
+  // the child's checkout completes.  It is moved, rather than copied, from
+  // inode.
+  auto treeInode = std::move(inode).asTreePtr();
+
   // If we are going from a directory to a directory, all we need to do
   // is call checkout().
   if (newTree) {
@@ -2659,7 +3087,9 @@ Future<Unit> TreeInode::checkoutUpdateEntry(
 
     CHECK(newScmEntry.hasValue());
     CHECK(newScmEntry->isTree());
-    return treeInode->checkout(ctx, std::move(oldTree), std::move(newTree));
+    auto future =
+        rawTreeInode->checkout(ctx, std::move(oldTree), std::move(newTree));
+    return std::move(future).ensure([treeInode = std::move(treeInode)] {});
   }
 
   if (ctx->isDryRun()) {
@@ -2676,11 +3106,14 @@ Future<Unit> TreeInode::checkoutUpdateEntry(
   // Fortunately, calling checkout() with an empty destination tree does
   // exactly what we want.  checkout() will even remove the directory before it
   // returns if the directory is empty.
-  return treeInode->checkout(ctx, std::move(oldTree), nullptr)
+  //
+  // Our caller holds a reference to us until this completes, so the callback
+  // below only borrows this TreeInode.
+  return rawTreeInode->checkout(ctx, std::move(oldTree), nullptr)
       .then([ctx,
              name = PathComponent{name},
-             parentInode = inodePtrFromThis(),
-             treeInode,
+             this,
+             treeInode = std::move(treeInode),
              newScmEntry]() {
         // Make sure the treeInode was completely removed by the checkout.
         // If there were still untracked files inside of it, it won't have
@@ -2698,28 +3131,28 @@ Future<Unit> TreeInode::checkoutUpdateEntry(
         // Add the new entry
         bool inserted;
         {
-          auto contents = parentInode->contents_.wlock();
+          auto contents = contents_.wlock();
           DCHECK(!newScmEntry->isTree());
           auto ret = contents->entries.emplace(
               name,
               modeFromTreeEntryType(newScmEntry->getType()),
-              parentInode->getOverlay()->allocateInodeNumber(),
+              getOverlay()->allocateInodeNumber(),
               newScmEntry->getHash());
           inserted = ret.second;
         }
         if (inserted) {
-          parentInode->invalidateFuseCache(name);
+          invalidateFuseCacheIfCached(name, /*childMayBeCached=*/true);
         } else {
           // Hmm.  Someone else already created a new entry in this location
           // before we had a chance to add our new entry.  We don't block new
           // file or directory creations during a checkout operation, so this
           // is possible.  Just report an error in this case.
           ctx->addError(
-              parentInode.get(),
+              this,
               name,
               InodeError(
                   EEXIST,
-                  parentInode,
+                  inodePtrFromThis(),
                   name,
                   "new file created with this name while checkout operation "
                   "was in progress"));
@@ -2731,9 +3164,25 @@ void TreeInode::invalidateFuseCache(PathComponentPiece name) {
   auto* fuseChannel = getMount()->getFuseChannel();
   if (fuseChannel) {
     fuseChannel->invalidateEntry(getNodeId(), name);
+    getMount()->getStats()->get()->entryInvalidationsSent.addValue(1);
   }
 }
 
+void TreeInode::invalidateFuseCacheIfCached(
+    PathComponentPiece name,
+    bool childMayBeCached) {
+  if (!getMount()->getFuseChannel()) {
+    return;
+  }
+  // The kernel's reference to the root is implicit, so it is not counted.
+  bool dirMayBeCached = getNodeId() == kRootNodeId || isReferencedByKernel();
+  if (!dirMayBeCached || !childMayBeCached) {
+    getMount()->getStats()->get()->entryInvalidationsSkipped.addValue(1);
+    return;
+  }
+  invalidateFuseCache(name);
+}
+
 void TreeInode::invalidateFuseCacheIfRequired(PathComponentPiece name) {
   if (RequestData::isFuseRequest()) {
     // no need to flush the cache if we are inside a FUSE request handler
@@ -3023,7 +3472,8 @@ uint64_t TreeInode::unloadChildrenLastAccessedBefore(const timespec& cutoff) {
   // we can avoid holding lock on inodes for atime while holding contents lock
 
   // Get the list of inodes in the directory by holding contents lock.
-  std::vector<FileInodePtr> potentialUnload;
+  std::vector<InodePtr> potentialUnload;
+  std::vector<TreeInodePtr> treeChildren;
   {
     auto contents = contents_.rlock();
     for (auto& entry : contents->entries) {
@@ -3031,14 +3481,26 @@ uint64_t TreeInode::unloadChildrenLastAccessedBefore(const timespec& cutoff) {
         continue;
       }
 
-      if (auto asFile = entry.second.asFilePtrOrNull()) {
-        potentialUnload.push_back(std::move(asFile));
+      if (auto asTree = entry.second.asTreePtrOrNull()) {
+        treeChildren.push_back(std::move(asTree));
       }
+      potentialUnload.push_back(entry.second.getInodePtr());
     }
   }
+
+  // Process our child trees first, so that a child tree whose contents all
+  // get unloaded can then be unloaded itself.  Every loaded inode holds a
+  // reference to its parent, so a tree can only be unloaded once all of its
+  // children have been.
+  uint64_t unloadCount = 0;
+  for (auto& child : treeChildren) {
+    unloadCount += child->unloadChildrenLastAccessedBefore(cutoff);
+  }
+  treeChildren.clear();
+
   // filter inodes based on the age (i.e atime) after releasing contents lock.
-  // We are intentionally making toUnload as a list of FileInode* rather than
-  // FileInodePtr to make raw pointer comparision to check if the pointer in
+  // We are intentionally making toUnload as a list of InodeBase* rather than
+  // InodePtr to make raw pointer comparision to check if the pointer in
   // toUnload exists in contents_->entries.
   std::unordered_set<InodeBase*> toUnload;
   {
@@ -3062,34 +3524,30 @@ uint64_t TreeInode::unloadChildrenLastAccessedBefore(const timespec& cutoff) {
     potentialUnload.clear();
   }
 
-  // Unload Inodes whose reference count is greater than zero and age is greater
-  // than the required age.
-  std::vector<TreeInodePtr> treeChildren;
+  // Unload inodes whose pointer acquire count is zero and whose age is
+  // greater than the required age.  For trees, a zero acquire count also
+  // means that none of their children are loaded.
   std::vector<InodeBase*> toDelete;
-  {
+  if (!toUnload.empty()) {
     auto* inodeMap = getInodeMap();
     auto contents = contents_.wlock();
     auto inodeMapLock = inodeMap->lockForUnload();
 
     for (auto& entry : contents->entries) {
-      if (!entry.second.getInode()) {
+      auto entryInode = entry.second.getInode();
+      if (!entryInode) {
         continue;
       }
-      if (auto asTree = entry.second.asTreePtrOrNull()) {
-        treeChildren.push_back(std::move(asTree));
-      } else {
-        // Check if the entry is present in the toUnload list(atime greater than
-        // age)
-        auto entryInode = entry.second.getInode();
-        if (toUnload.count(entryInode) && entryInode->isPtrAcquireCountZero()) {
-          (void)entry.second.clearInode();
-          // Unload the inode
-          inodeMap->unloadInode(
-              entryInode, this, entry.first, false, inodeMapLock);
-          // Record that we should now delete this inode after releasing
-          // the locks.
-          toDelete.push_back(entryInode);
-        }
+      // Check if the entry is present in the toUnload list(atime greater than
+      // age)
+      if (toUnload.count(entryInode) && entryInode->isPtrAcquireCountZero()) {
+        (void)entry.second.clearInode();
+        // Unload the inode
+        inodeMap->unloadInode(
+            entryInode, this, entry.first, false, inodeMapLock);
+        // Record that we should now delete this inode after releasing
+        // the locks.
+        toDelete.push_back(entryInode);
       }
     }
   }
@@ -3098,19 +3556,7 @@ uint64_t TreeInode::unloadChildrenLastAccessedBefore(const timespec& cutoff) {
     delete child;
   }
 
-  // Note that unloadCount only includes released FileInodes at the moment.
-  // It should include TreeInodes too.
-  uint64_t unloadCount = toDelete.size();
-  for (auto& child : treeChildren) {
-    // TODO(T21096505): Currently unloadChildrenNow is now unloading TreeInodes,
-    // we have to make sure that even treeChildren also gets unloaded.
-    unloadCount += child->unloadChildrenLastAccessedBefore(cutoff);
-  }
-
-  return unloadCount;
-  // Note: during mount point shutdown, returning from this function and
-  // destroying the treeChildren map will decrement the reference count on
-  // all of our children trees, which may result in them being destroyed.
+  return unloadCount + toDelete.size();
 }
 
 void TreeInode::getDebugStatus(vector<TreeInodeDebugInfo>& results) const {
@@ -3212,7 +3658,10 @@ InodeMetadata TreeInode::getMetadataLocked(const DirContents&) const {
 }
 
 folly::Future<folly::Unit> TreeInode::prefetch() {
-  return folly::via(getMount()->getThreadPool().get())
+  if (getMount()->isOutsideScope(*this)) {
+    return folly::unit;
+  }
+  return folly::via(getMount()->getBackgroundThreadPool().get())
       .thenValue([this](auto&&) {
         return loadMaterializedChildren(Recurse::SHALLOW);
       });
@@ -3221,7 +3670,8 @@ folly::Future<folly::Unit> TreeInode::prefetch() {
 folly::Future<Dispatcher::Attr> TreeInode::setattr(
     const fuse_setattr_in& attr) {
   materialize();
-  Dispatcher::Attr result(getMount()->initStatData());
+  Dispatcher::Attr result(
+      getMount()->initStatData(), getMount()->getAttrTimeout(true));
 
   // We do not have size field for directories and currently TreeInode does not
   // have any field like FileInode::state_::mode to set the mode. May be in the
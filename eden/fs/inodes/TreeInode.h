@@ -14,6 +14,7 @@
 #include <folly/Synchronized.h>
 #include "eden/fs/inodes/DirEntry.h"
 #include "eden/fs/inodes/InodeBase.h"
+#include "eden/fs/utils/LockProfiler.h"
 
 namespace facebook {
 namespace eden {
@@ -51,6 +52,18 @@ struct TreeInodeState {
 
   DirContents entries;
 
+  /**
+   * Set once bulkLoadChildren() has started loading every child of this
+   * directory, so that it is only done once per TreeInode.
+   */
+  bool childrenBulkLoaded{false};
+
+  /**
+   * The child whose blob was most recently loaded, used by
+   * prefetchSiblingBlobs() to tell when files are being read in order.
+   */
+  folly::Optional<PathComponent> lastBlobLoad;
+
   /**
    * If this TreeInode is unmaterialized (identical to an existing source
    * control Tree), treeHash contains the ID of the source control Tree
@@ -63,6 +76,17 @@ struct TreeInodeState {
   folly::Optional<Hash> treeHash;
 };
 
+struct TreeInodeContentsLockName {
+  static folly::StringPiece name() {
+    return "tree_inode_contents";
+  }
+};
+
+/** A TreeInodeState and the TreeInode lock that protects it. */
+using SynchronizedTreeInodeState = folly::Synchronized<
+    TreeInodeState,
+    ProfiledSharedMutex<TreeInodeContentsLockName>>;
+
 /**
  * Represents a directory in the file system.
  */
@@ -142,7 +166,7 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
   folly::Future<Dispatcher::Attr> getattr() override;
   folly::Future<Dispatcher::Attr> setattr(const fuse_setattr_in& attr) override;
   folly::Future<folly::Unit> prefetch() override;
-  Dispatcher::Attr getAttrLocked(const DirContents& contents);
+  Dispatcher::Attr getAttrLocked(const TreeInodeState& contents);
 
   /** Implements the InodeBase method used by the Dispatcher
    * to create the Inode instance for a given name */
@@ -154,8 +178,38 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
    * The Inode object will be loaded if it is not already loaded.
    */
   folly::Future<InodePtr> getOrLoadChild(PathComponentPiece name);
+
+  /**
+   * If the named child is a directory that is neither loaded nor
+   * materialized, return the attributes that its entry in this directory
+   * implies, so that a lookup can be answered without fetching the child's
+   * Tree.  The child stays unloaded until something needs its contents.
+   *
+   * Returns none if the child has to be loaded to answer.
+   */
+  folly::Optional<Dispatcher::Attr> getUnloadedChildAttr(
+      PathComponentPiece name);
+
+  /**
+   * Record a FUSE reference to a child returned by getUnloadedChildAttr(),
+   * whether or not it has been loaded since.  Returns false if the name no
+   * longer refers to that inode number.
+   */
+  bool incChildFuseRefcount(PathComponentPiece name, InodeNumber number);
   folly::Future<TreeInodePtr> getOrLoadChildTree(PathComponentPiece name);
 
+  /**
+   * Get the SHA-1 of the contents of several regular files in this
+   * directory.
+   *
+   * The results are in the same order as names.  Files that are neither
+   * loaded nor materialized are answered from the blob metadata without
+   * loading an inode for them.  An entry fails with EISDIR for a directory,
+   * EINVAL for a symlink, and ENOENT if it does not exist.
+   */
+  folly::Future<std::vector<folly::Try<Hash>>> getChildSha1s(
+      const std::vector<PathComponent>& names);
+
   /**
    * Recursively look up a child inode.
    *
@@ -172,10 +226,10 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
       TreeInodePtr newParent,
       PathComponentPiece newName);
 
-  const folly::Synchronized<TreeInodeState>& getContents() const {
+  const SynchronizedTreeInodeState& getContents() const {
     return contents_;
   }
-  folly::Synchronized<TreeInodeState>& getContents() {
+  SynchronizedTreeInodeState& getContents() {
     return contents_;
   }
 
@@ -223,6 +277,11 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
    * @return Returns a Future that will be fulfilled when the diff operation
    *     completes.  The caller must ensure that the InodeDiffCallback parameter
    *     remains valid until this Future completes.
+   *
+   * The caller must also hold a reference to this TreeInode until the
+   * returned Future completes.  diff() only borrows it, and the children it
+   * descends into are held by their DeferredDiffEntry objects, so walking a
+   * tree does not copy an InodePtr for every directory in it.
    */
   folly::Future<folly::Unit> diff(
       const DiffContext* context,
@@ -252,6 +311,9 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
    *
    * @return Returns a future that will be fulfilled once this tree and all of
    *     its children have been updated.
+   *
+   * Like diff(), checkout() only borrows this TreeInode: the caller must hold
+   * a reference to it until the returned future completes.
    */
   FOLLY_NODISCARD folly::Future<folly::Unit> checkout(
       CheckoutContext* ctx,
@@ -334,7 +396,11 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
    * Unload all unreferenced inodes under this tree whose last access time is
    * older than the specified cutoff.
    *
-   * Returns the number of inodes unloaded.
+   * This works bottom-up: each child tree is processed before we decide
+   * whether to unload it, so a subtree that becomes completely unreferenced
+   * is unloaded along with its contents.
+   *
+   * Returns the number of inodes unloaded, including trees.
    */
   uint64_t unloadChildrenLastAccessedBefore(const timespec& cutoff);
 
@@ -354,6 +420,34 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
   FOLLY_NODISCARD folly::Future<folly::Unit> loadMaterializedChildren(
       Recurse recurse = Recurse::DEEP);
 
+  /**
+   * Start loading every child of this directory that is not loaded yet, if
+   * this has not been done before and the directory has no more than
+   * --bulk_load_children_max_entries entries.
+   *
+   * Crawls like find(1) look up every child of a directory one at a time.
+   * Loading them all at once, the first time any child is looked up or the
+   * directory is read, takes the contents_ lock once instead of once per
+   * child and overlaps the ObjectStore fetches for child trees.  Lookups
+   * then find the inodes already loaded.
+   *
+   * This does not wait for the loads to finish.
+   */
+  void bulkLoadChildren();
+
+  /**
+   * Called by FileInode when it starts loading the blob of the child named
+   * name.
+   *
+   * Builds tend to read the files of a directory in name order, e.g. when
+   * compiling each source file or including each header in turn.  When this
+   * load follows the previous one in name order, ask the ObjectStore to
+   * prefetch the blobs of the next --sibling_blob_prefetch_count files, so
+   * that they are fetched together rather than one at a time as each is
+   * opened.
+   */
+  void prefetchSiblingBlobs(PathComponentPiece name);
+
   /*
    * Update a tree entry as part of a checkout operation.
    *
@@ -515,7 +609,7 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
    * returned via this parameter.
    */
   FileInodePtr createImpl(
-      folly::Synchronized<TreeInodeState>::LockedPtr contentsLock,
+      SynchronizedTreeInodeState::LockedPtr contentsLock,
       PathComponentPiece name,
       mode_t mode,
       folly::ByteRange fileContents,
@@ -594,6 +688,19 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
       DirEntry& entry,
       std::vector<IncompleteInodeLoad>* pendingLoads);
 
+  /**
+   * The body of bulkLoadChildren(), called with the contents_ lock held.
+   * Does not start loading the child named skip, if any; the caller is
+   * already loading it.
+   *
+   * The caller must call finish() on the pendingLoads after releasing the
+   * contents_ lock.
+   */
+  void bulkLoadChildrenLocked(
+      TreeInodeState& contents,
+      folly::Optional<PathComponentPiece> skip,
+      std::vector<IncompleteInodeLoad>* pendingLoads);
+
   /**
    * Load the .gitignore file for this directory, then call computeDiff() once
    * it is loaded.
@@ -615,7 +722,7 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
    * diff once all .gitignore data is loaded.
    */
   FOLLY_NODISCARD folly::Future<folly::Unit> computeDiff(
-      folly::Synchronized<TreeInodeState>::LockedPtr contentsLock,
+      SynchronizedTreeInodeState::LockedPtr contentsLock,
       const DiffContext* context,
       RelativePathPiece currentPath,
       std::shared_ptr<const Tree> tree,
@@ -675,6 +782,21 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
    */
   void invalidateFuseCacheIfRequired(PathComponentPiece name);
 
+  /**
+   * Invalidate the kernel FUSE cache for this entry name, unless the kernel
+   * cannot have cached it.
+   *
+   * The kernel only caches the entries of directories it holds a reference
+   * to, and each positive entry holds a reference to its inode.  So there is
+   * nothing to invalidate if the kernel has no reference to this directory,
+   * or if childMayBeCached is false because the entry referred to an inode
+   * the kernel had no reference to.  Names that did not exist before must
+   * pass true, since the kernel may hold negative entries for them.
+   */
+  void invalidateFuseCacheIfCached(
+      PathComponentPiece name,
+      bool childMayBeCached);
+
   /**
    * Attempt to remove an empty directory during a checkout operation.
    *
@@ -684,7 +806,7 @@ class TreeInode final : public InodeBaseMetadata<DirContents> {
    */
   FOLLY_NODISCARD bool checkoutTryRemoveEmptyDir(CheckoutContext* ctx);
 
-  folly::Synchronized<TreeInodeState> contents_;
+  SynchronizedTreeInodeState contents_;
 };
 
 /**
@@ -9,10 +9,18 @@
  */
 #include "TreeInodeDirHandle.h"
 
+#include <folly/logging/xlog.h>
+
 #include "Overlay.h"
 #include "eden/fs/fuse/DirList.h"
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/FileInode.h"
+#include "eden/fs/inodes/InodeMap.h"
+#include "eden/fs/inodes/InodeTable.h"
 #include "eden/fs/inodes/TreeInode.h"
 #include "eden/fs/model/Tree.h"
+#include "eden/fs/store/BlobMetadata.h"
+#include "eden/fs/store/ObjectStore.h"
 #include "eden/fs/utils/DirType.h"
 
 namespace facebook {
@@ -30,96 +38,232 @@ folly::Future<DirList> TreeInodeDirHandle::readdir(DirList&& list, off_t off) {
   // DirList.
   // We need to return as soon as we have filled the available space in the
   // provided DirList object.
+  //
+  // `off` is the index into listing_.  Reading from offset 0 (a new scan, or
+  // a rewinddir()) refreshes the listing so that it reflects any changes to
+  // the directory; otherwise we continue from the listing the scan started
+  // with, as POSIX leaves it unspecified whether later changes are seen.
+  auto listing = listing_.wlock();
+  if (off == 0 || listing->empty()) {
+    // Reading a directory is usually followed by looking up its entries.
+    if (off == 0 && !isOutsideScope()) {
+      inode_->bulkLoadChildren();
+    }
+    *listing = listEntries();
+  }
 
-  // The inode of this directory
-  auto dir_inode = inode_->getNodeId();
+  for (auto index = static_cast<size_t>(std::max<off_t>(off, 0));
+       index < listing->size();
+       ++index) {
+    const auto& entry = (*listing)[index];
+    if (!list.add(entry.name, entry.ino.get(), entry.type, index + 1)) {
+      break;
+    }
+  }
+  listing.unlock();
+  inode_->updateAtime();
 
-  // It's pretty complicated to stitch together the directory contents
-  // while trying to skip around and respect the offset parameter.
-  // Let's go for the simple approach and see if that is good enough.
-  //
-  // `off` is the index into a synthesized list of entries:
-  // 1. The "." and ".." entries
-  // 3. The TreeInode's entries in order.
-  //
-  // We're going to build a vector of this combined information,
-  // then we can paginate sanely using the off parameter.
+  return std::move(list);
+}
+
+bool TreeInodeDirHandle::isOutsideScope() const {
+  return inode_->getMount()->isOutsideScope(*inode_);
+}
+
+std::vector<TreeInodeDirHandle::Entry> TreeInodeDirHandle::listEntries() {
+  std::vector<Entry> entries;
+  // Directories outside the mount's scope only contain "." and "..".
+  bool outsideScope = isOutsideScope();
+  auto dirInode = inode_->getNodeId();
+  auto dir = inode_->getContents().rlock();
+  entries.reserve(2 /* "." and ".." */ + dir->entries.size());
 
-  /** This struct is pretty lightweight and doesn't need to make any
-   * heap copies of names as we accumulate the view of the entries */
+  // Reserved entries for linking to parent and self.
+  entries.emplace_back(".", dtype_t::Dir, dirInode);
+  // It's okay to query the parent without the rename lock held because, if
+  // readdir is racing with rename, the results are unspecified anyway.
+  // http://pubs.opengroup.org/onlinepubs/007908799/xsh/readdir.html
+  auto parent = inode_->getParentRacy();
+  // For the root of the mount point, just add its own inode ID as its parent.
+  // FUSE seems to overwrite the parent inode number on the root dir anyway.
+  auto parentInode = parent ? parent->getNodeId() : dirInode;
+  entries.emplace_back("..", dtype_t::Dir, parentInode);
+
+  if (outsideScope) {
+    return entries;
+  }
+  for (const auto& entry : dir->entries) {
+    entries.emplace_back(
+        entry.first.stringPiece(),
+        entry.second.getDtype(),
+        entry.second.getInodeNumber());
+  }
+  return entries;
+}
+
+folly::Future<DirList> TreeInodeDirHandle::readdirplus(
+    DirList&& list,
+    off_t off) {
+  // `off` has the same meaning as in readdir(): an index into "." and "..",
+  // followed by the TreeInode's entries in order.
+  //
+  // We only return attributes for entries that are cheap to describe without
+  // loading them: children that are already loaded, and unloaded files that
+  // are not materialized, whose size comes from the blob metadata and whose
+  // remaining attributes come from the InodeMetadataTable.  An unloaded
+  // directory would need its Tree loaded to compute st_nlink, and a
+  // materialized file would need its overlay file opened, so those are
+  // returned with a nodeid of 0 and the kernel looks them up when it needs
+  // them.
   struct Entry {
     // This must not contain any embedded nuls.
-    folly::StringPiece name;
-    dtype_t type;
-    /// If 0, look up/assign it based on name
+    std::string name;
     InodeNumber ino;
+    mode_t mode;
+    // Set if the child was loaded when we listed the directory.
+    InodePtr inode;
+    // Set for unloaded children whose attributes we can compute from their
+    // blob metadata.
+    folly::Optional<Hash> hash;
 
-    Entry(
-        folly::StringPiece name,
-        dtype_t type,
-        InodeNumber ino = InodeNumber{})
-        : name(name), type(type), ino(ino) {}
+    Entry(folly::StringPiece name, InodeNumber ino, mode_t mode)
+        : name(name.str()), ino(ino), mode(mode) {}
   };
-  folly::fbvector<Entry> entries;
+  std::vector<Entry> entries;
 
   {
+    const size_t maxEntries = list.getMaxPlusEntries();
+    bool outsideScope = isOutsideScope();
     auto dir = inode_->getContents().rlock();
-    entries.reserve(2 /* "." and ".." */ + dir->entries.size());
-
-    // Reserved entries for linking to parent and self.
-    entries.emplace_back(".", dtype_t::Dir, dir_inode);
-    // It's okay to query the parent without the rename lock held because, if
-    // readdir is racing with rename, the results are unspecified anyway.
-    // http://pubs.opengroup.org/onlinepubs/007908799/xsh/readdir.html
-    auto parent = inode_->getParentRacy();
-    // For the root of the mount point, just add its own inode ID as its parent.
-    // FUSE seems to overwrite the parent inode number on the root dir anyway.
-    auto parent_inode = parent ? parent->getNodeId() : dir_inode;
-    entries.emplace_back("..", dtype_t::Dir, parent_inode);
-
-    for (const auto& entry : dir->entries) {
-      entries.emplace_back(entry.first.value(), entry.second.getDtype());
+    auto dirInode = inode_->getNodeId();
+    if (off < 1) {
+      entries.emplace_back(".", dirInode, S_IFDIR);
+    }
+    if (off < 2) {
+      // See readdir() for why getParentRacy() is okay here.
+      auto parent = inode_->getParentRacy();
+      auto parentInode = parent ? parent->getNodeId() : dirInode;
+      entries.emplace_back("..", parentInode, S_IFDIR);
+    }
+
+    auto childOffset = outsideScope
+        ? dir->entries.size()
+        : std::min(
+              static_cast<size_t>(std::max<off_t>(off, 2) - 2),
+              dir->entries.size());
+    for (auto iter = dir->entries.begin() + childOffset;
+         iter != dir->entries.end() && entries.size() < maxEntries;
+         ++iter) {
+      const auto& ent = iter->second;
+      if (ent.getInode()) {
+        entries.emplace_back(
+            iter->first.stringPiece(),
+            ent.getInodeNumber(),
+            dtype_to_mode(ent.getDtype()));
+        entries.back().inode = ent.getInodePtr();
+      } else {
+        entries.emplace_back(
+            iter->first.stringPiece(),
+            ent.getInodeNumber(),
+            ent.getInitialMode());
+        if (!ent.isMaterialized() && !ent.isDirectory()) {
+          entries.back().hash = ent.getHash();
+        }
+      }
     }
   }
 
-  // And now the easy part: seek to the provided offset and fill up
-  // the DirList with the entries that remain.
-  auto entry_iter = entries.begin();
-  std::advance(entry_iter, off);
-
-  // The stat struct is only used by the fuse machinery to compute the type
-  // of the entry so that it can report an appropriate DT_XXX type up to
-  // the caller of readdir(), so we zero initialize it and only fill in
-  // the type bits of the mode.  The reset are irrelevant and we don't
-  // need to waste effort populating them.  We zero out the struct here
-  // once and vary just the bits that need to be updated in the loop below.
-  // https://www.daemon-systems.org/man/DTTOIF.3.html
-  struct stat st = {};
-
-  while (entry_iter < entries.end()) {
-    const auto& entry = *entry_iter;
-
-    if (entry.ino.hasValue()) {
-      st.st_ino = entry.ino.get();
+  // Fetch the attributes for all of the entries in one batch.
+  std::vector<folly::Future<folly::Optional<Dispatcher::Attr>>> attrFutures;
+  attrFutures.reserve(entries.size());
+  for (const auto& entry : entries) {
+    if (entry.inode) {
+      attrFutures.push_back(
+          entry.inode->getattr().thenValue([](Dispatcher::Attr&& attr) {
+            return folly::make_optional(std::move(attr));
+          }));
+    } else if (entry.hash) {
+      attrFutures.push_back(
+          inode_->getMount()
+              ->getObjectStore()
+              ->getBlobMetadata(entry.hash.value())
+              .thenValue([self = inode_, ino = entry.ino, mode = entry.mode](
+                             const BlobMetadata& blobMetadata) {
+                auto* mount = self->getMount();
+                auto st = mount->initStatData();
+                st.st_ino = ino.get();
+                st.st_nlink = 1;
+                st.st_size = blobMetadata.size;
+                mount->getInodeMetadataTable()
+                    ->setDefault(ino, mount->getInitialInodeMetadata(mode))
+                    .applyToStat(st);
+                FileInode::updateBlockCount(st);
+                return folly::make_optional(
+                    Dispatcher::Attr{st, mount->getAttrTimeout(false)});
+              }));
     } else {
-      // We haven't looked up its inode yet, do so now.
-      // We defer it from the first pass above in case we have a huge
-      // dir and need to paginate through it across several calls into
-      // this function.
-      st.st_ino =
-          inode_->getChildInodeNumber(PathComponentPiece{entry.name}).get();
+      attrFutures.push_back(folly::makeFuture(
+          folly::Optional<Dispatcher::Attr>{folly::none}));
     }
-    st.st_mode = dtype_to_mode(entry.type);
+  }
 
-    if (!list.add(entry.name, st, ++off)) {
-      break;
-    }
+  return folly::collectAllSemiFuture(attrFutures)
+      .toUnsafeFuture()
+      .thenValue(
+          [self = inode_,
+           list = std::move(list),
+           entries = std::move(entries),
+           off](std::vector<folly::Try<folly::Optional<Dispatcher::Attr>>>&&
+                    attrs) mutable {
+            auto* inodeMap = self->getMount()->getInodeMap();
 
-    ++entry_iter;
-  }
-  inode_->updateAtime();
+            // Hold the contents lock while adding the entries, so that the
+            // children we return cannot be loaded, unloaded or renamed
+            // before we record the kernel's references to them.
+            auto dir = self->getContents().wlock();
+            for (size_t n = 0; n < entries.size(); ++n) {
+              const auto& entry = entries[n];
+              fuse_entry_out out = {};
+              out.attr.ino = entry.ino.get();
+              out.attr.mode = entry.mode;
 
-  return std::move(list);
+              InodeBase* child = nullptr;
+              if (attrs[n].hasException()) {
+                XLOG(DBG4) << "readdirplus: error getting attributes for "
+                           << entry.name << " in " << self->getLogPath()
+                           << ": " << folly::exceptionStr(attrs[n].exception());
+              } else if (attrs[n].value().hasValue()) {
+                auto iter = dir->entries.find(PathComponentPiece{entry.name});
+                if (iter != dir->entries.end() &&
+                    iter->second.getInodeNumber() == entry.ino) {
+                  out = computeEntryParam(entry.ino, attrs[n].value().value());
+                  child = iter->second.getInode();
+                }
+              }
+
+              if (!list.addPlus(entry.name, out, ++off)) {
+                break;
+              }
+
+              if (out.nodeid != 0) {
+                if (child) {
+                  child->incFuseRefcount();
+                } else {
+                  DCHECK(entry.hash.hasValue());
+                  inodeMap->incUnloadedChildFuseRefcount(
+                      self.get(),
+                      PathComponentPiece{entry.name},
+                      entry.ino,
+                      entry.mode,
+                      entry.hash.value());
+                }
+              }
+            }
+            dir.unlock();
+
+            self->updateAtime();
+            return std::move(list);
+          });
 }
 
 folly::Future<Dispatcher::Attr> TreeInodeDirHandle::setattr(
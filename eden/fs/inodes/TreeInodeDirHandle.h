@@ -8,8 +8,12 @@
  *
  */
 #pragma once
+#include <folly/Synchronized.h>
+#include <string>
+#include <vector>
 #include "eden/fs/fuse/DirHandle.h"
 #include "eden/fs/inodes/InodePtr.h"
+#include "eden/fs/utils/DirType.h"
 
 namespace facebook {
 namespace eden {
@@ -19,6 +23,7 @@ class TreeInodeDirHandle : public DirHandle {
   explicit TreeInodeDirHandle(TreeInodePtr inode);
 
   folly::Future<DirList> readdir(DirList&& list, off_t off) override;
+  folly::Future<DirList> readdirplus(DirList&& list, off_t off) override;
 
   folly::Future<Dispatcher::Attr> setattr(const fuse_setattr_in& attr) override;
   folly::Future<folly::Unit> fsyncdir(bool datasync) override;
@@ -26,7 +31,43 @@ class TreeInodeDirHandle : public DirHandle {
   InodeNumber getInodeNumber() override;
 
  private:
+  /**
+   * One entry of the listing that readdir() pages through.
+   */
+  struct Entry {
+    Entry(folly::StringPiece name, dtype_t type, InodeNumber ino)
+        : name(name.str()), type(type), ino(ino) {}
+
+    // This must not contain any embedded nuls.
+    std::string name;
+    dtype_t type;
+    InodeNumber ino;
+  };
+
+  /**
+   * Build the listing: "." and "..", followed by the TreeInode's entries
+   * in order.
+   */
+  std::vector<Entry> listEntries();
+
+  /**
+   * Returns true if this directory's contents are hidden by the mount's
+   * scope.  This must be called without the TreeInode's contents locked,
+   * since it computes the directory's path.
+   */
+  bool isOutsideScope() const;
+
   TreeInodePtr inode_;
+
+  /**
+   * The listing served by readdir(), indexed by offset.
+   *
+   * It is taken when the application reads from offset 0, and later calls
+   * continue from it, so paging through a large directory costs O(n) rather
+   * than rebuilding the whole listing for every chunk.  It is empty until
+   * the first readdir(), and is freed with the handle on releasedir.
+   */
+  folly::Synchronized<std::vector<Entry>> listing_;
 };
 } // namespace eden
 } // namespace facebook
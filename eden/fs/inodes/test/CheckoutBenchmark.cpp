@@ -0,0 +1,213 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <folly/executors/ManualExecutor.h>
+#include <folly/init/Init.h>
+#include <folly/stop_watch.h>
+#include <gflags/gflags.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/InodeDiffCallback.h"
+#include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/store/Diff.h"
+#include "eden/fs/testharness/FakeBackingStore.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+
+using namespace facebook::eden;
+using folly::StringPiece;
+using std::string;
+using std::vector;
+
+DEFINE_int32(files, 100000, "Number of files in the generated repository");
+DEFINE_int32(files_per_dir, 16, "Number of files in each directory");
+DEFINE_int32(dir_fanout, 8, "Number of subdirectories in each directory");
+DEFINE_string(
+    change_fractions,
+    "0.001,0.01,0.1",
+    "Comma-separated fractions of the files that each target commit changes");
+DEFINE_int32(
+    backing_store_latency_ms,
+    0,
+    "Latency added to each tree and blob fetch from the backing store");
+
+namespace {
+
+/**
+ * Generate file paths breadth first, so that the tree fills each level
+ * before the next one, like the upper levels of a real repository.
+ */
+vector<string> generatePaths(size_t count) {
+  vector<string> paths;
+  paths.reserve(count);
+  std::deque<string> dirs{""};
+  while (paths.size() < count) {
+    auto dir = std::move(dirs.front());
+    dirs.pop_front();
+    for (int n = 0; n < FLAGS_files_per_dir && paths.size() < count; ++n) {
+      paths.push_back(folly::sformat("{}file{}.cpp", dir, n));
+    }
+    for (int n = 0; n < FLAGS_dir_fanout; ++n) {
+      dirs.push_back(folly::sformat("{}dir{}/", dir, n));
+    }
+  }
+  return paths;
+}
+
+/**
+ * Build a commit that modifies the given fraction of the files, and removes
+ * one in every eight of the files it changes.
+ */
+Hash makeTargetCommit(
+    TestMount& testMount,
+    const FakeTreeBuilder& base,
+    const vector<string>& paths,
+    double fraction) {
+  vector<size_t> indices(paths.size());
+  for (size_t n = 0; n < indices.size(); ++n) {
+    indices[n] = n;
+  }
+  std::mt19937_64 rng{1};
+  std::shuffle(indices.begin(), indices.end(), rng);
+  auto changes = std::max<size_t>(1, fraction * paths.size());
+
+  auto target = base.clone();
+  for (size_t n = 0; n < changes; ++n) {
+    const auto& path = paths[indices[n]];
+    if (n % 8 == 7) {
+      target.removeFile(path);
+    } else {
+      target.replaceFile(path, path + " changed\n");
+    }
+  }
+  target.finalize(testMount.getBackingStore(), true);
+  auto commitHash = testMount.nextCommitHash();
+  testMount.getBackingStore()->putCommit(commitHash, target)->setReady();
+  return commitHash;
+}
+
+class CountingDiffCallback : public InodeDiffCallback {
+ public:
+  void ignoredFile(RelativePathPiece) override {}
+  void untrackedFile(RelativePathPiece) override {
+    ++count;
+  }
+  void removedFile(RelativePathPiece, const TreeEntry&) override {
+    ++count;
+  }
+  void modifiedFile(RelativePathPiece, const TreeEntry&) override {
+    ++count;
+  }
+  void diffError(RelativePathPiece, const folly::exception_wrapper&) override {
+    ++count;
+  }
+
+  std::atomic<size_t> count{0};
+};
+
+/**
+ * Time fn(), and report how many fetches it made from the backing store and
+ * the process's peak RSS afterwards.  fn() returns the number of results
+ * it produced: differences for diffs, and conflicts for checkouts.
+ */
+template <typename Fn>
+void measure(StringPiece name, FakeBackingStore& store, Fn&& fn) {
+  auto trees = store.getTreeFetchCount();
+  auto blobs = store.getBlobFetchCount();
+  folly::stop_watch<std::chrono::milliseconds> timer;
+  size_t results = fn();
+  auto elapsed = timer.elapsed();
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf(
+      "  %-16s %8lld ms %8zu results %8zu trees %8zu blobs %7ld MB peak\n",
+      name.str().c_str(),
+      static_cast<long long>(elapsed.count()),
+      results,
+      store.getTreeFetchCount() - trees,
+      store.getBlobFetchCount() - blobs,
+      usage.ru_maxrss / 1024);
+}
+
+void runBenchmark() {
+  auto paths = generatePaths(FLAGS_files);
+  FakeTreeBuilder base;
+  for (const auto& path : paths) {
+    base.setFile(path, path + "\n");
+  }
+  TestMount testMount{base};
+  auto& backingStore = *testMount.getBackingStore();
+  const auto& edenMount = testMount.getEdenMount();
+  auto baseCommit = edenMount->getParentCommits().parent1();
+
+  // TestMount runs background work on a ManualExecutor, so keep draining it
+  // while the operations below wait on their futures.
+  auto executor = testMount.getServerExecutor();
+  std::atomic<bool> done{false};
+  std::thread driver([&] {
+    while (!done) {
+      executor->wait();
+      executor->drain();
+    }
+  });
+
+  vector<StringPiece> fractions;
+  folly::split(',', FLAGS_change_fractions, fractions, /* ignoreEmpty */ true);
+  for (auto fractionStr : fractions) {
+    auto fraction = folly::to<double>(fractionStr);
+    auto targetCommit = makeTargetCommit(testMount, base, paths, fraction);
+    printf("%d files, %s changed:\n", FLAGS_files, fractionStr.str().c_str());
+
+    // Start each fraction with no inodes loaded below the root.
+    edenMount->getRootInode()->unloadChildrenNow();
+    backingStore.setFetchLatency(
+        std::chrono::milliseconds{FLAGS_backing_store_latency_ms});
+
+    measure("diffCommits", backingStore, [&] {
+      return diffCommits(edenMount->getObjectStore(), baseCommit, targetCommit)
+          .get()
+          .entries.size();
+    });
+    measure("EdenMount::diff", backingStore, [&] {
+      CountingDiffCallback callback;
+      edenMount->diff(&callback, targetCommit).get();
+      return callback.count.load();
+    });
+    measure("checkout", backingStore, [&] {
+      return edenMount->checkout(targetCommit).get().size();
+    });
+    measure("checkout back", backingStore, [&] {
+      return edenMount->checkout(baseCommit).get().size();
+    });
+
+    backingStore.setFetchLatency(std::chrono::milliseconds{0});
+  }
+
+  done = true;
+  executor->add([] {});
+  driver.join();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  runBenchmark();
+  return 0;
+}
@@ -15,6 +15,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "eden/fs/inodes/CheckoutTreePrefetcher.h"
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/FileInode.h"
 #include "eden/fs/inodes/InodeMap.h"
@@ -278,6 +279,28 @@ TEST(Checkout, addFile) {
   runAddFileTests("src/zzz.c");
 }
 
+TEST(Checkout, treePrefetcherFetchesDifferingSubtrees) {
+  auto builder1 = FakeTreeBuilder();
+  builder1.setFile("a/b/c/file.txt", "one");
+  builder1.setFile("a/other.txt", "same");
+  builder1.setFile("x/file.txt", "same");
+  TestMount testMount{builder1};
+
+  auto builder2 = builder1.clone();
+  builder2.replaceFile("a/b/c/file.txt", "two");
+  builder2.setFile("new/file.txt", "added");
+  builder2.finalize(testMount.getBackingStore(), true);
+
+  // Allow only one fetch at a time, so the rest have to wait in the queue.
+  auto prefetcher = std::make_shared<CheckoutTreePrefetcher>(
+      testMount.getEdenMount()->getObjectStore(), 1);
+  prefetcher->start(&builder1.getRoot()->get(), &builder2.getRoot()->get());
+
+  // Both versions of a, a/b and a/b/c were fetched.  x is unchanged, and new
+  // only exists on one side, so neither needs comparing.
+  EXPECT_EQ(6, prefetcher->getTreesFetched());
+}
+
 void testRemoveFile(folly::StringPiece filePath, LoadBehavior loadType) {
   auto builder1 = FakeTreeBuilder();
   builder1.setFile("src/main.c", "int main() { return 0; }\n");
@@ -663,6 +686,27 @@ TEST(Checkout, modifyThenRevert) {
   EXPECT_FILE_INODE(preInode, "temporary edit\n", 0644);
 }
 
+TEST(Checkout, rewriteWithSameContents) {
+  auto srcBuilder = FakeTreeBuilder();
+  srcBuilder.setFile("a/same.txt", "test contents\n");
+  srcBuilder.setFile("a/samesize.txt", "test contents\n");
+  TestMount testMount{srcBuilder};
+  auto originalCommit = testMount.getEdenMount()->getParentCommits().parent1();
+
+  // Both files are materialized.  Only the one whose contents actually
+  // changed should be reported, even though its size did not change.
+  testMount.overwriteFile("a/same.txt", "test contents\n");
+  testMount.overwriteFile("a/samesize.txt", "test CONTENTS\n");
+
+  auto checkoutResult =
+      testMount.getEdenMount()->checkout(originalCommit, CheckoutMode::FORCE);
+  ASSERT_TRUE(checkoutResult.isReady());
+  EXPECT_THAT(
+      std::move(checkoutResult).get(),
+      UnorderedElementsAre(
+          makeConflict(ConflictType::MODIFIED_MODIFIED, "a/samesize.txt")));
+}
+
 TEST(Checkout, modifyThenCheckoutRevisionWithoutFile) {
   auto builder1 = FakeTreeBuilder();
   builder1.setFile("src/main.c", "// Some code.\n");
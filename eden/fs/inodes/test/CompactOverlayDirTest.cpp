@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/CompactOverlayDir.h"
+
+#include <gtest/gtest.h>
+#include "eden/fs/testharness/TestUtil.h"
+
+using namespace facebook::eden;
+using folly::StringPiece;
+
+namespace {
+DirContents makeDir() {
+  DirContents dir;
+  dir.emplace("a.txt"_pc, S_IFREG | 0644, 5_ino, makeTestHash("1"));
+  dir.emplace("bin"_pc, S_IFDIR | 0755, 6_ino);
+  dir.emplace("link"_pc, S_IFLNK | 0777, 7_ino, makeTestHash("2"));
+  dir.emplace("new.c"_pc, S_IFREG | 0600, 12345678901_ino);
+  return dir;
+}
+} // namespace
+
+TEST(CompactOverlayDir, roundTrip) {
+  auto data = serializeCompactOverlayDir(makeDir());
+  auto dir = deserializeCompactOverlayDir(data);
+
+  ASSERT_EQ(4, dir.size());
+  const auto& file = dir.at("a.txt"_pc);
+  EXPECT_EQ(5_ino, file.getInodeNumber());
+  EXPECT_EQ(S_IFREG | 0644, file.getInitialMode());
+  EXPECT_FALSE(file.isMaterialized());
+  EXPECT_EQ(makeTestHash("1"), file.getHash());
+
+  const auto& bin = dir.at("bin"_pc);
+  EXPECT_EQ(6_ino, bin.getInodeNumber());
+  EXPECT_TRUE(bin.isMaterialized());
+  EXPECT_TRUE(bin.isDirectory());
+
+  EXPECT_EQ(makeTestHash("2"), dir.at("link"_pc).getHash());
+  EXPECT_EQ(12345678901_ino, dir.at("new.c"_pc).getInodeNumber());
+  EXPECT_TRUE(dir.at("new.c"_pc).isMaterialized());
+}
+
+TEST(CompactOverlayDir, emptyDirectory) {
+  auto data = serializeCompactOverlayDir(DirContents{});
+  EXPECT_EQ(8, data.size());
+  EXPECT_TRUE(deserializeCompactOverlayDir(data).empty());
+}
+
+TEST(CompactOverlayDir, convertsToThrift) {
+  auto dir = compactOverlayDirToThrift(serializeCompactOverlayDir(makeDir()));
+  ASSERT_EQ(4, dir.entries.size());
+  const auto& file = dir.entries.at("a.txt");
+  EXPECT_EQ(5, file.inodeNumber);
+  EXPECT_EQ(S_IFREG | 0644, file.mode);
+  EXPECT_EQ(StringPiece{makeTestHash("1").getBytes()}, file.hash);
+  EXPECT_FALSE(dir.entries.at("bin").__isset.hash);
+}
+
+TEST(CompactOverlayDir, rejectsMalformedData) {
+  auto data = serializeCompactOverlayDir(makeDir());
+  EXPECT_THROW(deserializeCompactOverlayDir(StringPiece{}), std::exception);
+  EXPECT_THROW(
+      deserializeCompactOverlayDir(StringPiece{data}.subpiece(0, 20)),
+      std::exception);
+  EXPECT_THROW(
+      deserializeCompactOverlayDir(StringPiece{data}.subpiece(
+          0, data.size() - 1)),
+      std::exception);
+  EXPECT_THROW(deserializeCompactOverlayDir(data + "x"), std::exception);
+}
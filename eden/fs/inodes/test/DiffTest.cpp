@@ -12,10 +12,12 @@
 #include <folly/test/TestUtils.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <atomic>
 
 #include "eden/fs/inodes/DiffContext.h"
 #include "eden/fs/inodes/FileInode.h"
 #include "eden/fs/inodes/InodeDiffCallback.h"
+#include "eden/fs/inodes/ServerState.h"
 #include "eden/fs/inodes/TopLevelIgnores.h"
 #include "eden/fs/inodes/TreeInode.h"
 #include "eden/fs/testharness/FakeBackingStore.h"
@@ -249,6 +251,26 @@ TEST(DiffTest, noChanges) {
   test.checkNoChanges();
 }
 
+TEST(DiffTest, loadedUnmodifiedDirectories) {
+  DiffTest test;
+  test.getMount().loadAllInodes();
+  auto result = test.diff(true);
+  EXPECT_THAT(result.getErrors(), UnorderedElementsAre());
+  EXPECT_THAT(result.getUntracked(), UnorderedElementsAre());
+  EXPECT_THAT(result.getIgnored(), UnorderedElementsAre());
+  EXPECT_THAT(result.getRemoved(), UnorderedElementsAre());
+  EXPECT_THAT(result.getModified(), UnorderedElementsAre());
+
+  // Modifying a file deep in a loaded directory materializes every directory
+  // above it, so the change is still found.
+  test.getMount().overwriteFile("src/a/b/c/4.txt", "updated\n");
+  result = test.diff(true);
+  EXPECT_THAT(result.getErrors(), UnorderedElementsAre());
+  EXPECT_THAT(
+      result.getModified(),
+      UnorderedElementsAre(RelativePath{"src/a/b/c/4.txt"}));
+}
+
 TEST(DiffTest, fileModified) {
   DiffTest test;
   test.getMount().overwriteFile("src/1.txt", "This file has been updated.\n");
@@ -679,6 +701,44 @@ TEST(DiffTest, resetReplaceFileWithDir) {
   testResetReplaceFileWithDir(false);
 }
 
+TEST(DiffTest, ignoreFilesAreCachedByBlobHash) {
+  DiffTest test({
+      {".gitignore", "*.log\n"},
+      {"src/.gitignore", "*.log\n"},
+      {"src/x.txt", "test\n"},
+  });
+  test.getMount().addFile("a.log", "new\n");
+  test.getMount().addFile("src/b.log", "new\n");
+  auto* ignoreCache =
+      test.getMount().getEdenMount()->getServerState()->getGitIgnoreCache();
+
+  auto result = test.diff(true);
+  EXPECT_THAT(
+      result.getIgnored(),
+      UnorderedElementsAre(RelativePath{"a.log"}, RelativePath{"src/b.log"}));
+  // Both .gitignore files have the same blob, so only the first one needs
+  // to be parsed.
+  auto hitCount = ignoreCache->getHitCount();
+  EXPECT_EQ(1, hitCount);
+
+  result = test.diff(true);
+  EXPECT_THAT(
+      result.getIgnored(),
+      UnorderedElementsAre(RelativePath{"a.log"}, RelativePath{"src/b.log"}));
+  EXPECT_EQ(hitCount + 2, ignoreCache->getHitCount());
+
+  // A modified .gitignore file is read again rather than taken from the
+  // cache.
+  test.getMount().overwriteFile("src/.gitignore", "*.txt\n");
+  result = test.diff(true);
+  EXPECT_THAT(result.getIgnored(), UnorderedElementsAre(RelativePath{"a.log"}));
+  EXPECT_THAT(
+      result.getUntracked(), UnorderedElementsAre(RelativePath{"src/b.log"}));
+  EXPECT_THAT(
+      result.getModified(),
+      UnorderedElementsAre(RelativePath{"src/.gitignore"}));
+}
+
 // Test with a .gitignore file in the top-level directory
 TEST(DiffTest, ignoreToplevelOnly) {
   DiffTest test({
@@ -1230,3 +1290,42 @@ TEST(DiffTest, fileNotReady) {
           RelativePath{"doc/c.txt"},
           RelativePath{"doc/d.txt"}));
 }
+
+namespace {
+/**
+ * A DiffResultsCallback that asks the diff to stop as soon as it has seen
+ * an untracked file.
+ */
+class CancellingDiffCallback : public DiffResultsCallback {
+ public:
+  void untrackedFile(RelativePathPiece path) override {
+    DiffResultsCallback::untrackedFile(path);
+    cancelled_.store(true);
+  }
+  bool isCancelled() const override {
+    return cancelled_.load();
+  }
+
+ private:
+  std::atomic<bool> cancelled_{false};
+};
+} // namespace
+
+TEST(DiffTest, cancelledDiffStopsEarly) {
+  DiffTest test;
+  auto& mount = test.getMount();
+  mount.mkdir("new1");
+  mount.addFile("new1/a.txt", "a\n");
+  mount.mkdir("new2");
+  mount.addFile("new2/b.txt", "b\n");
+
+  CancellingDiffCallback callback;
+  auto commitHash = mount.getEdenMount()->getParentCommits().parent1();
+  auto diffFuture = mount.getEdenMount()->diff(&callback, commitHash);
+  EXPECT_FUTURE_RESULT(diffFuture);
+  auto result = callback.extractResults();
+
+  // Only one of the untracked directories was diffed before we cancelled.
+  EXPECT_THAT(result.getErrors(), UnorderedElementsAre());
+  EXPECT_EQ(1, result.getUntracked().size());
+}
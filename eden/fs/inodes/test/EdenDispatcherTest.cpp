@@ -11,6 +11,7 @@
 
 #include <folly/experimental/TestUtil.h>
 #include <folly/test/TestUtils.h>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include "eden/fs/testharness/FakeTreeBuilder.h"
 #include "eden/fs/testharness/TestMount.h"
@@ -19,6 +20,10 @@ using namespace facebook::eden;
 using namespace std::chrono_literals;
 using namespace folly::string_piece_literals;
 
+DECLARE_int32(negative_lookup_ttl_seconds);
+DECLARE_int32(materialized_negative_lookup_ttl_seconds);
+DECLARE_bool(lookup_unloaded_directories);
+
 namespace {
 struct EdenDispatcherTest : ::testing::Test {
   EdenDispatcherTest() : mount{builder} {}
@@ -99,3 +104,96 @@ TEST_F(EdenDispatcherTest, createReturnsNameTooLong) {
     EXPECT_EQ(ENAMETOOLONG, e.code().value());
   }
 }
+
+TEST_F(EdenDispatcherTest, lookupCachesMissingNamesForConfiguredTime) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_negative_lookup_ttl_seconds = 30;
+  FLAGS_materialized_negative_lookup_ttl_seconds = 5;
+  auto* dispatcher = mount.getDispatcher();
+
+  auto entry = dispatcher->lookup(kRootNodeId, "missing"_pc).get(0ms);
+  EXPECT_EQ(0, entry.nodeid);
+  EXPECT_EQ(30, entry.entry_valid);
+
+  // Modifying the directory switches to the shorter time.
+  dispatcher->mkdir(kRootNodeId, "dir"_pc, S_IFDIR | 0755).get(0ms);
+  entry = dispatcher->lookup(kRootNodeId, "missing"_pc).get(0ms);
+  EXPECT_EQ(0, entry.nodeid);
+  EXPECT_EQ(5, entry.entry_valid);
+
+  FLAGS_materialized_negative_lookup_ttl_seconds = 0;
+  try {
+    dispatcher->lookup(kRootNodeId, "missing"_pc).get(0ms);
+    FAIL() << "should throw";
+  } catch (std::system_error& e) {
+    EXPECT_EQ(ENOENT, e.code().value());
+  }
+}
+
+TEST(EdenDispatcher, identicalConcurrentLookupsEachTakeAReference) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_lookup_unloaded_directories = false;
+  FakeTreeBuilder builder;
+  builder.setFile("src/main.c", "int main() { return 0; }\n");
+  TestMount mount{builder, false};
+  auto* dispatcher = mount.getDispatcher();
+
+  // Both lookups wait on the same load of "src".
+  auto first = dispatcher->lookup(kRootNodeId, "src"_pc);
+  auto second = dispatcher->lookup(kRootNodeId, "src"_pc);
+  EXPECT_FALSE(first.isReady());
+  EXPECT_FALSE(second.isReady());
+
+  builder.setReady("src");
+  auto firstEntry = std::move(first).get(0ms);
+  auto secondEntry = std::move(second).get(0ms);
+  EXPECT_EQ(firstEntry.nodeid, secondEntry.nodeid);
+
+  // The kernel will send a FUSE_FORGET for each reply, so each must count.
+  auto src = mount.getInode("src"_relpath);
+  EXPECT_EQ(2, src->getFuseRefcount());
+}
+
+TEST(EdenDispatcher, lookupDoesNotFetchUnloadedDirectories) {
+  FakeTreeBuilder builder;
+  builder.setFile("src/main.c", "int main() { return 0; }\n");
+  TestMount mount{builder, false};
+  auto* dispatcher = mount.getDispatcher();
+  auto* inodeMap = mount.getEdenMount()->getInodeMap();
+
+  // The lookups are answered from the root's entry for "src".
+  auto entry = dispatcher->lookup(kRootNodeId, "src"_pc).get(0ms);
+  EXPECT_NE(0, entry.nodeid);
+  EXPECT_TRUE(S_ISDIR(entry.attr.mode));
+  dispatcher->lookup(kRootNodeId, "src"_pc).get(0ms);
+  auto number = InodeNumber{entry.nodeid};
+  EXPECT_FALSE(inodeMap->lookupLoadedInode(number));
+
+  // Loading the directory fetches its Tree and keeps both references.
+  auto srcFuture = inodeMap->lookupTreeInode(number);
+  EXPECT_FALSE(srcFuture.isReady());
+  builder.setReady("src");
+  auto src = std::move(srcFuture).get(0ms);
+  EXPECT_EQ(2, src->getFuseRefcount());
+}
+
+TEST(EdenDispatcher, modificationsChangeTheGeneration) {
+  FakeTreeBuilder builder;
+  TestMount mount{builder};
+  auto* dispatcher = mount.getDispatcher();
+  fuse_in_header header = {};
+
+  auto generation = dispatcher->getModificationGeneration();
+  header.opcode = FUSE_LOOKUP;
+  dispatcher->recordRequest(header);
+  dispatcher->recordRequestFinished(header);
+  EXPECT_EQ(generation, dispatcher->getModificationGeneration());
+
+  // Reads may not share results across either end of a modification.
+  header.opcode = FUSE_MKDIR;
+  dispatcher->recordRequest(header);
+  auto during = dispatcher->getModificationGeneration();
+  EXPECT_NE(generation, during);
+  dispatcher->recordRequestFinished(header);
+  EXPECT_NE(during, dispatcher->getModificationGeneration());
+}
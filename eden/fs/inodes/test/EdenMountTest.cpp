@@ -324,3 +324,96 @@ TEST(EdenMount, testCanChownFilesAndDirs) {
   EXPECT_EQ(attr.uid, fileResult.st.st_uid);
   EXPECT_EQ(attr.gid, fileResult.st.st_gid);
 }
+
+TEST(EdenMount, getInodeCacheFollowsRenamesAndUnlinks) {
+  TestMount testMount;
+  auto builder = FakeTreeBuilder();
+  builder.setFile("a/b/c/file.txt", "contents");
+  builder.setFile("a/b/other.txt", "other");
+  testMount.initialize(builder);
+  auto edenMount = testMount.getEdenMount();
+
+  auto first = edenMount->getInode("a/b/c/file.txt"_relpath).get(0ms);
+  auto second = edenMount->getInode("a/b/c/file.txt"_relpath).get(0ms);
+  EXPECT_EQ(first.get(), second.get());
+
+  auto dirB = testMount.getTreeInode("a/b");
+  dirB->rename("c"_pc, dirB, "d"_pc).get(0ms);
+  EXPECT_THROW_ERRNO(
+      edenMount->getInode("a/b/c/file.txt"_relpath).get(0ms), ENOENT);
+  EXPECT_EQ(
+      first.get(), edenMount->getInode("a/b/d/file.txt"_relpath).get(0ms));
+
+  edenMount->getInode("a/b/other.txt"_relpath).get(0ms);
+  dirB->unlink("other.txt"_pc).get(0ms);
+  EXPECT_THROW_ERRNO(
+      edenMount->getInode("a/b/other.txt"_relpath).get(0ms), ENOENT);
+}
+
+TEST(EdenMount, journalSurvivesRestarts) {
+  TestMount testMount;
+  auto builder = FakeTreeBuilder();
+  builder.setFile("src/main.c", "int main() { return 0; }\n");
+  testMount.initialize(builder);
+  auto generation = testMount.getEdenMount()->getMountGeneration();
+
+  testMount.addFile("src/first.c", "first");
+  auto sequence =
+      testMount.getEdenMount()->getJournal().getLatest()->toSequence;
+
+  // A clean shutdown saves the journal and the next mount picks it up.
+  testMount.remount();
+  auto& journal = testMount.getEdenMount()->getJournal();
+  EXPECT_EQ(generation, testMount.getEdenMount()->getMountGeneration());
+  EXPECT_EQ(sequence, journal.getLatest()->toSequence);
+  auto merged = journal.accumulateRange(1);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_FALSE(merged->isTruncated);
+  EXPECT_EQ(1, merged->changedFilesInOverlay.count("src/first.c"_relpath));
+
+  // So does a graceful restart, and new changes carry on from there.
+  testMount.addFile("src/second.c", "second");
+  auto secondSequence = journal.getLatest()->toSequence;
+  testMount.remountGracefully();
+  auto& newJournal = testMount.getEdenMount()->getJournal();
+  EXPECT_EQ(generation, testMount.getEdenMount()->getMountGeneration());
+  EXPECT_EQ(secondSequence, newJournal.getLatest()->toSequence);
+  testMount.addFile("src/third.c", "third");
+  merged = newJournal.accumulateRange(sequence + 1);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_EQ(2, merged->changedFilesInOverlay.size());
+  EXPECT_EQ(1, merged->changedFilesInOverlay.count("src/second.c"_relpath));
+  EXPECT_EQ(1, merged->changedFilesInOverlay.count("src/third.c"_relpath));
+}
+
+TEST(EdenMount, hibernateUnloadsInodesUntilTheMountIsUsed) {
+  FakeTreeBuilder builder;
+  builder.setFiles({
+      {"src/a.c", "a\n"},
+      {"src/b.c", "b\n"},
+      {"doc/README", "readme\n"},
+  });
+  TestMount testMount{builder};
+  const auto& edenMount = testMount.getEdenMount();
+  auto* inodeMap = edenMount->getInodeMap();
+  auto unheld = testMount.getFileInode("src/a.c")->getNodeId();
+  auto docIno = testMount.getTreeInode("doc")->getNodeId();
+  auto held = testMount.getFileInode("src/b.c");
+  testMount.addFile("src/c.c", "c\n");
+  testMount.addFile("src/d.c", "d\n");
+  EXPECT_FALSE(edenMount->isHibernating());
+
+  // Everything but the inode we hold, and the directories above it, unloads.
+  edenMount->hibernate(0).get(1s);
+  EXPECT_TRUE(edenMount->isHibernating());
+  EXPECT_FALSE(inodeMap->lookupLoadedInode(unheld));
+  EXPECT_FALSE(inodeMap->lookupLoadedInode(docIno));
+  EXPECT_TRUE(inodeMap->lookupLoadedInode(held->getNodeId()));
+  EXPECT_EQ(1, edenMount->getJournal().getStats().entryCount);
+
+  // The next access loads what it needs again.
+  edenMount->recordActivity();
+  EXPECT_FALSE(edenMount->isHibernating());
+  EXPECT_EQ("a\n", testMount.readFile("src/a.c"));
+  EXPECT_EQ("readme\n", testMount.readFile("doc/README"));
+}
@@ -9,13 +9,19 @@
  */
 #include "eden/fs/inodes/FileInode.h"
 
+#include <folly/FileUtil.h>
 #include <folly/Format.h>
 #include <folly/Range.h>
 #include <folly/test/TestUtils.h>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include <chrono>
+#include <thread>
+#include <vector>
 
 #include "eden/fs/fuse/FileHandle.h"
+#include "eden/fs/inodes/InodeMap.h"
+#include "eden/fs/inodes/Overlay.h"
 #include "eden/fs/inodes/TreeInode.h"
 #include "eden/fs/testharness/FakeBackingStore.h"
 #include "eden/fs/testharness/FakeTreeBuilder.h"
@@ -28,6 +34,9 @@ using folly::literals::string_piece_literals::operator""_sp;
 using std::chrono::duration_cast;
 using namespace std::chrono_literals;
 
+DECLARE_uint64(min_streaming_read_blob_size);
+DECLARE_uint64(write_buffer_size);
+
 std::ostream& operator<<(std::ostream& os, const timespec& ts) {
   os << folly::sformat("{}.{:09d}", ts.tv_sec, ts.tv_nsec);
   return os;
@@ -365,6 +374,31 @@ TEST_F(FileInodeTest, setattrMtimeMaterialized) {
   testSetattrMtime(mount_);
 }
 
+TEST_F(FileInodeTest, setattrCtime) {
+  auto inode = mount_.getFileInode("dir/a.txt");
+  fuse_setattr_in desired = {};
+
+  // The kernel sends FATTR_CTIME to flush the ctime of cached writes.
+  desired.ctime = 1234;
+  desired.ctimensec = 5678;
+  desired.valid = FATTR_CTIME;
+  auto attr = setFileAttr(inode, desired);
+
+  BASIC_ATTR_CHECKS(inode, attr);
+  EXPECT_EQ(1234, attr.st.st_ctim.tv_sec);
+  EXPECT_EQ(5678, attr.st.st_ctim.tv_nsec);
+
+  // Other changes still set the ctime to the current time.
+  mount_.getClock().advance(1234min);
+  auto start = mount_.getClock().getTimePoint();
+  desired.valid = FATTR_MODE;
+  desired.mode = S_IFREG | 0600;
+  attr = setFileAttr(inode, desired);
+
+  BASIC_ATTR_CHECKS(inode, attr);
+  EXPECT_EQ(start, folly::to<FakeClock::time_point>(attr.st.st_ctim));
+}
+
 namespace {
 bool isInodeMaterialized(const TreeInodePtr& inode) {
   return inode->getContents().wlock()->isMaterialized();
@@ -401,6 +435,107 @@ TEST_F(FileInodeTest, truncatingMaterializesParent) {
   EXPECT_EQ(true, isInodeMaterialized(parent));
 }
 
+TEST_F(FileInodeTest, openingLargeFileForWriteDefersMaterialization) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_min_streaming_read_blob_size = 4;
+
+  auto inode = mount_.getFileInode("dir/sub/b.txt");
+  auto parent = mount_.getTreeInode("dir/sub");
+  auto handle = inode->open(O_RDWR).get();
+  EXPECT_EQ(false, isInodeMaterialized(parent));
+
+  EXPECT_EQ(1, handle->write("T", 0).get());
+  EXPECT_EQ(true, isInodeMaterialized(parent));
+  EXPECT_EQ("This is b.txt.\n", inode->readAll().get());
+}
+
+TEST_F(FileInodeTest, idleBlobsOfOpenFilesAreReleased) {
+  auto inode = mount_.getFileInode("dir/sub/b.txt");
+  auto* inodeMap = mount_.getEdenMount()->getInodeMap();
+  auto handle = inode->open(O_RDONLY).get();
+  EXPECT_EQ("This is b.txt.\n", inode->readAll().get());
+  auto loaded = inodeMap->getLoadedBlobBytes();
+  EXPECT_EQ(15, loaded);
+
+  // Nothing has been idle since before a cutoff in the past.
+  auto now = std::chrono::steady_clock::now();
+  EXPECT_EQ(0, inodeMap->releaseIdleBlobs(now - std::chrono::hours(1)));
+  EXPECT_EQ(loaded, inodeMap->releaseIdleBlobs(now + std::chrono::hours(1)));
+  EXPECT_EQ(0, inodeMap->getLoadedBlobBytes());
+
+  // The next read loads the blob again.
+  EXPECT_EQ("This is b.txt.\n", inode->readAll().get());
+  EXPECT_EQ(loaded, inodeMap->getLoadedBlobBytes());
+}
+
+TEST_F(FileInodeTest, sha1TracksAppendsAndOverwrites) {
+  auto inode = mount_.getFileInode("dir/a.txt");
+  auto expectSha1 = [&](StringPiece contents) {
+    EXPECT_EQ(
+        Hash::sha1(folly::ByteRange{contents}), inode->getSha1().get(0ms));
+  };
+  expectSha1("This is a.txt.\n");
+
+  inode->write("T", 0).get(0ms);
+  expectSha1("This is a.txt.\n");
+
+  // Appends extend the saved SHA-1 state.
+  inode->write("more\n", 15).get(0ms);
+  expectSha1("This is a.txt.\nmore\n");
+  inode->write("and more\n", 20).get(0ms);
+  inode->write("tail\n", 29).get(0ms);
+  expectSha1("This is a.txt.\nmore\nand more\ntail\n");
+
+  // Writes within the hashed data and truncation discard it.
+  inode->write("X", 0).get(0ms);
+  expectSha1("Xhis is a.txt.\nmore\nand more\ntail\n");
+  fuse_setattr_in desired = {};
+  desired.size = 4;
+  desired.valid = FATTR_SIZE;
+  setFileAttr(inode, desired);
+  expectSha1("Xhis");
+  inode->write("!", 4).get(0ms);
+  expectSha1("Xhis!");
+}
+
+TEST_F(FileInodeTest, smallWritesAreBufferedUntilRead) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_write_buffer_size = 64;
+  auto inode = mount_.getFileInode("dir/a.txt");
+  auto handle = inode->open(O_RDWR).get(0ms);
+  auto overlayContents = [&] {
+    auto file = mount_.getEdenMount()->getOverlay()->openFileNoVerify(
+        inode->getNodeId());
+    std::string contents;
+    folly::readFile(file.fd(), contents);
+    return contents.substr(Overlay::kHeaderLength);
+  };
+
+  // The first write materializes the file, and the next ones are merged.
+  EXPECT_EQ(1, handle->write("T"_sp, 0).get(0ms));
+  EXPECT_EQ(2, handle->write("HI"_sp, 1).get(0ms));
+  EXPECT_EQ(2, handle->write("S "_sp, 3).get(0ms));
+  EXPECT_EQ("This is a.txt.\n", overlayContents());
+
+  EXPECT_EQ("THIS is a.txt.\n", inode->readAll().get(0ms));
+  EXPECT_EQ("THIS is a.txt.\n", overlayContents());
+
+  // Writes elsewhere in the file flush the buffer first.
+  EXPECT_EQ(2, handle->write("IS"_sp, 5).get(0ms));
+  EXPECT_EQ(1, handle->write("!"_sp, 14).get(0ms));
+  EXPECT_EQ("THIS IS a.txt.\n", overlayContents());
+  EXPECT_EQ(15, getFileAttr(inode).st.st_size);
+  EXPECT_EQ("THIS IS a.txt.!", overlayContents());
+
+  // So do the periodic flush and closing the file.
+  EXPECT_EQ(1, handle->write("?"_sp, 14).get(0ms));
+  mount_.getEdenMount()->getInodeMap()->flushWriteBuffers();
+  EXPECT_EQ("THIS IS a.txt.?", overlayContents());
+  EXPECT_EQ(1, handle->write("A"_sp, 8).get(0ms));
+  handle.reset();
+  EXPECT_EQ("THIS IS A.txt.?", overlayContents());
+}
+
 TEST(FileInode, truncatingDuringLoad) {
   FakeTreeBuilder builder;
   builder.setFiles({{"notready.txt", "Contents not ready.\n"}});
@@ -455,6 +590,37 @@ TEST(FileInode, readDuringLoad) {
   EXPECT_EQ(contents, std::move(dataFuture).get().copyData());
 }
 
+TEST(FileInode, concurrentReadsOfLoadedAndMaterializedFiles) {
+  FakeTreeBuilder builder;
+  auto contents = "shared header contents\n"_sp;
+  builder.setFiles({{"loaded.h", contents}, {"written.h", contents}});
+  TestMount mount_{builder};
+
+  auto loaded = mount_.getFileInode("loaded.h");
+  auto loadedHandle = loaded->open(O_RDONLY).get(0ms);
+  auto written = mount_.getFileInode("written.h");
+  auto writtenHandle = written->open(O_RDWR).get(0ms);
+  writtenHandle->write("SHARED"_sp, 0).get(0ms);
+  EXPECT_EQ(contents, loadedHandle->read(4096, 0).get(0ms).copyData());
+
+  // Once the blob is loaded or the file is materialized, reads only take the
+  // state lock in shared mode and may run at the same time.
+  std::vector<std::thread> threads;
+  for (int n = 0; n < 8; ++n) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(contents, loadedHandle->read(4096, 0).get().copyData());
+        EXPECT_EQ(
+            "SHARED header contents\n",
+            writtenHandle->read(4096, 0).get().copyData());
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 TEST(FileInode, writeDuringLoad) {
   // Build a tree to test against, but do not mark the state ready yet
   FakeTreeBuilder builder;
@@ -0,0 +1,541 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <folly/Synchronized.h>
+#include <folly/executors/ManualExecutor.h>
+#include <folly/init/Init.h>
+#include <folly/logging/xlog.h>
+#include <folly/synchronization/Baton.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <random>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/testharness/FakeFuse.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+
+using namespace facebook::eden;
+using namespace std::chrono_literals;
+using folly::ByteRange;
+using folly::StringPiece;
+using std::string;
+using std::vector;
+using Clock = std::chrono::steady_clock;
+
+DEFINE_int32(clients, 8, "Number of clients sending FUSE requests at once");
+DEFINE_int32(ops, 200000, "Total number of FUSE requests to send");
+DEFINE_string(
+    op_mix,
+    "lookup:30,getattr:30,readdir:5,read:25,write:5,create:3,rename:2",
+    "Comma-separated op:weight pairs to draw the synthetic requests from");
+DEFINE_string(
+    op_trace,
+    "",
+    "File listing recorded ops, one name per line, to replay instead of "
+    "--op_mix.  The clients take turns sending them in order.");
+DEFINE_int32(dirs, 100, "Number of directories in the mount");
+DEFINE_int32(files_per_dir, 100, "Number of files in each directory");
+DEFINE_int32(file_size, 4096, "Size of each file in the mount");
+DEFINE_int32(io_size, 4096, "Number of bytes in each read and write request");
+DEFINE_bool(
+    readdirplus,
+    false,
+    "Send FUSE_READDIRPLUS rather than FUSE_READDIR for readdir ops");
+
+namespace {
+
+enum class Op {
+  LOOKUP,
+  GETATTR,
+  READDIR,
+  READ,
+  WRITE,
+  CREATE,
+  RENAME,
+};
+constexpr size_t kNumOps = static_cast<size_t>(Op::RENAME) + 1;
+constexpr StringPiece kOpNames[kNumOps] =
+    {"lookup", "getattr", "readdir", "read", "write", "create", "rename"};
+
+Op parseOp(StringPiece name) {
+  for (size_t n = 0; n < kNumOps; ++n) {
+    if (name == kOpNames[n]) {
+      return static_cast<Op>(n);
+    }
+  }
+  throw std::invalid_argument(folly::to<string>("unknown FUSE op ", name));
+}
+
+/**
+ * Build a request argument from a fixed-size struct followed by
+ * NUL-terminated names.
+ */
+template <typename T>
+string makeArg(const T& fixed, std::initializer_list<StringPiece> names = {}) {
+  string arg{reinterpret_cast<const char*>(&fixed), sizeof(fixed)};
+  for (auto name : names) {
+    arg.append(name.data(), name.size());
+    arg.push_back('\0');
+  }
+  return arg;
+}
+
+string makeNameArg(StringPiece name) {
+  return string{name.data(), name.size()} + '\0';
+}
+
+template <typename T>
+T parseBody(const FakeFuse::Response& response, size_t offset = 0) {
+  CHECK_GE(response.body.size(), offset + sizeof(T));
+  T value;
+  memcpy(&value, response.body.data() + offset, sizeof(T));
+  return value;
+}
+
+/**
+ * Sends requests from several client threads over one FakeFuse connection,
+ * and hands each response to the client waiting for it.
+ */
+class FuseConnection {
+ public:
+  struct Reply {
+    FakeFuse::Response response;
+    Clock::time_point received;
+  };
+
+  explicit FuseConnection(std::shared_ptr<FakeFuse> fuse)
+      : fuse_(std::move(fuse)), receiver_([this] { receiveLoop(); }) {}
+
+  ~FuseConnection() {
+    stopping_ = true;
+    receiver_.join();
+  }
+
+  Reply call(uint32_t opcode, uint64_t nodeid, StringPiece arg) {
+    auto unique = fuse_->sendRequest(opcode, nodeid, ByteRange{arg});
+    auto slot = getSlot(unique);
+    slot->baton.wait();
+    slots_.wlock()->erase(unique);
+    return std::move(slot->reply);
+  }
+
+ private:
+  struct Slot {
+    folly::Baton<> baton;
+    Reply reply;
+  };
+
+  /**
+   * Whichever of the client and the receiver gets here first creates the
+   * slot, since the response can arrive before sendRequest() returns.
+   */
+  std::shared_ptr<Slot> getSlot(uint32_t unique) {
+    auto slots = slots_.wlock();
+    auto& slot = (*slots)[unique];
+    if (!slot) {
+      slot = std::make_shared<Slot>();
+    }
+    return slot;
+  }
+
+  void receiveLoop() {
+    while (true) {
+      FakeFuse::Response response;
+      try {
+        response = fuse_->recvResponse();
+      } catch (const std::system_error& ex) {
+        // recvResponse() times out whenever no client is waiting.
+        if (stopping_ || ex.code().value() != EAGAIN) {
+          return;
+        }
+        continue;
+      }
+      auto received = Clock::now();
+      auto slot = getSlot(response.header.unique);
+      slot->reply = Reply{std::move(response), received};
+      slot->baton.post();
+    }
+  }
+
+  std::shared_ptr<FakeFuse> fuse_;
+  std::atomic<bool> stopping_{false};
+  folly::Synchronized<std::unordered_map<uint32_t, std::shared_ptr<Slot>>>
+      slots_;
+  std::thread receiver_;
+};
+
+struct OpResults {
+  vector<Clock::duration> latencies;
+  size_t errors{0};
+};
+
+struct DirInfo {
+  uint64_t nodeid;
+  uint64_t fh;
+  vector<string> fileNames;
+};
+
+struct FileInfo {
+  uint64_t nodeid;
+  uint64_t fh;
+};
+
+/**
+ * The inodes and handles that the clients send requests for, found with
+ * FUSE requests in the same way that the kernel would.
+ */
+struct MountInfo {
+  vector<DirInfo> dirs;
+  vector<FileInfo> files;
+  vector<uint64_t> nodeids;
+};
+
+FakeFuse::Response checkedCall(
+    FuseConnection& conn,
+    uint32_t opcode,
+    uint64_t nodeid,
+    StringPiece arg) {
+  auto reply = conn.call(opcode, nodeid, arg);
+  if (reply.response.header.error != 0) {
+    throw std::runtime_error(folly::to<string>(
+        "FUSE opcode ",
+        opcode,
+        " failed during setup: ",
+        folly::errnoStr(-reply.response.header.error)));
+  }
+  return std::move(reply.response);
+}
+
+MountInfo resolveMount(FuseConnection& conn) {
+  MountInfo info;
+  info.nodeids.push_back(FUSE_ROOT_ID);
+  for (int dir = 0; dir < FLAGS_dirs; ++dir) {
+    auto dirName = folly::sformat("dir{:04d}", dir);
+    auto entry = parseBody<fuse_entry_out>(checkedCall(
+        conn, FUSE_LOOKUP, FUSE_ROOT_ID, makeNameArg(dirName)));
+    fuse_open_in openArg = {};
+    openArg.flags = O_RDONLY | O_DIRECTORY;
+    auto opened = parseBody<fuse_open_out>(
+        checkedCall(conn, FUSE_OPENDIR, entry.nodeid, makeArg(openArg)));
+    info.dirs.push_back(DirInfo{entry.nodeid, opened.fh, {}});
+    info.nodeids.push_back(entry.nodeid);
+
+    for (int file = 0; file < FLAGS_files_per_dir; ++file) {
+      auto fileName = folly::sformat("file{:04d}", file);
+      auto fileEntry = parseBody<fuse_entry_out>(checkedCall(
+          conn, FUSE_LOOKUP, entry.nodeid, makeNameArg(fileName)));
+      openArg.flags = O_RDONLY;
+      auto fileOpened = parseBody<fuse_open_out>(
+          checkedCall(conn, FUSE_OPEN, fileEntry.nodeid, makeArg(openArg)));
+      info.dirs.back().fileNames.push_back(fileName);
+      info.files.push_back(FileInfo{fileEntry.nodeid, fileOpened.fh});
+      info.nodeids.push_back(fileEntry.nodeid);
+    }
+  }
+  return info;
+}
+
+/**
+ * One client of the mount.  Writes, creates and renames happen in a
+ * directory of the client's own, so that they do not conflict.
+ */
+class Client {
+ public:
+  Client(FuseConnection& conn, const MountInfo& mount, size_t index)
+      : conn_(conn), mount_(mount), rng_(index) {
+    fuse_mkdir_in mkdirArg = {};
+    mkdirArg.mode = S_IFDIR | 0755;
+    auto name = folly::sformat("client{:04d}", index);
+    auto response = checkedCall(
+        conn_, FUSE_MKDIR, FUSE_ROOT_ID, makeArg(mkdirArg, {name}));
+    scratchDir_ = parseBody<fuse_entry_out>(response).nodeid;
+  }
+
+  void run(const vector<Op>& ops) {
+    for (auto op : ops) {
+      // Writes and renames need a file that this client created.
+      if ((op == Op::WRITE || op == Op::RENAME) && created_.empty()) {
+        op = Op::CREATE;
+      }
+      auto start = Clock::now();
+      auto reply = send(op);
+      auto& results = results_[static_cast<size_t>(op)];
+      results.latencies.push_back(reply.received - start);
+      if (reply.response.header.error != 0) {
+        ++results.errors;
+      } else if (op == Op::CREATE) {
+        auto entry = parseBody<fuse_entry_out>(reply.response);
+        auto opened =
+            parseBody<fuse_open_out>(reply.response, sizeof(fuse_entry_out));
+        created_.push_back(CreatedFile{lastName_, entry.nodeid, opened.fh});
+      } else if (op == Op::RENAME) {
+        created_[renamed_].name = lastName_;
+      }
+    }
+  }
+
+  const OpResults& getResults(Op op) const {
+    return results_[static_cast<size_t>(op)];
+  }
+
+ private:
+  struct CreatedFile {
+    string name;
+    uint64_t nodeid;
+    uint64_t fh;
+  };
+
+  template <typename Container>
+  const typename Container::value_type& pick(const Container& items) {
+    return items[rng_() % items.size()];
+  }
+
+  FuseConnection::Reply send(Op op) {
+    switch (op) {
+      case Op::LOOKUP: {
+        const auto& dir = pick(mount_.dirs);
+        return conn_.call(
+            FUSE_LOOKUP, dir.nodeid, makeNameArg(pick(dir.fileNames)));
+      }
+      case Op::GETATTR: {
+        fuse_getattr_in arg = {};
+        return conn_.call(FUSE_GETATTR, pick(mount_.nodeids), makeArg(arg));
+      }
+      case Op::READDIR: {
+        const auto& dir = pick(mount_.dirs);
+        fuse_read_in arg = {};
+        arg.fh = dir.fh;
+        arg.size = 4096;
+        return conn_.call(
+            FLAGS_readdirplus ? FUSE_READDIRPLUS : FUSE_READDIR,
+            dir.nodeid,
+            makeArg(arg));
+      }
+      case Op::READ: {
+        const auto& file = pick(mount_.files);
+        fuse_read_in arg = {};
+        arg.fh = file.fh;
+        arg.size = FLAGS_io_size;
+        return conn_.call(FUSE_READ, file.nodeid, makeArg(arg));
+      }
+      case Op::WRITE: {
+        const auto& file = pick(created_);
+        fuse_write_in arg = {};
+        arg.fh = file.fh;
+        arg.size = FLAGS_io_size;
+        return conn_.call(
+            FUSE_WRITE,
+            file.nodeid,
+            makeArg(arg) + string(FLAGS_io_size, 'w'));
+      }
+      case Op::CREATE: {
+        fuse_create_in arg = {};
+        arg.flags = O_RDWR | O_CREAT | O_EXCL;
+        arg.mode = S_IFREG | 0644;
+        lastName_ = nextName();
+        return conn_.call(FUSE_CREATE, scratchDir_, makeArg(arg, {lastName_}));
+      }
+      case Op::RENAME: {
+        renamed_ = rng_() % created_.size();
+        fuse_rename_in arg = {};
+        arg.newdir = scratchDir_;
+        lastName_ = nextName();
+        return conn_.call(
+            FUSE_RENAME,
+            scratchDir_,
+            makeArg(arg, {created_[renamed_].name, lastName_}));
+      }
+    }
+    throw std::logic_error("unhandled op");
+  }
+
+  string nextName() {
+    return folly::to<string>("new", nextFile_++);
+  }
+
+  FuseConnection& conn_;
+  const MountInfo& mount_;
+  std::mt19937_64 rng_;
+  uint64_t scratchDir_;
+  vector<CreatedFile> created_;
+  size_t nextFile_{0};
+  string lastName_;
+  size_t renamed_{0};
+  OpResults results_[kNumOps];
+};
+
+/**
+ * Returns the ops each client sends, either drawn from --op_mix or taken in
+ * turn from --op_trace.
+ */
+vector<vector<Op>> makeOps(size_t clients) {
+  vector<vector<Op>> ops(clients);
+  if (!FLAGS_op_trace.empty()) {
+    string trace;
+    folly::checkUnixError(
+        folly::readFile(FLAGS_op_trace.c_str(), trace),
+        "failed to read ",
+        FLAGS_op_trace);
+    vector<StringPiece> lines;
+    folly::split('\n', trace, lines, /* ignoreEmpty */ true);
+    for (size_t n = 0; n < lines.size(); ++n) {
+      ops[n % clients].push_back(parseOp(folly::trimWhitespace(lines[n])));
+    }
+    return ops;
+  }
+
+  vector<double> weights(kNumOps, 0);
+  vector<StringPiece> pairs;
+  folly::split(',', FLAGS_op_mix, pairs, /* ignoreEmpty */ true);
+  for (auto pair : pairs) {
+    StringPiece name;
+    double weight;
+    if (!folly::split(':', pair, name, weight)) {
+      throw std::invalid_argument(folly::to<string>("bad --op_mix ", pair));
+    }
+    weights[static_cast<size_t>(parseOp(name))] = weight;
+  }
+  std::mt19937_64 rng{0};
+  std::discrete_distribution<size_t> dist{weights.begin(), weights.end()};
+  for (int n = 0; n < FLAGS_ops; ++n) {
+    ops[n % clients].push_back(static_cast<Op>(dist(rng)));
+  }
+  return ops;
+}
+
+double toMicros(Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(
+             duration)
+      .count();
+}
+
+void report(const vector<std::unique_ptr<Client>>& clients, double seconds) {
+  printf(
+      "%-8s %9s %10s %9s %9s %9s %9s %7s\n",
+      "op",
+      "count",
+      "ops/sec",
+      "p50 us",
+      "p90 us",
+      "p99 us",
+      "max us",
+      "errors");
+  size_t total = 0;
+  for (size_t n = 0; n < kNumOps; ++n) {
+    vector<Clock::duration> latencies;
+    size_t errors = 0;
+    for (const auto& client : clients) {
+      const auto& results = client->getResults(static_cast<Op>(n));
+      latencies.insert(
+          latencies.end(),
+          results.latencies.begin(),
+          results.latencies.end());
+      errors += results.errors;
+    }
+    if (latencies.empty()) {
+      continue;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+      return toMicros(latencies[static_cast<size_t>(
+          p * static_cast<double>(latencies.size() - 1))]);
+    };
+    printf(
+        "%-8s %9zu %10.0f %9.1f %9.1f %9.1f %9.1f %7zu\n",
+        kOpNames[n].data(),
+        latencies.size(),
+        latencies.size() / seconds,
+        percentile(0.5),
+        percentile(0.9),
+        percentile(0.99),
+        toMicros(latencies.back()),
+        errors);
+    total += latencies.size();
+  }
+  printf("%-8s %9zu %10.0f\n", "total", total, total / seconds);
+}
+
+void runBenchmark() {
+  FakeTreeBuilder builder;
+  const string contents(FLAGS_file_size, 'x');
+  for (int dir = 0; dir < FLAGS_dirs; ++dir) {
+    for (int file = 0; file < FLAGS_files_per_dir; ++file) {
+      builder.setFile(
+          folly::sformat("dir{:04d}/file{:04d}", dir, file), contents);
+    }
+  }
+  TestMount testMount{builder};
+
+  // TestMount runs background work on a ManualExecutor, so keep draining it
+  // while the FUSE channel's threads queue work.
+  auto executor = testMount.getServerExecutor();
+  std::atomic<bool> done{false};
+  std::thread driver([&] {
+    while (!done) {
+      executor->wait();
+      executor->drain();
+    }
+  });
+
+  auto fuse = std::make_shared<FakeFuse>();
+  testMount.registerFakeFuse(fuse);
+  auto initFuture = testMount.getEdenMount()->startFuse();
+  fuse->sendInitRequest();
+  fuse->recvResponse();
+  std::move(initFuture).get(10s);
+
+  {
+    FuseConnection conn{fuse};
+    auto mount = resolveMount(conn);
+    auto ops = makeOps(FLAGS_clients);
+    vector<std::unique_ptr<Client>> clients;
+    for (int n = 0; n < FLAGS_clients; ++n) {
+      clients.push_back(std::make_unique<Client>(conn, mount, n));
+    }
+
+    auto start = Clock::now();
+    vector<std::thread> threads;
+    for (int n = 0; n < FLAGS_clients; ++n) {
+      threads.emplace_back([&, n] { clients[n]->run(ops[n]); });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+                       Clock::now() - start)
+                       .count();
+    report(clients, seconds);
+  }
+
+  auto completionFuture = testMount.getEdenMount()->getFuseCompletionFuture();
+  fuse->close();
+  std::move(completionFuture).get(10s);
+
+  done = true;
+  executor->add([] {});
+  driver.join();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  runBenchmark();
+  return 0;
+}
@@ -0,0 +1,760 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/Optional.h>
+#include <folly/String.h>
+#include <folly/Synchronized.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/ManualExecutor.h>
+#include <folly/init/Init.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <climits>
+#include <dirent.h>
+#include <fcntl.h>
+#include <map>
+#include <set>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "eden/fs/fuse/FuseTrace.h"
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/testharness/FakeFuse.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+
+using namespace facebook::eden;
+using namespace std::chrono_literals;
+using folly::ByteRange;
+using folly::StringPiece;
+using std::string;
+using std::vector;
+using Clock = std::chrono::steady_clock;
+
+DEFINE_string(trace, "", "FUSE trace recorded with startRecordingFuseTrace");
+DEFINE_double(
+    speed,
+    1.0,
+    "How many times faster than recorded to send the requests, or 0 to send "
+    "them as fast as possible");
+DEFINE_int64(
+    max_file_size,
+    1024 * 1024,
+    "Largest file to create when rebuilding the traced tree");
+DEFINE_string(
+    mount_path,
+    "",
+    "Replay with system calls against this directory, for example a real "
+    "eden mount, rather than against a TestMount over FakeFuse.  The traced "
+    "tree is created in it unless --create_tree=false.");
+DEFINE_bool(
+    create_tree,
+    true,
+    "Create the traced tree under --mount_path before replaying");
+DEFINE_int32(
+    threads,
+    8,
+    "Threads issuing system calls when replaying against --mount_path");
+
+namespace {
+
+/**
+ * The part of the traced mount that the trace used, rebuilt from its
+ * lookups: each inode is named by the anonymized name it was looked up by.
+ */
+class TraceTree {
+ public:
+  explicit TraceTree(const vector<FuseTraceRecord>& records) {
+    std::unordered_map<uint64_t, std::pair<uint64_t, uint32_t>> lookups;
+    for (const auto& record : records) {
+      if (record.kind == FuseTraceRecord::REQUEST) {
+        switch (record.opcode) {
+          case FUSE_LOOKUP:
+            lookups[record.unique] = {record.nodeid, record.nameId};
+            unknownDirs_.insert(record.nodeid);
+            break;
+          case FUSE_OPENDIR:
+          case FUSE_READDIR:
+          case FUSE_READDIRPLUS:
+            unknownDirs_.insert(record.nodeid);
+            break;
+        }
+        continue;
+      }
+      auto it = lookups.find(record.unique);
+      if (it == lookups.end()) {
+        continue;
+      }
+      nodes_[record.nodeid] =
+          Node{it->second.first, it->second.second, record.mode, record.offset};
+      lookups.erase(it);
+    }
+    // What remains are directories that the kernel already knew when the
+    // recording started.
+    unknownDirs_.erase(FUSE_ROOT_ID);
+    for (const auto& node : nodes_) {
+      unknownDirs_.erase(node.first);
+    }
+  }
+
+  /**
+   * Returns the path of the given traced inode, or none if the trace never
+   * named it.  Directories that the trace used without looking them up are
+   * placed at the root.
+   */
+  folly::Optional<string> getPath(uint64_t nodeid) const {
+    vector<string> components;
+    // Inode numbers that the kernel reused within the trace can form cycles.
+    for (size_t depth = 0; depth < 256; ++depth) {
+      if (nodeid == FUSE_ROOT_ID) {
+        std::reverse(components.begin(), components.end());
+        return folly::join('/', components);
+      }
+      auto it = nodes_.find(nodeid);
+      if (it == nodes_.end()) {
+        if (unknownDirs_.count(nodeid) == 0) {
+          return folly::none;
+        }
+        components.push_back(folly::to<string>("p", nodeid));
+        nodeid = FUSE_ROOT_ID;
+        continue;
+      }
+      components.push_back(getName(it->second.nameId));
+      nodeid = it->second.parent;
+    }
+    return folly::none;
+  }
+
+  static string getName(uint32_t nameId) {
+    return folly::to<string>("n", nameId);
+  }
+
+  /**
+   * Calls fileFn(path, size) for each regular file, symlinkFn(path) for each
+   * symlink, and dirFn(path) for each empty directory.  An inode that was
+   * recorded as a file but has children elsewhere in the trace is treated as
+   * a directory.
+   */
+  template <typename FileFn, typename SymlinkFn, typename DirFn>
+  void forEachEntry(FileFn&& fileFn, SymlinkFn&& symlinkFn, DirFn&& dirFn)
+      const {
+    std::map<string, const Node*> entries;
+    std::set<string> dirs;
+    std::set<string> nonEmpty;
+    auto addParents = [&](const string& path) {
+      auto slash = path.rfind('/');
+      while (slash != string::npos) {
+        auto parent = path.substr(0, slash);
+        nonEmpty.insert(parent);
+        dirs.insert(parent);
+        slash = parent.rfind('/');
+      }
+    };
+    for (const auto& node : nodes_) {
+      auto path = getPath(node.first);
+      if (path) {
+        entries[*path] = &node.second;
+        addParents(*path);
+      }
+    }
+    for (auto nodeid : unknownDirs_) {
+      dirs.insert(*getPath(nodeid));
+    }
+    for (const auto& entry : entries) {
+      if (S_ISDIR(entry.second->mode)) {
+        dirs.insert(entry.first);
+      } else if (dirs.count(entry.first) == 0) {
+        if (S_ISLNK(entry.second->mode)) {
+          symlinkFn(entry.first);
+        } else {
+          fileFn(entry.first, entry.second->size);
+        }
+      }
+    }
+    for (const auto& dir : dirs) {
+      if (nonEmpty.count(dir) == 0) {
+        dirFn(dir);
+      }
+    }
+  }
+
+ private:
+  struct Node {
+    uint64_t parent;
+    uint32_t nameId;
+    uint32_t mode;
+    uint64_t size;
+  };
+
+  std::unordered_map<uint64_t, Node> nodes_;
+  std::set<uint64_t> unknownDirs_;
+};
+
+bool isReplayed(const FuseTraceRecord& record) {
+  if (record.kind != FuseTraceRecord::REQUEST) {
+    return false;
+  }
+  switch (record.opcode) {
+    case FUSE_LOOKUP:
+    case FUSE_GETATTR:
+    case FUSE_READ:
+    case FUSE_READDIR:
+    case FUSE_READDIRPLUS:
+    case FUSE_READLINK:
+    case FUSE_OPEN:
+    case FUSE_OPENDIR:
+      return true;
+  }
+  return false;
+}
+
+struct OpStats {
+  vector<Clock::duration> latencies;
+  size_t errors{0};
+};
+
+/**
+ * Latencies and errors by opcode, plus the requests that were not replayed.
+ */
+class ReplayResults {
+ public:
+  void record(uint32_t opcode, Clock::duration latency, bool error) {
+    auto stats = stats_.wlock();
+    auto& op = (*stats)[opcode];
+    op.latencies.push_back(latency);
+    if (error) {
+      ++op.errors;
+    }
+  }
+
+  void skip(uint32_t opcode) {
+    ++(*skipped_.wlock())[opcode];
+  }
+
+  void report(double seconds, double tracedSeconds) {
+    printf(
+        "%-20s %9s %9s %9s %9s %7s\n",
+        "op",
+        "count",
+        "p50 us",
+        "p99 us",
+        "max us",
+        "errors");
+    auto stats = stats_.wlock();
+    for (auto& entry : *stats) {
+      auto& latencies = entry.second.latencies;
+      std::sort(latencies.begin(), latencies.end());
+      auto percentile = [&](double p) {
+        return toMicros(latencies[static_cast<size_t>(
+            p * static_cast<double>(latencies.size() - 1))]);
+      };
+      printf(
+          "%-20s %9zu %9.1f %9.1f %9.1f %7zu\n",
+          fuseOpcodeName(entry.first).str().c_str(),
+          latencies.size(),
+          percentile(0.5),
+          percentile(0.99),
+          toMicros(latencies.back()),
+          entry.second.errors);
+    }
+    for (const auto& entry : *skipped_.rlock()) {
+      printf(
+          "%-20s %9zu skipped\n",
+          fuseOpcodeName(entry.first).str().c_str(),
+          entry.second);
+    }
+    printf(
+        "replayed in %.3f s, recorded over %.3f s\n", seconds, tracedSeconds);
+  }
+
+ private:
+  static double toMicros(Clock::duration duration) {
+    return std::chrono::duration_cast<
+               std::chrono::duration<double, std::micro>>(duration)
+        .count();
+  }
+
+  folly::Synchronized<std::map<uint32_t, OpStats>> stats_;
+  folly::Synchronized<std::map<uint32_t, size_t>> skipped_;
+};
+
+/**
+ * Calls sendFn(record) for each replayed record at the time it was recorded,
+ * scaled by --speed, whether or not earlier requests have completed, so
+ * that the replay keeps the trace's concurrency.
+ */
+template <typename SendFn>
+void sendOnSchedule(
+    const vector<FuseTraceRecord>& records,
+    ReplayResults& results,
+    SendFn&& sendFn) {
+  auto start = Clock::now();
+  auto firstNs = records.empty() ? 0 : records.front().timeNs;
+  for (const auto& record : records) {
+    if (record.kind != FuseTraceRecord::REQUEST) {
+      continue;
+    }
+    if (!isReplayed(record)) {
+      results.skip(record.opcode);
+      continue;
+    }
+    if (FLAGS_speed > 0) {
+      std::this_thread::sleep_until(
+          start +
+          std::chrono::nanoseconds{static_cast<int64_t>(
+              (record.timeNs - firstNs) / FLAGS_speed)});
+    }
+    if (!sendFn(record)) {
+      results.skip(record.opcode);
+    }
+  }
+}
+
+template <typename T>
+string makeArg(const T& fixed) {
+  return string{reinterpret_cast<const char*>(&fixed), sizeof(fixed)};
+}
+
+template <typename T>
+T parseBody(const FakeFuse::Response& response) {
+  CHECK_GE(response.body.size(), sizeof(T));
+  T value;
+  memcpy(&value, response.body.data(), sizeof(T));
+  return value;
+}
+
+/**
+ * Replays a trace over FakeFuse.  Requests are sent from one thread and
+ * their replies are received on another.
+ */
+class FakeFuseReplayer {
+ public:
+  FakeFuseReplayer(
+      std::shared_ptr<FakeFuse> fuse,
+      const TraceTree& tree,
+      ReplayResults& results)
+      : fuse_{std::move(fuse)}, tree_{tree}, results_{results} {}
+
+  /**
+   * Find the replay inodes and handles for the requests in the trace,
+   * before any replies are being received in the background.
+   */
+  void resolve(const vector<FuseTraceRecord>& records) {
+    for (const auto& record : records) {
+      if (!isReplayed(record)) {
+        continue;
+      }
+      auto nodeid = resolveNode(record.nodeid);
+      if (!nodeid) {
+        continue;
+      }
+      if (record.opcode == FUSE_READ) {
+        resolveHandle(record.nodeid, *nodeid, FUSE_OPEN, O_RDONLY);
+      } else if (
+          record.opcode == FUSE_READDIR || record.opcode == FUSE_READDIRPLUS) {
+        resolveHandle(
+            record.nodeid, *nodeid, FUSE_OPENDIR, O_RDONLY | O_DIRECTORY);
+      }
+    }
+  }
+
+  void replay(const vector<FuseTraceRecord>& records) {
+    std::thread receiver([this] { receiveLoop(); });
+    sendOnSchedule(records, results_, [this](const FuseTraceRecord& record) {
+      return send(record);
+    });
+
+    // Wait for the outstanding replies.
+    auto deadline = Clock::now() + 60s;
+    while (Clock::now() < deadline) {
+      auto pending = pending_.rlock();
+      if (pending->size() == 0 && received_ == sent_) {
+        break;
+      }
+      pending.unlock();
+      std::this_thread::sleep_for(1ms);
+    }
+    stopping_ = true;
+    receiver.join();
+  }
+
+ private:
+  struct Pending {
+    uint32_t opcode{0};
+    Clock::time_point sent;
+    folly::Optional<Clock::time_point> received;
+    int32_t error{0};
+  };
+
+  FakeFuse::Response call(uint32_t opcode, uint64_t nodeid, StringPiece arg) {
+    fuse_->sendRequest(opcode, nodeid, ByteRange{arg});
+    return fuse_->recvResponse();
+  }
+
+  folly::Optional<uint64_t> resolveNode(uint64_t tracedNodeid) {
+    auto found = nodeids_.find(tracedNodeid);
+    if (found != nodeids_.end()) {
+      return found->second;
+    }
+    auto path = tree_.getPath(tracedNodeid);
+    if (!path) {
+      return folly::none;
+    }
+    uint64_t nodeid = FUSE_ROOT_ID;
+    vector<StringPiece> components;
+    folly::split('/', *path, components, /* ignoreEmpty */ true);
+    for (auto component : components) {
+      auto response =
+          call(FUSE_LOOKUP, nodeid, component.str() + string(1, '\0'));
+      if (response.header.error != 0) {
+        return folly::none;
+      }
+      nodeid = parseBody<fuse_entry_out>(response).nodeid;
+    }
+    nodeids_[tracedNodeid] = nodeid;
+    return nodeid;
+  }
+
+  void resolveHandle(
+      uint64_t tracedNodeid,
+      uint64_t nodeid,
+      uint32_t opcode,
+      uint32_t flags) {
+    if (handles_.count(tracedNodeid) != 0) {
+      return;
+    }
+    fuse_open_in arg = {};
+    arg.flags = flags;
+    auto response = call(opcode, nodeid, makeArg(arg));
+    if (response.header.error == 0) {
+      handles_[tracedNodeid] = parseBody<fuse_open_out>(response).fh;
+    }
+  }
+
+  bool send(const FuseTraceRecord& record) {
+    auto node = nodeids_.find(record.nodeid);
+    if (node == nodeids_.end()) {
+      return false;
+    }
+    string arg;
+    switch (record.opcode) {
+      case FUSE_LOOKUP:
+        arg = TraceTree::getName(record.nameId) + string(1, '\0');
+        break;
+      case FUSE_GETATTR:
+        arg = makeArg(fuse_getattr_in{});
+        break;
+      case FUSE_READ:
+      case FUSE_READDIR:
+      case FUSE_READDIRPLUS: {
+        auto handle = handles_.find(record.nodeid);
+        if (handle == handles_.end()) {
+          return false;
+        }
+        fuse_read_in read = {};
+        read.fh = handle->second;
+        read.offset = record.offset;
+        read.size = record.size;
+        arg = makeArg(read);
+        break;
+      }
+      case FUSE_OPEN:
+      case FUSE_OPENDIR: {
+        fuse_open_in open = {};
+        open.flags = record.opcode == FUSE_OPEN ? O_RDONLY
+                                                : O_RDONLY | O_DIRECTORY;
+        arg = makeArg(open);
+        break;
+      }
+    }
+
+    auto sent = Clock::now();
+    auto unique =
+        fuse_->sendRequest(record.opcode, node->second, ByteRange{arg});
+    ++sent_;
+    // The reply may have been received before sendRequest() returned.
+    auto pending = pending_.wlock();
+    auto& entry = (*pending)[unique];
+    entry.opcode = record.opcode;
+    entry.sent = sent;
+    if (entry.received) {
+      results_.record(
+          entry.opcode, *entry.received - sent, entry.error != 0);
+      pending->erase(unique);
+    }
+    return true;
+  }
+
+  void receiveLoop() {
+    fuse_->setTimeout(100ms);
+    while (true) {
+      FakeFuse::Response response;
+      try {
+        response = fuse_->recvResponse();
+      } catch (const std::system_error& ex) {
+        if (stopping_ || ex.code().value() != EAGAIN) {
+          return;
+        }
+        continue;
+      }
+      auto received = Clock::now();
+      ++received_;
+      auto pending = pending_.wlock();
+      auto& entry = (*pending)[response.header.unique];
+      if (entry.opcode == 0) {
+        entry.received = received;
+        entry.error = response.header.error;
+        continue;
+      }
+      results_.record(
+          entry.opcode, received - entry.sent, response.header.error != 0);
+      pending->erase(response.header.unique);
+    }
+  }
+
+  std::shared_ptr<FakeFuse> fuse_;
+  const TraceTree& tree_;
+  ReplayResults& results_;
+  std::unordered_map<uint64_t, uint64_t> nodeids_;
+  std::unordered_map<uint64_t, uint64_t> handles_;
+  folly::Synchronized<std::unordered_map<uint32_t, Pending>> pending_;
+  std::atomic<size_t> sent_{0};
+  std::atomic<size_t> received_{0};
+  std::atomic<bool> stopping_{false};
+};
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::duration<double>>(
+             Clock::now() - start)
+      .count();
+}
+
+/**
+ * Returns how long the replay took, in seconds.
+ */
+double replayOnTestMount(
+    const vector<FuseTraceRecord>& records,
+    const TraceTree& tree,
+    ReplayResults& results) {
+  FakeTreeBuilder builder;
+  tree.forEachEntry(
+      [&](const string& path, uint64_t size) {
+        auto length = std::min<uint64_t>(size, FLAGS_max_file_size);
+        builder.setFile(path, string(length, 'x'));
+      },
+      [&](const string& path) { builder.setSymlink(path, "target"); },
+      [&](const string& path) { builder.setFile(path + "/placeholder", ""); });
+  TestMount testMount{builder};
+  double seconds = 0;
+
+  // TestMount runs background work on a ManualExecutor, so keep draining it
+  // while the FUSE channel's threads queue work.
+  auto executor = testMount.getServerExecutor();
+  std::atomic<bool> done{false};
+  std::thread driver([&] {
+    while (!done) {
+      executor->wait();
+      executor->drain();
+    }
+  });
+
+  auto fuse = std::make_shared<FakeFuse>();
+  testMount.registerFakeFuse(fuse);
+  auto initFuture = testMount.getEdenMount()->startFuse();
+  fuse->sendInitRequest();
+  fuse->recvResponse();
+  std::move(initFuture).get(10s);
+
+  {
+    FakeFuseReplayer replayer{fuse, tree, results};
+    replayer.resolve(records);
+    auto start = Clock::now();
+    replayer.replay(records);
+    seconds = secondsSince(start);
+  }
+
+  auto completionFuture = testMount.getEdenMount()->getFuseCompletionFuture();
+  fuse->close();
+  std::move(completionFuture).get(10s);
+
+  done = true;
+  executor->add([] {});
+  driver.join();
+  return seconds;
+}
+
+void createTree(const TraceTree& tree, StringPiece root) {
+  auto makeParents = [&](const string& path) {
+    for (auto slash = path.find('/'); slash != string::npos;
+         slash = path.find('/', slash + 1)) {
+      auto dir = folly::to<string>(root, "/", path.substr(0, slash));
+      if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        folly::throwSystemError("failed to create ", dir);
+      }
+    }
+  };
+  tree.forEachEntry(
+      [&](const string& path, uint64_t size) {
+        makeParents(path);
+        auto length = std::min<uint64_t>(size, FLAGS_max_file_size);
+        folly::writeFile(
+            string(length, 'x'), folly::to<string>(root, "/", path).c_str());
+      },
+      [&](const string& path) {
+        makeParents(path);
+        auto fullPath = folly::to<string>(root, "/", path);
+        if (symlink("target", fullPath.c_str()) != 0 && errno != EEXIST) {
+          folly::throwSystemError("failed to create ", fullPath);
+        }
+      },
+      [&](const string& path) { makeParents(path + "/placeholder"); });
+}
+
+/**
+ * Replays a trace as the system calls that would have caused its requests,
+ * from a pool of --threads threads.  Returns how long the replay took, in
+ * seconds.
+ */
+double replayOnMount(
+    const vector<FuseTraceRecord>& records,
+    const TraceTree& tree,
+    ReplayResults& results) {
+  if (FLAGS_create_tree) {
+    createTree(tree, FLAGS_mount_path);
+  }
+
+  std::unordered_map<uint64_t, string> paths;
+  std::unordered_map<uint64_t, folly::File> files;
+  for (const auto& record : records) {
+    if (!isReplayed(record)) {
+      continue;
+    }
+    auto path = paths.find(record.nodeid);
+    if (path == paths.end()) {
+      auto tracedPath = tree.getPath(record.nodeid);
+      if (!tracedPath) {
+        continue;
+      }
+      path = paths
+                 .emplace(
+                     record.nodeid,
+                     folly::to<string>(FLAGS_mount_path, "/", *tracedPath))
+                 .first;
+    }
+    if (record.opcode == FUSE_READ && files.count(record.nodeid) == 0) {
+      auto fd = open(path->second.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd >= 0) {
+        files.emplace(record.nodeid, folly::File{fd, true});
+      }
+    }
+  }
+
+  auto syscall = [&](const FuseTraceRecord& record, const string& path) {
+    struct stat st;
+    switch (record.opcode) {
+      case FUSE_LOOKUP:
+        return lstat(
+            folly::to<string>(path, "/", TraceTree::getName(record.nameId))
+                .c_str(),
+            &st);
+      case FUSE_GETATTR:
+        return lstat(path.c_str(), &st);
+      case FUSE_READ: {
+        string buffer(record.size, '\0');
+        return pread(
+                   files.at(record.nodeid).fd(),
+                   &buffer[0],
+                   buffer.size(),
+                   record.offset) < 0
+            ? -1
+            : 0;
+      }
+      case FUSE_READDIR:
+      case FUSE_READDIRPLUS:
+      case FUSE_OPENDIR: {
+        auto dir = opendir(path.c_str());
+        if (!dir) {
+          return -1;
+        }
+        if (record.opcode != FUSE_OPENDIR) {
+          while (readdir(dir)) {
+          }
+        }
+        closedir(dir);
+        return 0;
+      }
+      case FUSE_READLINK: {
+        char buffer[PATH_MAX];
+        return readlink(path.c_str(), buffer, sizeof(buffer)) < 0 ? -1 : 0;
+      }
+      case FUSE_OPEN: {
+        auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+          return -1;
+        }
+        close(fd);
+        return 0;
+      }
+    }
+    return -1;
+  };
+
+  auto start = Clock::now();
+  {
+    folly::CPUThreadPoolExecutor pool(FLAGS_threads);
+    sendOnSchedule(records, results, [&](const FuseTraceRecord& record) {
+      auto path = paths.find(record.nodeid);
+      // A single readdir system call lists the whole directory.
+      if (path == paths.end() ||
+          (record.opcode == FUSE_READ && files.count(record.nodeid) == 0) ||
+          ((record.opcode == FUSE_READDIR ||
+            record.opcode == FUSE_READDIRPLUS) &&
+           record.offset != 0)) {
+        return false;
+      }
+      auto sent = Clock::now();
+      pool.add([&, record, sent, fullPath = &path->second] {
+        auto ret = syscall(record, *fullPath);
+        results.record(record.opcode, Clock::now() - sent, ret != 0);
+      });
+      return true;
+    });
+    pool.join();
+  }
+  return secondsSince(start);
+}
+
+void runReplay() {
+  if (FLAGS_trace.empty()) {
+    throw std::invalid_argument("--trace is required");
+  }
+  auto records = readFuseTrace(FLAGS_trace);
+  TraceTree tree{records};
+  ReplayResults results;
+  auto seconds = FLAGS_mount_path.empty()
+      ? replayOnTestMount(records, tree, results)
+      : replayOnMount(records, tree, results);
+  auto tracedNs =
+      records.empty() ? 0 : records.back().timeNs - records.front().timeNs;
+  results.report(seconds, tracedNs / 1e9);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  runReplay();
+  return 0;
+}
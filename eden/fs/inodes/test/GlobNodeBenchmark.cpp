@@ -0,0 +1,171 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <folly/init/Init.h>
+#include <folly/stop_watch.h>
+#include <gflags/gflags.h>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <vector>
+
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/GlobNode.h"
+#include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+
+using namespace facebook::eden;
+using folly::StringPiece;
+using std::string;
+using std::vector;
+
+DEFINE_int32(files, 100000, "Number of files in the generated repository");
+DEFINE_int32(files_per_dir, 16, "Number of files in each directory");
+DEFINE_int32(dir_fanout, 6, "Number of subdirectories in each directory");
+DEFINE_string(
+    globs,
+    "**/*.cpp,**/*.h;src*/**/*.py;**/TARGETS;*/*/file1?.*;**/*Test*",
+    "Semicolon-separated glob requests, each a comma-separated list of "
+    "patterns evaluated together");
+DEFINE_int32(iterations, 5, "Number of warm evaluations of each request");
+
+// Count every allocation so that the results can report allocations per
+// entry alongside the time.
+namespace {
+std::atomic<size_t> allocationCount{0};
+} // namespace
+
+void* operator new(size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (auto* ptr = malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+namespace {
+
+constexpr StringPiece kSuffixes[] = {
+    ".cpp", ".h", ".py", "Test.java", ".thrift", ".md", ".js", ""};
+constexpr size_t kNumSuffixes = sizeof(kSuffixes) / sizeof(kSuffixes[0]);
+
+/**
+ * Generate file paths breadth first, mixing the extensions of a typical
+ * source tree and giving every directory a build file.
+ */
+vector<string> generatePaths(size_t count) {
+  vector<string> paths;
+  paths.reserve(count);
+  std::deque<string> dirs{""};
+  size_t dirIndex = 0;
+  while (paths.size() < count) {
+    auto dir = std::move(dirs.front());
+    dirs.pop_front();
+    paths.push_back(dir + "TARGETS");
+    for (int n = 0; n < FLAGS_files_per_dir && paths.size() < count; ++n) {
+      auto suffix = kSuffixes[(n + dirIndex) % kNumSuffixes];
+      paths.push_back(folly::to<string>(dir, "file", n, suffix));
+    }
+    for (int n = 0; n < FLAGS_dir_fanout; ++n) {
+      auto name = (n % 2 == 0) ? "src" : "lib";
+      dirs.push_back(folly::sformat("{}{}{}/", dir, name, n));
+    }
+    ++dirIndex;
+  }
+  return paths;
+}
+
+template <typename Fn>
+void measure(StringPiece name, size_t entries, size_t iterations, Fn&& fn) {
+  size_t matches = 0;
+  auto allocations = allocationCount.load();
+  folly::stop_watch<std::chrono::nanoseconds> timer;
+  for (size_t n = 0; n < iterations; ++n) {
+    matches = fn();
+  }
+  auto elapsed = timer.elapsed();
+  auto perEntry = static_cast<double>(entries * iterations);
+  printf(
+      "  %-12s %10.3f ms %8.1f ns/entry %7.3f allocs/entry %8zu matches\n",
+      name.str().c_str(),
+      elapsed.count() / 1e6 / iterations,
+      elapsed.count() / perEntry,
+      (allocationCount.load() - allocations) / perEntry,
+      matches);
+}
+
+void runBenchmark() {
+  auto paths = generatePaths(FLAGS_files);
+  FakeTreeBuilder builder;
+  for (const auto& path : paths) {
+    builder.setFile(path, path + "\n");
+  }
+  TestMount testMount{builder};
+  const auto& edenMount = testMount.getEdenMount();
+  auto* store = edenMount->getObjectStore();
+
+  vector<StringPiece> requests;
+  folly::split(';', FLAGS_globs, requests, /* ignoreEmpty */ true);
+  for (auto request : requests) {
+    vector<StringPiece> patterns;
+    folly::split(',', request, patterns, /* ignoreEmpty */ true);
+    GlobNode globRoot(/*includeDotfiles=*/true);
+    for (auto pattern : patterns) {
+      globRoot.parse(pattern);
+    }
+    printf("%s (%zu files):\n", request.str().c_str(), paths.size());
+
+    auto evaluateInodes = [&] {
+      return globRoot
+          .evaluate(
+              store,
+              RelativePathPiece(),
+              edenMount->getRootInode(),
+              /*fileBlobsToPrefetch=*/nullptr)
+          .get()
+          .size();
+    };
+    // The first evaluation loads the inodes it visits, so unload them to
+    // measure it again for each request.
+    edenMount->getRootInode()->unloadChildrenNow();
+    measure("cold inodes", paths.size(), 1, evaluateInodes);
+    measure("warm inodes", paths.size(), FLAGS_iterations, evaluateInodes);
+    measure("trees", paths.size(), FLAGS_iterations, [&] {
+      return globRoot
+          .evaluate(
+              store,
+              RelativePathPiece(),
+              edenMount->getRootTree(),
+              /*fileBlobsToPrefetch=*/nullptr)
+          .get()
+          .size();
+    });
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  runBenchmark();
+  return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/GlobNode.h"
+
+#include <folly/executors/ManualExecutor.h>
+#include <folly/futures/Future.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+
+using namespace facebook::eden;
+using std::string;
+using std::vector;
+
+class GlobNodeTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    FakeTreeBuilder builder;
+    builder.setFiles({
+        {"a.txt", "a\n"},
+        {"src/foo.c", "foo.c\n"},
+        {"src/foo.h", "foo.h\n"},
+        {"src/README.txt", "readme\n"},
+        {"src/sub/bar.c", "bar.c\n"},
+        {"tools/run.sh", "run\n"},
+    });
+    mount_.initialize(builder);
+  }
+
+  vector<string> sorted(vector<RelativePath>&& paths) {
+    vector<string> result;
+    for (auto& path : paths) {
+      result.push_back(path.stringPiece().str());
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  vector<string> evaluate(
+      const vector<string>& globs,
+      folly::Executor* executor = nullptr) {
+    GlobNode globRoot(/*includeDotfiles=*/true);
+    for (auto& glob : globs) {
+      globRoot.parse(glob);
+    }
+    auto edenMount = mount_.getEdenMount();
+    return sorted(globRoot
+                      .evaluate(
+                          edenMount->getObjectStore(),
+                          RelativePathPiece(),
+                          edenMount->getRootInode(),
+                          /*fileBlobsToPrefetch=*/nullptr,
+                          executor)
+                      .get());
+  }
+
+  vector<string> evaluateTree(const vector<string>& globs) {
+    GlobNode globRoot(/*includeDotfiles=*/true);
+    for (auto& glob : globs) {
+      globRoot.parse(glob);
+    }
+    auto edenMount = mount_.getEdenMount();
+    return sorted(globRoot
+                      .evaluate(
+                          edenMount->getObjectStore(),
+                          RelativePathPiece(),
+                          edenMount->getRootTree(),
+                          /*fileBlobsToPrefetch=*/nullptr)
+                      .get());
+  }
+
+  TestMount mount_;
+};
+
+TEST_F(GlobNodeTest, overlappingPatterns) {
+  vector<string> globs{"src/*.c", "src/*.h", "src/foo.*"};
+  vector<string> expected{
+      "src/foo.c", "src/foo.c", "src/foo.h", "src/foo.h"};
+  EXPECT_EQ(expected, evaluate(globs));
+  EXPECT_EQ(expected, evaluateTree(globs));
+}
+
+TEST_F(GlobNodeTest, leafWithChildren) {
+  // "src" is both a match in its own right and the parent of other patterns.
+  vector<string> globs{"src", "src/*.c", "src/sub"};
+  vector<string> expected{"src", "src/foo.c", "src/sub"};
+  EXPECT_EQ(expected, evaluate(globs));
+  EXPECT_EQ(expected, evaluateTree(globs));
+}
+
+TEST_F(GlobNodeTest, recursivePatterns) {
+  vector<string> globs{"**/*.c", "src/*.txt"};
+  vector<string> expected{"src/README.txt", "src/foo.c", "src/sub/bar.c"};
+  EXPECT_EQ(expected, evaluate(globs));
+  EXPECT_EQ(expected, evaluateTree(globs));
+}
+
+TEST_F(GlobNodeTest, evaluateOnExecutor) {
+  GlobNode globRoot(/*includeDotfiles=*/true);
+  globRoot.parse("src/**/*.c");
+  globRoot.parse("tools/*");
+  auto edenMount = mount_.getEdenMount();
+
+  folly::ManualExecutor executor;
+  auto future = globRoot.evaluate(
+      edenMount->getObjectStore(),
+      RelativePathPiece(),
+      edenMount->getRootInode(),
+      /*fileBlobsToPrefetch=*/nullptr,
+      &executor);
+  EXPECT_FALSE(future.isReady());
+  executor.drain();
+  ASSERT_TRUE(future.isReady());
+  EXPECT_EQ(
+      (vector<string>{"src/foo.c", "src/sub/bar.c", "tools/run.sh"}),
+      sorted(std::move(future).get()));
+}
+
+TEST_F(GlobNodeTest, evaluateStreaming) {
+  GlobNode globRoot(/*includeDotfiles=*/true);
+  globRoot.parse("**/*.c");
+  globRoot.parse("*.txt");
+  auto edenMount = mount_.getEdenMount();
+
+  vector<RelativePath> found;
+  globRoot
+      .evaluateStreaming(
+          edenMount->getObjectStore(),
+          RelativePathPiece(),
+          edenMount->getRootInode(),
+          /*fileBlobsToPrefetch=*/nullptr,
+          /*executor=*/nullptr,
+          [&found](vector<RelativePath>&& paths) {
+            found.insert(found.end(), paths.begin(), paths.end());
+            return true;
+          })
+      .get();
+  EXPECT_EQ(
+      (vector<string>{"a.txt", "src/foo.c", "src/sub/bar.c"}),
+      sorted(std::move(found)));
+}
+
+TEST_F(GlobNodeTest, evaluateStreamingStopsWhenCancelled) {
+  GlobNode globRoot(/*includeDotfiles=*/true);
+  globRoot.parse("**");
+  auto edenMount = mount_.getEdenMount();
+
+  // Stop once the root directory has been evaluated.
+  vector<RelativePath> found;
+  globRoot
+      .evaluateStreaming(
+          edenMount->getObjectStore(),
+          RelativePathPiece(),
+          edenMount->getRootInode(),
+          /*fileBlobsToPrefetch=*/nullptr,
+          /*executor=*/nullptr,
+          [&found](vector<RelativePath>&& paths) {
+            found.insert(found.end(), paths.begin(), paths.end());
+            return false;
+          })
+      .get();
+  EXPECT_EQ(
+      (vector<string>{"a.txt", "src", "tools"}), sorted(std::move(found)));
+}
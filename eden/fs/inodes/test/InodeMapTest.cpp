@@ -11,8 +11,10 @@
 
 #include <folly/Format.h>
 #include <folly/String.h>
+#include <folly/chrono/Conv.h>
 #include <folly/test/TestUtils.h>
 #include <gtest/gtest.h>
+#include <algorithm>
 
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/FileInode.h"
@@ -349,6 +351,111 @@ TEST(InodeMap, unloadedFileMetadataIsForgotten) {
   EXPECT_FALSE(mount.hasMetadata(file2ino));
 }
 
+TEST(InodeMap, batchForgetDefersUnloadingToTheBackgroundPool) {
+  FakeTreeBuilder builder;
+  builder.setFile("dir1/file.txt", "contents");
+  builder.setFile("dir2/file.txt", "contents");
+  TestMount mount{builder};
+  auto edenMount = mount.getEdenMount();
+  auto inodeMap = edenMount->getInodeMap();
+
+  auto root = edenMount->getRootInode();
+  auto dir1 = edenMount->getInode("dir1"_relpath).get().asTreePtr();
+  auto file1 = edenMount->getInode("dir1/file.txt"_relpath).get();
+  auto file1ino = file1->getNodeId();
+  auto file2 = edenMount->getInode("dir2/file.txt"_relpath).get();
+  auto file2ino = file2->getNodeId();
+
+  // Leave file2 remembered in the unloaded map, and file1 loaded but unlinked.
+  file1->incFuseRefcount();
+  file2->incFuseRefcount();
+  file2->incFuseRefcount();
+  file2.reset();
+  root->unloadChildrenNow();
+  auto unloadedCount = inodeMap->getUnloadedInodeCount();
+  dir1->unlink("file.txt"_pc).get(0ms);
+  file1.reset();
+  EXPECT_TRUE(mount.hasMetadata(file1ino));
+
+  std::vector<InodeForget> forgets{{file2ino, 1}, {file1ino, 1}, {file2ino, 1}};
+  inodeMap->decFuseRefcounts(folly::range(forgets));
+
+  // Unloaded inodes are forgotten immediately.
+  EXPECT_EQ(unloadedCount - 1, inodeMap->getUnloadedInodeCount());
+  // The unlinked inode is only unloaded once the background pool runs.
+  EXPECT_TRUE(mount.hasMetadata(file1ino));
+  mount.drainServerExecutor();
+  EXPECT_FALSE(mount.hasMetadata(file1ino));
+}
+
+TEST(InodeMap, unloadChildrenLastAccessedBeforeUnloadsTreesBottomUp) {
+  FakeTreeBuilder builder;
+  builder.setFile("dir1/sub/file.txt", "contents");
+  builder.setFile("dir2/sub/file.txt", "contents");
+  TestMount mount{builder};
+  auto edenMount = mount.getEdenMount();
+  auto* inodeMap = edenMount->getInodeMap();
+
+  auto root = edenMount->getRootInode();
+  auto dir1ino = edenMount->getInode("dir1/sub/file.txt"_relpath)
+                     .get()
+                     ->getParentRacy()
+                     ->getParentRacy()
+                     ->getNodeId();
+  auto file2 = edenMount->getInode("dir2/sub/file.txt"_relpath).get();
+  auto dir2ino = file2->getParentRacy()->getParentRacy()->getNodeId();
+
+  // Treat everything as old enough to unload.
+  auto cutoff = folly::to<timespec>(std::chrono::system_clock::now() + 1h);
+
+  // dir1 and everything under it is unreferenced, so all three inodes are
+  // unloaded.  file2 is still referenced, which keeps its parents loaded.
+  EXPECT_EQ(3, root->unloadChildrenLastAccessedBefore(cutoff));
+  EXPECT_FALSE(inodeMap->lookupLoadedInode(dir1ino));
+  EXPECT_TRUE(inodeMap->lookupLoadedInode(dir2ino));
+
+  file2.reset();
+  EXPECT_EQ(3, root->unloadChildrenLastAccessedBefore(cutoff));
+  EXPECT_FALSE(inodeMap->lookupLoadedInode(dir2ino));
+}
+
+namespace {
+bool isChildLoaded(const TreeInodePtr& tree, PathComponentPiece name) {
+  auto contents = tree->getContents().rlock();
+  auto it = contents->entries.find(name);
+  return it != contents->entries.end() && it->second.getInode();
+}
+} // namespace
+
+TEST(InodeMap, gracefulRestartWarmsLoadedDirectories) {
+  FakeTreeBuilder builder;
+  builder.setFile("dir1/sub/file.txt", "contents");
+  builder.setFile("dir2/file.txt", "contents");
+  TestMount testMount{builder};
+  testMount.getEdenMount()->getInode("dir1/sub/file.txt"_relpath).get();
+
+  testMount.remountGracefully();
+  const auto& warmState = testMount.getTakeoverWarmState();
+  const auto& directories = warmState.loadedDirectories;
+  auto dir1 = std::find(directories.begin(), directories.end(), "dir1");
+  auto sub = std::find(directories.begin(), directories.end(), "dir1/sub");
+  ASSERT_NE(directories.end(), dir1);
+  ASSERT_NE(directories.end(), sub);
+  EXPECT_LT(dir1, sub) << "parents should be listed before their children";
+  EXPECT_FALSE(warmState.blobHashes.empty());
+
+  auto edenMount = testMount.getEdenMount();
+  auto root = edenMount->getRootInode();
+  EXPECT_FALSE(isChildLoaded(root, "dir1"_pc));
+
+  auto warmFuture = edenMount->warmCaches(warmState);
+  testMount.drainServerExecutor();
+  ASSERT_TRUE(warmFuture.isReady());
+  EXPECT_TRUE(isChildLoaded(root, "dir1"_pc));
+  EXPECT_TRUE(isChildLoaded(
+      edenMount->getInode("dir1"_relpath).get().asTreePtr(), "sub"_pc));
+}
+
 struct InodePersistenceTreeTest : ::testing::Test {
   InodePersistenceTreeTest() {
     builder.setFile("dir/file1.txt", "contents1");
@@ -451,6 +558,45 @@ TEST_F(
   EXPECT_EQ(oldFile2Id, file2->getNodeId());
 }
 
+TEST_F(InodePersistenceTreeTest, unloadedInodeTableIsMovedIntoTheMapOnUse) {
+  TestMount testMount{builder};
+  auto edenMount = testMount.getEdenMount();
+
+  auto file1 = edenMount->getInode("dir/file1.txt"_relpath).get();
+  file1->incFuseRefcount();
+  auto file1Id = file1->getNodeId();
+  auto treeId = edenMount->getInode("dir"_relpath).get()->getNodeId();
+
+  edenMount.reset();
+  file1.reset();
+  testMount.remountGracefully(/*useUnloadedInodeTable=*/true);
+
+  edenMount = testMount.getEdenMount();
+  auto* inodeMap = edenMount->getInodeMap();
+  EXPECT_TRUE(inodeMap->isInodeRemembered(file1Id));
+  EXPECT_TRUE(inodeMap->isInodeRemembered(treeId));
+  auto unloadedCount = inodeMap->getUnloadedInodeCount();
+  EXPECT_LE(2, unloadedCount);
+  EXPECT_EQ(
+      "dir/file1.txt"_relpath, inodeMap->getPathForInode(file1Id).value());
+
+  // Loading the file by number has to move it and its parent out of the
+  // table, keeping the FUSE reference count handed over.
+  file1 = inodeMap->lookupInode(file1Id).get().asFilePtr();
+  EXPECT_EQ(1, file1->debugGetFuseRefcount());
+  EXPECT_EQ(unloadedCount - 2, inodeMap->getUnloadedInodeCount());
+  EXPECT_EQ(treeId, edenMount->getInode("dir"_relpath).get()->getNodeId());
+
+  // Records that moved must not be handed over twice on the next takeover.
+  edenMount.reset();
+  file1.reset();
+  testMount.remountGracefully(/*useUnloadedInodeTable=*/true);
+  edenMount = testMount.getEdenMount();
+  file1 = edenMount->getInode("dir/file1.txt"_relpath).get().asFilePtr();
+  EXPECT_EQ(file1Id, file1->getNodeId());
+  EXPECT_EQ(1, file1->debugGetFuseRefcount());
+}
+
 /**
  * clang and gcc use the inode number of a header to determine whether it's the
  * same file as one previously included and marked #pragma once.
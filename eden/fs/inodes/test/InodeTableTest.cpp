@@ -13,6 +13,10 @@
 #include <folly/experimental/TestUtil.h>
 #include <folly/test/TestUtils.h>
 #include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 using namespace facebook::eden;
 using std::chrono::system_clock;
@@ -148,6 +152,79 @@ TEST_F(
   }
 }
 
+namespace {
+InodeMetadata makeMetadata(uid_t uid, gid_t gid) {
+  InodeTimestamps timestamps;
+  timestamps.atime = EdenTimestamp{1000};
+  timestamps.mtime = EdenTimestamp{2000};
+  timestamps.ctime = EdenTimestamp{3000};
+  return InodeMetadata{S_IFREG | 04755, uid, gid, timestamps};
+}
+
+void expectSameMetadata(const InodeMetadata& a, const InodeMetadata& b) {
+  EXPECT_EQ(a.mode, b.mode);
+  EXPECT_EQ(a.uid, b.uid);
+  EXPECT_EQ(a.gid, b.gid);
+  EXPECT_EQ(a.timestamps.atime, b.timestamps.atime);
+  EXPECT_EQ(a.timestamps.mtime, b.timestamps.mtime);
+  EXPECT_EQ(a.timestamps.ctime, b.timestamps.ctime);
+}
+} // namespace
+
+TEST(PackedInodeMetadata, ownersAreOmitted) {
+  auto metadata = makeMetadata(getuid(), getgid());
+  PackedInodeMetadata packed{metadata};
+  EXPECT_EQ(0, packed.flags);
+  EXPECT_EQ(0, packed.id);
+  expectSameMetadata(metadata, packed.unpack());
+}
+
+TEST(PackedInodeMetadata, otherOwnersRoundTrip) {
+  auto uid = getuid() + 1;
+  auto gid = getgid() + 2;
+  for (auto metadata : {makeMetadata(uid, getgid()),
+                        makeMetadata(getuid(), gid),
+                        makeMetadata(uid, gid),
+                        makeMetadata(uid + 100000, uid + 100000),
+                        makeMetadata(~0u - 1, getgid())}) {
+    expectSameMetadata(metadata, PackedInodeMetadata{metadata}.unpack());
+  }
+}
+
+TEST(PackedInodeMetadata, largeDistinctIdsKeepOwnershipOverAtime) {
+  auto metadata = makeMetadata(getuid() + 100000, getgid() + 200000);
+  auto unpacked = PackedInodeMetadata{metadata}.unpack();
+  EXPECT_EQ(metadata.uid, unpacked.uid);
+  EXPECT_EQ(metadata.gid, unpacked.gid);
+  EXPECT_EQ(metadata.timestamps.mtime, unpacked.timestamps.atime);
+  EXPECT_EQ(metadata.timestamps.mtime, unpacked.timestamps.mtime);
+  EXPECT_EQ(metadata.timestamps.ctime, unpacked.timestamps.ctime);
+}
+
+TEST_F(InodeTableTest, metadata_tables_migrate_to_packed_records) {
+  auto metadata = makeMetadata(getuid(), getgid() + 1);
+  {
+    auto inodeTable = InodeTable<InodeMetadata>::open(tablePath);
+    inodeTable->set(1_ino, metadata);
+  }
+
+  {
+    auto inodeTable = InodeMetadataTable::open<InodeMetadata>(tablePath);
+    expectSameMetadata(metadata, inodeTable->getOrThrow(1_ino));
+
+    auto modified = inodeTable->modifyOrThrow(1_ino, [](auto& record) {
+      record.timestamps.atime = EdenTimestamp{5000};
+    });
+    EXPECT_EQ(EdenTimestamp{5000}, modified.timestamps.atime);
+    EXPECT_EQ(metadata.gid, inodeTable->getOrThrow(1_ino).gid);
+  }
+  {
+    auto inodeTable = InodeMetadataTable::open<InodeMetadata>(tablePath);
+    EXPECT_EQ(
+        EdenTimestamp{5000}, inodeTable->getOrThrow(1_ino).timestamps.atime);
+  }
+}
+
 TEST_F(InodeTableTest, populateIfNotSet) {
   auto inodeTable = InodeTable<Int>::open(tablePath);
   inodeTable->set(1_ino, 15);
@@ -165,6 +242,113 @@ TEST_F(InodeTableTest, setDefault) {
   EXPECT_EQ(14, inodeTable->setDefault(1_ino, 16));
 }
 
+TEST_F(InodeTableTest, freeInode_moves_last_record) {
+  auto inodeTable = InodeTable<Int>::open(tablePath);
+  inodeTable->set(1_ino, 10);
+  inodeTable->set(2_ino, 20);
+  inodeTable->set(3_ino, 30);
+
+  inodeTable->freeInode(1_ino);
+  EXPECT_FALSE(inodeTable->getOptional(1_ino));
+  EXPECT_EQ(20, inodeTable->getOrThrow(2_ino));
+  EXPECT_EQ(30, inodeTable->getOrThrow(3_ino));
+
+  inodeTable->modifyOrThrow(3_ino, [](Int& record) { record.value = 31; });
+  EXPECT_EQ(31, inodeTable->getOrThrow(3_ino));
+}
+
+TEST_F(InodeTableTest, compact_removes_records_that_are_not_live) {
+  {
+    auto inodeTable = InodeTable<Int>::open(tablePath);
+    for (uint64_t ino = 1; ino <= 10; ++ino) {
+      inodeTable->set(InodeNumber{ino}, static_cast<int>(ino * 10));
+    }
+
+    EXPECT_EQ(5, inodeTable->compact([](InodeNumber ino) {
+      return ino.get() % 2 == 0;
+    }));
+    auto stats = inodeTable->getStats();
+    EXPECT_EQ(5, stats.records);
+    EXPECT_EQ(5, stats.recordsCompacted);
+    for (uint64_t ino = 1; ino <= 10; ++ino) {
+      auto record = inodeTable->getOptional(InodeNumber{ino});
+      if (ino % 2 == 0) {
+        ASSERT_TRUE(record);
+        EXPECT_EQ(static_cast<int>(ino * 10), *record);
+      } else {
+        EXPECT_FALSE(record);
+      }
+    }
+
+    inodeTable->set(11_ino, 110);
+    EXPECT_EQ(110, inodeTable->getOrThrow(11_ino));
+  }
+
+  // The compacted table is what is persisted.
+  auto inodeTable = InodeTable<Int>::open(tablePath);
+  EXPECT_EQ(6, inodeTable->getStats().records);
+  EXPECT_FALSE(inodeTable->getOptional(3_ino));
+  EXPECT_EQ(40, inodeTable->getOrThrow(4_ino));
+  EXPECT_EQ(110, inodeTable->getOrThrow(11_ino));
+}
+
+namespace {
+struct Pair {
+  enum { VERSION = 0 };
+  uint64_t first;
+  uint64_t second;
+};
+} // namespace
+
+TEST_F(InodeTableTest, readers_never_see_partial_updates) {
+  auto inodeTable = InodeTable<Pair>::open(tablePath);
+  constexpr uint64_t kInodes = 16;
+  for (uint64_t ino = 1; ino <= kInodes; ++ino) {
+    inodeTable->set(InodeNumber{ino}, Pair{0, 0});
+  }
+
+  std::atomic<bool> done{false};
+  std::thread writer{[&] {
+    for (uint64_t n = 1; n < 20000; ++n) {
+      inodeTable->modifyOrThrow(InodeNumber{n % kInodes + 1}, [&](Pair& p) {
+        p.first = n;
+        p.second = n;
+      });
+      // Add and remove records so that others are moved and the file grows.
+      auto extra = InodeNumber{kInodes + 1 + n};
+      inodeTable->set(extra, Pair{n, n});
+      if (n % 2) {
+        inodeTable->freeInode(extra);
+      }
+    }
+    done = true;
+  }};
+
+  std::vector<std::thread> readers;
+  std::atomic<uint64_t> inconsistent{0};
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&] {
+      while (!done) {
+        for (uint64_t ino = 1; ino <= kInodes; ++ino) {
+          auto p = inodeTable->getOrThrow(InodeNumber{ino});
+          if (p.first != p.second) {
+            ++inconsistent;
+          }
+        }
+      }
+    });
+  }
+
+  writer.join();
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(0, inconsistent);
+  for (uint64_t n = 2; n < 20000; n += 2) {
+    EXPECT_EQ(n, inodeTable->getOrThrow(InodeNumber{kInodes + 1 + n}).second);
+  }
+}
+
 // TEST(INodeTable, set) {}
 // TEST(INodeTable, getOrThrow) {}
 // TEST(INodeTable, getOptional) {}
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/MountScope.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::eden;
+using namespace facebook::eden::path_literals;
+
+namespace {
+std::vector<RelativePath> makePaths(
+    std::initializer_list<folly::StringPiece> strings) {
+  std::vector<RelativePath> result;
+  for (auto path : strings) {
+    result.emplace_back(path);
+  }
+  return result;
+}
+} // namespace
+
+TEST(MountScope, unrestrictedScopeHidesNothing) {
+  MountScope scope;
+  EXPECT_FALSE(scope.isRestricted());
+  EXPECT_FALSE(scope.isOutside(""_relpath));
+  EXPECT_FALSE(scope.isOutside("a/b/c"_relpath));
+
+  MountScope root{makePaths({"", "a"})};
+  EXPECT_FALSE(root.isRestricted());
+  EXPECT_FALSE(root.isOutside("b"_relpath));
+}
+
+TEST(MountScope, includesTheirDescendantsAndAncestors) {
+  MountScope scope{makePaths({"src/lib", "docs"})};
+  EXPECT_TRUE(scope.isRestricted());
+
+  EXPECT_FALSE(scope.isOutside(""_relpath));
+  EXPECT_FALSE(scope.isOutside("src"_relpath));
+  EXPECT_FALSE(scope.isOutside("src/lib"_relpath));
+  EXPECT_FALSE(scope.isOutside("src/lib/sub/dir"_relpath));
+  EXPECT_FALSE(scope.isOutside("docs"_relpath));
+
+  EXPECT_TRUE(scope.isOutside("src/bin"_relpath));
+  EXPECT_TRUE(scope.isOutside("src/libs"_relpath));
+  EXPECT_TRUE(scope.isOutside("third-party"_relpath));
+  EXPECT_TRUE(scope.isOutside("third-party/src/lib"_relpath));
+}
+
+TEST(MountScope, widenMergesIncludes) {
+  MountScope scope{makePaths({"src/lib/a", "src/lib/b"})};
+  EXPECT_FALSE(scope.widen(makePaths({"src/lib/a/x"})));
+  EXPECT_EQ(2, scope.getIncludes().size());
+
+  EXPECT_TRUE(scope.widen(makePaths({"src/lib"})));
+  EXPECT_EQ(makePaths({"src/lib"}), scope.getIncludes());
+  EXPECT_FALSE(scope.isOutside("src/lib/c"_relpath));
+  EXPECT_TRUE(scope.isOutside("src/bin"_relpath));
+
+  EXPECT_TRUE(scope.widen(makePaths({"src/bin"})));
+  EXPECT_FALSE(scope.isOutside("src/bin"_relpath));
+  EXPECT_EQ(2, scope.getIncludes().size());
+}
+
+TEST(MountScope, widenToTheRootRemovesTheRestriction) {
+  MountScope scope{makePaths({"src"})};
+  EXPECT_TRUE(scope.widen(makePaths({"docs", ""})));
+  EXPECT_FALSE(scope.isRestricted());
+  EXPECT_TRUE(scope.getIncludes().empty());
+  EXPECT_FALSE(scope.isOutside("third-party"_relpath));
+
+  // An unrestricted scope cannot be widened any further.
+  EXPECT_FALSE(scope.widen(makePaths({"src"})));
+  EXPECT_FALSE(scope.isRestricted());
+}
@@ -7,20 +7,152 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <folly/Conv.h>
+#include <folly/String.h>
 #include <folly/init/Init.h>
 #include <folly/stop_watch.h>
 #include <gflags/gflags.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <cinttypes>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
 #include "eden/fs/inodes/DirEntry.h"
+#include "eden/fs/inodes/InodeTable.h"
 #include "eden/fs/inodes/Overlay.h"
 
 using namespace facebook::eden;
 using namespace folly::string_piece_literals;
+using folly::StringPiece;
+using std::string;
 
 DEFINE_string(overlayPath, "", "Directory where the test overlay is created");
+DEFINE_string(
+    benchmarks,
+    "treeWrites,dirs,gc,scan,metadata",
+    "Comma-separated benchmarks to run.  Each one creates its own overlay "
+    "in a subdirectory of overlayPath.");
+DEFINE_string(
+    dir_sizes,
+    "100,10000,100000",
+    "Comma-separated entry counts of the directories the dirs benchmark "
+    "saves and loads");
+DEFINE_int32(dir_iterations, 20, "Number of saves and loads of each directory");
+DEFINE_int32(
+    gc_inodes,
+    200000,
+    "Number of inodes in the tree the gc benchmark removes");
+DEFINE_int32(
+    scan_inodes,
+    1000000,
+    "Number of inodes in the overlay the scan benchmark scans on startup");
+DEFINE_int32(
+    entries_per_dir,
+    32,
+    "Number of entries in each directory of the gc and scan trees");
+DEFINE_int32(
+    materialize_every,
+    8,
+    "Give one in this many files of the gc and scan trees overlay data, or "
+    "0 for none");
+DEFINE_int32(metadata_inodes, 1000000, "Number of InodeMetadataTable records");
+DEFINE_int32(metadata_threads, 4, "Number of threads updating the table");
 
 namespace {
 
+const Hash kHash1{folly::ByteRange{"abcdabcdabcdabcdabcd"_sp}};
+const Hash kHash2{folly::ByteRange{"01234012340123401234"_sp}};
+
+/**
+ * Print one result line in the same format for every benchmark, so that
+ * runs against different overlay backends and encodings can be compared
+ * line by line.
+ */
+void report(
+    StringPiece name,
+    uint64_t count,
+    std::chrono::nanoseconds elapsed) {
+  auto seconds = std::chrono::duration<double>(elapsed).count();
+  printf(
+      "%-32s %10" PRIu64 " ops %9.3f s %10.2f us/op %12.0f ops/s\n",
+      name.str().c_str(),
+      count,
+      seconds,
+      seconds * 1e6 / std::max<uint64_t>(1, count),
+      count / seconds);
+}
+
+template <typename Fn>
+void measure(StringPiece name, uint64_t count, Fn&& fn) {
+  folly::stop_watch<> timer;
+  fn();
+  report(name, count, timer.elapsed());
+}
+
+std::unique_ptr<Overlay> openOverlay(AbsolutePathPiece path) {
+  auto overlay = std::make_unique<Overlay>(path);
+  overlay->scanForNextInodeNumber();
+  return overlay;
+}
+
+DirContents makeDir(Overlay& overlay, size_t entries) {
+  DirContents contents;
+  for (size_t n = 0; n < entries; ++n) {
+    // Zero-padded names keep the insertions in sorted order.
+    char name[32];
+    snprintf(name, sizeof(name), "entry%08zu", n);
+    contents.emplace(
+        PathComponent{StringPiece{name}},
+        S_IFREG | 0644,
+        overlay.allocateInodeNumber(),
+        kHash1);
+  }
+  return contents;
+}
+
+/**
+ * Write a tree of about `inodes` inodes below `root` into the overlay,
+ * breadth first.  Each directory has --entries_per_dir entries, a quarter
+ * of them directories, and one in --materialize_every files gets overlay
+ * data.  Returns the number of inodes written.
+ */
+uint64_t writeTree(Overlay& overlay, InodeNumber root, uint64_t inodes) {
+  InodeTimestamps timestamps;
+  uint64_t count = 1;
+  uint64_t files = 0;
+  std::deque<InodeNumber> dirs{root};
+  while (!dirs.empty()) {
+    auto dir = dirs.front();
+    dirs.pop_front();
+    DirContents contents;
+    for (int n = 0; n < FLAGS_entries_per_dir; ++n) {
+      char name[16];
+      snprintf(name, sizeof(name), "e%04d", n);
+      auto ino = overlay.allocateInodeNumber();
+      bool isDir = n % 4 == 0 && count + dirs.size() < inodes;
+      if (isDir) {
+        contents.emplace(
+            PathComponent{StringPiece{name}}, S_IFDIR | 0755, ino, kHash2);
+        dirs.push_back(ino);
+      } else if (
+          FLAGS_materialize_every > 0 &&
+          ++files % FLAGS_materialize_every == 0) {
+        overlay.createOverlayFile(ino, timestamps, "contents\n"_sp);
+        contents.emplace(PathComponent{StringPiece{name}}, S_IFREG | 0644, ino);
+      } else {
+        contents.emplace(
+            PathComponent{StringPiece{name}}, S_IFREG | 0644, ino, kHash1);
+      }
+      ++count;
+    }
+    overlay.saveOverlayDir(dir, contents, timestamps);
+  }
+  overlay.flushPendingAsync().get();
+  return count;
+}
+
 void benchmarkOverlayTreeWrites(AbsolutePathPiece overlayPath) {
   // A large mount will contain 500,000 trees. If they're all loaded, they
   // will all be written into the overlay. This benchmark simulates that
@@ -28,54 +160,146 @@ void benchmarkOverlayTreeWrites(AbsolutePathPiece overlayPath) {
   //
   // overlayPath is parameterized to measure on different filesystem types.
 
-  Overlay overlay{overlayPath};
-  overlay.scanForNextInodeNumber();
-
-  Hash hash1{folly::ByteRange{"abcdabcdabcdabcdabcd"_sp}};
-  Hash hash2{folly::ByteRange{"01234012340123401234"_sp}};
+  auto overlay = openOverlay(overlayPath);
 
   DirContents contents;
   contents.emplace(
       PathComponent{"one"},
       S_IFREG | 0644,
-      overlay.allocateInodeNumber(),
-      hash1);
+      overlay->allocateInodeNumber(),
+      kHash1);
   contents.emplace(
       PathComponent{"two"},
       S_IFDIR | 0755,
-      overlay.allocateInodeNumber(),
-      hash2);
+      overlay->allocateInodeNumber(),
+      kHash2);
   InodeTimestamps timestamps;
 
   uint64_t N = 500000;
 
-  folly::stop_watch<> timer;
-
-  for (uint64_t i = 1; i <= N; i++) {
-    auto ino = overlay.allocateInodeNumber();
-    overlay.saveOverlayDir(ino, contents, timestamps);
-  }
-
-  auto elapsed = timer.elapsed();
-
-  printf(
-      "Total elapsed time for %" SCNu64 " entries: %.2f s\n",
-      N,
-      std::chrono::duration_cast<std::chrono::duration<double>>(elapsed)
-          .count());
-
   // Normally, I prefer to use minimum, but the cost of writing into the
   // overlay increases as the overlay grows, as xfs especially updates its
   // btrees.
   //
   // That reason, plus the reason that we want a fixed N for comparable results
   // is why this benchmark doesn't use folly Benchmark.
+  measure("saveOverlayDir (2 entries)", N, [&] {
+    for (uint64_t i = 1; i <= N; i++) {
+      auto ino = overlay->allocateInodeNumber();
+      overlay->saveOverlayDir(ino, contents, timestamps);
+    }
+    overlay->flushPendingAsync().get();
+  });
+}
+
+void benchmarkLargeDirs(AbsolutePathPiece overlayPath) {
+  // Saving a directory rewrites its whole record, so a change to one entry
+  // of a large directory costs as much as saving all of it.
+  auto overlay = openOverlay(overlayPath);
+  InodeTimestamps timestamps;
+  std::vector<StringPiece> sizes;
+  folly::split(',', FLAGS_dir_sizes, sizes, /* ignoreEmpty */ true);
+  for (auto sizeStr : sizes) {
+    auto size = folly::to<size_t>(sizeStr);
+    auto contents = makeDir(*overlay, size);
+    auto ino = overlay->allocateInodeNumber();
+    auto suffix = folly::to<string>(" (", size, " entries)");
+
+    measure("saveOverlayDir" + suffix, FLAGS_dir_iterations, [&] {
+      for (int n = 0; n < FLAGS_dir_iterations; ++n) {
+        overlay->saveOverlayDir(ino, contents, timestamps);
+        overlay->flushPendingAsync().get();
+      }
+    });
+    measure("loadOverlayDir" + suffix, FLAGS_dir_iterations, [&] {
+      for (int n = 0; n < FLAGS_dir_iterations; ++n) {
+        auto loaded = overlay->loadOverlayDir(ino);
+        CHECK(loaded.hasValue());
+        CHECK_EQ(size, loaded->first.size());
+      }
+    });
+  }
+}
+
+void benchmarkGC(AbsolutePathPiece overlayPath) {
+  auto overlay = openOverlay(overlayPath);
+  auto root = overlay->allocateInodeNumber();
+  auto inodes = writeTree(*overlay, root, FLAGS_gc_inodes);
+
+  // Time until the GC threads have removed the whole tree, not just until
+  // the request was queued.
+  auto removedBefore = overlay->getGCRemovedInodeCount();
+  measure("recursivelyRemoveOverlayData", inodes, [&] {
+    overlay->recursivelyRemoveOverlayData(root);
+    overlay->flushPendingAsync().get();
+  });
   printf(
-      "Average time per call: %.2f us\n",
-      static_cast<double>(
-          std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(
-              elapsed / N)
-              .count()));
+      "  (%" PRIu64 " inodes removed by the GC threads)\n",
+      overlay->getGCRemovedInodeCount() - removedBefore);
+}
+
+void benchmarkStartupScan(AbsolutePathPiece overlayPath) {
+  uint64_t inodes;
+  {
+    auto overlay = openOverlay(overlayPath);
+    inodes = writeTree(*overlay, kRootNodeId, FLAGS_scan_inodes);
+  }
+
+  measure("open after clean shutdown", 1, [&] { openOverlay(overlayPath); });
+
+  // Remove the files that let the overlay skip the scan, as if edenfs had
+  // crashed without an inode checkpoint.
+  for (auto name : {"next-inode-number", "next-inode-checkpoint"}) {
+    auto path = overlayPath + PathComponentPiece{name};
+    unlink(path.c_str());
+  }
+  Overlay overlay{overlayPath};
+  measure("scanForNextInodeNumber", inodes, [&] {
+    overlay.scanForNextInodeNumber();
+  });
+}
+
+void benchmarkMetadataTable(AbsolutePathPiece overlayPath) {
+  auto overlay = openOverlay(overlayPath);
+  auto* table = overlay->getInodeMetadataTable();
+  std::vector<InodeNumber> inodes;
+  inodes.reserve(FLAGS_metadata_inodes);
+  for (int n = 0; n < FLAGS_metadata_inodes; ++n) {
+    inodes.push_back(overlay->allocateInodeNumber());
+  }
+
+  InodeMetadata metadata{S_IFREG | 0644, 0, 0, InodeTimestamps{}};
+  measure("InodeMetadataTable::set", inodes.size(), [&] {
+    for (auto ino : inodes) {
+      table->set(ino, metadata);
+    }
+  });
+
+  // Spread the updates over the threads as setattr() calls would be, each
+  // thread updating its own slice of the inodes.
+  auto perThread = inodes.size() / FLAGS_metadata_threads;
+  auto runThreads = [&](auto&& fn) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < FLAGS_metadata_threads; ++t) {
+      threads.emplace_back([&, t] {
+        for (size_t n = t * perThread; n < (t + 1) * perThread; ++n) {
+          fn(inodes[n]);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  };
+  auto threads = folly::to<string>(" (", FLAGS_metadata_threads, " threads)");
+  measure("modifyOrThrow" + threads, perThread * FLAGS_metadata_threads, [&] {
+    runThreads([&](InodeNumber ino) {
+      table->modifyOrThrow(ino, [](InodeMetadata& record) { ++record.uid; });
+    });
+  });
+  measure("getOptional" + threads, perThread * FLAGS_metadata_threads, [&] {
+    runThreads([&](InodeNumber ino) { CHECK(table->getOptional(ino)); });
+  });
 }
 
 } // namespace
@@ -89,7 +313,25 @@ int main(int argc, char* argv[]) {
   }
 
   auto overlayPath = normalizeBestEffort(FLAGS_overlayPath.c_str());
-  benchmarkOverlayTreeWrites(overlayPath);
+  std::vector<StringPiece> benchmarks;
+  folly::split(',', FLAGS_benchmarks, benchmarks, /* ignoreEmpty */ true);
+  for (auto name : benchmarks) {
+    auto path = overlayPath + PathComponentPiece{name};
+    if (name == "treeWrites") {
+      benchmarkOverlayTreeWrites(path);
+    } else if (name == "dirs") {
+      benchmarkLargeDirs(path);
+    } else if (name == "gc") {
+      benchmarkGC(path);
+    } else if (name == "scan") {
+      benchmarkStartupScan(path);
+    } else if (name == "metadata") {
+      benchmarkMetadataTable(path);
+    } else {
+      fprintf(stderr, "error: unknown benchmark %s\n", name.str().c_str());
+      return 1;
+    }
+  }
 
   return 0;
 }
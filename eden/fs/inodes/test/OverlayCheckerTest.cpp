@@ -0,0 +1,234 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/OverlayChecker.h"
+
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/experimental/TestUtil.h>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include "eden/fs/inodes/DirEntry.h"
+#include "eden/fs/inodes/InodeTable.h"
+#include "eden/fs/inodes/Overlay.h"
+
+using namespace folly::string_piece_literals;
+using folly::test::TemporaryDirectory;
+
+DECLARE_bool(overlay_dirs_in_sqlite);
+
+namespace facebook {
+namespace eden {
+
+namespace {
+class OverlayCheckerTest : public ::testing::TestWithParam<bool> {
+ public:
+  OverlayCheckerTest() : testDir_{"eden_overlay_checker_test_"} {
+    FLAGS_overlay_dirs_in_sqlite = GetParam();
+    overlay = std::make_unique<Overlay>(localDir());
+    overlay->scanForNextInodeNumber();
+  }
+
+  AbsolutePath localDir() const {
+    return AbsolutePath{testDir_.path().string()};
+  }
+
+  InodeNumber createFile() {
+    auto ino = overlay->allocateInodeNumber();
+    overlay->createOverlayFile(
+        ino, InodeTimestamps{}, folly::ByteRange{"contents"_sp});
+    return ino;
+  }
+
+  /**
+   * Save a root directory holding a materialized file "f" and a directory
+   * "d" that also holds a materialized file.
+   */
+  void createConsistentTree() {
+    DirContents subdir;
+    subdir.emplace("g"_pc, S_IFREG | 0644, createFile());
+    auto subdirIno = overlay->allocateInodeNumber();
+    overlay->saveOverlayDir(subdirIno, subdir, InodeTimestamps{});
+
+    DirContents root;
+    root.emplace("f"_pc, S_IFREG | 0644, createFile());
+    root.emplace("d"_pc, S_IFDIR | 0755, subdirIno);
+    overlay->saveOverlayDir(kRootNodeId, root, InodeTimestamps{});
+  }
+
+  OverlayChecker::Result check(
+      bool repair = false,
+      std::function<bool(InodeNumber)> isInodeInUse = nullptr) {
+    OverlayChecker::Options options;
+    options.repair = repair;
+    options.isInodeInUse = std::move(isInodeInUse);
+    return overlay->checkInBackground(std::move(options)).get();
+  }
+
+  gflags::FlagSaver flagSaver_;
+  TemporaryDirectory testDir_;
+  std::unique_ptr<Overlay> overlay;
+};
+} // namespace
+
+TEST_P(OverlayCheckerTest, consistentOverlayHasNoProblems) {
+  createConsistentTree();
+  auto result = check();
+  EXPECT_EQ(0, result.getProblemCount());
+  EXPECT_TRUE(result.problems.empty());
+  EXPECT_EQ(2, result.directoriesScanned);
+  // With the dir store only the file contents are per-inode files.
+  EXPECT_EQ(GetParam() ? 2 : 4, result.filesScanned);
+}
+
+TEST_P(OverlayCheckerTest, removesOrphansAndTheirMetadata) {
+  createConsistentTree();
+
+  // A directory tree whose parent no longer refers to it, as left behind by
+  // a crash while the GC threads were removing it.
+  auto orphanFile = createFile();
+  DirContents orphanContents;
+  orphanContents.emplace("x"_pc, S_IFREG | 0644, orphanFile);
+  auto orphanDir = overlay->allocateInodeNumber();
+  overlay->saveOverlayDir(orphanDir, orphanContents, InodeTimestamps{});
+  auto strayFile = createFile();
+  overlay->getInodeMetadataTable()->set(
+      strayFile, InodeMetadata{S_IFREG | 0644, 0, 0, InodeTimestamps{}});
+
+  auto result = check();
+  EXPECT_EQ(3, result.orphans);
+  EXPECT_EQ(0, result.orphansRemoved);
+  ASSERT_EQ(3, result.problems.size());
+  EXPECT_EQ(orphanFile, result.problems[0].first);
+  EXPECT_TRUE(overlay->hasOverlayData(orphanDir));
+
+  result = check(/*repair=*/true);
+  EXPECT_EQ(3, result.orphans);
+  EXPECT_EQ(3, result.orphansRemoved);
+  EXPECT_FALSE(overlay->hasOverlayData(orphanFile));
+  EXPECT_FALSE(overlay->hasOverlayData(orphanDir));
+  EXPECT_FALSE(overlay->hasOverlayData(strayFile));
+  EXPECT_FALSE(overlay->getInodeMetadataTable()->getOptional(strayFile));
+
+  EXPECT_EQ(0, check().getProblemCount());
+}
+
+TEST_P(OverlayCheckerTest, leavesInodesInUseAlone) {
+  createConsistentTree();
+  // The data of an unlinked file that is still open.
+  auto unlinked = createFile();
+
+  auto result = check(/*repair=*/true, [&](InodeNumber ino) {
+    return ino == unlinked;
+  });
+  EXPECT_EQ(0, result.orphans);
+  EXPECT_TRUE(overlay->hasOverlayData(unlinked));
+}
+
+TEST_P(OverlayCheckerTest, reportsInvalidAndMissingData) {
+  createConsistentTree();
+  auto corrupt = createFile();
+  auto missing = overlay->allocateInodeNumber();
+  DirContents root;
+  root.emplace("c"_pc, S_IFREG | 0644, corrupt);
+  root.emplace("m"_pc, S_IFREG | 0644, missing);
+  overlay->saveOverlayDir(kRootNodeId, root, InodeTimestamps{});
+
+  auto corruptPath = localDir() +
+      RelativePathPiece{
+          folly::sformat("{:02x}/{}", corrupt.get() & 0xff, corrupt.get())};
+  folly::writeFile("not an overlay header"_sp, corruptPath.c_str());
+
+  auto result = check();
+  EXPECT_EQ(1, result.badRecords);
+  EXPECT_EQ(1, result.missingData);
+  // The old tree is no longer referred to by the new root.
+  EXPECT_EQ(3, result.orphans);
+}
+
+TEST_P(OverlayCheckerTest, detectsTypeMismatches) {
+  auto file = createFile();
+  auto dir = overlay->allocateInodeNumber();
+  overlay->saveOverlayDir(dir, DirContents{}, InodeTimestamps{});
+  DirContents root;
+  // Each entry has the other's type.
+  root.emplace("f"_pc, S_IFDIR | 0755, file);
+  root.emplace("d"_pc, S_IFREG | 0644, dir);
+  overlay->saveOverlayDir(kRootNodeId, root, InodeTimestamps{});
+
+  auto result = check();
+  EXPECT_EQ(2, result.typeMismatches);
+  EXPECT_EQ(0, result.orphans);
+}
+
+TEST_P(OverlayCheckerTest, removesMetadataForUnallocatedInodes) {
+  createConsistentTree();
+  InodeNumber unallocated{1000};
+  overlay->getInodeMetadataTable()->set(
+      unallocated, InodeMetadata{S_IFREG | 0644, 0, 0, InodeTimestamps{}});
+
+  auto result = check(/*repair=*/true);
+  EXPECT_EQ(1, result.unallocatedMetadata);
+  EXPECT_EQ(1, result.metadataRemoved);
+  EXPECT_FALSE(overlay->getInodeMetadataTable()->getOptional(unallocated));
+}
+
+TEST_P(OverlayCheckerTest, removesUnreferencedMetadata) {
+  createConsistentTree();
+  auto metadata = InodeMetadata{S_IFREG | 0644, 0, 0, InodeTimestamps{}};
+  // The child of an unmaterialized tree that was forgotten: nothing refers
+  // to its number any more.
+  auto forgotten = overlay->allocateInodeNumber();
+  overlay->getInodeMetadataTable()->set(forgotten, metadata);
+  overlay->getInodeMetadataTable()->set(kRootNodeId, metadata);
+  auto loaded = overlay->allocateInodeNumber();
+  overlay->getInodeMetadataTable()->set(loaded, metadata);
+
+  // Records allocated by this process may belong to inodes not yet linked.
+  EXPECT_EQ(0, check(/*repair=*/true).unreferencedMetadata);
+  EXPECT_TRUE(overlay->getInodeMetadataTable()->getOptional(forgotten));
+
+  overlay->close();
+  overlay = std::make_unique<Overlay>(localDir());
+  overlay->scanForNextInodeNumber();
+
+  auto result = check(/*repair=*/true, [&](InodeNumber ino) {
+    return ino == loaded;
+  });
+  EXPECT_EQ(1, result.unreferencedMetadata);
+  EXPECT_EQ(1, result.metadataRemoved);
+  // Unreferenced records are expected, not problems.
+  EXPECT_EQ(0, result.getProblemCount());
+  EXPECT_FALSE(overlay->getInodeMetadataTable()->getOptional(forgotten));
+  EXPECT_TRUE(overlay->getInodeMetadataTable()->getOptional(kRootNodeId));
+  EXPECT_TRUE(overlay->getInodeMetadataTable()->getOptional(loaded));
+}
+
+TEST_P(OverlayCheckerTest, onlyOneCheckRunsAtATime) {
+  createConsistentTree();
+  auto first = overlay->checkInBackground(OverlayChecker::Options{});
+  auto second = overlay->checkInBackground(OverlayChecker::Options{});
+  // The second check fails if the first is still running.
+  auto result = std::move(first).get();
+  EXPECT_EQ(0, result.getProblemCount());
+  if (second.isReady() && second.hasException()) {
+    EXPECT_THROW(std::move(second).get(), std::runtime_error);
+  } else {
+    EXPECT_EQ(0, std::move(second).get().getProblemCount());
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(
+    OverlayCheckerTest,
+    OverlayCheckerTest,
+    ::testing::Values(false, true));
+
+} // namespace eden
+} // namespace facebook
@@ -9,11 +9,15 @@
  */
 #include "eden/fs/inodes/Overlay.h"
 
+#include <boost/filesystem.hpp>
 #include <folly/FileUtil.h>
 #include <folly/Subprocess.h>
 #include <folly/experimental/TestUtil.h>
 #include <folly/test/TestUtils.h>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
 
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/FileInode.h"
@@ -33,6 +37,12 @@ using folly::Subprocess;
 using folly::test::TemporaryDirectory;
 using std::string;
 
+DECLARE_bool(overlay_dirs_in_sqlite);
+DECLARE_int32(overlay_dir_write_delay_ms);
+DECLARE_uint64(overlay_inode_reservation);
+DECLARE_uint64(overlay_small_file_max_size);
+DECLARE_uint64(overlay_syncfs_min_files);
+
 namespace facebook {
 namespace eden {
 
@@ -267,6 +277,12 @@ class RawOverlayTest : public ::testing::TestWithParam<OverlayRestartMode> {
         if (unlink((testDir_.path() / "next-inode-number").c_str())) {
           folly::throwSystemError("removing saved inode numebr");
         }
+        // Also lose the inode checkpoint so that these tests cover the
+        // overlay scan.
+        if (unlink((testDir_.path() / "next-inode-checkpoint").c_str()) &&
+            errno != ENOENT) {
+          folly::throwSystemError("removing inode checkpoint");
+        }
         break;
     }
     overlay.reset(new Overlay{AbsolutePathPiece{testDir_.path().string()}});
@@ -335,6 +351,58 @@ TEST_P(RawOverlayTest, remembers_max_inode_number_of_file) {
   EXPECT_EQ(3_ino, overlay->scanForNextInodeNumber());
 }
 
+TEST_P(RawOverlayTest, overlay_files_can_be_replaced) {
+  auto ino2 = overlay->allocateInodeNumber();
+  overlay->createOverlayFile(
+      ino2, InodeTimestamps{}, folly::ByteRange{"first"_sp});
+  overlay->createOverlayFile(
+      ino2, InodeTimestamps{}, folly::ByteRange{"second"_sp});
+
+  InodeTimestamps timestamps;
+  auto file =
+      overlay->openFile(ino2, Overlay::kHeaderIdentifierFile, timestamps);
+  folly::checkUnixError(lseek(file.fd(), Overlay::kHeaderLength, SEEK_SET));
+  std::string contents;
+  folly::readFile(file.fd(), contents);
+  EXPECT_EQ("second", contents);
+
+  // Neither way of creating the files leaves anything behind in tmp/.
+  auto tmpDir = testDir_.path() / "tmp";
+  EXPECT_TRUE(boost::filesystem::is_empty(tmpDir));
+}
+
+TEST_P(RawOverlayTest, concurrent_syncs_all_complete) {
+  gflags::FlagSaver flagSaver;
+  for (auto minFiles : {0, 1, 4}) {
+    FLAGS_overlay_syncfs_min_files = minFiles;
+    std::vector<folly::File> files;
+    for (int n = 0; n < 8; ++n) {
+      files.push_back(overlay->createOverlayFile(
+          overlay->allocateInodeNumber(),
+          InodeTimestamps{},
+          folly::ByteRange{"contents"_sp}));
+    }
+
+    std::vector<std::thread> threads;
+    std::atomic<size_t> synced{0};
+    for (size_t n = 0; n < files.size(); ++n) {
+      threads.emplace_back([&, n] {
+        try {
+          overlay->syncFile(files[n].dup(), /*datasync=*/n % 2)
+              .get(std::chrono::seconds(10));
+          ++synced;
+        } catch (const std::exception& ex) {
+          ADD_FAILURE() << "sync failed: " << ex.what();
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    EXPECT_EQ(files.size(), synced.load());
+  }
+}
+
 TEST_P(RawOverlayTest, inode_numbers_not_reused_after_unclean_shutdown) {
   auto ino2 = overlay->allocateInodeNumber();
   EXPECT_EQ(2_ino, ino2);
@@ -395,6 +463,89 @@ TEST_P(RawOverlayTest, inode_numbers_after_takeover) {
   EXPECT_EQ(5_ino, overlay->scanForNextInodeNumber());
 }
 
+TEST_P(RawOverlayTest, gc_removes_whole_tree) {
+  // Build a tree three levels deep with a materialized file in every leaf.
+  auto makeTree = [&](auto& self, size_t depth) -> InodeNumber {
+    auto ino = overlay->allocateInodeNumber();
+    DirContents dir;
+    for (size_t n = 0; n < 3; ++n) {
+      auto name = PathComponent{folly::to<string>("child", n)};
+      if (depth == 0) {
+        auto fileIno = overlay->allocateInodeNumber();
+        overlay->createOverlayFile(
+            fileIno, InodeTimestamps{}, folly::ByteRange{"contents"_sp});
+        dir.emplace(name, S_IFREG | 0644, fileIno);
+      } else {
+        dir.emplace(name, S_IFDIR | 0755, self(self, depth - 1));
+      }
+    }
+    overlay->saveOverlayDir(ino, dir, InodeTimestamps{});
+    return ino;
+  };
+  auto top = makeTree(makeTree, 2);
+  // 1 + 3 + 9 directories and 27 files.
+  std::vector<InodeNumber> inodes;
+  for (auto n = top.get(); n < top.get() + 40; ++n) {
+    inodes.push_back(InodeNumber{n});
+    ASSERT_TRUE(overlay->hasOverlayData(InodeNumber{n}));
+  }
+
+  overlay->recursivelyRemoveOverlayData(top);
+  overlay->flushPendingAsync().get();
+
+  for (auto ino : inodes) {
+    EXPECT_FALSE(overlay->hasOverlayData(ino)) << ino;
+  }
+  EXPECT_EQ(0, overlay->getGCQueueDepth());
+  // Everything but the top directory is removed by the GC threads.
+  EXPECT_EQ(39, overlay->getGCRemovedInodeCount());
+}
+
+TEST_P(RawOverlayTest, unclean_shutdown_continues_from_inode_checkpoint) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_overlay_inode_reservation = 10;
+  recreate(OverlayRestartMode::CLEAN);
+  overlay->scanForNextInodeNumber();
+
+  // The first allocation reserves inode numbers 2 through 12.
+  EXPECT_EQ(2_ino, overlay->allocateInodeNumber());
+  auto ino3 = overlay->allocateInodeNumber();
+  overlay->createOverlayFile(
+      ino3, InodeTimestamps{}, folly::ByteRange{"contents"_sp});
+
+  // Crash, keeping only the checkpoint.
+  overlay->close();
+  overlay.reset();
+  ASSERT_EQ(0, unlink((testDir_.path() / "next-inode-number").c_str()));
+  overlay.reset(new Overlay{AbsolutePathPiece{testDir_.path().string()}});
+
+  EXPECT_TRUE(overlay->hasInitializedNextInodeNumber());
+  EXPECT_EQ(12_ino, overlay->scanForNextInodeNumber());
+  EXPECT_EQ(13_ino, overlay->allocateInodeNumber());
+  overlay->verifyNextInodeNumberInBackground();
+}
+
+TEST_P(RawOverlayTest, inode_checkpoint_covers_each_reservation) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_overlay_inode_reservation = 2;
+  recreate(OverlayRestartMode::CLEAN);
+  overlay->scanForNextInodeNumber();
+
+  // Allocating past the first reservation writes another checkpoint.
+  InodeNumber last;
+  for (int n = 0; n < 7; ++n) {
+    last = overlay->allocateInodeNumber();
+  }
+  EXPECT_EQ(8_ino, last);
+
+  overlay->close();
+  overlay.reset();
+  ASSERT_EQ(0, unlink((testDir_.path() / "next-inode-number").c_str()));
+  overlay.reset(new Overlay{AbsolutePathPiece{testDir_.path().string()}});
+
+  EXPECT_LT(last, overlay->allocateInodeNumber());
+}
+
 INSTANTIATE_TEST_CASE_P(
     Clean,
     RawOverlayTest,
@@ -405,6 +556,207 @@ INSTANTIATE_TEST_CASE_P(
     RawOverlayTest,
     ::testing::Values(OverlayRestartMode::UNCLEAN));
 
+class SqliteOverlayTest : public ::testing::Test {
+ public:
+  SqliteOverlayTest() : testDir_{"eden_sqlite_overlay_test_"} {
+    FLAGS_overlay_dirs_in_sqlite = true;
+    overlay = std::make_unique<Overlay>(localDir());
+  }
+
+  AbsolutePath localDir() const {
+    return AbsolutePath{testDir_.path().string()};
+  }
+
+  void recreate(bool clean) {
+    overlay->close();
+    overlay.reset();
+    if (!clean) {
+      auto path = localDir() + "next-inode-number"_pc;
+      if (unlink(path.c_str())) {
+        folly::throwSystemError("removing saved inode number");
+      }
+    }
+    overlay = std::make_unique<Overlay>(localDir());
+  }
+
+  gflags::FlagSaver flagSaver_;
+  folly::test::TemporaryDirectory testDir_;
+  std::unique_ptr<Overlay> overlay;
+};
+
+TEST_F(SqliteOverlayTest, dirsAreStoredInOneDatabase) {
+  auto ino2 = overlay->allocateInodeNumber();
+  auto ino3 = overlay->allocateInodeNumber();
+  auto ino4 = overlay->allocateInodeNumber();
+  overlay->createOverlayFile(
+      ino4, InodeTimestamps{}, folly::ByteRange{"contents"_sp});
+
+  DirContents subdir;
+  subdir.emplace("f"_pc, S_IFREG | 0644, ino4);
+  overlay->saveOverlayDir(ino3, subdir, InodeTimestamps{});
+  DirContents root;
+  root.emplace("e"_pc, S_IFREG | 0644, ino2);
+  root.emplace("d"_pc, S_IFDIR | 0755, ino3);
+  overlay->saveOverlayDir(kRootNodeId, root, InodeTimestamps{});
+
+  // Only the file contents were written as per-inode files.
+  auto fileExists = [this](StringPiece path) {
+    return 0 == access((localDir() + RelativePathPiece{path}).c_str(), F_OK);
+  };
+  EXPECT_TRUE(fileExists("dirs.db"));
+  EXPECT_FALSE(fileExists("01/1"));
+  EXPECT_FALSE(fileExists("03/3"));
+  EXPECT_TRUE(fileExists("04/4"));
+  EXPECT_TRUE(overlay->hasOverlayData(kRootNodeId));
+  EXPECT_TRUE(overlay->hasOverlayData(ino3));
+  EXPECT_TRUE(overlay->hasOverlayData(ino4));
+  EXPECT_FALSE(overlay->hasOverlayData(ino2));
+
+  // The overlay keeps the format it was created with.
+  FLAGS_overlay_dirs_in_sqlite = false;
+  recreate(/*clean=*/false);
+  EXPECT_EQ(ino4, overlay->scanForNextInodeNumber());
+
+  auto loaded = overlay->loadOverlayDir(kRootNodeId);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(2, loaded->first.size());
+  EXPECT_EQ(ino3, loaded->first.at("d"_pc).getInodeNumber());
+  loaded = overlay->loadOverlayDir(ino3);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(ino4, loaded->first.at("f"_pc).getInodeNumber());
+}
+
+TEST_F(SqliteOverlayTest, recursivelyRemoveOverlayData) {
+  auto ino2 = overlay->allocateInodeNumber();
+  auto ino3 = overlay->allocateInodeNumber();
+  auto ino4 = overlay->allocateInodeNumber();
+  overlay->createOverlayFile(
+      ino4, InodeTimestamps{}, folly::ByteRange{"contents"_sp});
+
+  DirContents subsubdir;
+  subsubdir.emplace("f"_pc, S_IFREG | 0644, ino4);
+  overlay->saveOverlayDir(ino3, subsubdir, InodeTimestamps{});
+  DirContents subdir;
+  subdir.emplace("d"_pc, S_IFDIR | 0755, ino3);
+  overlay->saveOverlayDir(ino2, subdir, InodeTimestamps{});
+
+  overlay->recursivelyRemoveOverlayData(ino2);
+  EXPECT_FALSE(overlay->hasOverlayData(ino2));
+  overlay->flushPendingAsync().get();
+  EXPECT_FALSE(overlay->hasOverlayData(ino3));
+  EXPECT_FALSE(overlay->hasOverlayData(ino4));
+  EXPECT_FALSE(overlay->loadOverlayDir(ino3));
+}
+
+TEST(BufferedOverlayTest, buffersDirectoryWrites) {
+  gflags::FlagSaver flagSaver;
+  // Long enough that nothing is written before the flush below.
+  FLAGS_overlay_dir_write_delay_ms = 60 * 60 * 1000;
+  TemporaryDirectory testDir{"eden_buffered_overlay_test_"};
+  AbsolutePath localDir{testDir.path().string()};
+  auto dirFileExists = [&](StringPiece path) {
+    return 0 == access((localDir + RelativePathPiece{path}).c_str(), F_OK);
+  };
+
+  auto overlay = std::make_unique<Overlay>(localDir);
+  auto ino2 = overlay->allocateInodeNumber();
+  auto ino3 = overlay->allocateInodeNumber();
+
+  DirContents subdir;
+  overlay->saveOverlayDir(ino3, subdir, InodeTimestamps{});
+  DirContents root;
+  root.emplace("d"_pc, S_IFDIR | 0755, ino3);
+  overlay->saveOverlayDir(kRootNodeId, root, InodeTimestamps{});
+  root.emplace("e"_pc, S_IFDIR | 0755, ino2);
+  overlay->saveOverlayDir(ino2, subdir, InodeTimestamps{});
+  overlay->saveOverlayDir(kRootNodeId, root, InodeTimestamps{});
+
+  // Buffered records are visible but not yet written.
+  EXPECT_FALSE(dirFileExists("01/1"));
+  EXPECT_TRUE(overlay->hasOverlayData(kRootNodeId));
+  auto loaded = overlay->loadOverlayDir(kRootNodeId);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(2, loaded->first.size());
+
+  overlay->flushPendingAsync().get();
+  EXPECT_TRUE(dirFileExists("01/1"));
+  EXPECT_TRUE(dirFileExists("02/2"));
+  EXPECT_TRUE(dirFileExists("03/3"));
+
+  // Removals are buffered too, and a buffered removal hides the record.
+  overlay->removeOverlayData(ino2);
+  EXPECT_FALSE(overlay->hasOverlayData(ino2));
+  EXPECT_FALSE(overlay->loadOverlayDir(ino2));
+  EXPECT_TRUE(dirFileExists("02/2"));
+  overlay->flushPendingAsync().get();
+  EXPECT_FALSE(dirFileExists("02/2"));
+
+  // Closing writes out anything still buffered.
+  root.erase("e"_pc);
+  overlay->saveOverlayDir(kRootNodeId, root, InodeTimestamps{});
+  overlay->close();
+  overlay.reset();
+
+  FLAGS_overlay_dir_write_delay_ms = 0;
+  overlay = std::make_unique<Overlay>(localDir);
+  loaded = overlay->loadOverlayDir(kRootNodeId);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(1, loaded->first.size());
+  EXPECT_EQ(ino3, loaded->first.at("d"_pc).getInodeNumber());
+}
+
+TEST(SmallFileOverlayTest, smallFilesArePackedUntilOpened) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_overlay_small_file_max_size = 8;
+  TemporaryDirectory testDir{"eden_small_file_overlay_test_"};
+  AbsolutePath localDir{testDir.path().string()};
+  auto fileExists = [&](StringPiece path) {
+    return 0 == access((localDir + RelativePathPiece{path}).c_str(), F_OK);
+  };
+
+  auto overlay = std::make_unique<Overlay>(localDir);
+  auto large = overlay->allocateInodeNumber();
+  auto small = overlay->allocateInodeNumber();
+  overlay->createOverlayFile(
+      small, InodeTimestamps{}, folly::ByteRange{"contents"_sp});
+  overlay->createOverlayFile(
+      large, InodeTimestamps{}, folly::ByteRange{"more contents"_sp});
+
+  EXPECT_TRUE(overlay->packSmallFile(small));
+  EXPECT_FALSE(overlay->packSmallFile(large));
+  EXPECT_TRUE(fileExists("files.db"));
+  EXPECT_TRUE(fileExists("02/2"));
+  EXPECT_FALSE(fileExists("03/3"));
+  EXPECT_TRUE(overlay->hasOverlayData(small));
+
+  // Packed files survive an unclean restart, even with packing turned off.
+  overlay->close();
+  overlay.reset();
+  ASSERT_EQ(0, unlink((localDir + "next-inode-number"_pc).c_str()));
+  auto checkpoint = localDir + "next-inode-checkpoint"_pc;
+  ASSERT_TRUE(0 == unlink(checkpoint.c_str()) || errno == ENOENT);
+  FLAGS_overlay_small_file_max_size = 0;
+  overlay = std::make_unique<Overlay>(localDir);
+  EXPECT_EQ(small, overlay->scanForNextInodeNumber());
+  EXPECT_TRUE(overlay->hasOverlayData(small));
+
+  // Opening the file unpacks it.
+  InodeTimestamps timestamps;
+  auto file =
+      overlay->openFile(small, Overlay::kHeaderIdentifierFile, timestamps);
+  std::string contents;
+  ASSERT_TRUE(folly::readFile(file.fd(), contents));
+  EXPECT_EQ("contents", contents);
+  EXPECT_TRUE(fileExists("03/3"));
+
+  FLAGS_overlay_small_file_max_size = 8;
+  file.close();
+  EXPECT_TRUE(overlay->packSmallFile(small));
+  overlay->removeOverlayData(small);
+  EXPECT_FALSE(overlay->hasOverlayData(small));
+  EXPECT_FALSE(fileExists("03/3"));
+}
+
 TEST(OverlayInodePath, defaultInodePathIsEmpty) {
   Overlay::InodePath path;
   EXPECT_STREQ(path.c_str(), "");
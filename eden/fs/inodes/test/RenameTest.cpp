@@ -11,6 +11,7 @@
 #include <folly/String.h>
 #include <folly/test/TestUtils.h>
 #include <gtest/gtest.h>
+#include <future>
 
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/FileInode.h"
@@ -140,6 +141,27 @@ TEST_F(RenameTest, renameFileOtherDirectory) {
   renameFile("a/b/c/doc.txt", "a/x/y/z/newdocs.txt", false);
 }
 
+TEST_F(RenameTest, renameFileSameDirectoryHoldsSharedRenameLock) {
+  // Renames of files within one directory only need the rename lock in
+  // shared mode, so they can proceed while someone else holds it shared.
+  // The first rename materializes the directory, which does need the
+  // exclusive lock.
+  auto cInode = mount_->getTreeInode("a/b/c");
+  auto docInode = mount_->getFileInode("a/b/c/doc.txt");
+  cInode->rename("readme.txt"_pc, cInode, "old.txt"_pc).get(0ms);
+
+  auto sharedLock = mount_->getEdenMount()->acquireSharedRenameLock();
+  auto result = std::async(std::launch::async, [&] {
+    cInode->rename("doc.txt"_pc, cInode, "readme.txt"_pc).get();
+  });
+  ASSERT_EQ(std::future_status::ready, result.wait_for(10s));
+  result.get();
+  sharedLock.unlock();
+
+  EXPECT_THROW_ERRNO(mount_->getFileInode("a/b/c/doc.txt"), ENOENT);
+  EXPECT_EQ(docInode, mount_->getFileInode("a/b/c/readme.txt"));
+}
+
 TEST_F(RenameTest, replaceFileSameDirectory) {
   renameFile("a/b/c/doc.txt", "a/b/c/readme.txt", true);
 }
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/inodes/ScmStatusCache.h"
+
+#include <folly/futures/Future.h>
+#include <gtest/gtest.h>
+
+#include "eden/fs/inodes/Differ.h"
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
+
+using namespace facebook::eden;
+using std::string;
+
+class ScmStatusCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    FakeTreeBuilder builder;
+    builder.setFiles({
+        {"a.txt", "a contents\n"},
+        {"src/b.txt", "b contents\n"},
+        {"src/c.txt", "c contents\n"},
+    });
+    mount_.initialize(builder);
+  }
+
+  /**
+   * Get the status through the cache, and check that it matches the result
+   * of a full diff.
+   */
+  std::map<string, ScmFileStatus> getStatus() {
+    auto edenMount = mount_.getEdenMount();
+    auto commitHash = edenMount->getParentCommits().parent1();
+    auto cached =
+        edenMount->getScmStatusCache()->getStatus(commitHash, false).get();
+    auto full = diffMountForStatus(edenMount.get(), commitHash, false).get();
+    EXPECT_EQ(full->entries, cached->entries);
+    return cached->entries;
+  }
+
+  size_t getIncrementalUpdateCount() {
+    return mount_.getEdenMount()
+        ->getScmStatusCache()
+        ->getIncrementalUpdateCount();
+  }
+
+  TestMount mount_;
+};
+
+TEST_F(ScmStatusCacheTest, unchangedMountUsesCachedStatus) {
+  EXPECT_EQ(0, getStatus().size());
+  EXPECT_EQ(0, getIncrementalUpdateCount());
+  EXPECT_EQ(0, getStatus().size());
+  EXPECT_EQ(1, getIncrementalUpdateCount());
+}
+
+TEST_F(ScmStatusCacheTest, trackedFileChangesAreAppliedIncrementally) {
+  EXPECT_EQ(0, getStatus().size());
+
+  mount_.overwriteFile("src/b.txt", "new contents\n");
+  auto status = getStatus();
+  EXPECT_EQ(1, getIncrementalUpdateCount());
+  ASSERT_EQ(1, status.size());
+  EXPECT_EQ(ScmFileStatus::MODIFIED, status["src/b.txt"]);
+
+  mount_.deleteFile("a.txt");
+  status = getStatus();
+  EXPECT_EQ(2, getIncrementalUpdateCount());
+  ASSERT_EQ(2, status.size());
+  EXPECT_EQ(ScmFileStatus::REMOVED, status["a.txt"]);
+  EXPECT_EQ(ScmFileStatus::MODIFIED, status["src/b.txt"]);
+
+  // Restoring the original contents makes the file clean again.
+  mount_.overwriteFile("src/b.txt", "b contents\n");
+  status = getStatus();
+  EXPECT_EQ(3, getIncrementalUpdateCount());
+  ASSERT_EQ(1, status.size());
+  EXPECT_EQ(ScmFileStatus::REMOVED, status["a.txt"]);
+}
+
+TEST_F(ScmStatusCacheTest, untrackedFilesRequireFullDiff) {
+  EXPECT_EQ(0, getStatus().size());
+
+  mount_.addFile("src/new.txt", "new\n");
+  auto status = getStatus();
+  EXPECT_EQ(0, getIncrementalUpdateCount());
+  ASSERT_EQ(1, status.size());
+  EXPECT_EQ(ScmFileStatus::ADDED, status["src/new.txt"]);
+
+  // The full diff refreshed the cache.
+  EXPECT_EQ(1, getStatus().size());
+  EXPECT_EQ(1, getIncrementalUpdateCount());
+}
+
+TEST_F(ScmStatusCacheTest, removedDirectoryRequiresFullDiff) {
+  EXPECT_EQ(0, getStatus().size());
+
+  mount_.deleteFile("src/b.txt");
+  mount_.deleteFile("src/c.txt");
+  mount_.rmdir("src");
+  auto status = getStatus();
+  EXPECT_EQ(0, getIncrementalUpdateCount());
+  ASSERT_EQ(2, status.size());
+  EXPECT_EQ(ScmFileStatus::REMOVED, status["src/b.txt"]);
+  EXPECT_EQ(ScmFileStatus::REMOVED, status["src/c.txt"]);
+}
@@ -71,3 +71,25 @@ TEST_F(SymlinkTest, makeSymlinkCollisionDir) {
   // Name already exists, so we expect this to fail
   EXPECT_THROW_ERRNO(root->symlink(PathComponentPiece{name}, target), EEXIST);
 }
+
+TEST(SymlinkTargets, committedSymlinksAreReadThroughTheObjectStore) {
+  FakeTreeBuilder builder;
+  builder.setFile("dir/target.txt", "contents\n");
+  builder.setSymlink("dir/link", "target.txt");
+  builder.setSymlink("link_to_link", "dir/link");
+  TestMount mount{builder};
+
+  auto link = mount.getFileInode("dir/link");
+  EXPECT_EQ("target.txt", link->readlink().get());
+  // Reading the target does not materialize the symlink.
+  auto hash = link->getBlobHash();
+  ASSERT_TRUE(hash.hasValue());
+  EXPECT_EQ(
+      "target.txt",
+      mount.getEdenMount()->getObjectStore()->getSymlinkTarget(*hash).get());
+
+  auto resolved = mount.getEdenMount()
+                      ->resolveSymlink(mount.getInode("link_to_link"))
+                      .get();
+  EXPECT_TRUE(mount.getInode("dir/target.txt") == resolved);
+}
@@ -9,12 +9,22 @@
  */
 #include "eden/fs/inodes/TreeInode.h"
 
+#include <folly/futures/Future.h>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
+#include <future>
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/InodeMap.h"
 #include "eden/fs/model/Tree.h"
 #include "eden/fs/model/TreeEntry.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestMount.h"
 
 using namespace facebook::eden;
 
+DECLARE_int32(bulk_load_children_max_entries);
+DECLARE_int32(sibling_blob_prefetch_count);
+
 static DirEntry makeDirEntry() {
   return DirEntry{S_IFREG | 0644, 1_ino, Hash{}};
 }
@@ -23,6 +33,10 @@ static TreeEntry makeTreeEntry(folly::StringPiece name) {
   return TreeEntry{Hash{}, name, TreeEntryType::REGULAR_FILE};
 }
 
+static Hash sha1(folly::StringPiece contents) {
+  return Hash::sha1(folly::ByteRange{contents});
+}
+
 TEST(TreeInode, findEntryDifferencesWithSameEntriesReturnsNone) {
   DirContents dir;
   dir.emplace("one"_pc, makeDirEntry());
@@ -65,3 +79,142 @@ TEST(TreeInode, findEntryDifferencesWithOneAddition) {
   EXPECT_TRUE(differences);
   EXPECT_EQ((std::vector<std::string>{"+ three"}), *differences);
 }
+
+TEST(TreeInode, getChildSha1s) {
+  FakeTreeBuilder builder;
+  builder.setFiles({
+      {"dir/a.txt", "a\n"},
+      {"dir/b.txt", "b\n"},
+      {"dir/sub/c.txt", "c\n"},
+  });
+  builder.setSymlink("dir/link", "a.txt");
+  TestMount mount{builder};
+  mount.overwriteFile("dir/b.txt", "modified b\n");
+
+  auto dir = mount.getTreeInode("dir");
+  auto loadedFiles =
+      mount.getEdenMount()->getInodeMap()->getLoadedInodeCounts().fileCount;
+  auto results = dir->getChildSha1s({"a.txt"_pc,
+                                     "b.txt"_pc,
+                                     "sub"_pc,
+                                     "link"_pc,
+                                     "missing"_pc})
+                     .get();
+  ASSERT_EQ(5, results.size());
+  EXPECT_EQ(sha1("a\n"), results[0].value());
+  EXPECT_EQ(sha1("modified b\n"), results[1].value());
+  EXPECT_TRUE(results[2].hasException());
+  EXPECT_TRUE(results[3].hasException());
+  EXPECT_TRUE(results[4].hasException());
+
+  // a.txt was answered from its blob metadata without loading an inode.
+  EXPECT_EQ(
+      loadedFiles,
+      mount.getEdenMount()->getInodeMap()->getLoadedInodeCounts().fileCount);
+}
+
+TEST(TreeInode, lookupLoadsSiblingsInBulk) {
+  FakeTreeBuilder builder;
+  builder.setFiles({
+      {"dir/a.txt", "a\n"},
+      {"dir/b.txt", "b\n"},
+      {"dir/sub/c.txt", "c\n"},
+  });
+  TestMount mount{builder};
+  auto* inodeMap = mount.getEdenMount()->getInodeMap();
+
+  auto dir = mount.getTreeInode("dir");
+  auto before = inodeMap->getLoadedInodeCounts();
+  dir->getOrLoadChild("a.txt"_pc).get();
+
+  // b.txt and sub were loaded along with a.txt.
+  auto after = inodeMap->getLoadedInodeCounts();
+  EXPECT_EQ(before.fileCount + 2, after.fileCount);
+  EXPECT_EQ(before.treeCount + 1, after.treeCount);
+  EXPECT_TRUE(dir->getContents().rlock()->childrenBulkLoaded);
+  EXPECT_TRUE(mount.getFileInode("dir/b.txt"));
+}
+
+TEST(TreeInode, loadedChildrenAreFoundUnderTheSharedLock) {
+  FakeTreeBuilder builder;
+  builder.setFiles({
+      {"dir/a.txt", "a\n"},
+      {"dir/b.txt", "b\n"},
+  });
+  TestMount mount{builder};
+  auto dir = mount.getTreeInode("dir");
+  auto a = dir->getOrLoadChild("a.txt"_pc).get();
+  // b.txt was loaded in bulk, and its first lookup clears that flag.
+  auto b = dir->getOrLoadChild("b.txt"_pc).get();
+
+  // With another reader holding the lock, lookups of loaded children still
+  // complete.
+  auto contents = dir->getContents().rlock();
+  auto lookup = std::async(std::launch::async, [&] {
+    return dir->getOrLoadChild("a.txt"_pc).get().get() == a.get() &&
+        dir->getOrLoadChild("b.txt"_pc).get().get() == b.get();
+  });
+  auto status = lookup.wait_for(std::chrono::seconds(10));
+  contents.unlock();
+  ASSERT_EQ(std::future_status::ready, status);
+  EXPECT_TRUE(lookup.get());
+}
+
+TEST(TreeInode, bulkLoadChildrenRespectsMaxEntries) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_bulk_load_children_max_entries = 1;
+
+  FakeTreeBuilder builder;
+  builder.setFiles({
+      {"dir/a.txt", "a\n"},
+      {"dir/b.txt", "b\n"},
+  });
+  TestMount mount{builder};
+  auto* inodeMap = mount.getEdenMount()->getInodeMap();
+
+  auto dir = mount.getTreeInode("dir");
+  auto before = inodeMap->getLoadedInodeCounts();
+  dir->bulkLoadChildren();
+  EXPECT_EQ(before.fileCount, inodeMap->getLoadedInodeCounts().fileCount);
+  EXPECT_FALSE(dir->getContents().rlock()->childrenBulkLoaded);
+}
+
+TEST(TreeInode, inOrderLoadsPrefetchFollowingSiblings) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_sibling_blob_prefetch_count = 2;
+
+  FakeTreeBuilder builder;
+  builder.setFiles({
+      {"dir/a.txt", "a\n"},
+      {"dir/b.txt", "b\n"},
+      {"dir/c.txt", "c\n"},
+      {"dir/d.txt", "d\n"},
+      {"dir/e.txt", "e\n"},
+      {"dir/sub/f.txt", "f\n"},
+  });
+  TestMount mount{builder};
+  auto dir = mount.getTreeInode("dir");
+  auto isPrefetched = [&](folly::StringPiece name) {
+    auto contents = dir->getContents().rlock();
+    return contents->entries.find(PathComponentPiece{name})
+        ->second.isBlobPrefetched();
+  };
+
+  // A single load is not a pattern yet.
+  EXPECT_EQ("b\n", mount.readFile("dir/b.txt"));
+  EXPECT_FALSE(isPrefetched("c.txt"));
+
+  // Loading a file after the previous one prefetches the next two files.
+  EXPECT_EQ("c\n", mount.readFile("dir/c.txt"));
+  EXPECT_TRUE(isPrefetched("d.txt"));
+  EXPECT_TRUE(isPrefetched("e.txt"));
+
+  // Loading a prefetched file clears its flag.
+  EXPECT_EQ("d\n", mount.readFile("dir/d.txt"));
+  EXPECT_FALSE(isPrefetched("d.txt"));
+  EXPECT_TRUE(isPrefetched("e.txt"));
+
+  // Going backwards does not prefetch anything.
+  EXPECT_EQ("a\n", mount.readFile("dir/a.txt"));
+  EXPECT_FALSE(isPrefetched("b.txt"));
+}
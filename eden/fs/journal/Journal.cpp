@@ -9,30 +9,87 @@
  */
 #include "Journal.h"
 
+#include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <shared_mutex>
+
+DEFINE_uint64(
+    journal_memory_limit,
+    1024 * 1024 * 1024,
+    "The estimated number of bytes each mount's journal may use before its "
+    "oldest entries are dropped.  0 means no limit.");
+DEFINE_bool(
+    journal_coalesce_modifications,
+    true,
+    "Merge a journal entry that modifies the same files as the previous entry "
+    "into it, rather than adding a new entry");
+
 namespace facebook {
 namespace eden {
 
+constexpr Journal::SequenceNumber Journal::kMinCheckpointSpan;
+constexpr Journal::SequenceNumber Journal::kMaxCheckpointSpan;
+
+Journal::Journal() : pathTable_{std::make_shared<JournalPathTable>()} {}
+
 void Journal::addDelta(std::unique_ptr<JournalDelta>&& delta) {
+  auto memoryLimit = FLAGS_journal_memory_limit;
+  delta->compact(pathTable_);
+  auto deltaMemoryUsage = delta->estimateMemoryUsage();
+  bool needTruncate = false;
+  JournalDeltaPtr latest;
+  JournalDeltaPtr replaced;
   {
+    // Replacing the tip must not race with truncate() unlinking the deltas
+    // behind it.  Rather than wait for a truncation, just append as usual.
+    std::shared_lock<folly::SharedMutex> truncationLock;
+    if (FLAGS_journal_coalesce_modifications && isModificationOnly(*delta)) {
+      truncationLock = std::shared_lock<folly::SharedMutex>(
+          truncationMutex_, std::try_to_lock);
+    }
     auto deltaState = deltaState_.wlock();
 
     delta->toSequence = deltaState->nextSequence++;
-    delta->fromSequence = delta->toSequence;
-
     delta->toTime = std::chrono::steady_clock::now();
-    delta->fromTime = delta->toTime;
 
-    delta->previous = deltaState->latest;
+    auto& tip = deltaState->latest;
+    if (truncationLock.owns_lock() && tip && canCoalesce(*tip, *delta)) {
+      delta->fromSequence = tip->fromSequence;
+      delta->fromTime = tip->fromTime;
+      delta->fromHash = tip->fromHash;
+      delta->toHash = tip->toHash;
+      delta->previous = tip->previous;
+      deltaState->memoryUsage -= tip->estimateMemoryUsage();
+      // Release the old tip once the lock is dropped.
+      replaced = std::move(tip);
+    } else {
+      delta->fromSequence = delta->toSequence;
+      delta->fromTime = delta->toTime;
+      delta->previous = tip;
 
-    // If the hashes were not set to anything, default to copying
-    // the value from the prior journal entry
-    if (delta->previous && delta->fromHash == kZeroHash &&
-        delta->toHash == kZeroHash) {
-      delta->fromHash = delta->previous->toHash;
-      delta->toHash = delta->fromHash;
+      // If the hashes were not set to anything, default to copying
+      // the value from the prior journal entry
+      if (delta->previous && delta->fromHash == kZeroHash &&
+          delta->toHash == kZeroHash) {
+        delta->fromHash = delta->previous->toHash;
+        delta->toHash = delta->fromHash;
+      }
+      ++deltaState->entryCount;
     }
 
     deltaState->latest = JournalDeltaPtr{std::move(delta)};
+    latest = deltaState->latest;
+    deltaState->memoryUsage += deltaMemoryUsage;
+    needTruncate = memoryLimit != 0 &&
+        deltaState->memoryUsage + pathTable_->estimateMemoryUsage() >
+            memoryLimit;
+  }
+
+  buildCheckpoint(latest);
+  if (needTruncate) {
+    truncate(memoryLimit);
   }
 
   // Careful to call the subscribers with no locks held.
@@ -47,10 +104,296 @@ JournalDeltaPtr Journal::getLatest() const {
 }
 
 void Journal::replaceJournal(std::unique_ptr<JournalDelta>&& delta) {
+  std::unique_lock<folly::SharedMutex> truncationLock(truncationMutex_);
   auto deltaState = deltaState_.wlock();
+  deltaState->memoryUsage = 0;
+  deltaState->entryCount = 0;
+  for (auto* current = delta.get(); current;
+       current = current->previous.get()) {
+    if (!current->isCompact()) {
+      // Nothing else can be reading these deltas yet, even if they are
+      // shared with the chain being replaced: that chain is compact already.
+      const_cast<JournalDelta*>(current)->compact(pathTable_);
+    }
+    deltaState->memoryUsage += current->estimateMemoryUsage();
+    ++deltaState->entryCount;
+  }
   deltaState->latest = JournalDeltaPtr{std::move(delta)};
 }
 
+void Journal::restore(std::vector<std::unique_ptr<JournalDelta>>&& deltas) {
+  if (deltas.empty()) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  auto truncatedThrough = deltas.front()->fromSequence - 1;
+  for (auto& delta : deltas) {
+    delta->fromTime = now;
+    delta->toTime = now;
+    delta->compact(pathTable_);
+    auto deltaMemoryUsage = delta->estimateMemoryUsage();
+
+    JournalDeltaPtr latest;
+    {
+      auto deltaState = deltaState_.wlock();
+      DCHECK(!deltaState->latest ||
+             deltaState->latest->toSequence < delta->fromSequence);
+      delta->previous = deltaState->latest;
+      deltaState->nextSequence = delta->toSequence + 1;
+      deltaState->truncatedThrough = truncatedThrough;
+      deltaState->latest = JournalDeltaPtr{std::move(delta)};
+      latest = deltaState->latest;
+      deltaState->memoryUsage += deltaMemoryUsage;
+      ++deltaState->entryCount;
+    }
+    buildCheckpoint(latest);
+  }
+
+  auto memoryLimit = FLAGS_journal_memory_limit;
+  if (memoryLimit != 0 && getStats().memoryUsage > memoryLimit) {
+    truncate(memoryLimit);
+  }
+}
+
+void Journal::shrinkTo(size_t memoryLimit) {
+  auto stats = getStats();
+  if (stats.entryCount > 0 && stats.memoryUsage > memoryLimit) {
+    truncate(memoryLimit);
+  }
+}
+
+std::unique_ptr<JournalDelta> Journal::accumulateRange(
+    SequenceNumber limitSequence) const {
+  std::shared_lock<folly::SharedMutex> truncationLock(truncationMutex_);
+  JournalDeltaPtr latest;
+  SequenceNumber truncatedThrough;
+  {
+    auto deltaState = deltaState_.rlock();
+    latest = deltaState->latest;
+    truncatedThrough = deltaState->truncatedThrough;
+  }
+  if (!latest) {
+    return nullptr;
+  }
+
+  if (latest->toSequence < limitSequence) {
+    return nullptr;
+  }
+
+  std::vector<const JournalDelta*> pieces;
+  collectRange(pieces, latest.get(), limitSequence, truncatedThrough);
+  auto result = std::make_unique<JournalDelta>();
+  result->assignMerged(pieces, /*compactResult=*/false);
+  if (limitSequence <= truncatedThrough) {
+    result->isTruncated = true;
+  }
+  return result;
+}
+
+void Journal::forEachDelta(
+    SequenceNumber from,
+    SequenceNumber to,
+    folly::FunctionRef<bool(const JournalDelta&)> callback) const {
+  std::shared_lock<folly::SharedMutex> truncationLock(truncationMutex_);
+  JournalDeltaPtr latest;
+  SequenceNumber truncatedThrough;
+  {
+    auto deltaState = deltaState_.rlock();
+    latest = deltaState->latest;
+    truncatedThrough = deltaState->truncatedThrough;
+  }
+
+  const JournalDelta* current = latest.get();
+  while (current && current->toSequence >= from) {
+    if (current->fromSequence > to) {
+      // Skip whole checkpoints that are newer than the range.
+      auto* checkpoint = current->checkpoint_.load(std::memory_order_acquire);
+      if (checkpoint && checkpoint->fromSequence > to) {
+        current = skipCheckpoint(*current, *checkpoint, truncatedThrough);
+      } else {
+        current = current->previous.get();
+      }
+      continue;
+    }
+    if (!callback(*current)) {
+      break;
+    }
+    current = current->previous.get();
+  }
+}
+
+const JournalDelta* Journal::skipCheckpoint(
+    const JournalDelta& delta,
+    const JournalDelta& checkpoint,
+    SequenceNumber truncatedThrough) {
+  // beforeCheckpoint_ is a raw pointer, so it may refer to a delta that
+  // truncate() has already freed.
+  if (checkpoint.fromSequence <= truncatedThrough + 1) {
+    return nullptr;
+  }
+  return delta.beforeCheckpoint_;
+}
+
+const JournalDelta* Journal::collectRange(
+    std::vector<const JournalDelta*>& pieces,
+    const JournalDelta* current,
+    SequenceNumber limitSequence,
+    SequenceNumber truncatedThrough) {
+  while (current && current->toSequence >= limitSequence) {
+    auto* checkpoint = current->checkpoint_.load(std::memory_order_acquire);
+    if (checkpoint && checkpoint->fromSequence >= limitSequence) {
+      pieces.push_back(checkpoint);
+      current = skipCheckpoint(*current, *checkpoint, truncatedThrough);
+    } else {
+      pieces.push_back(current);
+      current = current->previous.get();
+    }
+  }
+  return current;
+}
+
+bool Journal::isModificationOnly(const JournalDelta& delta) {
+  if (!delta.compactUncleanPaths_.empty() || delta.compactChanges_.empty()) {
+    return false;
+  }
+  for (const auto& change : delta.compactChanges_) {
+    if (!change.info.existedBefore || !change.info.existedAfter) {
+      return false;
+    }
+  }
+  return delta.fromHash == delta.toHash;
+}
+
+bool Journal::canCoalesce(const JournalDelta& tip, const JournalDelta& delta) {
+  // The tip may be about to get a checkpoint, and a checkpoint sequence
+  // number has to stay the toSequence of a delta of its own.
+  if (tip.toSequence % kMinCheckpointSpan == 0 ||
+      delta.toSequence % kMinCheckpointSpan == 0) {
+    return false;
+  }
+  // New deltas leave their hashes zero, and only take on the tip's.
+  if (delta.fromHash != kZeroHash || !isModificationOnly(tip)) {
+    return false;
+  }
+  // Both are sorted by PathId.
+  return std::equal(
+      tip.compactChanges_.begin(),
+      tip.compactChanges_.end(),
+      delta.compactChanges_.begin(),
+      delta.compactChanges_.end(),
+      [](const JournalDelta::CompactChange& a,
+         const JournalDelta::CompactChange& b) { return a.path == b.path; });
+}
+
+void Journal::buildCheckpoint(const JournalDeltaPtr& delta) {
+  auto sequence = delta->toSequence;
+  if (sequence % kMinCheckpointSpan != 0) {
+    return;
+  }
+  // The largest power of two dividing the sequence number.
+  auto span = std::min(sequence & (~sequence + 1), kMaxCheckpointSpan);
+
+  std::shared_lock<folly::SharedMutex> truncationLock(truncationMutex_);
+  auto truncatedThrough = deltaState_.rlock()->truncatedThrough;
+  auto limitSequence = sequence - span + 1;
+  if (limitSequence <= truncatedThrough) {
+    return;
+  }
+
+  // The checkpoints of earlier, smaller spans make this cheap: it merges
+  // at most kMinCheckpointSpan deltas plus one checkpoint per power of two.
+  std::vector<const JournalDelta*> pieces;
+  auto* before =
+      collectRange(pieces, delta.get(), limitSequence, truncatedThrough);
+  auto checkpoint = std::make_unique<JournalDelta>();
+  checkpoint->assignMerged(pieces, /*compactResult=*/true);
+  auto usage = checkpoint->estimateMemoryUsage();
+
+  // Only the thread that added this delta builds its checkpoint, and
+  // readers do not look at beforeCheckpoint_ until they see checkpoint_.
+  auto* mutableDelta = const_cast<JournalDelta*>(delta.get());
+  mutableDelta->beforeCheckpoint_ = before;
+  mutableDelta->checkpoint_.store(
+      checkpoint.release(), std::memory_order_release);
+
+  // Account for the checkpoint while still holding truncationMutex_, so that
+  // truncate() sees a consistent total.
+  deltaState_.wlock()->memoryUsage += usage;
+}
+
+Journal::Stats Journal::getStats() const {
+  auto deltaState = deltaState_.rlock();
+  Stats stats;
+  stats.entryCount = deltaState->entryCount;
+  stats.memoryUsage =
+      deltaState->memoryUsage + pathTable_->estimateMemoryUsage();
+  stats.truncatedThrough = deltaState->truncatedThrough;
+  return stats;
+}
+
+void Journal::truncate(size_t memoryLimit) {
+  // If another thread is already truncating, or walking the chain, leave it
+  // to the next addDelta() call rather than blocking this writer.
+  std::unique_lock<folly::SharedMutex> truncationLock(
+      truncationMutex_, std::try_to_lock);
+  if (!truncationLock.owns_lock()) {
+    return;
+  }
+
+  JournalDeltaPtr latest;
+  size_t totalUsage;
+  size_t totalCount;
+  {
+    auto deltaState = deltaState_.rlock();
+    latest = deltaState->latest;
+    totalUsage = deltaState->memoryUsage;
+    totalCount = deltaState->entryCount;
+  }
+
+  // Find the oldest delta to keep.  Only truncate() modifies the chain
+  // behind the tip, so this does not need deltaState_.  Always keep the tip
+  // itself, since getLatest() callers need it.  The paths of the deltas we
+  // keep stay in the path table, so leave room for all of it.
+  auto target = memoryLimit / 4 * 3;
+  auto pathTableUsage = pathTable_->estimateMemoryUsage();
+  target = target > pathTableUsage ? target - pathTableUsage : 0;
+  auto* current = const_cast<JournalDelta*>(latest.get());
+  size_t keptUsage = current->estimateMemoryUsage();
+  size_t keptCount = 1;
+  while (current->previous) {
+    auto usage = current->previous->estimateMemoryUsage();
+    if (keptUsage + usage > target) {
+      break;
+    }
+    keptUsage += usage;
+    ++keptCount;
+    current = const_cast<JournalDelta*>(current->previous.get());
+  }
+  if (!current->previous) {
+    return;
+  }
+
+  // No one else can be walking the chain while we hold truncationMutex_,
+  // so it is safe to unlink the oldest deltas here.
+  JournalDeltaPtr dropped = std::move(current->previous);
+  current->previous = nullptr;
+  XLOG(DBG2) << "journal dropped " << (totalCount - keptCount)
+             << " deltas through sequence " << dropped->toSequence
+             << " to stay below " << memoryLimit << " bytes";
+  {
+    // Deltas added since we looked at the tip are still accounted for.
+    auto deltaState = deltaState_.wlock();
+    deltaState->truncatedThrough = dropped->toSequence;
+    deltaState->memoryUsage -= totalUsage - keptUsage;
+    deltaState->entryCount -= totalCount - keptCount;
+  }
+
+  // Free the dropped deltas without holding any locks.  The JournalDelta
+  // destructor does this iteratively, however long the chain is.
+  truncationLock.unlock();
+  dropped = nullptr;
+}
+
 uint64_t Journal::registerSubscriber(SubscriberCallback&& callback) {
   auto subscriberState = subscriberState_.wlock();
   auto id = subscriberState->nextSubscriberId++;
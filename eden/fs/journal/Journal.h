@@ -10,11 +10,15 @@
 #pragma once
 
 #include <folly/Function.h>
+#include <folly/SharedMutex.h>
 #include <folly/Synchronized.h>
 #include <cstdint>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 #include "eden/fs/journal/JournalDelta.h"
+#include "eden/fs/journal/JournalPathTable.h"
+#include "eden/fs/utils/LockProfiler.h"
 
 namespace facebook {
 namespace eden {
@@ -34,10 +38,33 @@ namespace eden {
  *
  * The Journal class is thread-safe.  Subscribers are called on the thread
  * that called addDelta.
+ *
+ * To bound its memory usage, the Journal drops its oldest deltas once their
+ * estimated size exceeds --journal_memory_limit.  Queries that need dropped
+ * deltas are told so (see JournalDelta::isTruncated), so that clients can
+ * recompute their state from scratch instead of missing changes.
+ *
+ * So that queries over long ranges stay cheap, the Journal also keeps
+ * checkpoints: deltas whose sequence number is a multiple of a power of two
+ * (at least kMinCheckpointSpan) carry the merge of that many preceding
+ * deltas.  accumulateRange() and forEachDelta() use them to skip over whole
+ * spans, so they touch O(log n) checkpoints rather than every delta in the
+ * range.
+ *
+ * Stored deltas intern their paths in a JournalPathTable shared by the whole
+ * Journal, so a path that changes over and over is stored once, and keep
+ * their changes in flat sorted arrays (see JournalDelta::compact()).  The
+ * deltas returned by accumulateRange() use the ordinary containers.
+ *
+ * Build tools rewrite the same outputs over and over, so when a delta only
+ * modifies exactly the files that the tip modified, addDelta() replaces the
+ * tip with it instead of growing the chain (see canCoalesce()).  The new tip
+ * still gets the next sequence number, and covers the tip's range too, so
+ * asking for the changes since any earlier position still reports them.
  */
 class Journal {
  public:
-  Journal() = default;
+  Journal();
 
   /// It is almost always a mistake to copy a Journal.
   Journal(const Journal&) = delete;
@@ -49,19 +76,73 @@ class Journal {
 
   /** Add a delta to the journal
    * The delta will have a new sequence number and timestamp
-   * applied. */
+   * applied.  It may be coalesced with the current tip, in which case its
+   * fromSequence and fromTime are the tip's. */
   void addDelta(std::unique_ptr<JournalDelta>&& delta);
 
   /** Get a shared, immutable reference to the tip of the journal.
-   * May return nullptr if there have been no changes */
+   * May return nullptr if there have been no changes
+   *
+   * Only the tip's own fields may be used.  Walking its previous chain can
+   * race with truncation; use accumulateRange() or forEachDelta() instead. */
   JournalDeltaPtr getLatest() const;
 
+  /**
+   * Merge every delta whose toSequence is >= limitSequence into a single
+   * delta, as JournalDelta::merge() does with pruneAfterLimit set.
+   *
+   * Returns nullptr if no deltas are that recent.  The result has
+   * isTruncated set if some of the deltas in that range were dropped.
+   */
+  std::unique_ptr<JournalDelta> accumulateRange(
+      SequenceNumber limitSequence) const;
+
+  /**
+   * Call the callback on each delta whose sequence range overlaps
+   * [from, to], from the newest to the oldest.  Iteration stops early if the
+   * callback returns false.  Deltas that were dropped are skipped silently,
+   * so callers that need the whole range should check the fromSequence of
+   * the oldest delta they were given.
+   */
+  void forEachDelta(
+      SequenceNumber from,
+      SequenceNumber to,
+      folly::FunctionRef<bool(const JournalDelta&)> callback) const;
+
+  struct Stats {
+    /// The number of deltas currently held.
+    size_t entryCount{0};
+    /// The estimated memory used by those deltas and their paths, in bytes.
+    size_t memoryUsage{0};
+    /// The newest sequence number that has been dropped, or 0 if none have.
+    SequenceNumber truncatedThrough{0};
+  };
+  Stats getStats() const;
+
+  /**
+   * Drop the oldest deltas if the journal uses more than memoryLimit bytes,
+   * as addDelta() does at --journal_memory_limit.  The latest delta is
+   * always kept.
+   */
+  void shrinkTo(size_t memoryLimit);
+
   /** Replace the journal with a new delta.
    * The new delta will typically be the result of JournalDelta::merge().
    * No sanity checking is performed inside this function; the
    * supplied delta is moved in and replaces current tip. */
   void replaceJournal(std::unique_ptr<JournalDelta>&& delta);
 
+  /**
+   * Fill an empty journal with the deltas saved by an earlier instance of
+   * it, oldest first, keeping their sequence numbers.  New deltas continue
+   * from the newest of them, and ranges reaching back before the oldest are
+   * reported as truncated.
+   *
+   * Arrival times are not meaningful across processes, so the restored
+   * deltas are all given the current time.
+   */
+  void restore(std::vector<std::unique_ptr<JournalDelta>>&& deltas);
+
   /** Register a subscriber.
    * A subscriber is just a callback that is called whenever the
    * journal has changed.
@@ -86,8 +167,90 @@ class Journal {
     SequenceNumber nextSequence{1};
     /** The most recently recorded entry */
     JournalDeltaPtr latest;
+    /** The estimated memory usage and number of the entries in the chain */
+    size_t memoryUsage{0};
+    size_t entryCount{0};
+    /** The newest sequence number that truncate() has dropped */
+    SequenceNumber truncatedThrough{0};
   };
-  folly::Synchronized<DeltaState> deltaState_;
+
+  /**
+   * Drop the oldest deltas until the journal uses at most three quarters of
+   * its memory limit, so that this happens rarely.
+   */
+  void truncate(size_t memoryLimit);
+
+  /**
+   * The smallest and largest ranges that checkpoints cover.  Checkpoints
+   * are only built for deltas whose sequence number is a multiple of
+   * kMinCheckpointSpan, and each one covers the largest power of two
+   * dividing that sequence number, up to kMaxCheckpointSpan.
+   */
+  static constexpr SequenceNumber kMinCheckpointSpan = 64;
+  static constexpr SequenceNumber kMaxCheckpointSpan = 1 << 16;
+
+  /**
+   * Build the checkpoint for `delta`, if its sequence number calls for one.
+   */
+  void buildCheckpoint(const JournalDeltaPtr& delta);
+
+  /**
+   * Returns true if `delta` only modifies files that already existed, and
+   * does not move to a new snapshot.  Only such deltas are coalesced.
+   */
+  static bool isModificationOnly(const JournalDelta& delta);
+
+  /**
+   * Returns true if the new, compacted `delta` can replace `tip`: both
+   * only modify the same set of files, and neither end of the combined
+   * range is a checkpoint sequence number, so checkpoints never have to be
+   * rebuilt.
+   */
+  static bool canCoalesce(const JournalDelta& tip, const JournalDelta& delta);
+
+  /**
+   * Collect the deltas, or checkpoints, covering every delta from `current`
+   * back to limitSequence into `pieces`, newest first, using checkpoints
+   * where they fit within the range.  Returns the first delta that was not
+   * collected.
+   *
+   * The caller must hold truncationMutex_, and pass the truncatedThrough
+   * value it read while holding it.
+   */
+  static const JournalDelta* collectRange(
+      std::vector<const JournalDelta*>& pieces,
+      const JournalDelta* current,
+      SequenceNumber limitSequence,
+      SequenceNumber truncatedThrough);
+
+  /**
+   * Returns the delta preceding `delta`'s checkpoint, or nullptr if that
+   * delta has been dropped or the checkpoint reaches back to the start of
+   * the journal.
+   */
+  static const JournalDelta* skipCheckpoint(
+      const JournalDelta& delta,
+      const JournalDelta& checkpoint,
+      SequenceNumber truncatedThrough);
+
+  /** Interns the paths of every delta in the chain. */
+  const std::shared_ptr<JournalPathTable> pathTable_;
+
+  struct DeltaStateLockName {
+    static folly::StringPiece name() {
+      return "journal";
+    }
+  };
+  folly::Synchronized<DeltaState, ProfiledSharedMutex<DeltaStateLockName>>
+      deltaState_;
+
+  /**
+   * Held in shared mode by anything that walks the delta chain without
+   * holding deltaState_, and in exclusive mode by truncate() while it
+   * unlinks the oldest deltas.  addDelta() does not need it, so walking a
+   * long chain never holds up writers.
+   */
+  mutable folly::SharedMutex truncationMutex_;
 
   struct SubscriberState {
     SubscriberId nextSubscriberId{1};
@@ -9,6 +9,9 @@
  */
 #include "JournalDelta.h"
 #include <folly/logging/xlog.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <functional>
 
 namespace facebook {
 namespace eden {
@@ -25,6 +28,22 @@ folly::StringPiece eventCharacterizationFor(const PathChangeInfo& ci) {
     return "Ghost";
   }
 }
+
+void checkChangeSequence(
+    RelativePathPiece name,
+    const PathChangeInfo& olderInfo,
+    const PathChangeInfo& newerInfo) {
+  if (newerInfo.existedBefore != olderInfo.existedAfter) {
+    auto event1 = eventCharacterizationFor(olderInfo);
+    auto event2 = eventCharacterizationFor(newerInfo);
+    XLOG(ERR) << "Journal for " << name << " holds invalid " << event1 << ", "
+              << event2 << " sequence";
+  }
+}
+
+bool pathIdLess(JournalPathTable::PathId a, JournalPathTable::PathId b) {
+  return std::less<JournalPathTable::PathId>()(a, b);
+}
 } // namespace
 
 JournalDelta::JournalDelta(RelativePathPiece fileName, JournalDelta::Created)
@@ -51,6 +70,17 @@ JournalDelta::JournalDelta(
                             {newName.copy(), PathChangeInfo{true, true}}} {}
 
 JournalDelta::~JournalDelta() {
+  delete checkpoint_.load(std::memory_order_acquire);
+
+  if (pathTable_) {
+    for (const auto& change : compactChanges_) {
+      pathTable_->release(change.path);
+    }
+    for (auto path : compactUncleanPaths_) {
+      pathTable_->release(path);
+    }
+  }
+
   // O(1) stack space destruction of the delta chain.
   JournalDeltaPtr p{std::move(previous)};
   while (p && p.unique()) {
@@ -82,32 +112,7 @@ std::unique_ptr<JournalDelta> JournalDelta::merge(
       break;
     }
 
-    // Capture the lower bound.
-    result->fromSequence = current->fromSequence;
-    result->fromTime = current->fromTime;
-    result->fromHash = current->fromHash;
-
-    // Merge the unclean status list
-    result->uncleanPaths.insert(
-        current->uncleanPaths.begin(), current->uncleanPaths.end());
-
-    for (auto& entry : current->changedFilesInOverlay) {
-      auto& name = entry.first;
-      auto& currentInfo = entry.second;
-      auto* resultInfo = folly::get_ptr(result->changedFilesInOverlay, name);
-      if (!resultInfo) {
-        result->changedFilesInOverlay.emplace(name, currentInfo);
-      } else {
-        if (resultInfo->existedBefore != currentInfo.existedAfter) {
-          auto event1 = eventCharacterizationFor(currentInfo);
-          auto event2 = eventCharacterizationFor(*resultInfo);
-          XLOG(ERR) << "Journal for " << name << " holds invalid " << event1
-                    << ", " << event2 << " sequence";
-        }
-
-        resultInfo->existedBefore = currentInfo.existedBefore;
-      }
-    }
+    result->mergeOlder(*current);
 
     // Continue the chain, but not if the caller requested that
     // we prune it out.
@@ -121,6 +126,177 @@ std::unique_ptr<JournalDelta> JournalDelta::merge(
   return result;
 }
 
+void JournalDelta::mergeOlder(const JournalDelta& older) {
+  // Capture the lower bound.
+  fromSequence = older.fromSequence;
+  fromTime = older.fromTime;
+  fromHash = older.fromHash;
+
+  // Merge the unclean status list
+  older.forEachUncleanPath(
+      [this](RelativePathPiece path) { uncleanPaths.insert(path.copy()); });
+
+  older.forEachChangedPath(
+      [this](RelativePathPiece name, const PathChangeInfo& olderInfo) {
+        auto result = changedFilesInOverlay.emplace(name.copy(), olderInfo);
+        if (!result.second) {
+          auto& resultInfo = result.first->second;
+          checkChangeSequence(name, olderInfo, resultInfo);
+          resultInfo.existedBefore = olderInfo.existedBefore;
+        }
+      });
+}
+
+void JournalDelta::forEachChangedPath(
+    folly::FunctionRef<void(RelativePathPiece, const PathChangeInfo&)>
+        callback) const {
+  for (const auto& entry : changedFilesInOverlay) {
+    callback(entry.first, entry.second);
+  }
+  for (const auto& change : compactChanges_) {
+    callback(change.path->path(), change.info);
+  }
+}
+
+void JournalDelta::forEachUncleanPath(
+    folly::FunctionRef<void(RelativePathPiece)> callback) const {
+  for (const auto& path : uncleanPaths) {
+    callback(path);
+  }
+  for (auto path : compactUncleanPaths_) {
+    callback(path->path());
+  }
+}
+
+void JournalDelta::compact(std::shared_ptr<JournalPathTable> pathTable) {
+  DCHECK(!isCompact());
+  pathTable_ = std::move(pathTable);
+
+  compactChanges_.reserve(changedFilesInOverlay.size());
+  for (const auto& entry : changedFilesInOverlay) {
+    compactChanges_.push_back({pathTable_->intern(entry.first), entry.second});
+  }
+  std::sort(
+      compactChanges_.begin(),
+      compactChanges_.end(),
+      [](const CompactChange& a, const CompactChange& b) {
+        return pathIdLess(a.path, b.path);
+      });
+
+  compactUncleanPaths_.reserve(uncleanPaths.size());
+  for (const auto& path : uncleanPaths) {
+    compactUncleanPaths_.push_back(pathTable_->intern(path));
+  }
+  std::sort(
+      compactUncleanPaths_.begin(), compactUncleanPaths_.end(), pathIdLess);
+
+  // Free the hash tables' buckets too, not just their nodes.
+  std::unordered_map<RelativePath, PathChangeInfo>().swap(
+      changedFilesInOverlay);
+  std::unordered_set<RelativePath>().swap(uncleanPaths);
+}
+
+void JournalDelta::assignMerged(
+    const std::vector<const JournalDelta*>& deltas,
+    bool compactResult) {
+  DCHECK(!deltas.empty());
+  DCHECK(!isCompact());
+  const auto& newest = *deltas.front();
+  const auto& oldest = *deltas.back();
+  toSequence = newest.toSequence;
+  toTime = newest.toTime;
+  toHash = newest.toHash;
+  fromSequence = oldest.fromSequence;
+  fromTime = oldest.fromTime;
+  fromHash = oldest.fromHash;
+
+  // Gather every change, tagged with the age of its delta, and sort them so
+  // that the changes to each path are adjacent and ordered newest first.
+  struct AgedChange {
+    JournalPathTable::PathId path;
+    size_t age;
+    PathChangeInfo info;
+  };
+  size_t numChanges = 0;
+  size_t numUnclean = 0;
+  for (const auto* delta : deltas) {
+    DCHECK(delta->isCompact());
+    numChanges += delta->compactChanges_.size();
+    numUnclean += delta->compactUncleanPaths_.size();
+  }
+  std::vector<AgedChange> changes;
+  std::vector<JournalPathTable::PathId> unclean;
+  changes.reserve(numChanges);
+  unclean.reserve(numUnclean);
+  for (size_t age = 0; age < deltas.size(); ++age) {
+    for (const auto& change : deltas[age]->compactChanges_) {
+      changes.push_back({change.path, age, change.info});
+    }
+    const auto& deltaUnclean = deltas[age]->compactUncleanPaths_;
+    unclean.insert(unclean.end(), deltaUnclean.begin(), deltaUnclean.end());
+  }
+  std::sort(
+      changes.begin(),
+      changes.end(),
+      [](const AgedChange& a, const AgedChange& b) {
+        if (a.path != b.path) {
+          return pathIdLess(a.path, b.path);
+        }
+        return a.age < b.age;
+      });
+  std::sort(unclean.begin(), unclean.end(), pathIdLess);
+  unclean.erase(std::unique(unclean.begin(), unclean.end()), unclean.end());
+
+  if (compactResult) {
+    pathTable_ = newest.pathTable_;
+  }
+  for (size_t i = 0; i < changes.size();) {
+    auto path = changes[i].path;
+    auto info = changes[i].info;
+    for (++i; i < changes.size() && changes[i].path == path; ++i) {
+      checkChangeSequence(path->path(), changes[i].info, info);
+      info.existedBefore = changes[i].info.existedBefore;
+    }
+    if (compactResult) {
+      JournalPathTable::addRef(path);
+      compactChanges_.push_back({path, info});
+    } else {
+      changedFilesInOverlay.emplace(path->path().copy(), info);
+    }
+  }
+  for (auto path : unclean) {
+    if (compactResult) {
+      JournalPathTable::addRef(path);
+      compactUncleanPaths_.push_back(path);
+    } else {
+      uncleanPaths.insert(path->path().copy());
+    }
+  }
+}
+
+size_t JournalDelta::estimateMemoryUsage() const {
+  // Each hash table node holds its value and a next pointer, and is
+  // referenced by a bucket.
+  constexpr size_t kNodeOverhead = 2 * sizeof(void*);
+  size_t usage = sizeof(JournalDelta);
+  usage += changedFilesInOverlay.bucket_count() * sizeof(void*);
+  for (const auto& entry : changedFilesInOverlay) {
+    usage += sizeof(entry) + kNodeOverhead + entry.first.stringPiece().size();
+  }
+  usage += uncleanPaths.bucket_count() * sizeof(void*);
+  for (const auto& path : uncleanPaths) {
+    usage += sizeof(path) + kNodeOverhead + path.stringPiece().size();
+  }
+  // Compact paths are stored once in the Journal's JournalPathTable, which
+  // accounts for them separately.
+  usage += compactChanges_.capacity() * sizeof(CompactChange);
+  usage += compactUncleanPaths_.capacity() * sizeof(JournalPathTable::PathId);
+  if (auto* checkpoint = checkpoint_.load(std::memory_order_acquire)) {
+    usage += checkpoint->estimateMemoryUsage();
+  }
+  return usage;
+}
+
 void JournalDelta::incRef() const noexcept {
   refCount_.fetch_add(1, std::memory_order_relaxed);
 }
@@ -9,9 +9,14 @@
  */
 #pragma once
 
+#include <folly/Function.h>
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <unordered_set>
+#include <vector>
 #include "eden/fs/journal/JournalDeltaPtr.h"
+#include "eden/fs/journal/JournalPathTable.h"
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/utils/PathFuncs.h"
 
@@ -94,12 +99,38 @@ class JournalDelta {
   /**
    * The set of files that changed in the overlay in this update, including
    * some information about the changes.
+   *
+   * Deltas stored in a Journal keep their paths in a compact form instead,
+   * so these are empty for them; use forEachChangedPath() and
+   * forEachUncleanPath() to read any delta.
    */
   std::unordered_map<RelativePath, PathChangeInfo> changedFilesInOverlay;
   /** The set of files that had differing status across a checkout or
    * some other operation that changes the snapshot hash */
   std::unordered_set<RelativePath> uncleanPaths;
 
+  /** Call the callback on each changed path, in no particular order. */
+  void forEachChangedPath(
+      folly::FunctionRef<void(RelativePathPiece, const PathChangeInfo&)>
+          callback) const;
+
+  /** Call the callback on each unclean path, in no particular order. */
+  void forEachUncleanPath(
+      folly::FunctionRef<void(RelativePathPiece)> callback) const;
+
+  /** Set on deltas returned by Journal::accumulateRange() when the Journal
+   * has dropped some of the deltas in the requested range to bound its
+   * memory usage, so this delta does not list every change in it. */
+  bool isTruncated{false};
+
+  /** An estimate of the memory used by this delta alone, not including the
+   * rest of its chain. */
+  size_t estimateMemoryUsage() const;
+
+  /** Fold in `older`, which must be the delta (or merged range of deltas)
+   * immediately preceding the changes already accumulated here. */
+  void mergeOlder(const JournalDelta& older);
+
   /** Merge the deltas running back from this delta for all deltas
    * whose toSequence is >= limitSequence.
    * The default limit value is 0 which is never assigned by the Journal
@@ -118,10 +149,58 @@ class JournalDelta {
   void decRef() const noexcept;
   bool isUnique() const noexcept;
 
+  /**
+   * Move changedFilesInOverlay and uncleanPaths into the compact form,
+   * interning their paths in pathTable.  The Journal does this to every
+   * delta it stores.
+   */
+  void compact(std::shared_ptr<JournalPathTable> pathTable);
+
+  bool isCompact() const {
+    return pathTable_ != nullptr;
+  }
+
+  /**
+   * Set this delta to the merge of `deltas`: consecutive compact deltas
+   * from one Journal, newest first.  The result is compact if
+   * compactResult is set, and uses the public containers otherwise.
+   *
+   * The caller must keep every delta in `deltas` alive until this returns.
+   */
+  void assignMerged(
+      const std::vector<const JournalDelta*>& deltas,
+      bool compactResult);
+
   mutable std::atomic<size_t> refCount_{0};
 
+  /**
+   * The compact form of changedFilesInOverlay and uncleanPaths: flat arrays
+   * sorted by PathId, each holding a reference to its path in pathTable_.
+   * Merging these is a linear pass over contiguous memory rather than a
+   * hash table lookup per path.
+   */
+  struct CompactChange {
+    JournalPathTable::PathId path;
+    PathChangeInfo info;
+  };
+  std::shared_ptr<JournalPathTable> pathTable_;
+  std::vector<CompactChange> compactChanges_;
+  std::vector<JournalPathTable::PathId> compactUncleanPaths_;
+
+  /**
+   * Set by the Journal on deltas whose toSequence is a multiple of a
+   * checkpoint span: the merge of the deltas in
+   * (toSequence - span, toSequence], including this one, and the delta
+   * preceding that range.  This lets range queries skip over whole spans.
+   * See Journal::buildCheckpoint().
+   */
+  std::atomic<const JournalDelta*> checkpoint_{nullptr};
+  const JournalDelta* beforeCheckpoint_{nullptr};
+
   // For reference counting.
   friend class JournalDeltaPtr;
+  // For checkpoints and compaction.
+  friend class Journal;
 };
 
 } // namespace eden
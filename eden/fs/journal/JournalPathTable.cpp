@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/journal/JournalPathTable.h"
+
+#include <glog/logging.h>
+
+namespace facebook {
+namespace eden {
+
+JournalPathTable::PathId JournalPathTable::intern(RelativePathPiece path) {
+  auto state = state_.wlock();
+  auto iter = state->entries.find(path);
+  if (iter == state->entries.end()) {
+    auto entry = std::make_unique<Entry>(path);
+    auto key = entry->path();
+    state->pathBytes += key.stringPiece().size();
+    iter = state->entries.emplace(key, std::move(entry)).first;
+  }
+  // Only ever incremented from zero with the lock held; see release().
+  iter->second->refCount_.fetch_add(1, std::memory_order_relaxed);
+  return iter->second.get();
+}
+
+void JournalPathTable::release(PathId id) {
+  // Drop references without the lock as long as this is not the last one.
+  auto count = id->refCount_.load(std::memory_order_acquire);
+  while (count > 1) {
+    if (id->refCount_.compare_exchange_weak(
+            count, count - 1, std::memory_order_acq_rel)) {
+      return;
+    }
+  }
+
+  // This may be the last reference.  intern() only adds references with the
+  // lock held, and no one else can call addRef() on a path they do not hold
+  // a reference to, so the count cannot go back up while we hold the lock.
+  auto state = state_.wlock();
+  if (id->refCount_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  state->pathBytes -= id->path().stringPiece().size();
+  // Look the entry up first; the key we pass in points into the entry.
+  auto iter = state->entries.find(id->path());
+  DCHECK(iter != state->entries.end());
+  state->entries.erase(iter);
+}
+
+size_t JournalPathTable::estimateMemoryUsage() const {
+  // Each entry is a hash table node holding a key, a pointer to the Entry,
+  // and a next pointer, plus its bucket and the Entry itself.
+  constexpr size_t kEntryOverhead = sizeof(RelativePathPiece) +
+      3 * sizeof(void*) + sizeof(Entry);
+  auto state = state_.rlock();
+  return state->entries.bucket_count() * sizeof(void*) +
+      state->entries.size() * kEntryOverhead + state->pathBytes;
+}
+
+size_t JournalPathTable::size() const {
+  return state_.rlock()->entries.size();
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * JournalPathTable interns the paths recorded in a Journal's deltas.
+ *
+ * Build outputs and other hot files are rewritten over and over, so the same
+ * path shows up in thousands of deltas.  Deltas stored in the Journal refer
+ * to paths by PathId instead, and each distinct path is stored once.  Paths
+ * are reference counted and removed from the table once no delta refers to
+ * them.
+ *
+ * JournalPathTable is thread-safe.
+ */
+class JournalPathTable {
+ public:
+  class Entry {
+   public:
+    explicit Entry(RelativePathPiece path) : path_{path.copy()} {}
+
+    RelativePathPiece path() const {
+      return path_;
+    }
+
+   private:
+    friend class JournalPathTable;
+
+    const RelativePath path_;
+    mutable std::atomic<size_t> refCount_{0};
+  };
+
+  /**
+   * Identifies an interned path.  It remains valid for as long as the caller
+   * holds a reference to it.
+   *
+   * PathIds are compared by address, which is stable but arbitrary, so
+   * sorting by PathId does not sort by path.
+   */
+  using PathId = const Entry*;
+
+  JournalPathTable() = default;
+  JournalPathTable(const JournalPathTable&) = delete;
+  JournalPathTable& operator=(const JournalPathTable&) = delete;
+
+  /**
+   * Returns the PathId for path, adding it to the table if necessary.  The
+   * caller owns one reference to the result.
+   */
+  PathId intern(RelativePathPiece path);
+
+  /**
+   * Add a reference to a PathId that the caller already holds a reference
+   * to.
+   */
+  static void addRef(PathId id) {
+    id->refCount_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Drop a reference, removing the path from the table if it was the last.
+   */
+  void release(PathId id);
+
+  /**
+   * An estimate of the memory used by the table itself, not including the
+   * deltas referring to it.
+   */
+  size_t estimateMemoryUsage() const;
+
+  /** The number of distinct paths in the table. */
+  size_t size() const;
+
+ private:
+  struct State {
+    /** Keys point into the path stored in their Entry. */
+    std::unordered_map<RelativePathPiece, std::unique_ptr<Entry>> entries;
+    size_t pathBytes{0};
+  };
+
+  folly::Synchronized<State> state_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,300 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <folly/init/Init.h>
+#include <folly/stop_watch.h>
+#include <folly/synchronization/Baton.h>
+#include <gflags/gflags.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include "eden/fs/journal/Journal.h"
+
+using namespace facebook::eden;
+using folly::StringPiece;
+using std::string;
+using std::vector;
+
+DEFINE_int32(deltas, 1000000, "Number of deltas each writer appends");
+DEFINE_int32(writers, 1, "Number of threads appending deltas");
+DEFINE_int32(subscribers, 4, "Number of subscribers merging new deltas");
+DEFINE_int32(paths, 100000, "Number of distinct paths the writers touch");
+DEFINE_double(
+    hot_fraction,
+    0.01,
+    "Fraction of the paths that receive most of the changes, as the outputs "
+    "of a build do");
+DEFINE_double(
+    hot_share,
+    0.9,
+    "Fraction of the changes that go to the hot paths");
+DEFINE_string(
+    range_sizes,
+    "1,10,100,1000,10000,100000,1000000",
+    "Comma-separated range sizes, in deltas, to time accumulateRange() over "
+    "once the writers are done");
+DEFINE_int32(range_iterations, 20, "Number of merges of each range size");
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+vector<RelativePath> makePaths() {
+  vector<RelativePath> paths;
+  paths.reserve(FLAGS_paths);
+  for (int n = 0; n < FLAGS_paths; ++n) {
+    paths.emplace_back(folly::to<string>(
+        "buck-out/gen/project", n % 97, "/dir", n % 13, "/file", n, ".o"));
+  }
+  return paths;
+}
+
+std::unique_ptr<JournalDelta> makeDelta(
+    const vector<RelativePath>& paths,
+    std::mt19937_64& rng) {
+  auto hotCount = std::max<size_t>(1, FLAGS_hot_fraction * paths.size());
+  std::uniform_real_distribution<double> share;
+  auto index = share(rng) < FLAGS_hot_share ? rng() % hotCount
+                                            : rng() % paths.size();
+  const auto& path = paths[index];
+  // Mostly modifications, with the creates, removes and renames of temporary
+  // files that build tools produce.
+  switch (rng() % 16) {
+    case 0:
+      return std::make_unique<JournalDelta>(path, JournalDelta::CREATED);
+    case 1:
+      return std::make_unique<JournalDelta>(path, JournalDelta::REMOVED);
+    case 2:
+      return std::make_unique<JournalDelta>(
+          paths[rng() % paths.size()], path, JournalDelta::RENAME);
+    default:
+      return std::make_unique<JournalDelta>(path, JournalDelta::CHANGED);
+  }
+}
+
+double toMicros(Clock::duration duration) {
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+void printLatencies(StringPiece name, vector<Clock::duration>& latencies) {
+  if (latencies.empty()) {
+    printf("%-28s %9d\n", name.str().c_str(), 0);
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return toMicros(latencies[static_cast<size_t>(
+        p * static_cast<double>(latencies.size() - 1))]);
+  };
+  printf(
+      "%-28s %9zu %9.2f %9.2f %9.2f %10.2f\n",
+      name.str().c_str(),
+      latencies.size(),
+      percentile(0.5),
+      percentile(0.9),
+      percentile(0.99),
+      toMicros(latencies.back()));
+}
+
+/**
+ * A subscriber in the style of the streaming Thrift subscription: the
+ * journal callback only wakes it, and it then merges everything since the
+ * last sequence number it saw.  Its merge latencies are grouped by the
+ * number of deltas merged, rounded down to a power of two.
+ */
+class Subscriber {
+ public:
+  explicit Subscriber(Journal& journal) : journal_{journal} {
+    id_ = journal_.registerSubscriber([this] {
+      if (!pending_.exchange(true)) {
+        baton_.post();
+      }
+    });
+    thread_ = std::thread([this] { run(); });
+  }
+
+  void stop() {
+    journal_.cancelSubscriber(id_);
+    stopping_ = true;
+    baton_.post();
+    thread_.join();
+  }
+
+  vector<vector<Clock::duration>> latenciesByRange;
+  size_t truncatedMerges{0};
+
+ private:
+  void run() {
+    Journal::SequenceNumber lastSeen = 0;
+    while (true) {
+      baton_.wait();
+      baton_.reset();
+      pending_ = false;
+      if (stopping_) {
+        return;
+      }
+      auto start = Clock::now();
+      auto merged = journal_.accumulateRange(lastSeen + 1);
+      auto elapsed = Clock::now() - start;
+      if (!merged) {
+        continue;
+      }
+      truncatedMerges += merged->isTruncated;
+      auto range = merged->toSequence - lastSeen;
+      size_t bucket = 0;
+      while ((range >>= 1) != 0) {
+        ++bucket;
+      }
+      if (latenciesByRange.size() <= bucket) {
+        latenciesByRange.resize(bucket + 1);
+      }
+      latenciesByRange[bucket].push_back(elapsed);
+      lastSeen = merged->toSequence;
+    }
+  }
+
+  Journal& journal_;
+  Journal::SubscriberId id_;
+  folly::Baton<> baton_;
+  std::atomic<bool> pending_{false};
+  std::atomic<bool> stopping_{false};
+  std::thread thread_;
+};
+
+long maxRssKB() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void runBenchmark() {
+  auto paths = makePaths();
+  Journal journal;
+  auto rssBefore = maxRssKB();
+
+  vector<std::unique_ptr<Subscriber>> subscribers;
+  for (int n = 0; n < FLAGS_subscribers; ++n) {
+    subscribers.push_back(std::make_unique<Subscriber>(journal));
+  }
+
+  // Each delta is built before its timer starts, so only addDelta() is timed.
+  vector<vector<Clock::duration>> appendLatencies(FLAGS_writers);
+  vector<std::thread> writers;
+  folly::stop_watch<std::chrono::milliseconds> appendTimer;
+  for (int w = 0; w < FLAGS_writers; ++w) {
+    writers.emplace_back([&, w] {
+      std::mt19937_64 rng(w);
+      auto& latencies = appendLatencies[w];
+      latencies.reserve(FLAGS_deltas);
+      for (int n = 0; n < FLAGS_deltas; ++n) {
+        auto delta = makeDelta(paths, rng);
+        auto start = Clock::now();
+        journal.addDelta(std::move(delta));
+        latencies.push_back(Clock::now() - start);
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  auto appendElapsed = appendTimer.elapsed();
+  for (auto& subscriber : subscribers) {
+    subscriber->stop();
+  }
+
+  auto stats = journal.getStats();
+  auto totalDeltas = static_cast<size_t>(FLAGS_deltas) * FLAGS_writers;
+  printf(
+      "%zu deltas over %d paths in %lld ms (%.0f deltas/s)\n",
+      totalDeltas,
+      FLAGS_paths,
+      static_cast<long long>(appendElapsed.count()),
+      totalDeltas * 1000.0 / std::max<int64_t>(1, appendElapsed.count()));
+  printf(
+      "journal holds %zu deltas in %zu bytes (%.1f bytes/delta), "
+      "truncated through %llu, peak RSS grew %ld MB\n",
+      stats.entryCount,
+      stats.memoryUsage,
+      static_cast<double>(stats.memoryUsage) /
+          std::max<size_t>(1, stats.entryCount),
+      static_cast<unsigned long long>(stats.truncatedThrough),
+      (maxRssKB() - rssBefore) / 1024);
+
+  printf(
+      "\n%-28s %9s %9s %9s %9s %10s\n",
+      "latency (us)",
+      "count",
+      "p50",
+      "p90",
+      "p99",
+      "max");
+  vector<Clock::duration> appends;
+  for (auto& latencies : appendLatencies) {
+    appends.insert(appends.end(), latencies.begin(), latencies.end());
+  }
+  printLatencies("addDelta", appends);
+
+  vector<vector<Clock::duration>> merges;
+  size_t truncatedMerges = 0;
+  for (const auto& subscriber : subscribers) {
+    const auto& byRange = subscriber->latenciesByRange;
+    if (merges.size() < byRange.size()) {
+      merges.resize(byRange.size());
+    }
+    for (size_t bucket = 0; bucket < byRange.size(); ++bucket) {
+      merges[bucket].insert(
+          merges[bucket].end(), byRange[bucket].begin(), byRange[bucket].end());
+    }
+    truncatedMerges += subscriber->truncatedMerges;
+  }
+  for (size_t bucket = 0; bucket < merges.size(); ++bucket) {
+    printLatencies(
+        folly::to<string>("subscriber merge ", 1ull << bucket, "+"),
+        merges[bucket]);
+  }
+  if (truncatedMerges != 0) {
+    printf("%zu subscriber merges were truncated\n", truncatedMerges);
+  }
+
+  // Time merges of fixed sizes, reaching back from the tip.
+  auto latest = journal.getLatest()->toSequence;
+  vector<StringPiece> sizes;
+  folly::split(',', FLAGS_range_sizes, sizes, /* ignoreEmpty */ true);
+  for (auto sizeStr : sizes) {
+    auto size = folly::to<Journal::SequenceNumber>(sizeStr);
+    if (size > latest) {
+      continue;
+    }
+    vector<Clock::duration> latencies;
+    size_t changedPaths = 0;
+    for (int n = 0; n < FLAGS_range_iterations; ++n) {
+      auto start = Clock::now();
+      auto merged = journal.accumulateRange(latest - size + 1);
+      latencies.push_back(Clock::now() - start);
+      changedPaths = merged ? merged->changedFilesInOverlay.size() : 0;
+    }
+    printLatencies(
+        folly::to<string>(
+            "accumulateRange ", size, " (", changedPaths, " paths)"),
+        latencies);
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  runBenchmark();
+  return 0;
+}
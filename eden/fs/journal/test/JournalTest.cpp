@@ -8,8 +8,14 @@
  *
  */
 #include "eden/fs/journal/Journal.h"
+#include <folly/Conv.h>
+#include <gflags/gflags.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <vector>
+
+DECLARE_bool(journal_coalesce_modifications);
+DECLARE_uint64(journal_memory_limit);
 
 using namespace facebook::eden;
 using ::testing::UnorderedElementsAre;
@@ -171,3 +177,177 @@ TEST(Journal, destruction_does_not_overflow_stack_on_long_chain) {
     journal.addDelta(std::move(delta));
   }
 }
+
+TEST(Journal, truncates_oldest_deltas_past_memory_limit) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_journal_memory_limit = 16 * 1024;
+
+  Journal journal;
+  for (size_t i = 0; i < 1000; ++i) {
+    journal.addDelta(std::make_unique<JournalDelta>(
+        RelativePath{folly::to<std::string>("dir/file", i)},
+        JournalDelta::CREATED));
+  }
+
+  auto stats = journal.getStats();
+  EXPECT_LE(stats.memoryUsage, FLAGS_journal_memory_limit);
+  EXPECT_LT(stats.entryCount, 1000);
+  EXPECT_GT(stats.truncatedThrough, 0);
+
+  // Ranges that reach back into the dropped deltas say so.
+  auto merged = journal.accumulateRange(1);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_TRUE(merged->isTruncated);
+  EXPECT_EQ(stats.truncatedThrough + 1, merged->fromSequence);
+  EXPECT_EQ(1000, merged->toSequence);
+
+  // Ranges within the retained deltas are complete.
+  merged = journal.accumulateRange(stats.truncatedThrough + 1);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_FALSE(merged->isTruncated);
+  EXPECT_EQ(stats.entryCount, merged->changedFilesInOverlay.size());
+
+  size_t visited = 0;
+  journal.forEachDelta(1, 1000, [&](const JournalDelta& delta) {
+    EXPECT_GT(delta.fromSequence, stats.truncatedThrough);
+    ++visited;
+    return true;
+  });
+  EXPECT_EQ(stats.entryCount, visited);
+}
+
+TEST(Journal, stores_repeated_paths_once) {
+  // Keep every delta, rather than letting them coalesce into one.
+  gflags::FlagSaver flagSaver;
+  FLAGS_journal_coalesce_modifications = false;
+
+  auto longPath = [](size_t i) {
+    return RelativePath{folly::to<std::string>(
+        "buck-out/gen/some/deeply/nested/target/directory/output", i)};
+  };
+
+  Journal repeated;
+  Journal distinct;
+  for (size_t i = 0; i < 1000; ++i) {
+    repeated.addDelta(
+        std::make_unique<JournalDelta>(longPath(0), JournalDelta::CHANGED));
+    distinct.addDelta(
+        std::make_unique<JournalDelta>(longPath(i), JournalDelta::CHANGED));
+  }
+  EXPECT_LT(
+      repeated.getStats().memoryUsage + 1000 * longPath(0).stringPiece().size(),
+      distinct.getStats().memoryUsage);
+
+  auto merged = repeated.accumulateRange(1);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_EQ(1, merged->fromSequence);
+  EXPECT_EQ(1000, merged->toSequence);
+  ASSERT_EQ(1, merged->changedFilesInOverlay.size());
+  auto& info = merged->changedFilesInOverlay[longPath(0)];
+  EXPECT_TRUE(info.existedBefore);
+  EXPECT_TRUE(info.existedAfter);
+
+  // Deltas in the journal can still be read through their accessors.
+  size_t changed = 0;
+  repeated.getLatest()->forEachChangedPath(
+      [&](RelativePathPiece path, const PathChangeInfo&) {
+        EXPECT_EQ(longPath(0), path);
+        ++changed;
+      });
+  EXPECT_EQ(1, changed);
+}
+
+TEST(Journal, checkpointed_ranges_match_full_merges) {
+  Journal journal;
+  for (size_t i = 1; i <= 5000; ++i) {
+    journal.addDelta(std::make_unique<JournalDelta>(
+        RelativePath{folly::to<std::string>("dir/file", i % 700)},
+        i <= 700 ? JournalDelta::CREATED : JournalDelta::CHANGED));
+  }
+
+  auto latest = journal.getLatest();
+  for (Journal::SequenceNumber limit :
+       {1, 2, 63, 64, 65, 128, 1000, 4096, 4097, 4999, 5000}) {
+    SCOPED_TRACE(limit);
+    auto expected = latest->merge(limit, true);
+    auto merged = journal.accumulateRange(limit);
+    ASSERT_NE(nullptr, merged);
+    EXPECT_FALSE(merged->isTruncated);
+    EXPECT_EQ(expected->fromSequence, merged->fromSequence);
+    EXPECT_EQ(expected->toSequence, merged->toSequence);
+    ASSERT_EQ(
+        expected->changedFilesInOverlay.size(),
+        merged->changedFilesInOverlay.size());
+    for (const auto& entry : expected->changedFilesInOverlay) {
+      auto iter = merged->changedFilesInOverlay.find(entry.first);
+      ASSERT_NE(iter, merged->changedFilesInOverlay.end());
+      EXPECT_EQ(entry.second.existedBefore, iter->second.existedBefore);
+      EXPECT_EQ(entry.second.existedAfter, iter->second.existedAfter);
+    }
+  }
+  EXPECT_EQ(nullptr, journal.accumulateRange(5001));
+
+  std::vector<Journal::SequenceNumber> visited;
+  journal.forEachDelta(100, 4200, [&](const JournalDelta& delta) {
+    visited.push_back(delta.toSequence);
+    return true;
+  });
+  ASSERT_EQ(4101, visited.size());
+  EXPECT_EQ(4200, visited.front());
+  EXPECT_EQ(100, visited.back());
+}
+
+TEST(Journal, coalesces_repeated_modifications) {
+  Journal journal;
+  journal.addDelta(std::make_unique<JournalDelta>(
+      "out/lib.so"_relpath, JournalDelta::CREATED));
+  for (size_t i = 0; i < 10; ++i) {
+    journal.addDelta(std::make_unique<JournalDelta>(
+        "out/lib.so"_relpath, JournalDelta::CHANGED));
+  }
+
+  // The creation stays separate, and the modifications share one delta
+  // that still spans a sequence number for each of them.
+  EXPECT_EQ(2, journal.getStats().entryCount);
+  auto latest = journal.getLatest();
+  EXPECT_EQ(2, latest->fromSequence);
+  EXPECT_EQ(11, latest->toSequence);
+  EXPECT_EQ(1, latest->previous->toSequence);
+
+  // A client that saw any earlier position still learns of the change.
+  auto merged = journal.accumulateRange(11);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_EQ(1, merged->changedFilesInOverlay.count("out/lib.so"_relpath));
+
+  // Modifying another file starts a new delta.
+  journal.addDelta(
+      std::make_unique<JournalDelta>("out/bin"_relpath, JournalDelta::CHANGED));
+  journal.addDelta(std::make_unique<JournalDelta>(
+      "out/lib.so"_relpath, JournalDelta::CHANGED));
+  EXPECT_EQ(4, journal.getStats().entryCount);
+  EXPECT_EQ(13, journal.getLatest()->fromSequence);
+}
+
+TEST(Journal, coalescing_keeps_checkpoint_sequence_numbers) {
+  Journal journal;
+  for (size_t i = 0; i < 200; ++i) {
+    journal.addDelta(std::make_unique<JournalDelta>(
+        "out/lib.so"_relpath, JournalDelta::CHANGED));
+  }
+
+  // Coalesced deltas never span a multiple of the checkpoint span.
+  std::vector<Journal::SequenceNumber> toSequences;
+  journal.forEachDelta(1, 200, [&](const JournalDelta& delta) {
+    toSequences.push_back(delta.toSequence);
+    return true;
+  });
+  EXPECT_EQ(
+      (std::vector<Journal::SequenceNumber>{200, 192, 191, 128, 127, 64, 63}),
+      toSequences);
+
+  auto merged = journal.accumulateRange(100);
+  ASSERT_NE(nullptr, merged);
+  EXPECT_EQ(65, merged->fromSequence);
+  EXPECT_EQ(200, merged->toSequence);
+  EXPECT_EQ(1, merged->changedFilesInOverlay.size());
+}
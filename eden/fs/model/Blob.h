@@ -32,6 +32,13 @@ class Blob {
     return contents_;
   }
 
+  /**
+   * Get an estimate of the number of bytes of memory used by this Blob.
+   */
+  size_t getSizeBytes() const {
+    return sizeof(Blob) + contents_.computeChainDataLength();
+  }
+
  private:
   const Hash hash_;
   const folly::IOBuf contents_;
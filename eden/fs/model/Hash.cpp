@@ -15,6 +15,7 @@
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/ssl/OpenSSLHash.h>
+#include <openssl/sha.h>
 #include <string>
 
 using folly::ByteRange;
@@ -55,21 +56,6 @@ std::string Hash::toString() const {
   return result;
 }
 
-size_t Hash::getHashCode() const {
-  static_assert(sizeof(size_t) <= RAW_SIZE, "crazy size_t type");
-  size_t result;
-  memcpy(&result, bytes_.data(), sizeof(size_t));
-  return result;
-}
-
-bool Hash::operator==(const Hash& otherHash) const {
-  return bytes_ == otherHash.bytes_;
-}
-
-bool Hash::operator<(const Hash& otherHash) const {
-  return bytes_ < otherHash.bytes_;
-}
-
 namespace {
 Hash::Storage hexToBytes(StringPiece hex) {
   size_t requiredSize = Hash::RAW_SIZE * 2;
@@ -121,6 +107,23 @@ Hash Hash::sha1(ByteRange data) {
   return Hash(hashBytes);
 }
 
+std::vector<Hash> Hash::sha1Batch(
+    folly::Range<const folly::IOBuf* const*> bufs) {
+  std::vector<Hash> hashes;
+  hashes.reserve(bufs.size());
+  SHA_CTX ctx;
+  Storage hashBytes;
+  for (const auto* buf : bufs) {
+    SHA1_Init(&ctx);
+    for (auto bytes : *buf) {
+      SHA1_Update(&ctx, bytes.data(), bytes.size());
+    }
+    SHA1_Final(hashBytes.data(), &ctx);
+    hashes.emplace_back(hashBytes);
+  }
+  return hashes;
+}
+
 std::ostream& operator<<(std::ostream& os, const Hash& hash) {
   os << hash.toString();
   return os;
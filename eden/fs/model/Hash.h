@@ -11,9 +11,13 @@
 
 #include <boost/operators.hpp>
 #include <folly/Range.h>
+#include <folly/lang/Bits.h>
 #include <stdint.h>
 #include <array>
+#include <cstring>
 #include <iosfwd>
+#include <type_traits>
+#include <vector>
 
 namespace folly {
 class IOBuf;
@@ -54,18 +58,73 @@ class Hash : boost::totally_ordered<Hash> {
    */
   static Hash sha1(folly::ByteRange data);
 
+  /**
+   * Compute the SHA1 hashes of many IOBuf chains.
+   *
+   * This is cheaper than calling sha1() for each of them when they are
+   * small, as it reuses one hash context rather than allocating one per
+   * buffer.  OpenSSL picks the fastest block function the CPU supports,
+   * including the SHA extensions.
+   */
+  static std::vector<Hash> sha1Batch(
+      folly::Range<const folly::IOBuf* const*> bufs);
+
   folly::ByteRange getBytes() const;
   folly::MutableByteRange mutableBytes();
 
   /** @return 40-character [lowercase] hex representation of this hash. */
   std::string toString() const;
 
-  size_t getHashCode() const;
+  /**
+   * The hash's first bytes are already uniformly distributed, so they are
+   * used as the hash code directly.
+   */
+  size_t getHashCode() const {
+    static_assert(sizeof(size_t) <= RAW_SIZE, "crazy size_t type");
+    return loadWord<size_t>(0);
+  }
+
+  /*
+   * Hashes are compared very often during diffs and in hash tables, so these
+   * are defined inline and compare a word at a time: 16 bytes followed by the
+   * remaining 4.
+   */
 
-  bool operator==(const Hash&) const;
-  bool operator<(const Hash&) const;
+  bool operator==(const Hash& other) const {
+    return ((loadWord<uint64_t>(0) ^ other.loadWord<uint64_t>(0)) |
+            (loadWord<uint64_t>(8) ^ other.loadWord<uint64_t>(8)) |
+            (loadWord<uint32_t>(16) ^ other.loadWord<uint32_t>(16))) == 0;
+  }
+
+  /**
+   * Hashes are ordered by their bytes, so the words are compared as big
+   * endian integers.
+   */
+  bool operator<(const Hash& other) const {
+    auto word1 = folly::Endian::big(loadWord<uint64_t>(0));
+    auto otherWord1 = folly::Endian::big(other.loadWord<uint64_t>(0));
+    if (word1 != otherWord1) {
+      return word1 < otherWord1;
+    }
+    auto word2 = folly::Endian::big(loadWord<uint64_t>(8));
+    auto otherWord2 = folly::Endian::big(other.loadWord<uint64_t>(8));
+    if (word2 != otherWord2) {
+      return word2 < otherWord2;
+    }
+    return folly::Endian::big(loadWord<uint32_t>(16)) <
+        folly::Endian::big(other.loadWord<uint32_t>(16));
+  }
 
  private:
+  static_assert(RAW_SIZE == 2 * sizeof(uint64_t) + sizeof(uint32_t), "");
+
+  template <typename T>
+  T loadWord(size_t offset) const {
+    T word;
+    memcpy(&word, bytes_.data() + offset, sizeof(T));
+    return word;
+  }
+
   Storage bytes_;
 };
 
@@ -87,6 +146,12 @@ void toAppend(const Hash& hash, std::string* result);
 namespace std {
 template <>
 struct hash<facebook::eden::Hash> {
+  /**
+   * Tell folly's F14 maps that the hash code's bits are already well mixed,
+   * so they can use it without mixing it again.
+   */
+  using folly_is_avalanching = std::true_type;
+
   size_t operator()(const facebook::eden::Hash& hash) const {
     return hash.getHashCode();
   }
@@ -11,6 +11,24 @@
 
 namespace facebook {
 namespace eden {
+namespace {
+// PathComponent stores its name in a folly::fbstring, which keeps strings up
+// to this length inline, inside the TreeEntry itself.  Only longer names
+// cost a separate heap allocation.
+constexpr size_t kMaxInlineNameLength = 23;
+} // namespace
+
+size_t Tree::getSizeBytes() const {
+  size_t size = sizeof(Tree) + entries_.capacity() * sizeof(TreeEntry);
+  for (const auto& entry : entries_) {
+    const auto nameLength = entry.getName().stringPiece().size();
+    if (nameLength > kMaxInlineNameLength) {
+      size += nameLength + 1;
+    }
+  }
+  return size;
+}
+
 bool operator==(const Tree& tree1, const Tree& tree2) {
   return (tree1.getHash() == tree2.getHash()) &&
       (tree1.getTreeEntries() == tree2.getTreeEntries());
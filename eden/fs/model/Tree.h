@@ -57,6 +57,13 @@ class Tree {
     return *entry;
   }
 
+  /**
+   * Get an estimate of the number of bytes of memory used by this Tree,
+   * including its entries and any of their names too long to be stored
+   * inline.
+   */
+  size_t getSizeBytes() const;
+
   std::vector<PathComponent> getEntryNames() const {
     std::vector<PathComponent> results;
     results.reserve(entries_.size());
@@ -86,7 +86,9 @@ std::ostream& operator<<(std::ostream& os, TreeEntryType type) {
 bool operator==(const TreeEntry& entry1, const TreeEntry& entry2) {
   return (entry1.getHash() == entry2.getHash()) &&
       (entry1.getType() == entry2.getType()) &&
-      (entry1.getName() == entry2.getName());
+      (entry1.getName() == entry2.getName()) &&
+      (entry1.getSize() == entry2.getSize()) &&
+      (entry1.getContentSha1() == entry2.getContentSha1());
 }
 
 bool operator!=(const TreeEntry& entry1, const TreeEntry& entry2) {
@@ -12,6 +12,7 @@
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/utils/PathFuncs.h"
 
+#include <folly/Optional.h>
 #include <folly/String.h>
 #include <iosfwd>
 
@@ -51,6 +52,22 @@ class TreeEntry {
       TreeEntryType type)
       : type_(type), hash_(hash), name_(PathComponentPiece(name)) {}
 
+  /**
+   * Construct an entry for a file whose size and SHA-1 of its contents are
+   * known, so that they can be reported without fetching the blob.
+   */
+  explicit TreeEntry(
+      const Hash& hash,
+      folly::StringPiece name,
+      TreeEntryType type,
+      folly::Optional<uint64_t> size,
+      folly::Optional<Hash> contentSha1)
+      : type_(type),
+        hash_(hash),
+        name_(PathComponentPiece(name)),
+        size_(size),
+        contentSha1_(contentSha1) {}
+
   const Hash& getHash() const {
     return hash_;
   }
@@ -67,12 +84,28 @@ class TreeEntry {
     return type_;
   }
 
+  /**
+   * The size of the file's contents, if the BackingStore reported it.
+   */
+  const folly::Optional<uint64_t>& getSize() const {
+    return size_;
+  }
+
+  /**
+   * The SHA-1 of the file's contents, if the BackingStore reported it.
+   */
+  const folly::Optional<Hash>& getContentSha1() const {
+    return contentSha1_;
+  }
+
   std::string toLogString() const;
 
  private:
   TreeEntryType type_;
   Hash hash_;
   PathComponent name_;
+  folly::Optional<uint64_t> size_;
+  folly::Optional<Hash> contentSha1_;
 };
 
 std::ostream& operator<<(std::ostream& os, TreeEntryType type);
@@ -19,6 +19,31 @@ using std::string;
 namespace facebook {
 namespace eden {
 
+namespace {
+/**
+ * Call fn() with the index of each rule in entries whose key is equal to key,
+ * in order, until fn() returns true.
+ */
+template <typename Fn>
+void forEachIndexedRule(
+    const std::vector<std::pair<string, uint32_t>>& entries,
+    StringPiece key,
+    Fn&& fn) {
+  auto iter = std::lower_bound(
+      entries.begin(),
+      entries.end(),
+      key,
+      [](const std::pair<string, uint32_t>& entry, StringPiece k) {
+        return StringPiece{entry.first} < k;
+      });
+  for (; iter != entries.end() && StringPiece{iter->first} == key; ++iter) {
+    if (fn(iter->second)) {
+      return;
+    }
+  }
+}
+} // namespace
+
 GitIgnore::GitIgnore() {}
 
 GitIgnore::GitIgnore(GitIgnore const&) = default;
@@ -71,20 +96,81 @@ void GitIgnore::loadFile(StringPiece contents) {
   // stop at the first match.
   std::reverse(newRules.begin(), newRules.end());
   std::swap(rules_, newRules);
+  buildIndex();
+}
+
+void GitIgnore::buildIndex() {
+  basenameRules_.clear();
+  pathRules_.clear();
+  extensionRules_.clear();
+  otherRules_.clear();
+
+  for (uint32_t idx = 0; idx < rules_.size(); ++idx) {
+    const auto& rule = rules_[idx];
+    auto literal = rule.getLiteral();
+    switch (rule.getKind()) {
+      case GitIgnorePattern::Kind::LITERAL:
+        if (rule.isBasenameOnly()) {
+          basenameRules_.emplace_back(literal.str(), idx);
+        } else {
+          pathRules_.emplace_back(literal.str(), idx);
+        }
+        continue;
+      case GitIgnorePattern::Kind::SUFFIX: {
+        auto dot = literal.rfind('.');
+        if (dot != StringPiece::npos) {
+          extensionRules_.emplace_back(literal.subpiece(dot + 1).str(), idx);
+          continue;
+        }
+        break;
+      }
+      case GitIgnorePattern::Kind::GLOB:
+        break;
+    }
+    otherRules_.push_back(idx);
+  }
+
+  std::sort(basenameRules_.begin(), basenameRules_.end());
+  std::sort(pathRules_.begin(), pathRules_.end());
+  std::sort(extensionRules_.begin(), extensionRules_.end());
 }
 
 GitIgnore::MatchResult GitIgnore::match(
     RelativePathPiece path,
     PathComponentPiece basename,
     FileType fileType) const {
-  for (const auto& pattern : rules_) {
-    auto result = pattern.match(path, basename, fileType);
-    if (result != NO_MATCH) {
-      return result;
+  // Find the highest precedence (lowest index) rule that matches.  Each
+  // lookup below only needs to consider rules that precede the best match
+  // found so far.
+  size_t bestIdx = rules_.size();
+  auto result = NO_MATCH;
+  auto tryRule = [&](uint32_t idx) {
+    if (idx >= bestIdx) {
+      return true;
+    }
+    auto ruleResult = rules_[idx].match(path, basename, fileType);
+    if (ruleResult == NO_MATCH) {
+      return false;
+    }
+    bestIdx = idx;
+    result = ruleResult;
+    return true;
+  };
+
+  forEachIndexedRule(basenameRules_, basename.stringPiece(), tryRule);
+  forEachIndexedRule(pathRules_, path.stringPiece(), tryRule);
+  auto dot = basename.stringPiece().rfind('.');
+  if (dot != StringPiece::npos) {
+    forEachIndexedRule(
+        extensionRules_, basename.stringPiece().subpiece(dot + 1), tryRule);
+  }
+  for (auto idx : otherRules_) {
+    if (tryRule(idx)) {
+      break;
     }
   }
 
-  return NO_MATCH;
+  return result;
 }
 
 string GitIgnore::matchString(MatchResult result) {
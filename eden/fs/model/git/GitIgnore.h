@@ -10,6 +10,8 @@
 #pragma once
 
 #include <folly/Range.h>
+#include <string>
+#include <utility>
 #include <vector>
 #include "eden/fs/utils/PathFuncs.h"
 
@@ -176,12 +178,42 @@ class GitIgnore {
   static std::string matchString(MatchResult result);
 
  private:
+  /**
+   * A (key, index into rules_) pair.  Vectors of these are sorted by key, and
+   * then by index, so the rules that apply to a key can be found with a
+   * binary search, highest precedence first.
+   */
+  using IndexEntry = std::pair<std::string, uint32_t>;
+
+  /**
+   * Sort the rules into the index vectors below.
+   */
+  void buildIndex();
+
   /*
    * The patterns loaded from the gitignore file.  These are sorted from
    * highest to lowest precedence (the reverse of the order they are actually
    * listed in the .gitignore file).
    */
   std::vector<GitIgnorePattern> rules_;
+
+  /*
+   * Most patterns in real ignore files are plain names ("buck-out/") or
+   * extensions ("*.pyc"), so match() looks those up by name instead of
+   * trying every pattern's GlobMatcher in turn.
+   *
+   * - basenameRules_ holds literal basename-only patterns, keyed by name.
+   * - pathRules_ holds literal patterns that contain a slash, keyed by the
+   *   path relative to this file's directory.
+   * - extensionRules_ holds "*<suffix>" basename-only patterns whose suffix
+   *   contains a '.', keyed by the text after the suffix's last '.'.  Any
+   *   basename they match has the same extension.
+   * - otherRules_ lists the indexes of the remaining patterns, in order.
+   */
+  std::vector<IndexEntry> basenameRules_;
+  std::vector<IndexEntry> pathRules_;
+  std::vector<IndexEntry> extensionRules_;
+  std::vector<uint32_t> otherRules_;
 };
 } // namespace eden
 } // namespace facebook
@@ -0,0 +1,42 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/model/git/GitIgnoreCache.h"
+
+#include <algorithm>
+
+#include "eden/fs/model/git/GitIgnore.h"
+
+namespace facebook {
+namespace eden {
+
+GitIgnoreCache::GitIgnoreCache(size_t maxEntries)
+    : entries_{std::max<size_t>(maxEntries, 1)} {}
+
+GitIgnoreCache::~GitIgnoreCache() {}
+
+std::shared_ptr<const GitIgnore> GitIgnoreCache::get(const Hash& blobHash) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto iter = entries_.find(blobHash);
+  if (iter == entries_.end()) {
+    return nullptr;
+  }
+  hitCount_.fetch_add(1, std::memory_order_relaxed);
+  return iter->second;
+}
+
+void GitIgnoreCache::insert(
+    const Hash& blobHash,
+    std::shared_ptr<const GitIgnore> ignore) {
+  std::lock_guard<std::mutex> guard(lock_);
+  entries_.set(blobHash, std::move(ignore));
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/container/EvictingCacheMap.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include "eden/fs/model/Hash.h"
+
+namespace facebook {
+namespace eden {
+
+class GitIgnore;
+
+/**
+ * GitIgnoreCache holds recently parsed .gitignore files, keyed by the hash of
+ * the blob they were parsed from.
+ *
+ * Every status call has to load the .gitignore file in each directory it
+ * walks.  Almost all of those files are unmodified from source control, and
+ * identical between calls, so the diff code looks up their blob hash here
+ * rather than reading and parsing the file again.
+ *
+ * GitIgnoreCache is thread-safe.
+ */
+class GitIgnoreCache {
+ public:
+  explicit GitIgnoreCache(size_t maxEntries);
+  ~GitIgnoreCache();
+
+  /**
+   * Get the parsed contents of the blob with the specified hash.
+   *
+   * Returns nullptr if the blob is not in the cache.
+   */
+  std::shared_ptr<const GitIgnore> get(const Hash& blobHash);
+
+  /**
+   * Record the parsed contents of a blob.
+   */
+  void insert(const Hash& blobHash, std::shared_ptr<const GitIgnore> ignore);
+
+  /**
+   * Get the number of lookups that were answered by the cache.
+   */
+  uint64_t getHitCount() const {
+    return hitCount_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  GitIgnoreCache(const GitIgnoreCache&) = delete;
+  GitIgnoreCache& operator=(const GitIgnoreCache&) = delete;
+
+  std::mutex lock_;
+  folly::EvictingCacheMap<Hash, std::shared_ptr<const GitIgnore>> entries_;
+  std::atomic<uint64_t> hitCount_{0};
+};
+
+} // namespace eden
+} // namespace facebook
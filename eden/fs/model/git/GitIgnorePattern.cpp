@@ -16,6 +16,17 @@ using std::string;
 namespace facebook {
 namespace eden {
 
+namespace {
+bool hasGlobChars(StringPiece text) {
+  for (auto c : text) {
+    if (c == '*' || c == '?' || c == '[' || c == '\\') {
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace
+
 Optional<GitIgnorePattern> GitIgnorePattern::parseLine(StringPiece line) {
   uint32_t flags = 0;
 
@@ -141,11 +152,30 @@ Optional<GitIgnorePattern> GitIgnorePattern::parseLine(StringPiece line) {
     return folly::none;
   }
 
-  return GitIgnorePattern(flags, std::move(matcher).value());
+  auto kind = Kind::GLOB;
+  StringPiece literal;
+  if (!hasGlobChars(line)) {
+    kind = Kind::LITERAL;
+    literal = line;
+  } else if (
+      (flags & FLAG_BASENAME_ONLY) && line.size() > 1 && line[0] == '*' &&
+      !hasGlobChars(line.subpiece(1))) {
+    kind = Kind::SUFFIX;
+    literal = line.subpiece(1);
+  }
+
+  return GitIgnorePattern(flags, std::move(matcher).value(), kind, literal);
 }
 
-GitIgnorePattern::GitIgnorePattern(uint32_t flags, GlobMatcher&& matcher)
-    : flags_(flags), matcher_(std::move(matcher)) {}
+GitIgnorePattern::GitIgnorePattern(
+    uint32_t flags,
+    GlobMatcher&& matcher,
+    Kind kind,
+    StringPiece literal)
+    : flags_(flags),
+      matcher_(std::move(matcher)),
+      kind_(kind),
+      literal_(literal.str()) {}
 
 GitIgnorePattern::~GitIgnorePattern() {}
 
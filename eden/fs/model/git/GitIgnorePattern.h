@@ -11,6 +11,7 @@
 
 #include <folly/Optional.h>
 #include <folly/Range.h>
+#include <string>
 #include "eden/fs/model/git/GitIgnore.h"
 #include "eden/fs/model/git/GlobMatcher.h"
 
@@ -26,6 +27,21 @@ namespace eden {
  */
 class GitIgnorePattern {
  public:
+  /**
+   * Describes patterns that can be matched without running their GlobMatcher,
+   * so that GitIgnore can look them up by name rather than trying each one.
+   */
+  enum class Kind {
+    // The pattern contains no wildcards, and only matches names equal to
+    // getLiteral().
+    LITERAL,
+    // The pattern is "*" followed by getLiteral(), and it only matches
+    // basenames.  It matches any basename ending in getLiteral().
+    SUFFIX,
+    // Any other pattern.
+    GLOB,
+  };
+
   /**
    * Parse a line from a gitignore file.
    *
@@ -72,6 +88,25 @@ class GitIgnorePattern {
       PathComponentPiece basename,
       GitIgnore::FileType fileType) const;
 
+  Kind getKind() const {
+    return kind_;
+  }
+
+  /**
+   * Get the literal text matched by a LITERAL or SUFFIX pattern.
+   */
+  folly::StringPiece getLiteral() const {
+    return literal_;
+  }
+
+  /**
+   * Returns true if this pattern is matched against just the basename, rather
+   * than the full path relative to its .gitignore file.
+   */
+  bool isBasenameOnly() const {
+    return flags_ & FLAG_BASENAME_ONLY;
+  }
+
  private:
   /**
    * Flag values that can be bitwise-ORed to create the flags_ value.
@@ -87,7 +122,11 @@ class GitIgnorePattern {
     FLAG_BASENAME_ONLY = 0x04,
   };
 
-  GitIgnorePattern(uint32_t flags, GlobMatcher&& matcher);
+  GitIgnorePattern(
+      uint32_t flags,
+      GlobMatcher&& matcher,
+      Kind kind,
+      folly::StringPiece literal);
 
   /**
    * A bit set of the Flags defined above.
@@ -97,6 +136,12 @@ class GitIgnorePattern {
    * The GlobMatcher object for performing matching.
    */
   GlobMatcher matcher_;
+  Kind kind_{Kind::GLOB};
+  /**
+   * The text that LITERAL and SUFFIX patterns match.  This is empty for GLOB
+   * patterns.
+   */
+  std::string literal_;
 };
 } // namespace eden
 } // namespace facebook
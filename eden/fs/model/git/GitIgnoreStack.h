@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <memory>
 #include <string>
 #include "eden/fs/model/git/GitIgnore.h"
 #include "eden/fs/utils/PathFuncs.h"
@@ -59,10 +60,25 @@ class GitIgnoreStack {
       const GitIgnoreStack* parent,
       folly::StringPiece ignoreFileContents)
       : parent_{parent} {
-    ignore_.loadFile(ignoreFileContents);
+    auto ignore = std::make_shared<GitIgnore>();
+    ignore->loadFile(ignoreFileContents);
+    ignore_ = std::move(ignore);
   }
 
   GitIgnoreStack(const GitIgnoreStack* parent, GitIgnore ignore)
+      : ignore_{std::make_shared<GitIgnore>(std::move(ignore))},
+        parent_{parent} {}
+
+  /**
+   * Create a new GitIgnoreStack for a directory whose .gitignore file has
+   * already been parsed.
+   *
+   * The GitIgnore object may be shared with other GitIgnoreStacks, including
+   * ones for other directories with identical .gitignore files.
+   */
+  GitIgnoreStack(
+      const GitIgnoreStack* parent,
+      std::shared_ptr<const GitIgnore> ignore)
       : ignore_{std::move(ignore)}, parent_{parent} {}
 
   /**
@@ -73,14 +89,15 @@ class GitIgnoreStack {
       GitIgnore::FileType fileType) const;
 
   bool empty() const {
-    return ignore_.empty();
+    return !ignore_ || ignore_->empty();
   }
 
  private:
   /**
-   * The GitIgnore info for this node on the stack
+   * The GitIgnore info for this node on the stack.
+   * This is null if the directory does not contain a .gitignore file.
    */
-  GitIgnore ignore_;
+  std::shared_ptr<const GitIgnore> ignore_;
 
   /**
    * A pointer to the next node in the stack.
@@ -92,8 +92,10 @@ bool operator&(GlobOptions a, GlobOptions b) {
   return (static_cast<uint32_t>(a) & static_cast<uint32_t>(b)) != 0;
 }
 
+constexpr size_t GlobMatcher::kNoStarChain;
+
 GlobMatcher::GlobMatcher(vector<uint8_t> pattern)
-    : pattern_(std::move(pattern)) {}
+    : pattern_(std::move(pattern)), starChainStart_(findStarChain(pattern_)) {}
 
 GlobMatcher::GlobMatcher() {}
 
@@ -470,9 +472,137 @@ bool GlobMatcher::addCharClass(
 }
 
 bool GlobMatcher::match(StringPiece text) const {
+  if (starChainStart_ != kNoStarChain) {
+    return matchStarChain(text);
+  }
+  return tryMatchAt(text, 0, 0);
+}
+
+bool GlobMatcher::matchInterpreted(StringPiece text) const {
   return tryMatchAt(text, 0, 0);
 }
 
+size_t GlobMatcher::findStarChain(const vector<uint8_t>& pattern) {
+  size_t idx = 0;
+  bool afterStarStarSlash = false;
+  if (pattern.size() >= 2 && pattern[0] == GLOB_STAR_STAR_SLASH) {
+    if (pattern[1] != GLOB_TRUE) {
+      return kNoStarChain;
+    }
+    idx = 2;
+    afterStarStarSlash = true;
+  }
+  const auto start = idx;
+
+  // Literals between two wildcards must not contain a slash.  After a
+  // leading "**/" no literal may contain one, so that the chain can only
+  // ever match the final path component.
+  auto hasSlash = [&](size_t dataIdx, size_t length) {
+    return memchr(pattern.data() + dataIdx, '/', length) != nullptr;
+  };
+
+  if (idx < pattern.size() && pattern[idx] == GLOB_LITERAL) {
+    auto length = pattern[idx + 1];
+    if (afterStarStarSlash && hasSlash(idx + 2, length)) {
+      return kNoStarChain;
+    }
+    idx += 2 + length;
+  }
+
+  size_t numStars = 0;
+  while (idx < pattern.size()) {
+    if (pattern[idx] == GLOB_ENDS_WITH) {
+      auto length = pattern[idx + 2];
+      if (pattern[idx + 1] != GLOB_TRUE ||
+          (afterStarStarSlash && hasSlash(idx + 3, length))) {
+        return kNoStarChain;
+      }
+      // GLOB_ENDS_WITH is always the final opcode.
+      ++numStars;
+      break;
+    }
+    if (pattern[idx] != GLOB_STAR || pattern[idx + 1] != GLOB_TRUE) {
+      return kNoStarChain;
+    }
+    idx += 2;
+    ++numStars;
+    if (idx < pattern.size() && pattern[idx] == GLOB_LITERAL) {
+      auto length = pattern[idx + 1];
+      if (hasSlash(idx + 2, length)) {
+        return kNoStarChain;
+      }
+      idx += 2 + length;
+    }
+  }
+
+  // tryMatchAt() already handles patterns with a single '*' without
+  // backtracking.
+  if (numStars < 2 && !afterStarStarSlash) {
+    return kNoStarChain;
+  }
+  return start;
+}
+
+bool GlobMatcher::matchStarChain(StringPiece text) const {
+  size_t patternIdx = starChainStart_;
+  if (patternIdx != 0) {
+    // The pattern starts with "**/", and the rest of it can only match a
+    // single path component, so only the final component can match.
+    auto lastSlash = text.rfind('/');
+    if (lastSlash != StringPiece::npos) {
+      text.advance(lastSlash + 1);
+    }
+  }
+
+  size_t textIdx = 0;
+  if (patternIdx < pattern_.size() && pattern_[patternIdx] == GLOB_LITERAL) {
+    uint8_t length = pattern_[patternIdx + 1];
+    if (text.size() < length ||
+        0 != memcmp(text.data(), pattern_.data() + patternIdx + 2, length)) {
+      return false;
+    }
+    textIdx = length;
+    patternIdx += 2 + length;
+  }
+
+  auto noSlashUntil = [&](size_t endIdx) {
+    return memchr(text.data() + textIdx, '/', endIdx - textIdx) == nullptr;
+  };
+
+  while (patternIdx < pattern_.size()) {
+    if (pattern_[patternIdx] == GLOB_ENDS_WITH) {
+      uint8_t length = pattern_[patternIdx + 2];
+      if (text.size() - textIdx < length ||
+          0 !=
+              memcmp(
+                  text.end() - length,
+                  pattern_.data() + patternIdx + 3,
+                  length)) {
+        return false;
+      }
+      return noSlashUntil(text.size() - length);
+    }
+
+    // This is a GLOB_STAR.
+    patternIdx += 2;
+    if (patternIdx >= pattern_.size()) {
+      return noSlashUntil(text.size());
+    }
+
+    // The GLOB_LITERAL after it.
+    uint8_t length = pattern_[patternIdx + 1];
+    StringPiece literal{ByteRange(pattern_.data() + patternIdx + 2, length)};
+    patternIdx += 2 + length;
+    auto literalIdx = text.find(literal, textIdx);
+    if (literalIdx == StringPiece::npos || !noSlashUntil(literalIdx)) {
+      return false;
+    }
+    textIdx = literalIdx + length;
+  }
+
+  return textIdx == text.size();
+}
+
 bool GlobMatcher::tryMatchAt(
     StringPiece text,
     size_t textIdx,
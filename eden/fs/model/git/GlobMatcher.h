@@ -78,9 +78,44 @@ class GlobMatcher {
    */
   bool match(folly::StringPiece text) const;
 
+  /**
+   * Match a string against this glob pattern, always using the general
+   * purpose backtracking matcher, even if match() would use a faster
+   * specialized one.
+   *
+   * This returns the same result as match().  It exists for testing and
+   * benchmarking the specialized matchers.
+   */
+  bool matchInterpreted(folly::StringPiece text) const;
+
  private:
+  static constexpr size_t kNoStarChain = ~size_t{0};
+
   explicit GlobMatcher(std::vector<uint8_t> pattern);
 
+  /**
+   * Check whether a pattern buffer is a "star chain": a sequence of literals
+   * separated by '*' wildcards that may match dotfiles, optionally preceded by
+   * a leading "**\/".
+   *
+   * Returns the index in the pattern buffer where the chain starts (after
+   * any leading "**\/"), or kNoStarChain if the pattern is not a star chain
+   * or would not benefit from matchStarChain().
+   */
+  static size_t findStarChain(const std::vector<uint8_t>& pattern);
+
+  /**
+   * Match a star chain pattern without backtracking.
+   *
+   * Since '*' cannot match '/', and none of the literals between two '*'
+   * wildcards contain a '/', matching each of those literals at its leftmost
+   * possible position never rules out a match that a later position would
+   * have found.  This lets us match each literal with a single substring
+   * search, rather than retrying the rest of the pattern after every
+   * candidate position as tryMatchAt() does.
+   */
+  bool matchStarChain(folly::StringPiece text) const;
+
   static folly::Expected<size_t, std::string> parseBracketExpr(
       folly::StringPiece glob,
       size_t idx,
@@ -119,6 +154,11 @@ class GlobMatcher {
    * rather than heap-allocating them in a vector.
    */
   std::vector<uint8_t> pattern_;
+
+  /**
+   * The result of findStarChain() for pattern_.
+   */
+  size_t starChainStart_{kNoStarChain};
 };
 } // namespace eden
 } // namespace facebook
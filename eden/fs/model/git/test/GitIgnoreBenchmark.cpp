@@ -0,0 +1,365 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <folly/init/Init.h>
+#include <folly/stop_watch.h>
+#include <gflags/gflags.h>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "eden/fs/model/git/GitIgnore.h"
+#include "eden/fs/model/git/GitIgnoreStack.h"
+#include "eden/fs/model/git/GlobMatcher.h"
+
+using namespace facebook::eden;
+using folly::StringPiece;
+using std::string;
+using std::vector;
+
+DEFINE_string(
+    gitignore_file,
+    "",
+    "A .gitignore file to match against, instead of the built-in one");
+DEFINE_string(
+    glob_file,
+    "",
+    "A file with one glob pattern per line, instead of the built-in list");
+DEFINE_string(
+    paths_file,
+    "",
+    "A file with one repository-relative path per line, such as the output "
+    "of `hg files`, instead of generated paths");
+DEFINE_int32(paths, 1000000, "Number of paths to generate");
+DEFINE_int32(
+    nested_gitignore_every,
+    50,
+    "Give one in this many generated directories its own .gitignore file, "
+    "or 0 for none");
+
+// Count every allocation so that the results can report allocations per
+// match alongside the time.
+namespace {
+std::atomic<size_t> allocationCount{0};
+} // namespace
+
+void* operator new(size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (auto* ptr = malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+namespace {
+
+/**
+ * A .gitignore in the style of a large monorepo's top-level one: build
+ * output, editor and tool droppings, and a few negated and anchored rules.
+ */
+constexpr StringPiece kRootGitIgnore{
+    "# Build output\n"
+    "/buck-out/\n"
+    "/build/\n"
+    "/_build/\n"
+    "*.o\n"
+    "*.a\n"
+    "*.so\n"
+    "*.pyc\n"
+    "*.pyo\n"
+    "__pycache__/\n"
+    "*.class\n"
+    "*.jar\n"
+    "!/third-party/**/*.jar\n"
+    "node_modules/\n"
+    "/dist/\n"
+    "*.min.js\n"
+    "# Editors and tools\n"
+    ".*.swp\n"
+    ".*.sw?\n"
+    "*~\n"
+    "*#\n"
+    ".#*\n"
+    "*_flymake.*\n"
+    ".idea/\n"
+    ".vscode/\n"
+    "*.iml\n"
+    "tags\n"
+    "TAGS\n"
+    ".DS_Store\n"
+    "# Merge and patch leftovers\n"
+    "*.orig\n"
+    "*.rej\n"
+    "*.orig.*\n"
+    "# Generated sources\n"
+    "**/gen/**/*.cpp\n"
+    "**/gen/**/*.h\n"
+    "!**/gen/**/keep.h\n"
+    "*.pb.cc\n"
+    "*.pb.h\n"
+    "*_pb2.py\n"
+    "/fbcode/**/TARGETS.generated\n"
+    "*.log\n"
+    "!important.log\n"
+    "core.[0-9]*\n"
+    "*.tmp\n"};
+
+/**
+ * The rules of a project-level .gitignore deeper in the tree.
+ */
+constexpr StringPiece kNestedGitIgnore{
+    "/output/\n"
+    "*.generated.*\n"
+    "!keep.generated.h\n"
+    "test-results/\n"
+    "*.bak\n"};
+
+/**
+ * Globs in the style of build-file srcs and resources lists.
+ */
+constexpr StringPiece kBuildGlobs{
+    "**/*.cpp\n"
+    "**/*.h\n"
+    "src/**/*.c\n"
+    "**/test/**/*.py\n"
+    "**/*_test.py\n"
+    "**/*Test.java\n"
+    "lib/*/include/**/*.h\n"
+    "**/resources/**\n"
+    "*.thrift\n"
+    "**/*.[ch]\n"
+    "**/[A-Z]*.java\n"
+    "**/*io*o*\n"
+    "third-party/**/LICENSE*\n"};
+
+constexpr StringPiece kDirNames[] = {
+    "src",     "lib",       "include", "test",         "tests",
+    "gen",     "resources", "docs",    "node_modules", "buck-out",
+    "scripts", "java",      "python",  "third-party",  "tools",
+    "common",  "util",      "service", "client",       "__pycache__",
+};
+
+constexpr StringPiece kFileStems[] = {
+    "main",    "util",    "Server",  "client", "README",    "TARGETS",
+    "handler", "config",  "parser",  "Test",   "LICENSE",   "index",
+    "core.12", "keep",    "request", "types",  "important", "EdenMount",
+};
+
+constexpr StringPiece kFileSuffixes[] = {
+    ".cpp", ".h",     ".py",   ".pyc",    ".java",   ".js",      ".o",
+    ".log", ".thrift", ".txt", ".c.swp",  ".orig",   ".pb.h",    "_test.py",
+    "",     "~",      ".md",   ".min.js", ".tmp",    ".generated.h",
+};
+
+template <typename T, size_t N>
+const T& pick(const T (&array)[N], std::mt19937_64& rng) {
+  return array[rng() % N];
+}
+
+vector<string> readLines(StringPiece contents) {
+  vector<string> lines;
+  folly::split('\n', contents, lines, /* ignoreEmpty */ true);
+  return lines;
+}
+
+string readFileOrDie(const string& path) {
+  string contents;
+  if (!folly::readFile(path.c_str(), contents)) {
+    fprintf(stderr, "error: unable to read %s\n", path.c_str());
+    exit(1);
+  }
+  return contents;
+}
+
+/**
+ * Generate paths from a random walk over a directory tree built from
+ * common directory and file names, so that the corpus has the mix of depths,
+ * extensions and ignored directories that a real repository has.
+ */
+vector<string> generatePaths(size_t count) {
+  std::mt19937_64 rng{1};
+  vector<string> paths;
+  paths.reserve(count);
+  while (paths.size() < count) {
+    string dir;
+    auto depth = 1 + rng() % 8;
+    for (size_t n = 0; n < depth; ++n) {
+      dir += pick(kDirNames, rng).str();
+      dir += folly::to<string>(rng() % 4);
+      dir += '/';
+    }
+    // Emit a whole directory's worth of files at once, as a walk would.
+    auto files = 1 + rng() % 16;
+    for (size_t n = 0; n < files && paths.size() < count; ++n) {
+      paths.push_back(folly::to<string>(
+          dir, pick(kFileStems, rng), pick(kFileSuffixes, rng)));
+    }
+  }
+  return paths;
+}
+
+vector<string> loadPaths() {
+  if (FLAGS_paths_file.empty()) {
+    return generatePaths(FLAGS_paths);
+  }
+  return readLines(readFileOrDie(FLAGS_paths_file));
+}
+
+void report(
+    StringPiece name,
+    size_t matches,
+    size_t hits,
+    std::chrono::nanoseconds elapsed,
+    size_t allocations) {
+  printf(
+      "%-24s %10zu matches %8.1f ns/match %6.3f allocs/match %5.1f%% hit\n",
+      name.str().c_str(),
+      matches,
+      static_cast<double>(elapsed.count()) / matches,
+      static_cast<double>(allocations) / matches,
+      100.0 * hits / matches);
+}
+
+/**
+ * Match every path against every glob, the way a build tool expands a list
+ * of globs over the files of a package.
+ */
+void benchmarkGlobMatcher(const vector<string>& paths) {
+  auto globs = readLines(
+      FLAGS_glob_file.empty() ? kBuildGlobs.str()
+                              : readFileOrDie(FLAGS_glob_file));
+  vector<GlobMatcher> matchers;
+  for (const auto& glob : globs) {
+    auto matcher = GlobMatcher::create(glob, GlobOptions::DEFAULT);
+    if (matcher.hasError()) {
+      // Skip patterns our syntax does not support, such as brace expansion,
+      // rather than failing on a real-world list.
+      fprintf(
+          stderr,
+          "skipping glob \"%s\": %s\n",
+          glob.c_str(),
+          matcher.error().c_str());
+      continue;
+    }
+    matchers.push_back(std::move(matcher).value());
+  }
+
+  size_t hits = 0;
+  auto allocations = allocationCount.load();
+  folly::stop_watch<std::chrono::nanoseconds> timer;
+  for (const auto& path : paths) {
+    for (const auto& matcher : matchers) {
+      hits += matcher.match(path);
+    }
+  }
+  auto elapsed = timer.elapsed();
+  report(
+      "GlobMatcher::match",
+      paths.size() * matchers.size(),
+      hits,
+      elapsed,
+      allocationCount.load() - allocations);
+}
+
+StringPiece parentDir(StringPiece path) {
+  auto slash = path.rfind('/');
+  return slash == StringPiece::npos ? StringPiece{} : path.subpiece(0, slash);
+}
+
+/**
+ * Holds one GitIgnoreStack per directory, as the status code builds them
+ * while it walks the tree.
+ */
+class IgnoreStacks {
+ public:
+  IgnoreStacks() {
+    auto contents = FLAGS_gitignore_file.empty()
+        ? kRootGitIgnore.str()
+        : readFileOrDie(FLAGS_gitignore_file);
+    nested_ = std::make_shared<GitIgnore>();
+    nested_->loadFile(kNestedGitIgnore);
+    stacks_.emplace(
+        "", std::make_unique<GitIgnoreStack>(nullptr, contents));
+  }
+
+  const GitIgnoreStack* get(StringPiece dir) {
+    auto it = stacks_.find(dir.str());
+    if (it != stacks_.end()) {
+      return it->second.get();
+    }
+    auto parent = get(parentDir(dir));
+    std::unique_ptr<GitIgnoreStack> stack;
+    if (FLAGS_nested_gitignore_every > 0 &&
+        ++dirCount_ % FLAGS_nested_gitignore_every == 0) {
+      stack = std::make_unique<GitIgnoreStack>(parent, nested_);
+    } else {
+      stack = std::make_unique<GitIgnoreStack>(parent);
+    }
+    auto* result = stack.get();
+    stacks_.emplace(dir.str(), std::move(stack));
+    return result;
+  }
+
+ private:
+  std::shared_ptr<GitIgnore> nested_;
+  std::unordered_map<string, std::unique_ptr<GitIgnoreStack>> stacks_;
+  size_t dirCount_{0};
+};
+
+void benchmarkGitIgnoreStack(const vector<string>& paths) {
+  // Build the stacks before timing, so that only match() is measured.
+  IgnoreStacks stacks;
+  vector<std::pair<const GitIgnoreStack*, RelativePathPiece>> inputs;
+  inputs.reserve(paths.size());
+  for (const auto& path : paths) {
+    inputs.emplace_back(stacks.get(parentDir(path)), RelativePathPiece{path});
+  }
+
+  size_t hits = 0;
+  auto allocations = allocationCount.load();
+  folly::stop_watch<std::chrono::nanoseconds> timer;
+  for (const auto& input : inputs) {
+    auto result = input.first->match(input.second, GitIgnore::TYPE_FILE);
+    hits += (result == GitIgnore::EXCLUDE);
+  }
+  auto elapsed = timer.elapsed();
+  report(
+      "GitIgnoreStack::match",
+      inputs.size(),
+      hits,
+      elapsed,
+      allocationCount.load() - allocations);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  auto paths = loadPaths();
+  printf("%zu paths\n", paths.size());
+  benchmarkGlobMatcher(paths);
+  benchmarkGitIgnoreStack(paths);
+  return 0;
+}
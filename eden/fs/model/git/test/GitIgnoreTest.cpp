@@ -668,3 +668,37 @@ TEST(GitIgnore, directory) {
   // path known to be a file.  It expects ignored directories earlier in the
   // path to have already been filtered out.
 }
+
+TEST(GitIgnore, indexedRulesKeepPrecedence) {
+  GitIgnore ignore;
+  ignore.loadFile(
+      "*.log\n"
+      "!keep.log\n"
+      "keep*\n"
+      "*.tar.gz\n"
+      "!src/release.tar.gz\n"
+      "*~\n"
+      "!*.keep~\n"
+      "build\n"
+      "!/build/\n");
+
+  EXPECT_IGNORE(ignore, EXCLUDE, "debug.log");
+  EXPECT_IGNORE(ignore, EXCLUDE, "src/debug.log");
+  EXPECT_IGNORE(ignore, EXCLUDE, ".log");
+  // The later "keep*" glob wins over the earlier "!keep.log" literal.
+  EXPECT_IGNORE(ignore, EXCLUDE, "keep.log");
+  EXPECT_IGNORE(ignore, EXCLUDE, "keepsake");
+  EXPECT_IGNORE(ignore, NO_MATCH, "debug.log2");
+
+  EXPECT_IGNORE(ignore, EXCLUDE, "out.tar.gz");
+  EXPECT_IGNORE(ignore, NO_MATCH, "out.gz");
+  EXPECT_IGNORE(ignore, INCLUDE, "src/release.tar.gz");
+  EXPECT_IGNORE(ignore, EXCLUDE, "release.tar.gz");
+
+  EXPECT_IGNORE(ignore, EXCLUDE, "notes~");
+  EXPECT_IGNORE(ignore, INCLUDE, "notes.keep~");
+
+  EXPECT_IGNORE(ignore, EXCLUDE, "build");
+  EXPECT_IGNORE_DIR(ignore, INCLUDE, "build");
+  EXPECT_IGNORE_DIR(ignore, EXCLUDE, "src/build");
+}
@@ -87,6 +87,24 @@ class GlobMatcherImpl {
   GlobMatcher matcher_;
 };
 
+/**
+ * GlobMatcher, but always using the general purpose backtracking matcher.
+ */
+class GlobMatcherInterpretedImpl {
+ public:
+  GlobMatcherInterpretedImpl() {}
+  void init(folly::StringPiece glob) {
+    matcher_ = GlobMatcher::create(glob, GlobOptions::DEFAULT).value();
+  }
+
+  bool match(folly::StringPiece input) {
+    return matcher_.matchInterpreted(input);
+  }
+
+ private:
+  GlobMatcher matcher_;
+};
+
 class WildmatchImpl {
  public:
   WildmatchImpl() {}
@@ -249,6 +267,63 @@ BENCHMARK_RELATIVE(fullpath_re2, numIters) {
   runBenchmark<RE2Impl>(numIters, ".*/[^/]io[^/]*o[^/]*", fullnameCorpus);
 }
 
+// Patterns with several '*' wildcards, taken from real .gitignore files.
+BENCHMARK(multiStar_globmatch, numIters) {
+  runBenchmark<GlobMatcherImpl>(numIters, "*_flymake.*", basenameCorpus);
+}
+
+BENCHMARK_RELATIVE(multiStar_interpreted, numIters) {
+  runBenchmark<GlobMatcherInterpretedImpl>(
+      numIters, "*_flymake.*", basenameCorpus);
+}
+
+BENCHMARK_RELATIVE(multiStar_wildmatch, numIters) {
+  runBenchmark<WildmatchImpl>(numIters, "*_flymake.*", basenameCorpus);
+}
+
+BENCHMARK(multiStar2_globmatch, numIters) {
+  runBenchmark<GlobMatcherImpl>(numIters, "*.orig.*", fullnameCorpus);
+}
+
+BENCHMARK_RELATIVE(multiStar2_interpreted, numIters) {
+  runBenchmark<GlobMatcherInterpretedImpl>(
+      numIters, "*.orig.*", fullnameCorpus);
+}
+
+BENCHMARK_RELATIVE(multiStar2_wildmatch, numIters) {
+  runBenchmark<WildmatchImpl>(numIters, "*.orig.*", fullnameCorpus);
+}
+
+BENCHMARK(fullpathStarChain_globmatch, numIters) {
+  runBenchmark<GlobMatcherImpl>(numIters, "**/*io*o*", fullnameCorpus);
+}
+
+BENCHMARK_RELATIVE(fullpathStarChain_interpreted, numIters) {
+  runBenchmark<GlobMatcherInterpretedImpl>(
+      numIters, "**/*io*o*", fullnameCorpus);
+}
+
+// A pattern that makes a backtracking matcher retry many candidate positions
+// for each '*' on a long file name.
+std::vector<folly::StringPiece> repetitiveCorpus = {
+    "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa.log",
+    "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa_a_a.log.b",
+    "ab_ab_ab_ab_ab_ab_ab_ab_ab_ab_ab",
+};
+
+BENCHMARK(pathological_globmatch, numIters) {
+  runBenchmark<GlobMatcherImpl>(numIters, "*a*a*a*b", repetitiveCorpus);
+}
+
+BENCHMARK_RELATIVE(pathological_interpreted, numIters) {
+  runBenchmark<GlobMatcherInterpretedImpl>(
+      numIters, "*a*a*a*b", repetitiveCorpus);
+}
+
+BENCHMARK_RELATIVE(pathological_wildmatch, numIters) {
+  runBenchmark<WildmatchImpl>(numIters, "*a*a*a*b", repetitiveCorpus);
+}
+
 void initGlobBenchmark();
 
 int main(int argc, char* argv[]) {
@@ -8,6 +8,7 @@
  *
  */
 #include <gtest/gtest.h>
+#include <string>
 
 #include "eden/fs/model/git/GlobMatcher.h"
 
@@ -19,17 +20,22 @@ using folly::StringPiece;
 // due to a gcc / gtest bug: https://github.com/google/googletest/issues/322
 // We have to explicitly break this out in to separate EXPECT_TRUE /
 // EXPECT_FALSE checks.
-#define EXPECT_MATCH_IMPL(text, glob, options, expected)   \
-  do {                                                     \
-    auto matcher = GlobMatcher::create(glob, options);     \
-    if (!matcher.hasValue()) {                             \
-      ADD_FAILURE() << "failed to compile glob \"" << glob \
-                    << "\": " << matcher.error();          \
-    } else if (expected) {                                 \
-      EXPECT_TRUE(matcher.value().match(text));            \
-    } else {                                               \
-      EXPECT_FALSE(matcher.value().match(text));           \
-    }                                                      \
+//
+// We also check that matchInterpreted() agrees, since match() may use a
+// specialized matcher for some patterns.
+#define EXPECT_MATCH_IMPL(text, glob, options, expected)     \
+  do {                                                       \
+    auto matcher = GlobMatcher::create(glob, options);       \
+    if (!matcher.hasValue()) {                               \
+      ADD_FAILURE() << "failed to compile glob \"" << glob   \
+                    << "\": " << matcher.error();            \
+    } else if (expected) {                                   \
+      EXPECT_TRUE(matcher.value().match(text));              \
+      EXPECT_TRUE(matcher.value().matchInterpreted(text));   \
+    } else {                                                 \
+      EXPECT_FALSE(matcher.value().match(text));             \
+      EXPECT_FALSE(matcher.value().matchInterpreted(text));  \
+    }                                                        \
   } while (0)
 #define EXPECT_MATCH(text, glob) \
   EXPECT_MATCH_IMPL(text, glob, GlobOptions::DEFAULT, true)
@@ -330,6 +336,47 @@ TEST(Glob, testOther) {
   EXPECT_NOMATCH("foo\x9atest", "foo[\xa0-\xaf]test");
 }
 
+TEST(Glob, testStarChains) {
+  // Patterns made up of literals separated by '*' are matched without
+  // backtracking.
+  EXPECT_MATCH("foo.orig.cpp", "*.orig.*");
+  EXPECT_NOMATCH("foo.orig", "*.orig.*");
+  EXPECT_NOMATCH("dir.orig./foo", "*.orig.*");
+  EXPECT_MATCH("#notes.txt#", "#*#");
+  EXPECT_MATCH("a_flymake.b_flymake.c", "*_flymake.*");
+  EXPECT_MATCH("abcabd", "*ab*d");
+  EXPECT_MATCH("abcab", "*ab*b");
+  EXPECT_MATCH("abb", "*ab*b");
+  EXPECT_NOMATCH("ab", "*ab*b");
+  EXPECT_MATCH("prefix_x_y_suffix", "prefix*x*y*suffix");
+  EXPECT_NOMATCH("prefix_x_y_suffi", "prefix*x*y*suffix");
+  EXPECT_NOMATCH("prefix/x_y_suffix", "prefix*x*y*suffix");
+  EXPECT_MATCH("dir/prefix_x_y_suffix", "dir/prefix*x*y*suffix");
+  EXPECT_MATCH("x_y/z", "*x*y/z");
+  EXPECT_NOMATCH("a/x_y/z", "*x*y/z");
+
+  // A leading "**/" followed by a chain matches the final path component.
+  EXPECT_MATCH("kernel/irq/radio_tool.c", "**/*io*o*");
+  EXPECT_MATCH("radio_tool.c", "**/*io*o*");
+  EXPECT_NOMATCH("radio.c", "**/*io*o*");
+  EXPECT_NOMATCH("radio/x.c", "**/*io*o*");
+  EXPECT_MATCH("a/b/foo_test.py", "**/foo*.py");
+  EXPECT_NOMATCH("a/foo/test.py", "**/foo*.py");
+
+  // Backtracking takes exponential time on this pattern, so only check
+  // match() and not matchInterpreted().
+  auto matcher =
+      GlobMatcher::create("*a*a*a*a*a*a*a*a*a*a*b", GlobOptions::DEFAULT)
+          .value();
+  std::string longText(200, 'a');
+  EXPECT_FALSE(matcher.match(longText));
+  EXPECT_TRUE(matcher.match(longText + "b"));
+
+  // With IGNORE_DOTFILES the chain is handled by the general matcher.
+  EXPECT_IGNORE_DOTFILES_NOMATCH(".a_b", "*a*b");
+  EXPECT_IGNORE_DOTFILES_MATCH("xa_b", "*a*b");
+}
+
 void testCharClass(StringPiece name, int (*libcFn)(int)) {
   auto matcher =
       GlobMatcher::create("[[:" + name.str() + ":]]", GlobOptions::DEFAULT)
@@ -173,6 +173,23 @@ TEST(Hash, sha1ByteRange) {
       Hash::sha1(ByteRange(data.data(), data.size())));
 }
 
+TEST(Hash, sha1BatchMatchesSha1) {
+  auto chain = IOBuf::copyBuffer(StringPiece("abcdefghijklmnopqrstuvwxyz"));
+  chain->appendChain(IOBuf::create(10));
+  chain->appendChain(IOBuf::copyBuffer(StringPiece("1234567890")));
+  auto empty = IOBuf::create(0);
+  auto large = IOBuf::copyBuffer(std::string(1000, 'x'));
+
+  std::vector<const IOBuf*> bufs{chain.get(), empty.get(), large.get()};
+  auto hashes = Hash::sha1Batch(folly::range(bufs));
+  ASSERT_EQ(3, hashes.size());
+  for (size_t n = 0; n < bufs.size(); ++n) {
+    EXPECT_EQ(Hash::sha1(bufs[n]), hashes[n]);
+  }
+  EXPECT_EQ(Hash("da39a3ee5e6b4b0d3255bfef95601890afd80709"), hashes[1]);
+  EXPECT_TRUE(Hash::sha1Batch({}).empty());
+}
+
 TEST(Hash, assignment) {
   Hash h1;
   Hash h2("0123456789abcdeffedcba987654321076543210");
@@ -190,3 +207,27 @@ TEST(Hash, getHashCode) {
   // using 64 bits of data to contribute to the hash code.
   EXPECT_EQ(folly::Endian::big(0xfaceb00cdeadbeef), testHash.getHashCode());
 }
+
+TEST(Hash, compareEachByte) {
+  // Equality and ordering compare a word at a time, so check that a
+  // difference in any byte is seen, and that the order is the byte order.
+  Hash::Storage base;
+  base.fill(0x80);
+  const Hash baseHash{base};
+  for (size_t index = 0; index < Hash::RAW_SIZE; ++index) {
+    auto bytes = base;
+    bytes[index] = 0x81;
+    Hash larger{bytes};
+    EXPECT_NE(baseHash, larger) << "at byte " << index;
+    EXPECT_LT(baseHash, larger) << "at byte " << index;
+    EXPECT_FALSE(larger < baseHash) << "at byte " << index;
+
+    // A later byte must not override an earlier one.
+    if (index + 1 < Hash::RAW_SIZE) {
+      bytes[index + 1] = 0;
+      EXPECT_LT(baseHash, Hash{bytes}) << "at byte " << index;
+    }
+  }
+  EXPECT_FALSE(baseHash < baseHash);
+  EXPECT_EQ(testHash, Hash{testHashHex});
+}
@@ -51,3 +51,23 @@ TEST(Tree, testGetEntryPtr) {
   PathComponentPiece nonExistentPath("not_a_file");
   EXPECT_EQ(nullptr, tree.getEntryPtr(nonExistentPath));
 }
+
+TEST(Tree, getSizeBytesOnlyCountsOutOfLineNames) {
+  vector<TreeEntry> shortEntries;
+  shortEntries.emplace_back(testHash, "BUCK", TreeEntryType::REGULAR_FILE);
+  shortEntries.emplace_back(
+      testHash, "__init__.py", TreeEntryType::REGULAR_FILE);
+  Tree shortTree(std::move(shortEntries));
+  EXPECT_EQ(
+      sizeof(Tree) + shortTree.getTreeEntries().capacity() * sizeof(TreeEntry),
+      shortTree.getSizeBytes());
+
+  string longName(40, 'x');
+  vector<TreeEntry> longEntries;
+  longEntries.emplace_back(testHash, longName, TreeEntryType::REGULAR_FILE);
+  Tree longTree(std::move(longEntries));
+  EXPECT_EQ(
+      sizeof(Tree) + longTree.getTreeEntries().capacity() * sizeof(TreeEntry) +
+          longName.size() + 1,
+      longTree.getSizeBytes());
+}
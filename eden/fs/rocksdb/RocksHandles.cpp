@@ -41,6 +41,11 @@ RocksHandles::RocksHandles(
   options.create_if_missing = true;
   // Automatically create column families as we define new ones.
   options.create_missing_column_families = true;
+  // Count the tickers reported in EdenServer's stats, such as block cache
+  // hits.  The detailed timers cost more than they are worth here.
+  statistics = rocksdb::CreateDBStatistics();
+  statistics->stats_level_ = rocksdb::kExceptDetailedTimers;
+  options.statistics = statistics;
 
   DB* dbRaw;
   columns.reserve(columnDescriptors.size());
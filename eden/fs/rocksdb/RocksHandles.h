@@ -11,6 +11,7 @@
 
 #include <folly/String.h>
 #include <rocksdb/db.h>
+#include <rocksdb/statistics.h>
 #include <memory>
 #include <string>
 
@@ -31,6 +32,9 @@ struct RocksHandles {
   // as column_descriptors to createRocksDb().
   std::vector<std::unique_ptr<rocksdb::ColumnFamilyHandle>> columns;
 
+  // The DB's ticker counts, such as block cache hits and misses.
+  std::shared_ptr<rocksdb::Statistics> statistics;
+
   /**
    * Note that the columns MUST be destroyed prior to the DB,
    * so we have a custom destructor for that purpose.
@@ -9,15 +9,117 @@
  */
 #include "eden/fs/service/EdenCPUThreadPool.h"
 
+#include <folly/Conv.h>
 #include <gflags/gflags.h>
+#include <chrono>
 
 DEFINE_int32(num_eden_threads, 12, "the number of eden CPU worker threads");
+DEFINE_int32(
+    num_eden_background_threads,
+    4,
+    "the number of eden worker threads for bulk background work");
+DEFINE_int32(
+    num_eden_overlay_io_threads,
+    8,
+    "the number of eden threads that read and write files in the overlay.  "
+    "If 0, overlay I/O runs on the thread that handles the FUSE request");
+DEFINE_bool(
+    work_stealing_thread_pools,
+    false,
+    "Give each eden worker thread its own task queue, stealing from the "
+    "others when it runs out, rather than sharing one queue");
+DEFINE_string(
+    eden_thread_affinity,
+    "",
+    "The CPUs the eden CPU worker threads may run on: a CPU list like "
+    "\"0-7,16-23\", or \"node:\" followed by a list of NUMA nodes.  Empty "
+    "lets them run anywhere");
+DEFINE_string(
+    eden_background_thread_affinity,
+    "",
+    "The CPUs the eden background worker threads may run on, in the same "
+    "form as --eden_thread_affinity");
+DEFINE_string(
+    eden_overlay_io_thread_affinity,
+    "",
+    "The CPUs the eden overlay I/O threads may run on, in the same form as "
+    "--eden_thread_affinity");
+
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
 
 namespace facebook {
 namespace eden {
 
-EdenCPUThreadPool::EdenCPUThreadPool()
-    : UnboundedQueueExecutor(FLAGS_num_eden_threads, "EdenCPUThread") {}
+namespace {
+// Queue latency is tracked in microseconds, up to 100ms.
+constexpr microseconds kMinValue{0};
+constexpr microseconds kMaxValue{100000};
+constexpr microseconds kBucketSize{1000};
+} // namespace
+
+EdenCPUThreadPool::EdenCPUThreadPool(
+    size_t numThreads,
+    folly::StringPiece threadNamePrefix,
+    folly::StringPiece statsPrefix,
+    const CpuAffinity& affinity)
+    : UnboundedQueueExecutor(
+          numThreads,
+          threadNamePrefix,
+          FLAGS_work_stealing_thread_pools ? QueueType::WorkStealing
+                                           : QueueType::Shared,
+          affinity),
+      queueLatency_{&stats_,
+                    folly::to<std::string>(statsPrefix, ".queue_latency_us"),
+                    static_cast<size_t>(kBucketSize.count()),
+                    kMinValue.count(),
+                    kMaxValue.count(),
+                    facebook::stats::COUNT,
+                    50,
+                    90,
+                    99} {}
+
+std::shared_ptr<EdenCPUThreadPool> EdenCPUThreadPool::createInteractivePool() {
+  return std::make_shared<EdenCPUThreadPool>(
+      FLAGS_num_eden_threads,
+      "EdenCPUThread",
+      "thread_pool.interactive",
+      CpuAffinity::parse(FLAGS_eden_thread_affinity));
+}
+
+std::shared_ptr<EdenCPUThreadPool> EdenCPUThreadPool::createBackgroundPool() {
+  return std::make_shared<EdenCPUThreadPool>(
+      FLAGS_num_eden_background_threads,
+      "EdenBgThread",
+      "thread_pool.background",
+      CpuAffinity::parse(FLAGS_eden_background_thread_affinity));
+}
+
+std::shared_ptr<EdenCPUThreadPool> EdenCPUThreadPool::createOverlayIoPool() {
+  if (FLAGS_num_eden_overlay_io_threads <= 0) {
+    return nullptr;
+  }
+  return std::make_shared<EdenCPUThreadPool>(
+      FLAGS_num_eden_overlay_io_threads,
+      "EdenOverlayIo",
+      "thread_pool.overlay_io",
+      CpuAffinity::parse(FLAGS_eden_overlay_io_thread_affinity));
+}
+
+void EdenCPUThreadPool::add(folly::Func func) {
+  UnboundedQueueExecutor::add(
+      [this, func = std::move(func), enqueued = steady_clock::now()]() mutable {
+        queueLatency_.addValue(
+            std::chrono::duration_cast<microseconds>(
+                steady_clock::now() - enqueued)
+                .count());
+        func();
+      });
+}
+
+void EdenCPUThreadPool::aggregateStats() {
+  stats_.aggregate();
+}
 
 } // namespace eden
 } // namespace facebook
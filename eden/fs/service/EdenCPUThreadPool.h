@@ -9,15 +9,64 @@
  */
 #pragma once
 
+#include <folly/Range.h>
+#include <memory>
+#include "common/stats/ThreadLocalStats.h"
 #include "eden/fs/utils/UnboundedQueueExecutor.h"
 
 namespace facebook {
 namespace eden {
 
-// The Eden CPU thread pool is intended for miscellaneous background tasks.
+/**
+ * The thread pools EdenServer gives to ServerState.
+ *
+ * Work is split into classes so that bulk requests cannot delay
+ * interactive ones:
+ *
+ * - The interactive pool, sized by --num_eden_threads, runs FUSE request
+ *   continuations and backing store callbacks.
+ * - The background pool, sized by --num_eden_background_threads, runs glob
+ *   evaluation and prefetching, diffs between commits, and local store
+ *   garbage collection.
+ * - The overlay I/O pool, sized by --num_eden_overlay_io_threads, reads,
+ *   writes and syncs materialized files, so that a slow disk blocks these
+ *   threads rather than the FUSE workers.
+ *
+ * Thrift handlers run on the thrift server's own worker threads.
+ *
+ * Each pool records how long tasks wait in its queue before starting, in
+ * the <statsPrefix>.queue_latency_us histogram.
+ *
+ * The threads of each pool can be restricted to a set of CPUs or NUMA nodes
+ * with --eden_thread_affinity, --eden_background_thread_affinity and
+ * --eden_overlay_io_thread_affinity.  The create functions throw
+ * std::invalid_argument if the setting for their pool is malformed.
+ */
 class EdenCPUThreadPool : public UnboundedQueueExecutor {
  public:
-  explicit EdenCPUThreadPool();
+  EdenCPUThreadPool(
+      size_t numThreads,
+      folly::StringPiece threadNamePrefix,
+      folly::StringPiece statsPrefix,
+      const CpuAffinity& affinity = CpuAffinity{});
+
+  static std::shared_ptr<EdenCPUThreadPool> createInteractivePool();
+  static std::shared_ptr<EdenCPUThreadPool> createBackgroundPool();
+  /** Returns nullptr if --num_eden_overlay_io_threads is 0. */
+  static std::shared_ptr<EdenCPUThreadPool> createOverlayIoPool();
+
+  void add(folly::Func func) override;
+
+  /** Flush this pool's thread-local stats to the main ServiceData. */
+  void aggregateStats();
+
+ private:
+  using Stats =
+      facebook::stats::ThreadLocalStatsT<facebook::stats::TLStatsThreadSafe>;
+
+  // This must be declared before queueLatency_, which refers to it.
+  Stats stats_;
+  Stats::TLHistogram queueLatency_;
 };
 
 } // namespace eden
@@ -19,6 +19,8 @@
 #include <folly/stop_watch.h>
 #include <gflags/gflags.h>
 #include <signal.h>
+#include <algorithm>
+#include <atomic>
 #include <thrift/lib/cpp/concurrency/ThreadManager.h>
 #include <thrift/lib/cpp2/server/ThriftServer.h>
 
@@ -32,23 +34,32 @@
 #include "eden/fs/inodes/EdenDispatcher.h"
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/InodeMap.h"
+#include "eden/fs/inodes/InodeTable.h"
+#include "eden/fs/inodes/Overlay.h"
 #include "eden/fs/inodes/TreeInode.h"
 #include "eden/fs/service/EdenCPUThreadPool.h"
 #include "eden/fs/service/EdenServiceHandler.h"
+#include "eden/fs/service/PrefetchLimiter.h"
 #include "eden/fs/service/StartupLogger.h"
+#include "eden/fs/store/CachingBackingStore.h"
 #include "eden/fs/store/EmptyBackingStore.h"
 #include "eden/fs/store/LocalStore.h"
 #include "eden/fs/store/MemoryLocalStore.h"
+#include "eden/fs/store/NegativeCache.h"
 #include "eden/fs/store/ObjectStore.h"
 #include "eden/fs/store/RocksDbLocalStore.h"
 #include "eden/fs/store/SqliteLocalStore.h"
+#include "eden/fs/store/TieredLocalStore.h"
+#include "eden/fs/store/TreeSnapshot.h"
 #include "eden/fs/store/git/GitBackingStore.h"
 #include "eden/fs/store/hg/HgBackingStore.h"
 #include "eden/fs/takeover/TakeoverClient.h"
 #include "eden/fs/takeover/TakeoverData.h"
 #include "eden/fs/takeover/TakeoverServer.h"
 #include "eden/fs/utils/Clock.h"
+#include "eden/fs/utils/LockProfiler.h"
 #include "eden/fs/utils/ProcUtil.h"
+#include "eden/fs/utils/UnboundedQueueExecutor.h"
 
 DEFINE_bool(
     debug,
@@ -88,6 +99,90 @@ DEFINE_int64(
     unload_age_minutes,
     60,
     "Minimum age of the inodes to be unloaded");
+DEFINE_int64(
+    unload_rss_target_mb,
+    0,
+    "If non-zero, unload inodes sooner, and with a shorter minimum age, "
+    "whenever the RSS of this process is above this many megabytes");
+DEFINE_int64(
+    unload_rss_check_interval_seconds,
+    60,
+    "How often to compare our RSS against --unload_rss_target_mb");
+DEFINE_int64(
+    blob_idle_release_seconds,
+    300,
+    "Release the source control data held in memory for an open file once "
+    "it has not been read for this many seconds.  The next read loads it "
+    "again from the local store.  0 disables this");
+DEFINE_int64(
+    loaded_blob_target_mb,
+    0,
+    "If non-zero, whenever the open files of a mount hold more than this "
+    "many megabytes of source control data, release the data of the files "
+    "that have not been read since the last check");
+DEFINE_int64(
+    mount_hibernate_idle_minutes,
+    0,
+    "Hibernate a mount once it has had no FUSE requests or thrift calls for "
+    "this many minutes: unload all of its unreferenced inodes, drop its "
+    "caches and shrink its journal.  It wakes on the next access.  "
+    "0 disables hibernation");
+DEFINE_uint64(
+    hibernate_journal_memory_limit,
+    8 * 1024 * 1024,
+    "The estimated number of bytes that the journal of a hibernating mount "
+    "keeps; older entries are dropped");
+DEFINE_string(
+    prefetch_bookmarks,
+    "",
+    "Comma-separated revision names, such as remote bookmarks, whose root "
+    "trees are imported ahead of time whenever they move");
+DEFINE_int64(
+    bookmark_prefetch_interval_seconds,
+    300,
+    "How often to check whether the --prefetch_bookmarks have moved");
+DEFINE_int32(
+    startup_mount_parallelism,
+    4,
+    "The number of checkouts to remount at once during startup");
+DEFINE_int64(
+    max_prefetch_blobs_in_flight,
+    1000000,
+    "The number of blobs that thrift clients may have queued for "
+    "prefetching at once, or 0 for no limit");
+DEFINE_int64(
+    max_prefetch_blobs_per_client,
+    250000,
+    "The number of blobs that each thrift connection may have queued for "
+    "prefetching at once, or 0 for no limit");
+DEFINE_string(
+    tree_snapshot,
+    "",
+    "The absolute path of a tree snapshot written by "
+    "'eden debug export_tree_snapshot'.  Trees are read from it, rather than "
+    "from the local or backing store, whenever it contains them.");
+DEFINE_string(
+    shared_local_store,
+    "",
+    "The absolute path of a SQLite database to share imported trees and "
+    "blobs through with the other edenfs processes on this machine.  It is "
+    "consulted when the local store misses, before the backing store, and "
+    "everything imported is written to it.  Every user of it must be able "
+    "to write to its directory, and must trust the others not to corrupt "
+    "it.");
+DEFINE_int64(
+    write_buffer_flush_ms,
+    1000,
+    "With --write_buffer_size, how often to write the writes buffered for "
+    "open files to the overlay, bounding how long they stay in memory");
+DEFINE_int32(
+    lock_profiling_sample_rate,
+    0,
+    "Record the wait and hold times of one in every N acquisitions of the "
+    "profiled locks, such as the InodeMap and Journal locks, or 0 to "
+    "disable lock profiling.  debugSetLockProfiling changes it at runtime.");
+
+DECLARE_uint64(write_buffer_size);
 
 using apache::thrift::ThriftServer;
 using facebook::eden::FuseChannelData;
@@ -110,7 +205,92 @@ constexpr StringPiece kLockFileName{"lock"};
 constexpr StringPiece kThriftSocketName{"socket"};
 constexpr StringPiece kTakeoverSocketName{"takeover"};
 constexpr StringPiece kRocksDBPath{"storage/rocks-db"};
+// How often to look for the blobs of idle open files to release.
+constexpr std::chrono::seconds kBlobReleaseInterval{30};
+// How often to look for idle mounts to hibernate.
+constexpr std::chrono::seconds kHibernationCheckInterval{60};
 constexpr StringPiece kSqlitePath{"storage/sqlite.db"};
+
+constexpr StringPiece kTreeCacheStatsPrefix{"object_store.tree_cache."};
+constexpr StringPiece kBlobCacheStatsPrefix{"object_store.blob_cache."};
+constexpr StringPiece kNegativeCacheHitsCounterKey{
+    "object_store.negative_cache.hits"};
+constexpr StringPiece kLocalStoreGCEvictionCounterKey{
+    "local_store.gc.evicted"};
+constexpr StringPiece kLocalStoreMemoryCounterKey{"local_store.memory"};
+
+folly::Optional<uint64_t> getRssBytes() {
+  auto rssKBytes = proc_util::getUnsignedLongLongValue(
+      proc_util::loadProcStatus(), kVmRSSKey.data(), kKBytes.data());
+  if (!rssKBytes) {
+    return folly::none;
+  }
+  return rssKBytes.value() * 1024;
+}
+
+template <typename Cache>
+void registerCacheCounters(
+    StringPiece prefix,
+    const std::shared_ptr<Cache>& cache) {
+  auto counters = facebook::stats::ServiceData::get()->getDynamicCounters();
+  auto registerCounter = [&](StringPiece name, auto getValue) {
+    counters->registerCallback(
+        folly::to<string>(prefix, name),
+        [cache, getValue] { return getValue(cache->getStats()); });
+  };
+  using Stats = typename Cache::Stats;
+  registerCounter("hits", [](const Stats& stats) { return stats.hitCount; });
+  registerCounter(
+      "misses", [](const Stats& stats) { return stats.missCount; });
+  registerCounter(
+      "evictions", [](const Stats& stats) { return stats.evictionCount; });
+  registerCounter(
+      "objects", [](const Stats& stats) { return stats.objectCount; });
+  registerCounter(
+      "size_bytes", [](const Stats& stats) { return stats.totalSizeBytes; });
+}
+
+/**
+ * Run tasks on executor, with no more than parallelism of them in progress
+ * at once.  The returned Future completes once every task has finished;
+ * the tasks are responsible for reporting their own errors.
+ */
+Future<Unit> runWithParallelism(
+    std::vector<folly::Function<Future<Unit>()>> tasks,
+    size_t parallelism,
+    folly::Executor* executor) {
+  struct Queue {
+    std::vector<folly::Function<Future<Unit>()>> tasks;
+    std::atomic<size_t> next{0};
+    folly::Executor* executor;
+  };
+  auto queue = std::make_shared<Queue>();
+  queue->tasks = std::move(tasks);
+  queue->executor = executor;
+
+  // Each worker runs one task at a time, taking the next one from the queue
+  // as soon as its current task finishes.
+  struct Worker {
+    static Future<Unit> runNext(std::shared_ptr<Queue> queue) {
+      auto index = queue->next.fetch_add(1, std::memory_order_relaxed);
+      if (index >= queue->tasks.size()) {
+        return makeFuture();
+      }
+      return folly::via(queue->executor)
+          .then([queue, index] { return queue->tasks[index](); })
+          .then([](folly::Try<Unit>&&) {})
+          .then([queue] { return runNext(queue); });
+    }
+  };
+
+  std::vector<Future<Unit>> workers;
+  auto numWorkers = std::min(parallelism, queue->tasks.size());
+  for (size_t n = 0; n < numWorkers; ++n) {
+    workers.push_back(Worker::runNext(queue));
+  }
+  return folly::collectAll(workers).then(
+      [](std::vector<folly::Try<Unit>>&&) {});
+}
 } // namespace
 
 namespace facebook {
@@ -168,13 +348,47 @@ EdenServer::EdenServer(
     : serverState_{make_shared<ServerState>(
           std::move(userInfo),
           std::move(privHelper),
-          std::make_shared<EdenCPUThreadPool>(),
+          EdenCPUThreadPool::createInteractivePool(),
+          EdenCPUThreadPool::createBackgroundPool(),
+          EdenCPUThreadPool::createOverlayIoPool(),
           std::make_shared<UnixClock>(),
           edenConfig)} {
   edenDir_ = edenConfig->getEdenDir();
   configPath_ = edenConfig->getUserConfigPath();
   clientCertificate_ = edenConfig->getClientCertificate();
   useMononoke_ = edenConfig->getUseMononoke();
+  treeCache_ = make_shared<TreeCache>(edenConfig->getTreeCacheSize());
+  BlobCache::CompressionOptions blobCompression;
+  try {
+    blobCompression.codecType =
+        BlobCache::parseCodecType(edenConfig->getBlobCacheCompression());
+  } catch (const std::invalid_argument& ex) {
+    XLOG(ERR) << ex.what() << "; keeping cached blobs uncompressed";
+  }
+  blobCompression.minSize = edenConfig->getBlobCacheCompressMinSize();
+  blobCompression.maxSize = edenConfig->getBlobCacheCompressMaxSize();
+  blobCache_ =
+      make_shared<BlobCache>(edenConfig->getBlobCacheSize(), blobCompression);
+  negativeCache_ =
+      make_shared<NegativeCache>(edenConfig->getNegativeCacheTTL());
+  prefetchLimiter_ = make_shared<PrefetchLimiter>(
+      std::max<int64_t>(FLAGS_max_prefetch_blobs_in_flight, 0),
+      std::max<int64_t>(FLAGS_max_prefetch_blobs_per_client, 0));
+  LockProfiler::setSampleRate(
+      std::max<int32_t>(FLAGS_lock_profiling_sample_rate, 0));
+
+  // The snapshot only saves work, so edenfs still starts without it.
+  if (!FLAGS_tree_snapshot.empty()) {
+    try {
+      treeSnapshot_ =
+          TreeSnapshot::open(AbsolutePathPiece{FLAGS_tree_snapshot});
+      XLOG(INFO) << "serving " << treeSnapshot_->size()
+                 << " trees from snapshot " << FLAGS_tree_snapshot;
+    } catch (const std::exception& ex) {
+      XLOG(ERR) << "unable to open tree snapshot " << FLAGS_tree_snapshot
+                << ": " << folly::exceptionStr(ex);
+    }
+  }
 }
 
 EdenServer::~EdenServer() {}
@@ -225,14 +439,28 @@ Future<TakeoverData> EdenServer::stopMountsForTakeover() {
       try {
         info.takeoverPromise.emplace();
         auto future = info.takeoverPromise->getFuture();
+        // The kernel blocks FUSE requests from here until the new process
+        // starts reading them.
+        const auto pausedAt = std::chrono::steady_clock::now();
         info.edenMount->getFuseChannel()->takeoverStop();
         futures.emplace_back(std::move(future).then(
-            [self = this,
-             edenMount = info.edenMount](TakeoverData::MountInfo takeover)
+            [self = this, edenMount = info.edenMount, pausedAt](
+                TakeoverData::MountInfo takeover)
                 -> Future<Optional<TakeoverData::MountInfo>> {
               if (!takeover.fuseFD) {
                 return folly::none;
               }
+              XLOG(INFO) << "outstanding FUSE requests for "
+                         << edenMount->getPath() << " finished "
+                         << std::chrono::duration_cast<
+                                std::chrono::milliseconds>(
+                                std::chrono::steady_clock::now() - pausedAt)
+                                .count()
+                         << "ms after stopping for takeover";
+              takeover.fusePausedAtNs =
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      pausedAt.time_since_epoch())
+                      .count();
               return self->serverState_->getPrivHelper()
                   ->fuseTakeoverShutdown(edenMount->getPath().stringPiece())
                   .then([takeover = std::move(takeover)]() mutable {
@@ -290,6 +518,50 @@ void EdenServer::scheduleFlushStats() {
 }
 
 void EdenServer::unloadInodes() {
+  const auto now = std::chrono::steady_clock::now();
+  const bool ageUnloadEnabled = FLAGS_unload_interval_hours > 0;
+  const bool rssCheckEnabled = FLAGS_unload_rss_target_mb > 0;
+
+  std::chrono::seconds age = std::chrono::minutes(FLAGS_unload_age_minutes);
+  bool shouldUnload = ageUnloadEnabled && now >= nextAgeUnload_;
+  if (rssCheckEnabled) {
+    const uint64_t target = FLAGS_unload_rss_target_mb * 1024 * 1024;
+    auto rss = getRssBytes();
+    if (rss && rss.value() > target) {
+      // Be more aggressive the further we are over the target: scale the
+      // minimum age down in proportion, so that at twice the target we unload
+      // inodes accessed half as long ago.
+      age = std::chrono::seconds(age.count() * target / rss.value());
+      shouldUnload = true;
+      XLOG(INFO) << "RSS of " << rss.value() << " bytes is above the target of "
+                 << target << " bytes; unloading inodes older than "
+                 << age.count() << " seconds";
+    }
+  }
+
+  if (shouldUnload) {
+    unloadInodesOlderThan(age);
+  }
+
+  if (ageUnloadEnabled && now >= nextAgeUnload_) {
+    nextAgeUnload_ = now + std::chrono::hours(FLAGS_unload_interval_hours);
+  }
+
+  std::chrono::milliseconds timeout{0};
+  if (ageUnloadEnabled) {
+    timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+        nextAgeUnload_ - now);
+  }
+  if (rssCheckEnabled) {
+    std::chrono::milliseconds checkInterval =
+        std::chrono::seconds(FLAGS_unload_rss_check_interval_seconds);
+    timeout = ageUnloadEnabled ? std::min(timeout, checkInterval)
+                               : checkInterval;
+  }
+  scheduleInodeUnload(timeout);
+}
+
+void EdenServer::unloadInodesOlderThan(std::chrono::seconds age) {
   std::vector<TreeInodePtr> roots;
   {
     const auto mountPoints = mountPoints_.wlock();
@@ -297,27 +569,251 @@ void EdenServer::unloadInodes() {
       roots.emplace_back(entry.second.edenMount->getRootInode());
     }
   }
+  if (roots.empty()) {
+    return;
+  }
+
+  XLOG(INFO) << "UnloadInodeScheduler Unloading Free Inodes";
+  auto serviceData = stats::ServiceData::get();
+  auto rssBefore = getRssBytes();
+
+  uint64_t unloaded = 0;
+  auto cutoff = folly::to<timespec>(std::chrono::system_clock::now() - age);
+  for (auto& rootInode : roots) {
+    unloaded += rootInode->unloadChildrenLastAccessedBefore(cutoff);
+  }
+  roots.clear();
+
+  // The allocator does not necessarily return freed memory to the system
+  // right away, so this is only an estimate of what unloading saved.
+  uint64_t bytesFreed = 0;
+  auto rssAfter = getRssBytes();
+  if (rssBefore && rssAfter && rssAfter.value() < rssBefore.value()) {
+    bytesFreed = rssBefore.value() - rssAfter.value();
+  }
+  XLOG(INFO) << "UnloadInodeScheduler unloaded " << unloaded
+             << " inodes, freeing " << bytesFreed << " bytes";
+
+  serviceData->setCounter(
+      kPeriodicUnloadCounterKey,
+      serviceData->getCounter(kPeriodicUnloadCounterKey) + unloaded);
+  serviceData->setCounter(
+      kPeriodicUnloadBytesFreedKey,
+      serviceData->getCounter(kPeriodicUnloadBytesFreedKey) + bytesFreed);
+}
+
+void EdenServer::scheduleInodeUnload(std::chrono::milliseconds timeout) {
+  mainEventBase_->timer().scheduleTimeoutFn(
+      [this] { unloadInodes(); }, timeout);
+}
+
+void EdenServer::scheduleBlobRelease() {
+  mainEventBase_->timer().scheduleTimeoutFn(
+      [this] { releaseIdleBlobs(); }, kBlobReleaseInterval);
+}
+
+void EdenServer::releaseIdleBlobs() {
+  const auto now = std::chrono::steady_clock::now();
+  const uint64_t target = FLAGS_loaded_blob_target_mb * 1024 * 1024;
+  std::vector<std::shared_ptr<EdenMount>> mounts;
+  {
+    const auto mountPoints = mountPoints_.rlock();
+    for (const auto& entry : *mountPoints) {
+      mounts.push_back(entry.second.edenMount);
+    }
+  }
+
+  uint64_t released = 0;
+  for (const auto& mount : mounts) {
+    auto* inodeMap = mount->getInodeMap();
+    folly::Optional<std::chrono::steady_clock::time_point> cutoff;
+    if (FLAGS_blob_idle_release_seconds > 0) {
+      cutoff = now - std::chrono::seconds(FLAGS_blob_idle_release_seconds);
+    }
+    if (target > 0 && inodeMap->getLoadedBlobBytes() > target) {
+      // Also release the blobs that have not been read since the last check.
+      const auto pressureCutoff = now - kBlobReleaseInterval;
+      cutoff = std::max(cutoff.value_or(pressureCutoff), pressureCutoff);
+    }
+    if (cutoff) {
+      released += inodeMap->releaseIdleBlobs(cutoff.value());
+    }
+  }
 
-  if (!roots.empty()) {
-    XLOG(INFO) << "UnloadInodeScheduler Unloading Free Inodes";
+  if (released > 0) {
+    XLOG(DBG2) << "released " << released << " bytes of idle blobs";
     auto serviceData = stats::ServiceData::get();
+    serviceData->setCounter(
+        kIdleBlobBytesReleasedKey,
+        serviceData->getCounter(kIdleBlobBytesReleasedKey) + released);
+  }
+  scheduleBlobRelease();
+}
 
-    uint64_t totalUnloaded = serviceData->getCounter(kPeriodicUnloadCounterKey);
-    for (auto& rootInode : roots) {
-      auto cutoff = std::chrono::system_clock::now() -
-          std::chrono::minutes(FLAGS_unload_age_minutes);
-      auto cutoff_ts = folly::to<timespec>(cutoff);
-      totalUnloaded += rootInode->unloadChildrenLastAccessedBefore(cutoff_ts);
+void EdenServer::scheduleWriteBufferFlush() {
+  mainEventBase_->timer().scheduleTimeoutFn(
+      [this] { flushWriteBuffers(); },
+      std::chrono::milliseconds(FLAGS_write_buffer_flush_ms));
+}
+
+void EdenServer::flushWriteBuffers() {
+  std::vector<std::shared_ptr<EdenMount>> mounts;
+  {
+    const auto mountPoints = mountPoints_.rlock();
+    for (const auto& entry : *mountPoints) {
+      mounts.push_back(entry.second.edenMount);
     }
-    serviceData->setCounter(kPeriodicUnloadCounterKey, totalUnloaded);
   }
 
-  scheduleInodeUnload(std::chrono::hours(FLAGS_unload_interval_hours));
+  for (const auto& mount : mounts) {
+    mount->getInodeMap()->flushWriteBuffers();
+  }
+  scheduleWriteBufferFlush();
 }
 
-void EdenServer::scheduleInodeUnload(std::chrono::milliseconds timeout) {
+void EdenServer::scheduleMountHibernation() {
   mainEventBase_->timer().scheduleTimeoutFn(
-      [this] { unloadInodes(); }, timeout);
+      [this] { hibernateIdleMounts(); }, kHibernationCheckInterval);
+}
+
+void EdenServer::hibernateIdleMounts() {
+  const auto idleCutoff = std::chrono::steady_clock::now() -
+      std::chrono::minutes(FLAGS_mount_hibernate_idle_minutes);
+  std::vector<std::shared_ptr<EdenMount>> mounts;
+  {
+    const auto mountPoints = mountPoints_.rlock();
+    for (const auto& entry : *mountPoints) {
+      mounts.push_back(entry.second.edenMount);
+    }
+  }
+
+  auto serviceData = stats::ServiceData::get();
+  auto rssBefore = getRssBytes();
+  int64_t hibernating = 0;
+  std::vector<Future<size_t>> hibernations;
+  for (const auto& mount : mounts) {
+    if (mount->isHibernating()) {
+      ++hibernating;
+    } else if (mount->getLastActivityTime() < idleCutoff) {
+      XLOG(INFO) << "hibernating idle mount " << mount->getPath();
+      hibernations.push_back(
+          mount->hibernate(FLAGS_hibernate_journal_memory_limit));
+      ++hibernating;
+    }
+  }
+  serviceData->setCounter(kHibernatingMountsKey, hibernating);
+  if (hibernations.empty()) {
+    scheduleMountHibernation();
+    return;
+  }
+
+  folly::collectAll(hibernations)
+      .via(mainEventBase_)
+      .then([this, rssBefore](std::vector<folly::Try<size_t>>&& results) {
+        uint64_t unloaded = 0;
+        for (const auto& result : results) {
+          if (result.hasException()) {
+            XLOG(WARN) << "error hibernating a mount: "
+                       << folly::exceptionStr(result.exception());
+          } else {
+            unloaded += result.value();
+          }
+        }
+
+        // As for periodic unloads, this is only an estimate of what
+        // hibernating saved.
+        uint64_t bytesFreed = 0;
+        auto rssAfter = getRssBytes();
+        if (rssBefore && rssAfter && rssAfter.value() < rssBefore.value()) {
+          bytesFreed = rssBefore.value() - rssAfter.value();
+        }
+        XLOG(INFO) << "hibernated " << results.size() << " mounts, unloading "
+                   << unloaded << " inodes and freeing " << bytesFreed
+                   << " bytes";
+
+        auto serviceData = stats::ServiceData::get();
+        serviceData->setCounter(
+            kHibernationCountKey,
+            serviceData->getCounter(kHibernationCountKey) + results.size());
+        serviceData->setCounter(
+            kHibernationBytesFreedKey,
+            serviceData->getCounter(kHibernationBytesFreedKey) + bytesFreed);
+        scheduleMountHibernation();
+      });
+}
+
+void EdenServer::scheduleBookmarkPrefetch() {
+  mainEventBase_->timer().scheduleTimeoutFn(
+      [this] { prefetchBookmarkTrees(); },
+      std::chrono::seconds(FLAGS_bookmark_prefetch_interval_seconds));
+}
+
+void EdenServer::prefetchBookmarkTrees() {
+  std::vector<std::string> bookmarks;
+  folly::split(',', FLAGS_prefetch_bookmarks, bookmarks, /*ignoreEmpty=*/true);
+  std::vector<std::shared_ptr<BackingStore>> stores;
+  for (const auto& entry : *backingStores_.rlock()) {
+    stores.push_back(entry.second);
+  }
+
+  // Each store logs the bookmarks it could not resolve, so this only waits
+  // for them all to finish before scheduling the next round.
+  std::vector<Future<Unit>> prefetches;
+  for (const auto& store : stores) {
+    prefetches.push_back(store->prefetchCommitTrees(bookmarks));
+  }
+  folly::collectAll(prefetches)
+      .via(mainEventBase_)
+      .then([this](std::vector<folly::Try<Unit>>&&) {
+        scheduleBookmarkPrefetch();
+      });
+}
+
+void EdenServer::garbageCollectLocalStore() {
+  const auto config = serverState_->getEdenConfig();
+  const auto interval = config->getLocalStoreGCInterval();
+  const auto blobSizeLimit = config->getLocalStoreBlobSizeLimit();
+  const auto treeSizeLimit = config->getLocalStoreTreeSizeLimit();
+
+  // Garbage collection scans entire key spaces, so run it on the thread pool
+  // rather than blocking the main event base.
+  folly::via(
+      serverState_->getBackgroundThreadPool().get(),
+      [localStore = localStore_, blobSizeLimit, treeSizeLimit] {
+        uint64_t numEvicted = 0;
+        if (blobSizeLimit > 0) {
+          numEvicted += localStore->evictLeastRecentlyUsed(
+              LocalStore::BlobFamily, blobSizeLimit);
+          numEvicted += localStore->evictLeastRecentlyUsed(
+              LocalStore::BlobContentFamily, blobSizeLimit);
+        }
+        if (treeSizeLimit > 0) {
+          numEvicted += localStore->evictLeastRecentlyUsed(
+              LocalStore::TreeFamily, treeSizeLimit);
+        }
+        return numEvicted;
+      })
+      .via(mainEventBase_)
+      .then([this, interval](folly::Try<uint64_t>&& result) {
+        if (result.hasException()) {
+          XLOG(ERR) << "error garbage collecting the local store: "
+                    << result.exception().what();
+        } else {
+          auto serviceData = stats::ServiceData::get();
+          serviceData->setCounter(
+              kLocalStoreGCEvictionCounterKey,
+              serviceData->getCounter(kLocalStoreGCEvictionCounterKey) +
+                  result.value());
+        }
+        if (interval.count() > 0) {
+          scheduleLocalStoreGC(interval);
+        }
+      });
+}
+
+void EdenServer::scheduleLocalStoreGC(std::chrono::milliseconds timeout) {
+  mainEventBase_->timer().scheduleTimeoutFn(
+      [this] { garbageCollectLocalStore(); }, timeout);
 }
 
 Future<Unit> EdenServer::prepare(std::shared_ptr<StartupLogger> logger) {
@@ -331,6 +827,7 @@ Future<Unit> EdenServer::prepare(std::shared_ptr<StartupLogger> logger) {
 }
 
 Future<Unit> EdenServer::prepareImpl(std::shared_ptr<StartupLogger> logger) {
+  folly::stop_watch<std::chrono::milliseconds> startupWatch;
   bool doingTakeover = false;
   if (!acquireEdenLock()) {
     // Another edenfs process is already running.
@@ -357,17 +854,45 @@ Future<Unit> EdenServer::prepareImpl(std::shared_ptr<StartupLogger> logger) {
 
   // Start stats aggregation
   scheduleFlushStats();
+  registerObjectCacheStats();
 
   // Set the ServiceData counter for tracking number of inodes unloaded by
   // periodic job for unloading inodes to zero on EdenServer start.
   stats::ServiceData::get()->setCounter(kPeriodicUnloadCounterKey, 0);
+  stats::ServiceData::get()->setCounter(kPeriodicUnloadBytesFreedKey, 0);
+
+  // Release the blobs held by open files that are not being read.  The
+  // per-mount blob memory counters report how much they hold.
+  if (FLAGS_blob_idle_release_seconds > 0 || FLAGS_loaded_blob_target_mb > 0) {
+    stats::ServiceData::get()->setCounter(kIdleBlobBytesReleasedKey, 0);
+    scheduleBlobRelease();
+  }
+
+  // Bound how long small writes merged by --write_buffer_size stay in
+  // memory rather than in the overlay.
+  if (FLAGS_write_buffer_size > 0 && FLAGS_write_buffer_flush_ms > 0) {
+    scheduleWriteBufferFlush();
+  }
+
+  if (!FLAGS_prefetch_bookmarks.empty() &&
+      FLAGS_bookmark_prefetch_interval_seconds > 0) {
+    scheduleBookmarkPrefetch();
+  }
+
+  // Give back the memory of mounts that nothing has used for a while.
+  if (FLAGS_mount_hibernate_idle_minutes > 0) {
+    auto serviceData = stats::ServiceData::get();
+    serviceData->setCounter(kHibernatingMountsKey, 0);
+    serviceData->setCounter(kHibernationCountKey, 0);
+    serviceData->setCounter(kHibernationBytesFreedKey, 0);
+    scheduleMountHibernation();
+  }
 
   // Schedule a periodic job to unload unused inodes based on the last access
-  // time. currently Eden does not have accurate timestamp tracking for inodes,
-  // so using unloadChildrenNow just to validate the behaviour. We will have to
-  // modify current unloadChildrenNow function to unload inodes based on the
-  // last access time.
-  if (FLAGS_unload_interval_hours > 0) {
+  // time, and on our memory usage if --unload_rss_target_mb is set.
+  if (FLAGS_unload_interval_hours > 0 || FLAGS_unload_rss_target_mb > 0) {
+    nextAgeUnload_ = std::chrono::steady_clock::now() +
+        std::chrono::minutes(FLAGS_start_delay_minutes);
     scheduleInodeUnload(std::chrono::minutes(FLAGS_start_delay_minutes));
   }
 
@@ -380,11 +905,13 @@ Future<Unit> EdenServer::prepareImpl(std::shared_ptr<StartupLogger> logger) {
     logger->log(
         "Requesting existing edenfs process to gracefully "
         "transfer its mount points...");
+    folly::stop_watch<std::chrono::milliseconds> takeoverWatch;
     takeoverData = takeoverMounts(takeoverPath);
     logger->log(
         "Received takeover information for ",
         takeoverData.mountPoints.size(),
         " mount points");
+    recordStartupPhase("takeover", takeoverWatch.elapsed());
 
     // Take over the eden lock file and the thrift server socket.
     lockFile_ = std::move(takeoverData.lockFile);
@@ -394,27 +921,198 @@ Future<Unit> EdenServer::prepareImpl(std::shared_ptr<StartupLogger> logger) {
     prepareThriftAddress();
   }
 
+  // Find the checkouts to mount, and start loading their configs and opening
+  // their overlays on the thread pool while the local store opens here.
+  // Neither needs the other, and after an unclean shutdown both can take
+  // seconds.
+  struct StartupMount {
+    std::string mountPath;
+    Future<PreparedMount> prepared;
+    Optional<TakeoverData::MountInfo> takeover;
+  };
+  std::vector<StartupMount> startupMounts;
+  folly::exception_wrapper clientDirectoryMapError;
+  if (doingTakeover) {
+    for (auto& info : takeoverData.mountPoints) {
+      auto mountPath = info.mountPath.stringPiece().str();
+      auto prepared = prepareMount(
+          info.mountPath.stringPiece(),
+          info.stateDirectory.stringPiece(),
+          true);
+      startupMounts.push_back(StartupMount{
+          std::move(mountPath), std::move(prepared), std::move(info)});
+    }
+  } else {
+    folly::dynamic dirs = folly::dynamic::object();
+    try {
+      dirs = ClientConfig::loadClientDirectoryMap(edenDir_);
+    } catch (const std::exception& ex) {
+      logger->warn(
+          "Could not parse config.json file: ",
+          ex.what(),
+          "\nSkipping remount step.");
+      clientDirectoryMapError =
+          folly::exception_wrapper(std::current_exception(), ex);
+    }
+    for (const auto& client : dirs.items()) {
+      auto mountPath = client.first.asString();
+      auto prepared = makeFutureWith([&] {
+        auto clientDirectory = edenDir_ + PathComponent("clients") +
+            PathComponent(client.second.asString());
+        return prepareMount(mountPath, clientDirectory.stringPiece(), false);
+      });
+      startupMounts.push_back(
+          StartupMount{std::move(mountPath), std::move(prepared), folly::none});
+    }
+  }
+
+  folly::stop_watch<std::chrono::milliseconds> localStoreWatch;
+  openLocalStore(*logger);
+  recordStartupPhase("local_store", localStoreWatch.elapsed());
+
+  // Keep the local store within its configured size.  The first pass is
+  // deferred by a full interval so that the store has a chance to observe
+  // which entries are in use before it evicts anything.
+  const auto gcInterval =
+      serverState_->getEdenConfig()->getLocalStoreGCInterval();
+  if (gcInterval.count() > 0) {
+    stats::ServiceData::get()->setCounter(kLocalStoreGCEvictionCounterKey, 0);
+    scheduleLocalStoreGC(gcInterval);
+  }
+
+  // Start listening for graceful takeover requests
+  takeoverServer_.reset(
+      new TakeoverServer(getMainEventBase(), takeoverPath, this));
+  takeoverServer_->start();
+
+  // Mount the checkouts once their overlays are open.  If doingTakeover is
+  // true these are the mounts received in TakeoverData.
+  //
+  // Independent checkouts are mounted in parallel, and each one is usable as
+  // soon as its own mount completes.
+  if (clientDirectoryMapError) {
+    return std::move(thriftRunningFuture)
+        .then([ew = std::move(clientDirectoryMapError)] {
+          return makeFuture<Unit>(ew);
+        });
+  }
+  if (!doingTakeover) {
+    if (startupMounts.empty()) {
+      logger->log("No mount points currently configured.");
+      return thriftRunningFuture;
+    }
+    logger->log("Remounting ", startupMounts.size(), " mount points...");
+  }
+
+  std::vector<folly::Function<Future<Unit>()>> mountTasks;
+  auto numMounted = std::make_shared<std::atomic<size_t>>(0);
+  auto numMounts = startupMounts.size();
+  for (auto& startupMount : startupMounts) {
+    mountTasks.emplace_back([this,
+                             logger,
+                             numMounted,
+                             numMounts,
+                             doingTakeover,
+                             startupMount = std::move(startupMount)]() mutable {
+      auto mountPath = startupMount.mountPath;
+      folly::stop_watch<std::chrono::milliseconds> watch;
+      return std::move(startupMount.prepared)
+          .thenValue([this, takeover = std::move(startupMount.takeover)](
+                         PreparedMount&& prepared) mutable {
+            return mount(
+                std::move(prepared.config),
+                std::move(takeover),
+                std::move(prepared.overlay));
+          })
+          .then([logger,
+                 mountPath,
+                 numMounted,
+                 numMounts,
+                 doingTakeover,
+                 watch](folly::Try<std::shared_ptr<EdenMount>>&& result) {
+            if (result.hasValue()) {
+              logger->log(
+                  doingTakeover ? "Successfully took over mount "
+                                : "Successfully remounted ",
+                  mountPath,
+                  " in ",
+                  watch.elapsed().count() / 1000.0,
+                  " seconds (",
+                  ++*numMounted,
+                  " of ",
+                  numMounts,
+                  " ready)");
+              return makeFuture();
+            } else {
+              logger->warn(
+                  doingTakeover ? "Failed to perform takeover for "
+                                : "Failed to remount ",
+                  mountPath,
+                  ": ",
+                  result.exception().what());
+              return makeFuture<Unit>(std::move(result).exception());
+            }
+          });
+    });
+  }
+
+  // Return a future that will complete only when all mount points have started
+  // and the thrift server is also running.
+  folly::stop_watch<std::chrono::milliseconds> mountsWatch;
+  return runWithParallelism(
+             std::move(mountTasks),
+             std::max(FLAGS_startup_mount_parallelism, 1),
+             serverState_->getThreadPool().get())
+      .ensure([this, mountsWatch, startupWatch] {
+        recordStartupPhase("mounts", mountsWatch.elapsed());
+        recordStartupPhase("total", startupWatch.elapsed());
+      })
+      .then([thriftFuture = std::move(thriftRunningFuture)]() mutable {
+        return std::move(thriftFuture);
+      });
+}
+
+void EdenServer::openLocalStore(StartupLogger& logger) {
   if (FLAGS_local_storage_engine_unsafe == "memory") {
-    logger->log("Creating new memory store.");
-    localStore_ = make_shared<MemoryLocalStore>();
+    logger.log("Creating new memory store.");
+    localStore_ = make_shared<MemoryLocalStore>(
+        serverState_->getEdenConfig()->getMemoryLocalStoreSizeLimit());
   } else if (FLAGS_local_storage_engine_unsafe == "sqlite") {
     const auto path = edenDir_ + RelativePathPiece{kSqlitePath};
     const auto parentDir = path.dirname();
     ensureDirectoryExists(parentDir);
-    logger->log("Opening local SQLite store ", path, "...");
+    logger.log("Opening local SQLite store ", path, "...");
     folly::stop_watch<std::chrono::milliseconds> watch;
     localStore_ = make_shared<SqliteLocalStore>(path);
-    logger->log(
+    logger.log(
         "Opened SQLite store in ",
         watch.elapsed().count() / 1000.0,
         " seconds.");
   } else if (FLAGS_local_storage_engine_unsafe == "rocksdb") {
-    logger->log("Opening local RocksDB store...");
+    logger.log("Opening local RocksDB store...");
     folly::stop_watch<std::chrono::milliseconds> watch;
     const auto rocksPath = edenDir_ + RelativePathPiece{kRocksDBPath};
     ensureDirectoryExists(rocksPath);
-    localStore_ = make_shared<RocksDbLocalStore>(rocksPath);
-    logger->log(
+    const auto config = serverState_->getEdenConfig();
+    RocksDbTuning tuning;
+    tuning.blockCacheSize = config->getRocksDbBlockCacheSize();
+    tuning.blobBlockCacheSize = config->getRocksDbBlobBlockCacheSize();
+    tuning.blob.blockSize = config->getRocksDbBlobBlockSize();
+    tuning.blob.writeBufferSize = config->getRocksDbBlobWriteBufferSize();
+    tuning.blob.compression = config->getRocksDbBlobCompression();
+    tuning.blob.compressionDictSize =
+        config->getRocksDbBlobCompressionDictSize();
+    tuning.tree.blockSize = config->getRocksDbTreeBlockSize();
+    tuning.tree.writeBufferSize = config->getRocksDbTreeWriteBufferSize();
+    tuning.tree.compression = config->getRocksDbTreeCompression();
+    tuning.metadata.blockSize = config->getRocksDbMetadataBlockSize();
+    tuning.metadata.writeBufferSize =
+        config->getRocksDbMetadataWriteBufferSize();
+    tuning.metadata.compression = config->getRocksDbMetadataCompression();
+    tuning.asyncWrites = config->getRocksDbAsyncWriteBatches();
+    tuning.disableEphemeralWAL = config->getRocksDbDisableEphemeralWAL();
+    localStore_ = make_shared<RocksDbLocalStore>(rocksPath, tuning);
+    logger.log(
         "Opened RocksDB store in ",
         watch.elapsed().count() / 1000.0,
         " seconds.");
@@ -424,100 +1122,64 @@ Future<Unit> EdenServer::prepareImpl(std::shared_ptr<StartupLogger> logger) {
         FLAGS_local_storage_engine_unsafe));
   }
 
-  // Start listening for graceful takeover requests
-  takeoverServer_.reset(
-      new TakeoverServer(getMainEventBase(), takeoverPath, this));
-  takeoverServer_->start();
-
-  // Trigger remounting of existing mount points
-  // If doingTakeover is true, use the mounts received in TakeoverData
-  std::vector<Future<Unit>> mountFutures;
-  if (doingTakeover) {
-    for (auto& info : takeoverData.mountPoints) {
-      const auto stateDirectory = info.stateDirectory;
-      auto mountFuture =
-          makeFutureWith([&] {
-            auto initialConfig = ClientConfig::loadFromClientDirectory(
-                AbsolutePathPiece{info.mountPath},
-                AbsolutePathPiece{info.stateDirectory});
-            return mount(std::move(initialConfig), std::move(info));
-          })
-              .then([logger, mountPath = info.mountPath](
-                        folly::Try<std::shared_ptr<EdenMount>>&& result) {
-                if (result.hasValue()) {
-                  logger->log("Successfully took over mount ", mountPath);
-                  return makeFuture();
-                } else {
-                  logger->warn(
-                      "Failed to perform takeover for ",
-                      mountPath,
-                      ": ",
-                      result.exception().what());
-                  return makeFuture<Unit>(std::move(result).exception());
-                }
-              });
-      mountFutures.push_back(std::move(mountFuture));
-    }
-  } else {
-    folly::dynamic dirs = folly::dynamic::object();
+  // The shared store only saves work, so edenfs still starts without it.
+  if (!FLAGS_shared_local_store.empty()) {
     try {
-      dirs = ClientConfig::loadClientDirectoryMap(edenDir_);
+      auto sharedStore = make_shared<SqliteLocalStore>(
+          AbsolutePathPiece{FLAGS_shared_local_store});
+      localStore_ =
+          make_shared<TieredLocalStore>(localStore_, std::move(sharedStore));
+      logger.log("Opened shared local store ", FLAGS_shared_local_store);
     } catch (const std::exception& ex) {
-      logger->warn(
-          "Could not parse config.json file: ",
-          ex.what(),
-          "\nSkipping remount step.");
-      return std::move(thriftRunningFuture)
-          .then([ew = folly::exception_wrapper(std::current_exception(), ex)] {
-            return makeFuture<Unit>(ew);
-          });
-    }
-
-    if (dirs.empty()) {
-      logger->log("No mount points currently configured.");
-      return thriftRunningFuture;
-    }
-    logger->log("Remounting ", dirs.size(), " mount points...");
-
-    for (const auto& client : dirs.items()) {
-      auto mountFuture =
-          makeFutureWith([&] {
-            MountInfo mountInfo;
-            mountInfo.mountPoint = client.first.c_str();
-            auto edenClientPath = edenDir_ + PathComponent("clients") +
-                PathComponent(client.second.c_str());
-            mountInfo.edenClientPath = edenClientPath.stringPiece().str();
-            auto initialConfig = ClientConfig::loadFromClientDirectory(
-                AbsolutePathPiece{mountInfo.mountPoint},
-                AbsolutePathPiece{mountInfo.edenClientPath});
-            return mount(std::move(initialConfig));
-          })
-              .then([logger, mountPath = client.first.asString()](
-                        folly::Try<std::shared_ptr<EdenMount>>&& result) {
-                if (result.hasValue()) {
-                  logger->log("Successfully remounted ", mountPath);
-                  return makeFuture();
-                } else {
-                  logger->warn(
-                      "Failed to remount ",
-                      mountPath,
-                      ": ",
-                      result.exception().what());
-                  return makeFuture<Unit>(std::move(result).exception());
-                }
-              });
-      mountFutures.push_back(std::move(mountFuture));
+      logger.warn(
+          "unable to open shared local store ",
+          FLAGS_shared_local_store,
+          ": ",
+          folly::exceptionStr(ex));
     }
   }
 
-  // Return a future that will complete only when all mount points have started
-  // and the thrift server is also running.
-  return folly::collectAll(mountFutures)
-      .then([thriftFuture = std::move(thriftRunningFuture)]() mutable {
-        return std::move(thriftFuture);
+}
+
+Future<EdenServer::PreparedMount> EdenServer::prepareMount(
+    StringPiece mountPath,
+    StringPiece clientDirectory,
+    bool takeover) {
+  return folly::via(
+      serverState_->getThreadPool().get(),
+      [this,
+       mountPath = mountPath.str(),
+       clientDirectory = clientDirectory.str(),
+       takeover] {
+        folly::stop_watch<std::chrono::milliseconds> watch;
+        PreparedMount prepared;
+        prepared.config = ClientConfig::loadFromClientDirectory(
+            AbsolutePathPiece{mountPath}, AbsolutePathPiece{clientDirectory});
+        prepared.overlay =
+            std::make_unique<Overlay>(prepared.config->getOverlayPath());
+        if (!takeover) {
+          prepared.overlay->scanForNextInodeNumber();
+        }
+        recordStartupPhase("overlay", watch.elapsed());
+        return prepared;
       });
 }
 
+void EdenServer::recordStartupPhase(
+    StringPiece phase,
+    std::chrono::milliseconds duration) {
+  if (runningState_.rlock()->state != RunState::STARTING) {
+    return;
+  }
+  XLOG(INFO) << "startup phase " << phase << " took " << duration.count()
+             << "ms";
+  auto phases = startupPhases_.wlock();
+  auto& longest = (*phases)[phase.str()];
+  longest = std::max<int64_t>(longest, duration.count());
+  stats::ServiceData::get()->setCounter(
+      folly::to<std::string>("startup.", phase, "_ms"), longest);
+}
+
 // Defined separately in RunServer.cpp
 void runServer(const EdenServer& server);
 
@@ -552,32 +1214,75 @@ void EdenServer::run() {
   std::move(shutdownFuture).get();
 }
 
-Future<Unit> EdenServer::performTakeoverShutdown(folly::File thriftSocket) {
-  // stop processing new FUSE requests for the mounts,
-  return stopMountsForTakeover().then([this, socket = std::move(thriftSocket)](
-                                          TakeoverData&& takeover) mutable {
-    // Destroy the local store and backing stores.
-    // We shouldn't access the local store any more after giving up our
-    // lock, and we need to close it to release its lock before the new
-    // edenfs process tries to open it.
-    backingStores_.wlock()->clear();
-    // Explicit close the LocalStore before we reset our pointer, to
-    // ensure we release the RocksDB lock.  Since this is managed with a
-    // shared_ptr it is somewhat hard to confirm if we really have the
-    // last reference to it.
-    localStore_->close();
-    localStore_.reset();
-
-    // Stop the privhelper process.
-    shutdownPrivhelper();
+Future<Unit> EdenServer::prepareMountsForTakeover() {
+  std::vector<Future<Unit>> futures;
+  for (const auto& edenMount : getMountPoints()) {
+    futures.push_back(
+        folly::makeFutureWith([&] { return edenMount->prepareForTakeover(); })
+            .onError([edenMount](const folly::exception_wrapper& ew) {
+              // This only makes the takeover slower, so carry on.
+              XLOG(WARN) << "error preparing " << edenMount->getPath()
+                         << " for takeover: " << ew;
+            }));
+  }
+  return folly::collectAll(futures).unit();
+}
 
-    takeover.lockFile = std::move(lockFile_);
-    auto future = takeover.takeoverComplete.getFuture();
-    takeover.thriftSocket = std::move(socket);
+void EdenServer::recordTakeoverPause(
+    const EdenMount& edenMount,
+    int64_t pausedAtNs) {
+  if (pausedAtNs <= 0) {
+    // The previous process didn't send the time, probably because it
+    // predates this field.
+    return;
+  }
+  // steady_clock is CLOCK_MONOTONIC, which is shared by every process on
+  // the host, so the previous process's time is comparable with ours.
+  const auto pausedAt = std::chrono::steady_clock::time_point{
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::nanoseconds{pausedAtNs})};
+  const auto pause = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - pausedAt);
+  takeoverPause_.addValue(pause.count());
+  XLOG(INFO) << "FUSE requests for " << edenMount.getPath()
+             << " were paused for " << pause.count() / 1000
+             << "ms during takeover";
+}
 
-    takeoverPromise_.setValue(std::move(takeover));
-    return future;
-  });
+Future<Unit> EdenServer::performTakeoverShutdown(folly::File thriftSocket) {
+  // Do what we can while FUSE requests are still being served, then stop
+  // processing new FUSE requests for the mounts,
+  folly::stop_watch<std::chrono::milliseconds> prepareTimer;
+  return prepareMountsForTakeover()
+      .then([this, prepareTimer] {
+        XLOG(INFO) << "prepared mounts for takeover in "
+                   << prepareTimer.elapsed().count() << "ms";
+        return stopMountsForTakeover();
+      })
+      .then([this, socket = std::move(thriftSocket)](
+                TakeoverData&& takeover) mutable {
+        // Destroy the local store and backing stores.
+        // We shouldn't access the local store any more after giving up our
+        // lock, and we need to close it to release its lock before the new
+        // edenfs process tries to open it.
+        backingStores_.wlock()->clear();
+        // Explicit close the LocalStore before we reset our pointer, to
+        // ensure we release the RocksDB lock.  Since this is managed with a
+        // shared_ptr it is somewhat hard to confirm if we really have the
+        // last reference to it.
+        localStore_->close();
+        localStore_.reset();
+
+        // Stop the privhelper process.
+        shutdownPrivhelper();
+
+        takeover.lockFile = std::move(lockFile_);
+        auto future = takeover.takeoverComplete.getFuture();
+        takeover.thriftSocket = std::move(socket);
+
+        takeoverPromise_.setValue(std::move(takeover));
+        return future;
+      });
 }
 
 Future<Unit> EdenServer::performNormalShutdown() {
@@ -631,6 +1336,47 @@ void EdenServer::registerStats(std::shared_ptr<EdenMount> edenMount) {
       edenMount->getCounterName(CounterName::UNLOADED), [edenMount] {
         return edenMount->getInodeMap()->getUnloadedInodeCount();
       });
+  counters->registerCallback(
+      edenMount->getCounterName(CounterName::OVERLAY_GC_QUEUED), [edenMount] {
+        return edenMount->getOverlay()->getGCQueueDepth();
+      });
+  counters->registerCallback(
+      edenMount->getCounterName(CounterName::OVERLAY_GC_REMOVED), [edenMount] {
+        return edenMount->getOverlay()->getGCRemovedInodeCount();
+      });
+  counters->registerCallback(
+      edenMount->getCounterName(CounterName::JOURNAL_MEMORY), [edenMount] {
+        return edenMount->getJournal().getStats().memoryUsage;
+      });
+  counters->registerCallback(
+      edenMount->getCounterName(CounterName::JOURNAL_ENTRIES), [edenMount] {
+        return edenMount->getJournal().getStats().entryCount;
+      });
+  counters->registerCallback(
+      edenMount->getCounterName(CounterName::INODE_MEMORY), [edenMount] {
+        return edenMount->getInodeMap()->getApproximateMemoryUsage();
+      });
+  counters->registerCallback(
+      edenMount->getCounterName(CounterName::BLOB_MEMORY), [edenMount] {
+        return edenMount->getInodeMap()->getLoadedBlobBytes();
+      });
+  // The table is gone once the overlay is closed.
+  auto getInodeTableStats = [edenMount] {
+    auto* table = edenMount->getInodeMetadataTable();
+    return table ? table->getStats() : InodeMetadataTable::Stats{};
+  };
+  counters->registerCallback(
+      edenMount->getCounterName(CounterName::INODE_TABLE_RECORDS),
+      [getInodeTableStats] { return getInodeTableStats().records; });
+  counters->registerCallback(
+      edenMount->getCounterName(CounterName::INODE_TABLE_FRAGMENTATION),
+      [getInodeTableStats] {
+        return static_cast<int64_t>(
+            100 * getInodeTableStats().getFragmentation());
+      });
+  counters->registerCallback(
+      edenMount->getCounterName(CounterName::INODE_TABLE_COMPACTED),
+      [getInodeTableStats] { return getInodeTableStats().recordsCompacted; });
 }
 
 void EdenServer::unregisterStats(EdenMount* edenMount) {
@@ -638,6 +1384,55 @@ void EdenServer::unregisterStats(EdenMount* edenMount) {
   counters->unregisterCallback(edenMount->getCounterName(CounterName::LOADED));
   counters->unregisterCallback(
       edenMount->getCounterName(CounterName::UNLOADED));
+  counters->unregisterCallback(
+      edenMount->getCounterName(CounterName::OVERLAY_GC_QUEUED));
+  counters->unregisterCallback(
+      edenMount->getCounterName(CounterName::OVERLAY_GC_REMOVED));
+  counters->unregisterCallback(
+      edenMount->getCounterName(CounterName::JOURNAL_MEMORY));
+  counters->unregisterCallback(
+      edenMount->getCounterName(CounterName::JOURNAL_ENTRIES));
+  counters->unregisterCallback(
+      edenMount->getCounterName(CounterName::INODE_MEMORY));
+  counters->unregisterCallback(
+      edenMount->getCounterName(CounterName::BLOB_MEMORY));
+  counters->unregisterCallback(
+      edenMount->getCounterName(CounterName::INODE_TABLE_RECORDS));
+  counters->unregisterCallback(
+      edenMount->getCounterName(CounterName::INODE_TABLE_FRAGMENTATION));
+  counters->unregisterCallback(
+      edenMount->getCounterName(CounterName::INODE_TABLE_COMPACTED));
+}
+
+void EdenServer::registerObjectCacheStats() {
+  registerCacheCounters(kTreeCacheStatsPrefix, treeCache_);
+  registerCacheCounters(kBlobCacheStatsPrefix, blobCache_);
+  auto counters = stats::ServiceData::get()->getDynamicCounters();
+  auto registerBlobCounter = [&](StringPiece name, auto getValue) {
+    counters->registerCallback(
+        folly::to<string>(kBlobCacheStatsPrefix, name),
+        [blobCache = blobCache_, getValue] {
+          return getValue(blobCache->getStats());
+        });
+  };
+  using BlobStats = BlobCache::Stats;
+  registerBlobCounter("compressed_hits", [](const BlobStats& stats) {
+    return stats.compressedHitCount;
+  });
+  registerBlobCounter("decompress_us", [](const BlobStats& stats) {
+    return stats.decompressTimeUs;
+  });
+  registerBlobCounter("compressed_inserts", [](const BlobStats& stats) {
+    return stats.compressedInsertCount;
+  });
+  registerBlobCounter("compression_saved_bytes", [](const BlobStats& stats) {
+    return stats.compressionSavedBytes;
+  });
+  counters->registerCallback(
+      kNegativeCacheHitsCounterKey,
+      [negativeCache = negativeCache_] {
+        return negativeCache->getHitCount();
+      });
 }
 
 folly::Future<folly::Unit> EdenServer::performFreshFuseStart(
@@ -710,26 +1505,47 @@ Future<Unit> EdenServer::completeTakeoverFuseStart(
 
 folly::Future<std::shared_ptr<EdenMount>> EdenServer::mount(
     std::unique_ptr<ClientConfig> initialConfig,
-    Optional<TakeoverData::MountInfo>&& optionalTakeover) {
+    Optional<TakeoverData::MountInfo>&& optionalTakeover,
+    std::unique_ptr<Overlay> overlay) {
   auto backingStore = getBackingStore(
       initialConfig->getRepoType(), initialConfig->getRepoSource());
-  auto objectStore =
-      std::make_unique<ObjectStore>(getLocalStore(), backingStore);
+  auto objectStore = std::make_unique<ObjectStore>(
+      getLocalStore(),
+      backingStore,
+      treeCache_,
+      blobCache_,
+      negativeCache_,
+      EdenMount::getCounterName(
+          initialConfig->getMountPath(), CounterName::OBJECT_STORE),
+      treeSnapshot_);
   const bool doTakeover = optionalTakeover.hasValue();
 
   auto edenMount = EdenMount::create(
-      std::move(initialConfig), std::move(objectStore), serverState_);
+      std::move(initialConfig),
+      std::move(objectStore),
+      serverState_,
+      std::move(overlay));
 
+  folly::stop_watch<std::chrono::milliseconds> phaseWatch;
   auto initFuture = edenMount->initialize(
       optionalTakeover ? folly::make_optional(optionalTakeover->inodeMap)
+                       : folly::none,
+      optionalTakeover ? folly::make_optional(optionalTakeover->journal)
                        : folly::none);
   return std::move(initFuture)
       .then([this,
              doTakeover,
              edenMount,
+             phaseWatch,
              optionalTakeover = std::move(optionalTakeover)]() mutable {
+        recordStartupPhase("mount_initialize", phaseWatch.lap());
         addToMountPoints(edenMount);
 
+        auto warmState = optionalTakeover
+            ? std::move(optionalTakeover->warmState)
+            : SerializedWarmState{};
+        const int64_t fusePausedAtNs =
+            optionalTakeover ? optionalTakeover->fusePausedAtNs : 0;
         return (optionalTakeover ? performTakeoverFuseStart(
                                        edenMount, std::move(*optionalTakeover))
                                  : performFreshFuseStart(edenMount))
@@ -740,7 +1556,13 @@ folly::Future<std::shared_ptr<EdenMount>> EdenServer::mount(
               mountFinished(edenMount.get(), folly::none);
               return makeFuture<folly::Unit>(ew);
             })
-            .then([edenMount, doTakeover, this]() mutable {
+            .then([edenMount,
+                   doTakeover,
+                   warmState = std::move(warmState),
+                   fusePausedAtNs,
+                   phaseWatch,
+                   this]() mutable {
+              recordStartupPhase("fuse_start", phaseWatch.lap());
               // Now that we've started the workers, arrange to call
               // mountFinished once the pool is torn down.
               auto finishFuture = edenMount->getFuseCompletionFuture().then(
@@ -759,6 +1581,17 @@ folly::Future<std::shared_ptr<EdenMount>> EdenServer::mount(
               registerStats(edenMount);
 
               if (doTakeover) {
+                recordTakeoverPause(*edenMount, fusePausedAtNs);
+
+                // Reload what the previous process had loaded, without
+                // delaying the rest of startup.  The callback keeps
+                // edenMount alive until warming is done.
+                edenMount->warmCaches(std::move(warmState))
+                    .onError([edenMount](const folly::exception_wrapper& ew) {
+                      XLOG(WARN) << "failed to warm caches for "
+                                 << edenMount->getPath() << ": " << ew;
+                    });
+
                 // The bind mounts are already mounted in the takeover case
                 return makeFuture<std::shared_ptr<EdenMount>>(
                     std::move(edenMount));
@@ -767,7 +1600,10 @@ folly::Future<std::shared_ptr<EdenMount>> EdenServer::mount(
                 // client.  We don't need to do this for the takeover
                 // case as they are already mounted.
                 return edenMount->performBindMounts().then(
-                    [edenMount] { return edenMount; });
+                    [this, edenMount, phaseWatch]() mutable {
+                      recordStartupPhase("bind_mounts", phaseWatch.lap());
+                      return edenMount;
+                    });
               }
             });
       });
@@ -823,15 +1659,21 @@ void EdenServer::mountFinished(
       .then([unmountPromise = std::move(unmountPromise),
              takeoverPromise = std::move(takeoverPromise),
              takeoverData = std::move(takeover)](
-                folly::Try<
-                    std::tuple<SerializedFileHandleMap, SerializedInodeMap>>&&
-                    result) mutable {
+                folly::Try<std::tuple<
+                    SerializedFileHandleMap,
+                    SerializedInodeMap,
+                    SerializedJournal,
+                    SerializedWarmState>>&& result) mutable {
         if (takeoverPromise) {
           takeoverPromise.value().setWith([&]() mutable {
             takeoverData.value().fileHandleMap =
                 std::move(std::get<0>(result.value()));
             takeoverData.value().inodeMap =
                 std::move(std::get<1>(result.value()));
+            takeoverData.value().journal =
+                std::move(std::get<2>(result.value()));
+            takeoverData.value().warmState =
+                std::move(std::get<3>(result.value()));
             return std::move(takeoverData.value());
           });
         }
@@ -860,6 +1702,9 @@ shared_ptr<EdenMount> EdenServer::getMount(StringPiece mountPath) const {
     throw EdenError(folly::to<string>(
         "mount point \"", mountPath, "\" is not known to this eden instance"));
   }
+  // Thrift calls look their mount up here, so this keeps it from
+  // hibernating while clients are using it.
+  mount->recordActivity();
   return mount;
 }
 
@@ -896,11 +1741,15 @@ shared_ptr<BackingStore> EdenServer::getBackingStore(
 shared_ptr<BackingStore> EdenServer::createBackingStore(
     StringPiece type,
     StringPiece name) {
+  shared_ptr<BackingStore> store;
+  // Whether the store's trees can be fetched from the remote cache.  The hg
+  // store has to import each tree itself to fetch its children later.
+  bool cacheTrees = false;
   if (type == "null") {
     return make_shared<EmptyBackingStore>();
   } else if (type == "hg") {
     const auto repoPath = realpath(name);
-    return make_shared<HgBackingStore>(
+    store = make_shared<HgBackingStore>(
         repoPath,
         localStore_.get(),
         serverState_->getThreadPool().get(),
@@ -908,11 +1757,25 @@ shared_ptr<BackingStore> EdenServer::createBackingStore(
         useMononoke_);
   } else if (type == "git") {
     const auto repoPath = realpath(name);
-    return make_shared<GitBackingStore>(repoPath, localStore_.get());
+    store = make_shared<GitBackingStore>(repoPath, localStore_.get());
+    cacheTrees = true;
   } else {
     throw std::domain_error(
         folly::to<string>("unsupported backing store type: ", type));
   }
+
+  if (!remoteObjectCache_) {
+    return store;
+  }
+  // Objects are keyed by their hashes, which are the same for every clone of
+  // a repository, so only the type is needed to keep the stores apart.
+  return make_shared<CachingBackingStore>(
+      std::move(store),
+      remoteObjectCache_,
+      localStore_.get(),
+      serverState_->getThreadPool().get(),
+      type,
+      cacheTrees);
 }
 
 Future<Unit> EdenServer::createThriftServer() {
@@ -1038,6 +1901,29 @@ void EdenServer::flushStatsNow() {
   for (auto& stats : serverState_->getStats().accessAllThreads()) {
     stats.aggregate();
   }
+  serverStats_.aggregate();
+  // ServerState only knows the pools as UnboundedQueueExecutors, but
+  // unit tests may give it pools that don't keep stats.
+  for (const auto* pool : {&serverState_->getThreadPool(),
+                           &serverState_->getBackgroundThreadPool(),
+                           &serverState_->getOverlayIoPool()}) {
+    if (auto* cpuPool = dynamic_cast<EdenCPUThreadPool*>(pool->get())) {
+      cpuPool->aggregateStats();
+    }
+  }
+  for (const auto& entry : *mountPoints_.rlock()) {
+    auto* mountStats = entry.second.edenMount->getMountStats();
+    for (auto& stats : mountStats->accessAllThreads()) {
+      stats.aggregate();
+    }
+    entry.second.edenMount->getObjectStore()->aggregateStats();
+  }
+  if (localStore_) {
+    localStore_->aggregateStats();
+  }
+  for (const auto& entry : *backingStores_.rlock()) {
+    entry.second->aggregateStats();
+  }
 }
 
 void EdenServer::reportProcStats() {
@@ -1057,6 +1943,24 @@ void EdenServer::reportProcStats() {
       stats::ServiceData::get()->addStatValue(
           kRssBytes, rssKBytes.value() * 1024, stats::AVG);
     }
+
+    // Reported alongside the process totals, so that they can be compared.
+    if (localStore_) {
+      stats::ServiceData::get()->setCounter(
+          kLocalStoreMemoryCounterKey,
+          localStore_->getApproximateMemoryUsage());
+
+      // The engine's own stats can take a while to compute, so refresh them
+      // on the thread pool rather than blocking the main event base.
+      serverState_->getBackgroundThreadPool()->add(
+          [localStore = localStore_] {
+            try {
+              localStore->refreshEngineStats();
+            } catch (const std::exception& ex) {
+              XLOG(ERR) << "error computing local store stats: " << ex.what();
+            }
+          });
+    }
     lastProcStatsRun_.store(now);
   }
 }
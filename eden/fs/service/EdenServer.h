@@ -18,6 +18,7 @@
 #include <folly/ThreadLocal.h>
 #include <folly/experimental/StringKeyedMap.h>
 #include <folly/futures/SharedPromise.h>
+#include <chrono>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
@@ -29,12 +30,21 @@
 #include "eden/fs/fuse/FuseTypes.h"
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/ServerState.h"
+#include "eden/fs/store/ObjectStore.h"
 #include "eden/fs/takeover/TakeoverData.h"
 #include "eden/fs/takeover/TakeoverHandler.h"
 #include "eden/fs/utils/PathFuncs.h"
 #include "folly/experimental/FunctionScheduler.h"
 
 constexpr folly::StringPiece kPeriodicUnloadCounterKey{"PeriodicUnloadCounter"};
+constexpr folly::StringPiece kPeriodicUnloadBytesFreedKey{
+    "PeriodicUnloadBytesFreed"};
+constexpr folly::StringPiece kIdleBlobBytesReleasedKey{
+    "IdleBlobBytesReleased"};
+constexpr folly::StringPiece kHibernatingMountsKey{"HibernatingMounts"};
+constexpr folly::StringPiece kHibernationCountKey{"HibernationCount"};
+constexpr folly::StringPiece kHibernationBytesFreedKey{
+    "HibernationBytesFreed"};
 constexpr folly::StringPiece kPrivateBytes{"memory_private_bytes"};
 constexpr folly::StringPiece kRssBytes{"memory_vm_rss_bytes"};
 constexpr std::chrono::seconds kMemoryPollSeconds{30};
@@ -57,8 +67,13 @@ class Dirstate;
 class EdenServiceHandler;
 class LocalStore;
 class MountInfo;
+class NegativeCache;
+class Overlay;
+class PrefetchLimiter;
+class RemoteObjectCache;
 class StartupLogger;
 class TakeoverServer;
+class TreeSnapshot;
 
 /*
  * EdenServer contains logic for running the Eden main loop.
@@ -131,11 +146,15 @@ class EdenServer : private TakeoverHandler {
 
   /**
    * Mount and return an EdenMount.
+   *
+   * The checkout's overlay is opened here unless the caller passes one that
+   * it has already opened.
    */
   FOLLY_NODISCARD folly::Future<std::shared_ptr<EdenMount>> mount(
       std::unique_ptr<ClientConfig> initialConfig,
       folly::Optional<TakeoverData::MountInfo>&& optionalTakeover =
-          folly::none);
+          folly::none,
+      std::unique_ptr<Overlay> overlay = nullptr);
 
   /**
    * Takeover a mount from another eden instance
@@ -203,6 +222,26 @@ class EdenServer : private TakeoverHandler {
       folly::StringPiece type,
       folly::StringPiece name);
 
+  /**
+   * Front the BackingStores created from now on with a remote cache shared
+   * by other machines, such as a cache in the datacenter that a fleet of CI
+   * hosts checking out the same commits can share.
+   *
+   * This must be called before prepare(), so that it applies to the
+   * BackingStores of every mount.
+   */
+  void setRemoteObjectCache(std::shared_ptr<RemoteObjectCache> cache) {
+    remoteObjectCache_ = std::move(cache);
+  }
+
+  /**
+   * The admission control for prefetches requested over thrift, shared by
+   * all mounts.
+   */
+  const std::shared_ptr<PrefetchLimiter>& getPrefetchLimiter() const {
+    return prefetchLimiter_;
+  }
+
   AbsolutePathPiece getEdenDir() {
     return edenDir_;
   }
@@ -262,6 +301,13 @@ class EdenServer : private TakeoverHandler {
   using MountMap = folly::StringKeyedMap<struct EdenMountInfo>;
   class ThriftServerEventHandler;
 
+  // The parts of a mount that startup prepares before the local store is
+  // open.
+  struct PreparedMount {
+    std::unique_ptr<ClientConfig> config;
+    std::unique_ptr<Overlay> overlay;
+  };
+
   // Forbidden copy constructor and assignment operator
   EdenServer(EdenServer const&) = delete;
   EdenServer& operator=(EdenServer const&) = delete;
@@ -280,8 +326,66 @@ class EdenServer : private TakeoverHandler {
   // and then schedule another call to unloadInodes() to happen
   // at the next appropriate interval.  The unload attempt applies to
   // all mounts.
+  //
+  // When --unload_rss_target_mb is set this also runs every
+  // --unload_rss_check_interval_seconds, and unloads inodes early, with a
+  // shorter minimum age, whenever our RSS is above the target.
   void unloadInodes();
 
+  // Unload inodes in all mounts that have not been accessed within the given
+  // age, and update the periodic unload counters.
+  void unloadInodesOlderThan(std::chrono::seconds age);
+
+  // Schedule a call to releaseIdleBlobs() after kBlobReleaseInterval.
+  // Must be called only from the eventBase thread.
+  void scheduleBlobRelease();
+
+  // Release the blobs of open files that have not been read within
+  // --blob_idle_release_seconds, or that have not been read since the last
+  // check in mounts holding more than --loaded_blob_target_mb of them, and
+  // then schedule the next check.
+  void releaseIdleBlobs();
+
+  // Schedule a call to flushWriteBuffers() after --write_buffer_flush_ms.
+  // Must be called only from the eventBase thread.
+  void scheduleWriteBufferFlush();
+
+  // Write the writes buffered for open files by --write_buffer_size to the
+  // overlay, and then schedule the next flush.
+  void flushWriteBuffers();
+
+  // Schedule a call to hibernateIdleMounts() after
+  // kHibernationCheckInterval.
+  // Must be called only from the eventBase thread.
+  void scheduleMountHibernation();
+
+  // Hibernate the mounts that have been idle for
+  // --mount_hibernate_idle_minutes and have not hibernated since they were
+  // last used, update the hibernation counters, and then schedule the next
+  // check.
+  void hibernateIdleMounts();
+
+  // Schedule a call to prefetchBookmarkTrees() after
+  // --bookmark_prefetch_interval_seconds.
+  // Must be called only from the eventBase thread.
+  void scheduleBookmarkPrefetch();
+
+  // Import the root trees of the commits that the --prefetch_bookmarks
+  // currently point to into every backing store, so that the first status
+  // or checkout against a bookmark that a pull moved does not wait for the
+  // import, and then schedule the next prefetch.
+  void prefetchBookmarkTrees();
+
+  // Schedule a call to garbageCollectLocalStore() to happen after timeout
+  // has expired.
+  // Must be called only from the eventBase thread.
+  void scheduleLocalStoreGC(std::chrono::milliseconds timeout);
+
+  // Evict least recently used entries from the local store to keep it under
+  // its configured size limits, and then schedule another call to
+  // garbageCollectLocalStore() at the next configured interval.
+  void garbageCollectLocalStore();
+
   std::shared_ptr<BackingStore> createBackingStore(
       folly::StringPiece type,
       folly::StringPiece name);
@@ -305,6 +409,25 @@ class EdenServer : private TakeoverHandler {
   FOLLY_NODISCARD folly::Future<folly::Unit> prepareImpl(
       std::shared_ptr<StartupLogger> logger);
 
+  // Open the local store selected by --local_storage_engine_unsafe, and the
+  // --shared_local_store if there is one.
+  void openLocalStore(StartupLogger& logger);
+
+  // Load a checkout's config and open its overlay on the thread pool.  The
+  // next inode number is found now too, unless it comes from a takeover.
+  FOLLY_NODISCARD folly::Future<PreparedMount> prepareMount(
+      folly::StringPiece mountPath,
+      folly::StringPiece clientDirectory,
+      bool takeover);
+
+  // Log how long a phase of startup took and export it, in milliseconds, as
+  // the startup.<phase>_ms counter.  Phases that run once per mount export
+  // the slowest mount's duration.  Calls made after startup are ignored, so
+  // that later mounts do not change the counters.
+  void recordStartupPhase(
+      folly::StringPiece phase,
+      std::chrono::milliseconds duration);
+
   // Called when a mount has been unmounted and has stopped.
   void mountFinished(
       EdenMount* mountPoint,
@@ -313,6 +436,13 @@ class EdenServer : private TakeoverHandler {
   FOLLY_NODISCARD folly::Future<folly::Unit> performNormalShutdown();
   FOLLY_NODISCARD folly::Future<folly::Unit> performTakeoverShutdown(
       folly::File thriftSocket);
+  // Do the parts of shutting mounts down for a takeover that can happen
+  // while they are still serving FUSE requests, so that they are paused for
+  // as short a time as possible.
+  FOLLY_NODISCARD folly::Future<folly::Unit> prepareMountsForTakeover();
+  // Record how long edenMount's FUSE requests went unanswered during a
+  // takeover that ended with them handed to this process.
+  void recordTakeoverPause(const EdenMount& edenMount, int64_t pausedAtNs);
   void shutdownPrivhelper();
 
   // Starts up a new fuse mount for edenMount, starting up the thread
@@ -340,6 +470,10 @@ class EdenServer : private TakeoverHandler {
   void registerStats(std::shared_ptr<EdenMount> edenMount);
   void unregisterStats(EdenMount* edenMount);
 
+  // Registers stats callbacks for the in-memory object caches shared by all
+  // mounts.
+  void registerObjectCacheStats();
+
   // Cancel all subscribers on all mounts so that we can tear
   // down the thrift server without blocking
   void shutdownSubscribers();
@@ -365,6 +499,37 @@ class EdenServer : private TakeoverHandler {
   std::shared_ptr<LocalStore> localStore_;
   folly::Synchronized<BackingStoreMap> backingStores_;
 
+  /**
+   * In-memory caches of Tree and Blob objects, shared by the ObjectStores of
+   * all mounts.
+   */
+  std::shared_ptr<TreeCache> treeCache_;
+  std::shared_ptr<BlobCache> blobCache_;
+
+  /**
+   * Short-lived cache of objects that the backing stores reported as missing,
+   * shared by the ObjectStores of all mounts.
+   */
+  std::shared_ptr<NegativeCache> negativeCache_;
+
+  /**
+   * The budget for prefetches requested by thrift clients, sized by
+   * --max_prefetch_blobs_in_flight and --max_prefetch_blobs_per_client.
+   */
+  std::shared_ptr<PrefetchLimiter> prefetchLimiter_;
+
+  /**
+   * The snapshot named by --tree_snapshot, shared by the ObjectStores of all
+   * mounts.  Null if there is none.
+   */
+  std::shared_ptr<const TreeSnapshot> treeSnapshot_;
+
+  /**
+   * The cache set by setRemoteObjectCache(), which the BackingStores are
+   * wrapped in a CachingBackingStore to use.  Null if there is none.
+   */
+  std::shared_ptr<RemoteObjectCache> remoteObjectCache_;
+
   folly::Synchronized<MountMap> mountPoints_;
 
   /**
@@ -390,6 +555,12 @@ class EdenServer : private TakeoverHandler {
   };
   folly::Synchronized<RunStateData> runningState_;
 
+  /**
+   * The longest duration recorded for each startup phase, in milliseconds.
+   */
+  folly::Synchronized<std::unordered_map<std::string, int64_t>>
+      startupPhases_;
+
   /**
    * Common state shared by all of the EdenMount objects.
    */
@@ -412,6 +583,33 @@ class EdenServer : private TakeoverHandler {
    * std::atomic chokes on time_point.
    */
   std::atomic<std::chrono::system_clock::duration> lastProcStatsRun_;
+
+  /**
+   * When the next regular, age-based inode unload is due.  unloadInodes()
+   * may run more often than this to check for memory pressure.
+   *
+   * This is only accessed from the main EventBase thread.
+   */
+  std::chrono::steady_clock::time_point nextAgeUnload_;
+
+  using ServerStats = facebook::stats::ThreadLocalStatsT<
+      facebook::stats::TLStatsThreadSafe>;
+  ServerStats serverStats_;
+
+  /**
+   * How long FUSE requests for each mount were held up by a graceful
+   * restart, from when the previous process stopped reading them until this
+   * one started.  This is recorded by the new process.
+   */
+  ServerStats::TLHistogram takeoverPause_{&serverStats_,
+                                          "takeover.pause_us",
+                                          100000,
+                                          0,
+                                          60000000,
+                                          facebook::stats::COUNT,
+                                          50,
+                                          90,
+                                          99};
 };
 } // namespace eden
 } // namespace facebook
@@ -19,11 +19,15 @@
 #include <folly/logging/LoggerDB.h>
 #include <folly/logging/xlog.h>
 #include <folly/stop_watch.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <set>
 #include "common/stats/ServiceData.h"
 #include "eden/fs/config/ClientConfig.h"
 #include "eden/fs/fuse/FuseChannel.h"
-#include "eden/fs/inodes/Differ.h"
+#include "eden/fs/fuse/FuseTrace.h"
 #include "eden/fs/inodes/EdenDispatcher.h"
+#include "eden/fs/inodes/Differ.h"
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/inodes/FileInode.h"
 #include "eden/fs/inodes/GlobNode.h"
@@ -31,6 +35,7 @@
 #include "eden/fs/inodes/InodeLoader.h"
 #include "eden/fs/inodes/InodeMap.h"
 #include "eden/fs/inodes/Overlay.h"
+#include "eden/fs/inodes/ScmStatusCache.h"
 #include "eden/fs/inodes/TreeInode.h"
 #include "eden/fs/model/Blob.h"
 #include "eden/fs/model/Hash.h"
@@ -38,13 +43,26 @@
 #include "eden/fs/model/TreeEntry.h"
 #include "eden/fs/service/EdenError.h"
 #include "eden/fs/service/EdenServer.h"
+#include "eden/fs/service/PrefetchLimiter.h"
+#include "eden/fs/service/StreamingGlobber.h"
+#include "eden/fs/service/StreamingScmStatus.h"
 #include "eden/fs/service/StreamingSubscriber.h"
 #include "eden/fs/service/ThriftUtil.h"
+#include "eden/fs/store/AccessProfile.h"
 #include "eden/fs/store/BlobMetadata.h"
+#include "eden/fs/store/CommitDiffCache.h"
 #include "eden/fs/store/Diff.h"
 #include "eden/fs/store/LocalStore.h"
 #include "eden/fs/store/ObjectStore.h"
+#include "eden/fs/store/PathIndex.h"
+#include "eden/fs/store/TreeSnapshot.h"
+#include "eden/fs/store/TreeView.h"
+#include "eden/fs/utils/LockProfiler.h"
+#include "eden/fs/utils/PathPrefixFilter.h"
+#include "eden/fs/utils/ProcessAccessLog.h"
+#include "eden/fs/utils/PathTable.h"
 #include "eden/fs/utils/ProcUtil.h"
+#include "eden/fs/utils/TraceBuffer.h"
 
 using folly::Future;
 using folly::makeFuture;
@@ -58,6 +76,12 @@ using std::string;
 using std::unique_ptr;
 using std::vector;
 
+DEFINE_bool(
+    journal_expand_commit_transitions,
+    true,
+    "Have getFilesChangedSince() report the files that differ between the "
+    "commits a range of the journal moved between");
+
 namespace {
 /*
  * We need a version of folly::toDelim() that accepts zero, one, or many
@@ -81,6 +105,12 @@ std::string toDelimWrapper(StringPiece arg1, const Args&... rest) {
 }
 
 using facebook::eden::Hash;
+
+// The number of directories getSHA1() resolves concurrently.  Watchman asks
+// for the SHA-1s of many thousands of files at once, and without a bound we
+// would start loading all of their directories and blobs at the same time.
+constexpr size_t kMaxConcurrentSha1Dirs = 64;
+
 std::string logHash(StringPiece thriftArg) {
   if (thriftArg.size() == Hash::RAW_SIZE) {
     return Hash{folly::ByteRange{thriftArg}}.toString();
@@ -90,6 +120,20 @@ std::string logHash(StringPiece thriftArg) {
     return folly::hexlify(thriftArg);
   }
 }
+
+/**
+ * Append an entry of a TreeView or a Tree to a debugGetScmTree() result.
+ */
+template <typename Entry>
+void addScmTreeEntry(
+    std::vector<facebook::eden::ScmTreeEntry>& entries,
+    const Entry& entry) {
+  entries.emplace_back();
+  auto& out = entries.back();
+  out.name = entry.getName().stringPiece().str();
+  out.mode = facebook::eden::modeFromTreeEntryType(entry.getType());
+  out.id = facebook::eden::thriftHash(entry.getHash());
+}
 } // namespace
 
 #define TLOG(logger, level, file, line)     \
@@ -183,6 +227,192 @@ class ThriftLogHelper {
 namespace facebook {
 namespace eden {
 
+namespace {
+/**
+ * Convert SubscribeParams to StreamingSubscriber::Options, throwing an
+ * EdenError if they are invalid.
+ */
+StreamingSubscriber::Options subscribeOptions(const SubscribeParams& params) {
+  StreamingSubscriber::Options options;
+  if (params.minIntervalMs < 0) {
+    throw newEdenError(EINVAL, "minIntervalMs must not be negative");
+  }
+  options.minInterval = std::chrono::milliseconds{params.minIntervalMs};
+  for (const auto& prefix : params.pathPrefixes) {
+    try {
+      options.pathPrefixes.emplace_back(prefix);
+    } catch (const std::exception& exc) {
+      throw newEdenError(
+          EINVAL, "invalid path prefix \"{}\": {}", prefix, exc.what());
+    }
+  }
+  return options;
+}
+
+// The number of blobs globFiles() asks the ObjectStore to prefetch at a time.
+constexpr size_t kPrefetchBatchSize = 20480;
+
+/**
+ * Prefetch blobs[start:] one batch after another.  HgBackingStore imports
+ * each batch on a single importer thread, so a large prefetch leaves the
+ * other importers free for reads rather than queueing every batch at once.
+ */
+Future<Unit> prefetchInBatches(
+    std::shared_ptr<EdenMount> edenMount,
+    std::shared_ptr<const vector<Hash>> blobs,
+    size_t start) {
+  if (start >= blobs->size()) {
+    return folly::unit;
+  }
+  auto end = std::min(start + kPrefetchBatchSize, blobs->size());
+  vector<Hash> batch(blobs->begin() + start, blobs->begin() + end);
+  auto* store = edenMount->getObjectStore();
+  return store->prefetchBlobs(batch).then(
+      [edenMount = std::move(edenMount), blobs = std::move(blobs), end]() {
+        return prefetchInBatches(edenMount, blobs, end);
+      });
+}
+
+/**
+ * Merge the changes journaled in a mount since fromPosition, and set
+ * outFrom and outTo to the range that they cover.  Returns nullptr if
+ * nothing has changed since fromPosition.
+ *
+ * Throws an EdenError with ERANGE if the changes since fromPosition can no
+ * longer be computed.
+ */
+std::unique_ptr<JournalDelta> getChangesSince(
+    EdenMount& edenMount,
+    const JournalPosition& fromPosition,
+    JournalPosition& outFrom,
+    JournalPosition& outTo) {
+  auto delta = edenMount.getJournal().getLatest();
+
+  if (fromPosition.mountGeneration !=
+      static_cast<ssize_t>(edenMount.getMountGeneration())) {
+    throw newEdenError(
+        ERANGE,
+        "fromPosition.mountGeneration does not match the current "
+        "mountGeneration.  "
+        "You need to compute a new basis for delta queries.");
+  }
+
+  outTo.sequenceNumber = delta->toSequence;
+  outTo.snapshotHash = thriftHash(delta->toHash);
+  outTo.mountGeneration = edenMount.getMountGeneration();
+
+  outFrom = outTo;
+
+  // The +1 is because the core merge stops at the item prior to
+  // its limitSequence parameter and we want the changes *since*
+  // the provided sequence number.
+  auto merged =
+      edenMount.getJournal().accumulateRange(fromPosition.sequenceNumber + 1);
+  if (!merged) {
+    return nullptr;
+  }
+  if (merged->isTruncated) {
+    // Some of the changes in this range are no longer in the journal, so
+    // any answer we gave would be missing paths.
+    throw newEdenError(
+        ERANGE,
+        "the journal no longer holds changes since sequence number {}.  "
+        "You need to compute a new basis for delta queries.",
+        fromPosition.sequenceNumber);
+  }
+
+  // Deltas may have been added since we looked at the tip above.
+  outTo.sequenceNumber = merged->toSequence;
+  outTo.snapshotHash = thriftHash(merged->toHash);
+
+  // The Journal coalesces repeated modifications into one delta, which
+  // may start before the requested position.  Still report the range as
+  // starting just after it.
+  outFrom.sequenceNumber = std::max<int64_t>(
+      merged->fromSequence, fromPosition.sequenceNumber + 1);
+  outFrom.snapshotHash = thriftHash(merged->fromHash);
+  outFrom.mountGeneration = outTo.mountGeneration;
+  return merged;
+}
+
+/**
+ * Get the files that differ between the commits a merged delta moved
+ * between, or nullptr if it did not change commits or commit transitions
+ * are not being expanded.
+ *
+ * A filter or limit restricts the diff as diffCommits() does.
+ */
+std::shared_ptr<const ScmStatus> getCommitChanges(
+    const EdenMount& edenMount,
+    const JournalDelta& merged,
+    const PathPrefixFilter& filter = PathPrefixFilter{},
+    size_t limit = 0) {
+  // Checkouts are journaled as just the commits they moved between.  Only
+  // diff those commits now that a client is asking about the range, and
+  // share the result with any other clients that ask.
+  if (!FLAGS_journal_expand_commit_transitions ||
+      merged.fromHash == merged.toHash) {
+    return nullptr;
+  }
+  if (filter.matchesAll() && limit == 0) {
+    return edenMount.getCommitDiffCache()
+        ->getDiff(merged.fromHash, merged.toHash)
+        .get();
+  }
+  // Restricted diffs are cheap, and are not worth sharing.
+  return std::make_shared<const ScmStatus>(
+      diffCommits(
+          edenMount.getObjectStore(),
+          merged.fromHash,
+          merged.toHash,
+          filter,
+          limit,
+          edenMount.getBackgroundThreadPool().get())
+          .get());
+}
+
+/**
+ * Convert the prefixes of a ResultFilter to a PathPrefixFilter, throwing
+ * an EdenError if they are invalid.
+ */
+PathPrefixFilter toPathPrefixFilter(const ResultFilter& filter) {
+  vector<RelativePath> prefixes;
+  for (const auto& prefix : filter.pathPrefixes) {
+    try {
+      prefixes.emplace_back(prefix);
+    } catch (const std::exception& exc) {
+      throw newEdenError(
+          EINVAL, "invalid path prefix \"{}\": {}", prefix, exc.what());
+    }
+  }
+  return PathPrefixFilter{std::move(prefixes)};
+}
+
+/**
+ * Get the limit of a ResultFilter, where 0 means no limit, throwing an
+ * EdenError if it is invalid.
+ */
+size_t toResultLimit(const ResultFilter& filter) {
+  if (filter.limit < 0) {
+    throw newEdenError(EINVAL, "limit must not be negative");
+  }
+  return static_cast<size_t>(filter.limit);
+}
+
+/**
+ * Build a PathTable of the entries of a status, tagged with their
+ * ScmFileStatus.
+ */
+std::string statusPathTable(const ScmStatus& status) {
+  // entries is a sorted map, so its paths can be added as they are.
+  PathTableBuilder builder;
+  for (const auto& entry : status.entries) {
+    builder.add(entry.first, static_cast<uint8_t>(entry.second));
+  }
+  return std::move(builder).finish();
+}
+} // namespace
+
 EdenServiceHandler::EdenServiceHandler(EdenServer* server)
     : FacebookBase2("Eden"), server_(server) {}
 
@@ -226,8 +456,8 @@ void EdenServiceHandler::listMounts(std::vector<MountInfo>& results) {
   }
 }
 
-void EdenServiceHandler::checkOutRevision(
-    std::vector<CheckoutConflict>& results,
+folly::Future<std::unique_ptr<std::vector<CheckoutConflict>>>
+EdenServiceHandler::future_checkOutRevision(
     std::unique_ptr<std::string> mountPoint,
     std::unique_ptr<std::string> hash,
     CheckoutMode checkoutMode) {
@@ -240,8 +470,45 @@ void EdenServiceHandler::checkOutRevision(
   auto hashObj = hashFromThrift(*hash);
 
   auto edenMount = server_->getMount(*mountPoint);
-  auto checkoutFuture = edenMount->checkout(hashObj, checkoutMode);
-  results = std::move(checkoutFuture).get();
+  return helper.wrapFuture(
+      edenMount->checkout(hashObj, checkoutMode)
+          .then([](vector<CheckoutConflict>&& conflicts) {
+            return make_unique<vector<CheckoutConflict>>(std::move(conflicts));
+          }));
+}
+
+folly::Future<int64_t> EdenServiceHandler::future_prefetchCommitTrees(
+    std::unique_ptr<PrefetchCommitTreesParams> params) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG2,
+      params->mountPoint,
+      logHash(params->commit),
+      params->maxDepth,
+      "[" + folly::join(", ", params->paths) + "]");
+  if (params->maxDepth < 0) {
+    throw newEdenError(EINVAL, "maxDepth must not be negative");
+  }
+  std::vector<RelativePath> paths;
+  try {
+    for (const auto& path : params->paths) {
+      paths.emplace_back(path);
+    }
+  } catch (const std::domain_error& ex) {
+    throw newEdenError(EINVAL, ex.what());
+  }
+
+  auto edenMount = server_->getMount(params->mountPoint);
+  return helper.wrapFuture(
+      prefetchChangedTrees(
+          edenMount->getObjectStore(),
+          edenMount->getParentCommits().parent1(),
+          hashFromThrift(params->commit),
+          static_cast<size_t>(params->maxDepth),
+          std::move(paths),
+          edenMount->getBackgroundThreadPool().get())
+          .thenValue([edenMount](uint64_t numTrees) {
+            return static_cast<int64_t>(numTrees);
+          }));
 }
 
 void EdenServiceHandler::resetParentCommits(
@@ -258,61 +525,89 @@ void EdenServiceHandler::resetParentCommits(
   edenMount->resetParents(edenParents);
 }
 
-void EdenServiceHandler::getSHA1(
-    vector<SHA1Result>& out,
+folly::Future<unique_ptr<vector<SHA1Result>>>
+EdenServiceHandler::future_getSHA1(
     unique_ptr<string> mountPoint,
     unique_ptr<vector<string>> paths) {
   auto helper = INSTRUMENT_THRIFT_CALL(
       DBG3, *mountPoint, "[" + folly::join(", ", *paths.get()) + "]");
 
-  vector<Future<Hash>> futures;
-  for (const auto& path : *paths) {
-    futures.emplace_back(getSHA1ForPathDefensively(*mountPoint, path));
-  }
+  auto edenMount = server_->getMount(*mountPoint);
 
-  auto results = folly::collectAllSemiFuture(std::move(futures)).get();
-  for (auto& result : results) {
-    out.emplace_back();
-    SHA1Result& sha1Result = out.back();
-    if (result.hasValue()) {
-      sha1Result.set_sha1(thriftHash(result.value()));
-    } else {
-      sha1Result.set_error(newEdenError(result.exception()));
+  // Group the paths by their parent directory, so that each directory is
+  // only looked up once no matter how many of its children were requested.
+  struct DirBatch {
+    RelativePath dir;
+    vector<PathComponent> names;
+    vector<size_t> indexes;
+  };
+  vector<DirBatch> batches;
+  std::unordered_map<RelativePathPiece, size_t> batchIndexes;
+  auto results = std::make_shared<vector<Try<Hash>>>(paths->size());
+  for (size_t n = 0; n < paths->size(); ++n) {
+    const auto& path = (*paths)[n];
+    if (path.empty()) {
+      (*results)[n] = Try<Hash>(
+          newEdenError(EINVAL, "path cannot be the empty string"));
+      continue;
     }
-  }
-}
-
-Future<Hash> EdenServiceHandler::getSHA1ForPathDefensively(
-    StringPiece mountPoint,
-    StringPiece path) noexcept {
-  // Calls getSHA1ForPath() and traps all immediate exceptions and converts
-  // them in to a Future result.
-  try {
-    return getSHA1ForPath(mountPoint, path);
-  } catch (const std::system_error& e) {
-    return makeFuture<Hash>(newEdenError(e));
-  }
-}
-
-Future<Hash> EdenServiceHandler::getSHA1ForPath(
-    StringPiece mountPoint,
-    StringPiece path) {
-  if (path.empty()) {
-    return makeFuture<Hash>(
-        newEdenError(EINVAL, "path cannot be the empty string"));
-  }
-
-  auto edenMount = server_->getMount(mountPoint);
-  auto relativePath = RelativePathPiece{path};
-  return edenMount->getInode(relativePath).then([](const InodePtr& inode) {
-    auto fileInode = inode.asFilePtr();
-    if (!S_ISREG(fileInode->getMode())) {
-      // We intentionally want to refuse to compute the SHA1 of symlinks
-      return makeFuture<Hash>(
-          InodeError(EINVAL, fileInode, "file is a symlink"));
+    try {
+      auto relativePath = RelativePathPiece{path};
+      auto ret = batchIndexes.emplace(relativePath.dirname(), batches.size());
+      if (ret.second) {
+        batches.push_back(
+            DirBatch{RelativePath{relativePath.dirname()}, {}, {}});
+      }
+      auto& batch = batches[ret.first->second];
+      batch.names.emplace_back(relativePath.basename());
+      batch.indexes.push_back(n);
+    } catch (const std::system_error& e) {
+      (*results)[n] = Try<Hash>(newEdenError(e));
     }
-    return fileInode->getSha1();
-  });
+  }
+  batchIndexes.clear();
+
+  // Resolve a bounded number of directories at a time.  Each batch only
+  // writes to its own entries in results, so the thrift thread is never
+  // blocked waiting for them.
+  auto done = folly::window(
+      std::move(batches),
+      [edenMount, results](DirBatch batch) {
+        auto dir = batch.dir;
+        auto shared = std::make_shared<DirBatch>(std::move(batch));
+        return edenMount->getInode(dir)
+            .then([shared](const InodePtr& inode) {
+              return inode.asTreePtr()->getChildSha1s(shared->names);
+            })
+            .then([shared, results](Try<vector<Try<Hash>>>&& hashes) {
+              for (size_t n = 0; n < shared->indexes.size(); ++n) {
+                auto& result = (*results)[shared->indexes[n]];
+                if (hashes.hasException()) {
+                  result = Try<Hash>(newEdenError(hashes.exception()));
+                } else if (hashes->at(n).hasException()) {
+                  result = Try<Hash>(newEdenError(hashes->at(n).exception()));
+                } else {
+                  result = std::move(hashes->at(n));
+                }
+              }
+            });
+      },
+      kMaxConcurrentSha1Dirs);
+  return helper.wrapFuture(
+      folly::collectAll(std::move(done)).then([results](vector<Try<Unit>>&&) {
+        auto out = make_unique<vector<SHA1Result>>();
+        out->reserve(results->size());
+        for (auto& result : *results) {
+          out->emplace_back();
+          SHA1Result& sha1Result = out->back();
+          if (result.hasValue()) {
+            sha1Result.set_sha1(thriftHash(result.value()));
+          } else {
+            sha1Result.set_error(newEdenError(result.exception()));
+          }
+        }
+        return out;
+      }));
 }
 
 void EdenServiceHandler::getBindMounts(
@@ -353,76 +648,191 @@ void EdenServiceHandler::async_tm_subscribe(
   StreamingSubscriber::subscribe(std::move(callback), std::move(edenMount));
 }
 
+void EdenServiceHandler::async_tm_subscribeFiltered(
+    std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+        std::unique_ptr<SubscriptionNotification>>> callback,
+    std::unique_ptr<SubscribeParams> params) {
+  auto edenMount = server_->getMount(params->mountPoint);
+
+  StreamingSubscriber::Options options;
+  try {
+    options = subscribeOptions(*params);
+  } catch (const EdenError& err) {
+    callback->exception(folly::make_exception_wrapper<EdenError>(err));
+    return;
+  }
+
+  StreamingSubscriber::subscribe(
+      std::move(callback), std::move(edenMount), std::move(options));
+}
+
+void EdenServiceHandler::async_tm_subscribeFileDeltas(
+    std::unique_ptr<
+        apache::thrift::StreamingHandlerCallback<std::unique_ptr<FileDelta>>>
+        callback,
+    std::unique_ptr<SubscribeParams> params,
+    std::unique_ptr<JournalPosition> fromPosition) {
+  auto edenMount = server_->getMount(params->mountPoint);
+
+  StreamingSubscriber::Options options;
+  try {
+    options = subscribeOptions(*params);
+    if (fromPosition->mountGeneration !=
+        static_cast<ssize_t>(edenMount->getMountGeneration())) {
+      throw newEdenError(
+          ERANGE,
+          "fromPosition.mountGeneration does not match the current "
+          "mountGeneration.  "
+          "You need to compute a new basis for delta queries.");
+    }
+  } catch (const EdenError& err) {
+    callback->exception(folly::make_exception_wrapper<EdenError>(err));
+    return;
+  }
+
+  StreamingSubscriber::subscribe(
+      std::move(callback),
+      std::move(edenMount),
+      std::move(options),
+      static_cast<JournalDelta::SequenceNumber>(fromPosition->sequenceNumber));
+}
+
 void EdenServiceHandler::getFilesChangedSince(
     FileDelta& out,
     std::unique_ptr<std::string> mountPoint,
     std::unique_ptr<JournalPosition> fromPosition) {
   auto helper = INSTRUMENT_THRIFT_CALL(DBG3, *mountPoint);
   auto edenMount = server_->getMount(*mountPoint);
-  auto delta = edenMount->getJournal().getLatest();
+  auto merged = getChangesSince(
+      *edenMount, *fromPosition, out.fromPosition, out.toPosition);
+  if (!merged) {
+    return;
+  }
 
-  if (fromPosition->mountGeneration !=
-      static_cast<ssize_t>(edenMount->getMountGeneration())) {
-    throw newEdenError(
-        ERANGE,
-        "fromPosition.mountGeneration does not match the current "
-        "mountGeneration.  "
-        "You need to compute a new basis for delta queries.");
+  for (const auto& entry : merged->changedFilesInOverlay) {
+    auto& path = entry.first;
+    auto& changeInfo = entry.second;
+    if (changeInfo.isNew()) {
+      out.createdPaths.emplace_back(path.stringPiece().str());
+    } else {
+      out.changedPaths.emplace_back(path.stringPiece().str());
+    }
   }
 
-  out.toPosition.sequenceNumber = delta->toSequence;
-  out.toPosition.snapshotHash = thriftHash(delta->toHash);
-  out.toPosition.mountGeneration = edenMount->getMountGeneration();
+  for (auto& path : merged->uncleanPaths) {
+    out.uncleanPaths.emplace_back(path.stringPiece().str());
+  }
 
-  out.fromPosition = out.toPosition;
+  if (auto diff = getCommitChanges(*edenMount, *merged)) {
+    for (const auto& entry : diff->entries) {
+      out.commitChangedPaths.emplace_back(entry.first);
+    }
+    // Report files that could not be compared as changed, so that clients
+    // do not miss them.
+    for (const auto& error : diff->errors) {
+      out.commitChangedPaths.emplace_back(error.first);
+    }
+  }
+}
 
-  // The +1 is because the core merge stops at the item prior to
-  // its limitSequence parameter and we want the changes *since*
-  // the provided sequence number.
-  auto merged = delta->merge(fromPosition->sequenceNumber + 1, true);
-  if (merged) {
-    out.fromPosition.sequenceNumber = merged->fromSequence;
-    out.fromPosition.snapshotHash = thriftHash(merged->fromHash);
-    out.fromPosition.mountGeneration = out.toPosition.mountGeneration;
-
-    for (const auto& entry : merged->changedFilesInOverlay) {
-      auto& path = entry.first;
-      auto& changeInfo = entry.second;
-      if (changeInfo.isNew()) {
-        out.createdPaths.emplace_back(path.stringPiece().str());
-      } else {
-        out.changedPaths.emplace_back(path.stringPiece().str());
-      }
+void EdenServiceHandler::getFilesChangedSinceFiltered(
+    FileDelta& out,
+    std::unique_ptr<std::string> mountPoint,
+    std::unique_ptr<JournalPosition> fromPosition,
+    std::unique_ptr<ResultFilter> filter) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG3,
+      *mountPoint,
+      "[" + folly::join(", ", filter->pathPrefixes) + "]",
+      filter->limit);
+  auto prefixFilter = toPathPrefixFilter(*filter);
+  auto limit = toResultLimit(*filter);
+  auto edenMount = server_->getMount(*mountPoint);
+  auto merged = getChangesSince(
+      *edenMount, *fromPosition, out.fromPosition, out.toPosition);
+  if (!merged) {
+    return;
+  }
+
+  size_t count = 0;
+  auto add = [&](vector<string>& paths, RelativePathPiece path) {
+    if (!prefixFilter.matches(path)) {
+      return;
+    }
+    if (limit != 0 && count >= limit) {
+      out.truncated = true;
+      return;
     }
+    ++count;
+    paths.emplace_back(path.stringPiece().str());
+  };
+
+  for (const auto& entry : merged->changedFilesInOverlay) {
+    add(entry.second.isNew() ? out.createdPaths : out.changedPaths,
+        entry.first);
+  }
+  for (const auto& path : merged->uncleanPaths) {
+    add(out.uncleanPaths, path);
+  }
 
-    for (auto& path : merged->uncleanPaths) {
-      out.uncleanPaths.emplace_back(path.stringPiece().str());
+  // One more difference than fits is enough to know that the result is
+  // truncated.
+  auto diffLimit = limit == 0 ? 0 : limit - std::min(count, limit) + 1;
+  if (auto diff =
+          getCommitChanges(*edenMount, *merged, prefixFilter, diffLimit)) {
+    for (const auto& entry : diff->entries) {
+      add(out.commitChangedPaths, RelativePathPiece{entry.first});
+    }
+    for (const auto& error : diff->errors) {
+      add(out.commitChangedPaths, RelativePathPiece{error.first});
+    }
+    if (diff->truncated) {
+      out.truncated = true;
     }
   }
 }
 
-namespace {
-/**
- * Starting from the provided delta, walks the chain backwards until it finds
- * the delta whose [fromSequence, toSequence] range includes `target`.
- */
-const JournalDelta* FOLLY_NULLABLE
-findJournalDelta(const JournalDelta* delta, Journal::SequenceNumber target) {
-  // If the tip of the delta chain precedes the target, then do not bother to
-  // search.
-  if (delta == nullptr || delta->toSequence < target) {
-    return nullptr;
+void EdenServiceHandler::getFilesChangedSinceCompact(
+    CompactFileDelta& out,
+    std::unique_ptr<std::string> mountPoint,
+    std::unique_ptr<JournalPosition> fromPosition) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG3, *mountPoint);
+  auto edenMount = server_->getMount(*mountPoint);
+  auto merged = getChangesSince(
+      *edenMount, *fromPosition, out.fromPosition, out.toPosition);
+  if (!merged) {
+    out.changedPaths = PathTableBuilder{}.finish();
+    out.uncleanPaths = PathTableBuilder{}.finish();
+    out.commitChangedPaths = PathTableBuilder{}.finish();
+    return;
+  }
+
+  // The tables refer to the paths held by merged, so building them copies
+  // each path once, into the response.
+  vector<std::pair<StringPiece, uint8_t>> paths;
+  paths.reserve(merged->changedFilesInOverlay.size());
+  for (const auto& entry : merged->changedFilesInOverlay) {
+    paths.emplace_back(entry.first.stringPiece(), entry.second.isNew());
+  }
+  out.changedPaths = PathTableBuilder::build(std::move(paths));
+
+  paths.clear();
+  for (const auto& path : merged->uncleanPaths) {
+    paths.emplace_back(path.stringPiece(), 0);
   }
+  out.uncleanPaths = PathTableBuilder::build(std::move(paths));
 
-  while (delta) {
-    if (delta->fromSequence <= target && target <= delta->toSequence) {
-      return delta;
+  paths.clear();
+  if (auto diff = getCommitChanges(*edenMount, *merged)) {
+    for (const auto& entry : diff->entries) {
+      paths.emplace_back(entry.first, 0);
+    }
+    for (const auto& error : diff->errors) {
+      paths.emplace_back(error.first, 0);
     }
-    delta = delta->previous.get();
   }
-  return nullptr;
+  out.commitChangedPaths = PathTableBuilder::build(std::move(paths));
 }
-} // namespace
 
 void EdenServiceHandler::debugGetRawJournal(
     DebugGetRawJournalResponse& out,
@@ -440,56 +850,51 @@ void EdenServiceHandler::debugGetRawJournal(
         "You need to compute a new basis for delta queries.");
   }
 
-  auto latest = edenMount->getJournal().getLatest();
-
-  // Walk the journal until we find toPosition.
-  auto toPos =
-      findJournalDelta(latest.get(), params->toPosition.sequenceNumber);
-  if (toPos == nullptr) {
+  auto& journal = edenMount->getJournal();
+  auto latest = journal.getLatest();
+  auto toSequence =
+      static_cast<Journal::SequenceNumber>(params->toPosition.sequenceNumber);
+  if (!latest || latest->toSequence < toSequence) {
     throw newEdenError(
-        "no JournalDelta found for toPosition.sequenceNumber ",
-        params->toPosition.sequenceNumber);
+        "no JournalDelta found for toPosition.sequenceNumber ", toSequence);
   }
 
-  // Walk the journal until we find a JournalDelta that preceeds fromPosition,
-  // or the beginning of the chain, whichever comes first.
-  auto current = toPos;
-  auto fromPos = params->fromPosition.sequenceNumber;
-  while (current) {
-    if (static_cast<ssize_t>(current->toSequence) < fromPos) {
-      break;
-    }
-
-    DebugJournalDelta delta;
-    JournalPosition fromPosition;
-    fromPosition.set_mountGeneration(mountGeneration);
-    fromPosition.set_sequenceNumber(current->fromSequence);
-    fromPosition.set_snapshotHash(thriftHash(current->fromHash));
-    delta.set_fromPosition(fromPosition);
-
-    JournalPosition toPosition;
-    toPosition.set_mountGeneration(mountGeneration);
-    toPosition.set_sequenceNumber(current->toSequence);
-    toPosition.set_snapshotHash(thriftHash(current->toHash));
-    delta.set_toPosition(toPosition);
-
-    for (const auto& entry : current->changedFilesInOverlay) {
-      auto& path = entry.first;
-      auto& changeInfo = entry.second;
-
-      DebugPathChangeInfo debugChangeInfo;
-      debugChangeInfo.existedBefore = changeInfo.existedBefore;
-      debugChangeInfo.existedAfter = changeInfo.existedAfter;
-      delta.changedPaths.emplace(path.stringPiece().str(), debugChangeInfo);
-    }
-
-    for (auto& path : current->uncleanPaths) {
-      delta.uncleanPaths.emplace(path.stringPiece().str());
-    }
-
-    out.allDeltas.push_back(delta);
-    current = current->previous.get();
-  }
+  // Walk the journal back from toPosition until we find a JournalDelta that
+  // preceeds fromPosition, or the beginning of the journal, whichever comes
+  // first.
+  auto fromSequence = static_cast<Journal::SequenceNumber>(
+      std::max<int64_t>(params->fromPosition.sequenceNumber, 0));
+  journal.forEachDelta(
+      fromSequence, toSequence, [&](const JournalDelta& current) {
+        DebugJournalDelta delta;
+        JournalPosition fromPosition;
+        fromPosition.set_mountGeneration(mountGeneration);
+        fromPosition.set_sequenceNumber(current.fromSequence);
+        fromPosition.set_snapshotHash(thriftHash(current.fromHash));
+        delta.set_fromPosition(fromPosition);
+
+        JournalPosition toPosition;
+        toPosition.set_mountGeneration(mountGeneration);
+        toPosition.set_sequenceNumber(current.toSequence);
+        toPosition.set_snapshotHash(thriftHash(current.toHash));
+        delta.set_toPosition(toPosition);
+
+        current.forEachChangedPath(
+            [&](RelativePathPiece path, const PathChangeInfo& changeInfo) {
+              DebugPathChangeInfo debugChangeInfo;
+              debugChangeInfo.existedBefore = changeInfo.existedBefore;
+              debugChangeInfo.existedAfter = changeInfo.existedAfter;
+              delta.changedPaths.emplace(
+                  path.stringPiece().str(), debugChangeInfo);
+            });
+
+        current.forEachUncleanPath([&](RelativePathPiece path) {
+          delta.uncleanPaths.emplace(path.stringPiece().str());
+        });
+
+        out.allDeltas.push_back(delta);
+        return true;
+      });
 }
 
 folly::Future<std::unique_ptr<std::vector<FileInformationOrError>>>
@@ -540,8 +945,7 @@ EdenServiceHandler::future_getFileInformation(
       });
 }
 
-void EdenServiceHandler::glob(
-    vector<string>& out,
+folly::Future<unique_ptr<vector<string>>> EdenServiceHandler::future_glob(
     unique_ptr<string> mountPoint,
     unique_ptr<vector<string>> globs) {
   auto helper = INSTRUMENT_THRIFT_CALL(
@@ -549,27 +953,36 @@ void EdenServiceHandler::glob(
   auto edenMount = server_->getMount(*mountPoint);
   auto rootInode = edenMount->getRootInode();
 
+  // Compile the list of globs into a tree
+  auto globRoot = std::make_shared<GlobNode>(/*includeDotfiles=*/true);
   try {
-    // Compile the list of globs into a tree
-    GlobNode globRoot(/*includeDotfiles=*/true);
     for (auto& globString : *globs) {
-      globRoot.parse(globString);
-    }
-
-    // and evaluate it against the root
-    auto matches = globRoot
-                       .evaluate(
-                           edenMount->getObjectStore(),
-                           RelativePathPiece(),
-                           rootInode,
-                           /*fileBlobsToPrefetch=*/nullptr)
-                       .get();
-    for (auto& fileName : matches) {
-      out.emplace_back(fileName.stringPiece().toString());
+      globRoot->parse(globString);
     }
   } catch (const std::system_error& exc) {
     throw newEdenError(exc);
   }
+
+  // and evaluate it against the root
+  return helper.wrapFuture(
+      globRoot
+          ->evaluate(
+              edenMount->getObjectStore(),
+              RelativePathPiece(),
+              rootInode,
+              /*fileBlobsToPrefetch=*/nullptr,
+              edenMount->getBackgroundThreadPool().get())
+          .then([globRoot](std::vector<RelativePath>&& matches) {
+            auto out = make_unique<vector<string>>();
+            out->reserve(matches.size());
+            for (auto& fileName : matches) {
+              out->emplace_back(fileName.stringPiece().toString());
+            }
+            return out;
+          })
+          .onError([](const std::system_error& exc) {
+            return makeFuture<unique_ptr<vector<string>>>(newEdenError(exc));
+          }));
 }
 
 folly::Future<std::unique_ptr<Glob>> EdenServiceHandler::future_globFiles(
@@ -603,9 +1016,12 @@ folly::Future<std::unique_ptr<Glob>> EdenServiceHandler::future_globFiles(
               edenMount->getObjectStore(),
               RelativePathPiece(),
               rootInode,
-              fileBlobsToPrefetch)
+              fileBlobsToPrefetch,
+              edenMount->getBackgroundThreadPool().get())
           .then([edenMount,
                  fileBlobsToPrefetch,
+                 limiter = server_->getPrefetchLimiter(),
+                 client = getPrefetchClientId(),
                  suppressFileList = params->suppressFileList](
                     std::vector<RelativePath>&& paths) {
             auto out = std::make_unique<Glob>();
@@ -621,25 +1037,15 @@ folly::Future<std::unique_ptr<Glob>> EdenServiceHandler::future_globFiles(
               }
             }
             if (fileBlobsToPrefetch) {
-              std::vector<folly::Future<folly::Unit>> futures;
-
-              auto store = edenMount->getObjectStore();
-              auto blobs = fileBlobsToPrefetch->rlock();
-              std::vector<Hash> batch;
-
-              for (auto& hash : *blobs) {
-                if (batch.size() >= 20480) {
-                  futures.emplace_back(store->prefetchBlobs(batch));
-                  batch.clear();
-                }
-                batch.emplace_back(hash);
-              }
-              if (!batch.empty()) {
-                futures.emplace_back(store->prefetchBlobs(batch));
-              }
-
-              return folly::collect(futures).then(
-                  [glob = std::move(out)]() mutable {
+              auto blobs = std::make_shared<const vector<Hash>>(
+                  std::move(*fileBlobsToPrefetch->wlock()));
+              // This throws EAGAIN if too many blobs are already being
+              // prefetched, and otherwise holds the budget until the
+              // prefetch finishes.
+              auto admission = std::make_shared<PrefetchLimiter::Admission>(
+                  limiter->admit(client, blobs->size()));
+              return prefetchInBatches(edenMount, std::move(blobs), 0)
+                  .then([glob = std::move(out), admission]() mutable {
                     return makeFuture(std::move(glob));
                   });
             }
@@ -650,6 +1056,183 @@ folly::Future<std::unique_ptr<Glob>> EdenServiceHandler::future_globFiles(
           }));
 }
 
+folly::Future<std::unique_ptr<Glob>> EdenServiceHandler::future_searchFileNames(
+    std::unique_ptr<FileNameSearchParams> params) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG3,
+      params->mountPoint,
+      "[" + folly::join(", ", params->globs) + "]",
+      params->includeDotfiles);
+  auto edenMount = server_->getMount(params->mountPoint);
+
+  auto queries = std::make_shared<vector<PathIndex::Query>>();
+  for (const auto& glob : params->globs) {
+    auto query = PathIndex::parseGlob(glob);
+    if (!query) {
+      throw newEdenError(
+          EINVAL, "searchFileNames() does not support the glob \"{}\"", glob);
+    }
+    queries->push_back(std::move(query).value());
+  }
+
+  // The index describes the commit, and the status has the local changes
+  // made on top of it.  The status is kept up to date from the journal by
+  // the ScmStatusCache, so neither of them walks the tree once computed.
+  auto commitHash = edenMount->getParentCommits().parent1();
+  auto includeDotfiles = params->includeDotfiles;
+  return helper.wrapFuture(
+      folly::collect(
+          edenMount->getPathIndex(commitHash),
+          edenMount->getScmStatusCache()->getStatus(
+              commitHash, /*listIgnored=*/false))
+          .thenValue([edenMount, queries, includeDotfiles](
+                         std::tuple<
+                             std::shared_ptr<const PathIndex>,
+                             unique_ptr<ScmStatus>> results) {
+            const auto& index = std::get<0>(results);
+            const auto& status = std::get<1>(results)->entries;
+
+            std::set<string> matches;
+            for (const auto& query : *queries) {
+              for (auto path : index->search(query, includeDotfiles)) {
+                auto name = path.stringPiece().str();
+                auto it = status.find(name);
+                if (it == status.end() ||
+                    it->second != ScmFileStatus::REMOVED) {
+                  matches.insert(std::move(name));
+                }
+              }
+            }
+            for (const auto& entry : status) {
+              if (entry.second != ScmFileStatus::ADDED) {
+                continue;
+              }
+              RelativePathPiece path{entry.first};
+              for (const auto& query : *queries) {
+                if (query.matches(path, includeDotfiles)) {
+                  matches.insert(entry.first);
+                  break;
+                }
+              }
+            }
+
+            auto out = std::make_unique<Glob>();
+            out->matchingFiles.assign(matches.begin(), matches.end());
+            return out;
+          }));
+}
+
+void EdenServiceHandler::startRecordingAccessProfile(
+    std::unique_ptr<std::string> mountPoint,
+    std::unique_ptr<std::string> tag) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG2, *mountPoint, *tag);
+  auto edenMount = server_->getMount(*mountPoint);
+  if (!edenMount->startRecordingAccessProfile(*tag)) {
+    throw newEdenError(
+        EEXIST, "access profile \"{}\" is already being recorded", *tag);
+  }
+}
+
+void EdenServiceHandler::stopRecordingAccessProfile(
+    std::string& profile,
+    std::unique_ptr<std::string> mountPoint,
+    std::unique_ptr<std::string> tag) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG2, *mountPoint, *tag);
+  auto edenMount = server_->getMount(*mountPoint);
+  auto recorded = edenMount->stopRecordingAccessProfile(*tag);
+  if (!recorded) {
+    throw newEdenError(
+        ENOENT, "access profile \"{}\" is not being recorded", *tag);
+  }
+  profile = recorded->serialize();
+}
+
+folly::Future<int64_t> EdenServiceHandler::future_prefetchAccessProfile(
+    std::unique_ptr<std::string> mountPoint,
+    std::unique_ptr<std::string> profile) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG2, *mountPoint);
+  auto edenMount = server_->getMount(*mountPoint);
+  std::shared_ptr<const AccessProfile> parsed;
+  try {
+    parsed = std::make_shared<AccessProfile>(
+        AccessProfile::parse(folly::StringPiece{*profile}));
+  } catch (const std::invalid_argument& ex) {
+    throw newEdenError(EINVAL, ex.what());
+  }
+  return helper.wrapFuture(
+      edenMount->prefetchAccessProfile(std::move(parsed))
+          .thenValue([edenMount](size_t numFiles) {
+            return static_cast<int64_t>(numFiles);
+          }));
+}
+
+void EdenServiceHandler::widenMountScope(
+    std::unique_ptr<std::string> mountPoint,
+    std::unique_ptr<std::vector<std::string>> paths) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG2, *mountPoint, "[" + folly::join(", ", *paths) + "]");
+  auto edenMount = server_->getMount(*mountPoint);
+  vector<RelativePath> includes;
+  includes.reserve(paths->size());
+  try {
+    for (const auto& path : *paths) {
+      includes.emplace_back(path);
+    }
+  } catch (const std::domain_error& ex) {
+    throw newEdenError(EINVAL, ex.what());
+  }
+  edenMount->widenScope(includes);
+}
+
+void EdenServiceHandler::getMountScope(
+    std::vector<std::string>& includes,
+    std::unique_ptr<std::string> mountPoint) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG3, *mountPoint);
+  auto edenMount = server_->getMount(*mountPoint);
+  for (const auto& include : edenMount->getScopeIncludes()) {
+    includes.emplace_back(include.stringPiece().str());
+  }
+}
+
+void EdenServiceHandler::async_tm_streamGlobFiles(
+    std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+        std::unique_ptr<GlobChunk>>> callback,
+    std::unique_ptr<GlobParams> params) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG3,
+      params->mountPoint,
+      "[" + folly::join(", ", params->globs) + "]",
+      params->includeDotfiles);
+  auto edenMount = server_->getMount(params->mountPoint);
+
+  // StreamingGlobber sends the results as it finds them and releases itself
+  // once the stream is closed.
+  StreamingGlobber::glob(
+      std::move(callback),
+      std::move(edenMount),
+      std::move(params),
+      server_->getPrefetchLimiter(),
+      getPrefetchClientId());
+}
+
+void EdenServiceHandler::getPrefetchStatus(PrefetchStatus& result) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG4);
+  auto status = server_->getPrefetchLimiter()->getStatus(getPrefetchClientId());
+  result.blobsInFlight = status.inFlight;
+  result.maxBlobsInFlight = status.maxInFlight;
+  result.clientBlobsInFlight = status.clientInFlight;
+  result.maxClientBlobsInFlight = status.maxPerClient;
+  result.rejectedRequests = status.rejected;
+}
+
+PrefetchLimiter::ClientId EdenServiceHandler::getPrefetchClientId() {
+  // Each build tool keeps its own connection open for as long as it runs, so
+  // the connection stands in for the client.
+  auto* requestContext = getConnectionContext();
+  return reinterpret_cast<PrefetchLimiter::ClientId>(
+      requestContext ? requestContext->getConnectionContext() : nullptr);
+}
+
 void EdenServiceHandler::getManifestEntry(
     ManifestEntry& out,
     std::unique_ptr<std::string> mountPoint,
@@ -693,6 +1276,62 @@ folly::Optional<mode_t> EdenServiceHandler::isInManifestAsFile(
   return folly::none;
 }
 
+folly::Future<std::unique_ptr<ScmStatus>>
+EdenServiceHandler::future_getScmStatusFiltered(
+    std::unique_ptr<std::string> mountPoint,
+    bool listIgnored,
+    std::unique_ptr<std::string> commitHash,
+    std::unique_ptr<ResultFilter> filter) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG2,
+      *mountPoint,
+      folly::to<string>("listIgnored=", listIgnored ? "true" : "false"),
+      folly::to<string>("commitHash=", logHash(*commitHash)),
+      "[" + folly::join(", ", filter->pathPrefixes) + "]",
+      filter->limit);
+
+  auto prefixFilter = toPathPrefixFilter(*filter);
+  auto limit = toResultLimit(*filter);
+  auto mount = server_->getMount(*mountPoint);
+  auto hash = hashFromThrift(*commitHash);
+  if (prefixFilter.matchesAll() && limit == 0) {
+    return helper.wrapFuture(
+        mount->getScmStatusCache()->getStatus(hash, listIgnored));
+  }
+
+  // The cached status covers the whole working directory, so a restricted
+  // diff is cheaper than bringing it up to date.
+  auto* mountPtr = mount.get();
+  return helper.wrapFuture(
+      diffMountForStatus(
+          mountPtr, hash, listIgnored, std::move(prefixFilter), limit)
+          .ensure([mount = std::move(mount)] {}));
+}
+
+folly::Future<std::unique_ptr<CompactScmStatus>>
+EdenServiceHandler::future_getScmStatusCompact(
+    std::unique_ptr<std::string> mountPoint,
+    bool listIgnored,
+    std::unique_ptr<std::string> commitHash) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG2,
+      *mountPoint,
+      folly::to<string>("listIgnored=", listIgnored ? "true" : "false"),
+      folly::to<string>("commitHash=", logHash(*commitHash)));
+
+  auto mount = server_->getMount(*mountPoint);
+  auto hash = hashFromThrift(*commitHash);
+  return helper.wrapFuture(
+      mount->getScmStatusCache()
+          ->getStatus(hash, listIgnored)
+          .then([](std::unique_ptr<ScmStatus> status) {
+            auto out = make_unique<CompactScmStatus>();
+            out->entries = statusPathTable(*status);
+            out->errors = std::move(status->errors);
+            return out;
+          }));
+}
+
 folly::Future<std::unique_ptr<ScmStatus>>
 EdenServiceHandler::future_getScmStatus(
     std::unique_ptr<std::string> mountPoint,
@@ -706,7 +1345,53 @@ EdenServiceHandler::future_getScmStatus(
 
   auto mount = server_->getMount(*mountPoint);
   auto hash = hashFromThrift(*commitHash);
-  return helper.wrapFuture(diffMountForStatus(mount.get(), hash, listIgnored));
+  return helper.wrapFuture(
+      mount->getScmStatusCache()->getStatus(hash, listIgnored));
+}
+
+void EdenServiceHandler::async_tm_streamScmStatus(
+    std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+        std::unique_ptr<ScmStatusChunk>>> callback,
+    std::unique_ptr<StreamScmStatusParams> params) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG2,
+      params->mountPoint,
+      folly::to<string>(
+          "listIgnored=", params->listIgnored ? "true" : "false"),
+      folly::to<string>("commit=", logHash(params->commit)));
+
+  auto mount = server_->getMount(params->mountPoint);
+  auto hash = hashFromThrift(params->commit);
+
+  // StreamingScmStatus sends the results as the diff finds them and releases
+  // itself once the stream is closed.
+  StreamingScmStatus::status(
+      std::move(callback),
+      std::move(mount),
+      hash,
+      params->listIgnored,
+      std::chrono::milliseconds{params->timeoutMs});
+}
+
+void EdenServiceHandler::async_tm_streamScmStatusBetweenRevisions(
+    std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+        std::unique_ptr<ScmStatusChunk>>> callback,
+    std::unique_ptr<StreamScmStatusBetweenRevisionsParams> params) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG2,
+      params->mountPoint,
+      folly::to<string>("oldHash=", logHash(params->oldHash)),
+      folly::to<string>("newHash=", logHash(params->newHash)));
+
+  auto id1 = hashFromThrift(params->oldHash);
+  auto id2 = hashFromThrift(params->newHash);
+  auto mount = server_->getMount(params->mountPoint);
+  StreamingScmStatus::statusBetweenRevisions(
+      std::move(callback),
+      std::move(mount),
+      id1,
+      id2,
+      std::chrono::milliseconds{params->timeoutMs});
 }
 
 folly::Future<std::unique_ptr<ScmStatus>>
@@ -722,11 +1407,46 @@ EdenServiceHandler::future_getScmStatusBetweenRevisions(
   auto id1 = hashFromThrift(*oldHash);
   auto id2 = hashFromThrift(*newHash);
   auto mount = server_->getMount(*mountPoint);
-  return helper.wrapFuture(diffCommits(mount->getObjectStore(), id1, id2)
-                               .then([](ScmStatus&& result) {
-                                 return make_unique<ScmStatus>(
-                                     std::move(result));
-                               }));
+  return helper.wrapFuture(
+      diffCommits(
+          mount->getObjectStore(),
+          id1,
+          id2,
+          mount->getBackgroundThreadPool().get())
+          .then([](ScmStatus&& result) {
+            return make_unique<ScmStatus>(std::move(result));
+          }));
+}
+
+folly::Future<std::unique_ptr<ScmStatus>>
+EdenServiceHandler::future_getScmStatusBetweenRevisionsFiltered(
+    std::unique_ptr<std::string> mountPoint,
+    std::unique_ptr<std::string> oldHash,
+    std::unique_ptr<std::string> newHash,
+    std::unique_ptr<ResultFilter> filter) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG2,
+      *mountPoint,
+      folly::to<string>("oldHash=", logHash(*oldHash)),
+      folly::to<string>("newHash=", logHash(*newHash)),
+      "[" + folly::join(", ", filter->pathPrefixes) + "]",
+      filter->limit);
+  auto prefixFilter = toPathPrefixFilter(*filter);
+  auto limit = toResultLimit(*filter);
+  auto id1 = hashFromThrift(*oldHash);
+  auto id2 = hashFromThrift(*newHash);
+  auto mount = server_->getMount(*mountPoint);
+  return helper.wrapFuture(
+      diffCommits(
+          mount->getObjectStore(),
+          id1,
+          id2,
+          std::move(prefixFilter),
+          limit,
+          mount->getBackgroundThreadPool().get())
+          .then([mount](ScmStatus&& result) {
+            return make_unique<ScmStatus>(std::move(result));
+          }));
 }
 
 void EdenServiceHandler::debugGetScmTree(
@@ -738,25 +1458,28 @@ void EdenServiceHandler::debugGetScmTree(
   auto edenMount = server_->getMount(*mountPoint);
   auto id = hashFromThrift(*idStr);
 
-  std::shared_ptr<const Tree> tree;
   auto store = edenMount->getObjectStore();
   if (localStoreOnly) {
-    auto localStore = store->getLocalStore();
-    tree = localStore->getTree(id).get();
-  } else {
-    tree = store->getTree(id).get();
+    // Read the stored data directly, rather than building a Tree just to
+    // copy its entries again.
+    auto view = store->getLocalStore()->getTreeView(id).get();
+    if (!view) {
+      throw newEdenError("no tree found for id ", *idStr);
+    }
+    entries.reserve(view->size());
+    for (size_t index = 0; index < view->size(); ++index) {
+      addScmTreeEntry(entries, view->getEntryAt(index));
+    }
+    return;
   }
 
+  auto tree = store->getTree(id).get();
   if (!tree) {
     throw newEdenError("no tree found for id ", *idStr);
   }
-
+  entries.reserve(tree->getTreeEntries().size());
   for (const auto& entry : tree->getTreeEntries()) {
-    entries.emplace_back();
-    auto& out = entries.back();
-    out.name = entry.getName().stringPiece().str();
-    out.mode = modeFromTreeEntryType(entry.getType());
-    out.id = thriftHash(entry.getHash());
+    addScmTreeEntry(entries, entry);
   }
 }
 
@@ -855,6 +1578,152 @@ void EdenServiceHandler::debugOutstandingFuseCalls(
   }
 } // namespace eden
 
+namespace {
+std::vector<ProcessAccessCounts> processAccessCountsToThrift(
+    const std::vector<ProcessAccessLog::ProcessCounts>& counts) {
+  std::vector<ProcessAccessCounts> result;
+  result.reserve(counts.size());
+  for (const auto& entry : counts) {
+    ProcessAccessCounts thriftCounts;
+    thriftCounts.pid = entry.pid;
+    thriftCounts.name = entry.name;
+    thriftCounts.fuseRequests = entry.fuseRequests;
+    thriftCounts.treeFetches = entry.treeFetches;
+    thriftCounts.blobFetches = entry.blobFetches;
+    thriftCounts.fetchedBytes = entry.fetchedBytes;
+    result.push_back(std::move(thriftCounts));
+  }
+  return result;
+}
+} // namespace
+
+void EdenServiceHandler::getProcessAccessCounts(
+    ProcessAccessInfo& result,
+    std::unique_ptr<std::string> mountPoint,
+    int64_t limit) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG3, *mountPoint, limit);
+  if (limit < 0) {
+    throw newEdenError(EINVAL, "limit must not be negative");
+  }
+
+  auto edenMount = server_->getMount(*mountPoint);
+  const auto& log = edenMount->getDispatcher()->getProcessAccessLog();
+  result.processes = processAccessCountsToThrift(log.getTopProcesses(limit));
+  result.processNames =
+      processAccessCountsToThrift(log.getTopProcessNames(limit));
+}
+
+namespace {
+template <typename Entry>
+HotObject hotObjectToThrift(const Entry& entry) {
+  HotObject object;
+  object.accesses = entry.accesses;
+  object.hits = entry.hits;
+  object.misses = entry.misses;
+  return object;
+}
+
+std::vector<HotObject> hotObjectsToThrift(
+    const std::vector<ObjectStore::HotObjectTracker::Entry>& entries) {
+  std::vector<HotObject> result;
+  result.reserve(entries.size());
+  for (const auto& entry : entries) {
+    auto object = hotObjectToThrift(entry);
+    object.id = entry.key.toString();
+    result.push_back(std::move(object));
+  }
+  return result;
+}
+} // namespace
+
+void EdenServiceHandler::debugGetHotObjects(
+    HotObjects& result,
+    std::unique_ptr<std::string> mountPoint,
+    int64_t limit) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG3, *mountPoint, limit);
+  if (limit < 0) {
+    throw newEdenError(EINVAL, "limit must not be negative");
+  }
+
+  auto edenMount = server_->getMount(*mountPoint);
+  auto* objectStore = edenMount->getObjectStore();
+  result.trees = hotObjectsToThrift(objectStore->getHotTrees().getTop(limit));
+  result.blobs = hotObjectsToThrift(objectStore->getHotBlobs().getTop(limit));
+
+  auto* inodeMap = edenMount->getInodeMap();
+  for (const auto& entry :
+       edenMount->getDispatcher()->getHotInodes().getTop(limit)) {
+    auto object = hotObjectToThrift(entry);
+    object.inodeNumber = entry.key.get();
+    try {
+      auto path = inodeMap->getPathForInode(entry.key);
+      if (path) {
+        object.id = path->stringPiece().str();
+      }
+    } catch (const std::exception& ex) {
+      // The inode has been forgotten since it was opened.
+      XLOG(DBG3) << "no path for hot inode " << entry.key << ": "
+                 << ex.what();
+    }
+    result.inodes.push_back(std::move(object));
+  }
+}
+
+void EdenServiceHandler::startRecordingFuseTrace(
+    std::unique_ptr<std::string> mountPoint,
+    std::unique_ptr<std::string> outputPath,
+    bool includePids) {
+  auto helper =
+      INSTRUMENT_THRIFT_CALL(DBG1, *mountPoint, *outputPath, includePids);
+
+  auto edenMount = server_->getMount(*mountPoint);
+  auto* fuseChannel = edenMount->getFuseChannel();
+  if (!fuseChannel) {
+    throw newEdenError(EINVAL, "{} has no FUSE channel", *mountPoint);
+  }
+  folly::File file{
+      *outputPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600};
+  fuseChannel->startTraceRecording(
+      std::make_shared<FuseTraceWriter>(std::move(file), includePids));
+}
+
+int64_t EdenServiceHandler::stopRecordingFuseTrace(
+    std::unique_ptr<std::string> mountPoint) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG1, *mountPoint);
+
+  auto edenMount = server_->getMount(*mountPoint);
+  auto* fuseChannel = edenMount->getFuseChannel();
+  if (!fuseChannel) {
+    throw newEdenError(EINVAL, "{} has no FUSE channel", *mountPoint);
+  }
+  auto writer = fuseChannel->stopTraceRecording();
+  if (!writer) {
+    throw newEdenError(
+        EINVAL, "no FUSE trace is being recorded for {}", *mountPoint);
+  }
+  return writer->finish();
+}
+
+void EdenServiceHandler::debugGetRecentTraceEvents(
+    std::vector<TraceEventInfo>& events) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG3);
+
+  auto traceEvents = TraceBuffer::getEvents();
+  events.reserve(traceEvents.size());
+  for (const auto& event : traceEvents) {
+    // Conversion is done here, as for FuseCall, so that TraceBuffer does not
+    // depend on thrift.  The thrift enums use the same values.
+    TraceEventInfo info;
+    info.timestamp = event.timestamp;
+    info.requestId = event.requestId;
+    info.operation = static_cast<TracedOperation>(event.kind);
+    info.phase = static_cast<TraceEventPhase>(event.phase);
+    info.argument = event.argument;
+    info.threadId = event.threadId;
+    events.push_back(std::move(info));
+  }
+}
+
 void EdenServiceHandler::debugGetInodePath(
     InodePathDebugInfo& info,
     std::unique_ptr<std::string> mountPoint,
@@ -873,6 +1742,59 @@ void EdenServiceHandler::debugGetInodePath(
   info.path = relativePath ? relativePath->stringPiece().str() : "";
 }
 
+folly::Future<std::unique_ptr<OverlayCheckResult>>
+EdenServiceHandler::future_debugCheckOverlay(
+    std::unique_ptr<std::string> mountPoint,
+    bool repair) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG1, *mountPoint, repair);
+  auto edenMount = server_->getMount(*mountPoint);
+  return helper.wrapFuture(
+      edenMount->checkOverlay(repair).thenValue(
+          [edenMount](OverlayChecker::Result&& checked) {
+            auto result = std::make_unique<OverlayCheckResult>();
+            result->directoriesScanned = checked.directoriesScanned;
+            result->filesScanned = checked.filesScanned;
+            result->orphans = checked.orphans;
+            result->orphansRemoved = checked.orphansRemoved;
+            result->badRecords = checked.badRecords;
+            result->typeMismatches = checked.typeMismatches;
+            result->missingData = checked.missingData;
+            result->unallocatedMetadata = checked.unallocatedMetadata;
+            result->unreferencedMetadata = checked.unreferencedMetadata;
+            result->metadataRemoved = checked.metadataRemoved;
+            for (auto& problem : checked.problems) {
+              OverlayProblem out;
+              out.inodeNumber = problem.first.get();
+              out.description = std::move(problem.second);
+              result->problems.push_back(std::move(out));
+            }
+            return result;
+          }));
+}
+
+folly::Future<int64_t> EdenServiceHandler::future_debugExportTreeSnapshot(
+    std::unique_ptr<std::string> mountPoint,
+    std::unique_ptr<std::string> commit,
+    std::unique_ptr<std::string> outputPath) {
+  auto helper = INSTRUMENT_THRIFT_CALL(
+      DBG1, *mountPoint, logHash(*commit), *outputPath);
+  AbsolutePath path;
+  try {
+    path = AbsolutePath{*outputPath};
+  } catch (const std::domain_error& ex) {
+    throw newEdenError(EINVAL, ex.what());
+  }
+
+  auto edenMount = server_->getMount(*mountPoint);
+  auto commitID = commit->empty() ? edenMount->getParentCommits().parent1()
+                                  : hashFromThrift(*commit);
+  return helper.wrapFuture(
+      TreeSnapshot::create(edenMount->getObjectStore(), commitID, path)
+          .thenValue([edenMount](size_t numTrees) {
+            return static_cast<int64_t>(numTrees);
+          }));
+}
+
 void EdenServiceHandler::debugSetLogLevel(
     SetLogLevelResult& result,
     std::unique_ptr<std::string> category,
@@ -892,6 +1814,14 @@ void EdenServiceHandler::debugSetLogLevel(
       folly::stringToLogLevel(*level), inherit);
 }
 
+void EdenServiceHandler::debugSetLockProfiling(int32_t sampleRate) {
+  auto helper = INSTRUMENT_THRIFT_CALL(DBG1, sampleRate);
+  if (sampleRate < 0) {
+    throw newEdenError(EINVAL, "sampleRate must not be negative");
+  }
+  LockProfiler::setSampleRate(sampleRate);
+}
+
 void EdenServiceHandler::clearAndCompactLocalStore() {
   auto helper = INSTRUMENT_THRIFT_CALL(DBG1);
   server_->getLocalStore()->clearCachesAndCompactAll();
@@ -939,6 +1869,10 @@ void EdenServiceHandler::getStatInfo(InternalStats& result) {
     mountInodeInfo.unloadedInodeCount = inodeMap->getUnloadedInodeCount();
     mountInodeInfo.loadedFileCount = counts.fileCount;
     mountInodeInfo.loadedTreeCount = counts.treeCount;
+    mountInodeInfo.inodeMemoryBytes = inodeMap->getApproximateMemoryUsage();
+    mountInodeInfo.blobMemoryBytes = inodeMap->getLoadedBlobBytes();
+    mountInodeInfo.journalMemoryBytes =
+        mount->getJournal().getStats().memoryUsage;
 
     // TODO: Currently getting Materialization status of an inode using
     // getDebugStatus which walks through entire Tree of inodes, in future we
@@ -962,6 +1896,10 @@ void EdenServiceHandler::getStatInfo(InternalStats& result) {
   result.periodicUnloadCount =
       result.counters[kPeriodicUnloadCounterKey.toString()];
 
+  result.localStoreMemoryBytes =
+      server_->getLocalStore()->getApproximateMemoryUsage();
+  result.localStoreStats = server_->getLocalStore()->getEngineStats();
+
   auto privateDirtyBytes = facebook::eden::proc_util::calculatePrivateBytes();
   if (privateDirtyBytes) {
     result.privateBytes = privateDirtyBytes.value();
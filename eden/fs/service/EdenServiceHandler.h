@@ -11,6 +11,7 @@
 
 #include "common/fb303/cpp/FacebookBase2.h"
 #include "eden/fs/service/gen-cpp2/StreamingEdenService.h"
+#include "eden/fs/service/PrefetchLimiter.h"
 #include "eden/fs/utils/PathFuncs.h"
 
 namespace folly {
@@ -45,12 +46,15 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
 
   void listMounts(std::vector<MountInfo>& results) override;
 
-  void checkOutRevision(
-      std::vector<CheckoutConflict>& results,
+  folly::Future<std::unique_ptr<std::vector<CheckoutConflict>>>
+  future_checkOutRevision(
       std::unique_ptr<std::string> mountPoint,
       std::unique_ptr<std::string> hash,
       CheckoutMode checkoutMode) override;
 
+  folly::Future<int64_t> future_prefetchCommitTrees(
+      std::unique_ptr<PrefetchCommitTreesParams> params) override;
+
   void resetParentCommits(
       std::unique_ptr<std::string> mountPoint,
       std::unique_ptr<WorkingDirectoryParents> parents) override;
@@ -59,8 +63,7 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
       std::vector<std::string>& out,
       std::unique_ptr<std::string> mountPoint) override;
 
-  void getSHA1(
-      std::vector<SHA1Result>& out,
+  folly::Future<std::unique_ptr<std::vector<SHA1Result>>> future_getSHA1(
       std::unique_ptr<std::string> mountPoint,
       std::unique_ptr<std::vector<std::string>> paths) override;
 
@@ -73,6 +76,17 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
       std::unique_ptr<std::string> mountPoint,
       std::unique_ptr<JournalPosition> fromPosition) override;
 
+  void getFilesChangedSinceFiltered(
+      FileDelta& out,
+      std::unique_ptr<std::string> mountPoint,
+      std::unique_ptr<JournalPosition> fromPosition,
+      std::unique_ptr<ResultFilter> filter) override;
+
+  void getFilesChangedSinceCompact(
+      CompactFileDelta& out,
+      std::unique_ptr<std::string> mountPoint,
+      std::unique_ptr<JournalPosition> fromPosition) override;
+
   void debugGetRawJournal(
       DebugGetRawJournalResponse& out,
       std::unique_ptr<DebugGetRawJournalParams> params) override;
@@ -82,19 +96,70 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
       std::unique_ptr<std::string> mountPoint,
       std::unique_ptr<std::vector<std::string>> paths) override;
 
-  void glob(
-      std::vector<std::string>& out,
+  folly::Future<std::unique_ptr<std::vector<std::string>>> future_glob(
       std::unique_ptr<std::string> mountPoint,
       std::unique_ptr<std::vector<std::string>> globs) override;
 
   folly::Future<std::unique_ptr<Glob>> future_globFiles(
       std::unique_ptr<GlobParams> params) override;
 
+  folly::Future<std::unique_ptr<Glob>> future_searchFileNames(
+      std::unique_ptr<FileNameSearchParams> params) override;
+
+  void getPrefetchStatus(PrefetchStatus& result) override;
+
+  void startRecordingAccessProfile(
+      std::unique_ptr<std::string> mountPoint,
+      std::unique_ptr<std::string> tag) override;
+
+  void stopRecordingAccessProfile(
+      std::string& profile,
+      std::unique_ptr<std::string> mountPoint,
+      std::unique_ptr<std::string> tag) override;
+
+  folly::Future<int64_t> future_prefetchAccessProfile(
+      std::unique_ptr<std::string> mountPoint,
+      std::unique_ptr<std::string> profile) override;
+
+  void widenMountScope(
+      std::unique_ptr<std::string> mountPoint,
+      std::unique_ptr<std::vector<std::string>> paths) override;
+
+  void getMountScope(
+      std::vector<std::string>& includes,
+      std::unique_ptr<std::string> mountPoint) override;
+
   void async_tm_subscribe(
       std::unique_ptr<apache::thrift::StreamingHandlerCallback<
           std::unique_ptr<JournalPosition>>> callback,
       std::unique_ptr<std::string> mountPoint) override;
 
+  void async_tm_subscribeFiltered(
+      std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+          std::unique_ptr<SubscriptionNotification>>> callback,
+      std::unique_ptr<SubscribeParams> params) override;
+
+  void async_tm_subscribeFileDeltas(
+      std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+          std::unique_ptr<FileDelta>>> callback,
+      std::unique_ptr<SubscribeParams> params,
+      std::unique_ptr<JournalPosition> fromPosition) override;
+
+  void async_tm_streamGlobFiles(
+      std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+          std::unique_ptr<GlobChunk>>> callback,
+      std::unique_ptr<GlobParams> params) override;
+
+  void async_tm_streamScmStatus(
+      std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+          std::unique_ptr<ScmStatusChunk>>> callback,
+      std::unique_ptr<StreamScmStatusParams> params) override;
+
+  void async_tm_streamScmStatusBetweenRevisions(
+      std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+          std::unique_ptr<ScmStatusChunk>>> callback,
+      std::unique_ptr<StreamScmStatusBetweenRevisionsParams> params) override;
+
   void getManifestEntry(
       ManifestEntry& out,
       std::unique_ptr<std::string> mountPoint,
@@ -105,11 +170,29 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
       bool listIgnored,
       std::unique_ptr<std::string> commitHash) override;
 
+  folly::Future<std::unique_ptr<ScmStatus>> future_getScmStatusFiltered(
+      std::unique_ptr<std::string> mountPoint,
+      bool listIgnored,
+      std::unique_ptr<std::string> commitHash,
+      std::unique_ptr<ResultFilter> filter) override;
+
+  folly::Future<std::unique_ptr<CompactScmStatus>> future_getScmStatusCompact(
+      std::unique_ptr<std::string> mountPoint,
+      bool listIgnored,
+      std::unique_ptr<std::string> commitHash) override;
+
   folly::Future<std::unique_ptr<ScmStatus>> future_getScmStatusBetweenRevisions(
       std::unique_ptr<std::string> mountPoint,
       std::unique_ptr<std::string> oldHash,
       std::unique_ptr<std::string> newHash) override;
 
+  folly::Future<std::unique_ptr<ScmStatus>>
+  future_getScmStatusBetweenRevisionsFiltered(
+      std::unique_ptr<std::string> mountPoint,
+      std::unique_ptr<std::string> oldHash,
+      std::unique_ptr<std::string> newHash,
+      std::unique_ptr<ResultFilter> filter) override;
+
   void debugGetScmTree(
       std::vector<ScmTreeEntry>& entries,
       std::unique_ptr<std::string> mountPoint,
@@ -137,16 +220,47 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
       std::vector<FuseCall>& outstandingCalls,
       std::unique_ptr<std::string> mountPoint) override;
 
+  void getProcessAccessCounts(
+      ProcessAccessInfo& result,
+      std::unique_ptr<std::string> mountPoint,
+      int64_t limit) override;
+
+  void debugGetHotObjects(
+      HotObjects& result,
+      std::unique_ptr<std::string> mountPoint,
+      int64_t limit) override;
+
+  void startRecordingFuseTrace(
+      std::unique_ptr<std::string> mountPoint,
+      std::unique_ptr<std::string> outputPath,
+      bool includePids) override;
+
+  int64_t stopRecordingFuseTrace(
+      std::unique_ptr<std::string> mountPoint) override;
+
+  void debugGetRecentTraceEvents(std::vector<TraceEventInfo>& events) override;
+
   void debugGetInodePath(
       InodePathDebugInfo& inodePath,
       std::unique_ptr<std::string> mountPoint,
       int64_t inodeNumber) override;
 
+  folly::Future<std::unique_ptr<OverlayCheckResult>> future_debugCheckOverlay(
+      std::unique_ptr<std::string> mountPoint,
+      bool repair) override;
+
+  folly::Future<int64_t> future_debugExportTreeSnapshot(
+      std::unique_ptr<std::string> mountPoint,
+      std::unique_ptr<std::string> commit,
+      std::unique_ptr<std::string> outputPath) override;
+
   void debugSetLogLevel(
       SetLogLevelResult& result,
       std::unique_ptr<std::string> category,
       std::unique_ptr<std::string> level) override;
 
+  void debugSetLockProfiling(int32_t sampleRate) override;
+
   void clearAndCompactLocalStore() override;
 
   void debugClearLocalStoreCaches() override;
@@ -181,14 +295,6 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
   void initiateShutdown(std::unique_ptr<std::string> reason) override;
 
  private:
-  folly::Future<Hash> getSHA1ForPath(
-      folly::StringPiece mountPoint,
-      folly::StringPiece path);
-
-  folly::Future<Hash> getSHA1ForPathDefensively(
-      folly::StringPiece mountPoint,
-      folly::StringPiece path) noexcept;
-
   /**
    * If `filename` exists in the manifest as a file (not a directory), returns
    * the mode of the file as recorded in the manifest.
@@ -197,6 +303,11 @@ class EdenServiceHandler : virtual public StreamingEdenServiceSvIf,
       const EdenMount* mount,
       const RelativePathPiece filename);
 
+  /**
+   * Identify the client of the current request for PrefetchLimiter.
+   */
+  PrefetchLimiter::ClientId getPrefetchClientId();
+
   EdenServer* const server_;
 };
 } // namespace eden
@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/service/PrefetchLimiter.h"
+
+#include <folly/logging/xlog.h>
+#include <cerrno>
+#include "eden/fs/service/EdenError.h"
+
+namespace facebook {
+namespace eden {
+
+struct PrefetchLimiter::Admission::State {
+  size_t inFlight{0};
+  std::unordered_map<ClientId, size_t> clientInFlight;
+  uint64_t rejected{0};
+};
+
+namespace {
+/**
+ * Returns true if count more blobs fit within limit.  Anything fits when
+ * nothing is in flight, or when there is no limit.
+ */
+bool fits(size_t inFlight, size_t count, size_t limit) {
+  return limit == 0 || inFlight == 0 || inFlight + count <= limit;
+}
+} // namespace
+
+PrefetchLimiter::PrefetchLimiter(size_t maxInFlight, size_t maxPerClient)
+    : maxInFlight_{maxInFlight},
+      maxPerClient_{maxPerClient},
+      state_{std::make_shared<folly::Synchronized<Admission::State>>()} {}
+
+PrefetchLimiter::Admission PrefetchLimiter::admit(
+    ClientId client,
+    size_t count) {
+  if (count == 0) {
+    return Admission{};
+  }
+  {
+    auto state = state_->wlock();
+    auto it = state->clientInFlight.find(client);
+    auto clientInFlight = it == state->clientInFlight.end() ? 0 : it->second;
+    if (fits(state->inFlight, count, maxInFlight_) &&
+        fits(clientInFlight, count, maxPerClient_)) {
+      state->inFlight += count;
+      state->clientInFlight[client] += count;
+      return Admission{state_, client, count};
+    }
+    ++state->rejected;
+  }
+
+  XLOG(DBG2) << "refusing to prefetch " << count << " blobs for client "
+             << client << ", which is over its quota";
+  throw newEdenError(
+      EAGAIN,
+      "too many blobs are already being prefetched; "
+      "retry once earlier prefetches have finished");
+}
+
+PrefetchLimiter::Status PrefetchLimiter::getStatus(ClientId client) const {
+  Status status;
+  status.maxInFlight = maxInFlight_;
+  status.maxPerClient = maxPerClient_;
+  auto state = state_->rlock();
+  status.inFlight = state->inFlight;
+  status.rejected = state->rejected;
+  auto it = state->clientInFlight.find(client);
+  if (it != state->clientInFlight.end()) {
+    status.clientInFlight = it->second;
+  }
+  return status;
+}
+
+PrefetchLimiter::Admission::Admission(
+    std::shared_ptr<folly::Synchronized<State>> state,
+    ClientId client,
+    size_t count)
+    : state_{std::move(state)}, client_{client}, count_{count} {}
+
+PrefetchLimiter::Admission::~Admission() {
+  release();
+}
+
+PrefetchLimiter::Admission::Admission(Admission&& other) noexcept
+    : state_{std::move(other.state_)},
+      client_{other.client_},
+      count_{other.count_} {}
+
+PrefetchLimiter::Admission& PrefetchLimiter::Admission::operator=(
+    Admission&& other) noexcept {
+  if (this != &other) {
+    release();
+    state_ = std::move(other.state_);
+    client_ = other.client_;
+    count_ = other.count_;
+  }
+  return *this;
+}
+
+void PrefetchLimiter::Admission::release() {
+  auto shared = std::move(state_);
+  if (!shared) {
+    return;
+  }
+  auto state = shared->wlock();
+  state->inFlight -= count_;
+  auto it = state->clientInFlight.find(client_);
+  it->second -= count_;
+  if (it->second == 0) {
+    state->clientInFlight.erase(it);
+  }
+}
+
+} // namespace eden
+} // namespace facebook
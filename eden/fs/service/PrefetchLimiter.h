@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * PrefetchLimiter bounds the number of blobs that thrift clients can have
+ * queued for prefetching at once, so that a few build tools prefetching
+ * large globs at the same time cannot take all of the importer capacity
+ * away from interactive reads.
+ *
+ * There is a budget for the whole server and a smaller quota for each
+ * client.  A request that would exceed either one is refused with an
+ * EdenError whose errorCode is EAGAIN, and the client should retry once its
+ * earlier prefetches have finished.  A request is always admitted if nothing
+ * else is in flight, so a request larger than the limits still runs on its
+ * own.  A limit of 0 disables that check.
+ *
+ * PrefetchLimiter is thread-safe.  Admissions only reference the shared
+ * internal state, so they may outlive the PrefetchLimiter.
+ */
+class PrefetchLimiter {
+ public:
+  /**
+   * Identifies the client that a prefetch is for.  EdenServiceHandler uses
+   * the thrift connection, since each build tool keeps its own connection
+   * open while it runs.
+   */
+  using ClientId = uintptr_t;
+
+  PrefetchLimiter(size_t maxInFlight, size_t maxPerClient);
+
+  /**
+   * Holds a share of the budget, and returns it when destroyed.
+   */
+  class Admission {
+   public:
+    Admission() = default;
+    ~Admission();
+    Admission(Admission&& other) noexcept;
+    Admission& operator=(Admission&& other) noexcept;
+    Admission(const Admission&) = delete;
+    Admission& operator=(const Admission&) = delete;
+
+   private:
+    friend class PrefetchLimiter;
+    struct State;
+
+    Admission(
+        std::shared_ptr<folly::Synchronized<State>> state,
+        ClientId client,
+        size_t count);
+    void release();
+
+    std::shared_ptr<folly::Synchronized<State>> state_;
+    ClientId client_{0};
+    size_t count_{0};
+  };
+
+  /**
+   * Reserve room for count blobs requested by client.
+   *
+   * Throws an EdenError with errorCode EAGAIN if the server or the client
+   * already has too many blobs in flight.
+   */
+  Admission admit(ClientId client, size_t count);
+
+  struct Status {
+    size_t inFlight{0};
+    size_t maxInFlight{0};
+    size_t clientInFlight{0};
+    size_t maxPerClient{0};
+    uint64_t rejected{0};
+  };
+
+  /**
+   * Get the current usage of the budget, and of client's quota.
+   */
+  Status getStatus(ClientId client) const;
+
+ private:
+  const size_t maxInFlight_;
+  const size_t maxPerClient_;
+  std::shared_ptr<folly::Synchronized<Admission::State>> state_;
+};
+
+} // namespace eden
+} // namespace facebook
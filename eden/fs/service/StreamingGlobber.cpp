@@ -0,0 +1,208 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "StreamingGlobber.h"
+
+#include <folly/logging/xlog.h>
+#include <algorithm>
+
+#include "eden/fs/inodes/GlobNode.h"
+#include "eden/fs/inodes/TreeInode.h"
+#include "eden/fs/service/EdenError.h"
+#include "eden/fs/store/ObjectStore.h"
+
+using folly::Future;
+using folly::makeFuture;
+using folly::Unit;
+using std::vector;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+// The number of matching files to accumulate before sending them.
+constexpr size_t kFilesPerChunk = 1024;
+// The number of blobs to prefetch at a time.  This matches the batch size
+// used by globFiles().
+constexpr size_t kPrefetchBatchSize = 20480;
+} // namespace
+
+StreamingGlobber::State::State(StreamingGlobber::Callback callback)
+    : callback(std::move(callback)) {}
+
+StreamingGlobber::StreamingGlobber(
+    Callback callback,
+    std::shared_ptr<EdenMount> edenMount,
+    bool suppressFileList)
+    : edenMount_(std::move(edenMount)),
+      suppressFileList_(suppressFileList),
+      eventBase_(callback->getEventBase()),
+      state_(folly::in_place, std::move(callback)) {}
+
+void StreamingGlobber::glob(
+    Callback callback,
+    std::shared_ptr<EdenMount> edenMount,
+    std::unique_ptr<GlobParams> params,
+    std::shared_ptr<PrefetchLimiter> limiter,
+    PrefetchLimiter::ClientId client) {
+  // Compile the list of globs into a tree
+  auto globRoot = std::make_shared<GlobNode>(params->includeDotfiles);
+  try {
+    for (auto& globString : params->globs) {
+      globRoot->parse(globString);
+    }
+  } catch (const std::system_error& exc) {
+    callback->exception(
+        folly::make_exception_wrapper<EdenError>(newEdenError(exc)));
+    return;
+  }
+
+  auto fileBlobsToPrefetch = params->prefetchFiles
+      ? std::make_shared<folly::Synchronized<std::vector<Hash>>>()
+      : nullptr;
+
+  auto self = std::make_shared<StreamingGlobber>(
+      std::move(callback), edenMount, params->suppressFileList);
+  CancellationScope scope{self->cancellation_.getToken()};
+  globRoot
+      ->evaluateStreaming(
+          edenMount->getObjectStore(),
+          RelativePathPiece(),
+          edenMount->getRootInode(),
+          fileBlobsToPrefetch,
+          edenMount->getBackgroundThreadPool().get(),
+          [self](vector<RelativePath>&& paths) {
+            return self->addResults(std::move(paths));
+          })
+      .then([self, fileBlobsToPrefetch, limiter, client] {
+        self->flush();
+        if (!fileBlobsToPrefetch) {
+          return makeFuture();
+        }
+        auto blobs = std::make_shared<const vector<Hash>>(
+            std::move(*fileBlobsToPrefetch->wlock()));
+        // Hold the budget until the prefetch finishes.  This throws, ending
+        // the stream with EAGAIN, if there is no room for it.
+        auto admission = std::make_shared<PrefetchLimiter::Admission>(
+            limiter->admit(client, blobs->size()));
+        return self->prefetch(std::move(blobs), 0).ensure([admission] {});
+      })
+      .then([self, globRoot](folly::Try<Unit>&& result) {
+        // globRoot must stay alive until the evaluation has finished
+        self->finish(
+            result.hasException() ? std::move(result.exception())
+                                  : folly::exception_wrapper{});
+      });
+}
+
+bool StreamingGlobber::addResults(vector<RelativePath>&& paths) {
+  if (cancellation_.isCancelled()) {
+    return false;
+  }
+  if (suppressFileList_ || paths.empty()) {
+    return true;
+  }
+
+  GlobChunk chunk;
+  {
+    auto state = state_.wlock();
+    for (auto& path : paths) {
+      // Overlapping patterns can match the same file more than once.
+      auto ret = state->sentFiles.insert(path.stringPiece().str());
+      if (ret.second) {
+        state->pendingFiles.emplace_back(*ret.first);
+      }
+    }
+    if (state->pendingFiles.size() < kFilesPerChunk) {
+      return true;
+    }
+    chunk.matchingFiles = std::move(state->pendingFiles);
+    state->pendingFiles.clear();
+  }
+  send(std::move(chunk));
+  return true;
+}
+
+void StreamingGlobber::flush() {
+  GlobChunk chunk;
+  {
+    auto state = state_.wlock();
+    if (state->pendingFiles.empty()) {
+      return;
+    }
+    chunk.matchingFiles = std::move(state->pendingFiles);
+    state->pendingFiles.clear();
+  }
+  send(std::move(chunk));
+}
+
+Future<Unit> StreamingGlobber::prefetch(
+    std::shared_ptr<const vector<Hash>> blobs,
+    size_t start) {
+  if (cancellation_.isCancelled() || start >= blobs->size()) {
+    return makeFuture();
+  }
+
+  auto end = std::min(start + kPrefetchBatchSize, blobs->size());
+  vector<Hash> batch(blobs->begin() + start, blobs->begin() + end);
+  return edenMount_->getObjectStore()->prefetchBlobs(batch).then(
+      [self = shared_from_this(), blobs, end] {
+        GlobChunk chunk;
+        chunk.prefetchedFiles = end;
+        chunk.filesToPrefetch = blobs->size();
+        self->send(std::move(chunk));
+        return self->prefetch(blobs, end);
+      });
+}
+
+void StreamingGlobber::send(GlobChunk chunk) {
+  eventBase_->runInEventBaseThread(
+      [self = shared_from_this(), chunk = std::move(chunk)] {
+        self->write(chunk);
+      });
+}
+
+void StreamingGlobber::write(const GlobChunk& chunk) {
+  auto state = state_.wlock();
+  if (!state->callback) {
+    return;
+  }
+  if (!state->callback->isRequestActive()) {
+    XLOG(DBG3) << "client disconnected during streamGlobFiles";
+    cancellation_.cancel();
+    state->callback->done();
+    state->callback.reset();
+    return;
+  }
+
+  try {
+    state->callback->write(chunk);
+  } catch (const std::exception& exc) {
+    XLOG(ERR) << "Error while sending glob results: " << exc.what();
+  }
+}
+
+void StreamingGlobber::finish(folly::exception_wrapper ew) {
+  eventBase_->runInEventBaseThread(
+      [self = shared_from_this(), ew = std::move(ew)] {
+        auto state = self->state_.wlock();
+        if (!state->callback) {
+          return;
+        }
+        if (ew) {
+          state->callback->exception(
+              folly::make_exception_wrapper<EdenError>(newEdenError(ew)));
+        } else {
+          state->callback->done();
+        }
+        state->callback.reset();
+      });
+}
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <folly/Synchronized.h>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/service/PrefetchLimiter.h"
+#include "eden/fs/service/gen-cpp2/StreamingEdenService.h"
+#include "eden/fs/utils/Cancellation.h"
+
+namespace facebook {
+namespace eden {
+
+/** StreamingGlobber implements streamGlobFiles().
+ *
+ * Rather than building the complete list of matches before replying, the
+ * matches are sent to the client in chunks as the GlobNode evaluation finds
+ * them, followed by the progress of the prefetch if one was requested.
+ *
+ * The chunks are written on the eventBase thread associated with the
+ * client; doing so from there is also how we notice that the client has gone
+ * away, at which point the evaluation and prefetch stop early.
+ */
+class StreamingGlobber
+    : public std::enable_shared_from_this<StreamingGlobber> {
+ public:
+  using Callback = std::unique_ptr<
+      apache::thrift::StreamingHandlerCallback<std::unique_ptr<GlobChunk>>>;
+
+  /** Start evaluating params against edenMount.
+   * The StreamingGlobber keeps itself alive until the evaluation and
+   * prefetch have finished and the stream has been closed.
+   * If any of the glob patterns are invalid the error is reported through
+   * callback instead.  A prefetch is admitted by limiter on behalf of client,
+   * and fails the stream with EAGAIN if there is no room for it.
+   */
+  static void glob(
+      Callback callback,
+      std::shared_ptr<EdenMount> edenMount,
+      std::unique_ptr<GlobParams> params,
+      std::shared_ptr<PrefetchLimiter> limiter,
+      PrefetchLimiter::ClientId client);
+
+  // Not really public. Exposed publicly so std::make_shared can instantiate
+  // this class.
+  StreamingGlobber(
+      Callback callback,
+      std::shared_ptr<EdenMount> edenMount,
+      bool suppressFileList);
+
+ private:
+  /** Record the matches from one directory, sending a chunk to the client
+   * once enough of them have accumulated.
+   * This may be called from several threads at once.
+   * Returns false once the client has disconnected. */
+  bool addResults(std::vector<RelativePath>&& paths);
+
+  /** Send any matches that have not been sent yet. */
+  void flush();
+
+  /** Prefetch blobs starting at the given index, one batch at a time,
+   * reporting progress after each batch. */
+  folly::Future<folly::Unit> prefetch(
+      std::shared_ptr<const std::vector<Hash>> blobs,
+      size_t start);
+
+  /** Schedule chunk to be written to the client. */
+  void send(GlobChunk chunk);
+
+  /** Close the stream, reporting the error if there was one. */
+  void finish(folly::exception_wrapper ew);
+
+  /** Write chunk to the client.
+   * This must only be called on the thread associated with the client. */
+  void write(const GlobChunk& chunk);
+
+  struct State {
+    Callback callback;
+    std::vector<std::string> pendingFiles;
+    std::unordered_set<std::string> sentFiles;
+
+    explicit State(Callback callback);
+  };
+
+  const std::shared_ptr<EdenMount> edenMount_;
+  const bool suppressFileList_{false};
+  folly::EventBase* const eventBase_{nullptr};
+  // Cancelled once the client goes away, so that the imports that only this
+  // stream is waiting for are dropped.
+  CancellationSource cancellation_;
+  folly::Synchronized<State> state_;
+};
+} // namespace eden
+} // namespace facebook
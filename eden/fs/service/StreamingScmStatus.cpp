@@ -0,0 +1,234 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "StreamingScmStatus.h"
+
+#include <folly/futures/Future.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/logging/xlog.h>
+
+#include "eden/fs/service/EdenError.h"
+
+using folly::Future;
+using folly::Unit;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+// The number of status entries to accumulate before sending them.
+constexpr size_t kEntriesPerChunk = 1024;
+} // namespace
+
+StreamingScmStatus::State::State(StreamingScmStatus::Callback callback)
+    : callback(std::move(callback)) {}
+
+StreamingScmStatus::StreamingScmStatus(
+    Callback callback,
+    std::shared_ptr<EdenMount> edenMount)
+    : edenMount_(std::move(edenMount)),
+      eventBase_(callback->getEventBase()),
+      state_(folly::in_place, std::move(callback)) {}
+
+void StreamingScmStatus::status(
+    Callback callback,
+    std::shared_ptr<EdenMount> edenMount,
+    Hash commitHash,
+    bool listIgnored,
+    std::chrono::milliseconds timeout) {
+  auto self =
+      std::make_shared<StreamingScmStatus>(std::move(callback), edenMount);
+  self->startDeadline(timeout);
+  CancellationScope scope{self->cancellation_.getToken()};
+  self->finishAfter(folly::makeFutureWith([&] {
+    return edenMount->diff(
+        static_cast<InodeDiffCallback*>(self.get()), commitHash, listIgnored);
+  }));
+}
+
+void StreamingScmStatus::statusBetweenRevisions(
+    Callback callback,
+    std::shared_ptr<EdenMount> edenMount,
+    Hash oldHash,
+    Hash newHash,
+    std::chrono::milliseconds timeout) {
+  auto self =
+      std::make_shared<StreamingScmStatus>(std::move(callback), edenMount);
+  self->startDeadline(timeout);
+  CancellationScope scope{self->cancellation_.getToken()};
+  self->finishAfter(diffCommits(
+      edenMount->getObjectStore(),
+      oldHash,
+      newHash,
+      static_cast<TreeDiffCallback*>(self.get()),
+      edenMount->getBackgroundThreadPool().get()));
+}
+
+void StreamingScmStatus::startDeadline(std::chrono::milliseconds timeout) {
+  if (timeout.count() <= 0) {
+    return;
+  }
+  eventBase_->runInEventBaseThread([self = shared_from_this(), timeout] {
+    // Don't keep ourselves alive just to time out a finished stream.
+    std::weak_ptr<StreamingScmStatus> weakSelf = self;
+    self->eventBase_->runAfterDelay(
+        [weakSelf, timeout] {
+          auto self = weakSelf.lock();
+          if (!self) {
+            return;
+          }
+          self->cancellation_.cancel();
+          auto state = self->state_.wlock();
+          if (!state->callback) {
+            return;
+          }
+          XLOG(DBG2) << "SCM status stream timed out after "
+                     << timeout.count() << "ms";
+          state->callback->exception(
+              folly::make_exception_wrapper<EdenError>(newEdenError(
+                  ETIMEDOUT,
+                  "status did not complete within {}ms",
+                  timeout.count())));
+          state->callback.reset();
+        },
+        timeout.count());
+  });
+}
+
+void StreamingScmStatus::finishAfter(Future<Unit>&& diffFuture) {
+  std::move(diffFuture).then(
+      [self = shared_from_this()](folly::Try<Unit>&& result) {
+        // The diff holds a raw pointer to us, so self must stay alive until
+        // it has completed.
+        self->flush();
+        self->finish(
+            result.hasException() ? std::move(result.exception())
+                                  : folly::exception_wrapper{});
+      });
+}
+
+void StreamingScmStatus::ignoredFile(RelativePathPiece path) {
+  addEntry(path, ScmFileStatus::IGNORED);
+}
+
+void StreamingScmStatus::untrackedFile(RelativePathPiece path) {
+  addEntry(path, ScmFileStatus::ADDED);
+}
+
+void StreamingScmStatus::removedFile(
+    RelativePathPiece path,
+    const TreeEntry& /* sourceControlEntry */) {
+  addEntry(path, ScmFileStatus::REMOVED);
+}
+
+void StreamingScmStatus::modifiedFile(
+    RelativePathPiece path,
+    const TreeEntry& /* sourceControlEntry */) {
+  addEntry(path, ScmFileStatus::MODIFIED);
+}
+
+void StreamingScmStatus::changedFile(
+    RelativePathPiece path,
+    ScmFileStatus status) {
+  addEntry(path, status);
+}
+
+void StreamingScmStatus::diffError(
+    RelativePathPiece path,
+    const folly::exception_wrapper& ew) {
+  XLOG(WARNING) << "error computing status data for " << path << ": "
+                << folly::exceptionStr(ew);
+  state_.wlock()->pending.errors.emplace(
+      path.stringPiece().str(), ew.what().toStdString());
+}
+
+bool StreamingScmStatus::isCancelled() const {
+  return cancellation_.isCancelled();
+}
+
+void StreamingScmStatus::addEntry(
+    RelativePathPiece path,
+    ScmFileStatus status) {
+  if (isCancelled()) {
+    return;
+  }
+
+  ScmStatusChunk chunk;
+  {
+    auto state = state_.wlock();
+    state->pending.entries.emplace(path.stringPiece().str(), status);
+    if (++state->pendingCount < kEntriesPerChunk) {
+      return;
+    }
+    chunk = std::move(state->pending);
+    state->pending = ScmStatusChunk{};
+    state->pendingCount = 0;
+  }
+  send(std::move(chunk));
+}
+
+void StreamingScmStatus::flush() {
+  ScmStatusChunk chunk;
+  {
+    auto state = state_.wlock();
+    if (state->pending.entries.empty() && state->pending.errors.empty()) {
+      return;
+    }
+    chunk = std::move(state->pending);
+    state->pending = ScmStatusChunk{};
+    state->pendingCount = 0;
+  }
+  send(std::move(chunk));
+}
+
+void StreamingScmStatus::send(ScmStatusChunk chunk) {
+  eventBase_->runInEventBaseThread(
+      [self = shared_from_this(), chunk = std::move(chunk)] {
+        self->write(chunk);
+      });
+}
+
+void StreamingScmStatus::write(const ScmStatusChunk& chunk) {
+  auto state = state_.wlock();
+  if (!state->callback) {
+    return;
+  }
+  if (!state->callback->isRequestActive()) {
+    XLOG(DBG3) << "client disconnected during SCM status stream";
+    cancellation_.cancel();
+    state->callback->done();
+    state->callback.reset();
+    return;
+  }
+
+  try {
+    state->callback->write(chunk);
+  } catch (const std::exception& exc) {
+    XLOG(ERR) << "Error while sending status results: " << exc.what();
+  }
+}
+
+void StreamingScmStatus::finish(folly::exception_wrapper ew) {
+  eventBase_->runInEventBaseThread(
+      [self = shared_from_this(), ew = std::move(ew)] {
+        auto state = self->state_.wlock();
+        if (!state->callback) {
+          return;
+        }
+        if (ew) {
+          state->callback->exception(
+              folly::make_exception_wrapper<EdenError>(newEdenError(ew)));
+        } else {
+          state->callback->done();
+        }
+        state->callback.reset();
+      });
+}
+} // namespace eden
+} // namespace facebook
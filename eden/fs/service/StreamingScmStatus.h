@@ -0,0 +1,124 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <folly/Synchronized.h>
+#include <chrono>
+#include <memory>
+#include "eden/fs/inodes/EdenMount.h"
+#include "eden/fs/inodes/InodeDiffCallback.h"
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/service/gen-cpp2/StreamingEdenService.h"
+#include "eden/fs/store/Diff.h"
+#include "eden/fs/utils/Cancellation.h"
+
+namespace facebook {
+namespace eden {
+
+/** StreamingScmStatus implements streamScmStatus() and
+ * streamScmStatusBetweenRevisions().
+ *
+ * Rather than collecting the complete ScmStatus before replying, the status
+ * entries are sent to the client in chunks as the diff finds them, so the
+ * full set of results is never held in memory.
+ *
+ * As with StreamingGlobber, the chunks are written on the eventBase thread
+ * associated with the client.  Once the client has gone away, or the
+ * deadline has passed, isCancelled() returns true and the diff stops early.
+ */
+class StreamingScmStatus
+    : public InodeDiffCallback,
+      public TreeDiffCallback,
+      public std::enable_shared_from_this<StreamingScmStatus> {
+ public:
+  using Callback = std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+      std::unique_ptr<ScmStatusChunk>>>;
+
+  /** Stream the differences between commitHash and the working directory.
+   * A timeout of zero means there is no deadline.
+   */
+  static void status(
+      Callback callback,
+      std::shared_ptr<EdenMount> edenMount,
+      Hash commitHash,
+      bool listIgnored,
+      std::chrono::milliseconds timeout);
+
+  /** Stream the differences between two commits. */
+  static void statusBetweenRevisions(
+      Callback callback,
+      std::shared_ptr<EdenMount> edenMount,
+      Hash oldHash,
+      Hash newHash,
+      std::chrono::milliseconds timeout);
+
+  // Not really public. Exposed publicly so std::make_shared can instantiate
+  // this class.
+  StreamingScmStatus(Callback callback, std::shared_ptr<EdenMount> edenMount);
+
+  // InodeDiffCallback
+  void ignoredFile(RelativePathPiece path) override;
+  void untrackedFile(RelativePathPiece path) override;
+  void removedFile(RelativePathPiece path, const TreeEntry& sourceControlEntry)
+      override;
+  void modifiedFile(RelativePathPiece path, const TreeEntry& sourceControlEntry)
+      override;
+
+  // TreeDiffCallback
+  void changedFile(RelativePathPiece path, ScmFileStatus status) override;
+
+  // Shared by both callback interfaces.
+  void diffError(RelativePathPiece path, const folly::exception_wrapper& ew)
+      override;
+  bool isCancelled() const override;
+
+ private:
+  /** Arrange for the stream to end with ETIMEDOUT once timeout has passed.
+   */
+  void startDeadline(std::chrono::milliseconds timeout);
+
+  /** Wait for the diff to complete, then send the remaining results and
+   * close the stream. */
+  void finishAfter(folly::Future<folly::Unit>&& diffFuture);
+
+  /** Record one result, sending a chunk to the client once enough of them
+   * have accumulated.
+   * This may be called from several threads at once. */
+  void addEntry(RelativePathPiece path, ScmFileStatus status);
+
+  /** Send any results that have not been sent yet. */
+  void flush();
+
+  /** Schedule chunk to be written to the client. */
+  void send(ScmStatusChunk chunk);
+
+  /** Write chunk to the client.
+   * This must only be called on the thread associated with the client. */
+  void write(const ScmStatusChunk& chunk);
+
+  /** Close the stream, reporting the error if there was one. */
+  void finish(folly::exception_wrapper ew);
+
+  struct State {
+    Callback callback;
+    ScmStatusChunk pending;
+    size_t pendingCount{0};
+
+    explicit State(Callback callback);
+  };
+
+  const std::shared_ptr<EdenMount> edenMount_;
+  folly::EventBase* const eventBase_{nullptr};
+  // Cancelled once the client goes away, so that the imports that only this
+  // stream is waiting for are dropped.
+  CancellationSource cancellation_;
+  folly::Synchronized<State> state_;
+};
+} // namespace eden
+} // namespace facebook
@@ -10,44 +10,207 @@
 #include "StreamingSubscriber.h"
 
 #include <folly/logging/xlog.h>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+#include "eden/fs/service/EdenError.h"
+#include "eden/fs/service/ThriftUtil.h"
 
 using folly::StringPiece;
 
 namespace facebook {
 namespace eden {
 
-StreamingSubscriber::State::State(StreamingSubscriber::Callback callback)
-    : callback(std::move(callback)) {}
+namespace {
+/**
+ * The FileDeltas most recently computed for subscribeFileDeltas() streams.
+ *
+ * Subscribers that have kept up with the journal all ask for the same range
+ * after each update, so only a few recent ranges are worth keeping.  A mount
+ * generation and sequence range always describe the same changes, even in a
+ * restored journal, so the cache is shared by every mount.
+ */
+class FileDeltaCache {
+ public:
+  std::shared_ptr<const FileDelta> get(
+      EdenMount& edenMount,
+      JournalDelta::SequenceNumber fromSequence) {
+    auto generation = edenMount.getMountGeneration();
+    auto toSequence = edenMount.getJournal().getLatest()->toSequence;
+
+    // Hold the lock while merging, so that subscribers waiting for the same
+    // range use this merge rather than each doing their own.
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (const auto& entry : entries_) {
+      if (entry.generation == generation &&
+          entry.fromSequence == fromSequence &&
+          entry.toSequence == toSequence) {
+        return entry.delta;
+      }
+    }
+
+    auto delta = compute(edenMount, fromSequence);
+    entries_.push_back(Entry{generation,
+                             fromSequence,
+                             static_cast<JournalDelta::SequenceNumber>(
+                                 delta->toPosition.sequenceNumber),
+                             delta});
+    if (entries_.size() > kMaxEntries) {
+      entries_.pop_front();
+    }
+    return delta;
+  }
+
+ private:
+  static std::shared_ptr<const FileDelta> compute(
+      EdenMount& edenMount,
+      JournalDelta::SequenceNumber fromSequence) {
+    auto delta = std::make_shared<FileDelta>();
+    auto latest = edenMount.getJournal().getLatest();
+    delta->toPosition.mountGeneration = edenMount.getMountGeneration();
+    delta->toPosition.sequenceNumber = latest->toSequence;
+    delta->toPosition.snapshotHash = thriftHash(latest->toHash);
+    delta->fromPosition = delta->toPosition;
+
+    auto merged = edenMount.getJournal().accumulateRange(fromSequence + 1);
+    if (!merged) {
+      return delta;
+    }
+    if (merged->isTruncated) {
+      throw newEdenError(
+          ERANGE,
+          "the journal no longer holds changes since sequence number {}.  "
+          "You need to compute a new basis for delta queries.",
+          fromSequence);
+    }
+
+    delta->toPosition.sequenceNumber = merged->toSequence;
+    delta->toPosition.snapshotHash = thriftHash(merged->toHash);
+    delta->fromPosition.sequenceNumber = merged->fromSequence;
+    delta->fromPosition.snapshotHash = thriftHash(merged->fromHash);
+    for (const auto& entry : merged->changedFilesInOverlay) {
+      if (entry.second.isNew()) {
+        delta->createdPaths.emplace_back(entry.first.stringPiece().str());
+      } else {
+        delta->changedPaths.emplace_back(entry.first.stringPiece().str());
+      }
+    }
+    for (const auto& path : merged->uncleanPaths) {
+      delta->uncleanPaths.emplace_back(path.stringPiece().str());
+    }
+    return delta;
+  }
+
+  static constexpr size_t kMaxEntries = 4;
+
+  struct Entry {
+    uint64_t generation;
+    JournalDelta::SequenceNumber fromSequence;
+    JournalDelta::SequenceNumber toSequence;
+    std::shared_ptr<const FileDelta> delta;
+  };
+
+  std::mutex mutex_;
+  std::deque<Entry> entries_;
+};
+
+FileDeltaCache& getFileDeltaCache() {
+  static auto* cache = new FileDeltaCache();
+  return *cache;
+}
+} // namespace
+
+folly::EventBase* StreamingSubscriber::State::getEventBase() const {
+  if (callback) {
+    return callback->getEventBase();
+  } else if (notificationCallback) {
+    return notificationCallback->getEventBase();
+  }
+  return fileDeltaCallback->getEventBase();
+}
+
+bool StreamingSubscriber::State::isRequestActive() const {
+  if (callback) {
+    return callback->isRequestActive();
+  } else if (notificationCallback) {
+    return notificationCallback->isRequestActive();
+  }
+  return fileDeltaCallback->isRequestActive();
+}
+
+void StreamingSubscriber::State::done() {
+  if (callback) {
+    callback->done();
+    callback.reset();
+  }
+  if (notificationCallback) {
+    notificationCallback->done();
+    notificationCallback.reset();
+  }
+  if (fileDeltaCallback) {
+    fileDeltaCallback->done();
+    fileDeltaCallback.reset();
+  }
+}
 
 void StreamingSubscriber::runLoopCallback() noexcept {
   auto state = state_.wlock();
-  if (state->callback) {
-    // We're called on the eventBase thread so we can call these
-    // methods directly and tear down the peer.  Note that we
-    // should only get here in the case that the server is being
-    // shutdown.  The individual unmount case is handled by the
-    // destructor.
-    state->callback->done();
-    state->callback.reset();
-  }
+  // We're called on the eventBase thread so we can call these
+  // methods directly and tear down the peer.  Note that we
+  // should only get here in the case that the server is being
+  // shutdown.  The individual unmount case is handled by the
+  // destructor.
+  state->done();
   state->eventBaseAlive = false;
 }
 
 void StreamingSubscriber::subscribe(
     Callback callback,
     std::shared_ptr<EdenMount> edenMount) {
+  auto self = std::make_shared<StreamingSubscriber>(edenMount, Options{});
+  self->state_.wlock()->callback = std::move(callback);
+  start(std::move(self), *edenMount);
+}
+
+void StreamingSubscriber::subscribe(
+    NotificationCallback callback,
+    std::shared_ptr<EdenMount> edenMount,
+    Options options) {
   auto self =
-      std::make_shared<StreamingSubscriber>(std::move(callback), edenMount);
+      std::make_shared<StreamingSubscriber>(edenMount, std::move(options));
+  self->state_.wlock()->notificationCallback = std::move(callback);
+  start(std::move(self), *edenMount);
+}
 
+void StreamingSubscriber::subscribe(
+    FileDeltaCallback callback,
+    std::shared_ptr<EdenMount> edenMount,
+    Options options,
+    JournalDelta::SequenceNumber fromSequence) {
+  auto self =
+      std::make_shared<StreamingSubscriber>(edenMount, std::move(options));
+  {
+    auto state = self->state_.wlock();
+    state->fileDeltaCallback = std::move(callback);
+    state->lastSequence = fromSequence;
+    state->lastSentSequence = fromSequence;
+  }
+  start(std::move(self), *edenMount);
+}
+
+void StreamingSubscriber::start(
+    std::shared_ptr<StreamingSubscriber> self,
+    EdenMount& edenMount) {
   // Separately scope the lock as the schedule() below will attempt to acquire
   // it for itself.
   {
     auto state = self->state_.wlock();
 
     // Arrange to be told when the eventBase is about to be destroyed
-    state->callback->getEventBase()->runOnDestruction(self.get());
+    state->getEventBase()->runOnDestruction(self.get());
     state->subscriberId =
-        edenMount->getJournal().registerSubscriber([self] { schedule(self); });
+        edenMount.getJournal().registerSubscriber([self] { schedule(self); });
   }
 
   // Suggest to the subscription that the journal has been updated so that
@@ -56,76 +219,204 @@ void StreamingSubscriber::subscribe(
 }
 
 StreamingSubscriber::StreamingSubscriber(
-    Callback callback,
-    std::shared_ptr<EdenMount> edenMount)
-    : edenMount_(std::move(edenMount)),
-      state_(folly::in_place, std::move(callback)) {}
+    std::shared_ptr<EdenMount> edenMount,
+    Options options)
+    : edenMount_(std::move(edenMount)), options_(std::move(options)) {}
 
 StreamingSubscriber::~StreamingSubscriber() {
   auto state = state_.wlock();
   // If the eventBase is still live then we should tear down the peer
-  if (state->callback) {
+  if (state->isActive()) {
     CHECK(state->eventBaseAlive);
-    auto evb = state->callback->getEventBase();
+    auto evb = state->getEventBase();
 
-    // Move the callback away; we won't be able to use it
+    // Move the callbacks away; we won't be able to use them
     // via state-> again.
-    evb->runInEventBaseThread(
-        [callback = std::move(state->callback)]() mutable {
-          callback->done();
-          callback.reset();
-        });
+    auto callbacks = std::make_shared<State>();
+    callbacks->callback = std::move(state->callback);
+    callbacks->notificationCallback = std::move(state->notificationCallback);
+    callbacks->fileDeltaCallback = std::move(state->fileDeltaCallback);
+    evb->runInEventBaseThread([callbacks] { callbacks->done(); });
   }
 }
 
 void StreamingSubscriber::schedule(std::shared_ptr<StreamingSubscriber> self) {
-  auto state = self->state_.rlock();
-  if (state->callback) {
-    state->callback->getEventBase()->runInEventBaseThread(
+  auto state = self->state_.wlock();
+  if (state->isActive() && !state->scheduled) {
+    state->scheduled = true;
+    state->getEventBase()->runInEventBaseThread(
         [self] { self->journalUpdated(); });
   }
 }
 
+bool StreamingSubscriber::matchesPrefix(RelativePathPiece path) const {
+  if (options_.pathPrefixes.empty()) {
+    return true;
+  }
+  for (const auto& prefix : options_.pathPrefixes) {
+    if (path == prefix || path.isSubDirOf(prefix)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool StreamingSubscriber::matches(const JournalDelta& delta) const {
+  // Checkouts change the status of paths that the journal does not list.
+  if (options_.pathPrefixes.empty() || delta.fromHash != delta.toHash) {
+    return true;
+  }
+  bool found = false;
+  auto check = [&](RelativePathPiece path) {
+    found = found || matchesPrefix(path);
+  };
+  delta.forEachChangedPath(
+      [&](RelativePathPiece path, const PathChangeInfo&) { check(path); });
+  delta.forEachUncleanPath(check);
+  return found;
+}
+
+std::shared_ptr<const FileDelta> StreamingSubscriber::getFileDelta(
+    EdenMount& edenMount,
+    JournalDelta::SequenceNumber fromSequence) const {
+  auto delta = getFileDeltaCache().get(edenMount, fromSequence);
+  if (options_.pathPrefixes.empty()) {
+    return delta;
+  }
+
+  auto filtered = std::make_shared<FileDelta>();
+  filtered->fromPosition = delta->fromPosition;
+  filtered->toPosition = delta->toPosition;
+  auto filter = [this](
+                    const std::vector<std::string>& paths,
+                    std::vector<std::string>& out) {
+    for (const auto& path : paths) {
+      if (matchesPrefix(RelativePathPiece{path})) {
+        out.push_back(path);
+      }
+    }
+  };
+  filter(delta->changedPaths, filtered->changedPaths);
+  filter(delta->createdPaths, filtered->createdPaths);
+  filter(delta->uncleanPaths, filtered->uncleanPaths);
+  return filtered;
+}
+
 void StreamingSubscriber::journalUpdated() {
   auto edenMount = edenMount_.lock();
   if (!edenMount) {
     XLOG(DBG1) << "Mount is released: subscription is no longer active";
-    auto state = state_.wlock();
-    state->callback->done();
-    state->callback.reset();
+    state_.wlock()->done();
     return;
   }
 
   auto state = state_.wlock();
-  if (!state->callback) {
+  if (!state->isActive()) {
     // We were cancelled while this callback was queued up.
     // There's nothing for us to do now.
     return;
   }
+  state->scheduled = false;
 
   auto& journal = edenMount->getJournal();
-  if (!state->callback->isRequestActive() ||
+  if (!state->isRequestActive() ||
       !journal.isSubscriberValid(state->subscriberId)) {
     XLOG(DBG1) << "Subscription is no longer active";
     journal.cancelSubscriber(state->subscriberId);
-    state->callback->done();
-    state->callback.reset();
+    state->done();
     return;
   }
 
-  JournalPosition pos;
-
   auto delta = journal.getLatest();
+  if (state->sentInitial) {
+    // Count up the entries since the last time we looked.
+    auto nextSequence = state->lastSequence + 1;
+    auto oldestSeen = delta->toSequence + 1;
+    journal.forEachDelta(
+        nextSequence, delta->toSequence, [&](const JournalDelta& current) {
+          auto from = std::max(current.fromSequence, nextSequence);
+          auto entries = static_cast<int64_t>(current.toSequence - from + 1);
+          if (matches(current)) {
+            state->coalescedEntries += entries;
+          } else {
+            state->filteredEntries += entries;
+          }
+          oldestSeen = from;
+          return true;
+        });
+    // Entries the journal has dropped might have matched.
+    if (oldestSeen > nextSequence) {
+      state->coalescedEntries +=
+          static_cast<int64_t>(oldestSeen - nextSequence);
+    }
+    state->lastSequence = std::max(state->lastSequence, delta->toSequence);
+    if (state->coalescedEntries == 0) {
+      return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto nextAllowed = state->lastNotification + options_.minInterval;
+    if (now < nextAllowed) {
+      // Come back once the interval has passed; anything that arrives in the
+      // meantime is folded into that notification.
+      state->scheduled = true;
+      auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       nextAllowed - now) +
+          std::chrono::milliseconds{1};
+      state->getEventBase()->runAfterDelay(
+          [self = shared_from_this()] { self->journalUpdated(); },
+          delay.count());
+      return;
+    }
+  }
+  state->sentInitial = true;
+  state->lastNotification = std::chrono::steady_clock::now();
+
+  if (state->fileDeltaCallback) {
+    try {
+      auto fileDelta = getFileDelta(*edenMount, state->lastSentSequence);
+      auto sentThrough =
+          static_cast<JournalDelta::SequenceNumber>(
+              fileDelta->toPosition.sequenceNumber);
+      state->lastSentSequence = sentThrough;
+      state->lastSequence = std::max(state->lastSequence, sentThrough);
+      state->fileDeltaCallback->write(*fileDelta);
+    } catch (const EdenError& err) {
+      // The client needs to compute a new basis, so this stream is over.
+      journal.cancelSubscriber(state->subscriberId);
+      state->fileDeltaCallback->exception(
+          folly::make_exception_wrapper<EdenError>(err));
+      state->fileDeltaCallback.reset();
+    } catch (const std::exception& exc) {
+      XLOG(ERR) << "Error while sending subscription update: " << exc.what();
+    }
+    state->coalescedEntries = 0;
+    state->filteredEntries = 0;
+    return;
+  }
+
+  state->lastSequence = std::max(state->lastSequence, delta->toSequence);
+  JournalPosition pos;
   pos.sequenceNumber = delta->toSequence;
   pos.snapshotHash = StringPiece(delta->toHash.getBytes()).str();
   pos.mountGeneration = edenMount->getMountGeneration();
 
   try {
     // And send it
-    state->callback->write(pos);
+    if (state->callback) {
+      state->callback->write(pos);
+    } else {
+      SubscriptionNotification notification;
+      notification.position = pos;
+      notification.coalescedEntries = state->coalescedEntries;
+      notification.filteredEntries = state->filteredEntries;
+      state->notificationCallback->write(notification);
+    }
   } catch (const std::exception& exc) {
     XLOG(ERR) << "Error while sending subscription update: " << exc.what();
   }
+  state->coalescedEntries = 0;
+  state->filteredEntries = 0;
 }
 } // namespace eden
 } // namespace facebook
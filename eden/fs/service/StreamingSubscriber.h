@@ -8,7 +8,9 @@
  *
  */
 #pragma once
+#include <chrono>
 #include <memory>
+#include <vector>
 #include "eden/fs/inodes/EdenMount.h"
 #include "eden/fs/service/gen-cpp2/StreamingEdenService.h"
 
@@ -19,19 +21,38 @@ namespace eden {
  * connected subscribers so that they can take action as files
  * are modified in the eden mount.
  *
- * This initial implementation is relatively dumb in that it
- * will immediately try to send a notification to the subscriber.
+ * Journal updates that arrive while a notification is already queued are
+ * coalesced into it, so a burst of writes wakes each subscriber up once
+ * rather than once per write.  Subscribers made with subscribeFiltered()
+ * may also limit how often they are notified, and only be notified about
+ * changes to some paths; each notification says how many journal entries
+ * it covers and how many were filtered out.
  *
- * Future iterations will add the ability to rate control these
- * updates (no more than 1 update per specified time interval)
- * and potentially also add a predicate so that we only notify
- * for updates that match certain criteria.
+ * Subscribers made with subscribeFileDeltas() are sent the FileDelta since
+ * the previous one instead of just the new position, so they do not need
+ * to call getFilesChangedSince().  Subscribers sharing a position share the
+ * merged FileDelta too, rather than each merging the journal again.
  */
 
-class StreamingSubscriber : private folly::EventBase::LoopCallback {
+class StreamingSubscriber
+    : private folly::EventBase::LoopCallback,
+      public std::enable_shared_from_this<StreamingSubscriber> {
  public:
   using Callback = std::unique_ptr<apache::thrift::StreamingHandlerCallback<
       std::unique_ptr<JournalPosition>>>;
+  using NotificationCallback =
+      std::unique_ptr<apache::thrift::StreamingHandlerCallback<
+          std::unique_ptr<SubscriptionNotification>>>;
+  using FileDeltaCallback = std::unique_ptr<
+      apache::thrift::StreamingHandlerCallback<std::unique_ptr<FileDelta>>>;
+
+  struct Options {
+    /** Only notify about changes to these paths or below them.  Every
+     * change is reported if this is empty. */
+    std::vector<RelativePath> pathPrefixes;
+    /** The minimum time between notifications. */
+    std::chrono::milliseconds minInterval{0};
+  };
 
   /** Establishes a subscription with the journal in the edenMount
    * that was passed in during construction.
@@ -44,12 +65,32 @@ class StreamingSubscriber : private folly::EventBase::LoopCallback {
       Callback callback,
       std::shared_ptr<EdenMount> edenMount);
 
+  /** Like subscribe(), but only notifying as the options allow. */
+  static void subscribe(
+      NotificationCallback callback,
+      std::shared_ptr<EdenMount> edenMount,
+      Options options);
+
+  /** Push the changes made after fromSequence, and then the changes since
+   * each previous push, as the options allow.  The stream fails with ERANGE
+   * if the journal no longer holds all of the changes to send. */
+  static void subscribe(
+      FileDeltaCallback callback,
+      std::shared_ptr<EdenMount> edenMount,
+      Options options,
+      JournalDelta::SequenceNumber fromSequence);
+
   // Not really public. Exposed publicly so std::make_shared can instantiate
   // this class.
-  StreamingSubscriber(Callback callback, std::shared_ptr<EdenMount> edenMount);
+  StreamingSubscriber(std::shared_ptr<EdenMount> edenMount, Options options);
   ~StreamingSubscriber();
 
  private:
+  /** Register with the journal and push the initial position. */
+  static void start(
+      std::shared_ptr<StreamingSubscriber> self,
+      EdenMount& edenMount);
+
   /** Schedule a call to journalUpdated.
    * The journalUpdated method will be called in the context of the
    * eventBase thread that is associated with the connected client */
@@ -60,6 +101,15 @@ class StreamingSubscriber : private folly::EventBase::LoopCallback {
    * This is ensured by only ever calling it via the schedule() method. */
   void journalUpdated();
 
+  /** Whether the subscriber wants to hear about delta. */
+  bool matches(const JournalDelta& delta) const;
+  bool matchesPrefix(RelativePathPiece path) const;
+
+  /** The changes after fromSequence, restricted to options_.pathPrefixes. */
+  std::shared_ptr<const FileDelta> getFileDelta(
+      EdenMount& edenMount,
+      JournalDelta::SequenceNumber fromSequence) const;
+
   /** We implement LoopCallback so that we can get notified when the
    * eventBase is about to be destroyed.  The other option for lifetime
    * management is KeepAlive tokens but those are not suitable for us
@@ -70,11 +120,33 @@ class StreamingSubscriber : private folly::EventBase::LoopCallback {
   void runLoopCallback() noexcept override;
 
   struct State {
+    /** Exactly one of these is set while the subscription is active. */
     Callback callback;
+    NotificationCallback notificationCallback;
+    FileDeltaCallback fileDeltaCallback;
     uint64_t subscriberId{0};
     bool eventBaseAlive{true};
 
-    explicit State(Callback callback);
+    /** Set while a call to journalUpdated() is queued, or waiting for
+     * minInterval to pass.  Further journal updates are left to it. */
+    bool scheduled{false};
+    bool sentInitial{false};
+    /** The newest journal entry that has been looked at. */
+    JournalDelta::SequenceNumber lastSequence{0};
+    /** The newest journal entry that has been sent to a FileDeltaCallback. */
+    JournalDelta::SequenceNumber lastSentSequence{0};
+    std::chrono::steady_clock::time_point lastNotification;
+    /** Counts of the entries since the previous notification. */
+    int64_t coalescedEntries{0};
+    int64_t filteredEntries{0};
+
+    bool isActive() const {
+      return callback || notificationCallback || fileDeltaCallback;
+    }
+    folly::EventBase* getEventBase() const;
+    bool isRequestActive() const;
+    /** Close the stream.  Must be called on the eventBase thread. */
+    void done();
   };
 
   // There is a lock hierarchy here.  Writes to Eden update the Journal which
@@ -88,6 +160,7 @@ class StreamingSubscriber : private folly::EventBase::LoopCallback {
   // its callbacks outside of its lock.  Alternatively, Journal::addDelta
   // could simply schedule the subscriber calls onto the subscriber's thread.
   const std::weak_ptr<EdenMount> edenMount_;
+  const Options options_;
   folly::Synchronized<State> state_;
 };
 } // namespace eden
@@ -85,7 +85,9 @@ union FileInformationOrError {
  */
 struct JournalPosition {
   /** An opaque but unique number within the scope of a given mount point.
-   * This is used to determine when sequenceNumber has been invalidated. */
+   * This is used to determine when sequenceNumber has been invalidated.
+   * It is preserved across graceful restarts and clean shutdowns of edenfs,
+   * but changes if the journal could not be carried over. */
   1: i64 mountGeneration
 
   /** Monotonically incrementing number
@@ -129,6 +131,38 @@ struct FileDelta {
    * in ways that may not be able to be extracted solely by performing
    * source control diff operations on the from/to hashes. */
   6: list<PathString> uncleanPaths
+  /** When fromPosition.snapshotHash != toPosition.snapshotHash this holds
+   * the files that differ between the two commits, so that clients do not
+   * need to diff them themselves.  edenfs computes this only when a query
+   * spans a change of commit, and shares the result between queries. */
+  7: list<PathString> commitChangedPaths
+  /** Set by getFilesChangedSinceFiltered() when it left out some of the
+   * paths because of its limit. */
+  8: bool truncated
+}
+
+/**
+ * A sorted list of paths, each tagged with one byte, encoded with shared
+ * prefixes in one buffer.  For responses with many paths this is much
+ * smaller, and much cheaper to build and parse, than a list of strings.
+ * The format is described in eden/fs/utils/PathTable.h.
+ */
+typedef binary PathTable
+
+/**
+ * The result of getFilesChangedSinceCompact(): the same information as
+ * FileDelta, with the paths in PathTables.
+ */
+struct CompactFileDelta {
+  1: JournalPosition fromPosition
+  2: JournalPosition toPosition
+  /** FileDelta's changedPaths and createdPaths, tagged 0 for changed paths
+   * and 1 for created paths. */
+  3: PathTable changedPaths
+  /** Tagged 0. */
+  4: PathTable uncleanPaths
+  /** Tagged 0. */
+  5: PathTable commitChangedPaths
 }
 
 struct DebugGetRawJournalParams {
@@ -198,6 +232,41 @@ struct ScmStatus {
    * This map will be empty if no errors occurred.
    */
   2: map<PathString, string> errors
+
+  /**
+   * Set by the *Filtered() status calls when they stopped early because
+   * they reached their limit, so entries and errors are incomplete.
+   */
+  3: bool truncated
+}
+
+/**
+ * Restricts the results of the *Filtered() status and journal calls, so
+ * that clients interested in part of the repository do not pay for the
+ * rest of it.
+ */
+struct ResultFilter {
+  /**
+   * If non-empty, only report the paths equal to or under one of these.
+   * Directories that cannot contain such a path are not examined at all.
+   */
+  1: list<PathString> pathPrefixes
+  /**
+   * If non-zero, report at most this many paths, and set the truncated
+   * field of the result if there were more.  Must not be negative.  Which of the paths are
+   * reported is unspecified: the operation stops once it has found enough
+   * of them.
+   */
+  2: i64 limit
+}
+
+/**
+ * The result of getScmStatusCompact(): the same information as ScmStatus,
+ * with each path in entries tagged with its ScmFileStatus.
+ */
+struct CompactScmStatus {
+  1: PathTable entries
+  2: map<PathString, string> errors
 }
 
 /** Option for use with checkOutRevision(). */
@@ -326,6 +395,31 @@ struct InodePathDebugInfo {
   3: bool linked
 }
 
+struct OverlayProblem {
+  1: i64 inodeNumber
+  2: string description
+}
+
+/**
+ * The result of debugCheckOverlay().  See OverlayChecker for what each kind
+ * of problem means.
+ */
+struct OverlayCheckResult {
+  1: i64 directoriesScanned
+  2: i64 filesScanned
+  3: i64 orphans
+  4: i64 orphansRemoved
+  5: i64 badRecords
+  6: i64 typeMismatches
+  7: i64 missingData
+  8: i64 unallocatedMetadata
+  9: i64 metadataRemoved
+  // A sample of the problems found.
+  10: list<OverlayProblem> problems
+  // Metadata records that nothing refers to any more.  Not a problem.
+  11: i64 unreferencedMetadata
+}
+
 struct SetLogLevelResult {
   1: bool categoryCreated
 }
@@ -339,6 +433,20 @@ struct MountInodeInfo {
   3: i64 materializedInodeCount
   4: i64 loadedFileCount
   5: i64 loadedTreeCount
+  /**
+   * The estimated memory used by the mount's loaded and unloaded inodes, not
+   * including the contents of loaded directories.
+   */
+  6: i64 inodeMemoryBytes
+  /**
+   * The bytes of source control data held in memory by open files.  These
+   * blobs may also be in the object store's blob cache.
+   */
+  7: i64 blobMemoryBytes
+  /**
+   * The estimated memory used by the mount's journal.
+   */
+  8: i64 journalMemoryBytes
 }
 
 /**
@@ -372,6 +480,16 @@ struct InternalStats {
    * Populated with current value (the fb303 counters value is an average).
    */
   6: i64 vmRSSBytes
+  /**
+   * The estimated memory used by the local store's caches and write buffers.
+   */
+  7: i64 localStoreMemoryBytes
+  /**
+   * The storage engine's internal stats, such as its block cache hits and
+   * the on-disk size of each key space.  These are refreshed periodically,
+   * and are also exported as "local_store.<name>" counters.
+   */
+  8: map<string, i64> localStoreStats
 }
 
 struct ManifestEntry {
@@ -389,18 +507,133 @@ struct FuseCall {
   7: i32 pid
 }
 
+/**
+ * The work that one client process, or all processes with one name, caused
+ * a mount to do.  Fetches are the trees and blobs that had to be loaded from
+ * the backing store to answer the process's FUSE requests.
+ */
+struct ProcessAccessCounts {
+  /** 0 in totals by process name. */
+  1: i32 pid
+  2: string name
+  3: i64 fuseRequests
+  4: i64 treeFetches
+  5: i64 blobFetches
+  6: i64 fetchedBytes
+}
+
+struct ProcessAccessInfo {
+  1: list<ProcessAccessCounts> processes
+  2: list<ProcessAccessCounts> processNames
+}
+
+/**
+ * One of the most frequently accessed objects in a mount.  accesses is an
+ * estimate that may be too high; hits and misses are only counted from when
+ * the object became one of the most accessed.
+ */
+struct HotObject {
+  /** The hex hash of a tree or blob, or the path of an inode. */
+  1: string id
+  2: i64 accesses
+  3: i64 hits
+  4: i64 misses
+  /** For inodes, the inode number.  id is empty if it has no path. */
+  5: i64 inodeNumber
+}
+
+struct HotObjects {
+  /** Hits were found in memory or the LocalStore; misses were fetched. */
+  1: list<HotObject> trees
+  2: list<HotObject> blobs
+  /** The inodes opened most, where hits were already loaded. */
+  3: list<HotObject> inodes
+}
+
+/**
+ * The operations recorded in edenfs' trace buffers.  The meaning of a trace
+ * event's argument depends on its operation:
+ * - FUSE_REQUEST: the FUSE opcode
+ * - INODE_LOAD, OVERLAY_READ, OVERLAY_WRITE: the inode number
+ * - LOCAL_STORE_HIT, LOCAL_STORE_MISS, HG_IMPORT: the LocalStore key space
+ */
+enum TracedOperation {
+  FUSE_REQUEST = 0,
+  INODE_LOAD = 1,
+  LOCAL_STORE_HIT = 2,
+  LOCAL_STORE_MISS = 3,
+  HG_IMPORT = 4,
+  OVERLAY_READ = 5,
+  OVERLAY_WRITE = 6,
+}
+
+enum TraceEventPhase {
+  BEGIN = 0,
+  END = 1,
+  INSTANT = 2,
+}
+
+struct TraceEventInfo {
+  /** Nanoseconds on edenfs' monotonic clock. */
+  1: i64 timestamp
+  /** The request that the event was part of, or 0 if there was none. */
+  2: i64 requestId
+  3: TracedOperation operation
+  4: TraceEventPhase phase
+  5: i64 argument
+  6: i64 threadId
+}
+
 /** Params for globFiles(). */
 struct GlobParams {
   1: PathString mountPoint,
   2: list<string> globs,
   3: bool includeDotfiles,
-  // if true, prefetch matching blobs
+  // if true, prefetch matching blobs.  The request fails with EAGAIN if
+  // too many blobs are already being prefetched; see getPrefetchStatus().
   4: bool prefetchFiles,
   // if true, don't populate matchingFiles in the Glob
   // results.  This only really makes sense with prefetchFiles.
   5: bool suppressFileList,
 }
 
+/**
+ * The admission control for prefetches requested by globFiles() and
+ * streamGlobFiles().  Clients can pace themselves by keeping their own
+ * usage below the per-client limit.  A limit of 0 means there is none.
+ */
+struct PrefetchStatus {
+  // Blobs admitted for prefetching that have not finished, for all clients.
+  1: i64 blobsInFlight
+  2: i64 maxBlobsInFlight
+  // The same, for the calling connection only.
+  3: i64 clientBlobsInFlight
+  4: i64 maxClientBlobsInFlight
+  // Prefetch requests refused with EAGAIN since edenfs started.
+  5: i64 rejectedRequests
+}
+
+/** Params for searchFileNames(). */
+struct FileNameSearchParams {
+  1: PathString mountPoint,
+  // Each glob is an optional directory, then a "**" component, then either
+  // a file name or "*" followed by a suffix, e.g. "**/TARGETS" or
+  // "fbcode/**/*.thrift".  None of the parts may contain other wildcards.
+  2: list<string> globs,
+  3: bool includeDotfiles,
+}
+
+/** Params for prefetchCommitTrees(). */
+struct PrefetchCommitTreesParams {
+  1: PathString mountPoint,
+  // The commit that the mount is expected to be checked out to next.
+  2: BinaryHash commit,
+  // If non-zero, only fetch trees at most this many levels below the root.
+  3: i32 maxDepth,
+  // If not empty, only fetch the trees leading to and under these paths.
+  4: list<PathString> paths,
+}
+
 struct Glob {
   /**
    * This list cannot contain duplicate values and is not guaranteed to be
@@ -442,6 +675,17 @@ service EdenService extends fb303.FacebookService {
     3: CheckoutMode checkoutMode)
       throws (1: EdenError ex)
 
+  /**
+   * Fetch the trees of a commit that differ from those of the mount's current
+   * parent into the local store, at background priority, so that a later
+   * checkOutRevision() to that commit needs few trees from the backing store.
+   *
+   * Returns the number of trees that were loaded.
+   */
+  i64 prefetchCommitTrees(
+    1: PrefetchCommitTreesParams params,
+  ) throws (1: EdenError ex)
+
   /**
    * Reset the working directory's parent commits, without changing the working
    * directory contents.
@@ -488,6 +732,25 @@ service EdenService extends fb303.FacebookService {
     2: JournalPosition fromPosition)
       throws (1: EdenError ex)
 
+  /**
+   * The same as getFilesChangedSince(), but only reporting the paths that
+   * match the filter.
+   */
+  FileDelta getFilesChangedSinceFiltered(
+    1: PathString mountPoint,
+    2: JournalPosition fromPosition,
+    3: ResultFilter filter)
+      throws (1: EdenError ex)
+
+  /**
+   * The same as getFilesChangedSince(), but with the paths encoded in
+   * PathTables, for clients that expect large numbers of changes.
+   */
+  CompactFileDelta getFilesChangedSinceCompact(
+    1: PathString mountPoint,
+    2: JournalPosition fromPosition)
+      throws (1: EdenError ex)
+
   /**
    * Returns the journal entries for the specified params. Useful for auditing
    * the changes that Eden has sent to Watchman. Note that the most recent
@@ -529,6 +792,86 @@ service EdenService extends fb303.FacebookService {
     1: GlobParams params,
   ) throws (1: EdenError ex)
 
+  /**
+   * Returns how much of the prefetch budget is in use, so that clients that
+   * prefetch in bulk can back off before they are refused.
+   */
+  PrefetchStatus getPrefetchStatus()
+
+  /**
+   * Returns the files in the working copy that match the globs, without
+   * walking the trees of the commit.
+   *
+   * Matches are looked up in an index of the paths in the commit that is
+   * checked out, which is built the first time it is needed and kept in the
+   * local store.  Local changes are applied from the working copy's status:
+   * removed files are left out and untracked files are added, but ignored
+   * files are never reported.
+   *
+   * Only the globs described in FileNameSearchParams are supported; others
+   * fail with EINVAL.  The results are sorted and have no duplicates.
+   */
+  Glob searchFileNames(
+    1: FileNameSearchParams params,
+  ) throws (1: EdenError ex)
+
+  /**
+   * Start recording the paths of the files opened in a mount, under a tag
+   * chosen by the client, such as the name of the build target about to be
+   * built.  Several recordings with different tags may run at once.
+   */
+  void startRecordingAccessProfile(
+    1: PathString mountPoint,
+    2: string tag,
+  ) throws (1: EdenError ex)
+
+  /**
+   * Stop the recording with this tag and return the paths it recorded in a
+   * compact binary form.  The profile does not depend on the mount or the
+   * commit it was recorded in, so it can be saved and replayed later, in any
+   * checkout of the same repository.
+   */
+  binary stopRecordingAccessProfile(
+    1: PathString mountPoint,
+    2: string tag,
+  ) throws (1: EdenError ex)
+
+  /**
+   * Fetch the trees and blobs of the files in a profile returned by
+   * stopRecordingAccessProfile(), as of the mount's current commit, so that
+   * they are local before a build opens them.  Files that do not exist in
+   * the current commit are skipped.
+   *
+   * Returns the number of files whose blobs were fetched.
+   */
+  i64 prefetchAccessProfile(
+    1: PathString mountPoint,
+    2: binary profile,
+  ) throws (1: EdenError ex)
+
+  /**
+   * Add directories to the scope of a mount that was scoped to some of its
+   * directories with the "include" list in the [scope] section of its
+   * config.  Directories outside of the scope appear empty, and are skipped
+   * by diffs, globs and prefetches.
+   *
+   * The paths are relative to the mount point; an empty path makes the whole
+   * checkout visible.  The widened scope takes effect immediately and is
+   * kept for later mounts of the checkout.  Scopes cannot be narrowed.
+   */
+  void widenMountScope(
+    1: PathString mountPoint,
+    2: list<PathString> paths,
+  ) throws (1: EdenError ex)
+
+  /**
+   * Get the directories a mount is scoped to.  The list is empty if the
+   * whole checkout is visible.
+   */
+  list<PathString> getMountScope(
+    1: PathString mountPoint,
+  ) throws (1: EdenError ex)
+
   /**
    * Get the status of the working directory against the specified commit.
    *
@@ -541,6 +884,27 @@ service EdenService extends fb303.FacebookService {
     3: BinaryHash commit,
   ) throws (1: EdenError ex)
 
+  /**
+   * The same as getScmStatus(), but only diffing the parts of the working
+   * directory that can hold paths matching the filter.
+   */
+  ScmStatus getScmStatusFiltered(
+    1: PathString mountPoint,
+    2: bool listIgnored,
+    3: BinaryHash commit,
+    4: ResultFilter filter,
+  ) throws (1: EdenError ex)
+
+  /**
+   * The same as getScmStatus(), but with the paths encoded in a PathTable,
+   * for clients that expect large numbers of changes.
+   */
+  CompactScmStatus getScmStatusCompact(
+    1: PathString mountPoint,
+    2: bool listIgnored,
+    3: BinaryHash commit,
+  ) throws (1: EdenError ex)
+
   /**
    * Computes the status between two specified revisions.
    * This does not care about the state of the working copy.
@@ -551,6 +915,17 @@ service EdenService extends fb303.FacebookService {
     3: BinaryHash newHash,
   ) throws (1: EdenError ex)
 
+  /**
+   * The same as getScmStatusBetweenRevisions(), but only loading the trees
+   * of the two revisions that can hold paths matching the filter.
+   */
+  ScmStatus getScmStatusBetweenRevisionsFiltered(
+    1: PathString mountPoint,
+    2: BinaryHash oldHash,
+    3: BinaryHash newHash,
+    4: ResultFilter filter,
+  ) throws (1: EdenError ex)
+
   //////// SCM Commit-Related APIs ////////
 
   /**
@@ -652,6 +1027,60 @@ service EdenService extends fb303.FacebookService {
     1: PathString mountPoint,
   )
 
+  /**
+   * Get the client processes that have caused the most backing store
+   * fetches, and then the most FUSE requests, in the given mount.
+   *
+   * At most limit processes and limit process names are returned, most
+   * active first.  Edenfs only keeps counts for a bounded number of
+   * processes, so a process that was evicted to make room for others starts
+   * counting again from zero.
+   */
+  ProcessAccessInfo getProcessAccessCounts(
+    1: PathString mountPoint,
+    2: i64 limit,
+  ) throws (1: EdenError ex)
+
+  /**
+   * Get up to limit of the trees, blobs and inodes accessed most often in
+   * the given mount, for sizing caches and prefetch profiles.
+   */
+  HotObjects debugGetHotObjects(
+    1: PathString mountPoint,
+    2: i64 limit,
+  ) throws (1: EdenError ex)
+
+  /**
+   * Start recording the FUSE requests that the given mount receives into a
+   * trace at outputPath, for replaying later to benchmark edenfs against
+   * real traffic.  File names are anonymized and file contents are never
+   * recorded.  The pids of the requesting processes are only recorded if
+   * includePids is set.
+   *
+   * Starting a new recording stops any recording already in progress.
+   */
+  void startRecordingFuseTrace(
+    1: PathString mountPoint,
+    2: PathString outputPath,
+    3: bool includePids,
+  ) throws (1: EdenError ex)
+
+  /**
+   * Stop recording the given mount's FUSE requests, and return the number of
+   * records written to the trace.
+   */
+  i64 stopRecordingFuseTrace(
+    1: PathString mountPoint,
+  ) throws (1: EdenError ex)
+
+  /**
+   * Get the most recent events from the trace buffers of all edenfs threads,
+   * ordered by timestamp.
+   *
+   * Each thread keeps the last --trace_buffer_events events that it recorded.
+   */
+  list<TraceEventInfo> debugGetRecentTraceEvents()
+
   /**
    * Get the InodePathDebugInfo for the inode that corresponds to the given
    * inode number. This provides the path for the inode and also indicates
@@ -663,6 +1092,34 @@ service EdenService extends fb303.FacebookService {
     2: i64 inodeNumber,
   ) throws (1: EdenError ex)
 
+  /**
+   * Check a mount's overlay for consistency while it stays mounted.  If
+   * repair is true, orphaned overlay data and stray inode metadata records
+   * are removed.
+   *
+   * The check scans the whole overlay, so it can take a while on large
+   * overlays.  Only one check runs at a time for each mount.
+   */
+  OverlayCheckResult debugCheckOverlay(
+    1: PathString mountPoint,
+    2: bool repair,
+  ) throws (1: EdenError ex)
+
+  /**
+   * Write every tree reachable from a commit to a TreeSnapshot file at
+   * outputPath, which must be absolute.  If commit is empty, the mount's
+   * current parent commit is used.
+   *
+   * edenfs serves trees from the snapshot named by --tree_snapshot, and the
+   * file can be copied to other machines.  Returns the number of trees
+   * written.
+   */
+  i64 debugExportTreeSnapshot(
+    1: PathString mountPoint,
+    2: BinaryHash commit,
+    3: PathString outputPath,
+  ) throws (1: EdenError ex)
+
   /**
    * Sets the log level for a given category at runtime.
    */
@@ -671,6 +1128,16 @@ service EdenService extends fb303.FacebookService {
     2: string level,
   ) throws (1: EdenError ex)
 
+  /**
+   * Record the wait and hold times of one in every sampleRate acquisitions
+   * of the profiled locks, such as the InodeMap, TreeInode contents and
+   * Journal locks, or stop recording them if sampleRate is 0.  The times are
+   * exported as the lock.<name>.wait_us and lock.<name>.hold_us histograms.
+   */
+  void debugSetLockProfiling(
+    1: i32 sampleRate,
+  ) throws (1: EdenError ex)
+
   /**
    * Column by column, clears and compacts the LocalStore. All columns are
    * compacted, but only columns that contain ephemeral data are cleared.
@@ -5,6 +5,73 @@ namespace cpp2 facebook.eden
  * This is only available to cpp2 clients and won't compile for other
  * language/runtimes. */
 
+/** A portion of the results of streamGlobFiles().
+ * Chunks of matchingFiles are sent as the glob is evaluated, followed by
+ * chunks that report the progress of prefetching the matching files when
+ * prefetchFiles was requested. */
+struct GlobChunk {
+  /**
+   * The matches found since the previous chunk.  The same path is never
+   * sent twice, and paths are not sorted.  This is always empty when
+   * suppressFileList was requested.
+   */
+  1: list<eden.PathString> matchingFiles,
+  /** The number of matching files whose prefetch has completed so far. */
+  2: i64 prefetchedFiles,
+  /** The number of matching files to prefetch.  This is only known, and
+   * only non-zero, once the glob evaluation has finished. */
+  3: i64 filesToPrefetch,
+}
+
+struct SubscribeParams {
+  1: eden.PathString mountPoint,
+  /** Only notify about changes to these paths or to files below them.
+   * Changes to the parent commit are always reported.  If this is empty
+   * every change is reported. */
+  2: list<eden.PathString> pathPrefixes,
+  /** Send at most one notification per this many milliseconds.  Changes
+   * made in the meantime are coalesced into the next notification.  0 sends
+   * notifications as soon as possible. */
+  3: i64 minIntervalMs,
+}
+
+struct SubscriptionNotification {
+  1: eden.JournalPosition position,
+  /** The number of journal entries matching pathPrefixes since the previous
+   * notification.  More than one means that changes were coalesced. */
+  2: i64 coalescedEntries,
+  /** The number of journal entries since the previous notification that
+   * did not match pathPrefixes, and so were not reported on their own. */
+  3: i64 filteredEntries,
+}
+
+/** A portion of the results of streamScmStatus() or
+ * streamScmStatusBetweenRevisions().  Taken together the chunks hold the
+ * same results as the corresponding ScmStatus. */
+struct ScmStatusChunk {
+  1: map<eden.PathString, eden.ScmFileStatus> entries,
+  /** Errors computing the status of these paths; see ScmStatus.errors. */
+  2: map<eden.PathString, string> errors,
+}
+
+struct StreamScmStatusParams {
+  1: eden.PathString mountPoint,
+  2: bool listIgnored,
+  /** The commit to compare the working directory against. */
+  3: eden.BinaryHash commit,
+  /** Stop the diff and end the stream with an ETIMEDOUT EdenError if it has
+   * not finished after this many milliseconds.  0 means no deadline. */
+  4: i64 timeoutMs,
+}
+
+struct StreamScmStatusBetweenRevisionsParams {
+  1: eden.PathString mountPoint,
+  2: eden.BinaryHash oldHash,
+  3: eden.BinaryHash newHash,
+  /** As for StreamScmStatusParams.timeoutMs. */
+  4: i64 timeoutMs,
+}
+
 service StreamingEdenService extends eden.EdenService {
   /** Request notification about changes to the journal for
    * the specified mountPoint.
@@ -16,4 +83,42 @@ service StreamingEdenService extends eden.EdenService {
    */
   stream<eden.JournalPosition> subscribe(
     1: string mountPoint)
+
+  /** Like subscribe(), but only notify about changes to the given paths,
+   * and no more often than requested.  The JournalPosition at the time of
+   * the call is always pushed first.
+   */
+  stream<SubscriptionNotification> subscribeFiltered(
+    1: SubscribeParams params)
+
+  /** Like subscribeFiltered(), but push the changed files themselves rather
+   * than just the latest position.  Each FileDelta holds the changes since
+   * the previous one sent on this stream, starting from fromPosition, so
+   * clients need not call getFilesChangedSince().  The stream ends with an
+   * ERANGE EdenError if the journal no longer holds the changes since the
+   * last FileDelta sent.
+   */
+  stream<eden.FileDelta> subscribeFileDeltas(
+    1: SubscribeParams params,
+    2: eden.JournalPosition fromPosition)
+
+  /** Evaluate globs like globFiles(), streaming the matching files back as
+   * they are found rather than after the whole walk has finished.
+   * If the client disconnects the evaluation and prefetch stop early.
+   */
+  stream<GlobChunk> streamGlobFiles(
+    1: eden.GlobParams params)
+
+  /** Like getScmStatus(), but stream the status entries back in chunks as
+   * the diff finds them rather than building the whole ScmStatus first.
+   * The results are not taken from or added to the status cache.
+   * If the client disconnects, or the deadline passes, the diff stops early.
+   */
+  stream<ScmStatusChunk> streamScmStatus(
+    1: StreamScmStatusParams params)
+
+  /** Like getScmStatusBetweenRevisions(), streamed as for streamScmStatus().
+   */
+  stream<ScmStatusChunk> streamScmStatusBetweenRevisions(
+    1: StreamScmStatusBetweenRevisionsParams params)
 }
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/service/PrefetchLimiter.h"
+
+#include <gtest/gtest.h>
+#include "eden/fs/service/gen-cpp2/eden_types.h"
+
+using namespace facebook::eden;
+
+namespace {
+constexpr PrefetchLimiter::ClientId kClient1 = 1;
+constexpr PrefetchLimiter::ClientId kClient2 = 2;
+
+void expectRefused(
+    PrefetchLimiter& limiter,
+    PrefetchLimiter::ClientId client,
+    size_t count) {
+  try {
+    limiter.admit(client, count);
+    ADD_FAILURE() << "admitted " << count << " blobs for client " << client;
+  } catch (const EdenError& error) {
+    EXPECT_EQ(EAGAIN, error.errorCode);
+  }
+}
+} // namespace
+
+TEST(PrefetchLimiter, admissionsAreReleasedWhenDestroyed) {
+  PrefetchLimiter limiter{100, 0};
+  {
+    auto admission = limiter.admit(kClient1, 60);
+    auto status = limiter.getStatus(kClient1);
+    EXPECT_EQ(60, status.inFlight);
+    EXPECT_EQ(60, status.clientInFlight);
+    EXPECT_EQ(0, limiter.getStatus(kClient2).clientInFlight);
+    expectRefused(limiter, kClient2, 50);
+  }
+  EXPECT_EQ(0, limiter.getStatus(kClient1).inFlight);
+  auto admission = limiter.admit(kClient2, 50);
+  EXPECT_EQ(1, limiter.getStatus(kClient2).rejected);
+}
+
+TEST(PrefetchLimiter, eachClientHasItsOwnQuota) {
+  PrefetchLimiter limiter{0, 100};
+  auto admission1 = limiter.admit(kClient1, 80);
+  expectRefused(limiter, kClient1, 30);
+  auto admission2 = limiter.admit(kClient2, 80);
+  EXPECT_EQ(160, limiter.getStatus(kClient1).inFlight);
+}
+
+TEST(PrefetchLimiter, largeRequestsRunAlone) {
+  PrefetchLimiter limiter{100, 50};
+  {
+    auto admission = limiter.admit(kClient1, 500);
+    expectRefused(limiter, kClient2, 1);
+  }
+  auto admission = limiter.admit(kClient2, 1);
+}
+
+TEST(PrefetchLimiter, movedAdmissionsReleaseOnce) {
+  PrefetchLimiter limiter{100, 100};
+  PrefetchLimiter::Admission outer;
+  {
+    auto admission = limiter.admit(kClient1, 40);
+    outer = std::move(admission);
+  }
+  EXPECT_EQ(40, limiter.getStatus(kClient1).clientInFlight);
+  outer = PrefetchLimiter::Admission{};
+  EXPECT_EQ(0, limiter.getStatus(kClient1).inFlight);
+}
@@ -37,9 +37,13 @@ void checkSqliteResult(sqlite3* db, int result) {
       to<string>("sqlite error: ", result, ": ", sqlite3_errstr(result)));
 }
 
-SqliteDatabase::SqliteDatabase(AbsolutePathPiece path) {
+SqliteDatabase::SqliteDatabase(AbsolutePathPiece path)
+    : SqliteDatabase(path, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) {}
+
+SqliteDatabase::SqliteDatabase(AbsolutePathPiece path, int openFlags) {
   sqlite3* db = nullptr;
-  auto result = sqlite3_open(path.copy().c_str(), &db);
+  auto result =
+      sqlite3_open_v2(path.copy().c_str(), &db, openFlags, /*zVfs=*/nullptr);
   if (result != SQLITE_OK) {
     // On most error conditions sqlite3_open() does allocate the DB object,
     // and it needs to be closed afterwards if it is non-null.
@@ -61,12 +65,12 @@ SqliteDatabase::~SqliteDatabase() {
   close();
 }
 
-Synchronized<sqlite3*>::LockedPtr SqliteDatabase::lock() {
+SqliteDatabase::LockedPtr SqliteDatabase::lock() {
   return db_.wlock();
 }
 
 SqliteStatement::SqliteStatement(
-    folly::Synchronized<sqlite3*>::LockedPtr& db,
+    SqliteDatabase::LockedPtr& db,
     folly::StringPiece query)
     : db_{*db} {
   checkSqliteResult(
@@ -88,6 +92,11 @@ bool SqliteStatement::step() {
   }
 }
 
+void SqliteStatement::reset() {
+  sqlite3_reset(stmt_);
+  sqlite3_clear_bindings(stmt_);
+}
+
 void SqliteStatement::bind(
     size_t paramNo,
     folly::StringPiece blob,
@@ -104,6 +113,10 @@ StringPiece SqliteStatement::columnBlob(size_t colNo) const {
       sqlite3_column_bytes(stmt_, colNo));
 }
 
+int64_t SqliteStatement::columnInt64(size_t colNo) const {
+  return sqlite3_column_int64(stmt_, colNo);
+}
+
 SqliteStatement::~SqliteStatement() {
   sqlite3_finalize(stmt_);
 }
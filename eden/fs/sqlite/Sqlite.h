@@ -11,6 +11,7 @@
 #include <folly/String.h>
 #include <folly/Synchronized.h>
 #include <sqlite3.h>
+#include "eden/fs/utils/LockProfiler.h"
 #include "eden/fs/utils/PathFuncs.h"
 namespace facebook {
 namespace eden {
@@ -21,13 +22,31 @@ void checkSqliteResult(sqlite3* db, int result);
 
 /** A helper class for managing a handle to a sqlite database. */
 class SqliteDatabase {
+ private:
+  struct LockName {
+    static folly::StringPiece name() {
+      return "sqlite";
+    }
+  };
+  using SynchronizedHandle =
+      folly::Synchronized<sqlite3*, ProfiledSharedMutex<LockName>>;
+
  public:
+  using LockedPtr = SynchronizedHandle::LockedPtr;
+
   /** Open a handle to the database at the specified path.
    * Will throw an exception if the database fails to open.
    * The database will be created if it didn't already exist.
    */
   explicit SqliteDatabase(AbsolutePathPiece path);
 
+  /** Open a handle to the database at the specified path, passing openFlags
+   * through to sqlite3_open_v2().  For example, SQLITE_OPEN_READONLY opens a
+   * connection that can only be used for reads; such a database must already
+   * exist.  Will throw an exception if the database fails to open.
+   */
+  SqliteDatabase(AbsolutePathPiece path, int openFlags);
+
   // Not copyable...
   SqliteDatabase(const SqliteDatabase&) = delete;
   SqliteDatabase& operator=(const SqliteDatabase&) = delete;
@@ -45,10 +64,10 @@ class SqliteDatabase {
 
   /** Obtain a locked database pointer suitable for passing
    * to the SqliteStatement class. */
-  folly::Synchronized<sqlite3*>::LockedPtr lock();
+  LockedPtr lock();
 
  private:
-  folly::Synchronized<sqlite3*> db_{nullptr};
+  SynchronizedHandle db_{nullptr};
 };
 
 /** Represents the sqlite vm that will execute a SQL statement.
@@ -63,7 +82,7 @@ class SqliteStatement {
  public:
   /** Prepare to execute the statement described by the `query` parameter */
   SqliteStatement(
-      folly::Synchronized<sqlite3*>::LockedPtr& db,
+      SqliteDatabase::LockedPtr& db,
       folly::StringPiece query);
 
   /** Join together the arguments as a single query string and prepare a
@@ -74,7 +93,7 @@ class SqliteStatement {
    * cases where the query string is known at compile time. */
   template <typename Arg1, typename Arg2, typename... Args>
   SqliteStatement(
-      folly::Synchronized<sqlite3*>::LockedPtr& db,
+      SqliteDatabase::LockedPtr& db,
       Arg1&& first,
       Arg2&& second,
       Args&&... args)
@@ -95,6 +114,12 @@ class SqliteStatement {
    */
   bool step();
 
+  /** Reset the statement so that it can be executed again, and clear any
+   * bound parameters.  This allows a prepared statement to be cached and
+   * re-used rather than re-compiling the query each time.
+   */
+  void reset();
+
   /** Bind a stringy parameter to a prepared statement placeholder.
    * Parameters are 1-based, with the first parameter having paramNo==1.
    * Throws an exception on error.
@@ -129,6 +154,11 @@ class SqliteStatement {
    * */
   folly::StringPiece columnBlob(size_t colNo) const;
 
+  /** Return an integer column in the current row returned by the statement.
+   * This is only valid to call once `step()` has returned true.
+   * */
+  int64_t columnInt64(size_t colNo) const;
+
   ~SqliteStatement();
 
  private:
@@ -0,0 +1,233 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/AccessProfile.h"
+
+#include <folly/Synchronized.h>
+#include <folly/Varint.h>
+#include <folly/futures/Future.h>
+#include <folly/logging/xlog.h>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/LocalStore.h"
+#include "eden/fs/store/ObjectStore.h"
+
+using folly::ByteRange;
+using folly::Future;
+using folly::StringPiece;
+using folly::Unit;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace facebook {
+namespace eden {
+
+constexpr StringPiece AccessProfile::kMagic;
+constexpr uint8_t AccessProfile::kVersion;
+
+namespace {
+/** The most blobs requested from the ObjectStore at once. */
+constexpr size_t kBlobBatchSize = 20480;
+
+void appendVarint(string& out, uint64_t value) {
+  uint8_t buf[folly::kMaxVarintLength64];
+  auto size = folly::encodeVarint(value, buf);
+  out.append(reinterpret_cast<const char*>(buf), size);
+}
+
+uint64_t readVarint(ByteRange& data) {
+  // decodeVarint() throws std::invalid_argument if the varint is truncated.
+  return folly::decodeVarint(data);
+}
+
+size_t sharedPrefixLength(StringPiece a, StringPiece b) {
+  size_t length = 0;
+  const auto limit = std::min(a.size(), b.size());
+  while (length < limit && a[length] == b[length]) {
+    ++length;
+  }
+  return length;
+}
+
+class ProfilePrefetcher {
+ public:
+  ProfilePrefetcher(
+      ObjectStore* store,
+      shared_ptr<const AccessProfile> profile,
+      folly::Executor* executor)
+      : store_(store), profile_(std::move(profile)), executor_(executor) {}
+
+  /**
+   * Queue the blobs of the given paths, which are relative to tree, and load
+   * the subtrees leading to the rest of them.  An empty path refers to tree
+   * itself.
+   */
+  static Future<Unit> walk(
+      shared_ptr<ProfilePrefetcher> self,
+      const Tree& tree,
+      const vector<RelativePathPiece>& paths);
+
+  const AccessProfile& getProfile() const {
+    return *profile_;
+  }
+
+  Future<size_t> prefetchBlobs();
+
+ private:
+  ObjectStore* const store_;
+  const shared_ptr<const AccessProfile> profile_;
+  folly::Executor* const executor_;
+  folly::Synchronized<vector<Hash>> blobs_;
+};
+
+Future<Unit> ProfilePrefetcher::walk(
+    shared_ptr<ProfilePrefetcher> self,
+    const Tree& tree,
+    const vector<RelativePathPiece>& paths) {
+  // Group the paths by the child of tree that they are under.  Each value
+  // holds the paths relative to that child.
+  std::map<PathComponentPiece, vector<RelativePathPiece>> children;
+  for (auto path : paths) {
+    auto str = path.stringPiece();
+    if (str.empty()) {
+      continue;
+    }
+    auto slash = str.find('/');
+    auto& rest = children[PathComponentPiece{
+        str.subpiece(0, slash), detail::SkipPathSanityCheck()}];
+    if (slash == StringPiece::npos) {
+      rest.emplace_back();
+    } else {
+      rest.emplace_back(
+          str.subpiece(slash + 1), detail::SkipPathSanityCheck());
+    }
+  }
+
+  vector<Future<Unit>> futures;
+  for (auto& child : children) {
+    const auto* entry = tree.getEntryPtr(child.first);
+    if (!entry) {
+      continue;
+    }
+    if (!entry->isTree()) {
+      const auto& rest = child.second;
+      if (std::any_of(rest.begin(), rest.end(), [](RelativePathPiece path) {
+            return path.empty();
+          })) {
+        self->blobs_.wlock()->push_back(entry->getHash());
+      }
+      continue;
+    }
+
+    auto future = self->store_->getTree(entry->getHash());
+    if (self->executor_ && !future.isReady()) {
+      future = std::move(future).via(self->executor_);
+    }
+    futures.push_back(std::move(future).thenValue(
+        [self, subpaths = std::move(child.second)](
+            shared_ptr<const Tree> subtree) {
+          return walk(self, *subtree, subpaths);
+        }));
+  }
+  return folly::collect(futures).unit();
+}
+
+Future<size_t> ProfilePrefetcher::prefetchBlobs() {
+  auto blobs = blobs_.wlock();
+  vector<Future<Unit>> futures;
+  for (size_t begin = 0; begin < blobs->size(); begin += kBlobBatchSize) {
+    auto end = std::min(begin + kBlobBatchSize, blobs->size());
+    futures.push_back(store_->prefetchBlobs(
+        vector<Hash>{blobs->begin() + begin, blobs->begin() + end}));
+  }
+  return folly::collect(futures).thenValue(
+      [numBlobs = blobs->size()](auto&&) { return numBlobs; });
+}
+} // namespace
+
+string AccessProfile::serialize() const {
+  string out;
+  out.append(kMagic.data(), kMagic.size());
+  out.push_back(static_cast<char>(kVersion));
+  appendVarint(out, paths_.size());
+
+  StringPiece previous;
+  for (const auto& path : paths_) {
+    auto str = path.stringPiece();
+    auto shared = sharedPrefixLength(previous, str);
+    appendVarint(out, shared);
+    appendVarint(out, str.size() - shared);
+    out.append(str.data() + shared, str.size() - shared);
+    previous = str;
+  }
+  return out;
+}
+
+AccessProfile AccessProfile::parse(ByteRange data) {
+  if (!StringPiece{data}.startsWith(kMagic) ||
+      data.size() < kMagic.size() + 1) {
+    throw std::invalid_argument("not an access profile");
+  }
+  if (data[kMagic.size()] != kVersion) {
+    throw std::invalid_argument("unsupported access profile version");
+  }
+  data.advance(kMagic.size() + 1);
+
+  AccessProfile profile;
+  auto count = readVarint(data);
+  string path;
+  for (uint64_t n = 0; n < count; ++n) {
+    auto shared = readVarint(data);
+    auto restSize = readVarint(data);
+    if (shared > path.size() || restSize > data.size()) {
+      throw std::invalid_argument("truncated access profile");
+    }
+    path.resize(shared);
+    path.append(reinterpret_cast<const char*>(data.data()), restSize);
+    data.advance(restSize);
+    try {
+      profile.paths_.emplace_hint(profile.paths_.end(), path);
+    } catch (const std::domain_error&) {
+      throw std::invalid_argument("invalid path in access profile");
+    }
+  }
+  if (!data.empty()) {
+    throw std::invalid_argument("trailing data in access profile");
+  }
+  return profile;
+}
+
+Future<size_t> prefetchAccessProfile(
+    ObjectStore* store,
+    shared_ptr<const Tree> rootTree,
+    shared_ptr<const AccessProfile> profile,
+    folly::Executor* executor) {
+  LocalStore::ScanScope scan;
+  auto prefetcher =
+      std::make_shared<ProfilePrefetcher>(store, std::move(profile), executor);
+  vector<RelativePathPiece> paths;
+  paths.reserve(prefetcher->getProfile().size());
+  for (const auto& path : prefetcher->getProfile().getPaths()) {
+    paths.push_back(path);
+  }
+  XLOG(DBG3) << "prefetching the " << paths.size()
+             << " paths of an access profile";
+  return ProfilePrefetcher::walk(prefetcher, *rootTree, paths)
+      .thenValue([prefetcher, rootTree](auto&&) {
+        return prefetcher->prefetchBlobs();
+      });
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <memory>
+#include <set>
+#include <string>
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace folly {
+class Executor;
+template <typename T>
+class Future;
+} // namespace folly
+
+namespace facebook {
+namespace eden {
+
+class ObjectStore;
+class Tree;
+
+/**
+ * The paths of the files that were opened in a mount while it was being
+ * recorded, e.g. during one build of one target.
+ *
+ * A profile names neither the mount nor the commit it was recorded in, since
+ * the files a build touches change little from one commit to the next.
+ * Replaying it with prefetchAccessProfile() fetches whichever of the files
+ * exist in the commit that is checked out when it is replayed.
+ *
+ * The serialized format is:
+ * - magic (4 bytes, "EDAP")
+ * - format version (1 byte)
+ * - path count (varint)
+ * - for each path, in sorted order:
+ *   - the length of the prefix it shares with the previous path (varint)
+ *   - the length of the rest of the path (varint)
+ *   - the rest of the path
+ *
+ * Paths in a tree share long prefixes, so this is much smaller than a list
+ * of the full paths.
+ */
+class AccessProfile {
+ public:
+  /**
+   * Add a path, returning false if it was already in the profile.
+   */
+  bool add(RelativePathPiece path) {
+    return paths_.emplace(path).second;
+  }
+
+  const std::set<RelativePath>& getPaths() const {
+    return paths_;
+  }
+
+  size_t size() const {
+    return paths_.size();
+  }
+
+  std::string serialize() const;
+
+  /**
+   * Parse a serialized profile.
+   *
+   * Throws std::invalid_argument if the data is not a valid profile.
+   */
+  static AccessProfile parse(folly::ByteRange data);
+
+ private:
+  static constexpr folly::StringPiece kMagic{"EDAP"};
+  static constexpr uint8_t kVersion = 1;
+
+  std::set<RelativePath> paths_;
+};
+
+/**
+ * Fetch the trees leading to the files of an access profile, starting from
+ * rootTree, then the blobs of those files that exist.  Paths that do not
+ * exist under rootTree, or that are not files there, are skipped.
+ *
+ * The trees of each level are fetched together, and the blobs are fetched
+ * in batches with ObjectStore::prefetchBlobs() once all the trees are
+ * loaded.  If an executor is given, the walk continues on it after each tree
+ * load that could not complete immediately.
+ *
+ * Returns the number of files whose blobs were requested.  The caller is
+ * responsible for ensuring that the ObjectStore remains valid until the
+ * returned Future completes.
+ */
+folly::Future<size_t> prefetchAccessProfile(
+    ObjectStore* store,
+    std::shared_ptr<const Tree> rootTree,
+    std::shared_ptr<const AccessProfile> profile,
+    folly::Executor* executor = nullptr);
+
+} // namespace eden
+} // namespace facebook
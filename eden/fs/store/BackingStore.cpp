@@ -19,5 +19,10 @@ folly::Future<std::unique_ptr<Blob>> BackingStore::verifyEmptyBlob(
   return folly::makeFuture(nullptr);
 }
 
+folly::Future<folly::Optional<BlobMetadata>> BackingStore::getBlobMetadata(
+    const Hash&) {
+  return folly::makeFuture<folly::Optional<BlobMetadata>>(folly::none);
+}
+
 } // namespace eden
 } // namespace facebook
@@ -9,8 +9,13 @@
  */
 #pragma once
 
+#include <folly/Optional.h>
 #include <folly/futures/Future.h>
 #include <memory>
+#include <string>
+#include <vector>
+#include "eden/fs/store/BlobMetadata.h"
+#include "eden/fs/store/ImportPriority.h"
 
 namespace folly {
 template <typename T>
@@ -21,7 +26,6 @@ namespace facebook {
 namespace eden {
 
 class Blob;
-class Hash;
 class Tree;
 
 /**
@@ -38,8 +42,19 @@ class BackingStore {
   BackingStore() {}
   virtual ~BackingStore() {}
 
-  virtual folly::Future<std::unique_ptr<Tree>> getTree(const Hash& id) = 0;
-  virtual folly::Future<std::unique_ptr<Blob>> getBlob(const Hash& id) = 0;
+  /**
+   * Get a Tree or Blob by ID.
+   *
+   * The priority indicates how urgently the caller needs the object.
+   * Implementations that queue imports should serve more urgent requests
+   * first; others may ignore it.
+   */
+  virtual folly::Future<std::unique_ptr<Tree>> getTree(
+      const Hash& id,
+      ImportPriority priority) = 0;
+  virtual folly::Future<std::unique_ptr<Blob>> getBlob(
+      const Hash& id,
+      ImportPriority priority) = 0;
   virtual folly::Future<std::unique_ptr<Tree>> getTreeForCommit(
       const Hash& commitID) = 0;
   FOLLY_NODISCARD virtual folly::Future<folly::Unit> prefetchBlobs(
@@ -47,6 +62,35 @@ class BackingStore {
     return folly::unit;
   }
 
+  /**
+   * Fetch a tree along with its subtrees down to depth levels below it, and
+   * store them in the LocalStore, in anticipation of them being needed soon.
+   * A depth of 0 fetches just the tree itself.
+   *
+   * This is a hint: stores that cannot fetch several levels of a tree more
+   * cheaply than one getTree() call per tree may do nothing at all, which is
+   * what the default implementation does.
+   */
+  FOLLY_NODISCARD virtual folly::Future<folly::Unit> prefetchTree(
+      const Hash& /* id */,
+      size_t /* depth */) const {
+    return folly::unit;
+  }
+
+  /**
+   * Resolve each revision name, such as a bookmark, to the commit it
+   * currently refers to, and import that commit's root tree, so that the
+   * first getTreeForCommit() call for it does not have to wait.
+   *
+   * Revisions that cannot be resolved are skipped.  Stores that have no
+   * notion of revision names do nothing, which is what the default
+   * implementation does.
+   */
+  FOLLY_NODISCARD virtual folly::Future<folly::Unit> prefetchCommitTrees(
+      const std::vector<std::string>& /* revisions */) {
+    return folly::unit;
+  }
+
   /**
    * Attempt to re-verify the contents of a previously imported blob that was
    * recorded as empty.  This is unfortunately necessary at the moment since
@@ -58,6 +102,25 @@ class BackingStore {
    */
   virtual folly::Future<std::unique_ptr<Blob>> verifyEmptyBlob(const Hash& id);
 
+  /**
+   * Get the size and SHA-1 of a blob's contents without fetching the
+   * contents, if the underlying store can provide them cheaply.
+   *
+   * Returns folly::none if the metadata is not available this way, in which
+   * case the caller must fetch the blob itself.  The default implementation
+   * always returns folly::none.
+   */
+  virtual folly::Future<folly::Optional<BlobMetadata>> getBlobMetadata(
+      const Hash& id);
+
+  /**
+   * Add the stats recorded since the last call to ServiceData.
+   *
+   * EdenServer calls this periodically for every BackingStore.  Stores that
+   * keep no stats of their own need not override it.
+   */
+  virtual void aggregateStats() {}
+
  private:
   // Forbidden copy constructor and assignment operator
   BackingStore(BackingStore const&) = delete;
@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/BlobCache.h"
+
+#include <folly/Conv.h>
+#include <folly/experimental/logging/xlog.h>
+#include <folly/stop_watch.h>
+#include <stdexcept>
+
+using folly::StringPiece;
+using folly::io::CodecType;
+using std::string;
+
+namespace facebook {
+namespace eden {
+
+CodecType BlobCache::parseCodecType(StringPiece name) {
+  if (name == "none") {
+    return CodecType::NO_COMPRESSION;
+  } else if (name == "lz4") {
+    return CodecType::LZ4;
+  } else if (name == "zstd") {
+    return CodecType::ZSTD;
+  }
+  throw std::invalid_argument(folly::to<string>(
+      "unsupported blob cache compression type: \"",
+      name,
+      "\"; expected one of none, lz4 or zstd"));
+}
+
+BlobCache::BlobCache(
+    size_t maximumCacheSizeBytes,
+    CompressionOptions compression,
+    size_t numShards)
+    : compression_{compression}, cache_{maximumCacheSizeBytes, numShards} {}
+
+folly::io::Codec* BlobCache::getCodec() {
+  auto& codec = *codecs_;
+  if (!codec) {
+    codec = folly::io::getCodec(compression_.codecType);
+  }
+  return codec.get();
+}
+
+BlobCache::ObjectPtr BlobCache::get(const Hash& id) {
+  auto entry = cache_.get(id);
+  if (!entry) {
+    return nullptr;
+  }
+  if (entry->blob) {
+    return entry->blob;
+  }
+
+  folly::stop_watch<std::chrono::microseconds> timer;
+  std::unique_ptr<folly::IOBuf> contents;
+  try {
+    contents = getCodec()->uncompress(
+        entry->compressed.get(), entry->uncompressedSize);
+  } catch (const std::exception& ex) {
+    // Treat it as a miss; the caller falls back to the LocalStore.
+    XLOG(ERR) << "failed to decompress cached blob " << id << ": "
+              << folly::exceptionStr(ex);
+    return nullptr;
+  }
+  ++compressedHitCount_;
+  decompressTimeUs_ += timer.elapsed().count();
+  return std::make_shared<Blob>(id, std::move(*contents));
+}
+
+void BlobCache::insert(ObjectPtr blob) {
+  const auto size = blob->getContents().computeChainDataLength();
+  if (compression_.codecType == CodecType::NO_COMPRESSION ||
+      size < compression_.minSize || size > compression_.maxSize) {
+    cache_.insert(std::make_shared<Entry>(std::move(blob)));
+    return;
+  }
+
+  std::unique_ptr<folly::IOBuf> compressed;
+  try {
+    compressed = getCodec()->compress(&blob->getContents());
+  } catch (const std::exception& ex) {
+    XLOG(WARN) << "failed to compress blob " << blob->getHash()
+               << " for the blob cache: " << folly::exceptionStr(ex);
+  }
+  const auto compressedSize =
+      compressed ? compressed->computeChainDataLength() : size;
+  if (compressedSize >= size) {
+    cache_.insert(std::make_shared<Entry>(std::move(blob)));
+    return;
+  }
+
+  // Codecs allocate room for the worst case, so copy the output into a
+  // buffer of exactly its size before holding on to it.
+  auto range = compressed->coalesce();
+  compressed = folly::IOBuf::copyBuffer(range.data(), range.size());
+  ++compressedInsertCount_;
+  compressionSavedBytes_ += size - compressedSize;
+  cache_.insert(
+      std::make_shared<Entry>(blob->getHash(), std::move(compressed), size));
+}
+
+BlobCache::Stats BlobCache::getStats() const {
+  Stats stats;
+  auto cacheStats = cache_.getStats();
+  stats.hitCount = cacheStats.hitCount;
+  stats.missCount = cacheStats.missCount;
+  stats.evictionCount = cacheStats.evictionCount;
+  stats.objectCount = cacheStats.objectCount;
+  stats.totalSizeBytes = cacheStats.totalSizeBytes;
+  stats.compressedHitCount = compressedHitCount_.load();
+  stats.decompressTimeUs = decompressTimeUs_.load();
+  stats.compressedInsertCount = compressedInsertCount_.load();
+  stats.compressionSavedBytes = compressionSavedBytes_.load();
+  return stats;
+}
+
+} // namespace eden
+} // namespace facebook
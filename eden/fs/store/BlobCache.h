@@ -0,0 +1,143 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/ThreadLocal.h>
+#include <folly/compression/Compression.h>
+#include <atomic>
+#include <memory>
+#include "eden/fs/model/Blob.h"
+#include "eden/fs/store/ObjectCache.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * BlobCache is the ObjectStore's in-memory cache of recently used Blobs.
+ *
+ * It can optionally keep blobs within a range of sizes compressed.  Most
+ * source files are small text files that compress several times over, so
+ * storing them compressed fits a larger working set into the same memory
+ * budget, at the cost of decompressing them into a fresh Blob on each hit.
+ * Blobs outside the range, and blobs that do not get smaller when
+ * compressed, are kept as they are.
+ *
+ * The size budget counts the compressed size of compressed entries.
+ *
+ * BlobCache is thread-safe.
+ */
+class BlobCache {
+ public:
+  using ObjectPtr = std::shared_ptr<const Blob>;
+
+  struct CompressionOptions {
+    /** NO_COMPRESSION keeps every blob uncompressed. */
+    folly::io::CodecType codecType{folly::io::CodecType::NO_COMPRESSION};
+    /** The smallest blob to compress, in bytes. */
+    size_t minSize{256};
+    /** The largest blob to compress, in bytes. */
+    size_t maxSize{256 * 1024};
+  };
+
+  struct Stats {
+    uint64_t hitCount{0};
+    uint64_t missCount{0};
+    uint64_t evictionCount{0};
+    uint64_t objectCount{0};
+    uint64_t totalSizeBytes{0};
+    /** Hits on entries that had to be decompressed. */
+    uint64_t compressedHitCount{0};
+    /** Total time spent decompressing entries, in microseconds. */
+    uint64_t decompressTimeUs{0};
+    /** Number of blobs that were stored compressed when inserted. */
+    uint64_t compressedInsertCount{0};
+    /** Bytes saved by compressing those blobs, measured at insert time. */
+    uint64_t compressionSavedBytes{0};
+  };
+
+  /**
+   * Parse the name of a blob cache codec: one of "none", "lz4" or "zstd".
+   *
+   * Throws std::invalid_argument for any other name.
+   */
+  static folly::io::CodecType parseCodecType(folly::StringPiece name);
+
+  explicit BlobCache(
+      size_t maximumCacheSizeBytes,
+      CompressionOptions compression = CompressionOptions{},
+      size_t numShards = ObjectCache<Blob>::kDefaultNumShards);
+
+  BlobCache(const BlobCache&) = delete;
+  BlobCache& operator=(const BlobCache&) = delete;
+
+  /**
+   * Look up a blob by ID.
+   *
+   * Returns nullptr if the blob is not present in the cache, or if it was
+   * stored compressed and can no longer be decompressed.
+   */
+  ObjectPtr get(const Hash& id);
+
+  /**
+   * Insert a blob, compressing it first if compression is enabled and the
+   * blob's size is within the configured range.
+   */
+  void insert(ObjectPtr blob);
+
+  /**
+   * Remove all blobs from the cache.
+   */
+  void clear() {
+    cache_.clear();
+  }
+
+  Stats getStats() const;
+
+ private:
+  /**
+   * One cache entry: either an uncompressed Blob, or the compressed
+   * contents of one.
+   */
+  struct Entry {
+    explicit Entry(ObjectPtr b) : hash{b->getHash()}, blob{std::move(b)} {}
+    Entry(const Hash& h, std::unique_ptr<folly::IOBuf> c, uint64_t size)
+        : hash{h}, compressed{std::move(c)}, uncompressedSize{size} {}
+
+    const Hash& getHash() const {
+      return hash;
+    }
+
+    size_t getSizeBytes() const {
+      return blob ? blob->getSizeBytes()
+                  : sizeof(Entry) + compressed->computeChainDataLength();
+    }
+
+    const Hash hash;
+    const ObjectPtr blob;
+    const std::unique_ptr<folly::IOBuf> compressed;
+    const uint64_t uncompressedSize{0};
+  };
+
+  folly::io::Codec* getCodec();
+
+  const CompressionOptions compression_;
+  ObjectCache<Entry> cache_;
+  /** Codecs keep per-stream state, so each thread uses its own. */
+  folly::ThreadLocal<std::unique_ptr<folly::io::Codec>> codecs_;
+
+  std::atomic<uint64_t> compressedHitCount_{0};
+  std::atomic<uint64_t> decompressTimeUs_{0};
+  std::atomic<uint64_t> compressedInsertCount_{0};
+  std::atomic<uint64_t> compressionSavedBytes_{0};
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,326 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/CachingBackingStore.h"
+
+#include <folly/Conv.h>
+#include <folly/Executor.h>
+#include <folly/Synchronized.h>
+#include <folly/futures/Future.h>
+#include <folly/futures/Promise.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <folly/logging/xlog.h>
+#include <algorithm>
+#include "eden/fs/model/Blob.h"
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/model/git/GitTree.h"
+#include "eden/fs/store/LocalStore.h"
+#include "eden/fs/store/RemoteObjectCache.h"
+#include "eden/fs/store/StoreResult.h"
+#include "eden/fs/store/TreeView.h"
+
+using folly::Future;
+using folly::IOBuf;
+using folly::makeFuture;
+using folly::Optional;
+using folly::StringPiece;
+using folly::Unit;
+using std::string;
+using std::unique_ptr;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+string toString(const IOBuf& buf) {
+  folly::io::Cursor cursor(&buf);
+  return cursor.readFixedString(buf.computeChainDataLength());
+}
+
+unique_ptr<Tree> parseTree(const Hash& id, string&& data) {
+  if (TreeView::isSerializedTree(StringPiece{data})) {
+    return TreeView{id, StoreResult{std::move(data)}}.toTree();
+  }
+  return deserializeGitTree(id, StringPiece{data});
+}
+} // namespace
+
+/**
+ * Collects the lookups made while a batch is waiting to be sent, so that
+ * they can share one multiGet().
+ *
+ * The first lookup added to an empty queue schedules the batch to be sent
+ * on the executor, and lookups made before then join it.  A batch that
+ * reaches maxBatchSize is sent right away.
+ */
+class CachingBackingStore::LookupQueue
+    : public std::enable_shared_from_this<LookupQueue> {
+ public:
+  LookupQueue(
+      std::shared_ptr<RemoteObjectCache> cache,
+      folly::Executor* executor,
+      size_t maxBatchSize)
+      : cache_{std::move(cache)},
+        executor_{executor},
+        maxBatchSize_{std::max<size_t>(maxBatchSize, 1)} {}
+
+  /**
+   * Look up key in the cache.  The returned Future never fails; errors
+   * from the cache are reported as misses.
+   */
+  Future<Optional<string>> lookup(string key) {
+    folly::Promise<Optional<string>> promise;
+    auto future = promise.getFuture();
+    std::vector<Lookup> batch;
+    bool scheduleSend = false;
+    {
+      auto pending = pending_.wlock();
+      pending->push_back(Lookup{std::move(key), std::move(promise)});
+      if (pending->size() >= maxBatchSize_) {
+        batch.swap(*pending);
+      } else {
+        scheduleSend = pending->size() == 1;
+      }
+    }
+
+    if (!batch.empty()) {
+      send(std::move(batch));
+    } else if (scheduleSend) {
+      executor_->add([self = shared_from_this()] { self->sendPending(); });
+    }
+    return future;
+  }
+
+ private:
+  struct Lookup {
+    string key;
+    folly::Promise<Optional<string>> promise;
+  };
+
+  void sendPending() {
+    std::vector<Lookup> batch;
+    pending_.wlock()->swap(batch);
+    if (!batch.empty()) {
+      send(std::move(batch));
+    }
+  }
+
+  void send(std::vector<Lookup> batch) {
+    std::vector<string> keys;
+    keys.reserve(batch.size());
+    for (const auto& lookup : batch) {
+      keys.push_back(lookup.key);
+    }
+    folly::makeFutureWith([&] { return cache_->multiGet(keys); })
+        .then([batch = std::move(batch)](
+                  folly::Try<std::vector<Optional<string>>>&& result) mutable {
+          if (result.hasException()) {
+            XLOG(WARN) << "error looking up " << batch.size()
+                       << " objects in the remote cache: "
+                       << result.exception().what();
+          }
+          for (size_t n = 0; n < batch.size(); ++n) {
+            Optional<string> value;
+            if (result.hasValue() && n < result.value().size()) {
+              value = std::move(result.value()[n]);
+            }
+            batch[n].promise.setValue(std::move(value));
+          }
+        });
+  }
+
+  const std::shared_ptr<RemoteObjectCache> cache_;
+  folly::Executor* const executor_;
+  const size_t maxBatchSize_;
+  folly::Synchronized<std::vector<Lookup>> pending_;
+};
+
+CachingBackingStore::CachingBackingStore(
+    std::shared_ptr<BackingStore> backingStore,
+    std::shared_ptr<RemoteObjectCache> cache,
+    LocalStore* localStore,
+    folly::Executor* executor,
+    StringPiece keyPrefix,
+    bool cacheTrees,
+    size_t maxBatchSize)
+    : backingStore_{std::move(backingStore)},
+      cache_{cache},
+      localStore_{localStore},
+      keyPrefix_{keyPrefix.str()},
+      cacheTrees_{cacheTrees},
+      lookups_{std::make_shared<LookupQueue>(
+          std::move(cache),
+          executor,
+          maxBatchSize)} {}
+
+CachingBackingStore::~CachingBackingStore() {}
+
+string CachingBackingStore::getKey(StringPiece kind, const Hash& id) const {
+  return folly::to<string>(keyPrefix_, ":", kind, ":", id.toString());
+}
+
+Future<unique_ptr<Tree>> CachingBackingStore::getTree(
+    const Hash& id,
+    ImportPriority priority) {
+  if (!cacheTrees_) {
+    return backingStore_->getTree(id, priority);
+  }
+
+  auto key = getKey("tree", id);
+  return lookups_->lookup(key).then(
+      [this, id, priority, key](
+          Optional<string>&& value) -> Future<unique_ptr<Tree>> {
+        if (value) {
+          try {
+            auto tree = parseTree(id, std::move(value).value());
+            localStore_->putTree(tree.get());
+            return std::move(tree);
+          } catch (const std::exception& ex) {
+            XLOG(WARN) << "ignoring corrupt tree " << id
+                       << " from the remote cache: " << ex.what();
+          }
+        }
+        return backingStore_->getTree(id, priority)
+            .then([this, key](unique_ptr<Tree> tree) {
+              if (tree) {
+                auto serialized = LocalStore::serializeTree(tree.get());
+                writeBack({{key, toString(serialized.second)}});
+              }
+              return tree;
+            });
+      });
+}
+
+Future<unique_ptr<Blob>> CachingBackingStore::getBlob(
+    const Hash& id,
+    ImportPriority priority) {
+  auto key = getKey("blob", id);
+  return lookups_->lookup(key).then(
+      [this, id, priority, key](
+          Optional<string>&& value) -> Future<unique_ptr<Blob>> {
+        if (value) {
+          auto contents = IOBuf::fromString(std::move(value).value());
+          return std::make_unique<Blob>(id, std::move(*contents));
+        }
+        return backingStore_->getBlob(id, priority)
+            .then([this, key](unique_ptr<Blob> blob) {
+              if (blob) {
+                writeBack({{key, toString(blob->getContents())}});
+              }
+              return blob;
+            });
+      });
+}
+
+Future<unique_ptr<Tree>> CachingBackingStore::getTreeForCommit(
+    const Hash& commitID) {
+  return backingStore_->getTreeForCommit(commitID);
+}
+
+Future<Unit> CachingBackingStore::prefetchBlobs(
+    const std::vector<Hash>& ids) const {
+  if (ids.empty()) {
+    return folly::unit;
+  }
+  std::vector<Future<Optional<string>>> lookups;
+  lookups.reserve(ids.size());
+  for (const auto& id : ids) {
+    lookups.push_back(lookups_->lookup(getKey("blob", id)));
+  }
+
+  return folly::collect(lookups).then(
+      [this, ids](std::vector<Optional<string>>&& values) -> Future<Unit> {
+        std::vector<Hash> missing;
+        std::vector<Blob> found;
+        found.reserve(ids.size());
+        for (size_t n = 0; n < ids.size(); ++n) {
+          if (values[n]) {
+            auto contents = IOBuf::fromString(std::move(values[n]).value());
+            found.emplace_back(ids[n], std::move(*contents));
+          } else {
+            missing.push_back(ids[n]);
+          }
+        }
+        if (!found.empty()) {
+          std::vector<const Blob*> blobs;
+          blobs.reserve(found.size());
+          for (const auto& blob : found) {
+            blobs.push_back(&blob);
+          }
+          auto batch = localStore_->beginWrite();
+          batch->putBlobs(blobs);
+          batch->flush();
+        }
+        if (missing.empty()) {
+          return folly::unit;
+        }
+
+        // The wrapped store only leaves what it fetched in the LocalStore,
+        // so read it back from there to write it to the cache.
+        return backingStore_->prefetchBlobs(missing).then([this, missing] {
+          std::vector<Future<unique_ptr<Blob>>> blobs;
+          blobs.reserve(missing.size());
+          for (const auto& id : missing) {
+            blobs.push_back(localStore_->getBlob(id));
+          }
+          return folly::collectAll(blobs).then(
+              [this,
+               missing](std::vector<folly::Try<unique_ptr<Blob>>>&& results) {
+                std::vector<std::pair<string, string>> entries;
+                for (size_t n = 0; n < missing.size(); ++n) {
+                  if (results[n].hasValue() && results[n].value()) {
+                    entries.emplace_back(
+                        getKey("blob", missing[n]),
+                        toString(results[n].value()->getContents()));
+                  }
+                }
+                writeBack(std::move(entries));
+              });
+        });
+      });
+}
+
+Future<Unit> CachingBackingStore::prefetchTree(const Hash& id, size_t depth)
+    const {
+  return backingStore_->prefetchTree(id, depth);
+}
+
+Future<Unit> CachingBackingStore::prefetchCommitTrees(
+    const std::vector<string>& revisions) {
+  return backingStore_->prefetchCommitTrees(revisions);
+}
+
+Future<unique_ptr<Blob>> CachingBackingStore::verifyEmptyBlob(
+    const Hash& id) {
+  return backingStore_->verifyEmptyBlob(id);
+}
+
+Future<Optional<BlobMetadata>> CachingBackingStore::getBlobMetadata(
+    const Hash& id) {
+  return backingStore_->getBlobMetadata(id);
+}
+
+void CachingBackingStore::aggregateStats() {
+  backingStore_->aggregateStats();
+}
+
+void CachingBackingStore::writeBack(
+    std::vector<std::pair<string, string>> entries) const {
+  if (entries.empty()) {
+    return;
+  }
+  folly::makeFutureWith([&] { return cache_->multiPut(std::move(entries)); })
+      .onError([](const std::exception& ex) {
+        XLOG(WARN) << "error writing to the remote cache: " << ex.what();
+      });
+}
+
+} // namespace eden
+} // namespace facebook
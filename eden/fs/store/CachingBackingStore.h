@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <memory>
+#include <string>
+#include "eden/fs/store/BackingStore.h"
+
+namespace folly {
+class Executor;
+} // namespace folly
+
+namespace facebook {
+namespace eden {
+
+class LocalStore;
+class RemoteObjectCache;
+
+/**
+ * A BackingStore that fronts another one with a RemoteObjectCache, so that
+ * a fleet of machines checking out the same commits fetches each object
+ * from the origin only once.
+ *
+ * Lookups that arrive while an earlier one is waiting to be sent are
+ * batched into a single multiGet().  Objects that miss in the cache are
+ * fetched from the wrapped BackingStore and then written back to the cache.
+ *
+ * Blobs are always cached.  Trees are only cached when cacheTrees is set:
+ * some BackingStores, such as the HgBackingStore, record data in the
+ * LocalStore as they import a tree that they need to fetch its children
+ * later, and a tree from the cache would not have it.
+ *
+ * Trees and blobs found in the cache are stored in the LocalStore, as the
+ * wrapped BackingStore would have done.
+ */
+class CachingBackingStore : public BackingStore {
+ public:
+  static constexpr size_t kDefaultMaxBatchSize = 256;
+
+  /**
+   * keyPrefix is prepended to the cache keys of every object, so that
+   * repositories sharing a cache cannot see each other's objects.  Batches
+   * of lookups are sent from executor.
+   */
+  CachingBackingStore(
+      std::shared_ptr<BackingStore> backingStore,
+      std::shared_ptr<RemoteObjectCache> cache,
+      LocalStore* localStore,
+      folly::Executor* executor,
+      folly::StringPiece keyPrefix,
+      bool cacheTrees,
+      size_t maxBatchSize = kDefaultMaxBatchSize);
+  ~CachingBackingStore() override;
+
+  folly::Future<std::unique_ptr<Tree>> getTree(
+      const Hash& id,
+      ImportPriority priority) override;
+  folly::Future<std::unique_ptr<Blob>> getBlob(
+      const Hash& id,
+      ImportPriority priority) override;
+  folly::Future<std::unique_ptr<Tree>> getTreeForCommit(
+      const Hash& commitID) override;
+  FOLLY_NODISCARD folly::Future<folly::Unit> prefetchBlobs(
+      const std::vector<Hash>& ids) const override;
+  FOLLY_NODISCARD folly::Future<folly::Unit> prefetchTree(
+      const Hash& id,
+      size_t depth) const override;
+  FOLLY_NODISCARD folly::Future<folly::Unit> prefetchCommitTrees(
+      const std::vector<std::string>& revisions) override;
+  folly::Future<std::unique_ptr<Blob>> verifyEmptyBlob(
+      const Hash& id) override;
+  folly::Future<folly::Optional<BlobMetadata>> getBlobMetadata(
+      const Hash& id) override;
+  void aggregateStats() override;
+
+ private:
+  class LookupQueue;
+
+  std::string getKey(folly::StringPiece kind, const Hash& id) const;
+
+  /**
+   * Write key/value pairs back to the cache, logging rather than failing
+   * if that goes wrong.
+   */
+  void writeBack(std::vector<std::pair<std::string, std::string>> entries)
+      const;
+
+  const std::shared_ptr<BackingStore> backingStore_;
+  const std::shared_ptr<RemoteObjectCache> cache_;
+  LocalStore* const localStore_;
+  const std::string keyPrefix_;
+  const bool cacheTrees_;
+  const std::shared_ptr<LookupQueue> lookups_;
+};
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/CommitDiffCache.h"
+
+#include <folly/hash/Hash.h>
+#include <algorithm>
+#include "eden/fs/store/Diff.h"
+
+namespace facebook {
+namespace eden {
+
+constexpr size_t CommitDiffCache::kDefaultMaxEntries;
+
+CommitDiffCache::CommitDiffCache(ObjectStore* store, size_t maxEntries)
+    : store_{store}, entries_{std::max<size_t>(maxEntries, 1)} {}
+
+folly::Future<std::shared_ptr<const ScmStatus>> CommitDiffCache::getDiff(
+    Hash fromCommit,
+    Hash toCommit) {
+  Key key{fromCommit, toCommit};
+  auto diff = std::make_shared<SharedDiff>();
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      auto future = it->second->getFuture();
+      // Diffs that failed stay in the map until someone asks again, so that
+      // completing one never needs to refer back to the cache.
+      if (!future.isReady() || future.hasValue()) {
+        return future;
+      }
+    }
+    entries_.set(key, diff);
+  }
+
+  return folly::makeFutureWith(
+             [&] { return diffCommits(store_, fromCommit, toCommit); })
+      .thenTry([diff](folly::Try<ScmStatus>&& status) {
+        if (status.hasException()) {
+          diff->setException(std::move(status.exception()));
+        } else {
+          diff->setValue(
+              std::make_shared<const ScmStatus>(std::move(status.value())));
+        }
+        return diff->getFuture();
+      });
+}
+
+size_t CommitDiffCache::size() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return entries_.size();
+}
+
+void CommitDiffCache::clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  entries_.clear();
+}
+
+size_t CommitDiffCache::KeyHasher::operator()(const Key& key) const {
+  return folly::hash::hash_combine(
+      key.fromCommit.getHashCode(), key.toCommit.getHashCode());
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/container/EvictingCacheMap.h>
+#include <folly/futures/Future.h>
+#include <folly/futures/SharedPromise.h>
+#include <memory>
+#include <mutex>
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/service/gen-cpp2/eden_types.h"
+
+namespace facebook {
+namespace eden {
+
+class ObjectStore;
+
+/**
+ * CommitDiffCache remembers the files that differ between pairs of commits.
+ *
+ * The Journal records a checkout as just the commits it moved between.
+ * Journal queries that span a checkout use this cache to report the files
+ * that moving between those commits changed, so that the diff is only
+ * computed when some client actually asks for it, and only once however
+ * many clients ask.
+ *
+ * Concurrent requests for the same pair of commits share a single diff.
+ * Diffs that fail are not cached, so the next request tries again.  The
+ * cache holds a bounded number of diffs, evicting the least recently used.
+ *
+ * CommitDiffCache is thread-safe.
+ */
+class CommitDiffCache {
+ public:
+  static constexpr size_t kDefaultMaxEntries = 32;
+
+  /**
+   * The ObjectStore must remain valid for the lifetime of the cache, and
+   * until every Future it returned has completed.
+   */
+  explicit CommitDiffCache(
+      ObjectStore* store,
+      size_t maxEntries = kDefaultMaxEntries);
+
+  /**
+   * Get the files that differ between fromCommit and toCommit, as
+   * diffCommits() reports them.
+   */
+  folly::Future<std::shared_ptr<const ScmStatus>> getDiff(
+      Hash fromCommit,
+      Hash toCommit);
+
+  /**
+   * Get the number of diffs in the cache, including ones still in progress.
+   */
+  size_t size() const;
+
+  /**
+   * Forget every cached diff.  Requests already waiting on a diff in
+   * progress still get its result.
+   */
+  void clear();
+
+ private:
+  struct Key {
+    Hash fromCommit;
+    Hash toCommit;
+
+    bool operator==(const Key& other) const {
+      return fromCommit == other.fromCommit && toCommit == other.toCommit;
+    }
+  };
+  struct KeyHasher {
+    size_t operator()(const Key& key) const;
+  };
+  using SharedDiff = folly::SharedPromise<std::shared_ptr<const ScmStatus>>;
+
+  ObjectStore* const store_;
+  mutable std::mutex lock_;
+  folly::EvictingCacheMap<Key, std::shared_ptr<SharedDiff>, KeyHasher>
+      entries_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -13,12 +13,19 @@
 #include <folly/Synchronized.h>
 #include <folly/futures/Future.h>
 #include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <memory>
 #include <vector>
 
 #include "eden/fs/model/Tree.h"
 #include "eden/fs/model/TreeEntry.h"
+#include "eden/fs/store/ImportPriority.h"
+#include "eden/fs/store/LocalStore.h"
 #include "eden/fs/store/ObjectStore.h"
+#include "eden/fs/store/TreeDiffCache.h"
 #include "eden/fs/utils/PathFuncs.h"
 
 using folly::Future;
@@ -26,27 +33,174 @@ using folly::makeFuture;
 using folly::Synchronized;
 using folly::Try;
 using folly::Unit;
+using std::make_shared;
 using std::make_unique;
 using std::vector;
 
+DEFINE_int32(
+    diff_max_tree_loads,
+    64,
+    "The most tree loads that a diff between two commits keeps outstanding "
+    "at once.  Further loads wait for one of these to finish.  0 means no "
+    "limit.");
+DEFINE_int32(
+    diff_tree_prefetch_depth,
+    1,
+    "When a diff between two commits walks into a pair of directories that "
+    "differ, ask the backing store to fetch this many levels of "
+    "subdirectories below them as well, for stores that can fetch them "
+    "together.  0 disables this.");
+
 namespace facebook {
 namespace eden {
 
 namespace {
 
+/**
+ * ScmStatusCallback collects the results of a diff into a ScmStatus.
+ *
+ * Results outside of the filter are dropped, and the trees that cannot hold
+ * any are not loaded.  Once limit results have been collected the diff is
+ * cancelled, and the status is marked as truncated.
+ */
+class ScmStatusCallback : public TreeDiffCallback {
+ public:
+  ScmStatusCallback() = default;
+  ScmStatusCallback(PathPrefixFilter filter, size_t limit)
+      : filter_(std::move(filter)), limit_(limit) {}
+
+  void changedFile(RelativePathPiece path, ScmFileStatus status) override {
+    if (!filter_.matches(path)) {
+      return;
+    }
+    auto result = result_.wlock();
+    if (!reserveResult(*result)) {
+      return;
+    }
+    result->entries.emplace(path.value().str(), status);
+  }
+
+  void diffError(RelativePathPiece path, const folly::exception_wrapper& ew)
+      override {
+    if (!filter_.matches(path)) {
+      return;
+    }
+    auto result = result_.wlock();
+    if (!reserveResult(*result)) {
+      return;
+    }
+    result->errors.emplace(path.value().str(), ew.what().toStdString());
+  }
+
+  bool isCancelled() const override {
+    return limitReached_.load(std::memory_order_relaxed);
+  }
+
+  bool shouldLoadTree(RelativePathPiece path, ScmFileStatus /* status */)
+      const override {
+    return filter_.mayMatchUnder(path);
+  }
+
+  /**
+   * Extract the computed ScmStatus
+   */
+  ScmStatus extractResult() {
+    return std::move(*result_.wlock());
+  }
+
+ private:
+  /**
+   * Returns false, and marks the status as truncated, if there is no room
+   * left for another result.
+   */
+  bool reserveResult(ScmStatus& result) {
+    if (limit_ == 0) {
+      return true;
+    }
+    if (result.entries.size() + result.errors.size() >= limit_) {
+      result.truncated = true;
+      limitReached_.store(true, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  const PathPrefixFilter filter_;
+  const size_t limit_{0};
+  std::atomic<bool> limitReached_{false};
+  Synchronized<ScmStatus> result_;
+};
+
+/**
+ * PrefetchTreesCallback ignores the changed files, and limits a diff to the
+ * trees that prefetchChangedTrees() was asked to fetch.
+ */
+class PrefetchTreesCallback : public TreeDiffCallback {
+ public:
+  PrefetchTreesCallback(size_t maxDepth, vector<RelativePath> paths)
+      : maxDepth_(maxDepth), filter_(std::move(paths)) {}
+
+  void changedFile(RelativePathPiece, ScmFileStatus) override {}
+
+  void diffError(RelativePathPiece path, const folly::exception_wrapper& ew)
+      override {
+    XLOG(DBG2) << "error prefetching trees under " << path << ": "
+               << ew.what();
+  }
+
+  bool shouldLoadTree(RelativePathPiece path, ScmFileStatus status)
+      const override {
+    // Only the new commit's trees are needed by the checkout.
+    if (status == ScmFileStatus::REMOVED) {
+      return false;
+    }
+    // The root is never passed here, so path has at least one component.
+    auto str = path.stringPiece();
+    const size_t depth = 1 + std::count(str.begin(), str.end(), '/');
+    if (maxDepth_ != 0 && depth > maxDepth_) {
+      return false;
+    }
+    if (!filter_.mayMatchUnder(path)) {
+      return false;
+    }
+    numTrees_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  uint64_t getNumTrees() const {
+    return numTrees_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  const size_t maxDepth_;
+  const PathPrefixFilter filter_;
+  mutable std::atomic<uint64_t> numTrees_{0};
+};
+
 /**
  * TreeDiffer knows how to diff source control Tree objects.
  */
 class TreeDiffer {
  public:
-  explicit TreeDiffer(ObjectStore* store) : store_(store) {}
+  TreeDiffer(
+      ObjectStore* store,
+      TreeDiffCallback* callback,
+      folly::Executor* executor = nullptr,
+      ImportPriority priority = ImportPriority::Foreground,
+      TreeDiffCache* cache = nullptr)
+      : store_(store),
+        callback_(callback),
+        executor_(executor),
+        priority_(priority),
+        cache_(cache),
+        limitLoads_(executor && FLAGS_diff_max_tree_loads > 0) {
+    fetchSlots_.wlock()->available = FLAGS_diff_max_tree_loads;
+  }
 
   /**
    * Diff two commits.
    *
-   * The differences will be added to the internal ScmStatus object,
-   * which can then be extracted by calling extractResult() once the returned
-   * Future completes.
+   * The differences will be reported to the callback.
    */
   FOLLY_NODISCARD Future<Unit> diffCommits(Hash hash1, Hash hash2);
 
@@ -54,25 +208,33 @@ class TreeDiffer {
    * Diff two trees.
    *
    * The path argument specifies the path to these trees, and will be prefixed
-   * to all differences recorded in the results.
-   *
-   * The differences will be added to the internal ScmStatus object,
-   * which can then be extracted by calling extractResult() once the returned
-   * Future completes.
+   * to all differences reported to the callback.
    */
   FOLLY_NODISCARD Future<Unit>
   diffTrees(RelativePathPiece path, Hash hash1, Hash hash2);
   FOLLY_NODISCARD Future<Unit>
   diffTrees(RelativePathPiece path, const Tree& tree1, const Tree& tree2);
 
+ private:
   /**
-   * Extract the computed ScmStatus
+   * Collects the differences under one pair of trees for the TreeDiffCache,
+   * as they are reported to the callback.  The lists are only appended to
+   * while the pair's entries are compared, and read once every subtree has
+   * finished, so they need no lock.
    */
-  ScmStatus extractResult() {
-    return std::move(*result_.wlock());
-  }
+  struct ResultBuilder {
+    ResultBuilder(const Hash& tree1, const Hash& tree2)
+        : tree1{tree1}, tree2{tree2} {}
+
+    const Hash tree1;
+    const Hash tree2;
+    vector<std::pair<PathComponent, ScmFileStatus>> files;
+    vector<std::pair<PathComponent, std::shared_ptr<ResultBuilder>>> trees;
+    /** Set once every difference under the pair is known. */
+    std::shared_ptr<const TreeDiffResult> result;
+  };
+  using BuilderPtr = std::shared_ptr<ResultBuilder>;
 
- private:
   struct ChildFutures {
     void add(RelativePath&& path, Future<Unit>&& future) {
       paths.emplace_back(std::move(path));
@@ -83,36 +245,141 @@ class TreeDiffer {
     vector<Future<Unit>> futures;
   };
 
-  Future<Unit>
-  diffOneTree(RelativePathPiece path, Hash hash, ScmFileStatus status);
-  FOLLY_NODISCARD Future<Unit>
-  diffOneTree(RelativePathPiece path, const Tree& tree, ScmFileStatus status);
+  struct FetchSlots {
+    /** The number of tree loads that may still be started. */
+    int available{0};
+    /** Loads waiting for a slot, in the order they asked for one. */
+    std::deque<folly::Promise<Unit>> waiters;
+  };
+
+  Future<Unit> diffTrees(
+      RelativePathPiece path,
+      Hash hash1,
+      Hash hash2,
+      const BuilderPtr& builder);
+  Future<Unit> loadAndDiffTrees(
+      RelativePathPiece path,
+      Hash hash1,
+      Hash hash2,
+      const BuilderPtr& builder);
+  FOLLY_NODISCARD Future<Unit> diffTrees(
+      RelativePathPiece path,
+      const Tree& tree1,
+      const Tree& tree2,
+      const BuilderPtr& builder);
+  Future<Unit> diffOneTree(
+      RelativePathPiece path,
+      Hash hash,
+      ScmFileStatus status,
+      const BuilderPtr& builder);
+  Future<Unit> loadAndDiffOneTree(
+      RelativePathPiece path,
+      Hash hash,
+      ScmFileStatus status,
+      const BuilderPtr& builder);
+  FOLLY_NODISCARD Future<Unit> diffOneTree(
+      RelativePathPiece path,
+      const Tree& tree,
+      ScmFileStatus status,
+      const BuilderPtr& builder);
 
   void processOneSideOnly(
       ChildFutures& futures,
       RelativePathPiece parentPath,
       const TreeEntry& entry,
-      ScmFileStatus status);
+      ScmFileStatus status,
+      const BuilderPtr& builder);
   void processBothPresent(
       ChildFutures& futures,
       RelativePathPiece parentPath,
       const TreeEntry& entry1,
-      const TreeEntry& entry2);
+      const TreeEntry& entry2,
+      const BuilderPtr& builder);
 
-  void addEntry(RelativePathPiece path, ScmFileStatus status) {
-    result_.wlock()->entries.emplace(path.value().str(), status);
+  void addEntry(
+      RelativePathPiece parentPath,
+      PathComponentPiece name,
+      ScmFileStatus status,
+      const BuilderPtr& builder) {
+    callback_->changedFile(parentPath + name, status);
+    if (builder) {
+      builder->files.emplace_back(PathComponent{name}, status);
+    }
   }
 
-  Future<Unit> waitOnResults(ChildFutures&& childFutures);
+  /**
+   * Start collecting the differences between a pair of subtrees of the
+   * pair that parent is collecting, or return null if parent is null.  One
+   * side is kZeroHash for a subtree that is only in the other tree.
+   */
+  BuilderPtr addSubtree(
+      const BuilderPtr& parent,
+      PathComponentPiece name,
+      const Hash& tree1,
+      const Hash& tree2);
+
+  /**
+   * If the differences between the builder's pair of trees are cached,
+   * record them in the builder and report them to the callback, unless it
+   * does not want the subtree at path.  Returns false if they are not
+   * cached.
+   */
+  bool reportCachedResult(
+      RelativePathPiece path,
+      ScmFileStatus status,
+      const BuilderPtr& builder);
+  void replay(RelativePathPiece path, const TreeDiffResult& result);
+
+  /**
+   * Cache the differences the builder collected, if every subtree's
+   * differences are known.  Subtrees are missing if the callback skipped
+   * them, the diff was cancelled, or they could not be loaded.
+   */
+  void finishResult(const BuilderPtr& builder);
+
+  Future<Unit> waitOnResults(
+      ChildFutures&& childFutures,
+      const BuilderPtr& builder);
+
+  /**
+   * Wait until fewer than --diff_max_tree_loads tree loads are outstanding.
+   * Each call that completes must be followed by one releaseFetchSlot() once
+   * the trees have been loaded.
+   *
+   * Loads are only limited when we have an executor to resume the waiting
+   * ones on.  Resuming them inline could recurse once per waiter when the
+   * trees are already in the LocalStore.
+   */
+  Future<Unit> acquireFetchSlot();
+  void releaseFetchSlot();
+
+  void prefetchTree(const Hash& hash);
+
+  /**
+   * Run the rest of the diff on executor_, if we have one, rather than on
+   * whichever thread completes the tree load.
+   */
+  template <typename T>
+  Future<T> continueOnExecutor(Future<T>&& future) {
+    if (!executor_) {
+      return std::move(future);
+    }
+    return std::move(future).via(executor_);
+  }
 
   ObjectStore* store_;
-  Synchronized<ScmStatus> result_;
+  TreeDiffCallback* callback_;
+  folly::Executor* executor_;
+  const ImportPriority priority_;
+  TreeDiffCache* const cache_;
+  const bool limitLoads_;
+  Synchronized<FetchSlots> fetchSlots_;
 };
 
 Future<Unit> TreeDiffer::diffCommits(Hash hash1, Hash hash2) {
   auto future1 = store_->getTreeForCommit(hash1);
   auto future2 = store_->getTreeForCommit(hash2);
-  return collect(future1, future2)
+  return continueOnExecutor(collect(future1, future2))
       .then([this](std::tuple<
                    std::shared_ptr<const Tree>,
                    std::shared_ptr<const Tree>>&& tup) {
@@ -124,29 +391,89 @@ Future<Unit> TreeDiffer::diffCommits(Hash hash1, Hash hash2) {
 
 Future<Unit>
 TreeDiffer::diffTrees(RelativePathPiece path, Hash hash1, Hash hash2) {
-  auto treeFuture1 = store_->getTree(hash1);
-  auto treeFuture2 = store_->getTree(hash2);
+  auto builder = cache_ ? make_shared<ResultBuilder>(hash1, hash2) : nullptr;
+  return diffTrees(path, hash1, hash2, builder);
+}
+
+Future<Unit> TreeDiffer::diffTrees(
+    RelativePathPiece path,
+    const Tree& tree1,
+    const Tree& tree2) {
+  BuilderPtr builder;
+  if (cache_) {
+    builder = make_shared<ResultBuilder>(tree1.getHash(), tree2.getHash());
+    if (reportCachedResult(path, ScmFileStatus::MODIFIED, builder)) {
+      return makeFuture();
+    }
+  }
+  return diffTrees(path, tree1, tree2, builder);
+}
+
+Future<Unit> TreeDiffer::diffTrees(
+    RelativePathPiece path,
+    Hash hash1,
+    Hash hash2,
+    const BuilderPtr& builder) {
+  if (reportCachedResult(path, ScmFileStatus::MODIFIED, builder)) {
+    return makeFuture();
+  }
+  if (!callback_->shouldLoadTree(path, ScmFileStatus::MODIFIED)) {
+    return makeFuture();
+  }
+  auto slot = acquireFetchSlot();
+  if (slot.isReady()) {
+    return loadAndDiffTrees(path, hash1, hash2, builder);
+  }
+  return std::move(slot).thenValue(
+      [this, path = path.copy(), hash1, hash2, builder](auto&&) {
+        return loadAndDiffTrees(path, hash1, hash2, builder);
+      });
+}
+
+Future<Unit> TreeDiffer::loadAndDiffTrees(
+    RelativePathPiece path,
+    Hash hash1,
+    Hash hash2,
+    const BuilderPtr& builder) {
+  // Check this after getting a slot, since the wait may have been long.
+  if (callback_->isCancelled()) {
+    releaseFetchSlot();
+    return makeFuture();
+  }
+  prefetchTree(hash1);
+  prefetchTree(hash2);
+  auto treeFuture1 = store_->getTree(hash1, priority_);
+  auto treeFuture2 = store_->getTree(hash2, priority_);
   // Optimization for the case when both tree objects are immediately ready.
   // We can avoid copying the input path in this case.
   if (treeFuture1.isReady() && treeFuture2.isReady()) {
+    releaseFetchSlot();
     return diffTrees(
-        path, *std::move(treeFuture1).get(), *std::move(treeFuture2).get());
+        path,
+        *std::move(treeFuture1).get(),
+        *std::move(treeFuture2).get(),
+        builder);
   }
 
-  return folly::collect(treeFuture1, treeFuture2)
-      .then([this, path = path.copy()](std::tuple<
-                                       std::shared_ptr<const Tree>,
-                                       std::shared_ptr<const Tree>>&& tup) {
+  // Give up the slot as soon as the trees are loaded, before walking into
+  // them, since their children need slots of their own.
+  return continueOnExecutor(folly::collect(treeFuture1, treeFuture2)
+                                .ensure([this] { releaseFetchSlot(); }))
+      .then([this, path = path.copy(), builder](
+                std::tuple<
+                    std::shared_ptr<const Tree>,
+                    std::shared_ptr<const Tree>>&& tup) {
         auto tree1 = std::get<0>(tup);
         auto tree2 = std::get<1>(tup);
-        return diffTrees(path, *tree1, *tree2);
+        return diffTrees(path, *tree1, *tree2, builder);
       });
 }
 
 Future<Unit> TreeDiffer::diffTrees(
     RelativePathPiece path,
     const Tree& tree1,
-    const Tree& tree2) {
+    const Tree& tree2,
+    const BuilderPtr& builder) {
   // A list of Futures to wait on for our children's results.
   ChildFutures childFutures;
 
@@ -165,45 +492,76 @@ Future<Unit> TreeDiffer::diffTrees(
 
       // This entry is present in tree2 but not tree1
       processOneSideOnly(
-          childFutures, path, entries2[idx2], ScmFileStatus::ADDED);
+          childFutures, path, entries2[idx2], ScmFileStatus::ADDED, builder);
       ++idx2;
     } else if (idx2 >= entries2.size()) {
       // This entry is present in tree1 but not tree2
       processOneSideOnly(
-          childFutures, path, entries1[idx1], ScmFileStatus::REMOVED);
+          childFutures, path, entries1[idx1], ScmFileStatus::REMOVED, builder);
       ++idx1;
     } else if (entries1[idx1].getName() < entries2[idx2].getName()) {
       processOneSideOnly(
-          childFutures, path, entries1[idx1], ScmFileStatus::REMOVED);
+          childFutures, path, entries1[idx1], ScmFileStatus::REMOVED, builder);
       ++idx1;
     } else if (entries1[idx1].getName() > entries2[idx2].getName()) {
       processOneSideOnly(
-          childFutures, path, entries2[idx2], ScmFileStatus::ADDED);
+          childFutures, path, entries2[idx2], ScmFileStatus::ADDED, builder);
       ++idx2;
     } else {
-      processBothPresent(childFutures, path, entries1[idx1], entries2[idx2]);
+      processBothPresent(
+          childFutures, path, entries1[idx1], entries2[idx2], builder);
       ++idx1;
       ++idx2;
     }
   }
 
-  return waitOnResults(std::move(childFutures));
+  return waitOnResults(std::move(childFutures), builder);
 }
 
 Future<Unit> TreeDiffer::diffOneTree(
     RelativePathPiece path,
     Hash hash,
-    ScmFileStatus status) {
-  auto future = store_->getTree(hash);
+    ScmFileStatus status,
+    const BuilderPtr& builder) {
+  if (reportCachedResult(path, status, builder)) {
+    return makeFuture();
+  }
+  if (!callback_->shouldLoadTree(path, status)) {
+    return makeFuture();
+  }
+  auto slot = acquireFetchSlot();
+  if (slot.isReady()) {
+    return loadAndDiffOneTree(path, hash, status, builder);
+  }
+  return std::move(slot).thenValue(
+      [this, path = path.copy(), hash, status, builder](auto&&) {
+        return loadAndDiffOneTree(path, hash, status, builder);
+      });
+}
+
+Future<Unit> TreeDiffer::loadAndDiffOneTree(
+    RelativePathPiece path,
+    Hash hash,
+    ScmFileStatus status,
+    const BuilderPtr& builder) {
+  if (callback_->isCancelled()) {
+    releaseFetchSlot();
+    return makeFuture();
+  }
+  prefetchTree(hash);
+  auto future = store_->getTree(hash, priority_);
   // Optimization for the case when the tree object is immediately ready.
   // We can avoid copying the input path in this case.
   if (future.isReady()) {
-    return diffOneTree(path, *std::move(future).get(), status);
+    releaseFetchSlot();
+    return diffOneTree(path, *std::move(future).get(), status, builder);
   }
 
-  return std::move(future).then(
-      [this, status, path = path.copy()](std::shared_ptr<const Tree>&& tree) {
-        return diffOneTree(path, *tree, status);
+  return continueOnExecutor(
+             std::move(future).ensure([this] { releaseFetchSlot(); }))
+      .then([this, status, path = path.copy(), builder](
+                std::shared_ptr<const Tree>&& tree) {
+        return diffOneTree(path, *tree, status, builder);
       });
 }
 
@@ -213,12 +571,13 @@ Future<Unit> TreeDiffer::diffOneTree(
 Future<Unit> TreeDiffer::diffOneTree(
     RelativePathPiece path,
     const Tree& tree,
-    ScmFileStatus status) {
+    ScmFileStatus status,
+    const BuilderPtr& builder) {
   ChildFutures childFutures;
   for (const auto& childEntry : tree.getTreeEntries()) {
-    processOneSideOnly(childFutures, path, childEntry, status);
+    processOneSideOnly(childFutures, path, childEntry, status, builder);
   }
-  return waitOnResults(std::move(childFutures));
+  return waitOnResults(std::move(childFutures), builder);
 }
 
 /**
@@ -232,14 +591,19 @@ void TreeDiffer::processOneSideOnly(
     ChildFutures& childFutures,
     RelativePathPiece parentPath,
     const TreeEntry& entry,
-    ScmFileStatus status) {
+    ScmFileStatus status,
+    const BuilderPtr& builder) {
   if (!entry.isTree()) {
-    addEntry(parentPath + entry.getName(), status);
+    addEntry(parentPath, entry.getName(), status, builder);
     return;
   }
 
+  const auto& hash = entry.getHash();
+  auto childBuilder = status == ScmFileStatus::ADDED
+      ? addSubtree(builder, entry.getName(), kZeroHash, hash)
+      : addSubtree(builder, entry.getName(), hash, kZeroHash);
   auto childPath = parentPath + entry.getName();
-  auto childFuture = diffOneTree(childPath, entry.getHash(), status);
+  auto childFuture = diffOneTree(childPath, hash, status, childBuilder);
   childFutures.add(std::move(childPath), std::move(childFuture));
 }
 
@@ -250,7 +614,8 @@ void TreeDiffer::processBothPresent(
     ChildFutures& childFutures,
     RelativePathPiece parentPath,
     const TreeEntry& entry1,
-    const TreeEntry& entry2) {
+    const TreeEntry& entry2,
+    const BuilderPtr& builder) {
   bool isTree1 = entry1.isTree();
   bool isTree2 = entry2.isTree();
 
@@ -261,47 +626,126 @@ void TreeDiffer::processBothPresent(
       if (entry1.getHash() == entry2.getHash()) {
         return;
       }
+      auto childBuilder = addSubtree(
+          builder, entry1.getName(), entry1.getHash(), entry2.getHash());
       auto childPath = parentPath + entry1.getName();
-      auto childFuture =
-          diffTrees(childPath, entry1.getHash(), entry2.getHash());
+      auto childFuture = diffTrees(
+          childPath, entry1.getHash(), entry2.getHash(), childBuilder);
       childFutures.add(std::move(childPath), std::move(childFuture));
     } else {
       // tree-to-file
       // Record an ADDED entry for this path
-      addEntry(parentPath + entry1.getName(), ScmFileStatus::ADDED);
+      addEntry(parentPath, entry1.getName(), ScmFileStatus::ADDED, builder);
       // Report everything in tree1 as REMOVED
       processOneSideOnly(
-          childFutures, parentPath, entry1, ScmFileStatus::REMOVED);
+          childFutures, parentPath, entry1, ScmFileStatus::REMOVED, builder);
     }
   } else {
     if (isTree2) {
       // file-to-tree
       // Add a REMOVED entry for this path
-      addEntry(parentPath + entry1.getName(), ScmFileStatus::REMOVED);
+      addEntry(parentPath, entry1.getName(), ScmFileStatus::REMOVED, builder);
       // Report everything in tree2 as ADDED
       processOneSideOnly(
-          childFutures, parentPath, entry2, ScmFileStatus::ADDED);
+          childFutures, parentPath, entry2, ScmFileStatus::ADDED, builder);
     } else {
       // file-to-file diff
       // We currently do not load the blob contents, and assume that blobs with
       // different hashes have different contents.
       if (entry1.getType() != entry2.getType() ||
           entry1.getHash() != entry2.getHash()) {
-        addEntry(parentPath + entry1.getName(), ScmFileStatus::MODIFIED);
+        addEntry(
+            parentPath, entry1.getName(), ScmFileStatus::MODIFIED, builder);
       }
     }
   }
 }
 
-Future<Unit> TreeDiffer::waitOnResults(ChildFutures&& childFutures) {
+TreeDiffer::BuilderPtr TreeDiffer::addSubtree(
+    const BuilderPtr& parent,
+    PathComponentPiece name,
+    const Hash& tree1,
+    const Hash& tree2) {
+  if (!parent) {
+    return nullptr;
+  }
+  auto child = make_shared<ResultBuilder>(tree1, tree2);
+  parent->trees.emplace_back(PathComponent{name}, child);
+  return child;
+}
+
+bool TreeDiffer::reportCachedResult(
+    RelativePathPiece path,
+    ScmFileStatus status,
+    const BuilderPtr& builder) {
+  if (!builder) {
+    return false;
+  }
+  builder->result = cache_->get(builder->tree1, builder->tree2);
+  if (!builder->result) {
+    return false;
+  }
+  // The root is always reported; shouldLoadTree() is only asked about the
+  // trees below it.
+  if (path.empty() || callback_->shouldLoadTree(path, status)) {
+    replay(path, *builder->result);
+  }
+  return true;
+}
+
+void TreeDiffer::replay(RelativePathPiece path, const TreeDiffResult& result) {
+  for (const auto& file : result.files) {
+    callback_->changedFile(path + file.first, file.second);
+  }
+  for (const auto& subtree : result.trees) {
+    if (callback_->isCancelled()) {
+      return;
+    }
+    auto status = subtree.tree1 == kZeroHash
+        ? ScmFileStatus::ADDED
+        : subtree.tree2 == kZeroHash ? ScmFileStatus::REMOVED
+                                     : ScmFileStatus::MODIFIED;
+    auto childPath = path + subtree.name;
+    if (callback_->shouldLoadTree(childPath, status)) {
+      replay(childPath, *subtree.result);
+    }
+  }
+}
+
+void TreeDiffer::finishResult(const BuilderPtr& builder) {
+  if (!builder) {
+    return;
+  }
+  auto result = std::make_shared<TreeDiffResult>();
+  result->trees.reserve(builder->trees.size());
+  for (const auto& subtree : builder->trees) {
+    if (!subtree.second->result) {
+      return;
+    }
+    result->trees.emplace_back(
+        subtree.first,
+        subtree.second->tree1,
+        subtree.second->tree2,
+        subtree.second->result);
+  }
+  result->files = std::move(builder->files);
+  builder->trees.clear();
+  builder->result = result;
+  cache_->put(builder->tree1, builder->tree2, std::move(result));
+}
+
+Future<Unit> TreeDiffer::waitOnResults(
+    ChildFutures&& childFutures,
+    const BuilderPtr& builder) {
   DCHECK_EQ(childFutures.paths.size(), childFutures.futures.size());
   if (childFutures.futures.empty()) {
+    finishResult(builder);
     return makeFuture();
   }
 
   return folly::collectAllSemiFuture(std::move(childFutures.futures))
       .toUnsafeFuture()
-      .then([this, paths = std::move(childFutures.paths)](
+      .then([this, paths = std::move(childFutures.paths), builder](
                 vector<Try<Unit>>&& results) {
         DCHECK_EQ(paths.size(), results.size());
         for (size_t idx = 0; idx < results.size(); ++idx) {
@@ -310,40 +754,171 @@ Future<Unit> TreeDiffer::waitOnResults(ChildFutures&& childFutures) {
             continue;
           }
           XLOG(ERR) << "error computing SCM diff for " << paths.at(idx);
-          result_.wlock()->errors.emplace(
-              paths.at(idx).value(), result.exception().what().toStdString());
+          callback_->diffError(paths.at(idx), result.exception());
         }
+        finishResult(builder);
+      });
+}
+
+Future<Unit> TreeDiffer::acquireFetchSlot() {
+  if (!limitLoads_) {
+    return makeFuture();
+  }
+  auto slots = fetchSlots_.wlock();
+  if (slots->available > 0) {
+    --slots->available;
+    return makeFuture();
+  }
+  slots->waiters.emplace_back();
+  return slots->waiters.back().getFuture().via(executor_);
+}
+
+void TreeDiffer::releaseFetchSlot() {
+  if (!limitLoads_) {
+    return;
+  }
+  folly::Promise<Unit> waiter;
+  {
+    auto slots = fetchSlots_.wlock();
+    if (slots->waiters.empty()) {
+      ++slots->available;
+      return;
+    }
+    waiter = std::move(slots->waiters.front());
+    slots->waiters.pop_front();
+  }
+  // Hand our slot straight to the oldest waiter.
+  waiter.setValue();
+}
+
+/**
+ * Ask the backing store to fetch the levels below a tree that we are about
+ * to walk into, in as few requests as it can.  This is only a hint, so
+ * errors are ignored; the getTree() calls that need the data will report
+ * them.
+ */
+void TreeDiffer::prefetchTree(const Hash& hash) {
+  if (FLAGS_diff_tree_prefetch_depth <= 0) {
+    return;
+  }
+  store_
+      ->prefetchTree(
+          hash, static_cast<size_t>(FLAGS_diff_tree_prefetch_depth))
+      .onError([hash](const folly::exception_wrapper& ew) {
+        XLOG(DBG3) << "error prefetching tree " << hash << ": " << ew.what();
       });
 }
 
 } // namespace
 
-folly::Future<ScmStatus>
-diffCommits(ObjectStore* store, Hash commit1, Hash commit2) {
+folly::Future<ScmStatus> diffCommits(
+    ObjectStore* store,
+    Hash commit1,
+    Hash commit2,
+    folly::Executor* executor) {
+  return folly::makeFutureWith([&] {
+    auto callback = make_unique<ScmStatusCallback>();
+    auto* callbackRawPtr = callback.get();
+    return diffCommits(store, commit1, commit2, callbackRawPtr, executor)
+        .then([callback = std::move(callback)] {
+          return callback->extractResult();
+        });
+  });
+}
+
+folly::Future<ScmStatus> diffCommits(
+    ObjectStore* store,
+    Hash commit1,
+    Hash commit2,
+    PathPrefixFilter filter,
+    size_t limit,
+    folly::Executor* executor) {
+  return folly::makeFutureWith([&] {
+    auto callback = make_unique<ScmStatusCallback>(std::move(filter), limit);
+    auto* callbackRawPtr = callback.get();
+    return diffCommits(store, commit1, commit2, callbackRawPtr, executor)
+        .then([callback = std::move(callback)] {
+          return callback->extractResult();
+        });
+  });
+}
+
+folly::Future<Unit> diffCommits(
+    ObjectStore* store,
+    Hash commit1,
+    Hash commit2,
+    TreeDiffCallback* callback,
+    folly::Executor* executor) {
+  // Diffing commits reads trees that interactive lookups are unlikely to
+  // need soon, so keep them out of the LocalStore's caches.
+  LocalStore::ScanScope scan;
   return folly::makeFutureWith([&] {
-    auto differ = make_unique<TreeDiffer>(store);
+    auto differ = make_unique<TreeDiffer>(
+        store,
+        callback,
+        executor,
+        ImportPriority::Foreground,
+        store->getTreeDiffCache());
     auto* differRawPtr = differ.get();
     return differRawPtr->diffCommits(commit1, commit2)
-        .then([differ = std::move(differ)] { return differ->extractResult(); });
+        .ensure([differ = std::move(differ)] {});
+  });
+}
+
+folly::Future<uint64_t> prefetchChangedTrees(
+    ObjectStore* store,
+    Hash fromCommit,
+    Hash toCommit,
+    size_t maxDepth,
+    vector<RelativePath> paths,
+    folly::Executor* executor) {
+  LocalStore::ScanScope scan;
+  return folly::makeFutureWith([&] {
+    auto callback =
+        make_unique<PrefetchTreesCallback>(maxDepth, std::move(paths));
+    auto differ = make_unique<TreeDiffer>(
+        store, callback.get(), executor, ImportPriority::Background);
+    auto* differRawPtr = differ.get();
+    return differRawPtr->diffCommits(fromCommit, toCommit)
+        .then([differ = std::move(differ), callback = std::move(callback)] {
+          // The root tree of toCommit is always loaded.
+          return callback->getNumTrees() + 1;
+        });
   });
 }
 
 folly::Future<ScmStatus> diffTrees(ObjectStore* store, Hash tree1, Hash tree2) {
   return folly::makeFutureWith([&] {
-    auto differ = make_unique<TreeDiffer>(store);
+    auto callback = make_unique<ScmStatusCallback>();
+    auto differ = make_unique<TreeDiffer>(
+        store,
+        callback.get(),
+        nullptr,
+        ImportPriority::Foreground,
+        store->getTreeDiffCache());
     auto* differRawPtr = differ.get();
     return differRawPtr->diffTrees(RelativePathPiece{}, tree1, tree2)
-        .then([differ = std::move(differ)] { return differ->extractResult(); });
+        .then([differ = std::move(differ), callback = std::move(callback)] {
+          return callback->extractResult();
+        });
   });
 }
 
 folly::Future<ScmStatus>
 diffTrees(ObjectStore* store, const Tree& tree1, const Tree& tree2) {
   return folly::makeFutureWith([&] {
-    auto differ = make_unique<TreeDiffer>(store);
+    auto callback = make_unique<ScmStatusCallback>();
+    auto differ = make_unique<TreeDiffer>(
+        store,
+        callback.get(),
+        nullptr,
+        ImportPriority::Foreground,
+        store->getTreeDiffCache());
     auto* differRawPtr = differ.get();
     return differRawPtr->diffTrees(RelativePathPiece{}, tree1, tree2)
-        .then([differ = std::move(differ)] { return differ->extractResult(); });
+        .then([differ = std::move(differ), callback = std::move(callback)] {
+          return callback->extractResult();
+        });
   });
 }
 
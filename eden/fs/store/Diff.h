@@ -9,12 +9,18 @@
  */
 #pragma once
 
+#include <vector>
 #include "eden/fs/service/gen-cpp2/eden_types.h"
+#include "eden/fs/utils/PathFuncs.h"
+#include "eden/fs/utils/PathPrefixFilter.h"
 
 namespace folly {
+class Executor;
+class exception_wrapper;
 template <typename T>
 class Future;
-}
+struct Unit;
+} // namespace folly
 
 namespace facebook {
 namespace eden {
@@ -23,14 +29,115 @@ class Hash;
 class ObjectStore;
 class Tree;
 
+/**
+ * A callback that will be invoked with results from a diff between two
+ * source control trees.
+ *
+ * As with InodeDiffCallback, the callback functions may be invoked from
+ * multiple threads simultaneously.
+ */
+class TreeDiffCallback {
+ public:
+  TreeDiffCallback() {}
+  virtual ~TreeDiffCallback() {}
+
+  virtual void changedFile(RelativePathPiece path, ScmFileStatus status) = 0;
+  virtual void diffError(
+      RelativePathPiece path,
+      const folly::exception_wrapper& ew) = 0;
+
+  /**
+   * Returns true if the caller no longer wants the results of this diff.
+   * The diff stops descending into subtrees once this returns true.
+   */
+  virtual bool isCancelled() const {
+    return false;
+  }
+
+  /**
+   * Returns false to skip the subtree at path, without loading it or
+   * reporting the files in it.  status is ADDED or REMOVED for a tree that
+   * is only in one of the commits, and MODIFIED for a tree that differs
+   * between them.
+   */
+  virtual bool shouldLoadTree(
+      RelativePathPiece /* path */,
+      ScmFileStatus /* status */) const {
+    return true;
+  }
+};
+
 /**
  * Compute the diff between two commits.
  *
+ * The differences between pairs of subtrees are remembered in the
+ * ObjectStore's TreeDiffCache, if it has one, so that later diffs involving
+ * the same pairs do not need to walk them again.
+ *
+ * If an executor is given, the diff continues on it after each tree load
+ * that could not complete immediately.
+ *
  * The caller is responsible for ensuring that the ObjectStore remains valid
  * until the returned Future completes.
  */
-folly::Future<ScmStatus>
-diffCommits(ObjectStore* store, Hash commit1, Hash commit2);
+folly::Future<ScmStatus> diffCommits(
+    ObjectStore* store,
+    Hash commit1,
+    Hash commit2,
+    folly::Executor* executor = nullptr);
+
+/**
+ * Compute the diff between two commits, restricted to the paths that match
+ * filter.  Trees that cannot contain a matching path are not loaded.
+ *
+ * If limit is non-zero the diff stops once it has found that many
+ * differences and errors, and sets the truncated field of the result.  The
+ * differences returned are then not necessarily the first ones in path
+ * order.
+ */
+folly::Future<ScmStatus> diffCommits(
+    ObjectStore* store,
+    Hash commit1,
+    Hash commit2,
+    PathPrefixFilter filter,
+    size_t limit,
+    folly::Executor* executor = nullptr);
+
+/**
+ * Compute the diff between two commits, reporting each difference to the
+ * callback as it is found rather than collecting them all.
+ *
+ * The caller is responsible for ensuring that the ObjectStore and callback
+ * remain valid until the returned Future completes.
+ */
+folly::Future<folly::Unit> diffCommits(
+    ObjectStore* store,
+    Hash commit1,
+    Hash commit2,
+    TreeDiffCallback* callback,
+    folly::Executor* executor = nullptr);
+
+/**
+ * Fetch the trees of toCommit that differ from those of fromCommit into the
+ * LocalStore, at background priority, so that a later checkout from
+ * fromCommit to toCommit does not have to wait on the backing store for
+ * them.  Trees that are only in fromCommit are not loaded.
+ *
+ * If maxDepth is non-zero, only trees at most that many levels below the
+ * root are fetched.  If paths is non-empty, only the trees leading to and
+ * under those paths are fetched.
+ *
+ * Returns the number of trees that were loaded.  Trees that cannot be
+ * loaded are logged and skipped.  The caller is responsible for ensuring
+ * that the ObjectStore remains valid until the returned Future completes.
+ */
+folly::Future<uint64_t> prefetchChangedTrees(
+    ObjectStore* store,
+    Hash fromCommit,
+    Hash toCommit,
+    size_t maxDepth,
+    std::vector<RelativePath> paths,
+    folly::Executor* executor = nullptr);
 
 /**
  * Compute the diff between two commits.
@@ -25,11 +25,15 @@ EmptyBackingStore::EmptyBackingStore() {}
 
 EmptyBackingStore::~EmptyBackingStore() {}
 
-Future<unique_ptr<Tree>> EmptyBackingStore::getTree(const Hash& /* id */) {
+Future<unique_ptr<Tree>> EmptyBackingStore::getTree(
+    const Hash& /* id */,
+    ImportPriority /* priority */) {
   return makeFuture<unique_ptr<Tree>>(std::domain_error("empty backing store"));
 }
 
-Future<unique_ptr<Blob>> EmptyBackingStore::getBlob(const Hash& /* id */) {
+Future<unique_ptr<Blob>> EmptyBackingStore::getBlob(
+    const Hash& /* id */,
+    ImportPriority /* priority */) {
   return makeFuture<unique_ptr<Blob>>(std::domain_error("empty backing store"));
 }
 
@@ -23,8 +23,12 @@ class EmptyBackingStore : public BackingStore {
   EmptyBackingStore();
   ~EmptyBackingStore() override;
 
-  folly::Future<std::unique_ptr<Tree>> getTree(const Hash& id) override;
-  folly::Future<std::unique_ptr<Blob>> getBlob(const Hash& id) override;
+  folly::Future<std::unique_ptr<Tree>> getTree(
+      const Hash& id,
+      ImportPriority priority) override;
+  folly::Future<std::unique_ptr<Blob>> getBlob(
+      const Hash& id,
+      ImportPriority priority) override;
   folly::Future<std::unique_ptr<Tree>> getTreeForCommit(
       const Hash& commitID) override;
 };
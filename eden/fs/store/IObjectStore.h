@@ -12,6 +12,8 @@
 #include <memory>
 #include <vector>
 
+#include "eden/fs/store/ImportPriority.h"
+
 namespace folly {
 template <typename T>
 class Future;
@@ -32,16 +34,24 @@ class IObjectStore {
 
   /*
    * Object access APIs.
+   *
+   * The priority is passed on to the BackingStore if the object must be
+   * imported.
    */
   virtual folly::Future<std::shared_ptr<const Tree>> getTree(
-      const Hash& id) const = 0;
+      const Hash& id,
+      ImportPriority priority = ImportPriority::Foreground) const = 0;
   virtual folly::Future<std::shared_ptr<const Blob>> getBlob(
-      const Hash& id) const = 0;
+      const Hash& id,
+      ImportPriority priority = ImportPriority::Foreground) const = 0;
   virtual folly::Future<std::shared_ptr<const Tree>> getTreeForCommit(
       const Hash& commitID) const = 0;
   virtual folly::Future<BlobMetadata> getBlobMetadata(const Hash& id) const = 0;
   virtual folly::Future<folly::Unit> prefetchBlobs(
       const std::vector<Hash>& ids) const = 0;
+  virtual folly::Future<folly::Unit> prefetchTree(
+      const Hash& id,
+      size_t depth) const = 0;
 };
 } // namespace eden
 } // namespace facebook
@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * How urgently the caller needs an object that may have to be imported from
+ * the BackingStore.
+ *
+ * BackingStores that queue imports use this to decide what to work on next.
+ * Values are ordered from most to least urgent.
+ */
+enum class ImportPriority : uint8_t {
+  /**
+   * A filesystem request from a process that is blocked waiting for the
+   * result, such as a read() from an editor.
+   */
+  Interactive = 0,
+  /**
+   * A thrift request or similar, where a user is waiting for the result but
+   * not blocked inside a filesystem call.
+   */
+  Foreground = 1,
+  /**
+   * Bulk work such as checkout or prefetching, which should not delay the
+   * requests above.
+   */
+  Background = 2,
+};
+
+constexpr size_t kNumImportPriorities = 3;
+
+} // namespace eden
+} // namespace facebook
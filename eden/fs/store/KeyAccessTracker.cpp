@@ -0,0 +1,94 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/KeyAccessTracker.h"
+
+#include <folly/hash/Hash.h>
+
+namespace facebook {
+namespace eden {
+
+KeyAccessTracker::KeyAccessTracker(size_t maxEntries)
+    : maxEntries_{maxEntries} {}
+
+uint64_t KeyAccessTracker::fingerprint(folly::ByteRange key) {
+  return folly::hash::fnv64_buf(key.data(), key.size());
+}
+
+void KeyAccessTracker::recordAccess(folly::ByteRange key) {
+  const auto fp = fingerprint(key);
+  auto state = state_.lock();
+  const auto current = state->currentGeneration;
+
+  auto it = state->lastAccess.find(fp);
+  if (it != state->lastAccess.end()) {
+    if (it->second != current) {
+      auto sizeIt = state->generationSizes.find(it->second);
+      if (--sizeIt->second == 0) {
+        state->generationSizes.erase(sizeIt);
+      }
+      it->second = current;
+      ++state->generationSizes[current];
+    }
+    return;
+  }
+
+  if (!makeRoom(*state)) {
+    return;
+  }
+  state->lastAccess.emplace(fp, current);
+  ++state->generationSizes[current];
+}
+
+bool KeyAccessTracker::makeRoom(State& state) {
+  if (state.lastAccess.size() < maxEntries_) {
+    return true;
+  }
+  if (state.generationSizes.empty()) {
+    // maxEntries_ is 0.
+    return false;
+  }
+
+  auto oldest = state.generationSizes.begin()->first;
+  if (oldest == state.currentGeneration) {
+    return false;
+  }
+  for (auto it = state.lastAccess.begin(); it != state.lastAccess.end();) {
+    if (it->second == oldest) {
+      it = state.lastAccess.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  state.generationSizes.erase(state.generationSizes.begin());
+  return true;
+}
+
+KeyAccessTracker::Generation KeyAccessTracker::getLastAccess(
+    folly::ByteRange key) const {
+  const auto fp = fingerprint(key);
+  auto state = state_.lock();
+  auto it = state->lastAccess.find(fp);
+  return it == state->lastAccess.end() ? 0 : it->second;
+}
+
+KeyAccessTracker::Generation KeyAccessTracker::advanceGeneration() {
+  return ++state_.lock()->currentGeneration;
+}
+
+KeyAccessTracker::Generation KeyAccessTracker::getCurrentGeneration() const {
+  return state_.lock()->currentGeneration;
+}
+
+size_t KeyAccessTracker::size() const {
+  return state_.lock()->lastAccess.size();
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/Synchronized.h>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * KeyAccessTracker records approximately when each LocalStore key was last
+ * read, so that the least recently used entries can be garbage collected.
+ *
+ * Time is measured in generations rather than wall-clock time: the owner
+ * calls advanceGeneration() periodically (normally once per garbage
+ * collection pass), and every access records the current generation.  Keys
+ * are tracked by a 64-bit fingerprint rather than their full contents, which
+ * keeps each entry small.  A fingerprint collision can only make a key look
+ * more recently used than it really is.
+ *
+ * The table holds at most maxEntries keys.  When it is full the oldest
+ * generation is dropped; if only the current generation remains, new keys are
+ * not recorded until the next generation starts.  Keys that are not tracked
+ * report generation 0, older than any tracked key.
+ *
+ * The table lives only in memory, so after a restart every key looks
+ * unused until it is read again.
+ *
+ * KeyAccessTracker is thread-safe.
+ */
+class KeyAccessTracker {
+ public:
+  using Generation = uint32_t;
+
+  static constexpr size_t kDefaultMaxEntries = 1024 * 1024;
+
+  explicit KeyAccessTracker(size_t maxEntries = kDefaultMaxEntries);
+
+  KeyAccessTracker(const KeyAccessTracker&) = delete;
+  KeyAccessTracker& operator=(const KeyAccessTracker&) = delete;
+
+  /**
+   * Record that key was read during the current generation.
+   */
+  void recordAccess(folly::ByteRange key);
+
+  /**
+   * Get the generation during which key was last read, or 0 if the key is not
+   * tracked.
+   */
+  Generation getLastAccess(folly::ByteRange key) const;
+
+  /**
+   * Start a new generation.  Returns the new current generation.
+   */
+  Generation advanceGeneration();
+
+  Generation getCurrentGeneration() const;
+
+  /**
+   * Get the number of keys currently being tracked.
+   */
+  size_t size() const;
+
+ private:
+  struct State {
+    Generation currentGeneration{1};
+    std::unordered_map<uint64_t, Generation> lastAccess;
+    /** The number of entries in lastAccess for each generation. */
+    std::map<Generation, size_t> generationSizes;
+  };
+
+  static uint64_t fingerprint(folly::ByteRange key);
+
+  /**
+   * Make room for one more entry.  Returns false if the table is full of
+   * entries from the current generation.
+   */
+  bool makeRoom(State& state);
+
+  const size_t maxEntries_;
+  folly::Synchronized<State, std::mutex> state_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -9,21 +9,29 @@
  */
 #include "LocalStore.h"
 
+#include <folly/Conv.h>
 #include <folly/Format.h>
 #include <folly/Optional.h>
 #include <folly/String.h>
+#include <folly/compression/Compression.h>
 #include <folly/futures/Future.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/lang/Bits.h>
 #include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
+#include <algorithm>
 #include <array>
+#include <chrono>
 
+#include "common/stats/ServiceData.h"
 #include "eden/fs/model/Blob.h"
 #include "eden/fs/model/Tree.h"
 #include "eden/fs/model/git/GitBlob.h"
 #include "eden/fs/model/git/GitTree.h"
 #include "eden/fs/store/StoreResult.h"
+#include "eden/fs/store/StoreStats.h"
+#include "eden/fs/store/TreeView.h"
 
 using facebook::eden::Hash;
 using folly::ByteRange;
@@ -33,9 +41,32 @@ using folly::StringPiece;
 using folly::io::Cursor;
 using std::string;
 using std::unique_ptr;
+using std::chrono::steady_clock;
+
+DEFINE_bool(
+    local_store_dedupe_blobs,
+    false,
+    "Store the contents of blobs under their SHA-1, so that blobs with the "
+    "same contents are only stored once.  Blobs stored either way can be "
+    "read regardless of this setting.");
+DEFINE_uint64(
+    local_store_compress_blobs_over,
+    0,
+    "When --local_store_dedupe_blobs is set, compress the contents of blobs "
+    "of at least this many bytes with zstd.  0 disables compression.");
 
 namespace {
 using namespace facebook::eden;
+
+const std::string kScanKey("eden_local_store_scan");
+
+class ScanRequestData : public folly::RequestData {
+ public:
+  bool hasCallback() override {
+    return false;
+  }
+};
+
 class SerializedBlobMetadata {
  public:
   explicit SerializedBlobMetadata(const BlobMetadata& metadata) {
@@ -85,6 +116,99 @@ class SerializedBlobMetadata {
   std::array<uint8_t, SIZE> data_;
 };
 
+/**
+ * The key of one piece of a blob stored by putBlobChunks().  This is stored
+ * as:
+ * - blob ID (20 bytes)
+ * - chunk index (4 bytes, big endian)
+ *
+ * Keeping the index big endian means that all of a blob's chunks sort
+ * together, in order.
+ */
+class BlobChunkKey {
+ public:
+  BlobChunkKey(const Hash& id, uint32_t index) {
+    uint32_t indexBE = folly::Endian::big(index);
+    memcpy(data_.data(), id.getBytes().data(), Hash::RAW_SIZE);
+    memcpy(data_.data() + Hash::RAW_SIZE, &indexBE, sizeof(uint32_t));
+  }
+
+  ByteRange slice() const {
+    return ByteRange{data_};
+  }
+
+ private:
+  std::array<uint8_t, Hash::RAW_SIZE + sizeof(uint32_t)> data_;
+};
+
+/**
+ * When --local_store_dedupe_blobs is set, the BlobFamily entry for a blob is
+ * this prefix followed by the SHA-1 of its contents, which are stored in the
+ * BlobContentFamily.  Blobs stored in git's format always start with
+ * "blob ", so the two cannot be confused.
+ */
+constexpr StringPiece kBlobContentReferencePrefix{"content "};
+
+/**
+ * The first byte of each BlobContentFamily entry, which says how the rest of
+ * it is encoded.
+ */
+enum class BlobContentFormat : uint8_t {
+  Raw = 0,
+  Zstd = 1,
+};
+
+constexpr auto kBlobCompressionCodec = folly::io::CodecType::ZSTD;
+
+/**
+ * Returns the SHA-1 that a BlobFamily entry refers to, or folly::none if the
+ * entry holds the blob itself.
+ */
+Optional<Hash> parseBlobContentReference(ByteRange bytes) {
+  if (bytes.size() != kBlobContentReferencePrefix.size() + Hash::RAW_SIZE ||
+      !StringPiece{bytes}.startsWith(kBlobContentReferencePrefix)) {
+    return folly::none;
+  }
+  bytes.advance(kBlobContentReferencePrefix.size());
+  return Hash{bytes};
+}
+
+IOBuf decodeBlobContent(const Hash& contentSha1, StoreResult&& data) {
+  auto bytes = data.bytes();
+  if (bytes.empty()) {
+    throw std::invalid_argument(folly::sformat(
+        "Blob contents {} are empty. Could not deserialize.",
+        contentSha1.toString()));
+  }
+  auto format = bytes[0];
+  auto buf = data.extractIOBuf();
+  buf.trimStart(1);
+  switch (static_cast<BlobContentFormat>(format)) {
+    case BlobContentFormat::Raw:
+      return buf;
+    case BlobContentFormat::Zstd:
+      return std::move(*folly::io::getCodec(kBlobCompressionCodec)
+                            ->uncompress(&buf));
+  }
+  throw std::invalid_argument(folly::sformat(
+      "Blob contents {} have unknown format {}. Could not deserialize.",
+      contentSha1.toString(),
+      format));
+}
+
+// Add all of the IOBuf chunks
+void appendSlices(const IOBuf& buf, std::vector<ByteRange>& slices) {
+  Cursor cursor(&buf);
+  while (true) {
+    auto bytes = cursor.peekBytes();
+    if (bytes.empty()) {
+      break;
+    }
+    slices.push_back(bytes);
+    cursor.skip(bytes.size());
+  }
+}
+
 enum class Persistence : bool {
   Ephemeral = false,
   Persistent = true,
@@ -93,26 +217,118 @@ enum class Persistence : bool {
 static constexpr struct KeySpaceRecord {
   LocalStore::KeySpace keySpace;
   Persistence persistence;
+  // The name used for this KeySpace's stats.
+  const char* name;
 } kKeySpaceRecords[] = {
-    {LocalStore::BlobFamily, Persistence::Ephemeral},
-    {LocalStore::BlobMetaDataFamily, Persistence::Ephemeral},
+    {LocalStore::BlobFamily, Persistence::Ephemeral, "blob"},
+    {LocalStore::BlobMetaDataFamily, Persistence::Ephemeral, "blob_metadata"},
 
     // If the trees were imported from a flatmanifest, we cannot delete them.
     // See test_contents_are_the_same_if_handle_is_held_open when running
     // against a flatmanifest repository.
-    {LocalStore::TreeFamily, Persistence::Persistent},
+    {LocalStore::TreeFamily, Persistence::Persistent, "tree"},
 
     // Proxy hashes are required to fetch objects from hg from a hash.
     // Deleting them breaks re-importing after an inode is unloaded.
-    {LocalStore::HgProxyHashFamily, Persistence::Persistent},
-
-    {LocalStore::HgCommitToTreeFamily, Persistence::Ephemeral},
+    {LocalStore::HgProxyHashFamily, Persistence::Persistent, "hg_proxy_hash"},
+
+    {LocalStore::HgCommitToTreeFamily,
+     Persistence::Ephemeral,
+     "hg_commit_to_tree"},
+    {LocalStore::BlobChunkFamily, Persistence::Ephemeral, "blob_chunk"},
+    {LocalStore::BlobContentFamily, Persistence::Ephemeral, "blob_content"},
+    {LocalStore::PathIndexFamily, Persistence::Ephemeral, "path_index"},
+    {LocalStore::TreeDiffFamily, Persistence::Ephemeral, "tree_diff"},
 };
 } // namespace
 
 namespace facebook {
 namespace eden {
 
+/**
+ * Latencies of the LocalStore helpers, for each KeySpace.
+ */
+class LocalStoreStats : public StoreStats {
+ public:
+  using KeySpace = LocalStore::KeySpace;
+
+  LocalStoreStats() : StoreStats{"local_store"} {
+    for (auto ks : kKeySpaceRecords) {
+      gets_[ks.keySpace] = std::make_unique<Histogram>(createLatencyHistogram(
+          folly::to<string>(ks.name, ".get_us")));
+      puts_[ks.keySpace] = std::make_unique<Histogram>(createLatencyHistogram(
+          folly::to<string>(ks.name, ".put_us")));
+    }
+  }
+
+  void recordGet(KeySpace keySpace, steady_clock::time_point start) {
+    recordLatency(*gets_[keySpace], steady_clock::now() - start);
+  }
+
+  void recordPut(KeySpace keySpace, steady_clock::time_point start) {
+    recordLatency(*puts_[keySpace], steady_clock::now() - start);
+  }
+
+  // The number of chunks read by each getBlobRange() call.
+  Histogram blobChunkBatchSize{
+      createHistogram("blob_chunk.batch_size", 1, 0, 64)};
+
+ private:
+  std::array<std::unique_ptr<Histogram>, KeySpace::End> gets_;
+  std::array<std::unique_ptr<Histogram>, KeySpace::End> puts_;
+};
+
+constexpr size_t LocalStore::kBlobChunkSize;
+
+LocalStore::LocalStore() : stats_{std::make_unique<LocalStoreStats>()} {}
+
+void LocalStore::aggregateStats() {
+  stats_->aggregate();
+}
+
+void LocalStore::refreshEngineStats() {
+  auto engineStats = computeEngineStats();
+  auto serviceData = stats::ServiceData::get();
+  for (const auto& stat : engineStats) {
+    serviceData->setCounter(
+        folly::to<string>("local_store.", stat.first), stat.second);
+  }
+  *engineStats_.wlock() = std::move(engineStats);
+}
+
+std::map<std::string, int64_t> LocalStore::getEngineStats() const {
+  return *engineStats_.rlock();
+}
+
+std::map<std::string, int64_t> LocalStore::computeEngineStats() const {
+  return {};
+}
+
+LocalStore::ScanScope::ScanScope()
+    : guard_{kScanKey, std::make_unique<ScanRequestData>()} {}
+
+bool LocalStore::isScanning() {
+  return folly::RequestContext::get()->getContextData(kScanKey) != nullptr;
+}
+
+folly::StringPiece LocalStore::getKeySpaceName(KeySpace keySpace) {
+  for (auto ks : kKeySpaceRecords) {
+    if (ks.keySpace == keySpace) {
+      return ks.name;
+    }
+  }
+  return "default";
+}
+
+bool LocalStore::isEphemeral(KeySpace keySpace) {
+  for (auto ks : kKeySpaceRecords) {
+    if (ks.keySpace == keySpace) {
+      return ks.persistence == Persistence::Ephemeral;
+    }
+  }
+  return false;
+}
+
 void LocalStore::clearCachesAndCompactAll() {
   for (auto ks : kKeySpaceRecords) {
     if (ks.persistence == Persistence::Ephemeral) {
@@ -136,6 +352,16 @@ void LocalStore::compactStorage() {
   }
 }
 
+uint64_t LocalStore::evictLeastRecentlyUsed(
+    KeySpace /* keySpace */,
+    uint64_t /* maxSizeBytes */) {
+  return 0;
+}
+
+uint64_t LocalStore::getApproximateMemoryUsage() const {
+  return 0;
+}
+
 StoreResult LocalStore::get(KeySpace keySpace, const Hash& id) const {
   return get(keySpace, id.getBytes());
 }
@@ -169,30 +395,162 @@ folly::Future<std::vector<StoreResult>> LocalStore::getBatch(
 // or deserializeGitBlob().
 
 folly::Future<std::unique_ptr<Tree>> LocalStore::getTree(const Hash& id) const {
+  auto start = steady_clock::now();
   return getFuture(KeySpace::TreeFamily, id.getBytes())
-      .then([id](StoreResult&& data) {
+      .then([id, start, this](StoreResult&& data) {
+        stats_->recordGet(KeySpace::TreeFamily, start);
         if (!data.isValid()) {
           return std::unique_ptr<Tree>(nullptr);
         }
+        if (TreeView::isSerializedTree(data.bytes())) {
+          return TreeView{id, std::move(data)}.toTree();
+        }
         return deserializeGitTree(id, data.bytes());
       });
 }
 
+folly::Future<Optional<TreeView>> LocalStore::getTreeView(
+    const Hash& id) const {
+  auto start = steady_clock::now();
+  return getFuture(KeySpace::TreeFamily, id.getBytes())
+      .then([id, start, this](StoreResult&& data) -> Optional<TreeView> {
+        stats_->recordGet(KeySpace::TreeFamily, start);
+        if (!data.isValid()) {
+          return folly::none;
+        }
+        if (TreeView::isSerializedTree(data.bytes())) {
+          return TreeView{id, std::move(data)};
+        }
+
+        // Trees stored in git's format have to be converted.
+        auto tree = deserializeGitTree(id, data.bytes());
+        auto serialized = TreeView::serialize(*tree);
+        if (!serialized) {
+          throw std::invalid_argument(folly::sformat(
+              "Tree {} cannot be viewed: a name is too long", id.toString()));
+        }
+        return TreeView{
+            id, StoreResult{serialized->moveToFbString().toStdString()}};
+      });
+}
+
 folly::Future<std::unique_ptr<Blob>> LocalStore::getBlob(const Hash& id) const {
+  auto start = steady_clock::now();
   return getFuture(KeySpace::BlobFamily, id.getBytes())
-      .then([id](StoreResult&& data) {
-        if (!data.isValid()) {
-          return std::unique_ptr<Blob>(nullptr);
+      .then([id, start, this](
+                StoreResult&& data) -> folly::Future<unique_ptr<Blob>> {
+        stats_->recordGet(KeySpace::BlobFamily, start);
+        if (data.isValid()) {
+          auto contentSha1 = parseBlobContentReference(data.bytes());
+          if (!contentSha1) {
+            auto buf = data.extractIOBuf();
+            return deserializeGitBlob(id, &buf);
+          }
+
+          // The contents are shared with any other blobs that have the same
+          // SHA-1.  If they have been evicted, treat the blob as missing so
+          // that it is fetched again.
+          auto contentStart = steady_clock::now();
+          return getFuture(KeySpace::BlobContentFamily, contentSha1->getBytes())
+              .then([id, contentSha1 = *contentSha1, contentStart, this](
+                        StoreResult&& content) {
+                stats_->recordGet(KeySpace::BlobContentFamily, contentStart);
+                if (!content.isValid()) {
+                  return unique_ptr<Blob>(nullptr);
+                }
+                return std::make_unique<Blob>(
+                    id, decodeBlobContent(contentSha1, std::move(content)));
+              });
         }
-        auto buf = data.extractIOBuf();
-        return deserializeGitBlob(id, &buf);
+
+        // The blob may have been stored in pieces by putBlobChunks().  Its
+        // metadata tells us how many chunks to look for.
+        return getBlobMetadata(id).then(
+            [id, this](Optional<BlobMetadata>&& metadata) {
+              if (!metadata.hasValue() || metadata->size == 0) {
+                return folly::makeFuture(unique_ptr<Blob>(nullptr));
+              }
+              return getBlobRange(id, metadata->size, 0, metadata->size)
+                  .then([id](unique_ptr<IOBuf> contents) {
+                    if (!contents) {
+                      return unique_ptr<Blob>(nullptr);
+                    }
+                    return std::make_unique<Blob>(id, std::move(*contents));
+                  });
+            });
+      });
+}
+
+folly::Future<unique_ptr<IOBuf>> LocalStore::getBlobRange(
+    const Hash& id,
+    uint64_t blobSize,
+    uint64_t offset,
+    size_t length) const {
+  if (offset >= blobSize || length == 0) {
+    return folly::makeFuture(IOBuf::create(0));
+  }
+  auto end = std::min<uint64_t>(blobSize, offset + length);
+  auto firstChunk = offset / kBlobChunkSize;
+  auto lastChunk = (end - 1) / kBlobChunkSize;
+
+  std::vector<BlobChunkKey> chunkKeys;
+  std::vector<ByteRange> keys;
+  for (auto index = firstChunk; index <= lastChunk; ++index) {
+    chunkKeys.emplace_back(id, index);
+  }
+  for (const auto& key : chunkKeys) {
+    keys.push_back(key.slice());
+  }
+
+  stats_->blobChunkBatchSize.addValue(keys.size());
+  auto start = steady_clock::now();
+  return getBatch(KeySpace::BlobChunkFamily, keys)
+      .then([id, blobSize, offset, end, firstChunk, start, this](
+                std::vector<StoreResult>&& chunks) -> unique_ptr<IOBuf> {
+        stats_->recordGet(KeySpace::BlobChunkFamily, start);
+        unique_ptr<IOBuf> result;
+        uint64_t chunkStart = firstChunk * kBlobChunkSize;
+        for (auto& chunk : chunks) {
+          if (!chunk.isValid()) {
+            return nullptr;
+          }
+          auto buf = std::make_unique<IOBuf>(chunk.extractIOBuf());
+          auto expectedLength =
+              std::min<uint64_t>(kBlobChunkSize, blobSize - chunkStart);
+          if (buf->length() != expectedLength) {
+            throw std::invalid_argument(folly::sformat(
+                "chunk {} of blob {} had unexpected size {}, expected {}",
+                chunkStart / kBlobChunkSize,
+                id.toString(),
+                buf->length(),
+                expectedLength));
+          }
+
+          // Only the first and last chunks extend outside of the range.
+          auto chunkEnd = chunkStart + buf->length();
+          if (offset > chunkStart) {
+            buf->trimStart(offset - chunkStart);
+          }
+          if (chunkEnd > end) {
+            buf->trimEnd(chunkEnd - end);
+          }
+          if (result) {
+            result->prependChain(std::move(buf));
+          } else {
+            result = std::move(buf);
+          }
+          chunkStart = chunkEnd;
+        }
+        return result;
       });
 }
 
 folly::Future<Optional<BlobMetadata>> LocalStore::getBlobMetadata(
     const Hash& id) const {
+  auto start = steady_clock::now();
   return getFuture(KeySpace::BlobMetaDataFamily, id.getBytes())
-      .then([id](StoreResult&& data) -> Optional<BlobMetadata> {
+      .then([id, start, this](StoreResult&& data) -> Optional<BlobMetadata> {
+        stats_->recordGet(KeySpace::BlobMetaDataFamily, start);
         if (!data.isValid()) {
           return folly::none;
         } else {
@@ -202,23 +560,41 @@ folly::Future<Optional<BlobMetadata>> LocalStore::getBlobMetadata(
 }
 
 std::pair<Hash, folly::IOBuf> LocalStore::serializeTree(const Tree* tree) {
+  auto id = tree->getHash();
+  auto treeBuf = TreeView::serialize(*tree);
+  if (treeBuf && id != Hash()) {
+    return std::make_pair(id, std::move(treeBuf).value());
+  }
+
+  // Trees without an ID are identified by the SHA-1 of their git tree
+  // object, so they still need to be serialized that way.
   GitTreeSerializer serializer;
   for (auto& entry : tree->getTreeEntries()) {
-    serializer.addEntry(std::move(entry));
+    serializer.addEntry(entry);
   }
-  IOBuf treeBuf = serializer.finalize();
-
-  auto id = tree->getHash();
+  IOBuf gitTreeBuf = serializer.finalize();
   if (id == Hash()) {
-    id = Hash::sha1(&treeBuf);
+    id = Hash::sha1(&gitTreeBuf);
   }
-  return std::make_pair(id, treeBuf);
+  return std::make_pair(
+      id, treeBuf ? std::move(treeBuf).value() : std::move(gitTreeBuf));
 }
 
 bool LocalStore::hasKey(KeySpace keySpace, const Hash& id) const {
   return hasKey(keySpace, id.getBytes());
 }
 
+std::vector<bool> LocalStore::hasKeyBatch(
+    KeySpace keySpace,
+    const std::vector<folly::ByteRange>& keys) const {
+  std::vector<bool> results;
+  results.reserve(keys.size());
+  for (const auto& key : keys) {
+    results.push_back(hasKey(keySpace, key));
+  }
+  return results;
+}
+
 Hash LocalStore::putTree(const Tree* tree) {
   auto serialized = LocalStore::serializeTree(tree);
   ByteRange treeData = serialized.second.coalesce();
@@ -243,17 +619,37 @@ BlobMetadata LocalStore::putBlob(const Hash& id, const Blob* blob) {
   // Pre-allocate a buffer of approximately the right size; it
   // needs to hold the blob content plus have room for a couple of
   // hashes for the keys, plus some padding.
+  auto start = steady_clock::now();
   auto batch = beginWrite(blob->getContents().computeChainDataLength() + 64);
   auto result = batch->putBlob(id, blob);
   batch->flush();
+  stats_->recordPut(KeySpace::BlobFamily, start);
+  return result;
+}
+
+BlobMetadata LocalStore::putBlobChunks(const Hash& id, const Blob* blob) {
+  auto start = steady_clock::now();
+  auto batch = beginWrite(blob->getContents().computeChainDataLength() + 64);
+  auto result = batch->putBlobChunks(id, blob);
+  batch->flush();
+  stats_->recordPut(KeySpace::BlobChunkFamily, start);
   return result;
 }
 
+void LocalStore::putBlobMetadata(
+    const Hash& id,
+    const BlobMetadata& metadata) {
+  SerializedBlobMetadata metadataBytes(metadata);
+  put(KeySpace::BlobMetaDataFamily, id, metadataBytes.slice());
+}
+
 void LocalStore::put(
     LocalStore::KeySpace keySpace,
     const Hash& id,
     folly::ByteRange value) {
+  auto start = steady_clock::now();
   put(keySpace, id.getBytes(), value);
+  stats_->recordPut(keySpace, start);
 }
 
 void LocalStore::WriteBatch::put(
@@ -263,40 +659,140 @@ void LocalStore::WriteBatch::put(
   put(keySpace, id.getBytes(), value);
 }
 
+void LocalStore::WriteBatch::putBlobMetadata(
+    const Hash& id,
+    const BlobMetadata& metadata) {
+  SerializedBlobMetadata metadataBytes(metadata);
+  put(KeySpace::BlobMetaDataFamily, id, metadataBytes.slice());
+}
+
 BlobMetadata LocalStore::WriteBatch::putBlob(const Hash& id, const Blob* blob) {
   const IOBuf& contents = blob->getContents();
 
   BlobMetadata metadata{Hash::sha1(&contents),
                         contents.computeChainDataLength()};
+  putBlobData(id, contents, metadata);
+  return metadata;
+}
+
+std::vector<BlobMetadata> LocalStore::WriteBatch::putBlobs(
+    const std::vector<const Blob*>& blobs) {
+  std::vector<const IOBuf*> contents;
+  contents.reserve(blobs.size());
+  for (const auto* blob : blobs) {
+    contents.push_back(&blob->getContents());
+  }
+  auto sha1s = Hash::sha1Batch(folly::range(contents));
+
+  std::vector<BlobMetadata> results;
+  results.reserve(blobs.size());
+  for (size_t n = 0; n < blobs.size(); ++n) {
+    BlobMetadata metadata{sha1s[n], contents[n]->computeChainDataLength()};
+    putBlobData(blobs[n]->getHash(), *contents[n], metadata);
+    results.push_back(metadata);
+  }
+  return results;
+}
 
+void LocalStore::WriteBatch::putBlobData(
+    const Hash& id,
+    const IOBuf& contents,
+    const BlobMetadata& metadata) {
   SerializedBlobMetadata metadataBytes(metadata);
 
   auto hashSlice = id.getBytes();
 
-  // Add a git-style blob prefix
-  auto prefix = folly::to<string>("blob ", contents.computeChainDataLength());
-  prefix.push_back('\0');
-  std::vector<ByteRange> bodySlices;
-  bodySlices.emplace_back(StringPiece(prefix));
+  if (FLAGS_local_store_dedupe_blobs) {
+    putBlobContent(metadata.sha1, contents);
+
+    std::vector<ByteRange> referenceSlices;
+    referenceSlices.emplace_back(kBlobContentReferencePrefix);
+    referenceSlices.push_back(metadata.sha1.getBytes());
+    put(LocalStore::KeySpace::BlobFamily,
+        hashSlice,
+        std::move(referenceSlices));
+  } else {
+    // Add a git-style blob prefix
+    auto prefix = folly::to<string>("blob ", metadata.size);
+    prefix.push_back('\0');
+    std::vector<ByteRange> bodySlices;
+    bodySlices.emplace_back(StringPiece(prefix));
+    appendSlices(contents, bodySlices);
+
+    put(LocalStore::KeySpace::BlobFamily, hashSlice, bodySlices);
+  }
+  put(LocalStore::KeySpace::BlobMetaDataFamily,
+      hashSlice,
+      metadataBytes.slice());
+}
+
+void LocalStore::WriteBatch::putBlobContent(
+    const Hash& contentSha1,
+    const IOBuf& contents) {
+  // Compressing data that does not shrink only costs time when it is read,
+  // so such blobs are stored raw.
+  unique_ptr<IOBuf> compressed;
+  auto size = contents.computeChainDataLength();
+  if (FLAGS_local_store_compress_blobs_over > 0 &&
+      size >= FLAGS_local_store_compress_blobs_over &&
+      folly::io::hasCodec(kBlobCompressionCodec)) {
+    auto codec = folly::io::getCodec(kBlobCompressionCodec);
+    compressed = codec->compress(&contents);
+    if (compressed->computeChainDataLength() >= size) {
+      compressed.reset();
+    }
+  }
+
+  auto format = static_cast<uint8_t>(
+      compressed ? BlobContentFormat::Zstd : BlobContentFormat::Raw);
+  std::vector<ByteRange> slices;
+  slices.emplace_back(&format, 1);
+  appendSlices(compressed ? *compressed : contents, slices);
+  put(LocalStore::KeySpace::BlobContentFamily,
+      contentSha1.getBytes(),
+      std::move(slices));
+}
+
+BlobMetadata LocalStore::WriteBatch::putBlobChunks(
+    const Hash& id,
+    const Blob* blob) {
+  const IOBuf& contents = blob->getContents();
+
+  BlobMetadata metadata{Hash::sha1(&contents),
+                        contents.computeChainDataLength()};
 
-  // Add all of the IOBuf chunks
   Cursor cursor(&contents);
-  while (true) {
-    auto bytes = cursor.peekBytes();
-    if (bytes.empty()) {
-      break;
+  for (uint32_t index = 0; !cursor.isAtEnd(); ++index) {
+    // A chunk may span several of the IOBufs in the chain.
+    std::vector<ByteRange> chunkSlices;
+    size_t remaining = kBlobChunkSize;
+    while (remaining > 0) {
+      auto bytes = cursor.peekBytes().subpiece(0, remaining);
+      if (bytes.empty()) {
+        break;
+      }
+      chunkSlices.push_back(bytes);
+      cursor.skip(bytes.size());
+      remaining -= bytes.size();
     }
-    bodySlices.push_back(bytes);
-    cursor.skip(bytes.size());
+
+    BlobChunkKey key(id, index);
+    put(LocalStore::KeySpace::BlobChunkFamily,
+        key.slice(),
+        std::move(chunkSlices));
   }
 
-  put(LocalStore::KeySpace::BlobFamily, hashSlice, bodySlices);
+  SerializedBlobMetadata metadataBytes(metadata);
   put(LocalStore::KeySpace::BlobMetaDataFamily,
-      hashSlice,
+      id.getBytes(),
       metadataBytes.slice());
   return metadata;
 }
 
+folly::Future<folly::Unit> LocalStore::WriteBatch::flushAsync() {
+  return folly::makeFutureWith([this] { flush(); });
+}
+
 LocalStore::WriteBatch::~WriteBatch() {}
 LocalStore::~LocalStore() {}
 
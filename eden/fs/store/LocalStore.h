@@ -10,7 +10,12 @@
 #pragma once
 
 #include <folly/Range.h>
+#include <folly/Synchronized.h>
+#include <folly/io/async/Request.h>
+#include <map>
 #include <memory>
+#include <string>
+#include <vector>
 #ifndef EDEN_WIN
 #include "eden/fs/rocksdb/RocksHandles.h"
 #endif
@@ -18,10 +23,12 @@
 #include "eden/fs/utils/PathFuncs.h"
 
 namespace folly {
+class IOBuf;
 template <typename T>
 class Optional;
 template <typename T>
 class Future;
+struct Unit;
 } // namespace folly
 
 namespace facebook {
@@ -29,8 +36,10 @@ namespace eden {
 
 class Blob;
 class Hash;
+class LocalStoreStats;
 class StoreResult;
 class Tree;
+class TreeView;
 
 /*
  * LocalStore stores objects (trees and blobs) locally on disk.
@@ -51,6 +60,7 @@ class Tree;
  */
 class LocalStore {
  public:
+  LocalStore();
   virtual ~LocalStore();
 
   /**
@@ -65,10 +75,59 @@ class LocalStore {
     TreeFamily = 3,
     HgProxyHashFamily = 4,
     HgCommitToTreeFamily = 5,
+    BlobChunkFamily = 6,
+    BlobContentFamily = 7,
+    PathIndexFamily = 8,
+    TreeDiffFamily = 9,
 
     End, // must be last!
   };
 
+  /**
+   * Returns true if the contents of keySpace can be recomputed or re-fetched
+   * from the BackingStore, and so may be discarded, or written without the
+   * durability guarantees the other KeySpaces need.
+   */
+  static bool isEphemeral(KeySpace keySpace);
+
+  /**
+   * Returns the name used for keySpace in stats, such as "blob_metadata".
+   */
+  static folly::StringPiece getKeySpaceName(KeySpace keySpace);
+
+  /**
+   * The size of the pieces that putBlobChunks() splits blobs into.  Each
+   * chunk is stored under the blob ID followed by the chunk's index.
+   */
+  static constexpr size_t kBlobChunkSize = 1024 * 1024;
+
+  /**
+   * Marks the reads made while it is in scope as part of a bulk scan, such
+   * as diffing two commits or building a PathIndex, rather than the point
+   * lookups that serve interactive requests.
+   *
+   * Storage engines with a block cache read the data for scans without
+   * inserting it into the cache, so that a scan doesn't evict the blocks
+   * that FUSE lookups depend on, and read ahead when iterating.  The hint is
+   * kept in the folly RequestContext, so it also applies to the futures
+   * started in the scope.
+   */
+  class ScanScope {
+   public:
+    ScanScope();
+
+    ScanScope(const ScanScope&) = delete;
+    ScanScope& operator=(const ScanScope&) = delete;
+
+   private:
+    folly::ShallowCopyRequestContextScopeGuard guard_;
+  };
+
+  /**
+   * Returns true if the current request is in a ScanScope.
+   */
+  static bool isScanning();
+
   /**
    * Close the underlying store.
    */
@@ -101,6 +160,62 @@ class LocalStore {
    */
   virtual void compactKeySpace(KeySpace keySpace) = 0;
 
+  /**
+   * Remove the least recently read entries from the given KeySpace until its
+   * approximate on-disk size is no more than maxSizeBytes, and return the
+   * number of entries removed.
+   *
+   * This must only be used on KeySpaces whose contents can be re-fetched from
+   * the BackingStore.  Stores that do not track reads do not support this;
+   * the default implementation removes nothing.
+   */
+  virtual uint64_t evictLeastRecentlyUsed(
+      KeySpace keySpace,
+      uint64_t maxSizeBytes);
+
+  /**
+   * Returns an estimate of the memory the storage engine is using for
+   * caches and write buffers, in bytes.
+   *
+   * The default implementation returns 0, for stores that keep nothing
+   * significant in memory or cannot tell.
+   */
+  virtual uint64_t getApproximateMemoryUsage() const;
+
+  /**
+   * Add the latencies recorded since the last call to ServiceData.
+   *
+   * This records the non-virtual helpers below, named
+   * "local_store.<key space>.get_us" and "local_store.<key space>.put_us",
+   * so it applies to every storage engine alike.  The LocalStore is shared
+   * by all of the mounts, so these are process-wide.
+   */
+  void aggregateStats();
+
+  /**
+   * Recompute the storage engine's internal statistics, such as its cache
+   * hit counts and the on-disk size of each KeySpace, and publish them to
+   * ServiceData as "local_store.<name>".
+   *
+   * Computing these may touch every file in the store, so EdenServer calls
+   * this periodically on a background thread rather than on each read.
+   */
+  void refreshEngineStats();
+
+  /**
+   * Returns the statistics computed by the most recent call to
+   * refreshEngineStats(), keyed by name without the "local_store." prefix.
+   */
+  std::map<std::string, int64_t> getEngineStats() const;
+
+  /**
+   * Compute the statistics published by refreshEngineStats().  Most callers
+   * want getEngineStats() instead, which does not recompute them.
+   *
+   * The default implementation returns none.
+   */
+  virtual std::map<std::string, int64_t> computeEngineStats() const;
+
   /**
    * Get arbitrary unserialized data from the store.
    *
@@ -129,6 +244,15 @@ class LocalStore {
    */
   folly::Future<std::unique_ptr<Tree>> getTree(const Hash& id) const;
 
+  /**
+   * Get a read-only view of a tree in the store, which refers to the stored
+   * data rather than copying each entry.  This is cheaper than getTree() for
+   * callers that only need to walk the tree once.
+   *
+   * Returns folly::none if this key is not present in the store.
+   */
+  folly::Future<folly::Optional<TreeView>> getTreeView(const Hash& id) const;
+
   /**
    * Get a Blob from the store.
    *
@@ -140,6 +264,22 @@ class LocalStore {
    */
   folly::Future<std::unique_ptr<Blob>> getBlob(const Hash& id) const;
 
+  /**
+   * Read length bytes starting at offset from a blob that was stored with
+   * putBlobChunks(), reading only the chunks that cover that range.
+   *
+   * blobSize is the size of the whole blob, as reported by its BlobMetadata.
+   * The result is truncated at the end of the blob, and is empty if offset is
+   * past the end.
+   *
+   * Returns nullptr if any of the needed chunks are not present in the store.
+   */
+  folly::Future<std::unique_ptr<folly::IOBuf>> getBlobRange(
+      const Hash& id,
+      uint64_t blobSize,
+      uint64_t offset,
+      size_t length) const;
+
   /**
    * Get the size of a blob and the SHA-1 hash of its contents.
    *
@@ -152,6 +292,9 @@ class LocalStore {
   /**
    * Compute the serialized version of the tree.
    * Returns the key and the (not coalesced) serialized data.
+   * If the tree has no hash, the key is the SHA-1 of its git tree object,
+   * although the data is stored in LocalStore's own, faster to parse,
+   * format.
    * This does not modify the contents of the store; it is the method
    * used by the putTree method to compute the data that it stores.
    * This is useful when computing the overall set of data during a
@@ -164,6 +307,20 @@ class LocalStore {
   virtual bool hasKey(KeySpace keySpace, folly::ByteRange key) const = 0;
   bool hasKey(KeySpace keySpace, const Hash& id) const;
 
+  /**
+   * Test whether each of a set of keys is stored.
+   *
+   * Returns a vector with one entry per key, which is true if the
+   * corresponding key is present.  The default implementation simply calls
+   * hasKey() for each key; storage engines that can check many keys at once
+   * more cheaply override it.
+   *
+   * May throw exceptions on error.
+   */
+  virtual std::vector<bool> hasKeyBatch(
+      KeySpace keySpace,
+      const std::vector<folly::ByteRange>& keys) const;
+
   /**
    * Store a Tree into the TreeFamily KeySpace.
    *
@@ -174,11 +331,35 @@ class LocalStore {
   /**
    * Store a Blob.
    *
+   * When --local_store_dedupe_blobs is set, the contents are stored once in
+   * the BlobContentFamily KeySpace under their SHA-1, and the BlobFamily
+   * entry for id only refers to them, so blobs with the same contents share
+   * their storage.  Contents of at least --local_store_compress_blobs_over
+   * bytes are also compressed.
+   *
    * Returns a BlobMetadata about the blob, which includes the SHA-1 hash of
    * its contents.
    */
   BlobMetadata putBlob(const Hash& id, const Blob* blob);
 
+  /**
+   * Store a Blob as a series of kBlobChunkSize pieces in the BlobChunkFamily
+   * KeySpace, so that getBlobRange() can later read parts of it without
+   * loading the whole blob.  getBlob() reassembles blobs stored this way.
+   *
+   * Returns a BlobMetadata about the blob, which includes the SHA-1 hash of
+   * its contents.
+   */
+  BlobMetadata putBlobChunks(const Hash& id, const Blob* blob);
+
+  /**
+   * Store the metadata for a blob without storing its contents.
+   *
+   * This is used when the BackingStore can report a blob's metadata without
+   * the blob itself, so that later metadata lookups can be answered locally.
+   */
+  void putBlobMetadata(const Hash& id, const BlobMetadata& metadata);
+
   /**
    * Put arbitrary data in the store.
    */
@@ -218,6 +399,26 @@ class LocalStore {
      */
     BlobMetadata putBlob(const Hash& id, const Blob* blob);
 
+    /**
+     * Store many Blobs, each under its own hash.
+     *
+     * This is the same as calling putBlob() for each of them, but computes
+     * their SHA-1s together, which is cheaper when importing many small
+     * files.  Returns their metadata in the same order.
+     */
+    std::vector<BlobMetadata> putBlobs(const std::vector<const Blob*>& blobs);
+
+    /**
+     * Store a Blob as a series of chunks.  See LocalStore::putBlobChunks().
+     */
+    BlobMetadata putBlobChunks(const Hash& id, const Blob* blob);
+
+    /**
+     * Store the metadata of a blob that is not itself being stored.  See
+     * LocalStore::putBlobMetadata().
+     */
+    void putBlobMetadata(const Hash& id, const BlobMetadata& metadata);
+
     /**
      * Put arbitrary data in the store.
      */
@@ -236,9 +437,22 @@ class LocalStore {
 
     /**
      * Flush any pending data to the store.
+     *
+     * When this returns, everything put into this batch (including data
+     * handed off earlier by flushAsync() or automatic flushes) is visible to
+     * readers of the store.
      */
     virtual void flush() = 0;
 
+    /**
+     * Hand any pending data off to be written to the store, and return a
+     * Future that completes once it has been written.
+     *
+     * The batch is empty and may be reused as soon as this returns.  The
+     * default implementation simply calls flush().
+     */
+    FOLLY_NODISCARD virtual folly::Future<folly::Unit> flushAsync();
+
     // Forbidden copy construction/assignment; allow only moves
     WriteBatch(const WriteBatch&) = delete;
     WriteBatch(WriteBatch&&) = default;
@@ -249,6 +463,21 @@ class LocalStore {
 
    private:
     friend class LocalStore;
+
+    /**
+     * Store the contents of a blob in the BlobContentFamily KeySpace, under
+     * their SHA-1.
+     */
+    void putBlobContent(const Hash& contentSha1, const folly::IOBuf& contents);
+
+    /**
+     * Store the contents and metadata of a blob whose metadata has already
+     * been computed.
+     */
+    void putBlobData(
+        const Hash& id,
+        const folly::IOBuf& contents,
+        const BlobMetadata& metadata);
   };
 
   /**
@@ -261,6 +490,10 @@ class LocalStore {
    * destruction either.
    */
   virtual std::unique_ptr<WriteBatch> beginWrite(size_t bufSize = 0) = 0;
+
+ private:
+  std::unique_ptr<LocalStoreStats> stats_;
+  folly::Synchronized<std::map<std::string, int64_t>> engineStats_;
 };
 } // namespace eden
 } // namespace facebook
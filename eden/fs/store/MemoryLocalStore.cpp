@@ -9,6 +9,8 @@
  */
 #include "eden/fs/store/MemoryLocalStore.h"
 #include <folly/String.h>
+#include <folly/futures/Future.h>
+#include <folly/hash/Hash.h>
 #include "eden/fs/store/StoreResult.h"
 namespace facebook {
 namespace eden {
@@ -58,14 +60,28 @@ class MemoryWriteBatch : public LocalStore::WriteBatch {
 };
 } // namespace
 
-MemoryLocalStore::MemoryLocalStore() {
-  storage_->resize(KeySpace::End);
+MemoryLocalStore::MemoryLocalStore(uint64_t maxEphemeralBytes)
+    : maxEphemeralBytes_{maxEphemeralBytes} {}
+
+MemoryLocalStore::SynchronizedShard& MemoryLocalStore::getShard(
+    KeySpace keySpace,
+    folly::ByteRange key) const {
+  auto hash = folly::hash::fnv64_buf(key.data(), key.size());
+  return storage_[keySpace][hash % kNumShards];
 }
 
 void MemoryLocalStore::close() {}
 
 void MemoryLocalStore::clearKeySpace(KeySpace keySpace) {
-  (*storage_.wlock())[keySpace].clear();
+  for (auto& shard : storage_[keySpace]) {
+    auto locked = shard.wlock();
+    if (maxEphemeralBytes_ > 0 && isEphemeral(keySpace)) {
+      ephemeralBytes_.fetch_sub(locked->totalBytes);
+    }
+    locked->entries.clear();
+    locked->insertionOrder.clear();
+    locked->totalBytes = 0;
+  }
 }
 
 void MemoryLocalStore::compactKeySpace(KeySpace) {}
@@ -73,27 +89,82 @@ void MemoryLocalStore::compactKeySpace(KeySpace) {}
 StoreResult MemoryLocalStore::get(
     LocalStore::KeySpace keySpace,
     folly::ByteRange key) const {
-  auto store = storage_.rlock();
-  auto it = (*store)[keySpace].find(StringPiece(key));
-  if (it == (*store)[keySpace].end()) {
+  auto shard = getShard(keySpace, key).rlock();
+  auto it = shard->entries.find(StringPiece(key));
+  if (it == shard->entries.end()) {
     return StoreResult();
   }
   return StoreResult(std::string(it->second));
 }
 
+folly::Future<std::vector<StoreResult>> MemoryLocalStore::getBatch(
+    KeySpace keySpace,
+    const std::vector<folly::ByteRange>& keys) const {
+  std::vector<StoreResult> results;
+  results.reserve(keys.size());
+  for (const auto& key : keys) {
+    results.push_back(get(keySpace, key));
+  }
+  return folly::makeFuture(std::move(results));
+}
+
 bool MemoryLocalStore::hasKey(
     LocalStore::KeySpace keySpace,
     folly::ByteRange key) const {
-  auto store = storage_.rlock();
-  auto it = (*store)[keySpace].find(StringPiece(key));
-  return it != (*store)[keySpace].end();
+  auto shard = getShard(keySpace, key).rlock();
+  return shard->entries.find(StringPiece(key)) != shard->entries.end();
+}
+
+std::vector<bool> MemoryLocalStore::hasKeyBatch(
+    LocalStore::KeySpace keySpace,
+    const std::vector<folly::ByteRange>& keys) const {
+  std::vector<bool> results;
+  results.reserve(keys.size());
+  for (const auto& key : keys) {
+    results.push_back(hasKey(keySpace, key));
+  }
+  return results;
 }
 
 void MemoryLocalStore::put(
     LocalStore::KeySpace keySpace,
     folly::ByteRange key,
     folly::ByteRange value) {
-  (*storage_.wlock())[keySpace][StringPiece(key)] = StringPiece(value).str();
+  const bool bounded = maxEphemeralBytes_ > 0 && isEphemeral(keySpace);
+  auto shard = getShard(keySpace, key).wlock();
+
+  int64_t sizeDelta = value.size();
+  auto it = shard->entries.find(StringPiece(key));
+  if (it != shard->entries.end()) {
+    sizeDelta -= it->second.size();
+    it->second = StringPiece(value).str();
+  } else {
+    shard->entries.emplace(StringPiece(key), StringPiece(value).str());
+    sizeDelta += key.size();
+    if (bounded) {
+      shard->insertionOrder.emplace_back(StringPiece(key).str());
+    }
+  }
+  shard->totalBytes += sizeDelta;
+  if (!bounded) {
+    return;
+  }
+
+  // The limit applies to all ephemeral shards together, but each put only
+  // evicts from its own shard.  Busier shards therefore give up more
+  // entries.  Never evict the entry that was just stored.
+  auto totalBytes = ephemeralBytes_.fetch_add(sizeDelta) + sizeDelta;
+  while (totalBytes > static_cast<int64_t>(maxEphemeralBytes_) &&
+         shard->insertionOrder.size() > 1) {
+    auto oldest = shard->entries.find(shard->insertionOrder.front());
+    if (oldest != shard->entries.end()) {
+      int64_t size = oldest->first.size() + oldest->second.size();
+      shard->totalBytes -= size;
+      totalBytes = ephemeralBytes_.fetch_sub(size) - size;
+      shard->entries.erase(oldest);
+    }
+    shard->insertionOrder.pop_front();
+  }
 }
 
 std::unique_ptr<LocalStore::WriteBatch> MemoryLocalStore::beginWrite(size_t) {
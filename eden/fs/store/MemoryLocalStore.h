@@ -10,6 +10,9 @@
 #pragma once
 #include <folly/Synchronized.h>
 #include <folly/experimental/StringKeyedUnorderedMap.h>
+#include <array>
+#include <atomic>
+#include <deque>
 #include "eden/fs/store/LocalStore.h"
 
 namespace facebook {
@@ -17,20 +20,37 @@ namespace eden {
 
 /** An implementation of LocalStore that stores values in memory.
  * Stored values remain in memory for the lifetime of the
- * MemoryLocalStore instance.
+ * MemoryLocalStore instance, unless a size limit is configured.
  * MemoryLocalStore is thread safe, allowing concurrent reads and
  * writes from any thread.
+ *
+ * Each KeySpace is split into independently locked shards selected by a hash
+ * of the key, so that concurrent accesses to different keys rarely contend.
  * */
 class MemoryLocalStore : public LocalStore {
  public:
-  MemoryLocalStore();
+  static constexpr size_t kNumShards = 32;
+
+  /**
+   * If maxEphemeralBytes is non-zero, the total size of the keys and values
+   * stored in ephemeral KeySpaces (see LocalStore::isEphemeral()) is kept
+   * under that limit by evicting the oldest entries.  Entries in the other
+   * KeySpaces cannot be re-fetched and are never evicted.
+   */
+  explicit MemoryLocalStore(uint64_t maxEphemeralBytes = 0);
   void close() override;
   void clearKeySpace(KeySpace keySpace) override;
   void compactKeySpace(KeySpace keySpace) override;
   StoreResult get(LocalStore::KeySpace keySpace, folly::ByteRange key)
       const override;
+  FOLLY_NODISCARD folly::Future<std::vector<StoreResult>> getBatch(
+      KeySpace keySpace,
+      const std::vector<folly::ByteRange>& keys) const override;
   bool hasKey(LocalStore::KeySpace keySpace, folly::ByteRange key)
       const override;
+  std::vector<bool> hasKeyBatch(
+      LocalStore::KeySpace keySpace,
+      const std::vector<folly::ByteRange>& keys) const override;
   void put(
       LocalStore::KeySpace keySpace,
       folly::ByteRange key,
@@ -39,7 +59,25 @@ class MemoryLocalStore : public LocalStore {
       size_t bufSize = 0) override;
 
  private:
-  folly::Synchronized<std::vector<folly::StringKeyedUnorderedMap<std::string>>>
+  struct Shard {
+    folly::StringKeyedUnorderedMap<std::string> entries;
+    /**
+     * Keys in the order they were inserted.  Only maintained for shards that
+     * are subject to eviction.
+     */
+    std::deque<std::string> insertionOrder;
+    uint64_t totalBytes{0};
+  };
+  using SynchronizedShard = folly::Synchronized<Shard>;
+
+  SynchronizedShard& getShard(KeySpace keySpace, folly::ByteRange key) const;
+
+  /** The size limit for the ephemeral KeySpaces; 0 if there is none. */
+  const uint64_t maxEphemeralBytes_;
+  /** The total size of the ephemeral KeySpaces, if they are bounded. */
+  std::atomic<int64_t> ephemeralBytes_{0};
+
+  mutable std::array<std::array<SynchronizedShard, kNumShards>, KeySpace::End>
       storage_;
 };
 
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/NegativeCache.h"
+
+#include <folly/hash/Hash.h>
+#include <algorithm>
+
+namespace facebook {
+namespace eden {
+
+NegativeCache::NegativeCache(std::chrono::milliseconds ttl, size_t maxEntries)
+    : ttl_{ttl}, entries_{std::max<size_t>(maxEntries, 1)} {}
+
+bool NegativeCache::contains(LocalStore::KeySpace keySpace, const Hash& id) {
+  if (ttl_.count() <= 0) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  Key key{keySpace, id};
+  auto it = entries_.findWithoutPromotion(key);
+  if (it == entries_.end()) {
+    return false;
+  }
+  if (Clock::now() >= it->second) {
+    entries_.erase(key);
+    return false;
+  }
+  hitCount_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void NegativeCache::insert(LocalStore::KeySpace keySpace, const Hash& id) {
+  if (ttl_.count() <= 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  entries_.set(Key{keySpace, id}, Clock::now() + ttl_);
+}
+
+void NegativeCache::clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  entries_.clear();
+}
+
+size_t NegativeCache::size() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return entries_.size();
+}
+
+size_t NegativeCache::KeyHasher::operator()(const Key& key) const {
+  return folly::hash::hash_combine(
+      static_cast<uint8_t>(key.keySpace), key.id.getHashCode());
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/container/EvictingCacheMap.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/store/LocalStore.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * NegativeCache remembers, for a short period of time, object IDs that the
+ * BackingStore reported as not existing.
+ *
+ * Looking up a missing object is expensive: it generally requires a round trip
+ * to the backing store (for instance to the hg_import_helper.py process).  Some
+ * tools repeatedly probe for objects that do not exist, and the NegativeCache
+ * lets the ObjectStore answer those repeated requests without going back to the
+ * BackingStore each time.
+ *
+ * Entries expire after a fixed TTL, and the cache also holds a bounded number
+ * of entries, evicting the least recently inserted ones first.  Since a pull
+ * may make previously missing objects available, callers should clear() the
+ * cache whenever they learn that new data has arrived.
+ *
+ * NegativeCache is thread-safe.
+ */
+class NegativeCache {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t kDefaultMaxEntries = 10000;
+
+  /**
+   * Create a NegativeCache whose entries expire ttl after being inserted.
+   * A ttl of 0 disables negative caching.
+   */
+  explicit NegativeCache(
+      std::chrono::milliseconds ttl,
+      size_t maxEntries = kDefaultMaxEntries);
+
+  /**
+   * Returns true if the given object is known not to exist.
+   */
+  bool contains(LocalStore::KeySpace keySpace, const Hash& id);
+
+  /**
+   * Record that the given object does not exist.
+   */
+  void insert(LocalStore::KeySpace keySpace, const Hash& id);
+
+  /**
+   * Forget everything that is known about missing objects.
+   */
+  void clear();
+
+  /**
+   * Get the number of lookups that were answered by the cache.
+   */
+  uint64_t getHitCount() const {
+    return hitCount_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Get the number of entries currently in the cache.  This may include
+   * entries that have expired but have not been removed yet.
+   */
+  size_t size() const;
+
+ private:
+  struct Key {
+    LocalStore::KeySpace keySpace;
+    Hash id;
+
+    bool operator==(const Key& other) const {
+      return keySpace == other.keySpace && id == other.id;
+    }
+  };
+  struct KeyHasher {
+    size_t operator()(const Key& key) const;
+  };
+
+  const std::chrono::milliseconds ttl_;
+  mutable std::mutex lock_;
+  folly::EvictingCacheMap<Key, Clock::time_point, KeyHasher> entries_;
+  std::atomic<uint64_t> hitCount_{0};
+};
+
+} // namespace eden
+} // namespace facebook
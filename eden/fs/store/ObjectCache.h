@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <folly/container/F14Map.h>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "eden/fs/model/Hash.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * ObjectCache is an in-memory cache of immutable source control objects
+ * (Trees or Blobs), keyed by their ID.
+ *
+ * The cache is bounded by the total size in bytes of the objects it holds, as
+ * reported by ObjectType::getSizeBytes(), rather than by the number of
+ * entries.  Once the limit is exceeded the least-recently-used objects are
+ * evicted.
+ *
+ * The cache is split into a number of independently locked shards so that
+ * concurrent lookups of different objects do not all contend on one lock.
+ * Each shard receives an equal fraction of the total size budget.
+ *
+ * ObjectCache is thread-safe.
+ */
+template <typename ObjectType>
+class ObjectCache {
+ public:
+  using ObjectPtr = std::shared_ptr<const ObjectType>;
+
+  static constexpr size_t kDefaultNumShards = 16;
+
+  struct Stats {
+    uint64_t hitCount{0};
+    uint64_t missCount{0};
+    uint64_t evictionCount{0};
+    uint64_t objectCount{0};
+    uint64_t totalSizeBytes{0};
+  };
+
+  /**
+   * Create an ObjectCache that holds at most maximumCacheSizeBytes worth of
+   * objects.  A maximum size of 0 disables caching entirely.
+   */
+  explicit ObjectCache(
+      size_t maximumCacheSizeBytes,
+      size_t numShards = kDefaultNumShards)
+      : shardSizeLimit_{maximumCacheSizeBytes /
+                        std::max<size_t>(numShards, 1)},
+        shards_(std::max<size_t>(numShards, 1)) {}
+
+  ObjectCache(const ObjectCache&) = delete;
+  ObjectCache& operator=(const ObjectCache&) = delete;
+
+  /**
+   * Look up an object by ID.
+   *
+   * Returns nullptr if the object is not present in the cache.
+   */
+  ObjectPtr get(const Hash& id) {
+    auto state = getShard(id).lock();
+    auto it = state->index.find(id);
+    if (it == state->index.end()) {
+      ++state->missCount;
+      return nullptr;
+    }
+    ++state->hitCount;
+    // Move this entry to the front of the LRU list.
+    state->lru.splice(state->lru.begin(), state->lru, it->second);
+    return *it->second;
+  }
+
+  /**
+   * Insert an object into the cache, evicting older entries as necessary to
+   * stay within the size limit.
+   *
+   * Objects that are larger than a single shard's budget are not cached.
+   */
+  void insert(ObjectPtr object) {
+    const auto size = object->getSizeBytes();
+    if (size > shardSizeLimit_) {
+      return;
+    }
+
+    const auto& id = object->getHash();
+    auto state = getShard(id).lock();
+    auto it = state->index.find(id);
+    if (it != state->index.end()) {
+      state->lru.splice(state->lru.begin(), state->lru, it->second);
+      return;
+    }
+
+    state->lru.push_front(std::move(object));
+    state->index.emplace(id, state->lru.begin());
+    state->totalSize += size;
+
+    while (state->totalSize > shardSizeLimit_) {
+      auto& oldest = state->lru.back();
+      state->totalSize -= oldest->getSizeBytes();
+      state->index.erase(oldest->getHash());
+      state->lru.pop_back();
+      ++state->evictionCount;
+    }
+  }
+
+  /**
+   * Remove all objects from the cache.
+   *
+   * The hit, miss, and eviction counters are left untouched.
+   */
+  void clear() {
+    for (auto& shard : shards_) {
+      auto state = shard.lock();
+      state->index.clear();
+      state->lru.clear();
+      state->totalSize = 0;
+    }
+  }
+
+  /**
+   * Get a snapshot of the cache statistics, summed across all shards.
+   */
+  Stats getStats() const {
+    Stats stats;
+    for (const auto& shard : shards_) {
+      auto state = shard.lock();
+      stats.hitCount += state->hitCount;
+      stats.missCount += state->missCount;
+      stats.evictionCount += state->evictionCount;
+      stats.objectCount += state->index.size();
+      stats.totalSizeBytes += state->totalSize;
+    }
+    return stats;
+  }
+
+ private:
+  struct ShardState {
+    /**
+     * Objects ordered from most recently used (front) to least recently used
+     * (back).
+     */
+    std::list<ObjectPtr> lru;
+    folly::F14FastMap<Hash, typename std::list<ObjectPtr>::iterator> index;
+    size_t totalSize{0};
+
+    uint64_t hitCount{0};
+    uint64_t missCount{0};
+    uint64_t evictionCount{0};
+  };
+  using Shard = folly::Synchronized<ShardState, std::mutex>;
+
+  Shard& getShard(const Hash& id) {
+    // The index uses the first bytes of the hash, so pick the shard from the
+    // last one.  Otherwise every ID in a shard would share the low bits that
+    // the index uses to place them.
+    return shards_[id.getBytes()[Hash::RAW_SIZE - 1] % shards_.size()];
+  }
+
+  const size_t shardSizeLimit_;
+  std::vector<Shard> shards_;
+};
+
+} // namespace eden
+} // namespace facebook
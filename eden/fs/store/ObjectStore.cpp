@@ -12,14 +12,22 @@
 #include <folly/Conv.h>
 #include <folly/Optional.h>
 #include <folly/futures/Future.h>
+#include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/logging/xlog.h>
+#include <algorithm>
 #include <stdexcept>
 
 #include "eden/fs/model/Blob.h"
 #include "eden/fs/model/Tree.h"
 #include "eden/fs/store/BackingStore.h"
 #include "eden/fs/store/LocalStore.h"
+#include "eden/fs/store/NegativeCache.h"
+#include "eden/fs/store/StoreStats.h"
+#include "eden/fs/store/TreeDiffCache.h"
+#include "eden/fs/store/TreeSnapshot.h"
+#include "eden/fs/utils/ProcessAccessLog.h"
+#include "eden/fs/utils/TraceBuffer.h"
 
 using folly::Future;
 using folly::IOBuf;
@@ -27,48 +35,164 @@ using folly::makeFuture;
 using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
+using KeySpace = facebook::eden::LocalStore::KeySpace;
 
 DEFINE_bool(
     reverify_empty_files,
     true,
     "Perform extra verification of file contents for empty files.");
+DEFINE_int32(
+    tree_diff_cache_entries,
+    100000,
+    "How many diffs between pairs of trees each mount keeps in memory, so "
+    "that repeated and overlapping commit diffs skip the subtrees they have "
+    "already compared.  0 disables the cache.");
+DEFINE_bool(
+    tree_diff_cache_in_local_store,
+    false,
+    "Also keep the diffs between pairs of trees in the LocalStore, so that "
+    "they survive eviction from memory and restarts.");
 
 namespace facebook {
 namespace eden {
 
+namespace {
+// Symlink targets are short, so this holds tens of thousands of them.
+constexpr size_t kSymlinkTargetCacheSize = 4 * 1024 * 1024;
+
+unique_ptr<IOBuf> sliceBlob(const Blob& blob, uint64_t offset, size_t length) {
+  const auto& contents = blob.getContents();
+  folly::io::Cursor cursor(&contents);
+  if (!cursor.canAdvance(offset)) {
+    return IOBuf::create(0);
+  }
+  cursor.skip(offset);
+
+  // The slice may outlive the blob, so it can only share the blob's buffers
+  // if they are reference counted.
+  unique_ptr<IOBuf> result;
+  if (contents.isManaged()) {
+    cursor.cloneAtMost(result, length);
+  } else {
+    result = IOBuf::create(std::min(length, cursor.totalLength()));
+    result->append(cursor.pullAtMost(result->writableData(), length));
+  }
+  return result;
+}
+} // namespace
+
 ObjectStore::ObjectStore(
     shared_ptr<LocalStore> localStore,
-    shared_ptr<BackingStore> backingStore)
+    shared_ptr<BackingStore> backingStore,
+    shared_ptr<TreeCache> treeCache,
+    shared_ptr<BlobCache> blobCache,
+    shared_ptr<NegativeCache> negativeCache,
+    folly::StringPiece statsPrefix,
+    shared_ptr<const TreeSnapshot> treeSnapshot)
     : localStore_(std::move(localStore)),
-      backingStore_(std::move(backingStore)) {}
+      backingStore_(std::move(backingStore)),
+      stats_(std::make_shared<BackingStoreStats>(statsPrefix)),
+      treeCache_(std::move(treeCache)),
+      blobCache_(std::move(blobCache)),
+      symlinkTargets_(
+          std::make_shared<SymlinkTargetCache>(kSymlinkTargetCacheSize)),
+      treeDiffs_(
+          FLAGS_tree_diff_cache_entries > 0
+              ? std::make_unique<TreeDiffCache>(
+                    FLAGS_tree_diff_cache_entries,
+                    FLAGS_tree_diff_cache_in_local_store ? localStore_
+                                                         : nullptr)
+              : nullptr),
+      negativeCache_(std::move(negativeCache)),
+      treeSnapshot_(std::move(treeSnapshot)),
+      hotTrees_(std::make_shared<HotObjectTracker>()),
+      hotBlobs_(std::make_shared<HotObjectTracker>()) {}
 
 ObjectStore::~ObjectStore() {}
 
-Future<shared_ptr<const Tree>> ObjectStore::getTree(const Hash& id) const {
+void ObjectStore::aggregateStats() {
+  stats_->aggregate();
+}
+
+Future<shared_ptr<const Tree>> ObjectStore::getTree(
+    const Hash& id,
+    ImportPriority priority) const {
+  // Check the in-memory cache first
+  if (treeCache_) {
+    if (auto tree = treeCache_->get(id)) {
+      XLOG(DBG4) << "tree " << id << " found in memory cache";
+      hotTrees_->record(id, true);
+      return makeFuture(std::move(tree));
+    }
+  }
+  // The snapshot is memory-mapped, so reading from it is cheap enough to do
+  // inline.
+  if (treeSnapshot_) {
+    if (auto snapshotTree = treeSnapshot_->getTree(id)) {
+      XLOG(DBG4) << "tree " << id << " found in tree snapshot";
+      hotTrees_->record(id, true);
+      auto tree = shared_ptr<const Tree>(std::move(snapshotTree));
+      if (treeCache_) {
+        treeCache_->insert(tree);
+      }
+      return makeFuture(std::move(tree));
+    }
+  }
+  if (negativeCache_ && negativeCache_->contains(KeySpace::TreeFamily, id)) {
+    XLOG(DBG4) << "tree " << id << " found in negative cache";
+    return makeFuture<shared_ptr<const Tree>>(std::domain_error(
+        folly::to<string>("tree ", id.toString(), " not found")));
+  }
+
+  // If another caller is already loading this tree, share the result of
+  // that load rather than starting a duplicate one.  Not all tree lookups go
+  // through the inode layer (e.g., globbing and diffing source control trees),
+  // so we cannot rely on it to de-duplicate loads for us.
+  return pendingTreeLoads_.load(id, [&] { return loadTree(id, priority); });
+}
+
+Future<shared_ptr<const Tree>> ObjectStore::loadTree(
+    const Hash& id,
+    ImportPriority priority) const {
   // Check in the LocalStore first
   return localStore_->getTree(id).then(
-      [id, backingStore = backingStore_](shared_ptr<const Tree> tree) {
+      [id,
+       priority,
+       backingStore = backingStore_,
+       stats = stats_,
+       treeCache = treeCache_,
+       negativeCache = negativeCache_,
+       hotTrees = hotTrees_](shared_ptr<const Tree> tree) {
+        hotTrees->record(id, tree != nullptr);
         if (tree) {
           XLOG(DBG4) << "tree " << id << " found in local store";
+          TraceBuffer::record(
+              TraceEventKind::LOCAL_STORE_HIT,
+              TracePhase::INSTANT,
+              static_cast<uint64_t>(KeySpace::TreeFamily));
+          if (treeCache) {
+            treeCache->insert(tree);
+          }
           return makeFuture(std::move(tree));
         }
 
-        // Note: We don't currently have logic here to avoid duplicate work if
-        // multiple callers request the same tree at once.  We could store a map
-        // of pending lookups as (Hash --> std::list<Promise<unique_ptr<Tree>>),
-        // and just add a new Promise to the list if this Hash already exists in
-        // the pending list.
-        //
-        // However, de-duplication of object loads will already be done at the
-        // Inode layer.  Therefore we currently don't bother de-duping loads at
-        // this layer.
-
         // Load the tree from the BackingStore.
-        return backingStore->getTree(id).then(
-            [id](unique_ptr<const Tree> loadedTree) {
+        TraceBuffer::record(
+            TraceEventKind::LOCAL_STORE_MISS,
+            TracePhase::INSTANT,
+            static_cast<uint64_t>(KeySpace::TreeFamily));
+        ProcessAccessLog::recordCurrentTreeFetch();
+        return BackingStoreStats::track(
+                   stats,
+                   &BackingStoreStats::getTree,
+                   [&] { return backingStore->getTree(id, priority); })
+            .then([id, treeCache, negativeCache](
+                      unique_ptr<const Tree> loadedTree) {
               if (!loadedTree) {
-                // TODO: Perhaps we should do some short-term negative caching?
                 XLOG(DBG2) << "unable to find tree " << id;
+                if (negativeCache) {
+                  negativeCache->insert(KeySpace::TreeFamily, id);
+                }
                 throw std::domain_error(
                     folly::to<string>("tree ", id.toString(), " not found"));
               }
@@ -79,44 +203,174 @@ Future<shared_ptr<const Tree>> ObjectStore::getTree(const Hash& id) const {
               //
               // localStore_->putTree(loadedTree.get());
               XLOG(DBG3) << "tree " << id << " retrieved from backing store";
-              return shared_ptr<const Tree>(std::move(loadedTree));
+              auto tree = shared_ptr<const Tree>(std::move(loadedTree));
+              if (treeCache) {
+                treeCache->insert(tree);
+              }
+              return tree;
             });
       });
 }
 
-Future<shared_ptr<const Blob>> ObjectStore::getBlob(const Hash& id) const {
+Future<shared_ptr<const Blob>> ObjectStore::getBlob(
+    const Hash& id,
+    ImportPriority priority) const {
+  // Check the in-memory cache first.  Empty blobs are only inserted into the
+  // cache after they have been verified, so a cache hit never needs to be
+  // re-verified.
+  if (blobCache_) {
+    if (auto blob = blobCache_->get(id)) {
+      XLOG(DBG4) << "blob " << id << " found in memory cache";
+      hotBlobs_->record(id, true);
+      return makeFuture(std::move(blob));
+    }
+  }
+  if (negativeCache_ && negativeCache_->contains(KeySpace::BlobFamily, id)) {
+    XLOG(DBG4) << "blob " << id << " found in negative cache";
+    return makeFuture<shared_ptr<const Blob>>(std::domain_error(
+        folly::to<string>("blob ", id.toString(), " not found")));
+  }
+
+  return pendingBlobLoads_.load(id, [&] { return loadBlob(id, priority); });
+}
+
+Future<shared_ptr<const Blob>> ObjectStore::loadBlob(
+    const Hash& id,
+    ImportPriority priority) const {
   return localStore_->getBlob(id).then([id,
+                                        priority,
                                         localStore = localStore_,
-                                        backingStore = backingStore_](
+                                        backingStore = backingStore_,
+                                        stats = stats_,
+                                        blobCache = blobCache_,
+                                        negativeCache = negativeCache_,
+                                        hotBlobs = hotBlobs_](
                                            shared_ptr<const Blob> blob) {
+    hotBlobs->record(id, blob != nullptr);
     if (blob) {
+      TraceBuffer::record(
+          TraceEventKind::LOCAL_STORE_HIT,
+          TracePhase::INSTANT,
+          static_cast<uint64_t>(KeySpace::BlobFamily));
       if (FLAGS_reverify_empty_files && blob->getContents().empty()) {
         return backingStore->verifyEmptyBlob(id).thenValue(
-            [id, localStore, origBlob = std::move(blob)](
+            [id, localStore, blobCache, origBlob = std::move(blob)](
                 std::unique_ptr<Blob> updatedBlob) mutable {
+              shared_ptr<const Blob> result;
               if (!updatedBlob) {
-                return shared_ptr<const Blob>(std::move(origBlob));
+                result = std::move(origBlob);
+              } else {
+                localStore->putBlob(id, updatedBlob.get());
+                result = std::move(updatedBlob);
+              }
+              if (blobCache) {
+                blobCache->insert(result);
               }
-              localStore->putBlob(id, updatedBlob.get());
-              return shared_ptr<const Blob>(std::move(updatedBlob));
+              return result;
             });
       }
       XLOG(DBG4) << "blob " << id << "  found in local store";
+      if (blobCache) {
+        blobCache->insert(blob);
+      }
       return makeFuture(shared_ptr<const Blob>(std::move(blob)));
     }
 
     // Look in the BackingStore
-    return backingStore->getBlob(id).then(
-        [localStore, id](unique_ptr<const Blob> loadedBlob) {
+    TraceBuffer::record(
+        TraceEventKind::LOCAL_STORE_MISS,
+        TracePhase::INSTANT,
+        static_cast<uint64_t>(KeySpace::BlobFamily));
+    return BackingStoreStats::track(
+               stats,
+               &BackingStoreStats::getBlob,
+               [&] { return backingStore->getBlob(id, priority); })
+        .then([localStore, blobCache, negativeCache, id](
+                  unique_ptr<const Blob> loadedBlob) {
           if (!loadedBlob) {
             XLOG(DBG2) << "unable to find blob " << id;
-            // TODO: Perhaps we should do some short-term negative caching?
+            if (negativeCache) {
+              negativeCache->insert(KeySpace::BlobFamily, id);
+            }
             throw std::domain_error(
                 folly::to<string>("blob ", id.toString(), " not found"));
           }
 
           XLOG(DBG3) << "blob " << id << "  retrieved from backing store";
+          ProcessAccessLog::recordCurrentBlobFetch(
+              loadedBlob->getContents().computeChainDataLength());
           localStore->putBlob(id, loadedBlob.get());
+          auto blob = shared_ptr<const Blob>(std::move(loadedBlob));
+          if (blobCache) {
+            blobCache->insert(blob);
+          }
+          return blob;
+        });
+  });
+}
+
+Future<unique_ptr<IOBuf>> ObjectStore::getBlobRange(
+    const Hash& id,
+    uint64_t blobSize,
+    uint64_t offset,
+    size_t length,
+    ImportPriority priority) const {
+  // If the whole blob is in memory anyway just use it.
+  if (blobCache_) {
+    if (auto blob = blobCache_->get(id)) {
+      return makeFuture(sliceBlob(*blob, offset, length));
+    }
+  }
+
+  return localStore_->getBlobRange(id, blobSize, offset, length)
+      .then([this, id, offset, length, priority](
+                unique_ptr<IOBuf> range) -> Future<unique_ptr<IOBuf>> {
+        if (range) {
+          return std::move(range);
+        }
+
+        XLOG(DBG3) << "chunks of blob " << id << " not found in local store";
+        return pendingBlobChunkLoads_
+            .load(id, [&] { return loadBlobChunks(id, priority); })
+            .thenValue([offset, length](shared_ptr<const Blob> blob) {
+              return sliceBlob(*blob, offset, length);
+            });
+      });
+}
+
+Future<shared_ptr<const Blob>> ObjectStore::loadBlobChunks(
+    const Hash& id,
+    ImportPriority priority) const {
+  return localStore_->getBlob(id).then([id,
+                                        priority,
+                                        localStore = localStore_,
+                                        backingStore = backingStore_,
+                                        stats = stats_,
+                                        negativeCache = negativeCache_](
+                                           unique_ptr<Blob> localBlob) {
+    if (localBlob) {
+      localStore->putBlobChunks(id, localBlob.get());
+      return makeFuture(shared_ptr<const Blob>(std::move(localBlob)));
+    }
+
+    return BackingStoreStats::track(
+               stats,
+               &BackingStoreStats::getBlob,
+               [&] { return backingStore->getBlob(id, priority); })
+        .then([localStore, negativeCache, id](
+                  unique_ptr<const Blob> loadedBlob) {
+          if (!loadedBlob) {
+            XLOG(DBG2) << "unable to find blob " << id;
+            if (negativeCache) {
+              negativeCache->insert(KeySpace::BlobFamily, id);
+            }
+            throw std::domain_error(
+                folly::to<string>("blob ", id.toString(), " not found"));
+          }
+
+          XLOG(DBG3) << "blob " << id << " retrieved from backing store "
+                     << "to be stored in chunks";
+          localStore->putBlobChunks(id, loadedBlob.get());
           return shared_ptr<const Blob>(std::move(loadedBlob));
         });
   });
@@ -124,30 +378,87 @@ Future<shared_ptr<const Blob>> ObjectStore::getBlob(const Hash& id) const {
 
 folly::Future<folly::Unit> ObjectStore::prefetchBlobs(
     const std::vector<Hash>& ids) const {
-  // In theory we could/should ask the localStore_ to filter the list
-  // of ids down to just the set that we need to load, but there is no
-  // bulk key existence check in rocksdb, so we would need to cause it
-  // to load all the blocks of those keys into memory.
-  // So for the moment we are committing a layering violation in the
-  // interest of making things faster in practice by just asking the
-  // mercurial backing store to ensure that its local hgcache storage
-  // has entries for all of the requested keys.
   if (ids.empty()) {
     return folly::unit;
   }
-  return backingStore_->prefetchBlobs(ids);
+
+  // Filter the list down to just the blobs that are not already present in
+  // the LocalStore, so that we only ask the BackingStore to fetch data that
+  // we actually need.
+  std::vector<folly::ByteRange> keys;
+  keys.reserve(ids.size());
+  for (const auto& id : ids) {
+    keys.push_back(id.getBytes());
+  }
+  // Checking which keys are present shouldn't push data that interactive
+  // reads depend on out of the LocalStore's caches.
+  LocalStore::ScanScope scan;
+  auto present = localStore_->hasKeyBatch(KeySpace::BlobFamily, keys);
+
+  std::vector<Hash> missing;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    if (!present[i]) {
+      missing.push_back(ids[i]);
+    }
+  }
+  XLOG(DBG3) << "prefetchBlobs: " << missing.size() << " of " << ids.size()
+             << " blobs not found in local store";
+
+  if (missing.empty()) {
+    return folly::unit;
+  }
+  return backingStore_->prefetchBlobs(missing);
+}
+
+folly::Future<folly::Unit> ObjectStore::prefetchTree(
+    const Hash& id,
+    size_t depth) const {
+  if (localStore_->hasKey(KeySpace::TreeFamily, id)) {
+    return folly::unit;
+  }
+  XLOG(DBG3) << "prefetchTree(" << id << ", depth=" << depth << ")";
+  return backingStore_->prefetchTree(id, depth);
 }
 
 Future<shared_ptr<const Tree>> ObjectStore::getTreeForCommit(
     const Hash& commitID) const {
   XLOG(DBG3) << "getTreeForCommit(" << commitID << ")";
 
-  return backingStore_->getTreeForCommit(commitID).then(
-      [commitID](std::shared_ptr<const Tree> tree) {
+  if (treeSnapshot_ && treeSnapshot_->getCommitID() == commitID) {
+    if (auto root = treeSnapshot_->getTree(treeSnapshot_->getRootTreeID())) {
+      XLOG(DBG4) << "commit " << commitID << " found in tree snapshot";
+      return makeFuture(shared_ptr<const Tree>(std::move(root)));
+    }
+  }
+
+  if (negativeCache_ &&
+      negativeCache_->contains(KeySpace::HgCommitToTreeFamily, commitID)) {
+    return makeFuture<shared_ptr<const Tree>>(std::domain_error(
+        folly::to<string>("unable to import commit ", commitID.toString())));
+  }
+
+  return BackingStoreStats::track(
+             stats_,
+             &BackingStoreStats::getTreeForCommit,
+             [&] { return backingStore_->getTreeForCommit(commitID); })
+      .then([commitID, treeCache = treeCache_, negativeCache = negativeCache_](
+                std::shared_ptr<const Tree> tree) {
         if (!tree) {
+          if (negativeCache) {
+            negativeCache->insert(KeySpace::HgCommitToTreeFamily, commitID);
+          }
           throw std::domain_error(folly::to<string>(
               "unable to import commit ", commitID.toString()));
         }
+        if (treeCache) {
+          treeCache->insert(tree);
+        }
+        if (negativeCache) {
+          // Successfully importing a commit is our signal that new data may
+          // have been pulled into the backing repository, which may make
+          // objects that were previously missing available now.
+          negativeCache->clear();
+        }
 
         // For now we assume that the BackingStore will insert the Tree into the
         // LocalStore on its own, so we don't have to update the LocalStore
@@ -157,8 +468,17 @@ Future<shared_ptr<const Tree>> ObjectStore::getTreeForCommit(
 }
 
 Future<BlobMetadata> ObjectStore::getBlobMetadata(const Hash& id) const {
+  if (negativeCache_ && negativeCache_->contains(KeySpace::BlobFamily, id)) {
+    return makeFuture<BlobMetadata>(std::domain_error(
+        folly::to<string>("blob ", id.toString(), " not found")));
+  }
+
   return localStore_->getBlobMetadata(id).then(
-      [id, localStore = localStore_, backingStore = backingStore_](
+      [id,
+       localStore = localStore_,
+       backingStore = backingStore_,
+       stats = stats_,
+       negativeCache = negativeCache_](
           folly::Optional<BlobMetadata>&& localData) {
         if (localData.hasValue()) {
           if (FLAGS_reverify_empty_files && localData.value().size == 0) {
@@ -175,22 +495,53 @@ Future<BlobMetadata> ObjectStore::getBlobMetadata(const Hash& id) const {
           }
         }
 
-        // Load the blob from the BackingStore.
-        //
-        // TODO: It would be nice to add a smarter API to the BackingStore so
-        // that we can query it just for the blob metadata if it supports
-        // getting that without retrieving the full blob data.
-        return backingStore->getBlob(id).then(
-            [localStore, id](std::unique_ptr<Blob> blob) {
-              if (!blob) {
-                // TODO: Perhaps we should do some short-term negative caching?
-                throw std::domain_error(
-                    folly::to<string>("blob ", id.toString(), " not found"));
+        // Ask the BackingStore for just the metadata first, and only fall
+        // back to loading the full blob if it cannot provide it.
+        return backingStore->getBlobMetadata(id).then(
+            [id, localStore, backingStore, stats, negativeCache](
+                folly::Optional<BlobMetadata>&& backingData) {
+              if (backingData.hasValue()) {
+                localStore->putBlobMetadata(id, backingData.value());
+                return makeFuture(backingData.value());
               }
 
-              return localStore->putBlob(id, blob.get());
+              return BackingStoreStats::track(
+                         stats,
+                         &BackingStoreStats::getBlob,
+                         [&] {
+                           return backingStore->getBlob(
+                               id, ImportPriority::Foreground);
+                         })
+                  .then([localStore, negativeCache, id](
+                            std::unique_ptr<Blob> blob) {
+                    if (!blob) {
+                      if (negativeCache) {
+                        negativeCache->insert(KeySpace::BlobFamily, id);
+                      }
+                      throw std::domain_error(folly::to<string>(
+                          "blob ", id.toString(), " not found"));
+                    }
+
+                    return localStore->putBlob(id, blob.get());
+                  });
             });
       });
 }
+
+Future<string> ObjectStore::getSymlinkTarget(const Hash& id) const {
+  if (auto target = symlinkTargets_->get(id)) {
+    return makeFuture(target->getTarget());
+  }
+  return getBlob(id, ImportPriority::Interactive)
+      .thenValue([id, symlinkTargets = symlinkTargets_](
+                     shared_ptr<const Blob> blob) {
+        const auto& contents = blob->getContents();
+        folly::io::Cursor cursor(&contents);
+        auto target = std::make_shared<SymlinkTarget>(
+            id, cursor.readFixedString(contents.computeChainDataLength()));
+        symlinkTargets->insert(target);
+        return target->getTarget();
+      });
+}
 } // namespace eden
 } // namespace facebook
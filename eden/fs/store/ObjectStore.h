@@ -9,17 +9,57 @@
  */
 #pragma once
 
+#include <folly/Range.h>
 #include <memory>
+#include "eden/fs/store/BlobCache.h"
 #include "eden/fs/store/IObjectStore.h"
+#include "eden/fs/store/ObjectCache.h"
+#include "eden/fs/utils/HotKeyTracker.h"
+#include "eden/fs/utils/PendingLoadMap.h"
+
+namespace folly {
+class IOBuf;
+} // namespace folly
 
 namespace facebook {
 namespace eden {
 
 class BackingStore;
+class BackingStoreStats;
 class Blob;
 class Hash;
 class LocalStore;
+class NegativeCache;
 class Tree;
+class TreeDiffCache;
+class TreeSnapshot;
+
+using TreeCache = ObjectCache<Tree>;
+
+/**
+ * The target of a symlink, as cached by ObjectStore::getSymlinkTarget().
+ */
+class SymlinkTarget {
+ public:
+  SymlinkTarget(const Hash& hash, std::string target)
+      : hash_{hash}, target_{std::move(target)} {}
+
+  const Hash& getHash() const {
+    return hash_;
+  }
+  const std::string& getTarget() const {
+    return target_;
+  }
+  size_t getSizeBytes() const {
+    return sizeof(SymlinkTarget) + target_.size();
+  }
+
+ private:
+  Hash hash_;
+  std::string target_;
+};
+
+using SymlinkTargetCache = ObjectCache<SymlinkTarget>;
 
 /**
  * ObjectStore is a content-addressed store for eden object data.
@@ -30,14 +70,46 @@ class Tree;
  * - BackingStore, which represents the authoritative source for the object
  *   data.  The BackingStore is generally more expensive to query for object
  *   data, and may not be available during offline operation.
+ *
+ * In front of the LocalStore the ObjectStore may also consult in-memory
+ * caches of recently used Tree and Blob objects, which avoids deserializing
+ * frequently accessed objects from the LocalStore over and over again.
  */
 class ObjectStore : public IObjectStore {
  public:
+  /**
+   * Create a new ObjectStore.
+   *
+   * treeCache and blobCache are optional.  They may be shared by multiple
+   * ObjectStores, and if they are null no in-memory caching is performed.
+   *
+   * negativeCache is also optional.  If present it is used to remember
+   * objects that the BackingStore reported as missing, so repeated requests
+   * for them fail quickly.
+   *
+   * The latency of the fetches this ObjectStore makes from the BackingStore
+   * is recorded in stats named with statsPrefix.  EdenServer passes the
+   * mount's EdenMount::getCounterName(CounterName::OBJECT_STORE), so that
+   * they are attributed to the mount even when the BackingStore is shared.
+   *
+   * treeSnapshot is optional as well.  Trees that it contains are read from
+   * it rather than from the LocalStore or BackingStore.
+   */
   ObjectStore(
       std::shared_ptr<LocalStore> localStore,
-      std::shared_ptr<BackingStore> backingStore);
+      std::shared_ptr<BackingStore> backingStore,
+      std::shared_ptr<TreeCache> treeCache = nullptr,
+      std::shared_ptr<BlobCache> blobCache = nullptr,
+      std::shared_ptr<NegativeCache> negativeCache = nullptr,
+      folly::StringPiece statsPrefix = "object_store",
+      std::shared_ptr<const TreeSnapshot> treeSnapshot = nullptr);
   ~ObjectStore() override;
 
+  /**
+   * Add the stats recorded since the last call to ServiceData.
+   */
+  void aggregateStats();
+
   /**
    * Get a Tree by ID.
    *
@@ -46,7 +118,8 @@ class ObjectStore : public IObjectStore {
    * exist, or possibly other exceptions on error.
    */
   folly::Future<std::shared_ptr<const Tree>> getTree(
-      const Hash& id) const override;
+      const Hash& id,
+      ImportPriority priority = ImportPriority::Foreground) const override;
 
   /**
    * Get a Blob by ID.
@@ -56,10 +129,23 @@ class ObjectStore : public IObjectStore {
    * exist, or possibly other exceptions on error.
    */
   folly::Future<std::shared_ptr<const Blob>> getBlob(
-      const Hash& id) const override;
+      const Hash& id,
+      ImportPriority priority = ImportPriority::Foreground) const override;
   folly::Future<folly::Unit> prefetchBlobs(
       const std::vector<Hash>& ids) const override;
 
+  /**
+   * Ask the BackingStore to fetch a tree and its subtrees down to depth
+   * levels below it, ahead of them being loaded with getTree().
+   *
+   * This does nothing if the tree is already in the LocalStore.  The
+   * BackingStore stores a tree's prefetched subtrees at the same time as the
+   * tree itself, so only the deepest prefetched level starts another
+   * prefetch when callers prefetch each subtree they are about to walk into.
+   */
+  folly::Future<folly::Unit> prefetchTree(const Hash& id, size_t depth)
+      const override;
+
   /**
    * Get a commit's root Tree.
    *
@@ -79,6 +165,33 @@ class ObjectStore : public IObjectStore {
    */
   folly::Future<BlobMetadata> getBlobMetadata(const Hash& id) const override;
 
+  /**
+   * Get the contents of a symlink's Blob as its target.
+   *
+   * Targets are kept in a small cache of their own, so that resolving paths
+   * through many symlinks does not depend on their Blobs staying in the
+   * blob cache.
+   */
+  folly::Future<std::string> getSymlinkTarget(const Hash& id) const;
+
+  /**
+   * Read up to length bytes starting at offset from a Blob, without loading
+   * the whole Blob into memory when it can be avoided.
+   *
+   * blobSize must be the size reported by getBlobMetadata().  The data is
+   * read from the chunks stored by LocalStore::putBlobChunks().  If they are
+   * not present the whole blob is fetched once from the BackingStore and
+   * stored in chunks, but it is not added to the in-memory blob cache.
+   *
+   * The result is empty if offset is at or past the end of the blob.
+   */
+  folly::Future<std::unique_ptr<folly::IOBuf>> getBlobRange(
+      const Hash& id,
+      uint64_t blobSize,
+      uint64_t offset,
+      size_t length,
+      ImportPriority priority = ImportPriority::Foreground) const;
+
   /**
    * Get the LocalStore used by this ObjectStore
    */
@@ -93,11 +206,64 @@ class ObjectStore : public IObjectStore {
     return backingStore_;
   }
 
+  /**
+   * Get the cache of differences between pairs of trees that diffs consult,
+   * or nullptr if --tree_diff_cache_entries is 0.
+   */
+  TreeDiffCache* getTreeDiffCache() const {
+    return treeDiffs_.get();
+  }
+
+  using HotObjectTracker = HotKeyTracker<Hash>;
+
+  /**
+   * Get the most frequently requested trees and blobs.  An access is a hit
+   * if the object was found in memory, the tree snapshot or the LocalStore,
+   * and a miss if it had to be fetched from the BackingStore.  Requests that
+   * join a load already in progress are not counted.
+   */
+  HotObjectTracker& getHotTrees() const {
+    return *hotTrees_;
+  }
+  HotObjectTracker& getHotBlobs() const {
+    return *hotBlobs_;
+  }
+
  private:
   // Forbidden copy constructor and assignment operator
   ObjectStore(ObjectStore const&) = delete;
   ObjectStore& operator=(ObjectStore const&) = delete;
 
+  /**
+   * Load a Tree from the LocalStore, or from the BackingStore if it is not
+   * present locally.  This does not consult the in-memory cache and does not
+   * de-duplicate concurrent requests; getTree() takes care of both.
+   */
+  folly::Future<std::shared_ptr<const Tree>> loadTree(
+      const Hash& id,
+      ImportPriority priority) const;
+
+  /**
+   * Load a Blob from the LocalStore, or from the BackingStore if it is not
+   * present locally.  This does not consult the in-memory cache and does not
+   * de-duplicate concurrent requests; getBlob() takes care of both.
+   *
+   * Note that a request that joins a load already in progress does not
+   * change the priority of that load.
+   */
+  folly::Future<std::shared_ptr<const Blob>> loadBlob(
+      const Hash& id,
+      ImportPriority priority) const;
+
+  /**
+   * Store a Blob in the LocalStore in chunks, for getBlobRange().  The blob
+   * is read from the LocalStore if it was stored whole already, or from the
+   * BackingStore otherwise.
+   */
+  folly::Future<std::shared_ptr<const Blob>> loadBlobChunks(
+      const Hash& id,
+      ImportPriority priority) const;
+
   /*
    * The LocalStore.
    *
@@ -111,6 +277,52 @@ class ObjectStore : public IObjectStore {
    * Multiple ObjectStores may share the same BackingStore.
    */
   std::shared_ptr<BackingStore> backingStore_;
+  /*
+   * Fetches from the BackingStore on behalf of this ObjectStore's mount.
+   * Shared with the continuations of those fetches, which may outlive it.
+   */
+  std::shared_ptr<BackingStoreStats> stats_;
+
+  /*
+   * In-memory caches of recently loaded objects.  Either may be null.
+   */
+  std::shared_ptr<TreeCache> treeCache_;
+  std::shared_ptr<BlobCache> blobCache_;
+
+  /*
+   * Recently read symlink targets.  Shared with the continuations of loads.
+   */
+  std::shared_ptr<SymlinkTargetCache> symlinkTargets_;
+
+  /*
+   * Differences between pairs of trees found by earlier diffs.  May be null.
+   */
+  std::unique_ptr<TreeDiffCache> treeDiffs_;
+
+  /*
+   * Recently requested objects that were not found.  May be null.
+   */
+  std::shared_ptr<NegativeCache> negativeCache_;
+
+  /*
+   * A read-only snapshot of the trees of a commit.  May be null.
+   */
+  std::shared_ptr<const TreeSnapshot> treeSnapshot_;
+
+  /*
+   * The most requested objects.  Shared with the continuations of loads.
+   */
+  std::shared_ptr<HotObjectTracker> hotTrees_;
+  std::shared_ptr<HotObjectTracker> hotBlobs_;
+
+  /*
+   * Loads that are currently in progress, so that concurrent requests for the
+   * same object share a single LocalStore/BackingStore fetch.
+   */
+  mutable PendingLoadMap<Hash, std::shared_ptr<const Tree>> pendingTreeLoads_;
+  mutable PendingLoadMap<Hash, std::shared_ptr<const Blob>> pendingBlobLoads_;
+  mutable PendingLoadMap<Hash, std::shared_ptr<const Blob>>
+      pendingBlobChunkLoads_;
 };
 } // namespace eden
 } // namespace facebook
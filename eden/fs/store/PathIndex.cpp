@@ -0,0 +1,391 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/PathIndex.h"
+
+#include <folly/Varint.h>
+#include <folly/futures/Future.h>
+#include <folly/logging/xlog.h>
+#include <algorithm>
+#include <stdexcept>
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/IObjectStore.h"
+#include "eden/fs/store/LocalStore.h"
+#include "eden/fs/store/ObjectStore.h"
+
+using folly::ByteRange;
+using folly::Future;
+using folly::StringPiece;
+using folly::Unit;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace facebook {
+namespace eden {
+
+constexpr uint8_t PathIndex::kVersion;
+
+namespace {
+void appendVarint(string& out, uint64_t value) {
+  uint8_t buf[folly::kMaxVarintLength64];
+  auto size = folly::encodeVarint(value, buf);
+  out.append(reinterpret_cast<const char*>(buf), size);
+}
+
+uint64_t readVarint(ByteRange& data) {
+  // decodeVarint() throws std::invalid_argument if the varint is truncated.
+  return folly::decodeVarint(data);
+}
+
+size_t sharedPrefixLength(StringPiece a, StringPiece b) {
+  size_t length = 0;
+  const auto limit = std::min(a.size(), b.size());
+  while (length < limit && a[length] == b[length]) {
+    ++length;
+  }
+  return length;
+}
+
+/**
+ * Compare the last suffixSize bytes of name with suffix, reading both
+ * backwards.  If name is shorter than the suffix, the whole of name is
+ * compared, and it sorts first if it ends the same way as the suffix.
+ *
+ * With suffixSize set to the larger of the two sizes, this orders strings by
+ * their reverse.  With it set to the size of a suffix, the names that end
+ * with the suffix compare equal to it, and form a range in that order.
+ */
+int compareReversed(StringPiece name, StringPiece suffix, size_t suffixSize) {
+  const auto limit = std::min({name.size(), suffix.size(), suffixSize});
+  for (size_t n = 1; n <= limit; ++n) {
+    auto a = static_cast<unsigned char>(name[name.size() - n]);
+    auto b = static_cast<unsigned char>(suffix[suffix.size() - n]);
+    if (a != b) {
+      return a < b ? -1 : 1;
+    }
+  }
+  auto nameSize = std::min(name.size(), suffixSize);
+  auto otherSize = std::min(suffix.size(), suffixSize);
+  return nameSize < otherSize ? -1 : (nameSize > otherSize ? 1 : 0);
+}
+
+bool isLiteral(StringPiece str) {
+  return str.find_first_of("*?[]{}\\") == StringPiece::npos;
+}
+
+struct IndexBuilder {
+  IndexBuilder(const IObjectStore* store, const Hash& rootTreeID)
+      : store{store}, rootTreeID{rootTreeID} {}
+
+  const IObjectStore* const store;
+  const Hash rootTreeID;
+  vector<string> paths;
+};
+
+using Directory = std::pair<RelativePath, Hash>;
+
+Future<Unit> addLevel(
+    shared_ptr<IndexBuilder> builder,
+    vector<Directory> dirs) {
+  if (dirs.empty()) {
+    return folly::makeFuture();
+  }
+  vector<Future<shared_ptr<const Tree>>> futures;
+  futures.reserve(dirs.size());
+  for (const auto& dir : dirs) {
+    futures.push_back(
+        builder->store->getTree(dir.second, ImportPriority::Background));
+  }
+  return folly::collect(futures).thenValue(
+      [builder, dirs = std::move(dirs)](vector<shared_ptr<const Tree>> trees) {
+        vector<Directory> next;
+        for (size_t n = 0; n < trees.size(); ++n) {
+          for (const auto& entry : trees[n]->getTreeEntries()) {
+            auto path = dirs[n].first + entry.getName();
+            if (entry.isTree()) {
+              next.emplace_back(std::move(path), entry.getHash());
+            } else {
+              builder->paths.push_back(std::move(path).value());
+            }
+          }
+        }
+        return addLevel(builder, std::move(next));
+      });
+}
+} // namespace
+
+bool PathIndex::Query::matches(RelativePathPiece path, bool includeDotfiles)
+    const {
+  auto rest = path.stringPiece();
+  if (!directory.empty()) {
+    auto dir = directory.stringPiece();
+    if (!rest.startsWith(dir) || rest.size() <= dir.size() ||
+        rest[dir.size()] != '/') {
+      return false;
+    }
+    rest.advance(dir.size() + 1);
+  }
+
+  auto slash = rest.rfind('/');
+  auto basename =
+      slash == StringPiece::npos ? rest : rest.subpiece(slash + 1);
+  if (isSuffix ? !basename.endsWith(name) : basename != name) {
+    return false;
+  }
+  if (!includeDotfiles) {
+    if (isSuffix && basename.startsWith('.')) {
+      return false;
+    }
+    if (slash != StringPiece::npos) {
+      auto dirs = rest.subpiece(0, slash);
+      if (dirs.startsWith('.') || dirs.find("/.") != StringPiece::npos) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+PathIndex PathIndex::fromPaths(const Hash& rootTreeID, vector<string> paths) {
+  std::sort(paths.begin(), paths.end());
+  paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+  PathIndex index{rootTreeID};
+  size_t total = 0;
+  for (const auto& path : paths) {
+    total += path.size();
+  }
+  index.data_.reserve(total);
+  index.offsets_.reserve(paths.size() + 1);
+  for (const auto& path : paths) {
+    index.data_.append(path);
+    index.offsets_.push_back(index.data_.size());
+  }
+  index.computeOrderings();
+  return index;
+}
+
+Future<shared_ptr<const PathIndex>> PathIndex::build(
+    const IObjectStore* store,
+    const Hash& rootTreeID) {
+  // Indexing walks every tree of the commit once.
+  LocalStore::ScanScope scan;
+  auto builder = std::make_shared<IndexBuilder>(store, rootTreeID);
+  vector<Directory> root;
+  root.emplace_back(RelativePath{}, rootTreeID);
+  return addLevel(builder, std::move(root)).thenValue([builder](Unit) {
+    XLOG(DBG3) << "indexed " << builder->paths.size() << " paths in tree "
+               << builder->rootTreeID;
+    return shared_ptr<const PathIndex>{std::make_shared<PathIndex>(
+        fromPaths(builder->rootTreeID, std::move(builder->paths)))};
+  });
+}
+
+Future<shared_ptr<const PathIndex>> PathIndex::getOrBuild(
+    ObjectStore* store,
+    const Hash& rootTreeID) {
+  auto localStore = store->getLocalStore();
+  return localStore
+      ->getFuture(LocalStore::PathIndexFamily, rootTreeID.getBytes())
+      .thenValue([store, localStore, rootTreeID](StoreResult data) {
+        if (data.isValid()) {
+          try {
+            return folly::makeFuture(
+                shared_ptr<const PathIndex>{std::make_shared<PathIndex>(
+                    deserialize(rootTreeID, data.bytes()))});
+          } catch (const std::invalid_argument& ex) {
+            XLOG(WARN) << "rebuilding the invalid path index of tree "
+                       << rootTreeID << ": " << ex.what();
+          }
+        }
+        return build(store, rootTreeID)
+            .thenValue([localStore](shared_ptr<const PathIndex> index) {
+              localStore->put(
+                  LocalStore::PathIndexFamily,
+                  index->getRootTreeID(),
+                  ByteRange{StringPiece{index->serialize()}});
+              return index;
+            });
+      });
+}
+
+folly::Optional<PathIndex::Query> PathIndex::parseGlob(StringPiece glob) {
+  constexpr StringPiece kRecursive{"**/"};
+  auto recursive = glob.find(kRecursive);
+  if (recursive == StringPiece::npos ||
+      (recursive > 0 && glob[recursive - 1] != '/')) {
+    return folly::none;
+  }
+  auto dir = recursive > 0 ? glob.subpiece(0, recursive - 1) : StringPiece{};
+  auto rest = glob.subpiece(recursive + kRecursive.size());
+
+  Query query;
+  if (rest.startsWith('*')) {
+    query.isSuffix = true;
+    rest.advance(1);
+  } else if (rest.empty() || rest == "." || rest == "..") {
+    return folly::none;
+  }
+  if (!isLiteral(dir) || !isLiteral(rest) || rest.contains('/')) {
+    return folly::none;
+  }
+  try {
+    query.directory = RelativePath{dir};
+  } catch (const std::domain_error&) {
+    return folly::none;
+  }
+  query.name = rest.str();
+  return query;
+}
+
+string PathIndex::serialize() const {
+  string out;
+  out.push_back(static_cast<char>(kVersion));
+  appendVarint(out, size());
+
+  StringPiece previous;
+  for (size_t n = 0; n < size(); ++n) {
+    auto path = getPath(n).stringPiece();
+    auto shared = sharedPrefixLength(previous, path);
+    appendVarint(out, shared);
+    appendVarint(out, path.size() - shared);
+    out.append(path.data() + shared, path.size() - shared);
+    previous = path;
+  }
+  for (auto index : byBasename_) {
+    appendVarint(out, index);
+  }
+  for (auto index : byReversedBasename_) {
+    appendVarint(out, index);
+  }
+  return out;
+}
+
+PathIndex PathIndex::deserialize(const Hash& rootTreeID, ByteRange data) {
+  if (data.empty() || data[0] != kVersion) {
+    throw std::invalid_argument("unsupported path index version");
+  }
+  data.advance(1);
+
+  PathIndex index{rootTreeID};
+  auto count = readVarint(data);
+  // Each path takes at least two bytes, which bounds the reservations.
+  if (count > data.size() / 2) {
+    throw std::invalid_argument("truncated path index");
+  }
+  index.offsets_.reserve(count + 1);
+  string path;
+  for (uint64_t n = 0; n < count; ++n) {
+    auto shared = readVarint(data);
+    auto restSize = readVarint(data);
+    if (shared > path.size() || restSize > data.size()) {
+      throw std::invalid_argument("truncated path index");
+    }
+    path.resize(shared);
+    path.append(reinterpret_cast<const char*>(data.data()), restSize);
+    data.advance(restSize);
+    if (n > 0 && StringPiece{path} <= index.getPath(n - 1).stringPiece()) {
+      throw std::invalid_argument("unsorted path index");
+    }
+    index.data_.append(path);
+    index.offsets_.push_back(index.data_.size());
+  }
+
+  auto readOrdering = [&](vector<uint32_t>& ordering) {
+    vector<bool> seen(count);
+    ordering.reserve(count);
+    for (uint64_t n = 0; n < count; ++n) {
+      auto value = readVarint(data);
+      if (value >= count || seen[value]) {
+        throw std::invalid_argument("invalid path index ordering");
+      }
+      seen[value] = true;
+      ordering.push_back(value);
+    }
+  };
+  readOrdering(index.byBasename_);
+  readOrdering(index.byReversedBasename_);
+  if (!data.empty()) {
+    throw std::invalid_argument("trailing data in path index");
+  }
+  return index;
+}
+
+vector<RelativePathPiece> PathIndex::search(
+    const Query& query,
+    bool includeDotfiles) const {
+  StringPiece name{query.name};
+  vector<uint32_t>::const_iterator begin;
+  vector<uint32_t>::const_iterator end;
+  if (query.isSuffix) {
+    auto compare = [&](uint32_t index) {
+      return compareReversed(getBasename(index), name, name.size());
+    };
+    begin = std::partition_point(
+        byReversedBasename_.begin(),
+        byReversedBasename_.end(),
+        [&](uint32_t index) { return compare(index) < 0; });
+    end = std::partition_point(
+        begin, byReversedBasename_.cend(), [&](uint32_t index) {
+          return compare(index) == 0;
+        });
+  } else {
+    begin = std::partition_point(
+        byBasename_.begin(), byBasename_.end(), [&](uint32_t index) {
+          return getBasename(index) < name;
+        });
+    end = std::partition_point(begin, byBasename_.cend(), [&](uint32_t index) {
+      return getBasename(index) == name;
+    });
+  }
+
+  vector<RelativePathPiece> results;
+  for (auto it = begin; it != end; ++it) {
+    auto path = getPath(*it);
+    if (query.matches(path, includeDotfiles)) {
+      results.push_back(path);
+    }
+  }
+  return results;
+}
+
+StringPiece PathIndex::getBasename(size_t index) const {
+  auto path = getPath(index).stringPiece();
+  auto slash = path.rfind('/');
+  return slash == StringPiece::npos ? path : path.subpiece(slash + 1);
+}
+
+void PathIndex::computeOrderings() {
+  byBasename_.resize(size());
+  for (uint32_t n = 0; n < byBasename_.size(); ++n) {
+    byBasename_[n] = n;
+  }
+  byReversedBasename_ = byBasename_;
+
+  // Ties are broken by path, which keeps the orderings deterministic.
+  std::sort(
+      byBasename_.begin(), byBasename_.end(), [&](uint32_t a, uint32_t b) {
+        auto cmp = getBasename(a).compare(getBasename(b));
+        return cmp < 0 || (cmp == 0 && a < b);
+      });
+  std::sort(
+      byReversedBasename_.begin(),
+      byReversedBasename_.end(),
+      [&](uint32_t a, uint32_t b) {
+        auto nameA = getBasename(a);
+        auto nameB = getBasename(b);
+        auto cmp = compareReversed(
+            nameA, nameB, std::max(nameA.size(), nameB.size()));
+        return cmp < 0 || (cmp == 0 && a < b);
+      });
+}
+
+} // namespace eden
+} // namespace facebook
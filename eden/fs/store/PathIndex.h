@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace folly {
+template <typename T>
+class Future;
+} // namespace folly
+
+namespace facebook {
+namespace eden {
+
+class IObjectStore;
+class ObjectStore;
+
+/**
+ * The paths of every file in a source control tree, indexed by basename, so
+ * that searches for every file with a given name (such as TARGETS) or
+ * extension (such as .thrift) do not have to walk the whole tree.
+ *
+ * Besides the sorted paths, the index keeps two orderings of them: one by
+ * basename, and one by basename read backwards.  Files with a given
+ * basename, or whose basename ends with a given suffix, form a range in one
+ * of these orderings, so a search takes O(log n + matches) time however
+ * large the tree is.
+ *
+ * An index describes a tree, not a working copy; callers combine it with
+ * the working copy's status to account for local changes.
+ *
+ * Indexes are stored in LocalStore's PathIndexFamily, keyed by the hash of
+ * the root tree.  The serialized format is:
+ * - format version (1 byte)
+ * - path count (varint)
+ * - for each path, in sorted order:
+ *   - the length of the prefix it shares with the previous path (varint)
+ *   - the length of the rest of the path (varint)
+ *   - the rest of the path
+ * - the indices of the paths ordered by basename (varints)
+ * - the indices of the paths ordered by reversed basename (varints)
+ *
+ * PathIndex is immutable, and can be used from multiple threads.
+ */
+class PathIndex {
+ public:
+  /**
+   * A search that the index can answer: the files anywhere below directory
+   * (which is empty for the whole tree) whose basename is name, or ends with
+   * name if isSuffix is set.
+   */
+  struct Query {
+    RelativePath directory;
+    std::string name;
+    bool isSuffix{false};
+
+    /**
+     * Returns true if path matches the query.  Unless includeDotfiles is
+     * set, the directories below the query's directory and a basename
+     * matched by a wildcard must not start with a '.', as in GlobNode.
+     */
+    bool matches(RelativePathPiece path, bool includeDotfiles) const;
+  };
+
+  PathIndex(PathIndex&&) = default;
+  PathIndex& operator=(PathIndex&&) = default;
+
+  /**
+   * Build an index of the given file paths.  Duplicates are ignored.
+   */
+  static PathIndex fromPaths(
+      const Hash& rootTreeID,
+      std::vector<std::string> paths);
+
+  /**
+   * Build an index of every file in the tree, fetching its subtrees with
+   * background priority.  The store must remain valid until the returned
+   * Future completes.
+   */
+  static folly::Future<std::shared_ptr<const PathIndex>> build(
+      const IObjectStore* store,
+      const Hash& rootTreeID);
+
+  /**
+   * Load the index of a tree from the store's LocalStore, or build it and
+   * save it there if it has not been built yet.
+   */
+  static folly::Future<std::shared_ptr<const PathIndex>> getOrBuild(
+      ObjectStore* store,
+      const Hash& rootTreeID);
+
+  /**
+   * Parse a glob that the index can answer: an optional directory, then a
+   * "**" component, then either a basename or "*" followed by a suffix.
+   * The directory, basename and suffix must not contain wildcards.
+   *
+   * Returns folly::none for any other glob.
+   */
+  static folly::Optional<Query> parseGlob(folly::StringPiece glob);
+
+  std::string serialize() const;
+
+  /**
+   * Throws std::invalid_argument if data is not a serialized index.
+   */
+  static PathIndex deserialize(const Hash& rootTreeID, folly::ByteRange data);
+
+  const Hash& getRootTreeID() const {
+    return rootTreeID_;
+  }
+
+  size_t size() const {
+    return offsets_.size() - 1;
+  }
+
+  RelativePathPiece getPath(size_t index) const {
+    return RelativePathPiece{
+        folly::StringPiece{data_.data() + offsets_[index],
+                           data_.data() + offsets_[index + 1]},
+        detail::SkipPathSanityCheck{}};
+  }
+
+  /**
+   * Returns the paths that match the query, in no particular order.
+   */
+  std::vector<RelativePathPiece> search(
+      const Query& query,
+      bool includeDotfiles) const;
+
+ private:
+  explicit PathIndex(const Hash& rootTreeID) : rootTreeID_{rootTreeID} {}
+
+  folly::StringPiece getBasename(size_t index) const;
+  void computeOrderings();
+
+  static constexpr uint8_t kVersion = 1;
+
+  Hash rootTreeID_;
+  /** The paths, concatenated in sorted order. */
+  std::string data_;
+  /** Where each path starts in data_, followed by data_.size(). */
+  std::vector<size_t> offsets_{0};
+  std::vector<uint32_t> byBasename_;
+  std::vector<uint32_t> byReversedBasename_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/futures/Future.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * Abstract interface for a key/value cache shared over the network, such as
+ * an HTTP or memcache-style cache in the datacenter, which a
+ * CachingBackingStore puts in front of a BackingStore.
+ *
+ * Implementations must be thread-safe.  Since this is only a cache, callers
+ * treat errors as misses, and implementations may drop writes.
+ */
+class RemoteObjectCache {
+ public:
+  virtual ~RemoteObjectCache() {}
+
+  /**
+   * Look up several keys in one request.
+   *
+   * Returns one entry per key, holding the value if the key was found and
+   * folly::none otherwise.
+   */
+  virtual folly::Future<std::vector<folly::Optional<std::string>>> multiGet(
+      const std::vector<std::string>& keys) = 0;
+
+  /**
+   * Store several key/value pairs in one request.
+   */
+  virtual folly::Future<folly::Unit> multiPut(
+      std::vector<std::pair<std::string, std::string>> entries) = 0;
+};
+} // namespace eden
+} // namespace facebook
@@ -10,16 +10,19 @@
 #include "eden/fs/store/RocksDbLocalStore.h"
 #include <folly/Format.h>
 #include <folly/Optional.h>
+#include <folly/ScopeGuard.h>
 #include <folly/String.h>
 #include <folly/futures/Future.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/lang/Bits.h>
 #include <folly/logging/xlog.h>
+#include <rocksdb/cache.h>
 #include <rocksdb/db.h>
 #include <rocksdb/filter_policy.h>
 #include <rocksdb/table.h>
 #include <array>
+#include <map>
 #include "eden/fs/rocksdb/RocksException.h"
 #include "eden/fs/rocksdb/RocksHandles.h"
 #include "eden/fs/store/StoreResult.h"
@@ -41,15 +44,80 @@ using std::unique_ptr;
 namespace {
 using namespace facebook::eden;
 
-rocksdb::ColumnFamilyOptions makeColumnOptions(uint64_t LRUblockCacheSizeMB) {
-  rocksdb::ColumnFamilyOptions options;
+// How far iterators read ahead during a LocalStore::ScanScope.
+constexpr size_t kScanReadaheadSize = 2 * 1024 * 1024;
+
+/**
+ * Get the ReadOptions for a read made by the current request.
+ */
+ReadOptions getReadOptions() {
+  ReadOptions options;
+  if (LocalStore::isScanning()) {
+    // A scan reads each block about once, so keep it from evicting the
+    // blocks that interactive lookups keep coming back to.
+    options.fill_cache = false;
+    options.readahead_size = kScanReadaheadSize;
+  }
+  return options;
+}
 
-  // We'll never perform range scans on any of the keys that we store.
-  // This enables bloom filters and a hash policy that improves our
-  // get/put performance.
-  options.OptimizeForPointLookup(LRUblockCacheSizeMB);
+rocksdb::CompressionType parseCompressionType(StringPiece name) {
+  if (name == "none") {
+    return rocksdb::kNoCompression;
+  } else if (name == "snappy") {
+    return rocksdb::kSnappyCompression;
+  } else if (name == "lz4") {
+    return rocksdb::kLZ4Compression;
+  } else if (name == "zstd") {
+    return rocksdb::kZSTD;
+  }
+  throw std::invalid_argument(folly::to<string>(
+      "unsupported RocksDB compression type: \"",
+      name,
+      "\"; expected one of none, snappy, lz4 or zstd"));
+}
 
-  options.OptimizeLevelStyleCompaction();
+rocksdb::ColumnFamilyOptions makeColumnOptions(
+    const RocksDbColumnProfile& profile,
+    std::shared_ptr<rocksdb::Cache> blockCache) {
+  rocksdb::ColumnFamilyOptions options;
+  options.OptimizeLevelStyleCompaction(profile.writeBufferSize * 4);
+  options.write_buffer_size = profile.writeBufferSize;
+
+  // We'll never perform range scans on any of the keys that we store, so
+  // whole-key bloom filters let most lookups for absent keys skip reading
+  // data blocks entirely.
+  rocksdb::BlockBasedTableOptions tableOptions;
+  tableOptions.block_cache = std::move(blockCache);
+  tableOptions.block_size = profile.blockSize;
+  tableOptions.whole_key_filtering = true;
+  tableOptions.cache_index_and_filter_blocks = true;
+  tableOptions.pin_l0_filter_and_index_blocks_in_cache = true;
+  // Use full filters rather than the legacy block-based ones; partitioned
+  // filters require them.
+  tableOptions.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
+  if (profile.partitionedIndex) {
+    tableOptions.index_type =
+        rocksdb::BlockBasedTableOptions::IndexType::kTwoLevelIndexSearch;
+    tableOptions.partition_filters = true;
+  }
+  options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(tableOptions));
+
+  // Apply the same compression at every level, rather than the per-level
+  // defaults chosen by OptimizeLevelStyleCompaction().
+  auto compression = parseCompressionType(profile.compression);
+  options.compression_per_level.clear();
+  options.compression = compression;
+  if (compression != rocksdb::kNoCompression &&
+      profile.compressionDictSize > 0) {
+    options.compression_opts.max_dict_bytes = profile.compressionDictSize;
+    if (compression == rocksdb::kZSTD) {
+      // Train the dictionary on a sample of the data rather than just using
+      // the leading bytes of the file.
+      options.compression_opts.zstd_max_train_bytes =
+          profile.compressionDictSize * 100;
+    }
+  }
   return options;
 }
 
@@ -57,31 +125,45 @@ rocksdb::ColumnFamilyOptions makeColumnOptions(uint64_t LRUblockCacheSizeMB) {
  * The different key spaces that we desire.
  * The ordering is coupled with the values of the LocalStore::KeySpace enum.
  */
-const std::vector<rocksdb::ColumnFamilyDescriptor>& columnFamilies() {
-  // Most of the column families will share the same cache.  We
+std::vector<rocksdb::ColumnFamilyDescriptor> columnFamilies(
+    const RocksDbTuning& tuning) {
+  // The tree and metadata column families share the same cache.  We
   // want the blob data to live in its own smaller cache; the assumption
   // is that the vfs cache will compensate for that, together with the
   // idea that we shouldn't need to materialize a great many files.
-  auto options = makeColumnOptions(64);
-  auto blobOptions = makeColumnOptions(8);
+  auto sharedCache = rocksdb::NewLRUCache(tuning.blockCacheSize);
+  auto blobOptions = makeColumnOptions(
+      tuning.blob, rocksdb::NewLRUCache(tuning.blobBlockCacheSize));
+  auto treeOptions = makeColumnOptions(tuning.tree, sharedCache);
+  auto metadataOptions = makeColumnOptions(tuning.metadata, sharedCache);
 
-  // Meyers singleton to avoid SIOF issues
-  static const std::vector<rocksdb::ColumnFamilyDescriptor> families{
+  return std::vector<rocksdb::ColumnFamilyDescriptor>{
       rocksdb::ColumnFamilyDescriptor{rocksdb::kDefaultColumnFamilyName,
-                                      options},
+                                      metadataOptions},
       rocksdb::ColumnFamilyDescriptor{"blob", blobOptions},
-      rocksdb::ColumnFamilyDescriptor{"blobmeta", options},
-      rocksdb::ColumnFamilyDescriptor{"tree", options},
-      rocksdb::ColumnFamilyDescriptor{"hgproxyhash", options},
-      rocksdb::ColumnFamilyDescriptor{"hgcommit2tree", options},
+      rocksdb::ColumnFamilyDescriptor{"blobmeta", metadataOptions},
+      rocksdb::ColumnFamilyDescriptor{"tree", treeOptions},
+      rocksdb::ColumnFamilyDescriptor{"hgproxyhash", metadataOptions},
+      rocksdb::ColumnFamilyDescriptor{"hgcommit2tree", metadataOptions},
+      rocksdb::ColumnFamilyDescriptor{"blobchunk", blobOptions},
+      rocksdb::ColumnFamilyDescriptor{"blobcontent", blobOptions},
+      rocksdb::ColumnFamilyDescriptor{"pathindex", metadataOptions},
+      rocksdb::ColumnFamilyDescriptor{"treediff", metadataOptions},
   };
-  return families;
 }
 
 rocksdb::Slice _createSlice(folly::ByteRange bytes) {
   return Slice(reinterpret_cast<const char*>(bytes.data()), bytes.size());
 }
 
+/**
+ * The maximum number of automatically flushed batches that a
+ * RocksDbWriteBatch lets queue up for the writer thread before the caller
+ * waits for the oldest one.  This bounds the amount of memory held by
+ * batches in flight.
+ */
+constexpr size_t kMaxPendingFlushes = 4;
+
 class RocksDbWriteBatch : public LocalStore::WriteBatch {
  public:
   void put(
@@ -93,63 +175,161 @@ class RocksDbWriteBatch : public LocalStore::WriteBatch {
       folly::ByteRange key,
       std::vector<folly::ByteRange> valueSlices) override;
   void flush() override;
+  folly::Future<folly::Unit> flushAsync() override;
   ~RocksDbWriteBatch();
   // Use LocalStore::beginWrite() to create a write batch
-  RocksDbWriteBatch(RocksHandles& dbHandles, size_t bufferSize);
+  RocksDbWriteBatch(
+      RocksHandles& dbHandles,
+      size_t bufferSize,
+      folly::Executor* writer,
+      bool disableEphemeralWAL);
 
   void flushIfNeeded();
 
+  /**
+   * Take the accumulated writes, leaving this batch empty, along with the
+   * options they should be written with.
+   */
+  std::pair<std::unique_ptr<rocksdb::WriteBatch>, WriteOptions> takeBatch();
+
+  static void write(
+      RocksHandles& dbHandles,
+      rocksdb::WriteBatch& batch,
+      const WriteOptions& options);
+
   RocksHandles& dbHandles_;
-  rocksdb::WriteBatch writeBatch_;
+  std::unique_ptr<rocksdb::WriteBatch> writeBatch_;
   size_t bufSize_;
-};
 
-void RocksDbWriteBatch::flush() {
-  auto pending = writeBatch_.Count();
-  if (pending == 0) {
-    return;
-  }
+  /**
+   * The thread on which batches are written, or nullptr to write them
+   * synchronously on the calling thread.
+   */
+  folly::Executor* writer_;
+  std::vector<folly::Future<folly::Unit>> pendingFlushes_;
+
+  const bool disableEphemeralWAL_;
+  /** Whether writeBatch_ holds any writes to a non-ephemeral KeySpace. */
+  bool hasPersistentWrites_{false};
+};
 
-  XLOG(DBG5) << "Flushing " << pending << " entries with data size of "
-             << writeBatch_.GetDataSize();
+void RocksDbWriteBatch::write(
+    RocksHandles& dbHandles,
+    rocksdb::WriteBatch& batch,
+    const WriteOptions& options) {
+  XLOG(DBG5) << "Flushing " << batch.Count() << " entries with data size of "
+             << batch.GetDataSize();
 
-  auto status = dbHandles_.db->Write(WriteOptions(), &writeBatch_);
+  auto status = dbHandles.db->Write(options, &batch);
   XLOG(DBG5) << "... Flushed";
 
   if (!status.ok()) {
     throw RocksException::build(
         status, "error putting blob batch in local store");
   }
+}
+
+std::pair<std::unique_ptr<rocksdb::WriteBatch>, WriteOptions>
+RocksDbWriteBatch::takeBatch() {
+  WriteOptions options;
+  // Writes that only touch data we can fetch again don't need to survive a
+  // crash, so skip the write-ahead log for them.
+  options.disableWAL = disableEphemeralWAL_ && !hasPersistentWrites_;
+  hasPersistentWrites_ = false;
+
+  auto batch = std::move(writeBatch_);
+  writeBatch_ = std::make_unique<rocksdb::WriteBatch>(bufSize_);
+  return std::make_pair(std::move(batch), options);
+}
+
+void RocksDbWriteBatch::flush() {
+  if (!writer_) {
+    if (writeBatch_->Count() == 0) {
+      return;
+    }
+    auto batch = takeBatch();
+    write(dbHandles_, *batch.first, batch.second);
+    return;
+  }
+
+  // Wait for everything handed off to the writer thread, including the
+  // remainder of this batch.
+  if (writeBatch_->Count() > 0) {
+    pendingFlushes_.push_back(flushAsync());
+  }
+  auto results = folly::collectAll(pendingFlushes_).get();
+  pendingFlushes_.clear();
+  for (auto& result : results) {
+    result.throwIfFailed();
+  }
+}
 
-  writeBatch_.Clear();
+folly::Future<folly::Unit> RocksDbWriteBatch::flushAsync() {
+  if (writeBatch_->Count() == 0) {
+    return folly::makeFuture();
+  }
+  if (!writer_) {
+    return folly::makeFutureWith([this] { flush(); });
+  }
+
+  auto batch = takeBatch();
+  return folly::via(
+      writer_,
+      [&dbHandles = dbHandles_,
+       writeBatch = std::move(batch.first),
+       options = batch.second] { write(dbHandles, *writeBatch, options); });
 }
 
 void RocksDbWriteBatch::flushIfNeeded() {
-  auto needFlush = bufSize_ > 0 && writeBatch_.GetDataSize() >= bufSize_;
+  auto needFlush = bufSize_ > 0 && writeBatch_->GetDataSize() >= bufSize_;
+  if (!needFlush) {
+    return;
+  }
 
-  if (needFlush) {
+  if (!writer_) {
     flush();
+    return;
+  }
+
+  // Let the writer thread persist this batch while the caller carries on
+  // producing the next one.
+  if (pendingFlushes_.size() >= kMaxPendingFlushes) {
+    auto oldest = std::move(pendingFlushes_.front());
+    pendingFlushes_.erase(pendingFlushes_.begin());
+    std::move(oldest).get();
   }
+  pendingFlushes_.push_back(flushAsync());
 }
 
-RocksDbWriteBatch::RocksDbWriteBatch(RocksHandles& dbHandles, size_t bufSize)
+RocksDbWriteBatch::RocksDbWriteBatch(
+    RocksHandles& dbHandles,
+    size_t bufSize,
+    folly::Executor* writer,
+    bool disableEphemeralWAL)
     : LocalStore::WriteBatch(),
       dbHandles_(dbHandles),
-      writeBatch_(bufSize),
-      bufSize_(bufSize) {}
+      writeBatch_(std::make_unique<rocksdb::WriteBatch>(bufSize)),
+      bufSize_(bufSize),
+      writer_(writer),
+      disableEphemeralWAL_(disableEphemeralWAL) {}
 
 RocksDbWriteBatch::~RocksDbWriteBatch() {
-  if (writeBatch_.Count() > 0) {
-    XLOG(ERR) << "WriteBatch being destroyed with " << writeBatch_.Count()
+  if (writeBatch_->Count() > 0) {
+    XLOG(ERR) << "WriteBatch being destroyed with " << writeBatch_->Count()
               << " items pending flush";
   }
+  if (!pendingFlushes_.empty()) {
+    XLOG(ERR) << "WriteBatch being destroyed with " << pendingFlushes_.size()
+              << " flushes that were never waited on";
+  }
 }
 
 void RocksDbWriteBatch::put(
     LocalStore::KeySpace keySpace,
     folly::ByteRange key,
     folly::ByteRange value) {
-  writeBatch_.Put(
+  hasPersistentWrites_ |= !LocalStore::isEphemeral(keySpace);
+  writeBatch_->Put(
       dbHandles_.columns[keySpace].get(),
       _createSlice(key),
       _createSlice(value));
@@ -167,9 +347,10 @@ void RocksDbWriteBatch::put(
     slices.emplace_back(_createSlice(valueSlice));
   }
 
+  hasPersistentWrites_ |= !LocalStore::isEphemeral(keySpace);
   auto keySlice = _createSlice(key);
   SliceParts keyParts(&keySlice, 1);
-  writeBatch_.Put(
+  writeBatch_->Put(
       dbHandles_.columns[keySpace].get(),
       keyParts,
       SliceParts(slices.data(), slices.size()));
@@ -182,11 +363,19 @@ void RocksDbWriteBatch::put(
 namespace facebook {
 namespace eden {
 
-RocksDbLocalStore::RocksDbLocalStore(AbsolutePathPiece pathToRocksDb)
-    : dbHandles_(pathToRocksDb.stringPiece(), columnFamilies()),
-      ioPool_(12, "RocksLocalStore") {}
+RocksDbLocalStore::RocksDbLocalStore(
+    AbsolutePathPiece pathToRocksDb,
+    const RocksDbTuning& tuning)
+    : dbHandles_(pathToRocksDb.stringPiece(), columnFamilies(tuning)),
+      ioPool_(12, "RocksLocalStore"),
+      writer_(
+          tuning.asyncWrites
+              ? std::make_unique<UnboundedQueueExecutor>(1, "RocksDbWriter")
+              : nullptr),
+      disableEphemeralWAL_(tuning.disableEphemeralWAL) {}
 
 RocksDbLocalStore::~RocksDbLocalStore() {
+  waitForPendingWrites();
 #ifdef FOLLY_SANITIZE_ADDRESS
   // RocksDB has some race conditions around setting up and tearing down
   // the threads that it uses to maintain the database.  This manifests
@@ -201,15 +390,28 @@ RocksDbLocalStore::~RocksDbLocalStore() {
 #endif
 }
 
+void RocksDbLocalStore::waitForPendingWrites() {
+  if (writer_) {
+    // The writer runs batches in order on a single thread, so once a no-op
+    // queued now has run everything before it has been written.
+    folly::via(writer_.get(), [] {}).get();
+  }
+}
+
 void RocksDbLocalStore::close() {
+  waitForPendingWrites();
   dbHandles_.columns.clear();
   dbHandles_.db.reset();
 }
 
 void RocksDbLocalStore::clearKeySpace(KeySpace keySpace) {
   auto columnFamily = dbHandles_.columns[keySpace].get();
+  // The data is about to be deleted, so there is no point caching it.
+  ReadOptions readOptions;
+  readOptions.fill_cache = false;
+  readOptions.readahead_size = kScanReadaheadSize;
   std::unique_ptr<rocksdb::Iterator> it{
-      dbHandles_.db->NewIterator(ReadOptions(), columnFamily)};
+      dbHandles_.db->NewIterator(readOptions, columnFamily)};
   const WriteOptions writeOptions;
   for (it->SeekToFirst(); it->Valid(); it->Next()) {
     dbHandles_.db->Delete(writeOptions, columnFamily, it->key());
@@ -224,11 +426,233 @@ void RocksDbLocalStore::compactKeySpace(KeySpace keySpace) {
       options, columnFamily, /*begin=*/nullptr, /*end=*/nullptr);
 }
 
+uint64_t RocksDbLocalStore::getApproximateMemoryUsage() const {
+  if (!dbHandles_.db) {
+    return 0;
+  }
+  auto getProperty = [&](rocksdb::ColumnFamilyHandle* column,
+                         const std::string& name) -> uint64_t {
+    uint64_t value = 0;
+    if (!dbHandles_.db->GetIntProperty(column, name, &value)) {
+      return 0;
+    }
+    return value;
+  };
+
+  uint64_t total = 0;
+  for (const auto& column : dbHandles_.columns) {
+    total += getProperty(column.get(), "rocksdb.cur-size-all-mem-tables");
+    total += getProperty(column.get(), "rocksdb.estimate-table-readers-mem");
+  }
+  // The metadata and tree column families share one block cache, and the
+  // blob column families share another.  Count each cache once.
+  const std::string blockCacheUsage{"rocksdb.block-cache-usage"};
+  total += getProperty(
+      dbHandles_.columns[KeySpace::TreeFamily].get(), blockCacheUsage);
+  total += getProperty(
+      dbHandles_.columns[KeySpace::BlobFamily].get(), blockCacheUsage);
+  return total;
+}
+
+std::map<std::string, int64_t> RocksDbLocalStore::computeEngineStats() const {
+  std::map<std::string, int64_t> stats;
+  if (!dbHandles_.db) {
+    return stats;
+  }
+  auto addProperty = [&](rocksdb::ColumnFamilyHandle* column,
+                         const std::string& property,
+                         const std::string& name) {
+    uint64_t value = 0;
+    if (dbHandles_.db->GetIntProperty(column, property, &value)) {
+      stats[name] = value;
+    }
+  };
+
+  for (size_t index = 0; index < dbHandles_.columns.size(); ++index) {
+    auto column = dbHandles_.columns[index].get();
+    auto name = getKeySpaceName(static_cast<KeySpace>(index)).str();
+    addProperty(column, "rocksdb.total-sst-files-size", name + ".sst_bytes");
+    addProperty(
+        column, "rocksdb.cur-size-all-mem-tables", name + ".memtable_bytes");
+    addProperty(
+        column,
+        "rocksdb.estimate-pending-compaction-bytes",
+        name + ".pending_compaction_bytes");
+    addProperty(column, "rocksdb.estimate-num-keys", name + ".keys");
+  }
+
+  // Each block cache is shared by several column families, so read each
+  // one's usage through just one of them, as getApproximateMemoryUsage()
+  // does.
+  for (auto keySpace : {KeySpace::TreeFamily, KeySpace::BlobFamily}) {
+    auto column = dbHandles_.columns[keySpace].get();
+    auto name = getKeySpaceName(keySpace).str();
+    addProperty(
+        column, "rocksdb.block-cache-usage", name + ".block_cache_bytes");
+    addProperty(
+        column,
+        "rocksdb.block-cache-capacity",
+        name + ".block_cache_capacity_bytes");
+  }
+
+  // The tickers are counted across the whole DB since it was opened.
+  if (dbHandles_.statistics) {
+    const auto& statistics = *dbHandles_.statistics;
+    auto hits = statistics.getTickerCount(rocksdb::BLOCK_CACHE_HIT);
+    auto misses = statistics.getTickerCount(rocksdb::BLOCK_CACHE_MISS);
+    stats["block_cache.hits"] = hits;
+    stats["block_cache.misses"] = misses;
+    stats["block_cache.hit_percent"] =
+        hits + misses == 0 ? 0 : hits * 100 / (hits + misses);
+    stats["block_cache.data_hits"] =
+        statistics.getTickerCount(rocksdb::BLOCK_CACHE_DATA_HIT);
+    stats["block_cache.data_misses"] =
+        statistics.getTickerCount(rocksdb::BLOCK_CACHE_DATA_MISS);
+    stats["memtable.hits"] = statistics.getTickerCount(rocksdb::MEMTABLE_HIT);
+    stats["memtable.misses"] =
+        statistics.getTickerCount(rocksdb::MEMTABLE_MISS);
+    stats["write_stall_us"] = statistics.getTickerCount(rocksdb::STALL_MICROS);
+  }
+  return stats;
+}
+
+void RocksDbLocalStore::recordAccess(KeySpace keySpace, ByteRange key) const {
+  if (keySpace == KeySpace::BlobFamily) {
+    blobAccesses_.recordAccess(key);
+  } else if (keySpace == KeySpace::TreeFamily) {
+    treeAccesses_.recordAccess(key);
+  }
+}
+
+uint64_t RocksDbLocalStore::evictLeastRecentlyUsed(
+    KeySpace keySpace,
+    uint64_t maxSizeBytes) {
+  KeyAccessTracker* tracker;
+  if (keySpace == KeySpace::BlobFamily) {
+    tracker = &blobAccesses_;
+  } else if (keySpace == KeySpace::TreeFamily) {
+    tracker = &treeAccesses_;
+  } else {
+    throw std::invalid_argument(folly::to<string>(
+        "eviction is not supported for key space ", int(keySpace)));
+  }
+
+  // Everything read from here on counts as more recent than anything we
+  // might evict below.
+  const auto currentGeneration = tracker->getCurrentGeneration();
+  tracker->advanceGeneration();
+
+  auto columnFamily = dbHandles_.columns[keySpace].get();
+  uint64_t diskSize = 0;
+  if (!dbHandles_.db->GetIntProperty(
+          columnFamily, "rocksdb.estimate-live-data-size", &diskSize)) {
+    XLOG(WARN) << "unable to determine the size of key space "
+               << int(keySpace);
+    return 0;
+  }
+  if (diskSize <= maxSizeBytes) {
+    return 0;
+  }
+
+  // Both passes below work from the same snapshot, and don't pollute the
+  // block cache with data that is about to be deleted.
+  auto snapshot = dbHandles_.db->GetSnapshot();
+  SCOPE_EXIT {
+    dbHandles_.db->ReleaseSnapshot(snapshot);
+  };
+  ReadOptions readOptions;
+  readOptions.snapshot = snapshot;
+  readOptions.fill_cache = false;
+  readOptions.readahead_size = kScanReadaheadSize;
+
+  // Pass 1: total up the (uncompressed) size of the entries last read in
+  // each generation.
+  std::map<KeyAccessTracker::Generation, uint64_t> bytesByGeneration;
+  uint64_t totalBytes = 0;
+  {
+    std::unique_ptr<rocksdb::Iterator> it{
+        dbHandles_.db->NewIterator(readOptions, columnFamily)};
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+      auto key = it->key();
+      auto size = key.size() + it->value().size();
+      auto generation = tracker->getLastAccess(
+          ByteRange{reinterpret_cast<const uint8_t*>(key.data()), key.size()});
+      bytesByGeneration[generation] += size;
+      totalBytes += size;
+    }
+    RocksException::check(it->status(), "error scanning local store");
+  }
+  if (totalBytes == 0) {
+    return 0;
+  }
+
+  // The entries are compressed on disk, so scale the amount that needs to be
+  // removed by the fraction of the key space that is over budget.
+  const auto bytesToFree = static_cast<uint64_t>(
+      totalBytes * (double(diskSize - maxSizeBytes) / double(diskSize)));
+
+  // Find the generation at which we will have freed enough.  Older
+  // generations are removed wholesale, and the cutoff generation partially.
+  // Entries read during the current generation are never removed.
+  auto cutoffGeneration = currentGeneration;
+  uint64_t bytesBeforeCutoff = 0;
+  for (const auto& entry : bytesByGeneration) {
+    if (entry.first >= currentGeneration ||
+        bytesBeforeCutoff + entry.second >= bytesToFree) {
+      cutoffGeneration = entry.first;
+      break;
+    }
+    bytesBeforeCutoff += entry.second;
+  }
+
+  // Pass 2: delete.
+  uint64_t bytesFreed = 0;
+  uint64_t numEvicted = 0;
+  rocksdb::WriteBatch batch;
+  auto flushBatch = [&] {
+    auto status = dbHandles_.db->Write(WriteOptions(), &batch);
+    RocksException::check(status, "error evicting entries from local store");
+    batch.Clear();
+  };
+  {
+    std::unique_ptr<rocksdb::Iterator> it{
+        dbHandles_.db->NewIterator(readOptions, columnFamily)};
+    for (it->SeekToFirst(); it->Valid() && bytesFreed < bytesToFree;
+         it->Next()) {
+      auto key = it->key();
+      auto generation = tracker->getLastAccess(
+          ByteRange{reinterpret_cast<const uint8_t*>(key.data()), key.size()});
+      if (generation > cutoffGeneration ||
+          generation >= currentGeneration) {
+        continue;
+      }
+      batch.Delete(columnFamily, key);
+      bytesFreed += key.size() + it->value().size();
+      ++numEvicted;
+      if (batch.GetDataSize() >= 1024 * 1024) {
+        flushBatch();
+      }
+    }
+    RocksException::check(it->status(), "error scanning local store");
+  }
+  if (batch.Count() > 0) {
+    flushBatch();
+  }
+
+  XLOG(INFO) << "evicted " << numEvicted << " entries (" << bytesFreed
+             << " bytes uncompressed) from key space " << int(keySpace)
+             << " to bring it under " << maxSizeBytes << " bytes";
+  if (numEvicted > 0) {
+    compactKeySpace(keySpace);
+  }
+  return numEvicted;
+}
+
 StoreResult RocksDbLocalStore::get(LocalStore::KeySpace keySpace, ByteRange key)
     const {
   string value;
   auto status = dbHandles_.db->Get(
-      ReadOptions(),
+      getReadOptions(),
       dbHandles_.columns[keySpace].get(),
       _createSlice(key),
       &value);
@@ -246,6 +670,7 @@ StoreResult RocksDbLocalStore::get(LocalStore::KeySpace keySpace, ByteRange key)
     throw RocksException::build(
         status, "failed to get ", folly::hexlify(key), " from local store");
   }
+  recordAccess(keySpace, key);
   return StoreResult(std::move(value));
 }
 
@@ -297,8 +722,10 @@ RocksDbLocalStore::getBatch(
             keySlices.emplace_back(key);
             columns.emplace_back(dbHandles_.columns[keySpace].get());
           }
+          // The RequestContext, and so any ScanScope, follows the request
+          // onto ioPool_.
           auto statuses = dbHandles_.db->MultiGet(
-              ReadOptions(), columns, keySlices, &values);
+              getReadOptions(), columns, keySlices, &values);
 
           std::vector<StoreResult> results;
           for (size_t i = 0; i < keys->size(); ++i) {
@@ -323,6 +750,7 @@ RocksDbLocalStore::getBatch(
                   folly::hexlify(keys->at(i)),
                   " from local store");
             }
+            recordAccess(keySpace, ByteRange{StringPiece{keys->at(i)}});
             results.emplace_back(std::move(values[i]));
           }
           return results;
@@ -347,7 +775,7 @@ bool RocksDbLocalStore::hasKey(
     folly::ByteRange key) const {
   string value;
   auto status = dbHandles_.db->Get(
-      ReadOptions(),
+      getReadOptions(),
       dbHandles_.columns[keySpace].get(),
       _createSlice(key),
       &value);
@@ -367,9 +795,64 @@ bool RocksDbLocalStore::hasKey(
   return true;
 }
 
+std::vector<bool> RocksDbLocalStore::hasKeyBatch(
+    LocalStore::KeySpace keySpace,
+    const std::vector<folly::ByteRange>& keys) const {
+  auto columnFamily = dbHandles_.columns[keySpace].get();
+  auto readOptions = getReadOptions();
+  std::vector<bool> results(keys.size(), false);
+
+  // First probe the bloom filters, memtables and block cache.  KeyMayExist()
+  // never performs disk I/O, so this cheaply rules out most of the keys that
+  // are absent, and confirms the keys whose values are already in memory.
+  std::vector<size_t> maybePresentIndices;
+  std::vector<Slice> maybePresentKeys;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto keySlice = _createSlice(keys[i]);
+    string value;
+    bool valueFound = false;
+    if (!dbHandles_.db->KeyMayExist(
+            readOptions, columnFamily, keySlice, &value, &valueFound)) {
+      continue;
+    }
+    if (valueFound) {
+      results[i] = true;
+      continue;
+    }
+    maybePresentIndices.push_back(i);
+    maybePresentKeys.push_back(keySlice);
+  }
+
+  if (maybePresentKeys.empty()) {
+    return results;
+  }
+
+  // Bloom filters may report false positives, so confirm the remaining keys
+  // with a single MultiGet().
+  std::vector<rocksdb::ColumnFamilyHandle*> columns(
+      maybePresentKeys.size(), columnFamily);
+  std::vector<string> values;
+  auto statuses = dbHandles_.db->MultiGet(
+      readOptions, columns, maybePresentKeys, &values);
+  for (size_t i = 0; i < statuses.size(); ++i) {
+    const auto& status = statuses[i];
+    if (status.ok()) {
+      results[maybePresentIndices[i]] = true;
+    } else if (!status.IsNotFound()) {
+      throw RocksException::build(
+          status,
+          "failed to get ",
+          folly::hexlify(keys[maybePresentIndices[i]]),
+          " from local store");
+    }
+  }
+  return results;
+}
+
 std::unique_ptr<LocalStore::WriteBatch> RocksDbLocalStore::beginWrite(
     size_t bufSize) {
-  return std::make_unique<RocksDbWriteBatch>(dbHandles_, bufSize);
+  return std::make_unique<RocksDbWriteBatch>(
+      dbHandles_, bufSize, writer_.get(), disableEphemeralWAL_);
 }
 
 void RocksDbLocalStore::put(
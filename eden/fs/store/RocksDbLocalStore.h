@@ -8,23 +8,87 @@
  *
  */
 #pragma once
+#include <string>
 #include "eden/fs/rocksdb/RocksHandles.h"
+#include "eden/fs/store/KeyAccessTracker.h"
 #include "eden/fs/store/LocalStore.h"
 #include "eden/fs/utils/UnboundedQueueExecutor.h"
 
 namespace facebook {
 namespace eden {
 
+/**
+ * Tuning parameters for one group of RocksDB column families.
+ */
+struct RocksDbColumnProfile {
+  /** Size of an uncompressed data block, in bytes. */
+  uint64_t blockSize{4 * 1024};
+  /** Size of a single memtable, in bytes. */
+  uint64_t writeBufferSize{16 * 1024 * 1024};
+  /** One of "none", "snappy", "lz4" or "zstd". */
+  std::string compression{"none"};
+  /**
+   * Maximum size of the compression dictionary shared by the blocks of an
+   * SST file.  0 disables dictionary compression.
+   */
+  uint64_t compressionDictSize{0};
+  /**
+   * Use two-level partitioned indexes and bloom filters, so that only the top
+   * level index has to stay in the block cache.  Worthwhile for the large
+   * column families; the small ones are better served by a flat index.
+   */
+  bool partitionedIndex{false};
+};
+
+/**
+ * Tuning parameters for a RocksDbLocalStore.
+ *
+ * The blob column family gets its own profile and block cache, the tree
+ * column family gets its own profile, and the remaining small, fixed-size
+ * records share the metadata profile.  The tree and metadata families share
+ * one block cache.
+ */
+struct RocksDbTuning {
+  uint64_t blockCacheSize{64 * 1024 * 1024};
+  uint64_t blobBlockCacheSize{8 * 1024 * 1024};
+  RocksDbColumnProfile blob{64 * 1024,
+                            64 * 1024 * 1024,
+                            "zstd",
+                            16 * 1024,
+                            true};
+  RocksDbColumnProfile tree{16 * 1024, 32 * 1024 * 1024, "lz4", 0, true};
+  RocksDbColumnProfile metadata;
+
+  /**
+   * Write automatically flushed batches on a dedicated writer thread, so
+   * that the threads filling them (typically importers) can carry on
+   * instead of waiting on RocksDB.
+   */
+  bool asyncWrites{true};
+
+  /**
+   * Skip the write-ahead log for write batches that only contain data which
+   * can be fetched again from the BackingStore.  Such writes may be lost if
+   * edenfs crashes before RocksDB flushes its memtables.
+   */
+  bool disableEphemeralWAL{true};
+};
+
 /** An implementation of LocalStore that uses RocksDB for the underlying
  * storage.
  */
 class RocksDbLocalStore : public LocalStore {
  public:
-  explicit RocksDbLocalStore(AbsolutePathPiece pathToRocksDb);
+  explicit RocksDbLocalStore(
+      AbsolutePathPiece pathToRocksDb,
+      const RocksDbTuning& tuning = RocksDbTuning{});
   ~RocksDbLocalStore();
   void close() override;
   void clearKeySpace(KeySpace keySpace) override;
   void compactKeySpace(KeySpace keySpace) override;
+  uint64_t evictLeastRecentlyUsed(KeySpace keySpace, uint64_t maxSizeBytes)
+      override;
+  uint64_t getApproximateMemoryUsage() const override;
   StoreResult get(LocalStore::KeySpace keySpace, folly::ByteRange key)
       const override;
   FOLLY_NODISCARD folly::Future<StoreResult> getFuture(
@@ -35,15 +99,44 @@ class RocksDbLocalStore : public LocalStore {
       const std::vector<folly::ByteRange>& keys) const override;
   bool hasKey(LocalStore::KeySpace keySpace, folly::ByteRange key)
       const override;
+  std::vector<bool> hasKeyBatch(
+      LocalStore::KeySpace keySpace,
+      const std::vector<folly::ByteRange>& keys) const override;
   void put(
       LocalStore::KeySpace keySpace,
       folly::ByteRange key,
       folly::ByteRange value) override;
   std::unique_ptr<WriteBatch> beginWrite(size_t bufSize = 0) override;
+  std::map<std::string, int64_t> computeEngineStats() const override;
 
  private:
+  /**
+   * Note that key was read, if keySpace is one that supports eviction.
+   */
+  void recordAccess(KeySpace keySpace, folly::ByteRange key) const;
+
+  /**
+   * Wait until the writer thread has written every batch handed to it so
+   * far.
+   */
+  void waitForPendingWrites();
+
   RocksHandles dbHandles_;
   mutable UnboundedQueueExecutor ioPool_;
+
+  /**
+   * The thread on which write batches are written, or nullptr if writes are
+   * synchronous.  Declared after dbHandles_ so that it is destroyed first.
+   */
+  std::unique_ptr<UnboundedQueueExecutor> writer_;
+  const bool disableEphemeralWAL_;
+
+  /**
+   * Read tracking for the BlobFamily and TreeFamily KeySpaces, used by
+   * evictLeastRecentlyUsed().  The other KeySpaces are never evicted.
+   */
+  mutable KeyAccessTracker blobAccesses_;
+  mutable KeyAccessTracker treeAccesses_;
 };
 
 } // namespace eden
@@ -8,9 +8,14 @@
  *
  */
 #include "eden/fs/store/SqliteLocalStore.h"
+#include <folly/ScopeGuard.h>
 #include <folly/String.h>
 #include <folly/container/Array.h>
+#include <folly/futures/Future.h>
 #include <folly/logging/xlog.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 #include "eden/fs/sqlite/Sqlite.h"
 #include "eden/fs/store/StoreResult.h"
 namespace facebook {
@@ -31,7 +36,16 @@ constexpr auto tableNames = folly::make_array(
     StringPiece("blobmeta"),
     StringPiece("tree"),
     StringPiece("hgproxyhash"),
-    StringPiece("hgcommit2tree"));
+    StringPiece("hgcommit2tree"),
+    StringPiece("blobchunk"),
+    StringPiece("blobcontent"),
+    StringPiece("pathindex"),
+    StringPiece("treediff"));
+
+// The maximum number of keys to check in a single hasKeyBatch() query.
+// This is kept comfortably below sqlite's default SQLITE_MAX_VARIABLE_NUMBER
+// of 999.
+constexpr size_t kMaxKeysPerQuery = 500;
 
 /**
  * Implements the write batching helper.
@@ -109,39 +123,134 @@ class SqliteWriteBatch : public LocalStore::WriteBatch {
   SqliteDatabase& db_;
 };
 
+/**
+ * Build an "in (?, ?, ...)" clause with count parameters.
+ */
+string makeInClause(size_t count) {
+  string clause = " in (?";
+  for (size_t i = 1; i < count; ++i) {
+    clause.append(",?");
+  }
+  clause.push_back(')');
+  return clause;
+}
+
 } // namespace
 
-SqliteLocalStore::SqliteLocalStore(AbsolutePathPiece pathToDb)
-    : db_(SqliteDatabase(pathToDb)) {
-  auto db = db_.lock();
+SqliteLocalStore::Connection::Connection(
+    AbsolutePathPiece path,
+    int openFlags)
+    : db(path, openFlags | SQLITE_OPEN_NOMUTEX) {
+  // Each connection is only used while holding its lock, so sqlite's own
+  // mutexes are redundant.  Wait briefly rather than failing if a reader
+  // races with a checkpoint.
+  auto locked = db.lock();
+  sqlite3_busy_timeout(*locked, 5000);
+}
 
-  // Write ahead log for faster perf
-  // https://www.sqlite.org/wal.html
-  SqliteStatement(db, "PRAGMA journal_mode=WAL").step();
+SqliteStatement& SqliteLocalStore::Connection::getStatement(
+    SqliteDatabase::LockedPtr& locked,
+    Query query,
+    KeySpace keySpace) {
+  auto& statement = statements[query][keySpace];
+  if (!statement) {
+    const auto table = tableNames[keySpace];
+    switch (query) {
+      case GetQuery:
+        statement = std::make_unique<SqliteStatement>(
+            locked, "select value from ", table, " where key = ?");
+        break;
+      case HasKeyQuery:
+        statement = std::make_unique<SqliteStatement>(
+            locked, "select 1 from ", table, " where key = ?");
+        break;
+      case PutQuery:
+        statement = std::make_unique<SqliteStatement>(
+            locked,
+            // TODO: we need `or ignore` otherwise we hit primary key
+            // violations when running our integration tests.  This implies
+            // that we're over-fetching and that we have a perf improvement
+            // opportunity.
+            "insert or ignore into ",
+            table,
+            " VALUES(?, ?)");
+        break;
+      case NumQueries:
+        throw std::invalid_argument("invalid sqlite query");
+    }
+  }
+  return *statement;
+}
 
-  for (auto& name : tableNames) {
-    if (name == "") {
-      continue;
+void SqliteLocalStore::Connection::close() {
+  {
+    auto locked = db.lock();
+    for (auto& perQuery : statements) {
+      for (auto& statement : perQuery) {
+        statement.reset();
+      }
     }
-    SqliteStatement(
-        db,
-        "CREATE TABLE IF NOT EXISTS ",
-        name,
-        "(",
-        "key BINARY NOT NULL,",
-        "value BINARY NOT NULL,"
-        "PRIMARY KEY (key)",
-        ")")
-        .step();
   }
+  db.close();
+}
+
+SqliteLocalStore::SqliteLocalStore(
+    AbsolutePathPiece pathToDb,
+    size_t numReaders)
+    : writer_(pathToDb, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) {
+  {
+    auto db = writer_.db.lock();
+
+    // Write ahead log for faster perf, and so that readers do not block
+    // the writer or each other.
+    // https://www.sqlite.org/wal.html
+    SqliteStatement(db, "PRAGMA journal_mode=WAL").step();
+    // In WAL mode this is still safe against corruption; a power loss may
+    // roll back the most recent transactions, which we can re-fetch.
+    SqliteStatement(db, "PRAGMA synchronous=NORMAL").step();
+
+    for (auto& name : tableNames) {
+      if (name == "") {
+        continue;
+      }
+      SqliteStatement(
+          db,
+          "CREATE TABLE IF NOT EXISTS ",
+          name,
+          "(",
+          "key BINARY NOT NULL,",
+          "value BINARY NOT NULL,"
+          "PRIMARY KEY (key)",
+          ")")
+          .step();
+    }
+  }
+
+  // The readers can only be opened once the tables exist.
+  readers_.reserve(numReaders);
+  for (size_t i = 0; i < numReaders; ++i) {
+    readers_.push_back(
+        std::make_unique<Connection>(pathToDb, SQLITE_OPEN_READONLY));
+  }
+}
+
+SqliteLocalStore::Connection& SqliteLocalStore::getReader() const {
+  if (readers_.empty()) {
+    return writer_;
+  }
+  auto index = nextReader_.fetch_add(1, std::memory_order_relaxed);
+  return *readers_[index % readers_.size()];
 }
 
 void SqliteLocalStore::close() {
-  db_.close();
+  for (auto& reader : readers_) {
+    reader->close();
+  }
+  writer_.close();
 }
 
 void SqliteLocalStore::clearKeySpace(KeySpace keySpace) {
-  auto db = db_.lock();
+  auto db = writer_.db.lock();
 
   SqliteStatement stmt(db, "delete from ", tableNames[keySpace]);
   stmt.step();
@@ -151,10 +260,14 @@ void SqliteLocalStore::compactKeySpace(KeySpace) {}
 
 StoreResult SqliteLocalStore::get(LocalStore::KeySpace keySpace, ByteRange key)
     const {
-  auto db = db_.lock();
-
-  SqliteStatement stmt(
-      db, "select value from ", tableNames[keySpace], " where key = ?");
+  auto& reader = getReader();
+  auto db = reader.db.lock();
+  auto& stmt = reader.getStatement(db, GetQuery, keySpace);
+  // Reset the statement once we are done with it, so that it doesn't hold
+  // a read transaction open while it sits in the cache.
+  SCOPE_EXIT {
+    stmt.reset();
+  };
 
   // Bind the key; parameters are 1-based
   stmt.bind(1, key);
@@ -168,39 +281,152 @@ StoreResult SqliteLocalStore::get(LocalStore::KeySpace keySpace, ByteRange key)
   return StoreResult();
 }
 
+folly::Future<std::vector<StoreResult>> SqliteLocalStore::getBatch(
+    KeySpace keySpace,
+    const std::vector<ByteRange>& keys) const {
+  return folly::makeFutureWith([&] {
+    std::vector<StoreResult> results;
+    results.reserve(keys.size());
+
+    auto& reader = getReader();
+    auto db = reader.db.lock();
+    for (size_t start = 0; start < keys.size(); start += kMaxKeysPerQuery) {
+      const auto count = std::min(kMaxKeysPerQuery, keys.size() - start);
+
+      SqliteStatement stmt(
+          db,
+          "select key, value from ",
+          tableNames[keySpace],
+          " where key",
+          makeInClause(count));
+      for (size_t i = 0; i < count; ++i) {
+        stmt.bind(i + 1, keys[start + i]);
+      }
+
+      std::unordered_map<string, string> found;
+      while (stmt.step()) {
+        found.emplace(stmt.columnBlob(0).str(), stmt.columnBlob(1).str());
+      }
+      for (size_t i = 0; i < count; ++i) {
+        auto it = found.find(StringPiece(keys[start + i]).str());
+        if (it == found.end()) {
+          results.emplace_back();
+        } else {
+          results.emplace_back(std::move(it->second));
+        }
+      }
+    }
+    return results;
+  });
+}
+
 bool SqliteLocalStore::hasKey(LocalStore::KeySpace keySpace, ByteRange key)
     const {
-  auto db = db_.lock();
-
-  SqliteStatement stmt(
-      db, "select 1 from ", tableNames[keySpace], " where key = ?");
+  auto& reader = getReader();
+  auto db = reader.db.lock();
+  auto& stmt = reader.getStatement(db, HasKeyQuery, keySpace);
+  SCOPE_EXIT {
+    stmt.reset();
+  };
 
   stmt.bind(1, key);
   return stmt.step();
 }
 
+std::vector<bool> SqliteLocalStore::hasKeyBatch(
+    LocalStore::KeySpace keySpace,
+    const std::vector<ByteRange>& keys) const {
+  std::vector<bool> results(keys.size(), false);
+  auto db = getReader().db.lock();
+
+  for (size_t start = 0; start < keys.size(); start += kMaxKeysPerQuery) {
+    const auto count = std::min(kMaxKeysPerQuery, keys.size() - start);
+
+    SqliteStatement stmt(
+        db,
+        "select key from ",
+        tableNames[keySpace],
+        " where key",
+        makeInClause(count));
+    for (size_t i = 0; i < count; ++i) {
+      stmt.bind(i + 1, keys[start + i]);
+    }
+
+    std::unordered_set<string> found;
+    while (stmt.step()) {
+      found.insert(stmt.columnBlob(0).str());
+    }
+    for (size_t i = 0; i < count; ++i) {
+      results[start + i] = found.count(StringPiece(keys[start + i]).str()) != 0;
+    }
+  }
+
+  return results;
+}
+
 void SqliteLocalStore::put(
     LocalStore::KeySpace keySpace,
     ByteRange key,
     ByteRange value) {
-  auto db = db_.lock();
-
-  SqliteStatement stmt(
-      db,
-      // TODO: we need `or ignore` otherwise we hit primary key violations
-      // when running our integration tests.  This implies that we're
-      // over-fetching and that we have a perf improvement opportunity.
-      "insert or ignore into ",
-      tableNames[keySpace],
-      " VALUES(?, ?)");
+  auto db = writer_.db.lock();
+  auto& stmt = writer_.getStatement(db, PutQuery, keySpace);
+  SCOPE_EXIT {
+    stmt.reset();
+  };
 
   stmt.bind(1, key);
   stmt.bind(2, value);
   stmt.step();
 }
 
+std::map<std::string, int64_t> SqliteLocalStore::computeEngineStats() const {
+  std::map<std::string, int64_t> stats;
+  {
+    auto db = writer_.db.lock();
+    if (!*db) {
+      return stats;
+    }
+    auto pragma = [&](StringPiece name) -> int64_t {
+      SqliteStatement stmt(db, "PRAGMA ", name);
+      return stmt.step() ? stmt.columnInt64(0) : 0;
+    };
+    auto pageSize = pragma("page_size");
+    stats["sqlite.page_size"] = pageSize;
+    stats["sqlite.db_bytes"] = pageSize * pragma("page_count");
+    stats["sqlite.free_bytes"] = pageSize * pragma("freelist_count");
+  }
+
+  // Each connection has its own page cache, so sum them.
+  int64_t cacheHits = 0;
+  int64_t cacheMisses = 0;
+  int64_t cacheBytes = 0;
+  auto addCacheStats = [&](Connection& connection) {
+    auto db = connection.db.lock();
+    if (!*db) {
+      return;
+    }
+    auto status = [&](int op) -> int64_t {
+      int current = 0;
+      int highwater = 0;
+      sqlite3_db_status(*db, op, &current, &highwater, /*resetFlag=*/0);
+      return current;
+    };
+    cacheHits += status(SQLITE_DBSTATUS_CACHE_HIT);
+    cacheMisses += status(SQLITE_DBSTATUS_CACHE_MISS);
+    cacheBytes += status(SQLITE_DBSTATUS_CACHE_USED);
+  };
+  addCacheStats(writer_);
+  for (auto& reader : readers_) {
+    addCacheStats(*reader);
+  }
+  stats["sqlite.cache_hits"] = cacheHits;
+  stats["sqlite.cache_misses"] = cacheMisses;
+  stats["sqlite.cache_bytes"] = cacheBytes;
+  return stats;
+}
+
 std::unique_ptr<LocalStore::WriteBatch> SqliteLocalStore::beginWrite(size_t) {
-  return std::make_unique<SqliteWriteBatch>(db_);
+  return std::make_unique<SqliteWriteBatch>(writer_.db);
 }
 
 } // namespace eden
@@ -9,6 +9,10 @@
  */
 #pragma once
 #include <folly/Synchronized.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
 #include "eden/fs/sqlite/Sqlite.h"
 #include "eden/fs/store/LocalStore.h"
 
@@ -18,26 +22,82 @@ namespace eden {
 /** An implementation of LocalStore that stores values in Sqlite.
  * SqliteLocalStore is thread safe, allowing reads and writes from
  * any thread.
+ *
+ * The database is used in WAL mode, which lets readers proceed concurrently
+ * with each other and with the writer.  All writes go through a single
+ * read-write connection, while reads are spread across a pool of read-only
+ * connections.  Each connection caches its prepared statements.
  * */
 class SqliteLocalStore : public LocalStore {
  public:
-  explicit SqliteLocalStore(AbsolutePathPiece pathToDb);
+  static constexpr size_t kDefaultNumReaders = 8;
+
+  explicit SqliteLocalStore(
+      AbsolutePathPiece pathToDb,
+      size_t numReaders = kDefaultNumReaders);
   void close() override;
   void clearKeySpace(KeySpace keySpace) override;
   void compactKeySpace(KeySpace keySpace) override;
   StoreResult get(LocalStore::KeySpace keySpace, folly::ByteRange key)
       const override;
+  FOLLY_NODISCARD folly::Future<std::vector<StoreResult>> getBatch(
+      KeySpace keySpace,
+      const std::vector<folly::ByteRange>& keys) const override;
   bool hasKey(LocalStore::KeySpace keySpace, folly::ByteRange key)
       const override;
+  std::vector<bool> hasKeyBatch(
+      LocalStore::KeySpace keySpace,
+      const std::vector<folly::ByteRange>& keys) const override;
   void put(
       LocalStore::KeySpace keySpace,
       folly::ByteRange key,
       folly::ByteRange value) override;
   std::unique_ptr<LocalStore::WriteBatch> beginWrite(
       size_t bufSize = 0) override;
+  std::map<std::string, int64_t> computeEngineStats() const override;
 
  private:
-  mutable SqliteDatabase db_;
+  /** The queries whose prepared statements are cached per connection. */
+  enum Query : size_t {
+    GetQuery,
+    HasKeyQuery,
+    PutQuery,
+    NumQueries,
+  };
+
+  struct Connection {
+    Connection(AbsolutePathPiece path, int openFlags);
+
+    /**
+     * Get the cached prepared statement for query against keySpace,
+     * preparing it if necessary.  db must be a lock on this->db.  Callers
+     * must reset() the statement when they are done with it.
+     */
+    SqliteStatement& getStatement(
+        SqliteDatabase::LockedPtr& db,
+        Query query,
+        KeySpace keySpace);
+
+    /** Finalize the cached statements and close the database handle. */
+    void close();
+
+    SqliteDatabase db;
+    /**
+     * Cached prepared statements, indexed by Query and KeySpace.  These must
+     * only be used while holding the lock on db.  Declared after db so that
+     * they are finalized before it is closed.
+     */
+    std::array<std::array<std::unique_ptr<SqliteStatement>, KeySpace::End>,
+               NumQueries>
+        statements;
+  };
+
+  /** Pick a read-only connection to use for a read. */
+  Connection& getReader() const;
+
+  mutable Connection writer_;
+  mutable std::vector<std::unique_ptr<Connection>> readers_;
+  mutable std::atomic<size_t> nextReader_{0};
 };
 
 } // namespace eden
@@ -0,0 +1,59 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/StoreStats.h"
+
+#include <folly/Conv.h>
+
+using folly::StringPiece;
+
+namespace {
+constexpr int64_t kLatencyBucketSize = 10000;
+constexpr int64_t kLatencyMaxValue = 10000000;
+} // namespace
+
+namespace facebook {
+namespace eden {
+
+StoreStats::StoreStats(StringPiece prefix) : prefix_{prefix.str()} {}
+
+StoreStats::Histogram StoreStats::createLatencyHistogram(StringPiece name) {
+  return createHistogram(name, kLatencyBucketSize, 0, kLatencyMaxValue);
+}
+
+StoreStats::Histogram StoreStats::createHistogram(
+    StringPiece name,
+    int64_t bucketSize,
+    int64_t minValue,
+    int64_t maxValue) {
+  return Histogram{this,
+                   folly::to<std::string>(prefix_, ".", name),
+                   static_cast<size_t>(bucketSize),
+                   minValue,
+                   maxValue,
+                   facebook::stats::COUNT,
+                   50,
+                   90,
+                   99,
+                   99.9};
+}
+
+StoreStats::Timeseries StoreStats::createTimeseries(StringPiece name) {
+  return Timeseries{this,
+                    folly::to<std::string>(prefix_, ".", name),
+                    facebook::stats::SUM,
+                    facebook::stats::RATE};
+}
+
+StoreStats::Counter StoreStats::createCounter(StringPiece name) {
+  return Counter{this, folly::to<std::string>(prefix_, ".", name)};
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/futures/Future.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include "common/stats/ThreadLocalStats.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * The base class for the stats kept by the object storage layers: the
+ * LocalStore, the BackingStores and each mount's ObjectStore.
+ *
+ * Unlike EdenStats, these are shared by every thread that uses the store
+ * they belong to.  The TLStatsThreadSafe stats synchronize internally, and
+ * EdenServer aggregates them into ServiceData once a second.
+ *
+ * Every stat is named "<prefix>.<name>".  Latencies are recorded in
+ * microseconds, and their names end in _us.
+ */
+class StoreStats : public facebook::stats::ThreadLocalStatsT<
+                       facebook::stats::TLStatsThreadSafe> {
+ protected:
+  // This must be declared before the stats of the subclasses, since they are
+  // named using it.
+  const std::string prefix_;
+
+ public:
+  using Histogram = TLHistogram;
+  using Timeseries = TLTimeseries;
+  using Counter = TLCounter;
+
+  explicit StoreStats(folly::StringPiece prefix);
+
+  const std::string& getPrefix() const {
+    return prefix_;
+  }
+
+  static void recordLatency(
+      Histogram& histogram,
+      std::chrono::steady_clock::duration elapsed) {
+    histogram.addValue(
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+            .count());
+  }
+
+ protected:
+  /**
+   * A histogram of latencies from 0 to 10 seconds.  Store operations range
+   * from microseconds for a cached read to seconds for a network fetch, so
+   * the buckets are coarse; the exported percentiles are what matter.
+   */
+  Histogram createLatencyHistogram(folly::StringPiece name);
+  Histogram createHistogram(
+      folly::StringPiece name,
+      int64_t bucketSize,
+      int64_t minValue,
+      int64_t maxValue);
+  Timeseries createTimeseries(folly::StringPiece name);
+  Counter createCounter(folly::StringPiece name);
+};
+
+/**
+ * The latency of fetching each kind of object from a BackingStore, and the
+ * number of fetches in progress.
+ *
+ * The BackingStores keep these for themselves, and each ObjectStore keeps
+ * its own for the fetches it makes from its BackingStore on behalf of its
+ * mount.
+ */
+class BackingStoreStats : public StoreStats {
+ public:
+  explicit BackingStoreStats(folly::StringPiece prefix) : StoreStats{prefix} {}
+
+  using HistogramPtr = Histogram BackingStoreStats::*;
+
+  Histogram getTree{createLatencyHistogram("get_tree_us")};
+  Histogram getBlob{createLatencyHistogram("get_blob_us")};
+  Histogram getTreeForCommit{createLatencyHistogram("get_tree_for_commit_us")};
+  Counter inflight{createCounter("inflight")};
+
+  /**
+   * Call fn() to start a fetch, and record how long the Future that it
+   * returns takes to complete, whether it succeeds or fails.
+   *
+   * The stats are kept alive until then, since the fetch may outlive the
+   * caller.
+   */
+  template <typename Fn>
+  static auto track(
+      const std::shared_ptr<BackingStoreStats>& stats,
+      HistogramPtr item,
+      Fn&& fn) {
+    stats->inflight.incrementValue(1);
+    auto start = std::chrono::steady_clock::now();
+    return folly::makeFutureWith(std::forward<Fn>(fn))
+        .ensure([stats, item, start] {
+          stats->inflight.incrementValue(-1);
+          recordLatency(
+              (*stats).*item, std::chrono::steady_clock::now() - start);
+        });
+  }
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/TieredLocalStore.h"
+#include <folly/Conv.h>
+#include <folly/futures/Future.h>
+#include <folly/logging/xlog.h>
+#include "eden/fs/store/StoreResult.h"
+
+using folly::ByteRange;
+using folly::Future;
+using folly::makeFuture;
+using folly::StringPiece;
+using std::string;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+
+/**
+ * Writes each put to a batch for both the local and the shared store.
+ */
+class TieredWriteBatch : public LocalStore::WriteBatch {
+ public:
+  TieredWriteBatch(
+      std::unique_ptr<LocalStore::WriteBatch> local,
+      std::unique_ptr<LocalStore::WriteBatch> shared)
+      : local_{std::move(local)}, shared_{std::move(shared)} {}
+
+  void put(LocalStore::KeySpace keySpace, ByteRange key, ByteRange value)
+      override {
+    local_->put(keySpace, key, value);
+    shared_->put(keySpace, key, value);
+  }
+
+  void put(
+      LocalStore::KeySpace keySpace,
+      ByteRange key,
+      std::vector<ByteRange> valueSlices) override {
+    local_->put(keySpace, key, valueSlices);
+    shared_->put(keySpace, key, std::move(valueSlices));
+  }
+
+  void flush() override {
+    local_->flush();
+    try {
+      shared_->flush();
+    } catch (const std::exception& ex) {
+      XLOG(WARN) << "error writing to the shared local store: " << ex.what();
+    }
+  }
+
+  Future<folly::Unit> flushAsync() override {
+    auto shared = shared_->flushAsync().onError([](const std::exception& ex) {
+      XLOG(WARN) << "error writing to the shared local store: " << ex.what();
+    });
+    return local_->flushAsync().then(
+        [shared = std::move(shared)]() mutable { return std::move(shared); });
+  }
+
+ private:
+  std::unique_ptr<LocalStore::WriteBatch> local_;
+  std::unique_ptr<LocalStore::WriteBatch> shared_;
+};
+
+ByteRange toByteRange(const string& key) {
+  return ByteRange{StringPiece{key}};
+}
+
+} // namespace
+
+TieredLocalStore::TieredLocalStore(
+    std::shared_ptr<LocalStore> local,
+    std::shared_ptr<LocalStore> shared)
+    : local_{std::move(local)}, shared_{std::move(shared)} {}
+
+void TieredLocalStore::close() {
+  local_->close();
+  shared_->close();
+}
+
+void TieredLocalStore::clearKeySpace(KeySpace keySpace) {
+  local_->clearKeySpace(keySpace);
+}
+
+void TieredLocalStore::compactKeySpace(KeySpace keySpace) {
+  local_->compactKeySpace(keySpace);
+}
+
+uint64_t TieredLocalStore::evictLeastRecentlyUsed(
+    KeySpace keySpace,
+    uint64_t maxSizeBytes) {
+  return local_->evictLeastRecentlyUsed(keySpace, maxSizeBytes);
+}
+
+uint64_t TieredLocalStore::getApproximateMemoryUsage() const {
+  return local_->getApproximateMemoryUsage() +
+      shared_->getApproximateMemoryUsage();
+}
+
+StoreResult TieredLocalStore::get(KeySpace keySpace, ByteRange key) const {
+  auto result = local_->get(keySpace, key);
+  if (result.isValid()) {
+    return result;
+  }
+  return shared_->get(keySpace, key);
+}
+
+Future<StoreResult> TieredLocalStore::getFuture(
+    KeySpace keySpace,
+    ByteRange key) const {
+  return local_->getFuture(keySpace, key)
+      .then([keySpace, key = StringPiece{key}.str(), shared = shared_](
+                StoreResult&& result) {
+        if (result.isValid()) {
+          return makeFuture(std::move(result));
+        }
+        return shared->getFuture(keySpace, toByteRange(key));
+      });
+}
+
+Future<std::vector<StoreResult>> TieredLocalStore::getBatch(
+    KeySpace keySpace,
+    const std::vector<ByteRange>& keys) const {
+  std::vector<string> keyCopies;
+  keyCopies.reserve(keys.size());
+  for (const auto& key : keys) {
+    keyCopies.push_back(StringPiece{key}.str());
+  }
+  return local_->getBatch(keySpace, keys)
+      .then([keySpace, keys = std::move(keyCopies), shared = shared_](
+                std::vector<StoreResult>&& results) {
+        std::vector<size_t> missing;
+        std::vector<ByteRange> missingKeys;
+        for (size_t index = 0; index < results.size(); ++index) {
+          if (!results[index].isValid()) {
+            missing.push_back(index);
+            missingKeys.push_back(toByteRange(keys[index]));
+          }
+        }
+        if (missing.empty()) {
+          return makeFuture(std::move(results));
+        }
+        return shared->getBatch(keySpace, missingKeys)
+            .then([results = std::move(results), missing = std::move(missing)](
+                      std::vector<StoreResult>&& sharedResults) mutable {
+              for (size_t n = 0; n < missing.size(); ++n) {
+                results[missing[n]] = std::move(sharedResults[n]);
+              }
+              return std::move(results);
+            });
+      });
+}
+
+bool TieredLocalStore::hasKey(KeySpace keySpace, ByteRange key) const {
+  return local_->hasKey(keySpace, key) || shared_->hasKey(keySpace, key);
+}
+
+std::vector<bool> TieredLocalStore::hasKeyBatch(
+    KeySpace keySpace,
+    const std::vector<ByteRange>& keys) const {
+  auto present = local_->hasKeyBatch(keySpace, keys);
+  std::vector<size_t> missing;
+  std::vector<ByteRange> missingKeys;
+  for (size_t index = 0; index < present.size(); ++index) {
+    if (!present[index]) {
+      missing.push_back(index);
+      missingKeys.push_back(keys[index]);
+    }
+  }
+  if (!missing.empty()) {
+    auto sharedPresent = shared_->hasKeyBatch(keySpace, missingKeys);
+    for (size_t n = 0; n < missing.size(); ++n) {
+      present[missing[n]] = sharedPresent[n];
+    }
+  }
+  return present;
+}
+
+void TieredLocalStore::put(
+    KeySpace keySpace,
+    ByteRange key,
+    ByteRange value) {
+  local_->put(keySpace, key, value);
+  try {
+    shared_->put(keySpace, key, value);
+  } catch (const std::exception& ex) {
+    XLOG(WARN) << "error writing to the shared local store: " << ex.what();
+  }
+}
+
+std::unique_ptr<LocalStore::WriteBatch> TieredLocalStore::beginWrite(
+    size_t bufSize) {
+  return std::make_unique<TieredWriteBatch>(
+      local_->beginWrite(bufSize), shared_->beginWrite(bufSize));
+}
+
+std::map<string, int64_t> TieredLocalStore::computeEngineStats() const {
+  auto stats = local_->computeEngineStats();
+  for (const auto& stat : shared_->computeEngineStats()) {
+    stats.emplace(folly::to<string>("shared.", stat.first), stat.second);
+  }
+  return stats;
+}
+
+} // namespace eden
+} // namespace facebook
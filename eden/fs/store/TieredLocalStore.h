@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include <memory>
+#include "eden/fs/store/LocalStore.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * A LocalStore that puts a machine-wide cache, shared by the edenfs
+ * processes of every user on the host, behind this process's own store.
+ *
+ * Reads check the local store first, and fall back to the shared store for
+ * keys it does not have.  Writes go to both, so whatever one edenfs imports
+ * from its BackingStore is available to the others without importing it
+ * again.  Every KeySpace is addressed by content or by source control
+ * hashes, so the entries written by one process are valid for all of them.
+ *
+ * Entries found in the shared store are not copied into the local store, so
+ * that each user does not keep a private copy of the objects they share.
+ *
+ * Maintenance operations such as clearKeySpace() and
+ * evictLeastRecentlyUsed() only apply to the local store; the shared store
+ * belongs to every process using it.  Failures to write to the shared store
+ * are logged and otherwise ignored, since it is only a cache.
+ */
+class TieredLocalStore : public LocalStore {
+ public:
+  TieredLocalStore(
+      std::shared_ptr<LocalStore> local,
+      std::shared_ptr<LocalStore> shared);
+  void close() override;
+  void clearKeySpace(KeySpace keySpace) override;
+  void compactKeySpace(KeySpace keySpace) override;
+  uint64_t evictLeastRecentlyUsed(KeySpace keySpace, uint64_t maxSizeBytes)
+      override;
+  uint64_t getApproximateMemoryUsage() const override;
+  StoreResult get(LocalStore::KeySpace keySpace, folly::ByteRange key)
+      const override;
+  FOLLY_NODISCARD folly::Future<StoreResult> getFuture(
+      KeySpace keySpace,
+      folly::ByteRange key) const override;
+  FOLLY_NODISCARD folly::Future<std::vector<StoreResult>> getBatch(
+      KeySpace keySpace,
+      const std::vector<folly::ByteRange>& keys) const override;
+  bool hasKey(LocalStore::KeySpace keySpace, folly::ByteRange key)
+      const override;
+  std::vector<bool> hasKeyBatch(
+      LocalStore::KeySpace keySpace,
+      const std::vector<folly::ByteRange>& keys) const override;
+  void put(
+      LocalStore::KeySpace keySpace,
+      folly::ByteRange key,
+      folly::ByteRange value) override;
+  std::unique_ptr<LocalStore::WriteBatch> beginWrite(
+      size_t bufSize = 0) override;
+
+  /**
+   * Returns the local store's stats, along with the shared store's prefixed
+   * with "shared.".
+   */
+  std::map<std::string, int64_t> computeEngineStats() const override;
+
+ private:
+  std::shared_ptr<LocalStore> local_;
+  std::shared_ptr<LocalStore> shared_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,222 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/TreeDiffCache.h"
+
+#include <folly/Conv.h>
+#include <folly/Varint.h>
+#include <folly/hash/Hash.h>
+#include <folly/logging/xlog.h>
+#include <algorithm>
+#include <stdexcept>
+#include "eden/fs/store/LocalStore.h"
+
+using folly::ByteRange;
+using folly::StringPiece;
+using std::shared_ptr;
+using std::string;
+
+namespace facebook {
+namespace eden {
+
+constexpr uint8_t TreeDiffCache::kVersion;
+
+namespace {
+void appendVarint(string& out, uint64_t value) {
+  uint8_t buf[folly::kMaxVarintLength64];
+  auto size = folly::encodeVarint(value, buf);
+  out.append(reinterpret_cast<const char*>(buf), size);
+}
+
+void appendName(string& out, PathComponentPiece name) {
+  appendVarint(out, name.stringPiece().size());
+  out.append(name.stringPiece().data(), name.stringPiece().size());
+}
+
+PathComponent readName(ByteRange& data) {
+  // decodeVarint() throws std::invalid_argument if the varint is truncated.
+  auto size = folly::decodeVarint(data);
+  if (size > data.size()) {
+    throw std::invalid_argument("truncated tree diff");
+  }
+  StringPiece name{reinterpret_cast<const char*>(data.data()), size};
+  data.advance(size);
+  try {
+    return PathComponent{name};
+  } catch (const std::exception& ex) {
+    throw std::invalid_argument(
+        folly::to<string>("bad name in tree diff: ", ex.what()));
+  }
+}
+
+Hash readHash(ByteRange& data) {
+  if (data.size() < Hash::RAW_SIZE) {
+    throw std::invalid_argument("truncated tree diff");
+  }
+  Hash hash{data.subpiece(0, Hash::RAW_SIZE)};
+  data.advance(Hash::RAW_SIZE);
+  return hash;
+}
+} // namespace
+
+TreeDiffCache::TreeDiffCache(
+    size_t maxEntries,
+    std::shared_ptr<LocalStore> localStore)
+    : localStore_{std::move(localStore)},
+      entries_{std::max<size_t>(maxEntries, 1)} {}
+
+shared_ptr<const TreeDiffResult> TreeDiffCache::get(
+    const Hash& tree1,
+    const Hash& tree2) {
+  Key key{tree1, tree2};
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      return it->second;
+    }
+  }
+  if (!localStore_) {
+    return nullptr;
+  }
+  return load(key);
+}
+
+void TreeDiffCache::put(
+    const Hash& tree1,
+    const Hash& tree2,
+    shared_ptr<const TreeDiffResult> result) {
+  Key key{tree1, tree2};
+  if (localStore_) {
+    localStore_->put(
+        LocalStore::TreeDiffFamily,
+        ByteRange{StringPiece{localStoreKey(key)}},
+        ByteRange{StringPiece{serialize(*result)}});
+  }
+  std::lock_guard<std::mutex> guard(lock_);
+  entries_.set(key, std::move(result));
+}
+
+size_t TreeDiffCache::size() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return entries_.size();
+}
+
+void TreeDiffCache::clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  entries_.clear();
+}
+
+string TreeDiffCache::serialize(const TreeDiffResult& result) {
+  string out;
+  out.push_back(static_cast<char>(kVersion));
+  appendVarint(out, result.files.size());
+  for (const auto& file : result.files) {
+    out.push_back(static_cast<char>(file.second));
+    appendName(out, file.first);
+  }
+  appendVarint(out, result.trees.size());
+  for (const auto& subtree : result.trees) {
+    appendName(out, subtree.name);
+    auto tree1 = subtree.tree1.getBytes();
+    auto tree2 = subtree.tree2.getBytes();
+    out.append(reinterpret_cast<const char*>(tree1.data()), tree1.size());
+    out.append(reinterpret_cast<const char*>(tree2.data()), tree2.size());
+  }
+  return out;
+}
+
+TreeDiffResult TreeDiffCache::deserialize(ByteRange data) {
+  if (data.empty() || data[0] != kVersion) {
+    throw std::invalid_argument("unsupported tree diff version");
+  }
+  data.advance(1);
+
+  TreeDiffResult result;
+  auto numFiles = folly::decodeVarint(data);
+  // Each file takes at least two bytes, which bounds the reservation.
+  if (numFiles > data.size() / 2) {
+    throw std::invalid_argument("truncated tree diff");
+  }
+  result.files.reserve(numFiles);
+  for (uint64_t n = 0; n < numFiles; ++n) {
+    if (data.empty()) {
+      throw std::invalid_argument("truncated tree diff");
+    }
+    auto status = static_cast<ScmFileStatus>(data[0]);
+    if (status != ScmFileStatus::ADDED && status != ScmFileStatus::MODIFIED &&
+        status != ScmFileStatus::REMOVED) {
+      throw std::invalid_argument("bad file status in tree diff");
+    }
+    data.advance(1);
+    result.files.emplace_back(readName(data), status);
+  }
+
+  auto numTrees = folly::decodeVarint(data);
+  if (numTrees > data.size() / (1 + 2 * Hash::RAW_SIZE)) {
+    throw std::invalid_argument("truncated tree diff");
+  }
+  result.trees.reserve(numTrees);
+  for (uint64_t n = 0; n < numTrees; ++n) {
+    auto name = readName(data);
+    auto tree1 = readHash(data);
+    auto tree2 = readHash(data);
+    result.trees.emplace_back(name, tree1, tree2, nullptr);
+  }
+  if (!data.empty()) {
+    throw std::invalid_argument("trailing data in tree diff");
+  }
+  return result;
+}
+
+string TreeDiffCache::localStoreKey(const Key& key) {
+  auto tree1 = key.tree1.getBytes();
+  auto tree2 = key.tree2.getBytes();
+  string out;
+  out.reserve(tree1.size() + tree2.size());
+  out.append(reinterpret_cast<const char*>(tree1.data()), tree1.size());
+  out.append(reinterpret_cast<const char*>(tree2.data()), tree2.size());
+  return out;
+}
+
+shared_ptr<const TreeDiffResult> TreeDiffCache::load(const Key& key) {
+  auto data = localStore_->get(
+      LocalStore::TreeDiffFamily, ByteRange{StringPiece{localStoreKey(key)}});
+  if (!data.isValid()) {
+    return nullptr;
+  }
+  TreeDiffResult result;
+  try {
+    result = deserialize(data.bytes());
+  } catch (const std::invalid_argument& ex) {
+    XLOG(WARN) << "ignoring the invalid diff of trees " << key.tree1 << " and "
+               << key.tree2 << ": " << ex.what();
+    return nullptr;
+  }
+  // A result is only usable with the results of all of its subtrees.
+  for (auto& subtree : result.trees) {
+    subtree.result = get(subtree.tree1, subtree.tree2);
+    if (!subtree.result) {
+      return nullptr;
+    }
+  }
+
+  auto shared = std::make_shared<const TreeDiffResult>(std::move(result));
+  std::lock_guard<std::mutex> guard(lock_);
+  entries_.set(key, shared);
+  return shared;
+}
+
+size_t TreeDiffCache::KeyHasher::operator()(const Key& key) const {
+  return folly::hash::hash_combine(
+      key.tree1.getHashCode(), key.tree2.getHashCode());
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/container/EvictingCacheMap.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/service/gen-cpp2/eden_types.h"
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace facebook {
+namespace eden {
+
+class LocalStore;
+
+/**
+ * The differences between a pair of source control trees.
+ *
+ * Files are listed by name.  The differences inside subtrees are the
+ * results for those pairs of subtrees, which are shared with any other
+ * result that contains the same pair.
+ */
+struct TreeDiffResult {
+  struct Subtree {
+    Subtree(
+        PathComponentPiece name,
+        const Hash& tree1,
+        const Hash& tree2,
+        std::shared_ptr<const TreeDiffResult> result)
+        : name{name}, tree1{tree1}, tree2{tree2}, result{std::move(result)} {}
+
+    PathComponent name;
+    /** An all-zero hash if the subtree is only in the second tree. */
+    Hash tree1;
+    /** An all-zero hash if the subtree is only in the first tree. */
+    Hash tree2;
+    std::shared_ptr<const TreeDiffResult> result;
+  };
+
+  std::vector<std::pair<PathComponent, ScmFileStatus>> files;
+  std::vector<Subtree> trees;
+};
+
+/**
+ * TreeDiffCache remembers the differences between pairs of trees, so that
+ * diffs that are repeated, or that overlap an earlier one, only walk the
+ * subtrees that they have not seen before.
+ *
+ * A tree that is only on one side of a diff is cached against an all-zero
+ * hash for the other side.  Trees are immutable, so a result never goes
+ * stale.  The cache holds a bounded number of results, evicting the least
+ * recently used, although a result stays in memory while a cached result
+ * for one of its parents refers to it.
+ *
+ * If a LocalStore is given, results are also stored in its TreeDiffFamily
+ * KeySpace, one entry per pair of trees, so that they survive eviction and
+ * restarts.
+ *
+ * TreeDiffCache is thread-safe.
+ */
+class TreeDiffCache {
+ public:
+  static constexpr uint8_t kVersion = 1;
+
+  explicit TreeDiffCache(
+      size_t maxEntries,
+      std::shared_ptr<LocalStore> localStore = nullptr);
+
+  /**
+   * Get the differences between tree1 and tree2, or nullptr if they are not
+   * cached.  Results that are only in the LocalStore are read synchronously,
+   * along with the results for all of their subtrees.
+   */
+  std::shared_ptr<const TreeDiffResult> get(
+      const Hash& tree1,
+      const Hash& tree2);
+
+  /**
+   * Record the differences between tree1 and tree2.  The results for their
+   * subtrees must already have been recorded.
+   */
+  void put(
+      const Hash& tree1,
+      const Hash& tree2,
+      std::shared_ptr<const TreeDiffResult> result);
+
+  /**
+   * Get the number of results held in memory.
+   */
+  size_t size() const;
+
+  /**
+   * Forget every result held in memory.
+   */
+  void clear();
+
+  /**
+   * Serialize the files and subtree hashes of a result.  The results of the
+   * subtrees are stored separately, under their own pairs of hashes.
+   */
+  static std::string serialize(const TreeDiffResult& result);
+
+  /**
+   * Parse the output of serialize().  The subtrees' results are left null.
+   * Throws std::invalid_argument if the data is not valid.
+   */
+  static TreeDiffResult deserialize(folly::ByteRange data);
+
+ private:
+  struct Key {
+    Hash tree1;
+    Hash tree2;
+
+    bool operator==(const Key& other) const {
+      return tree1 == other.tree1 && tree2 == other.tree2;
+    }
+  };
+  struct KeyHasher {
+    size_t operator()(const Key& key) const;
+  };
+
+  static std::string localStoreKey(const Key& key);
+  std::shared_ptr<const TreeDiffResult> load(const Key& key);
+
+  const std::shared_ptr<LocalStore> localStore_;
+  mutable std::mutex lock_;
+  folly::EvictingCacheMap<Key, std::shared_ptr<const TreeDiffResult>, KeyHasher>
+      entries_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,254 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/TreeSnapshot.h"
+
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/futures/Future.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <folly/lang/Bits.h>
+#include <folly/logging/xlog.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/IObjectStore.h"
+#include "eden/fs/store/TreeView.h"
+
+using folly::ByteRange;
+using folly::Future;
+using folly::IOBuf;
+using folly::StringPiece;
+using folly::Unit;
+using std::shared_ptr;
+using std::unique_ptr;
+using std::vector;
+
+namespace facebook {
+namespace eden {
+
+constexpr StringPiece TreeSnapshot::kMagic;
+constexpr uint32_t TreeSnapshot::kVersion;
+constexpr size_t TreeSnapshot::kHeaderSize;
+constexpr size_t TreeSnapshot::kIndexEntrySize;
+
+namespace {
+template <typename T>
+T loadBigEndian(const uint8_t* data) {
+  T value;
+  memcpy(&value, data, sizeof(T));
+  return folly::Endian::big(value);
+}
+
+/**
+ * Collects the trees for TreeSnapshot::create().  The trees are loaded one
+ * level of the commit at a time, and each level is added from a single
+ * continuation, so this needs no locking.
+ */
+struct SnapshotBuilder {
+  SnapshotBuilder(
+      const IObjectStore* store,
+      const Hash& commitID,
+      AbsolutePathPiece path)
+      : store{store}, commitID{commitID}, path{path} {}
+
+  /**
+   * Add a tree, and return the hashes of its subtrees that have not been
+   * seen yet.
+   */
+  vector<Hash> add(const Tree& tree) {
+    auto serialized = TreeView::serialize(tree);
+    if (serialized) {
+      trees.emplace_back(tree.getHash(), std::move(*serialized));
+    } else {
+      XLOG(WARN) << "leaving tree " << tree.getHash()
+                 << " out of the snapshot: a name is too long";
+    }
+
+    vector<Hash> subtrees;
+    for (const auto& entry : tree.getTreeEntries()) {
+      if (entry.isTree() && seen.insert(entry.getHash()).second) {
+        subtrees.push_back(entry.getHash());
+      }
+    }
+    return subtrees;
+  }
+
+  const IObjectStore* const store;
+  const Hash commitID;
+  const AbsolutePath path;
+  Hash rootTreeID;
+  std::unordered_set<Hash> seen;
+  vector<std::pair<Hash, IOBuf>> trees;
+};
+
+Future<Unit> addLevel(shared_ptr<SnapshotBuilder> builder, vector<Hash> ids) {
+  if (ids.empty()) {
+    return folly::makeFuture();
+  }
+  vector<Future<shared_ptr<const Tree>>> futures;
+  futures.reserve(ids.size());
+  for (const auto& id : ids) {
+    futures.push_back(
+        builder->store->getTree(id, ImportPriority::Background));
+  }
+  return folly::collect(futures).then(
+      [builder](vector<shared_ptr<const Tree>>&& trees) {
+        vector<Hash> next;
+        for (const auto& tree : trees) {
+          auto subtrees = builder->add(*tree);
+          next.insert(next.end(), subtrees.begin(), subtrees.end());
+        }
+        return addLevel(builder, std::move(next));
+      });
+}
+} // namespace
+
+size_t TreeSnapshot::write(
+    AbsolutePathPiece path,
+    const Hash& commitID,
+    const Hash& rootTreeID,
+    vector<std::pair<Hash, IOBuf>>& trees) {
+  std::sort(trees.begin(), trees.end(), [](const auto& a, const auto& b) {
+    return a.first < b.first;
+  });
+
+  auto file = IOBuf::create(kHeaderSize + trees.size() * kIndexEntrySize);
+  folly::io::Appender appender(file.get(), 0);
+  appender.push(ByteRange{kMagic});
+  appender.writeBE<uint32_t>(kVersion);
+  appender.writeBE<uint64_t>(trees.size());
+  appender.push(commitID.getBytes());
+  appender.push(rootTreeID.getBytes());
+
+  uint64_t offset = kHeaderSize + trees.size() * kIndexEntrySize;
+  for (const auto& tree : trees) {
+    auto length = tree.second.computeChainDataLength();
+    appender.push(tree.first.getBytes());
+    appender.writeBE<uint64_t>(offset);
+    appender.writeBE<uint32_t>(length);
+    offset += length;
+  }
+  for (auto& tree : trees) {
+    file->prependChain(tree.second.clone());
+  }
+
+  auto iov = file->getIov();
+  folly::writeFileAtomic(path.stringPiece(), iov.data(), iov.size(), 0644);
+  return trees.size();
+}
+
+TreeSnapshot::TreeSnapshot(
+    AbsolutePathPiece path,
+    folly::MemoryMapping mapping)
+    : path_{path}, mapping_{std::move(mapping)} {
+  auto bytes = mapping_.range();
+  if (bytes.size() < kHeaderSize ||
+      memcmp(bytes.data(), kMagic.data(), kMagic.size()) != 0) {
+    throwInvalid("unsupported header");
+  }
+  if (loadBigEndian<uint32_t>(bytes.data() + kMagic.size()) != kVersion) {
+    throwInvalid("unsupported version");
+  }
+  auto count =
+      loadBigEndian<uint64_t>(bytes.data() + kMagic.size() + sizeof(uint32_t));
+  if ((bytes.size() - kHeaderSize) / kIndexEntrySize < count) {
+    throwInvalid("truncated index");
+  }
+  count_ = count;
+  const auto* ids = bytes.data() + kMagic.size() + sizeof(uint32_t) +
+      sizeof(uint64_t);
+  commitID_ = Hash{ByteRange{ids, Hash::RAW_SIZE}};
+  rootTreeID_ = Hash{ByteRange{ids + Hash::RAW_SIZE, Hash::RAW_SIZE}};
+
+  // Lookups rely on the index being sorted, so check it now.  This only
+  // reads the index, not the trees.
+  const auto* index = bytes.data() + kHeaderSize;
+  for (size_t n = 1; n < count_; ++n) {
+    const auto* entry = index + n * kIndexEntrySize;
+    if (memcmp(entry - kIndexEntrySize, entry, Hash::RAW_SIZE) >= 0) {
+      throwInvalid("unsorted index");
+    }
+  }
+}
+
+shared_ptr<const TreeSnapshot> TreeSnapshot::open(AbsolutePathPiece path) {
+  folly::MemoryMapping mapping{path.stringPiece().str().c_str()};
+  return shared_ptr<const TreeSnapshot>{
+      new TreeSnapshot{path, std::move(mapping)}};
+}
+
+Future<size_t> TreeSnapshot::create(
+    const IObjectStore* store,
+    const Hash& commitID,
+    AbsolutePathPiece path) {
+  auto builder = std::make_shared<SnapshotBuilder>(store, commitID, path);
+  return store->getTreeForCommit(commitID)
+      .then([builder](shared_ptr<const Tree> root) {
+        builder->rootTreeID = root->getHash();
+        builder->seen.insert(root->getHash());
+        return addLevel(builder, builder->add(*root));
+      })
+      .then([builder] {
+        return write(
+            builder->path,
+            builder->commitID,
+            builder->rootTreeID,
+            builder->trees);
+      });
+}
+
+folly::Optional<TreeView> TreeSnapshot::getTreeView(const Hash& id) const {
+  auto bytes = mapping_.range();
+  const auto* index = bytes.data() + kHeaderSize;
+
+  // Binary search the index for the hash.
+  size_t begin = 0;
+  size_t end = count_;
+  while (begin < end) {
+    auto middle = begin + (end - begin) / 2;
+    const auto* entry = index + middle * kIndexEntrySize;
+    auto cmp = memcmp(entry, id.getBytes().data(), Hash::RAW_SIZE);
+    if (cmp < 0) {
+      begin = middle + 1;
+    } else if (cmp > 0) {
+      end = middle;
+    } else {
+      auto offset = loadBigEndian<uint64_t>(entry + Hash::RAW_SIZE);
+      auto length = loadBigEndian<uint32_t>(
+          entry + Hash::RAW_SIZE + sizeof(uint64_t));
+      if (offset > bytes.size() || bytes.size() - offset < length) {
+        throwInvalid(folly::sformat("tree {} is truncated", id.toString()));
+      }
+      return TreeView{id, bytes.subpiece(offset, length)};
+    }
+  }
+  return folly::none;
+}
+
+unique_ptr<Tree> TreeSnapshot::getTree(const Hash& id) const {
+  auto view = getTreeView(id);
+  if (!view) {
+    return nullptr;
+  }
+  return view->toTree();
+}
+
+void TreeSnapshot::throwInvalid(StringPiece reason) const {
+  throw std::invalid_argument(folly::sformat(
+      "invalid tree snapshot {}: {}", path_.stringPiece(), reason));
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <folly/system/MemoryMapping.h>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace folly {
+class IOBuf;
+template <typename T>
+class Future;
+} // namespace folly
+
+namespace facebook {
+namespace eden {
+
+class IObjectStore;
+class Tree;
+class TreeView;
+
+/**
+ * A read-only file holding every tree reachable from a commit, which is
+ * memory-mapped and read in place.
+ *
+ * Trees are immutable and identified by their hash, so a snapshot can serve
+ * lookups for any mount, and can be copied to other machines so that they
+ * need not import the trees at all.  The kernel's page cache holds the parts
+ * of the file that are in use, rather than the LocalStore.
+ *
+ * The file consists of:
+ * - a header: "EDTS", the format version (4 bytes, big endian), the number
+ *   of trees (8 bytes, big endian), the commit ID (20 bytes) and the hash of
+ *   its root tree (20 bytes)
+ * - an index of the trees, sorted by hash, with each entry holding the
+ *   tree's hash (20 bytes), and the offset (8 bytes, big endian) and length
+ *   (4 bytes, big endian) of its data
+ * - the trees, in TreeView's serialized format
+ *
+ * TreeSnapshot is immutable once opened, and can be used from multiple
+ * threads.
+ */
+class TreeSnapshot {
+ public:
+  /**
+   * Open and validate the index of a snapshot.
+   *
+   * Throws an exception if the file cannot be read or is not a snapshot.
+   */
+  static std::shared_ptr<const TreeSnapshot> open(AbsolutePathPiece path);
+
+  /**
+   * Write a snapshot of all of the trees reachable from commitID to path,
+   * replacing any file that is already there.
+   *
+   * The store must remain valid until the returned Future completes, which
+   * produces the number of trees written.  Trees with names too long for
+   * TreeView's format are left out; they are still loaded normally.
+   */
+  static folly::Future<size_t> create(
+      const IObjectStore* store,
+      const Hash& commitID,
+      AbsolutePathPiece path);
+
+  /**
+   * Returns a view of the tree with the given hash, which refers to the
+   * mapped file and so must not outlive this TreeSnapshot, or folly::none if
+   * the snapshot does not contain it.
+   */
+  folly::Optional<TreeView> getTreeView(const Hash& id) const;
+
+  /**
+   * Returns a copy of the tree with the given hash, or nullptr if the
+   * snapshot does not contain it.
+   */
+  std::unique_ptr<Tree> getTree(const Hash& id) const;
+
+  /**
+   * Returns the commit that the snapshot was made from.
+   */
+  const Hash& getCommitID() const {
+    return commitID_;
+  }
+
+  /**
+   * Returns the hash of the commit's root tree.
+   */
+  const Hash& getRootTreeID() const {
+    return rootTreeID_;
+  }
+
+  /**
+   * Returns the number of trees in the snapshot.
+   */
+  size_t size() const {
+    return count_;
+  }
+
+  const AbsolutePath& getPath() const {
+    return path_;
+  }
+
+ private:
+  static constexpr folly::StringPiece kMagic{"EDTS"};
+  static constexpr uint32_t kVersion = 1;
+  static constexpr size_t kHeaderSize =
+      4 + sizeof(uint32_t) + sizeof(uint64_t) + 2 * Hash::RAW_SIZE;
+  static constexpr size_t kIndexEntrySize =
+      Hash::RAW_SIZE + sizeof(uint64_t) + sizeof(uint32_t);
+
+  TreeSnapshot(AbsolutePathPiece path, folly::MemoryMapping mapping);
+
+  /**
+   * Sort the trees and write them to path, returning how many there were.
+   */
+  static size_t write(
+      AbsolutePathPiece path,
+      const Hash& commitID,
+      const Hash& rootTreeID,
+      std::vector<std::pair<Hash, folly::IOBuf>>& trees);
+
+  [[noreturn]] void throwInvalid(folly::StringPiece reason) const;
+
+  const AbsolutePath path_;
+  const folly::MemoryMapping mapping_;
+  size_t count_{0};
+  Hash commitID_;
+  Hash rootTreeID_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,200 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/TreeView.h"
+
+#include <folly/Format.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <folly/lang/Bits.h>
+#include <cstring>
+#include <limits>
+
+#include "eden/fs/model/Tree.h"
+
+using folly::ByteRange;
+using folly::IOBuf;
+using folly::StringPiece;
+
+namespace facebook {
+namespace eden {
+
+constexpr uint8_t TreeView::kMagic;
+constexpr uint8_t TreeView::kVersion;
+constexpr uint8_t TreeView::kVersionWithMetadata;
+constexpr size_t TreeView::kHeaderSize;
+constexpr size_t TreeView::kEntrySize;
+constexpr size_t TreeView::kEntryWithMetadataSize;
+constexpr uint8_t TreeView::kHasSize;
+constexpr uint8_t TreeView::kHasContentSha1;
+
+namespace {
+template <typename T>
+T loadBigEndian(const uint8_t* data) {
+  T value;
+  memcpy(&value, data, sizeof(T));
+  return folly::Endian::big(value);
+}
+} // namespace
+
+TreeView::TreeView(const Hash& hash, StoreResult&& data)
+    : hash_(hash), data_(std::move(data)) {
+  parse(data_.bytes());
+}
+
+TreeView::TreeView(const Hash& hash, ByteRange data)
+    : hash_(hash), borrowed_(data) {
+  parse(borrowed_);
+}
+
+void TreeView::parse(ByteRange bytes) {
+  if (bytes.size() < kHeaderSize || bytes[0] != kMagic) {
+    throwInvalid("unsupported header");
+  }
+  if (bytes[1] == kVersionWithMetadata) {
+    entrySize_ = kEntryWithMetadataSize;
+  } else if (bytes[1] != kVersion) {
+    throwInvalid("unsupported version");
+  }
+  const size_t count = loadBigEndian<uint32_t>(bytes.data() + 2);
+  if ((bytes.size() - kHeaderSize) / entrySize_ < count) {
+    throwInvalid("truncated entries");
+  }
+
+  // Check every entry now, so that accessing them later cannot fail.
+  nameOffsets_.reserve(count);
+  size_t nameOffset = kHeaderSize + count * entrySize_;
+  const uint8_t allowedFlags =
+      entrySize_ == kEntrySize ? 0 : kHasSize | kHasContentSha1;
+  for (size_t index = 0; index < count; ++index) {
+    const auto* record = bytes.data() + kHeaderSize + index * entrySize_;
+    const auto type = record[Hash::RAW_SIZE];
+    if (type > static_cast<uint8_t>(TreeEntryType::SYMLINK)) {
+      throwInvalid("unknown entry type");
+    }
+    if (record[Hash::RAW_SIZE + 1] & ~allowedFlags) {
+      throwInvalid("unknown entry flags");
+    }
+    const size_t nameSize =
+        loadBigEndian<uint16_t>(record + Hash::RAW_SIZE + 2);
+    if (bytes.size() - nameOffset < nameSize) {
+      throwInvalid("truncated names");
+    }
+
+    auto name = StringPiece{bytes.subpiece(nameOffset, nameSize)};
+    try {
+      (void)PathComponentPiece{name};
+    } catch (const std::domain_error&) {
+      throwInvalid("invalid entry name");
+    }
+
+    nameOffsets_.push_back(nameOffset);
+    nameOffset += nameSize;
+  }
+  if (nameOffset != bytes.size()) {
+    throwInvalid("trailing data");
+  }
+}
+
+folly::Optional<IOBuf> TreeView::serialize(const Tree& tree) {
+  const auto& entries = tree.getTreeEntries();
+  size_t namesSize = 0;
+  bool hasMetadata = false;
+  for (const auto& entry : entries) {
+    auto nameSize = entry.getName().stringPiece().size();
+    if (nameSize > std::numeric_limits<uint16_t>::max()) {
+      return folly::none;
+    }
+    namesSize += nameSize;
+    hasMetadata = hasMetadata || entry.getSize() || entry.getContentSha1();
+  }
+
+  const auto entrySize = hasMetadata ? kEntryWithMetadataSize : kEntrySize;
+  IOBuf buf{IOBuf::CREATE,
+            kHeaderSize + entries.size() * entrySize + namesSize};
+  folly::io::Appender appender{&buf, 0};
+  appender.write<uint8_t>(kMagic);
+  appender.write<uint8_t>(hasMetadata ? kVersionWithMetadata : kVersion);
+  appender.writeBE<uint32_t>(entries.size());
+  for (const auto& entry : entries) {
+    appender.push(entry.getHash().getBytes());
+    appender.write<uint8_t>(static_cast<uint8_t>(entry.getType()));
+    appender.write<uint8_t>(
+        (entry.getSize() ? kHasSize : 0) |
+        (entry.getContentSha1() ? kHasContentSha1 : 0));
+    appender.writeBE<uint16_t>(entry.getName().stringPiece().size());
+    if (hasMetadata) {
+      appender.writeBE<uint64_t>(entry.getSize().value_or(0));
+      appender.push(entry.getContentSha1().value_or(Hash{}).getBytes());
+    }
+  }
+  for (const auto& entry : entries) {
+    appender.push(ByteRange{entry.getName().stringPiece()});
+  }
+  return std::move(buf);
+}
+
+TreeEntryView TreeView::getEntryAt(size_t index) const {
+  auto bytes = getBytes();
+  const auto* record = bytes.data() + kHeaderSize + index * entrySize_;
+  const auto flags = record[Hash::RAW_SIZE + 1];
+  const size_t nameSize = loadBigEndian<uint16_t>(record + Hash::RAW_SIZE + 2);
+  const auto* metadata = record + kEntrySize;
+
+  folly::Optional<uint64_t> size;
+  if (flags & kHasSize) {
+    size = loadBigEndian<uint64_t>(metadata);
+  }
+  ByteRange contentSha1;
+  if (flags & kHasContentSha1) {
+    contentSha1 = ByteRange{metadata + sizeof(uint64_t), Hash::RAW_SIZE};
+  }
+  return TreeEntryView{
+      ByteRange{record, Hash::RAW_SIZE},
+      PathComponentPiece{
+          StringPiece{bytes.subpiece(nameOffsets_[index], nameSize)},
+          detail::SkipPathSanityCheck()},
+      static_cast<TreeEntryType>(record[Hash::RAW_SIZE]),
+      size,
+      contentSha1};
+}
+
+folly::Optional<TreeEntryView> TreeView::find(PathComponentPiece name) const {
+  size_t begin = 0;
+  size_t end = size();
+  while (begin < end) {
+    const auto middle = begin + (end - begin) / 2;
+    auto entry = getEntryAt(middle);
+    if (entry.getName() < name) {
+      begin = middle + 1;
+    } else if (name < entry.getName()) {
+      end = middle;
+    } else {
+      return entry;
+    }
+  }
+  return folly::none;
+}
+
+std::unique_ptr<Tree> TreeView::toTree() const {
+  std::vector<TreeEntry> entries;
+  entries.reserve(size());
+  for (size_t index = 0; index < size(); ++index) {
+    entries.push_back(getEntryAt(index).toTreeEntry());
+  }
+  return std::make_unique<Tree>(std::move(entries), hash_);
+}
+
+void TreeView::throwInvalid(StringPiece reason) const {
+  throw std::invalid_argument(folly::sformat(
+      "Tree {} could not be deserialized: {}", hash_.toString(), reason));
+}
+
+} // namespace eden
+} // namespace facebook
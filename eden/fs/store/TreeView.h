@@ -0,0 +1,203 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <memory>
+#include <vector>
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/model/TreeEntry.h"
+#include "eden/fs/store/StoreResult.h"
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace folly {
+class IOBuf;
+}
+
+namespace facebook {
+namespace eden {
+
+class Tree;
+
+/**
+ * An entry of a TreeView.  It refers to the TreeView's data, so it must not
+ * outlive the TreeView.
+ */
+class TreeEntryView {
+ public:
+  Hash getHash() const {
+    return Hash{hash_};
+  }
+
+  PathComponentPiece getName() const {
+    return name_;
+  }
+
+  TreeEntryType getType() const {
+    return type_;
+  }
+
+  bool isTree() const {
+    return type_ == TreeEntryType::TREE;
+  }
+
+  const folly::Optional<uint64_t>& getSize() const {
+    return size_;
+  }
+
+  folly::Optional<Hash> getContentSha1() const {
+    if (contentSha1_.empty()) {
+      return folly::none;
+    }
+    return Hash{contentSha1_};
+  }
+
+  TreeEntry toTreeEntry() const {
+    return TreeEntry{
+        getHash(), name_.stringPiece(), type_, size_, getContentSha1()};
+  }
+
+ private:
+  friend class TreeView;
+
+  TreeEntryView(
+      folly::ByteRange hash,
+      PathComponentPiece name,
+      TreeEntryType type,
+      folly::Optional<uint64_t> size,
+      folly::ByteRange contentSha1)
+      : hash_(hash),
+        name_(name),
+        type_(type),
+        size_(size),
+        contentSha1_(contentSha1) {}
+
+  folly::ByteRange hash_;
+  PathComponentPiece name_;
+  TreeEntryType type_;
+  folly::Optional<uint64_t> size_;
+  /** Empty if the SHA-1 is not known. */
+  folly::ByteRange contentSha1_;
+};
+
+/**
+ * A read-only view of a tree in LocalStore's serialized tree format.
+ *
+ * Unlike Tree, TreeView does not copy each entry's name and hash out of the
+ * serialized data.  Its entries are decoded when they are accessed, so a
+ * whole tree can be walked without an allocation per entry.  The data is
+ * validated once, when the TreeView is constructed.
+ *
+ * The serialized format is:
+ * - magic byte (0xed), which git tree objects never start with
+ * - format version (1 byte)
+ * - entry count (4 bytes, big endian)
+ * - one fixed size record for each entry, ordered by name:
+ *   - hash (20 bytes)
+ *   - TreeEntryType (1 byte)
+ *   - flags (1 byte), saying which of the optional fields are set
+ *   - name length (2 bytes, big endian)
+ *   - in version 2 only, the size of the file (8 bytes, big endian)
+ *   - in version 2 only, the SHA-1 of the file's contents (20 bytes)
+ * - the entries' names, concatenated in order
+ *
+ * Version 2 is only used for trees that have an entry with a known size or
+ * SHA-1, so that other trees do not pay for the larger records.
+ */
+class TreeView {
+ public:
+  /**
+   * Create a view of serialized tree data.
+   *
+   * Throws std::invalid_argument if the data is not a valid serialized tree.
+   */
+  TreeView(const Hash& hash, StoreResult&& data);
+
+  /**
+   * Create a view of serialized tree data that is owned by someone else,
+   * such as a TreeSnapshot.  The data is not copied, so it must outlive the
+   * view and any entries read from it.
+   */
+  TreeView(const Hash& hash, folly::ByteRange data);
+
+  TreeView(TreeView&&) = default;
+  TreeView& operator=(TreeView&&) = default;
+
+  /**
+   * Returns true if the data is in the serialized tree format, rather than
+   * git's tree format.
+   */
+  static bool isSerializedTree(folly::ByteRange data) {
+    return !data.empty() && data[0] == kMagic;
+  }
+
+  /**
+   * Serialize a tree, or return folly::none if it has a name too long to be
+   * represented in this format.
+   */
+  static folly::Optional<folly::IOBuf> serialize(const Tree& tree);
+
+  const Hash& getHash() const {
+    return hash_;
+  }
+
+  size_t size() const {
+    return nameOffsets_.size();
+  }
+
+  TreeEntryView getEntryAt(size_t index) const;
+
+  /**
+   * Find the entry with the given name, or return folly::none if there is
+   * none.
+   */
+  folly::Optional<TreeEntryView> find(PathComponentPiece name) const;
+
+  /**
+   * Copy the entries into a Tree.
+   */
+  std::unique_ptr<Tree> toTree() const;
+
+ private:
+  static constexpr uint8_t kMagic = 0xed;
+  static constexpr uint8_t kVersion = 1;
+  static constexpr uint8_t kVersionWithMetadata = 2;
+  static constexpr size_t kHeaderSize = 2 + sizeof(uint32_t);
+  static constexpr size_t kEntrySize = Hash::RAW_SIZE + 2 + sizeof(uint16_t);
+  static constexpr size_t kEntryWithMetadataSize =
+      kEntrySize + sizeof(uint64_t) + Hash::RAW_SIZE;
+  /** Entry flags */
+  static constexpr uint8_t kHasSize = 0x01;
+  static constexpr uint8_t kHasContentSha1 = 0x02;
+
+  [[noreturn]] void throwInvalid(folly::StringPiece reason) const;
+
+  void parse(folly::ByteRange bytes);
+
+  folly::ByteRange getBytes() const {
+    return data_.isValid() ? data_.bytes() : borrowed_;
+  }
+
+  Hash hash_;
+  /**
+   * The data is kept in the StoreResult that it was read into.  Entries are
+   * located by offset, since moving a short std::string moves its data.
+   */
+  StoreResult data_;
+  /** The data, if it is not owned by this view. */
+  folly::ByteRange borrowed_;
+  size_t entrySize_{kEntrySize};
+  /** The offset of each entry's name in data_. */
+  std::vector<uint32_t> nameOffsets_;
+};
+
+} // namespace eden
+} // namespace facebook
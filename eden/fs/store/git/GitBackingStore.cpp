@@ -10,9 +10,14 @@
 #include "GitBackingStore.h"
 
 #include <folly/Conv.h>
+#include <folly/ThreadLocal.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
 #include <folly/futures/Future.h>
 #include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
 #include <git2.h>
+#include <algorithm>
 
 #include "eden/fs/model/Blob.h"
 #include "eden/fs/model/Hash.h"
@@ -20,6 +25,7 @@
 #include "eden/fs/model/TreeEntry.h"
 #include "eden/fs/model/git/GitTree.h"
 #include "eden/fs/store/LocalStore.h"
+#include "eden/fs/store/StoreStats.h"
 
 using folly::ByteRange;
 using folly::Future;
@@ -30,6 +36,11 @@ using std::make_unique;
 using std::string;
 using std::unique_ptr;
 
+DEFINE_int32(
+    num_git_import_threads,
+    8,
+    "the number of threads per git repository used to read git objects");
+
 namespace {
 
 template <typename... Args>
@@ -46,6 +57,52 @@ void freeBlobIOBufData(void* /*blobData*/, void* blobObject) {
   git_blob* gitBlob = static_cast<git_blob*>(blobObject);
   git_blob_free(gitBlob);
 }
+
+// The repository handle for the current thread.  This is only initialized on
+// git import threads.
+folly::ThreadLocalPtr<git_repository> threadLocalRepo;
+
+/**
+ * Thread factory that sets the thread name and opens a handle to the
+ * repository for the thread to use.
+ */
+class GitImportThreadFactory : public folly::ThreadFactory {
+ public:
+  explicit GitImportThreadFactory(std::string repository)
+      : delegate_("GitImport"), repository_(std::move(repository)) {}
+
+  std::thread newThread(folly::Func&& func) override {
+    return delegate_.newThread([this, func = std::move(func)]() mutable {
+      git_repository* repo = nullptr;
+      auto error = git_repository_open(&repo, repository_.c_str());
+      if (error) {
+        // getThreadRepository() reports this to each request that needs the
+        // repository, rather than taking down the whole process here.
+        XLOG(ERR) << "error opening git repository " << repository_ << ": "
+                  << giterr_last()->message;
+      } else {
+        threadLocalRepo.reset(
+            repo, [](git_repository* r, folly::TLPDestructionMode) {
+              git_repository_free(r);
+            });
+      }
+      func();
+    });
+  }
+
+ private:
+  folly::NamedThreadFactory delegate_;
+  std::string repository_;
+};
+
+git_repository* getThreadRepository() {
+  if (!threadLocalRepo) {
+    throw std::runtime_error(
+        "no git repository is open on this thread; "
+        "objects can only be read on git import threads");
+  }
+  return threadLocalRepo.get();
+}
 } // namespace
 
 namespace facebook {
@@ -54,7 +111,9 @@ namespace eden {
 GitBackingStore::GitBackingStore(
     AbsolutePathPiece repository,
     LocalStore* localStore)
-    : localStore_{localStore} {
+    : localStore_{localStore},
+      stats_{std::make_shared<BackingStoreStats>(
+          folly::to<string>(repository.value(), ".git"))} {
   // Make sure libgit2 is initialized.
   // (git_libgit2_init() is safe to call multiple times if multiple
   // GitBackingStore objects are created.  git_libgit2_shutdown() should be
@@ -63,28 +122,43 @@ GitBackingStore::GitBackingStore(
 
   auto error = git_repository_open(&repo_, repository.value().str().c_str());
   gitCheckError(error, "error opening git repository", repository);
+
+  gitThreadPool_ = make_unique<folly::CPUThreadPoolExecutor>(
+      std::max(FLAGS_num_git_import_threads, 1),
+      std::make_shared<GitImportThreadFactory>(repository.value().str()));
 }
 
 GitBackingStore::~GitBackingStore() {
+  // Join the import threads first, since they free their repository handles
+  // on exit and that has to happen before git_libgit2_shutdown().
+  gitThreadPool_.reset();
   git_repository_free(repo_);
   git_libgit2_shutdown();
 }
 
+void GitBackingStore::aggregateStats() {
+  stats_->aggregate();
+}
+
 const char* GitBackingStore::getPath() const {
   return git_repository_path(repo_);
 }
 
-Future<unique_ptr<Tree>> GitBackingStore::getTree(const Hash& id) {
-  // TODO: Use a separate thread pool to do the git I/O
-  return makeFuture(getTreeImpl(id));
+Future<unique_ptr<Tree>> GitBackingStore::getTree(
+    const Hash& id,
+    ImportPriority /* priority */) {
+  return BackingStoreStats::track(stats_, &BackingStoreStats::getTree, [&] {
+    return folly::via(
+        gitThreadPool_.get(), [this, id] { return getTreeImpl(id); });
+  });
 }
 
-unique_ptr<Tree> GitBackingStore::getTreeImpl(const Hash& id) {
+unique_ptr<Tree> GitBackingStore::getTreeImpl(const Hash& id) const {
   XLOG(DBG4) << "importing tree " << id;
 
   git_oid treeOID = hash2Oid(id);
   git_tree* gitTree = nullptr;
-  auto error = git_tree_lookup(&gitTree, repo_, &treeOID);
+  auto error = git_tree_lookup(&gitTree, getThreadRepository(), &treeOID);
   gitCheckError(
       error, "unable to find git tree ", id, " in repository ", getPath());
   SCOPE_EXIT {
@@ -126,17 +200,21 @@ unique_ptr<Tree> GitBackingStore::getTreeImpl(const Hash& id) {
   return tree;
 }
 
-Future<unique_ptr<Blob>> GitBackingStore::getBlob(const Hash& id) {
-  // TODO: Use a separate thread pool to do the git I/O
-  return makeFuture(getBlobImpl(id));
+Future<unique_ptr<Blob>> GitBackingStore::getBlob(
+    const Hash& id,
+    ImportPriority /* priority */) {
+  return BackingStoreStats::track(stats_, &BackingStoreStats::getBlob, [&] {
+    return folly::via(
+        gitThreadPool_.get(), [this, id] { return getBlobImpl(id); });
+  });
 }
 
-unique_ptr<Blob> GitBackingStore::getBlobImpl(const Hash& id) {
+unique_ptr<Blob> GitBackingStore::getBlobImpl(const Hash& id) const {
   XLOG(DBG5) << "importing blob " << id;
 
   auto blobOID = hash2Oid(id);
   git_blob* blob = nullptr;
-  int error = git_blob_lookup(&blob, repo_, &blobOID);
+  int error = git_blob_lookup(&blob, getThreadRepository(), &blobOID);
   gitCheckError(
       error, "unable to find git blob ", id, " in repository ", getPath());
 
@@ -154,15 +232,72 @@ unique_ptr<Blob> GitBackingStore::getBlobImpl(const Hash& id) {
   return make_unique<Blob>(id, std::move(buf));
 }
 
+folly::Future<folly::Unit> GitBackingStore::prefetchBlobs(
+    const std::vector<Hash>& ids) const {
+  if (ids.empty()) {
+    return folly::unit;
+  }
+
+  auto sortedIDs = std::make_shared<std::vector<Hash>>(ids);
+  std::sort(sortedIDs->begin(), sortedIDs->end());
+
+  // Give each thread one contiguous range of the sorted IDs.
+  auto numBatches = std::min(
+      sortedIDs->size(),
+      static_cast<size_t>(std::max(FLAGS_num_git_import_threads, 1)));
+  auto batchSize = (sortedIDs->size() + numBatches - 1) / numBatches;
+  std::vector<Future<folly::Unit>> futures;
+  for (size_t start = 0; start < sortedIDs->size(); start += batchSize) {
+    auto end = std::min(start + batchSize, sortedIDs->size());
+    futures.push_back(
+        folly::via(gitThreadPool_.get(), [this, sortedIDs, start, end] {
+          for (size_t n = start; n < end; ++n) {
+            const auto& id = (*sortedIDs)[n];
+            try {
+              auto blob = getBlobImpl(id);
+              localStore_->putBlob(id, blob.get());
+            } catch (const std::exception& ex) {
+              // A prefetch is only a hint; getBlob() will report the error
+              // if the blob turns out to be needed.
+              XLOG(DBG3) << "error prefetching git blob " << id << ": "
+                         << ex.what();
+            }
+          }
+        }));
+  }
+  return folly::collectAll(futures).then(
+      [](std::vector<folly::Try<folly::Unit>>&&) {});
+}
+
 Future<unique_ptr<Tree>> GitBackingStore::getTreeForCommit(
     const Hash& commitID) {
-  // TODO: Use a separate thread pool to do the git I/O
+  return BackingStoreStats::track(
+      stats_, &BackingStoreStats::getTreeForCommit, [&] {
+        return folly::via(
+                   gitThreadPool_.get(),
+                   [this, commitID] { return getTreeIDForCommit(commitID); })
+            .then([this](const Hash& treeID) {
+              return localStore_->getTree(treeID).then(
+                  [this, treeID](
+                      unique_ptr<Tree> tree) -> Future<unique_ptr<Tree>> {
+                    if (tree) {
+                      return std::move(tree);
+                    }
+                    return folly::via(gitThreadPool_.get(), [this, treeID] {
+                      return getTreeImpl(treeID);
+                    });
+                  });
+            });
+      });
+}
+
+Hash GitBackingStore::getTreeIDForCommit(const Hash& commitID) const {
   XLOG(DBG4) << "resolving tree for commit " << commitID;
 
   // Look up the commit info
   git_oid commitOID = hash2Oid(commitID);
   git_commit* commit = nullptr;
-  auto error = git_commit_lookup(&commit, repo_, &commitOID);
+  auto error = git_commit_lookup(&commit, getThreadRepository(), &commitOID);
   gitCheckError(
       error,
       "unable to find git commit ",
@@ -174,17 +309,7 @@ Future<unique_ptr<Tree>> GitBackingStore::getTreeForCommit(
   };
 
   // Get the tree ID for this commit.
-  Hash treeID = oid2Hash(git_commit_tree_id(commit));
-
-  // Now get the specified tree.
-  return localStore_->getTree(treeID).then(
-      [this, treeID](unique_ptr<Tree> tree) {
-        if (tree) {
-          return tree;
-        } else {
-          return getTreeImpl(treeID);
-        }
-      });
+  return oid2Hash(git_commit_tree_id(commit));
 }
 
 git_oid GitBackingStore::hash2Oid(const Hash& hash) {
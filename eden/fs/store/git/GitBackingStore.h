@@ -10,6 +10,7 @@
 #pragma once
 
 #include <folly/Range.h>
+#include <memory>
 
 #include "eden/fs/store/BackingStore.h"
 #include "eden/fs/utils/PathFuncs.h"
@@ -17,14 +18,25 @@
 struct git_oid;
 struct git_repository;
 
+namespace folly {
+class CPUThreadPoolExecutor;
+} // namespace folly
+
 namespace facebook {
 namespace eden {
 
+class BackingStoreStats;
 class Hash;
 class LocalStore;
 
 /**
  * A BackingStore implementation that loads data out of a git repository.
+ *
+ * Objects are read on a dedicated thread pool, so callers get back futures
+ * that complete once the read is done rather than blocking while it happens.
+ * libgit2 repository objects are not safe to use from several threads at
+ * once, so each pool thread opens its own handle to the repository.  The
+ * handles share libgit2's process-wide cache of mmap'd pack files.
  */
 class GitBackingStore : public BackingStore {
  public:
@@ -45,23 +57,46 @@ class GitBackingStore : public BackingStore {
    */
   const char* getPath() const;
 
-  folly::Future<std::unique_ptr<Tree>> getTree(const Hash& id) override;
-  folly::Future<std::unique_ptr<Blob>> getBlob(const Hash& id) override;
+  folly::Future<std::unique_ptr<Tree>> getTree(
+      const Hash& id,
+      ImportPriority priority) override;
+  folly::Future<std::unique_ptr<Blob>> getBlob(
+      const Hash& id,
+      ImportPriority priority) override;
   folly::Future<std::unique_ptr<Tree>> getTreeForCommit(
       const Hash& commitID) override;
 
+  /**
+   * Read the given blobs into the LocalStore.
+   *
+   * The blobs are split into a few batches that are read in parallel, and
+   * the objects in each batch are sorted by ID, which is the order that the
+   * pack index stores them in.
+   */
+  FOLLY_NODISCARD folly::Future<folly::Unit> prefetchBlobs(
+      const std::vector<Hash>& ids) const override;
+
+  void aggregateStats() override;
+
  private:
   GitBackingStore(GitBackingStore const&) = delete;
   GitBackingStore& operator=(GitBackingStore const&) = delete;
 
-  std::unique_ptr<Tree> getTreeImpl(const Hash& id);
-  std::unique_ptr<Blob> getBlobImpl(const Hash& id);
+  // These must be called on a thread from gitThreadPool_.
+  std::unique_ptr<Tree> getTreeImpl(const Hash& id) const;
+  std::unique_ptr<Blob> getBlobImpl(const Hash& id) const;
+  Hash getTreeIDForCommit(const Hash& commitID) const;
 
   static git_oid hash2Oid(const Hash& hash);
   static Hash oid2Hash(const git_oid* oid);
 
   LocalStore* localStore_{nullptr};
+  // The repository handle used on the thread that created the store.  Pool
+  // threads use their own; see getThreadRepository() in the .cpp file.
   git_repository* repo_{nullptr};
+  std::unique_ptr<folly::CPUThreadPoolExecutor> gitThreadPool_;
+  // Named "<repository>.git".
+  std::shared_ptr<BackingStoreStats> stats_;
 };
 } // namespace eden
 } // namespace facebook
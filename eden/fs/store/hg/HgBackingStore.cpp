@@ -9,6 +9,7 @@
  */
 #include "HgBackingStore.h"
 
+#include <folly/Conv.h>
 #include <folly/ThreadLocal.h>
 #include <folly/executors/CPUThreadPoolExecutor.h>
 #include <folly/executors/thread_factory/NamedThreadFactory.h>
@@ -21,7 +22,7 @@
 #include "eden/fs/store/LocalStore.h"
 #include "eden/fs/store/StoreResult.h"
 #include "eden/fs/store/hg/HgImporter.h"
-#include "eden/fs/store/hg/HgProxyHash.h"
+#include "eden/fs/utils/ThreadAffinity.h"
 #include "eden/fs/utils/UnboundedQueueExecutor.h"
 
 using folly::ByteRange;
@@ -30,6 +31,7 @@ using folly::makeFuture;
 using folly::StringPiece;
 using std::make_unique;
 using std::unique_ptr;
+using std::chrono::steady_clock;
 using KeySpace = facebook::eden::LocalStore::KeySpace;
 
 DEFINE_int32(
@@ -42,6 +44,36 @@ DEFINE_int32(
     8,
     "the number of hg import threads per repo");
 
+DEFINE_int32(
+    hg_import_batch_size,
+    256,
+    "the maximum number of blob requests combined into a single batch for "
+    "hg_import_helper.py");
+
+DEFINE_int32(
+    hg_import_helper_spares,
+    1,
+    "the number of hg_import_helper.py processes per repo to keep started "
+    "ahead of time, ready to replace one that fails");
+
+DEFINE_uint64(
+    hg_proxy_hash_cache_size,
+    200000,
+    "the maximum number of HgProxyHash entries to keep in memory per repo");
+
+DEFINE_string(
+    hg_import_thread_affinity,
+    "",
+    "The CPUs the hg importer threads, and the hg_import_helper.py processes "
+    "they start, may run on: a CPU list like \"0-7,16-23\", or \"node:\" "
+    "followed by a list of NUMA nodes.  Empty lets them run anywhere");
+
+DEFINE_uint64(
+    hg_commit_tree_cache_size,
+    1000,
+    "the maximum number of commit to root tree mappings to keep in memory "
+    "per repo");
+
 namespace facebook {
 namespace eden {
 
@@ -61,8 +93,9 @@ Importer& getThreadLocalImporter() {
 }
 
 /**
- * Thread factory that sets thread name and initializes a thread local
- * HgImporter.
+ * Thread factory that sets thread name and CPU affinity, and initializes a
+ * thread local HgImporter.  The affinity is set first, so that the helper
+ * processes the importer starts inherit it.
  */
 class HgImporterThreadFactory : public folly::ThreadFactory {
  public:
@@ -70,17 +103,32 @@ class HgImporterThreadFactory : public folly::ThreadFactory {
       AbsolutePathPiece repository,
       LocalStore* localStore,
       folly::Optional<AbsolutePath> clientCertificate,
-      bool useMononoke)
+      bool useMononoke,
+      HgProxyHashCache* proxyHashCache,
+      HgImporterPool* importerPool,
+      HgImportStats* stats,
+      CpuAffinity affinity)
       : delegate_("HgImporter"),
         repository_(repository),
         localStore_(localStore),
         clientCertificate_(clientCertificate),
-        useMononoke_(useMononoke) {}
+        useMononoke_(useMononoke),
+        proxyHashCache_(proxyHashCache),
+        importerPool_(importerPool),
+        stats_(stats),
+        affinity_(std::move(affinity)) {}
 
   std::thread newThread(folly::Func&& func) override {
     return delegate_.newThread([this, func = std::move(func)]() mutable {
+      affinity_.applyToCurrentThread();
       threadLocalImporter.reset(new HgImporterManager(
-          repository_, localStore_, clientCertificate_, useMononoke_));
+          repository_,
+          localStore_,
+          clientCertificate_,
+          useMononoke_,
+          proxyHashCache_,
+          importerPool_,
+          stats_));
       func();
     });
   }
@@ -91,6 +139,9 @@ class HgImporterThreadFactory : public folly::ThreadFactory {
   LocalStore* localStore_;
   folly::Optional<AbsolutePath> clientCertificate_;
   bool useMononoke_;
+  HgProxyHashCache* proxyHashCache_;
+  HgImporterPool* importerPool_;
+  HgImportStats* stats_;
 };
 
 /**
@@ -116,6 +167,21 @@ HgBackingStore::HgBackingStore(
     folly::Optional<AbsolutePath> clientCertificate,
     bool useMononoke)
     : localStore_(localStore),
+      stats_(make_unique<HgImportStats>(
+          folly::to<std::string>(repository.value(), ".hg"))),
+      proxyHashCache_(FLAGS_hg_proxy_hash_cache_size),
+      commitTreeCache_(std::max<size_t>(FLAGS_hg_commit_tree_cache_size, 1)),
+      // The pool starts its first helper right away, so that it is likely to
+      // be ready by the time the first import for this repository arrives.
+      importerPool_(make_unique<HgImporterPool>(
+          repository,
+          localStore,
+          clientCertificate,
+          useMononoke,
+          &proxyHashCache_,
+          static_cast<size_t>(std::max(FLAGS_hg_import_helper_spares, 0)),
+          stats_.get(),
+          CpuAffinity::parse(FLAGS_hg_import_thread_affinity))),
       importThreadPool_(make_unique<folly::CPUThreadPoolExecutor>(
           FLAGS_num_hg_import_threads,
           make_unique<folly::LifoSemMPMCQueue<
@@ -131,7 +197,11 @@ HgBackingStore::HgBackingStore(
               repository,
               localStore,
               clientCertificate,
-              useMononoke))),
+              useMononoke,
+              &proxyHashCache_,
+              importerPool_.get(),
+              stats_.get(),
+              CpuAffinity::parse(FLAGS_hg_import_thread_affinity)))),
       serverThreadPool_(serverThreadPool) {}
 
 /**
@@ -141,93 +211,326 @@ HgBackingStore::HgBackingStore(
  */
 HgBackingStore::HgBackingStore(Importer* importer, LocalStore* localStore)
     : localStore_{localStore},
+      stats_{make_unique<HgImportStats>("hg")},
+      proxyHashCache_{FLAGS_hg_proxy_hash_cache_size},
+      commitTreeCache_{std::max<size_t>(FLAGS_hg_commit_tree_cache_size, 1)},
       importThreadPool_{std::make_unique<HgImporterTestExecutor>(importer)},
       serverThreadPool_{importThreadPool_.get()} {}
 
 HgBackingStore::~HgBackingStore() {}
 
-Future<unique_ptr<Tree>> HgBackingStore::getTree(const Hash& id) {
-  return folly::via(
-             importThreadPool_.get(),
-             [id] { return getThreadLocalImporter().importTree(id); })
-      // Ensure that the control moves back to the main thread pool
-      // to process the caller-attached .then routine.
-      .via(serverThreadPool_);
+void HgBackingStore::aggregateStats() {
+  stats_->aggregate();
+}
+
+void HgBackingStore::scheduleImport(ImportPriority priority, folly::Func job)
+    const {
+  stats_->queueDepth.incrementValue(1);
+  importQueue_.wlock()->jobs[static_cast<size_t>(priority)].push_back(
+      [this, enqueued = steady_clock::now(), job = std::move(job)]() mutable {
+        StoreStats::recordLatency(
+            stats_->queueWait, steady_clock::now() - enqueued);
+        job();
+      });
+  importThreadPool_->add([this] { runNextImport(); });
+}
+
+template <typename T, typename Fn>
+Future<T> HgBackingStore::runImport(ImportPriority priority, Fn&& fn) const {
+  folly::Promise<T> promise;
+  auto future = promise.getFuture();
+  scheduleImport(
+      priority,
+      [this,
+       promise = std::move(promise),
+       token = CancellationToken::current(),
+       fn = std::forward<Fn>(fn)]() mutable {
+        // Nobody is waiting for the result any more, so don't spend importer
+        // time on it.
+        if (token.isCancelled()) {
+          stats_->cancelledImports.addValue(1);
+          promise.setException(folly::FutureCancellation{});
+          return;
+        }
+        promise.setWith(std::move(fn));
+      });
+  return future;
+}
+
+void HgBackingStore::runNextImport() const {
+  folly::Func job;
+  std::vector<PendingBlobImport> batch;
+  {
+    auto queue = importQueue_.wlock();
+    for (size_t priority = 0; priority < kNumImportPriorities; ++priority) {
+      auto& jobs = queue->jobs[priority];
+      if (!jobs.empty()) {
+        job = std::move(jobs.front());
+        jobs.pop_front();
+        break;
+      }
+
+      auto& blobs = queue->blobs[priority];
+      if (!blobs.empty()) {
+        auto count = std::min(
+            blobs.size(),
+            static_cast<size_t>(std::max(FLAGS_hg_import_batch_size, 1)));
+        batch.reserve(count);
+        for (size_t n = 0; n < count; ++n) {
+          batch.push_back(std::move(blobs.front()));
+          blobs.pop_front();
+        }
+        break;
+      }
+    }
+  }
+
+  if (job) {
+    stats_->queueDepth.incrementValue(-1);
+    job();
+  } else if (!batch.empty()) {
+    stats_->queueDepth.incrementValue(-static_cast<int64_t>(batch.size()));
+    auto now = steady_clock::now();
+    for (const auto& import : batch) {
+      StoreStats::recordLatency(stats_->queueWait, now - import.enqueued);
+    }
+    importBlobs(std::move(batch));
+  }
 }
 
-Future<unique_ptr<Blob>> HgBackingStore::getBlob(const Hash& id) {
-  return folly::via(
-             importThreadPool_.get(),
-             [id] { return getThreadLocalImporter().importFileContents(id); })
+void HgBackingStore::importBlobs(std::vector<PendingBlobImport> batch) const {
+  std::vector<PendingBlobImport> imports;
+  imports.reserve(batch.size());
+  for (auto& import : batch) {
+    if (import.cancelled->load(std::memory_order_relaxed) ||
+        import.token.isCancelled()) {
+      stats_->cancelledImports.addValue(1);
+      import.promise.setException(folly::FutureCancellation{});
+    } else {
+      imports.push_back(std::move(import));
+    }
+  }
+  if (imports.empty()) {
+    return;
+  }
+
+  std::vector<Hash> ids;
+  ids.reserve(imports.size());
+  for (const auto& import : imports) {
+    ids.push_back(import.id);
+  }
+
+  XLOG(DBG5) << "importing a batch of " << ids.size() << " blobs";
+  stats_->blobBatchSize.addValue(ids.size());
+  auto start = steady_clock::now();
+  try {
+    auto results = getThreadLocalImporter().importFileContentsBatch(ids);
+    StoreStats::recordLatency(
+        stats_->importBlobBatch, steady_clock::now() - start);
+    for (size_t n = 0; n < imports.size(); ++n) {
+      if (results[n].hasValue() && results[n].value()) {
+        stats_->importedBlobBytes.addValue(
+            results[n].value()->getContents().computeChainDataLength());
+      }
+      imports[n].promise.setTry(std::move(results[n]));
+    }
+  } catch (const std::exception& ex) {
+    auto ew = folly::exception_wrapper{std::current_exception(), ex};
+    for (auto& import : imports) {
+      import.promise.setException(ew);
+    }
+  }
+}
+
+Future<unique_ptr<Tree>> HgBackingStore::getTree(
+    const Hash& id,
+    ImportPriority priority) {
+  return runImport<unique_ptr<Tree>>(
+             priority,
+             [this, id] {
+               // A prefetchTree() call that was queued ahead of this request
+               // may have imported the tree while it waited.
+               auto tree = localStore_->getTree(id).get();
+               if (tree) {
+                 return tree;
+               }
+               auto start = steady_clock::now();
+               tree = getThreadLocalImporter().importTree(id);
+               StoreStats::recordLatency(
+                   stats_->importTree, steady_clock::now() - start);
+               return tree;
+             })
       // Ensure that the control moves back to the main thread pool
       // to process the caller-attached .then routine.
       .via(serverThreadPool_);
 }
 
+Future<unique_ptr<Blob>> HgBackingStore::getBlob(
+    const Hash& id,
+    ImportPriority priority) {
+  PendingBlobImport import{id};
+  auto future = import.promise.getFuture();
+  // If the requester goes away before the import starts, skip it rather than
+  // spending importer time on a blob that nobody is waiting for.
+  import.promise.setInterruptHandler(
+      [cancelled = import.cancelled](const folly::exception_wrapper&) {
+        cancelled->store(true, std::memory_order_relaxed);
+      });
+  stats_->queueDepth.incrementValue(1);
+  importQueue_.wlock()->blobs[static_cast<size_t>(priority)].push_back(
+      std::move(import));
+  // Each request schedules one task.  The task may find that an earlier task
+  // already imported its request in a batch, in which case it does nothing.
+  importThreadPool_->add([this] { runNextImport(); });
+  // Ensure that the control moves back to the main thread pool
+  // to process the caller-attached .then routine.
+  return std::move(future).via(serverThreadPool_);
+}
+
 folly::Future<folly::Unit> HgBackingStore::prefetchBlobs(
     const std::vector<Hash>& ids) const {
-  return HgProxyHash::getBatch(localStore_, ids)
-      .via(importThreadPool_.get())
-      .then([](std::vector<std::pair<RelativePath, Hash>>&& hgPathHashes) {
-        return getThreadLocalImporter().prefetchFiles(hgPathHashes);
+  return proxyHashCache_.getBatch(localStore_, ids)
+      .then([this](std::vector<std::pair<RelativePath, Hash>>&& hgPathHashes) {
+        // Prefetches are never urgent, so they wait behind any reads.
+        return runImport<folly::Unit>(
+            ImportPriority::Background,
+            [this, hgPathHashes = std::move(hgPathHashes)] {
+              auto start = steady_clock::now();
+              getThreadLocalImporter().prefetchFiles(hgPathHashes);
+              StoreStats::recordLatency(
+                  stats_->prefetch, steady_clock::now() - start);
+            });
       })
       .via(serverThreadPool_);
 }
 
+folly::Future<folly::Unit> HgBackingStore::prefetchTree(
+    const Hash& id,
+    size_t depth) const {
+  return runImport<folly::Unit>(
+             ImportPriority::Background,
+             [this, id, depth] {
+               auto start = steady_clock::now();
+               getThreadLocalImporter().prefetchTree(id, depth);
+               StoreStats::recordLatency(
+                   stats_->prefetch, steady_clock::now() - start);
+             })
+      .via(serverThreadPool_);
+}
+
 Future<unique_ptr<Tree>> HgBackingStore::getTreeForCommit(
     const Hash& commitID) {
   // Ensure that the control moves back to the main thread pool
   // to process the caller-attached .then routine.
-  return getTreeForCommitImpl(commitID).via(serverThreadPool_);
+  return getTreeForCommitImpl(commitID, ImportPriority::Foreground)
+      .via(serverThreadPool_);
 }
 
 folly::Future<unique_ptr<Tree>> HgBackingStore::getTreeForCommitImpl(
-    const Hash& commitID) {
+    const Hash& commitID,
+    ImportPriority priority) {
+  if (auto rootTreeHash = getCachedRootTree(commitID)) {
+    return getRootTree(commitID, rootTreeHash.value(), priority);
+  }
+
   return localStore_
       ->getFuture(KeySpace::HgCommitToTreeFamily, commitID.getBytes())
       .then(
-          [this,
-           commitID](StoreResult result) -> folly::Future<unique_ptr<Tree>> {
+          [this, commitID, priority](
+              StoreResult result) -> folly::Future<unique_ptr<Tree>> {
             if (!result.isValid()) {
-              return importTreeForCommit(commitID);
+              return importTreeForCommit(commitID, priority);
             }
 
             auto rootTreeHash = Hash{result.bytes()};
             XLOG(DBG5) << "found existing tree " << rootTreeHash.toString()
                        << " for mercurial commit " << commitID.toString();
+            cacheRootTree(commitID, rootTreeHash);
+            return getRootTree(commitID, rootTreeHash, priority);
+          });
+}
+
+folly::Future<unique_ptr<Tree>> HgBackingStore::getRootTree(
+    const Hash& commitID,
+    const Hash& rootTreeHash,
+    ImportPriority priority) {
+  return localStore_->getTree(rootTreeHash)
+      .then(
+          [this, rootTreeHash, commitID, priority](std::unique_ptr<Tree> tree)
+              -> folly::Future<unique_ptr<Tree>> {
+            if (tree) {
+              return std::move(tree);
+            }
 
-            return localStore_->getTree(rootTreeHash)
-                .then(
-                    [this, rootTreeHash, commitID](std::unique_ptr<Tree> tree)
-                        -> folly::Future<unique_ptr<Tree>> {
-                      if (tree) {
-                        return std::move(tree);
-                      }
-
-                      // No corresponding tree for this commit ID! Must
-                      // re-import. This could happen if RocksDB is corrupted
-                      // in some way or deleting entries races with
-                      // population.
-                      XLOG(WARN) << "No corresponding tree " << rootTreeHash
-                                 << " for commit " << commitID
-                                 << "; will import again";
-                      return importTreeForCommit(commitID);
-                    });
+            // No corresponding tree for this commit ID! Must re-import. This
+            // could happen if RocksDB is corrupted in some way or deleting
+            // entries races with population.
+            XLOG(WARN) << "No corresponding tree " << rootTreeHash
+                       << " for commit " << commitID << "; will import again";
+            return importTreeForCommit(commitID, priority);
           });
 }
 
 folly::Future<unique_ptr<Tree>> HgBackingStore::importTreeForCommit(
-    const Hash& commitID) {
-  return folly::via(importThreadPool_.get(), [this, commitID] {
+    const Hash& commitID,
+    ImportPriority priority) {
+  auto importManifest = [this, commitID] {
+    auto start = steady_clock::now();
     auto rootTreeHash =
         getThreadLocalImporter().importManifest(commitID.toString());
+    StoreStats::recordLatency(
+        stats_->importManifest, steady_clock::now() - start);
     XLOG(DBG1) << "imported mercurial commit " << commitID.toString()
                << " as tree " << rootTreeHash.toString();
 
     localStore_->put(
         KeySpace::HgCommitToTreeFamily, commitID, rootTreeHash.getBytes());
-    return localStore_->getTree(rootTreeHash);
-  });
+    cacheRootTree(commitID, rootTreeHash);
+    return rootTreeHash;
+  };
+  return runImport<Hash>(priority, std::move(importManifest))
+      .then([this](Hash rootTreeHash) {
+        return localStore_->getTree(rootTreeHash);
+      });
+}
+
+folly::Optional<Hash> HgBackingStore::getCachedRootTree(const Hash& commitID) {
+  auto cache = commitTreeCache_.lock();
+  auto it = cache->find(commitID);
+  if (it == cache->end()) {
+    return folly::none;
+  }
+  return it->second;
+}
+
+void HgBackingStore::cacheRootTree(
+    const Hash& commitID,
+    const Hash& rootTreeHash) {
+  commitTreeCache_.lock()->set(commitID, rootTreeHash);
+}
+
+Future<folly::Unit> HgBackingStore::prefetchCommitTrees(
+    const std::vector<std::string>& revisions) {
+  std::vector<Future<folly::Unit>> futures;
+  for (const auto& revision : revisions) {
+    futures.push_back(
+        runImport<Hash>(
+            ImportPriority::Background,
+            [revision] {
+              return getThreadLocalImporter().resolveCommit(revision);
+            })
+            .then([this, revision](Hash commitID) {
+              XLOG(DBG3) << "prefetching the root tree of " << revision
+                         << " at commit " << commitID;
+              return getTreeForCommitImpl(commitID, ImportPriority::Background)
+                  .unit();
+            })
+            .onError([revision](const folly::exception_wrapper& ew) {
+              XLOG(WARN) << "unable to prefetch the root tree of " << revision
+                         << ": " << folly::exceptionStr(ew);
+            }));
+  }
+  return folly::collectAll(futures).unit();
 }
 
 Future<std::unique_ptr<Blob>> HgBackingStore::verifyEmptyBlob(const Hash& id) {
@@ -238,13 +541,14 @@ Future<std::unique_ptr<Blob>> HgBackingStore::verifyEmptyBlob(const Hash& id) {
   // that is causing blobs to be imported as empty we should change the storage
   // format in the LocalStore so that we can confirm if the blob contents need
   // verification or not.
-  return getBlob(id).thenValue([id](unique_ptr<Blob>&& blob) {
-    if (blob->getContents().empty()) {
-      return unique_ptr<Blob>(nullptr);
-    }
-    XLOG(WARN) << "fixed previously incorrect empty import of blob " << id;
-    return std::move(blob);
-  });
+  return getBlob(id, ImportPriority::Foreground)
+      .thenValue([id](unique_ptr<Blob>&& blob) {
+        if (blob->getContents().empty()) {
+          return unique_ptr<Blob>(nullptr);
+        }
+        XLOG(WARN) << "fixed previously incorrect empty import of blob " << id;
+        return std::move(blob);
+      });
 }
 
 } // namespace eden
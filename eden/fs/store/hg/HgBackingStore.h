@@ -10,11 +10,23 @@
 #pragma once
 
 #include "eden/fs/store/BackingStore.h"
+#include "eden/fs/store/hg/HgImportStats.h"
+#include "eden/fs/store/hg/HgImporterPool.h"
+#include "eden/fs/store/hg/HgProxyHashCache.h"
+#include "eden/fs/utils/Cancellation.h"
 #include "eden/fs/utils/PathFuncs.h"
 
 #include <folly/Executor.h>
+#include <folly/Optional.h>
 #include <folly/Range.h>
 #include <folly/Synchronized.h>
+#include <folly/container/EvictingCacheMap.h>
+#include <folly/futures/Promise.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
 
 namespace facebook {
 namespace eden {
@@ -62,28 +74,121 @@ class HgBackingStore : public BackingStore {
 
   ~HgBackingStore() override;
 
-  folly::Future<std::unique_ptr<Tree>> getTree(const Hash& id) override;
-  folly::Future<std::unique_ptr<Blob>> getBlob(const Hash& id) override;
+  folly::Future<std::unique_ptr<Tree>> getTree(
+      const Hash& id,
+      ImportPriority priority) override;
+  folly::Future<std::unique_ptr<Blob>> getBlob(
+      const Hash& id,
+      ImportPriority priority) override;
   folly::Future<std::unique_ptr<Tree>> getTreeForCommit(
       const Hash& commitID) override;
   FOLLY_NODISCARD folly::Future<folly::Unit> prefetchBlobs(
       const std::vector<Hash>& ids) const override;
+  FOLLY_NODISCARD folly::Future<folly::Unit> prefetchTree(
+      const Hash& id,
+      size_t depth) const override;
+  FOLLY_NODISCARD folly::Future<folly::Unit> prefetchCommitTrees(
+      const std::vector<std::string>& revisions) override;
 
   folly::Future<std::unique_ptr<Blob>> verifyEmptyBlob(const Hash& id) override;
 
+  void aggregateStats() override;
+
  private:
   // Forbidden copy constructor and assignment operator
   HgBackingStore(HgBackingStore const&) = delete;
   HgBackingStore& operator=(HgBackingStore const&) = delete;
 
   folly::Future<std::unique_ptr<Tree>> getTreeForCommitImpl(
-      const Hash& commitID);
+      const Hash& commitID,
+      ImportPriority priority);
+
+  /**
+   * Load the root tree that the commit was found to map to, importing the
+   * commit again if the tree is missing from the LocalStore.
+   */
+  folly::Future<std::unique_ptr<Tree>> getRootTree(
+      const Hash& commitID,
+      const Hash& rootTreeHash,
+      ImportPriority priority);
 
   // Import the Tree from Hg and cache it in the LocalStore before returning it.
   folly::Future<std::unique_ptr<Tree>> importTreeForCommit(
-      const Hash& commitID);
+      const Hash& commitID,
+      ImportPriority priority);
+
+  /**
+   * Look up and record commit to root tree mappings in commitTreeCache_.
+   */
+  folly::Optional<Hash> getCachedRootTree(const Hash& commitID);
+  void cacheRootTree(const Hash& commitID, const Hash& rootTreeHash);
+
+  /**
+   * Queue job to run on an importer thread once there is no more urgent work
+   * waiting.
+   */
+  void scheduleImport(ImportPriority priority, folly::Func job) const;
+
+  /**
+   * Queue fn to run on an importer thread as with scheduleImport(), and
+   * return a Future for its result.
+   */
+  template <typename T, typename Fn>
+  folly::Future<T> runImport(ImportPriority priority, Fn&& fn) const;
+
+  /**
+   * Run the most urgent queued work.
+   *
+   * This runs on an importer thread, once for each item that was queued.
+   * Blob requests of the same priority that were queued while all of the
+   * importer threads were busy are imported together, in one batch, so a
+   * later call may find that there is nothing left to do.
+   */
+  void runNextImport() const;
+
+  struct PendingBlobImport {
+    explicit PendingBlobImport(const Hash& blobID)
+        : id{blobID}, cancelled{std::make_shared<std::atomic<bool>>(false)} {}
+
+    Hash id;
+    std::chrono::steady_clock::time_point enqueued{
+        std::chrono::steady_clock::now()};
+    folly::Promise<std::unique_ptr<Blob>> promise;
+    // Set if the requester no longer wants the blob, so that it can be
+    // skipped rather than imported when it reaches the front of the queue.
+    std::shared_ptr<std::atomic<bool>> cancelled;
+    // The requests waiting for the blob, which likewise let it be skipped
+    // once all of them have been cancelled.
+    CancellationToken token{CancellationToken::current()};
+  };
+
+  /**
+   * Work waiting for an importer thread, with one queue per ImportPriority.
+   */
+  struct ImportQueue {
+    std::array<std::deque<PendingBlobImport>, kNumImportPriorities> blobs;
+    std::array<std::deque<folly::Func>, kNumImportPriorities> jobs;
+  };
+
+  void importBlobs(std::vector<PendingBlobImport> batch) const;
 
   LocalStore* localStore_{nullptr};
+  // Shared by all of the importers, so this is declared first in order to
+  // outlive them.
+  std::unique_ptr<HgImportStats> stats_;
+  // Recently used HgProxyHash data, shared by all of the importers.
+  mutable HgProxyHashCache proxyHashCache_;
+  // Recently used commit to root tree mappings.  Tools ask about the same
+  // few commits (the working copy parent, remote bookmarks) over and over,
+  // so this saves a read from the HgCommitToTreeFamily each time.
+  folly::Synchronized<folly::EvictingCacheMap<Hash, Hash>, std::mutex>
+      commitTreeCache_;
+  // Spare importers, ready to replace one that fails.  This is null for the
+  // unit test constructor.
+  std::unique_ptr<HgImporterPool> importerPool_;
+  // This, importerPool_ and proxyHashCache_ are declared before
+  // importThreadPool_ so that they outlive the importer threads.
+  mutable folly::Synchronized<ImportQueue> importQueue_;
   // A set of threads owning HgImporter instances
   std::unique_ptr<folly::Executor> importThreadPool_;
   // The main server thread pool; we push the Futures back into
@@ -0,0 +1,60 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "eden/fs/store/StoreStats.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * Stats for importing from one mercurial repository, shared by the
+ * HgBackingStore and all of its importers.
+ *
+ * The HgBackingStore serves every mount of the repository, so these are
+ * named after the repository rather than a mount: "<repository>.hg.<name>".
+ */
+class HgImportStats : public StoreStats {
+ public:
+  explicit HgImportStats(folly::StringPiece prefix) : StoreStats{prefix} {}
+
+  // The time that each request spent queued before an importer thread
+  // started on it.
+  Histogram queueWait{createLatencyHistogram("queue_wait_us")};
+  // The number of requests waiting for an importer thread.  Each thread adds
+  // its own enqueues and dequeues, and they add up to the depth once
+  // aggregated.
+  Counter queueDepth{createCounter("queue_depth")};
+  // Queued imports that were skipped because every request waiting for them
+  // had been cancelled.
+  Timeseries cancelledImports{createTimeseries("cancelled_imports")};
+
+  Histogram importTree{createLatencyHistogram("import_tree_us")};
+  Histogram importBlobBatch{createLatencyHistogram("import_blob_batch_us")};
+  Histogram importManifest{createLatencyHistogram("import_manifest_us")};
+  Histogram prefetch{createLatencyHistogram("prefetch_us")};
+  Histogram blobBatchSize{createHistogram("blob_batch_size", 8, 0, 256)};
+  Timeseries importedBlobBytes{createTimeseries("imported_blob_bytes")};
+  // HgProxyHash mappings written by tree imports, and those skipped because
+  // an earlier import had already stored them.
+  Timeseries proxyHashWrites{createTimeseries("proxy_hash_writes")};
+  Timeseries skippedProxyHashWrites{
+      createTimeseries("skipped_proxy_hash_writes")};
+
+  // Time spent writing requests to, and reading responses from,
+  // hg_import_helper.py.
+  Histogram helperWrite{createLatencyHistogram("helper_write_us")};
+  Histogram helperRead{createLatencyHistogram("helper_read_us")};
+  // How often HgImporterManager had to replace a failed helper.
+  Timeseries helperRestarts{createTimeseries("helper_restarts")};
+};
+
+} // namespace eden
+} // namespace facebook
@@ -13,6 +13,7 @@
 #include <boost/filesystem/path.hpp>
 #include <folly/Conv.h>
 #include <folly/FileUtil.h>
+#include <folly/ScopeGuard.h>
 #include <folly/container/Array.h>
 #include <folly/dynamic.h>
 #include <folly/executors/GlobalExecutor.h>
@@ -26,12 +27,15 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #ifndef EDEN_WIN
+#include <fcntl.h>
 #include <unistd.h>
 #else
 #include "eden/win/eden/Pipe.h" // @manual
 #include "eden/win/eden/Subprocess.h" // @manual
 #endif
 
+#include <chrono>
+#include <cstring>
 #include <mutex>
 
 #include "eden/fs/model/Blob.h"
@@ -39,11 +43,15 @@
 #include "eden/fs/model/TreeEntry.h"
 #include "eden/fs/store/LocalStore.h"
 #include "eden/fs/store/hg/HgImportPyError.h"
+#include "eden/fs/store/hg/HgImportStats.h"
+#include "eden/fs/store/hg/HgImporterPool.h"
 #include "eden/fs/store/hg/HgManifestImporter.h"
 #include "eden/fs/store/hg/HgProxyHash.h"
+#include "eden/fs/store/hg/HgProxyHashCache.h"
 #include "eden/fs/utils/PathFuncs.h"
 #include "eden/fs/utils/SSLContext.h"
 #include "eden/fs/utils/TimeUtil.h"
+#include "eden/fs/utils/TraceBuffer.h"
 
 #if EDEN_HAVE_HG_TREEMANIFEST
 #include "hgext/extlib/cstore/uniondatapackstore.h" // @manual=//scm/hg:datapack
@@ -100,11 +108,31 @@ DEFINE_bool(
     "commit information using flatmanifest if tree if an error occurs trying "
     "to get treemanifest data.");
 
+DEFINE_bool(
+    hg_read_file_datapacks,
+    true,
+    "Read file contents directly from the local remotefilelog data packs when "
+    "possible, rather than asking hg_import_helper.py for them.");
+
 DEFINE_int32(
     hgManifestImportBufferSize,
     256 * 1024 * 1024, // 256MB
     "Buffer size for batching LocalStore writes during hg manifest imports");
 
+DEFINE_int32(
+    hg_manifest_import_threads,
+    4,
+    "The number of threads used to compute and store the trees for each "
+    "top-level directory during flat manifest imports.  0 imports everything "
+    "on the importing thread.");
+
+DEFINE_int32(
+    hg_import_helper_pipe_size,
+    1024 * 1024,
+    "The capacity to request for the pipe that hg_import_helper.py sends its "
+    "responses on, where supported.  A larger pipe lets each read() return "
+    "more of a large file at once.  0 leaves the system default.");
+
 DEFINE_int32(
     mononoke_timeout,
     2000, // msec
@@ -217,9 +245,13 @@ HgImporter::HgImporter(
     AbsolutePathPiece repoPath,
     LocalStore* store,
     folly::Optional<AbsolutePath> clientCertificate,
-    bool useMononoke)
+    bool useMononoke,
+    HgProxyHashCache* proxyHashCache,
+    HgImportStats* stats)
     : repoPath_{repoPath},
       store_{store},
+      proxyHashCache_{proxyHashCache},
+      stats_{stats},
       clientCertificate_(clientCertificate),
       useMononoke_(useMononoke) {
   auto importHelper = getImportHelperPath();
@@ -252,6 +284,15 @@ HgImporter::HgImporter(
   };
   helperIn_ = helper_.stdinFd();
   helperOut_ = helper_.parentFd(HELPER_PIPE_FD);
+#ifdef F_SETPIPE_SZ
+  if (FLAGS_hg_import_helper_pipe_size > 0 &&
+      fcntl(helperOut_, F_SETPIPE_SZ, FLAGS_hg_import_helper_pipe_size) < 0) {
+    // This is only an optimization, and will fail if the size is larger than
+    // the system allows for unprivileged processes.
+    XLOG(DBG2) << "unable to resize the hg_import_helper.py response pipe: "
+               << folly::errnoStr(errno);
+  }
+#endif // F_SETPIPE_SZ
 #else
 
   auto childInPipe = std::make_unique<Pipe>(nullptr, true);
@@ -281,6 +322,7 @@ HgImporter::HgImporter(
 #endif
   auto options = waitForHelperStart();
   initializeTreeManifestImport(options);
+  initializeFileDatapackImport(options);
 #ifndef EDEN_WIN_NOMONONOKE
   initializeMononoke(options);
 #endif
@@ -336,6 +378,12 @@ HgImporter::Options HgImporter::waitForHelperStart() {
     options.treeManifestPackPaths.push_back(cursor.readFixedString(pathLength));
   }
 
+  auto numFilePackPaths = cursor.readBE<uint32_t>();
+  for (uint32_t n = 0; n < numFilePackPaths; ++n) {
+    auto pathLength = cursor.readBE<uint32_t>();
+    options.filePackPaths.push_back(cursor.readFixedString(pathLength));
+  }
+
   if (flags & StartFlag::MONONOKE_SUPPORTED) {
     auto nameLength = cursor.readBE<uint32_t>();
     options.repoName = cursor.readFixedString(nameLength);
@@ -374,6 +422,34 @@ void HgImporter::initializeTreeManifestImport(const Options& options) {
 #endif // EDEN_HAVE_HG_TREEMANIFEST
 }
 
+void HgImporter::initializeFileDatapackImport(const Options& options) {
+#if EDEN_HAVE_HG_TREEMANIFEST
+  if (!FLAGS_hg_read_file_datapacks) {
+    XLOG(DBG2) << "reading file data packs disabled via command line flags "
+                  "for repository "
+               << repoPath_;
+    return;
+  }
+  if (options.filePackPaths.empty()) {
+    XLOG(DBG2) << "no file data packs to read in repository " << repoPath_;
+    return;
+  }
+
+  std::vector<DataStore*> storePtrs;
+  for (const auto& path : options.filePackPaths) {
+    XLOG(DBG5) << "file pack path: " << path;
+    // As for the treemanifest packs, removing dead pack files is safe because
+    // we copy the data out before making another call into fileUnionStore_.
+    fileDataPackStores_.emplace_back(
+        std::make_unique<DatapackStore>(path, true));
+    storePtrs.emplace_back(fileDataPackStores_.back().get());
+  }
+
+  fileUnionStore_ = std::make_unique<UnionDatapackStore>(storePtrs);
+  XLOG(DBG2) << "reading file data packs in repository " << repoPath_;
+#endif // EDEN_HAVE_HG_TREEMANIFEST
+}
+
 #ifndef EDEN_WIN_NOMONONOKE
 void HgImporter::initializeMononoke(const Options& options) {
 #if EDEN_HAVE_HG_TREEMANIFEST
@@ -410,6 +486,12 @@ void HgImporter::initializeMononoke(const Options& options) {
 #endif
 
 HgImporter::~HgImporter() {
+  for (auto& entry : pendingRequests_) {
+    entry.second.failRemaining(folly::make_exception_wrapper<HgImporterError>(
+        "HgImporter destroyed before receiving the ",
+        entry.second.cmdName,
+        " response"));
+  }
 #ifndef EDEN_WIN
   helper_.closeParentFd(STDIN_FILENO);
   helper_.wait();
@@ -433,14 +515,16 @@ unique_ptr<Tree> HgImporter::importTree(const Hash& id) {
         "with treemanifest"));
   }
 
-  HgProxyHash pathInfo(store_, id, "importTree");
-  auto writeBatch = store_->beginWrite();
+  TraceScope trace{TraceEventKind::HG_IMPORT,
+                   static_cast<uint64_t>(LocalStore::KeySpace::TreeFamily)};
+  auto pathInfo = resolveProxyHash(id, "importTree");
+  auto writeBatch = beginImportBatch();
   auto tree = importTreeImpl(
-      pathInfo.revHash(), // this is really the manifest node
+      pathInfo.second, // this is really the manifest node
       id,
-      pathInfo.path(),
+      pathInfo.first,
       writeBatch.get());
-  writeBatch->flush();
+  flushImportBatch(writeBatch.get());
   return tree;
 #else // !EDEN_HAVE_HG_TREEMANIFEST
   throw std::domain_error(folly::to<string>(
@@ -450,7 +534,146 @@ unique_ptr<Tree> HgImporter::importTree(const Hash& id) {
 #endif // EDEN_HAVE_HG_TREEMANIFEST
 }
 
+void HgImporter::prefetchTree(const Hash& id, size_t depth) {
+#if EDEN_HAVE_HG_TREEMANIFEST
+  if (!mononoke_ || !unionStore_) {
+    return;
+  }
+
+  auto pathInfo = resolveProxyHash(id, "prefetchTree");
+  const auto& rootPath = pathInfo.first;
+  // Each request has its own timeout, so this does not wait forever.
+  auto trees = mononoke_
+                   ->getTreeWithDescendants(
+                       pathInfo.second, depth, ImportPriority::Background)
+                   .get();
+
+  // Parents come before their children, so the eden ID of each subtree has
+  // already been computed by the time we get to it.
+  std::unordered_map<RelativePath, Hash> treeIDs;
+  treeIDs.emplace(RelativePath{}, id);
+  auto writeBatch = beginImportBatch();
+  for (const auto& entry : trees) {
+    const auto& relPath = entry.first;
+    auto it = treeIDs.find(relPath);
+    if (it == treeIDs.end()) {
+      continue;
+    }
+    auto tree = storeMononokeTree(
+        *entry.second, it->second, rootPath + relPath, writeBatch.get());
+    for (const auto& child : tree->getTreeEntries()) {
+      if (child.isTree()) {
+        treeIDs.emplace(relPath + child.getName(), child.getHash());
+      }
+    }
+  }
+  flushImportBatch(writeBatch.get());
+  XLOG(DBG4) << "prefetched " << trees.size() << " trees below " << rootPath
+             << " from mononoke";
+#else // !EDEN_HAVE_HG_TREEMANIFEST
+  (void)id;
+  (void)depth;
+#endif // EDEN_HAVE_HG_TREEMANIFEST
+}
+
 #if EDEN_HAVE_HG_TREEMANIFEST
+unique_ptr<Blob> HgImporter::importFileContentsFromDatapack(
+    Hash blobHash,
+    RelativePathPiece path,
+    Hash revHash) {
+  if (!fileUnionStore_) {
+    return nullptr;
+  }
+
+  auto key =
+      Key(path.stringPiece().data(),
+          path.stringPiece().size(),
+          (const char*)revHash.getBytes().data(),
+          revHash.getBytes().size());
+  ConstantStringRef content;
+  try {
+    content = fileUnionStore_->get(key);
+  } catch (const MissingKeyError&) {
+    // The helper may have written new packs since we last looked.
+    fileUnionStore_->markForRefresh();
+    try {
+      content = fileUnionStore_->get(key);
+    } catch (const MissingKeyError&) {
+      return nullptr;
+    }
+  }
+  if (!content.content()) {
+    return nullptr;
+  }
+
+  // The stored text may start with a copy metadata header, delimited by
+  // "\1\n" markers, which is not part of the file contents.
+  StringPiece text{content.content(), content.size()};
+  constexpr StringPiece kMetadataMarker{"\1\n"};
+  if (text.startsWith(kMetadataMarker)) {
+    auto end = text.find(kMetadataMarker, kMetadataMarker.size());
+    if (end == StringPiece::npos) {
+      XLOG(WARN) << "unterminated metadata header in file pack data for "
+                 << path << " " << revHash;
+      return nullptr;
+    }
+    text.advance(end + kMetadataMarker.size());
+  }
+
+  // Let the helper double-check files that appear to be empty; see
+  // HgServer.get_file() in hg_import_helper.py.
+  if (text.empty()) {
+    return nullptr;
+  }
+
+  XLOG(DBG4) << "imported blob " << blobHash << " (" << path << ", "
+             << revHash << ") from file packs; length=" << text.size();
+  // Hand the pack store's own buffer to the Blob rather than copying it.  The
+  // IOBuf keeps a reference to the string so that it stays alive as long as
+  // the Blob does.
+  auto owner = new ConstantStringRef(std::move(content));
+  IOBuf contents{IOBuf::TAKE_OWNERSHIP,
+                 const_cast<char*>(text.data()),
+                 text.size(),
+                 [](void* /* buf */, void* userData) {
+                   delete static_cast<ConstantStringRef*>(userData);
+                 },
+                 owner};
+  return make_unique<Blob>(blobHash, std::move(contents));
+}
+
+unique_ptr<Tree> HgImporter::storeMononokeTree(
+    const Tree& mononokeTree,
+    const Hash& edenTreeID,
+    RelativePathPiece path,
+    LocalStore::WriteBatch* writeBatch) {
+  std::vector<TreeEntry> entries;
+  for (const auto& entry : mononokeTree.getTreeEntries()) {
+    auto blobHash = entry.getHash();
+    auto entryName = entry.getName();
+    auto proxyHash = storeProxyHash(path + entryName, blobHash, writeBatch);
+
+    // Mononoke may tell us the size and SHA-1 of a file up front.  Recording
+    // them as the blob's metadata lets stat() and diff answer without
+    // fetching the contents.
+    const auto& size = entry.getSize();
+    const auto& contentSha1 = entry.getContentSha1();
+    if (size && contentSha1) {
+      writeBatch->putBlobMetadata(
+          proxyHash, BlobMetadata{*contentSha1, *size});
+    }
+
+    entries.emplace_back(
+        proxyHash, entryName.stringPiece(), entry.getType(), size, contentSha1);
+  }
+
+  auto tree = make_unique<Tree>(std::move(entries), edenTreeID);
+  auto serialized = LocalStore::serializeTree(tree.get());
+  writeBatch->put(
+      KeySpace::TreeFamily, edenTreeID, serialized.second.coalesce());
+  return tree;
+}
+
 unique_ptr<Tree> HgImporter::importTreeImpl(
     const Hash& manifestNode,
     const Hash& edenTreeID,
@@ -503,25 +726,9 @@ unique_ptr<Tree> HgImporter::importTreeImpl(
     XLOG(DBG4) << "importing tree \"" << manifestNode << "\" from mononoke";
     try {
       auto mononokeTree =
-          mononoke_->getTree(manifestNode)
+          mononoke_->getTree(manifestNode, ImportPriority::Foreground)
               .get(std::chrono::milliseconds(FLAGS_mononoke_timeout));
-      std::vector<TreeEntry> entries;
-
-      for (const auto& entry : mononokeTree->getTreeEntries()) {
-        auto blobHash = entry.getHash();
-        auto entryName = entry.getName();
-        auto proxyHash =
-            HgProxyHash::store(path + entryName, blobHash, writeBatch);
-
-        entries.emplace_back(
-            proxyHash, entryName.stringPiece(), entry.getType());
-      }
-
-      auto tree = make_unique<Tree>(std::move(entries), edenTreeID);
-      auto serialized = LocalStore::serializeTree(tree.get());
-      writeBatch->put(
-          KeySpace::TreeFamily, edenTreeID, serialized.second.coalesce());
-      return tree;
+      return storeMononokeTree(*mononokeTree, edenTreeID, path, writeBatch);
     } catch (const std::exception& ex) {
       XLOG(WARN) << "got exception from MononokeBackingStore: " << ex.what();
     }
@@ -637,7 +844,7 @@ unique_ptr<Tree> HgImporter::importTreeImpl(
       fileType = TreeEntryType::REGULAR_FILE;
     }
 
-    auto proxyHash = HgProxyHash::store(
+    auto proxyHash = storeProxyHash(
         path + RelativePathPiece(entryName), entryHash, writeBatch);
 
     entries.emplace_back(proxyHash, entryName, fileType);
@@ -659,13 +866,17 @@ Hash HgImporter::importTreeManifest(StringPiece revName) {
   // Record that we are at the root for this node
   RelativePathPiece path{};
   auto proxyInfo = HgProxyHash::prepareToStore(path, manifestNode);
-  auto writeBatch = store_->beginWrite();
+  auto writeBatch = beginImportBatch();
   auto tree =
       importTreeImpl(manifestNode, proxyInfo.first, path, writeBatch.get());
   // Only write the proxy hash value for this once we've imported
   // the root.
   HgProxyHash::store(proxyInfo, writeBatch.get());
-  writeBatch->flush();
+  flushImportBatch(writeBatch.get());
+  if (proxyHashCache_) {
+    proxyHashCache_->insert(
+        proxyInfo.first, path, manifestNode, /* stored */ true);
+  }
 
   return tree->getHash();
 }
@@ -696,7 +907,14 @@ Hash HgImporter::importFlatManifest(StringPiece revName) {
   auto requestID = sendManifestRequest(revName);
 
   auto writeBatch = store_->beginWrite(FLAGS_hgManifestImportBufferSize);
-  HgManifestImporter importer(store_, writeBatch.get());
+  // Split the write buffer budget between the worker threads, so that using
+  // more of them does not use more memory.
+  auto numWorkerThreads =
+      static_cast<size_t>(std::max(FLAGS_hg_manifest_import_threads, 0));
+  auto workerBufSize = static_cast<size_t>(FLAGS_hgManifestImportBufferSize) /
+      std::max<size_t>(numWorkerThreads, 1);
+  HgManifestImporter importer(
+      store_, writeBatch.get(), numWorkerThreads, workerBufSize);
   size_t numPaths = 0;
 
   auto start = std::chrono::steady_clock::now();
@@ -719,10 +937,11 @@ Hash HgImporter::importFlatManifest(StringPiece revName) {
         "CMD_MANIFEST response body");
     chunkData.append(header.dataLength);
 
-    // Now process the entries in the chunk
-    Cursor cursor(&chunkData);
-    while (!cursor.isAtEnd()) {
-      readManifestEntry(importer, cursor, writeBatch.get());
+    // Now process the entries in the chunk.  Entries never span chunks and
+    // the chunk is a single contiguous buffer, so it is parsed in place.
+    ByteRange entries{chunkData.data(), chunkData.length()};
+    while (!entries.empty()) {
+      readManifestEntry(importer, entries, writeBatch.get());
       ++numPaths;
     }
 
@@ -745,55 +964,312 @@ Hash HgImporter::importFlatManifest(StringPiece revName) {
 }
 
 unique_ptr<Blob> HgImporter::importFileContents(Hash blobHash) {
+  TraceScope trace{TraceEventKind::HG_IMPORT,
+                   static_cast<uint64_t>(LocalStore::KeySpace::BlobFamily)};
   // Look up the mercurial path and file revision hash,
   // which we need to import the data from mercurial
-  HgProxyHash hgInfo(store_, blobHash, "importFileContents");
+  auto hgInfo = resolveProxyHash(blobHash, "importFileContents");
+  const auto& path = hgInfo.first;
+  const auto& revHash = hgInfo.second;
+
+#if EDEN_HAVE_HG_TREEMANIFEST
+  auto localBlob = importFileContentsFromDatapack(blobHash, path, revHash);
+  if (localBlob) {
+    return localBlob;
+  }
+#endif // EDEN_HAVE_HG_TREEMANIFEST
 
   if (mononoke_) {
-    XLOG(DBG5) << "requesting file contents of '" << hgInfo.path() << "', "
-               << hgInfo.revHash().toString() << " from mononoke";
+    XLOG(DBG5) << "requesting file contents of '" << path << "', "
+               << revHash.toString() << " from mononoke";
     try {
-      return mononoke_->getBlob(hgInfo.revHash())
+      return mononoke_->getBlob(revHash, ImportPriority::Foreground)
           .get(std::chrono::milliseconds(FLAGS_mononoke_timeout));
     } catch (const std::exception& ex) {
-      XLOG(WARN) << "Error while fetching file contents of '" << hgInfo.path()
-                 << "', " << hgInfo.revHash().toString()
-                 << " from mononoke: " << ex.what();
+      XLOG(WARN) << "Error while fetching file contents of '" << path << "', "
+                 << revHash.toString() << " from mononoke: " << ex.what();
+    }
+  }
+
+  XLOG(DBG5) << "requesting file contents of '" << path << "', "
+             << revHash.toString();
+
+  auto future = fetchFileContents(blobHash, path, revHash);
+  while (!future.isReady()) {
+    readPendingResponse();
+  }
+  return std::move(future).get();
+}
+
+std::vector<folly::Try<unique_ptr<Blob>>> HgImporter::importFileContentsBatch(
+    const std::vector<Hash>& blobHashes) {
+  std::vector<folly::Try<unique_ptr<Blob>>> results(blobHashes.size());
+  // The futures for files requested from the helper, with their index in
+  // blobHashes.
+  std::vector<std::pair<size_t, folly::Future<unique_ptr<Blob>>>> futures;
+
+  std::vector<FileRequest> request;
+  std::vector<size_t> requestIndexes;
+  size_t requestBytes = 0;
+  auto sendRequest = [&] {
+    auto requestFutures = fetchFileContents(request);
+    for (size_t n = 0; n < requestFutures.size(); ++n) {
+      futures.emplace_back(requestIndexes[n], std::move(requestFutures[n]));
+    }
+    request.clear();
+    requestIndexes.clear();
+    requestBytes = 0;
+  };
+  auto addRequest = [&](size_t idx, FileRequest&& file) {
+    auto fileBytes =
+        Hash::RAW_SIZE + sizeof(uint32_t) + file.path.stringPiece().size();
+    if (!request.empty() &&
+        (request.size() >= kMaxFilesPerRequest ||
+         requestBytes + fileBytes > kMaxFileRequestBytes)) {
+      sendRequest();
+    }
+    request.push_back(std::move(file));
+    requestIndexes.push_back(idx);
+    requestBytes += fileBytes;
+  };
+  // The files to ask mononoke for, with their index in blobHashes.
+  std::vector<FileRequest> mononokeRequest;
+  std::vector<size_t> mononokeIndexes;
+
+  // Look up all of the proxy hashes up front, so that any that are not cached
+  // are read from the LocalStore together.
+  auto hgInfos = resolveProxyHashes(blobHashes);
+  for (size_t idx = 0; idx < blobHashes.size(); ++idx) {
+    const auto& blobHash = blobHashes[idx];
+    try {
+      auto& hgInfo = hgInfos[idx].value();
+#if EDEN_HAVE_HG_TREEMANIFEST
+      auto localBlob = importFileContentsFromDatapack(
+          blobHash, hgInfo.first, hgInfo.second);
+      if (localBlob) {
+        results[idx] = folly::Try<unique_ptr<Blob>>{std::move(localBlob)};
+        continue;
+      }
+#endif // EDEN_HAVE_HG_TREEMANIFEST
+      FileRequest file{blobHash, std::move(hgInfo.first), hgInfo.second};
+      if (mononoke_) {
+        mononokeRequest.push_back(std::move(file));
+        mononokeIndexes.push_back(idx);
+      } else {
+        addRequest(idx, std::move(file));
+      }
+    } catch (const HgImporterError&) {
+      // Errors communicating with the helper affect the whole batch.
+      throw;
+    } catch (const std::exception& ex) {
+      results[idx] = folly::Try<unique_ptr<Blob>>{
+          folly::exception_wrapper{std::current_exception(), ex}};
+    }
+  }
+
+  if (!mononokeRequest.empty()) {
+    // Ask for all of these at once, so that they can share the connections
+    // to the server.  Each request has its own timeout, so this does not
+    // wait forever.  As in importFileContents(), files that mononoke cannot
+    // provide are fetched by the helper instead.
+    std::vector<Hash> revHashes;
+    revHashes.reserve(mononokeRequest.size());
+    for (const auto& file : mononokeRequest) {
+      revHashes.push_back(file.revHash);
+    }
+    XLOG(DBG5) << "requesting contents of " << revHashes.size()
+               << " files from mononoke";
+    auto mononokeBlobs =
+        mononoke_->getBlobBatch(revHashes, ImportPriority::Foreground).get();
+    for (size_t n = 0; n < mononokeBlobs.size(); ++n) {
+      auto idx = mononokeIndexes[n];
+      if (mononokeBlobs[n].hasValue()) {
+        results[idx] = std::move(mononokeBlobs[n]);
+        continue;
+      }
+      auto& file = mononokeRequest[n];
+      XLOG(WARN) << "Error while fetching file contents of '" << file.path
+                 << "', " << file.revHash.toString()
+                 << " from mononoke: " << mononokeBlobs[n].exception().what();
+      addRequest(idx, std::move(file));
     }
   }
 
-  XLOG(DBG5) << "requesting file contents of '" << hgInfo.path() << "', "
-             << hgInfo.revHash().toString();
+  if (!request.empty()) {
+    sendRequest();
+  }
+  waitForPendingRequests();
+
+  for (auto& entry : futures) {
+    auto& result = entry.second.getTry();
+    // The helper asks to be restarted by failing with ResetRepoError.  Like
+    // HgImporterError this is thrown so that HgImporterManager restarts it.
+    bool restartHelper = false;
+    if (result.hasException()) {
+      restartHelper = result.exception().is_compatible_with<HgImporterError>();
+      result.exception().with_exception([&](const HgImportPyError& ex) {
+        restartHelper = ex.errorType() == "ResetRepoError";
+      });
+    }
+    if (restartHelper) {
+      result.exception().throw_exception();
+    }
+    results[entry.first] = std::move(result);
+  }
+  return results;
+}
+
+std::pair<RelativePath, Hash> HgImporter::resolveProxyHash(
+    const Hash& edenBlobHash,
+    StringPiece context) {
+  if (proxyHashCache_) {
+    if (auto cached = proxyHashCache_->get(edenBlobHash)) {
+      return std::move(cached).value();
+    }
+  }
+
+  HgProxyHash hgInfo(store_, edenBlobHash, context);
+  if (proxyHashCache_) {
+    proxyHashCache_->insert(
+        edenBlobHash, hgInfo.path(), hgInfo.revHash(), /* stored */ true);
+  }
+  return std::make_pair(hgInfo.path().copy(), hgInfo.revHash());
+}
+
+std::vector<folly::Try<std::pair<RelativePath, Hash>>>
+HgImporter::resolveProxyHashes(const std::vector<Hash>& edenBlobHashes) {
+  std::vector<folly::Try<std::pair<RelativePath, Hash>>> results;
+  results.reserve(edenBlobHashes.size());
+  try {
+    auto resolved = proxyHashCache_
+        ? proxyHashCache_->getBatch(store_, edenBlobHashes).get()
+        : HgProxyHash::getBatch(store_, edenBlobHashes).get();
+    for (auto& hgInfo : resolved) {
+      results.emplace_back(std::move(hgInfo));
+    }
+  } catch (const std::exception&) {
+    // At least one of the hashes is unknown.  Look them up one at a time so
+    // that the error is only reported for the files it actually affects.
+    results.clear();
+    for (const auto& edenBlobHash : edenBlobHashes) {
+      results.push_back(folly::makeTryWith([&] {
+        return resolveProxyHash(edenBlobHash, "importFileContentsBatch");
+      }));
+    }
+  }
+  return results;
+}
+
+Hash HgImporter::storeProxyHash(
+    RelativePathPiece path,
+    Hash revHash,
+    LocalStore::WriteBatch* writeBatch) {
+  auto proxyInfo = HgProxyHash::prepareToStore(path, revHash);
+  const auto& proxyHash = proxyInfo.first;
+  if (proxyHashCache_ && proxyHashCache_->isStored(proxyHash)) {
+    // The entry is unchanged from a tree that was imported earlier.
+    if (stats_) {
+      stats_->skippedProxyHashWrites.addValue(1);
+    }
+    return proxyHash;
+  }
+
+  HgProxyHash::store(proxyInfo, writeBatch);
+  if (stats_) {
+    stats_->proxyHashWrites.addValue(1);
+  }
+  if (proxyHashCache_) {
+    proxyHashCache_->insert(proxyHash, path, revHash);
+    unflushedProxyHashes_.push_back(proxyHash);
+  }
+  return proxyHash;
+}
+
+std::unique_ptr<LocalStore::WriteBatch> HgImporter::beginImportBatch() {
+  // Forget the mappings of an earlier import that failed before it flushed.
+  unflushedProxyHashes_.clear();
+  return store_->beginWrite();
+}
+
+void HgImporter::flushImportBatch(LocalStore::WriteBatch* writeBatch) {
+  auto proxyHashes = std::move(unflushedProxyHashes_);
+  unflushedProxyHashes_.clear();
+  writeBatch->flush();
+  if (proxyHashCache_) {
+    proxyHashCache_->markStored(proxyHashes);
+  }
+}
+
+folly::Future<unique_ptr<Blob>> HgImporter::fetchFileContents(
+    Hash blobHash,
+    RelativePathPiece path,
+    Hash revHash) {
+  const auto requestSize =
+      sizeof(ChunkHeader) + Hash::RAW_SIZE + path.stringPiece().size();
+  makeRoomForRequest(requestSize);
 
   // Ask the import helper process for the file contents
-  auto requestID = sendFileRequest(hgInfo.path(), hgInfo.revHash());
+  auto requestID = sendFileRequest(path, revHash);
+  auto& pending = addPendingRequest(requestID, "CMD_CAT_FILE", requestSize, 1);
+  return pending.responses[0].getFuture().thenValue(
+      [blobHash, path = RelativePath{path}, revHash](IOBuf&& buf) {
+        return parseFileResponse(blobHash, path, revHash, std::move(buf));
+      });
+}
 
-  // Read the response.  The response body contains the file contents,
-  // which is exactly what we want to return.
+std::vector<folly::Future<unique_ptr<Blob>>> HgImporter::fetchFileContents(
+    const std::vector<FileRequest>& files) {
+  size_t requestSize = sizeof(ChunkHeader) + sizeof(uint32_t);
+  for (const auto& file : files) {
+    requestSize +=
+        Hash::RAW_SIZE + sizeof(uint32_t) + file.path.stringPiece().size();
+  }
+  makeRoomForRequest(requestSize);
+
+  XLOG(DBG5) << "requesting contents of " << files.size() << " files";
+  auto requestID = sendFilesRequest(files);
+  auto& pending = addPendingRequest(
+      requestID, "CMD_CAT_FILES", requestSize, files.size());
+
+  std::vector<folly::Future<unique_ptr<Blob>>> futures;
+  futures.reserve(files.size());
+  for (size_t n = 0; n < files.size(); ++n) {
+    futures.push_back(pending.responses[n].getFuture().thenValue(
+        [blobHash = files[n].blobHash,
+         path = files[n].path,
+         revHash = files[n].revHash](IOBuf&& buf) {
+          return parseFileResponse(blobHash, path, revHash, std::move(buf));
+        }));
+  }
+  return futures;
+}
+
+unique_ptr<Blob> HgImporter::parseFileResponse(
+    Hash blobHash,
+    RelativePathPiece path,
+    Hash revHash,
+    IOBuf buf) {
+  // The response body contains the file contents, followed by the body
+  // length.
   //
   // Note: For now we expect to receive the entire contents in a single chunk.
   // In the future we might want to consider if it is more efficient to receive
   // the body data in fixed-size chunks, particularly for very large files.
-  auto header = readChunkHeader(requestID, "CMD_CAT_FILE");
-  if (header.dataLength < sizeof(uint64_t)) {
+  const auto responseLength = buf.length();
+  if (responseLength < sizeof(uint64_t)) {
     auto msg = folly::to<string>(
         "CMD_CAT_FILE response for blob ",
         blobHash,
         " (",
-        hgInfo.path(),
+        path,
         ", ",
-        hgInfo.revHash(),
+        revHash,
         ") from hg_import_helper.py is too "
         "short for body length field: length = ",
-        header.dataLength);
+        responseLength);
     XLOG(ERR) << msg;
     throw std::runtime_error(std::move(msg));
   }
-  auto buf = IOBuf(IOBuf::CREATE, header.dataLength);
-
-  readFromHelper(
-      buf.writableTail(), header.dataLength, "CMD_CAT_FILE response body");
-  buf.append(header.dataLength);
 
   // The last 8 bytes of the response are the body length.
   // Ensure that this looks correct, and advance the buffer past this data to
@@ -805,18 +1281,18 @@ unique_ptr<Blob> HgImporter::importFileContents(Hash blobHash) {
   uint64_t bodyLength;
   memcpy(&bodyLength, buf.tail(), sizeof(uint64_t));
   bodyLength = Endian::big(bodyLength);
-  if (bodyLength != header.dataLength - sizeof(uint64_t)) {
+  if (bodyLength != responseLength - sizeof(uint64_t)) {
     auto msg = folly::to<string>(
         "inconsistent body length received when importing blob ",
         blobHash,
         " (",
-        hgInfo.path(),
+        path,
         ", ",
-        hgInfo.revHash(),
+        revHash,
         "): bodyLength=",
         bodyLength,
         " responseLength=",
-        header.dataLength);
+        responseLength);
     XLOG(ERR) << msg;
     throw std::runtime_error(std::move(msg));
   }
@@ -824,11 +1300,11 @@ unique_ptr<Blob> HgImporter::importFileContents(Hash blobHash) {
   // Log empty files with a higher verbosity for now, while we are trying to
   // debug issues where some files get incorrectly imported as being empty.
   if (bodyLength == 0) {
-    XLOG(DBG2) << "imported blob " << blobHash << " (" << hgInfo.path() << ", "
-               << hgInfo.revHash() << ") as an empty file";
+    XLOG(DBG2) << "imported blob " << blobHash << " (" << path << ", "
+               << revHash << ") as an empty file";
   } else {
-    XLOG(DBG4) << "imported blob " << blobHash << " (" << hgInfo.path() << ", "
-               << hgInfo.revHash() << "); length=" << bodyLength;
+    XLOG(DBG4) << "imported blob " << blobHash << " (" << path << ", "
+               << revHash << "); length=" << bodyLength;
   }
 
   return make_unique<Blob>(blobHash, std::move(buf));
@@ -845,11 +1321,24 @@ void HgImporter::prefetchFiles(
 
 Hash HgImporter::resolveManifestNode(folly::StringPiece revName) {
   auto requestID = sendManifestNodeRequest(revName);
+  return readHashResponse(requestID, revName, "CMD_MANIFEST_NODE_FOR_COMMIT");
+}
 
-  auto header = readChunkHeader(requestID, "CMD_MANIFEST_NODE_FOR_COMMIT");
+Hash HgImporter::resolveCommit(folly::StringPiece revName) {
+  auto requestID = sendResolveCommitRequest(revName);
+  return readHashResponse(requestID, revName, "CMD_RESOLVE_COMMIT");
+}
+
+Hash HgImporter::readHashResponse(
+    TransactionID requestID,
+    folly::StringPiece revName,
+    folly::StringPiece cmdName) {
+  auto header = readChunkHeader(requestID, cmdName);
   if (header.dataLength != 20) {
     throw std::runtime_error(folly::to<string>(
-        "expected a 20-byte hash for the manifest node '",
+        "expected a 20-byte hash for ",
+        cmdName,
+        " '",
         revName,
         "' but got data of length ",
         header.dataLength));
@@ -859,35 +1348,50 @@ Hash HgImporter::resolveManifestNode(folly::StringPiece revName) {
   readFromHelper(
       buffer.data(),
       buffer.size(),
-      "CMD_MANIFEST_NODE_FOR_COMMIT response body");
+      folly::to<string>(cmdName, " response body"));
   return Hash(buffer);
 }
 
 void HgImporter::readManifestEntry(
     HgManifestImporter& importer,
-    folly::io::Cursor& cursor,
+    ByteRange& entries,
     LocalStore::WriteBatch* writeBatch) {
-  Hash::Storage hashBuf;
-  cursor.pull(hashBuf.data(), hashBuf.size());
-  Hash fileRevHash(hashBuf);
+  // Each entry is <20-byte node>\t<flag>\t<path>\0, where the flag is
+  // empty for regular files.
+  constexpr size_t kMinEntrySize = Hash::RAW_SIZE + 2;
+  if (entries.size() < kMinEntrySize) {
+    throw std::runtime_error(folly::to<string>(
+        "truncated manifest entry: ", entries.size(), " bytes"));
+  }
+  Hash fileRevHash(entries.subpiece(0, Hash::RAW_SIZE));
+  auto* pos = entries.begin() + Hash::RAW_SIZE;
 
-  auto sep = cursor.read<char>();
+  auto sep = static_cast<char>(*pos++);
   if (sep != '\t') {
     throw std::runtime_error(folly::to<string>(
         "unexpected separator char: ", static_cast<int>(sep)));
   }
-  auto flag = cursor.read<char>();
+  auto flag = static_cast<char>(*pos++);
   if (flag == '\t') {
     flag = ' ';
   } else {
-    sep = cursor.read<char>();
+    sep = pos < entries.end() ? static_cast<char>(*pos++) : '\0';
     if (sep != '\t') {
       throw std::runtime_error(folly::to<string>(
           "unexpected separator char: ", static_cast<int>(sep)));
     }
   }
 
-  auto pathStr = cursor.readTerminatedString();
+  // memchr() scans a word or vector at a time, and pathStr refers to the
+  // chunk rather than being copied out of it.
+  auto* nul = static_cast<const uint8_t*>(
+      memchr(pos, '\0', static_cast<size_t>(entries.end() - pos)));
+  if (!nul) {
+    throw std::runtime_error("manifest entry path is not terminated");
+  }
+  StringPiece pathStr{reinterpret_cast<const char*>(pos),
+                      reinterpret_cast<const char*>(nul)};
+  entries.advance(static_cast<size_t>(nul + 1 - entries.begin()));
 
   TreeEntryType fileType;
   if (flag == ' ') {
@@ -910,16 +1414,23 @@ void HgImporter::readManifestEntry(
   importer.processEntry(path.dirname(), std::move(entry));
 }
 
+void HgImporter::PendingRequest::failRemaining(
+    const folly::exception_wrapper& ew) {
+  for (; nextResponse < responses.size(); ++nextResponse) {
+    responses[nextResponse].setException(ew);
+  }
+}
+
 HgImporter::ChunkHeader HgImporter::readChunkHeader(
     TransactionID txnID,
     StringPiece cmdName) {
-  ChunkHeader header;
-  readFromHelper(&header, sizeof(header), "response header");
-
-  header.requestID = Endian::big(header.requestID);
-  header.command = Endian::big(header.command);
-  header.flags = Endian::big(header.flags);
-  header.dataLength = Endian::big(header.dataLength);
+  auto header = readResponseHeader();
+  // Responses to requests sent earlier may arrive first.
+  while (header.requestID != txnID &&
+         pendingRequests_.find(header.requestID) != pendingRequests_.end()) {
+    readPendingResponse(header);
+    header = readResponseHeader();
+  }
 
   // If the header indicates an error, read the error message
   // and throw an exception.
@@ -943,6 +1454,134 @@ HgImporter::ChunkHeader HgImporter::readChunkHeader(
   return header;
 }
 
+HgImporter::ChunkHeader HgImporter::readResponseHeader() {
+  ChunkHeader header;
+  readFromHelper(&header, sizeof(header), "response header");
+
+  header.requestID = Endian::big(header.requestID);
+  header.command = Endian::big(header.command);
+  header.flags = Endian::big(header.flags);
+  header.dataLength = Endian::big(header.dataLength);
+  return header;
+}
+
+void HgImporter::readPendingResponse() {
+  readPendingResponse(readResponseHeader());
+}
+
+void HgImporter::readPendingResponse(const ChunkHeader& header) {
+  auto it = pendingRequests_.find(header.requestID);
+  if (it == pendingRequests_.end()) {
+    auto err = HgImporterError(
+        "received unexpected transaction ID ",
+        header.requestID,
+        " from hg_import_helper.py while ",
+        pendingRequests_.size(),
+        " requests are outstanding");
+    XLOG(ERR) << err.what();
+    throw err;
+  }
+
+  bool complete;
+  try {
+    complete = readPendingChunk(header, it->second);
+  } catch (const HgImporterError& ex) {
+    it->second.failRemaining(
+        folly::exception_wrapper{std::current_exception(), ex});
+    pendingRequestBytes_ -= it->second.requestSize;
+    pendingRequests_.erase(it);
+    throw;
+  }
+  if (complete) {
+    pendingRequestBytes_ -= it->second.requestSize;
+    pendingRequests_.erase(it);
+  }
+}
+
+bool HgImporter::readPendingChunk(
+    const ChunkHeader& header,
+    PendingRequest& pending) {
+  // HgImportPyError cannot safely be copied, so the promises are given the
+  // exception object that was thrown.
+  if ((header.flags & FLAG_ERROR) != 0) {
+    // The request as a whole failed.  Any responses we have not received yet
+    // will never arrive.
+    try {
+      readErrorAndThrow(header);
+    } catch (const HgImportPyError& ex) {
+      pending.failRemaining(
+          folly::exception_wrapper{std::current_exception(), ex});
+      return true;
+    }
+  }
+
+  if (pending.nextResponse >= pending.responses.size()) {
+    auto err = HgImporterError(
+        "received too many ",
+        pending.cmdName,
+        " response chunks from hg_import_helper.py");
+    XLOG(ERR) << err.what();
+    throw err;
+  }
+  auto& promise = pending.responses[pending.nextResponse++];
+  if ((header.flags & FLAG_ITEM_ERROR) != 0) {
+    try {
+      readErrorAndThrow(header);
+    } catch (const HgImportPyError& ex) {
+      promise.setException(
+          folly::exception_wrapper{std::current_exception(), ex});
+    }
+  } else {
+    auto buf = IOBuf(IOBuf::CREATE, header.dataLength);
+    readFromHelper(
+        buf.writableTail(), header.dataLength, "pending response body");
+    buf.append(header.dataLength);
+    promise.setValue(std::move(buf));
+  }
+
+  const bool isLast = (header.flags & FLAG_MORE_CHUNKS) == 0;
+  if (isLast && pending.nextResponse != pending.responses.size()) {
+    auto err = HgImporterError(
+        "received only ",
+        pending.nextResponse,
+        " of ",
+        pending.responses.size(),
+        " ",
+        pending.cmdName,
+        " response chunks from hg_import_helper.py");
+    XLOG(ERR) << err.what();
+    throw err;
+  }
+  return isLast;
+}
+
+HgImporter::PendingRequest& HgImporter::addPendingRequest(
+    TransactionID txnID,
+    StringPiece cmdName,
+    size_t requestSize,
+    size_t numResponses) {
+  auto ret = pendingRequests_.emplace(
+      std::piecewise_construct,
+      std::forward_as_tuple(txnID),
+      std::forward_as_tuple(cmdName, requestSize, numResponses));
+  pendingRequestBytes_ += requestSize;
+  return ret.first->second;
+}
+
+void HgImporter::makeRoomForRequest(size_t requestSize) {
+  while (!pendingRequests_.empty() &&
+         (pendingRequests_.size() >= kMaxPendingRequests ||
+          pendingRequestBytes_ + requestSize > kMaxPendingRequestBytes)) {
+    readPendingResponse();
+  }
+}
+
+void HgImporter::waitForPendingRequests() {
+  while (!pendingRequests_.empty()) {
+    readPendingResponse();
+  }
+}
+
 [[noreturn]] void HgImporter::readErrorAndThrow(const ChunkHeader& header) {
   auto buf = IOBuf{IOBuf::CREATE, header.dataLength};
   readFromHelper(buf.writableTail(), header.dataLength, "error response body");
@@ -999,6 +1638,25 @@ HgImporter::TransactionID HgImporter::sendManifestNodeRequest(
   return txnID;
 }
 
+HgImporter::TransactionID HgImporter::sendResolveCommitRequest(
+    folly::StringPiece revName) {
+  auto txnID = nextRequestID_++;
+  ChunkHeader header;
+  header.command = Endian::big<uint32_t>(CMD_RESOLVE_COMMIT);
+  header.requestID = Endian::big<uint32_t>(txnID);
+  header.flags = 0;
+  header.dataLength = Endian::big<uint32_t>(revName.size());
+
+  std::array<struct iovec, 2> iov;
+  iov[0].iov_base = &header;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = const_cast<char*>(revName.data());
+  iov[1].iov_len = revName.size();
+  writeToHelper(iov, "CMD_RESOLVE_COMMIT");
+
+  return txnID;
+}
+
 HgImporter::TransactionID HgImporter::sendFileRequest(
     RelativePathPiece path,
     Hash revHash) {
@@ -1022,6 +1680,42 @@ HgImporter::TransactionID HgImporter::sendFileRequest(
   return txnID;
 }
 
+HgImporter::TransactionID HgImporter::sendFilesRequest(
+    const std::vector<FileRequest>& files) {
+  auto txnID = nextRequestID_++;
+  ChunkHeader header;
+  header.command = Endian::big<uint32_t>(CMD_CAT_FILES);
+  header.requestID = Endian::big<uint32_t>(txnID);
+  header.flags = 0;
+
+  size_t dataLength = sizeof(uint32_t);
+  for (const auto& file : files) {
+    dataLength +=
+        Hash::RAW_SIZE + sizeof(uint32_t) + file.path.stringPiece().size();
+  }
+  header.dataLength = Endian::big<uint32_t>(dataLength);
+
+  IOBuf buf(IOBuf::CREATE, dataLength);
+  Appender appender(&buf, 0);
+  appender.writeBE<uint32_t>(files.size());
+  for (const auto& file : files) {
+    auto pathStr = file.path.stringPiece();
+    appender.push(file.revHash.getBytes());
+    appender.writeBE<uint32_t>(pathStr.size());
+    appender.push(pathStr);
+  }
+  DCHECK_EQ(buf.length(), dataLength);
+
+  std::array<struct iovec, 2> iov;
+  iov[0].iov_base = &header;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = const_cast<uint8_t*>(buf.data());
+  iov[1].iov_len = buf.length();
+  writeToHelper(iov, "CMD_CAT_FILES");
+
+  return txnID;
+}
+
 HgImporter::TransactionID HgImporter::sendPrefetchFilesRequest(
     const std::vector<std::pair<RelativePath, Hash>>& files) {
   auto txnID = nextRequestID_++;
@@ -1100,6 +1794,13 @@ HgImporter::TransactionID HgImporter::sendFetchTreeRequest(
 }
 
 void HgImporter::readFromHelper(void* buf, size_t size, StringPiece context) {
+  auto start = std::chrono::steady_clock::now();
+  SCOPE_EXIT {
+    if (stats_) {
+      StoreStats::recordLatency(
+          stats_->helperRead, std::chrono::steady_clock::now() - start);
+    }
+  };
   size_t bytesRead;
 #ifdef EDEN_WIN
   DWORD winBytesRead;
@@ -1147,6 +1848,13 @@ void HgImporter::writeToHelper(
     struct iovec* iov,
     size_t numIov,
     StringPiece context) {
+  auto start = std::chrono::steady_clock::now();
+  SCOPE_EXIT {
+    if (stats_) {
+      StoreStats::recordLatency(
+          stats_->helperWrite, std::chrono::steady_clock::now() - start);
+    }
+  };
 #ifdef EDEN_WIN
   try {
     facebook::edenwin::Pipe::writeiov(helperIn_, iov, numIov);
@@ -1181,11 +1889,17 @@ HgImporterManager::HgImporterManager(
     AbsolutePathPiece repoPath,
     LocalStore* store,
     folly::Optional<AbsolutePath> clientCertificate,
-    bool useMononoke)
+    bool useMononoke,
+    HgProxyHashCache* proxyHashCache,
+    HgImporterPool* importerPool,
+    HgImportStats* stats)
     : repoPath_{repoPath},
       store_{store},
       clientCertificate_{clientCertificate},
-      useMononoke_{useMononoke} {}
+      useMononoke_{useMononoke},
+      proxyHashCache_{proxyHashCache},
+      importerPool_{importerPool},
+      stats_{stats} {}
 
 template <typename Fn>
 auto HgImporterManager::retryOnError(Fn&& fn) {
@@ -1234,21 +1948,50 @@ unique_ptr<Blob> HgImporterManager::importFileContents(Hash blobHash) {
   });
 }
 
+std::vector<folly::Try<unique_ptr<Blob>>>
+HgImporterManager::importFileContentsBatch(
+    const std::vector<Hash>& blobHashes) {
+  return retryOnError([&](HgImporter* importer) {
+    return importer->importFileContentsBatch(blobHashes);
+  });
+}
+
 void HgImporterManager::prefetchFiles(
     const std::vector<std::pair<RelativePath, Hash>>& files) {
   return retryOnError(
       [&](HgImporter* importer) { return importer->prefetchFiles(files); });
 }
 
+void HgImporterManager::prefetchTree(const Hash& id, size_t depth) {
+  return retryOnError(
+      [&](HgImporter* importer) { return importer->prefetchTree(id, depth); });
+}
+
+Hash HgImporterManager::resolveCommit(StringPiece revName) {
+  return retryOnError(
+      [&](HgImporter* importer) { return importer->resolveCommit(revName); });
+}
+
 HgImporter* HgImporterManager::getImporter() {
+  if (!importer_ && importerPool_) {
+    importer_ = importerPool_->tryTake();
+  }
   if (!importer_) {
     importer_ = make_unique<HgImporter>(
-        repoPath_, store_, clientCertificate_, useMononoke_);
+        repoPath_,
+        store_,
+        clientCertificate_,
+        useMononoke_,
+        proxyHashCache_,
+        stats_);
   }
   return importer_.get();
 }
 
 void HgImporterManager::resetHgImporter(const std::exception& ex) {
+  if (stats_) {
+    stats_->helperRestarts.addValue(1);
+  }
   importer_.reset();
   XLOG(WARN) << "error communicating with hg_import_helper.py: " << ex.what();
 }
@@ -10,23 +10,21 @@
 #pragma once
 
 #include <folly/Range.h>
+#include <folly/Try.h>
+#include <folly/futures/Future.h>
 #ifndef EDEN_WIN
 #include <folly/Subprocess.h>
 #else
 #include "eden/win/eden/Subprocess.h" // @manual
 #endif
+#include <unordered_map>
+#include <vector>
 
 #include "eden/fs/eden-config.h"
 #include "eden/fs/store/LocalStore.h"
 #include "eden/fs/store/mononoke/MononokeBackingStore.h"
 #include "eden/fs/utils/PathFuncs.h"
 
-namespace folly {
-namespace io {
-class Cursor;
-}
-} // namespace folly
-
 #if EDEN_HAVE_HG_TREEMANIFEST
 /* forward declare support classes from mercurial */
 class DatapackStore;
@@ -38,7 +36,10 @@ namespace eden {
 
 class Blob;
 class Hash;
+class HgImportStats;
+class HgImporterPool;
 class HgManifestImporter;
+class HgProxyHashCache;
 class StoreResult;
 class Tree;
 
@@ -82,8 +83,32 @@ class Importer {
    */
   virtual std::unique_ptr<Blob> importFileContents(Hash blobHash) = 0;
 
+  /**
+   * Import the contents of several files.
+   *
+   * Returns one result per input hash, in the same order.  A failure to
+   * import one file is reported in its result rather than thrown, so that it
+   * does not affect the other files in the batch.
+   */
+  virtual std::vector<folly::Try<std::unique_ptr<Blob>>>
+  importFileContentsBatch(const std::vector<Hash>& blobHashes) = 0;
+
   virtual void prefetchFiles(
       const std::vector<std::pair<RelativePath, Hash>>& files) = 0;
+
+  /**
+   * Import a tree and its subtrees down to depth levels below it, if they
+   * can be fetched together more cheaply than one at a time.
+   *
+   * This is only a hint, and may do nothing.
+   */
+  virtual void prefetchTree(const Hash& id, size_t depth) = 0;
+
+  /**
+   * Resolve a revision name, such as a bookmark, to the commit it currently
+   * refers to.
+   */
+  virtual Hash resolveCommit(folly::StringPiece revName) = 0;
 };
 
 /**
@@ -106,13 +131,19 @@ class HgImporter : public Importer {
    * repository into the given LocalStore.
    *
    * The caller is responsible for ensuring that the LocalStore object remains
-   * valid for the lifetime of the HgImporter object.
+   * valid for the lifetime of the HgImporter object.  The same goes for the
+   * proxyHashCache, if one is given.  It is used to look up HgProxyHash data
+   * without reading the LocalStore, and the importer records every proxy
+   * hash that it stores in it.  Likewise the stats, if given, record the
+   * time spent talking to hg_import_helper.py.
    */
   HgImporter(
       AbsolutePathPiece repoPath,
       LocalStore* store,
       folly::Optional<AbsolutePath> clientCertificate,
-      bool useMononoke);
+      bool useMononoke,
+      HgProxyHashCache* proxyHashCache = nullptr,
+      HgImportStats* stats = nullptr);
 
   HgImporter(AbsolutePathPiece repoPath, LocalStore* store)
       : HgImporter(repoPath, store, folly::none, false) {}
@@ -145,9 +176,31 @@ class HgImporter : public Importer {
 
   std::unique_ptr<Tree> importTree(const Hash& id) override;
   std::unique_ptr<Blob> importFileContents(Hash blobHash) override;
+
+  /**
+   * Import the contents of several files.
+   *
+   * The files are requested with CMD_CAT_FILES, so the helper process
+   * handles many files per message.  The requests are written up front
+   * (subject to the limits on outstanding requests below), so the helper can
+   * move straight on to the next batch rather than waiting for a round trip
+   * through edenfs after each one.
+   */
+  std::vector<folly::Try<std::unique_ptr<Blob>>> importFileContentsBatch(
+      const std::vector<Hash>& blobHashes) override;
+
   void prefetchFiles(
       const std::vector<std::pair<RelativePath, Hash>>& files) override;
 
+  /**
+   * Fetch the trees from mononoke, which requests each level of subtrees
+   * all at once.  When mononoke is not in use the trees are read one at a
+   * time on demand, so this does nothing.
+   */
+  void prefetchTree(const Hash& id, size_t depth) override;
+
+  Hash resolveCommit(folly::StringPiece revName) override;
+
   /**
    * Resolve the manifest node for the specified revision.
    *
@@ -167,6 +220,7 @@ class HgImporter : public Importer {
   enum : uint32_t {
     FLAG_ERROR = 0x01,
     FLAG_MORE_CHUNKS = 0x02,
+    FLAG_ITEM_ERROR = 0x04,
   };
   /**
    * hg_import_helper protocol version number.
@@ -179,7 +233,7 @@ class HgImporter : public Importer {
    * hg_import_helper.py
    */
   enum : uint32_t {
-    PROTOCOL_VERSION = 1,
+    PROTOCOL_VERSION = 4,
   };
   /**
    * Flags for the CMD_STARTED response
@@ -203,6 +257,8 @@ class HgImporter : public Importer {
     CMD_FETCH_TREE = 5,
     CMD_PREFETCH_FILES = 6,
     CMD_CAT_FILE = 7,
+    CMD_CAT_FILES = 8,
+    CMD_RESOLVE_COMMIT = 9,
   };
   using TransactionID = uint32_t;
   struct ChunkHeader {
@@ -226,12 +282,70 @@ class HgImporter : public Importer {
      */
     std::vector<std::string> treeManifestPackPaths;
 
+    /**
+     * The paths to the remotefilelog file pack directories.
+     * If this vector is empty all file contents must be requested from the
+     * helper process.
+     */
+    std::vector<std::string> filePackPaths;
+
     /**
      * The name of the repo
      */
     std::string repoName;
   };
 
+  /**
+   * A request that has been sent to the helper process and whose response
+   * has not been read yet.
+   */
+  struct PendingRequest {
+    PendingRequest(folly::StringPiece name, size_t size, size_t numResponses)
+        : cmdName{name}, requestSize{size}, responses(numResponses) {}
+
+    /**
+     * Fail all of the responses that have not been received yet.
+     */
+    void failRemaining(const folly::exception_wrapper& ew);
+
+    folly::StringPiece cmdName;
+    size_t requestSize;
+    /**
+     * One promise per expected response chunk, fulfilled in the order the
+     * chunks arrive.
+     */
+    std::vector<folly::Promise<folly::IOBuf>> responses;
+    size_t nextResponse{0};
+  };
+
+  /**
+   * A file to include in a CMD_CAT_FILES request.
+   */
+  struct FileRequest {
+    Hash blobHash;
+    RelativePath path;
+    Hash revHash;
+  };
+
+  /**
+   * Limits on the requests that may be outstanding at once.
+   *
+   * The helper process handles requests one at a time and writes each
+   * response before reading the next request.  If it blocks writing a
+   * response while we block writing a request, neither side makes progress.
+   * Keeping the unread request bytes well below the pipe capacity ensures we
+   * can always finish writing a request without reading first.
+   */
+  static constexpr size_t kMaxPendingRequests = 64;
+  static constexpr size_t kMaxPendingRequestBytes = 32 * 1024;
+
+  /**
+   * Limits on the size of a single CMD_CAT_FILES request.  Larger batches are
+   * split across several requests.
+   */
+  static constexpr size_t kMaxFilesPerRequest = 1024;
+  static constexpr size_t kMaxFileRequestBytes = kMaxPendingRequestBytes / 2;
+
   // Forbidden copy constructor and assignment operator
   HgImporter(const HgImporter&) = delete;
   HgImporter& operator=(const HgImporter&) = delete;
@@ -240,13 +354,13 @@ class HgImporter : public Importer {
    * Read a single manifest entry from a manifest response chunk,
    * and give it to the HgManifestImporter for processing.
    *
-   * The cursor argument points to the start of the manifest entry in the
-   * response chunk received from the helper process.  readManifestEntry() is
-   * responsible for updating the cursor to point to the next manifest entry.
+   * The entries argument starts with the manifest entry in the response
+   * chunk received from the helper process.  readManifestEntry() advances it
+   * past the entry, to the start of the next one.
    */
   static void readManifestEntry(
       HgManifestImporter& importer,
-      folly::io::Cursor& cursor,
+      folly::ByteRange& entries,
       LocalStore::WriteBatch* writeBatch);
   /**
    * Read a response chunk header from the helper process
@@ -260,6 +374,78 @@ class HgImporter : public Importer {
    */
   ChunkHeader readChunkHeader(TransactionID txnID, folly::StringPiece cmdName);
 
+  /**
+   * Read a response chunk header from the helper process and convert it to
+   * host byte order, without checking its contents.
+   */
+  ChunkHeader readResponseHeader();
+
+  /**
+   * Read the response to one of the requests in pendingRequests_, and fulfill
+   * its promise.
+   *
+   * Throws an HgImporterError if there is an error communicating with the
+   * helper process, or if the response is not for an outstanding request.
+   */
+  void readPendingResponse();
+  void readPendingResponse(const ChunkHeader& header);
+
+  /**
+   * Read one response chunk for a pending request.
+   *
+   * Returns true if this was the last chunk of the response.
+   */
+  bool readPendingChunk(const ChunkHeader& header, PendingRequest& pending);
+
+  /**
+   * Record that a request has been sent, and return its entry in
+   * pendingRequests_.
+   */
+  PendingRequest& addPendingRequest(
+      TransactionID txnID,
+      folly::StringPiece cmdName,
+      size_t requestSize,
+      size_t numResponses);
+
+  /**
+   * Read responses until there is room for another outstanding request of
+   * the given size.
+   */
+  void makeRoomForRequest(size_t requestSize);
+
+  /**
+   * Read responses until there are no outstanding requests.
+   */
+  void waitForPendingRequests();
+
+  /**
+   * Send a CMD_CAT_FILE request for the given file without waiting for the
+   * response.
+   *
+   * The returned future is fulfilled once the response has been read, which
+   * happens during a later call to readPendingResponse().  If too many
+   * requests are already outstanding this first reads responses until there
+   * is room for another.
+   */
+  folly::Future<std::unique_ptr<Blob>>
+  fetchFileContents(Hash blobHash, RelativePathPiece path, Hash revHash);
+
+  /**
+   * Send a CMD_CAT_FILES request for several files without waiting for the
+   * response.  Returns one future per file, in the same order.
+   */
+  std::vector<folly::Future<std::unique_ptr<Blob>>> fetchFileContents(
+      const std::vector<FileRequest>& files);
+
+  /**
+   * Build a Blob from a CMD_CAT_FILE response body.
+   */
+  static std::unique_ptr<Blob> parseFileResponse(
+      Hash blobHash,
+      RelativePathPiece path,
+      Hash revHash,
+      folly::IOBuf buf);
+
   /**
    * Read the body of an error message, and throw it as an exception.
    */
@@ -290,6 +476,14 @@ class HgImporter : public Importer {
    */
   void initializeTreeManifestImport(const Options& options);
 
+  /**
+   * Initialize the fileUnionStore_ used to read file contents directly from
+   * the local file packs.
+   *
+   * This leaves fileUnionStore_ null if the repository has no file packs.
+   */
+  void initializeFileDatapackImport(const Options& options);
+
 #ifndef EDEN_WIN_NOMONONOKE
   /**
    * Initialize the mononoke_ needed for Mononoke API Server support.
@@ -308,11 +502,28 @@ class HgImporter : public Importer {
    * of the given file at the specified file revision.
    */
   TransactionID sendFileRequest(RelativePathPiece path, Hash fileRevHash);
+  /**
+   * Send a request to the helper process, asking it to send us the contents
+   * of several files.
+   */
+  TransactionID sendFilesRequest(const std::vector<FileRequest>& files);
   /**
    * Send a request to the helper process, asking it to send us the
    * manifest node (NOT the full manifest!) for the specified revision.
    */
   TransactionID sendManifestNodeRequest(folly::StringPiece revName);
+  /**
+   * Send a request to the helper process, asking it to resolve a revision
+   * name to a commit hash.
+   */
+  TransactionID sendResolveCommitRequest(folly::StringPiece revName);
+  /**
+   * Read a response whose body is a single 20-byte hash.
+   */
+  Hash readHashResponse(
+      TransactionID requestID,
+      folly::StringPiece revName,
+      folly::StringPiece cmdName);
   /**
    * Send a request to the helper process asking it to prefetch data for trees
    * under the specified path, at the specified manifest node for the given
@@ -329,12 +540,67 @@ class HgImporter : public Importer {
       const std::vector<std::pair<RelativePath, Hash>>& files);
 
 #if EDEN_HAVE_HG_TREEMANIFEST
+  /**
+   * Read the contents of a file from the local file packs, without involving
+   * the helper process.
+   *
+   * Returns nullptr if the file is not available locally; the caller should
+   * then ask the helper for it.
+   */
+  std::unique_ptr<Blob> importFileContentsFromDatapack(
+      Hash blobHash,
+      RelativePathPiece path,
+      Hash revHash);
+
   std::unique_ptr<Tree> importTreeImpl(
       const Hash& manifestNode,
       const Hash& edenTreeID,
       RelativePathPiece path,
       LocalStore::WriteBatch* writeBatch);
+
+  /**
+   * Store a tree that was fetched from mononoke, whose entries refer to
+   * mercurial hashes, as the eden tree edenTreeID.
+   */
+  std::unique_ptr<Tree> storeMononokeTree(
+      const Tree& mononokeTree,
+      const Hash& edenTreeID,
+      RelativePathPiece path,
+      LocalStore::WriteBatch* writeBatch);
 #endif
+
+  /**
+   * Look up the mercurial (path, revHash) pair for an eden hash, using
+   * proxyHashCache_ when possible.
+   */
+  std::pair<RelativePath, Hash> resolveProxyHash(
+      const Hash& edenBlobHash,
+      folly::StringPiece context);
+  /**
+   * Look up the (path, revHash) pairs for several eden hashes, reading any
+   * that are not cached from the LocalStore in a single batch.
+   *
+   * Returns one result per input hash, in the same order, so that a hash that
+   * cannot be resolved only fails its own result.
+   */
+  std::vector<folly::Try<std::pair<RelativePath, Hash>>> resolveProxyHashes(
+      const std::vector<Hash>& edenBlobHashes);
+  /**
+   * Store HgProxyHash data in the write batch, and record it in
+   * proxyHashCache_.
+   */
+  Hash storeProxyHash(
+      RelativePathPiece path,
+      Hash revHash,
+      LocalStore::WriteBatch* writeBatch);
+  /**
+   * Begin and flush the write batch of a tree import.  Once the batch is
+   * flushed, the proxy hashes that storeProxyHash() wrote to it are marked
+   * as stored in proxyHashCache_, so that later imports of trees that share
+   * those entries skip rewriting them.
+   */
+  std::unique_ptr<LocalStore::WriteBatch> beginImportBatch();
+  void flushImportBatch(LocalStore::WriteBatch* writeBatch);
 #ifndef EDEN_WIN
   folly::Subprocess helper_;
 #else
@@ -342,6 +608,12 @@ class HgImporter : public Importer {
 #endif
   const AbsolutePath repoPath_;
   LocalStore* const store_{nullptr};
+  HgProxyHashCache* const proxyHashCache_{nullptr};
+  HgImportStats* const stats_{nullptr};
+  /**
+   * The proxy hashes written to the current import's write batch.
+   */
+  std::vector<Hash> unflushedProxyHashes_;
   uint32_t nextRequestID_{0};
   folly::Optional<AbsolutePath> clientCertificate_;
   bool useMononoke_;
@@ -357,10 +629,21 @@ class HgImporter : public Importer {
   edenfd_t helperIn_{kInvalidFd};
   edenfd_t helperOut_{kInvalidFd};
 
+  /**
+   * Requests that have been sent to the helper process but whose responses
+   * have not been read yet, keyed by transaction ID.
+   */
+  std::unordered_map<TransactionID, PendingRequest> pendingRequests_;
+  /** The total size of the requests in pendingRequests_. */
+  size_t pendingRequestBytes_{0};
+
 #if EDEN_HAVE_HG_TREEMANIFEST
   std::vector<std::unique_ptr<DatapackStore>> dataPackStores_;
   std::unique_ptr<UnionDatapackStore> unionStore_;
 
+  std::vector<std::unique_ptr<DatapackStore>> fileDataPackStores_;
+  std::unique_ptr<UnionDatapackStore> fileUnionStore_;
+
   std::unique_ptr<MononokeBackingStore> mononoke_;
 #endif // EDEN_HAVE_HG_TREEMANIFEST
 };
@@ -382,6 +665,9 @@ class HgImporterError : public std::exception {
 /**
  * A helper class that manages an HgImporter and recreates it after any error
  * communicating with the underlying python hg_import_helper.py script.
+ *
+ * If an HgImporterPool is given, new HgImporters are taken from it when it
+ * has one ready, rather than waiting for a new helper process to start.
  */
 class HgImporterManager : public Importer {
  public:
@@ -389,15 +675,22 @@ class HgImporterManager : public Importer {
       AbsolutePathPiece repoPath,
       LocalStore* store,
       folly::Optional<AbsolutePath> clientCertificate,
-      bool useMononoke);
+      bool useMononoke,
+      HgProxyHashCache* proxyHashCache = nullptr,
+      HgImporterPool* importerPool = nullptr,
+      HgImportStats* stats = nullptr);
 
   Hash importManifest(folly::StringPiece revName) override;
 
   std::unique_ptr<Tree> importTree(const Hash& id) override;
 
   std::unique_ptr<Blob> importFileContents(Hash blobHash) override;
+  std::vector<folly::Try<std::unique_ptr<Blob>>> importFileContentsBatch(
+      const std::vector<Hash>& blobHashes) override;
   void prefetchFiles(
       const std::vector<std::pair<RelativePath, Hash>>& files) override;
+  void prefetchTree(const Hash& id, size_t depth) override;
+  Hash resolveCommit(folly::StringPiece revName) override;
 
  private:
   template <typename Fn>
@@ -412,6 +705,9 @@ class HgImporterManager : public Importer {
   LocalStore* const store_{nullptr};
   const folly::Optional<AbsolutePath> clientCertificate_;
   const bool useMononoke_{false};
+  HgProxyHashCache* const proxyHashCache_{nullptr};
+  HgImporterPool* const importerPool_{nullptr};
+  HgImportStats* const stats_{nullptr};
 };
 
 } // namespace eden
@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/hg/HgImporterPool.h"
+
+#include <folly/String.h>
+#include <folly/logging/xlog.h>
+#include <folly/system/ThreadName.h>
+#include <algorithm>
+#include <chrono>
+
+#include "eden/fs/store/hg/HgImporter.h"
+
+using std::unique_ptr;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+// How long to wait before trying again after a helper fails to start.  This
+// doubles after each consecutive failure, up to kMaxRetryDelay, so that a
+// repository that cannot be opened does not keep us spawning processes.
+constexpr std::chrono::seconds kMinRetryDelay{1};
+constexpr std::chrono::seconds kMaxRetryDelay{60};
+} // namespace
+
+HgImporterPool::HgImporterPool(
+    AbsolutePathPiece repoPath,
+    LocalStore* store,
+    folly::Optional<AbsolutePath> clientCertificate,
+    bool useMononoke,
+    HgProxyHashCache* proxyHashCache,
+    size_t numSpares,
+    HgImportStats* stats,
+    const CpuAffinity& affinity)
+    : repoPath_{repoPath},
+      store_{store},
+      clientCertificate_{clientCertificate},
+      useMononoke_{useMononoke},
+      proxyHashCache_{proxyHashCache},
+      numSpares_{numSpares},
+      stats_{stats} {
+  if (numSpares_ > 0) {
+    // The helpers inherit the affinity of the thread that starts them.
+    thread_ = std::thread([this, affinity] {
+      folly::setThreadName("HgImporterPool");
+      affinity.applyToCurrentThread();
+      replenish();
+    });
+  }
+}
+
+HgImporterPool::~HgImporterPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+unique_ptr<HgImporter> HgImporterPool::tryTake() {
+  unique_ptr<HgImporter> importer;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (spares_.empty()) {
+      return nullptr;
+    }
+    importer = std::move(spares_.back());
+    spares_.pop_back();
+  }
+  cv_.notify_all();
+  return importer;
+}
+
+void HgImporterPool::replenish() {
+  auto retryDelay = std::chrono::seconds{0};
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopping_ || spares_.size() < numSpares_; });
+    if (stopping_) {
+      return;
+    }
+
+    // Start the helper without holding the lock, since this takes a while.
+    lock.unlock();
+    unique_ptr<HgImporter> importer;
+    try {
+      importer = std::make_unique<HgImporter>(
+          repoPath_,
+          store_,
+          clientCertificate_,
+          useMononoke_,
+          proxyHashCache_,
+          stats_);
+    } catch (const std::exception& ex) {
+      XLOG(WARN) << "failed to start a spare hg_import_helper.py for "
+                 << repoPath_ << ": " << folly::exceptionStr(ex);
+    }
+    lock.lock();
+
+    if (importer) {
+      spares_.push_back(std::move(importer));
+      retryDelay = std::chrono::seconds{0};
+    } else {
+      retryDelay = std::min(
+          std::max(retryDelay * 2, std::chrono::seconds{kMinRetryDelay}),
+          std::chrono::seconds{kMaxRetryDelay});
+      cv_.wait_for(lock, retryDelay, [this] { return stopping_; });
+    }
+  }
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,94 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "eden/fs/utils/PathFuncs.h"
+#include "eden/fs/utils/ThreadAffinity.h"
+
+namespace facebook {
+namespace eden {
+
+class HgImportStats;
+class HgImporter;
+class HgProxyHashCache;
+class LocalStore;
+
+/**
+ * HgImporterPool keeps a few HgImporter objects whose hg_import_helper.py
+ * processes have already started, so that HgImporterManager does not have to
+ * wait for a new helper to start up when it needs one.
+ *
+ * Starting a helper takes several seconds, since it has to import mercurial
+ * and open the repository.  Without the pool that time is spent on an import
+ * thread, either the first time the thread is used after a mount or after an
+ * error that required the helper to be restarted, and every request queued
+ * for that thread waits for it.
+ *
+ * A background thread starts new helpers whenever the pool has fewer than
+ * the requested number of spares.
+ *
+ * HgImporterPool is thread-safe.
+ */
+class HgImporterPool {
+ public:
+  HgImporterPool(
+      AbsolutePathPiece repoPath,
+      LocalStore* store,
+      folly::Optional<AbsolutePath> clientCertificate,
+      bool useMononoke,
+      HgProxyHashCache* proxyHashCache,
+      size_t numSpares,
+      HgImportStats* stats = nullptr,
+      const CpuAffinity& affinity = CpuAffinity{});
+
+  /**
+   * Stop the background thread and close any spare helpers.  This waits for
+   * a helper that is in the middle of starting up to finish doing so.
+   */
+  ~HgImporterPool();
+
+  /**
+   * Take an importer whose helper process has already started.
+   *
+   * Returns nullptr if none is ready yet, in which case the caller should
+   * create its own.
+   */
+  std::unique_ptr<HgImporter> tryTake();
+
+ private:
+  HgImporterPool(const HgImporterPool&) = delete;
+  HgImporterPool& operator=(const HgImporterPool&) = delete;
+
+  void replenish();
+
+  const AbsolutePath repoPath_;
+  LocalStore* const store_{nullptr};
+  const folly::Optional<AbsolutePath> clientCertificate_;
+  const bool useMononoke_{false};
+  HgProxyHashCache* const proxyHashCache_{nullptr};
+  const size_t numSpares_{0};
+  HgImportStats* const stats_{nullptr};
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::unique_ptr<HgImporter>> spares_;
+  bool stopping_{false};
+  std::thread thread_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -9,10 +9,13 @@
  */
 #include "HgManifestImporter.h"
 
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/logging/xlog.h>
 #include <gflags/gflags.h>
+#include <algorithm>
 
 #include "eden/fs/model/Tree.h"
 #include "eden/fs/model/TreeEntry.h"
@@ -21,6 +24,7 @@
 
 using folly::ByteRange;
 using folly::IOBuf;
+using folly::StringPiece;
 using folly::io::Appender;
 using std::string;
 
@@ -45,9 +49,10 @@ class HgManifestImporter::PartialTree {
 
   void addEntry(TreeEntry&& entry);
 
-  /** move in a computed sub-tree.
-   * The tree will be recorded in the store in the second pass of
-   * the import, but only if the parent(s) are not stored. */
+  /** move in a sub-tree whose entries are complete.
+   * The sub-tree is computed along with this tree, and will be recorded
+   * in the store in the second pass of the import, but only if the
+   * parent(s) are not stored. */
   void addPartialTree(PartialTree&& tree);
 
   /** Record this node against the store.
@@ -56,6 +61,8 @@ class HgManifestImporter::PartialTree {
   Hash record(LocalStore* store, LocalStore::WriteBatch* batch);
 
   /** Compute the serialized version of this tree.
+   * Computes any sub-trees first, since their hashes are part of this
+   * tree's contents.
    * Records the id and data ready to be stored by a later call
    * to the record() method. */
   Hash compute(LocalStore* store);
@@ -110,6 +117,13 @@ void HgManifestImporter::PartialTree::addEntry(TreeEntry&& entry) {
 
 Hash HgManifestImporter::PartialTree::compute(LocalStore* store) {
   DCHECK(!computed_) << "Can only compute a PartialTree once";
+  for (auto& child : trees_) {
+    auto childHash = child.compute(store);
+    addEntry(TreeEntry{childHash,
+                       child.getPath().basename().stringPiece(),
+                       TreeEntryType::TREE});
+  }
+
   auto tree = Tree(std::move(entries_));
   std::tie(id_, treeData_) = store->serializeTree(&tree);
 
@@ -147,10 +161,20 @@ Hash HgManifestImporter::PartialTree::record(
 
 HgManifestImporter::HgManifestImporter(
     LocalStore* store,
-    LocalStore::WriteBatch* writeBatch)
-    : store_(store), writeBatch_(writeBatch) {
+    LocalStore::WriteBatch* writeBatch,
+    size_t numWorkerThreads,
+    size_t writeBatchBufSize)
+    : store_(store),
+      writeBatch_(writeBatch),
+      writeBatchBufSize_(writeBatchBufSize) {
   // Push the root directory onto the stack
   dirStack_.emplace_back(RelativePath(""));
+
+  if (numWorkerThreads > 0) {
+    workers_ = std::make_unique<folly::CPUThreadPoolExecutor>(
+        numWorkerThreads,
+        std::make_shared<folly::NamedThreadFactory>("HgManifestImport"));
+  }
 }
 
 HgManifestImporter::~HgManifestImporter() {
@@ -163,43 +187,58 @@ void HgManifestImporter::processEntry(
     TreeEntry&& entry) {
   CHECK(!dirStack_.empty());
 
-  // mercurial always maintains the manifest in sorted order,
-  // so we can take advantage of this when processing the entries.
-  while (true) {
-    // If this entry is for the current directory,
-    // we can just add the tree entry to the current PartialTree.
-    if (dirname == dirStack_.back().getPath()) {
-      dirStack_.back().addEntry(std::move(entry));
-      break;
-    }
-
-    // If this is for a subdirectory of the current directory,
-    // we have to push new directories onto the stack.
-    auto iter = dirname.findParent(dirStack_.back().getPath());
-    auto end = dirname.allPaths().end();
-    if (iter != end) {
-      ++iter;
-      while (iter != end) {
-        XLOG(DBG7) << "push '" << iter.piece() << "'  # '" << dirname << "'";
-        dirStack_.emplace_back(iter.piece());
-        ++iter;
-      }
-      dirStack_.back().addEntry(std::move(entry));
-      break;
-    }
+  // Consecutive entries are usually in the same directory.
+  if (dirname == dirStack_.back().getPath()) {
+    dirStack_.back().addEntry(std::move(entry));
+    return;
+  }
 
-    // None of the checks above passed, so the current entry must be a parent
-    // of the current directory.  Record the current directory, then pop it off
-    // the stack.
+  // mercurial always maintains the manifest in sorted order, so every
+  // directory on the stack below the one shared with dirname is complete.
+  // Record and pop them, then push the rest of dirname.  dirStack_ holds
+  // every ancestor of the current directory, so comparing the two paths once
+  // is enough to find both, and the shared components are never re-split.
+  auto dir = dirname.stringPiece();
+  auto common = commonDirPrefixLength(dirStack_.back().getPath(), dirname);
+  while (dirStack_.back().getPath().stringPiece().size() > common) {
     XLOG(DBG7) << "pop '" << dirStack_.back().getPath() << "' --> '"
                << (dirStack_.end() - 2)->getPath() << "'  # '" << dirname
                << "'";
     popCurrentDir();
     CHECK(!dirStack_.empty());
-    // Continue around the while loop, now that the current directory
-    // is updated.
-    continue;
   }
+  auto pos = common == 0 ? 0 : common + 1;
+  while (pos < dir.size()) {
+    auto slash = dir.find('/', pos);
+    if (slash == StringPiece::npos) {
+      slash = dir.size();
+    }
+    RelativePathPiece subdir{dir.subpiece(0, slash)};
+    XLOG(DBG7) << "push '" << subdir << "'  # '" << dirname << "'";
+    dirStack_.emplace_back(subdir);
+    pos = slash + 1;
+  }
+  dirStack_.back().addEntry(std::move(entry));
+}
+
+size_t HgManifestImporter::commonDirPrefixLength(
+    RelativePathPiece a,
+    RelativePathPiece b) {
+  auto left = a.stringPiece();
+  auto right = b.stringPiece();
+  auto length = std::min(left.size(), right.size());
+  auto mismatch =
+      std::mismatch(left.begin(), left.begin() + length, right.begin());
+  size_t common = mismatch.first - left.begin();
+  auto endsComponent = [common](StringPiece path) {
+    return common == path.size() || path[common] == '/';
+  };
+  if (endsComponent(left) && endsComponent(right)) {
+    return common;
+  }
+  // The paths diverge within a component; back up to its start.
+  auto slash = left.subpiece(0, common).rfind('/');
+  return slash == StringPiece::npos ? 0 : slash;
 }
 
 Hash HgManifestImporter::finish() {
@@ -212,6 +251,15 @@ Hash HgManifestImporter::finish() {
     popCurrentDir();
   }
 
+  // Add the top-level directories that were imported by the workers.
+  for (auto& pending : pendingDirs_) {
+    auto dirHash = std::move(pending.second).get();
+    TreeEntry dirEntry{
+        dirHash, pending.first.stringPiece(), TreeEntryType::TREE};
+    dirStack_.back().addEntry(std::move(dirEntry));
+  }
+  pendingDirs_.clear();
+
   auto rootHash = dirStack_.back().compute(store_);
   dirStack_.back().record(store_, writeBatch_);
   dirStack_.pop_back();
@@ -223,17 +271,34 @@ Hash HgManifestImporter::finish() {
 }
 
 void HgManifestImporter::popCurrentDir() {
-  PathComponent entryName = dirStack_.back().getPath().basename().copy();
-
   PartialTree back = std::move(dirStack_.back());
   dirStack_.pop_back();
   DCHECK(!dirStack_.empty());
 
-  auto dirHash = back.compute(store_);
+  if (workers_ && dirStack_.size() == 1) {
+    importTopLevelDir(std::move(back));
+    return;
+  }
 
-  TreeEntry dirEntry{dirHash, entryName.stringPiece(), TreeEntryType::TREE};
-  dirStack_.back().addEntry(std::move(dirEntry));
+  // The tree is computed along with its parent, once all of the parent's
+  // entries have been processed.
   dirStack_.back().addPartialTree(std::move(back));
 }
+
+void HgManifestImporter::importTopLevelDir(PartialTree&& tree) {
+  auto entryName = tree.getPath().basename().copy();
+  auto future = folly::via(
+      workers_.get(),
+      [store = store_,
+       bufSize = writeBatchBufSize_,
+       tree = std::move(tree)]() mutable {
+        auto dirHash = tree.compute(store);
+        auto writeBatch = store->beginWrite(bufSize);
+        tree.record(store, writeBatch.get());
+        writeBatch->flush();
+        return dirHash;
+      });
+  pendingDirs_.emplace_back(std::move(entryName), std::move(future));
+}
 } // namespace eden
 } // namespace facebook
@@ -9,11 +9,18 @@
  */
 #pragma once
 
+#include <folly/futures/Future.h>
+#include <memory>
+#include <utility>
 #include <vector>
 
 #include "eden/fs/store/LocalStore.h"
 #include "eden/fs/utils/PathFuncs.h"
 
+namespace folly {
+class CPUThreadPoolExecutor;
+} // namespace folly
+
 namespace facebook {
 namespace eden {
 
@@ -23,12 +30,22 @@ class TreeEntry;
 /*
  * HgManifestImporter maintains state needed to process an
  * HG manifest and create Tree objects from it.
+ *
+ * If numWorkerThreads is non-zero, each top-level directory is handed off to
+ * a pool of that many threads as soon as all of its entries have been
+ * processed.  The workers compute the trees for the directory and write them
+ * to the LocalStore using their own WriteBatch, of up to writeBatchBufSize
+ * bytes, while the caller carries on streaming in the rest of the manifest.
+ * finish() then waits for the workers and builds the root tree from their
+ * results.
  */
 class HgManifestImporter {
  public:
   explicit HgManifestImporter(
       LocalStore* store,
-      LocalStore::WriteBatch* writeBatch);
+      LocalStore::WriteBatch* writeBatch,
+      size_t numWorkerThreads = 0,
+      size_t writeBatchBufSize = 0);
   virtual ~HgManifestImporter();
 
   /**
@@ -60,9 +77,29 @@ class HgManifestImporter {
 
   void popCurrentDir();
 
+  /**
+   * Return the length of the deepest directory that is either of a and b or
+   * an ancestor of both.  This is 0 if that is the root.
+   */
+  static size_t commonDirPrefixLength(
+      RelativePathPiece a,
+      RelativePathPiece b);
+
+  /**
+   * Compute and record a complete top-level directory on the worker pool.
+   */
+  void importTopLevelDir(PartialTree&& tree);
+
   LocalStore* store_{nullptr};
   std::vector<PartialTree> dirStack_;
   LocalStore::WriteBatch* writeBatch_;
+  const size_t writeBatchBufSize_;
+  // The names and eventual hashes of the top-level directories that have been
+  // handed off to workers_.
+  std::vector<std::pair<PathComponent, folly::Future<Hash>>> pendingDirs_;
+  // This is declared last so that it is destroyed first; its destructor waits
+  // for any work that is still in progress.
+  std::unique_ptr<folly::CPUThreadPoolExecutor> workers_;
 };
 } // namespace eden
 } // namespace facebook
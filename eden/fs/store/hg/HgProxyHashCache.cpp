@@ -0,0 +1,180 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/hg/HgProxyHashCache.h"
+
+#include <folly/futures/Future.h>
+#include <folly/hash/Hash.h>
+#include <algorithm>
+
+#include "eden/fs/store/hg/HgProxyHash.h"
+
+using folly::StringPiece;
+using std::string;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+// Don't bother pruning unused directory names until there are at least this
+// many of them.
+constexpr size_t kMinDirNamePruneThreshold = 1024;
+} // namespace
+
+HgProxyHashCache::HgProxyHashCache(size_t maxEntries)
+    : entries_{std::max<size_t>(maxEntries, 1)},
+      dirNamePruneThreshold_{kMinDirNamePruneThreshold} {}
+
+folly::Optional<std::pair<RelativePath, Hash>> HgProxyHashCache::get(
+    const Hash& edenBlobHash) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = entries_.find(edenBlobHash);
+  if (it == entries_.end()) {
+    return folly::none;
+  }
+  hitCount_.fetch_add(1, std::memory_order_relaxed);
+  return it->second.get();
+}
+
+folly::Future<std::vector<std::pair<RelativePath, Hash>>>
+HgProxyHashCache::getBatch(
+    LocalStore* store,
+    const std::vector<Hash>& edenBlobHashes) {
+  std::vector<std::pair<RelativePath, Hash>> results(edenBlobHashes.size());
+  std::vector<Hash> missing;
+  std::vector<size_t> missingIndexes;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (size_t idx = 0; idx < edenBlobHashes.size(); ++idx) {
+      auto it = entries_.find(edenBlobHashes[idx]);
+      if (it == entries_.end()) {
+        missing.push_back(edenBlobHashes[idx]);
+        missingIndexes.push_back(idx);
+      } else {
+        results[idx] = it->second.get();
+      }
+    }
+  }
+  hitCount_.fetch_add(
+      edenBlobHashes.size() - missing.size(), std::memory_order_relaxed);
+
+  if (missing.empty()) {
+    return folly::makeFuture(std::move(results));
+  }
+
+  return HgProxyHash::getBatch(store, missing)
+      .then([this,
+             results = std::move(results),
+             missing,
+             missingIndexes = std::move(missingIndexes)](
+                std::vector<std::pair<RelativePath, Hash>>&& loaded) mutable {
+        for (size_t n = 0; n < loaded.size(); ++n) {
+          insert(missing[n], loaded[n].first, loaded[n].second, true);
+          results[missingIndexes[n]] = std::move(loaded[n]);
+        }
+        return std::move(results);
+      });
+}
+
+void HgProxyHashCache::insert(
+    const Hash& edenBlobHash,
+    RelativePathPiece path,
+    Hash revHash,
+    bool stored) {
+  auto dirName = path.dirname().stringPiece();
+  auto baseName = path.basename().stringPiece().str();
+
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = entries_.find(edenBlobHash);
+  if (it != entries_.end()) {
+    // The eden hash is computed from the path and revHash, so the mapping
+    // itself cannot have changed.
+    it->second.stored |= stored;
+    return;
+  }
+  entries_.set(
+      edenBlobHash,
+      Entry{internDirName(dirName), std::move(baseName), revHash, stored});
+}
+
+bool HgProxyHashCache::isStored(const Hash& edenBlobHash) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = entries_.find(edenBlobHash);
+  return it != entries_.end() && it->second.stored;
+}
+
+void HgProxyHashCache::markStored(const std::vector<Hash>& edenBlobHashes) {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (const auto& edenBlobHash : edenBlobHashes) {
+    auto it = entries_.findWithoutPromotion(edenBlobHash);
+    if (it != entries_.end()) {
+      it->second.stored = true;
+    }
+  }
+}
+
+size_t HgProxyHashCache::size() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return entries_.size();
+}
+
+size_t HgProxyHashCache::getDirNameCount() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return dirNames_.size();
+}
+
+std::shared_ptr<const string> HgProxyHashCache::internDirName(
+    StringPiece dirName) {
+  auto it = dirNames_.find(dirName);
+  if (it != dirNames_.end()) {
+    return it->second;
+  }
+
+  if (dirNames_.size() >= dirNamePruneThreshold_) {
+    pruneDirNames();
+  }
+  auto interned = std::make_shared<const string>(dirName.str());
+  dirNames_.emplace(StringPiece{*interned}, interned);
+  return interned;
+}
+
+void HgProxyHashCache::pruneDirNames() {
+  for (auto it = dirNames_.begin(); it != dirNames_.end();) {
+    // A use count of 1 means that only dirNames_ itself refers to it.
+    if (it->second.use_count() == 1) {
+      it = dirNames_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  // Wait for the table to double in size again before the next pass, so that
+  // the cost of pruning is amortized across insertions.
+  dirNamePruneThreshold_ =
+      std::max(kMinDirNamePruneThreshold, 2 * dirNames_.size());
+}
+
+std::pair<RelativePath, Hash> HgProxyHashCache::Entry::get() const {
+  if (dirName->empty()) {
+    return std::make_pair(RelativePath{StringPiece{baseName}}, revHash);
+  }
+
+  string path;
+  path.reserve(dirName->size() + 1 + baseName.size());
+  path.append(*dirName);
+  path.push_back('/');
+  path.append(baseName);
+  return std::make_pair(RelativePath{std::move(path)}, revHash);
+}
+
+size_t HgProxyHashCache::DirNameHasher::operator()(StringPiece dirName) const {
+  return folly::hash::fnv64_buf(dirName.data(), dirName.size());
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <folly/container/EvictingCacheMap.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace folly {
+template <typename T>
+class Future;
+} // namespace folly
+
+namespace facebook {
+namespace eden {
+
+class LocalStore;
+
+/**
+ * HgProxyHashCache keeps recently used HgProxyHash mappings in memory.
+ *
+ * Every hg import first has to turn the eden hash it was given back into the
+ * mercurial (path, revHash) pair it stands for, which otherwise costs a read
+ * from the HgProxyHashFamily in the LocalStore.  Most of those lookups are
+ * for objects whose proxy hash was computed moments earlier, when their
+ * parent tree was imported, so the importer records each mapping here as it
+ * stores it.
+ *
+ * Entries hold their directory name separately from their base name, and
+ * entries in the same directory share a single copy of the directory name.
+ * The cache holds a bounded number of entries, evicting the least recently
+ * used ones first.
+ *
+ * The cache also remembers which of its entries are known to be in the
+ * LocalStore, so that importers can skip rewriting a mapping that an earlier
+ * import already stored.  Trees that change only a few of their entries
+ * otherwise rewrite the mappings for all of the others.
+ *
+ * HgProxyHashCache is thread-safe.
+ */
+class HgProxyHashCache {
+ public:
+  explicit HgProxyHashCache(size_t maxEntries);
+
+  /**
+   * Look up the (path, revHash) pair for an eden hash.
+   *
+   * Returns folly::none if the hash is not in the cache.
+   */
+  folly::Optional<std::pair<RelativePath, Hash>> get(const Hash& edenBlobHash);
+
+  /**
+   * Look up the (path, revHash) pairs for several eden hashes.
+   *
+   * Hashes that are not in the cache are read from the LocalStore in a
+   * single batch and added to the cache.  As with HgProxyHash::getBatch(),
+   * the returned Future fails if any of the hashes is unknown.
+   *
+   * The HgProxyHashCache must remain valid until the returned Future
+   * completes.
+   */
+  folly::Future<std::vector<std::pair<RelativePath, Hash>>> getBatch(
+      LocalStore* store,
+      const std::vector<Hash>& edenBlobHashes);
+
+  /**
+   * Record the (path, revHash) pair for an eden hash.
+   *
+   * stored says whether the mapping is already in the LocalStore.  An entry
+   * that was known to be stored stays that way.
+   */
+  void insert(
+      const Hash& edenBlobHash,
+      RelativePathPiece path,
+      Hash revHash,
+      bool stored = false);
+
+  /**
+   * Returns true if the mapping for edenBlobHash is known to be in the
+   * LocalStore.
+   */
+  bool isStored(const Hash& edenBlobHash);
+
+  /**
+   * Record that the mappings for these hashes have been written to the
+   * LocalStore.  Hashes that are no longer cached are ignored.
+   */
+  void markStored(const std::vector<Hash>& edenBlobHashes);
+
+  /**
+   * Get the number of lookups that were answered by the cache.
+   */
+  uint64_t getHitCount() const {
+    return hitCount_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Get the number of entries currently in the cache.
+   */
+  size_t size() const;
+
+  /**
+   * Get the number of distinct directory names held by the cache.
+   */
+  size_t getDirNameCount() const;
+
+ private:
+  struct Entry {
+    std::shared_ptr<const std::string> dirName;
+    std::string baseName;
+    Hash revHash;
+    bool stored{false};
+
+    std::pair<RelativePath, Hash> get() const;
+  };
+  struct DirNameHasher {
+    size_t operator()(folly::StringPiece dirName) const;
+  };
+
+  /**
+   * Return the shared copy of dirName, creating it if necessary.
+   * lock_ must be held.
+   */
+  std::shared_ptr<const std::string> internDirName(folly::StringPiece dirName);
+
+  /**
+   * Forget directory names that are no longer used by any entry.
+   * lock_ must be held.
+   */
+  void pruneDirNames();
+
+  mutable std::mutex lock_;
+  folly::EvictingCacheMap<Hash, Entry> entries_;
+  // The keys point into the strings owned by the values.
+  std::unordered_map<
+      folly::StringPiece,
+      std::shared_ptr<const std::string>,
+      DirNameHasher>
+      dirNames_;
+  size_t dirNamePruneThreshold_;
+  std::atomic<uint64_t> hitCount_{0};
+};
+
+} // namespace eden
+} // namespace facebook
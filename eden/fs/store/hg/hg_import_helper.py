@@ -97,7 +97,7 @@ SHA1_NUM_BYTES = 20
 #
 # This must be kept in sync with the PROTOCOL_VERSION field in the C++
 # HgImporter code.
-PROTOCOL_VERSION = 1
+PROTOCOL_VERSION = 4
 
 START_FLAGS_TREEMANIFEST_SUPPORTED = 0x01
 START_FLAGS_MONONOKE_SUPPORTED = 0x02
@@ -116,6 +116,8 @@ CMD_MANIFEST_NODE_FOR_COMMIT = 4
 CMD_FETCH_TREE = 5
 CMD_PREFETCH_FILES = 6
 CMD_CAT_FILE = 7
+CMD_CAT_FILES = 8
+CMD_RESOLVE_COMMIT = 9
 
 #
 # Flag values.
@@ -133,6 +135,13 @@ FLAG_ERROR = 0x01
 #   same request/response.  If this flag is not set, this is the final chunk in
 #   this request/response.
 FLAG_MORE_CHUNKS = 0x02
+# FLAG_ITEM_ERROR:
+# - This flag is only valid in response chunks for commands that operate on
+#   several items at once, such as CMD_CAT_FILES.  It indicates that an error
+#   occurred processing the one item this chunk is for.  The chunk body uses
+#   the same format as a FLAG_ERROR chunk, but the response continues with the
+#   chunks for the remaining items.
+FLAG_ITEM_ERROR = 0x04
 
 
 class Request(object):
@@ -332,6 +341,8 @@ class HgServer(object):
         # - Is treemanifest supported?
         # - Number of treemanifest paths
         #   - treemanifest paths, encoded as (length, string_data)
+        # - Number of file pack paths
+        #   - file pack paths, encoded as (length, string_data)
         parts = []
         parts.append(
             struct.pack(b">III", PROTOCOL_VERSION, flags, len(treemanifest_paths))
@@ -340,12 +351,41 @@ class HgServer(object):
             parts.append(struct.pack(b">I", len(path)))
             parts.append(path)
 
+        file_pack_paths = self._get_file_pack_paths()
+        parts.append(struct.pack(b">I", len(file_pack_paths)))
+        for path in file_pack_paths:
+            parts.append(struct.pack(b">I", len(path)))
+            parts.append(path)
+
         if use_mononoke:
             parts.append(struct.pack(b">I", len(repo_name)))
             parts.append(repo_name)
 
         return "".join(parts)
 
+    def _get_file_pack_paths(self):
+        """
+        Get the directories holding remotefilelog file data packs, which edenfs
+        can read file contents from directly.
+
+        Returns an empty list if edenfs must ask us for all file contents.
+        """
+        if not hasattr(self.repo, "fileservice"):
+            return []
+        try:
+            # With lfs the packs hold pointers to the file contents rather than
+            # the contents themselves.
+            mercurial.extensions.find("lfs")
+            return []
+        except KeyError:
+            pass
+        return [
+            shallowutil.getlocalpackpath(
+                self.repo.svfs.vfs.base, constants.FILEPACK_CATEGORY
+            ),
+            shallowutil.getcachepackpath(self.repo, constants.FILEPACK_CATEGORY),
+        ]
+
     def debug(self, msg, *args, **kwargs):
         logging.debug(msg, *args, **kwargs)
 
@@ -481,6 +521,77 @@ class HgServer(object):
         length_data = struct.pack(b">Q", len(contents))
         self.send_chunk(request, contents, length_data)
 
+    @cmd(CMD_CAT_FILES)
+    def cmd_cat_files(self, request):
+        """CMD_CAT_FILES: get the contents of several files.
+
+        Request body format:
+        - <num_files><file>...
+          Fields:
+          - <num_files>: The number of files, as a 32-bit big-endian integer.
+          - <file>: <rev_hash><path_length><path>
+            - <rev_hash>: The file revision hash, as a 20-byte binary value.
+            - <path_length>: The length of <path>, as a 32-bit big-endian
+              integer.
+            - <path>: The file path, relative to the root of the repository.
+
+        Response format:
+        - One chunk per requested file, in the order the files were requested.
+          Every chunk except the last has FLAG_MORE_CHUNKS set.
+        - The body of each chunk uses the same format as a CMD_CAT_FILE
+          response.  If the file could not be read the chunk has
+          FLAG_ITEM_ERROR set instead, and contains the error information.
+        """
+        files = self._parse_cat_files_request(request.body)
+        self.debug("(pid:%s) getting contents of %d files", os.getpid(), len(files))
+        if not files:
+            self.send_chunk(request, b"")
+            return
+
+        # Fetch any files that are missing locally with as few round trips
+        # to the server as possible, rather than one at a time below.
+        if hasattr(self.repo, "fileservice"):
+            try:
+                self.repo.fileservice.prefetch(
+                    [(path, hex(rev_hash)) for rev_hash, path in files]
+                )
+            except Exception as ex:
+                logging.warning("error prefetching files for cat_files: %s", ex)
+
+        for n, (rev_hash, path) in enumerate(files):
+            is_last = n == len(files) - 1
+            try:
+                contents = self.get_file(path, rev_hash)
+            except ResetRepoError:
+                # Fail the whole request, so that edenfs restarts us.
+                raise
+            except Exception as ex:
+                logging.exception("error getting contents of file %r", path)
+                self.send_item_exception(request, ex, is_last=is_last)
+                continue
+            length_data = struct.pack(b">Q", len(contents))
+            self.send_chunk(request, contents, length_data, is_last=is_last)
+
+    def _parse_cat_files_request(self, body):
+        if len(body) < 4:
+            raise Exception("cat_files request data too short")
+        [num_files] = struct.unpack_from(b">I", body, 0)
+        offset = 4
+        files = []
+        for _ in range(num_files):
+            if len(body) < offset + SHA1_NUM_BYTES + 4:
+                raise Exception("cat_files request data too short")
+            rev_hash = body[offset : offset + SHA1_NUM_BYTES]
+            offset += SHA1_NUM_BYTES
+            [path_length] = struct.unpack_from(b">I", body, offset)
+            offset += 4
+            path = body[offset : offset + path_length]
+            if len(path) < path_length:
+                raise Exception("cat_files request data too short")
+            offset += path_length
+            files.append((rev_hash, path))
+        return files
+
     @cmd(CMD_MANIFEST_NODE_FOR_COMMIT)
     def cmd_manifest_node_for_commit(self, request):
         """
@@ -511,6 +622,32 @@ class HgServer(object):
 
         self.send_chunk(request, node)
 
+    @cmd(CMD_RESOLVE_COMMIT)
+    def cmd_resolve_commit(self, request):
+        """
+        Handler for CMD_RESOLVE_COMMIT requests.
+
+        Resolve a revision name, such as a bookmark, to the commit it
+        currently refers to.  The repository is re-read first, so that
+        bookmarks moved by a pull in another process are seen.
+
+        Request body format:
+        - Revision name (string)
+
+        Response body format:
+          The commit hash, a 20-byte binary value.
+        """
+        rev_name = request.body
+        self.debug("resolving commit for revision %r", rev_name)
+        self.repo.invalidate(clearfilecache=True)
+        try:
+            node = mercurial.scmutil.revsingle(self.repo, rev_name).node()
+        except mercurial.error.RepoError as ex:
+            self.send_exception(request, ex)
+            return
+
+        self.send_chunk(request, node)
+
     @cmd(CMD_FETCH_TREE)
     def cmd_fetch_tree(self, request):
         if len(request.body) < SHA1_NUM_BYTES:
@@ -579,12 +716,17 @@ class HgServer(object):
     def send_exception(self, request, exc):
         self.send_error(request, type(exc).__name__, str(exc))
 
-    def send_error(self, request, error_type, message):
-        txn_id = 0
-        if request is not None:
-            txn_id = request.txn_id
+    def send_item_exception(self, request, exc, is_last):
+        flags = FLAG_ITEM_ERROR
+        if not is_last:
+            flags |= FLAG_MORE_CHUNKS
+        data = self._encode_error(type(exc).__name__, str(exc))
+        self._send_chunk(
+            request.txn_id, command=CMD_RESPONSE, flags=flags, data_blocks=(data,)
+        )
 
-        data = b"".join(
+    def _encode_error(self, error_type, message):
+        return b"".join(
             [
                 struct.pack(b">I", len(error_type)),
                 error_type,
@@ -592,6 +734,13 @@ class HgServer(object):
                 message,
             ]
         )
+
+    def send_error(self, request, error_type, message):
+        txn_id = 0
+        if request is not None:
+            txn_id = request.txn_id
+
+        data = self._encode_error(error_type, message)
         self._send_chunk(
             txn_id, command=CMD_RESPONSE, flags=FLAG_ERROR, data_blocks=(data,)
         )
@@ -12,6 +12,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "eden/fs/model/Blob.h"
 #include "eden/fs/model/Tree.h"
 #include "eden/fs/store/MemoryLocalStore.h"
 #include "eden/fs/store/ObjectStore.h"
@@ -67,3 +68,46 @@ TEST_F(
       tree1->getEntryNames(),
       ::testing::ElementsAre(PathComponent{"foo"}, PathComponent{"src"}));
 }
+
+TEST_F(HgBackingStoreTest, getBlob_imports_file_contents) {
+  auto rootTree = objectStore.getTreeForCommit(commit1).get(0ms);
+  ASSERT_TRUE(rootTree);
+  auto fooTree =
+      objectStore.getTree(rootTree->getEntryAt("foo"_pc).getHash()).get(0ms);
+  ASSERT_TRUE(fooTree);
+
+  auto blob = backingStore
+                  ->getBlob(
+                      fooTree->getEntryAt("bar.txt"_pc).getHash(),
+                      ImportPriority::Foreground)
+                  .get(0ms);
+  ASSERT_TRUE(blob);
+  EXPECT_EQ("bar\n", blob->getContents().clone()->moveToFbString());
+}
+
+TEST_F(HgBackingStoreTest, getTreeForCommit_remembers_commits_in_memory) {
+  auto tree1 = backingStore->getTreeForCommit(commit1).get(0ms);
+  ASSERT_TRUE(tree1);
+
+  // The in-memory mapping answers without the HgCommitToTreeFamily entry,
+  // and without importing the commit again.
+  localStore->clearKeySpace(LocalStore::HgCommitToTreeFamily);
+  auto tree2 = backingStore->getTreeForCommit(commit1).get(0ms);
+  ASSERT_TRUE(tree2);
+  EXPECT_EQ(tree1->getHash(), tree2->getHash());
+  EXPECT_FALSE(
+      localStore->get(LocalStore::HgCommitToTreeFamily, commit1).isValid());
+}
+
+TEST_F(HgBackingStoreTest, prefetchCommitTrees_imports_bookmarked_commits) {
+  repo.hg("bookmark", "main");
+  backingStore->prefetchCommitTrees({"main", "no-such-bookmark"}).get(0ms);
+
+  auto result = localStore->get(LocalStore::HgCommitToTreeFamily, commit1);
+  ASSERT_TRUE(result.isValid());
+  auto rootTree = localStore->getTree(Hash{result.bytes()}).get(0ms);
+  ASSERT_TRUE(rootTree);
+  EXPECT_THAT(
+      rootTree->getEntryNames(),
+      ::testing::ElementsAre(PathComponent{"foo"}, PathComponent{"src"}));
+}
@@ -12,6 +12,7 @@
 #include <folly/test/TestUtils.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <thread>
 
 #include "eden/fs/model/Blob.h"
 #include "eden/fs/model/Hash.h"
@@ -20,6 +21,7 @@
 #include "eden/fs/store/MemoryLocalStore.h"
 #include "eden/fs/store/hg/HgImportPyError.h"
 #include "eden/fs/store/hg/HgImporter.h"
+#include "eden/fs/store/hg/HgImporterPool.h"
 #include "eden/fs/testharness/HgRepo.h"
 #include "eden/fs/testharness/TestUtil.h"
 #include "eden/fs/utils/PathFuncs.h"
@@ -205,6 +207,57 @@ TEST_P(HgImportTest, importTest) {
       "value not present in store");
 }
 
+TEST_P(HgImportTest, importFileContentsBatch) {
+  StringPiece aData = "contents of a\n";
+  StringPiece bData = "contents of b\n";
+  repo_.writeFile("a.txt", aData);
+  repo_.writeFile("b.txt", bData);
+  repo_.hg("add");
+  auto commit1 = repo_.commit("Initial commit");
+
+  HgImporter importer(repo_.path(), &localStore_);
+  auto rootTreeHash = importer.importFlatManifest(commit1.toString());
+  auto rootTree = localStore_.getTree(rootTreeHash).get(10s);
+  auto aHash = rootTree->getEntryAt("a.txt"_pc).getHash();
+  auto bHash = rootTree->getEntryAt("b.txt"_pc).getHash();
+  Hash noSuchHash = makeTestHash("123");
+
+  auto results =
+      importer.importFileContentsBatch({aHash, noSuchHash, bHash, aHash});
+  ASSERT_EQ(4, results.size());
+  EXPECT_BLOB_EQ(results[0].value(), aData);
+  EXPECT_THROW_RE(
+      results[1].value(), std::exception, "value not present in store");
+  EXPECT_BLOB_EQ(results[2].value(), bData);
+  EXPECT_BLOB_EQ(results[3].value(), aData);
+
+  // Requests made one at a time still work after a batch.
+  EXPECT_BLOB_EQ(importer.importFileContents(bHash), bData);
+}
+
+TEST_P(HgImportTest, importerPoolProvidesStartedImporters) {
+  StringPiece aData = "contents of a\n";
+  repo_.writeFile("a.txt", aData);
+  repo_.hg("add");
+  auto commit1 = repo_.commit("Initial commit");
+
+  HgImporterPool pool(
+      repo_.path(), &localStore_, folly::none, false, nullptr, 1);
+  std::unique_ptr<HgImporter> importer;
+  for (int attempt = 0; !importer && attempt < 300; ++attempt) {
+    importer = pool.tryTake();
+    if (!importer) {
+      /* sleep override */ std::this_thread::sleep_for(100ms);
+    }
+  }
+  ASSERT_TRUE(importer);
+
+  auto rootTreeHash = importer->importFlatManifest(commit1.toString());
+  auto rootTree = localStore_.getTree(rootTreeHash).get(10s);
+  auto aHash = rootTree->getEntryAt("a.txt"_pc).getHash();
+  EXPECT_BLOB_EQ(importer->importFileContents(aHash), aData);
+}
+
 INSTANTIATE_TEST_CASE_P(
     FlatManifest,
     HgImportTest,
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/hg/HgManifestImporter.h"
+
+#include <folly/Conv.h>
+#include <folly/futures/Future.h>
+#include <gtest/gtest.h>
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/model/TreeEntry.h"
+#include "eden/fs/store/MemoryLocalStore.h"
+#include "eden/fs/testharness/TestUtil.h"
+
+using namespace facebook::eden;
+
+namespace {
+// Manifest paths, in the order that mercurial sends them.
+const std::vector<folly::StringPiece> kManifestPaths = {
+    "README",
+    "docs/a.txt",
+    "docs/guide/b.txt",
+    "docs/guide/c.txt",
+    "docs/z.txt",
+    "src.txt",
+    "src/lib/x.cpp",
+    "src/lib/y.cpp",
+    "src/main.cpp",
+    "tools/build/run.sh",
+};
+
+Hash importManifest(LocalStore* store, size_t numWorkerThreads) {
+  auto writeBatch = store->beginWrite();
+  HgManifestImporter importer(store, writeBatch.get(), numWorkerThreads);
+  for (size_t n = 0; n < kManifestPaths.size(); ++n) {
+    RelativePathPiece path{kManifestPaths[n]};
+    importer.processEntry(
+        path.dirname(),
+        TreeEntry{makeTestHash(folly::to<std::string>(n + 1)),
+                  path.basename().stringPiece(),
+                  TreeEntryType::REGULAR_FILE});
+  }
+  return importer.finish();
+}
+} // namespace
+
+TEST(HgManifestImporter, workersProduceTheSameTrees) {
+  MemoryLocalStore serialStore;
+  auto serialRoot = importManifest(&serialStore, 0);
+
+  MemoryLocalStore parallelStore;
+  auto parallelRoot = importManifest(&parallelStore, 2);
+  EXPECT_EQ(serialRoot, parallelRoot);
+
+  auto rootTree = parallelStore.getTree(parallelRoot).get();
+  ASSERT_TRUE(rootTree);
+  std::vector<std::string> names;
+  for (const auto& entry : rootTree->getTreeEntries()) {
+    names.push_back(entry.getName().stringPiece().str());
+  }
+  EXPECT_EQ(
+      (std::vector<std::string>{"README", "docs", "src", "src.txt", "tools"}),
+      names);
+
+  // Every subtree was written to the store by the workers.
+  auto srcTree =
+      parallelStore.getTree(rootTree->getEntryAt("src"_pc).getHash()).get();
+  ASSERT_TRUE(srcTree);
+  auto libTree =
+      parallelStore.getTree(srcTree->getEntryAt("lib"_pc).getHash()).get();
+  ASSERT_TRUE(libTree);
+  EXPECT_EQ(2, libTree->getTreeEntries().size());
+}
+
+TEST(HgManifestImporter, directoriesSharingANamePrefixAreSeparate) {
+  MemoryLocalStore store;
+  auto writeBatch = store.beginWrite();
+  HgManifestImporter importer(&store, writeBatch.get());
+  // "ab/c" and "ab/cd" share a prefix that is not a whole directory name.
+  const std::vector<folly::StringPiece> paths = {
+      "ab/c/x", "ab/cd/e/y", "ab/cd/z", "abc/w"};
+  for (size_t n = 0; n < paths.size(); ++n) {
+    RelativePathPiece path{paths[n]};
+    importer.processEntry(
+        path.dirname(),
+        TreeEntry{makeTestHash(folly::to<std::string>(n + 1)),
+                  path.basename().stringPiece(),
+                  TreeEntryType::REGULAR_FILE});
+  }
+  auto root = store.getTree(importer.finish()).get();
+  ASSERT_TRUE(root);
+  EXPECT_EQ(2, root->getTreeEntries().size());
+
+  auto ab = store.getTree(root->getEntryAt("ab"_pc).getHash()).get();
+  ASSERT_TRUE(ab);
+  ASSERT_EQ(2, ab->getTreeEntries().size());
+  EXPECT_EQ("c", ab->getTreeEntries()[0].getName().stringPiece());
+  EXPECT_EQ("cd", ab->getTreeEntries()[1].getName().stringPiece());
+
+  auto cd = store.getTree(ab->getEntryAt("cd"_pc).getHash()).get();
+  ASSERT_TRUE(cd);
+  ASSERT_EQ(2, cd->getTreeEntries().size());
+  EXPECT_EQ("e", cd->getTreeEntries()[0].getName().stringPiece());
+  EXPECT_EQ("z", cd->getTreeEntries()[1].getName().stringPiece());
+  EXPECT_TRUE(store.getTree(root->getEntryAt("abc"_pc).getHash()).get());
+}
@@ -178,12 +178,21 @@ usecunionstore=True
   // Now test running prefetch
   // Build a list of file blob IDs to prefetch.
   auto rootTree = store.getTreeForCommit(commit2).get(10s);
-  auto srcTree =
-      store.getTree(rootTree->getEntryAt("src"_pc).getHash()).get(1s);
-  auto edenTree =
-      store.getTree(srcTree->getEntryAt("eden"_pc).getHash()).get(1s);
-  auto fooTree =
-      store.getTree(rootTree->getEntryAt("foo"_pc).getHash()).get(1s);
+  auto srcTree = store
+                     .getTree(
+                         rootTree->getEntryAt("src"_pc).getHash(),
+                         ImportPriority::Foreground)
+                     .get(1s);
+  auto edenTree = store
+                      .getTree(
+                          srcTree->getEntryAt("eden"_pc).getHash(),
+                          ImportPriority::Foreground)
+                      .get(1s);
+  auto fooTree = store
+                     .getTree(
+                         rootTree->getEntryAt("foo"_pc).getHash(),
+                         ImportPriority::Foreground)
+                     .get(1s);
 
   std::vector<Hash> blobHashes;
   blobHashes.push_back(edenTree->getEntryAt("main.py"_pc).getHash());
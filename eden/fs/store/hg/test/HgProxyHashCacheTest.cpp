@@ -0,0 +1,119 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/hg/HgProxyHashCache.h"
+
+#include <folly/futures/Future.h>
+#include <gtest/gtest.h>
+#include "eden/fs/store/MemoryLocalStore.h"
+#include "eden/fs/store/hg/HgProxyHash.h"
+#include "eden/fs/testharness/TestUtil.h"
+
+using namespace facebook::eden;
+
+TEST(HgProxyHashCache, returnsInsertedEntries) {
+  HgProxyHashCache cache{100};
+  auto id = makeTestHash("1");
+  auto revHash = makeTestHash("2");
+  EXPECT_FALSE(cache.get(id).hasValue());
+
+  cache.insert(id, "foo/bar/baz.txt"_relpath, revHash);
+  auto entry = cache.get(id);
+  ASSERT_TRUE(entry.hasValue());
+  EXPECT_EQ("foo/bar/baz.txt", entry->first.stringPiece());
+  EXPECT_EQ(revHash, entry->second);
+  EXPECT_EQ(1, cache.getHitCount());
+
+  cache.insert(makeTestHash("3"), "top.txt"_relpath, revHash);
+  EXPECT_EQ("top.txt", cache.get(makeTestHash("3"))->first.stringPiece());
+}
+
+TEST(HgProxyHashCache, sharesDirectoryNames) {
+  HgProxyHashCache cache{100};
+  cache.insert(makeTestHash("1"), "foo/bar/a.txt"_relpath, makeTestHash("a"));
+  cache.insert(makeTestHash("2"), "foo/bar/b.txt"_relpath, makeTestHash("b"));
+  cache.insert(makeTestHash("3"), "foo/c.txt"_relpath, makeTestHash("c"));
+  EXPECT_EQ(3, cache.size());
+  EXPECT_EQ(2, cache.getDirNameCount());
+  EXPECT_EQ("foo/bar/b.txt", cache.get(makeTestHash("2"))->first.stringPiece());
+}
+
+TEST(HgProxyHashCache, evictsLeastRecentlyUsedEntries) {
+  HgProxyHashCache cache{2};
+  cache.insert(makeTestHash("1"), "a"_relpath, makeTestHash("a"));
+  cache.insert(makeTestHash("2"), "b"_relpath, makeTestHash("b"));
+  EXPECT_TRUE(cache.get(makeTestHash("1")).hasValue());
+  cache.insert(makeTestHash("3"), "c"_relpath, makeTestHash("c"));
+
+  EXPECT_EQ(2, cache.size());
+  EXPECT_TRUE(cache.get(makeTestHash("1")).hasValue());
+  EXPECT_FALSE(cache.get(makeTestHash("2")).hasValue());
+  EXPECT_TRUE(cache.get(makeTestHash("3")).hasValue());
+}
+
+TEST(HgProxyHashCache, getBatchReadsMissingEntriesFromLocalStore) {
+  MemoryLocalStore store;
+  auto writeBatch = store.beginWrite();
+  auto storedID = HgProxyHash::store(
+      "dir/stored.txt"_relpath, makeTestHash("a"), writeBatch.get());
+  writeBatch->flush();
+
+  HgProxyHashCache cache{100};
+  auto cachedID = makeTestHash("1");
+  cache.insert(cachedID, "dir/cached.txt"_relpath, makeTestHash("b"));
+
+  auto results = cache.getBatch(&store, {cachedID, storedID}).get();
+  ASSERT_EQ(2, results.size());
+  EXPECT_EQ("dir/cached.txt", results[0].first.stringPiece());
+  EXPECT_EQ(makeTestHash("b"), results[0].second);
+  EXPECT_EQ("dir/stored.txt", results[1].first.stringPiece());
+  EXPECT_EQ(makeTestHash("a"), results[1].second);
+
+  // The entry read from the LocalStore is now cached too.
+  auto entry = cache.get(storedID);
+  ASSERT_TRUE(entry.hasValue());
+  EXPECT_EQ("dir/stored.txt", entry->first.stringPiece());
+}
+
+TEST(HgProxyHashCache, tracksWhichEntriesAreStored) {
+  HgProxyHashCache cache{100};
+  auto id1 = makeTestHash("1");
+  auto id2 = makeTestHash("2");
+  cache.insert(id1, "dir/one.txt"_relpath, makeTestHash("a"));
+  cache.insert(id2, "dir/two.txt"_relpath, makeTestHash("b"), true);
+  EXPECT_FALSE(cache.isStored(id1));
+  EXPECT_TRUE(cache.isStored(id2));
+  EXPECT_FALSE(cache.isStored(makeTestHash("3")));
+
+  cache.markStored({id1, makeTestHash("3")});
+  EXPECT_TRUE(cache.isStored(id1));
+  EXPECT_FALSE(cache.isStored(makeTestHash("3")));
+
+  // Inserting a known entry again does not forget that it is stored.
+  cache.insert(id2, "dir/two.txt"_relpath, makeTestHash("b"));
+  EXPECT_TRUE(cache.isStored(id2));
+}
+
+TEST(HgProxyHashCache, entriesReadFromLocalStoreAreStored) {
+  MemoryLocalStore store;
+  auto writeBatch = store.beginWrite();
+  auto storedID = HgProxyHash::store(
+      "dir/stored.txt"_relpath, makeTestHash("a"), writeBatch.get());
+  writeBatch->flush();
+
+  HgProxyHashCache cache{100};
+  cache.getBatch(&store, {storedID}).get();
+  EXPECT_TRUE(cache.isStored(storedID));
+}
+
+TEST(HgProxyHashCache, getBatchFailsForUnknownHashes) {
+  MemoryLocalStore store;
+  HgProxyHashCache cache{100};
+  EXPECT_ANY_THROW(cache.getBatch(&store, {makeTestHash("1")}).get());
+}
@@ -16,11 +16,17 @@
 #include <folly/io/Cursor.h>
 #include <folly/logging/Init.h>
 #include <folly/logging/xlog.h>
+#include <folly/stop_watch.h>
 #include <gflags/gflags.h>
 #include <rocksdb/db.h>
 #include <rocksdb/utilities/options_util.h>
+#include <sys/resource.h>
 #include <sysexits.h>
+#include <deque>
+#include <limits>
+#include <thread>
 
+#include "eden/fs/model/Blob.h"
 #include "eden/fs/model/Tree.h"
 #include "eden/fs/store/RocksDbLocalStore.h"
 #include "eden/fs/store/hg/HgImporter.h"
@@ -47,6 +53,29 @@ DEFINE_bool(
     true,
     "Recursively import all trees under the specified subdirectory when "
     "performing a treemanifest import");
+DEFINE_string(
+    benchmark,
+    "",
+    "Measure import throughput rather than importing once: \"manifest\" "
+    "imports the whole manifest of --rev, and \"trees\" or \"blobs\" "
+    "import --benchmark_count objects from it on --num_hg_import_threads "
+    "threads");
+DEFINE_int32(
+    benchmark_count,
+    10000,
+    "Number of trees or blobs to import with --benchmark");
+DEFINE_int32(
+    blob_batch_size,
+    100,
+    "Number of blobs to request at once with --benchmark=blobs.  1 requests "
+    "each blob separately.");
+DEFINE_int32(
+    round_trips,
+    200,
+    "Number of cheap requests to time with --benchmark, to measure the round "
+    "trip to the helper process");
+
+DECLARE_int32(num_hg_import_threads);
 
 using namespace facebook::eden;
 using namespace std::chrono_literals;
@@ -157,6 +186,264 @@ int importTree(
   return EX_OK;
 }
 #endif // EDEN_HAVE_HG_TREEMANIFEST
+
+Hash importRootManifest(HgImporter& importer, StringPiece revName) {
+#if EDEN_HAVE_HG_TREEMANIFEST
+  if (FLAGS_import_type == "tree") {
+    return importer.importTreeManifest(revName);
+  }
+#endif // EDEN_HAVE_HG_TREEMANIFEST
+  return importer.importFlatManifest(revName);
+}
+
+double getCpuSeconds(int who) {
+  struct rusage usage;
+  getrusage(who, &usage);
+  auto seconds = [](const struct timeval& tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+  };
+  return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+}
+
+/**
+ * The CPU time of helper processes that have exited.
+ *
+ * Each HgImporter waits for its helper process when it is destroyed, so the
+ * helpers' CPU time can be measured by destroying their importers.
+ */
+double getHelperCpuSeconds() {
+  return getCpuSeconds(RUSAGE_CHILDREN);
+}
+
+/**
+ * The trees and blobs of a manifest, found breadth first.
+ */
+struct ManifestObjects {
+  std::vector<Hash> trees;
+  std::vector<Hash> blobs;
+};
+
+ManifestObjects findObjects(
+    HgImporter& importer,
+    LocalStore& store,
+    Hash rootHash,
+    size_t count) {
+  ManifestObjects objects;
+  std::deque<Hash> queue{rootHash};
+  while (!queue.empty() &&
+         (objects.trees.size() < count || objects.blobs.size() < count)) {
+    auto hash = queue.front();
+    queue.pop_front();
+    auto tree = store.getTree(hash).get();
+    if (!tree) {
+      tree = importer.importTree(hash);
+    }
+    for (const auto& entry : tree->getTreeEntries()) {
+      if (entry.isTree()) {
+        queue.push_back(entry.getHash());
+        if (objects.trees.size() < count) {
+          objects.trees.push_back(entry.getHash());
+        }
+      } else if (objects.blobs.size() < count) {
+        objects.blobs.push_back(entry.getHash());
+      }
+    }
+  }
+  return objects;
+}
+
+struct ImportCounts {
+  size_t objects{0};
+  size_t bytes{0};
+  size_t errors{0};
+};
+
+/**
+ * Import objects with one HgImporter per thread, and report the throughput
+ * and the CPU time spent in edenfs and in the helper processes.
+ * importShard(importer, shard, numShards, counts) imports every
+ * numShards'th object, starting at the shard'th.
+ */
+template <typename ImportShard>
+void runImportThreads(
+    StringPiece name,
+    AbsolutePathPiece repoPath,
+    LocalStore* store,
+    double helperStartupCpu,
+    ImportShard&& importShard) {
+  const size_t numThreads = std::max(1, FLAGS_num_hg_import_threads);
+  std::vector<std::unique_ptr<HgImporter>> importers;
+  for (size_t n = 0; n < numThreads; ++n) {
+    importers.push_back(std::make_unique<HgImporter>(repoPath, store));
+  }
+  std::vector<ImportCounts> counts(numThreads);
+
+  auto helperCpuBefore = getHelperCpuSeconds();
+  auto selfCpuBefore = getCpuSeconds(RUSAGE_SELF);
+  folly::stop_watch<> timer;
+  std::vector<std::thread> threads;
+  for (size_t n = 0; n < numThreads; ++n) {
+    threads.emplace_back(
+        [&, n] { importShard(*importers[n], n, numThreads, counts[n]); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(
+          timer.elapsed())
+          .count();
+  auto selfCpu = getCpuSeconds(RUSAGE_SELF) - selfCpuBefore;
+  importers.clear();
+  auto helperCpu = std::max(
+      0.0,
+      getHelperCpuSeconds() - helperCpuBefore - numThreads * helperStartupCpu);
+
+  ImportCounts total;
+  for (const auto& threadCounts : counts) {
+    total.objects += threadCounts.objects;
+    total.bytes += threadCounts.bytes;
+    total.errors += threadCounts.errors;
+  }
+  printf(
+      "%s: %zu imported, %zu errors, %zu threads, %.2fs\n"
+      "  %.1f objects/s, %.2f MB/s\n"
+      "  edenfs CPU %.2fs, helper CPU %.2fs (%.1f us/object)\n",
+      name.str().c_str(),
+      total.objects,
+      total.errors,
+      numThreads,
+      seconds,
+      total.objects / seconds,
+      total.bytes / seconds / (1024 * 1024),
+      selfCpu,
+      helperCpu,
+      total.objects ? helperCpu * 1e6 / total.objects : 0.0);
+}
+
+int runBenchmark(
+    AbsolutePathPiece repoPath,
+    LocalStore* store,
+    StringPiece revName) {
+  // The CPU time the helper spends starting up and shutting down, which is
+  // subtracted from the measurements below.
+  auto helperCpuBefore = getHelperCpuSeconds();
+  {
+    HgImporter idle(repoPath, store);
+  }
+  auto helperStartupCpu = getHelperCpuSeconds() - helperCpuBefore;
+  printf("helper startup CPU: %.2fs\n", helperStartupCpu);
+
+  HgImporter importer(repoPath, store);
+  folly::stop_watch<> roundTripTimer;
+  for (int n = 0; n < FLAGS_round_trips; ++n) {
+    importer.resolveManifestNode(revName);
+  }
+  if (FLAGS_round_trips > 0) {
+    printf(
+        "round trip (manifest node lookup): %.1f us\n",
+        std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(
+            roundTripTimer.elapsed())
+                .count() /
+            FLAGS_round_trips);
+  }
+
+  folly::stop_watch<> manifestTimer;
+  auto rootHash = importRootManifest(importer, revName);
+  auto manifestSeconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(
+          manifestTimer.elapsed())
+          .count();
+  if (FLAGS_benchmark == "manifest") {
+    auto objects = findObjects(
+        importer, *store, rootHash, std::numeric_limits<size_t>::max());
+    printf(
+        "manifest: %zu trees, %zu files, %.2fs, %.1f trees/s\n",
+        objects.trees.size() + 1,
+        objects.blobs.size(),
+        manifestSeconds,
+        (objects.trees.size() + 1) / manifestSeconds);
+    return EX_OK;
+  }
+
+  auto objects = findObjects(importer, *store, rootHash, FLAGS_benchmark_count);
+  if (FLAGS_benchmark == "trees") {
+    runImportThreads(
+        "trees",
+        repoPath,
+        store,
+        helperStartupCpu,
+        [&](HgImporter& threadImporter,
+            size_t shard,
+            size_t numShards,
+            ImportCounts& counts) {
+          for (size_t n = shard; n < objects.trees.size(); n += numShards) {
+            try {
+              auto tree = threadImporter.importTree(objects.trees[n]);
+              ++counts.objects;
+              // Count the size of the manifest entries.
+              for (const auto& entry : tree->getTreeEntries()) {
+                counts.bytes +=
+                    entry.getName().stringPiece().size() + Hash::RAW_SIZE;
+              }
+            } catch (const std::exception&) {
+              ++counts.errors;
+            }
+          }
+        });
+  } else if (FLAGS_benchmark == "blobs") {
+    const size_t batchSize = std::max(1, FLAGS_blob_batch_size);
+    runImportThreads(
+        "blobs",
+        repoPath,
+        store,
+        helperStartupCpu,
+        [&](HgImporter& threadImporter,
+            size_t shard,
+            size_t numShards,
+            ImportCounts& counts) {
+          std::vector<Hash> batch;
+          auto importBatch = [&] {
+            if (batch.size() == 1) {
+              try {
+                auto blob = threadImporter.importFileContents(batch[0]);
+                ++counts.objects;
+                counts.bytes += blob->getContents().computeChainDataLength();
+              } catch (const std::exception&) {
+                ++counts.errors;
+              }
+            } else if (!batch.empty()) {
+              for (auto& result :
+                   threadImporter.importFileContentsBatch(batch)) {
+                if (result.hasValue()) {
+                  ++counts.objects;
+                  counts.bytes +=
+                      result.value()->getContents().computeChainDataLength();
+                } else {
+                  ++counts.errors;
+                }
+              }
+            }
+            batch.clear();
+          };
+          for (size_t n = shard; n < objects.blobs.size(); n += numShards) {
+            batch.push_back(objects.blobs[n]);
+            if (batch.size() >= batchSize) {
+              importBatch();
+            }
+          }
+          importBatch();
+        });
+  } else {
+    fprintf(
+        stderr,
+        "error: unknown benchmark \"%s\"; must be \"manifest\", "
+        "\"trees\" or \"blobs\"\n",
+        FLAGS_benchmark.c_str());
+    return EX_USAGE;
+  }
+  return EX_OK;
+}
 } // namespace
 
 int main(int argc, char* argv[]) {
@@ -191,6 +478,10 @@ int main(int argc, char* argv[]) {
 
   RocksDbLocalStore store(rocksPath);
 
+  if (!FLAGS_benchmark.empty()) {
+    return runBenchmark(repoPath, &store, revName);
+  }
+
   int returnCode = EX_OK;
   if (FLAGS_import_type == "flat") {
     HgImporter importer(repoPath, &store);
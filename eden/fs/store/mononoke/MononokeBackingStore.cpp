@@ -12,16 +12,23 @@
 #include <eden/fs/model/Blob.h>
 #include <eden/fs/model/Hash.h>
 #include <eden/fs/model/Tree.h>
+#include <eden/fs/store/StoreStats.h>
+#include <folly/Conv.h>
 #include <folly/futures/Future.h>
 #include <folly/futures/Promise.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/io/async/EventBaseManager.h>
 #include <folly/io/async/SSLOptions.h>
 #include <folly/json.h>
+#include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
 #include <proxygen/lib/http/HTTPConnector.h>
 #include <proxygen/lib/http/session/HTTPUpstreamSession.h>
 #include <proxygen/lib/utils/URL.h>
 #include <servicerouter/client/cpp2/ServiceRouter.h>
+#include <algorithm>
+#include <cctype>
+#include <deque>
 
 using folly::Future;
 using folly::IOBuf;
@@ -32,37 +39,190 @@ using proxygen::HTTPException;
 using proxygen::HTTPHeaders;
 using proxygen::HTTPMessage;
 using proxygen::HTTPTransaction;
+using proxygen::HTTPUpstreamSession;
 using proxygen::UpgradeProtocol;
 using proxygen::URL;
 
+DEFINE_bool(
+    mononoke_http2,
+    true,
+    "Offer HTTP/2 when connecting to the Mononoke API server over TLS, so "
+    "that one connection can carry many requests at once");
+
+DEFINE_int32(
+    mononoke_connections_per_thread,
+    4,
+    "The maximum number of connections to the Mononoke API server that each "
+    "IO thread keeps open");
+
+DEFINE_int32(
+    mononoke_max_requests_per_thread,
+    64,
+    "The maximum number of Mononoke requests that each IO thread has "
+    "outstanding at once.  Further requests wait for one of these to finish.");
+
+DEFINE_int32(
+    mononoke_request_retries,
+    2,
+    "The number of times to retry a Mononoke request that failed because of a "
+    "connection problem or a server error");
+
+DEFINE_int32(
+    mononoke_retry_delay,
+    100, // msec
+    "[unit: ms] How long to wait before the first retry of a failed Mononoke "
+    "request.  This doubles for each subsequent retry.");
+
 namespace facebook {
 namespace eden {
 namespace {
 
 using IOBufPromise = folly::Promise<std::unique_ptr<folly::IOBuf>>;
 
-// Callback that processes response for getblob request.
-// Note: because this callback deletes itself, it must be allocated on the heap!
-class MononokeCallback : public proxygen::HTTPConnector::Callback,
-                         public proxygen::HTTPTransaction::Handler {
+/**
+ * The error that a request fails with when it could not be completed.
+ *
+ * Connection problems, timeouts and 5xx responses are retryable, since
+ * another attempt may well succeed.  Other error responses, such as a 404 for
+ * an unknown object, are not.
+ */
+class MononokeRequestError : public std::runtime_error {
+ public:
+  template <typename... Args>
+  explicit MononokeRequestError(bool retryable, Args&&... args)
+      : std::runtime_error(folly::to<std::string>(std::forward<Args>(args)...)),
+        retryable_(retryable) {}
+
+  bool isRetryable() const {
+    return retryable_;
+  }
+
+ private:
+  bool retryable_;
+};
+
+} // namespace
+
+/**
+ * Consumes the body of a successful response as it arrives, so that large
+ * responses are parsed while they are still being received rather than
+ * being held in memory until the last byte arrives.
+ *
+ * onData() is called on the EventBase thread that runs the request.  It may
+ * throw to reject a malformed response.
+ */
+class MononokeBodyParser {
+ public:
+  virtual ~MononokeBodyParser() {}
+
+  /**
+   * Discard any state from an earlier attempt at the request.
+   */
+  virtual void reset() = 0;
+  virtual void onData(const folly::IOBuf& chunk) = 0;
+};
+
+/**
+ * The connections to the Mononoke API server used by one EventBase.
+ *
+ * Requests are queued until there is both a connection that can accept
+ * another transaction and room under --mononoke_max_requests_per_thread.  A
+ * new connection is opened only when the queued requests cannot be sent on
+ * the existing ones, up to --mononoke_connections_per_thread.  An HTTP/2
+ * connection accepts as many concurrent streams as the server allows, so in
+ * that case one connection is normally all that is needed.
+ *
+ * All methods must be called on eventBase_'s thread.  The pool does not refer
+ * to the MononokeBackingStore that created it, since EventBaseLocal may
+ * destroy it after the store has gone away.
+ */
+class MononokeSessionPool : public proxygen::HTTPSessionBase::InfoCallback,
+                            private folly::EventBase::LoopCallback {
+ public:
+  MononokeSessionPool(
+      folly::EventBase* eventBase,
+      folly::Optional<folly::SocketAddress> socketAddress,
+      std::shared_ptr<folly::SSLContext> sslContext,
+      std::chrono::milliseconds timeout);
+  ~MononokeSessionPool() override;
+
+  /**
+   * Send a GET request for url.  The returned future fails with a
+   * MononokeRequestError if the request could not be completed.
+   */
+  Future<std::unique_ptr<IOBuf>> send(
+      const URL& url,
+      std::shared_ptr<MononokeBodyParser> parser);
+
+  /**
+   * Called by the transaction handler once its transaction has finished.
+   */
+  void transactionDone();
+
+  void onDestroy(const proxygen::HTTPSessionBase& session) override;
+
+ private:
+  class Connection;
+  struct PendingRequest {
+    URL url;
+    std::shared_ptr<MononokeBodyParser> parser;
+    IOBufPromise promise;
+  };
+
+  MononokeSessionPool(const MononokeSessionPool&) = delete;
+  MononokeSessionPool& operator=(const MononokeSessionPool&) = delete;
+
+  void runLoopCallback() noexcept override;
+  void scheduleDispatch();
+  void dispatch();
+  HTTPUpstreamSession* findAvailableSession() const;
+  void startTransaction(HTTPUpstreamSession* session, PendingRequest&& request);
+
+  Future<folly::SocketAddress> getAddress();
+  void connect();
+  void connectSucceeded(Connection* connection, HTTPUpstreamSession* session);
+  void connectFailed(Connection* connection, folly::exception_wrapper error);
+  void finishConnecting(Connection* connection);
+
+  folly::EventBase* const eventBase_;
+  const folly::Optional<folly::SocketAddress> socketAddress_;
+  const std::shared_ptr<folly::SSLContext> sslContext_;
+  const std::chrono::milliseconds timeout_;
+  const size_t maxSessions_;
+  const size_t maxTransactions_;
+  folly::HHWheelTimer::UniquePtr timer_;
+
+  std::vector<HTTPUpstreamSession*> sessions_;
+  std::vector<std::unique_ptr<Connection>> connecting_;
+  // Connection attempts that have finished.  These are destroyed from
+  // runLoopCallback(), since their HTTPConnector is still on the stack when
+  // they report the result.
+  std::vector<std::unique_ptr<Connection>> finished_;
+  std::deque<PendingRequest> queue_;
+  size_t numTransactions_{0};
+  bool closing_{false};
+  // Set when the pool is destroyed, for the benefit of address lookups that
+  // are still in progress.
+  std::shared_ptr<bool> destroyed_{std::make_shared<bool>(false)};
+};
+
+namespace {
+
+// Handles the response to a single request.
+// Note: because this handler deletes itself, it must be allocated on the heap!
+class MononokeCallback : public proxygen::HTTPTransaction::Handler {
  public:
-  MononokeCallback(const proxygen::URL& url, IOBufPromise&& promise)
-      : promise_(std::move(promise)), url_(url) {}
-
-  virtual void connectSuccess(proxygen::HTTPUpstreamSession* session) override {
-    auto txn = session->newTransaction(this);
-    HTTPMessage message;
-    message.setMethod(proxygen::HTTPMethod::GET);
-    message.setURL(url_.makeRelativeURL());
-    txn->sendHeaders(message);
-    txn->sendEOM();
-    session->closeWhenIdle();
-  }
-
-  void connectError(const folly::AsyncSocketException& /* ex */) override {
-    // handler won't be used anymore, should be safe to delete
-    promise_.setException(
-        make_exception_wrapper<std::runtime_error>("connect error"));
+  MononokeCallback(
+      MononokeSessionPool* pool,
+      std::shared_ptr<MononokeBodyParser> parser,
+      IOBufPromise&& promise)
+      : pool_(pool), parser_(std::move(parser)), promise_(std::move(promise)) {}
+
+  /**
+   * Fail the request without it ever having been attached to a transaction.
+   */
+  void abort(folly::exception_wrapper error) {
+    promise_.setException(std::move(error));
     delete this;
   }
 
@@ -81,15 +241,15 @@ class MononokeCallback : public proxygen::HTTPConnector::Callback,
       if (isSuccessfulStatusCode()) {
         promise_.setValue(std::move(body_));
       } else {
-        auto error_msg = folly::to<std::string>(
+        promise_.setException(make_exception_wrapper<MononokeRequestError>(
+            isServerError(),
             "request failed: ",
             status_code_,
             ", ",
-            body_ ? body_->moveToFbString() : "");
-        promise_.setException(
-            make_exception_wrapper<std::runtime_error>(error_msg));
+            body_ ? body_->moveToFbString() : ""));
       }
     }
+    pool_->transactionDone();
 
     /*
     From proxygen source code comments (HTTPTransaction.h):
@@ -101,18 +261,29 @@ class MononokeCallback : public proxygen::HTTPConnector::Callback,
     */
     delete this;
   }
-
   void onHeadersComplete(std::unique_ptr<HTTPMessage> msg) noexcept override {
     status_code_ = msg->getStatusCode();
   }
 
   void onBody(std::unique_ptr<folly::IOBuf> chain) noexcept override {
+    if (parser_ && isSuccessfulStatusCode()) {
+      if (!error_) {
+        try {
+          parser_->onData(*chain);
+        } catch (const std::exception& ex) {
+          error_ = make_exception_wrapper<MononokeRequestError>(
+              false, "malformed mononoke response: ", ex.what());
+        }
+      }
+      return;
+    }
+
     if (!body_) {
-      body_.swap(chain);
-      last_ = body_->next();
+      body_ = std::move(chain);
     } else {
-      last_->appendChain(std::move(chain));
-      last_ = last_->next();
+      // Keep the buffers that proxygen handed us rather than copying them
+      // into one, so that a blob can take ownership of the chain as is.
+      body_->prependChain(std::move(chain));
     }
   }
 
@@ -129,7 +300,7 @@ class MononokeCallback : public proxygen::HTTPConnector::Callback,
 
   void onError(const HTTPException& error) noexcept override {
     auto exception =
-        make_exception_wrapper<std::runtime_error>(error.describe());
+        make_exception_wrapper<MononokeRequestError>(true, error.describe());
     error_.swap(exception);
   }
 
@@ -147,50 +318,417 @@ class MononokeCallback : public proxygen::HTTPConnector::Callback,
     return (status_code_ / 100) == 2;
   }
 
+  bool isServerError() {
+    return (status_code_ / 100) == 5;
+  }
+
+  MononokeSessionPool* pool_;
+  const std::shared_ptr<MononokeBodyParser> parser_;
   IOBufPromise promise_;
-  proxygen::URL url_;
-  Hash hash_;
-  std::string repo_;
   uint16_t status_code_{0};
   std::unique_ptr<folly::IOBuf> body_{nullptr};
-  // Pointer to the last IOBuf in a chain
-  folly::IOBuf* last_{nullptr};
   folly::exception_wrapper error_{nullptr};
 };
 
-std::unique_ptr<Tree> convertBufToTree(
-    std::unique_ptr<folly::IOBuf>&& buf,
-    const Hash& id) {
-  auto s = buf->moveToFbString();
-  auto parsed = folly::parseJson(s);
-  if (!parsed.isArray()) {
-    throw std::runtime_error("malformed json: should be array");
-  }
-
-  std::vector<TreeEntry> entries;
-  for (auto i = parsed.begin(); i != parsed.end(); ++i) {
-    auto name = i->at("name").asString();
-    auto hash = Hash(i->at("hash").asString());
-    auto str_type = i->at("type").asString();
-    TreeEntryType file_type;
-    if (str_type == "file") {
-      file_type = TreeEntryType::REGULAR_FILE;
-    } else if (str_type == "tree") {
-      file_type = TreeEntryType::TREE;
-    } else if (str_type == "executable") {
-      file_type = TreeEntryType::EXECUTABLE_FILE;
-    } else if (str_type == "symlink") {
-      file_type = TreeEntryType::SYMLINK;
-    } else {
-      throw std::runtime_error("unknown file type");
+TreeEntry parseTreeEntry(const folly::dynamic& entry) {
+  auto name = entry.at("name").asString();
+  auto hash = Hash(entry.at("hash").asString());
+  auto str_type = entry.at("type").asString();
+  TreeEntryType file_type;
+  if (str_type == "file") {
+    file_type = TreeEntryType::REGULAR_FILE;
+  } else if (str_type == "tree") {
+    file_type = TreeEntryType::TREE;
+  } else if (str_type == "executable") {
+    file_type = TreeEntryType::EXECUTABLE_FILE;
+  } else if (str_type == "symlink") {
+    file_type = TreeEntryType::SYMLINK;
+  } else {
+    throw std::runtime_error("unknown file type");
+  }
+
+  // Newer servers also report the size and SHA-1 of files.
+  folly::Optional<uint64_t> size;
+  folly::Optional<Hash> contentSha1;
+  auto sizeField = entry.get_ptr("size");
+  if (sizeField && !sizeField->isNull()) {
+    size = static_cast<uint64_t>(sizeField->asInt());
+  }
+  auto sha1Field = entry.get_ptr("content_sha1");
+  if (sha1Field && !sha1Field->isNull()) {
+    contentSha1 = Hash(sha1Field->asString());
+  }
+  return TreeEntry(hash, name, file_type, size, contentSha1);
+}
+
+/**
+ * Parses a tree response, a JSON array of entry objects, as it arrives.
+ *
+ * Only the text of the entry currently being received is buffered: each
+ * entry is parsed as soon as its closing brace arrives, so the full JSON
+ * text is never held in memory alongside the parsed entries.
+ */
+class TreeParser : public MononokeBodyParser {
+ public:
+  void reset() override {
+    entries_.clear();
+    entryText_.clear();
+    depth_ = 0;
+    inString_ = false;
+    escaped_ = false;
+    done_ = false;
+  }
+
+  void onData(const folly::IOBuf& chunk) override {
+    for (auto range : chunk) {
+      for (auto byte : range) {
+        consume(static_cast<char>(byte));
+      }
+    }
+  }
+
+  std::unique_ptr<Tree> finish(const Hash& id) {
+    if (!done_) {
+      throw std::runtime_error("malformed json: truncated tree");
+    }
+    return std::make_unique<Tree>(std::move(entries_), id);
+  }
+
+ private:
+  void consume(char c) {
+    if (depth_ > 1) {
+      // Inside an entry.
+      entryText_.push_back(c);
+      if (inString_) {
+        if (escaped_) {
+          escaped_ = false;
+        } else if (c == '\\') {
+          escaped_ = true;
+        } else if (c == '"') {
+          inString_ = false;
+        }
+      } else if (c == '"') {
+        inString_ = true;
+      } else if (c == '{' || c == '[') {
+        ++depth_;
+      } else if (c == '}' || c == ']') {
+        if (--depth_ == 1) {
+          entries_.push_back(parseTreeEntry(folly::parseJson(entryText_)));
+          entryText_.clear();
+        }
+      }
+      return;
     }
-    entries.push_back(TreeEntry(hash, name, file_type));
+
+    if (isspace(static_cast<unsigned char>(c))) {
+      return;
+    }
+    if (done_) {
+      throw std::runtime_error("malformed json: data after the tree");
+    } else if (depth_ == 0) {
+      if (c != '[') {
+        throw std::runtime_error("malformed json: should be array");
+      }
+      depth_ = 1;
+    } else if (c == '{') {
+      entryText_.push_back(c);
+      depth_ = 2;
+    } else if (c == ']') {
+      depth_ = 0;
+      done_ = true;
+    } else if (c != ',') {
+      throw std::runtime_error("malformed json: tree entries must be objects");
+    }
+  }
+
+  std::vector<TreeEntry> entries_;
+  std::string entryText_;
+  size_t depth_{0};
+  bool inString_{false};
+  bool escaped_{false};
+  bool done_{false};
+};
+
+void offerHttp2(folly::SSLContext* sslContext) {
+#if FOLLY_OPENSSL_HAS_ALPN
+  if (sslContext && FLAGS_mononoke_http2) {
+    // HTTPConnector picks the codec for whichever protocol the server chooses.
+    sslContext->setAdvertisedNextProtocols({"h2", "http/1.1"});
   }
-  return std::make_unique<Tree>(std::move(entries), id);
+#else
+  (void)sslContext;
+#endif
 }
 
 } // namespace
 
+/**
+ * One attempt to open a connection for a MononokeSessionPool.
+ */
+class MononokeSessionPool::Connection
+    : public proxygen::HTTPConnector::Callback {
+ public:
+  Connection(MononokeSessionPool* pool, folly::HHWheelTimer* timer)
+      : pool_(pool), connector_(this, timer) {}
+
+  void start(
+      folly::EventBase* eventBase,
+      const folly::SocketAddress& addr,
+      const std::shared_ptr<folly::SSLContext>& sslContext,
+      std::chrono::milliseconds timeout) {
+    const folly::AsyncSocket::OptionMap opts{{{SOL_SOCKET, SO_REUSEADDR}, 1}};
+    if (sslContext != nullptr) {
+      connector_.connectSSL(
+          eventBase, addr, sslContext, nullptr, timeout, opts);
+    } else {
+      connector_.connect(eventBase, addr, timeout, opts);
+    }
+  }
+
+  void connectSuccess(HTTPUpstreamSession* session) override {
+    pool_->connectSucceeded(this, session);
+  }
+
+  void connectError(const folly::AsyncSocketException& ex) override {
+    pool_->connectFailed(
+        this,
+        make_exception_wrapper<MononokeRequestError>(
+            true, "connect error: ", ex.what()));
+  }
+
+ private:
+  MononokeSessionPool* pool_;
+  proxygen::HTTPConnector connector_;
+};
+
+MononokeSessionPool::MononokeSessionPool(
+    folly::EventBase* eventBase,
+    folly::Optional<folly::SocketAddress> socketAddress,
+    std::shared_ptr<folly::SSLContext> sslContext,
+    std::chrono::milliseconds timeout)
+    : eventBase_(eventBase),
+      socketAddress_(std::move(socketAddress)),
+      sslContext_(std::move(sslContext)),
+      timeout_(timeout),
+      maxSessions_(std::max(FLAGS_mononoke_connections_per_thread, 1)),
+      maxTransactions_(std::max(FLAGS_mononoke_max_requests_per_thread, 1)),
+      timer_(folly::HHWheelTimer::newTimer(
+          eventBase,
+          std::chrono::milliseconds(
+              folly::HHWheelTimer::DEFAULT_TICK_INTERVAL),
+          folly::AsyncTimeout::InternalEnum::NORMAL,
+          timeout)) {}
+
+MononokeSessionPool::~MononokeSessionPool() {
+  closing_ = true;
+  *destroyed_ = true;
+  // Dropping the connections fails their outstanding transactions, which
+  // calls transactionDone() while we are still intact.
+  auto sessions = std::move(sessions_);
+  for (auto* session : sessions) {
+    session->setInfoCallback(nullptr);
+    session->dropConnection();
+  }
+  for (auto& request : queue_) {
+    request.promise.setException(make_exception_wrapper<MononokeRequestError>(
+        false, "mononoke connection pool destroyed"));
+  }
+}
+
+Future<std::unique_ptr<IOBuf>> MononokeSessionPool::send(
+    const URL& url,
+    std::shared_ptr<MononokeBodyParser> parser) {
+  IOBufPromise promise;
+  auto future = promise.getFuture();
+  queue_.push_back(
+      PendingRequest{url, std::move(parser), std::move(promise)});
+  dispatch();
+  return future;
+}
+
+void MononokeSessionPool::transactionDone() {
+  --numTransactions_;
+  if (!closing_) {
+    // Don't start the next transaction from inside this one's callbacks.
+    scheduleDispatch();
+  }
+}
+
+void MononokeSessionPool::onDestroy(const proxygen::HTTPSessionBase& session) {
+  sessions_.erase(
+      std::remove_if(
+          sessions_.begin(),
+          sessions_.end(),
+          [&](HTTPUpstreamSession* s) {
+            return static_cast<const proxygen::HTTPSessionBase*>(s) ==
+                &session;
+          }),
+      sessions_.end());
+  // Any queued requests may need a new connection now.
+  scheduleDispatch();
+}
+
+void MononokeSessionPool::runLoopCallback() noexcept {
+  finished_.clear();
+  dispatch();
+}
+
+void MononokeSessionPool::scheduleDispatch() {
+  if (!isLoopCallbackScheduled()) {
+    eventBase_->runInLoop(this);
+  }
+}
+
+void MononokeSessionPool::dispatch() {
+  while (!queue_.empty() && numTransactions_ < maxTransactions_) {
+    auto* session = findAvailableSession();
+    if (!session) {
+      break;
+    }
+    auto request = std::move(queue_.front());
+    queue_.pop_front();
+    startTransaction(session, std::move(request));
+  }
+
+  // Open more connections if the existing ones are all busy and the
+  // connections we are already opening will not be enough for the queue.
+  if (queue_.empty() || numTransactions_ >= maxTransactions_) {
+    return;
+  }
+  auto numOpen = sessions_.size() + connecting_.size();
+  if (numOpen >= maxSessions_ || connecting_.size() >= queue_.size()) {
+    return;
+  }
+  auto numToOpen =
+      std::min(maxSessions_ - numOpen, queue_.size() - connecting_.size());
+  for (size_t n = 0; n < numToOpen; ++n) {
+    connect();
+  }
+}
+
+HTTPUpstreamSession* MononokeSessionPool::findAvailableSession() const {
+  for (auto* session : sessions_) {
+    if (session->isReusable() && session->supportsMoreTransactions()) {
+      return session;
+    }
+  }
+  return nullptr;
+}
+
+void MononokeSessionPool::startTransaction(
+    HTTPUpstreamSession* session,
+    PendingRequest&& request) {
+  // MononokeCallback deletes itself - see detachTransaction() method
+  auto* callback = new MononokeCallback(
+      this, std::move(request.parser), std::move(request.promise));
+  auto* txn = session->newTransaction(callback);
+  if (!txn) {
+    callback->abort(make_exception_wrapper<MononokeRequestError>(
+        true, "unable to start a request on the mononoke connection"));
+    return;
+  }
+  ++numTransactions_;
+
+  HTTPMessage message;
+  message.setMethod(proxygen::HTTPMethod::GET);
+  message.setURL(request.url.makeRelativeURL());
+  txn->sendHeaders(message);
+  txn->sendEOM();
+}
+
+Future<folly::SocketAddress> MononokeSessionPool::getAddress() {
+  if (socketAddress_.hasValue()) {
+    return folly::makeFuture(socketAddress_.value());
+  }
+  auto promise = folly::Promise<folly::SocketAddress>();
+  auto future = promise.getFuture();
+
+  auto& factory = servicerouter::cpp2::getClientFactory();
+  auto selector = factory.getSelector();
+
+  selector->getSelectionAsync(
+      "mononoke-apiserver",
+      servicerouter::DebugContext(),
+      servicerouter::SelectionCacheCallback(
+          [promise = std::move(promise)](
+              const servicerouter::Selection& selection,
+              servicerouter::DebugContext&& /* unused */) mutable {
+            if (selection.hosts.empty()) {
+              auto ex = make_exception_wrapper<MononokeRequestError>(
+                  true, "no host found");
+              promise.setException(ex);
+              return;
+            }
+            auto selected = folly::Random::rand32(selection.hosts.size());
+            auto host = selection.hosts[selected];
+            auto addr =
+                folly::SocketAddress(host->getIpAddress(), host->getPort());
+            promise.setValue(addr);
+          }),
+      eventBase_,
+      servicerouter::ServiceOptions(),
+      servicerouter::ConnConfigs());
+
+  return future;
+}
+
+void MononokeSessionPool::connect() {
+  connecting_.push_back(std::make_unique<Connection>(this, timer_.get()));
+  auto* connection = connecting_.back().get();
+  getAddress()
+      .then([this, connection, destroyed = destroyed_](
+                folly::SocketAddress addr) {
+        if (!*destroyed) {
+          connection->start(eventBase_, addr, sslContext_, timeout_);
+        }
+      })
+      .onError([this, connection, destroyed = destroyed_](
+                   folly::exception_wrapper&& ew) {
+        if (!*destroyed) {
+          connectFailed(connection, std::move(ew));
+        }
+      });
+}
+
+void MononokeSessionPool::connectSucceeded(
+    Connection* connection,
+    HTTPUpstreamSession* session) {
+  finishConnecting(connection);
+  session->setInfoCallback(this);
+  sessions_.push_back(session);
+  dispatch();
+}
+
+void MononokeSessionPool::connectFailed(
+    Connection* connection,
+    folly::exception_wrapper error) {
+  finishConnecting(connection);
+  XLOG(DBG2) << "failed to connect to mononoke: " << error.what();
+  if (!sessions_.empty() || !connecting_.empty()) {
+    // The queued requests can still go out on another connection.
+    return;
+  }
+  auto queue = std::move(queue_);
+  queue_.clear();
+  for (auto& request : queue) {
+    request.promise.setException(error);
+  }
+}
+
+void MononokeSessionPool::finishConnecting(Connection* connection) {
+  auto it = std::find_if(
+      connecting_.begin(),
+      connecting_.end(),
+      [&](const std::unique_ptr<Connection>& c) {
+        return c.get() == connection;
+      });
+  if (it != connecting_.end()) {
+    finished_.push_back(std::move(*it));
+    connecting_.erase(it);
+    scheduleDispatch();
+  }
+}
+
 // This constructor should only be used in testing.
 MononokeBackingStore::MononokeBackingStore(
     const folly::SocketAddress& socketAddress,
@@ -202,7 +740,11 @@ MononokeBackingStore::MononokeBackingStore(
       repo_(repo),
       timeout_(timeout),
       executor_(executor),
-      sslContext_(sslContext) {}
+      sslContext_(sslContext),
+      stats_(std::make_shared<BackingStoreStats>(
+          folly::to<std::string>("mononoke.", repo))) {
+  offerHttp2(sslContext_.get());
+}
 
 MononokeBackingStore::MononokeBackingStore(
     const std::string& repo,
@@ -213,122 +755,160 @@ MononokeBackingStore::MononokeBackingStore(
       repo_(repo),
       timeout_(timeout),
       executor_(executor),
-      sslContext_(sslContext) {}
+      sslContext_(sslContext),
+      stats_(std::make_shared<BackingStoreStats>(
+          folly::to<std::string>("mononoke.", repo))) {
+  offerHttp2(sslContext_.get());
+}
 
 MononokeBackingStore::~MononokeBackingStore() {}
 
+void MononokeBackingStore::aggregateStats() {
+  stats_->aggregate();
+}
+
 folly::Future<std::unique_ptr<Tree>> MononokeBackingStore::getTree(
-    const Hash& id) {
+    const Hash& id,
+    ImportPriority /* priority */) {
   URL url(folly::sformat("/{}/tree/{}", repo_, id.toString()));
 
-  return folly::via(executor_)
-      .then([this, url] { return sendRequest(url); })
-      .then([id](std::unique_ptr<folly::IOBuf>&& buf) {
-        return convertBufToTree(std::move(buf), id);
-      });
+  return BackingStoreStats::track(stats_, &BackingStoreStats::getTree, [&] {
+    auto parser = std::make_shared<TreeParser>();
+    return folly::via(executor_)
+        .then([this, url, parser] { return sendRequest(url, parser); })
+        .then([id, parser](std::unique_ptr<folly::IOBuf>&&) {
+          return parser->finish(id);
+        });
+  });
 }
 
 folly::Future<std::unique_ptr<Blob>> MononokeBackingStore::getBlob(
-    const Hash& id) {
+    const Hash& id,
+    ImportPriority /* priority */) {
   URL url(folly::sformat("/{}/blob/{}", repo_, id.toString()));
-  return folly::via(executor_)
-      .then([this, url] { return sendRequest(url); })
-      .then([id](std::unique_ptr<folly::IOBuf>&& buf) {
-        return std::make_unique<Blob>(id, *buf);
-      });
+  return BackingStoreStats::track(stats_, &BackingStoreStats::getBlob, [&] {
+    return folly::via(executor_)
+        .then([this, url] { return sendRequest(url); })
+        .then([id](std::unique_ptr<folly::IOBuf>&& buf) {
+          // The Blob takes over the received chain without coalescing it.
+          return std::make_unique<Blob>(id, std::move(*buf));
+        });
+  });
 }
 
 folly::Future<std::unique_ptr<Tree>> MononokeBackingStore::getTreeForCommit(
     const Hash& commitID) {
   URL url(folly::sformat("/{}/changeset/{}", repo_, commitID.toString()));
-  return folly::via(executor_)
-      .then([this, url] { return sendRequest(url); })
-      .then([&](std::unique_ptr<folly::IOBuf>&& buf) {
-        auto s = buf->moveToFbString();
-        auto parsed = folly::parseJson(s);
-        auto hash = Hash(parsed.at("manifest").asString());
-        return getTree(hash);
+  return BackingStoreStats::track(
+      stats_, &BackingStoreStats::getTreeForCommit, [&] {
+        return folly::via(executor_)
+            .then([this, url] { return sendRequest(url); })
+            .then([&](std::unique_ptr<folly::IOBuf>&& buf) {
+              auto s = buf->moveToFbString();
+              auto parsed = folly::parseJson(s);
+              auto hash = Hash(parsed.at("manifest").asString());
+              return getTree(hash, ImportPriority::Foreground);
+            });
       });
 }
 
-folly::Future<folly::SocketAddress> MononokeBackingStore::getAddress(
-    folly::EventBase* eventBase) {
-  if (socketAddress_.hasValue()) {
-    return folly::makeFuture(socketAddress_.value());
+folly::Future<std::vector<folly::Try<std::unique_ptr<Blob>>>>
+MononokeBackingStore::getBlobBatch(
+    const std::vector<Hash>& ids,
+    ImportPriority priority) {
+  std::vector<folly::Future<std::unique_ptr<Blob>>> futures;
+  futures.reserve(ids.size());
+  for (const auto& id : ids) {
+    futures.push_back(getBlob(id, priority));
   }
-  auto promise = folly::Promise<folly::SocketAddress>();
-  auto future = promise.getFuture();
+  return folly::collectAll(futures);
+}
 
-  auto& factory = servicerouter::cpp2::getClientFactory();
-  auto selector = factory.getSelector();
+folly::Future<std::vector<std::pair<RelativePath, std::unique_ptr<Tree>>>>
+MononokeBackingStore::getTreeWithDescendants(
+    const Hash& id,
+    size_t depth,
+    ImportPriority priority) {
+  return getTree(id, priority)
+      .then([this, depth, priority](std::unique_ptr<Tree>&& tree) {
+        std::vector<std::pair<RelativePath, std::unique_ptr<Tree>>> trees;
+        trees.emplace_back(RelativePath{}, std::move(tree));
+        return fetchSubtrees(std::move(trees), 0, depth, priority);
+      });
+}
 
-  selector->getSelectionAsync(
-      "mononoke-apiserver",
-      servicerouter::DebugContext(),
-      servicerouter::SelectionCacheCallback(
-          [promise = std::move(promise)](
-              const servicerouter::Selection& selection,
-              servicerouter::DebugContext&& /* unused */) mutable {
-            if (selection.hosts.empty()) {
-              auto ex = make_exception_wrapper<std::runtime_error>(
-                  std::string("no host found"));
-              promise.setException(ex);
-              return;
-            }
-            auto selected = folly::Random::rand32(selection.hosts.size());
-            auto host = selection.hosts[selected];
-            auto addr =
-                folly::SocketAddress(host->getIpAddress(), host->getPort());
-            promise.setValue(addr);
-          }),
-      eventBase,
-      servicerouter::ServiceOptions(),
-      servicerouter::ConnConfigs());
+folly::Future<std::vector<std::pair<RelativePath, std::unique_ptr<Tree>>>>
+MononokeBackingStore::fetchSubtrees(
+    std::vector<std::pair<RelativePath, std::unique_ptr<Tree>>>&& trees,
+    size_t levelStart,
+    size_t depth,
+    ImportPriority priority) {
+  std::vector<RelativePath> paths;
+  std::vector<folly::Future<std::unique_ptr<Tree>>> futures;
+  if (depth > 0) {
+    for (size_t n = levelStart; n < trees.size(); ++n) {
+      for (const auto& entry : trees[n].second->getTreeEntries()) {
+        if (entry.isTree()) {
+          paths.push_back(trees[n].first + entry.getName());
+          futures.push_back(getTree(entry.getHash(), priority));
+        }
+      }
+    }
+  }
+  if (futures.empty()) {
+    return makeFuture(std::move(trees));
+  }
 
-  return future;
+  return folly::collectAll(futures).then(
+      [this,
+       trees = std::move(trees),
+       paths = std::move(paths),
+       depth,
+       priority](
+          std::vector<folly::Try<std::unique_ptr<Tree>>>&& results) mutable {
+        auto nextLevelStart = trees.size();
+        for (size_t n = 0; n < results.size(); ++n) {
+          if (results[n].hasException()) {
+            XLOG(DBG3) << "error fetching mononoke subtree " << paths[n]
+                       << ": " << results[n].exception().what();
+            continue;
+          }
+          trees.emplace_back(
+              std::move(paths[n]), std::move(results[n].value()));
+        }
+        return fetchSubtrees(
+            std::move(trees), nextLevelStart, depth - 1, priority);
+      });
 }
 
 folly::Future<std::unique_ptr<IOBuf>> MononokeBackingStore::sendRequest(
-    const URL& url) {
+    const URL& url,
+    std::shared_ptr<MononokeBodyParser> parser,
+    size_t attempt) {
   auto eventBase = folly::EventBaseManager::get()->getEventBase();
+  auto& pool = sessionPools_.getOrCreate(
+      *eventBase, eventBase, socketAddress_, sslContext_, timeout_);
 
-  return getAddress(eventBase).then(
-      [=](folly::SocketAddress addr) { return sendRequestImpl(addr, url); });
-}
-
-folly::Future<std::unique_ptr<IOBuf>> MononokeBackingStore::sendRequestImpl(
-    folly::SocketAddress addr,
-    const URL& url) {
-  auto eventBase = folly::EventBaseManager::get()->getEventBase();
-  IOBufPromise promise;
-  auto future = promise.getFuture();
-  // MononokeCallback deletes itself - see detachTransaction() method
-  MononokeCallback* callback = new MononokeCallback(url, std::move(promise));
-  // It is moved into the .then() lambda below and destroyed there
-  folly::HHWheelTimer::UniquePtr timer{folly::HHWheelTimer::newTimer(
-      eventBase,
-      std::chrono::milliseconds(folly::HHWheelTimer::DEFAULT_TICK_INTERVAL),
-      folly::AsyncTimeout::InternalEnum::NORMAL,
-      timeout_)};
-
-  // It is moved into the .then() lambda below and deleted there
-  auto connector =
-      std::make_unique<proxygen::HTTPConnector>(callback, timer.get());
-
-  const folly::AsyncSocket::OptionMap opts{{{SOL_SOCKET, SO_REUSEADDR}, 1}};
-
-  if (sslContext_ != nullptr) {
-    connector->connectSSL(
-        eventBase, addr, sslContext_, nullptr, timeout_, opts);
-  } else {
-    connector->connect(eventBase, addr, timeout_, opts);
+  if (parser) {
+    parser->reset();
   }
+  return pool.send(url, parser).onError([this, url, parser, attempt](
+                                            folly::exception_wrapper&& ew) {
+    auto* error = ew.get_exception<MononokeRequestError>();
+    if (!error || !error->isRetryable() ||
+        attempt >= static_cast<size_t>(FLAGS_mononoke_request_retries)) {
+      return makeFuture<std::unique_ptr<IOBuf>>(std::move(ew));
+    }
 
-  /* capture `connector` to make sure it stays alive for the duration of the
-     connection */
-  return std::move(future).then(
-      [connector = std::move(connector), timer = std::move(timer)](
-          std::unique_ptr<folly::IOBuf>&& buf) { return std::move(buf); });
+    auto delay = std::chrono::milliseconds(FLAGS_mononoke_retry_delay) *
+        (size_t{1} << std::min<size_t>(attempt, 10));
+    XLOG(DBG3) << "retrying mononoke request for " << url.getUrl() << " in "
+               << delay.count() << "ms: " << ew.what();
+    return folly::futures::sleep(delay).via(executor_).then(
+        [this, url, parser, attempt] {
+          return sendRequest(url, parser, attempt + 1);
+        });
+  });
 }
 
 } // namespace eden
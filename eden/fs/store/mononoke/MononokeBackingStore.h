@@ -10,12 +10,15 @@
 #pragma once
 
 #include "eden/fs/store/BackingStore.h"
+#include "eden/fs/utils/PathFuncs.h"
 
 #include <folly/Range.h>
 #include <folly/SocketAddress.h>
 #include <folly/Synchronized.h>
+#include <folly/Try.h>
 #include <folly/futures/Future.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventBaseLocal.h>
 #include <folly/io/async/SSLOptions.h>
 
 namespace folly {
@@ -30,13 +33,22 @@ class URL;
 namespace facebook {
 namespace eden {
 
+class BackingStoreStats;
 class Blob;
 class Hash;
+class MononokeBodyParser;
+class MononokeSessionPool;
 class Tree;
 
 /**
  * A BackingStore implementation that loads data out of a remote Mononoke
  * server over HTTP.
+ *
+ * Requests are sent over persistent connections that are shared by all of the
+ * requests made on the same EventBase.  When the server negotiates HTTP/2 a
+ * single connection carries many requests at once; otherwise a few HTTP/1.1
+ * connections are kept open and reused.  The EventBases that the executor
+ * runs requests on must outlive the MononokeBackingStore.
  */
 class MononokeBackingStore : public BackingStore {
  public:
@@ -54,28 +66,91 @@ class MononokeBackingStore : public BackingStore {
 
   virtual ~MononokeBackingStore();
 
-  virtual folly::Future<std::unique_ptr<Tree>> getTree(const Hash& id) override;
-  virtual folly::Future<std::unique_ptr<Blob>> getBlob(const Hash& id) override;
+  virtual folly::Future<std::unique_ptr<Tree>> getTree(
+      const Hash& id,
+      ImportPriority priority) override;
+  virtual folly::Future<std::unique_ptr<Blob>> getBlob(
+      const Hash& id,
+      ImportPriority priority) override;
   virtual folly::Future<std::unique_ptr<Tree>> getTreeForCommit(
       const Hash& commitID) override;
 
+  void aggregateStats() override;
+
+  /**
+   * Fetch several blobs at once.
+   *
+   * The requests are spread across the pooled connections, subject to the
+   * per-EventBase limit on concurrent requests, rather than waiting for each
+   * blob before asking for the next.  The results are in the same order as
+   * ids; each one fails independently of the others.
+   */
+  folly::Future<std::vector<folly::Try<std::unique_ptr<Blob>>>> getBlobBatch(
+      const std::vector<Hash>& ids,
+      ImportPriority priority);
+
+  /**
+   * Fetch a tree along with its subtrees down to depth levels below it.  A
+   * depth of 0 fetches just the tree itself.
+   *
+   * All of the subtrees at each level are requested at once, so this takes
+   * depth + 1 round trips to the server rather than one per tree.  Each tree
+   * is returned with its path relative to the tree with the given id, and
+   * parents come before their children.
+   *
+   * Only a failure to fetch the top-level tree fails the whole request.  A
+   * subtree that cannot be fetched is left out of the results, along with
+   * everything below it.
+   */
+  folly::Future<std::vector<std::pair<RelativePath, std::unique_ptr<Tree>>>>
+  getTreeWithDescendants(
+      const Hash& id,
+      size_t depth,
+      ImportPriority priority);
+
  private:
   // Forbidden copy constructor and assignment operator
   MononokeBackingStore(MononokeBackingStore const&) = delete;
   MononokeBackingStore& operator=(MononokeBackingStore const&) = delete;
 
-  folly::Future<folly::SocketAddress> getAddress(folly::EventBase*);
+  /**
+   * Send a GET request for url on the current thread's EventBase.
+   *
+   * Requests that fail because of a connection problem or a server error are
+   * retried, with exponential backoff, up to --mononoke_request_retries
+   * times.  attempt is the number of times the request has already been sent.
+   *
+   * If a parser is given, the body of a successful response is fed to it as
+   * it arrives rather than being collected, and the returned IOBuf is empty.
+   * The parser is reset before each attempt.
+   */
   folly::Future<std::unique_ptr<folly::IOBuf>> sendRequest(
-      const proxygen::URL& url);
-  folly::Future<std::unique_ptr<folly::IOBuf>> sendRequestImpl(
-      folly::SocketAddress addr,
-      const proxygen::URL& url);
+      const proxygen::URL& url,
+      std::shared_ptr<MononokeBodyParser> parser = nullptr,
+      size_t attempt = 0);
+
+  /**
+   * Fetch the subtrees of trees[levelStart:], which are the deepest level
+   * fetched so far, along with depth - 1 further levels below them, and
+   * append them to trees.
+   */
+  folly::Future<std::vector<std::pair<RelativePath, std::unique_ptr<Tree>>>>
+  fetchSubtrees(
+      std::vector<std::pair<RelativePath, std::unique_ptr<Tree>>>&& trees,
+      size_t levelStart,
+      size_t depth,
+      ImportPriority priority);
 
   folly::Optional<folly::SocketAddress> socketAddress_;
   std::string repo_;
   std::chrono::milliseconds timeout_;
   folly::Executor* executor_;
   std::shared_ptr<folly::SSLContext> sslContext_ = nullptr;
+  // Named "mononoke.<repo>", since the store serves every mount of the repo.
+  std::shared_ptr<BackingStoreStats> stats_;
+  // The connections used by each EventBase.  A MononokeSessionPool is only
+  // used from its EventBase's thread.
+  folly::EventBaseLocal<MononokeSessionPool> sessionPools_;
 };
 } // namespace eden
 } // namespace facebook
@@ -66,6 +66,7 @@ class Handler : public proxygen::RequestHandler {
             .status(404, "not found")
             .body("cannot find content")
             .sendWithEOM();
+        return;
       }
       // Split the data in two to make sure that client's onBody() callback
       // works fine
@@ -148,11 +149,17 @@ class MononokeBackingStoreTest : public ::testing::Test {
         std::make_pair(
             treehash.toString(),
             R"([{"hash": "b80de5d138758541c5f05265ad144ab9fa86d1db", "name": "a", "type": "file"},
-                {"hash": "b8e02f6433738021a065f94175c7cd23db5f05be", "name": "b", "type": "file"},
+                {"hash": "b8e02f6433738021a065f94175c7cd23db5f05be", "name": "b", "type": "file",
+                 "size": 10, "content_sha1": "d5477ccc0d5df20a4a7b7e2a3b0fa0fe7ef8b4e1"},
                 {"hash": "3333333333333333333333333333333333333333", "name": "dir", "type": "tree"},
                 {"hash": "4444444444444444444444444444444444444444", "name": "exec", "type": "executable"},
                 {"hash": "5555555555555555555555555555555555555555", "name": "link", "type": "symlink"}
             ])"),
+        std::make_pair(
+            parenttreehash.toString(),
+            R"([{"hash": "2222222222222222222222222222222222222222", "name": "sub", "type": "tree"},
+                {"hash": "b80de5d138758541c5f05265ad144ab9fa86d1db", "name": "z", "type": "file"}
+            ])"),
         std::make_pair(
             commithash.toString(),
             R"({
@@ -172,6 +179,7 @@ class MononokeBackingStoreTest : public ::testing::Test {
   Hash treehash{"2222222222222222222222222222222222222222"};
   Hash commithash{"3333333333333333333333333333333333333333"};
   Hash malformedhash{"9999999999999999999999999999999999999999"};
+  Hash parenttreehash{"6666666666666666666666666666666666666666"};
   folly::EventBase mainEventBase;
   std::unique_ptr<std::thread> mainEventBaseThread;
 };
@@ -187,13 +195,49 @@ TEST_F(MononokeBackingStoreTest, testGetBlob) {
         std::chrono::milliseconds(400),
         &mainEventBase,
         nullptr);
-    auto blob = store.getBlob(kZeroHash).get();
+    auto blob = store.getBlob(kZeroHash, ImportPriority::Foreground).get();
     auto buf = blob->getContents();
     EXPECT_EQ(blobs[kZeroHash.toString()], buf.moveToFbString());
     server->stop();
   });
 }
 
+TEST_F(MononokeBackingStoreTest, testGetBlobBatch) {
+  auto server = createServer();
+  auto blobs = getBlobs();
+  auto emptyhash = this->emptyhash;
+
+  server->start([&server, &blobs, emptyhash, this]() {
+    MononokeBackingStore store(
+        server->addresses()[0].address,
+        "repo",
+        std::chrono::milliseconds(400),
+        &mainEventBase,
+        nullptr);
+    auto unknownhash = Hash("7777777777777777777777777777777777777777");
+    auto results = store
+                       .getBlobBatch(
+                           {kZeroHash, emptyhash, unknownhash, kZeroHash},
+                           ImportPriority::Foreground)
+                       .get();
+    ASSERT_EQ(4, results.size());
+    EXPECT_EQ(
+        blobs[kZeroHash.toString()],
+        results[0].value()->getContents().moveToFbString());
+    EXPECT_EQ("", results[1].value()->getContents().moveToFbString());
+    EXPECT_THROW(results[2].value(), std::runtime_error);
+    EXPECT_EQ(
+        blobs[kZeroHash.toString()],
+        results[3].value()->getContents().moveToFbString());
+
+    // The connections stay usable after an error response.
+    auto blob = store.getBlob(kZeroHash, ImportPriority::Foreground).get();
+    EXPECT_EQ(
+        blobs[kZeroHash.toString()], blob->getContents().moveToFbString());
+    server->stop();
+  });
+}
+
 TEST_F(MononokeBackingStoreTest, testConnectFailed) {
   auto server = createServer();
   auto blobs = getBlobs();
@@ -203,7 +247,7 @@ TEST_F(MononokeBackingStoreTest, testConnectFailed) {
   MononokeBackingStore store(
       sa, "repo", std::chrono::milliseconds(300), &mainEventBase, nullptr);
   try {
-    store.getBlob(kZeroHash).get();
+    store.getBlob(kZeroHash, ImportPriority::Foreground).get();
     // Request should fail
     EXPECT_TRUE(false);
   } catch (const std::runtime_error&) {
@@ -221,7 +265,7 @@ TEST_F(MononokeBackingStoreTest, testEmptyBuffer) {
         std::chrono::milliseconds(300),
         &mainEventBase,
         nullptr);
-    auto blob = store.getBlob(emptyhash).get();
+    auto blob = store.getBlob(emptyhash, ImportPriority::Foreground).get();
     auto buf = blob->getContents();
     EXPECT_EQ(blobs[emptyhash.toString()], buf.moveToFbString());
     server->stop();
@@ -239,7 +283,7 @@ TEST_F(MononokeBackingStoreTest, testGetTree) {
         std::chrono::milliseconds(300),
         &mainEventBase,
         nullptr);
-    auto tree = store.getTree(treehash).get();
+    auto tree = store.getTree(treehash, ImportPriority::Foreground).get();
     auto tree_entries = tree->getTreeEntries();
 
     std::vector<TreeEntry> expected_entries{
@@ -250,7 +294,9 @@ TEST_F(MononokeBackingStoreTest, testGetTree) {
         TreeEntry(
             Hash("b8e02f6433738021a065f94175c7cd23db5f05be"),
             "b",
-            TreeEntryType::REGULAR_FILE),
+            TreeEntryType::REGULAR_FILE,
+            10,
+            Hash("d5477ccc0d5df20a4a7b7e2a3b0fa0fe7ef8b4e1")),
         TreeEntry(
             Hash("3333333333333333333333333333333333333333"),
             "dir",
@@ -282,7 +328,9 @@ TEST_F(MononokeBackingStoreTest, testMalformedGetTree) {
         std::chrono::milliseconds(300),
         &mainEventBase,
         nullptr);
-    EXPECT_THROW(store.getTree(treehash).get(), std::exception);
+    EXPECT_THROW(
+        store.getTree(treehash, ImportPriority::Foreground).get(),
+        std::exception);
     server->stop();
   });
 }
@@ -310,7 +358,9 @@ TEST_F(MononokeBackingStoreTest, testGetTreeForCommit) {
         TreeEntry(
             Hash("b8e02f6433738021a065f94175c7cd23db5f05be"),
             "b",
-            TreeEntryType::REGULAR_FILE),
+            TreeEntryType::REGULAR_FILE,
+            10,
+            Hash("d5477ccc0d5df20a4a7b7e2a3b0fa0fe7ef8b4e1")),
         TreeEntry(
             Hash("3333333333333333333333333333333333333333"),
             "dir",
@@ -330,3 +380,44 @@ TEST_F(MononokeBackingStoreTest, testGetTreeForCommit) {
     server->stop();
   });
 }
+
+TEST_F(MononokeBackingStoreTest, testGetTreeWithDescendants) {
+  auto server = createServer();
+  auto parenttreehash = this->parenttreehash;
+  auto treehash = this->treehash;
+  server->start([&server, parenttreehash, treehash, this]() {
+    MononokeBackingStore store(
+        server->addresses()[0].address,
+        "repo",
+        std::chrono::milliseconds(300),
+        &mainEventBase,
+        nullptr);
+
+    auto trees = store
+                     .getTreeWithDescendants(
+                         parenttreehash, 0, ImportPriority::Foreground)
+                     .get();
+    ASSERT_EQ(1, trees.size());
+    EXPECT_EQ(RelativePath{}, trees[0].first);
+    EXPECT_EQ(parenttreehash, trees[0].second->getHash());
+
+    trees = store
+                .getTreeWithDescendants(
+                    parenttreehash, 1, ImportPriority::Foreground)
+                .get();
+    ASSERT_EQ(2, trees.size());
+    EXPECT_EQ(parenttreehash, trees[0].second->getHash());
+    EXPECT_EQ(RelativePath{"sub"}, trees[1].first);
+    EXPECT_EQ(treehash, trees[1].second->getHash());
+    EXPECT_EQ(5, trees[1].second->getTreeEntries().size());
+
+    // "sub/dir" refers to a changeset rather than a tree, so it fails to
+    // parse and is left out of the results.
+    trees = store
+                .getTreeWithDescendants(
+                    parenttreehash, 2, ImportPriority::Foreground)
+                .get();
+    EXPECT_EQ(2, trees.size());
+    server->stop();
+  });
+}
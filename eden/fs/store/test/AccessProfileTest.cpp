@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/AccessProfile.h"
+
+#include <folly/futures/Future.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/MemoryLocalStore.h"
+#include "eden/fs/store/ObjectStore.h"
+#include "eden/fs/testharness/FakeBackingStore.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+
+using namespace facebook::eden;
+using namespace std::chrono_literals;
+using folly::ByteRange;
+using folly::StringPiece;
+
+namespace {
+AccessProfile makeProfile(std::initializer_list<StringPiece> paths) {
+  AccessProfile profile;
+  for (auto path : paths) {
+    profile.add(RelativePathPiece{path});
+  }
+  return profile;
+}
+
+AccessProfile roundTrip(const AccessProfile& profile) {
+  auto data = profile.serialize();
+  return AccessProfile::parse(StringPiece{data});
+}
+} // namespace
+
+TEST(AccessProfile, serializedPathsAreFrontCoded) {
+  auto profile = makeProfile({
+      "src/lib/util.h",
+      "src/lib/util.cpp",
+      "src/main.cpp",
+      "README",
+  });
+  EXPECT_FALSE(profile.add(RelativePathPiece{"README"}));
+  EXPECT_EQ(profile.getPaths(), roundTrip(profile).getPaths());
+
+  // Each path only adds the bytes it does not share with the one before.
+  size_t pathBytes = 0;
+  for (const auto& path : profile.getPaths()) {
+    pathBytes += path.stringPiece().size();
+  }
+  EXPECT_LT(profile.serialize().size(), pathBytes);
+}
+
+TEST(AccessProfile, emptyProfile) {
+  EXPECT_EQ(0, roundTrip(AccessProfile{}).size());
+}
+
+TEST(AccessProfile, rejectsCorruptData) {
+  auto data = makeProfile({"a/b", "a/c"}).serialize();
+  auto parse = [](const std::string& bytes) {
+    return AccessProfile::parse(StringPiece{bytes});
+  };
+  EXPECT_THROW(parse(""), std::invalid_argument);
+  EXPECT_THROW(parse("EDAX" + data.substr(4)), std::invalid_argument);
+  EXPECT_THROW(parse(data.substr(0, data.size() - 1)), std::invalid_argument);
+  EXPECT_THROW(parse(data + "x"), std::invalid_argument);
+
+  auto badVersion = data;
+  badVersion[4] = 2;
+  EXPECT_THROW(parse(badVersion), std::invalid_argument);
+
+  // The second path claims to share more than the first path's length.
+  auto badPrefix = data;
+  badPrefix[data.size() - 3] = 9;
+  EXPECT_THROW(parse(badPrefix), std::invalid_argument);
+}
+
+TEST(AccessProfile, prefetchFetchesTheFilesThatExist) {
+  auto localStore = std::make_shared<MemoryLocalStore>();
+  auto backingStore = std::make_shared<FakeBackingStore>(localStore);
+  ObjectStore store{localStore, backingStore};
+
+  FakeTreeBuilder builder;
+  builder.setFile("src/main.c", "main");
+  builder.setFile("src/lib/util.c", "util");
+  builder.setFile("src/lib/util.h", "header");
+  builder.setFile("docs/index.md", "docs");
+  auto* root = builder.finalize(backingStore, /* setReady */ true);
+  auto rootTree = store.getTree(root->get().getHash()).get(100ms);
+
+  auto profile = std::make_shared<AccessProfile>(makeProfile({
+      "src/main.c",
+      "src/lib/util.c",
+      "src/lib/util.h",
+      // Directories, and paths missing from this commit, are skipped.
+      "docs",
+      "src/removed.c",
+      "missing/dir/file.c",
+      "src/main.c/not_a_dir",
+  }));
+  auto numBlobs =
+      prefetchAccessProfile(&store, rootTree, profile).get(100ms);
+  EXPECT_EQ(3, numBlobs);
+}
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/BlobCache.h"
+
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include "eden/fs/testharness/TestUtil.h"
+
+using namespace facebook::eden;
+using folly::IOBuf;
+using folly::StringPiece;
+using folly::io::CodecType;
+
+namespace {
+std::shared_ptr<const Blob> makeBlob(StringPiece hash, std::string contents) {
+  return std::make_shared<Blob>(
+      makeTestHash(hash), IOBuf{IOBuf::COPY_BUFFER, contents});
+}
+
+std::string contentsOf(const Blob& blob) {
+  return blob.getContents().cloneCoalescedAsValue().moveToFbString().str();
+}
+
+BlobCache::CompressionOptions lz4Options() {
+  BlobCache::CompressionOptions options;
+  options.codecType = CodecType::LZ4;
+  options.minSize = 64;
+  options.maxSize = 4096;
+  return options;
+}
+} // namespace
+
+TEST(BlobCache, parseCodecType) {
+  EXPECT_EQ(CodecType::NO_COMPRESSION, BlobCache::parseCodecType("none"));
+  EXPECT_EQ(CodecType::LZ4, BlobCache::parseCodecType("lz4"));
+  EXPECT_EQ(CodecType::ZSTD, BlobCache::parseCodecType("zstd"));
+  EXPECT_THROW(BlobCache::parseCodecType("snappy"), std::invalid_argument);
+}
+
+TEST(BlobCache, uncompressedCacheReturnsTheInsertedBlob) {
+  BlobCache cache{1024 * 1024};
+  auto blob = makeBlob("1", std::string(1000, 'x'));
+  cache.insert(blob);
+  EXPECT_EQ(blob, cache.get(makeTestHash("1")));
+  EXPECT_EQ(nullptr, cache.get(makeTestHash("2")));
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(1, stats.hitCount);
+  EXPECT_EQ(1, stats.missCount);
+  EXPECT_EQ(0, stats.compressedHitCount);
+  EXPECT_EQ(0, stats.compressedInsertCount);
+}
+
+TEST(BlobCache, compressesBlobsWithinTheSizeRange) {
+  BlobCache cache{1024 * 1024, lz4Options()};
+  auto contents = std::string(1000, 'x');
+  auto blob = makeBlob("1", contents);
+  cache.insert(blob);
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(1, stats.compressedInsertCount);
+  EXPECT_LT(stats.totalSizeBytes, blob->getSizeBytes());
+  EXPECT_GT(stats.compressionSavedBytes, 0);
+
+  // Each hit decompresses into a new Blob with the same contents.
+  auto cached = cache.get(makeTestHash("1"));
+  ASSERT_NE(nullptr, cached);
+  EXPECT_NE(blob, cached);
+  EXPECT_EQ(blob->getHash(), cached->getHash());
+  EXPECT_EQ(contents, contentsOf(*cached));
+  EXPECT_EQ(1, cache.getStats().compressedHitCount);
+}
+
+TEST(BlobCache, keepsBlobsOutsideTheSizeRangeUncompressed) {
+  BlobCache cache{1024 * 1024, lz4Options()};
+  auto small = makeBlob("1", std::string(10, 'x'));
+  auto large = makeBlob("2", std::string(10000, 'x'));
+  cache.insert(small);
+  cache.insert(large);
+
+  EXPECT_EQ(small, cache.get(makeTestHash("1")));
+  EXPECT_EQ(large, cache.get(makeTestHash("2")));
+  auto stats = cache.getStats();
+  EXPECT_EQ(0, stats.compressedInsertCount);
+  EXPECT_EQ(0, stats.compressedHitCount);
+}
+
+TEST(BlobCache, keepsIncompressibleBlobsUncompressed) {
+  BlobCache cache{1024 * 1024, lz4Options()};
+  std::string contents;
+  uint32_t state = 12345;
+  for (int n = 0; n < 1000; ++n) {
+    state = state * 1103515245 + 12345;
+    contents.push_back(static_cast<char>(state >> 24));
+  }
+  auto blob = makeBlob("1", contents);
+  cache.insert(blob);
+
+  EXPECT_EQ(blob, cache.get(makeTestHash("1")));
+  EXPECT_EQ(0, cache.getStats().compressedInsertCount);
+}
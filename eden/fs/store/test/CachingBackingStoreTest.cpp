@@ -0,0 +1,167 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/CachingBackingStore.h"
+
+#include <folly/Synchronized.h>
+#include <folly/executors/ManualExecutor.h>
+#include <folly/futures/Future.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <unordered_map>
+
+#include "eden/fs/model/Blob.h"
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/MemoryLocalStore.h"
+#include "eden/fs/store/RemoteObjectCache.h"
+#include "eden/fs/testharness/FakeBackingStore.h"
+
+using namespace facebook::eden;
+using folly::Future;
+using folly::Optional;
+using std::string;
+
+namespace {
+class FakeRemoteObjectCache : public RemoteObjectCache {
+ public:
+  Future<std::vector<Optional<string>>> multiGet(
+      const std::vector<string>& keys) override {
+    ++multiGetCount;
+    std::vector<Optional<string>> values;
+    auto locked = entries.rlock();
+    for (const auto& key : keys) {
+      auto it = locked->find(key);
+      if (it == locked->end()) {
+        values.push_back(folly::none);
+      } else {
+        values.push_back(it->second);
+      }
+    }
+    return values;
+  }
+
+  Future<folly::Unit> multiPut(
+      std::vector<std::pair<string, string>> newEntries) override {
+    auto locked = entries.wlock();
+    for (auto& entry : newEntries) {
+      (*locked)[entry.first] = std::move(entry.second);
+    }
+    return folly::unit;
+  }
+
+  folly::Synchronized<std::unordered_map<string, string>> entries;
+  std::atomic<size_t> multiGetCount{0};
+};
+
+/**
+ * One machine's view of the cache: its own LocalStore and origin.
+ */
+struct Machine {
+  explicit Machine(
+      std::shared_ptr<RemoteObjectCache> cache,
+      bool cacheTrees = true)
+      : store{backingStore,
+              std::move(cache),
+              localStore.get(),
+              &executor,
+              "test",
+              cacheTrees} {}
+
+  template <typename T>
+  T wait(Future<T>&& future) {
+    executor.drain();
+    EXPECT_TRUE(future.isReady());
+    return std::move(future).get();
+  }
+
+  std::shared_ptr<MemoryLocalStore> localStore{
+      std::make_shared<MemoryLocalStore>()};
+  std::shared_ptr<FakeBackingStore> backingStore{
+      std::make_shared<FakeBackingStore>(localStore)};
+  folly::ManualExecutor executor;
+  CachingBackingStore store;
+};
+} // namespace
+
+TEST(CachingBackingStore, blobsAreFetchedFromOriginOnce) {
+  auto cache = std::make_shared<FakeRemoteObjectCache>();
+  Machine first{cache};
+  auto* stored = first.backingStore->putBlob("contents");
+  stored->setReady();
+  auto id = stored->get().getHash();
+
+  auto blob = first.wait(first.store.getBlob(id, ImportPriority::Foreground));
+  EXPECT_EQ("contents", blob->getContents().clone()->moveToFbString());
+  EXPECT_EQ(1, first.backingStore->getBlobFetchCount());
+  EXPECT_EQ(1, cache->entries.rlock()->size());
+
+  // Another machine finds the blob in the cache without going to its origin,
+  // which does not even have it.
+  Machine second{cache};
+  blob = second.wait(second.store.getBlob(id, ImportPriority::Foreground));
+  EXPECT_EQ("contents", blob->getContents().clone()->moveToFbString());
+  EXPECT_EQ(0, second.backingStore->getBlobFetchCount());
+}
+
+TEST(CachingBackingStore, concurrentLookupsShareOneMultiGet) {
+  auto cache = std::make_shared<FakeRemoteObjectCache>();
+  Machine machine{cache};
+  auto* blob1 = machine.backingStore->putBlob("one");
+  auto* blob2 = machine.backingStore->putBlob("two");
+  blob1->setReady();
+  blob2->setReady();
+
+  auto future1 = machine.store.getBlob(
+      blob1->get().getHash(), ImportPriority::Foreground);
+  auto future2 = machine.store.getBlob(
+      blob2->get().getHash(), ImportPriority::Foreground);
+  machine.wait(std::move(future1));
+  machine.wait(std::move(future2));
+  EXPECT_EQ(1, cache->multiGetCount);
+}
+
+TEST(CachingBackingStore, prefetchStoresCachedBlobsLocally) {
+  auto cache = std::make_shared<FakeRemoteObjectCache>();
+  Machine first{cache};
+  auto* stored = first.backingStore->putBlob("contents");
+  stored->setReady();
+  auto id = stored->get().getHash();
+  first.wait(first.store.getBlob(id, ImportPriority::Foreground));
+
+  Machine second{cache};
+  second.wait(second.store.prefetchBlobs({id}));
+  EXPECT_EQ(0, second.backingStore->getBlobFetchCount());
+  auto blob = second.localStore->getBlob(id).get();
+  ASSERT_TRUE(blob);
+  EXPECT_EQ("contents", blob->getContents().clone()->moveToFbString());
+}
+
+TEST(CachingBackingStore, treesAreOnlyCachedWhenEnabled) {
+  auto cache = std::make_shared<FakeRemoteObjectCache>();
+  Machine machine{cache, /*cacheTrees=*/false};
+  auto* tree = machine.backingStore->putTree(std::vector<TreeEntry>{});
+  tree->setReady();
+  machine.wait(machine.store.getTree(
+      tree->get().getHash(), ImportPriority::Foreground));
+  EXPECT_TRUE(cache->entries.rlock()->empty());
+  EXPECT_EQ(0, cache->multiGetCount);
+
+  Machine caching{cache};
+  auto* cachedTree = caching.backingStore->putTree(std::vector<TreeEntry>{});
+  cachedTree->setReady();
+  auto id = cachedTree->get().getHash();
+  caching.wait(caching.store.getTree(id, ImportPriority::Foreground));
+  EXPECT_EQ(1, cache->entries.rlock()->size());
+
+  Machine other{cache};
+  auto result = other.wait(other.store.getTree(id, ImportPriority::Foreground));
+  EXPECT_EQ(id, result->getHash());
+  EXPECT_EQ(0, other.backingStore->getTreeFetchCount());
+  EXPECT_TRUE(other.localStore->getTree(id).get());
+}
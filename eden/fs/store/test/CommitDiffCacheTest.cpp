@@ -0,0 +1,89 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/CommitDiffCache.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "eden/fs/store/MemoryLocalStore.h"
+#include "eden/fs/store/ObjectStore.h"
+#include "eden/fs/testharness/FakeBackingStore.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestUtil.h"
+
+using namespace facebook::eden;
+using namespace std::chrono_literals;
+using ::testing::ElementsAre;
+using ::testing::Pair;
+
+class CommitDiffCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    localStore_ = std::make_shared<MemoryLocalStore>();
+    backingStore_ = std::make_shared<FakeBackingStore>(localStore_);
+    store_ = std::make_unique<ObjectStore>(localStore_, backingStore_);
+    cache_ = std::make_unique<CommitDiffCache>(store_.get(), 2);
+
+    builder_.setFile("src/main.c", "hello world");
+    builder_.setFile("src/lib.c", "helper code");
+    builder_.finalize(backingStore_, /* setReady */ true);
+    backingStore_->putCommit("1", builder_)->setReady();
+  }
+
+  void makeCommit(folly::StringPiece commit, folly::StringPiece contents) {
+    auto builder = builder_.clone();
+    builder.replaceFile("src/main.c", contents);
+    builder.finalize(backingStore_, /* setReady */ true);
+    backingStore_->putCommit(commit, builder)->setReady();
+  }
+
+  std::shared_ptr<LocalStore> localStore_;
+  std::shared_ptr<FakeBackingStore> backingStore_;
+  std::unique_ptr<ObjectStore> store_;
+  std::unique_ptr<CommitDiffCache> cache_;
+  FakeTreeBuilder builder_;
+};
+
+TEST_F(CommitDiffCacheTest, sharesDiffsBetweenRequests) {
+  makeCommit("2", "hello world v2");
+
+  auto diff = cache_->getDiff(makeTestHash("1"), makeTestHash("2")).get(1s);
+  EXPECT_THAT(
+      diff->entries, ElementsAre(Pair("src/main.c", ScmFileStatus::MODIFIED)));
+  EXPECT_EQ(
+      diff, cache_->getDiff(makeTestHash("1"), makeTestHash("2")).get(1s));
+
+  // The reverse direction is a different diff.
+  auto reverse = cache_->getDiff(makeTestHash("2"), makeTestHash("1")).get(1s);
+  EXPECT_NE(diff, reverse);
+  EXPECT_EQ(2, cache_->size());
+}
+
+TEST_F(CommitDiffCacheTest, evictsLeastRecentlyUsedDiffs) {
+  makeCommit("2", "v2");
+  makeCommit("3", "v3");
+
+  auto first = cache_->getDiff(makeTestHash("1"), makeTestHash("2")).get(1s);
+  cache_->getDiff(makeTestHash("1"), makeTestHash("3")).get(1s);
+  cache_->getDiff(makeTestHash("2"), makeTestHash("3")).get(1s);
+  EXPECT_EQ(2, cache_->size());
+  EXPECT_NE(
+      first, cache_->getDiff(makeTestHash("1"), makeTestHash("2")).get(1s));
+}
+
+TEST_F(CommitDiffCacheTest, retriesFailedDiffs) {
+  EXPECT_THROW(
+      cache_->getDiff(makeTestHash("1"), makeTestHash("2")).get(1s),
+      std::domain_error);
+
+  makeCommit("2", "hello world v2");
+  auto diff = cache_->getDiff(makeTestHash("1"), makeTestHash("2")).get(1s);
+  EXPECT_EQ(1, diff->entries.size());
+}
@@ -9,9 +9,13 @@
  */
 #include "eden/fs/store/Diff.h"
 
+#include <folly/Synchronized.h>
+#include <folly/executors/ManualExecutor.h>
 #include <folly/test/TestUtils.h>
+#include <gflags/gflags.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <atomic>
 
 #include "eden/fs/store/MemoryLocalStore.h"
 #include "eden/fs/store/ObjectStore.h"
@@ -19,6 +23,8 @@
 #include "eden/fs/testharness/FakeTreeBuilder.h"
 #include "eden/fs/testharness/TestUtil.h"
 
+DECLARE_int32(diff_max_tree_loads);
+
 using namespace facebook::eden;
 using namespace std::chrono_literals;
 using folly::Future;
@@ -237,6 +243,145 @@ TEST_F(DiffTest, newDirectory) {
   EXPECT_THAT(treeResult2.entries, expectedResults);
 }
 
+namespace {
+/**
+ * A TreeDiffCallback that records what it is told and asks the diff to stop
+ * as soon as it has seen one change.
+ */
+class CancellingTreeDiffCallback : public TreeDiffCallback {
+ public:
+  void changedFile(RelativePathPiece path, ScmFileStatus status) override {
+    results_.wlock()->entries.emplace(path.value().str(), status);
+    cancelled_.store(true);
+  }
+  void diffError(RelativePathPiece path, const folly::exception_wrapper& ew)
+      override {
+    results_.wlock()->errors.emplace(
+        path.value().str(), ew.what().toStdString());
+  }
+  bool isCancelled() const override {
+    return cancelled_.load();
+  }
+
+  ScmStatus extractResults() {
+    return std::move(*results_.wlock());
+  }
+
+ private:
+  std::atomic<bool> cancelled_{false};
+  folly::Synchronized<ScmStatus> results_;
+};
+} // namespace
+
+TEST_F(DiffTest, streamingDiffStopsWhenCancelled) {
+  FakeTreeBuilder builder;
+  builder.setFile("src/foo/a.txt", "a");
+  builder.finalize(backingStore_, /* setReady */ true);
+  backingStore_->putCommit("1", builder)->setReady();
+
+  auto builder2 = builder.clone();
+  builder2.setFile("src/foo/a/b/c.txt", "c");
+  builder2.setFile("src/foo/a/b/d.txt", "d");
+  builder2.setFile("src/foo/a/b/f/g.txt", "g");
+  builder2.setFile("src/foo/z/y/x.txt", "x");
+  builder2.finalize(backingStore_, /* setReady */ true);
+  backingStore_->putCommit("2", builder2)->setReady();
+
+  // The files in the directory being processed are still reported, but no
+  // further directories are diffed once the callback has cancelled.
+  CancellingTreeDiffCallback callback;
+  facebook::eden::diffCommits(
+      store_.get(), makeTestHash("1"), makeTestHash("2"), &callback)
+      .get(100ms);
+  auto result = callback.extractResults();
+  EXPECT_THAT(result.errors, UnorderedElementsAre());
+  EXPECT_THAT(
+      result.entries,
+      UnorderedElementsAre(
+          Pair("src/foo/a/b/c.txt", ScmFileStatus::ADDED),
+          Pair("src/foo/a/b/d.txt", ScmFileStatus::ADDED)));
+}
+
+namespace {
+/**
+ * A TreeDiffCallback that records the results as they are reported.
+ */
+class RecordingTreeDiffCallback : public TreeDiffCallback {
+ public:
+  void changedFile(RelativePathPiece path, ScmFileStatus status) override {
+    results_.wlock()->entries.emplace(path.value().str(), status);
+  }
+  void diffError(RelativePathPiece path, const folly::exception_wrapper& ew)
+      override {
+    results_.wlock()->errors.emplace(
+        path.value().str(), ew.what().toStdString());
+  }
+
+  ScmStatus getResults() const {
+    return *results_.rlock();
+  }
+
+ private:
+  folly::Synchronized<ScmStatus> results_;
+};
+} // namespace
+
+TEST_F(DiffTest, treeLoadsAreLimited) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_diff_max_tree_loads = 1;
+
+  FakeTreeBuilder builder;
+  builder.setFile("a/x.txt", "a");
+  builder.setFile("b/x.txt", "b");
+  builder.setFile("c/x.txt", "c");
+  builder.finalize(backingStore_, /* setReady */ false);
+  backingStore_->putCommit("1", builder)->setReady();
+  builder.setReady("");
+
+  auto builder2 = builder.clone();
+  builder2.replaceFile("a/x.txt", "a2");
+  builder2.replaceFile("b/x.txt", "b2");
+  builder2.replaceFile("c/x.txt", "c2");
+  builder2.finalize(backingStore_, /* setReady */ false);
+  backingStore_->putCommit("2", builder2)->setReady();
+  builder2.setReady("");
+
+  folly::ManualExecutor executor;
+  RecordingTreeDiffCallback callback;
+  auto future = facebook::eden::diffCommits(
+      store_.get(),
+      makeTestHash("1"),
+      makeTestHash("2"),
+      &callback,
+      &executor);
+  executor.drain();
+
+  // "a" holds the only load slot, so "b" and "c" are not loaded yet even
+  // though their data is available.
+  builder.setReady("b");
+  builder2.setReady("b");
+  builder.setReady("c");
+  builder2.setReady("c");
+  executor.drain();
+  EXPECT_FALSE(future.isReady());
+  EXPECT_THAT(callback.getResults().entries, UnorderedElementsAre());
+
+  builder.setReady("a");
+  builder2.setReady("a");
+  executor.drain();
+  ASSERT_TRUE(future.isReady());
+  std::move(future).get();
+
+  auto result = callback.getResults();
+  EXPECT_THAT(result.errors, UnorderedElementsAre());
+  EXPECT_THAT(
+      result.entries,
+      UnorderedElementsAre(
+          Pair("a/x.txt", ScmFileStatus::MODIFIED),
+          Pair("b/x.txt", ScmFileStatus::MODIFIED),
+          Pair("c/x.txt", ScmFileStatus::MODIFIED)));
+}
+
 TEST_F(DiffTest, fileToDirectory) {
   FakeTreeBuilder builder;
 
@@ -422,3 +567,143 @@ TEST_F(DiffTest, loadTreeError) {
       result.entries,
       UnorderedElementsAre(Pair("a/b/3.txt", ScmFileStatus::MODIFIED)));
 }
+
+TEST_F(DiffTest, prefetchChangedTreesOnlyLoadsTheNewTrees) {
+  FakeTreeBuilder builder;
+  builder.setFile("src/foo/a.txt", "a");
+  builder.setFile("docs/readme.txt", "docs");
+  builder.setFile("old/gone.txt", "gone");
+  builder.finalize(backingStore_, /* setReady */ true);
+  backingStore_->putCommit("1", builder)->setReady();
+
+  auto builder2 = builder.clone();
+  builder2.setFile("src/foo/a/b/c.txt", "c");
+  builder2.setFile("src/bar/d.txt", "d");
+  builder2.removeFile("old/gone.txt");
+  builder2.finalize(backingStore_, /* setReady */ true);
+  backingStore_->putCommit("2", builder2)->setReady();
+
+  auto prefetch = [&](size_t maxDepth, std::vector<RelativePath> paths) {
+    return prefetchChangedTrees(
+               store_.get(),
+               makeTestHash("1"),
+               makeTestHash("2"),
+               maxDepth,
+               std::move(paths))
+        .get(100ms);
+  };
+  // The root, src, src/foo, src/foo/a, src/foo/a/b and src/bar.  docs did
+  // not change, and old is only in the first commit.
+  EXPECT_EQ(6, prefetch(0, {}));
+  EXPECT_EQ(4, prefetch(2, {}));
+  // The trees leading to src/bar, and src/bar itself.
+  EXPECT_EQ(3, prefetch(0, {RelativePath{"src/bar"}}));
+  EXPECT_EQ(5, prefetch(0, {RelativePath{"src/foo/a"}}));
+}
+
+TEST_F(DiffTest, filteredDiffOnlyReportsMatchingPaths) {
+  FakeTreeBuilder builder;
+  builder.setFile("src/lib/a.c", "a");
+  builder.setFile("src/tools/b.c", "b");
+  builder.setFile("docs/readme.txt", "docs");
+  builder.finalize(backingStore_, /* setReady */ true);
+  backingStore_->putCommit("1", builder)->setReady();
+
+  auto builder2 = builder.clone();
+  builder2.replaceFile("src/lib/a.c", "a v2");
+  builder2.setFile("src/lib/new.c", "new");
+  builder2.replaceFile("src/tools/b.c", "b v2");
+  builder2.removeFile("docs/readme.txt");
+  builder2.finalize(backingStore_, /* setReady */ true);
+  backingStore_->putCommit("2", builder2)->setReady();
+
+  auto diff = [&](std::vector<RelativePath> prefixes, size_t limit) {
+    return facebook::eden::diffCommits(
+               store_.get(),
+               makeTestHash("1"),
+               makeTestHash("2"),
+               PathPrefixFilter{std::move(prefixes)},
+               limit)
+        .get(100ms);
+  };
+
+  auto result = diff({RelativePath{"src/lib"}}, 0);
+  EXPECT_THAT(result.errors, UnorderedElementsAre());
+  EXPECT_THAT(
+      result.entries,
+      UnorderedElementsAre(
+          Pair("src/lib/a.c", ScmFileStatus::MODIFIED),
+          Pair("src/lib/new.c", ScmFileStatus::ADDED)));
+  EXPECT_FALSE(result.truncated);
+
+  auto removed = diff({RelativePath{"docs/readme.txt"}}, 0);
+  EXPECT_THAT(
+      removed.entries,
+      UnorderedElementsAre(Pair("docs/readme.txt", ScmFileStatus::REMOVED)));
+
+  auto limited = diff({}, 2);
+  EXPECT_EQ(2, limited.entries.size());
+  EXPECT_TRUE(limited.truncated);
+
+  auto exact = diff({RelativePath{"src"}}, 3);
+  EXPECT_EQ(3, exact.entries.size());
+  EXPECT_FALSE(exact.truncated);
+}
+
+TEST_F(DiffTest, repeatedDiffsReuseTheDiffsOfSubtrees) {
+  FakeTreeBuilder builder;
+  builder.setFile("a/b/1.txt", "1");
+  builder.setFile("a/c/2.txt", "2");
+  builder.setFile("src/main.c", "main");
+  builder.finalize(backingStore_, /* setReady */ true);
+  backingStore_->putCommit("1", builder)->setReady();
+
+  auto builder2 = builder.clone();
+  builder2.replaceFile("a/b/1.txt", "1 v2");
+  builder2.setFile("a/new/3.txt", "3");
+  builder2.finalize(backingStore_, /* setReady */ true);
+  backingStore_->putCommit("2", builder2)->setReady();
+
+  auto builder3 = builder2.clone();
+  builder3.replaceFile("src/main.c", "main v2");
+  builder3.finalize(backingStore_, /* setReady */ true);
+  backingStore_->putCommit("3", builder3)->setReady();
+
+  auto result = diffCommits("1", "2").get(100ms);
+  EXPECT_THAT(
+      result.entries,
+      UnorderedElementsAre(
+          Pair("a/b/1.txt", ScmFileStatus::MODIFIED),
+          Pair("a/new/3.txt", ScmFileStatus::ADDED)));
+
+  // Make every tree that the diffs walk into come from the backing store.
+  localStore_->clearKeySpace(LocalStore::TreeFamily);
+  auto fetches = backingStore_->getTreeFetchCount();
+  auto repeated = diffCommits("1", "2").get(100ms);
+  EXPECT_EQ(result.entries, repeated.entries);
+  EXPECT_EQ(fetches, backingStore_->getTreeFetchCount());
+
+  // Only the pair of src trees is new to this diff.
+  auto overlapping = diffCommits("1", "3").get(100ms);
+  EXPECT_THAT(overlapping.errors, UnorderedElementsAre());
+  EXPECT_THAT(
+      overlapping.entries,
+      UnorderedElementsAre(
+          Pair("a/b/1.txt", ScmFileStatus::MODIFIED),
+          Pair("a/new/3.txt", ScmFileStatus::ADDED),
+          Pair("src/main.c", ScmFileStatus::MODIFIED)));
+  EXPECT_EQ(fetches + 2, backingStore_->getTreeFetchCount());
+
+  // Cached subtrees are still filtered.
+  auto filtered = facebook::eden::diffCommits(
+                      store_.get(),
+                      makeTestHash("1"),
+                      makeTestHash("3"),
+                      PathPrefixFilter{std::vector<RelativePath>{
+                          RelativePath{"a/new"}}},
+                      0)
+                      .get(100ms);
+  EXPECT_THAT(
+      filtered.entries,
+      UnorderedElementsAre(Pair("a/new/3.txt", ScmFileStatus::ADDED)));
+}
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/KeyAccessTracker.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::eden;
+using namespace folly::string_piece_literals;
+using folly::ByteRange;
+
+TEST(KeyAccessTracker, untrackedKeysReportGenerationZero) {
+  KeyAccessTracker tracker;
+  EXPECT_EQ(0, tracker.getLastAccess(ByteRange{"foo"_sp}));
+  EXPECT_EQ(0, tracker.size());
+}
+
+TEST(KeyAccessTracker, accessesRecordTheCurrentGeneration) {
+  KeyAccessTracker tracker;
+  tracker.recordAccess(ByteRange{"foo"_sp});
+  EXPECT_EQ(1, tracker.getLastAccess(ByteRange{"foo"_sp}));
+
+  EXPECT_EQ(2, tracker.advanceGeneration());
+  tracker.recordAccess(ByteRange{"bar"_sp});
+  EXPECT_EQ(1, tracker.getLastAccess(ByteRange{"foo"_sp}));
+  EXPECT_EQ(2, tracker.getLastAccess(ByteRange{"bar"_sp}));
+
+  tracker.recordAccess(ByteRange{"foo"_sp});
+  EXPECT_EQ(2, tracker.getLastAccess(ByteRange{"foo"_sp}));
+  EXPECT_EQ(2, tracker.size());
+}
+
+TEST(KeyAccessTracker, fullTableDropsOldestGeneration) {
+  KeyAccessTracker tracker{2};
+  tracker.recordAccess(ByteRange{"one"_sp});
+  tracker.advanceGeneration();
+  tracker.recordAccess(ByteRange{"two"_sp});
+  tracker.advanceGeneration();
+  tracker.recordAccess(ByteRange{"three"_sp});
+
+  EXPECT_EQ(2, tracker.size());
+  EXPECT_EQ(0, tracker.getLastAccess(ByteRange{"one"_sp}));
+  EXPECT_EQ(2, tracker.getLastAccess(ByteRange{"two"_sp}));
+  EXPECT_EQ(3, tracker.getLastAccess(ByteRange{"three"_sp}));
+}
+
+TEST(KeyAccessTracker, fullTableOfCurrentGenerationIgnoresNewKeys) {
+  KeyAccessTracker tracker{2};
+  tracker.recordAccess(ByteRange{"one"_sp});
+  tracker.recordAccess(ByteRange{"two"_sp});
+  tracker.recordAccess(ByteRange{"three"_sp});
+
+  EXPECT_EQ(2, tracker.size());
+  EXPECT_EQ(1, tracker.getLastAccess(ByteRange{"one"_sp}));
+  EXPECT_EQ(0, tracker.getLastAccess(ByteRange{"three"_sp}));
+}
@@ -0,0 +1,505 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <folly/experimental/TestUtil.h>
+#include <folly/futures/Future.h>
+#include <folly/init/Init.h>
+#include <folly/io/IOBuf.h>
+#include <folly/stop_watch.h>
+#include <gflags/gflags.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "eden/fs/model/Blob.h"
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/model/TreeEntry.h"
+#include "eden/fs/store/BackingStore.h"
+#include "eden/fs/store/MemoryLocalStore.h"
+#include "eden/fs/store/ObjectStore.h"
+#include "eden/fs/store/RocksDbLocalStore.h"
+#include "eden/fs/store/SqliteLocalStore.h"
+#include "eden/fs/store/StoreResult.h"
+#include "eden/fs/store/TreeView.h"
+#include "eden/fs/testharness/FakeBackingStore.h"
+#include "eden/fs/testharness/StoredObject.h"
+
+using namespace facebook::eden;
+using namespace folly::string_piece_literals;
+using folly::ByteRange;
+using folly::Future;
+using folly::StringPiece;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+using KeySpace = LocalStore::KeySpace;
+
+DEFINE_string(
+    stores,
+    "memory,rocksdb,sqlite",
+    "Comma-separated LocalStore implementations to measure");
+DEFINE_string(
+    store_path,
+    "",
+    "Directory to create the on-disk stores in, to measure a particular "
+    "filesystem.  Defaults to a temporary directory.");
+DEFINE_string(
+    thread_counts,
+    "1,4,16",
+    "Comma-separated numbers of threads to run the read workloads with");
+DEFINE_int32(objects, 5000, "Number of blobs written to each store");
+DEFINE_int32(reads, 200000, "Number of reads in each read workload");
+DEFINE_int32(batch_size, 64, "Number of keys in each getBatch() call");
+DEFINE_int32(
+    hot_objects,
+    500,
+    "Number of blobs that the cache-hot workloads read from");
+DEFINE_int32(trees, 2000, "Number of trees written to each store");
+DEFINE_int32(tree_entries, 64, "Number of entries in each tree");
+DEFINE_int32(
+    backing_store_latency_ms,
+    5,
+    "Latency added to each fetch from the backing store in the ObjectStore "
+    "workloads");
+DEFINE_int32(
+    backing_store_fetches,
+    2000,
+    "Number of blobs fetched through the ObjectStore");
+DEFINE_int32(
+    backing_store_concurrency,
+    256,
+    "Number of ObjectStore fetches kept outstanding at once");
+
+namespace {
+
+/**
+ * Blob sizes to store, and the fraction of blobs of roughly that size in a
+ * large source tree.  Most files are a few kilobytes; a few are megabytes.
+ */
+struct ObjectSize {
+  size_t bytes;
+  double weight;
+};
+constexpr ObjectSize kObjectSizes[] = {
+    {64, 0.10},
+    {512, 0.20},
+    {2 * 1024, 0.25},
+    {8 * 1024, 0.20},
+    {32 * 1024, 0.15},
+    {128 * 1024, 0.08},
+    {1024 * 1024, 0.02},
+};
+
+Hash makeKey(uint64_t index) {
+  auto str = folly::to<string>("object ", index);
+  return Hash::sha1(ByteRange{StringPiece{str}});
+}
+
+vector<size_t> makeObjectSizes(size_t count) {
+  std::mt19937_64 rng{1};
+  vector<double> weights;
+  for (const auto& size : kObjectSizes) {
+    weights.push_back(size.weight);
+  }
+  std::discrete_distribution<size_t> dist{weights.begin(), weights.end()};
+  vector<size_t> sizes;
+  sizes.reserve(count);
+  for (size_t n = 0; n < count; ++n) {
+    sizes.push_back(kObjectSizes[dist(rng)].bytes);
+  }
+  return sizes;
+}
+
+string makeContents(uint64_t index, size_t size) {
+  string contents(size, '\0');
+  std::mt19937_64 rng{index};
+  for (auto& c : contents) {
+    c = static_cast<char>('a' + rng() % 26);
+  }
+  return contents;
+}
+
+vector<size_t> parseCounts(StringPiece str) {
+  vector<StringPiece> parts;
+  folly::split(',', str, parts, /* ignoreEmpty */ true);
+  vector<size_t> counts;
+  for (auto part : parts) {
+    counts.push_back(folly::to<size_t>(part));
+  }
+  return counts;
+}
+
+void report(
+    StringPiece name,
+    size_t threads,
+    uint64_t ops,
+    uint64_t bytes,
+    std::chrono::steady_clock::duration elapsed) {
+  auto seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(elapsed)
+          .count();
+  printf(
+      "  %-24s %3zu threads: %8.2f ms, %8.2f us/op, %8.1f MB/s\n",
+      name.str().c_str(),
+      threads,
+      seconds * 1000,
+      seconds * 1e6 / ops,
+      bytes / seconds / (1024 * 1024));
+}
+
+/**
+ * Run fn(threadIndex, opsForThisThread) on each of a number of threads, and
+ * return how long they took together.
+ */
+template <typename Fn>
+std::chrono::steady_clock::duration
+runThreads(size_t threads, uint64_t ops, Fn&& fn) {
+  vector<std::thread> workers;
+  folly::stop_watch<> timer;
+  for (size_t n = 0; n < threads; ++n) {
+    workers.emplace_back([&fn, n, threads, ops] {
+      fn(n, ops / threads + (n < ops % threads ? 1 : 0));
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return timer.elapsed();
+}
+
+/**
+ * The store under test, which can be closed and opened again to start with
+ * cold caches.  Reopening drops the store's own caches but not the
+ * kernel's page cache, so cold reads from disk stores are still faster
+ * than after a reboot.
+ */
+class StoreUnderTest {
+ public:
+  StoreUnderTest(StringPiece impl, AbsolutePathPiece dir)
+      : impl_(impl.str()), dir_(dir) {
+    open();
+  }
+
+  const string& getName() const {
+    return impl_;
+  }
+
+  const shared_ptr<LocalStore>& get() const {
+    return store_;
+  }
+
+  bool canReopen() const {
+    return impl_ != "memory";
+  }
+
+  void reopen() {
+    store_->close();
+    store_.reset();
+    open();
+  }
+
+ private:
+  void open() {
+    if (impl_ == "memory") {
+      store_ = std::make_shared<MemoryLocalStore>();
+    } else if (impl_ == "rocksdb") {
+      store_ = std::make_shared<RocksDbLocalStore>(dir_ + "rocksdb"_pc);
+    } else if (impl_ == "sqlite") {
+      store_ = std::make_shared<SqliteLocalStore>(dir_ + "sqlite"_pc);
+    } else {
+      throw std::invalid_argument("unknown store " + impl_);
+    }
+  }
+
+  const string impl_;
+  const AbsolutePath dir_;
+  shared_ptr<LocalStore> store_;
+};
+
+class BlobWorkload {
+ public:
+  explicit BlobWorkload(size_t count) : sizes_(makeObjectSizes(count)) {
+    keys_.reserve(count);
+    for (size_t n = 0; n < count; ++n) {
+      keys_.push_back(makeKey(n));
+    }
+  }
+
+  size_t size() const {
+    return keys_.size();
+  }
+  const Hash& getKey(size_t index) const {
+    return keys_[index];
+  }
+  size_t getSize(size_t index) const {
+    return sizes_[index];
+  }
+
+  void put(LocalStore& store) const {
+    uint64_t bytes = 0;
+    auto elapsed = runThreads(1, size(), [&](size_t, uint64_t) {
+      for (size_t n = 0; n < size(); ++n) {
+        auto contents = makeContents(n, sizes_[n]);
+        store.put(KeySpace::BlobFamily, keys_[n], StringPiece{contents});
+        bytes += contents.size();
+      }
+    });
+    report("put", 1, size(), bytes, elapsed);
+  }
+
+  /**
+   * Read random blobs from the first range of them.
+   */
+  void get(LocalStore& store, StringPiece name, size_t range, size_t threads)
+      const {
+    std::atomic<uint64_t> bytes{0};
+    auto elapsed =
+        runThreads(threads, FLAGS_reads, [&](size_t n, uint64_t ops) {
+          std::mt19937_64 rng{n};
+          uint64_t threadBytes = 0;
+          for (uint64_t op = 0; op < ops; ++op) {
+            auto result =
+                store.get(KeySpace::BlobFamily, keys_[rng() % range]);
+            threadBytes += result.bytes().size();
+          }
+          bytes += threadBytes;
+        });
+    report(name, threads, FLAGS_reads, bytes, elapsed);
+  }
+
+  void getBatch(LocalStore& store, size_t threads) const {
+    const size_t batchSize = FLAGS_batch_size;
+    const uint64_t batches = FLAGS_reads / batchSize;
+    std::atomic<uint64_t> bytes{0};
+    auto elapsed = runThreads(threads, batches, [&](size_t n, uint64_t ops) {
+      std::mt19937_64 rng{n};
+      uint64_t threadBytes = 0;
+      vector<ByteRange> batch(batchSize);
+      for (uint64_t op = 0; op < ops; ++op) {
+        for (auto& key : batch) {
+          key = keys_[rng() % size()].getBytes();
+        }
+        for (const auto& result :
+             store.getBatch(KeySpace::BlobFamily, batch).get()) {
+          threadBytes += result.bytes().size();
+        }
+      }
+      bytes += threadBytes;
+    });
+    report("getBatch", threads, batches * batchSize, bytes, elapsed);
+  }
+
+  /**
+   * Check for keys of which half are present.
+   */
+  void hasKey(LocalStore& store, size_t threads) const {
+    auto elapsed =
+        runThreads(threads, FLAGS_reads, [&](size_t n, uint64_t ops) {
+          std::mt19937_64 rng{n};
+          for (uint64_t op = 0; op < ops; ++op) {
+            auto index = rng() % (size() * 2);
+            auto key = index < size() ? keys_[index] : makeKey(index);
+            (void)store.hasKey(KeySpace::BlobFamily, key);
+          }
+        });
+    report("hasKey", threads, FLAGS_reads, 0, elapsed);
+  }
+
+ private:
+  vector<Hash> keys_;
+  vector<size_t> sizes_;
+};
+
+class TreeWorkload {
+ public:
+  explicit TreeWorkload(size_t count) {
+    ids_.reserve(count);
+    for (size_t n = 0; n < count; ++n) {
+      vector<TreeEntry> entries;
+      for (int entry = 0; entry < FLAGS_tree_entries; ++entry) {
+        entries.emplace_back(
+            makeKey(n * FLAGS_tree_entries + entry),
+            folly::sformat("source_file_{:04d}.cpp", entry),
+            entry % 8 == 0 ? TreeEntryType::TREE
+                           : TreeEntryType::REGULAR_FILE);
+      }
+      trees_.emplace_back(std::move(entries), makeKey(count * 1000 + n));
+    }
+  }
+
+  void put(LocalStore& store) {
+    auto elapsed = runThreads(1, trees_.size(), [&](size_t, uint64_t) {
+      for (const auto& tree : trees_) {
+        ids_.push_back(store.putTree(&tree));
+      }
+    });
+    report("putTree", 1, trees_.size(), 0, elapsed);
+  }
+
+  /**
+   * Load and decode random trees, either into Tree objects or as TreeViews.
+   */
+  void get(LocalStore& store, bool useViews, size_t threads) const {
+    auto elapsed =
+        runThreads(threads, FLAGS_reads, [&](size_t n, uint64_t ops) {
+          std::mt19937_64 rng{n};
+          for (uint64_t op = 0; op < ops; ++op) {
+            const auto& id = ids_[rng() % ids_.size()];
+            if (useViews) {
+              (void)store.getTreeView(id).get()->size();
+            } else {
+              (void)store.getTree(id).get()->getTreeEntries().size();
+            }
+          }
+        });
+    report(
+        useViews ? "getTreeView" : "getTree",
+        threads,
+        FLAGS_reads,
+        0,
+        elapsed);
+  }
+
+ private:
+  vector<Tree> trees_;
+  vector<Hash> ids_;
+};
+
+/**
+ * A BackingStore that adds a fixed latency to every fetch from another one,
+ * to stand in for the network round trip to a real source control server.
+ */
+class DelayedBackingStore : public BackingStore {
+ public:
+  DelayedBackingStore(
+      shared_ptr<BackingStore> store,
+      std::chrono::milliseconds latency)
+      : store_(std::move(store)), latency_(latency) {}
+
+  Future<std::unique_ptr<Tree>> getTree(
+      const Hash& id,
+      ImportPriority priority) override {
+    return folly::futures::sleep(latency_).then(
+        [store = store_, id, priority] {
+          return store->getTree(id, priority);
+        });
+  }
+  Future<std::unique_ptr<Blob>> getBlob(
+      const Hash& id,
+      ImportPriority priority) override {
+    return folly::futures::sleep(latency_).then(
+        [store = store_, id, priority] {
+          return store->getBlob(id, priority);
+        });
+  }
+  Future<std::unique_ptr<Tree>> getTreeForCommit(
+      const Hash& commitID) override {
+    return folly::futures::sleep(latency_).then(
+        [store = store_, commitID] {
+          return store->getTreeForCommit(commitID);
+        });
+  }
+
+ private:
+  const shared_ptr<BackingStore> store_;
+  const std::chrono::milliseconds latency_;
+};
+
+/**
+ * Fetch blobs through an ObjectStore, a window of them at a time, first
+ * from the backing store and then again from the LocalStore.
+ */
+void benchmarkObjectStore(const shared_ptr<LocalStore>& localStore) {
+  auto fakeStore = std::make_shared<FakeBackingStore>(localStore);
+  auto sizes = makeObjectSizes(FLAGS_backing_store_fetches);
+  vector<Hash> ids;
+  uint64_t totalBytes = 0;
+  for (size_t n = 0; n < sizes.size(); ++n) {
+    // Keys past those of the BlobWorkload, so that none are already local.
+    auto id = makeKey(1000000000 + n);
+    fakeStore->putBlob(id, makeContents(n, sizes[n]))->setReady();
+    ids.push_back(id);
+    totalBytes += sizes[n];
+  }
+  ObjectStore store{
+      localStore,
+      std::make_shared<DelayedBackingStore>(
+          fakeStore,
+          std::chrono::milliseconds{FLAGS_backing_store_latency_ms})};
+
+  auto fetchAll = [&](StringPiece name) {
+    folly::stop_watch<> timer;
+    const size_t window = FLAGS_backing_store_concurrency;
+    for (size_t begin = 0; begin < ids.size(); begin += window) {
+      vector<Future<shared_ptr<const Blob>>> futures;
+      for (size_t n = begin; n < std::min(begin + window, ids.size()); ++n) {
+        futures.push_back(store.getBlob(ids[n]));
+      }
+      folly::collect(futures).get();
+    }
+    report(name, window, ids.size(), totalBytes, timer.elapsed());
+  };
+  fetchAll("ObjectStore cold");
+  fetchAll("ObjectStore warm");
+}
+
+void benchmarkStore(StoreUnderTest& store, const vector<size_t>& threadCounts) {
+  printf("%s:\n", store.getName().c_str());
+
+  BlobWorkload blobs{static_cast<size_t>(FLAGS_objects)};
+  blobs.put(*store.get());
+  TreeWorkload trees{static_cast<size_t>(FLAGS_trees)};
+  trees.put(*store.get());
+
+  const size_t hotObjects =
+      std::min<size_t>(FLAGS_hot_objects, blobs.size());
+  for (auto threads : threadCounts) {
+    if (store.canReopen()) {
+      store.reopen();
+    }
+    blobs.get(*store.get(), "get cold", blobs.size(), threads);
+    // Warm the caches with the hot blobs before timing reads of them.
+    blobs.get(*store.get(), "get hot (warmup)", hotObjects, threads);
+    blobs.get(*store.get(), "get hot", hotObjects, threads);
+    blobs.getBatch(*store.get(), threads);
+    blobs.hasKey(*store.get(), threads);
+    trees.get(*store.get(), /* useViews */ false, threads);
+    trees.get(*store.get(), /* useViews */ true, threads);
+  }
+  benchmarkObjectStore(store.get());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+
+  folly::Optional<folly::test::TemporaryDirectory> tempDir;
+  AbsolutePath dir;
+  if (FLAGS_store_path.empty()) {
+    tempDir.emplace("eden_store_benchmark");
+    dir = AbsolutePath{tempDir->path().string()};
+  } else {
+    dir = normalizeBestEffort(FLAGS_store_path.c_str());
+  }
+
+  auto threadCounts = parseCounts(FLAGS_thread_counts);
+  vector<StringPiece> impls;
+  folly::split(',', FLAGS_stores, impls, /* ignoreEmpty */ true);
+  for (auto impl : impls) {
+    StoreUnderTest store{impl, dir};
+    benchmarkStore(store, threadCounts);
+  }
+
+  return 0;
+}
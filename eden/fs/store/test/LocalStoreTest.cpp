@@ -13,16 +13,19 @@
 #include <folly/experimental/TestUtil.h>
 #include <folly/futures/Future.h>
 #include <folly/io/IOBuf.h>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include <stdexcept>
 #include "eden/fs/model/Blob.h"
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/model/Tree.h"
 #include "eden/fs/model/TreeEntry.h"
+#include "eden/fs/model/git/GitTree.h"
 #include "eden/fs/store/MemoryLocalStore.h"
 #include "eden/fs/store/RocksDbLocalStore.h"
 #include "eden/fs/store/SqliteLocalStore.h"
 #include "eden/fs/store/StoreResult.h"
+#include "eden/fs/store/TreeView.h"
 
 using namespace facebook::eden;
 using namespace std::chrono_literals;
@@ -34,6 +37,9 @@ using folly::test::TemporaryDirectory;
 using std::string;
 using KeySpace = facebook::eden::LocalStore::KeySpace;
 
+DECLARE_bool(local_store_dedupe_blobs);
+DECLARE_uint64(local_store_compress_blobs_over);
+
 enum class StoreImpl {
   Memory,
   RocksDB,
@@ -89,6 +95,143 @@ TEST_P(LocalStoreTest, testReadAndWriteBlob) {
   EXPECT_EQ(contents.size(), retreivedMetadata.value().size);
 }
 
+TEST_P(LocalStoreTest, testPutBlobMetadataWithoutBlob) {
+  Hash hash("3a8f8eb91101860fd8484154885838bf322964d0");
+  Hash sha1("0123456789abcdef0123456789abcdef01234567");
+  store_->putBlobMetadata(hash, BlobMetadata{sha1, 1234});
+
+  EXPECT_TRUE(nullptr == store_->getBlob(hash).get(10s));
+  auto retreivedMetadata = store_->getBlobMetadata(hash).get(10s);
+  ASSERT_TRUE(retreivedMetadata.hasValue());
+  EXPECT_EQ(sha1, retreivedMetadata.value().sha1);
+  EXPECT_EQ(1234, retreivedMetadata.value().size);
+}
+
+TEST_P(LocalStoreTest, testReadBlobChunks) {
+  Hash hash("3a8f8eb91101860fd8484154885838bf322964d0");
+
+  // Two and a half chunks, split across IOBufs that do not line up with the
+  // chunk boundaries.
+  string contents;
+  for (size_t n = 0; contents.size() < LocalStore::kBlobChunkSize * 5 / 2;
+       ++n) {
+    contents.append(folly::to<string>(n, "\n"));
+  }
+  auto buf = IOBuf::copyBuffer(contents.data(), contents.size() / 3);
+  buf->prependChain(IOBuf::copyBuffer(
+      contents.data() + contents.size() / 3,
+      contents.size() - contents.size() / 3));
+  auto inBlob = Blob{hash, std::move(*buf)};
+  auto metadata = store_->putBlobChunks(hash, &inBlob);
+  EXPECT_EQ(contents.size(), metadata.size);
+  EXPECT_EQ(Hash::sha1(folly::ByteRange{StringPiece{contents}}), metadata.sha1);
+
+  auto readRange = [&](uint64_t offset, size_t length) {
+    auto range =
+        store_->getBlobRange(hash, contents.size(), offset, length).get(10s);
+    EXPECT_TRUE(range);
+    return range ? range->moveToFbString().toStdString() : string{};
+  };
+  EXPECT_EQ(contents.substr(10, 100), readRange(10, 100));
+  auto boundary = LocalStore::kBlobChunkSize - 5;
+  EXPECT_EQ(contents.substr(boundary, 10), readRange(boundary, 10));
+  auto tail = contents.size() - 20;
+  EXPECT_EQ(contents.substr(tail), readRange(tail, 50));
+  EXPECT_EQ("", readRange(contents.size(), 10));
+
+  // getBlob() reassembles the chunks.
+  auto outBlob = store_->getBlob(hash).get(10s);
+  ASSERT_TRUE(outBlob);
+  EXPECT_EQ(
+      contents, outBlob->getContents().clone()->moveToFbString().toStdString());
+
+  Hash missing("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+  auto missingRange = store_->getBlobRange(missing, contents.size(), 0, 10);
+  EXPECT_TRUE(nullptr == missingRange.get(10s));
+}
+
+TEST_P(LocalStoreTest, putBlobsMatchesPutBlob) {
+  std::vector<Blob> blobs;
+  blobs.emplace_back(
+      Hash("0123456789abcdef0123456789abcdef01234567"),
+      std::move(*IOBuf::copyBuffer(StringPiece("first\n"))));
+  blobs.emplace_back(
+      Hash("76543210fedcba9876543210fedcba9876543210"),
+      std::move(*IOBuf::copyBuffer(StringPiece(""))));
+  std::vector<const Blob*> blobPtrs{&blobs[0], &blobs[1]};
+
+  auto batch = store_->beginWrite();
+  auto results = batch->putBlobs(blobPtrs);
+  batch->flush();
+
+  ASSERT_EQ(2, results.size());
+  for (size_t n = 0; n < blobs.size(); ++n) {
+    const auto& contents = blobs[n].getContents();
+    EXPECT_EQ(Hash::sha1(&contents), results[n].sha1);
+    EXPECT_EQ(contents.computeChainDataLength(), results[n].size);
+
+    auto metadata = store_->getBlobMetadata(blobs[n].getHash()).get(10s);
+    ASSERT_TRUE(metadata.hasValue());
+    EXPECT_EQ(results[n].sha1, metadata->sha1);
+    auto outBlob = store_->getBlob(blobs[n].getHash()).get(10s);
+    ASSERT_TRUE(outBlob);
+    EXPECT_TRUE(folly::IOBufEqualTo{}(contents, outBlob->getContents()));
+  }
+}
+
+TEST_P(LocalStoreTest, testBlobsWithTheSameContentsShareStorage) {
+  Hash oldHash("3a8f8eb91101860fd8484154885838bf322964d0");
+  StringPiece oldContents("stored before deduplication\n");
+  auto oldBlob = Blob{
+      oldHash, IOBuf{IOBuf::WRAP_BUFFER, folly::ByteRange{oldContents}}};
+  store_->putBlob(oldHash, &oldBlob);
+
+  gflags::FlagSaver flagSaver;
+  FLAGS_local_store_dedupe_blobs = true;
+  FLAGS_local_store_compress_blobs_over = 1024;
+
+  auto checkSharedBlobs = [&](const string& contents) {
+    Hash hash1("0123456789abcdef0123456789abcdef01234567");
+    Hash hash2("76543210fedcba9876543210fedcba9876543210");
+    auto blob1 = Blob{hash1, std::move(*IOBuf::copyBuffer(contents))};
+    auto blob2 = Blob{hash2, std::move(*IOBuf::copyBuffer(contents))};
+    auto metadata = store_->putBlob(hash1, &blob1);
+    EXPECT_EQ(metadata.sha1, store_->putBlob(hash2, &blob2).sha1);
+    EXPECT_EQ(contents.size(), metadata.size);
+    EXPECT_TRUE(store_->hasKey(KeySpace::BlobContentFamily, metadata.sha1));
+
+    // Each ID's entry only refers to the shared contents.
+    auto reference = store_->get(KeySpace::BlobFamily, hash1);
+    ASSERT_TRUE(reference.isValid());
+    EXPECT_GT(64, reference.bytes().size());
+
+    for (const auto& hash : {hash1, hash2}) {
+      auto outBlob = store_->getBlob(hash).get(10s);
+      ASSERT_TRUE(outBlob);
+      EXPECT_EQ(hash, outBlob->getHash());
+      EXPECT_EQ(
+          contents,
+          outBlob->getContents().clone()->moveToFbString().toStdString());
+    }
+
+    // If the contents are discarded, the blobs have to be fetched again.
+    store_->clearKeySpace(KeySpace::BlobContentFamily);
+    EXPECT_TRUE(nullptr == store_->getBlob(hash1).get(10s));
+  };
+
+  // Below the compression threshold.
+  checkSharedBlobs("small and uncompressed\n");
+  // Above it, and compressible.
+  checkSharedBlobs(string(64 * 1024, 'x'));
+
+  // Blobs stored in git's format can still be read.
+  auto outBlob = store_->getBlob(oldHash).get(10s);
+  ASSERT_TRUE(outBlob);
+  EXPECT_EQ(
+      oldContents,
+      outBlob->getContents().clone()->moveToFbString().toStdString());
+}
+
 TEST_P(LocalStoreTest, testReadNonexistent) {
   Hash hash("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
   EXPECT_TRUE(nullptr == store_->getBlob(hash).get(10s));
@@ -149,6 +292,96 @@ TEST_P(LocalStoreTest, testReadsAndWriteTree) {
   EXPECT_EQ(TreeEntryType::REGULAR_FILE, readmeEntry.getType());
 }
 
+TEST_P(LocalStoreTest, testReadAndWriteTree) {
+  Hash hash("8e073e366ed82de6465d1209d3f07da7eebabb93");
+  std::vector<TreeEntry> entries;
+  entries.emplace_back(
+      Hash("3a8f8eb91101860fd8484154885838bf322964d0"),
+      "README.md",
+      TreeEntryType::REGULAR_FILE);
+  entries.emplace_back(
+      Hash("e95798e17f694c227b7a8441cc5c7dae50a187d0"),
+      "lib",
+      TreeEntryType::TREE);
+  entries.emplace_back(
+      Hash("006babcf5734d028098961c6f4b6b6719656924b"),
+      "a_name_too_long_to_be_stored_inline_in_a_string",
+      TreeEntryType::EXECUTABLE_FILE);
+  entries.emplace_back(
+      Hash("582591e0f0d92cb63a85156e39abd43ebf103edc"),
+      "link",
+      TreeEntryType::SYMLINK);
+  Tree inTree{std::move(entries), hash};
+
+  EXPECT_EQ(hash, store_->putTree(&inTree));
+  auto tree = store_->getTree(hash).get(10s);
+  ASSERT_TRUE(tree);
+  EXPECT_EQ(inTree, *tree);
+
+  // Trees are no longer stored in git's format.
+  auto data = store_->get(KeySpace::TreeFamily, hash);
+  ASSERT_TRUE(data.isValid());
+  EXPECT_NE('1', data.piece()[0]);
+}
+
+TEST_P(LocalStoreTest, testTreeWithoutHashIsIdentifiedByGitTreeHash) {
+  std::vector<TreeEntry> entries;
+  entries.emplace_back(
+      Hash("3a8f8eb91101860fd8484154885838bf322964d0"),
+      "README.md",
+      TreeEntryType::REGULAR_FILE);
+  Tree inTree{std::move(entries)};
+
+  GitTreeSerializer serializer;
+  serializer.addEntry(inTree.getEntryAt(0));
+  auto gitTree = serializer.finalize();
+
+  auto hash = store_->putTree(&inTree);
+  EXPECT_EQ(Hash::sha1(&gitTree), hash);
+  auto tree = store_->getTree(hash).get(10s);
+  ASSERT_TRUE(tree);
+  EXPECT_EQ(hash, tree->getHash());
+  EXPECT_EQ(inTree.getTreeEntries(), tree->getTreeEntries());
+}
+
+TEST_P(LocalStoreTest, testGetTreeView) {
+  Hash hash("8e073e366ed82de6465d1209d3f07da7eebabb93");
+  EXPECT_FALSE(store_->getTreeView(hash).get(10s).hasValue());
+
+  std::vector<TreeEntry> entries;
+  entries.emplace_back(
+      Hash("3a8f8eb91101860fd8484154885838bf322964d0"),
+      "README.md",
+      TreeEntryType::REGULAR_FILE);
+  Tree inTree{std::move(entries), hash};
+  store_->putTree(&inTree);
+
+  auto view = store_->getTreeView(hash).get(10s);
+  ASSERT_TRUE(view.hasValue());
+  ASSERT_EQ(1, view->size());
+  EXPECT_EQ(inTree.getEntryAt(0), view->getEntryAt(0).toTreeEntry());
+
+  // Trees stored in git's format can be viewed too.
+  GitTreeSerializer serializer;
+  serializer.addEntry(inTree.getEntryAt(0));
+  auto gitTree = serializer.finalize();
+  store_->put(KeySpace::TreeFamily, hash.getBytes(), gitTree.coalesce());
+  view = store_->getTreeView(hash).get(10s);
+  ASSERT_TRUE(view.hasValue());
+  ASSERT_EQ(1, view->size());
+  EXPECT_EQ(inTree.getEntryAt(0), view->getEntryAt(0).toTreeEntry());
+}
+
+TEST_P(LocalStoreTest, testReadCorruptTree) {
+  Hash hash("8e073e366ed82de6465d1209d3f07da7eebabb93");
+  // A header promising more entries than there are.
+  store_->put(
+      KeySpace::TreeFamily,
+      hash.getBytes(),
+      StringPiece{"\xed\x01\x00\x00\x00\x05", 6});
+  EXPECT_THROW(store_->getTree(hash).get(10s), std::invalid_argument);
+}
+
 TEST_P(LocalStoreTest, testGetResult) {
   StringPiece key1 = "foo";
   StringPiece key2 = "bar";
@@ -224,6 +457,115 @@ TEST_P(LocalStoreTest, testClearKeySpace) {
   EXPECT_TRUE(store_->hasKey(KeySpace::TreeFamily, "tree"_sp));
 }
 
+TEST_P(LocalStoreTest, testFlushAsync) {
+  auto batch = store_->beginWrite();
+  batch->put(KeySpace::BlobFamily, "key1"_sp, "blob1"_sp);
+  batch->put(KeySpace::HgProxyHashFamily, "key2"_sp, "proxy"_sp);
+  auto future = batch->flushAsync();
+
+  // The batch is immediately reusable.
+  batch->put(KeySpace::BlobFamily, "key3"_sp, "blob3"_sp);
+
+  std::move(future).get(10s);
+  EXPECT_EQ("blob1", store_->get(KeySpace::BlobFamily, "key1"_sp).piece());
+  EXPECT_EQ(
+      "proxy", store_->get(KeySpace::HgProxyHashFamily, "key2"_sp).piece());
+
+  batch->flush();
+  EXPECT_EQ("blob3", store_->get(KeySpace::BlobFamily, "key3"_sp).piece());
+}
+
+TEST_P(LocalStoreTest, testFlushWaitsForAutomaticFlushes) {
+  // Use a tiny buffer so that every put triggers an automatic flush.
+  auto batch = store_->beginWrite(1);
+  for (int i = 0; i < 20; ++i) {
+    batch->put(
+        KeySpace::BlobFamily,
+        StringPiece{folly::to<string>("key", i)},
+        StringPiece{folly::to<string>("value", i)});
+  }
+  batch->flush();
+
+  for (int i = 0; i < 20; ++i) {
+    auto key = folly::to<string>("key", i);
+    EXPECT_EQ(
+        folly::to<string>("value", i),
+        store_->get(KeySpace::BlobFamily, StringPiece{key}).piece());
+  }
+}
+
+TEST_P(LocalStoreTest, testGetBatch) {
+  store_->put(KeySpace::BlobFamily, "key1"_sp, "blob1"_sp);
+  store_->put(KeySpace::BlobFamily, "key3"_sp, "blob3"_sp);
+
+  std::vector<folly::ByteRange> keys{folly::ByteRange{"key1"_sp},
+                                     folly::ByteRange{"key2"_sp},
+                                     folly::ByteRange{"key3"_sp}};
+  auto results = store_->getBatch(KeySpace::BlobFamily, keys).get(10s);
+  ASSERT_EQ(3, results.size());
+  EXPECT_EQ("blob1", results[0].piece());
+  EXPECT_FALSE(results[1].isValid());
+  EXPECT_EQ("blob3", results[2].piece());
+}
+
+TEST_P(LocalStoreTest, testHasKeyBatch) {
+  store_->put(KeySpace::BlobFamily, "key1"_sp, "blob1"_sp);
+  store_->put(KeySpace::BlobFamily, "key3"_sp, "blob3"_sp);
+  store_->put(KeySpace::TreeFamily, "key2"_sp, "treeContents"_sp);
+
+  std::vector<folly::ByteRange> keys{folly::ByteRange{"key1"_sp},
+                                     folly::ByteRange{"key2"_sp},
+                                     folly::ByteRange{"key3"_sp},
+                                     folly::ByteRange{"key4"_sp}};
+  auto found = store_->hasKeyBatch(KeySpace::BlobFamily, keys);
+  EXPECT_EQ((std::vector<bool>{true, false, true, false}), found);
+
+  EXPECT_TRUE(store_->hasKeyBatch(KeySpace::BlobFamily, {}).empty());
+}
+
+TEST_P(LocalStoreTest, testReadsDuringScan) {
+  store_->put(KeySpace::BlobFamily, "key1"_sp, "blob1"_sp);
+  EXPECT_FALSE(LocalStore::isScanning());
+  {
+    LocalStore::ScanScope scan;
+    EXPECT_TRUE(LocalStore::isScanning());
+    EXPECT_EQ("blob1", store_->get(KeySpace::BlobFamily, "key1"_sp).piece());
+    std::vector<folly::ByteRange> keys{folly::ByteRange{"key1"_sp},
+                                       folly::ByteRange{"key2"_sp}};
+    auto results = store_->getBatch(KeySpace::BlobFamily, keys).get(10s);
+    ASSERT_EQ(2, results.size());
+    EXPECT_EQ("blob1", results[0].piece());
+    EXPECT_FALSE(results[1].isValid());
+    EXPECT_EQ(
+        (std::vector<bool>{true, false}),
+        store_->hasKeyBatch(KeySpace::BlobFamily, keys));
+  }
+  EXPECT_FALSE(LocalStore::isScanning());
+}
+
+TEST_P(LocalStoreTest, testEngineStats) {
+  EXPECT_TRUE(store_->getEngineStats().empty());
+  store_->put(KeySpace::BlobFamily, "key1"_sp, "blob1"_sp);
+  EXPECT_EQ("blob1", store_->get(KeySpace::BlobFamily, "key1"_sp).piece());
+  store_->refreshEngineStats();
+
+  auto stats = store_->getEngineStats();
+  switch (GetParam()) {
+    case StoreImpl::Memory:
+      EXPECT_TRUE(stats.empty());
+      break;
+    case StoreImpl::RocksDB:
+      EXPECT_EQ(1, stats.count("blob.memtable_bytes"));
+      EXPECT_EQ(1, stats.count("tree.sst_bytes"));
+      EXPECT_EQ(1, stats.count("block_cache.hits"));
+      break;
+    case StoreImpl::Sqlite:
+      EXPECT_LT(0, stats["sqlite.db_bytes"]);
+      EXPECT_EQ(1, stats.count("sqlite.cache_hits"));
+      break;
+  }
+}
+
 INSTANTIATE_TEST_CASE_P(
     Memory,
     LocalStoreTest,
@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/MemoryLocalStore.h"
+
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+#include "eden/fs/store/StoreResult.h"
+
+using namespace facebook::eden;
+using folly::StringPiece;
+using KeySpace = LocalStore::KeySpace;
+
+namespace {
+std::string makeKey(int i) {
+  return folly::to<std::string>("key", i);
+}
+} // namespace
+
+TEST(MemoryLocalStore, unboundedStoreKeepsEverything) {
+  MemoryLocalStore store;
+  for (int i = 0; i < 1000; ++i) {
+    store.put(KeySpace::BlobFamily, StringPiece{makeKey(i)}, StringPiece{"x"});
+  }
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(store.hasKey(KeySpace::BlobFamily, StringPiece{makeKey(i)}));
+  }
+}
+
+TEST(MemoryLocalStore, boundedStoreEvictsEphemeralEntries) {
+  const std::string value(100, 'x');
+  MemoryLocalStore store{10 * 1024};
+  for (int i = 0; i < 1000; ++i) {
+    store.put(
+        KeySpace::BlobFamily, StringPiece{makeKey(i)}, StringPiece{value});
+  }
+
+  size_t numPresent = 0;
+  for (int i = 0; i < 1000; ++i) {
+    if (store.hasKey(KeySpace::BlobFamily, StringPiece{makeKey(i)})) {
+      ++numPresent;
+    }
+  }
+  EXPECT_LT(numPresent, 1000);
+  EXPECT_GT(numPresent, 0);
+  // The most recently stored entry is never evicted.
+  EXPECT_TRUE(store.hasKey(KeySpace::BlobFamily, StringPiece{makeKey(999)}));
+}
+
+TEST(MemoryLocalStore, boundedStoreNeverEvictsPersistentEntries) {
+  const std::string value(100, 'x');
+  MemoryLocalStore store{1024};
+  for (int i = 0; i < 1000; ++i) {
+    store.put(
+        KeySpace::HgProxyHashFamily,
+        StringPiece{makeKey(i)},
+        StringPiece{value});
+  }
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(
+        store.hasKey(KeySpace::HgProxyHashFamily, StringPiece{makeKey(i)}));
+  }
+}
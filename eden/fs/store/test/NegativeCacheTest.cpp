@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/NegativeCache.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+#include "eden/fs/testharness/TestUtil.h"
+
+using namespace facebook::eden;
+using namespace std::chrono_literals;
+using KeySpace = LocalStore::KeySpace;
+
+TEST(NegativeCache, remembersMissingObjects) {
+  NegativeCache cache{1h};
+  auto id = makeTestHash("1");
+  EXPECT_FALSE(cache.contains(KeySpace::TreeFamily, id));
+
+  cache.insert(KeySpace::TreeFamily, id);
+  EXPECT_TRUE(cache.contains(KeySpace::TreeFamily, id));
+  EXPECT_EQ(1, cache.getHitCount());
+}
+
+TEST(NegativeCache, keySpacesAreIndependent) {
+  NegativeCache cache{1h};
+  auto id = makeTestHash("1");
+  cache.insert(KeySpace::TreeFamily, id);
+  EXPECT_FALSE(cache.contains(KeySpace::BlobFamily, id));
+  EXPECT_TRUE(cache.contains(KeySpace::TreeFamily, id));
+}
+
+TEST(NegativeCache, entriesExpire) {
+  NegativeCache cache{1ms};
+  auto id = makeTestHash("1");
+  cache.insert(KeySpace::BlobFamily, id);
+  std::this_thread::sleep_for(5ms);
+  EXPECT_FALSE(cache.contains(KeySpace::BlobFamily, id));
+  EXPECT_EQ(0, cache.getHitCount());
+  EXPECT_EQ(0, cache.size());
+}
+
+TEST(NegativeCache, zeroTTLDisablesCaching) {
+  NegativeCache cache{0ms};
+  auto id = makeTestHash("1");
+  cache.insert(KeySpace::BlobFamily, id);
+  EXPECT_FALSE(cache.contains(KeySpace::BlobFamily, id));
+  EXPECT_EQ(0, cache.size());
+}
+
+TEST(NegativeCache, clearForgetsEverything) {
+  NegativeCache cache{1h};
+  cache.insert(KeySpace::BlobFamily, makeTestHash("1"));
+  cache.insert(KeySpace::TreeFamily, makeTestHash("2"));
+  cache.clear();
+  EXPECT_FALSE(cache.contains(KeySpace::BlobFamily, makeTestHash("1")));
+  EXPECT_FALSE(cache.contains(KeySpace::TreeFamily, makeTestHash("2")));
+}
+
+TEST(NegativeCache, sizeIsBounded) {
+  NegativeCache cache{1h, 2};
+  cache.insert(KeySpace::BlobFamily, makeTestHash("1"));
+  cache.insert(KeySpace::BlobFamily, makeTestHash("2"));
+  cache.insert(KeySpace::BlobFamily, makeTestHash("3"));
+  EXPECT_EQ(2, cache.size());
+  EXPECT_FALSE(cache.contains(KeySpace::BlobFamily, makeTestHash("1")));
+  EXPECT_TRUE(cache.contains(KeySpace::BlobFamily, makeTestHash("3")));
+}
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/ObjectCache.h"
+
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include "eden/fs/model/Blob.h"
+#include "eden/fs/testharness/TestUtil.h"
+
+using namespace facebook::eden;
+using folly::IOBuf;
+
+namespace {
+std::shared_ptr<const Blob> makeBlob(folly::StringPiece hash, size_t size) {
+  return std::make_shared<Blob>(
+      makeTestHash(hash), IOBuf{IOBuf::COPY_BUFFER, std::string(size, 'x')});
+}
+
+std::shared_ptr<const Blob> makeBlobWithContents(
+    folly::StringPiece hash,
+    folly::StringPiece contents) {
+  return std::make_shared<Blob>(
+      makeTestHash(hash), IOBuf{IOBuf::COPY_BUFFER, contents});
+}
+} // namespace
+
+TEST(ObjectCache, getReturnsNullForMissingObject) {
+  ObjectCache<Blob> cache{1024 * 1024};
+  EXPECT_EQ(nullptr, cache.get(makeTestHash("1")));
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(0, stats.hitCount);
+  EXPECT_EQ(1, stats.missCount);
+}
+
+TEST(ObjectCache, getReturnsInsertedObject) {
+  ObjectCache<Blob> cache{1024 * 1024};
+  auto blob = makeBlobWithContents("1", "hello world");
+  cache.insert(blob);
+
+  EXPECT_EQ(blob, cache.get(makeTestHash("1")));
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(1, stats.hitCount);
+  EXPECT_EQ(0, stats.missCount);
+  EXPECT_EQ(1, stats.objectCount);
+  EXPECT_EQ(blob->getSizeBytes(), stats.totalSizeBytes);
+}
+
+TEST(ObjectCache, evictsLeastRecentlyUsedObjects) {
+  auto blobSize = makeBlobWithContents("0", "0123456789")->getSizeBytes();
+  // Use a single shard so that the eviction order is deterministic.
+  ObjectCache<Blob> cache{3 * blobSize, 1};
+
+  cache.insert(makeBlobWithContents("1", "0123456789"));
+  cache.insert(makeBlobWithContents("2", "0123456789"));
+  cache.insert(makeBlobWithContents("3", "0123456789"));
+
+  // Touch blob 1 so that blob 2 becomes the least recently used.
+  EXPECT_NE(nullptr, cache.get(makeTestHash("1")));
+
+  cache.insert(makeBlobWithContents("4", "0123456789"));
+  EXPECT_NE(nullptr, cache.get(makeTestHash("1")));
+  EXPECT_EQ(nullptr, cache.get(makeTestHash("2")));
+  EXPECT_NE(nullptr, cache.get(makeTestHash("3")));
+  EXPECT_NE(nullptr, cache.get(makeTestHash("4")));
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(1, stats.evictionCount);
+  EXPECT_EQ(3, stats.objectCount);
+  EXPECT_LE(stats.totalSizeBytes, 3 * blobSize);
+}
+
+TEST(ObjectCache, doesNotCacheObjectsLargerThanShard) {
+  ObjectCache<Blob> cache{1024, 1};
+  cache.insert(makeBlob("1", 4096));
+  EXPECT_EQ(nullptr, cache.get(makeTestHash("1")));
+  EXPECT_EQ(0, cache.getStats().objectCount);
+}
+
+TEST(ObjectCache, zeroSizeDisablesCaching) {
+  ObjectCache<Blob> cache{0};
+  cache.insert(makeBlobWithContents("1", "x"));
+  EXPECT_EQ(nullptr, cache.get(makeTestHash("1")));
+}
+
+TEST(ObjectCache, clearRemovesAllObjects) {
+  ObjectCache<Blob> cache{1024 * 1024};
+  cache.insert(makeBlobWithContents("1", "one"));
+  cache.insert(makeBlobWithContents("2", "two"));
+  cache.clear();
+
+  EXPECT_EQ(nullptr, cache.get(makeTestHash("1")));
+  EXPECT_EQ(nullptr, cache.get(makeTestHash("2")));
+  auto stats = cache.getStats();
+  EXPECT_EQ(0, stats.objectCount);
+  EXPECT_EQ(0, stats.totalSizeBytes);
+}
@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/PathIndex.h"
+
+#include <folly/futures/Future.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include "eden/fs/store/MemoryLocalStore.h"
+#include "eden/fs/store/ObjectStore.h"
+#include "eden/fs/testharness/FakeBackingStore.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestUtil.h"
+
+using namespace facebook::eden;
+using namespace std::chrono_literals;
+using std::string;
+using std::vector;
+using ::testing::UnorderedElementsAre;
+
+namespace {
+const vector<string> kPaths{
+    "README",
+    "TARGETS",
+    "fbcode/TARGETS",
+    "fbcode/eden/TARGETS",
+    "fbcode/eden/eden.thrift",
+    "fbcode/eden/fs/main.cpp",
+    "fbcode/eden/.hidden/TARGETS",
+    "fbcode/eden/.config.thrift",
+    "fbcode/thrift/fb303.thrift",
+    "fbcode/thrift/not.thrift.bak",
+    "www/TARGETS.old",
+};
+
+vector<string> search(
+    const PathIndex& index,
+    folly::StringPiece glob,
+    bool includeDotfiles = false) {
+  auto query = PathIndex::parseGlob(glob);
+  EXPECT_TRUE(query.hasValue()) << glob;
+  vector<string> results;
+  if (query) {
+    for (auto path : index.search(*query, includeDotfiles)) {
+      results.push_back(path.stringPiece().str());
+    }
+  }
+  return results;
+}
+} // namespace
+
+TEST(PathIndex, findsFilesByBasename) {
+  auto index = PathIndex::fromPaths(makeTestHash("1"), kPaths);
+  EXPECT_EQ(kPaths.size(), index.size());
+  EXPECT_THAT(
+      search(index, "**/TARGETS"),
+      UnorderedElementsAre("TARGETS", "fbcode/TARGETS", "fbcode/eden/TARGETS"));
+  EXPECT_THAT(
+      search(index, "**/TARGETS", /*includeDotfiles=*/true),
+      UnorderedElementsAre(
+          "TARGETS",
+          "fbcode/TARGETS",
+          "fbcode/eden/TARGETS",
+          "fbcode/eden/.hidden/TARGETS"));
+  EXPECT_THAT(
+      search(index, "fbcode/eden/**/TARGETS"),
+      UnorderedElementsAre("fbcode/eden/TARGETS"));
+  EXPECT_THAT(search(index, "**/missing"), UnorderedElementsAre());
+  EXPECT_THAT(search(index, "www/**/TARGETS"), UnorderedElementsAre());
+}
+
+TEST(PathIndex, findsFilesBySuffix) {
+  auto index = PathIndex::fromPaths(makeTestHash("1"), kPaths);
+  EXPECT_THAT(
+      search(index, "**/*.thrift"),
+      UnorderedElementsAre(
+          "fbcode/eden/eden.thrift", "fbcode/thrift/fb303.thrift"));
+  EXPECT_THAT(
+      search(index, "**/*.thrift", /*includeDotfiles=*/true),
+      UnorderedElementsAre(
+          "fbcode/eden/eden.thrift",
+          "fbcode/eden/.config.thrift",
+          "fbcode/thrift/fb303.thrift"));
+  EXPECT_THAT(
+      search(index, "fbcode/thrift/**/*.thrift"),
+      UnorderedElementsAre("fbcode/thrift/fb303.thrift"));
+  EXPECT_THAT(
+      search(index, "**/*S"),
+      UnorderedElementsAre("TARGETS", "fbcode/TARGETS", "fbcode/eden/TARGETS"));
+  EXPECT_EQ(9, search(index, "**/*").size());
+}
+
+TEST(PathIndex, onlyParsesGlobsItCanAnswer) {
+  auto query = PathIndex::parseGlob("a/b/**/*.cpp");
+  ASSERT_TRUE(query.hasValue());
+  EXPECT_EQ(RelativePath{"a/b"}, query->directory);
+  EXPECT_EQ(".cpp", query->name);
+  EXPECT_TRUE(query->isSuffix);
+
+  EXPECT_FALSE(PathIndex::parseGlob("TARGETS").hasValue());
+  EXPECT_FALSE(PathIndex::parseGlob("*/TARGETS").hasValue());
+  EXPECT_FALSE(PathIndex::parseGlob("**/").hasValue());
+  EXPECT_FALSE(PathIndex::parseGlob("**/a/TARGETS").hasValue());
+  EXPECT_FALSE(PathIndex::parseGlob("**/*.{cpp,h}").hasValue());
+  EXPECT_FALSE(PathIndex::parseGlob("a*/**/TARGETS").hasValue());
+  EXPECT_FALSE(PathIndex::parseGlob("a/**/b/**/TARGETS").hasValue());
+  EXPECT_FALSE(PathIndex::parseGlob("ab**/TARGETS").hasValue());
+}
+
+TEST(PathIndex, roundTripsThroughSerialization) {
+  auto index = PathIndex::fromPaths(makeTestHash("1"), kPaths);
+  auto data = index.serialize();
+  auto copy =
+      PathIndex::deserialize(makeTestHash("1"), folly::StringPiece{data});
+  ASSERT_EQ(index.size(), copy.size());
+  for (size_t n = 0; n < index.size(); ++n) {
+    EXPECT_EQ(index.getPath(n), copy.getPath(n));
+  }
+  EXPECT_THAT(
+      search(copy, "**/*.thrift"),
+      UnorderedElementsAre(
+          "fbcode/eden/eden.thrift", "fbcode/thrift/fb303.thrift"));
+
+  EXPECT_THROW(
+      PathIndex::deserialize(
+          makeTestHash("1"), folly::StringPiece{data.substr(0, 20)}),
+      std::invalid_argument);
+  EXPECT_THROW(
+      PathIndex::deserialize(makeTestHash("1"), folly::StringPiece{data + "x"}),
+      std::invalid_argument);
+}
+
+TEST(PathIndex, buildsAndStoresTheIndexOfATree) {
+  auto localStore = std::make_shared<MemoryLocalStore>();
+  auto backingStore = std::make_shared<FakeBackingStore>(localStore);
+  ObjectStore store{localStore, backingStore};
+
+  FakeTreeBuilder builder;
+  for (const auto& path : kPaths) {
+    builder.setFile(path, "contents\n");
+  }
+  builder.finalize(backingStore, /*setReady=*/true);
+  auto rootTreeID = builder.getRoot()->get().getHash();
+
+  auto index = PathIndex::getOrBuild(&store, rootTreeID).get(1s);
+  EXPECT_EQ(kPaths.size(), index->size());
+  EXPECT_THAT(
+      search(*index, "**/TARGETS"),
+      UnorderedElementsAre("TARGETS", "fbcode/TARGETS", "fbcode/eden/TARGETS"));
+  EXPECT_TRUE(
+      localStore->hasKey(LocalStore::PathIndexFamily, rootTreeID.getBytes()));
+
+  // The second lookup reads the index back without fetching any trees.
+  auto trees = backingStore->getTreeFetchCount();
+  auto loaded = PathIndex::getOrBuild(&store, rootTreeID).get(1s);
+  EXPECT_EQ(trees, backingStore->getTreeFetchCount());
+  EXPECT_EQ(kPaths.size(), loaded->size());
+}
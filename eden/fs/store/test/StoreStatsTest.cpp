@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/StoreStats.h"
+
+#include <folly/futures/Promise.h>
+#include <gtest/gtest.h>
+#include "common/stats/ServiceData.h"
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/MemoryLocalStore.h"
+
+using namespace facebook::eden;
+using facebook::stats::ServiceData;
+
+namespace {
+int64_t getCounter(const std::string& name) {
+  return ServiceData::get()->getCounter(name);
+}
+} // namespace
+
+TEST(StoreStats, trackRecordsInflightFetchesAndTheirLatency) {
+  auto stats = std::make_shared<BackingStoreStats>("track_test");
+  folly::Promise<int> promise;
+  auto future = BackingStoreStats::track(
+      stats, &BackingStoreStats::getBlob, [&] { return promise.getFuture(); });
+
+  stats->aggregate();
+  EXPECT_EQ(1, getCounter("track_test.inflight"));
+  EXPECT_EQ(0, getCounter("track_test.get_blob_us.count.60"));
+
+  promise.setValue(5);
+  EXPECT_EQ(5, std::move(future).get());
+  stats->aggregate();
+  EXPECT_EQ(0, getCounter("track_test.inflight"));
+  EXPECT_EQ(1, getCounter("track_test.get_blob_us.count.60"));
+  EXPECT_EQ(0, getCounter("track_test.get_tree_us.count.60"));
+}
+
+TEST(StoreStats, trackRecordsFailedFetches) {
+  auto stats = std::make_shared<BackingStoreStats>("track_failure_test");
+  auto future = BackingStoreStats::track(
+      stats, &BackingStoreStats::getTree, []() -> folly::Future<int> {
+        throw std::runtime_error("fetch failed");
+      });
+  EXPECT_THROW(std::move(future).get(), std::runtime_error);
+
+  stats->aggregate();
+  EXPECT_EQ(0, getCounter("track_failure_test.inflight"));
+  EXPECT_EQ(1, getCounter("track_failure_test.get_tree_us.count.60"));
+}
+
+TEST(StoreStats, localStoreRecordsLatencyPerKeySpace) {
+  MemoryLocalStore store;
+  // Every LocalStore shares the same process-wide stats, so compare against
+  // whatever the other tests have recorded.
+  store.aggregateStats();
+  auto puts = getCounter("local_store.tree.put_us.count");
+  auto gets = getCounter("local_store.tree.get_us.count");
+  auto blobGets = getCounter("local_store.blob.get_us.count");
+
+  Tree tree{std::vector<TreeEntry>{},
+            Hash{"8e073e366ed82de6465d1209d3f07da7eebabb93"}};
+  auto id = store.putTree(&tree);
+  EXPECT_NE(nullptr, store.getTree(id).get());
+  store.aggregateStats();
+
+  EXPECT_EQ(puts + 1, getCounter("local_store.tree.put_us.count"));
+  EXPECT_EQ(gets + 1, getCounter("local_store.tree.get_us.count"));
+  EXPECT_EQ(blobGets, getCounter("local_store.blob.get_us.count"));
+}
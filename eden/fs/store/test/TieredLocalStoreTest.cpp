@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/TieredLocalStore.h"
+
+#include <folly/futures/Future.h>
+#include <gtest/gtest.h>
+#include "eden/fs/store/MemoryLocalStore.h"
+#include "eden/fs/store/StoreResult.h"
+
+using namespace facebook::eden;
+using namespace folly::string_piece_literals;
+using namespace std::chrono_literals;
+using KeySpace = LocalStore::KeySpace;
+
+namespace {
+class TieredLocalStoreTest : public ::testing::Test {
+ protected:
+  std::shared_ptr<MemoryLocalStore> local_{
+      std::make_shared<MemoryLocalStore>()};
+  std::shared_ptr<MemoryLocalStore> shared_{
+      std::make_shared<MemoryLocalStore>()};
+  TieredLocalStore store_{local_, shared_};
+};
+} // namespace
+
+TEST_F(TieredLocalStoreTest, readsFallBackToTheSharedStore) {
+  local_->put(KeySpace::BlobFamily, "local"_sp, "from local"_sp);
+  shared_->put(KeySpace::BlobFamily, "local"_sp, "stale"_sp);
+  shared_->put(KeySpace::BlobFamily, "shared"_sp, "from shared"_sp);
+
+  EXPECT_EQ("from local", store_.get(KeySpace::BlobFamily, "local"_sp).piece());
+  EXPECT_EQ(
+      "from shared", store_.get(KeySpace::BlobFamily, "shared"_sp).piece());
+  EXPECT_FALSE(store_.get(KeySpace::BlobFamily, "missing"_sp).isValid());
+  EXPECT_EQ(
+      "from shared",
+      store_.getFuture(KeySpace::BlobFamily, "shared"_sp).get(10s).piece());
+
+  std::vector<folly::ByteRange> keys{folly::ByteRange{"shared"_sp},
+                                     folly::ByteRange{"missing"_sp},
+                                     folly::ByteRange{"local"_sp}};
+  auto results = store_.getBatch(KeySpace::BlobFamily, keys).get(10s);
+  ASSERT_EQ(3, results.size());
+  EXPECT_EQ("from shared", results[0].piece());
+  EXPECT_FALSE(results[1].isValid());
+  EXPECT_EQ("from local", results[2].piece());
+  EXPECT_EQ(
+      (std::vector<bool>{true, false, true}),
+      store_.hasKeyBatch(KeySpace::BlobFamily, keys));
+
+  // Entries read from the shared store are not copied into the local one.
+  EXPECT_FALSE(local_->hasKey(KeySpace::BlobFamily, "shared"_sp));
+}
+
+TEST_F(TieredLocalStoreTest, writesGoToBothStores) {
+  store_.put(KeySpace::TreeFamily, "put"_sp, "tree"_sp);
+  auto batch = store_.beginWrite();
+  batch->put(KeySpace::BlobFamily, "batched"_sp, "blob"_sp);
+  batch->flush();
+
+  for (auto* store : {local_.get(), shared_.get()}) {
+    EXPECT_EQ("tree", store->get(KeySpace::TreeFamily, "put"_sp).piece());
+    EXPECT_EQ("blob", store->get(KeySpace::BlobFamily, "batched"_sp).piece());
+  }
+}
+
+TEST_F(TieredLocalStoreTest, maintenanceOnlyAppliesToTheLocalStore) {
+  store_.put(KeySpace::BlobFamily, "key"_sp, "blob"_sp);
+  store_.clearKeySpace(KeySpace::BlobFamily);
+  EXPECT_FALSE(local_->hasKey(KeySpace::BlobFamily, "key"_sp));
+  EXPECT_TRUE(shared_->hasKey(KeySpace::BlobFamily, "key"_sp));
+  EXPECT_TRUE(store_.hasKey(KeySpace::BlobFamily, "key"_sp));
+}
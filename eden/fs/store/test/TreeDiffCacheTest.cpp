@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/TreeDiffCache.h"
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include "eden/fs/store/MemoryLocalStore.h"
+
+using namespace facebook::eden;
+using namespace facebook::eden::path_literals;
+using folly::ByteRange;
+using folly::StringPiece;
+using std::make_shared;
+using std::shared_ptr;
+
+namespace {
+const Hash kTree1("1111111111111111111111111111111111111111");
+const Hash kTree2("2222222222222222222222222222222222222222");
+const Hash kSub1("3333333333333333333333333333333333333333");
+const Hash kSub2("4444444444444444444444444444444444444444");
+
+shared_ptr<const TreeDiffResult> makeLeaf() {
+  auto leaf = make_shared<TreeDiffResult>();
+  leaf->files.emplace_back("main.c"_pc, ScmFileStatus::MODIFIED);
+  leaf->files.emplace_back("new.c"_pc, ScmFileStatus::ADDED);
+  return leaf;
+}
+
+shared_ptr<const TreeDiffResult> makeRoot(
+    shared_ptr<const TreeDiffResult> leaf) {
+  auto root = make_shared<TreeDiffResult>();
+  root->files.emplace_back("README"_pc, ScmFileStatus::REMOVED);
+  root->trees.emplace_back("src"_pc, kSub1, kSub2, std::move(leaf));
+  root->trees.emplace_back("docs"_pc, kZeroHash, kSub1, nullptr);
+  return root;
+}
+} // namespace
+
+TEST(TreeDiffCache, serializationRoundTrips) {
+  auto root = makeRoot(makeLeaf());
+  auto data = TreeDiffCache::serialize(*root);
+  auto parsed = TreeDiffCache::deserialize(ByteRange{StringPiece{data}});
+  EXPECT_EQ(root->files, parsed.files);
+  ASSERT_EQ(2, parsed.trees.size());
+  EXPECT_EQ("src"_pc, parsed.trees[0].name);
+  EXPECT_EQ(kSub1, parsed.trees[0].tree1);
+  EXPECT_EQ(kSub2, parsed.trees[0].tree2);
+  EXPECT_FALSE(parsed.trees[0].result);
+  EXPECT_EQ(kZeroHash, parsed.trees[1].tree1);
+}
+
+TEST(TreeDiffCache, rejectsCorruptData) {
+  auto data = TreeDiffCache::serialize(*makeRoot(makeLeaf()));
+  auto parse = [](const std::string& str) {
+    return TreeDiffCache::deserialize(ByteRange{StringPiece{str}});
+  };
+  EXPECT_THROW(parse(""), std::invalid_argument);
+  EXPECT_THROW(parse(data.substr(0, data.size() - 1)), std::invalid_argument);
+  EXPECT_THROW(parse(data + "x"), std::invalid_argument);
+
+  auto badVersion = data;
+  badVersion[0] = 7;
+  EXPECT_THROW(parse(badVersion), std::invalid_argument);
+
+  auto badStatus = data;
+  badStatus[2] = 9;
+  EXPECT_THROW(parse(badStatus), std::invalid_argument);
+}
+
+TEST(TreeDiffCache, evictsTheLeastRecentlyUsedResults) {
+  TreeDiffCache cache{2};
+  auto leaf = makeLeaf();
+  cache.put(kSub1, kSub2, leaf);
+  cache.put(kTree1, kTree2, makeRoot(leaf));
+  EXPECT_EQ(leaf, cache.get(kSub1, kSub2));
+  cache.put(kSub2, kSub1, leaf);
+  EXPECT_EQ(2, cache.size());
+  EXPECT_FALSE(cache.get(kTree1, kTree2));
+  EXPECT_TRUE(cache.get(kSub1, kSub2));
+  EXPECT_FALSE(cache.get(kSub2, kSub2));
+}
+
+TEST(TreeDiffCache, resultsSurviveInTheLocalStore) {
+  auto localStore = make_shared<MemoryLocalStore>();
+  auto leaf = makeLeaf();
+  auto root = make_shared<TreeDiffResult>();
+  root->trees.emplace_back("src"_pc, kSub1, kSub2, leaf);
+  {
+    TreeDiffCache cache{16, localStore};
+    cache.put(kSub1, kSub2, leaf);
+    cache.put(kTree1, kTree2, root);
+  }
+
+  TreeDiffCache cache{16, localStore};
+  auto loaded = cache.get(kTree1, kTree2);
+  ASSERT_TRUE(loaded);
+  ASSERT_EQ(1, loaded->trees.size());
+  ASSERT_TRUE(loaded->trees[0].result);
+  EXPECT_EQ(leaf->files, loaded->trees[0].result->files);
+  EXPECT_EQ(2, cache.size());
+
+  // A result is not usable without the results of its subtrees.
+  localStore->clearKeySpace(LocalStore::TreeDiffFamily);
+  TreeDiffCache otherCache{16, localStore};
+  otherCache.put(kTree1, kTree2, root);
+  TreeDiffCache emptyCache{16, localStore};
+  EXPECT_FALSE(emptyCache.get(kTree1, kTree2));
+}
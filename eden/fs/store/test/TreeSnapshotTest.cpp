@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/TreeSnapshot.h"
+
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <folly/futures/Future.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/MemoryLocalStore.h"
+#include "eden/fs/store/ObjectStore.h"
+#include "eden/fs/store/TreeView.h"
+#include "eden/fs/testharness/FakeBackingStore.h"
+#include "eden/fs/testharness/FakeTreeBuilder.h"
+#include "eden/fs/testharness/TestUtil.h"
+
+using namespace facebook::eden;
+using namespace facebook::eden::path_literals;
+using namespace std::chrono_literals;
+using folly::test::TemporaryDirectory;
+using std::make_shared;
+using std::make_unique;
+
+class TreeSnapshotTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    localStore_ = make_shared<MemoryLocalStore>();
+    backingStore_ = make_shared<FakeBackingStore>(localStore_);
+    store_ = make_unique<ObjectStore>(localStore_, backingStore_);
+
+    builder_.setFile("README", "readme");
+    builder_.setFile("src/main.c", "hello world");
+    builder_.setFile("src/test/test.c", "testing");
+    builder_.setFile("docs/index.md", "docs");
+    builder_.finalize(backingStore_, /* setReady */ true);
+    backingStore_->putCommit("1", builder_)->setReady();
+    snapshotPath_ = AbsolutePath{testDir_.path().string()} + "snapshot"_pc;
+  }
+
+  TemporaryDirectory testDir_{"eden_tree_snapshot_test"};
+  AbsolutePath snapshotPath_;
+  std::shared_ptr<LocalStore> localStore_;
+  std::shared_ptr<FakeBackingStore> backingStore_;
+  std::unique_ptr<ObjectStore> store_;
+  FakeTreeBuilder builder_;
+};
+
+TEST_F(TreeSnapshotTest, containsEveryTreeOfTheCommit) {
+  auto numTrees =
+      TreeSnapshot::create(store_.get(), makeTestHash("1"), snapshotPath_)
+          .get(10s);
+  // The root, src, src/test and docs.
+  EXPECT_EQ(4, numTrees);
+
+  auto snapshot = TreeSnapshot::open(snapshotPath_);
+  EXPECT_EQ(4, snapshot->size());
+  EXPECT_EQ(makeTestHash("1"), snapshot->getCommitID());
+  const auto& root = builder_.getRoot()->get();
+  EXPECT_EQ(root.getHash(), snapshot->getRootTreeID());
+
+  for (auto path : {""_relpath, "src"_relpath, "src/test"_relpath}) {
+    const auto& expected = builder_.getStoredTree(path)->get();
+    auto tree = snapshot->getTree(expected.getHash());
+    ASSERT_TRUE(tree) << path;
+    EXPECT_EQ(expected, *tree);
+  }
+
+  auto view = snapshot->getTreeView(root.getHash());
+  ASSERT_TRUE(view.hasValue());
+  EXPECT_TRUE(view->find("docs"_pc).hasValue());
+
+  EXPECT_FALSE(snapshot->getTree(makeTestHash("12345")));
+}
+
+TEST_F(TreeSnapshotTest, objectStoreReadsTreesFromTheSnapshot) {
+  TreeSnapshot::create(store_.get(), makeTestHash("1"), snapshotPath_)
+      .get(10s);
+
+  // A store with no trees at all can serve the commit from the snapshot.
+  auto emptyLocalStore = make_shared<MemoryLocalStore>();
+  auto emptyBackingStore = make_shared<FakeBackingStore>(emptyLocalStore);
+  ObjectStore snapshotStore{emptyLocalStore,
+                            emptyBackingStore,
+                            nullptr,
+                            nullptr,
+                            nullptr,
+                            "object_store",
+                            TreeSnapshot::open(snapshotPath_)};
+
+  auto root = snapshotStore.getTreeForCommit(makeTestHash("1")).get(10s);
+  EXPECT_EQ(builder_.getRoot()->get(), *root);
+  const auto& src = builder_.getStoredTree("src"_relpath)->get();
+  EXPECT_EQ(src, *snapshotStore.getTree(src.getHash()).get(10s));
+  EXPECT_EQ(0, emptyBackingStore->getTreeFetchCount());
+}
+
+TEST_F(TreeSnapshotTest, rejectsInvalidFiles) {
+  folly::writeFileAtomic(snapshotPath_.stringPiece(), "not a snapshot");
+  EXPECT_THROW(TreeSnapshot::open(snapshotPath_), std::invalid_argument);
+
+  TreeSnapshot::create(store_.get(), makeTestHash("1"), snapshotPath_)
+      .get(10s);
+  std::string data;
+  ASSERT_TRUE(folly::readFile(snapshotPath_.stringPiece().str().c_str(), data));
+  folly::writeFileAtomic(snapshotPath_.stringPiece(), data.substr(0, 100));
+  EXPECT_THROW(TreeSnapshot::open(snapshotPath_), std::invalid_argument);
+}
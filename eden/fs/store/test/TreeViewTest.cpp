@@ -0,0 +1,160 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/store/TreeView.h"
+
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include "eden/fs/model/Tree.h"
+
+using namespace facebook::eden;
+using namespace facebook::eden::path_literals;
+using std::string;
+
+namespace {
+const Hash kTreeHash("8e073e366ed82de6465d1209d3f07da7eebabb93");
+
+Tree makeTree() {
+  std::vector<TreeEntry> entries;
+  entries.emplace_back(
+      Hash("3a8f8eb91101860fd8484154885838bf322964d0"),
+      "README.md",
+      TreeEntryType::REGULAR_FILE);
+  entries.emplace_back(
+      Hash("e95798e17f694c227b7a8441cc5c7dae50a187d0"),
+      "lib",
+      TreeEntryType::TREE);
+  entries.emplace_back(
+      Hash("006babcf5734d028098961c6f4b6b6719656924b"),
+      "start_the_server_with_a_long_name",
+      TreeEntryType::EXECUTABLE_FILE);
+  return Tree{std::move(entries), kTreeHash};
+}
+
+string serialize(const Tree& tree) {
+  auto buf = TreeView::serialize(tree);
+  EXPECT_TRUE(buf.hasValue());
+  return buf->moveToFbString().toStdString();
+}
+
+TreeView makeView(string data) {
+  return TreeView{kTreeHash, StoreResult{std::move(data)}};
+}
+} // namespace
+
+TEST(TreeView, entriesMatchTheSerializedTree) {
+  auto tree = makeTree();
+  auto data = serialize(tree);
+  EXPECT_TRUE(TreeView::isSerializedTree(folly::StringPiece{data}));
+
+  auto view = makeView(data);
+  EXPECT_EQ(kTreeHash, view.getHash());
+  ASSERT_EQ(3, view.size());
+  for (size_t index = 0; index < view.size(); ++index) {
+    const auto& expected = tree.getEntryAt(index);
+    auto entry = view.getEntryAt(index);
+    EXPECT_EQ(expected.getName(), entry.getName());
+    EXPECT_EQ(expected.getHash(), entry.getHash());
+    EXPECT_EQ(expected.getType(), entry.getType());
+    EXPECT_EQ(expected, entry.toTreeEntry());
+  }
+  EXPECT_TRUE(view.getEntryAt(1).isTree());
+  EXPECT_EQ(tree, *view.toTree());
+}
+
+TEST(TreeView, findEntriesByName) {
+  auto view = makeView(serialize(makeTree()));
+  auto lib = view.find("lib"_pc);
+  ASSERT_TRUE(lib.hasValue());
+  EXPECT_EQ(TreeEntryType::TREE, lib->getType());
+  EXPECT_TRUE(view.find("README.md"_pc).hasValue());
+  EXPECT_TRUE(view.find("start_the_server_with_a_long_name"_pc).hasValue());
+  EXPECT_FALSE(view.find("missing"_pc).hasValue());
+  EXPECT_FALSE(view.find("a"_pc).hasValue());
+  EXPECT_FALSE(view.find("z"_pc).hasValue());
+}
+
+TEST(TreeView, emptyTree) {
+  auto view = makeView(serialize(Tree{std::vector<TreeEntry>{}, kTreeHash}));
+  EXPECT_EQ(0, view.size());
+  EXPECT_FALSE(view.find("lib"_pc).hasValue());
+}
+
+TEST(TreeView, viewSurvivesMove) {
+  // Entries are located by offset rather than by pointer, so they can still
+  // be read after the data moves.
+  auto view = makeView(serialize(makeTree()));
+  auto moved = std::move(view);
+  EXPECT_EQ("lib"_pc, moved.getEntryAt(1).getName());
+}
+
+TEST(TreeView, rejectsCorruptData) {
+  auto data = serialize(makeTree());
+  EXPECT_THROW(
+      makeView(data.substr(0, data.size() - 1)), std::invalid_argument);
+  EXPECT_THROW(makeView(data + "x"), std::invalid_argument);
+  EXPECT_THROW(makeView(data.substr(0, 10)), std::invalid_argument);
+
+  auto badType = data;
+  badType[6 + Hash::RAW_SIZE] = 9;
+  EXPECT_THROW(makeView(badType), std::invalid_argument);
+
+  auto badName = data;
+  badName[badName.size() - 1] = '/';
+  EXPECT_THROW(makeView(badName), std::invalid_argument);
+
+  auto badVersion = data;
+  badVersion[1] = 3;
+  EXPECT_THROW(makeView(badVersion), std::invalid_argument);
+
+  // Version 1 records have no room for the size or SHA-1.
+  auto badFlags = data;
+  badFlags[6 + Hash::RAW_SIZE + 1] = 1;
+  EXPECT_THROW(makeView(badFlags), std::invalid_argument);
+}
+
+TEST(TreeView, entriesKeepTheirSizeAndSha1) {
+  const Hash contentSha1("d5477ccc0d5df20a4a7b7e2a3b0fa0fe7ef8b4e1");
+  std::vector<TreeEntry> entries;
+  entries.emplace_back(
+      Hash("3a8f8eb91101860fd8484154885838bf322964d0"),
+      "README.md",
+      TreeEntryType::REGULAR_FILE,
+      1234,
+      contentSha1);
+  entries.emplace_back(
+      Hash("e95798e17f694c227b7a8441cc5c7dae50a187d0"),
+      "lib",
+      TreeEntryType::TREE);
+  entries.emplace_back(
+      Hash("006babcf5734d028098961c6f4b6b6719656924b"),
+      "run",
+      TreeEntryType::EXECUTABLE_FILE,
+      0x100000000,
+      folly::none);
+  Tree tree{std::move(entries), kTreeHash};
+
+  auto view = makeView(serialize(tree));
+  ASSERT_EQ(3, view.size());
+  auto readme = view.getEntryAt(0);
+  EXPECT_EQ(1234, readme.getSize().value_or(0));
+  EXPECT_EQ(contentSha1, readme.getContentSha1().value_or(Hash{}));
+  EXPECT_FALSE(view.getEntryAt(1).getSize().hasValue());
+  EXPECT_FALSE(view.getEntryAt(1).getContentSha1().hasValue());
+  EXPECT_EQ(0x100000000, view.getEntryAt(2).getSize().value_or(0));
+  EXPECT_FALSE(view.getEntryAt(2).getContentSha1().hasValue());
+  EXPECT_EQ(tree, *view.toTree());
+}
+
+TEST(TreeView, treesWithoutMetadataUseTheSmallerFormat) {
+  auto data = serialize(makeTree());
+  EXPECT_EQ(1, data[1]);
+}
@@ -33,6 +33,35 @@ DEFINE_int32(
 namespace facebook {
 namespace eden {
 
+namespace {
+/**
+ * Run evb until the next message arrives on socket, and return it.
+ */
+UnixSocket::Message receiveMessage(
+    folly::EventBase& evb,
+    FutureUnixSocket& socket) {
+  folly::Expected<UnixSocket::Message, folly::exception_wrapper>
+      expectedMessage;
+  auto timeout = std::chrono::seconds(FLAGS_takeoverReceiveTimeout);
+  socket.receive(timeout)
+      .then([&expectedMessage](UnixSocket::Message&& msg) {
+        expectedMessage = std::move(msg);
+      })
+      .onError([&expectedMessage](folly::exception_wrapper&& ew) {
+        expectedMessage = folly::makeUnexpected(std::move(ew));
+      })
+      .ensure([&evb] { evb.terminateLoopSoon(); });
+
+  evb.loop();
+
+  if (!expectedMessage) {
+    XLOG(ERR) << "error receiving takeover data: " << expectedMessage.error();
+    expectedMessage.error().throw_exception();
+  }
+  return std::move(expectedMessage.value());
+}
+} // namespace
+
 TakeoverData takeoverMounts(
     AbsolutePathPiece socketPath,
     const std::set<int32_t>& supportedVersions) {
@@ -91,6 +120,13 @@ TakeoverData takeoverMounts(
     mountInfo.fuseFD = std::move(message.files[n + 2]);
   }
 
+  // With version 4 the unloaded inodes follow.  Decoding each chunk as it
+  // arrives overlaps with the old process encoding the next one.
+  while (data.expectsInodeChunks()) {
+    auto chunk = receiveMessage(evb, socket);
+    data.deserializeInodeChunk(&chunk.data);
+  }
+
   return data;
 }
 } // namespace eden
@@ -12,8 +12,12 @@
 #include <folly/Format.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
+#include <folly/logging/xlog.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
+#include <algorithm>
+#include <array>
 
+#include "eden/fs/takeover/UnloadedInodeTable.h"
 #include "eden/fs/utils/Bug.h"
 
 using apache::thrift::CompactSerializer;
@@ -25,7 +29,23 @@ namespace eden {
 
 const std::set<int32_t> kSupportedTakeoverVersions{
     TakeoverData::kTakeoverProtocolVersionOne,
-    TakeoverData::kTakeoverProtocolVersionThree};
+    TakeoverData::kTakeoverProtocolVersionThree,
+    TakeoverData::kTakeoverProtocolVersionFour,
+    TakeoverData::kTakeoverProtocolVersionFive};
+
+namespace {
+// The size of a binary source control hash in a version 4 inode chunk.
+constexpr size_t kInodeChunkHashSize = 20;
+// The version, mount index, entry count and string table length.
+constexpr size_t kInodeChunkHeaderLength = 4 * sizeof(uint32_t);
+// The file in each mount's state directory that version 5 writes its
+// unloaded inodes to.
+constexpr folly::StringPiece kUnloadedInodeTableName{"takeover-inodes"};
+} // namespace
+
+constexpr size_t TakeoverData::kDefaultMaxInodesPerChunk;
+constexpr uint32_t TakeoverData::kEndOfInodeChunks;
+constexpr size_t TakeoverData::kInodeChunkEntrySize;
 
 folly::Optional<int32_t> TakeoverData::computeCompatibleVersion(
     const std::set<int32_t>& versions,
@@ -51,7 +71,9 @@ IOBuf TakeoverData::serialize(int32_t protocolVersion) {
     case kTakeoverProtocolVersionOne:
       return serializeVersion1();
     case kTakeoverProtocolVersionThree:
-      return serializeVersion3();
+    case kTakeoverProtocolVersionFour:
+    case kTakeoverProtocolVersionFive:
+      return serializeVersion3(protocolVersion);
     default: {
       auto bug = EDEN_BUG()
           << "only kTakeoverProtocolVersionOne is supported, but somehow "
@@ -72,6 +94,8 @@ folly::IOBuf TakeoverData::serializeError(
     case kTakeoverProtocolVersionOne:
       return serializeErrorVersion1(ew);
     case kTakeoverProtocolVersionThree:
+    case kTakeoverProtocolVersionFour:
+    case kTakeoverProtocolVersionFive:
       return serializeErrorVersion3(ew);
     default: {
       auto bug = EDEN_BUG()
@@ -99,6 +123,17 @@ TakeoverData TakeoverData::deserialize(IOBuf* buf) {
       // and let the underlying code decode the data
       buf->trimStart(sizeof(uint32_t));
       return deserializeVersion3(buf);
+    case kTakeoverProtocolVersionFour: {
+      // The same as version 3, except that the unloaded inodes follow.
+      buf->trimStart(sizeof(uint32_t));
+      auto data = deserializeVersion3(buf);
+      data.expectsInodeChunks_ = true;
+      return data;
+    }
+    case kTakeoverProtocolVersionFive:
+      // The same as version 3, except that the unloaded inodes are in files.
+      buf->trimStart(sizeof(uint32_t));
+      return deserializeVersion3(buf);
     default:
       throw std::runtime_error(folly::sformat(
           "Unrecognized TakeoverData response starting with {:x}",
@@ -274,17 +309,17 @@ TakeoverData TakeoverData::deserializeVersion1(IOBuf* buf) {
   return data;
 }
 
-IOBuf TakeoverData::serializeVersion3() {
+IOBuf TakeoverData::serializeVersion3(int32_t protocolVersion) {
   SerializedTakeoverData serialized;
 
   folly::IOBufQueue bufQ;
   folly::io::QueueAppender app(&bufQ, 0);
 
   // First word is the protocol version
-  app.writeBE<uint32_t>(kTakeoverProtocolVersionThree);
+  app.writeBE<uint32_t>(protocolVersion);
 
   std::vector<SerializedMountInfo> serializedMounts;
-  for (const auto& mount : mountPoints) {
+  for (auto& mount : mountPoints) {
     SerializedMountInfo serializedMount;
 
     serializedMount.mountPath = mount.mountPath.stringPiece().str();
@@ -303,7 +338,29 @@ IOBuf TakeoverData::serializeVersion3() {
         reinterpret_cast<const char*>(&mount.connInfo), sizeof(mount.connInfo)};
 
     serializedMount.fileHandleMap = mount.fileHandleMap;
-    serializedMount.inodeMap = mount.inodeMap;
+    // Version 4 sends the unloaded inodes in serializeNextInodeChunk().
+    if (protocolVersion == kTakeoverProtocolVersionThree) {
+      serializedMount.inodeMap = mount.inodeMap;
+    } else if (protocolVersion == kTakeoverProtocolVersionFive) {
+      // Version 5 writes them to a file, and releases them here as version
+      // 4 does once they have been sent.
+      serializedMount.inodeMap = std::move(mount.inodeMap);
+      if (!serializedMount.inodeMap.unloadedInodes.empty()) {
+        auto tablePath =
+            mount.stateDirectory + PathComponentPiece{kUnloadedInodeTableName};
+        try {
+          UnloadedInodeTable::moveToFile(serializedMount.inodeMap, tablePath);
+        } catch (const std::exception& ex) {
+          // The inodes still go over the socket, just less efficiently.
+          XLOG(WARN) << "error writing the unloaded inodes of "
+                     << mount.mountPath << " to a file: "
+                     << folly::exceptionStr(ex);
+        }
+      }
+    }
+    serializedMount.journal = mount.journal;
+    serializedMount.warmState = mount.warmState;
+    serializedMount.fusePausedAtNs = mount.fusePausedAtNs;
 
     serializedMounts.emplace_back(std::move(serializedMount));
   }
@@ -358,6 +415,10 @@ TakeoverData TakeoverData::deserializeVersion3(IOBuf* buf) {
             *connInfo,
             std::move(serializedMount.fileHandleMap),
             std::move(serializedMount.inodeMap));
+        data.mountPoints.back().journal = std::move(serializedMount.journal);
+        data.mountPoints.back().warmState =
+            std::move(serializedMount.warmState);
+        data.mountPoints.back().fusePausedAtNs = serializedMount.fusePausedAtNs;
       }
       return data;
     }
@@ -371,5 +432,160 @@ TakeoverData TakeoverData::deserializeVersion3(IOBuf* buf) {
       "impossible enum variant for SerializedTakeoverData");
 }
 
+folly::Optional<IOBuf> TakeoverData::serializeNextInodeChunk(
+    int32_t protocolVersion) {
+  if (protocolVersion != kTakeoverProtocolVersionFour || inodeChunksDone_) {
+    return folly::none;
+  }
+
+  // Move on past any mounts whose inodes have all been sent, releasing them.
+  while (nextChunkMount_ < mountPoints.size() &&
+         nextChunkInode_ >=
+             mountPoints[nextChunkMount_].inodeMap.unloadedInodes.size()) {
+    std::vector<SerializedInodeMapEntry>().swap(
+        mountPoints[nextChunkMount_].inodeMap.unloadedInodes);
+    ++nextChunkMount_;
+    nextChunkInode_ = 0;
+  }
+
+  if (nextChunkMount_ >= mountPoints.size()) {
+    inodeChunksDone_ = true;
+    IOBuf buf(IOBuf::CREATE, kInodeChunkHeaderLength);
+    folly::io::Appender app(&buf, 0);
+    app.writeBE<uint32_t>(kTakeoverProtocolVersionFour);
+    app.writeBE<uint32_t>(kEndOfInodeChunks);
+    app.writeBE<uint32_t>(0);
+    app.writeBE<uint32_t>(0);
+    return std::move(buf);
+  }
+
+  const auto& inodes = mountPoints[nextChunkMount_].inodeMap.unloadedInodes;
+  const auto begin = nextChunkInode_;
+  const auto end =
+      std::min(inodes.size(), begin + std::max<size_t>(maxInodesPerChunk, 1));
+  size_t stringTableLength = 0;
+  for (auto n = begin; n < end; ++n) {
+    stringTableLength += inodes[n].name.size();
+  }
+
+  // The message is the header described by kInodeChunkHeaderLength, then
+  // one fixed-width record per inode, then the names of all of the inodes
+  // in the same order.  Each record is:
+  //
+  //   uint64_t inodeNumber
+  //   uint64_t parentInode
+  //   uint64_t numFuseReferences
+  //   uint32_t nameOffset, relative to the start of the names
+  //   uint32_t nameLength
+  //   uint32_t mode
+  //   uint8_t isUnlinked
+  //   uint8_t hashLength
+  //   char hash[kInodeChunkHashSize], zero padded after hashLength bytes
+  IOBuf buf(
+      IOBuf::CREATE,
+      kInodeChunkHeaderLength + (end - begin) * kInodeChunkEntrySize +
+          stringTableLength);
+  folly::io::Appender app(&buf, 0);
+  app.writeBE<uint32_t>(kTakeoverProtocolVersionFour);
+  app.writeBE<uint32_t>(nextChunkMount_);
+  app.writeBE<uint32_t>(end - begin);
+  app.writeBE<uint32_t>(stringTableLength);
+
+  uint32_t nameOffset = 0;
+  for (auto n = begin; n < end; ++n) {
+    const auto& entry = inodes[n];
+    if (entry.hash.size() > kInodeChunkHashSize) {
+      throw std::runtime_error(folly::to<string>(
+          "unexpected ",
+          entry.hash.size(),
+          "-byte hash for unloaded inode ",
+          entry.inodeNumber));
+    }
+    app.writeBE<uint64_t>(entry.inodeNumber);
+    app.writeBE<uint64_t>(entry.parentInode);
+    app.writeBE<uint64_t>(entry.numFuseReferences);
+    app.writeBE<uint32_t>(nameOffset);
+    app.writeBE<uint32_t>(entry.name.size());
+    app.writeBE<uint32_t>(entry.mode);
+    app.write<uint8_t>(entry.isUnlinked ? 1 : 0);
+    app.write<uint8_t>(entry.hash.size());
+    std::array<char, kInodeChunkHashSize> hash{};
+    std::copy(entry.hash.begin(), entry.hash.end(), hash.begin());
+    app.push(folly::StringPiece{hash.data(), hash.size()});
+    nameOffset += entry.name.size();
+  }
+  for (auto n = begin; n < end; ++n) {
+    app.push(folly::StringPiece{inodes[n].name});
+  }
+
+  nextChunkInode_ = end;
+  return std::move(buf);
+}
+
+void TakeoverData::deserializeInodeChunk(IOBuf* buf) {
+  folly::io::Cursor cursor(buf);
+
+  auto version = cursor.readBE<uint32_t>();
+  if (version == kTakeoverProtocolVersionThree) {
+    // The sender failed part way through, and sent serializeError() instead.
+    buf->trimStart(sizeof(uint32_t));
+    deserializeVersion3(buf);
+  }
+  if (version != kTakeoverProtocolVersionFour) {
+    throw std::runtime_error(folly::sformat(
+        "Unrecognized takeover inode chunk starting with {:x}", version));
+  }
+  auto mountIndex = cursor.readBE<uint32_t>();
+  auto count = cursor.readBE<uint32_t>();
+  auto stringTableLength = cursor.readBE<uint32_t>();
+  if (mountIndex == kEndOfInodeChunks) {
+    expectsInodeChunks_ = false;
+    return;
+  }
+  if (mountIndex >= mountPoints.size()) {
+    throw std::runtime_error(folly::to<string>(
+        "takeover inode chunk for mount ",
+        mountIndex,
+        " but only ",
+        mountPoints.size(),
+        " mounts were received"));
+  }
+  const uint64_t recordsLength = uint64_t{count} * kInodeChunkEntrySize;
+  if (cursor.totalLength() != recordsLength + stringTableLength) {
+    throw std::runtime_error(folly::to<string>(
+        "takeover inode chunk of ",
+        count,
+        " inodes has the wrong length: ",
+        cursor.totalLength()));
+  }
+
+  auto names = cursor;
+  names.skip(recordsLength);
+  const auto stringTable = names.readFixedString(stringTableLength);
+
+  auto& inodes = mountPoints[mountIndex].inodeMap.unloadedInodes;
+  inodes.reserve(inodes.size() + count);
+  for (uint32_t n = 0; n < count; ++n) {
+    SerializedInodeMapEntry entry;
+    entry.inodeNumber = cursor.readBE<uint64_t>();
+    entry.parentInode = cursor.readBE<uint64_t>();
+    entry.numFuseReferences = cursor.readBE<uint64_t>();
+    auto nameOffset = cursor.readBE<uint32_t>();
+    auto nameLength = cursor.readBE<uint32_t>();
+    entry.mode = cursor.readBE<uint32_t>();
+    entry.isUnlinked = cursor.read<uint8_t>() != 0;
+    auto hashLength = cursor.read<uint8_t>();
+    entry.hash = cursor.readFixedString(kInodeChunkHashSize);
+    if (hashLength > kInodeChunkHashSize ||
+        uint64_t{nameOffset} + nameLength > stringTableLength) {
+      throw std::runtime_error(folly::to<string>(
+          "corrupt record for unloaded inode ", entry.inodeNumber));
+    }
+    entry.hash.resize(hashLength);
+    entry.name = stringTable.substr(nameOffset, nameLength);
+    inodes.push_back(std::move(entry));
+  }
+}
+
 } // namespace eden
 } // namespace facebook
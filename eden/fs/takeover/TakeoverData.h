@@ -10,6 +10,7 @@
 #pragma once
 
 #include <folly/File.h>
+#include <folly/Optional.h>
 #include <folly/futures/Promise.h>
 #include <memory>
 #include <vector>
@@ -62,8 +63,28 @@ class TakeoverData {
     // like too much of a headache, so we simply skip over using
     // version 2 to describe this next one.
     kTakeoverProtocolVersionThree = 3,
+
+    // This version sends the same thrift structures as version 3, except
+    // that the unloaded inodes of each mount follow in separate messages.
+    // Those use a compact fixed-width encoding and are built and decoded one
+    // chunk at a time, so neither process needs the whole encoded inode map
+    // in memory, and the new process decodes each chunk while the old one is
+    // still sending.  See serializeNextInodeChunk().
+    kTakeoverProtocolVersionFour = 4,
+
+    // This version sends the same thrift structures as version 3, except
+    // that the unloaded inodes of each mount are written to a file in its
+    // state directory, which the new process maps and consults lazily.  See
+    // UnloadedInodeTable.
+    kTakeoverProtocolVersionFive = 5,
   };
 
+  /**
+   * The default maximum number of unloaded inodes in one message sent by
+   * serializeNextInodeChunk().
+   */
+  static constexpr size_t kDefaultMaxInodesPerChunk = 32 * 1024;
+
   // Given a set of versions provided by a client, find the largest
   // version that is also present in the provided set of supported
   // versions.
@@ -95,6 +116,15 @@ class TakeoverData {
     fuse_init_out connInfo;
     SerializedFileHandleMap fileHandleMap;
     SerializedInodeMap inodeMap;
+    /** Only sent with version 3 of the takeover protocol. */
+    SerializedJournal journal;
+    /** Only sent with version 3 of the takeover protocol. */
+    SerializedWarmState warmState;
+    /**
+     * The steady_clock time at which FUSE requests stopped being served, in
+     * nanoseconds, or 0.  Only sent with version 3 of the takeover protocol.
+     */
+    int64_t fusePausedAtNs{0};
   };
 
   /**
@@ -118,6 +148,35 @@ class TakeoverData {
    */
   static TakeoverData deserialize(folly::IOBuf* buf);
 
+  /**
+   * With version 4 of the takeover protocol, serialize() leaves out the
+   * unloaded inodes.  They are sent afterwards, in the messages returned by
+   * successive calls to serializeNextInodeChunk(), the last of which is an
+   * end marker.
+   *
+   * Returns folly::none once the end marker has been returned, or straight
+   * away for earlier protocol versions.  The unloaded inodes of each mount
+   * are released once they have all been serialized.
+   */
+  folly::Optional<folly::IOBuf> serializeNextInodeChunk(
+      int32_t protocolVersion);
+
+  /**
+   * Whether deserialize() found that the unloaded inodes follow in separate
+   * messages.  If so, each of those must be passed to
+   * deserializeInodeChunk() until this returns false.
+   */
+  bool expectsInodeChunks() const {
+    return expectsInodeChunks_;
+  }
+
+  /**
+   * Add the unloaded inodes in a message built by serializeNextInodeChunk()
+   * to mountPoints.  Throws if the message is an error sent by
+   * serializeError() instead.
+   */
+  void deserializeInodeChunk(folly::IOBuf* buf);
+
   /**
    * The main eden lock file that prevents two edenfs processes from running at
    * the same time.
@@ -140,6 +199,12 @@ class TakeoverData {
    */
   folly::Promise<folly::Unit> takeoverComplete;
 
+  /**
+   * The maximum number of unloaded inodes serializeNextInodeChunk() puts in
+   * one message.
+   */
+  size_t maxInodesPerChunk{kDefaultMaxInodesPerChunk};
+
  private:
   /**
    * Serialize data using version 1 of the takeover protocol.
@@ -159,9 +224,11 @@ class TakeoverData {
   static TakeoverData deserializeVersion1(folly::IOBuf* buf);
 
   /**
-   * Serialize data using version 2 of the takeover protocol.
+   * Serialize data using version 2 of the takeover protocol, or, without
+   * the unloaded inodes, versions 4 and 5.
    */
-  folly::IOBuf serializeVersion3();
+  folly::IOBuf serializeVersion3(
+      int32_t protocolVersion = kTakeoverProtocolVersionThree);
 
   /**
    * Serialize an exception using version 2 of the takeover protocol.
@@ -191,6 +258,26 @@ class TakeoverData {
    * This is just a 4-byte message type field.
    */
   static constexpr uint32_t kHeaderLength = sizeof(uint32_t);
+
+  /**
+   * The mount index that marks the last message of a version 4 takeover.
+   */
+  static constexpr uint32_t kEndOfInodeChunks = 0xffffffff;
+
+  /**
+   * The encoded size of each unloaded inode in a version 4 chunk.  See
+   * serializeNextInodeChunk() in TakeoverData.cpp for the layout.
+   */
+  static constexpr size_t kInodeChunkEntrySize = 58;
+
+  /**
+   * How far serializeNextInodeChunk() has got.
+   */
+  size_t nextChunkMount_{0};
+  size_t nextChunkInode_{0};
+  bool inodeChunksDone_{false};
+
+  bool expectsInodeChunks_{false};
 };
 
 } // namespace eden
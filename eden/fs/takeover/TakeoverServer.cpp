@@ -63,6 +63,13 @@ class TakeoverServer::ConnHandler {
   FOLLY_NODISCARD folly::Future<folly::Unit> sendTakeoverData(
       folly::Try<TakeoverData>&& data);
 
+  /**
+   * Send the unloaded inodes that follow the rest of the takeover data in
+   * version 4 of the protocol, one chunk at a time.
+   */
+  FOLLY_NODISCARD folly::Future<folly::Unit> sendInodeChunks(
+      std::shared_ptr<TakeoverData> data);
+
   template <typename... Args>
   [[noreturn]] void fail(Args&&... args) {
     auto msg = folly::to<std::string>(std::forward<Args>(args)...);
@@ -186,13 +193,35 @@ Future<Unit> TakeoverServer::ConnHandler::sendTakeoverData(
   XLOG(INFO) << "Sending takeover data to new process: "
              << msg.data.computeChainDataLength() << " bytes";
 
+  auto sharedData = std::make_shared<TakeoverData>(std::move(data));
   return socket_.send(std::move(msg))
-      .then([promise = std::move(data.takeoverComplete)](
-                folly::Try<Unit>&& sendResult) mutable {
-        promise.setTry(std::move(sendResult));
+      .then([this, sharedData] { return sendInodeChunks(sharedData); })
+      .then([sharedData](folly::Try<Unit>&& sendResult) {
+        sharedData->takeoverComplete.setTry(std::move(sendResult));
       });
 }
 
+Future<Unit> TakeoverServer::ConnHandler::sendInodeChunks(
+    std::shared_ptr<TakeoverData> data) {
+  folly::Optional<folly::IOBuf> chunk;
+  try {
+    chunk = data->serializeNextInodeChunk(protocolVersion_);
+  } catch (const std::exception& ex) {
+    auto ew = folly::exception_wrapper{std::current_exception(), ex};
+    XLOG(ERR) << "error serializing unloaded inodes: " << ew;
+    return socket_.send(TakeoverData::serializeError(protocolVersion_, ew))
+        .then([ew] { return makeFuture<Unit>(ew); });
+  }
+  if (!chunk) {
+    return makeFuture();
+  }
+  // Each chunk is only built once the previous one has been handed to the
+  // kernel, so at most one encoded chunk is held in memory at a time.
+  return socket_.send(std::move(*chunk)).then([this, data] {
+    return sendInodeChunks(data);
+  });
+}
+
 TakeoverServer::TakeoverServer(
     folly::EventBase* eventBase,
     AbsolutePathPiece socketPath,
@@ -0,0 +1,239 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/takeover/UnloadedInodeTable.h"
+
+#include <folly/Conv.h>
+#include <folly/Exception.h>
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/ScopeGuard.h>
+#include <folly/String.h>
+#include <folly/logging/xlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+namespace facebook {
+namespace eden {
+
+namespace {
+constexpr uint32_t kMagic = 0x49554445; // "EDUI"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHashSize = 20;
+// How many records, or bytes of names, to buffer between writes.
+constexpr size_t kRecordsPerWrite = 4096;
+constexpr size_t kNameBytesPerWrite = 1024 * 1024;
+
+void writeOrThrow(int fd, const void* data, size_t length) {
+  if (folly::writeFull(fd, data, length) != static_cast<ssize_t>(length)) {
+    folly::throwSystemError("error writing unloaded inode table");
+  }
+}
+} // namespace
+
+struct UnloadedInodeTable::Header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t count;
+  uint64_t namesLength;
+  uint64_t unused; // for alignment
+};
+
+struct UnloadedInodeTable::Record {
+  uint64_t inodeNumber;
+  uint64_t parentInode;
+  int64_t numFuseReferences;
+  // Relative to the start of the names, which follow the records.
+  uint64_t nameOffset;
+  uint32_t nameLength;
+  uint32_t mode;
+  uint8_t isUnlinked;
+  uint8_t hashLength;
+  // Zero padded after hashLength bytes.
+  std::array<char, kHashSize> hash;
+  uint8_t unused[2];
+};
+
+void UnloadedInodeTable::moveToFile(
+    SerializedInodeMap& inodeMap,
+    AbsolutePathPiece path) {
+  auto& inodes = inodeMap.unloadedInodes;
+  std::sort(
+      inodes.begin(),
+      inodes.end(),
+      [](const SerializedInodeMapEntry& a, const SerializedInodeMapEntry& b) {
+        return a.inodeNumber < b.inodeNumber;
+      });
+
+  folly::File file{
+      path.stringPiece(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600};
+  SCOPE_FAIL {
+    ::unlink(path.stringPiece().str().c_str());
+  };
+
+  Header header{};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.count = inodes.size();
+  for (const auto& entry : inodes) {
+    header.namesLength += entry.name.size();
+  }
+  writeOrThrow(file.fd(), &header, sizeof(header));
+
+  std::vector<Record> records;
+  records.reserve(std::min(inodes.size(), kRecordsPerWrite));
+  uint64_t nameOffset = 0;
+  for (const auto& entry : inodes) {
+    if (entry.hash.size() > kHashSize) {
+      throw std::runtime_error(folly::to<std::string>(
+          "unexpected ",
+          entry.hash.size(),
+          "-byte hash for unloaded inode ",
+          entry.inodeNumber));
+    }
+    Record record{};
+    record.inodeNumber = entry.inodeNumber;
+    record.parentInode = entry.parentInode;
+    record.numFuseReferences = entry.numFuseReferences;
+    record.nameOffset = nameOffset;
+    record.nameLength = entry.name.size();
+    record.mode = entry.mode;
+    record.isUnlinked = entry.isUnlinked ? 1 : 0;
+    record.hashLength = entry.hash.size();
+    std::copy(entry.hash.begin(), entry.hash.end(), record.hash.begin());
+    nameOffset += entry.name.size();
+
+    records.push_back(record);
+    if (records.size() == kRecordsPerWrite) {
+      writeOrThrow(file.fd(), records.data(), records.size() * sizeof(Record));
+      records.clear();
+    }
+  }
+  writeOrThrow(file.fd(), records.data(), records.size() * sizeof(Record));
+
+  std::string names;
+  for (const auto& entry : inodes) {
+    names.append(entry.name);
+    if (names.size() >= kNameBytesPerWrite) {
+      writeOrThrow(file.fd(), names.data(), names.size());
+      names.clear();
+    }
+  }
+  writeOrThrow(file.fd(), names.data(), names.size());
+
+  std::vector<SerializedInodeMapEntry>().swap(inodes);
+  inodeMap.unloadedInodeTablePath = path.stringPiece().str();
+}
+
+std::unique_ptr<UnloadedInodeTable> UnloadedInodeTable::open(
+    AbsolutePathPiece path) {
+  folly::File file{path.stringPiece(), O_RDONLY | O_CLOEXEC};
+  struct stat st;
+  folly::checkUnixError(fstat(file.fd(), &st), "fstat failed on ", path);
+  const auto length = static_cast<size_t>(st.st_size);
+  if (length < sizeof(Header)) {
+    throw std::runtime_error(folly::to<std::string>(
+        "unloaded inode table ", path, " is too short"));
+  }
+
+  auto map = mmap(nullptr, length, PROT_READ, MAP_SHARED, file.fd(), 0);
+  if (map == MAP_FAILED) {
+    folly::throwSystemError("mmap failed on unloaded inode table ", path);
+  }
+  std::unique_ptr<UnloadedInodeTable> table{
+      new UnloadedInodeTable(map, length)};
+
+  const auto& header = *static_cast<const Header*>(map);
+  if (header.magic != kMagic || header.version != kVersion) {
+    throw std::runtime_error(folly::to<std::string>(
+        "unloaded inode table ", path, " has an unknown format"));
+  }
+  const auto maxCount = (length - sizeof(Header)) / sizeof(Record);
+  if (header.count > maxCount ||
+      sizeof(Header) + header.count * sizeof(Record) + header.namesLength !=
+          length) {
+    throw std::runtime_error(folly::to<std::string>(
+        "unloaded inode table ", path, " has the wrong length: ", length));
+  }
+  table->count_ = header.count;
+  table->names_ = folly::StringPiece{
+      reinterpret_cast<const char*>(table->records() + header.count),
+      header.namesLength};
+
+  // Lookups jump around the table, so reading ahead is wasted effort.
+  if (madvise(map, length, MADV_RANDOM)) {
+    XLOG(DBG3) << "MADV_RANDOM failed on " << path << ": "
+               << folly::errnoStr(errno);
+  }
+  if (::unlink(path.stringPiece().str().c_str()) && errno != ENOENT) {
+    XLOG(WARN) << "error removing unloaded inode table " << path << ": "
+               << folly::errnoStr(errno);
+  }
+  return table;
+}
+
+UnloadedInodeTable::UnloadedInodeTable(void* map, size_t mapLength)
+    : map_{map}, mapLength_{mapLength} {
+  static_assert(sizeof(Header) == 32, "Header must not have padding");
+  static_assert(sizeof(Record) == 64, "Record must not have padding");
+}
+
+UnloadedInodeTable::~UnloadedInodeTable() {
+  munmap(map_, mapLength_);
+}
+
+const UnloadedInodeTable::Record* UnloadedInodeTable::records() const {
+  return reinterpret_cast<const Record*>(static_cast<const Header*>(map_) + 1);
+}
+
+folly::Optional<size_t> UnloadedInodeTable::find(uint64_t inodeNumber) const {
+  const auto* begin = records();
+  const auto* end = begin + count_;
+  const auto* it = std::lower_bound(
+      begin, end, inodeNumber, [](const Record& record, uint64_t number) {
+        return record.inodeNumber < number;
+      });
+  if (it == end || it->inodeNumber != inodeNumber) {
+    return folly::none;
+  }
+  return static_cast<size_t>(it - begin);
+}
+
+uint64_t UnloadedInodeTable::getInodeNumber(size_t index) const {
+  DCHECK_LT(index, count_);
+  return records()[index].inodeNumber;
+}
+
+SerializedInodeMapEntry UnloadedInodeTable::getEntry(size_t index) const {
+  DCHECK_LT(index, count_);
+  const auto& record = records()[index];
+  if (record.hashLength > kHashSize ||
+      record.nameOffset > names_.size() ||
+      record.nameLength > names_.size() - record.nameOffset) {
+    throw std::runtime_error(folly::to<std::string>(
+        "corrupt record for unloaded inode ", record.inodeNumber));
+  }
+
+  SerializedInodeMapEntry entry;
+  entry.inodeNumber = record.inodeNumber;
+  entry.parentInode = record.parentInode;
+  entry.name = names_.subpiece(record.nameOffset, record.nameLength).str();
+  entry.isUnlinked = record.isUnlinked != 0;
+  entry.numFuseReferences = record.numFuseReferences;
+  entry.hash.assign(record.hash.data(), record.hashLength);
+  entry.mode = record.mode;
+  return entry;
+}
+
+} // namespace eden
+} // namespace facebook
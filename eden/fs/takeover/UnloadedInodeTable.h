@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+#include <cstdint>
+#include <memory>
+#include "eden/fs/takeover/gen-cpp2/takeover_types.h"
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * A read-only, memory-mapped table of the unloaded inodes of a mount, sorted
+ * by inode number.
+ *
+ * With version 5 of the takeover protocol the old process writes the
+ * unloaded inodes of each mount to one of these files rather than sending
+ * them over the takeover socket.  The new process maps the file and looks
+ * inodes up in it only as they are used, so that a mount that remembers
+ * millions of inodes can start serving without decoding and inserting every
+ * one of them first.
+ *
+ * The file is only ever read by another process on the same machine, so the
+ * records use the native byte order.
+ */
+class UnloadedInodeTable {
+ public:
+  ~UnloadedInodeTable();
+
+  UnloadedInodeTable(const UnloadedInodeTable&) = delete;
+  UnloadedInodeTable& operator=(const UnloadedInodeTable&) = delete;
+
+  /**
+   * Write the unloaded inodes in inodeMap to a new table at path, and
+   * replace them in inodeMap with the path of the table.  The inodes are
+   * sorted while they are written.
+   *
+   * Throws if the file cannot be written, leaving inodeMap holding its
+   * original inodes.
+   */
+  static void moveToFile(SerializedInodeMap& inodeMap, AbsolutePathPiece path);
+
+  /**
+   * Map the table at path and remove the file, since the mapping keeps the
+   * data until the table is destroyed.
+   *
+   * Throws if the file cannot be read or is not a valid table.
+   */
+  static std::unique_ptr<UnloadedInodeTable> open(AbsolutePathPiece path);
+
+  /**
+   * Get the number of inodes in the table.
+   */
+  size_t size() const {
+    return count_;
+  }
+
+  /**
+   * Return the index of the record for inodeNumber, or folly::none if the
+   * table has no such record.
+   */
+  folly::Optional<size_t> find(uint64_t inodeNumber) const;
+
+  /**
+   * Get the inode number of the record at index, which must be below size().
+   */
+  uint64_t getInodeNumber(size_t index) const;
+
+  /**
+   * Decode the record at index, which must be below size().  Throws if the
+   * record is corrupt.
+   */
+  SerializedInodeMapEntry getEntry(size_t index) const;
+
+ private:
+  struct Header;
+  struct Record;
+
+  UnloadedInodeTable(void* map, size_t mapLength);
+
+  const Record* records() const;
+
+  void* map_{nullptr};
+  size_t mapLength_{0};
+  size_t count_{0};
+  folly::StringPiece names_;
+};
+
+} // namespace eden
+} // namespace facebook
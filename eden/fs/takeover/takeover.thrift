@@ -19,6 +19,41 @@ struct SerializedInodeMapEntry {
 
 struct SerializedInodeMap {
   2: list<SerializedInodeMapEntry> unloadedInodes,
+  // With version 5 of the takeover protocol, the path of a file holding
+  // more unloaded inodes; see UnloadedInodeTable.  Empty if there is none.
+  3: string unloadedInodeTablePath,
+}
+
+struct SerializedPathChange {
+  1: string path,
+  2: bool existedBefore,
+  3: bool existedAfter,
+}
+
+struct SerializedJournalDelta {
+  1: i64 fromSequence,
+  2: i64 toSequence,
+  3: binary fromHash,
+  4: binary toHash,
+  5: list<SerializedPathChange> changedPaths,
+  6: list<string> uncleanPaths,
+}
+
+// The journal of a mount, carried across graceful restart and saved on clean
+// shutdown so that journal positions held by clients remain valid.
+struct SerializedJournal {
+  1: i64 mountGeneration,
+  // Oldest first.
+  2: list<SerializedJournalDelta> deltas,
+}
+
+// What a mount had loaded when it was taken over, so that the new process can
+// warm its caches rather than start cold.
+struct SerializedWarmState {
+  // Directories whose TreeInodes were loaded, parents before children.
+  1: list<string> loadedDirectories,
+  // The blobs of loaded files that matched source control.
+  2: list<binary> blobHashes,
 }
 
 struct SerializedMountInfo {
@@ -35,6 +70,15 @@ struct SerializedMountInfo {
   4: binary connInfo, // fuse_init_out
   5: handlemap.SerializedFileHandleMap fileHandleMap,
   6: SerializedInodeMap inodeMap,
+  // Empty when taking over from a process that did not send its journal.
+  7: SerializedJournal journal,
+  // Empty when taking over from a process that did not send it.
+  8: SerializedWarmState warmState,
+  // When the old process stopped reading FUSE requests for this mount, as a
+  // steady_clock (CLOCK_MONOTONIC) time in nanoseconds.  That clock is shared
+  // by every process on the machine, so the new process can measure how long
+  // requests were blocked.  0 if unknown.
+  9: i64 fusePausedAtNs,
 }
 
 union SerializedTakeoverData {
@@ -19,6 +19,7 @@
 #include "eden/fs/takeover/TakeoverData.h"
 #include "eden/fs/takeover/TakeoverHandler.h"
 #include "eden/fs/takeover/TakeoverServer.h"
+#include "eden/fs/takeover/UnloadedInodeTable.h"
 
 using namespace facebook::eden;
 using folly::EventBase;
@@ -193,6 +194,15 @@ TEST(Takeover, simple) {
       fuse_init_out{},
       SerializedFileHandleMap{},
       SerializedInodeMap{});
+  SerializedJournalDelta mount2Delta;
+  mount2Delta.fromSequence = 5;
+  mount2Delta.toSequence = 7;
+  mount2Delta.uncleanPaths.push_back("a/b");
+  serverData.mountPoints.back().journal.mountGeneration = 1234;
+  serverData.mountPoints.back().journal.deltas.push_back(mount2Delta);
+  serverData.mountPoints.back().warmState.loadedDirectories = {"a", "a/b"};
+  serverData.mountPoints.back().warmState.blobHashes = {"0123"};
+  serverData.mountPoints.back().fusePausedAtNs = 987654321;
 
   // Perform the takeover
   auto serverSendFuture = serverData.takeoverComplete.getFuture();
@@ -220,6 +230,22 @@ TEST(Takeover, simple) {
       clientData.mountPoints.at(1).bindMounts,
       ElementsAreArray(mount2BindMounts));
   checkExpectedFile(clientData.mountPoints.at(1).fuseFD.fd(), mount2FusePath);
+
+  EXPECT_EQ(0, clientData.mountPoints.at(0).journal.deltas.size());
+  const auto& journal2 = clientData.mountPoints.at(1).journal;
+  EXPECT_EQ(1234, journal2.mountGeneration);
+  ASSERT_EQ(1, journal2.deltas.size());
+  EXPECT_EQ(5, journal2.deltas.at(0).fromSequence);
+  EXPECT_EQ(7, journal2.deltas.at(0).toSequence);
+  EXPECT_THAT(journal2.deltas.at(0).uncleanPaths, ElementsAre("a/b"));
+
+  EXPECT_THAT(
+      clientData.mountPoints.at(0).warmState.loadedDirectories, ElementsAre());
+  const auto& warmState2 = clientData.mountPoints.at(1).warmState;
+  EXPECT_THAT(warmState2.loadedDirectories, ElementsAre("a", "a/b"));
+  EXPECT_THAT(warmState2.blobHashes, ElementsAre("0123"));
+  EXPECT_EQ(0, clientData.mountPoints.at(0).fusePausedAtNs);
+  EXPECT_EQ(987654321, clientData.mountPoints.at(1).fusePausedAtNs);
 }
 
 TEST(Takeover, noMounts) {
@@ -438,3 +464,125 @@ TEST(Takeover, oneToTwo) {
   // Make sure the received mount information is empty
   EXPECT_EQ(0, clientData.mountPoints.size());
 }
+
+namespace {
+SerializedInodeMap makeInodeMap(size_t numInodes, int64_t firstInode) {
+  SerializedInodeMap inodeMap;
+  for (size_t n = 0; n < numInodes; ++n) {
+    SerializedInodeMapEntry entry;
+    entry.inodeNumber = firstInode + n;
+    entry.parentInode = 1;
+    entry.name = folly::to<string>("file", n);
+    entry.isUnlinked = (n % 7 == 0);
+    entry.numFuseReferences = n % 3;
+    // Every other entry is materialized and has no hash.
+    entry.hash = (n % 2 == 0) ? string(20, static_cast<char>(n)) : "";
+    entry.mode = S_IFREG | 0644;
+    inodeMap.unloadedInodes.push_back(std::move(entry));
+  }
+  return inodeMap;
+}
+
+void checkInodeMap(
+    const SerializedInodeMap& expected,
+    SerializedInodeMap actual) {
+  // Version 5 hands the inodes over in a file when there are any.
+  if (!actual.unloadedInodeTablePath.empty()) {
+    EXPECT_TRUE(actual.unloadedInodes.empty());
+    auto table =
+        UnloadedInodeTable::open(AbsolutePath{actual.unloadedInodeTablePath});
+    for (size_t n = 0; n < table->size(); ++n) {
+      actual.unloadedInodes.push_back(table->getEntry(n));
+    }
+  }
+  ASSERT_EQ(expected.unloadedInodes.size(), actual.unloadedInodes.size());
+  for (size_t n = 0; n < expected.unloadedInodes.size(); ++n) {
+    const auto& want = expected.unloadedInodes[n];
+    const auto& got = actual.unloadedInodes[n];
+    EXPECT_EQ(want.inodeNumber, got.inodeNumber);
+    EXPECT_EQ(want.parentInode, got.parentInode);
+    EXPECT_EQ(want.name, got.name);
+    EXPECT_EQ(want.isUnlinked, got.isUnlinked);
+    EXPECT_EQ(want.numFuseReferences, got.numFuseReferences);
+    EXPECT_EQ(want.hash, got.hash);
+    EXPECT_EQ(want.mode, got.mode);
+  }
+}
+
+void checkUnloadedInodesTransferred(const std::set<int32_t>& versions) {
+  TemporaryDirectory tmpDir("eden_takeover_test");
+  AbsolutePathPiece tmpDirPath{tmpDir.path().string()};
+
+  TakeoverData serverData;
+  auto lockFilePath = tmpDirPath + "lock"_pc;
+  serverData.lockFile =
+      folly::File{lockFilePath.stringPiece(), O_RDWR | O_CREAT};
+  auto thriftSocketPath = tmpDirPath + "thrift"_pc;
+  serverData.thriftSocket =
+      folly::File{thriftSocketPath.stringPiece(), O_RDWR | O_CREAT};
+  // Make sure the inodes span several chunks.
+  serverData.maxInodesPerChunk = 100;
+
+  // The middle mount has no unloaded inodes at all.
+  const std::vector<SerializedInodeMap> inodeMaps{
+      makeInodeMap(1050, 100), makeInodeMap(0, 100), makeInodeMap(30, 5000)};
+  for (size_t n = 0; n < inodeMaps.size(); ++n) {
+    auto mountPath = tmpDirPath + PathComponent{folly::to<string>("mount", n)};
+    auto fusePath = tmpDirPath + PathComponent{folly::to<string>("fuse", n)};
+    auto clientPath =
+        tmpDirPath + PathComponent{folly::to<string>("client", n)};
+    folly::checkUnixError(
+        mkdir(clientPath.stringPiece().str().c_str(), 0755), "mkdir failed");
+    serverData.mountPoints.emplace_back(
+        mountPath,
+        clientPath,
+        std::vector<AbsolutePath>{},
+        folly::File{fusePath.stringPiece(), O_RDWR | O_CREAT},
+        fuse_init_out{},
+        SerializedFileHandleMap{},
+        SerializedInodeMap{inodeMaps[n]});
+  }
+
+  auto serverSendFuture = serverData.takeoverComplete.getFuture();
+  TestHandler handler{std::move(serverData)};
+  auto result = runTakeover(tmpDir, &handler, versions);
+  ASSERT_TRUE(serverSendFuture.hasValue());
+  ASSERT_TRUE(result.hasValue());
+  const auto& clientData = result.value();
+
+  ASSERT_EQ(inodeMaps.size(), clientData.mountPoints.size());
+  for (size_t n = 0; n < inodeMaps.size(); ++n) {
+    checkInodeMap(inodeMaps[n], clientData.mountPoints[n].inodeMap);
+  }
+}
+} // namespace
+
+TEST(Takeover, unloadedInodesAreStreamedInChunks) {
+  checkUnloadedInodesTransferred(
+      {TakeoverData::kTakeoverProtocolVersionFour});
+}
+
+TEST(Takeover, unloadedInodesAreHandedOverInFiles) {
+  checkUnloadedInodesTransferred(
+      {TakeoverData::kTakeoverProtocolVersionFive});
+}
+
+TEST(Takeover, unloadedInodesWithVersionThree) {
+  checkUnloadedInodesTransferred(
+      {TakeoverData::kTakeoverProtocolVersionThree});
+}
+
+TEST(Takeover, inodeChunksAreOnlyProducedForVersionFour) {
+  TakeoverData data;
+  EXPECT_FALSE(
+      data.serializeNextInodeChunk(TakeoverData::kTakeoverProtocolVersionThree)
+          .hasValue());
+
+  // With no mounts there is just the end marker.
+  auto endMarker =
+      data.serializeNextInodeChunk(TakeoverData::kTakeoverProtocolVersionFour);
+  ASSERT_TRUE(endMarker.hasValue());
+  EXPECT_FALSE(
+      data.serializeNextInodeChunk(TakeoverData::kTakeoverProtocolVersionFour)
+          .hasValue());
+}
@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/takeover/UnloadedInodeTable.h"
+
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+using namespace facebook::eden;
+using folly::test::TemporaryDirectory;
+using std::string;
+
+namespace {
+SerializedInodeMapEntry makeEntry(int64_t number, string name) {
+  SerializedInodeMapEntry entry;
+  entry.inodeNumber = number;
+  entry.parentInode = number / 2;
+  entry.name = std::move(name);
+  entry.isUnlinked = number % 3 == 0;
+  entry.numFuseReferences = number % 4;
+  entry.hash = number % 2 ? string(20, static_cast<char>(number)) : "";
+  entry.mode = S_IFREG | 0644;
+  return entry;
+}
+
+bool exists(AbsolutePathPiece path) {
+  struct stat st;
+  return stat(path.stringPiece().str().c_str(), &st) == 0;
+}
+} // namespace
+
+TEST(UnloadedInodeTable, entriesAreFoundByInodeNumber) {
+  TemporaryDirectory tmpDir("eden_unloaded_inode_table_test");
+  auto path = AbsolutePath{tmpDir.path().string()} + "inodes"_pc;
+
+  SerializedInodeMap inodeMap;
+  for (int64_t number : {17, 5, 1000, 6, 42}) {
+    inodeMap.unloadedInodes.push_back(
+        makeEntry(number, folly::to<string>("file", number)));
+  }
+  UnloadedInodeTable::moveToFile(inodeMap, path);
+  EXPECT_TRUE(inodeMap.unloadedInodes.empty());
+  EXPECT_EQ(path.stringPiece(), inodeMap.unloadedInodeTablePath);
+
+  auto table = UnloadedInodeTable::open(path);
+  EXPECT_FALSE(exists(path));
+  ASSERT_EQ(5, table->size());
+
+  // The records are sorted.
+  EXPECT_EQ(5, table->getInodeNumber(0));
+  EXPECT_EQ(1000, table->getInodeNumber(4));
+  for (int64_t number : {17, 5, 1000, 6, 42}) {
+    auto index = table->find(number);
+    ASSERT_TRUE(index.hasValue()) << number;
+    auto expected = makeEntry(number, folly::to<string>("file", number));
+    auto entry = table->getEntry(index.value());
+    EXPECT_EQ(expected.inodeNumber, entry.inodeNumber);
+    EXPECT_EQ(expected.parentInode, entry.parentInode);
+    EXPECT_EQ(expected.name, entry.name);
+    EXPECT_EQ(expected.isUnlinked, entry.isUnlinked);
+    EXPECT_EQ(expected.numFuseReferences, entry.numFuseReferences);
+    EXPECT_EQ(expected.hash, entry.hash);
+    EXPECT_EQ(expected.mode, entry.mode);
+  }
+  EXPECT_FALSE(table->find(1).hasValue());
+  EXPECT_FALSE(table->find(7).hasValue());
+  EXPECT_FALSE(table->find(2000).hasValue());
+}
+
+TEST(UnloadedInodeTable, rejectsInvalidFiles) {
+  TemporaryDirectory tmpDir("eden_unloaded_inode_table_test");
+  auto path = AbsolutePath{tmpDir.path().string()} + "inodes"_pc;
+
+  SerializedInodeMap inodeMap;
+  inodeMap.unloadedInodes.push_back(makeEntry(3, "name"));
+  UnloadedInodeTable::moveToFile(inodeMap, path);
+  string data;
+  ASSERT_TRUE(folly::readFile(path.stringPiece().str().c_str(), data));
+
+  ASSERT_TRUE(folly::writeFile(data.substr(0, data.size() - 1), path.c_str()));
+  EXPECT_THROW(UnloadedInodeTable::open(path), std::runtime_error);
+  ASSERT_TRUE(folly::writeFile(data.substr(0, 10), path.c_str()));
+  EXPECT_THROW(UnloadedInodeTable::open(path), std::runtime_error);
+  auto badMagic = data;
+  badMagic[0] ^= 1;
+  ASSERT_TRUE(folly::writeFile(badMagic, path.c_str()));
+  EXPECT_THROW(UnloadedInodeTable::open(path), std::runtime_error);
+
+  auto missing = AbsolutePath{tmpDir.path().string()} + "missing"_pc;
+  EXPECT_THROW(UnloadedInodeTable::open(missing), std::system_error);
+}
+
+TEST(UnloadedInodeTable, rejectsOversizedHashes) {
+  TemporaryDirectory tmpDir("eden_unloaded_inode_table_test");
+  auto path = AbsolutePath{tmpDir.path().string()} + "inodes"_pc;
+
+  SerializedInodeMap inodeMap;
+  inodeMap.unloadedInodes.push_back(makeEntry(3, "name"));
+  inodeMap.unloadedInodes.back().hash = string(21, 'x');
+  EXPECT_THROW(
+      UnloadedInodeTable::moveToFile(inodeMap, path), std::runtime_error);
+  EXPECT_EQ(1, inodeMap.unloadedInodes.size());
+  EXPECT_TRUE(inodeMap.unloadedInodeTablePath.empty());
+  EXPECT_FALSE(exists(path));
+}
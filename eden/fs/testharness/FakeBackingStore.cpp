@@ -32,12 +32,28 @@ using std::unique_ptr;
 namespace facebook {
 namespace eden {
 
+namespace {
+template <typename T>
+Future<T> delayBy(Future<T> future, std::chrono::milliseconds latency) {
+  if (latency.count() == 0) {
+    return future;
+  }
+  return folly::futures::sleep(latency).thenValue(
+      [future = std::move(future)](auto&&) mutable {
+        return std::move(future);
+      });
+}
+} // namespace
+
 FakeBackingStore::FakeBackingStore(std::shared_ptr<LocalStore> localStore)
     : localStore_(std::move(localStore)) {}
 
 FakeBackingStore::~FakeBackingStore() {}
 
-Future<unique_ptr<Tree>> FakeBackingStore::getTree(const Hash& id) {
+Future<unique_ptr<Tree>> FakeBackingStore::getTree(
+    const Hash& id,
+    ImportPriority /* priority */) {
+  ++treeFetchCount_;
   auto data = data_.rlock();
   auto it = data->trees.find(id);
   if (it == data->trees.end()) {
@@ -50,10 +66,13 @@ Future<unique_ptr<Tree>> FakeBackingStore::getTree(const Hash& id) {
     throw std::domain_error("tree " + id.toString() + " not found");
   }
 
-  return it->second->getFuture();
+  return delayBy(it->second->getFuture(), fetchLatency_.load());
 }
 
-Future<unique_ptr<Blob>> FakeBackingStore::getBlob(const Hash& id) {
+Future<unique_ptr<Blob>> FakeBackingStore::getBlob(
+    const Hash& id,
+    ImportPriority /* priority */) {
+  ++blobFetchCount_;
   auto data = data_.rlock();
   auto it = data->blobs.find(id);
   if (it == data->blobs.end()) {
@@ -61,7 +80,7 @@ Future<unique_ptr<Blob>> FakeBackingStore::getBlob(const Hash& id) {
     throw std::domain_error("blob " + id.toString() + " not found");
   }
 
-  return it->second->getFuture();
+  return delayBy(it->second->getFuture(), fetchLatency_.load());
 }
 
 Future<unique_ptr<Tree>> FakeBackingStore::getTreeForCommit(
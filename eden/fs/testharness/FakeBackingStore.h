@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <initializer_list>
 #include <memory>
 #include <unordered_map>
@@ -40,8 +42,12 @@ class FakeBackingStore : public BackingStore {
    * BackingStore APIs
    */
 
-  folly::Future<std::unique_ptr<Tree>> getTree(const Hash& id) override;
-  folly::Future<std::unique_ptr<Blob>> getBlob(const Hash& id) override;
+  folly::Future<std::unique_ptr<Tree>> getTree(
+      const Hash& id,
+      ImportPriority priority) override;
+  folly::Future<std::unique_ptr<Blob>> getBlob(
+      const Hash& id,
+      ImportPriority priority) override;
   folly::Future<std::unique_ptr<Tree>> getTreeForCommit(
       const Hash& commitID) override;
 
@@ -130,6 +136,24 @@ class FakeBackingStore : public BackingStore {
    */
   void discardOutstandingRequests();
 
+  /**
+   * Delay the result of each getTree() and getBlob() call by the given
+   * amount, to stand in for the round trip to a remote server.
+   */
+  void setFetchLatency(std::chrono::milliseconds latency) {
+    fetchLatency_ = latency;
+  }
+
+  /**
+   * The number of getTree() and getBlob() calls made so far.
+   */
+  size_t getTreeFetchCount() const {
+    return treeFetchCount_.load();
+  }
+  size_t getBlobFetchCount() const {
+    return blobFetchCount_.load();
+  }
+
  private:
   struct Data {
     std::unordered_map<Hash, std::unique_ptr<StoredTree>> trees;
@@ -148,6 +172,10 @@ class FakeBackingStore : public BackingStore {
 
   const std::shared_ptr<LocalStore> localStore_;
   folly::Synchronized<Data> data_;
+  std::atomic<std::chrono::milliseconds> fetchLatency_{
+      std::chrono::milliseconds{0}};
+  std::atomic<size_t> treeFetchCount_{0};
+  std::atomic<size_t> blobFetchCount_{0};
 };
 
 enum class FakeBlobType {
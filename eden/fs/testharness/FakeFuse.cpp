@@ -62,8 +62,7 @@ void FakeFuse::setTimeout(std::chrono::milliseconds timeout) {
 }
 
 uint32_t FakeFuse::sendRequest(uint32_t opcode, uint64_t inode, ByteRange arg) {
-  auto requestID = requestID_;
-  ++requestID_;
+  auto requestID = requestID_.fetch_add(1);
   XLOG(DBG5) << "injecting FUSE request ID " << requestID
              << ": opcode= " << opcode;
 
@@ -11,6 +11,7 @@
 
 #include <folly/File.h>
 #include <folly/Range.h>
+#include <atomic>
 #include <chrono>
 
 #include "eden/third-party/fuse_kernel_linux.h"
@@ -64,7 +65,8 @@ class FakeFuse {
   /**
    * Send a new request on the FUSE channel.
    *
-   * Returns the newly allocated request ID.
+   * Returns the newly allocated request ID.  Requests may be sent from
+   * several threads at once; each one is written as a single packet.
    */
   template <typename ArgType>
   uint32_t sendRequest(uint32_t opcode, uint64_t inode, const ArgType& arg) {
@@ -104,7 +106,7 @@ class FakeFuse {
    * The next request ID to use when sending requests.
    * We increment this for each request we send.
    */
-  uint32_t requestID_{0};
+  std::atomic<uint32_t> requestID_{0};
 };
 
 } // namespace eden
@@ -56,7 +56,8 @@ void FakeObjectStore::setTreeForCommit(const Hash& commitID, Tree&& tree) {
 }
 
 Future<std::shared_ptr<const Tree>> FakeObjectStore::getTree(
-    const Hash& id) const {
+    const Hash& id,
+    ImportPriority /* priority */) const {
   auto iter = trees_.find(id);
   if (iter == trees_.end()) {
     return makeFuture<shared_ptr<const Tree>>(
@@ -66,7 +67,8 @@ Future<std::shared_ptr<const Tree>> FakeObjectStore::getTree(
 }
 
 Future<std::shared_ptr<const Blob>> FakeObjectStore::getBlob(
-    const Hash& id) const {
+    const Hash& id,
+    ImportPriority /* priority */) const {
   auto iter = blobs_.find(id);
   if (iter == blobs_.end()) {
     return makeFuture<shared_ptr<const Blob>>(
@@ -97,5 +99,9 @@ folly::Future<folly::Unit> FakeObjectStore::prefetchBlobs(
     const std::vector<Hash>&) const {
   return folly::unit;
 }
+folly::Future<folly::Unit> FakeObjectStore::prefetchTree(const Hash&, size_t)
+    const {
+  return folly::unit;
+}
 } // namespace eden
 } // namespace facebook
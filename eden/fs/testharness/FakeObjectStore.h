@@ -34,14 +34,18 @@ class FakeObjectStore : public IObjectStore {
   void setTreeForCommit(const Hash& commitID, Tree&& tree);
 
   folly::Future<std::shared_ptr<const Tree>> getTree(
-      const Hash& id) const override;
+      const Hash& id,
+      ImportPriority priority = ImportPriority::Foreground) const override;
   folly::Future<std::shared_ptr<const Blob>> getBlob(
-      const Hash& id) const override;
+      const Hash& id,
+      ImportPriority priority = ImportPriority::Foreground) const override;
   folly::Future<std::shared_ptr<const Tree>> getTreeForCommit(
       const Hash& commitID) const override;
   folly::Future<BlobMetadata> getBlobMetadata(const Hash& id) const override;
   folly::Future<folly::Unit> prefetchBlobs(
       const std::vector<Hash>& ids) const override;
+  folly::Future<folly::Unit> prefetchTree(const Hash& id, size_t depth)
+      const override;
 
  private:
   std::unordered_map<Hash, Tree> trees_;
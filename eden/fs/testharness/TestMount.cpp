@@ -35,6 +35,7 @@
 #include "eden/fs/store/MemoryLocalStore.h"
 #include "eden/fs/store/ObjectStore.h"
 #include "eden/fs/store/hg/HgManifestImporter.h"
+#include "eden/fs/takeover/UnloadedInodeTable.h"
 #include "eden/fs/testharness/FakeBackingStore.h"
 #include "eden/fs/testharness/FakeClock.h"
 #include "eden/fs/testharness/FakeFuse.h"
@@ -78,10 +79,15 @@ TestMount::TestMount()
   // This sets both testDir_, config_, localStore_, and backingStore_
   initTestDirectory();
 
+  // Background work shares the same ManualExecutor, so that
+  // drainServerExecutor() runs everything.
+  auto threadPool = make_shared<UnboundedQueueExecutor>(serverExecutor_);
   serverState_ = {make_shared<ServerState>(
       UserInfo::lookup(),
       privHelper_,
-      make_shared<UnboundedQueueExecutor>(serverExecutor_),
+      threadPool,
+      threadPool,
+      /*overlayIoPool=*/nullptr,
       clock_,
       make_shared<EdenConfig>(
           /*userName=*/folly::StringPiece{"bob"},
@@ -233,7 +239,7 @@ void TestMount::remount() {
   edenMount_->initialize().get();
 }
 
-void TestMount::remountGracefully() {
+void TestMount::remountGracefully(bool useUnloadedInodeTable) {
   // Create a new copy of the ClientConfig
   auto config = make_unique<ClientConfig>(*edenMount_->getConfig());
   // Create a new ObjectStore pointing to our local store and backing store
@@ -257,11 +263,18 @@ void TestMount::remountGracefully() {
 
   XLOG(DBG1) << "number of unloaded inodes transferred on graceful remount: "
              << std::get<1>(takeoverData).unloadedInodes.size();
+  if (useUnloadedInodeTable) {
+    UnloadedInodeTable::moveToFile(
+        std::get<1>(takeoverData),
+        config->getClientDirectory() + PathComponentPiece{"takeover-inodes"});
+  }
 
   // Create a new EdenMount object.
   edenMount_ = EdenMount::create(
       std::move(config), std::move(objectStore), serverState_);
-  edenMount_->initialize(std::get<1>(takeoverData)).get();
+  edenMount_->initialize(std::get<1>(takeoverData), std::get<2>(takeoverData))
+      .get();
+  takeoverWarmState_ = std::move(std::get<3>(takeoverData));
 }
 
 void TestMount::resetCommit(FakeTreeBuilder& builder, bool setReady) {
@@ -184,8 +184,18 @@ class TestMount {
 
   /**
    * Simulate an edenfs daemon takeover for this mount.
+   *
+   * If useUnloadedInodeTable is true the unloaded inodes are handed over in
+   * an UnloadedInodeTable file, as takeover protocol version 5 does.
    */
-  void remountGracefully();
+  void remountGracefully(bool useUnloadedInodeTable = false);
+
+  /**
+   * Get the warm state handed over by the last remountGracefully().
+   */
+  const SerializedWarmState& getTakeoverWarmState() const {
+    return takeoverWarmState_;
+  }
 
   /**
    * Add file to the mount; it will be available in the overlay.
@@ -303,6 +313,7 @@ class TestMount {
   std::unique_ptr<folly::test::TemporaryDirectory> testDir_;
 
   std::shared_ptr<EdenMount> edenMount_;
+  SerializedWarmState takeoverWarmState_;
   std::shared_ptr<LocalStore> localStore_;
   std::shared_ptr<FakeBackingStore> backingStore_;
   /*
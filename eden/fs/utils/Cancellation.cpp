@@ -0,0 +1,160 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/Cancellation.h"
+
+#include <folly/Synchronized.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace facebook {
+namespace eden {
+
+namespace {
+const std::string kCancellationKey("eden_cancellation");
+
+class CancellationRequestData : public folly::RequestData {
+ public:
+  explicit CancellationRequestData(CancellationToken token)
+      : token_{std::move(token)} {}
+
+  bool hasCallback() override {
+    return false;
+  }
+
+  const CancellationToken& getToken() const {
+    return token_;
+  }
+
+ private:
+  CancellationToken token_;
+};
+} // namespace
+
+CancellationToken CancellationToken::current() {
+  const auto* data =
+      folly::RequestContext::get()->getContextData(kCancellationKey);
+  return data ? static_cast<const CancellationRequestData*>(data)->getToken()
+              : CancellationToken{};
+}
+
+void CancellationToken::setCurrent(CancellationToken token) {
+  folly::RequestContext::get()->setContextData(
+      kCancellationKey,
+      std::make_unique<CancellationRequestData>(std::move(token)));
+}
+
+class CancellationSource::SourceState : public CancellationToken::State {
+ public:
+  bool isCancelled() const override {
+    return cancelled_.load(std::memory_order_acquire);
+  }
+
+  void cancel() {
+    cancelled_.store(true, std::memory_order_release);
+  }
+
+ private:
+  std::atomic<bool> cancelled_{false};
+};
+
+CancellationSource::CancellationSource()
+    : state_{std::make_shared<SourceState>()} {}
+
+CancellationToken CancellationSource::getToken() const {
+  return CancellationToken{state_};
+}
+
+void CancellationSource::cancel() {
+  state_->cancel();
+}
+
+bool CancellationSource::isCancelled() const {
+  return state_->isCancelled();
+}
+
+class CancellationJoin::JoinState : public CancellationToken::State {
+ public:
+  explicit JoinState(CancellationToken token) {
+    addLocked(*state_.wlock(), std::move(token));
+  }
+
+  bool isCancelled() const override {
+    auto state = state_.wlock();
+    if (!state->sealed && !state->uncancellable &&
+        std::all_of(
+            state->tokens.begin(),
+            state->tokens.end(),
+            [](const CancellationToken& token) {
+              return token.isCancelled();
+            })) {
+      state->sealed = true;
+    }
+    return state->sealed;
+  }
+
+  bool add(CancellationToken token) {
+    auto state = state_.wlock();
+    if (state->sealed) {
+      return false;
+    }
+    addLocked(*state, std::move(token));
+    return true;
+  }
+
+ private:
+  struct Tokens {
+    std::vector<CancellationToken> tokens;
+    // Set once a waiter that can never be cancelled has joined.
+    bool uncancellable{false};
+    // Set once the combined token has been seen to be cancelled.
+    bool sealed{false};
+  };
+
+  static void addLocked(Tokens& state, CancellationToken token) {
+    if (state.uncancellable) {
+      return;
+    }
+    if (!token.canBeCancelled()) {
+      state.uncancellable = true;
+      state.tokens.clear();
+      return;
+    }
+    // Waiters that have already gone away no longer affect the result, so
+    // drop them to keep long-running joins from growing without bound.
+    state.tokens.erase(
+        std::remove_if(
+            state.tokens.begin(),
+            state.tokens.end(),
+            [](const CancellationToken& t) { return t.isCancelled(); }),
+        state.tokens.end());
+    state.tokens.push_back(std::move(token));
+  }
+
+  mutable folly::Synchronized<Tokens> state_;
+};
+
+CancellationJoin::CancellationJoin(CancellationToken token)
+    : state_{std::make_shared<JoinState>(std::move(token))} {}
+
+bool CancellationJoin::add(CancellationToken token) {
+  return state_ && state_->add(std::move(token));
+}
+
+CancellationToken CancellationJoin::getToken() const {
+  return state_ ? CancellationToken{state_} : CancellationToken{};
+}
+
+CancellationScope::CancellationScope(CancellationToken token)
+    : guard_{kCancellationKey,
+             std::make_unique<CancellationRequestData>(std::move(token))} {}
+
+} // namespace eden
+} // namespace facebook
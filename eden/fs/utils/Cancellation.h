@@ -0,0 +1,151 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/Request.h>
+#include <memory>
+#include <string>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * A CancellationToken tells work whether its requester still wants the
+ * result.
+ *
+ * Tokens are polled rather than notified: queued work checks isCancelled()
+ * when it reaches the front of its queue, and skips itself if nobody is
+ * waiting any more.  Work that has already started is never interrupted.
+ *
+ * The token of the current request is stored in the folly RequestContext,
+ * so that it follows the request across the futures and threads that work
+ * on it, and layers such as the backing stores can find it without it being
+ * passed through every interface in between.
+ *
+ * A default-constructed token is never cancelled.  Tokens are cheap to copy
+ * and may be used from any thread.
+ */
+class CancellationToken {
+ public:
+  CancellationToken() = default;
+
+  bool isCancelled() const {
+    return state_ && state_->isCancelled();
+  }
+
+  /**
+   * Returns false if this token can never be cancelled.
+   */
+  bool canBeCancelled() const {
+    return state_ != nullptr;
+  }
+
+  /**
+   * Get the token of the current RequestContext, or a token that is never
+   * cancelled if the request did not set one.
+   */
+  static CancellationToken current();
+
+  /**
+   * Store token in the current RequestContext.  The caller should have
+   * created a new RequestContext for the request; use CancellationScope to
+   * change the token of work that shares a RequestContext with other work.
+   */
+  static void setCurrent(CancellationToken token);
+
+  class State {
+   public:
+    virtual ~State() = default;
+    virtual bool isCancelled() const = 0;
+  };
+
+ private:
+  friend class CancellationSource;
+  friend class CancellationJoin;
+
+  explicit CancellationToken(std::shared_ptr<const State> state)
+      : state_{std::move(state)} {}
+
+  std::shared_ptr<const State> state_;
+};
+
+/**
+ * The owner of a request's cancellation, such as the FUSE request or thrift
+ * stream that the request is serving.
+ */
+class CancellationSource {
+ public:
+  CancellationSource();
+
+  CancellationToken getToken() const;
+
+  /**
+   * Cancel all of the tokens from getToken().  This cannot be undone.
+   */
+  void cancel();
+
+  bool isCancelled() const;
+
+ private:
+  class SourceState;
+
+  std::shared_ptr<SourceState> state_;
+};
+
+/**
+ * A CancellationJoin combines the tokens of every request waiting on one
+ * piece of shared work, such as a de-duplicated load.  Its token is cancelled
+ * once all of the requests joined to it have been cancelled, so the work is
+ * only dropped when no other waiter remains.
+ *
+ * Joining a token that can never be cancelled makes the join uncancellable.
+ * Once the join's token has been seen to be cancelled, the work may already
+ * have been dropped, so later calls to add() fail and the caller must start
+ * the work again rather than waiting for it.
+ *
+ * A default-constructed CancellationJoin holds no work: add() fails, and
+ * getToken() returns a token that is never cancelled.
+ */
+class CancellationJoin {
+ public:
+  CancellationJoin() = default;
+  explicit CancellationJoin(CancellationToken token);
+
+  /**
+   * Join another waiter to the work.  Returns false if the work may already
+   * have been dropped for being cancelled.
+   */
+  bool add(CancellationToken token);
+
+  CancellationToken getToken() const;
+
+ private:
+  class JoinState;
+
+  std::shared_ptr<JoinState> state_;
+};
+
+/**
+ * Runs the enclosing scope with token as the current CancellationToken,
+ * keeping the rest of the current RequestContext.
+ */
+class CancellationScope {
+ public:
+  explicit CancellationScope(CancellationToken token);
+
+  CancellationScope(const CancellationScope&) = delete;
+  CancellationScope& operator=(const CancellationScope&) = delete;
+
+ private:
+  folly::ShallowCopyRequestContextScopeGuard guard_;
+};
+
+} // namespace eden
+} // namespace facebook
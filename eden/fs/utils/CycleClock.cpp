@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/CycleClock.h"
+
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
+#include <time.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+DEFINE_bool(
+    tsc_timing,
+    true,
+    "Time FUSE requests with the CPU's time stamp counter when it runs at a "
+    "constant rate, rather than reading the steady clock.");
+
+using namespace std::chrono;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+constexpr auto kCalibrationPeriod = milliseconds{10};
+
+/**
+ * The TSC is only usable as a clock if it ticks at the same rate whatever
+ * the CPU's frequency and keeps ticking in deep sleep states.
+ */
+bool hasInvariantTsc() {
+  std::string cpuinfo;
+  if (!folly::readFile("/proc/cpuinfo", cpuinfo)) {
+    return false;
+  }
+  // Every CPU lists the same flags, so the first one is enough.
+  auto flagsPos = cpuinfo.find("\nflags");
+  if (flagsPos == std::string::npos) {
+    return false;
+  }
+  auto end = cpuinfo.find('\n', flagsPos + 1);
+  auto flagsLine = folly::StringPiece{cpuinfo}.subpiece(
+      flagsPos, end == std::string::npos ? end : end - flagsPos);
+  std::vector<folly::StringPiece> flags;
+  folly::split(' ', flagsLine, flags);
+  bool constant = false;
+  bool nonstop = false;
+  for (auto flag : flags) {
+    constant = constant || flag == "constant_tsc";
+    nonstop = nonstop || flag == "nonstop_tsc";
+  }
+  return constant && nonstop;
+}
+} // namespace
+
+CycleClock::Calibration CycleClock::calibrate() {
+  Calibration calibration;
+#if defined(__x86_64__)
+  if (!FLAGS_tsc_timing || !hasInvariantTsc()) {
+    XLOG(DBG2) << "timing with the steady clock";
+    return calibration;
+  }
+
+  auto startTime = steady_clock::now();
+  auto startTicks = __rdtsc();
+  std::this_thread::sleep_for(kCalibrationPeriod);
+  auto endTime = steady_clock::now();
+  auto endTicks = __rdtsc();
+  if (endTicks <= startTicks) {
+    XLOG(WARN) << "the time stamp counter did not advance; timing with the "
+               << "steady clock";
+    return calibration;
+  }
+
+  calibration.useTsc = true;
+  calibration.nanosPerTick =
+      static_cast<double>(
+          duration_cast<nanoseconds>(endTime - startTime).count()) /
+      static_cast<double>(endTicks - startTicks);
+  XLOG(DBG2) << "timing with the time stamp counter at "
+             << 1.0 / calibration.nanosPerTick << " GHz";
+#endif
+  return calibration;
+}
+
+steady_clock::time_point CycleClock::coarseSteadyNow() {
+#if defined(CLOCK_MONOTONIC_COARSE)
+  // CLOCK_MONOTONIC_COARSE shares CLOCK_MONOTONIC's epoch, which is what
+  // steady_clock uses on Linux.
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0) {
+    return steady_clock::time_point{duration_cast<steady_clock::duration>(
+        seconds{ts.tv_sec} + nanoseconds{ts.tv_nsec})};
+  }
+#endif
+  return steady_clock::now();
+}
+
+} // namespace eden
+} // namespace facebook
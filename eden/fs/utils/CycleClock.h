@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Likely.h>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace facebook {
+namespace eden {
+
+/**
+ * A cheap clock for timing short intervals, such as the stages of a FUSE
+ * request.
+ *
+ * On x86-64 CPUs whose time stamp counter runs at a constant rate and keeps
+ * running in deep sleep states, now() reads the TSC, which takes a few
+ * cycles rather than the tens of nanoseconds of a steady_clock read.  The
+ * TSC's rate is measured against steady_clock the first time the clock is
+ * used.  Elsewhere now() falls back to steady_clock.
+ *
+ * Tick values are only meaningful as differences, converted with
+ * toDuration().
+ */
+class CycleClock {
+ public:
+  using Ticks = uint64_t;
+
+  struct Calibration {
+    bool useTsc{false};
+    /** The length of one tick. */
+    double nanosPerTick{1.0};
+  };
+
+  static Ticks now() {
+#if defined(__x86_64__)
+    if (LIKELY(getCalibration().useTsc)) {
+      return __rdtsc();
+    }
+#endif
+    return steadyTicks();
+  }
+
+  /**
+   * Convert the difference between two now() values to a duration.  start
+   * may be after end if they were read on different CPUs whose counters
+   * are slightly out of step; that is treated as no time at all.
+   */
+  static std::chrono::nanoseconds elapsed(Ticks start, Ticks end) {
+    if (UNLIKELY(end < start)) {
+      return std::chrono::nanoseconds{0};
+    }
+    return std::chrono::nanoseconds{static_cast<int64_t>(
+        static_cast<double>(end - start) * getCalibration().nanosPerTick)};
+  }
+
+  /**
+   * The time in the same epoch as steady_clock, accurate only to the
+   * kernel's tick of a few milliseconds but much cheaper to read.  Good
+   * enough for choosing which second of a timeseries a value falls in.
+   */
+  static std::chrono::steady_clock::time_point coarseSteadyNow();
+
+  /**
+   * Measure the TSC if that has not been done yet.  This takes about 10ms,
+   * so it is worth calling at startup rather than on the first timed
+   * request.
+   */
+  static const Calibration& getCalibration() {
+    static const Calibration calibration = calibrate();
+    return calibration;
+  }
+
+ private:
+  static Ticks steadyTicks() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static Calibration calibrate();
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,203 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <folly/ThreadLocal.h>
+#include <folly/hash/Hash.h>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * HotKeyTracker finds the most frequently accessed keys, such as the trees
+ * and blobs read through an ObjectStore, in bounded memory.
+ *
+ * Access counts are estimated with a count-min sketch, which may overcount
+ * but never undercounts.  The capacity keys with the highest estimates are
+ * kept in a table, which also counts the hits and misses of each key since
+ * it entered the table.
+ *
+ * record() only appends to a buffer owned by the calling thread.  A thread's
+ * buffer is added to the sketch once it fills up, and all buffers are added
+ * before getTop() reports.  Accesses still buffered by a thread when it exits
+ * are lost.
+ *
+ * HotKeyTracker is thread-safe.
+ */
+template <typename KEY, typename HASH = std::hash<KEY>>
+class HotKeyTracker {
+ public:
+  struct Entry {
+    KEY key;
+    /** The estimated number of accesses. */
+    uint64_t accesses{0};
+    uint64_t hits{0};
+    uint64_t misses{0};
+  };
+
+  static constexpr size_t kDefaultCapacity = 100;
+  static constexpr size_t kDefaultSketchWidth = 4096;
+
+  explicit HotKeyTracker(
+      size_t capacity = kDefaultCapacity,
+      size_t sketchWidth = kDefaultSketchWidth)
+      : capacity_{capacity},
+        sketchWidth_{sketchWidth},
+        state_{folly::in_place, kSketchDepth * sketchWidth} {}
+
+  HotKeyTracker(const HotKeyTracker&) = delete;
+  HotKeyTracker& operator=(const HotKeyTracker&) = delete;
+
+  /**
+   * Record an access to key.  What counts as a hit is up to the caller.
+   */
+  void record(const KEY& key, bool hit) {
+    std::vector<Access> accesses;
+    {
+      auto& buffer = *buffers_;
+      std::lock_guard<std::mutex> guard(buffer.mutex);
+      buffer.accesses.push_back(Access{key, hit});
+      if (buffer.accesses.size() < kBufferSize) {
+        return;
+      }
+      accesses.swap(buffer.accesses);
+    }
+    apply(accesses);
+  }
+
+  /**
+   * Get up to limit of the most accessed keys, most accessed first.
+   */
+  std::vector<Entry> getTop(size_t limit) {
+    std::vector<Access> accesses;
+    for (auto& buffer : buffers_.accessAllThreads()) {
+      std::lock_guard<std::mutex> guard(buffer.mutex);
+      accesses.insert(
+          accesses.end(), buffer.accesses.begin(), buffer.accesses.end());
+      buffer.accesses.clear();
+    }
+    apply(accesses);
+
+    std::vector<Entry> result;
+    {
+      auto state = state_.lock();
+      result.reserve(state->top.size());
+      for (const auto& entry : state->top) {
+        result.push_back(entry.second);
+      }
+    }
+    limit = std::min(limit, result.size());
+    std::partial_sort(
+        result.begin(),
+        result.begin() + limit,
+        result.end(),
+        [](const Entry& a, const Entry& b) { return a.accesses > b.accesses; });
+    result.resize(limit);
+    return result;
+  }
+
+ private:
+  static constexpr size_t kSketchDepth = 4;
+  static constexpr size_t kBufferSize = 64;
+
+  struct Access {
+    KEY key;
+    bool hit;
+  };
+
+  struct Buffer {
+    std::mutex mutex;
+    std::vector<Access> accesses;
+  };
+
+  struct State {
+    explicit State(size_t sketchSize) : sketch(sketchSize) {}
+
+    std::vector<uint32_t> sketch;
+    std::unordered_map<KEY, Entry, HASH> top;
+    /**
+     * No entry in top has fewer accesses than this, so keys estimated at
+     * no more than it can be skipped without looking for the coldest entry.
+     */
+    uint64_t minAccesses{0};
+  };
+
+  uint64_t increment(State& state, const KEY& key) const {
+    // Derive the row hashes from two hashes of the key.
+    const uint64_t h1 = HASH{}(key);
+    const uint64_t h2 = folly::hash::twang_mix64(h1) | 1;
+    uint64_t estimate = std::numeric_limits<uint64_t>::max();
+    for (size_t row = 0; row < kSketchDepth; ++row) {
+      auto& counter =
+          state.sketch[row * sketchWidth_ + (h1 + row * h2) % sketchWidth_];
+      if (counter < std::numeric_limits<uint32_t>::max()) {
+        ++counter;
+      }
+      estimate = std::min<uint64_t>(estimate, counter);
+    }
+    return estimate;
+  }
+
+  void apply(const std::vector<Access>& accesses) {
+    if (accesses.empty()) {
+      return;
+    }
+    auto state = state_.lock();
+    for (const auto& access : accesses) {
+      const auto estimate = increment(*state, access.key);
+      auto it = state->top.find(access.key);
+      if (it == state->top.end()) {
+        if (state->top.size() >= capacity_) {
+          if (estimate <= state->minAccesses) {
+            continue;
+          }
+          auto coldest = std::min_element(
+              state->top.begin(),
+              state->top.end(),
+              [](const auto& a, const auto& b) {
+                return a.second.accesses < b.second.accesses;
+              });
+          if (coldest == state->top.end()) {
+            continue;
+          }
+          state->minAccesses = coldest->second.accesses;
+          if (estimate <= state->minAccesses) {
+            continue;
+          }
+          state->top.erase(coldest);
+        }
+        Entry entry;
+        entry.key = access.key;
+        it = state->top.emplace(access.key, std::move(entry)).first;
+      }
+      it->second.accesses = estimate;
+      if (access.hit) {
+        ++it->second.hits;
+      } else {
+        ++it->second.misses;
+      }
+    }
+  }
+
+  const size_t capacity_;
+  const size_t sketchWidth_;
+  folly::ThreadLocal<Buffer> buffers_;
+  folly::Synchronized<State, std::mutex> state_;
+};
+
+} // namespace eden
+} // namespace facebook
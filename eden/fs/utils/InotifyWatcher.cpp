@@ -0,0 +1,196 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/InotifyWatcher.h"
+
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <folly/logging/xlog.h>
+#include <folly/system/ThreadName.h>
+#include <sys/inotify.h>
+#include <algorithm>
+#include <thread>
+
+namespace facebook {
+namespace eden {
+
+namespace {
+// Events on a watched file's parent directory that may mean the file has
+// changed.  Other names in the directory are ignored.
+constexpr uint32_t kDirEvents = IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE |
+    IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+// Events on the file itself, including whatever it is a symlink to.
+constexpr uint32_t kFileEvents =
+    IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF;
+} // namespace
+
+InotifyWatcher::InotifyWatcher() {
+  const int fd = inotify_init1(IN_CLOEXEC);
+  if (fd < 0) {
+    XLOG(WARN) << "unable to initialize inotify, will poll files instead: "
+               << folly::errnoStr(errno);
+    return;
+  }
+  inotifyFd_ = folly::File(fd, /*ownsFd=*/true);
+
+  // The watcher lives until the process exits.
+  std::thread([this] {
+    folly::setThreadName("InotifyWatcher");
+    run();
+  })
+      .detach();
+}
+
+InotifyWatcher* InotifyWatcher::getInstance() {
+  // Created on first use rather than at startup, so that its thread is not
+  // started before the privhelper process is forked.
+  static auto* watcher = new InotifyWatcher();
+  return watcher;
+}
+
+std::shared_ptr<const InotifyWatcher::Watch> InotifyWatcher::watch(
+    AbsolutePathPiece path) {
+  auto* watcher = getInstance();
+  if (!watcher->inotifyFd_) {
+    return nullptr;
+  }
+  return watcher->addWatch(path);
+}
+
+std::shared_ptr<const InotifyWatcher::Watch> InotifyWatcher::addWatch(
+    AbsolutePathPiece path) {
+  auto state = state_.wlock();
+  auto key = path.stringPiece().str();
+  auto existing = state->watches.find(key);
+  if (existing != state->watches.end()) {
+    if (existing->second->isActive()) {
+      return existing->second;
+    }
+    // Its directory went away.  Try again, in case it is back.
+    state->paths.erase(existing->second.get());
+    state->watches.erase(existing);
+  }
+
+  // The lock is held while adding the inotify watches, so that run() can't
+  // process their events before they have been recorded.
+  const auto dirPath = path.dirname().stringPiece().str();
+  const int dirWd =
+      inotify_add_watch(inotifyFd_.fd(), dirPath.c_str(), kDirEvents);
+  if (dirWd < 0) {
+    XLOG(DBG2) << "unable to watch " << dirPath
+               << ", will poll instead: " << folly::errnoStr(errno);
+    return nullptr;
+  }
+
+  auto watch = std::make_shared<Watch>();
+  state->dirs[dirWd].files[path.basename().stringPiece().str()] = watch;
+  state->paths.emplace(watch.get(), AbsolutePath{path});
+  state->watches.emplace(std::move(key), watch);
+  watchFile(*state, watch);
+  return watch;
+}
+
+void InotifyWatcher::watchFile(
+    State& state,
+    const std::shared_ptr<Watch>& watch) {
+  const auto& path = state.paths.at(watch.get());
+  const int wd = inotify_add_watch(inotifyFd_.fd(), path.c_str(), kFileEvents);
+  if (wd < 0) {
+    // The file doesn't exist yet.  Its parent directory will tell us when it
+    // is created.
+    return;
+  }
+  auto& watches = state.files[wd];
+  if (std::find(watches.begin(), watches.end(), watch) == watches.end()) {
+    watches.push_back(watch);
+  }
+}
+
+void InotifyWatcher::run() {
+  // Large enough for many events at a time, since each one includes a name.
+  alignas(struct inotify_event) char buffer[16 * 1024];
+  while (true) {
+    const auto bytesRead =
+        folly::readNoInt(inotifyFd_.fd(), buffer, sizeof(buffer));
+    if (bytesRead < 0) {
+      XLOG(ERR) << "error reading inotify events, will poll files instead: "
+                << folly::errnoStr(errno);
+      auto state = state_.wlock();
+      for (auto& entry : state->watches) {
+        entry.second->active_.store(false, std::memory_order_relaxed);
+        entry.second->bump();
+      }
+      return;
+    }
+
+    auto state = state_.wlock();
+    for (ssize_t offset = 0; offset < bytesRead;) {
+      const auto* event =
+          reinterpret_cast<const struct inotify_event*>(buffer + offset);
+      processEvent(*state, *event);
+      offset += sizeof(struct inotify_event) + event->len;
+    }
+  }
+}
+
+void InotifyWatcher::processEvent(State& state, const inotify_event& event) {
+  if (event.mask & IN_Q_OVERFLOW) {
+    // Some events were lost, so anything may have changed.
+    for (auto& entry : state.watches) {
+      entry.second->bump();
+    }
+    return;
+  }
+
+  auto fileIter = state.files.find(event.wd);
+  if (fileIter != state.files.end()) {
+    auto watches = fileIter->second;
+    if (event.mask & IN_IGNORED) {
+      // The file was deleted or replaced.  Its parent directory's watch
+      // reports that too.
+      state.files.erase(fileIter);
+    }
+    for (const auto& watch : watches) {
+      watch->bump();
+      // A symlink's target may have been replaced, so watch whatever the
+      // path refers to now.
+      watchFile(state, watch);
+    }
+    return;
+  }
+
+  auto dirIter = state.dirs.find(event.wd);
+  if (dirIter == state.dirs.end()) {
+    return;
+  }
+  if (event.mask & IN_IGNORED) {
+    XLOG(DBG2) << "a watched directory went away, polling its files instead";
+    for (auto& entry : dirIter->second.files) {
+      entry.second->active_.store(false, std::memory_order_relaxed);
+      entry.second->bump();
+    }
+    state.dirs.erase(dirIter);
+    return;
+  }
+  if (event.len == 0) {
+    return;
+  }
+  auto nameIter = dirIter->second.files.find(event.name);
+  if (nameIter == dirIter->second.files.end()) {
+    return;
+  }
+  nameIter->second->bump();
+  if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+    watchFile(state, nameIter->second);
+  }
+}
+
+} // namespace eden
+} // namespace facebook
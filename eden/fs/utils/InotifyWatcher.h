@@ -0,0 +1,153 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/File.h>
+#include <folly/Optional.h>
+#include <folly/Synchronized.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "eden/fs/utils/PathFuncs.h"
+
+struct inotify_event;
+
+namespace facebook {
+namespace eden {
+
+/**
+ * InotifyWatcher uses inotify to learn when files may have changed, so that
+ * code that would otherwise stat() them every few seconds only needs to do so
+ * after something has happened to them.
+ *
+ * There is one InotifyWatcher per process, with a background thread that
+ * reads inotify events for every watched file.  Each file is watched through
+ * its parent directory, so that it is noticed when it is created, deleted, or
+ * atomically replaced by a rename, and through the file itself, so that
+ * changes made through a symlink are noticed too.
+ *
+ * Watches are never removed.  Eden only watches a handful of configuration
+ * files.
+ */
+class InotifyWatcher {
+ public:
+  class Watch {
+   public:
+    /**
+     * Returns a number that changes whenever the file may have changed.
+     */
+    uint64_t getGeneration() const {
+      return generation_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns false if changes to the file can no longer be detected, for
+     * instance because its parent directory was removed.  The file's users
+     * should go back to checking it themselves.
+     */
+    bool isActive() const {
+      return active_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    friend class InotifyWatcher;
+
+    void bump() {
+      generation_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> generation_{0};
+    std::atomic<bool> active_{true};
+  };
+
+  /**
+   * Start watching path for changes.
+   *
+   * Returns null if path cannot be watched, for instance because inotify is
+   * unavailable or the directory containing path does not exist.  Watching
+   * the same path more than once returns the same Watch.
+   */
+  static std::shared_ptr<const Watch> watch(AbsolutePathPiece path);
+
+ private:
+  struct DirWatch {
+    // The watched files in this directory, by name.
+    std::unordered_map<std::string, std::shared_ptr<Watch>> files;
+  };
+  struct State {
+    std::unordered_map<std::string, std::shared_ptr<Watch>> watches;
+    // Parent directories and watched files, by inotify watch descriptor.
+    std::unordered_map<int, DirWatch> dirs;
+    std::unordered_map<int, std::vector<std::shared_ptr<Watch>>> files;
+    // The path of each watched file, so that it can be watched again after
+    // being replaced.
+    std::unordered_map<const Watch*, AbsolutePath> paths;
+  };
+
+  InotifyWatcher();
+
+  static InotifyWatcher* getInstance();
+
+  std::shared_ptr<const Watch> addWatch(AbsolutePathPiece path);
+  /** Watch the file itself, in addition to its parent directory. */
+  void watchFile(State& state, const std::shared_ptr<Watch>& watch);
+  void run();
+  void processEvent(State& state, const inotify_event& event);
+
+  folly::File inotifyFd_;
+  folly::Synchronized<State> state_;
+};
+
+/**
+ * InotifyChangeTracker lets one user of a file find out whether it may have
+ * changed since that user last checked it.
+ *
+ * Without an active inotify watch it always reports that the file may have
+ * changed, so that its user checks the file as it would have without one.
+ */
+class InotifyChangeTracker {
+ public:
+  explicit InotifyChangeTracker(AbsolutePathPiece path)
+      : watch_{InotifyWatcher::watch(path)} {}
+
+  /**
+   * Returns true if the file may have changed since the last markChecked()
+   * call, or if there has not been one.
+   */
+  bool mayHaveChanged() const {
+    return !watch_ || !watch_->isActive() || !checkedGeneration_ ||
+        watch_->getGeneration() != checkedGeneration_.value();
+  }
+
+  /**
+   * Record that the file is about to be checked.  This must be called before
+   * looking at the file, so that a change made while it is being checked is
+   * reported by the next mayHaveChanged() call.
+   */
+  void markChecked() {
+    if (watch_) {
+      checkedGeneration_ = watch_->getGeneration();
+    }
+  }
+
+  /** Forget the last check, so that mayHaveChanged() returns true. */
+  void reset() {
+    checkedGeneration_.clear();
+  }
+
+ private:
+  std::shared_ptr<const InotifyWatcher::Watch> watch_;
+  folly::Optional<uint64_t> checkedGeneration_;
+};
+
+} // namespace eden
+} // namespace facebook
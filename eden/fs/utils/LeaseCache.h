@@ -8,74 +8,202 @@
  *
  */
 #pragma once
+#include <folly/Synchronized.h>
 #include <folly/container/EvictingCacheMap.h>
 #include <folly/futures/Future.h>
 #include <folly/futures/SharedPromise.h>
+#include <folly/hash/Hash.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace facebook {
 namespace eden {
 
+/**
+ * LeaseCache maps keys to values that are fetched on demand, making sure
+ * that concurrent requests for the same key share a single fetch.
+ *
+ * The cache holds at most maxSize entries, evicting the least recently used
+ * ones first.  A maxSize of 0 means the cache is unbounded.
+ *
+ * A fetch that fails, or that produces a null value, is a negative result.
+ * By default negative results are cached like any other, but they can be
+ * given a TTL after which the next get() fetches the key again.
+ *
+ * The cache is split into a number of independently locked shards so that
+ * lookups of different keys do not all contend on one lock.  Each shard
+ * receives an equal fraction of maxSize.
+ *
+ * LeaseCache is thread-safe.
+ */
 template <typename KEY, typename VAL, typename HASH = std::hash<KEY>>
 class LeaseCache {
  public:
+  using Clock = std::chrono::steady_clock;
   using ValuePtr = std::shared_ptr<VAL>;
   using FutureType = folly::Future<ValuePtr>;
-  using SharedPromiseType = std::shared_ptr<folly::SharedPromise<ValuePtr>>;
   using FetchFunc = std::function<FutureType(const KEY& key)>;
 
- private:
-  std::mutex lock_;
-  folly::EvictingCacheMap<KEY, SharedPromiseType, HASH> cache_;
-  FetchFunc fetcher_;
+  static constexpr size_t kDefaultNumShards = 16;
+  /** A negative TTL that keeps negative results until they are evicted. */
+  static constexpr std::chrono::milliseconds kNoExpiry =
+      std::chrono::milliseconds::max();
+
+  struct Stats {
+    uint64_t hitCount{0};
+    uint64_t missCount{0};
+    uint64_t evictionCount{0};
+    /** The number of negative results that were dropped after their TTL. */
+    uint64_t expirationCount{0};
+    uint64_t objectCount{0};
+  };
+
+  LeaseCache(
+      size_t maxSize,
+      FetchFunc fetcher,
+      size_t clearSize = 1,
+      size_t numShards = kDefaultNumShards,
+      std::chrono::milliseconds negativeTtl = kNoExpiry)
+      : fetcher_(std::move(fetcher)), negativeTtl_(negativeTtl) {
+    numShards = std::max<size_t>(numShards, 1);
+    const auto shardMaxSize = getShardMaxSize(maxSize, numShards);
+    for (size_t n = 0; n < numShards; ++n) {
+      shards_.push_back(
+          std::make_unique<Shard>(folly::in_place, shardMaxSize, clearSize));
+    }
+  }
 
- public:
-  LeaseCache(size_t maxSize, FetchFunc fetcher, size_t clearSize = 1)
-      : cache_(maxSize, clearSize), fetcher_(fetcher) {}
+  LeaseCache(const LeaseCache&) = delete;
+  LeaseCache& operator=(const LeaseCache&) = delete;
 
   void set(const KEY& key, ValuePtr val) {
-    std::lock_guard<std::mutex> g(lock_);
-    auto entry = std::make_shared<typename SharedPromiseType::element_type>();
-    entry->setValue(val);
-    cache_.set(key, entry);
+    auto entry = std::make_shared<Entry>();
+    entry->promise.setValue(val);
+    auto state = getShard(key).lock();
+    state->cache.set(key, std::move(entry));
   }
 
   void erase(const KEY& key) {
-    std::lock_guard<std::mutex> g(lock_);
-    cache_.erase(key);
+    auto state = getShard(key).lock();
+    state->cache.erase(key);
   }
 
   void setMaxSize(size_t size) {
-    cache_.setMaxSize(size);
+    const auto shardMaxSize = getShardMaxSize(size, shards_.size());
+    for (auto& shard : shards_) {
+      shard->lock()->cache.setMaxSize(shardMaxSize);
+    }
   }
 
   FutureType get(const KEY& key) {
-    SharedPromiseType entry;
+    std::shared_ptr<Entry> entry;
 
     {
-      std::lock_guard<std::mutex> g(lock_);
-
-      auto it = cache_.find(key);
-      if (it != cache_.end()) {
-        entry = it->second;
-        return entry->getFuture();
+      auto state = getShard(key).lock();
+
+      auto it = state->cache.find(key);
+      if (it != state->cache.end()) {
+        if (!it->second->isExpired(Clock::now())) {
+          ++state->hitCount;
+          return it->second->promise.getFuture();
+        }
+        ++state->expirationCount;
       }
 
-      entry = std::make_shared<typename SharedPromiseType::element_type>();
-      cache_.set(key, entry);
+      ++state->missCount;
+      entry = std::make_shared<Entry>();
+      state->cache.set(key, entry);
     }
 
-    auto future = entry->getFuture();
+    auto future = entry->promise.getFuture();
 
-    fetcher_(key).then(
-        [entry](folly::Try<ValuePtr>&& t) { entry->setTry(std::move(t)); });
+    folly::makeFutureWith([&] { return fetcher_(key); })
+        .then([entry, ttl = negativeTtl_](folly::Try<ValuePtr>&& t) {
+          if (ttl != kNoExpiry && (t.hasException() || !t.value())) {
+            entry->negativeExpiry.store(
+                (Clock::now() + ttl).time_since_epoch().count(),
+                std::memory_order_relaxed);
+          }
+          entry->promise.setTry(std::move(t));
+        });
 
     return future;
   }
 
   bool exists(const KEY& key) {
-    return cache_.exists(key);
+    return getShard(key).lock()->cache.exists(key);
+  }
+
+  /**
+   * Get a snapshot of the cache statistics, summed across all shards.
+   */
+  Stats getStats() const {
+    Stats stats;
+    for (const auto& shard : shards_) {
+      auto state = shard->lock();
+      stats.hitCount += state->hitCount;
+      stats.missCount += state->missCount;
+      stats.evictionCount += state->evictionCount;
+      stats.expirationCount += state->expirationCount;
+      stats.objectCount += state->cache.size();
+    }
+    return stats;
   }
+
+ private:
+  struct Entry {
+    bool isExpired(Clock::time_point now) const {
+      return now.time_since_epoch().count() >=
+          negativeExpiry.load(std::memory_order_relaxed);
+    }
+
+    folly::SharedPromise<ValuePtr> promise;
+    /**
+     * When a negative result stops being returned, as a count of Clock
+     * ticks.  This is set by the fetch callback, which does not hold the
+     * shard lock.
+     */
+    std::atomic<Clock::rep> negativeExpiry{Clock::duration::max().count()};
+  };
+
+  struct ShardState {
+    ShardState(size_t maxSize, size_t clearSize) : cache(maxSize, clearSize) {
+      cache.setPruneHook(
+          [this](const KEY&, std::shared_ptr<Entry>&&) { ++evictionCount; });
+    }
+
+    folly::EvictingCacheMap<KEY, std::shared_ptr<Entry>, HASH> cache;
+
+    uint64_t hitCount{0};
+    uint64_t missCount{0};
+    uint64_t evictionCount{0};
+    uint64_t expirationCount{0};
+  };
+  using Shard = folly::Synchronized<ShardState, std::mutex>;
+
+  static size_t getShardMaxSize(size_t maxSize, size_t numShards) {
+    // Round up, so that a small bounded cache doesn't become unbounded.
+    return (maxSize + numShards - 1) / numShards;
+  }
+
+  Shard& getShard(const KEY& key) {
+    // Mix the hash, since the shard's map uses the low bits of it too.
+    return *shards_[folly::hash::twang_mix64(HASH()(key)) % shards_.size()];
+  }
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  FetchFunc fetcher_;
+  const std::chrono::milliseconds negativeTtl_;
 };
 
+template <typename KEY, typename VAL, typename HASH>
+constexpr size_t LeaseCache<KEY, VAL, HASH>::kDefaultNumShards;
+template <typename KEY, typename VAL, typename HASH>
+constexpr std::chrono::milliseconds LeaseCache<KEY, VAL, HASH>::kNoExpiry;
+
 } // namespace eden
 } // namespace facebook
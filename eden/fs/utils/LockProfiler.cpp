@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/LockProfiler.h"
+
+#include <folly/Conv.h>
+
+#include "common/stats/ServiceData.h"
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+// Lock times are tracked in microseconds, up to 10ms.
+constexpr microseconds kMinValue{0};
+constexpr microseconds kMaxValue{10000};
+constexpr microseconds kBucketSize{50};
+
+void addHistogram(const std::string& key) {
+  auto serviceData = stats::ServiceData::get();
+  serviceData->addHistogram(
+      key,
+      static_cast<size_t>(kBucketSize.count()),
+      kMinValue.count(),
+      kMaxValue.count());
+  serviceData->exportHistogram(key, stats::COUNT);
+  for (auto percentile : {50.0, 90.0, 99.0, 99.9}) {
+    serviceData->exportHistogram(key, percentile);
+  }
+}
+} // namespace
+
+std::atomic<uint32_t> LockProfiler::sampleRate_{0};
+
+LockProfile::LockProfile(folly::StringPiece name)
+    : waitKey_{folly::to<std::string>("lock.", name, ".wait_us")},
+      holdKey_{folly::to<std::string>("lock.", name, ".hold_us")} {
+  addHistogram(waitKey_);
+  addHistogram(holdKey_);
+}
+
+void LockProfile::recordWait(std::chrono::steady_clock::duration wait) {
+  stats::ServiceData::get()->addHistogramValue(
+      waitKey_, duration_cast<microseconds>(wait).count());
+}
+
+void LockProfile::recordHold(std::chrono::steady_clock::duration hold) {
+  stats::ServiceData::get()->addHistogramValue(
+      holdKey_, duration_cast<microseconds>(hold).count());
+}
+
+} // namespace eden
+} // namespace facebook
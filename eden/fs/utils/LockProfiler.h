@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Likely.h>
+#include <folly/Range.h>
+#include <folly/SharedMutex.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * The wait and hold time histograms of one named lock, exported through
+ * ServiceData as "lock.<name>.wait_us" and "lock.<name>.hold_us".
+ */
+class LockProfile {
+ public:
+  explicit LockProfile(folly::StringPiece name);
+
+  void recordWait(std::chrono::steady_clock::duration wait);
+  void recordHold(std::chrono::steady_clock::duration hold);
+
+ private:
+  const std::string waitKey_;
+  const std::string holdKey_;
+};
+
+/**
+ * Process-wide control of lock profiling.
+ *
+ * One in every sampleRate acquisitions of a ProfiledMutex on each thread is
+ * timed, and a sample rate of 0 turns profiling off.  The rate starts at
+ * --lock_profiling_sample_rate and can be changed at runtime with the
+ * debugSetLockProfiling thrift call.
+ */
+class LockProfiler {
+ public:
+  static void setSampleRate(uint32_t sampleRate) {
+    sampleRate_.store(sampleRate, std::memory_order_relaxed);
+  }
+  static uint32_t getSampleRate() {
+    return sampleRate_.load(std::memory_order_relaxed);
+  }
+
+  /** Returns true if the calling thread's next acquisition is timed. */
+  static bool shouldSample() {
+    const auto sampleRate = getSampleRate();
+    if (LIKELY(sampleRate == 0)) {
+      return false;
+    }
+    static thread_local uint32_t acquisitions = 0;
+    if (++acquisitions < sampleRate) {
+      return false;
+    }
+    acquisitions = 0;
+    return true;
+  }
+
+ private:
+  static std::atomic<uint32_t> sampleRate_;
+};
+
+/**
+ * A mutex for folly::Synchronized that records how long sampled acquisitions
+ * waited for it and how long they held it, in the LockProfile named by
+ * NameTag::name().  For example:
+ *
+ *   struct JournalLockName {
+ *     static folly::StringPiece name() { return "journal"; }
+ *   };
+ *   folly::Synchronized<State, ProfiledSharedMutex<JournalLockName>> state_;
+ *
+ * Exclusive holds are timed from acquisition to release.  Shared holds
+ * overlap each other, so only their waits are recorded.  Upgrade locks and
+ * timed waits are not supported.
+ *
+ * While profiling is off, each acquisition only adds a relaxed atomic load.
+ */
+template <typename Mutex, typename NameTag>
+class ProfiledMutex {
+ public:
+  void lock() {
+    if (LIKELY(!LockProfiler::shouldSample())) {
+      mutex_.lock();
+      return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    mutex_.lock();
+    holdStart_ = std::chrono::steady_clock::now();
+    getProfile().recordWait(holdStart_ - start);
+  }
+
+  bool try_lock() {
+    return mutex_.try_lock();
+  }
+
+  void unlock() {
+    const auto holdStart = holdStart_;
+    if (LIKELY(holdStart == kNotSampled)) {
+      mutex_.unlock();
+      return;
+    }
+    holdStart_ = kNotSampled;
+    mutex_.unlock();
+    getProfile().recordHold(std::chrono::steady_clock::now() - holdStart);
+  }
+
+  void lock_shared() {
+    if (LIKELY(!LockProfiler::shouldSample())) {
+      mutex_.lock_shared();
+      return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    mutex_.lock_shared();
+    getProfile().recordWait(std::chrono::steady_clock::now() - start);
+  }
+
+  bool try_lock_shared() {
+    return mutex_.try_lock_shared();
+  }
+
+  void unlock_shared() {
+    mutex_.unlock_shared();
+  }
+
+ private:
+  static constexpr std::chrono::steady_clock::time_point kNotSampled{};
+
+  static LockProfile& getProfile() {
+    static LockProfile profile{NameTag::name()};
+    return profile;
+  }
+
+  Mutex mutex_;
+  /**
+   * When the current exclusive hold was acquired, if it is being timed.
+   * Only accessed by the thread holding the lock exclusively.
+   */
+  std::chrono::steady_clock::time_point holdStart_{kNotSampled};
+};
+
+template <typename Mutex, typename NameTag>
+constexpr std::chrono::steady_clock::time_point
+    ProfiledMutex<Mutex, NameTag>::kNotSampled;
+
+template <typename NameTag>
+using ProfiledSharedMutex = ProfiledMutex<folly::SharedMutex, NameTag>;
+
+} // namespace eden
+} // namespace facebook
@@ -9,15 +9,18 @@
  */
 #pragma once
 
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <type_traits>
+#include <vector>
 
 #include <eden/fs/utils/Bug.h>
 #include <folly/Exception.h>
 #include <folly/File.h>
 #include <folly/FileUtil.h>
 #include <folly/Range.h>
+#include <folly/String.h>
 #include <folly/logging/xlog.h>
 
 namespace facebook {
@@ -75,6 +78,44 @@ template <typename T, typename... OldVersions>
 struct Migrator;
 } // namespace detail
 
+/**
+ * Tuning knobs for how a MappedDiskVector maps its file.  The defaults suit
+ * small vectors; large, long-lived vectors like the InodeTable want some of
+ * these turned on.
+ */
+struct MappedDiskVectorOptions {
+  /**
+   * Prefault the whole mapping when the file is opened.  Worthwhile if every
+   * record is about to be read anyway.
+   */
+  bool populate{false};
+
+  /**
+   * Ask the kernel to back the mapping with transparent huge pages, reducing
+   * TLB pressure for large vectors.  This is only a hint: many filesystems
+   * cannot map file pages as huge pages, in which case it has no effect.
+   */
+  bool hugePages{false};
+
+  /**
+   * Reserve this many bytes of address space for the mapping up front.
+   * While the file fits in the reservation, growing it extends the mapping
+   * in place rather than moving it with mremap(), so growth never has to
+   * copy the page tables of the existing mapping.  Address space is cheap on
+   * 64-bit systems; no memory is committed for the unused part.
+   */
+  size_t addressSpaceReservation{0};
+
+  /**
+   * When growth has to move the mapping, leave the old mapping in place
+   * until the vector is destroyed instead of unmapping it.  Since the file is
+   * mapped shared, the old mapping keeps showing the current contents of the
+   * records it covers, so a reader racing with growth through a stale
+   * pointer still reads valid memory.  Used by InodeTable's lock-free reads.
+   */
+  bool keepOldMappings{false};
+};
+
 /**
  * MappedDiskVector is roughly analogous to std::vector, except it's backed by
  * a persistent memory-mapped file.
@@ -126,7 +167,7 @@ class MappedDiskVector {
   template <typename... OldVersions>
   static MappedDiskVector open(
       folly::StringPiece path,
-      bool shouldPopulate = false) {
+      const MappedDiskVectorOptions& options = {}) {
     folly::File file{path, O_RDWR | O_CREAT | O_CLOEXEC, 0600};
 
     if (!file.try_lock()) {
@@ -138,7 +179,7 @@ class MappedDiskVector {
         fstat(file.fd(), &st), "fstat failed on MappedDiskVector path ", path);
 
     if (st.st_size == 0) {
-      return initializeFromScratch(std::move(file));
+      return initializeFromScratch(std::move(file), options);
     }
 
     Header header;
@@ -185,7 +226,7 @@ class MappedDiskVector {
             header.recordSize));
       }
       return MappedDiskVector{
-          std::move(file), st.st_size, header.entryCount, shouldPopulate};
+          std::move(file), st.st_size, header.entryCount, options};
     }
 
     // Try to migrate from an old record format if any match.
@@ -207,6 +248,7 @@ class MappedDiskVector {
             st.st_size,
             header.entryCount,
             i,
+            options,
             [](const auto& from) { return T{from}; });
       }
     }
@@ -227,14 +269,16 @@ class MappedDiskVector {
    * Creates a new MappedDiskVector at the specified path, overwriting any that
    * was there prior.
    */
-  static MappedDiskVector createOrOverwrite(folly::StringPiece path) {
+  static MappedDiskVector createOrOverwrite(
+      folly::StringPiece path,
+      const MappedDiskVectorOptions& options = {}) {
     folly::File file{
         path, O_RDWR | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600};
     if (!file.try_lock()) {
       folly::throwSystemError("failed to acquire lock on ", path);
     }
 
-    return initializeFromScratch(std::move(file));
+    return initializeFromScratch(std::move(file), options);
   }
 
   MappedDiskVector() = delete;
@@ -246,34 +290,47 @@ class MappedDiskVector {
     end_ = other.end_;
     map_ = other.map_;
     mapSizeInBytes_ = other.mapSizeInBytes_;
+    backedSizeInBytes_ = other.backedSizeInBytes_;
+    reservedSizeInBytes_ = other.reservedSizeInBytes_;
+    hugePages_ = other.hugePages_;
+    keepOldMappings_ = other.keepOldMappings_;
+    oldMappings_ = std::move(other.oldMappings_);
 
     other.begin_ = nullptr;
     other.end_ = nullptr;
     other.map_ = nullptr;
     other.mapSizeInBytes_ = 0;
+    other.backedSizeInBytes_ = 0;
+    other.reservedSizeInBytes_ = 0;
+    other.oldMappings_.clear();
   }
 
   MappedDiskVector& operator=(MappedDiskVector&& other) {
-    if (map_) {
-      munmap(map_, mapSizeInBytes_);
-    }
+    unmap();
 
     file_ = std::move(other.file_);
     begin_ = other.begin_;
     end_ = other.end_;
     map_ = other.map_;
     mapSizeInBytes_ = other.mapSizeInBytes_;
+    backedSizeInBytes_ = other.backedSizeInBytes_;
+    reservedSizeInBytes_ = other.reservedSizeInBytes_;
+    hugePages_ = other.hugePages_;
+    keepOldMappings_ = other.keepOldMappings_;
+    oldMappings_ = std::move(other.oldMappings_);
 
     other.begin_ = nullptr;
     other.end_ = nullptr;
     other.map_ = nullptr;
     other.mapSizeInBytes_ = 0;
+    other.backedSizeInBytes_ = 0;
+    other.reservedSizeInBytes_ = 0;
+    other.oldMappings_.clear();
+    return *this;
   }
 
   ~MappedDiskVector() {
-    if (map_) {
-      munmap(map_, mapSizeInBytes_);
-    }
+    unmap();
   }
 
   size_t size() const {
@@ -285,6 +342,15 @@ class MappedDiskVector {
     return (mapSizeInBytes_ - sizeof(Header)) / sizeof(T);
   }
 
+  /**
+   * The number of records that fit in the part of the file that has disk
+   * space allocated.  This is capacity() unless releaseUnusedCapacity() gave
+   * some of it back.
+   */
+  size_t backedCapacity() const {
+    return (backedSizeInBytes_ - sizeof(Header)) / sizeof(T);
+  }
+
   T& operator[](size_t index) {
     return begin_[index];
   }
@@ -296,35 +362,9 @@ class MappedDiskVector {
   template <typename... Args>
   void emplace_back(Args&&... args) {
     if (!hasRoom(1)) {
-      static_assert(
-          sizeof(GROWTH_IN_PAGES) * detail::kPageSize >= sizeof(T),
-          "Growth must expand the file more than a single record");
-
-      size_t oldSize = size();
-      size_t newFileSize =
-          mapSizeInBytes_ + GROWTH_IN_PAGES * detail::kPageSize;
-
-      // Always keep the file size a whole number of pages.
-      CHECK_EQ(0, newFileSize % detail::kPageSize);
-
-      if (-1 == folly::ftruncateNoInt(file_.fd(), newFileSize)) {
-        folly::throwSystemError("ftruncateNoInt failed when growing capacity");
-      }
-
-      auto newMap = mremap(map_, mapSizeInBytes_, newFileSize, MREMAP_MAYMOVE);
-      if (newMap == MAP_FAILED) {
-        folly::throwSystemError(folly::to<std::string>(
-            "mremap failed when growing capacity from ",
-            mapSizeInBytes_,
-            " to ",
-            newFileSize));
-      }
-
-      map_ = newMap;
-      mapSizeInBytes_ = newFileSize;
-
-      begin_ = reinterpret_cast<T*>(static_cast<Header*>(newMap) + 1);
-      end_ = begin_ + oldSize;
+      grow();
+    } else if (!isBacked(1)) {
+      allocateReleasedCapacity();
     }
 
     T* out = end_;
@@ -342,6 +382,15 @@ class MappedDiskVector {
     --header().entryCount;
   }
 
+  /**
+   * Drop the records past the first newSize.
+   */
+  void truncate(size_t newSize) {
+    DCHECK_LE(newSize, size());
+    end_ = begin_ + newSize;
+    header().entryCount = newSize;
+  }
+
   T& front() {
     DCHECK_GT(end_, begin_);
     return begin_[0];
@@ -352,6 +401,101 @@ class MappedDiskVector {
     return end_[-1];
   }
 
+  T* begin() {
+    return begin_;
+  }
+
+  const T* begin() const {
+    return begin_;
+  }
+
+  T* end() {
+    return end_;
+  }
+
+  const T* end() const {
+    return end_;
+  }
+
+  /**
+   * Start writing modified records back to disk without waiting for the
+   * writes to complete.
+   */
+  void flushAsync() const {
+    // msync(MS_ASYNC) is a no-op on Linux, where shared mappings dirty the
+    // page cache directly.  sync_file_range() is what starts the writeback.
+    if (sync_file_range(file_.fd(), 0, 0, SYNC_FILE_RANGE_WRITE)) {
+      XLOG(DBG3) << "sync_file_range failed on MappedDiskVector: "
+                 << folly::errnoStr(errno);
+    }
+  }
+
+  /**
+   * Write modified records back to disk and wait for the writes to complete.
+   */
+  void sync() const {
+    folly::checkUnixError(
+        msync(map_, mapSizeInBytes_, MS_SYNC),
+        "msync failed on MappedDiskVector");
+  }
+
+  /**
+   * Let the kernel reclaim the pages of the file that are resident in this
+   * process.  The records stay valid: on a shared mapping this only drops
+   * the page table entries, modified pages are still written back, and the
+   * next access faults them back in from the page cache or disk.
+   */
+  void releaseMemory() const {
+    if (madvise(map_, mapSizeInBytes_, MADV_DONTNEED)) {
+      XLOG(DBG3) << "MADV_DONTNEED failed on MappedDiskVector: "
+                 << folly::errnoStr(errno);
+    }
+  }
+
+  /**
+   * The number of bytes releaseUnusedCapacity() would give back.
+   */
+  size_t getReleasableBytes() const {
+    auto used = detail::roundUpToNonzeroPageSize(
+        reinterpret_cast<const char*>(end_) - static_cast<const char*>(map_));
+    auto keep =
+        std::min(mapSizeInBytes_, used + GROWTH_IN_PAGES * detail::kPageSize);
+    return keep >= backedSizeInBytes_ ? 0 : backedSizeInBytes_ - keep;
+  }
+
+  /**
+   * Give back the disk space and memory of the capacity past the last
+   * record, keeping one growth step of it for the next insertions.
+   *
+   * The file keeps its size and stays mapped, so readers holding a stale
+   * index past the end read zeros rather than fault.  The space is
+   * allocated again before a record is next written there.
+   *
+   * Returns the number of bytes released.
+   */
+  size_t releaseUnusedCapacity() {
+    auto length = getReleasableBytes();
+    if (length == 0) {
+      return 0;
+    }
+    auto keep = backedSizeInBytes_ - length;
+    if (fallocate(
+            file_.fd(),
+            FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            keep,
+            length)) {
+      XLOG(DBG3) << "failed to punch a hole in MappedDiskVector: "
+                 << folly::errnoStr(errno);
+      return 0;
+    }
+    backedSizeInBytes_ = keep;
+    if (madvise(static_cast<char*>(map_) + keep, length, MADV_DONTNEED)) {
+      XLOG(DBG3) << "MADV_DONTNEED failed on MappedDiskVector: "
+                 << folly::errnoStr(errno);
+    }
+    return length;
+  }
+
  private:
   static constexpr uint32_t kMagic = 0x0056444d; // "MDV\0"
 
@@ -370,9 +514,17 @@ class MappedDiskVector {
       0 == sizeof(Header) % 16,
       "header alignment is 16 bytes in case someone uses SSE values");
 
+  /**
+   * The file grows by half its size at a time, so that a vector of N records
+   * is only resized O(log N) times, but never by less than GROWTH_IN_PAGES or
+   * more than MAX_GROWTH_IN_PAGES.
+   */
   static constexpr size_t GROWTH_IN_PAGES = 256;
+  static constexpr size_t MAX_GROWTH_IN_PAGES = 16384;
 
-  static MappedDiskVector initializeFromScratch(folly::File file) {
+  static MappedDiskVector initializeFromScratch(
+      folly::File file,
+      const MappedDiskVectorOptions& options) {
     // Start the file large enough to handle the header and a little under one
     // round one of growth.
     constexpr size_t initialSize = GROWTH_IN_PAGES * detail::kPageSize;
@@ -399,15 +551,17 @@ class MappedDiskVector {
       throw std::runtime_error("Failed to write complete initial header");
     }
 
+    auto mapOptions = options;
+    mapOptions.populate = false;
     return MappedDiskVector{
-        std::move(file), initialSize, header.entryCount, false};
+        std::move(file), initialSize, header.entryCount, mapOptions};
   }
 
   explicit MappedDiskVector(
       folly::File file,
       off_t fileSize,
       size_t currentEntryCount,
-      bool populate)
+      const MappedDiskVectorOptions& options)
       : file_(std::move(file)) {
     // It's worth keeping the file and mapping a whole number of pages to
     // avoid wasting an partial page at the end.  Note that this is an
@@ -429,21 +583,52 @@ class MappedDiskVector {
     // Call readahead() here?  Offer it as optional functionality?
     // InodeTable needs to traverse every record immediately after opening.
 
+    // If asked, reserve address space for the file to grow into.  The file
+    // is then mapped over the start of the reservation.
+    size_t reservedSize = desiredSize;
+    void* address = nullptr;
+    int fixed = 0;
+    if (options.addressSpaceReservation > desiredSize) {
+      reservedSize =
+          detail::roundUpToNonzeroPageSize(options.addressSpaceReservation);
+      address = mmap(
+          nullptr,
+          reservedSize,
+          PROT_NONE,
+          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+          -1,
+          0);
+      if (address == MAP_FAILED) {
+        folly::throwSystemError(
+            "failed to reserve ", reservedSize, " bytes of address space");
+      }
+      fixed = MAP_FIXED;
+    }
+
     auto map = mmap(
-        0,
+        address,
         desiredSize,
         PROT_READ | PROT_WRITE,
-        MAP_SHARED | (populate ? MAP_POPULATE : 0),
+        MAP_SHARED | fixed | (options.populate ? MAP_POPULATE : 0),
         file_.fd(),
         0);
     if (map == MAP_FAILED) {
-      folly::throwSystemError("mmap failed on file open");
+      auto err = errno;
+      if (address) {
+        munmap(address, reservedSize);
+      }
+      folly::throwSystemErrorExplicit(err, "mmap failed on file open");
     }
 
     // Throw no exceptions between assigning the fields.
 
     map_ = map;
     mapSizeInBytes_ = desiredSize;
+    backedSizeInBytes_ = desiredSize;
+    reservedSizeInBytes_ = reservedSize;
+    hugePages_ = options.hugePages;
+    keepOldMappings_ = options.keepOldMappings;
+    adviseHugePages(map_, mapSizeInBytes_);
     static_assert(
         alignof(Header) >= alignof(T),
         "T must not have stricter alignment requirements than Header");
@@ -456,32 +641,170 @@ class MappedDiskVector {
         static_cast<char*>(map_) + mapSizeInBytes_);
   }
 
-  bool hasRoom(size_t amount) const {
-    // Technically, the expression (end_ + amount) is constructing a pointer
-    // past the end of the "object" (mmap) and is thus UB.  But hopefully no
-    // compiler can see that.
-    return reinterpret_cast<char*>(end_ + amount) <=
-        static_cast<char*>(map_) + mapSizeInBytes_;
+  void unmap() {
+    if (map_) {
+      munmap(map_, std::max(mapSizeInBytes_, reservedSizeInBytes_));
+    }
+    for (const auto& mapping : oldMappings_) {
+      munmap(mapping.first, mapping.second);
+    }
+    oldMappings_.clear();
   }
 
-  T* data() {
-    return begin();
+  void adviseHugePages(void* start, size_t length) {
+    if (hugePages_ && madvise(start, length, MADV_HUGEPAGE)) {
+      // Expected on filesystems that do not support huge pages.
+      XLOG(DBG3) << "MADV_HUGEPAGE failed on MappedDiskVector: "
+                 << folly::errnoStr(errno);
+    }
   }
 
-  T* begin() {
-    return begin_;
+  /**
+   * Make room for more records, growing the file geometrically.
+   */
+  void grow() {
+    static_assert(
+        GROWTH_IN_PAGES * detail::kPageSize >= sizeof(T),
+        "Growth must expand the file more than a single record");
+
+    size_t oldSize = size();
+    size_t growthInPages = std::min(
+        std::max(mapSizeInBytes_ / 2 / detail::kPageSize, GROWTH_IN_PAGES),
+        MAX_GROWTH_IN_PAGES);
+    size_t newFileSize = mapSizeInBytes_ + growthInPages * detail::kPageSize;
+
+    // Always keep the file size a whole number of pages.
+    CHECK_EQ(0, newFileSize % detail::kPageSize);
+
+    // Allocate the disk blocks now rather than when the new pages are first
+    // written through the mapping, where running out of space is a SIGBUS.
+    // Not every filesystem supports fallocate, so fall back to ftruncate.
+    // Space given back by releaseUnusedCapacity() is allocated again too.
+    auto growth = static_cast<off_t>(newFileSize - backedSizeInBytes_);
+    if (fallocate(file_.fd(), 0, backedSizeInBytes_, growth)) {
+      if (errno != EOPNOTSUPP && errno != ENOSYS) {
+        folly::throwSystemError("fallocate failed when growing capacity");
+      }
+      if (-1 == folly::ftruncateNoInt(file_.fd(), newFileSize)) {
+        folly::throwSystemError("ftruncateNoInt failed when growing capacity");
+      }
+    }
+    backedSizeInBytes_ = newFileSize;
+
+    // Map the new part of the file into the reserved address space if it
+    // fits, which leaves the existing mapping alone.  The offset must be a
+    // multiple of the system page size.
+    static const size_t systemPageSize = sysconf(_SC_PAGESIZE);
+    if (newFileSize <= reservedSizeInBytes_ &&
+        0 == mapSizeInBytes_ % systemPageSize) {
+      auto* tail = static_cast<char*>(map_) + mapSizeInBytes_;
+      auto tailMap = mmap(
+          tail,
+          newFileSize - mapSizeInBytes_,
+          PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_FIXED,
+          file_.fd(),
+          mapSizeInBytes_);
+      if (tailMap == MAP_FAILED) {
+        folly::throwSystemError(folly::to<std::string>(
+            "mmap failed when growing capacity from ",
+            mapSizeInBytes_,
+            " to ",
+            newFileSize));
+      }
+      adviseHugePages(tail, newFileSize - mapSizeInBytes_);
+      mapSizeInBytes_ = newFileSize;
+      return;
+    }
+
+    // Outgrew the reservation, so the mapping has to move.
+    if (keepOldMappings_) {
+      auto newMap = mmap(
+          nullptr,
+          newFileSize,
+          PROT_READ | PROT_WRITE,
+          MAP_SHARED,
+          file_.fd(),
+          0);
+      if (newMap == MAP_FAILED) {
+        folly::throwSystemError(folly::to<std::string>(
+            "mmap failed when growing capacity from ",
+            mapSizeInBytes_,
+            " to ",
+            newFileSize));
+      }
+      oldMappings_.emplace_back(
+          map_, std::max(mapSizeInBytes_, reservedSizeInBytes_));
+      map_ = newMap;
+      mapSizeInBytes_ = newFileSize;
+      reservedSizeInBytes_ = 0;
+      adviseHugePages(map_, mapSizeInBytes_);
+
+      begin_ = reinterpret_cast<T*>(static_cast<Header*>(newMap) + 1);
+      end_ = begin_ + oldSize;
+      return;
+    }
+
+    // Give up the rest of the reservation and move the mapping.
+    if (reservedSizeInBytes_ > mapSizeInBytes_) {
+      munmap(
+          static_cast<char*>(map_) + mapSizeInBytes_,
+          reservedSizeInBytes_ - mapSizeInBytes_);
+      reservedSizeInBytes_ = 0;
+    }
+    auto newMap = mremap(map_, mapSizeInBytes_, newFileSize, MREMAP_MAYMOVE);
+    if (newMap == MAP_FAILED) {
+      folly::throwSystemError(folly::to<std::string>(
+          "mremap failed when growing capacity from ",
+          mapSizeInBytes_,
+          " to ",
+          newFileSize));
+    }
+
+    map_ = newMap;
+    mapSizeInBytes_ = newFileSize;
+    adviseHugePages(map_, mapSizeInBytes_);
+
+    begin_ = reinterpret_cast<T*>(static_cast<Header*>(newMap) + 1);
+    end_ = begin_ + oldSize;
   }
 
-  const T* begin() const {
-    return begin_;
+  bool isBacked(size_t amount) const {
+    return reinterpret_cast<char*>(end_ + amount) <=
+        static_cast<char*>(map_) + backedSizeInBytes_;
   }
 
-  T* end() {
-    return end_;
+  /**
+   * Allocate disk space again for the capacity after the last record, after
+   * releaseUnusedCapacity() gave it back, so that writing a record there
+   * cannot fail with SIGBUS when the disk is full.
+   */
+  void allocateReleasedCapacity() {
+    auto needed = detail::roundUpToNonzeroPageSize(
+        reinterpret_cast<char*>(end_ + 1) - static_cast<char*>(map_));
+    auto newBackedSize =
+        std::min(mapSizeInBytes_, needed + GROWTH_IN_PAGES * detail::kPageSize);
+    if (fallocate(
+            file_.fd(),
+            FALLOC_FL_KEEP_SIZE,
+            backedSizeInBytes_,
+            newBackedSize - backedSizeInBytes_) &&
+        errno != EOPNOTSUPP && errno != ENOSYS) {
+      folly::throwSystemError("fallocate failed when reusing capacity");
+    }
+    backedSizeInBytes_ = newBackedSize;
   }
 
-  const T* end() const {
-    return end_;
+  bool hasRoom(size_t amount) const {
+    // Technically, the expression (end_ + amount) is constructing a pointer
+    // past the end of the "object" (mmap) and is thus UB.  But hopefully no
+    // compiler can see that.
+    return reinterpret_cast<char*>(end_ + amount) <=
+        static_cast<char*>(map_) + mapSizeInBytes_;
+  }
+
+  T* data() {
+    return begin();
   }
 
   Header& header() {
@@ -498,6 +821,15 @@ class MappedDiskVector {
 
   void* map_{nullptr};
   size_t mapSizeInBytes_{0}; // must be nonzero, multiple of page size
+  // The prefix of the file with disk space allocated.  Less than
+  // mapSizeInBytes_ only after releaseUnusedCapacity().
+  size_t backedSizeInBytes_{0};
+  // The address space reserved at map_, if larger than mapSizeInBytes_.
+  size_t reservedSizeInBytes_{0};
+  bool hugePages_{false};
+  bool keepOldMappings_{false};
+  // Mappings replaced by growth, if keepOldMappings_ is set.
+  std::vector<std::pair<void*, size_t>> oldMappings_;
 
   folly::File file_;
 
@@ -515,6 +847,7 @@ struct Migrator<T> {
       off_t /*fileSize*/,
       size_t /*currentEntryCount*/,
       size_t /*oldVersionIndex*/,
+      const MappedDiskVectorOptions& /*options*/,
       ConvertFn /*convert*/) {
     auto bug = EDEN_BUG() << "oldVersionIndex >= sizeof...(OldVersions)";
     bug.throwException();
@@ -530,6 +863,7 @@ struct Migrator<T, First, Rest...> {
       off_t fileSize,
       size_t currentEntryCount,
       size_t oldVersionIndex,
+      const MappedDiskVectorOptions& options,
       ConvertFn convert) {
     using namespace folly::literals;
 
@@ -541,11 +875,13 @@ struct Migrator<T, First, Rest...> {
       // temporary file over the original.
       // Set populate to true because migrating requires reading every element
       // anyway.
+      MappedDiskVectorOptions originalOptions;
+      originalOptions.populate = true;
       MappedDiskVector<First> original{
-          std::move(file), fileSize, currentEntryCount, true};
+          std::move(file), fileSize, currentEntryCount, originalOptions};
 
       auto tmpPath = folly::to<std::string>(path, ".tmp");
-      auto newVector = MappedDiskVector<T>::createOrOverwrite(tmpPath);
+      auto newVector = MappedDiskVector<T>::createOrOverwrite(tmpPath, options);
       try {
         // TODO: newVector.reserve
         for (size_t i = 0; i < original.size(); ++i) {
@@ -570,6 +906,7 @@ struct Migrator<T, First, Rest...> {
         fileSize,
         currentEntryCount,
         oldVersionIndex - 1,
+        options,
         [=](const auto& from) { return convert(First{from}); });
   }
 };
@@ -27,7 +27,7 @@ namespace facebook {
 namespace eden {
 
 StringPiece dirname(StringPiece path) {
-  auto slash = path.rfind('/');
+  auto slash = detail::rfindChar(path, '/');
   if (slash != std::string::npos) {
     return path.subpiece(0, slash);
   }
@@ -35,7 +35,7 @@ StringPiece dirname(StringPiece path) {
 }
 
 StringPiece basename(StringPiece path) {
-  auto slash = path.rfind('/');
+  auto slash = detail::rfindChar(path, '/');
   if (slash != std::string::npos) {
     path.advance(slash + 1);
     return path;
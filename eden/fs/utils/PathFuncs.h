@@ -14,6 +14,7 @@
 #include <folly/Format.h>
 #include <folly/String.h>
 #include <folly/hash/Hash.h>
+#include <string.h>
 #include <type_traits>
 
 namespace facebook {
@@ -48,6 +49,28 @@ constexpr folly::StringPiece kDirSeparatorStr{"/"};
  */
 enum : size_t { kMaxPathComponentLength = 255 };
 
+namespace detail {
+/**
+ * Returns the position of the last c in str, or StringPiece::npos.
+ *
+ * Forward searches through StringPiece::find() already use memchr(), but
+ * folly::rfind() checks one byte at a time.  glibc's memrchr() is
+ * vectorized, which matters when walking deep paths from the end.
+ */
+inline size_t rfindChar(folly::StringPiece str, char c) {
+#ifdef __GLIBC__
+  if (str.empty()) {
+    return folly::StringPiece::npos;
+  }
+  auto found = static_cast<const char*>(memrchr(str.data(), c, str.size()));
+  return found ? static_cast<size_t>(found - str.data())
+               : folly::StringPiece::npos;
+#else
+  return folly::rfind(str, c);
+#endif
+}
+} // namespace detail
+
 /* Some helpers for working with path composition.
  * Goals:
  *
@@ -300,9 +323,7 @@ class PathBase :
       typename = typename std::enable_if<
           std::is_same<StorageAlias, std::string>::value>::type>
   explicit PathBase(std::string&& str, SkipPathSanityCheck)
-      : path_(std::move(str)) {
-    SanityChecker()(path_);
-  }
+      : path_(std::move(str)) {}
 
   /// Return the path as a StringPiece
   folly::StringPiece stringPiece() const {
@@ -1375,8 +1396,8 @@ class PathSuffixIterator
     }
 
     // Otherwise move to just past the previous /
-    auto next =
-        rfind(folly::StringPiece{path_.begin(), start_ - 1}, kDirSeparator);
+    auto next = rfindChar(
+        folly::StringPiece{path_.begin(), start_ - 1}, kDirSeparator);
     if (next == folly::StringPiece::npos) {
       start_ = 0;
     } else {
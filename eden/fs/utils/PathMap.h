@@ -29,6 +29,8 @@ namespace eden {
  *   the guts of the vector around to make space and are therefore slower
  *   than the equivalent std::map.  If bulk insert performance is critical,
  *   it is better to pre-sort the data to be inserted.
+ * - Most directories hold only a few entries, so find() scans small maps
+ *   linearly instead of binary searching them.
  * - Since insert and erase operations move the vector contents around,
  *   those operations invalidate iterators.
  */
@@ -76,6 +78,37 @@ class PathMap : private folly::fbvector<std::pair<Key, Value>> {
   // occupy any space.
   Compare compare_;
 
+  // Locate the position at which key belongs.  Entries are usually added in
+  // sorted order, when building a directory from a source control Tree or
+  // from the overlay, so check the end first and skip the binary search,
+  // which touches a name stored elsewhere on the heap at every step.
+  typename Vector::iterator insertionPoint(Piece key) {
+    if (this->empty() || compare_(this->back(), key)) {
+      return this->end();
+    }
+    return std::lower_bound(this->begin(), this->end(), key, compare_);
+  }
+
+  // Below this size find() scans every entry rather than binary searching.
+  // Checking an entry only needs its length and first byte, which are
+  // inline in the vector for short names, to rule out almost every
+  // mismatch, while a binary search does an ordered comparison of the whole
+  // name at every step and mispredicts its branches.
+  enum : size_t { kLinearFindMaxSize = 8 };
+
+  template <typename Iterator>
+  static Iterator linearFind(Iterator first, Iterator last, Piece key) {
+    const auto keyStr = key.stringPiece();
+    for (; first != last; ++first) {
+      const auto name = Piece(first->first).stringPiece();
+      if (name.size() == keyStr.size() &&
+          (name.empty() || name.front() == keyStr.front()) && name == keyStr) {
+        return first;
+      }
+    }
+    return last;
+  }
+
  public:
   // Various type aliases to satisfy container concepts.
   using key_type = Key;
@@ -130,6 +163,7 @@ class PathMap : private folly::fbvector<std::pair<Key, Value>> {
 
   // inherit these methods from the underlying vector.
   using Vector::begin;
+  using Vector::capacity;
   using Vector::cbegin;
   using Vector::cend;
   using Vector::clear;
@@ -141,6 +175,8 @@ class PathMap : private folly::fbvector<std::pair<Key, Value>> {
   using Vector::max_size;
   using Vector::rbegin;
   using Vector::rend;
+  using Vector::reserve;
+  using Vector::shrink_to_fit;
   using Vector::size;
 
   // Swap contents with another map.
@@ -161,6 +197,9 @@ class PathMap : private folly::fbvector<std::pair<Key, Value>> {
    * Does not allocate a copy of the key string.
    */
   iterator find(Piece key) {
+    if (size() <= kLinearFindMaxSize) {
+      return linearFind(begin(), end(), key);
+    }
     auto iter = lower_bound(key);
     if (iter != end() && compare_(key, iter->first)) {
       // We found the right slot, but it is occupied by a different key.
@@ -173,6 +212,9 @@ class PathMap : private folly::fbvector<std::pair<Key, Value>> {
    * Does not allocate a copy of the key string.
    */
   const_iterator find(Piece key) const {
+    if (size() <= kLinearFindMaxSize) {
+      return linearFind(begin(), end(), key);
+    }
     const auto iter = lower_bound(key);
     if (iter != end() && compare_(key, iter->first)) {
       // We found the right slot, but it is occupied by a different key.
@@ -186,7 +228,7 @@ class PathMap : private folly::fbvector<std::pair<Key, Value>> {
    * Returns a pair consisting of an iterator to the position for key and
    * a boolean that is true if an insert took place. */
   std::pair<iterator, bool> insert(const value_type& val) {
-    auto iter = lower_bound(val.first);
+    auto iter = insertionPoint(val.first);
     if (iter == end() || compare_(val.first, iter->first)) {
       return std::make_pair(Vector::insert(iter, val), true);
     }
@@ -201,7 +243,7 @@ class PathMap : private folly::fbvector<std::pair<Key, Value>> {
    * a boolean that is true if an insert took place. */
   template <typename... Args>
   std::pair<iterator, bool> emplace(Piece key, Args&&... args) {
-    auto iter = lower_bound(key);
+    auto iter = insertionPoint(key);
     if (iter == end() || compare_(key, iter->first)) {
       iter = Vector::emplace(
           iter, std::make_pair(Key(key), Value(std::forward<Args>(args)...)));
@@ -213,7 +255,7 @@ class PathMap : private folly::fbvector<std::pair<Key, Value>> {
   /** Returns a reference to the map position for key, creating it needed.
    * If the key is already present, no additional allocations are performed. */
   mapped_type& operator[](Piece key) {
-    auto iter = lower_bound(key);
+    auto iter = insertionPoint(key);
     if (iter == end() || compare_(key, iter->first)) {
       // Not yet present, make a new one
       iter = Vector::insert(iter, std::make_pair(Key(key), mapped_type()));
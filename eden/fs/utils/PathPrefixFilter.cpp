@@ -0,0 +1,59 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/PathPrefixFilter.h"
+
+#include <algorithm>
+
+namespace facebook {
+namespace eden {
+
+PathPrefixFilter::PathPrefixFilter(std::vector<RelativePath> prefixes) {
+  // A path sorts after every path it is under, so every prefix that
+  // contains this one has already been kept.
+  std::sort(prefixes.begin(), prefixes.end());
+  for (auto& prefix : prefixes) {
+    if (prefix.empty()) {
+      prefixes_.clear();
+      return;
+    }
+    if (!prefixes_.empty() && matches(prefix)) {
+      continue;
+    }
+    prefixes_.push_back(std::move(prefix));
+  }
+}
+
+bool PathPrefixFilter::matches(RelativePathPiece path) const {
+  if (prefixes_.empty()) {
+    return true;
+  }
+  for (const auto& prefix : prefixes_) {
+    if (path == prefix || path.isSubDirOf(prefix)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PathPrefixFilter::mayMatchUnder(RelativePathPiece path) const {
+  if (prefixes_.empty() || path.empty()) {
+    return true;
+  }
+  for (const auto& prefix : prefixes_) {
+    if (path == prefix || path.isSubDirOf(prefix) ||
+        prefix.isSubDirOf(path)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace eden
+} // namespace facebook
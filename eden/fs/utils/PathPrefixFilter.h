@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <vector>
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * Restricts an operation over a repository, such as a diff, to the paths
+ * under a set of prefixes.
+ *
+ * A prefix names a file or a directory, and matches itself and everything
+ * under it.  A filter with no prefixes matches every path.
+ */
+class PathPrefixFilter {
+ public:
+  /**
+   * Construct a filter that matches every path.
+   */
+  PathPrefixFilter() = default;
+
+  /**
+   * Construct a filter that matches the paths under any of the prefixes.
+   * An empty prefix names the root, so it makes the filter match every path.
+   */
+  explicit PathPrefixFilter(std::vector<RelativePath> prefixes);
+
+  bool matchesAll() const {
+    return prefixes_.empty();
+  }
+
+  /**
+   * Returns true if the path is one of the prefixes or is under one of them.
+   */
+  bool matches(RelativePathPiece path) const;
+
+  /**
+   * Returns true if the directory at path may contain a matching path: if
+   * it matches, or if it is a parent of one of the prefixes.  Operations
+   * can skip the directories for which this returns false entirely.
+   */
+  bool mayMatchUnder(RelativePathPiece path) const;
+
+  const std::vector<RelativePath>& getPrefixes() const {
+    return prefixes_;
+  }
+
+ private:
+  /** Sorted, with no prefix under another. */
+  std::vector<RelativePath> prefixes_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,227 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/PathTable.h"
+
+#include <folly/Bits.h>
+#include <folly/Varint.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using folly::ByteRange;
+using folly::StringPiece;
+using std::string;
+
+namespace facebook {
+namespace eden {
+
+constexpr size_t PathTableBuilder::kRestartInterval;
+
+namespace {
+constexpr uint8_t kVersion = 1;
+constexpr size_t kTrailerSize = 2 * sizeof(uint32_t);
+
+void appendVarint(string& out, uint64_t value) {
+  uint8_t buf[folly::kMaxVarintLength64];
+  auto size = folly::encodeVarint(value, buf);
+  out.append(reinterpret_cast<const char*>(buf), size);
+}
+
+void appendUint32(string& out, uint32_t value) {
+  value = folly::Endian::little(value);
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+uint32_t readUint32(const uint8_t* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return folly::Endian::little(value);
+}
+
+size_t sharedPrefixLength(StringPiece a, StringPiece b) {
+  size_t length = 0;
+  const auto limit = std::min(a.size(), b.size());
+  while (length < limit && a[length] == b[length]) {
+    ++length;
+  }
+  return length;
+}
+} // namespace
+
+PathTableBuilder::PathTableBuilder() {
+  out_.push_back(static_cast<char>(kVersion));
+}
+
+void PathTableBuilder::add(StringPiece path, uint8_t tag) {
+  StringPiece previous{previous_};
+  if (count_ > 0 && !(previous < path)) {
+    throw std::invalid_argument(
+        "paths must be added to a path table in sorted order");
+  }
+
+  size_t shared = 0;
+  if (count_ % kRestartInterval == 0) {
+    restarts_.push_back(static_cast<uint32_t>(out_.size()));
+  } else {
+    shared = sharedPrefixLength(previous, path);
+  }
+  appendVarint(out_, shared);
+  appendVarint(out_, path.size() - shared);
+  out_.push_back(static_cast<char>(tag));
+  out_.append(path.data() + shared, path.size() - shared);
+
+  previous_.resize(shared);
+  previous_.append(path.data() + shared, path.size() - shared);
+  ++count_;
+}
+
+string PathTableBuilder::finish() && {
+  for (auto offset : restarts_) {
+    appendUint32(out_, offset);
+  }
+  appendUint32(out_, static_cast<uint32_t>(restarts_.size()));
+  appendUint32(out_, static_cast<uint32_t>(count_));
+  return std::move(out_);
+}
+
+string PathTableBuilder::build(
+    std::vector<std::pair<StringPiece, uint8_t>>&& paths) {
+  std::stable_sort(
+      paths.begin(), paths.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+      });
+  PathTableBuilder builder;
+  for (size_t n = 0; n < paths.size(); ++n) {
+    if (n > 0 && paths[n].first == paths[n - 1].first) {
+      continue;
+    }
+    builder.add(paths[n].first, paths[n].second);
+  }
+  return std::move(builder).finish();
+}
+
+PathTableReader::PathTableReader(ByteRange data) {
+  if (data.size() < 1 + kTrailerSize) {
+    throw std::invalid_argument("truncated path table");
+  }
+  if (data[0] != kVersion) {
+    throw std::invalid_argument("unsupported path table version");
+  }
+  auto end = data.end();
+  count_ = readUint32(end - sizeof(uint32_t));
+  uint64_t numRestarts = readUint32(end - kTrailerSize);
+  auto restartsSize = numRestarts * sizeof(uint32_t);
+  if (restartsSize > data.size() - 1 - kTrailerSize) {
+    throw std::invalid_argument("truncated path table");
+  }
+  if (numRestarts !=
+      (count_ + PathTableBuilder::kRestartInterval - 1) /
+          PathTableBuilder::kRestartInterval) {
+    throw std::invalid_argument("corrupt path table restart offsets");
+  }
+
+  auto restartsBegin = end - kTrailerSize - restartsSize;
+  entries_ = ByteRange{data.begin() + 1, restartsBegin};
+  restarts_ = ByteRange{restartsBegin, end - kTrailerSize};
+  for (size_t n = 0; n < numRestarts; ++n) {
+    if (getRestart(n) >= entries_.size()) {
+      throw std::invalid_argument("corrupt path table restart offsets");
+    }
+  }
+}
+
+uint32_t PathTableReader::getRestart(size_t index) const {
+  // Offsets in the table count the version byte, which entries_ skips.
+  return readUint32(restarts_.data() + index * sizeof(uint32_t)) - 1;
+}
+
+void PathTableReader::scan(
+    size_t offset,
+    string& path,
+    folly::FunctionRef<bool(StringPiece, uint8_t)> callback) const {
+  ByteRange data{entries_.begin() + offset, entries_.end()};
+  while (!data.empty()) {
+    // decodeVarint() throws std::invalid_argument if the varint is
+    // truncated.
+    auto shared = folly::decodeVarint(data);
+    auto restSize = folly::decodeVarint(data);
+    if (shared > path.size() || data.empty() ||
+        restSize > data.size() - 1) {
+      throw std::invalid_argument("corrupt path table entry");
+    }
+    auto tag = data[0];
+    path.resize(shared);
+    path.append(reinterpret_cast<const char*>(data.data() + 1), restSize);
+    data.advance(restSize + 1);
+    if (!callback(path, tag)) {
+      return;
+    }
+  }
+}
+
+void PathTableReader::forEach(
+    folly::FunctionRef<void(StringPiece path, uint8_t tag)> callback) const {
+  if (count_ == 0) {
+    return;
+  }
+  string path;
+  size_t seen = 0;
+  scan(0, path, [&](StringPiece entry, uint8_t tag) {
+    callback(entry, tag);
+    ++seen;
+    return true;
+  });
+  if (seen != count_) {
+    throw std::invalid_argument("path table entry count mismatch");
+  }
+}
+
+folly::Optional<uint8_t> PathTableReader::find(StringPiece path) const {
+  auto numRestarts = restarts_.size() / sizeof(uint32_t);
+  if (numRestarts == 0) {
+    return folly::none;
+  }
+
+  // Find the last restart entry that is not after the path.  Restart
+  // entries are stored whole, so they can be read without the entries
+  // before them.
+  auto readRestartPath = [&](size_t index) {
+    string entry;
+    scan(getRestart(index), entry, [](StringPiece, uint8_t) {
+      return false;
+    });
+    return entry;
+  };
+  size_t low = 0;
+  size_t high = numRestarts;
+  while (high - low > 1) {
+    auto mid = low + (high - low) / 2;
+    if (StringPiece{readRestartPath(mid)} <= path) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  folly::Optional<uint8_t> result;
+  string entry;
+  size_t remaining = PathTableBuilder::kRestartInterval;
+  scan(getRestart(low), entry, [&](StringPiece current, uint8_t tag) {
+    if (current == path) {
+      result = tag;
+      return false;
+    }
+    return current < path && --remaining > 0;
+  });
+  return result;
+}
+
+} // namespace eden
+} // namespace facebook
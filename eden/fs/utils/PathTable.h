@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Function.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * Encodes a sorted list of paths, each tagged with one byte, into a single
+ * buffer that the thrift APIs return in place of a list of strings.
+ *
+ * The serialized format is:
+ * - format version (1 byte)
+ * - for each path, in sorted order:
+ *   - the length of the prefix it shares with the previous path (varint)
+ *   - the length of the rest of the path (varint)
+ *   - the tag (1 byte)
+ *   - the rest of the path
+ * - the offset of every kRestartInterval'th entry (4 bytes each)
+ * - the number of those offsets (4 bytes)
+ * - the number of paths (4 bytes)
+ *
+ * The fixed width fields are little endian.  The entries at the restart
+ * offsets share no prefix with the previous path, so a reader can binary
+ * search them and only decode the entries between two of them.
+ *
+ * The builder appends each path straight into the output buffer, so
+ * building a table does not allocate per path.
+ */
+class PathTableBuilder {
+ public:
+  /** The number of entries between two restart offsets. */
+  static constexpr size_t kRestartInterval = 16;
+
+  PathTableBuilder();
+
+  /**
+   * Add a path, which must sort after the previous path added.
+   *
+   * Throws std::invalid_argument if it does not.
+   */
+  void add(folly::StringPiece path, uint8_t tag = 0);
+
+  size_t size() const {
+    return count_;
+  }
+
+  /**
+   * Return the encoded table.  The builder must not be used afterwards.
+   */
+  std::string finish() &&;
+
+  /**
+   * Sort the paths, drop duplicates, and encode them.  The pieces are not
+   * copied, so they must remain valid until this returns.  When a path is
+   * listed more than once, the first tag listed with it is kept.
+   */
+  static std::string build(
+      std::vector<std::pair<folly::StringPiece, uint8_t>>&& paths);
+
+ private:
+  std::string out_;
+  std::vector<uint32_t> restarts_;
+  /** The last path added, rebuilt in place as each path is added. */
+  std::string previous_;
+  size_t count_{0};
+};
+
+/**
+ * Reads a table produced by PathTableBuilder without copying it.
+ */
+class PathTableReader {
+ public:
+  /**
+   * Throws std::invalid_argument if data is not a valid table.  The data
+   * must remain valid for the lifetime of the reader.
+   */
+  explicit PathTableReader(folly::ByteRange data);
+
+  size_t size() const {
+    return count_;
+  }
+
+  /**
+   * Call the callback on each path, in sorted order.  The path is only
+   * valid during the call.
+   *
+   * Throws std::invalid_argument if an entry is corrupt.
+   */
+  void forEach(
+      folly::FunctionRef<void(folly::StringPiece path, uint8_t tag)> callback)
+      const;
+
+  /**
+   * Look up the tag of a path, returning folly::none if it is not in the
+   * table.
+   */
+  folly::Optional<uint8_t> find(folly::StringPiece path) const;
+
+ private:
+  /**
+   * Decode entries from offset until the callback returns false or the
+   * entries end, keeping the current path in `path`.
+   */
+  void scan(
+      size_t offset,
+      std::string& path,
+      folly::FunctionRef<bool(folly::StringPiece, uint8_t)> callback) const;
+
+  uint32_t getRestart(size_t index) const;
+
+  folly::ByteRange entries_;
+  folly::ByteRange restarts_;
+  size_t count_{0};
+};
+
+} // namespace eden
+} // namespace facebook
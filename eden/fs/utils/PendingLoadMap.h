@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <folly/container/F14Map.h>
+#include <folly/futures/Future.h>
+#include <folly/futures/SharedPromise.h>
+#include <memory>
+#include "eden/fs/utils/Cancellation.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * PendingLoadMap de-duplicates concurrent asynchronous loads of the same key.
+ *
+ * While a load for a key is outstanding, additional callers asking for that
+ * same key are handed a Future that shares the result of the first load
+ * rather than starting a new one.  Once the load completes the key is removed
+ * from the map, so PendingLoadMap never caches results: a later request for
+ * the same key will start a fresh load.
+ *
+ * PendingLoadMap is thread-safe.  Completion callbacks only reference the
+ * shared internal state, so the PendingLoadMap itself may be destroyed while
+ * loads are still outstanding.
+ */
+template <typename KEY, typename VAL, typename HASH = std::hash<KEY>>
+class PendingLoadMap {
+ public:
+  using SharedPromisePtr = std::shared_ptr<folly::SharedPromise<VAL>>;
+
+  /**
+   * Get a Future for the value of key.
+   *
+   * If a load for this key is already in progress, the returned Future will
+   * complete with the result of that load.  Otherwise loadFn is invoked
+   * synchronously to start a new load.  loadFn must return a folly::Future<VAL>
+   * (or a VAL); exceptions thrown by loadFn are propagated to all waiters.
+   *
+   * loadFn runs with a CancellationToken that is only cancelled once every
+   * caller waiting on the load has been cancelled, so queued work for the
+   * load is dropped when no other waiter remains.  A caller arriving after
+   * the load was dropped starts a new one.
+   */
+  template <typename LoadFn>
+  folly::Future<VAL> load(const KEY& key, LoadFn&& loadFn) {
+    auto token = CancellationToken::current();
+    Entry entry;
+    {
+      auto pending = pending_->wlock();
+      auto it = pending->find(key);
+      if (it != pending->end() && it->second.waiters.add(token)) {
+        return it->second.promise->getFuture();
+      }
+      entry.promise = std::make_shared<folly::SharedPromise<VAL>>();
+      entry.waiters = CancellationJoin{token};
+      (*pending)[key] = entry;
+    }
+
+    auto future = entry.promise->getFuture();
+    CancellationScope scope{entry.waiters.getToken()};
+    folly::makeFutureWith(std::forward<LoadFn>(loadFn))
+        .then([pending = pending_, key, promise = entry.promise](
+                  folly::Try<VAL>&& result) {
+          // Remove the entry before fulfilling the promise, so that callbacks
+          // attached to the result that request the same key again start a
+          // new load rather than observing a completed promise.  A load that
+          // was dropped may already have been replaced by a newer one.
+          {
+            auto map = pending->wlock();
+            auto it = map->find(key);
+            if (it != map->end() && it->second.promise == promise) {
+              map->erase(it);
+            }
+          }
+          promise->setTry(std::move(result));
+        });
+    return future;
+  }
+
+  /**
+   * Get the number of keys that currently have a load outstanding.
+   */
+  size_t size() const {
+    return pending_->rlock()->size();
+  }
+
+ private:
+  struct Entry {
+    SharedPromisePtr promise;
+    CancellationJoin waiters;
+  };
+  using Map = folly::F14FastMap<KEY, Entry, HASH>;
+
+  std::shared_ptr<folly::Synchronized<Map>> pending_{
+      std::make_shared<folly::Synchronized<Map>>()};
+};
+
+} // namespace eden
+} // namespace facebook
@@ -8,6 +8,7 @@
  *
  */
 #include "eden/fs/utils/ProcUtil.h"
+#include <folly/Conv.h>
 #include <folly/logging/xlog.h>
 #include <fstream>
 #include <vector>
@@ -176,6 +177,16 @@ folly::Optional<uint64_t> calculatePrivateBytes() {
     return folly::none;
   }
 }
+
+std::string readProcessName(pid_t pid) {
+  std::string name;
+  std::ifstream input(folly::to<std::string>("/proc/", pid, "/comm"));
+  if (!getline(input, name)) {
+    XLOG(DBG3) << "Failed to read the name of process " << pid;
+    return std::string();
+  }
+  return trim(name);
+}
 } // namespace proc_util
 } // namespace eden
 } // namespace facebook
@@ -10,6 +10,7 @@
 #pragma once
 #include <folly/Optional.h>
 #include <folly/Range.h>
+#include <sys/types.h>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -119,6 +120,13 @@ folly::Optional<uint64_t> getUnsignedLongLongValue(
     const std::unordered_map<std::string, std::string>& procStatMap,
     const std::string& key,
     const std::string& unitSuffix);
+
+/**
+ * Read the command name of process pid from /proc/<pid>/comm.
+ * @return the name, or an empty string if the process has exited or the name
+ * could not be read.
+ */
+std::string readProcessName(pid_t pid);
 } // namespace proc_util
 } // namespace eden
 } // namespace facebook
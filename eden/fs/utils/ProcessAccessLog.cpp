@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/ProcessAccessLog.h"
+
+#include <folly/io/async/Request.h>
+#include <algorithm>
+#include <tuple>
+
+#include "eden/fs/utils/ProcUtil.h"
+
+namespace facebook {
+namespace eden {
+
+namespace {
+const std::string kProcessAccessKey("eden_process_access");
+
+class ProcessAccessRequestData : public folly::RequestData {
+ public:
+  ProcessAccessRequestData(std::shared_ptr<ProcessAccessLog> log, pid_t pid)
+      : log_{std::move(log)}, pid_{pid} {}
+
+  bool hasCallback() override {
+    return false;
+  }
+
+  ProcessAccessLog& getLog() const {
+    return *log_;
+  }
+
+  pid_t getPid() const {
+    return pid_;
+  }
+
+ private:
+  std::shared_ptr<ProcessAccessLog> log_;
+  pid_t pid_;
+};
+
+const ProcessAccessRequestData* getCurrentRequestData() {
+  return static_cast<const ProcessAccessRequestData*>(
+      folly::RequestContext::get()->getContextData(kProcessAccessKey));
+}
+
+using ProcessCounts = ProcessAccessLog::ProcessCounts;
+
+bool isMoreActive(const ProcessCounts& a, const ProcessCounts& b) {
+  return std::make_tuple(a.treeFetches + a.blobFetches, a.fuseRequests) >
+      std::make_tuple(b.treeFetches + b.blobFetches, b.fuseRequests);
+}
+
+template <typename Map>
+void evictLeastActive(Map& map) {
+  auto leastActive = std::min_element(
+      map.begin(), map.end(), [](const auto& a, const auto& b) {
+        return isMoreActive(b.second, a.second);
+      });
+  map.erase(leastActive);
+}
+
+template <typename Map>
+std::vector<ProcessCounts> getTop(const Map& map, size_t limit) {
+  std::vector<ProcessCounts> result;
+  result.reserve(map.size());
+  for (const auto& entry : map) {
+    result.push_back(entry.second);
+  }
+  limit = std::min(limit, result.size());
+  std::partial_sort(
+      result.begin(), result.begin() + limit, result.end(), isMoreActive);
+  result.resize(limit);
+  return result;
+}
+} // namespace
+
+ProcessAccessLog::ProcessAccessLog(size_t capacity) : capacity_{capacity} {}
+
+template <typename Fn>
+void ProcessAccessLog::record(pid_t pid, Fn&& update) {
+  auto state = state_.lock();
+  auto it = state->processes.find(pid);
+  if (it == state->processes.end()) {
+    // Read the name without holding the lock, so that a slow /proc does not
+    // hold up requests from other processes.
+    state.unlock();
+    auto name = proc_util::readProcessName(pid);
+    state = state_.lock();
+
+    it = state->processes.find(pid);
+    if (it == state->processes.end()) {
+      if (state->processes.size() >= capacity_) {
+        evictLeastActive(state->processes);
+      }
+      ProcessCounts counts;
+      counts.pid = pid;
+      counts.name = std::move(name);
+      it = state->processes.emplace(pid, std::move(counts)).first;
+    }
+  }
+  update(it->second);
+
+  const auto& name = it->second.name;
+  if (name.empty()) {
+    return;
+  }
+  auto nameIt = state->names.find(name);
+  if (nameIt == state->names.end()) {
+    if (state->names.size() >= capacity_) {
+      evictLeastActive(state->names);
+    }
+    ProcessCounts counts;
+    counts.name = name;
+    nameIt = state->names.emplace(name, std::move(counts)).first;
+  }
+  update(nameIt->second);
+}
+
+void ProcessAccessLog::recordFuseRequest(pid_t pid) {
+  record(pid, [](ProcessCounts& counts) { ++counts.fuseRequests; });
+}
+
+void ProcessAccessLog::recordTreeFetch(pid_t pid) {
+  record(pid, [](ProcessCounts& counts) { ++counts.treeFetches; });
+}
+
+void ProcessAccessLog::recordBlobFetch(pid_t pid, uint64_t bytes) {
+  record(pid, [bytes](ProcessCounts& counts) {
+    ++counts.blobFetches;
+    counts.fetchedBytes += bytes;
+  });
+}
+
+std::vector<ProcessCounts> ProcessAccessLog::getTopProcesses(
+    size_t limit) const {
+  return getTop(state_.lock()->processes, limit);
+}
+
+std::vector<ProcessCounts> ProcessAccessLog::getTopProcessNames(
+    size_t limit) const {
+  return getTop(state_.lock()->names, limit);
+}
+
+void ProcessAccessLog::setCurrent(
+    std::shared_ptr<ProcessAccessLog> log,
+    pid_t pid) {
+  folly::RequestContext::get()->setContextData(
+      kProcessAccessKey,
+      std::make_unique<ProcessAccessRequestData>(std::move(log), pid));
+}
+
+void ProcessAccessLog::recordCurrentTreeFetch() {
+  if (const auto* data = getCurrentRequestData()) {
+    data->getLog().recordTreeFetch(data->getPid());
+  }
+}
+
+void ProcessAccessLog::recordCurrentBlobFetch(uint64_t bytes) {
+  if (const auto* data = getCurrentRequestData()) {
+    data->getLog().recordBlobFetch(data->getPid(), bytes);
+  }
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <sys/types.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * ProcessAccessLog attributes a mount's FUSE requests, and the backing store
+ * fetches they cause, to the client processes that made them.  It is meant
+ * to find the indexer or crawler behind a fetch storm.
+ *
+ * Only the most active processes are kept: once capacity processes are
+ * known, a new one replaces the least active.  Totals are also kept by
+ * process name, so that short-lived processes such as compilers still add
+ * up to something visible.  Names are read from /proc the first time a
+ * process is seen.
+ *
+ * Processes are ranked by the backing store fetches they caused, and then
+ * by their FUSE requests.
+ */
+class ProcessAccessLog {
+ public:
+  /**
+   * The work a client process has caused the mount to do.
+   */
+  struct ProcessCounts {
+    /** The process ID, or 0 for totals by process name. */
+    pid_t pid{0};
+    /** The command name, or empty if it could not be read. */
+    std::string name;
+    uint64_t fuseRequests{0};
+    uint64_t treeFetches{0};
+    uint64_t blobFetches{0};
+    uint64_t fetchedBytes{0};
+  };
+
+  static constexpr size_t kDefaultCapacity = 256;
+
+  explicit ProcessAccessLog(size_t capacity = kDefaultCapacity);
+
+  void recordFuseRequest(pid_t pid);
+  void recordTreeFetch(pid_t pid);
+  void recordBlobFetch(pid_t pid, uint64_t bytes);
+
+  /**
+   * Get up to limit of the most active processes, most active first.
+   */
+  std::vector<ProcessCounts> getTopProcesses(size_t limit) const;
+
+  /**
+   * Like getTopProcesses(), but with the counts of all processes sharing a
+   * name added together.
+   */
+  std::vector<ProcessCounts> getTopProcessNames(size_t limit) const;
+
+  /**
+   * Attribute the work of the current RequestContext to process pid in log.
+   * Like CancellationToken::setCurrent(), this should be called on a new
+   * RequestContext, such as the one each FUSE request runs in.
+   */
+  static void setCurrent(std::shared_ptr<ProcessAccessLog> log, pid_t pid);
+
+  /**
+   * Record a fetch against the process of the current RequestContext.  These
+   * do nothing if the work was not started by a FUSE request.
+   */
+  static void recordCurrentTreeFetch();
+  static void recordCurrentBlobFetch(uint64_t bytes);
+
+ private:
+  struct State {
+    std::unordered_map<pid_t, ProcessCounts> processes;
+    std::unordered_map<std::string, ProcessCounts> names;
+  };
+
+  template <typename Fn>
+  void record(pid_t pid, Fn&& update);
+
+  const size_t capacity_;
+  folly::Synchronized<State, std::mutex> state_;
+};
+
+} // namespace eden
+} // namespace facebook
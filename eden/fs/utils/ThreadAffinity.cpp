@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/ThreadAffinity.h"
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <folly/logging/xlog.h>
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <stdexcept>
+
+using folly::StringPiece;
+
+namespace facebook {
+namespace eden {
+
+namespace {
+constexpr StringPiece kNodePrefix{"node:"};
+
+size_t parseListMember(StringPiece member, StringPiece list) {
+  auto value = folly::tryTo<size_t>(member);
+  if (!value.hasValue()) {
+    throw std::invalid_argument(folly::to<std::string>(
+        "invalid member \"", member, "\" in CPU list \"", list, "\""));
+  }
+  return value.value();
+}
+} // namespace
+
+std::vector<size_t> parseCpuList(StringPiece list) {
+  std::vector<StringPiece> ranges;
+  folly::split(',', folly::trimWhitespace(list), ranges);
+
+  std::vector<size_t> result;
+  for (auto range : ranges) {
+    auto dash = range.find('-');
+    auto first = parseListMember(range.subpiece(0, dash), list);
+    auto last = dash == StringPiece::npos
+        ? first
+        : parseListMember(range.subpiece(dash + 1), list);
+    if (last < first || last >= CPU_SETSIZE) {
+      throw std::invalid_argument(folly::to<std::string>(
+          "invalid range \"", range, "\" in CPU list \"", list, "\""));
+    }
+    for (auto n = first; n <= last; ++n) {
+      result.push_back(n);
+    }
+  }
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+  return result;
+}
+
+CpuAffinity CpuAffinity::parse(StringPiece spec, AbsolutePathPiece nodeDir) {
+  CpuAffinity affinity;
+  if (spec.empty()) {
+    return affinity;
+  }
+
+  if (spec.startsWith(kNodePrefix)) {
+    for (auto node : parseCpuList(spec.subpiece(kNodePrefix.size()))) {
+      auto cpuListPath = nodeDir +
+          PathComponent{folly::to<std::string>("node", node)} +
+          PathComponent{"cpulist"};
+      std::string cpuList;
+      if (!folly::readFile(cpuListPath.c_str(), cpuList)) {
+        throw std::invalid_argument(folly::to<std::string>(
+            "unable to read the CPUs of NUMA node ", node, " from ",
+            cpuListPath));
+      }
+      auto cpus = parseCpuList(cpuList);
+      affinity.cpus_.insert(affinity.cpus_.end(), cpus.begin(), cpus.end());
+    }
+    std::sort(affinity.cpus_.begin(), affinity.cpus_.end());
+    affinity.cpus_.erase(
+        std::unique(affinity.cpus_.begin(), affinity.cpus_.end()),
+        affinity.cpus_.end());
+  } else {
+    affinity.cpus_ = parseCpuList(spec);
+  }
+
+  if (affinity.cpus_.empty()) {
+    throw std::invalid_argument(
+        folly::to<std::string>("CPU affinity \"", spec, "\" selects no CPUs"));
+  }
+  return affinity;
+}
+
+void CpuAffinity::applyToCurrentThread() const {
+  if (!isSet()) {
+    return;
+  }
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  for (auto cpu : cpus_) {
+    CPU_SET(cpu, &cpuSet);
+  }
+  auto error = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+  if (error != 0) {
+    XLOG(WARN) << "unable to set the CPU affinity of this thread: "
+               << folly::errnoStr(error);
+  }
+}
+
+std::thread CpuAffinityThreadFactory::newThread(folly::Func&& func) {
+  if (!affinity_.isSet()) {
+    return delegate_->newThread(std::move(func));
+  }
+  return delegate_->newThread(
+      [affinity = affinity_, func = std::move(func)]() mutable {
+        affinity.applyToCurrentThread();
+        func();
+      });
+}
+
+} // namespace eden
+} // namespace facebook
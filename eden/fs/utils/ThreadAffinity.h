@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/executors/thread_factory/ThreadFactory.h>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace facebook {
+namespace eden {
+
+constexpr folly::StringPiece kSysfsNodeDir{"/sys/devices/system/node"};
+
+/**
+ * The set of CPUs that the threads of one of Eden's thread pools may run on.
+ *
+ * On machines with several NUMA nodes, keeping a pool's threads on one node
+ * keeps the caches and memory they touch local.  Linux allocates pages on
+ * the node of the CPU that first touches them, so the thread-local caches
+ * and allocator arenas of pinned threads end up on their node too.
+ */
+class CpuAffinity {
+ public:
+  /** An affinity that lets threads run on any CPU. */
+  CpuAffinity() = default;
+
+  /**
+   * Parse an affinity specification:
+   *
+   * - An empty string lets threads run on any CPU.
+   * - A list of CPUs and CPU ranges, like "0-7,16-23".
+   * - "node:" followed by a list of NUMA nodes and node ranges, like
+   *   "node:0" or "node:0-1", selects the CPUs of those nodes, as listed
+   *   in nodeDir.
+   *
+   * Throws std::invalid_argument if the specification is malformed or
+   * selects no CPUs.
+   */
+  static CpuAffinity parse(
+      folly::StringPiece spec,
+      AbsolutePathPiece nodeDir = AbsolutePathPiece{kSysfsNodeDir});
+
+  /**
+   * Returns false if threads may run on any CPU.
+   */
+  bool isSet() const {
+    return !cpus_.empty();
+  }
+
+  /**
+   * Returns the selected CPUs in increasing order.
+   */
+  const std::vector<size_t>& getCpus() const {
+    return cpus_;
+  }
+
+  /**
+   * Restrict the calling thread to the selected CPUs.
+   *
+   * Failures, such as all of the CPUs being offline or outside of the
+   * process's cpuset, are logged rather than thrown: the thread still works,
+   * just without the affinity.
+   */
+  void applyToCurrentThread() const;
+
+ private:
+  std::vector<size_t> cpus_;
+};
+
+/**
+ * Parse a Linux CPU or node list, like "0-3,8,10-11", into its sorted
+ * distinct members.  Throws std::invalid_argument if it is malformed.
+ */
+std::vector<size_t> parseCpuList(folly::StringPiece list);
+
+/**
+ * A ThreadFactory that applies a CpuAffinity to each thread before running
+ * it, and otherwise delegates to another factory.
+ */
+class CpuAffinityThreadFactory : public folly::ThreadFactory {
+ public:
+  CpuAffinityThreadFactory(
+      std::shared_ptr<folly::ThreadFactory> delegate,
+      CpuAffinity affinity)
+      : delegate_{std::move(delegate)}, affinity_{std::move(affinity)} {}
+
+  std::thread newThread(folly::Func&& func) override;
+
+ private:
+  std::shared_ptr<folly::ThreadFactory> delegate_;
+  CpuAffinity affinity_;
+};
+
+} // namespace eden
+} // namespace facebook
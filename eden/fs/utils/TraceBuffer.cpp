@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/TraceBuffer.h"
+
+#include <folly/ThreadLocal.h>
+#include <folly/system/ThreadId.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+DEFINE_int32(
+    trace_buffer_events,
+    1024,
+    "The number of recent trace events kept by each thread, or 0 to disable "
+    "tracing");
+
+namespace facebook {
+namespace eden {
+
+const std::string TraceRequestData::kKey("eden_trace");
+
+namespace {
+/**
+ * A slot in a ring buffer.  Only the owning thread writes to it, but any
+ * thread may read it, so every field is atomic.  seq is 0 while the slot is
+ * being written, and otherwise one more than the index of the event it
+ * holds, which lets a reader tell when a slot changed while it was copying
+ * it.
+ */
+struct Slot {
+  std::atomic<uint64_t> seq{0};
+  std::atomic<uint64_t> timestamp{0};
+  std::atomic<uint64_t> requestId{0};
+  std::atomic<uint64_t> argument{0};
+  std::atomic<uint8_t> kind{0};
+  std::atomic<uint8_t> phase{0};
+};
+
+class ThreadBuffer {
+ public:
+  ThreadBuffer()
+      : slots_(std::make_unique<Slot[]>(
+            std::max(FLAGS_trace_buffer_events, 1))),
+        size_(std::max(FLAGS_trace_buffer_events, 1)),
+        threadId_(folly::getOSThreadID()) {}
+
+  void record(
+      TraceEventKind kind,
+      TracePhase phase,
+      uint64_t requestId,
+      uint64_t argument) {
+    const auto timestamp =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    const auto index = next_++;
+    auto& slot = slots_[index % size_];
+
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.timestamp.store(timestamp, std::memory_order_relaxed);
+    slot.requestId.store(requestId, std::memory_order_relaxed);
+    slot.argument.store(argument, std::memory_order_relaxed);
+    slot.kind.store(static_cast<uint8_t>(kind), std::memory_order_relaxed);
+    slot.phase.store(static_cast<uint8_t>(phase), std::memory_order_relaxed);
+    slot.seq.store(index + 1, std::memory_order_release);
+  }
+
+  void copyEvents(std::vector<TraceEvent>& events) const {
+    for (size_t n = 0; n < size_; ++n) {
+      const auto& slot = slots_[n];
+      const auto seq = slot.seq.load(std::memory_order_acquire);
+      if (seq == 0) {
+        continue;
+      }
+
+      TraceEvent event;
+      event.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+      event.requestId = slot.requestId.load(std::memory_order_relaxed);
+      event.argument = slot.argument.load(std::memory_order_relaxed);
+      event.threadId = threadId_;
+      event.kind = static_cast<TraceEventKind>(
+          slot.kind.load(std::memory_order_relaxed));
+      event.phase =
+          static_cast<TracePhase>(slot.phase.load(std::memory_order_relaxed));
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == seq) {
+        events.push_back(event);
+      }
+    }
+  }
+
+ private:
+  const std::unique_ptr<Slot[]> slots_;
+  const size_t size_;
+  const uint64_t threadId_;
+  /** The index of the next event, only accessed by the owning thread. */
+  uint64_t next_{0};
+};
+
+class ThreadBufferTag {};
+using ThreadBuffers =
+    folly::ThreadLocal<ThreadBuffer, ThreadBufferTag, folly::AccessModeStrict>;
+
+ThreadBuffers& getThreadBuffers() {
+  // Leaked, so that threads exiting during shutdown can still use it.
+  static auto* buffers = new ThreadBuffers();
+  return *buffers;
+}
+
+std::atomic<uint64_t> nextRequestId{1};
+} // namespace
+
+uint64_t TraceBuffer::startRequest() {
+  if (!isEnabled()) {
+    return 0;
+  }
+  const auto requestId = nextRequestId.fetch_add(1, std::memory_order_relaxed);
+  folly::RequestContext::get()->setContextData(
+      TraceRequestData::kKey, std::make_unique<TraceRequestData>(requestId));
+  return requestId;
+}
+
+uint64_t TraceBuffer::getCurrentRequestId() {
+  const auto* data =
+      folly::RequestContext::get()->getContextData(TraceRequestData::kKey);
+  return data ? static_cast<const TraceRequestData*>(data)->getRequestId() : 0;
+}
+
+bool TraceBuffer::isEnabled() {
+  return FLAGS_trace_buffer_events > 0;
+}
+
+void TraceBuffer::recordEvent(
+    TraceEventKind kind,
+    TracePhase phase,
+    uint64_t requestId,
+    uint64_t argument) {
+  getThreadBuffers()->record(kind, phase, requestId, argument);
+}
+
+std::vector<TraceEvent> TraceBuffer::getEvents() {
+  std::vector<TraceEvent> events;
+  {
+    auto accessor = getThreadBuffers().accessAllThreads();
+    for (const auto& buffer : accessor) {
+      buffer.copyEvents(events);
+    }
+  }
+  std::stable_sort(
+      events.begin(),
+      events.end(),
+      [](const TraceEvent& a, const TraceEvent& b) {
+        return a.timestamp < b.timestamp;
+      });
+  return events;
+}
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,174 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/Request.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace facebook {
+namespace eden {
+
+/**
+ * The operations that are traced.  The meaning of an event's argument
+ * depends on its kind.
+ */
+enum class TraceEventKind : uint8_t {
+  /** A FUSE request.  The argument is the FUSE opcode. */
+  FUSE_REQUEST = 0,
+  /** Loading an inode.  The argument is the inode number. */
+  INODE_LOAD = 1,
+  /** An object found in the LocalStore.  The argument is the KeySpace. */
+  LOCAL_STORE_HIT = 2,
+  /** An object missing from the LocalStore.  The argument is the KeySpace. */
+  LOCAL_STORE_MISS = 3,
+  /** A request to the hg import helper.  The argument is the KeySpace. */
+  HG_IMPORT = 4,
+  /** Reading a directory from the overlay.  The argument is the inode. */
+  OVERLAY_READ = 5,
+  /** Writing a directory to the overlay.  The argument is the inode. */
+  OVERLAY_WRITE = 6,
+};
+
+enum class TracePhase : uint8_t {
+  BEGIN = 0,
+  END = 1,
+  /** An event with no duration. */
+  INSTANT = 2,
+};
+
+struct TraceEvent {
+  /** Nanoseconds on the steady clock. */
+  uint64_t timestamp;
+  /** The request the event was part of, or 0 if it was not in a request. */
+  uint64_t requestId;
+  uint64_t argument;
+  /** The OS thread that recorded the event. */
+  uint64_t threadId;
+  TraceEventKind kind;
+  TracePhase phase;
+};
+
+/**
+ * TraceBuffer keeps the most recent trace events recorded by each thread, so
+ * that the time spent on a slow request can be attributed to the layers it
+ * passed through.
+ *
+ * Each thread writes to its own fixed-size ring buffer without taking any
+ * locks, so recording an event only costs a few stores.  getEvents() copies
+ * the buffers of all threads, skipping any slot that is overwritten while it
+ * is being copied.  The --trace_buffer_events flag sets the size of each
+ * thread's buffer, and setting it to 0 disables tracing.  A thread's buffer
+ * is freed when the thread exits.
+ *
+ * Events are grouped by a request ID which is stored in the folly
+ * RequestContext, so that it follows the request across the futures and
+ * threads that work on it.
+ */
+class TraceBuffer {
+ public:
+  /**
+   * Allocate a new request ID and store it in the current RequestContext.
+   * The caller should have created a new RequestContext for the request.
+   */
+  static uint64_t startRequest();
+
+  /**
+   * Returns the request ID of the current RequestContext, or 0 if there is
+   * none.
+   */
+  static uint64_t getCurrentRequestId();
+
+  static bool isEnabled();
+
+  /**
+   * Record an event for the current request.
+   */
+  static void record(
+      TraceEventKind kind,
+      TracePhase phase,
+      uint64_t argument = 0) {
+    if (isEnabled()) {
+      recordEvent(kind, phase, getCurrentRequestId(), argument);
+    }
+  }
+
+  /**
+   * Record an event for the given request.
+   */
+  static void record(
+      TraceEventKind kind,
+      TracePhase phase,
+      uint64_t requestId,
+      uint64_t argument) {
+    if (isEnabled()) {
+      recordEvent(kind, phase, requestId, argument);
+    }
+  }
+
+  /**
+   * Get the events currently held by all threads' buffers, ordered by
+   * timestamp.
+   */
+  static std::vector<TraceEvent> getEvents();
+
+ private:
+  static void recordEvent(
+      TraceEventKind kind,
+      TracePhase phase,
+      uint64_t requestId,
+      uint64_t argument);
+};
+
+/**
+ * Records a BEGIN event now, and the matching END event when destroyed.
+ */
+class TraceScope {
+ public:
+  explicit TraceScope(TraceEventKind kind, uint64_t argument = 0)
+      : kind_(kind), argument_(argument) {
+    TraceBuffer::record(kind_, TracePhase::BEGIN, argument_);
+  }
+  ~TraceScope() {
+    TraceBuffer::record(kind_, TracePhase::END, argument_);
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  TraceEventKind kind_;
+  uint64_t argument_;
+};
+
+/**
+ * The RequestContext data holding the current request ID.
+ */
+class TraceRequestData : public folly::RequestData {
+ public:
+  static const std::string kKey;
+
+  explicit TraceRequestData(uint64_t requestId) : requestId_(requestId) {}
+
+  bool hasCallback() override {
+    return false;
+  }
+
+  uint64_t getRequestId() const {
+    return requestId_;
+  }
+
+ private:
+  const uint64_t requestId_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -14,17 +14,41 @@
 #include <folly/executors/task_queue/UnboundedBlockingQueue.h>
 #include <folly/executors/thread_factory/NamedThreadFactory.h>
 
+#include "eden/fs/utils/WorkStealingExecutor.h"
+
 namespace facebook {
 namespace eden {
 
+namespace {
+std::shared_ptr<folly::Executor> makeThreadPool(
+    size_t threadCount,
+    folly::StringPiece threadNamePrefix,
+    UnboundedQueueExecutor::QueueType queueType,
+    const CpuAffinity& affinity) {
+  if (queueType == UnboundedQueueExecutor::QueueType::WorkStealing) {
+    return std::make_shared<WorkStealingExecutor>(
+        threadCount, threadNamePrefix, affinity);
+  }
+  return std::make_shared<folly::CPUThreadPoolExecutor>(
+      threadCount,
+      std::make_unique<folly::UnboundedBlockingQueue<
+          folly::CPUThreadPoolExecutor::CPUTask>>(),
+      std::make_shared<CpuAffinityThreadFactory>(
+          std::make_shared<folly::NamedThreadFactory>(threadNamePrefix),
+          affinity));
+}
+} // namespace
+
 UnboundedQueueExecutor::UnboundedQueueExecutor(
     size_t threadCount,
-    folly::StringPiece threadNamePrefix)
-    : executor_{std::make_unique<folly::CPUThreadPoolExecutor>(
+    folly::StringPiece threadNamePrefix,
+    QueueType queueType,
+    const CpuAffinity& affinity)
+    : executor_{makeThreadPool(
           threadCount,
-          std::make_unique<folly::UnboundedBlockingQueue<
-              folly::CPUThreadPoolExecutor::CPUTask>>(),
-          std::make_unique<folly::NamedThreadFactory>(threadNamePrefix))} {}
+          threadNamePrefix,
+          queueType,
+          affinity)} {}
 
 UnboundedQueueExecutor::UnboundedQueueExecutor(
     std::shared_ptr<folly::ManualExecutor> executor)
@@ -11,6 +11,7 @@
 
 #include <folly/Executor.h>
 #include <folly/Range.h>
+#include "eden/fs/utils/ThreadAffinity.h"
 
 namespace folly {
 class ManualExecutor;
@@ -28,13 +29,24 @@ namespace eden {
  */
 class UnboundedQueueExecutor : public folly::Executor {
  public:
+  enum class QueueType {
+    /** One queue shared by every thread, in FIFO order. */
+    Shared,
+    /** A queue per thread; see WorkStealingExecutor. */
+    WorkStealing,
+  };
+
   /**
    * Instantiates with a folly::CPUThreadPoolExecutor with the given threadCount
-   * and threadNamePrefix but with an unlimited queue.
+   * and threadNamePrefix but with an unlimited queue, or with a
+   * WorkStealingExecutor if queueType is WorkStealing.  The threads are
+   * restricted to the CPUs selected by affinity.
    */
   explicit UnboundedQueueExecutor(
       size_t threadCount,
-      folly::StringPiece threadNamePrefix);
+      folly::StringPiece threadNamePrefix,
+      QueueType queueType = QueueType::Shared,
+      const CpuAffinity& affinity = CpuAffinity{});
 
   /**
    * ManualExecutors are unbounded too.
@@ -324,8 +324,10 @@ void UnixSocket::send(IOBuf&& data, SendCallback* callback) noexcept {
 
 void UnixSocket::send(Message&& message, SendCallback* callback) noexcept {
   if (closeStarted_) {
-    callback->sendError(make_exception_wrapper<std::runtime_error>(
-        "cannot send a message on a closed UnixSocket"));
+    if (callback) {
+      callback->sendError(make_exception_wrapper<std::runtime_error>(
+          "cannot send a message on a closed UnixSocket"));
+    }
     return;
   }
   eventBase_->dcheckIsInEventBaseThread();
@@ -341,8 +343,9 @@ void UnixSocket::send(Message&& message, SendCallback* callback) noexcept {
   } catch (const std::exception& ex) {
     auto ew = exception_wrapper{std::current_exception(), ex};
     XLOG(ERR) << "error allocating a send queue entry: " << ew.what();
-    callback->sendError(make_exception_wrapper<std::runtime_error>(
-        "cannot send a message on a closed UnixSocket"));
+    if (callback) {
+      callback->sendError(ew);
+    }
     return;
   }
 
@@ -469,25 +472,28 @@ void UnixSocket::trySend() {
   // If we have multiple message to send and write doesn't block,
   // break out after sending MAX_MSGS_AT_ONCE, just to yield the event loop
   // so that we don't starve other events that need to be handled.
-  constexpr unsigned int MAX_MSGS_AT_ONCE = 10;
-  for (unsigned int n = 0; n < MAX_MSGS_AT_ONCE; ++n) {
-    if (!sendQueue_) {
-      break;
+  constexpr size_t MAX_MSGS_AT_ONCE = 10;
+  size_t messagesSent = 0;
+  while (sendQueue_ && messagesSent < MAX_MSGS_AT_ONCE) {
+    // Small messages without file descriptors, like most privhelper
+    // requests and responses, are sent several at a time when they queue up.
+    bool blocked = false;
+    size_t completed;
+    if (canCoalesce(*sendQueue_) && sendQueue_->next &&
+        canCoalesce(*sendQueue_->next)) {
+      completed = trySendCoalesced(MAX_MSGS_AT_ONCE - messagesSent, blocked);
+    } else {
+      blocked = !trySendMessage(sendQueue_.get());
+      completed = blocked ? 0 : 1;
     }
 
-    if (!trySendMessage(sendQueue_.get())) {
-      // The write blocked, and we need to retry this message again
+    finishSends(completed);
+    messagesSent += completed;
+    if (blocked) {
+      // The write blocked, and we need to retry the remaining data again
       // after waiting for the socket to become writable.
       break;
     }
-    auto* callback = sendQueue_->callback;
-    sendQueue_ = std::move(sendQueue_->next);
-    if (!sendQueue_) {
-      sendQueueTail_ = nullptr;
-    }
-    if (callback) {
-      callback->sendSuccess();
-    }
   }
 
   // Update our I/O event and timeout registration
@@ -561,20 +567,7 @@ bool UnixSocket::trySendMessage(SendQueueEntry* entry) {
   }
 
   if (entry->iovIndex < entry->iovCount) {
-    // Update entry->iov and entry->iovIndex to account for the data that was
-    // successfully sent.
-    while (bytesSent > 0) {
-      if (static_cast<size_t>(bytesSent) >=
-          entry->iov[entry->iovIndex].iov_len) {
-        bytesSent -= entry->iov[entry->iovIndex].iov_len;
-        ++entry->iovIndex;
-      } else {
-        auto* iov = entry->iov + entry->iovIndex;
-        iov->iov_len -= bytesSent;
-        iov->iov_base = static_cast<char*>(iov->iov_base) + bytesSent;
-        break;
-      }
-    }
+    advanceSendEntry(entry, bytesSent);
   }
 
   // Update entry->filesSent to account for the file descriptors we sent.
@@ -586,6 +579,100 @@ bool UnixSocket::trySendMessage(SendQueueEntry* entry) {
       entry->filesSent == entry->message.files.size());
 }
 
+bool UnixSocket::canCoalesce(const SendQueueEntry& entry) {
+  return entry.iovIndex < entry.iovCount &&
+      entry.filesSent == entry.message.files.size();
+}
+
+size_t UnixSocket::trySendCoalesced(size_t maxMessages, bool& blocked) {
+  coalescedIovecs_.clear();
+  size_t numMessages = 0;
+  for (auto* entry = sendQueue_.get(); entry && numMessages < maxMessages &&
+       canCoalesce(*entry);
+       entry = entry->next.get()) {
+    const auto iovRemaining = entry->iovCount - entry->iovIndex;
+    if (numMessages > 0 &&
+        coalescedIovecs_.size() + iovRemaining > folly::kIovMax) {
+      break;
+    }
+    coalescedIovecs_.insert(
+        coalescedIovecs_.end(),
+        entry->iov + entry->iovIndex,
+        entry->iov + entry->iovCount);
+    ++numMessages;
+  }
+
+  struct msghdr msg = {};
+  msg.msg_iov = coalescedIovecs_.data();
+  msg.msg_iovlen = std::min(coalescedIovecs_.size(), folly::kIovMax);
+  auto bytesSent = sendmsg(socket_.fd(), &msg, MSG_DONTWAIT);
+  XLOG(DBG9) << "sendmsg() returned " << bytesSent << " for " << numMessages
+             << " coalesced messages";
+  if (bytesSent < 0) {
+    if (errno == EAGAIN) {
+      blocked = true;
+      return 0;
+    }
+    throwSystemError("sendmsg() failed on UnixSocket");
+  }
+
+  size_t completed = 0;
+  size_t bytesLeft = bytesSent;
+  for (auto* entry = sendQueue_.get(); completed < numMessages;
+       entry = entry->next.get()) {
+    bytesLeft = advanceSendEntry(entry, bytesLeft);
+    if (entry->iovIndex < entry->iovCount) {
+      break;
+    }
+    ++completed;
+  }
+  blocked = completed < numMessages;
+  return completed;
+}
+
+size_t UnixSocket::advanceSendEntry(SendQueueEntry* entry, size_t bytesSent) {
+  // Update entry->iov and entry->iovIndex to account for the data that was
+  // successfully sent.
+  while (bytesSent > 0 && entry->iovIndex < entry->iovCount) {
+    auto* iov = entry->iov + entry->iovIndex;
+    if (bytesSent >= iov->iov_len) {
+      bytesSent -= iov->iov_len;
+      ++entry->iovIndex;
+    } else {
+      iov->iov_len -= bytesSent;
+      iov->iov_base = static_cast<char*>(iov->iov_base) + bytesSent;
+      return 0;
+    }
+  }
+  return bytesSent;
+}
+
+void UnixSocket::finishSends(size_t count) {
+  if (count == 0) {
+    return;
+  }
+
+  // Detach the finished entries before invoking any callbacks, since a
+  // callback may close the socket and fail everything still on the queue.
+  auto finished = std::move(sendQueue_);
+  auto* last = finished.get();
+  for (size_t n = 1; n < count; ++n) {
+    last = last->next.get();
+  }
+  sendQueue_ = std::move(last->next);
+  if (!sendQueue_) {
+    sendQueueTail_ = nullptr;
+  }
+
+  while (finished) {
+    auto* callback = finished->callback;
+    finished = std::move(finished->next);
+    if (callback) {
+      callback->sendSuccess();
+    }
+  }
+}
+
 size_t UnixSocket::initializeFirstControlMsg(
     vector<uint8_t>& controlBuf,
     struct msghdr* msg,
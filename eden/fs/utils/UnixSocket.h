@@ -351,6 +351,28 @@ class UnixSocket : public folly::DelayedDestruction,
 
   void trySend();
   bool trySendMessage(SendQueueEntry* entry);
+  /**
+   * Send the data of several queued messages with a single sendmsg() call.
+   *
+   * This may only be used for messages that have no file descriptors left
+   * to send, since file descriptors are delivered with whichever bytes
+   * they were sent alongside.
+   *
+   * Returns the number of messages that were sent completely, and sets
+   * blocked if some of the data could not be sent.
+   */
+  size_t trySendCoalesced(size_t maxMessages, bool& blocked);
+  static bool canCoalesce(const SendQueueEntry& entry);
+  /**
+   * Account for bytesSent bytes of entry's data having been sent.
+   * Returns the number of bytes left over once entry's data is used up.
+   */
+  static size_t advanceSendEntry(SendQueueEntry* entry, size_t bytesSent);
+  /**
+   * Remove the first count entries from the send queue, and report their
+   * success.
+   */
+  void finishSends(size_t count);
   size_t initializeFirstControlMsg(
       std::vector<uint8_t>& controlBuf,
       struct msghdr* msg,
@@ -416,6 +438,9 @@ class UnixSocket : public folly::DelayedDestruction,
 
   SendQueuePtr sendQueue_;
   SendQueueEntry* sendQueueTail_{nullptr};
+  // Scratch space for trySendCoalesced(), kept to avoid allocating it for
+  // every send.
+  std::vector<struct iovec> coalescedIovecs_;
 };
 
 } // namespace eden
@@ -0,0 +1,146 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/WorkStealingExecutor.h"
+
+#include <folly/Conv.h>
+#include <folly/ExceptionString.h>
+#include <folly/logging/xlog.h>
+#include <folly/system/ThreadName.h>
+#include <algorithm>
+
+namespace facebook {
+namespace eden {
+
+namespace {
+/**
+ * The executor and worker index of the current thread, if it is one of a
+ * WorkStealingExecutor's workers.
+ */
+struct CurrentWorker {
+  const WorkStealingExecutor* executor{nullptr};
+  size_t index{0};
+};
+thread_local CurrentWorker currentWorker;
+} // namespace
+
+WorkStealingExecutor::WorkStealingExecutor(
+    size_t numThreads,
+    folly::StringPiece threadNamePrefix,
+    const CpuAffinity& affinity) {
+  numThreads = std::max<size_t>(numThreads, 1);
+  for (size_t n = 0; n < numThreads; ++n) {
+    localQueues_.push_back(std::make_unique<TaskQueue>());
+  }
+  for (size_t n = 0; n < numThreads; ++n) {
+    threads_.emplace_back(
+        [this,
+         n,
+         name = folly::to<std::string>(threadNamePrefix, n),
+         affinity] {
+          folly::setThreadName(name);
+          affinity.applyToCurrentThread();
+          runWorker(n);
+        });
+  }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+  {
+    std::lock_guard<std::mutex> guard(sleepMutex_);
+    stopping_ = true;
+  }
+  wakeup_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkStealingExecutor::add(folly::Func func) {
+  auto* queue = currentWorker.executor == this
+      ? localQueues_[currentWorker.index].get()
+      : &sharedQueue_;
+
+  // Count the task before queueing it, so that pending_ never drops below
+  // the number of queued tasks.  A worker woken in between just retries.
+  //
+  // This pairs with the idle_ increment and pending_ check in runWorker():
+  // either we see the sleeping worker, or it sees this task before sleeping.
+  pending_.fetch_add(1, std::memory_order_seq_cst);
+  {
+    std::lock_guard<std::mutex> guard(queue->mutex);
+    queue->tasks.push_back(std::move(func));
+  }
+  if (idle_.load(std::memory_order_seq_cst) > 0) {
+    std::lock_guard<std::mutex> guard(sleepMutex_);
+    wakeup_.notify_one();
+  }
+}
+
+bool WorkStealingExecutor::takeTask(size_t index, folly::Func& func) {
+  {
+    auto& local = *localQueues_[index];
+    std::lock_guard<std::mutex> guard(local.mutex);
+    if (!local.tasks.empty()) {
+      func = std::move(local.tasks.back());
+      local.tasks.pop_back();
+      return true;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> guard(sharedQueue_.mutex);
+    if (!sharedQueue_.tasks.empty()) {
+      func = std::move(sharedQueue_.tasks.front());
+      sharedQueue_.tasks.pop_front();
+      return true;
+    }
+  }
+  for (size_t n = 1; n < localQueues_.size(); ++n) {
+    auto& victim = *localQueues_[(index + n) % localQueues_.size()];
+    std::lock_guard<std::mutex> guard(victim.mutex);
+    if (!victim.tasks.empty()) {
+      func = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingExecutor::runWorker(size_t index) {
+  currentWorker.executor = this;
+  currentWorker.index = index;
+
+  while (true) {
+    folly::Func func;
+    if (takeTask(index, func)) {
+      pending_.fetch_sub(1, std::memory_order_seq_cst);
+      try {
+        func();
+      } catch (const std::exception& ex) {
+        XLOG(ERR) << "unhandled exception in WorkStealingExecutor task: "
+                  << folly::exceptionStr(ex);
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    idle_.fetch_add(1, std::memory_order_seq_cst);
+    wakeup_.wait(lock, [this] {
+      return pending_.load(std::memory_order_seq_cst) > 0 || stopping_;
+    });
+    idle_.fetch_sub(1, std::memory_order_seq_cst);
+    if (stopping_ && pending_.load(std::memory_order_seq_cst) == 0) {
+      return;
+    }
+  }
+}
+
+} // namespace eden
+} // namespace facebook
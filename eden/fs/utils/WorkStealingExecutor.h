@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Executor.h>
+#include <folly/Range.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "eden/fs/utils/ThreadAffinity.h"
+
+namespace facebook {
+namespace eden {
+
+/**
+ * A thread pool where each worker thread has its own queue.
+ *
+ * Tasks added from one of the pool's own threads, such as the continuations
+ * of work that thread is running, go on that thread's queue, and are run
+ * newest first so that they find the data their parent just touched still
+ * in cache.  Tasks added from elsewhere go on a shared queue.  A worker
+ * whose own queue is empty takes from the shared queue, and failing that
+ * steals the oldest task from another worker.
+ *
+ * Fan-out workloads like diff and glob add far more tasks from inside the
+ * pool than from outside it, so most adds touch only an uncontended
+ * per-thread queue, and no other thread needs to be woken for them unless
+ * some are idle.
+ *
+ * Like the queue used by UnboundedQueueExecutor, the queues are unbounded,
+ * so add() never blocks.  The destructor runs every task that has been
+ * added before the threads exit.
+ */
+class WorkStealingExecutor : public folly::Executor {
+ public:
+  WorkStealingExecutor(
+      size_t numThreads,
+      folly::StringPiece threadNamePrefix,
+      const CpuAffinity& affinity = CpuAffinity{});
+  ~WorkStealingExecutor() override;
+
+  WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+  WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+  void add(folly::Func func) override;
+
+ private:
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<folly::Func> tasks;
+  };
+
+  void runWorker(size_t index);
+
+  /**
+   * Find a task for worker index: its own newest task, the oldest shared
+   * task, or the oldest task of another worker, in that order.
+   */
+  bool takeTask(size_t index, folly::Func& func);
+
+  std::vector<std::unique_ptr<TaskQueue>> localQueues_;
+  TaskQueue sharedQueue_;
+
+  /**
+   * The number of tasks that have been added but not yet taken.  Workers
+   * only sleep while this is zero.
+   */
+  std::atomic<size_t> pending_{0};
+  /** The number of workers that are asleep, or about to be. */
+  std::atomic<size_t> idle_{0};
+
+  std::mutex sleepMutex_;
+  std::condition_variable wakeup_;
+  bool stopping_{false};
+
+  std::vector<std::thread> threads_;
+};
+
+} // namespace eden
+} // namespace facebook
@@ -0,0 +1,88 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/Cancellation.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::eden;
+
+TEST(Cancellation, defaultTokenIsNeverCancelled) {
+  CancellationToken token;
+  EXPECT_FALSE(token.canBeCancelled());
+  EXPECT_FALSE(token.isCancelled());
+  EXPECT_FALSE(CancellationToken::current().canBeCancelled());
+}
+
+TEST(Cancellation, sourceCancelsItsTokens) {
+  CancellationSource source;
+  auto token = source.getToken();
+  EXPECT_TRUE(token.canBeCancelled());
+  EXPECT_FALSE(token.isCancelled());
+  source.cancel();
+  EXPECT_TRUE(token.isCancelled());
+  EXPECT_TRUE(source.isCancelled());
+}
+
+TEST(Cancellation, scopeSetsTheCurrentToken) {
+  CancellationSource source;
+  {
+    CancellationScope scope{source.getToken()};
+    EXPECT_TRUE(CancellationToken::current().canBeCancelled());
+    {
+      CancellationScope inner{CancellationToken{}};
+      EXPECT_FALSE(CancellationToken::current().canBeCancelled());
+    }
+    source.cancel();
+    EXPECT_TRUE(CancellationToken::current().isCancelled());
+  }
+  EXPECT_FALSE(CancellationToken::current().canBeCancelled());
+}
+
+TEST(Cancellation, joinIsCancelledOnceEveryTokenIs) {
+  CancellationSource source1;
+  CancellationSource source2;
+  CancellationJoin join{source1.getToken()};
+  EXPECT_TRUE(join.add(source2.getToken()));
+  auto token = join.getToken();
+
+  source1.cancel();
+  EXPECT_FALSE(token.isCancelled());
+  source2.cancel();
+  EXPECT_TRUE(token.isCancelled());
+}
+
+TEST(Cancellation, joinCanBeRevivedUntilItIsObservedCancelled) {
+  CancellationSource source1;
+  CancellationSource source2;
+  CancellationJoin join{source1.getToken()};
+  source1.cancel();
+  EXPECT_TRUE(join.add(source2.getToken()));
+  EXPECT_FALSE(join.getToken().isCancelled());
+
+  source2.cancel();
+  EXPECT_TRUE(join.getToken().isCancelled());
+  CancellationSource source3;
+  EXPECT_FALSE(join.add(source3.getToken()));
+  EXPECT_TRUE(join.getToken().isCancelled());
+}
+
+TEST(Cancellation, uncancellableWaiterKeepsTheJoin) {
+  CancellationSource source;
+  CancellationJoin join{source.getToken()};
+  EXPECT_TRUE(join.add(CancellationToken{}));
+  source.cancel();
+  EXPECT_FALSE(join.getToken().isCancelled());
+}
+
+TEST(Cancellation, emptyJoinRefusesWaiters) {
+  CancellationJoin join;
+  EXPECT_FALSE(join.add(CancellationToken{}));
+  EXPECT_FALSE(join.getToken().canBeCancelled());
+}
@@ -0,0 +1,40 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/CycleClock.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace facebook::eden;
+using namespace std::chrono;
+
+TEST(CycleClock, measuresTheSameIntervalsAsTheSteadyClock) {
+  auto startTime = steady_clock::now();
+  auto startTicks = CycleClock::now();
+  std::this_thread::sleep_for(milliseconds{50});
+  auto endTicks = CycleClock::now();
+  auto steadyElapsed = steady_clock::now() - startTime;
+
+  auto elapsed = CycleClock::elapsed(startTicks, endTicks);
+  EXPECT_GE(elapsed, milliseconds{49});
+  EXPECT_LE(elapsed, steadyElapsed + milliseconds{1});
+}
+
+TEST(CycleClock, reversedTicksAreNoTime) {
+  auto ticks = CycleClock::now();
+  EXPECT_EQ(nanoseconds{0}, CycleClock::elapsed(ticks + 1000, ticks));
+}
+
+TEST(CycleClock, coarseTimeIsCloseToTheSteadyClock) {
+  auto coarse = CycleClock::coarseSteadyNow();
+  auto steady = steady_clock::now();
+  EXPECT_LE(coarse, steady);
+  EXPECT_LT(steady - coarse, milliseconds{100});
+}
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/futures/Future.h>
+#include <folly/init/Init.h>
+#include <folly/stop_watch.h>
+#include <gflags/gflags.h>
+#include <atomic>
+#include "eden/fs/utils/UnboundedQueueExecutor.h"
+
+using namespace facebook::eden;
+using folly::Future;
+using folly::Unit;
+
+DEFINE_int32(threads, 8, "Number of threads in each executor");
+DEFINE_int32(depth, 6, "Depth of the tree walked by the diff workload");
+DEFINE_int32(fanout, 8, "Children per directory in the diff workload");
+DEFINE_int32(tasks, 1000000, "Number of tasks in the glob workload");
+
+namespace {
+
+/**
+ * Walk a synthetic tree the way TreeInode::diff() does, with each directory
+ * scheduling a future per child and collecting their results.
+ */
+Future<Unit> walkTree(UnboundedQueueExecutor* executor, int depth) {
+  if (depth == 0) {
+    return folly::makeFuture();
+  }
+  std::vector<Future<Unit>> children;
+  children.reserve(FLAGS_fanout);
+  for (int n = 0; n < FLAGS_fanout; ++n) {
+    children.push_back(folly::via(executor).then(
+        [executor, depth] { return walkTree(executor, depth - 1); }));
+  }
+  return folly::collectAll(children).unit();
+}
+
+void benchmarkDiff(UnboundedQueueExecutor* executor) {
+  folly::stop_watch<> timer;
+  folly::via(executor)
+      .then([executor] { return walkTree(executor, FLAGS_depth); })
+      .get();
+  printf(
+      "  diff: %.2f ms\n",
+      std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+          timer.elapsed())
+          .count());
+}
+
+/**
+ * Queue a burst of tiny tasks from outside the pool, as a glob of a large
+ * directory does when it matches each entry.
+ */
+void benchmarkGlob(UnboundedQueueExecutor* executor) {
+  std::atomic<int> remaining{FLAGS_tasks};
+  folly::Promise<Unit> promise;
+  auto done = promise.getFuture();
+
+  folly::stop_watch<> timer;
+  for (int n = 0; n < FLAGS_tasks; ++n) {
+    executor->add([&] {
+      if (--remaining == 0) {
+        promise.setValue();
+      }
+    });
+  }
+  std::move(done).get();
+  printf(
+      "  glob: %.2f ms\n",
+      std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+          timer.elapsed())
+          .count());
+}
+
+void benchmark(const char* name, UnboundedQueueExecutor::QueueType type) {
+  UnboundedQueueExecutor executor{
+      static_cast<size_t>(FLAGS_threads), "BenchThread", type};
+  printf("%s:\n", name);
+  benchmarkDiff(&executor);
+  benchmarkGlob(&executor);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+
+  if (FLAGS_threads <= 0 || FLAGS_depth <= 0 || FLAGS_fanout <= 0 ||
+      FLAGS_tasks <= 0) {
+    fprintf(stderr, "error: all parameters must be positive\n");
+    return 1;
+  }
+
+  benchmark("shared queue", UnboundedQueueExecutor::QueueType::Shared);
+  benchmark("work stealing", UnboundedQueueExecutor::QueueType::WorkStealing);
+
+  return 0;
+}
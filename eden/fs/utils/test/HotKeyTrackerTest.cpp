@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/HotKeyTracker.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace facebook::eden;
+
+TEST(HotKeyTracker, emptyTrackerHasNoKeys) {
+  HotKeyTracker<uint64_t> tracker;
+  EXPECT_TRUE(tracker.getTop(10).empty());
+}
+
+TEST(HotKeyTracker, bufferedAccessesAreReported) {
+  HotKeyTracker<uint64_t> tracker;
+  tracker.record(1, true);
+  tracker.record(1, false);
+  tracker.record(1, true);
+  tracker.record(2, false);
+
+  auto top = tracker.getTop(10);
+  ASSERT_EQ(2, top.size());
+  EXPECT_EQ(1, top[0].key);
+  EXPECT_EQ(3, top[0].accesses);
+  EXPECT_EQ(2, top[0].hits);
+  EXPECT_EQ(1, top[0].misses);
+  EXPECT_EQ(2, top[1].key);
+  EXPECT_EQ(1, top[1].accesses);
+  EXPECT_EQ(0, top[1].hits);
+  EXPECT_EQ(1, top[1].misses);
+
+  EXPECT_EQ(1, tracker.getTop(1).size());
+}
+
+TEST(HotKeyTracker, hotKeysDisplaceColdOnes) {
+  HotKeyTracker<uint64_t> tracker{3};
+  for (uint64_t key = 100; key < 1100; ++key) {
+    tracker.record(key, true);
+  }
+  for (int n = 0; n < 50; ++n) {
+    tracker.record(1, true);
+    tracker.record(2, false);
+    tracker.record(3, true);
+  }
+
+  auto top = tracker.getTop(3);
+  ASSERT_EQ(3, top.size());
+  std::vector<uint64_t> keys;
+  for (const auto& entry : top) {
+    keys.push_back(entry.key);
+    EXPECT_LE(50, entry.accesses);
+  }
+  std::sort(keys.begin(), keys.end());
+  EXPECT_EQ((std::vector<uint64_t>{1, 2, 3}), keys);
+}
+
+TEST(HotKeyTracker, fullBuffersOfExitedThreadsAreKept) {
+  HotKeyTracker<uint64_t> tracker;
+  // A thread's buffer is added to the sketch whenever it fills up, so at
+  // most the last partial buffer is lost when the thread exits.
+  std::thread thread{[&] {
+    for (int n = 0; n < 100; ++n) {
+      tracker.record(7, false);
+    }
+  }};
+  thread.join();
+
+  auto top = tracker.getTop(10);
+  ASSERT_EQ(1, top.size());
+  EXPECT_EQ(7, top[0].key);
+  EXPECT_LE(64, top[0].misses);
+  EXPECT_EQ(0, top[0].hits);
+}
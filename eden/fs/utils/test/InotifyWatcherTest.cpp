@@ -0,0 +1,137 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/InotifyWatcher.h"
+
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+
+using namespace facebook::eden;
+using namespace std::chrono_literals;
+using folly::test::TemporaryDirectory;
+
+namespace {
+/**
+ * inotify events are delivered asynchronously, so wait a little while for
+ * the watch to see a change.
+ */
+bool waitForChange(const InotifyWatcher::Watch& watch, uint64_t generation) {
+  const auto deadline = std::chrono::steady_clock::now() + 5s;
+  while (watch.getGeneration() == generation) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    /* sleep override */ std::this_thread::sleep_for(1ms);
+  }
+  return true;
+}
+
+class InotifyWatcherTest : public ::testing::Test {
+ protected:
+  AbsolutePath getPath(folly::StringPiece name) {
+    return AbsolutePath{(testDir_.path() / name.str()).string()};
+  }
+
+  TemporaryDirectory testDir_{"eden_inotify_test"};
+};
+} // namespace
+
+TEST_F(InotifyWatcherTest, reportsWritesToWatchedFile) {
+  auto path = getPath("config");
+  folly::writeFile(std::string{"one"}, path.c_str());
+  auto watch = InotifyWatcher::watch(path);
+  ASSERT_TRUE(watch);
+  EXPECT_TRUE(watch->isActive());
+
+  auto generation = watch->getGeneration();
+  folly::writeFile(std::string{"two"}, path.c_str());
+  EXPECT_TRUE(waitForChange(*watch, generation));
+}
+
+TEST_F(InotifyWatcherTest, reportsAtomicReplacement) {
+  auto path = getPath("config");
+  folly::writeFileAtomic(path.value(), "one");
+  auto watch = InotifyWatcher::watch(path);
+  ASSERT_TRUE(watch);
+
+  auto generation = watch->getGeneration();
+  folly::writeFileAtomic(path.value(), "two");
+  EXPECT_TRUE(waitForChange(*watch, generation));
+
+  // The replacement is watched too.
+  generation = watch->getGeneration();
+  folly::writeFileAtomic(path.value(), "three");
+  EXPECT_TRUE(waitForChange(*watch, generation));
+}
+
+TEST_F(InotifyWatcherTest, reportsCreationAndRemoval) {
+  auto path = getPath("config");
+  auto watch = InotifyWatcher::watch(path);
+  ASSERT_TRUE(watch);
+
+  auto generation = watch->getGeneration();
+  folly::writeFile(std::string{"one"}, path.c_str());
+  EXPECT_TRUE(waitForChange(*watch, generation));
+
+  generation = watch->getGeneration();
+  ASSERT_EQ(0, unlink(path.c_str()));
+  EXPECT_TRUE(waitForChange(*watch, generation));
+}
+
+TEST_F(InotifyWatcherTest, ignoresOtherFilesInDirectory) {
+  auto path = getPath("config");
+  folly::writeFile(std::string{"one"}, path.c_str());
+  auto watch = InotifyWatcher::watch(path);
+  ASSERT_TRUE(watch);
+
+  auto generation = watch->getGeneration();
+  folly::writeFile(std::string{"other"}, getPath("other").c_str());
+  /* sleep override */ std::this_thread::sleep_for(50ms);
+  EXPECT_EQ(generation, watch->getGeneration());
+}
+
+TEST_F(InotifyWatcherTest, watchingAPathTwiceSharesTheWatch) {
+  auto path = getPath("config");
+  EXPECT_EQ(InotifyWatcher::watch(path), InotifyWatcher::watch(path));
+}
+
+TEST_F(InotifyWatcherTest, cannotWatchFileInMissingDirectory) {
+  EXPECT_FALSE(InotifyWatcher::watch(getPath("missing/config")));
+
+  // Without a watch, the tracker always says to check the file.
+  InotifyChangeTracker tracker{getPath("missing/config")};
+  tracker.markChecked();
+  EXPECT_TRUE(tracker.mayHaveChanged());
+}
+
+TEST_F(InotifyWatcherTest, trackerReportsEachChangeOnce) {
+  auto path = getPath("config");
+  folly::writeFile(std::string{"one"}, path.c_str());
+  InotifyChangeTracker tracker{path};
+  EXPECT_TRUE(tracker.mayHaveChanged());
+  tracker.markChecked();
+  EXPECT_FALSE(tracker.mayHaveChanged());
+
+  folly::writeFile(std::string{"two"}, path.c_str());
+  const auto deadline = std::chrono::steady_clock::now() + 5s;
+  while (!tracker.mayHaveChanged() &&
+         std::chrono::steady_clock::now() < deadline) {
+    /* sleep override */ std::this_thread::sleep_for(1ms);
+  }
+  EXPECT_TRUE(tracker.mayHaveChanged());
+  tracker.markChecked();
+  EXPECT_FALSE(tracker.mayHaveChanged());
+
+  tracker.reset();
+  EXPECT_TRUE(tracker.mayHaveChanged());
+}
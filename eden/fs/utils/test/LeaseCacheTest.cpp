@@ -0,0 +1,173 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/LeaseCache.h"
+
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace facebook::eden;
+using namespace std::chrono_literals;
+using Cache = LeaseCache<int, std::string>;
+
+namespace {
+/**
+ * A fetch function whose results are supplied by the test, counting how
+ * many times each key is fetched.
+ */
+struct Fetcher {
+  Cache::FutureType fetch(int key) {
+    ++fetchCount;
+    promises.emplace_back();
+    keys.push_back(key);
+    return promises.back().getFuture();
+  }
+
+  Cache::FetchFunc getFunc() {
+    return [this](const int& key) { return fetch(key); };
+  }
+
+  int fetchCount{0};
+  std::vector<int> keys;
+  std::deque<folly::Promise<Cache::ValuePtr>> promises;
+};
+
+/** A fetch function that immediately succeeds with the key as a string. */
+Cache::FetchFunc fetchToString(int* fetchCount) {
+  return [fetchCount](const int& key) {
+    ++*fetchCount;
+    return folly::makeFuture(
+        std::make_shared<std::string>(folly::to<std::string>(key)));
+  };
+}
+} // namespace
+
+TEST(LeaseCache, concurrentGetsShareOneFetch) {
+  Fetcher fetcher;
+  Cache cache{0, fetcher.getFunc()};
+
+  auto first = cache.get(1);
+  auto second = cache.get(1);
+  EXPECT_EQ(1, fetcher.fetchCount);
+  EXPECT_FALSE(first.isReady());
+
+  fetcher.promises[0].setValue(std::make_shared<std::string>("one"));
+  EXPECT_EQ("one", *std::move(first).get());
+  EXPECT_EQ("one", *std::move(second).get());
+  EXPECT_EQ("one", *cache.get(1).get());
+  EXPECT_EQ(1, fetcher.fetchCount);
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(2, stats.hitCount);
+  EXPECT_EQ(1, stats.missCount);
+  EXPECT_EQ(1, stats.objectCount);
+}
+
+TEST(LeaseCache, setAndErase) {
+  int fetchCount = 0;
+  Cache cache{0, fetchToString(&fetchCount)};
+
+  cache.set(1, std::make_shared<std::string>("one"));
+  EXPECT_TRUE(cache.exists(1));
+  EXPECT_EQ("one", *cache.get(1).get());
+  EXPECT_EQ(0, fetchCount);
+
+  cache.erase(1);
+  EXPECT_FALSE(cache.exists(1));
+  EXPECT_EQ("1", *cache.get(1).get());
+  EXPECT_EQ(1, fetchCount);
+}
+
+TEST(LeaseCache, evictsLeastRecentlyUsed) {
+  int fetchCount = 0;
+  // A single shard, so that the limit applies to every key.
+  Cache cache{2, fetchToString(&fetchCount), 1, 1};
+
+  cache.get(1).get();
+  cache.get(2).get();
+  // Use 1 again, so that 2 is the least recently used.
+  cache.get(1).get();
+  cache.get(3).get();
+
+  EXPECT_TRUE(cache.exists(1));
+  EXPECT_FALSE(cache.exists(2));
+  EXPECT_TRUE(cache.exists(3));
+  auto stats = cache.getStats();
+  EXPECT_EQ(1, stats.evictionCount);
+  EXPECT_EQ(2, stats.objectCount);
+
+  cache.setMaxSize(1);
+  EXPECT_EQ(1, cache.getStats().objectCount);
+}
+
+TEST(LeaseCache, shardedCacheStaysBounded) {
+  int fetchCount = 0;
+  Cache cache{4, fetchToString(&fetchCount), 1, 16};
+  for (int n = 0; n < 100; ++n) {
+    cache.get(n).get();
+  }
+  // Each shard holds at most one entry.
+  EXPECT_LE(cache.getStats().objectCount, 16);
+  EXPECT_EQ(100, fetchCount);
+}
+
+TEST(LeaseCache, negativeResultsAreKeptWithoutTTL) {
+  Fetcher fetcher;
+  Cache cache{0, fetcher.getFunc()};
+
+  auto result = cache.get(1);
+  fetcher.promises[0].setException(std::runtime_error("not found"));
+  EXPECT_THROW(std::move(result).get(), std::runtime_error);
+  EXPECT_THROW(cache.get(1).get(), std::runtime_error);
+  EXPECT_EQ(1, fetcher.fetchCount);
+}
+
+TEST(LeaseCache, negativeResultsExpire) {
+  Fetcher fetcher;
+  Cache cache{0, fetcher.getFunc(), 1, Cache::kDefaultNumShards, 10ms};
+
+  auto result = cache.get(1);
+  fetcher.promises[0].setException(std::runtime_error("not found"));
+  EXPECT_THROW(std::move(result).get(), std::runtime_error);
+  EXPECT_THROW(cache.get(1).get(), std::runtime_error);
+  EXPECT_EQ(1, fetcher.fetchCount);
+
+  // Null values are negative results too.
+  auto nullResult = cache.get(2);
+  fetcher.promises[1].setValue(nullptr);
+  EXPECT_EQ(nullptr, std::move(nullResult).get());
+
+  // Positive results do not expire.
+  auto positive = cache.get(3);
+  fetcher.promises[2].setValue(std::make_shared<std::string>("three"));
+  EXPECT_EQ("three", *std::move(positive).get());
+
+  /* sleep override */ std::this_thread::sleep_for(20ms);
+  auto refetched = cache.get(1);
+  cache.get(2);
+  EXPECT_EQ("three", *cache.get(3).get());
+  EXPECT_EQ(5, fetcher.fetchCount);
+  EXPECT_EQ(std::vector<int>({1, 2, 3, 1, 2}), fetcher.keys);
+  EXPECT_EQ(2, cache.getStats().expirationCount);
+
+  fetcher.promises[3].setValue(std::make_shared<std::string>("one"));
+  EXPECT_EQ("one", *std::move(refetched).get());
+}
+
+TEST(LeaseCache, fetchThatThrowsFailsTheGet) {
+  Cache cache{0, [](const int&) -> Cache::FutureType {
+                throw std::runtime_error("fetch failed");
+              }};
+  EXPECT_THROW(cache.get(1).get(), std::runtime_error);
+}
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/LockProfiler.h"
+#include <folly/Synchronized.h>
+#include <gtest/gtest.h>
+#include "common/stats/ServiceData.h"
+
+using namespace facebook::eden;
+using facebook::stats::ServiceData;
+
+namespace {
+struct DisabledLockName {
+  static folly::StringPiece name() {
+    return "disabled_test";
+  }
+};
+
+struct SampledLockName {
+  static folly::StringPiece name() {
+    return "sampled_test";
+  }
+};
+
+int64_t getCounter(const std::string& name) {
+  auto counters = ServiceData::get()->getCounters();
+  auto it = counters.find(name);
+  return it == counters.end() ? -1 : it->second;
+}
+
+class LockProfilerTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    LockProfiler::setSampleRate(0);
+  }
+};
+} // namespace
+
+TEST_F(LockProfilerTest, nothingIsRecordedWhileDisabled) {
+  LockProfiler::setSampleRate(0);
+  folly::Synchronized<int, ProfiledSharedMutex<DisabledLockName>> value{0};
+  for (int n = 0; n < 10; ++n) {
+    ++*value.wlock();
+    EXPECT_EQ(n + 1, *value.rlock());
+  }
+  EXPECT_EQ(-1, getCounter("lock.disabled_test.wait_us.count"));
+  EXPECT_EQ(-1, getCounter("lock.disabled_test.hold_us.count"));
+}
+
+TEST_F(LockProfilerTest, sampledAcquisitionsAreRecorded) {
+  // Every other acquisition by this thread is sampled.
+  LockProfiler::setSampleRate(2);
+  folly::Synchronized<int, ProfiledSharedMutex<SampledLockName>> value{0};
+  for (int n = 0; n < 10; ++n) {
+    ++*value.wlock();
+  }
+  EXPECT_EQ(5, getCounter("lock.sampled_test.wait_us.count"));
+  EXPECT_EQ(5, getCounter("lock.sampled_test.hold_us.count"));
+
+  // Shared acquisitions only record how long they waited.
+  for (int n = 0; n < 10; ++n) {
+    EXPECT_EQ(10, *value.rlock());
+  }
+  EXPECT_EQ(10, getCounter("lock.sampled_test.wait_us.count"));
+  EXPECT_EQ(5, getCounter("lock.sampled_test.hold_us.count"));
+
+  // Turning profiling off at runtime stops recording.
+  LockProfiler::setSampleRate(0);
+  for (int n = 0; n < 10; ++n) {
+    ++*value.wlock();
+  }
+  EXPECT_EQ(10, getCounter("lock.sampled_test.wait_us.count"));
+}
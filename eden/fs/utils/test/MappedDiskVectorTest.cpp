@@ -14,6 +14,7 @@
 #include <gtest/gtest.h>
 
 using facebook::eden::MappedDiskVector;
+using facebook::eden::MappedDiskVectorOptions;
 using folly::test::TemporaryDirectory;
 
 TEST(MappedDiskVector, roundUpToNonzeroPageSize) {
@@ -81,6 +82,46 @@ TEST_F(MappedDiskVectorTest, remembers_contents_on_reopen) {
   EXPECT_EQ(35, mdv[2]);
 }
 
+TEST_F(MappedDiskVectorTest, grows_in_place_within_reserved_address_space) {
+  constexpr uint64_t N = 1000000;
+  {
+    MappedDiskVectorOptions options;
+    options.addressSpaceReservation = 64 << 20;
+    options.hugePages = true;
+    auto mdv = MappedDiskVector<U64>::open(mdvPath, options);
+    mdv.emplace_back(0ull);
+    auto* first = &mdv[0];
+
+    for (uint64_t i = 1; i < N; ++i) {
+      mdv.emplace_back(i);
+    }
+    EXPECT_EQ(first, &mdv[0]);
+    EXPECT_EQ(N - 1, mdv[N - 1]);
+    mdv.flushAsync();
+  }
+
+  // Records written through the extended mapping are persisted.
+  auto mdv = MappedDiskVector<U64>::open(mdvPath);
+  ASSERT_EQ(N, mdv.size());
+  EXPECT_EQ(N - 1, mdv[N - 1]);
+}
+
+TEST_F(MappedDiskVectorTest, grows_past_reserved_address_space) {
+  MappedDiskVectorOptions options;
+  options.addressSpaceReservation = 2 << 20;
+  auto mdv = MappedDiskVector<U64>::open(mdvPath, options);
+
+  // 8 MB, well past the reservation.
+  constexpr uint64_t N = 1000000;
+  for (uint64_t i = 0; i < N; ++i) {
+    mdv.emplace_back(i);
+  }
+  ASSERT_EQ(N, mdv.size());
+  for (uint64_t i = 0; i < N; i += 1000) {
+    EXPECT_EQ(i, mdv[i]);
+  }
+}
+
 TEST_F(MappedDiskVectorTest, pop_back) {
   auto mdv = MappedDiskVector<U64>::open(mdvPath);
   mdv.emplace_back(1ull);
@@ -92,6 +133,43 @@ TEST_F(MappedDiskVectorTest, pop_back) {
   EXPECT_EQ(3, mdv[1]);
 }
 
+TEST_F(MappedDiskVectorTest, releases_and_reuses_unused_capacity) {
+  auto mdv = MappedDiskVector<U64>::open(mdvPath);
+  constexpr uint64_t N = 1000000;
+  for (uint64_t i = 0; i < N; ++i) {
+    mdv.emplace_back(i);
+  }
+  auto capacity = mdv.capacity();
+  mdv.truncate(10);
+  EXPECT_EQ(10, mdv.size());
+
+  struct stat before;
+  ASSERT_EQ(0, stat(mdvPath.c_str(), &before));
+  auto released = mdv.releaseUnusedCapacity();
+  if (released == 0) {
+    // The filesystem cannot punch holes.
+    EXPECT_EQ(capacity, mdv.backedCapacity());
+  } else {
+    struct stat after;
+    ASSERT_EQ(0, stat(mdvPath.c_str(), &after));
+    EXPECT_EQ(before.st_size, after.st_size);
+    EXPECT_LT(after.st_blocks, before.st_blocks);
+    EXPECT_LT(mdv.backedCapacity(), capacity);
+  }
+  EXPECT_EQ(capacity, mdv.capacity());
+  EXPECT_EQ(0, mdv.releaseUnusedCapacity());
+
+  // The released capacity is filled again without growing the file.
+  for (uint64_t i = 10; i < N; ++i) {
+    mdv.emplace_back(i);
+  }
+  EXPECT_EQ(capacity, mdv.capacity());
+  EXPECT_GE(mdv.backedCapacity(), N);
+  for (uint64_t i = 0; i < N; i += 1000) {
+    EXPECT_EQ(i, mdv[i]);
+  }
+}
+
 namespace {
 struct Small {
   enum { VERSION = 0 };
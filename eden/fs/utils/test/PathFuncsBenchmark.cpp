@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <folly/stop_watch.h>
+#include <gflags/gflags.h>
+#include <string>
+#include <vector>
+#include "eden/fs/utils/PathFuncs.h"
+
+using namespace facebook::eden;
+
+DEFINE_int32(iterations, 1000000, "Number of times each path is processed");
+DEFINE_int32(depth, 12, "Number of components in the paths processed");
+DEFINE_int32(length, 16, "Length of each path component");
+
+namespace {
+
+std::string makePath() {
+  std::string path;
+  for (int n = 0; n < FLAGS_depth; ++n) {
+    if (n != 0) {
+      path.push_back('/');
+    }
+    auto component = folly::to<std::string>("dir", n);
+    component.resize(FLAGS_length, 'x');
+    path.append(component);
+  }
+  return path;
+}
+
+template <typename Func>
+void benchmark(const char* name, Func&& func) {
+  size_t checksum = 0;
+  folly::stop_watch<> timer;
+  for (int n = 0; n < FLAGS_iterations; ++n) {
+    checksum += func();
+  }
+  printf(
+      "  %s: %.2f ns/iteration (%zu)\n",
+      name,
+      std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(
+          timer.elapsed())
+              .count() /
+          FLAGS_iterations,
+      checksum);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+
+  if (FLAGS_iterations <= 0 || FLAGS_depth <= 0 || FLAGS_length < 8) {
+    fprintf(
+        stderr,
+        "error: iterations and depth must be positive, "
+        "and length at least 8\n");
+    return 1;
+  }
+
+  const auto pathStr = makePath();
+  const RelativePathPiece path{pathStr};
+  const auto name = path.basename().stringPiece().str();
+  printf("%zu byte path with %d components:\n", pathStr.size(), FLAGS_depth);
+
+  benchmark("PathComponentPiece", [&] {
+    return PathComponentPiece{name}.stringPiece().size();
+  });
+  benchmark("RelativePathPiece", [&] {
+    return RelativePathPiece{pathStr}.stringPiece().size();
+  });
+  benchmark("basename", [&] { return path.basename().stringPiece().size(); });
+  benchmark("dirname", [&] { return path.dirname().stringPiece().size(); });
+  benchmark("forward paths", [&] {
+    size_t total = 0;
+    for (auto parent : path.paths()) {
+      total += parent.stringPiece().size();
+    }
+    return total;
+  });
+  benchmark("reverse paths", [&] {
+    size_t total = 0;
+    for (auto parent : path.rpaths()) {
+      total += parent.stringPiece().size();
+    }
+    return total;
+  });
+  benchmark("reverse suffixes", [&] {
+    size_t total = 0;
+    for (auto suffix : path.rsuffixes()) {
+      total += suffix.stringPiece().size();
+    }
+    return total;
+  });
+
+  return 0;
+}
@@ -436,6 +436,9 @@ TEST(PathFuncs, dirname) {
   EXPECT_EQ("foo/bar", dirname("foo/bar/baz"));
   EXPECT_EQ("foo", dirname("foo/bar"));
   EXPECT_EQ("", dirname("foo"));
+  EXPECT_EQ("", dirname(""));
+  EXPECT_EQ("", dirname("/foo"));
+  EXPECT_EQ("foo", dirname("foo/"));
 }
 
 TEST(PathFuncs, basename) {
@@ -446,6 +449,17 @@ TEST(PathFuncs, basename) {
   EXPECT_EQ("baz", basename(StringPiece("foo/bar/baz")));
   EXPECT_EQ("bar", basename(StringPiece("foo/bar")));
   EXPECT_EQ("foo", basename(StringPiece("foo")));
+  EXPECT_EQ("", basename(StringPiece("")));
+  EXPECT_EQ("foo", basename(StringPiece("/foo")));
+  EXPECT_EQ("", basename(StringPiece("foo/")));
+}
+
+TEST(PathFuncs, skipSanityCheckFromMovedString) {
+  // Trusted callers may build a path from a string they own without paying
+  // for the check.
+  std::string name{"foo"};
+  PathComponent comp{std::move(name), detail::SkipPathSanityCheck()};
+  EXPECT_EQ("foo", comp.stringPiece());
 }
 
 TEST(PathFuncs, isSubDir) {
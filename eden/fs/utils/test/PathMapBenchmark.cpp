@@ -0,0 +1,119 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <folly/stop_watch.h>
+#include <gflags/gflags.h>
+#include <string>
+#include <vector>
+#include "eden/fs/utils/PathMap.h"
+
+using namespace facebook::eden;
+
+DEFINE_int32(lookups, 10000000, "Number of lookups for each directory size");
+
+namespace {
+
+/**
+ * Directory sizes to measure, and the fraction of directories of roughly
+ * that size in a large source tree.  Most directories hold a handful of
+ * entries; a few hold thousands.
+ */
+struct DirSize {
+  int entries;
+  double weight;
+};
+constexpr DirSize kDirSizes[] = {
+    {1, 0.20},
+    {2, 0.15},
+    {3, 0.12},
+    {5, 0.15},
+    {8, 0.12},
+    {12, 0.09},
+    {20, 0.07},
+    {50, 0.06},
+    {200, 0.03},
+    {2000, 0.01},
+};
+
+std::vector<std::string> makeNames(int count) {
+  std::vector<std::string> names;
+  for (int n = 0; n < count; ++n) {
+    names.push_back(folly::to<std::string>("source_file_", n, ".cpp"));
+  }
+  return names;
+}
+
+/**
+ * Returns the nanoseconds per lookup, looking up each name in turn, with
+ * every fourth lookup a miss.
+ */
+template <typename Func>
+double timeLookups(const std::vector<std::string>& names, Func&& func) {
+  std::vector<PathComponent> keys;
+  for (size_t n = 0; n < names.size(); ++n) {
+    if (n % 4 == 3) {
+      keys.emplace_back(folly::to<std::string>("missing_file_", n, ".cpp"));
+    } else {
+      keys.emplace_back(names[n]);
+    }
+  }
+
+  size_t found = 0;
+  folly::stop_watch<> timer;
+  for (int n = 0; n < FLAGS_lookups; ++n) {
+    found += func(keys[n % keys.size()]);
+  }
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(
+          timer.elapsed())
+          .count();
+  if (found == 0) {
+    fprintf(stderr, "error: no lookups succeeded\n");
+  }
+  return elapsed / FLAGS_lookups;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+
+  if (FLAGS_lookups <= 0) {
+    fprintf(stderr, "error: lookups must be positive\n");
+    return 1;
+  }
+
+  double weightedFind = 0;
+  double weightedBinarySearch = 0;
+  printf("entries   find   binary search (ns/lookup)\n");
+  for (const auto& dirSize : kDirSizes) {
+    auto names = makeNames(dirSize.entries);
+    PathMap<int> map;
+    for (const auto& name : names) {
+      map.emplace(PathComponentPiece{name}, 0);
+    }
+
+    auto find = timeLookups(names, [&](const PathComponent& key) {
+      return map.find(key) != map.end();
+    });
+    // What find() did before it scanned small maps.
+    auto binarySearch = timeLookups(names, [&](const PathComponent& key) {
+      auto iter = map.lower_bound(key);
+      return iter != map.end() && iter->first == key;
+    });
+    printf("%7d %6.2f %15.2f\n", dirSize.entries, find, binarySearch);
+    weightedFind += dirSize.weight * find;
+    weightedBinarySearch += dirSize.weight * binarySearch;
+  }
+  printf("weighted %5.2f %15.2f\n", weightedFind, weightedBinarySearch);
+
+  return 0;
+}
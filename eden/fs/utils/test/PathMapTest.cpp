@@ -8,6 +8,7 @@
  *
  */
 #include "eden/fs/utils/PathMap.h"
+#include <folly/Conv.h>
 #include <gtest/gtest.h>
 
 using facebook::eden::PathComponent;
@@ -128,6 +129,25 @@ TEST(PathMap, emplace) {
   EXPECT_TRUE(map.at("one"_pc).dummy) << "didn't change value to false";
 }
 
+TEST(PathMap, insertInAndOutOfOrder) {
+  PathMap<int> map;
+  map.reserve(4);
+  auto capacity = map.capacity();
+  EXPECT_TRUE(map.emplace("b"_pc, 2).second);
+  EXPECT_TRUE(map.emplace("d"_pc, 4).second);
+  EXPECT_FALSE(map.emplace("d"_pc, 5).second) << "appending a duplicate";
+  EXPECT_TRUE(map.emplace("a"_pc, 1).second);
+  EXPECT_TRUE(map.insert(std::make_pair(PathComponent("c"), 3)).second);
+  EXPECT_EQ(capacity, map.capacity()) << "reserved capacity was enough";
+
+  std::vector<int> values;
+  for (const auto& entry : map) {
+    values.push_back(entry.second);
+  }
+  EXPECT_EQ((std::vector<int>{1, 2, 3, 4}), values);
+  EXPECT_EQ(4, map.at("d"_pc));
+}
+
 TEST(PathMap, swap) {
   PathMap<std::string> b, a{std::make_pair(PathComponent("foo"), "foo")};
 
@@ -141,3 +161,27 @@ TEST(PathMap, swap) {
   EXPECT_EQ(0, b.size()) << "b now has 0 elements";
   EXPECT_EQ("foo", a.at("foo"_pc));
 }
+
+TEST(PathMap, findInSmallAndLargeMaps) {
+  // Small maps are scanned linearly and large ones binary searched, so check
+  // sizes on both sides of the cutoff.
+  for (int size = 0; size < 40; ++size) {
+    PathMap<int> map;
+    for (int n = 0; n < size; ++n) {
+      map.emplace(PathComponentPiece{folly::to<std::string>("file", n)}, n);
+    }
+    for (int n = 0; n < size; ++n) {
+      auto name = folly::to<std::string>("file", n);
+      auto iter = map.find(PathComponentPiece{name});
+      ASSERT_NE(map.end(), iter) << name << " in map of size " << size;
+      EXPECT_EQ(n, iter->second);
+    }
+    // Misses that share a length or a first byte with the entries.
+    EXPECT_EQ(map.end(), map.find("file"_pc)) << size;
+    EXPECT_EQ(map.end(), map.find("fileX"_pc)) << size;
+    EXPECT_EQ(map.end(), map.find("xile0"_pc)) << size;
+    EXPECT_EQ(map.end(), map.find("file100"_pc)) << size;
+    const auto& cmap = map;
+    EXPECT_EQ(cmap.end(), cmap.find("file100"_pc)) << size;
+  }
+}
@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/PathPrefixFilter.h"
+#include <gtest/gtest.h>
+
+using namespace facebook::eden;
+using namespace facebook::eden::path_literals;
+
+TEST(PathPrefixFilter, emptyFilterMatchesEverything) {
+  PathPrefixFilter filter;
+  EXPECT_TRUE(filter.matchesAll());
+  EXPECT_TRUE(filter.matches("foo/bar"_relpath));
+  EXPECT_TRUE(filter.mayMatchUnder("foo"_relpath));
+
+  PathPrefixFilter rootFilter{{RelativePath{"foo"}, RelativePath{}}};
+  EXPECT_TRUE(rootFilter.matchesAll());
+}
+
+TEST(PathPrefixFilter, matchesPathsUnderPrefixes) {
+  PathPrefixFilter filter{{RelativePath{"src/lib"}, RelativePath{"docs"}}};
+  EXPECT_FALSE(filter.matchesAll());
+  EXPECT_TRUE(filter.matches("src/lib"_relpath));
+  EXPECT_TRUE(filter.matches("src/lib/a.cpp"_relpath));
+  EXPECT_TRUE(filter.matches("docs/index.md"_relpath));
+  EXPECT_FALSE(filter.matches("src"_relpath));
+  EXPECT_FALSE(filter.matches("src/library.cpp"_relpath));
+  EXPECT_FALSE(filter.matches("tools/docs"_relpath));
+}
+
+TEST(PathPrefixFilter, mayMatchUnderParentsOfPrefixes) {
+  PathPrefixFilter filter{{RelativePath{"src/lib"}}};
+  EXPECT_TRUE(filter.mayMatchUnder(RelativePathPiece{}));
+  EXPECT_TRUE(filter.mayMatchUnder("src"_relpath));
+  EXPECT_TRUE(filter.mayMatchUnder("src/lib"_relpath));
+  EXPECT_TRUE(filter.mayMatchUnder("src/lib/sub"_relpath));
+  EXPECT_FALSE(filter.mayMatchUnder("src/tools"_relpath));
+  EXPECT_FALSE(filter.mayMatchUnder("docs"_relpath));
+}
+
+TEST(PathPrefixFilter, dropsNestedPrefixes) {
+  PathPrefixFilter filter{{RelativePath{"a/b"},
+                           RelativePath{"a-c"},
+                           RelativePath{"a"},
+                           RelativePath{"a"}}};
+  ASSERT_EQ(2, filter.getPrefixes().size());
+  EXPECT_EQ("a"_relpath, filter.getPrefixes()[0]);
+  EXPECT_EQ("a-c"_relpath, filter.getPrefixes()[1]);
+}
@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/PathTable.h"
+#include <folly/Format.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace facebook::eden;
+using folly::ByteRange;
+using folly::StringPiece;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace {
+vector<pair<string, uint8_t>> readAll(const string& table) {
+  vector<pair<string, uint8_t>> out;
+  PathTableReader reader{ByteRange{StringPiece{table}}};
+  reader.forEach([&](StringPiece path, uint8_t tag) {
+    out.emplace_back(path.str(), tag);
+  });
+  EXPECT_EQ(out.size(), reader.size());
+  return out;
+}
+} // namespace
+
+TEST(PathTable, roundTrip) {
+  PathTableBuilder builder;
+  builder.add("README", 3);
+  builder.add("src/main.cpp", 1);
+  builder.add("src/main.h");
+  builder.add("src/util/strings.cpp", 2);
+  EXPECT_EQ(4, builder.size());
+  auto table = std::move(builder).finish();
+
+  vector<pair<string, uint8_t>> expected{
+      {"README", 3},
+      {"src/main.cpp", 1},
+      {"src/main.h", 0},
+      {"src/util/strings.cpp", 2},
+  };
+  EXPECT_EQ(expected, readAll(table));
+}
+
+TEST(PathTable, emptyTable) {
+  auto table = PathTableBuilder{}.finish();
+  EXPECT_TRUE(readAll(table).empty());
+  PathTableReader reader{ByteRange{StringPiece{table}}};
+  EXPECT_FALSE(reader.find("foo").hasValue());
+}
+
+TEST(PathTable, buildSortsAndDropsDuplicates) {
+  string owned = "b/two";
+  auto table = PathTableBuilder::build({
+      {"c", 1},
+      {StringPiece{owned}, 2},
+      {"a/one", 3},
+      {"c", 4},
+  });
+  vector<pair<string, uint8_t>> expected{
+      {"a/one", 3},
+      {"b/two", 2},
+      {"c", 1},
+  };
+  EXPECT_EQ(expected, readAll(table));
+}
+
+TEST(PathTable, rejectsUnsortedPaths) {
+  PathTableBuilder builder;
+  builder.add("b");
+  EXPECT_THROW(builder.add("a"), std::invalid_argument);
+  EXPECT_THROW(builder.add("b"), std::invalid_argument);
+}
+
+TEST(PathTable, findAcrossRestartPoints) {
+  PathTableBuilder builder;
+  vector<string> paths;
+  for (int n = 0; n < 100; ++n) {
+    paths.push_back(folly::sformat("dir/sub/file{:03d}", n));
+    builder.add(paths.back(), static_cast<uint8_t>(n % 4));
+  }
+  auto table = std::move(builder).finish();
+  // Sharing prefixes keeps the table well below the size of the paths.
+  EXPECT_LT(table.size(), 100 * paths[0].size() / 2);
+
+  PathTableReader reader{ByteRange{StringPiece{table}}};
+  EXPECT_EQ(100, reader.size());
+  for (int n = 0; n < 100; ++n) {
+    auto tag = reader.find(paths[n]);
+    ASSERT_TRUE(tag.hasValue()) << paths[n];
+    EXPECT_EQ(n % 4, *tag);
+  }
+  EXPECT_FALSE(reader.find("dir/sub/file").hasValue());
+  EXPECT_FALSE(reader.find("dir/sub/file0155").hasValue());
+  EXPECT_FALSE(reader.find("a").hasValue());
+  EXPECT_FALSE(reader.find("z").hasValue());
+}
+
+TEST(PathTable, rejectsCorruptData) {
+  PathTableBuilder builder;
+  builder.add("dir/a");
+  builder.add("dir/b");
+  auto table = std::move(builder).finish();
+
+  auto parse = [](const string& data) {
+    return PathTableReader{ByteRange{StringPiece{data}}};
+  };
+  EXPECT_THROW(parse(""), std::invalid_argument);
+  EXPECT_THROW(parse(table.substr(0, 5)), std::invalid_argument);
+
+  auto badVersion = table;
+  badVersion[0] = 2;
+  EXPECT_THROW(parse(badVersion), std::invalid_argument);
+
+  // Claim more paths than the table holds.
+  auto badCount = table;
+  badCount[badCount.size() - 4] = 3;
+  EXPECT_THROW(
+      parse(badCount).forEach([](StringPiece, uint8_t) {}),
+      std::invalid_argument);
+}
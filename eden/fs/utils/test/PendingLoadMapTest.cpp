@@ -0,0 +1,187 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/PendingLoadMap.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using facebook::eden::CancellationScope;
+using facebook::eden::CancellationSource;
+using facebook::eden::CancellationToken;
+using facebook::eden::PendingLoadMap;
+using folly::Future;
+using folly::Promise;
+
+TEST(PendingLoadMap, concurrentLoadsShareOneFetch) {
+  PendingLoadMap<int, std::string> map;
+  Promise<std::string> promise;
+  int numLoads = 0;
+  auto loadFn = [&] {
+    ++numLoads;
+    return promise.getFuture();
+  };
+
+  auto future1 = map.load(1, loadFn);
+  auto future2 = map.load(1, [] {
+    ADD_FAILURE() << "second load should not start a new fetch";
+    return folly::makeFuture<std::string>("unexpected");
+  });
+  EXPECT_EQ(1, numLoads);
+  EXPECT_EQ(1, map.size());
+  EXPECT_FALSE(future1.isReady());
+  EXPECT_FALSE(future2.isReady());
+
+  promise.setValue("hello");
+  ASSERT_TRUE(future1.isReady());
+  ASSERT_TRUE(future2.isReady());
+  EXPECT_EQ("hello", std::move(future1).get());
+  EXPECT_EQ("hello", std::move(future2).get());
+  EXPECT_EQ(0, map.size());
+}
+
+TEST(PendingLoadMap, differentKeysLoadIndependently) {
+  PendingLoadMap<int, std::string> map;
+  Promise<std::string> promise1;
+  Promise<std::string> promise2;
+
+  auto future1 = map.load(1, [&] { return promise1.getFuture(); });
+  auto future2 = map.load(2, [&] { return promise2.getFuture(); });
+  EXPECT_EQ(2, map.size());
+
+  promise2.setValue("two");
+  EXPECT_FALSE(future1.isReady());
+  EXPECT_EQ("two", std::move(future2).get());
+
+  promise1.setValue("one");
+  EXPECT_EQ("one", std::move(future1).get());
+  EXPECT_EQ(0, map.size());
+}
+
+TEST(PendingLoadMap, completedLoadsAreNotCached) {
+  PendingLoadMap<int, std::string> map;
+  int numLoads = 0;
+  auto loadFn = [&] {
+    ++numLoads;
+    return folly::makeFuture<std::string>("value");
+  };
+
+  EXPECT_EQ("value", map.load(1, loadFn).get());
+  EXPECT_EQ("value", map.load(1, loadFn).get());
+  EXPECT_EQ(2, numLoads);
+}
+
+TEST(PendingLoadMap, errorsArePropagatedToAllWaiters) {
+  PendingLoadMap<int, std::string> map;
+  Promise<std::string> promise;
+
+  auto future1 = map.load(1, [&] { return promise.getFuture(); });
+  auto future2 = map.load(1, [&] { return promise.getFuture(); });
+
+  promise.setException(std::domain_error("not found"));
+  EXPECT_THROW(std::move(future1).get(), std::domain_error);
+  EXPECT_THROW(std::move(future2).get(), std::domain_error);
+  EXPECT_EQ(0, map.size());
+}
+
+TEST(PendingLoadMap, loadFunctionExceptionsArePropagated) {
+  PendingLoadMap<int, std::string> map;
+  auto future = map.load(1, []() -> Future<std::string> {
+    throw std::runtime_error("failed to start load");
+  });
+  EXPECT_THROW(std::move(future).get(), std::runtime_error);
+  EXPECT_EQ(0, map.size());
+}
+
+TEST(PendingLoadMap, loadIsOnlyCancelledOnceAllWaitersAre) {
+  PendingLoadMap<int, std::string> map;
+  Promise<std::string> promise;
+  CancellationToken loadToken;
+  auto loadFn = [&] {
+    loadToken = CancellationToken::current();
+    return promise.getFuture();
+  };
+
+  CancellationSource source1;
+  CancellationSource source2;
+  auto future1 = [&] {
+    CancellationScope scope{source1.getToken()};
+    return map.load(1, loadFn);
+  }();
+  auto future2 = [&] {
+    CancellationScope scope{source2.getToken()};
+    return map.load(1, loadFn);
+  }();
+  ASSERT_TRUE(loadToken.canBeCancelled());
+
+  source1.cancel();
+  EXPECT_FALSE(loadToken.isCancelled());
+  source2.cancel();
+  EXPECT_TRUE(loadToken.isCancelled());
+
+  promise.setException(folly::FutureCancellation{});
+  EXPECT_THROW(std::move(future1).get(), folly::FutureCancellation);
+  EXPECT_THROW(std::move(future2).get(), folly::FutureCancellation);
+  EXPECT_EQ(0, map.size());
+}
+
+TEST(PendingLoadMap, uncancellableWaitersKeepTheLoad) {
+  PendingLoadMap<int, std::string> map;
+  Promise<std::string> promise;
+  CancellationToken loadToken;
+
+  CancellationSource source;
+  auto future1 = [&] {
+    CancellationScope scope{source.getToken()};
+    return map.load(1, [&] {
+      loadToken = CancellationToken::current();
+      return promise.getFuture();
+    });
+  }();
+  auto future2 = map.load(1, [&] { return promise.getFuture(); });
+
+  source.cancel();
+  EXPECT_FALSE(loadToken.isCancelled());
+  promise.setValue("kept");
+  EXPECT_EQ("kept", std::move(future2).get());
+}
+
+TEST(PendingLoadMap, waitersAfterCancellationStartANewLoad) {
+  PendingLoadMap<int, std::string> map;
+  Promise<std::string> promise1;
+  Promise<std::string> promise2;
+  CancellationToken loadToken;
+
+  CancellationSource source1;
+  auto future1 = [&] {
+    CancellationScope scope{source1.getToken()};
+    return map.load(1, [&] {
+      loadToken = CancellationToken::current();
+      return promise1.getFuture();
+    });
+  }();
+  source1.cancel();
+  EXPECT_TRUE(loadToken.isCancelled());
+
+  CancellationSource source2;
+  auto future2 = [&] {
+    CancellationScope scope{source2.getToken()};
+    return map.load(1, [&] { return promise2.getFuture(); });
+  }();
+  EXPECT_EQ(1, map.size());
+
+  // The dropped load finishing must not remove its replacement.
+  promise1.setException(folly::FutureCancellation{});
+  EXPECT_THROW(std::move(future1).get(), folly::FutureCancellation);
+  EXPECT_EQ(1, map.size());
+
+  promise2.setValue("reloaded");
+  EXPECT_EQ("reloaded", std::move(future2).get());
+  EXPECT_EQ(0, map.size());
+}
@@ -12,6 +12,7 @@
 #include <eden/fs/utils/PathFuncs.h>
 #include <folly/ExceptionWrapper.h>
 #include <gtest/gtest.h>
+#include <unistd.h>
 #include <fstream>
 
 using namespace facebook::eden;
@@ -149,3 +150,8 @@ TEST(proc_util, noProcSmapsNoThrow) {
   auto privateBytes = proc_util::calculatePrivateBytes(smapsListOfMaps).value();
   EXPECT_EQ(privateBytes, 0);
 }
+
+TEST(proc_util, readProcessName) {
+  EXPECT_FALSE(proc_util::readProcessName(getpid()).empty());
+  EXPECT_EQ("", proc_util::readProcessName(-1));
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/ProcessAccessLog.h"
+
+#include <folly/io/async/Request.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+using namespace facebook::eden;
+
+TEST(ProcessAccessLog, countsAreKeptByProcessAndName) {
+  ProcessAccessLog log;
+  auto pid = getpid();
+  log.recordFuseRequest(pid);
+  log.recordFuseRequest(pid);
+  log.recordTreeFetch(pid);
+  log.recordBlobFetch(pid, 100);
+
+  auto processes = log.getTopProcesses(10);
+  ASSERT_EQ(1, processes.size());
+  EXPECT_EQ(pid, processes[0].pid);
+  EXPECT_FALSE(processes[0].name.empty());
+  EXPECT_EQ(2, processes[0].fuseRequests);
+  EXPECT_EQ(1, processes[0].treeFetches);
+  EXPECT_EQ(1, processes[0].blobFetches);
+  EXPECT_EQ(100, processes[0].fetchedBytes);
+
+  auto names = log.getTopProcessNames(10);
+  ASSERT_EQ(1, names.size());
+  EXPECT_EQ(0, names[0].pid);
+  EXPECT_EQ(processes[0].name, names[0].name);
+  EXPECT_EQ(2, names[0].fuseRequests);
+  EXPECT_EQ(100, names[0].fetchedBytes);
+}
+
+TEST(ProcessAccessLog, processesAreRankedByFetchesThenRequests) {
+  ProcessAccessLog log;
+  // Nothing runs with these pids, so none of them have names.
+  const pid_t busy = 0x7ffffff0;
+  const pid_t fetching = 0x7ffffff1;
+  const pid_t idle = 0x7ffffff2;
+  for (int n = 0; n < 10; ++n) {
+    log.recordFuseRequest(busy);
+  }
+  log.recordFuseRequest(fetching);
+  log.recordBlobFetch(fetching, 10);
+  log.recordFuseRequest(idle);
+
+  auto processes = log.getTopProcesses(2);
+  ASSERT_EQ(2, processes.size());
+  EXPECT_EQ(fetching, processes[0].pid);
+  EXPECT_EQ(busy, processes[1].pid);
+  EXPECT_TRUE(log.getTopProcessNames(10).empty());
+}
+
+TEST(ProcessAccessLog, leastActiveProcessIsEvictedWhenFull) {
+  ProcessAccessLog log{2};
+  log.recordTreeFetch(0x7ffffff0);
+  log.recordFuseRequest(0x7ffffff1);
+  log.recordFuseRequest(0x7ffffff2);
+
+  auto processes = log.getTopProcesses(10);
+  ASSERT_EQ(2, processes.size());
+  EXPECT_EQ(0x7ffffff0, processes[0].pid);
+  EXPECT_EQ(0x7ffffff2, processes[1].pid);
+}
+
+TEST(ProcessAccessLog, fetchesAreRecordedAgainstTheCurrentRequest) {
+  auto log = std::make_shared<ProcessAccessLog>();
+
+  // Without a current process, fetches are not attributed to anyone.
+  ProcessAccessLog::recordCurrentTreeFetch();
+  EXPECT_TRUE(log->getTopProcesses(10).empty());
+
+  {
+    folly::RequestContextScopeGuard guard;
+    ProcessAccessLog::setCurrent(log, 0x7ffffff0);
+    ProcessAccessLog::recordCurrentTreeFetch();
+    ProcessAccessLog::recordCurrentBlobFetch(42);
+  }
+  ProcessAccessLog::recordCurrentBlobFetch(42);
+
+  auto processes = log->getTopProcesses(10);
+  ASSERT_EQ(1, processes.size());
+  EXPECT_EQ(0x7ffffff0, processes[0].pid);
+  EXPECT_EQ(1, processes[0].treeFetches);
+  EXPECT_EQ(1, processes[0].blobFetches);
+  EXPECT_EQ(42, processes[0].fetchedBytes);
+}
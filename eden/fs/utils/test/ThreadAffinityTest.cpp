@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/ThreadAffinity.h"
+
+#include <boost/filesystem.hpp>
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+
+using namespace facebook::eden;
+using folly::test::TemporaryDirectory;
+using std::vector;
+
+TEST(ThreadAffinity, parseCpuList) {
+  EXPECT_EQ(vector<size_t>{0}, parseCpuList("0"));
+  EXPECT_EQ((vector<size_t>{0, 1, 2, 3, 8}), parseCpuList("0-3,8"));
+  EXPECT_EQ((vector<size_t>{1, 2, 3}), parseCpuList("3,1-2,2\n"));
+
+  EXPECT_THROW(parseCpuList(""), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("1,"), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("3-1"), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("a-b"), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("-1"), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("100000"), std::invalid_argument);
+}
+
+TEST(ThreadAffinity, emptySpecLeavesThreadsUnrestricted) {
+  EXPECT_FALSE(CpuAffinity{}.isSet());
+  EXPECT_FALSE(CpuAffinity::parse("").isSet());
+}
+
+TEST(ThreadAffinity, parseNodes) {
+  TemporaryDirectory nodeDir{"eden_thread_affinity_test"};
+  auto writeNode = [&](folly::StringPiece node, folly::StringPiece cpus) {
+    auto dir = nodeDir.path() / node.str();
+    boost::filesystem::create_directory(dir);
+    folly::writeFile(cpus, (dir / "cpulist").c_str());
+  };
+  writeNode("node0", "0-3,8-11\n");
+  writeNode("node1", "4-7,12-15\n");
+  AbsolutePath nodePath{nodeDir.path().string()};
+
+  EXPECT_EQ(
+      (vector<size_t>{0, 1, 2, 3, 8, 9, 10, 11}),
+      CpuAffinity::parse("node:0", nodePath).getCpus());
+  EXPECT_EQ(16, CpuAffinity::parse("node:0-1", nodePath).getCpus().size());
+  EXPECT_THROW(CpuAffinity::parse("node:2", nodePath), std::invalid_argument);
+  EXPECT_THROW(CpuAffinity::parse("node:", nodePath), std::invalid_argument);
+}
+
+TEST(ThreadAffinity, applyToCurrentThread) {
+  cpu_set_t allowed;
+  ASSERT_EQ(0, sched_getaffinity(0, sizeof(allowed), &allowed));
+  size_t cpu = 0;
+  while (!CPU_ISSET(cpu, &allowed)) {
+    ++cpu;
+  }
+
+  auto affinity = CpuAffinity::parse(folly::to<std::string>(cpu));
+  std::thread thread([&] {
+    affinity.applyToCurrentThread();
+    cpu_set_t current;
+    ASSERT_EQ(
+        0, pthread_getaffinity_np(pthread_self(), sizeof(current), &current));
+    EXPECT_EQ(1, CPU_COUNT(&current));
+    EXPECT_TRUE(CPU_ISSET(cpu, &current));
+  });
+  thread.join();
+}
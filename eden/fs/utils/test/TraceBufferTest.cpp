@@ -0,0 +1,129 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/TraceBuffer.h"
+
+#include <folly/futures/Future.h>
+#include <folly/io/async/Request.h>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+DECLARE_int32(trace_buffer_events);
+
+using namespace facebook::eden;
+using folly::RequestContextScopeGuard;
+
+namespace {
+std::vector<TraceEvent> getRequestEvents(uint64_t requestId) {
+  std::vector<TraceEvent> result;
+  for (const auto& event : TraceBuffer::getEvents()) {
+    if (event.requestId == requestId) {
+      result.push_back(event);
+    }
+  }
+  return result;
+}
+} // namespace
+
+TEST(TraceBuffer, eventsCarryTheCurrentRequestId) {
+  RequestContextScopeGuard guard;
+  EXPECT_EQ(0, TraceBuffer::getCurrentRequestId());
+  auto requestId = TraceBuffer::startRequest();
+  EXPECT_NE(0, requestId);
+  EXPECT_EQ(requestId, TraceBuffer::getCurrentRequestId());
+
+  {
+    TraceScope scope{TraceEventKind::INODE_LOAD, 42};
+    TraceBuffer::record(
+        TraceEventKind::LOCAL_STORE_HIT, TracePhase::INSTANT, 1);
+  }
+
+  auto events = getRequestEvents(requestId);
+  ASSERT_EQ(3, events.size());
+  EXPECT_EQ(TraceEventKind::INODE_LOAD, events[0].kind);
+  EXPECT_EQ(TracePhase::BEGIN, events[0].phase);
+  EXPECT_EQ(42, events[0].argument);
+  EXPECT_EQ(TraceEventKind::LOCAL_STORE_HIT, events[1].kind);
+  EXPECT_EQ(TracePhase::INSTANT, events[1].phase);
+  EXPECT_EQ(TracePhase::END, events[2].phase);
+  EXPECT_LE(events[0].timestamp, events[1].timestamp);
+  EXPECT_LE(events[1].timestamp, events[2].timestamp);
+}
+
+TEST(TraceBuffer, requestIdFollowsFutures) {
+  uint64_t requestId;
+  folly::Promise<folly::Unit> promise;
+  auto future = folly::Future<folly::Unit>::makeEmpty();
+  {
+    RequestContextScopeGuard guard;
+    requestId = TraceBuffer::startRequest();
+    future = promise.getFuture().thenValue([](auto&&) {
+      TraceBuffer::record(
+          TraceEventKind::HG_IMPORT, TracePhase::INSTANT, 0);
+    });
+  }
+  // The callback runs outside of the request's scope, but with its context.
+  EXPECT_EQ(0, TraceBuffer::getCurrentRequestId());
+  promise.setValue();
+  std::move(future).get();
+
+  auto events = getRequestEvents(requestId);
+  ASSERT_EQ(1, events.size());
+  EXPECT_EQ(TraceEventKind::HG_IMPORT, events[0].kind);
+}
+
+TEST(TraceBuffer, eachThreadKeepsItsMostRecentEvents) {
+  RequestContextScopeGuard guard;
+  auto requestId = TraceBuffer::startRequest();
+  const auto capacity = static_cast<uint64_t>(FLAGS_trace_buffer_events);
+
+  // A new thread gets its own buffer.  Its events are read before it exits,
+  // since a thread's buffer is freed with it.
+  std::vector<TraceEvent> events;
+  std::thread([&] {
+    for (uint64_t n = 0; n < capacity * 3; ++n) {
+      TraceBuffer::record(
+          TraceEventKind::OVERLAY_WRITE, TracePhase::INSTANT, requestId, n);
+    }
+    events = getRequestEvents(requestId);
+  }).join();
+
+  ASSERT_EQ(capacity, events.size());
+  for (uint64_t n = 0; n < capacity; ++n) {
+    EXPECT_EQ(capacity * 2 + n, events[n].argument);
+    EXPECT_EQ(events[0].threadId, events[n].threadId);
+  }
+}
+
+TEST(TraceBuffer, readersRunConcurrentlyWithWriters) {
+  RequestContextScopeGuard guard;
+  auto requestId = TraceBuffer::startRequest();
+
+  std::vector<std::thread> writers;
+  for (int n = 0; n < 4; ++n) {
+    writers.emplace_back([requestId] {
+      for (uint64_t i = 0; i < 100000; ++i) {
+        TraceBuffer::record(
+            TraceEventKind::OVERLAY_READ, TracePhase::INSTANT, requestId, i);
+      }
+    });
+  }
+  for (int n = 0; n < 20; ++n) {
+    for (const auto& event : getRequestEvents(requestId)) {
+      // A torn copy would mix the fields of different events.
+      EXPECT_EQ(TraceEventKind::OVERLAY_READ, event.kind);
+      EXPECT_EQ(TracePhase::INSTANT, event.phase);
+    }
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+}
@@ -10,6 +10,7 @@
 #include "eden/fs/utils/UnixSocket.h"
 #include "eden/fs/utils/FutureUnixSocket.h"
 
+#include <folly/Conv.h>
 #include <folly/Exception.h>
 #include <folly/File.h>
 #include <folly/Random.h>
@@ -294,3 +295,65 @@ TEST(FutureUnixSocket, attachEventBase) {
     test(&evb2, socket2, socket1);
   }
 }
+
+TEST(FutureUnixSocket, queuedSmallMessagesAndFiles) {
+  auto sockets = createSocketPair();
+  EventBase evb;
+
+  auto socket1 = make_unique<FutureUnixSocket>(&evb, std::move(sockets.first));
+  auto socket2 = make_unique<FutureUnixSocket>(&evb, std::move(sockets.second));
+
+  TemporaryFile tmpFile;
+
+  // Start with a message too large for the socket buffer, so that the
+  // messages after it queue up and are sent together once it drains.  Put
+  // file descriptors in the middle, since those can't be coalesced with the
+  // messages around them.
+  constexpr size_t kNumMessages = 30;
+  constexpr size_t kMessageWithFiles = 17;
+  std::vector<std::string> sendMessages;
+  sendMessages.emplace_back(8 * 1024 * 1024, 'x');
+  for (size_t n = 1; n < kNumMessages; ++n) {
+    sendMessages.push_back(folly::to<std::string>("message ", n));
+  }
+
+  for (size_t n = 0; n < sendMessages.size(); ++n) {
+    std::vector<File> files;
+    if (n == kMessageWithFiles) {
+      files.push_back(File{tmpFile.fd(), /* ownsFd */ false}.dup());
+      files.push_back(File{tmpFile.fd(), /* ownsFd */ false}.dup());
+    }
+    socket1
+        ->send(UnixSocket::Message(
+            IOBuf(IOBuf::COPY_BUFFER, sendMessages[n]), std::move(files)))
+        .onError([](const folly::exception_wrapper& ew) {
+          ADD_FAILURE() << "send error: " << ew.what();
+        });
+  }
+
+  std::vector<UnixSocket::Message> receivedMessages;
+  for (size_t n = 0; n < sendMessages.size(); ++n) {
+    auto future = socket2->receive(5s)
+                      .thenValue([&](UnixSocket::Message&& msg) {
+                        receivedMessages.push_back(std::move(msg));
+                      })
+                      .onError([&evb](const folly::exception_wrapper& ew) {
+                        ADD_FAILURE() << "receive error: " << ew.what();
+                        evb.terminateLoopSoon();
+                      });
+    if (n == sendMessages.size() - 1) {
+      std::move(future).ensure([&evb]() { evb.terminateLoopSoon(); });
+    }
+  }
+
+  evb.loopForever();
+
+  ASSERT_EQ(sendMessages.size(), receivedMessages.size());
+  for (size_t n = 0; n < sendMessages.size(); ++n) {
+    EXPECT_EQ(
+        StringPiece{sendMessages[n]},
+        StringPiece{receivedMessages[n].data.coalesce()});
+    EXPECT_EQ(n == kMessageWithFiles ? 2 : 0, receivedMessages[n].files.size())
+        << "message " << n;
+  }
+}
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "eden/fs/utils/WorkStealingExecutor.h"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using facebook::eden::WorkStealingExecutor;
+
+TEST(WorkStealingExecutor, runsTasksAddedFromOutside) {
+  std::atomic<int> count{0};
+  {
+    WorkStealingExecutor executor{4, "WSTest"};
+    for (int i = 0; i < 1000; ++i) {
+      executor.add([&] { ++count; });
+    }
+  }
+  // The destructor waits for every queued task.
+  EXPECT_EQ(1000, count.load());
+}
+
+TEST(WorkStealingExecutor, runsTasksSpawnedByWorkers) {
+  std::atomic<int> count{0};
+  {
+    WorkStealingExecutor executor{4, "WSTest"};
+
+    // Each task adds two children until depth reaches zero, as a recursive
+    // diff or glob would.
+    std::function<void(int)> fanOut = [&](int depth) {
+      ++count;
+      if (depth > 0) {
+        executor.add([&, depth] { fanOut(depth - 1); });
+        executor.add([&, depth] { fanOut(depth - 1); });
+      }
+    };
+    executor.add([&] { fanOut(12); });
+  }
+  EXPECT_EQ((1 << 13) - 1, count.load());
+}
+
+TEST(WorkStealingExecutor, idleWorkersStealQueuedTasks) {
+  WorkStealingExecutor executor{4, "WSTest"};
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  std::atomic<int> remaining{4};
+
+  // One task queues four blocking tasks on its own worker's queue.  They can
+  // only all finish if the other workers steal them.
+  executor.add([&] {
+    for (int i = 0; i < 4; ++i) {
+      executor.add([&] {
+        {
+          std::lock_guard<std::mutex> guard(mutex);
+          threads.insert(std::this_thread::get_id());
+        }
+        --remaining;
+        while (remaining.load() > 0) {
+          std::this_thread::yield();
+        }
+      });
+    }
+  });
+
+  while (remaining.load() > 0) {
+    std::this_thread::yield();
+  }
+  std::lock_guard<std::mutex> guard(mutex);
+  EXPECT_EQ(4, threads.size());
+}
+
+TEST(WorkStealingExecutor, survivesThrowingTasks) {
+  std::atomic<int> count{0};
+  {
+    WorkStealingExecutor executor{2, "WSTest"};
+    executor.add([] { throw std::runtime_error("oops"); });
+    executor.add([&] { ++count; });
+  }
+  EXPECT_EQ(1, count.load());
+}
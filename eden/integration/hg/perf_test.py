@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2018-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+"""
+End-to-end timings of common operations on an Eden mount of an hg repository.
+
+Each test times one operation and emits a JSON record describing it, so that
+runs can be compared with each other.  Records are logged, and also appended
+one per line to the file named by $EDEN_PERF_RESULTS if that is set.
+
+The size of the generated repository can be changed with these environment
+variables, which default to a repository that is quick enough to run along
+with the rest of the integration tests:
+
+- EDEN_PERF_DIRS: the number of directories (default 20)
+- EDEN_PERF_FILES_PER_DIR: the number of files in each (default 50)
+- EDEN_PERF_COMMITS: the number of commits after the first (default 10)
+- EDEN_PERF_REPEAT: how many times each operation is timed (default 3)
+"""
+
+import json
+import logging
+import os
+import platform
+import socket
+import statistics
+import subprocess
+import time
+from typing import Any, Callable, Dict, List, Optional
+
+from eden.integration.hg.lib.hg_extension_test_base import EdenHgTestCase, hg_test
+from eden.integration.lib import hgrepo
+
+
+def _env_int(name: str, default: int) -> int:
+    value = os.environ.get(name)
+    return int(value) if value else default
+
+
+NUM_DIRS = _env_int("EDEN_PERF_DIRS", 20)
+FILES_PER_DIR = _env_int("EDEN_PERF_FILES_PER_DIR", 50)
+NUM_COMMITS = _env_int("EDEN_PERF_COMMITS", 10)
+REPEAT = max(_env_int("EDEN_PERF_REPEAT", 3), 1)
+# Each commit after the first modifies this many files in every directory.
+FILES_CHANGED_PER_COMMIT = 2
+# The word that the grep benchmark searches for.  One in ten files has it.
+GREP_WORD = "needle"
+
+
+def _file_path(dir_index: int, file_index: int) -> str:
+    # Nest every other directory one level down, so that the tree has some
+    # depth as well as breadth.
+    if dir_index % 2:
+        return f"dir{dir_index - 1:03d}/sub/file{file_index:04d}.txt"
+    return f"dir{dir_index:03d}/file{file_index:04d}.txt"
+
+
+def _file_contents(dir_index: int, file_index: int, revision: int) -> str:
+    lines = [f"{dir_index} {file_index} line {n}" for n in range(20)]
+    if file_index % 10 == 0:
+        lines.append(GREP_WORD)
+    lines.append(f"revision {revision}")
+    return "\n".join(lines) + "\n"
+
+
+@hg_test
+class PerfTest(EdenHgTestCase):
+    def select_storage_engine(self) -> str:
+        # Restart and takeover need the data to be persisted.
+        return "sqlite"
+
+    def populate_backing_repo(self, repo: hgrepo.HgRepository) -> None:
+        for dir_index in range(NUM_DIRS):
+            for file_index in range(FILES_PER_DIR):
+                repo.write_file(
+                    _file_path(dir_index, file_index),
+                    _file_contents(dir_index, file_index, 0),
+                    add=False,
+                )
+        repo.hg("addremove", "--quiet")
+        self.commits = [repo.commit("Initial commit.")]
+
+        for revision in range(1, NUM_COMMITS + 1):
+            for dir_index in range(NUM_DIRS):
+                for n in range(FILES_CHANGED_PER_COMMIT):
+                    file_index = (revision * FILES_CHANGED_PER_COMMIT + n) % (
+                        FILES_PER_DIR
+                    )
+                    repo.write_file(
+                        _file_path(dir_index, file_index),
+                        _file_contents(dir_index, file_index, revision),
+                        add=False,
+                    )
+            self.commits.append(repo.commit(f"Commit {revision}."))
+
+    def measure(
+        self,
+        benchmark: str,
+        operation: Callable[[], Any],
+        setup: Optional[Callable[[], Any]] = None,
+        repeat: int = REPEAT,
+        **extra: Any,
+    ) -> List[float]:
+        """
+        Time operation() repeat times, calling setup() untimed before each run,
+        and report the results.
+        """
+        runs = []
+        for _ in range(repeat):
+            if setup is not None:
+                setup()
+            start = time.monotonic()
+            operation()
+            runs.append(time.monotonic() - start)
+        self.report(benchmark, runs, **extra)
+        return runs
+
+    def report(self, benchmark: str, runs: List[float], **extra: Any) -> None:
+        record: Dict[str, Any] = {
+            "benchmark": benchmark,
+            "variant": self.config_variant_name,
+            "timestamp": int(time.time()),
+            "host": socket.gethostname(),
+            "kernel": platform.release(),
+            "repo": {
+                "dirs": NUM_DIRS,
+                "files": NUM_DIRS * FILES_PER_DIR,
+                "commits": NUM_COMMITS + 1,
+            },
+            "runs": runs,
+            "min": min(runs),
+            "median": statistics.median(runs),
+        }
+        record.update(extra)
+        line = json.dumps(record, sort_keys=True)
+        logging.info("perf result: %s", line)
+        results_path = os.environ.get("EDEN_PERF_RESULTS")
+        if results_path:
+            with open(results_path, "a") as f:
+                f.write(line + "\n")
+
+    def other_mount(self, index: int) -> str:
+        return os.path.join(self.mounts_dir, f"perf{index}")
+
+    def test_clone(self) -> None:
+        clones = iter(range(REPEAT))
+        self.measure(
+            "clone",
+            lambda: self.eden.clone(
+                self.backing_repo_name, self.other_mount(next(clones))
+            ),
+        )
+
+    def test_first_checkout(self) -> None:
+        # A fresh clone has no inodes loaded, so the checkout has to load the
+        # trees it changes.
+        clones = iter(range(REPEAT))
+        mounts: List[str] = []
+
+        def clone() -> None:
+            mounts.append(self.other_mount(next(clones)))
+            self.eden.clone(self.backing_repo_name, mounts[-1])
+
+        def checkout() -> None:
+            repo = hgrepo.HgRepository(mounts[-1], system_hgrc=self.system_hgrc)
+            repo.update(self.commits[0])
+
+        self.measure("first_checkout", checkout, setup=clone)
+
+    def test_status(self) -> None:
+        self.measure("status_clean", lambda: self.hg("status"))
+
+        modified = [_file_path(dir_index, 1) for dir_index in range(0, NUM_DIRS, 2)]
+        for path in modified:
+            self.write_file(path, "modified\n")
+        self.measure(
+            "status_modified",
+            lambda: self.hg("status"),
+            modified_files=len(modified),
+        )
+
+    def test_update_across_commits(self) -> None:
+        first = self.commits[0]
+        last = self.commits[-1]
+        self.measure(
+            "update_forward",
+            lambda: self.repo.update(last),
+            setup=lambda: self.repo.update(first),
+            commits=NUM_COMMITS,
+        )
+        self.measure(
+            "update_backward",
+            lambda: self.repo.update(first),
+            setup=lambda: self.repo.update(last),
+            commits=NUM_COMMITS,
+        )
+        self.assert_status_empty()
+
+    def test_find(self) -> None:
+        output: List[bytes] = []
+        find_args = ["find", self.mount, "-name", ".hg", "-prune"]
+        find_args += ["-o", "-type", "f", "-print"]
+
+        def find() -> None:
+            output.append(subprocess.check_output(find_args))
+
+        # Only the first walk of a new mount has to load the inodes.
+        self.measure("find_first", find, repeat=1)
+        # Repeated walks are answered from loaded inodes and the kernel caches.
+        self.measure("find_cached", find)
+        self.assertEqual(NUM_DIRS * FILES_PER_DIR, len(output[-1].splitlines()))
+
+    def test_grep(self) -> None:
+        output: List[bytes] = []
+
+        def grep() -> None:
+            output.append(
+                subprocess.check_output(
+                    [
+                        "grep",
+                        "--recursive",
+                        "--files-with-matches",
+                        "--exclude-dir=.hg",
+                        "--exclude-dir=.eden",
+                        GREP_WORD,
+                        self.mount,
+                    ]
+                )
+            )
+
+        self.measure("grep_first", grep, repeat=1)
+        self.measure("grep_cached", grep)
+        expected = NUM_DIRS * len(range(0, FILES_PER_DIR, 10))
+        self.assertEqual(expected, len(output[-1].splitlines()))
+
+    def test_restart(self) -> None:
+        self.measure("restart", self.eden.restart)
+        self.assert_status_empty()
+
+    def test_graceful_takeover(self) -> None:
+        # Load some inodes first, since the takeover has to hand them over.
+        subprocess.check_call(
+            ["find", self.mount, "-type", "f"], stdout=subprocess.DEVNULL
+        )
+        self.measure("graceful_takeover", self.eden.graceful_restart)
+        self.assert_status_empty()
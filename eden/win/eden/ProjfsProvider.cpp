@@ -0,0 +1,662 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ProjfsProvider.h"
+
+#include <folly/Executor.h>
+#include <folly/ScopeGuard.h>
+#include <folly/io/Cursor.h>
+#include <folly/logging/xlog.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <system_error>
+#include "eden/fs/journal/Journal.h"
+#include "eden/fs/journal/JournalDelta.h"
+#include "eden/fs/model/Blob.h"
+#include "eden/fs/model/Tree.h"
+#include "eden/fs/store/BlobMetadata.h"
+#include "eden/fs/store/ObjectStore.h"
+
+using facebook::eden::Blob;
+using facebook::eden::BlobMetadata;
+using facebook::eden::Hash;
+using facebook::eden::JournalDelta;
+using facebook::eden::PathComponent;
+using facebook::eden::PathComponentPiece;
+using facebook::eden::RelativePath;
+using facebook::eden::RelativePathPiece;
+using facebook::eden::Tree;
+using facebook::eden::TreeEntry;
+using folly::Future;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+using std::wstring;
+
+DEFINE_int32(
+    projfs_sibling_prefetch_count,
+    16,
+    "Number of files after a file to prefetch when a directory's files are "
+    "read in order");
+
+namespace facebook {
+namespace edenwin {
+
+namespace {
+// The largest number of directories whose last read file is remembered for
+// prefetching.
+constexpr size_t kMaxPrefetchDirectories = 1024;
+// The size of the buffers file data is written to ProjFS in.
+constexpr size_t kFileDataChunkSize = 1024 * 1024;
+
+string wideToUtf8(const wchar_t* str, size_t length) {
+  if (length == 0) {
+    return string{};
+  }
+  auto size = WideCharToMultiByte(
+      CP_UTF8, 0, str, length, nullptr, 0, nullptr, nullptr);
+  if (size <= 0) {
+    throw std::system_error(
+        GetLastError(), std::system_category(), "invalid wide string");
+  }
+  string result(size, '\0');
+  WideCharToMultiByte(
+      CP_UTF8, 0, str, length, &result[0], size, nullptr, nullptr);
+  return result;
+}
+
+wstring utf8ToWide(folly::StringPiece str) {
+  if (str.empty()) {
+    return wstring{};
+  }
+  auto size = MultiByteToWideChar(CP_UTF8, 0, str.data(), str.size(), 0, 0);
+  if (size <= 0) {
+    throw std::system_error(
+        GetLastError(), std::system_category(), "invalid UTF-8 string");
+  }
+  wstring result(size, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, str.data(), str.size(), &result[0], size);
+  return result;
+}
+
+/**
+ * Convert a path relative to the virtualization root, as ProjFS passes them,
+ * to a RelativePath.
+ */
+RelativePath toRelativePath(PCWSTR path) {
+  if (path == nullptr) {
+    return RelativePath{};
+  }
+  auto utf8 = wideToUtf8(path, wcslen(path));
+  std::replace(utf8.begin(), utf8.end(), '\\', '/');
+  return RelativePath{utf8};
+}
+
+std::system_error makeWin32Error(DWORD error, folly::StringPiece path) {
+  return std::system_error(error, std::system_category(), path.str());
+}
+
+HRESULT exceptionToHResult(const folly::exception_wrapper& ew) {
+  HRESULT result = E_FAIL;
+  if (!ew.with_exception([&](const std::system_error& ex) {
+        // std::system_category() holds Win32 error codes on Windows.
+        if (ex.code().category() == std::system_category()) {
+          result = HRESULT_FROM_WIN32(ex.code().value());
+        }
+      })) {
+    ew.with_exception([&](const std::bad_alloc&) { result = E_OUTOFMEMORY; });
+  }
+  if (result == E_FAIL) {
+    XLOG(ERR) << "ProjFS request failed: " << folly::exceptionStr(ew);
+  }
+  return result;
+}
+
+/**
+ * Find name in tree.  ProjFS names are case-insensitive, so this falls back
+ * to a case-insensitive search when there is no exact match.
+ */
+const TreeEntry* findEntry(const Tree& tree, PathComponentPiece name) {
+  auto entry = tree.getEntryPtr(name);
+  if (entry) {
+    return entry;
+  }
+  auto wideName = utf8ToWide(name.stringPiece());
+  for (const auto& candidate : tree.getTreeEntries()) {
+    auto candidateName = utf8ToWide(candidate.getName().stringPiece());
+    if (PrjFileNameCompare(candidateName.c_str(), wideName.c_str()) == 0) {
+      return &candidate;
+    }
+  }
+  return nullptr;
+}
+
+template <typename Fn>
+HRESULT callProvider(Fn&& fn) {
+  try {
+    return fn();
+  } catch (const std::exception& ex) {
+    return exceptionToHResult(
+        folly::exception_wrapper{std::current_exception(), ex});
+  }
+}
+
+ProjfsProvider* getProvider(const PRJ_CALLBACK_DATA* callbackData) {
+  return static_cast<ProjfsProvider*>(callbackData->InstanceContext);
+}
+} // namespace
+
+size_t ProjfsProvider::GuidHash::operator()(const GUID& guid) const {
+  static_assert(sizeof(GUID) == 2 * sizeof(uint64_t), "unexpected GUID size");
+  uint64_t words[2];
+  memcpy(words, &guid, sizeof(words));
+  return std::hash<uint64_t>()(words[0]) ^ (words[1] * 0x9e3779b97f4a7c15);
+}
+
+ProjfsProvider::ProjfsProvider(
+    wstring rootPath,
+    eden::ObjectStore* objectStore,
+    eden::Journal* journal,
+    folly::Executor* executor,
+    const Hash& commitID)
+    : rootPath_(std::move(rootPath)),
+      objectStore_(objectStore),
+      journal_(journal),
+      executor_(executor),
+      commitID_(commitID) {
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  startTime_.LowPart = now.dwLowDateTime;
+  startTime_.HighPart = now.dwHighDateTime;
+}
+
+ProjfsProvider::~ProjfsProvider() {
+  stop();
+}
+
+void ProjfsProvider::start() {
+  rootTree_ = objectStore_->getTreeForCommit(commitID_).get();
+
+  GUID instanceId;
+  auto result = CoCreateGuid(&instanceId);
+  if (FAILED(result)) {
+    throw makeWin32Error(result, "CoCreateGuid failed");
+  }
+  // This fails if rootPath_ is already a virtualization root, in which case
+  // ProjFS keeps the files it has already hydrated there.
+  result = PrjMarkDirectoryAsPlaceholder(
+      rootPath_.c_str(), nullptr, nullptr, &instanceId);
+  if (FAILED(result)) {
+    XLOG(DBG2) << "PrjMarkDirectoryAsPlaceholder failed: " << std::hex
+               << result << "; assuming it is already a virtualization root";
+  }
+
+  // Record the transition from no snapshot to the current snapshot, as
+  // EdenMount::initialize() does.
+  auto delta = std::make_unique<JournalDelta>();
+  delta->toHash = commitID_;
+  journal_->addDelta(std::move(delta));
+
+  PRJ_CALLBACKS callbacks{};
+  callbacks.StartDirectoryEnumerationCallback = startEnumerationCallback;
+  callbacks.EndDirectoryEnumerationCallback = endEnumerationCallback;
+  callbacks.GetDirectoryEnumerationCallback = getEnumerationDataCallback;
+  callbacks.GetPlaceholderInfoCallback = getPlaceholderInfoCallback;
+  callbacks.GetFileDataCallback = getFileDataCallback;
+  callbacks.QueryFileNameCallback = queryFileNameCallback;
+  callbacks.NotificationCallback = notificationCallback;
+
+  PRJ_NOTIFICATION_MAPPING mapping{};
+  mapping.NotificationRoot = L"";
+  mapping.NotificationBitMask = PRJ_NOTIFY_NEW_FILE_CREATED |
+      PRJ_NOTIFY_FILE_OVERWRITTEN | PRJ_NOTIFY_FILE_RENAMED |
+      PRJ_NOTIFY_HARDLINK_CREATED |
+      PRJ_NOTIFY_FILE_HANDLE_CLOSED_FILE_MODIFIED |
+      PRJ_NOTIFY_FILE_HANDLE_CLOSED_FILE_DELETED;
+  PRJ_STARTVIRTUALIZING_OPTIONS options{};
+  options.NotificationMappings = &mapping;
+  options.NotificationMappingsCount = 1;
+
+  result = PrjStartVirtualizing(
+      rootPath_.c_str(), &callbacks, this, &options, &context_);
+  if (FAILED(result)) {
+    context_ = nullptr;
+    throw makeWin32Error(result, "PrjStartVirtualizing failed");
+  }
+}
+
+void ProjfsProvider::stop() {
+  if (context_) {
+    PrjStopVirtualizing(context_);
+    context_ = nullptr;
+  }
+}
+
+Future<shared_ptr<const Tree>> ProjfsProvider::getTree(
+    RelativePathPiece path) const {
+  auto result = folly::makeFuture(rootTree_);
+  for (auto name : path.components()) {
+    result = std::move(result).thenValue(
+        [this, name = name.copy(), path = path.copy()](
+            shared_ptr<const Tree> tree) {
+          auto entry = findEntry(*tree, name);
+          if (!entry || !entry->isTree()) {
+            throw makeWin32Error(ERROR_PATH_NOT_FOUND, path.stringPiece());
+          }
+          return objectStore_->getTree(entry->getHash());
+        });
+  }
+  return result;
+}
+
+Future<TreeEntry> ProjfsProvider::lookup(RelativePathPiece path) const {
+  if (path.empty()) {
+    return folly::makeFuture<TreeEntry>(
+        makeWin32Error(ERROR_FILE_NOT_FOUND, path.stringPiece()));
+  }
+  return getTree(path.dirname())
+      .thenValue([path = path.copy()](shared_ptr<const Tree> tree) {
+        auto entry = findEntry(*tree, path.basename());
+        if (!entry) {
+          throw makeWin32Error(ERROR_FILE_NOT_FOUND, path.stringPiece());
+        }
+        return *entry;
+      })
+      .thenError(
+          folly::tag_t<std::system_error>{},
+          [path = path.copy()](std::system_error&& ex) -> TreeEntry {
+            // A missing parent directory means the file is missing too.
+            if (ex.code().value() == ERROR_PATH_NOT_FOUND) {
+              throw makeWin32Error(ERROR_FILE_NOT_FOUND, path.stringPiece());
+            }
+            throw std::move(ex);
+          });
+}
+
+Future<uint64_t> ProjfsProvider::getFileSize(const TreeEntry& entry) const {
+  if (entry.isTree()) {
+    return folly::makeFuture<uint64_t>(0);
+  }
+  if (entry.getSize().hasValue()) {
+    return folly::makeFuture<uint64_t>(entry.getSize().value());
+  }
+  return objectStore_->getBlobMetadata(entry.getHash())
+      .thenValue([](const BlobMetadata& metadata) { return metadata.size; });
+}
+
+PRJ_FILE_BASIC_INFO ProjfsProvider::makeBasicInfo(
+    bool isDirectory,
+    uint64_t size) const {
+  PRJ_FILE_BASIC_INFO info{};
+  info.IsDirectory = isDirectory;
+  info.FileSize = isDirectory ? 0 : size;
+  info.CreationTime = startTime_;
+  info.LastAccessTime = startTime_;
+  info.LastWriteTime = startTime_;
+  info.ChangeTime = startTime_;
+  info.FileAttributes =
+      isDirectory ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_ARCHIVE;
+  return info;
+}
+
+HRESULT ProjfsProvider::startEnumeration(
+    const PRJ_CALLBACK_DATA* callbackData,
+    const GUID& enumerationId) {
+  auto path = toRelativePath(callbackData->FilePathName);
+  auto tree = getTree(path).get();
+
+  // Fetch the sizes of all of the files the Tree does not record them for
+  // at once, so that the BackingStore can fetch them together.
+  const auto& treeEntries = tree->getTreeEntries();
+  vector<Future<uint64_t>> sizes;
+  sizes.reserve(treeEntries.size());
+  for (const auto& entry : treeEntries) {
+    sizes.push_back(getFileSize(entry));
+  }
+  auto results = folly::collect(sizes).get();
+
+  auto enumeration = std::make_shared<Enumeration>();
+  enumeration->entries.reserve(treeEntries.size());
+  for (size_t n = 0; n < treeEntries.size(); ++n) {
+    enumeration->entries.push_back(
+        DirEntry{utf8ToWide(treeEntries[n].getName().stringPiece()),
+                 treeEntries[n].isTree(),
+                 results[n]});
+  }
+  std::sort(
+      enumeration->entries.begin(),
+      enumeration->entries.end(),
+      [](const DirEntry& a, const DirEntry& b) {
+        return PrjFileNameCompare(a.name.c_str(), b.name.c_str()) < 0;
+      });
+
+  enumerations_.wlock()->emplace(enumerationId, std::move(enumeration));
+  return S_OK;
+}
+
+HRESULT ProjfsProvider::endEnumeration(const GUID& enumerationId) {
+  enumerations_.wlock()->erase(enumerationId);
+  return S_OK;
+}
+
+HRESULT ProjfsProvider::getEnumerationData(
+    const PRJ_CALLBACK_DATA* callbackData,
+    const GUID& enumerationId,
+    PCWSTR searchExpression,
+    PRJ_DIR_ENTRY_BUFFER_HANDLE dirEntryBufferHandle) {
+  shared_ptr<Enumeration> enumeration;
+  {
+    auto enumerations = enumerations_.rlock();
+    auto it = enumerations->find(enumerationId);
+    if (it == enumerations->end()) {
+      return E_INVALIDARG;
+    }
+    enumeration = it->second;
+  }
+
+  if (callbackData->Flags & PRJ_CB_DATA_FLAG_ENUM_RESTART_SCAN) {
+    enumeration->next = 0;
+    enumeration->searchExpression.clear();
+  }
+  if (!enumeration->searchExpression.hasValue()) {
+    enumeration->searchExpression =
+        wstring{searchExpression ? searchExpression : L""};
+  }
+  const auto& search = enumeration->searchExpression.value();
+  bool singleEntry =
+      callbackData->Flags & PRJ_CB_DATA_FLAG_ENUM_RETURN_SINGLE_ENTRY;
+
+  bool added = false;
+  for (; enumeration->next < enumeration->entries.size();
+       ++enumeration->next) {
+    const auto& entry = enumeration->entries[enumeration->next];
+    if (!search.empty() &&
+        !PrjFileNameMatch(entry.name.c_str(), search.c_str())) {
+      continue;
+    }
+    auto info = makeBasicInfo(entry.isDirectory, entry.size);
+    auto result =
+        PrjFillDirEntryBuffer(entry.name.c_str(), &info, dirEntryBufferHandle);
+    if (result == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER)) {
+      // ProjFS asks again for the entries that did not fit, but the buffer
+      // must hold at least one.
+      return added ? S_OK : result;
+    }
+    if (FAILED(result)) {
+      return result;
+    }
+    added = true;
+    if (singleEntry) {
+      ++enumeration->next;
+      break;
+    }
+  }
+  return S_OK;
+}
+
+HRESULT ProjfsProvider::getPlaceholderInfo(
+    const PRJ_CALLBACK_DATA* callbackData) {
+  auto path = toRelativePath(callbackData->FilePathName);
+  auto entry = lookup(path).get();
+  auto size = getFileSize(entry).get();
+
+  // Use the name as it is recorded in source control, which may differ in
+  // case from the one the file was opened by.
+  auto name = path.dirname() + entry.getName();
+  auto wideName = utf8ToWide(name.stringPiece());
+  std::replace(wideName.begin(), wideName.end(), L'/', L'\\');
+
+  PRJ_PLACEHOLDER_INFO info{};
+  info.FileBasicInfo = makeBasicInfo(entry.isTree(), size);
+  return PrjWritePlaceholderInfo(
+      context_, wideName.c_str(), &info, sizeof(info));
+}
+
+HRESULT ProjfsProvider::getFileData(
+    const PRJ_CALLBACK_DATA* callbackData,
+    uint64_t byteOffset,
+    uint32_t length) {
+  auto path = toRelativePath(callbackData->FilePathName);
+  auto write = [context = context_,
+                streamId = callbackData->DataStreamId,
+                byteOffset,
+                length](const Blob& blob) -> HRESULT {
+    const auto& contents = blob.getContents();
+    auto blobSize = contents.computeChainDataLength();
+    if (byteOffset > blobSize) {
+      return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+    size_t remaining = std::min<uint64_t>(length, blobSize - byteOffset);
+    size_t bufferSize = std::min(remaining, kFileDataChunkSize);
+    auto buffer = PrjAllocateAlignedBuffer(context, bufferSize);
+    if (!buffer) {
+      return E_OUTOFMEMORY;
+    }
+    SCOPE_EXIT {
+      PrjFreeAlignedBuffer(buffer);
+    };
+
+    folly::io::Cursor cursor(&contents);
+    cursor.skip(byteOffset);
+    uint64_t offset = byteOffset;
+    while (remaining > 0) {
+      auto chunk = std::min(remaining, bufferSize);
+      cursor.pull(buffer, chunk);
+      auto result =
+          PrjWriteFileData(context, &streamId, buffer, offset, chunk);
+      if (FAILED(result)) {
+        return result;
+      }
+      offset += chunk;
+      remaining -= chunk;
+    }
+    return S_OK;
+  };
+
+  auto blobFuture = lookup(path).thenValue([this](TreeEntry entry) {
+    if (entry.isTree()) {
+      throw makeWin32Error(ERROR_ACCESS_DENIED, entry.getName().stringPiece());
+    }
+    return objectStore_->getBlob(entry.getHash());
+  });
+  prefetchSiblingBlobs(path);
+
+  if (blobFuture.isReady()) {
+    return write(*std::move(blobFuture).get());
+  }
+
+  // Complete the request once the blob arrives, so that the BackingStore
+  // can combine it with the blobs other hydrations are waiting for.
+  std::move(blobFuture)
+      .via(executor_)
+      .thenValue([write](shared_ptr<const Blob> blob) { return write(*blob); })
+      .thenError([](folly::exception_wrapper&& ew) {
+        return exceptionToHResult(ew);
+      })
+      .thenValue([context = context_,
+                  commandId = callbackData->CommandId](HRESULT result) {
+        PrjCompleteCommand(context, commandId, result, nullptr);
+      });
+  return HRESULT_FROM_WIN32(ERROR_IO_PENDING);
+}
+
+void ProjfsProvider::prefetchSiblingBlobs(RelativePathPiece path) {
+  if (FLAGS_projfs_sibling_prefetch_count <= 0 || path.empty()) {
+    return;
+  }
+  auto dirname = path.dirname();
+  auto name = path.basename();
+
+  // Applications that read a directory's files in order, like compilers
+  // and grep, read each file right after the one before it.
+  bool sequential = false;
+  {
+    auto lastFileRead = lastFileRead_.wlock();
+    auto it = lastFileRead->find(dirname.copy());
+    if (it != lastFileRead->end()) {
+      sequential = it->second.stringPiece() < name.stringPiece();
+      it->second = name.copy();
+    } else {
+      if (lastFileRead->size() >= kMaxPrefetchDirectories) {
+        lastFileRead->clear();
+      }
+      lastFileRead->emplace(dirname.copy(), name.copy());
+    }
+  }
+  if (!sequential) {
+    return;
+  }
+
+  getTree(dirname)
+      .thenValue([this, name = name.copy()](shared_ptr<const Tree> tree) {
+        const auto& entries = tree->getTreeEntries();
+        auto it = std::upper_bound(
+            entries.begin(),
+            entries.end(),
+            name,
+            [](const PathComponent& value, const TreeEntry& entry) {
+              return value < entry.getName();
+            });
+        vector<Hash> ids;
+        for (; it != entries.end() &&
+             ids.size() < size_t(FLAGS_projfs_sibling_prefetch_count);
+             ++it) {
+          if (!it->isTree()) {
+            ids.push_back(it->getHash());
+          }
+        }
+        if (ids.empty()) {
+          return Future<folly::Unit>{folly::unit};
+        }
+        return objectStore_->prefetchBlobs(ids);
+      })
+      .thenError([path = path.copy()](const folly::exception_wrapper& ew) {
+        XLOG(DBG3) << "error prefetching the files after " << path << ": "
+                   << folly::exceptionStr(ew);
+      });
+}
+
+HRESULT ProjfsProvider::queryFileName(const PRJ_CALLBACK_DATA* callbackData) {
+  // lookup() fails with ERROR_FILE_NOT_FOUND if the path does not exist.
+  lookup(toRelativePath(callbackData->FilePathName)).get();
+  return S_OK;
+}
+
+HRESULT ProjfsProvider::notify(
+    const PRJ_CALLBACK_DATA* callbackData,
+    PRJ_NOTIFICATION notification,
+    PCWSTR destinationFileName) {
+  auto path = toRelativePath(callbackData->FilePathName);
+  std::unique_ptr<JournalDelta> delta;
+  switch (notification) {
+    case PRJ_NOTIFICATION_NEW_FILE_CREATED:
+      delta = std::make_unique<JournalDelta>(path, JournalDelta::CREATED);
+      break;
+    case PRJ_NOTIFICATION_HARDLINK_CREATED:
+      delta = std::make_unique<JournalDelta>(
+          toRelativePath(destinationFileName), JournalDelta::CREATED);
+      break;
+    case PRJ_NOTIFICATION_FILE_OVERWRITTEN:
+    case PRJ_NOTIFICATION_FILE_HANDLE_CLOSED_FILE_MODIFIED:
+      delta = std::make_unique<JournalDelta>(path, JournalDelta::CHANGED);
+      break;
+    case PRJ_NOTIFICATION_FILE_HANDLE_CLOSED_FILE_DELETED:
+      delta = std::make_unique<JournalDelta>(path, JournalDelta::REMOVED);
+      break;
+    case PRJ_NOTIFICATION_FILE_RENAMED: {
+      // ProjFS passes an empty path for the side of a rename outside the
+      // virtualization root.
+      auto destination = toRelativePath(destinationFileName);
+      if (destination.empty()) {
+        delta = std::make_unique<JournalDelta>(path, JournalDelta::REMOVED);
+      } else if (path.empty()) {
+        delta =
+            std::make_unique<JournalDelta>(destination, JournalDelta::CREATED);
+      } else {
+        delta = std::make_unique<JournalDelta>(
+            path, destination, JournalDelta::RENAME);
+      }
+      break;
+    }
+    default:
+      return S_OK;
+  }
+  journal_->addDelta(std::move(delta));
+  return S_OK;
+}
+
+HRESULT CALLBACK ProjfsProvider::startEnumerationCallback(
+    const PRJ_CALLBACK_DATA* callbackData,
+    const GUID* enumerationId) {
+  return callProvider([&] {
+    return getProvider(callbackData)
+        ->startEnumeration(callbackData, *enumerationId);
+  });
+}
+
+HRESULT CALLBACK ProjfsProvider::endEnumerationCallback(
+    const PRJ_CALLBACK_DATA* callbackData,
+    const GUID* enumerationId) {
+  return callProvider([&] {
+    return getProvider(callbackData)->endEnumeration(*enumerationId);
+  });
+}
+
+HRESULT CALLBACK ProjfsProvider::getEnumerationDataCallback(
+    const PRJ_CALLBACK_DATA* callbackData,
+    const GUID* enumerationId,
+    PCWSTR searchExpression,
+    PRJ_DIR_ENTRY_BUFFER_HANDLE dirEntryBufferHandle) {
+  return callProvider([&] {
+    return getProvider(callbackData)
+        ->getEnumerationData(
+            callbackData,
+            *enumerationId,
+            searchExpression,
+            dirEntryBufferHandle);
+  });
+}
+
+HRESULT CALLBACK ProjfsProvider::getPlaceholderInfoCallback(
+    const PRJ_CALLBACK_DATA* callbackData) {
+  return callProvider([&] {
+    return getProvider(callbackData)->getPlaceholderInfo(callbackData);
+  });
+}
+
+HRESULT CALLBACK ProjfsProvider::getFileDataCallback(
+    const PRJ_CALLBACK_DATA* callbackData,
+    UINT64 byteOffset,
+    UINT32 length) {
+  return callProvider([&] {
+    return getProvider(callbackData)
+        ->getFileData(callbackData, byteOffset, length);
+  });
+}
+
+HRESULT CALLBACK
+ProjfsProvider::queryFileNameCallback(const PRJ_CALLBACK_DATA* callbackData) {
+  return callProvider(
+      [&] { return getProvider(callbackData)->queryFileName(callbackData); });
+}
+
+HRESULT CALLBACK ProjfsProvider::notificationCallback(
+    const PRJ_CALLBACK_DATA* callbackData,
+    BOOLEAN /* isDirectory */,
+    PRJ_NOTIFICATION notification,
+    PCWSTR destinationFileName,
+    PRJ_NOTIFICATION_PARAMETERS* /* operationParameters */) {
+  return callProvider([&] {
+    return getProvider(callbackData)
+        ->notify(callbackData, notification, destinationFileName);
+  });
+}
+
+} // namespace edenwin
+} // namespace facebook
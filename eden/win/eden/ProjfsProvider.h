@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2018-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+#include "folly/portability/Windows.h"
+
+#include <ProjectedFSLib.h>
+#include <folly/Optional.h>
+#include <folly/Synchronized.h>
+#include <folly/futures/Future.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "eden/fs/model/Hash.h"
+#include "eden/fs/model/TreeEntry.h"
+#include "eden/fs/utils/PathFuncs.h"
+
+namespace folly {
+class Executor;
+} // namespace folly
+
+namespace facebook {
+namespace eden {
+class Blob;
+class Journal;
+class ObjectStore;
+class Tree;
+} // namespace eden
+
+namespace edenwin {
+
+/**
+ * A ProjFS provider that presents the source control state of a commit
+ * under a virtualization root, fetching everything from an ObjectStore.
+ *
+ * ProjFS itself keeps the files and directories that have been read or
+ * modified on disk, so the provider only has to serve the unmodified source
+ * control state:
+ *
+ * - Directory enumerations are answered from the commit's Trees.  The sizes
+ *   of all of a directory's files are fetched together when the enumeration
+ *   starts, rather than one at a time as ProjFS asks for each entry.
+ * - File data requests complete asynchronously, so that the BackingStore
+ *   can combine the blob fetches of many concurrent hydrations into batches.
+ *   Reading a directory's files in order also prefetches the files after
+ *   them, as TreeInode does for FUSE mounts.
+ * - Notifications of local changes are recorded in the Journal.
+ *
+ * The ObjectStore's in-memory caches and the LocalStore make repeated
+ * lookups cheap, so the provider keeps no copy of the Trees itself.
+ *
+ * Symlinks are presented as regular files holding the link target, since
+ * not every ProjFS version can create symlink placeholders.
+ */
+class ProjfsProvider {
+ public:
+  /**
+   * The ObjectStore, Journal and executor must outlive the provider.  The
+   * executor runs the completions of asynchronous file data requests.
+   */
+  ProjfsProvider(
+      std::wstring rootPath,
+      eden::ObjectStore* objectStore,
+      eden::Journal* journal,
+      folly::Executor* executor,
+      const eden::Hash& commitID);
+  ~ProjfsProvider();
+
+  /**
+   * Load the commit's root Tree, mark rootPath as a virtualization root if
+   * it is not one already, and start serving ProjFS callbacks.
+   *
+   * Throws std::system_error if ProjFS cannot be started.
+   */
+  void start();
+
+  /**
+   * Stop serving callbacks.  Requests that are still in progress complete
+   * before this returns.
+   */
+  void stop();
+
+ private:
+  ProjfsProvider(const ProjfsProvider&) = delete;
+  ProjfsProvider& operator=(const ProjfsProvider&) = delete;
+
+  struct DirEntry {
+    std::wstring name;
+    bool isDirectory;
+    uint64_t size;
+  };
+
+  /**
+   * The state of one directory enumeration.  ProjFS does not make
+   * concurrent calls for the same enumeration, so this needs no lock of its
+   * own.
+   */
+  struct Enumeration {
+    // Sorted with PrjFileNameCompare(), the order ProjFS requires.
+    std::vector<DirEntry> entries;
+    size_t next{0};
+    // Set by the first request of each scan, and kept until the scan is
+    // restarted.
+    folly::Optional<std::wstring> searchExpression;
+  };
+
+  struct GuidHash {
+    size_t operator()(const GUID& guid) const;
+  };
+
+  // The ProjFS callbacks, which forward to the provider in InstanceContext.
+  static HRESULT CALLBACK startEnumerationCallback(
+      const PRJ_CALLBACK_DATA* callbackData,
+      const GUID* enumerationId);
+  static HRESULT CALLBACK endEnumerationCallback(
+      const PRJ_CALLBACK_DATA* callbackData,
+      const GUID* enumerationId);
+  static HRESULT CALLBACK getEnumerationDataCallback(
+      const PRJ_CALLBACK_DATA* callbackData,
+      const GUID* enumerationId,
+      PCWSTR searchExpression,
+      PRJ_DIR_ENTRY_BUFFER_HANDLE dirEntryBufferHandle);
+  static HRESULT CALLBACK
+  getPlaceholderInfoCallback(const PRJ_CALLBACK_DATA* callbackData);
+  static HRESULT CALLBACK getFileDataCallback(
+      const PRJ_CALLBACK_DATA* callbackData,
+      UINT64 byteOffset,
+      UINT32 length);
+  static HRESULT CALLBACK
+  queryFileNameCallback(const PRJ_CALLBACK_DATA* callbackData);
+  static HRESULT CALLBACK notificationCallback(
+      const PRJ_CALLBACK_DATA* callbackData,
+      BOOLEAN isDirectory,
+      PRJ_NOTIFICATION notification,
+      PCWSTR destinationFileName,
+      PRJ_NOTIFICATION_PARAMETERS* operationParameters);
+
+  HRESULT startEnumeration(
+      const PRJ_CALLBACK_DATA* callbackData,
+      const GUID& enumerationId);
+  HRESULT endEnumeration(const GUID& enumerationId);
+  HRESULT getEnumerationData(
+      const PRJ_CALLBACK_DATA* callbackData,
+      const GUID& enumerationId,
+      PCWSTR searchExpression,
+      PRJ_DIR_ENTRY_BUFFER_HANDLE dirEntryBufferHandle);
+  HRESULT getPlaceholderInfo(const PRJ_CALLBACK_DATA* callbackData);
+  HRESULT getFileData(
+      const PRJ_CALLBACK_DATA* callbackData,
+      uint64_t byteOffset,
+      uint32_t length);
+  HRESULT queryFileName(const PRJ_CALLBACK_DATA* callbackData);
+  HRESULT notify(
+      const PRJ_CALLBACK_DATA* callbackData,
+      PRJ_NOTIFICATION notification,
+      PCWSTR destinationFileName);
+
+  /**
+   * Get the Tree of the directory at path, which is relative to the root.
+   * Fails with ERROR_PATH_NOT_FOUND if it does not exist in the commit.
+   */
+  folly::Future<std::shared_ptr<const eden::Tree>> getTree(
+      eden::RelativePathPiece path) const;
+
+  /**
+   * Get the entry for path.  Fails with ERROR_FILE_NOT_FOUND if it does not
+   * exist in the commit.
+   */
+  folly::Future<eden::TreeEntry> lookup(eden::RelativePathPiece path) const;
+
+  /**
+   * Get the size of a file, fetching its metadata if the Tree does not
+   * record it.
+   */
+  folly::Future<uint64_t> getFileSize(const eden::TreeEntry& entry) const;
+
+  /**
+   * Prefetch the files after path in its directory if the file before it was
+   * the last one read there.
+   */
+  void prefetchSiblingBlobs(eden::RelativePathPiece path);
+
+  PRJ_FILE_BASIC_INFO makeBasicInfo(bool isDirectory, uint64_t size) const;
+
+  const std::wstring rootPath_;
+  eden::ObjectStore* const objectStore_;
+  eden::Journal* const journal_;
+  folly::Executor* const executor_;
+  const eden::Hash commitID_;
+  // Used as the timestamps of every placeholder.
+  LARGE_INTEGER startTime_{};
+
+  std::shared_ptr<const eden::Tree> rootTree_;
+  PRJ_NAMESPACE_VIRTUALIZATION_CONTEXT context_{nullptr};
+
+  folly::Synchronized<
+      std::unordered_map<GUID, std::shared_ptr<Enumeration>, GuidHash>>
+      enumerations_;
+
+  // The last file read in each directory, for prefetchSiblingBlobs().
+  folly::Synchronized<
+      std::unordered_map<eden::RelativePath, eden::PathComponent>>
+      lastFileRead_;
+};
+
+} // namespace edenwin
+} // namespace facebook
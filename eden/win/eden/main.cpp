@@ -16,6 +16,7 @@
 #include <gflags/gflags.h>
 #include <prjlayer.h>
 #include <memory>
+#include "ProjfsProvider.h"
 #include "StringConv.h"
 #include "eden/fs/model/Hash.h"
 #include "eden/fs/model/Tree.h"
@@ -52,6 +53,7 @@ void debugSetLogLevel(std::string category, std::string level) {
 ///////////////////////////////////////
 // The following is temp code to test. This would go away.
 
+#include "eden/fs/journal/Journal.h"
 #include "eden/fs/service/EdenCPUThreadPool.h"
 #include "eden/fs/store/BackingStore.h"
 #include "eden/fs/store/EmptyBackingStore.h"
@@ -79,6 +81,8 @@ AbsolutePath configPath_;
 
 shared_ptr<BackingStore> backingStore_;
 unique_ptr<ObjectStore> objectStore_;
+unique_ptr<Journal> journal_;
+unique_ptr<ProjfsProvider> provider_;
 
 shared_ptr<BackingStore> createBackingStore(
     StringPiece type,
@@ -119,20 +123,21 @@ void StartBackingStore() {
   backingStore_ = createBackingStore("hg", "c:\\open\\fbsource");
 
   objectStore_ = std::make_unique<ObjectStore>(localStore_, backingStore_);
+  journal_ = std::make_unique<Journal>();
+}
 
+void StartFS(const wstring& rootPath) {
   // facebook::eden::Hash commitID("777362dde8e5");
   // facebook::eden::Hash commitID("777362dde8e574bda92c42816b7df0de0e8aba39");
   facebook::eden::Hash commitID("67f1923706e05421e823effbb51e41770486a5e0");
   // facebook::eden::Hash commitID("240625dabfa3b0b442e4939147de860d5a916459");
-  Future<unique_ptr<const Tree>> futTree =
-      backingStore_->getTreeForCommit(commitID);
-
-  unique_ptr<const Tree> tree = futTree.get();
-  cout << "TREE ENTRIES";
-
-  for (const auto& entry : tree->getTreeEntries()) {
-    cout << entry.getName() << endl;
-  }
+  provider_ = std::make_unique<ProjfsProvider>(
+      rootPath,
+      objectStore_.get(),
+      journal_.get(),
+      threadPool_.get(),
+      commitID);
+  provider_->start();
 }
 /////////////////////////////////
 
@@ -151,7 +156,11 @@ int __cdecl main(int argc, char** argv) {
              << StringConv::wstringToString(rootPath);
 
   StartBackingStore();
-  // StartFS(rootPath);
+  StartFS(rootPath);
+
+  cout << "Press Enter to unmount" << endl;
+  getchar();
+  provider_.reset();
 
   return 0;
 };